@@ -98,6 +98,131 @@ public class CommonConfigurationKeys extends CommonConfigurationKeysPublic {
   public static final int IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_DEFAULT =
       256 * 1024;
 
+  /**
+   * Whether each lz4 buffer is compressed independently. Turning this off
+   * improves the ratio on small records; readers must use the same setting.
+   */
+  public static final String IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_KEY =
+      "io.compression.codec.lz4.block.independent";
+
+  /** Default value for IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_KEY */
+  public static final boolean IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_DEFAULT =
+      true;
+
+  /**
+   * Use the lz4hc high compression mode, which compresses several times more
+   * slowly but is read back by the same decompressor at the same speed.
+   */
+  public static final String IO_COMPRESSION_CODEC_LZ4_USELZ4HC_KEY =
+      "io.compression.codec.lz4.use.lz4hc";
+
+  /** Default value for IO_COMPRESSION_CODEC_LZ4_USELZ4HC_KEY */
+  public static final boolean IO_COMPRESSION_CODEC_LZ4_USELZ4HC_DEFAULT =
+      false;
+
+  /** Internal buffer size for zstd compressor/decompressors */
+  public static final String IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY =
+      "io.compression.codec.zstd.buffersize";
+
+  /** Default value for IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY */
+  public static final int IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_DEFAULT =
+      256 * 1024;
+
+  /** Compression level of the zstd compressor */
+  public static final String IO_COMPRESSION_CODEC_ZSTD_LEVEL_KEY =
+      "io.compression.codec.zstd.level";
+
+  /** Default value for IO_COMPRESSION_CODEC_ZSTD_LEVEL_KEY */
+  public static final int IO_COMPRESSION_CODEC_ZSTD_LEVEL_DEFAULT = 3;
+
+  /**
+   * Local path of a dictionary, as trained by <code>zstd --train</code>, to
+   * prime the zstd compressor/decompressors with. Readers must use the same
+   * dictionary as the writer.
+   */
+  public static final String IO_COMPRESSION_CODEC_ZSTD_DICTIONARY_KEY =
+      "io.compression.codec.zstd.dictionary";
+
+  /**
+   * Shared library to bind the native zlib codecs to instead of libz, such
+   * as a zlib-compatible shim for a hardware compression accelerator. It
+   * must export the zlib API. If it cannot be loaded, libz is used.
+   */
+  public static final String IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_KEY =
+      "io.compression.codec.zlib.accelerator.library";
+
+  /** Default value for IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_KEY */
+  public static final String
+      IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_DEFAULT = "";
+
+  /**
+   * Whether the native zlib codecs may compress and decompress a whole
+   * stream in one call with libdeflate, when a single call holds all of it.
+   * The streams are in the same formats, but not byte for byte the same as
+   * zlib's. Not used with a zlib accelerator library.
+   */
+  public static final String IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_KEY =
+      "io.compression.codec.zlib.libdeflate";
+
+  /** Default value for IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_KEY */
+  public static final boolean IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_DEFAULT =
+      true;
+
+  /**
+   * Which bzip2 implementation BZip2Codec uses: "system-native" for the
+   * libbz2 the native library was built against, "java-builtin" for the
+   * pure Java one, or the path of a libbz2 shared library to bind to.
+   */
+  public static final String IO_COMPRESSION_CODEC_BZIP2_LIBRARY_KEY =
+      "io.compression.codec.bzip2.library";
+
+  /** Default value for IO_COMPRESSION_CODEC_BZIP2_LIBRARY_KEY */
+  public static final String IO_COMPRESSION_CODEC_BZIP2_LIBRARY_DEFAULT =
+      "system-native";
+
+  /**
+   * Number of threads the native bzip2 decompressor spreads the blocks of
+   * a stream over. 1 decompresses on the calling thread.
+   */
+  public static final String IO_COMPRESSION_CODEC_BZIP2_DECOMPRESS_THREADS_KEY =
+      "io.compression.codec.bzip2.decompress.threads";
+
+  /** Default value for IO_COMPRESSION_CODEC_BZIP2_DECOMPRESS_THREADS_KEY */
+  public static final int IO_COMPRESSION_CODEC_BZIP2_DECOMPRESS_THREADS_DEFAULT =
+      1;
+
+  /**
+   * How long the native uid/gid to name cache, used by NativeIO.fstat and
+   * JniBasedUnixGroupsMapping, keeps a resolved name.
+   */
+  public static final String HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_KEY =
+      "hadoop.security.uid.cache.secs";
+
+  /** Default value for HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_KEY */
+  public static final long HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_DEFAULT =
+      4 * 60 * 60;
+
+  /** How long the same cache remembers that an id has no name. */
+  public static final String
+      HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_KEY =
+      "hadoop.security.uid.cache.negative.secs";
+
+  /** Default value for HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_KEY */
+  public static final long
+      HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_DEFAULT = 60;
+
+  /**
+   * Number of native threads JniBasedUnixGroupsMapping uses to resolve a
+   * batch of users. It drops to 1 when
+   * hadoop.workaround.non.threadsafe.getpwuid is set.
+   */
+  public static final String HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_KEY =
+      "hadoop.security.group.mapping.jni.batch.threads";
+
+  /** Default value for HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_KEY */
+  public static final int HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_DEFAULT =
+      8;
+
   /**
    * Service Authorization
    */
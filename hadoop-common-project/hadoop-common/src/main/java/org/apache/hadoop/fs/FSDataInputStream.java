@@ -28,7 +28,8 @@
 @InterfaceAudience.Public
 @InterfaceStability.Stable
 public class FSDataInputStream extends DataInputStream
-    implements Seekable, PositionedReadable, Closeable, ByteBufferReadable, HasFileDescriptor {
+    implements Seekable, PositionedReadable, Closeable, ByteBufferReadable,
+               ByteBufferPositionedReadable, HasFileDescriptor {
 
   public FSDataInputStream(InputStream in)
     throws IOException {
@@ -133,6 +134,16 @@ public int read(ByteBuffer buf) throws IOException {
     throw new UnsupportedOperationException("Byte-buffer read unsupported by input stream");
   }
 
+  @Override
+  public int read(long position, ByteBuffer buf) throws IOException {
+    if (in instanceof ByteBufferPositionedReadable) {
+      return ((ByteBufferPositionedReadable)in).read(position, buf);
+    }
+
+    throw new UnsupportedOperationException(
+        "Byte-buffer positioned read unsupported by input stream");
+  }
+
   @Override
   public FileDescriptor getFileDescriptor() throws IOException {
     if (in instanceof HasFileDescriptor) {
@@ -1753,6 +1753,40 @@ public LocatedFileStatus next() throws IOException {
     };
   }
 
+  /**
+   * List the statuses of the files/directories in the given path if the
+   * path is a directory, a batch at a time where the file system supports
+   * it, instead of all at once as {@link #listStatus(Path)} does.
+   *
+   * @param p is the path
+   *
+   * @return an iterator that traverses statuses of the files/directories
+   *         in the given path
+   *
+   * @throws FileNotFoundException If <code>p</code> does not exist
+   * @throws IOException If an I/O error occurred
+   */
+  public RemoteIterator<FileStatus> listStatusIterator(final Path p)
+  throws FileNotFoundException, IOException {
+    return new RemoteIterator<FileStatus>() {
+      private final FileStatus[] stats = listStatus(p);
+      private int i = 0;
+
+      @Override
+      public boolean hasNext() {
+        return i<stats.length;
+      }
+
+      @Override
+      public FileStatus next() throws IOException {
+        if (!hasNext()) {
+          throw new NoSuchElementException("No more entry in " + p);
+        }
+        return stats[i++];
+      }
+    };
+  }
+
   /**
    * List the statuses and block locations of the files in the given path.
    * 
@@ -2127,6 +2161,26 @@ public short getDefaultReplication(Path path) {
    */
   public abstract FileStatus getFileStatus(Path f) throws IOException;
 
+  /**
+   * Return file status objects for a list of paths, in the same order.
+   * Unlike {@link #getFileStatus(Path)}, a path that does not exist is not
+   * an error; its entry in the result is null.
+   * @param files the paths we want information from
+   * @return an array of FileStatus objects, one per path
+   * @throws IOException see specific implementation
+   */
+  public FileStatus[] getFileStatus(Path[] files) throws IOException {
+    FileStatus[] results = new FileStatus[files.length];
+    for (int i = 0; i < files.length; i++) {
+      try {
+        results[i] = getFileStatus(files[i]);
+      } catch (FileNotFoundException e) {
+        results[i] = null;
+      }
+    }
+    return results;
+  }
+
   /**
    * Get the checksum of a file.
    *
@@ -26,34 +26,69 @@
 
 import org.apache.hadoop.classification.InterfaceAudience;
 import org.apache.hadoop.classification.InterfaceStability;
+import org.apache.hadoop.conf.Configurable;
+import org.apache.hadoop.conf.Configuration;
 import org.apache.hadoop.fs.Seekable;
 import org.apache.hadoop.io.compress.bzip2.BZip2Constants;
 import org.apache.hadoop.io.compress.bzip2.BZip2DummyCompressor;
 import org.apache.hadoop.io.compress.bzip2.BZip2DummyDecompressor;
+import org.apache.hadoop.io.compress.bzip2.Bzip2Factory;
 import org.apache.hadoop.io.compress.bzip2.CBZip2InputStream;
 import org.apache.hadoop.io.compress.bzip2.CBZip2OutputStream;
 
 /**
  * This class provides CompressionOutputStream and CompressionInputStream for
- * compression and decompression. Currently we dont have an implementation of
- * the Compressor and Decompressor interfaces, so those methods of
- * CompressionCodec which have a Compressor or Decompressor type argument, throw
- * UnsupportedOperationException.
+ * compression and decompression. When native bzip2 is loaded and enabled by
+ * the configuration, see {@link Bzip2Factory}, streams are compressed and
+ * decompressed by libbz2 through a Compressor and Decompressor. Otherwise the
+ * pure Java implementation is used, and the Compressor and Decompressor
+ * handed out are dummies which throw UnsupportedOperationException. Split
+ * reading always uses the Java implementation.
  */
 @InterfaceAudience.Public
 @InterfaceStability.Evolving
-public class BZip2Codec implements SplittableCompressionCodec {
+public class BZip2Codec implements Configurable, SplittableCompressionCodec {
 
   private static final String HEADER = "BZ";
   private static final int HEADER_LEN = HEADER.length();
   private static final String SUB_HEADER = "h9";
   private static final int SUB_HEADER_LEN = SUB_HEADER.length();
 
+  private Configuration conf;
+
+  /**
+   * Set the configuration to be used by this object.
+   *
+   * @param conf the configuration object.
+   */
+  @Override
+  public void setConf(Configuration conf) {
+    this.conf = conf;
+  }
+
+  /**
+   * Return the configuration used by this object.
+   *
+   * @return the configuration object used by this object.
+   */
+  @Override
+  public Configuration getConf() {
+    return conf;
+  }
+
   /**
   * Creates a new instance of BZip2Codec
   */
   public BZip2Codec() { }
 
+  private boolean isNativeBzip2Loaded() {
+    return conf != null && Bzip2Factory.isNativeBzip2Loaded(conf);
+  }
+
+  private int getBufferSize() {
+    return conf.getInt("io.file.buffer.size", 4*1024);
+  }
+
   /**
   * Creates CompressionOutputStream for BZip2
   *
@@ -66,7 +101,9 @@ public BZip2Codec() { }
   @Override
   public CompressionOutputStream createOutputStream(OutputStream out)
       throws IOException {
-    return new BZip2CompressionOutputStream(out);
+    return isNativeBzip2Loaded() ?
+        new CompressorStream(out, createCompressor(), getBufferSize()) :
+        new BZip2CompressionOutputStream(out);
   }
 
   /**
@@ -78,27 +115,31 @@ public CompressionOutputStream createOutputStream(OutputStream out)
   @Override
   public CompressionOutputStream createOutputStream(OutputStream out,
       Compressor compressor) throws IOException {
-    return createOutputStream(out);
+    return isNativeBzip2Loaded() ?
+        new CompressorStream(out, compressor, getBufferSize()) :
+        new BZip2CompressionOutputStream(out);
   }
 
   /**
-  * This functionality is currently not supported.
+  * Returns the type of the native compressor if native bzip2 is in use.
   *
-  * @return BZip2DummyCompressor.class
+  * @return Bzip2Compressor.class, or BZip2DummyCompressor.class
   */
   @Override
   public Class<? extends org.apache.hadoop.io.compress.Compressor> getCompressorType() {
-    return BZip2DummyCompressor.class;
+    return isNativeBzip2Loaded() ?
+        Bzip2Factory.getBzip2CompressorType(conf) : BZip2DummyCompressor.class;
   }
 
   /**
-  * This functionality is currently not supported.
+  * Creates a native compressor if native bzip2 is in use.
   *
   * @return Compressor
   */
   @Override
   public Compressor createCompressor() {
-    return new BZip2DummyCompressor();
+    return isNativeBzip2Loaded() ?
+        Bzip2Factory.getBzip2Compressor(conf) : new BZip2DummyCompressor();
   }
 
   /**
@@ -113,18 +154,23 @@ public Compressor createCompressor() {
   @Override
   public CompressionInputStream createInputStream(InputStream in)
       throws IOException {
-    return new BZip2CompressionInputStream(in);
+    return isNativeBzip2Loaded() ?
+        new DecompressorStream(in, createDecompressor(), getBufferSize()) :
+        new BZip2CompressionInputStream(in);
   }
 
   /**
-  * This functionality is currently not supported.
+  * Creates CompressionInputStream to be used to read off uncompressed data,
+  * with the given decompressor if native bzip2 is in use.
   *
   * @return CompressionInputStream
   */
   @Override
   public CompressionInputStream createInputStream(InputStream in,
       Decompressor decompressor) throws IOException {
-    return createInputStream(in);
+    return isNativeBzip2Loaded() ?
+        new DecompressorStream(in, decompressor, getBufferSize()) :
+        new BZip2CompressionInputStream(in);
   }
 
   /**
@@ -184,23 +230,26 @@ public SplitCompressionInputStream createInputStream(InputStream seekableIn,
   }
 
   /**
-  * This functionality is currently not supported.
+  * Returns the type of the native decompressor if native bzip2 is in use.
   *
-  * @return BZip2DummyDecompressor.class
+  * @return Bzip2Decompressor.class, or BZip2DummyDecompressor.class
   */
   @Override
   public Class<? extends org.apache.hadoop.io.compress.Decompressor> getDecompressorType() {
-    return BZip2DummyDecompressor.class;
+    return isNativeBzip2Loaded() ?
+        Bzip2Factory.getBzip2DecompressorType(conf) :
+        BZip2DummyDecompressor.class;
   }
 
   /**
-  * This functionality is currently not supported.
+  * Creates a native decompressor if native bzip2 is in use.
   *
   * @return Decompressor
   */
   @Override
   public Decompressor createDecompressor() {
-    return new BZip2DummyDecompressor();
+    return isNativeBzip2Loaded() ?
+        Bzip2Factory.getBzip2Decompressor(conf) : new BZip2DummyDecompressor();
   }
 
   /**
@@ -175,7 +175,8 @@ public GzipZlibCompressor(Configuration conf) {
       super(ZlibFactory.getCompressionLevel(conf),
            ZlibFactory.getCompressionStrategy(conf),
            ZlibCompressor.CompressionHeader.GZIP_FORMAT,
-           64 * 1024);
+           64 * 1024,
+           ZlibFactory.getCompressionThreads(conf));
     }
   }
 
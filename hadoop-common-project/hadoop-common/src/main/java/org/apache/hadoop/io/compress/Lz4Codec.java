@@ -136,7 +136,13 @@ public Compressor createCompressor() {
     int bufferSize = conf.getInt(
         CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_KEY,
         CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_DEFAULT);
-    return new Lz4Compressor(bufferSize);
+    boolean blockIndependent = conf.getBoolean(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_DEFAULT);
+    boolean useLz4HC = conf.getBoolean(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_USELZ4HC_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_USELZ4HC_DEFAULT);
+    return new Lz4Compressor(bufferSize, blockIndependent, useLz4HC);
   }
 
   /**
@@ -202,7 +208,10 @@ public Decompressor createDecompressor() {
     int bufferSize = conf.getInt(
         CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_KEY,
         CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_DEFAULT);
-    return new Lz4Decompressor(bufferSize);
+    boolean blockIndependent = conf.getBoolean(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_DEFAULT);
+    return new Lz4Decompressor(bufferSize, blockIndependent);
   }
 
   /**
@@ -0,0 +1,270 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package org.apache.hadoop.io.compress;
+
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+
+import org.apache.hadoop.conf.Configurable;
+import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.io.IOUtils;
+import org.apache.hadoop.io.compress.zstd.ZStandardCompressor;
+import org.apache.hadoop.io.compress.zstd.ZStandardDecompressor;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
+import org.apache.hadoop.util.NativeCodeLoader;
+
+/**
+ * This class creates zstd compressors/decompressors.
+ */
+public class ZStandardCodec implements Configurable, CompressionCodec {
+  Configuration conf;
+  private byte[] dictionary;
+  private String dictionaryPath;
+
+  /**
+   * Set the configuration to be used by this object.
+   *
+   * @param conf the configuration object.
+   */
+  @Override
+  public void setConf(Configuration conf) {
+    this.conf = conf;
+  }
+
+  /**
+   * Return the configuration used by this object.
+   *
+   * @return the configuration object used by this objec.
+   */
+  @Override
+  public Configuration getConf() {
+    return conf;
+  }
+
+  /**
+   * Are the native zstd libraries loaded & initialized?
+   */
+  public static void checkNativeCodeLoaded() {
+      if (!NativeCodeLoader.buildSupportsZstd()) {
+        throw new RuntimeException("native zstd library not available: " +
+            "this version of libhadoop was built without " +
+            "zstd support.");
+      }
+      if (!ZStandardCompressor.isNativeCodeLoaded()) {
+        throw new RuntimeException("native zstd library not available: " +
+            "ZStandardCompressor has not been loaded.");
+      }
+      if (!ZStandardDecompressor.isNativeCodeLoaded()) {
+        throw new RuntimeException("native zstd library not available: " +
+            "ZStandardDecompressor has not been loaded.");
+      }
+  }
+  
+  public static boolean isNativeCodeLoaded() {
+    return ZStandardCompressor.isNativeCodeLoaded() && 
+        ZStandardDecompressor.isNativeCodeLoaded();
+  }
+
+  /**
+   * Create a {@link CompressionOutputStream} that will write to the given
+   * {@link OutputStream}.
+   *
+   * @param out the location for the final output stream
+   * @return a stream the user can write uncompressed data to have it compressed
+   * @throws IOException
+   */
+  @Override
+  public CompressionOutputStream createOutputStream(OutputStream out)
+      throws IOException {
+    return createOutputStream(out, createCompressor());
+  }
+
+  /**
+   * Create a {@link CompressionOutputStream} that will write to the given
+   * {@link OutputStream} with the given {@link Compressor}.
+   *
+   * @param out        the location for the final output stream
+   * @param compressor compressor to use
+   * @return a stream the user can write uncompressed data to have it compressed
+   * @throws IOException
+   */
+  @Override
+  public CompressionOutputStream createOutputStream(OutputStream out,
+                                                    Compressor compressor)
+      throws IOException {
+    checkNativeCodeLoaded();
+    int bufferSize = conf.getInt(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_DEFAULT);
+
+    // zstd never expands a block by more than its frame header plus a few
+    // bytes per 128KB of input.
+    int compressionOverhead = (bufferSize / 128) + 64;
+
+    return new BlockCompressorStream(out, compressor, bufferSize,
+        compressionOverhead);
+  }
+
+  /**
+   * Get the type of {@link Compressor} needed by this {@link CompressionCodec}.
+   *
+   * @return the type of compressor needed by this codec.
+   */
+  @Override
+  public Class<? extends Compressor> getCompressorType() {
+    checkNativeCodeLoaded();
+    return ZStandardCompressor.class;
+  }
+
+  /**
+   * Create a new {@link Compressor} for use by this {@link CompressionCodec}.
+   *
+   * @return a new compressor for use by this codec
+   */
+  @Override
+  public Compressor createCompressor() {
+    checkNativeCodeLoaded();
+    int bufferSize = conf.getInt(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_DEFAULT);
+    int level = conf.getInt(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_LEVEL_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_LEVEL_DEFAULT);
+    Compressor compressor = new ZStandardCompressor(bufferSize, level);
+    byte[] dict = getDictionary();
+    if (dict != null) {
+      compressor.setDictionary(dict, 0, dict.length);
+    }
+    return compressor;
+  }
+
+  /**
+   * Create a {@link CompressionInputStream} that will read from the given
+   * input stream.
+   *
+   * @param in the stream to read compressed bytes from
+   * @return a stream to read uncompressed bytes from
+   * @throws IOException
+   */
+  @Override
+  public CompressionInputStream createInputStream(InputStream in)
+      throws IOException {
+    return createInputStream(in, createDecompressor());
+  }
+
+  /**
+   * Create a {@link CompressionInputStream} that will read from the given
+   * {@link InputStream} with the given {@link Decompressor}.
+   *
+   * @param in           the stream to read compressed bytes from
+   * @param decompressor decompressor to use
+   * @return a stream to read uncompressed bytes from
+   * @throws IOException
+   */
+  @Override
+  public CompressionInputStream createInputStream(InputStream in,
+                                                  Decompressor decompressor)
+      throws IOException {
+    checkNativeCodeLoaded();
+    return new BlockDecompressorStream(in, decompressor, conf.getInt(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_DEFAULT));
+  }
+
+  /**
+   * Get the type of {@link Decompressor} needed by this {@link CompressionCodec}.
+   *
+   * @return the type of decompressor needed by this codec.
+   */
+  @Override
+  public Class<? extends Decompressor> getDecompressorType() {
+    checkNativeCodeLoaded();
+    return ZStandardDecompressor.class;
+  }
+
+  /**
+   * Create a new {@link Decompressor} for use by this {@link CompressionCodec}.
+   *
+   * @return a new decompressor for use by this codec
+   */
+  @Override
+  public Decompressor createDecompressor() {
+    checkNativeCodeLoaded();
+    int bufferSize = conf.getInt(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_KEY,
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_BUFFERSIZE_DEFAULT);
+    Decompressor decompressor = new ZStandardDecompressor(bufferSize);
+    byte[] dict = getDictionary();
+    if (dict != null) {
+      decompressor.setDictionary(dict, 0, dict.length);
+    }
+    return decompressor;
+  }
+
+  /**
+   * Load the dictionary named by
+   * {@link CommonConfigurationKeys#IO_COMPRESSION_CODEC_ZSTD_DICTIONARY_KEY}
+   * from the local filesystem. The file is read again only if the configured
+   * path changes.
+   *
+   * @return the dictionary bytes, or null if no dictionary is configured
+   */
+  private synchronized byte[] getDictionary() {
+    String path = conf.get(
+        CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_DICTIONARY_KEY);
+    if (path == null || path.isEmpty()) {
+      return null;
+    }
+    if (path.equals(dictionaryPath)) {
+      return dictionary;
+    }
+    File file = new File(path);
+    long length = file.length();
+    if (length <= 0 || length > Integer.MAX_VALUE) {
+      throw new RuntimeException("invalid zstd dictionary " + path +
+          " of length " + length);
+    }
+    byte[] dict = new byte[(int) length];
+    FileInputStream in = null;
+    try {
+      in = new FileInputStream(file);
+      IOUtils.readFully(in, dict, 0, dict.length);
+    } catch (IOException e) {
+      throw new RuntimeException("failed to read zstd dictionary " + path, e);
+    } finally {
+      IOUtils.closeStream(in);
+    }
+    dictionary = dict;
+    dictionaryPath = path;
+    return dictionary;
+  }
+
+  /**
+   * Get the default filename extension for this kind of compression.
+   *
+   * @return <code>.zst</code>.
+   */
+  @Override
+  public String getDefaultExtension() {
+    return ".zst";
+  }
+}
@@ -0,0 +1,308 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package org.apache.hadoop.io.compress.bzip2;
+
+import java.io.IOException;
+import java.nio.Buffer;
+import java.nio.ByteBuffer;
+
+import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.io.compress.Decompressor;
+import org.apache.hadoop.util.NativeCodeLoader;
+
+/**
+ * A {@link Decompressor} based on the native libbz2 library.
+ *
+ * With more than one thread, the blocks of each stream are found by
+ * scanning for their markers and decompressed concurrently; the output is
+ * the same as with one.
+ */
+public class Bzip2Decompressor implements Decompressor {
+  private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64*1024;
+
+  // Layout of the value returned by decompressDirect
+  private static final int DECOMPRESS_COUNT_BITS = 30;
+  private static final long DECOMPRESS_COUNT_MASK =
+      (1L << DECOMPRESS_COUNT_BITS) - 1;
+  private static final long DECOMPRESS_STREAM_END = 1L << 60;
+
+  private long stream;
+  private int directBufferSize;
+  private Buffer compressedDirectBuf = null;
+  private int compressedDirectBufOff, compressedDirectBufLen;
+  private Buffer uncompressedDirectBuf = null;
+  private byte[] userBuf = null;
+  private int userBufOff = 0, userBufLen = 0;
+  private boolean finished;
+
+  private static boolean nativeBzip2Loaded = false;
+
+  static {
+    if (NativeCodeLoader.isNativeCodeLoaded() &&
+        NativeCodeLoader.buildSupportsBzip2()) {
+      try {
+        // Initialize the native library
+        initIDs(Bzip2Factory.getLibraryName(new Configuration()));
+        nativeBzip2Loaded = true;
+      } catch (Throwable t) {
+        // Ignore failure to load/initialize native-bzip2
+      }
+    }
+  }
+
+  static boolean isNativeBzip2Loaded() {
+    return nativeBzip2Loaded;
+  }
+
+  /**
+   * Creates a new decompressor.
+   *
+   * @param threads Number of threads to decompress the blocks of a stream
+   *                with; 1 decompresses on the calling thread.
+   * @param directBufferSize Size of the direct buffer to be used.
+   */
+  public Bzip2Decompressor(int threads, int directBufferSize) {
+    this.directBufferSize = directBufferSize;
+    compressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
+    uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
+    uncompressedDirectBuf.position(directBufferSize);
+
+    stream = init(threads);
+  }
+
+  /**
+   * Creates a new decompressor, taking settings from the configuration.
+   */
+  public Bzip2Decompressor(Configuration conf) {
+    this(Bzip2Factory.getDecompressionThreads(conf),
+         DEFAULT_DIRECT_BUFFER_SIZE);
+  }
+
+  public Bzip2Decompressor() {
+    this(1, DEFAULT_DIRECT_BUFFER_SIZE);
+  }
+
+  @Override
+  public synchronized void setInput(byte[] b, int off, int len) {
+    if (b == null) {
+      throw new NullPointerException();
+    }
+    if (off < 0 || len < 0 || off > b.length - len) {
+      throw new ArrayIndexOutOfBoundsException();
+    }
+
+    this.userBuf = b;
+    this.userBufOff = off;
+    this.userBufLen = len;
+
+    setInputFromSavedData();
+
+    // Reinitialize bzip2's output direct buffer
+    uncompressedDirectBuf.limit(directBufferSize);
+    uncompressedDirectBuf.position(directBufferSize);
+  }
+
+  synchronized void setInputFromSavedData() {
+    compressedDirectBufOff = 0;
+    compressedDirectBufLen = userBufLen;
+    if (compressedDirectBufLen > directBufferSize) {
+      compressedDirectBufLen = directBufferSize;
+    }
+
+    // Reinitialize bzip2's input direct buffer
+    compressedDirectBuf.rewind();
+    ((ByteBuffer)compressedDirectBuf).put(userBuf, userBufOff,
+                                          compressedDirectBufLen);
+
+    // Note how much data is being fed to bzip2
+    userBufOff += compressedDirectBufLen;
+    userBufLen -= compressedDirectBufLen;
+  }
+
+  @Override
+  public synchronized void setDictionary(byte[] b, int off, int len) {
+    throw new UnsupportedOperationException(
+        "bzip2 does not support dictionaries");
+  }
+
+  @Override
+  public synchronized boolean needsInput() {
+    // Consume remaining compressed data?
+    if (uncompressedDirectBuf.remaining() > 0) {
+      return false;
+    }
+
+    // Check if bzip2 has consumed all input
+    if (compressedDirectBufLen <= 0) {
+      // Check if we have consumed all user-input
+      if (userBufLen <= 0) {
+        return true;
+      } else {
+        setInputFromSavedData();
+      }
+    }
+
+    return false;
+  }
+
+  @Override
+  public synchronized boolean needsDictionary() {
+    return false;
+  }
+
+  @Override
+  public synchronized boolean finished() {
+    // Check if bzip2 says it's 'finished' and
+    // all compressed data has been consumed
+    return (finished && uncompressedDirectBuf.remaining() == 0);
+  }
+
+  @Override
+  public synchronized int decompress(byte[] b, int off, int len)
+    throws IOException {
+    if (b == null) {
+      throw new NullPointerException();
+    }
+    if (off < 0 || len < 0 || off > b.length - len) {
+      throw new ArrayIndexOutOfBoundsException();
+    }
+
+    int n = 0;
+
+    // Check if there is uncompressed data
+    n = uncompressedDirectBuf.remaining();
+    if (n > 0) {
+      n = Math.min(n, len);
+      ((ByteBuffer)uncompressedDirectBuf).get(b, off, n);
+      return n;
+    }
+    if (finished) {
+      return 0;
+    }
+
+    // Re-initialize the bzip2's output direct buffer
+    uncompressedDirectBuf.rewind();
+    uncompressedDirectBuf.limit(directBufferSize);
+
+    // Decompress data, refilling bzip2's input from the user buffer until
+    // the output buffer is full or the stream ends
+    n = 0;
+    while (true) {
+      long result = decompressDirect(stream,
+          compressedDirectBuf, compressedDirectBufOff, compressedDirectBufLen,
+          uncompressedDirectBuf, n, directBufferSize - n);
+      int consumed =
+          (int)((result >>> DECOMPRESS_COUNT_BITS) & DECOMPRESS_COUNT_MASK);
+      compressedDirectBufOff += consumed;
+      compressedDirectBufLen -= consumed;
+      n += (int)(result & DECOMPRESS_COUNT_MASK);
+      if ((result & DECOMPRESS_STREAM_END) != 0) {
+        finished = true;
+        break;
+      }
+      if (n == directBufferSize || compressedDirectBufLen > 0 ||
+          userBufLen <= 0) {
+        break;
+      }
+      setInputFromSavedData();
+    }
+    uncompressedDirectBuf.limit(n);
+
+    // Get at most 'len' bytes
+    n = Math.min(n, len);
+    ((ByteBuffer)uncompressedDirectBuf).get(b, off, n);
+
+    return n;
+  }
+
+  /**
+   * Returns the total number of uncompressed bytes output so far.
+   *
+   * @return the total (non-negative) number of uncompressed bytes output so far
+   */
+  public synchronized long getBytesWritten() {
+    checkStream();
+    return getBytesWritten(stream);
+  }
+
+  /**
+   * Returns the total number of compressed bytes input so far.</p>
+   *
+   * @return the total (non-negative) number of compressed bytes input so far
+   */
+  public synchronized long getBytesRead() {
+    checkStream();
+    return getBytesRead(stream);
+  }
+
+  /**
+   * Returns the number of bytes remaining in the input buffers; normally
+   * called when finished() is true to determine amount of data after the
+   * bzip2 stream, such as the next stream of a concatenated file.</p>
+   *
+   * @return the total (non-negative) number of unprocessed bytes in input
+   */
+  @Override
+  public synchronized int getRemaining() {
+    checkStream();
+    return userBufLen + compressedDirectBufLen;
+  }
+
+  /**
+   * Resets everything including the input buffers (user and direct).</p>
+   */
+  @Override
+  public synchronized void reset() {
+    checkStream();
+    reset(stream);
+    finished = false;
+    compressedDirectBufOff = compressedDirectBufLen = 0;
+    uncompressedDirectBuf.limit(directBufferSize);
+    uncompressedDirectBuf.position(directBufferSize);
+    userBufOff = userBufLen = 0;
+  }
+
+  @Override
+  public synchronized void end() {
+    if (stream != 0) {
+      end(stream);
+      stream = 0;
+    }
+  }
+
+  @Override
+  protected void finalize() {
+    end();
+  }
+
+  private void checkStream() {
+    if (stream == 0)
+      throw new NullPointerException();
+  }
+
+  private native static void initIDs(String libname);
+  private native static long init(int threads);
+  private native static long decompressDirect(long strm,
+      Buffer compressedBuf, int compressedOff, int compressedLen,
+      Buffer uncompressedBuf, int uncompressedOff, int uncompressedLen);
+  private native static long getBytesRead(long strm);
+  private native static long getBytesWritten(long strm);
+  private native static void reset(long strm);
+  private native static void end(long strm);
+}
@@ -37,10 +37,6 @@ public class Lz4Compressor implements Compressor {
       LogFactory.getLog(Lz4Compressor.class.getName());
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64 * 1024;
 
-  // HACK - Use this as a global lock in the JNI layer
-  @SuppressWarnings({"unchecked", "unused"})
-  private static Class clazz = Lz4Compressor.class;
-
   private int directBufferSize;
   private Buffer compressedDirectBuf = null;
   private int uncompressedDirectBufLen;
@@ -52,6 +48,15 @@ public class Lz4Compressor implements Compressor {
   private long bytesRead = 0L;
   private long bytesWritten = 0L;
 
+  // Native LZ4 stream state, or 0 if every buffer is compressed on its own
+  private long stream = 0L;
+
+  // Native hash table, or LZ4HC match finder, reused by every
+  // independently compressed buffer
+  private long ctx = 0L;
+
+  private final boolean useLz4HC;
+
 
   static {
     if (NativeCodeLoader.isNativeCodeLoaded()) {
@@ -72,13 +77,50 @@ public class Lz4Compressor implements Compressor {
    * Creates a new compressor.
    *
    * @param directBufferSize size of the direct buffer to be used.
+   * @param blockIndependent if false, each compressed buffer may refer back to
+   *                         the last 64KB of the buffers compressed before it
+   *                         since the last {@link #reset()}. Such output can
+   *                         only be read by an {@link Lz4Decompressor} that
+   *                         is also not block independent.
+   * @param useLz4HC use the slower high compression mode. Its output is read
+   *                 by the same {@link Lz4Decompressor}. Buffers compressed
+   *                 this way are always block independent.
    */
-  public Lz4Compressor(int directBufferSize) {
+  public Lz4Compressor(int directBufferSize, boolean blockIndependent,
+      boolean useLz4HC) {
     this.directBufferSize = directBufferSize;
+    this.useLz4HC = useLz4HC;
 
     uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
     compressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
     compressedDirectBuf.position(directBufferSize);
+    if (useLz4HC) {
+      ctx = initHCCtx();
+    } else if (blockIndependent) {
+      ctx = initCtx();
+    } else {
+      stream = initStream(directBufferSize);
+    }
+  }
+
+  /**
+   * Creates a new compressor using the fast compression mode.
+   *
+   * @param directBufferSize size of the direct buffer to be used.
+   * @param blockIndependent if false, each compressed buffer may refer back to
+   *                         the buffers compressed before it.
+   */
+  public Lz4Compressor(int directBufferSize, boolean blockIndependent) {
+    this(directBufferSize, blockIndependent, false);
+  }
+
+  /**
+   * Creates a new compressor whose buffers are compressed independently.
+   *
+   * @param directBufferSize size of the direct buffer to be used.
+   */
+  public Lz4Compressor(int directBufferSize) {
+    this(directBufferSize, true);
   }
 
   /**
@@ -227,7 +269,7 @@ public synchronized int compress(byte[] b, int off, int len)
     }
 
     // Compress data
-    n = compressBytesDirect();
+    n = useLz4HC ? compressBytesDirectHC() : compressBytesDirect();
     compressedDirectBuf.limit(n);
     uncompressedDirectBuf.clear(); // lz4 consumes all buffer input
 
@@ -257,6 +299,9 @@ public synchronized void reset() {
     compressedDirectBuf.limit(0);
     userBufOff = userBufLen = 0;
     bytesRead = bytesWritten = 0L;
+    if (stream != 0) {
+      resetStream(stream);
+    }
   }
 
   /**
@@ -291,9 +336,37 @@ public synchronized long getBytesWritten() {
    */
   @Override
   public synchronized void end() {
+    if (stream != 0) {
+      freeStream(stream);
+      stream = 0;
+    }
+    if (ctx != 0) {
+      if (useLz4HC) {
+        freeHCCtx(ctx);
+      } else {
+        freeCtx(ctx);
+      }
+      ctx = 0;
+    }
   }
 
   private native static void initIDs();
 
   private native int compressBytesDirect();
+
+  private native int compressBytesDirectHC();
+
+  private native static long initStream(int maxBlockSize);
+
+  private native static void resetStream(long stream);
+
+  private native static void freeStream(long stream);
+
+  private native static long initCtx();
+
+  private native static void freeCtx(long ctx);
+
+  private native static long initHCCtx();
+
+  private native static void freeHCCtx(long ctx);
 }
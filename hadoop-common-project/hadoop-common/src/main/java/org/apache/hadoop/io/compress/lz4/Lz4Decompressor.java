@@ -36,10 +36,6 @@ public class Lz4Decompressor implements Decompressor {
       LogFactory.getLog(Lz4Compressor.class.getName());
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64 * 1024;
 
-  // HACK - Use this as a global lock in the JNI layer
-  @SuppressWarnings({"unchecked", "unused"})
-  private static Class clazz = Lz4Decompressor.class;
-
   private int directBufferSize;
   private Buffer compressedDirectBuf = null;
   private int compressedDirectBufLen;
@@ -48,6 +44,9 @@ public class Lz4Decompressor implements Decompressor {
   private int userBufOff = 0, userBufLen = 0;
   private boolean finished;
 
+  // Native LZ4 stream state, or 0 if every buffer is decompressed on its own
+  private long stream = 0L;
+
   static {
     if (NativeCodeLoader.isNativeCodeLoaded()) {
       // Initialize the native library
@@ -64,17 +63,33 @@ public class Lz4Decompressor implements Decompressor {
   }
 
   /**
-   * Creates a new compressor.
+   * Creates a new decompressor.
    *
    * @param directBufferSize size of the direct buffer to be used.
+   * @param blockIndependent if false, each compressed buffer may refer back to
+   *                         the last 64KB of the buffers decompressed before
+   *                         it since the last {@link #reset()}, as written by
+   *                         an {@link Lz4Compressor} that is also not block
+   *                         independent.
    */
-  public Lz4Decompressor(int directBufferSize) {
+  public Lz4Decompressor(int directBufferSize, boolean blockIndependent) {
     this.directBufferSize = directBufferSize;
 
     compressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
     uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
     uncompressedDirectBuf.position(directBufferSize);
+    if (!blockIndependent) {
+      stream = initStream(directBufferSize);
+    }
+  }
 
+  /**
+   * Creates a new decompressor whose buffers are decompressed independently.
+   *
+   * @param directBufferSize size of the direct buffer to be used.
+   */
+  public Lz4Decompressor(int directBufferSize) {
+    this(directBufferSize, true);
   }
 
   /**
@@ -247,6 +262,33 @@ public synchronized int decompress(byte[] b, int off, int len)
     return n;
   }
 
+  /**
+   * Decompresses one whole lz4 block straight from one direct buffer into
+   * another, bypassing this decompressor's own buffers and the copy out of
+   * them. The block is the remaining bytes of <code>src</code>, which are
+   * all consumed; the position of <code>dst</code> is advanced past the
+   * uncompressed data.
+   * In streaming mode blocks may refer back to earlier ones, so they must
+   * be passed in the order they were written, whichever of the two
+   * decompress methods is used.
+   *
+   * @param src direct buffer holding one compressed block
+   * @param dst direct buffer to receive the uncompressed block
+   * @return the number of uncompressed bytes written to <code>dst</code>
+   * @throws IOException
+   */
+  public synchronized int decompress(ByteBuffer src, ByteBuffer dst)
+      throws IOException {
+    if (!src.isDirect() || !dst.isDirect()) {
+      throw new IllegalArgumentException("Buffers must be direct");
+    }
+    int n = decompressDirectBuf(src, src.position(), src.remaining(),
+        dst, dst.position(), dst.remaining());
+    src.position(src.limit());
+    dst.position(dst.position() + n);
+    return n;
+  }
+
   /**
    * Returns <code>0</code>.
    *
@@ -265,6 +307,9 @@ public synchronized void reset() {
     uncompressedDirectBuf.limit(directBufferSize);
     uncompressedDirectBuf.position(directBufferSize);
     userBufOff = userBufLen = 0;
+    if (stream != 0) {
+      resetStream(stream);
+    }
   }
 
   /**
@@ -273,10 +318,22 @@ public synchronized void reset() {
    */
   @Override
   public synchronized void end() {
-    // do nothing
+    if (stream != 0) {
+      freeStream(stream);
+      stream = 0;
+    }
   }
 
   private native static void initIDs();
 
   private native int decompressBytesDirect();
+
+  private native int decompressDirectBuf(ByteBuffer src, int srcOff,
+      int srcLen, ByteBuffer dst, int dstOff, int dstLen);
+
+  private native static long initStream(int maxBlockSize);
+
+  private native static void resetStream(long stream);
+
+  private native static void freeStream(long stream);
 }
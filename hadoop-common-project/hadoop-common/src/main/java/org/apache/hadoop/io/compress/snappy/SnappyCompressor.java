@@ -36,10 +36,7 @@ public class SnappyCompressor implements Compressor {
   private static final Log LOG =
       LogFactory.getLog(SnappyCompressor.class.getName());
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64 * 1024;
-
-  // HACK - Use this as a global lock in the JNI layer
-  @SuppressWarnings({"unchecked", "unused"})
-  private static Class clazz = SnappyCompressor.class;
+  static final int SNAPPY_MAX_CHUNK_UNCOMPRESSED = 64 * 1024;
 
   private int directBufferSize;
   private Buffer compressedDirectBuf = null;
@@ -48,6 +45,8 @@ public class SnappyCompressor implements Compressor {
   private byte[] userBuf = null;
   private int userBufOff = 0, userBufLen = 0;
   private boolean finish, finished;
+  private final boolean framed;
+  private boolean streamStarted;
 
   private long bytesRead = 0L;
   private long bytesWritten = 0L;
@@ -76,11 +75,37 @@ public static boolean isNativeCodeLoaded() {
    * @param directBufferSize size of the direct buffer to be used.
    */
   public SnappyCompressor(int directBufferSize) {
+    this(directBufferSize, false);
+  }
+
+  /**
+   * Creates a new compressor.
+   *
+   * @param directBufferSize size of the direct buffer to be used.
+   * @param framed whether to write the snappy framing format, which splits
+   *               the data into checksummed chunks of at most 64KB, rather
+   *               than raw snappy blocks.
+   */
+  public SnappyCompressor(int directBufferSize, boolean framed) {
     this.directBufferSize = directBufferSize;
+    this.framed = framed;
 
+    int compressedSize = framed ?
+        getFramedCompressedSize(directBufferSize) : directBufferSize;
     uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
-    compressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
-    compressedDirectBuf.position(directBufferSize);
+    compressedDirectBuf = ByteBuffer.allocateDirect(compressedSize);
+    compressedDirectBuf.position(compressedSize);
+  }
+
+  /**
+   * The worst case size of a framed buffer of the given amount of data: the
+   * stream identifier, then per 64KB chunk a header, a checksum and the
+   * snappy worst case of 32 + n + n/6 bytes.
+   */
+  private static int getFramedCompressedSize(int uncompressedSize) {
+    int chunks = (uncompressedSize + SNAPPY_MAX_CHUNK_UNCOMPRESSED - 1) /
+        SNAPPY_MAX_CHUNK_UNCOMPRESSED + 1;
+    return 10 + uncompressedSize + uncompressedSize / 6 + chunks * 48;
   }
 
   /**
@@ -221,7 +246,9 @@ public synchronized int compress(byte[] b, int off, int len)
     if (0 == uncompressedDirectBuf.position()) {
       // No compressed data, so we should have !needsInput or !finished
       setInputFromSavedData();
-      if (0 == uncompressedDirectBuf.position()) {
+      // A framed stream always starts with the stream identifier, even if
+      // it holds no data
+      if (0 == uncompressedDirectBuf.position() && (!framed || streamStarted)) {
         // Called without data; write nothing
         finished = true;
         return 0;
@@ -229,7 +256,12 @@ public synchronized int compress(byte[] b, int off, int len)
     }
 
     // Compress data
-    n = compressBytesDirect();
+    if (framed) {
+      n = compressFramedBytesDirect(!streamStarted);
+      streamStarted = true;
+    } else {
+      n = compressBytesDirect();
+    }
     compressedDirectBuf.limit(n);
     uncompressedDirectBuf.clear(); // snappy consumes all buffer input
 
@@ -253,6 +285,7 @@ public synchronized int compress(byte[] b, int off, int len)
   public synchronized void reset() {
     finish = false;
     finished = false;
+    streamStarted = false;
     uncompressedDirectBuf.clear();
     uncompressedDirectBufLen = 0;
     compressedDirectBuf.clear();
@@ -298,4 +331,6 @@ public synchronized void end() {
   private native static void initIDs();
 
   private native int compressBytesDirect();
+
+  private native int compressFramedBytesDirect(boolean writeStreamIdentifier);
 }
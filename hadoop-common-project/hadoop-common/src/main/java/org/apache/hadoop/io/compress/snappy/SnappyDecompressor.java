@@ -21,9 +21,11 @@
 import java.io.IOException;
 import java.nio.Buffer;
 import java.nio.ByteBuffer;
+import java.util.Arrays;
 
 import org.apache.commons.logging.Log;
 import org.apache.commons.logging.LogFactory;
+import org.apache.hadoop.fs.ChecksumException;
 import org.apache.hadoop.io.compress.Decompressor;
 import org.apache.hadoop.util.NativeCodeLoader;
 
@@ -36,9 +38,20 @@ public class SnappyDecompressor implements Decompressor {
       LogFactory.getLog(SnappyCompressor.class.getName());
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64 * 1024;
 
-  // HACK - Use this as a global lock in the JNI layer
-  @SuppressWarnings({"unchecked", "unused"})
-  private static Class clazz = SnappyDecompressor.class;
+  // Snappy framing format chunk types and sizes
+  private static final int CHUNK_COMPRESSED = 0x00;
+  private static final int CHUNK_UNCOMPRESSED = 0x01;
+  private static final int CHUNK_MIN_SKIPPABLE = 0x80;
+  private static final int CHUNK_STREAM_IDENTIFIER = 0xff;
+  private static final int CHUNK_HEADER_SIZE = 4;
+  private static final byte[] STREAM_IDENTIFIER =
+      { 's', 'N', 'a', 'P', 'p', 'Y' };
+  private static final int MAX_FRAMED_COMPRESSED_CHUNK = 4 + 32 +
+      SnappyCompressor.SNAPPY_MAX_CHUNK_UNCOMPRESSED +
+      SnappyCompressor.SNAPPY_MAX_CHUNK_UNCOMPRESSED / 6;
+  // Return codes of decompressFramedBytesDirect
+  private static final int FRAME_BAD_CHECKSUM = -1;
+  private static final int FRAME_CORRUPT = -2;
 
   private int directBufferSize;
   private Buffer compressedDirectBuf = null;
@@ -48,6 +61,14 @@ public class SnappyDecompressor implements Decompressor {
   private int userBufOff = 0, userBufLen = 0;
   private boolean finished;
 
+  // State of the chunk being read in framed mode; chunkType is -1 while the
+  // chunk header is being read
+  private final boolean framed;
+  private final byte[] chunkHeader = new byte[CHUNK_HEADER_SIZE];
+  private int chunkHeaderLen = 0;
+  private int chunkType = -1;
+  private int chunkLen, chunkRead;
+
   private static boolean nativeSnappyLoaded = false;
 
   static {
@@ -72,9 +93,27 @@ public static boolean isNativeCodeLoaded() {
    * @param directBufferSize size of the direct buffer to be used.
    */
   public SnappyDecompressor(int directBufferSize) {
+    this(directBufferSize, false);
+  }
+
+  /**
+   * Creates a new decompressor.
+   *
+   * @param directBufferSize size of the direct buffer to be used; ignored
+   *                         for the framing format, whose chunks are
+   *                         decompressed whole.
+   * @param framed whether the input is in the snappy framing format rather
+   *               than raw snappy blocks.
+   */
+  public SnappyDecompressor(int directBufferSize, boolean framed) {
+    this.framed = framed;
+    if (framed) {
+      directBufferSize = SnappyCompressor.SNAPPY_MAX_CHUNK_UNCOMPRESSED;
+    }
     this.directBufferSize = directBufferSize;
 
-    compressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
+    compressedDirectBuf = ByteBuffer.allocateDirect(
+        framed ? MAX_FRAMED_COMPRESSED_CHUNK : directBufferSize);
     uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
     uncompressedDirectBuf.position(directBufferSize);
 
@@ -114,6 +153,11 @@ public synchronized void setInput(byte[] b, int off, int len) {
     this.userBufOff = off;
     this.userBufLen = len;
 
+    if (framed) {
+      // Chunks are pulled out of the user buffer as they are decompressed
+      return;
+    }
+
     setInputFromSavedData();
 
     // Reinitialize snappy's output direct-buffer
@@ -163,6 +207,10 @@ public synchronized boolean needsInput() {
       return false;
     }
 
+    if (framed) {
+      return userBufLen <= 0;
+    }
+
     // Check if snappy has consumed all input
     if (compressedDirectBufLen <= 0) {
       // Check if we have consumed all user-input
@@ -195,6 +243,11 @@ public synchronized boolean needsDictionary() {
    */
   @Override
   public synchronized boolean finished() {
+    if (framed) {
+      // A framed stream may end after any complete chunk
+      return (chunkType < 0 && chunkHeaderLen == 0 &&
+          uncompressedDirectBuf.remaining() == 0);
+    }
     return (finished && uncompressedDirectBuf.remaining() == 0);
   }
 
@@ -222,6 +275,12 @@ public synchronized int decompress(byte[] b, int off, int len)
 
     int n = 0;
 
+    if (framed) {
+      while (uncompressedDirectBuf.remaining() == 0 && userBufLen > 0) {
+        readChunk();
+      }
+    }
+
     // Check if there is uncompressed data
     n = uncompressedDirectBuf.remaining();
     if (n > 0) {
@@ -229,7 +288,7 @@ public synchronized int decompress(byte[] b, int off, int len)
       ((ByteBuffer) uncompressedDirectBuf).get(b, off, n);
       return n;
     }
-    if (compressedDirectBufLen > 0) {
+    if (!framed && compressedDirectBufLen > 0) {
       // Re-initialize the snappy's output direct buffer
       uncompressedDirectBuf.rewind();
       uncompressedDirectBuf.limit(directBufferSize);
@@ -251,12 +310,122 @@ public synchronized int decompress(byte[] b, int off, int len)
   }
 
   /**
-   * Returns <code>0</code>.
+   * Decompresses one whole snappy block straight from one direct buffer into
+   * another, bypassing this decompressor's own buffers and the copy out of
+   * them. The block is the remaining bytes of <code>src</code>, which are
+   * all consumed; the position of <code>dst</code> is advanced past the
+   * uncompressed data.
+   *
+   * @param src direct buffer holding one compressed block
+   * @param dst direct buffer to receive the uncompressed block
+   * @return the number of uncompressed bytes written to <code>dst</code>
+   * @throws IOException
+   */
+  public synchronized int decompress(ByteBuffer src, ByteBuffer dst)
+      throws IOException {
+    if (framed) {
+      throw new UnsupportedOperationException(
+          "Direct decompression does not support the framing format");
+    }
+    if (!src.isDirect() || !dst.isDirect()) {
+      throw new IllegalArgumentException("Buffers must be direct");
+    }
+    int n = decompressDirectBuf(src, src.position(), src.remaining(),
+        dst, dst.position(), dst.remaining());
+    src.position(src.limit());
+    dst.position(dst.position() + n);
+    return n;
+  }
+
+  /**
+   * Consume as much of the next chunk of a framed stream from the user
+   * buffer as is available. Once a data chunk is complete it is
+   * decompressed into the uncompressed direct buffer.
+   */
+  private void readChunk() throws IOException {
+    if (chunkType < 0) {
+      int n = Math.min(CHUNK_HEADER_SIZE - chunkHeaderLen, userBufLen);
+      System.arraycopy(userBuf, userBufOff, chunkHeader, chunkHeaderLen, n);
+      userBufOff += n;
+      userBufLen -= n;
+      chunkHeaderLen += n;
+      if (chunkHeaderLen < CHUNK_HEADER_SIZE) {
+        return;
+      }
+      chunkHeaderLen = 0;
+      chunkType = chunkHeader[0] & 0xff;
+      chunkLen = (chunkHeader[1] & 0xff) | ((chunkHeader[2] & 0xff) << 8) |
+          ((chunkHeader[3] & 0xff) << 16);
+      chunkRead = 0;
+      if (chunkType == CHUNK_STREAM_IDENTIFIER) {
+        if (chunkLen != STREAM_IDENTIFIER.length) {
+          throw new IOException("Bad snappy stream identifier length " +
+              chunkLen);
+        }
+      } else if (chunkType == CHUNK_COMPRESSED ||
+                 chunkType == CHUNK_UNCOMPRESSED) {
+        if (chunkLen > compressedDirectBuf.capacity()) {
+          throw new IOException("Snappy chunk of " + chunkLen +
+              " bytes is too large");
+        }
+      } else if (chunkType < CHUNK_MIN_SKIPPABLE) {
+        throw new IOException("Unsupported unskippable snappy chunk type " +
+            chunkType);
+      }
+      compressedDirectBuf.clear();
+    }
+
+    // Skippable chunks are dropped without being buffered
+    int n = Math.min(chunkLen - chunkRead, userBufLen);
+    if (chunkType == CHUNK_STREAM_IDENTIFIER || chunkType == CHUNK_COMPRESSED ||
+        chunkType == CHUNK_UNCOMPRESSED) {
+      ((ByteBuffer) compressedDirectBuf).put(userBuf, userBufOff, n);
+    }
+    userBufOff += n;
+    userBufLen -= n;
+    chunkRead += n;
+    if (chunkRead < chunkLen) {
+      return;
+    }
+
+    int type = chunkType;
+    chunkType = -1;
+    if (type == CHUNK_STREAM_IDENTIFIER) {
+      byte[] identifier = new byte[STREAM_IDENTIFIER.length];
+      compressedDirectBuf.flip();
+      ((ByteBuffer) compressedDirectBuf).get(identifier);
+      if (!Arrays.equals(identifier, STREAM_IDENTIFIER)) {
+        throw new IOException("Bad snappy stream identifier");
+      }
+    } else if (type == CHUNK_COMPRESSED || type == CHUNK_UNCOMPRESSED) {
+      compressedDirectBufLen = chunkLen;
+      uncompressedDirectBuf.rewind();
+      uncompressedDirectBuf.limit(directBufferSize);
+
+      int len = decompressFramedBytesDirect(type);
+      compressedDirectBufLen = 0;
+      if (len == FRAME_BAD_CHECKSUM) {
+        uncompressedDirectBuf.limit(0);
+        throw new ChecksumException("Checksum error in snappy chunk", 0);
+      } else if (len == FRAME_CORRUPT) {
+        uncompressedDirectBuf.limit(0);
+        throw new IOException("Corrupt snappy chunk");
+      }
+      uncompressedDirectBuf.limit(len);
+    }
+  }
+
+  /**
+   * Returns <code>0</code>, or for the framing format the number of bytes
+   * of input not yet consumed.
    *
    * @return <code>0</code>.
    */
   @Override
   public synchronized int getRemaining() {
+    if (framed) {
+      return userBufLen;
+    }
     // Never use this function in BlockDecompressorStream.
     return 0;
   }
@@ -264,6 +433,8 @@ public synchronized int getRemaining() {
   @Override
   public synchronized void reset() {
     finished = false;
+    chunkHeaderLen = 0;
+    chunkType = -1;
     compressedDirectBufLen = 0;
     uncompressedDirectBuf.limit(directBufferSize);
     uncompressedDirectBuf.position(directBufferSize);
@@ -282,4 +453,9 @@ public synchronized void end() {
   private native static void initIDs();
 
   private native int decompressBytesDirect();
+
+  private native int decompressFramedBytesDirect(int type);
+
+  private native static int decompressDirectBuf(ByteBuffer src, int srcOff,
+      int srcLen, ByteBuffer dst, int dstOff, int dstLen);
 }
@@ -21,8 +21,10 @@
 import java.io.IOException;
 import java.nio.Buffer;
 import java.nio.ByteBuffer;
+import java.util.List;
 
 import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
 import org.apache.hadoop.io.compress.Compressor;
 import org.apache.hadoop.util.NativeCodeLoader;
 
@@ -41,12 +43,20 @@ public class ZlibCompressor implements Compressor {
 
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64*1024;
 
-  // HACK - Use this as a global lock in the JNI layer
-  private static Class clazz = ZlibCompressor.class;
+  // Size of the blocks handed to each thread in parallel gzip mode
+  private static final int PARALLEL_BLOCK_SIZE = 128*1024;
+
+  /**
+   * The largest useful preset dictionary: deflate can refer back at most
+   * 32KB.
+   */
+  public static final int MAX_DICTIONARY_SIZE = 32*1024;
 
   private long stream;
+  private long parallel;
   private CompressionLevel level;
   private CompressionStrategy strategy;
+  private int threads;
   private final CompressionHeader windowBits;
   private int directBufferSize;
   private byte[] userBuf = null;
@@ -173,9 +183,20 @@ public int windowBits() {
   static {
     if (NativeCodeLoader.isNativeCodeLoaded()) {
       try {
+        Configuration conf = new Configuration();
+        String accelerator = conf.get(
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_KEY,
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_DEFAULT);
+        boolean libdeflate = conf.getBoolean(
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_KEY,
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_DEFAULT);
         // Initialize the native library
-        initIDs();
+        initIDs(accelerator, libdeflate);
         nativeZlibLoaded = true;
+        if (!accelerator.isEmpty() && !accelerator.equals(getLibraryName())) {
+          LOG.warn("Could not load zlib accelerator library " + accelerator +
+              ", falling back to " + getLibraryName());
+        }
       } catch (Throwable t) {
         // Ignore failure to load/initialize native-zlib
       }
@@ -222,12 +243,32 @@ public ZlibCompressor(Configuration conf) {
    */
   public ZlibCompressor(CompressionLevel level, CompressionStrategy strategy, 
                         CompressionHeader header, int directBufferSize) {
+    this(level, strategy, header, directBufferSize, 1);
+  }
+
+  /** 
+   * Creates a new compressor using the specified compression level.
+   * 
+   * With {@link CompressionHeader#GZIP_FORMAT} and more than one thread,
+   * the input is cut into blocks which are deflated in parallel, each
+   * primed with the end of the block before it. The output is still a
+   * single standard gzip stream. Dictionaries are not supported in this
+   * mode. Other headers always compress on the calling thread.
+   * 
+   * @param level Compression level #CompressionLevel
+   * @param strategy Compression strategy #CompressionStrategy
+   * @param header Compression header #CompressionHeader
+   * @param directBufferSize Size of the direct buffer to be used.
+   * @param threads Number of threads to compress gzip data with.
+   */
+  public ZlibCompressor(CompressionLevel level, CompressionStrategy strategy, 
+                        CompressionHeader header, int directBufferSize,
+                        int threads) {
     this.level = level;
     this.strategy = strategy;
     this.windowBits = header;
-    stream = init(this.level.compressionLevel(), 
-                  this.strategy.compressionStrategy(), 
-                  this.windowBits.windowBits());
+    this.threads = threads;
+    initStream();
 
     this.directBufferSize = directBufferSize;
     uncompressedDirectBuf = ByteBuffer.allocateDirect(directBufferSize);
@@ -248,17 +289,28 @@ public synchronized void reinit(Configuration conf) {
     if (conf == null) {
       return;
     }
-    end(stream);
+    end();
     level = ZlibFactory.getCompressionLevel(conf);
     strategy = ZlibFactory.getCompressionStrategy(conf);
-    stream = init(level.compressionLevel(), 
-                  strategy.compressionStrategy(), 
-                  windowBits.windowBits());
+    threads = ZlibFactory.getCompressionThreads(conf);
+    initStream();
     if(LOG.isDebugEnabled()) {
       LOG.debug("Reinit compressor with new compression configuration");
     }
   }
 
+  private void initStream() {
+    if (threads > 1 && windowBits == CompressionHeader.GZIP_FORMAT) {
+      parallel = initParallel(level.compressionLevel(),
+                              strategy.compressionStrategy(),
+                              threads, PARALLEL_BLOCK_SIZE);
+    } else {
+      stream = init(level.compressionLevel(), 
+                    strategy.compressionStrategy(), 
+                    windowBits.windowBits());
+    }
+  }
+
   @Override
   public synchronized void setInput(byte[] b, int off, int len) {
     if (b== null) {
@@ -290,13 +342,60 @@ synchronized void setInputFromSavedData() {
 
   @Override
   public synchronized void setDictionary(byte[] b, int off, int len) {
+    if (parallel != 0) {
+      throw new UnsupportedOperationException(
+          "dictionaries are not supported by parallel gzip compression");
+    }
     if (stream == 0 || b == null) {
       throw new NullPointerException();
     }
     if (off < 0 || len < 0 || off > b.length - len) {
       throw new ArrayIndexOutOfBoundsException();
     }
-    setDictionary(stream, b, off, len);
+    setDictionary(stream, level.compressionLevel(),
+                  strategy.compressionStrategy(), windowBits.windowBits(),
+                  b, off, len);
+  }
+
+  /**
+   * Build a preset dictionary from samples of the data to be compressed,
+   * for use with {@link #setDictionary(byte[], int, int)} on both sides.
+   * This pays off for many small, similar inputs such as individually
+   * compressed records, which otherwise start from an empty window.
+   *
+   * Setting the same dictionary with the same level, strategy and header is
+   * cheap after the first time: the primed stream is cached process-wide
+   * and copied rather than rebuilt.
+   *
+   * @param samples  representative inputs
+   * @param dictSize the largest dictionary to build, at most
+   *                 {@link #MAX_DICTIONARY_SIZE}
+   * @return the dictionary; empty if the samples have too little in common
+   */
+  public static byte[] trainDictionary(List<byte[]> samples, int dictSize) {
+    if (!nativeZlibLoaded) {
+      throw new UnsupportedOperationException("native zlib is not loaded");
+    }
+    if (dictSize <= 0 || dictSize > MAX_DICTIONARY_SIZE) {
+      throw new IllegalArgumentException("dictSize must be between 1 and " +
+          MAX_DICTIONARY_SIZE + ": " + dictSize);
+    }
+    long total = 0;
+    for (byte[] sample : samples) {
+      total += sample.length;
+    }
+    if (total > Integer.MAX_VALUE) {
+      throw new IllegalArgumentException("samples are too large");
+    }
+    byte[] flat = new byte[(int)total];
+    int[] sizes = new int[samples.size()];
+    int off = 0, i = 0;
+    for (byte[] sample : samples) {
+      System.arraycopy(sample, 0, flat, off, sample.length);
+      off += sample.length;
+      sizes[i++] = sample.length;
+    }
+    return trainDictionary(flat, sizes, dictSize);
   }
 
   @Override
@@ -394,7 +493,8 @@ public synchronized int compress(byte[] b, int off, int len)
   @Override
   public synchronized long getBytesWritten() {
     checkStream();
-    return getBytesWritten(stream);
+    return parallel != 0 ? getParallelBytesWritten(parallel)
+                         : getBytesWritten(stream);
   }
 
   /**
@@ -405,13 +505,18 @@ public synchronized long getBytesWritten() {
   @Override
   public synchronized long getBytesRead() {
     checkStream();
-    return getBytesRead(stream);
+    return parallel != 0 ? getParallelBytesRead(parallel)
+                         : getBytesRead(stream);
   }
 
   @Override
   public synchronized void reset() {
     checkStream();
-    reset(stream);
+    if (parallel != 0) {
+      resetParallel(parallel);
+    } else {
+      reset(stream);
+    }
     finish = false;
     finished = false;
     uncompressedDirectBuf.rewind();
@@ -428,20 +533,42 @@ public synchronized void end() {
       end(stream);
       stream = 0;
     }
+    if (parallel != 0) {
+      endParallel(parallel);
+      parallel = 0;
+    }
   }
   
   private void checkStream() {
-    if (stream == 0)
+    if (stream == 0 && parallel == 0)
       throw new NullPointerException();
   }
   
-  private native static void initIDs();
+  private native static void initIDs(String accelerator,
+                                     boolean libdeflate);
+
+  /**
+   * Return the zlib library the native compressor is bound to. This is
+   * the configured accelerator library if it could be loaded, else libz.
+   */
+  public native static String getLibraryName();
+
   private native static long init(int level, int strategy, int windowBits);
-  private native static void setDictionary(long strm, byte[] b, int off,
-                                           int len);
+  private native static void setDictionary(long strm, int level,
+                                           int strategy, int windowBits,
+                                           byte[] b, int off, int len);
+  private native static byte[] trainDictionary(byte[] samples,
+                                               int[] sampleSizes,
+                                               int dictSize);
   private native int deflateBytesDirect();
   private native static long getBytesRead(long strm);
   private native static long getBytesWritten(long strm);
   private native static void reset(long strm);
   private native static void end(long strm);
+  private native static long initParallel(int level, int strategy,
+                                          int threads, int blockSize);
+  private native static long getParallelBytesRead(long parallel);
+  private native static long getParallelBytesWritten(long parallel);
+  private native static void resetParallel(long parallel);
+  private native static void endParallel(long parallel);
 }
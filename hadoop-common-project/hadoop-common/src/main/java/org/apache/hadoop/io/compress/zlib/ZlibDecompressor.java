@@ -22,9 +22,14 @@
 import java.nio.Buffer;
 import java.nio.ByteBuffer;
 
+import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
 import org.apache.hadoop.io.compress.Decompressor;
 import org.apache.hadoop.util.NativeCodeLoader;
 
+import org.apache.commons.logging.Log;
+import org.apache.commons.logging.LogFactory;
+
 /**
  * A {@link Decompressor} based on the popular 
  * zlib compression algorithm.
@@ -32,10 +37,15 @@
  * 
  */
 public class ZlibDecompressor implements Decompressor {
+  private static final Log LOG = LogFactory.getLog(ZlibDecompressor.class);
+
   private static final int DEFAULT_DIRECT_BUFFER_SIZE = 64*1024;
-  
-  // HACK - Use this as a global lock in the JNI layer
-  private static Class clazz = ZlibDecompressor.class;
+
+  // Layout of the value returned by inflateDirect
+  private static final int INFLATE_COUNT_BITS = 30;
+  private static final long INFLATE_COUNT_MASK = (1L << INFLATE_COUNT_BITS) - 1;
+  private static final long INFLATE_STREAM_END = 1L << 60;
+  private static final long INFLATE_NEED_DICT = 1L << 61;
   
   private long stream;
   private CompressionHeader header;
@@ -88,9 +98,20 @@ public int windowBits() {
   static {
     if (NativeCodeLoader.isNativeCodeLoaded()) {
       try {
+        Configuration conf = new Configuration();
+        String accelerator = conf.get(
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_KEY,
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_ACCELERATOR_LIBRARY_DEFAULT);
+        boolean libdeflate = conf.getBoolean(
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_KEY,
+            CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZLIB_LIBDEFLATE_DEFAULT);
         // Initialize the native library
-        initIDs();
+        initIDs(accelerator, libdeflate);
         nativeZlibLoaded = true;
+        if (!accelerator.isEmpty() && !accelerator.equals(getLibraryName())) {
+          LOG.warn("Could not load zlib accelerator library " + accelerator +
+              ", falling back to " + getLibraryName());
+        }
       } catch (Throwable t) {
         // Ignore failure to load/initialize native-zlib
       }
@@ -223,8 +244,31 @@ public synchronized int decompress(byte[] b, int off, int len)
     uncompressedDirectBuf.rewind();
     uncompressedDirectBuf.limit(directBufferSize);
 
-    // Decompress data
-    n = inflateBytesDirect();
+    // Decompress data, refilling zlib's input from the user buffer until
+    // the output buffer is full or the stream ends
+    n = 0;
+    while (true) {
+      long result = inflateDirect(stream,
+          compressedDirectBuf, compressedDirectBufOff, compressedDirectBufLen,
+          uncompressedDirectBuf, n, directBufferSize - n);
+      int consumed = (int)((result >>> INFLATE_COUNT_BITS) & INFLATE_COUNT_MASK);
+      compressedDirectBufOff += consumed;
+      compressedDirectBufLen -= consumed;
+      n += (int)(result & INFLATE_COUNT_MASK);
+      if ((result & INFLATE_STREAM_END) != 0) {
+        finished = true;
+        break;
+      }
+      if ((result & INFLATE_NEED_DICT) != 0) {
+        needDict = true;
+        break;
+      }
+      if (n == directBufferSize || compressedDirectBufLen > 0 ||
+          userBufLen <= 0) {
+        break;
+      }
+      setInputFromSavedData();
+    }
     uncompressedDirectBuf.limit(n);
 
     // Get at most 'len' bytes
@@ -300,11 +344,21 @@ private void checkStream() {
       throw new NullPointerException();
   }
   
-  private native static void initIDs();
+  private native static void initIDs(String accelerator,
+                                     boolean libdeflate);
+
+  /**
+   * Return the zlib library the native decompressor is bound to. This is
+   * the configured accelerator library if it could be loaded, else libz.
+   */
+  public native static String getLibraryName();
+
   private native static long init(int windowBits);
   private native static void setDictionary(long strm, byte[] b, int off,
                                            int len);
-  private native int inflateBytesDirect();
+  private native static long inflateDirect(long strm,
+      Buffer compressedBuf, int compressedOff, int compressedLen,
+      Buffer uncompressedBuf, int uncompressedOff, int uncompressedLen);
   private native static long getBytesRead(long strm);
   private native static long getBytesWritten(long strm);
   private native static int getRemaining(long strm);
@@ -133,4 +133,16 @@ public static CompressionLevel getCompressionLevel(Configuration conf) {
         CompressionLevel.DEFAULT_COMPRESSION);
   }
 
+  /**
+   * Set the number of threads the native gzip compressor may use. With more
+   * than one, blocks of the input are compressed in parallel.
+   */
+  public static void setCompressionThreads(Configuration conf, int threads) {
+    conf.setInt("zlib.compress.threads", threads);
+  }
+
+  public static int getCompressionThreads(Configuration conf) {
+    return conf.getInt("zlib.compress.threads", 1);
+  }
+
 }
@@ -0,0 +1,211 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.apache.hadoop.io.nativeio;
+
+import java.io.Closeable;
+import java.io.File;
+import java.io.IOException;
+
+/**
+ * Measures the latency of storage volumes by writing and reading back a
+ * few kilobytes with O_DIRECT in each of them at a fixed interval, so that
+ * a disk going slow can be noticed before requests against it time out.
+ *
+ * Every volume is probed from a native thread of its own. The probes of a
+ * volume are kept as histograms of read and write latency, and each
+ * {@link #getSample} also returns the kernel's counters from
+ * /proc/diskstats for the volume's device. The histograms and counters
+ * only grow; callers wanting rates should diff successive samples.
+ *
+ * Each directory gets a small file named <code>.disk_probe</code>, which
+ * is removed by {@link #close}.
+ */
+public class NativeDiskSampler implements Closeable {
+  /** Number of buckets in each latency histogram */
+  public static final int BUCKETS = 32;
+
+  // Layout of the array filled by NativeIO.getDiskSample
+  private static final int READ_HIST = 0;
+  private static final int WRITE_HIST = BUCKETS;
+  private static final int READ_ERRORS = 2 * BUCKETS;
+  private static final int WRITE_ERRORS = READ_ERRORS + 1;
+  private static final int LAST_ERROR = READ_ERRORS + 2;
+  private static final int LAST_READ = READ_ERRORS + 3;
+  private static final int LAST_WRITE = READ_ERRORS + 4;
+  private static final int INFLIGHT = READ_ERRORS + 5;
+  private static final int HAVE_DISKSTATS = READ_ERRORS + 6;
+  private static final int DISKSTATS = READ_ERRORS + 7;
+  private static final int SAMPLE_LENGTH = DISKSTATS + 11;
+
+  private long sampler;
+  private final File[] volumes;
+
+  /**
+   * Start probing.
+   *
+   * @param volumes    directories on the volumes to probe
+   * @param intervalMs time between the end of one probe of a volume and the
+   *                   start of the next
+   * @param probeSize  bytes written and read by each probe, rounded up to
+   *                   the page size
+   * @throws NativeIOException if a directory cannot be probed
+   */
+  public NativeDiskSampler(File[] volumes, int intervalMs, int probeSize)
+      throws IOException {
+    if (!NativeIO.isAvailable()) {
+      throw new UnsupportedOperationException("NativeIO is not available");
+    }
+    String[] dirs = new String[volumes.length];
+    for (int i = 0; i < volumes.length; i++) {
+      dirs[i] = volumes[i].getPath();
+    }
+    sampler = NativeIO.createDiskSampler(dirs, intervalMs, probeSize);
+    this.volumes = volumes.clone();
+  }
+
+  /** Return the number of volumes being probed. */
+  public int getNumVolumes() {
+    return volumes.length;
+  }
+
+  /** Return the statistics gathered so far for the i'th volume. */
+  public synchronized Sample getSample(int i) {
+    if (sampler == 0) {
+      throw new IllegalStateException("Sampler is closed");
+    }
+    long[] raw = new long[SAMPLE_LENGTH];
+    NativeIO.getDiskSample(sampler, i, raw);
+    return new Sample(volumes[i], raw);
+  }
+
+  /**
+   * Stop probing. This waits for the probes in flight, so it blocks for as
+   * long as a hung disk does.
+   */
+  @Override
+  public synchronized void close() {
+    if (sampler != 0) {
+      NativeIO.destroyDiskSampler(sampler);
+      sampler = 0;
+    }
+  }
+
+  /** What is known about one volume at one point in time */
+  public static class Sample {
+    private final File volume;
+    private final long[] raw;
+
+    Sample(File volume, long[] raw) {
+      this.volume = volume;
+      this.raw = raw;
+    }
+
+    public File getVolume() {
+      return volume;
+    }
+
+    /**
+     * Return the read latency histogram: bucket i counts probes that took
+     * from 2^i up to 2^(i+1) microseconds. The first bucket also counts
+     * faster probes, and the last one slower probes.
+     */
+    public long[] getReadHistogram() {
+      return histogram(READ_HIST);
+    }
+
+    /** Return the write latency histogram; see {@link #getReadHistogram} */
+    public long[] getWriteHistogram() {
+      return histogram(WRITE_HIST);
+    }
+
+    public long getReadErrors() {
+      return raw[READ_ERRORS];
+    }
+
+    public long getWriteErrors() {
+      return raw[WRITE_ERRORS];
+    }
+
+    /** Return the errno value of the last failed probe, or 0. */
+    public int getLastErrno() {
+      return (int)raw[LAST_ERROR];
+    }
+
+    /** Return the latency of the last successful read probe, or -1. */
+    public long getLastReadMicros() {
+      return raw[LAST_READ];
+    }
+
+    /** Return the latency of the last successful write probe, or -1. */
+    public long getLastWriteMicros() {
+      return raw[LAST_WRITE];
+    }
+
+    /**
+     * Return how long the probe now running has taken so far, or 0 if none
+     * is. A hung disk shows here long before its histograms change.
+     */
+    public long getInFlightMicros() {
+      return raw[INFLIGHT];
+    }
+
+    /**
+     * Return the counters of the volume's device from /proc/diskstats, in
+     * the kernel's order: reads, reads merged, sectors read, ms reading,
+     * writes, writes merged, sectors written, ms writing, I/Os in
+     * progress, ms doing I/O and weighted ms doing I/O. Returns null if
+     * the device was not found there.
+     */
+    public long[] getDiskStats() {
+      if (raw[HAVE_DISKSTATS] == 0) {
+        return null;
+      }
+      long[] stats = new long[SAMPLE_LENGTH - DISKSTATS];
+      System.arraycopy(raw, DISKSTATS, stats, 0, stats.length);
+      return stats;
+    }
+
+    private long[] histogram(int start) {
+      long[] hist = new long[BUCKETS];
+      System.arraycopy(raw, start, hist, 0, BUCKETS);
+      return hist;
+    }
+
+    /**
+     * Return an upper bound, in microseconds, on the latency of the given
+     * fraction of the probes counted by a histogram, or -1 if it is empty.
+     */
+    public static long percentileMicros(long[] hist, double fraction) {
+      long total = 0;
+      for (long count : hist) {
+        total += count;
+      }
+      if (total == 0) {
+        return -1;
+      }
+      long seen = 0;
+      for (int i = 0; i < hist.length - 1; i++) {
+        seen += hist[i];
+        if (seen >= fraction * total) {
+          return 2L << i;
+        }
+      }
+      return Long.MAX_VALUE;
+    }
+  }
+}
@@ -17,10 +17,19 @@
  */
 package org.apache.hadoop.io.nativeio;
 
+import java.io.File;
 import java.io.FileDescriptor;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.ArrayList;
+import java.util.List;
 
 import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
 import org.apache.hadoop.util.NativeCodeLoader;
 
 import org.apache.commons.logging.Log;
@@ -43,6 +52,7 @@ public class NativeIO {
   public static final int O_NONBLOCK = 04000;
   public static final int O_SYNC   =  010000;
   public static final int O_ASYNC  =  020000;
+  public static final int O_DIRECT =  040000;
   public static final int O_FSYNC = O_SYNC;
   public static final int O_NDELAY = O_NONBLOCK;
 
@@ -75,16 +85,39 @@ public class NativeIO {
      write.  */
   public static final int SYNC_FILE_RANGE_WAIT_AFTER = 4;
 
+  /* Modes for fallocate, from linux/falloc.h */
+  /* Allocate blocks without changing the file size.  */
+  public static final int FALLOC_FL_KEEP_SIZE = 1;
+  /* Deallocate the range; must be combined with KEEP_SIZE.  */
+  public static final int FALLOC_FL_PUNCH_HOLE = 2;
+
+  /* Allow copyFileRange to share extents with the source (reflink)  */
+  public static final int COPY_REFLINK = 1;
+
+  /* Memory protection flags for mmap, from bits/mman.h */
+  public static final int PROT_NONE = 0;
+  public static final int PROT_READ = 1;
+  public static final int PROT_WRITE = 2;
+  public static final int PROT_EXEC = 4;
+
+  /* Advice for madvise */
+  public static final int MADV_NORMAL = 0;
+  public static final int MADV_RANDOM = 1;
+  public static final int MADV_SEQUENTIAL = 2;
+  public static final int MADV_WILLNEED = 3;
+  public static final int MADV_DONTNEED = 4;
+
   private static final Log LOG = LogFactory.getLog(NativeIO.class);
 
   private static boolean nativeLoaded = false;
   private static boolean workaroundNonThreadSafePasswdCalls = false;
   private static boolean fadvisePossible = true;
   private static boolean syncFileRangePossible = true;
+  private static boolean fallocatePossible = true;
 
-  static final String WORKAROUND_NON_THREADSAFE_CALLS_KEY =
+  public static final String WORKAROUND_NON_THREADSAFE_CALLS_KEY =
     "hadoop.workaround.non.threadsafe.getpwuid";
-  static final boolean WORKAROUND_NON_THREADSAFE_CALLS_DEFAULT = false;
+  public static final boolean WORKAROUND_NON_THREADSAFE_CALLS_DEFAULT = false;
 
   static {
     if (NativeCodeLoader.isNativeCodeLoaded()) {
@@ -95,6 +128,12 @@ public class NativeIO {
           WORKAROUND_NON_THREADSAFE_CALLS_DEFAULT);
 
         initNative();
+        setIdCacheTtl(1000 * conf.getLong(
+            CommonConfigurationKeys.HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_KEY,
+            CommonConfigurationKeys.HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_DEFAULT),
+          1000 * conf.getLong(
+            CommonConfigurationKeys.HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_KEY,
+            CommonConfigurationKeys.HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_DEFAULT));
         nativeLoaded = true;
       } catch (Throwable t) {
         // This can happen if the user has an older version of libhadoop.so
@@ -127,6 +166,137 @@ static native void posix_fadvise(
   static native void sync_file_range(
     FileDescriptor fd, long offset, long nbytes, int flags) throws NativeIOException;
 
+  /**
+   * Map <code>length</code> bytes of a file, starting at
+   * <code>offset</code>, and return them as a direct buffer. The offset need
+   * not be page-aligned. The mapping stays valid until passed to
+   * {@link #munmap}; the buffer must not be touched after that.
+   */
+  public static native ByteBuffer mmap(FileDescriptor fd, int prot,
+    boolean shared, long offset, long length) throws IOException;
+  /** Unmap a buffer returned by {@link #mmap} */
+  public static native void munmap(ByteBuffer buf) throws IOException;
+  /** Wrapper around madvise(2) for a range of a mapped buffer */
+  public static native void madvise(ByteBuffer buf, long offset, long len,
+    int advice) throws IOException;
+  /**
+   * Wrapper around mlock(2) for a range of a mapped buffer. This is subject
+   * to RLIMIT_MEMLOCK for unprivileged users.
+   */
+  public static native void mlock(ByteBuffer buf, long offset, long len)
+    throws IOException;
+  /** Wrapper around munlock(2) for a range of a mapped buffer */
+  public static native void munlock(ByteBuffer buf, long offset, long len)
+    throws IOException;
+  /** Return the size of a page of memory */
+  public static native long getPageSize();
+
+  /**
+   * Copy <code>count</code> bytes of <code>in</code>, starting at
+   * <code>offset</code>, to <code>out</code> with sendfile(2), without
+   * passing them through user space. The file position of <code>in</code>
+   * is not changed.
+   *
+   * If <code>out</code> is non-blocking and fills up, the transfer stops
+   * early, but only on a multiple of <code>chunkSize</code> bytes, so a
+   * caller sending checksummed packets never stops mid-chunk; pass 0 to
+   * stop anywhere.
+   *
+   * @return the number of bytes transferred, which is less than count if
+   *         the end of the file was reached or out would block
+   */
+  public static native long sendfile(FileDescriptor out, FileDescriptor in,
+    long offset, long count, int chunkSize) throws IOException;
+  /**
+   * Like {@link #sendfile}, but moves the data with splice(2) through a
+   * per-thread pipe. This also works where sendfile does not support the
+   * destination.
+   */
+  public static native long splice(FileDescriptor out, FileDescriptor in,
+    long offset, long count, int chunkSize) throws IOException;
+
+  /**
+   * Wrapper around fallocate(2). A mode of 0 falls back to
+   * posix_fallocate(3) on file systems, or platforms, without fallocate.
+   */
+  static native void fallocate(
+    FileDescriptor fd, int mode, long offset, long len) throws IOException;
+
+  /**
+   * Allocate a direct buffer outside the Java heap whose address is a
+   * multiple of <code>alignment</code>, as O_DIRECT I/O requires. It must
+   * be released with {@link #freeAligned}; it is not garbage collected.
+   */
+  public static native ByteBuffer allocateAligned(int capacity,
+    int alignment);
+  /** Release a buffer returned by {@link #allocateAligned} */
+  public static native void freeAligned(ByteBuffer buf);
+  /** Wrapper around pwrite(2) from a range of a direct buffer */
+  public static native int pwrite(FileDescriptor fd, ByteBuffer buf,
+    int off, int len, long position) throws IOException;
+
+  /** Create a batched I/O queue; see {@link NativeIOQueue} */
+  static native long createQueue(int depth, int backend) throws IOException;
+  static native int getQueueBackend(long queue);
+  static native int submitQueue(long queue, int n, int[] ops, long[] offsets,
+    FileDescriptor[] fds, ByteBuffer[] bufs) throws IOException;
+  static native int reapQueue(long queue, int[] slots, long[] results,
+    int max, int minComplete) throws IOException;
+  static native void destroyQueue(long queue);
+
+  /** Start probing the latency of storage volumes; see {@link NativeDiskSampler} */
+  static native long createDiskSampler(String[] dirs, int intervalMs,
+    int probeSize) throws IOException;
+  static native void getDiskSample(long sampler, int volume, long[] out);
+  static native void destroyDiskSampler(long sampler);
+
+  /**
+   * Apply posix_fadvise to the first <code>n</code> (fd, offset, len,
+   * flags) entries of the arrays in one native call. The Errno of each
+   * failed entry is stored at its index in <code>errors</code>, and null
+   * for each entry that succeeded.
+   *
+   * @return the number of entries that failed
+   */
+  static native int posix_fadvise_batch(FileDescriptor[] fds,
+    long[] offsets, long[] lens, int[] flags, int n, Errno[] errors);
+
+  /** Batched sync_file_range; see {@link #posix_fadvise_batch} */
+  static native int sync_file_range_batch(FileDescriptor[] fds,
+    long[] offsets, long[] lens, int[] flags, int n, Errno[] errors);
+
+  /**
+   * Set how long the native uid/gid to name cache keeps names, and the
+   * absence of names, in milliseconds. This also empties the cache.
+   */
+  static native void setIdCacheTtl(long positiveMs, long negativeMs);
+
+  /**
+   * List one directory into a direct buffer, as records of (int name
+   * length, int type, long length, long mtime, name bytes) in native byte
+   * order, each padded to a multiple of 8 bytes.
+   *
+   * @return the number of bytes written, or if the listing does not fit,
+   *         the negated number of bytes it needs
+   */
+  static native int readDirectory(String path, ByteBuffer buf)
+    throws IOException;
+
+  /**
+   * Copy <code>len</code> bytes of <code>in</code> at
+   * <code>inOffset</code> to <code>out</code> at <code>outOffset</code>
+   * inside the kernel. With COPY_REFLINK, the range is first cloned where
+   * the file system supports it. Otherwise copy_file_range(2) is used
+   * where it works, then splice(2) through a pipe, then pread and pwrite.
+   * Neither descriptor's file position is changed.
+   *
+   * @return the number of bytes copied, less than len only at the end of
+   *         the source
+   */
+  public static native long copyFileRange(FileDescriptor in, long inOffset,
+    FileDescriptor out, long outOffset, long len, int flags)
+    throws IOException;
+
   /** Initialize the JNI method ID and class ID cache */
   private static native void initNative();
 
@@ -172,6 +342,211 @@ public static void syncFileRangeIfPossible(
     }
   }
 
+  /**
+   * Call posix_fadvise on a batch of ranges with a single JNI call. On
+   * systems where this call is not available, does nothing.
+   *
+   * @param errors receives the error of each failed entry; null entries
+   *               succeeded
+   * @return the number of entries that failed
+   */
+  public static int posixFadviseBatchIfPossible(FileDescriptor[] fds,
+      long[] offsets, long[] lens, int[] flags, int n, Errno[] errors) {
+    if (nativeLoaded && fadvisePossible) {
+      try {
+        return posix_fadvise_batch(fds, offsets, lens, flags, n, errors);
+      } catch (UnsupportedOperationException uoe) {
+        fadvisePossible = false;
+      } catch (UnsatisfiedLinkError ule) {
+        fadvisePossible = false;
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * Call sync_file_range on a batch of ranges with a single JNI call. On
+   * systems where this call is not available, does nothing.
+   *
+   * @param errors receives the error of each failed entry; null entries
+   *               succeeded
+   * @return the number of entries that failed
+   */
+  public static int syncFileRangeBatchIfPossible(FileDescriptor[] fds,
+      long[] offsets, long[] lens, int[] flags, int n, Errno[] errors) {
+    if (nativeLoaded && syncFileRangePossible) {
+      try {
+        return sync_file_range_batch(fds, offsets, lens, flags, n, errors);
+      } catch (UnsupportedOperationException uoe) {
+        syncFileRangePossible = false;
+      } catch (UnsatisfiedLinkError ule) {
+        syncFileRangePossible = false;
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * Call fallocate on the given file descriptor, to reserve disk space for
+   * a file before writing it. On systems where this call is not available,
+   * does nothing.
+   *
+   * @throws IOException if there is an error with the syscall, such as
+   *         running out of space
+   */
+  public static void fallocateIfPossible(
+      FileDescriptor fd, int mode, long offset, long len)
+      throws IOException {
+    if (nativeLoaded && fallocatePossible) {
+      try {
+        fallocate(fd, mode, offset, len);
+      } catch (UnsupportedOperationException uoe) {
+        fallocatePossible = false;
+      } catch (UnsatisfiedLinkError ule) {
+        fallocatePossible = false;
+      }
+    }
+  }
+
+  /**
+   * Write all the remaining bytes of a direct buffer at the given file
+   * position, advancing the buffer's position. For a descriptor opened with
+   * {@link #O_DIRECT} the buffer address, the position and the length must
+   * all be multiples of the device block size; use
+   * {@link #allocateAligned} for the buffer, and pad the final write and
+   * truncate the file afterwards.
+   */
+  public static void pwriteFully(FileDescriptor fd, ByteBuffer buf,
+      long position) throws IOException {
+    while (buf.hasRemaining()) {
+      int n = pwrite(fd, buf, buf.position(), buf.remaining(), position);
+      buf.position(buf.position() + n);
+      position += n;
+    }
+  }
+
+  /**
+   * Copy a whole file with {@link #copyFileRange}, creating or replacing
+   * <code>dst</code>. Reflinks are used where the file system allows.
+   */
+  public static void copyFile(File src, File dst) throws IOException {
+    FileInputStream in = new FileInputStream(src);
+    try {
+      FileOutputStream out = new FileOutputStream(dst);
+      try {
+        long len = in.getChannel().size();
+        long copied = copyFileRange(in.getFD(), 0, out.getFD(), 0, len,
+            COPY_REFLINK);
+        if (copied != len) {
+          throw new IOException("Copied only " + copied + " of " + len +
+              " bytes from " + src + " to " + dst);
+        }
+        out.getFD().sync();
+      } finally {
+        out.close();
+      }
+    } finally {
+      in.close();
+    }
+  }
+
+  /**
+   * Copy a block file and its checksum file so that the destination never
+   * holds one without the other. Both are copied to temporary names
+   * first; the checksum file is renamed into place before the block file,
+   * just as a finalized replica appears. On failure the temporary copies
+   * are removed.
+   */
+  public static void copyBlockAndMeta(File srcBlock, File srcMeta,
+      File dstBlock, File dstMeta) throws IOException {
+    File tmpBlock = new File(dstBlock.getPath() + ".copying");
+    File tmpMeta = new File(dstMeta.getPath() + ".copying");
+    boolean done = false;
+    try {
+      copyFile(srcMeta, tmpMeta);
+      copyFile(srcBlock, tmpBlock);
+      if (!tmpMeta.renameTo(dstMeta)) {
+        throw new IOException("Failed to rename " + tmpMeta + " to " + dstMeta);
+      }
+      if (!tmpBlock.renameTo(dstBlock)) {
+        dstMeta.delete();
+        throw new IOException("Failed to rename " + tmpBlock + " to " +
+            dstBlock);
+      }
+      done = true;
+    } finally {
+      if (!done) {
+        tmpBlock.delete();
+        tmpMeta.delete();
+      }
+    }
+  }
+
+  /** Entry types reported to a {@link DirectoryVisitor} */
+  public static final int DIRENT_FILE = 0;
+  public static final int DIRENT_DIRECTORY = 1;
+  public static final int DIRENT_OTHER = 2;
+
+  private static final int DIRENT_HEADER_LEN = 24;
+  private static final Charset UTF8 = Charset.forName("UTF-8");
+
+  /**
+   * Receives the entries found by {@link #walkDirectory}.
+   */
+  public interface DirectoryVisitor {
+    /**
+     * @param type    one of DIRENT_FILE, DIRENT_DIRECTORY and DIRENT_OTHER;
+     *                symbolic links are reported as DIRENT_OTHER
+     * @param length  the size of the entry in bytes
+     * @param mtime   the modification time, in milliseconds since the epoch
+     * @return whether to descend into the entry, if it is a directory
+     */
+    boolean visit(File dir, String name, int type, long length, long mtime)
+        throws IOException;
+  }
+
+  /**
+   * Walk the tree under <code>root</code>, passing every entry to the
+   * visitor. Each directory is listed and stat'ed by a single native call,
+   * which makes this much faster than File.listFiles over trees of
+   * millions of files. Entries that disappear during the walk are skipped.
+   */
+  public static void walkDirectory(File root, DirectoryVisitor visitor)
+      throws IOException {
+    ByteBuffer buf = ByteBuffer.allocateDirect(64 * 1024)
+        .order(ByteOrder.nativeOrder());
+    List<File> pending = new ArrayList<File>();
+    pending.add(root);
+    while (!pending.isEmpty()) {
+      File dir = pending.remove(pending.size() - 1);
+      int len;
+      while ((len = readDirectory(dir.getPath(), buf)) < 0) {
+        // Leave room for the directory to grow before the next listing
+        buf = ByteBuffer.allocateDirect(-len + -len / 4)
+            .order(ByteOrder.nativeOrder());
+      }
+      byte[] name = new byte[256];
+      for (int off = 0; off < len; ) {
+        int nameLen = buf.getInt(off);
+        int type = buf.getInt(off + 4);
+        long length = buf.getLong(off + 8);
+        long mtime = buf.getLong(off + 16);
+        if (name.length < nameLen) {
+          name = new byte[nameLen];
+        }
+        buf.position(off + DIRENT_HEADER_LEN);
+        buf.get(name, 0, nameLen);
+        String entry = new String(name, 0, nameLen, UTF8);
+        if (visitor.visit(dir, entry, type, length, mtime) &&
+            type == DIRENT_DIRECTORY) {
+          pending.add(new File(dir, entry));
+        }
+        off += (DIRENT_HEADER_LEN + nameLen + 7) & ~7;
+      }
+      buf.clear();
+    }
+  }
+
   /**
    * Result type of the fstat call
    */
@@ -0,0 +1,259 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.apache.hadoop.io.nativeio;
+
+import java.io.Closeable;
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+
+/**
+ * A queue of positional reads and writes that are handed to the kernel in
+ * batches and complete asynchronously. It runs on io_uring where the kernel
+ * supports it, and on Linux AIO otherwise.
+ *
+ * Requests are staged with {@link #add}, sent with a single system call by
+ * {@link #submit}, and collected with {@link #reap}. Each request is
+ * identified by the tag given to add. Buffers must be direct, and must not
+ * be touched until their request has been reaped. The position and limit
+ * of a buffer are read when it is added, and never updated.
+ *
+ * This class is not thread-safe.
+ */
+public class NativeIOQueue implements Closeable {
+  public static final int READ = 0;
+  public static final int WRITE = 1;
+
+  public static final int BACKEND_AUTO = 0;
+  public static final int BACKEND_IO_URING = 1;
+  public static final int BACKEND_AIO = 2;
+
+  private long queue;
+  private final int depth;
+
+  // Per slot: the tag and buffer of the request occupying it
+  private final long[] slotTags;
+  private final ByteBuffer[] slotBufs;
+  private final int[] freeSlots;
+  private int numFree;
+
+  // Requests added but not yet submitted, in the layout submitQueue expects
+  private final int[] pendingOps;
+  private final long[] pendingOffsets;
+  private final FileDescriptor[] pendingFds;
+  private final ByteBuffer[] pendingBufs;
+  private int numPending;
+  private int numInFlight;
+
+  private int[] reapSlots;
+  private long[] reapResults;
+
+  /**
+   * Create a queue allowing up to <code>depth</code> outstanding requests,
+   * on the best backend available.
+   */
+  public NativeIOQueue(int depth) throws IOException {
+    this(depth, BACKEND_AUTO);
+  }
+
+  /**
+   * Create a queue on a particular backend.
+   *
+   * @throws UnsupportedOperationException if the backend is not supported
+   *         by this kernel or build of libhadoop
+   */
+  public NativeIOQueue(int depth, int backend) throws IOException {
+    if (!NativeIO.isAvailable()) {
+      throw new UnsupportedOperationException("NativeIO is not available");
+    }
+    queue = NativeIO.createQueue(depth, backend);
+    this.depth = depth;
+    slotTags = new long[depth];
+    slotBufs = new ByteBuffer[depth];
+    freeSlots = new int[depth];
+    for (int i = 0; i < depth; i++) {
+      freeSlots[i] = depth - 1 - i;
+    }
+    numFree = depth;
+    pendingOps = new int[4 * depth];
+    pendingOffsets = new long[depth];
+    pendingFds = new FileDescriptor[depth];
+    pendingBufs = new ByteBuffer[depth];
+  }
+
+  /**
+   * Return the name of the backend the queue runs on, "io_uring" or "aio".
+   */
+  public String getBackend() {
+    checkOpen();
+    return NativeIO.getQueueBackend(queue) == BACKEND_IO_URING ?
+        "io_uring" : "aio";
+  }
+
+  /** Return the maximum number of outstanding requests. */
+  public int getDepth() {
+    return depth;
+  }
+
+  /** Return the number of requests added but not yet submitted. */
+  public int getPending() {
+    return numPending;
+  }
+
+  /** Return the number of requests submitted but not yet reaped. */
+  public int getInFlight() {
+    return numInFlight;
+  }
+
+  /**
+   * Stage a read into, or a write from, the remaining bytes of a direct
+   * buffer at the given file offset.
+   *
+   * @throws IllegalStateException if depth requests are already outstanding
+   */
+  public void add(int op, FileDescriptor fd, ByteBuffer buf, long offset,
+      long tag) {
+    checkOpen();
+    if (op != READ && op != WRITE) {
+      throw new IllegalArgumentException("Unknown op " + op);
+    }
+    if (!buf.isDirect()) {
+      throw new IllegalArgumentException("buffer must be direct");
+    }
+    if (numFree == 0) {
+      throw new IllegalStateException("Queue is full: " + depth +
+          " requests outstanding");
+    }
+    int slot = freeSlots[--numFree];
+    slotTags[slot] = tag;
+    slotBufs[slot] = buf;
+    pendingOps[4 * numPending] = op;
+    pendingOps[4 * numPending + 1] = slot;
+    pendingOps[4 * numPending + 2] = buf.position();
+    pendingOps[4 * numPending + 3] = buf.remaining();
+    pendingOffsets[numPending] = offset;
+    pendingFds[numPending] = fd;
+    pendingBufs[numPending] = buf;
+    numPending++;
+  }
+
+  /**
+   * Submit the staged requests. If the kernel accepts only some of them,
+   * the rest stay staged for the next call.
+   *
+   * @return the number of requests submitted
+   * @throws IOException if the first staged request was rejected; all the
+   *         staged requests are then discarded
+   */
+  public int submit() throws IOException {
+    checkOpen();
+    if (numPending == 0) {
+      return 0;
+    }
+    int n;
+    try {
+      n = NativeIO.submitQueue(queue, numPending, pendingOps,
+          pendingOffsets, pendingFds, pendingBufs);
+    } catch (IOException e) {
+      discardPending();
+      throw e;
+    }
+    numInFlight += n;
+    numPending -= n;
+    System.arraycopy(pendingOps, 4 * n, pendingOps, 0, 4 * numPending);
+    System.arraycopy(pendingOffsets, n, pendingOffsets, 0, numPending);
+    System.arraycopy(pendingFds, n, pendingFds, 0, numPending);
+    System.arraycopy(pendingBufs, n, pendingBufs, 0, numPending);
+    for (int i = numPending; i < numPending + n; i++) {
+      pendingFds[i] = null;
+      pendingBufs[i] = null;
+    }
+    return n;
+  }
+
+  /**
+   * Collect completed requests, blocking until at least
+   * <code>minComplete</code> are available or nothing is left in flight.
+   *
+   * @param tags     receives the tag of each completed request
+   * @param results  receives the number of bytes transferred by each
+   *                 request, or the negated errno value if it failed
+   * @return the number of completions stored
+   */
+  public int reap(long[] tags, long[] results, int minComplete)
+      throws IOException {
+    checkOpen();
+    int max = Math.min(Math.min(tags.length, results.length), numInFlight);
+    if (max == 0) {
+      return 0;
+    }
+    if (reapSlots == null || reapSlots.length < max) {
+      reapSlots = new int[depth];
+      reapResults = new long[depth];
+    }
+    int n = NativeIO.reapQueue(queue, reapSlots, reapResults, max,
+        Math.min(minComplete, max));
+    for (int i = 0; i < n; i++) {
+      int slot = reapSlots[i];
+      tags[i] = slotTags[slot];
+      results[i] = reapResults[i];
+      slotBufs[slot] = null;
+      freeSlots[numFree++] = slot;
+    }
+    numInFlight -= n;
+    return n;
+  }
+
+  /**
+   * Release the queue. Requests still in flight are waited for first, since
+   * the kernel may otherwise write into buffers that have been freed.
+   */
+  @Override
+  public void close() throws IOException {
+    if (queue == 0) {
+      return;
+    }
+    try {
+      long[] tags = new long[depth];
+      long[] results = new long[depth];
+      while (numInFlight > 0) {
+        reap(tags, results, numInFlight);
+      }
+    } finally {
+      NativeIO.destroyQueue(queue);
+      queue = 0;
+    }
+  }
+
+  private void discardPending() {
+    for (int i = 0; i < numPending; i++) {
+      int slot = pendingOps[4 * i + 1];
+      slotBufs[slot] = null;
+      freeSlots[numFree++] = slot;
+      pendingFds[i] = null;
+      pendingBufs[i] = null;
+    }
+    numPending = 0;
+  }
+
+  private void checkOpen() {
+    if (queue == 0) {
+      throw new IllegalStateException("Queue is closed");
+    }
+  }
+}
@@ -545,6 +545,42 @@ void genSetupRTIFields(CodeBuffer cb) {
       cb.append("}\n");
     }
     
+    void genSerializeFields(CodeBuffer cb) {
+      cb.append(Consts.RECORD_OUTPUT + ".startRecord(*this," + 
+          Consts.TAG + ");\n");
+      for (Iterator<JField<CppType>> i = fields.iterator(); i.hasNext();) {
+        JField<CppType> jf = i.next();
+        String name = jf.getName();
+        CppType type = jf.getType();
+        if (type instanceof JBuffer.CppBuffer) {
+          cb.append(Consts.RECORD_OUTPUT + ".serialize("+name+","+name+
+              ".length(),\""+name+"\");\n");
+        } else {
+          cb.append(Consts.RECORD_OUTPUT + ".serialize("+name+",\""+
+              name+"\");\n");
+        }
+      }
+      cb.append(Consts.RECORD_OUTPUT + ".endRecord(*this," + Consts.TAG + ");\n");
+    }
+
+    void genDeserializeFields(CodeBuffer cb) {
+      cb.append(Consts.RECORD_INPUT + ".startRecord(*this," + 
+          Consts.TAG + ");\n");
+      for (Iterator<JField<CppType>> i = fields.iterator(); i.hasNext();) {
+        JField<CppType> jf = i.next();
+        String name = jf.getName();
+        CppType type = jf.getType();
+        if (type instanceof JBuffer.CppBuffer) {
+          cb.append("{\nsize_t len=0; " + Consts.RECORD_INPUT + ".deserialize("+
+              name+",len,\""+name+"\");\n}\n");
+        } else {
+          cb.append(Consts.RECORD_INPUT + ".deserialize("+name+",\""+
+              name+"\");\n");
+        }
+      }
+      cb.append(Consts.RECORD_INPUT + ".endRecord(*this," + Consts.TAG + ");\n");
+    }
+
     void genCode(FileWriter hh, FileWriter cc, ArrayList<String> options)
       throws IOException {
       CodeBuffer hb = new CodeBuffer();
@@ -592,6 +628,20 @@ void genCode(FileWriter hh, FileWriter cc, ArrayList<String> options)
         CppType type = jf.getType();
         type.genGetSet(hb, name);
       }
+      // The same code as serialize() and deserialize() for any archive
+      // type, so that archives without virtual functions such as
+      // ::hadoop::OStaticBinArchive can have it inlined. Type filters are
+      // not applied.
+      hb.append("template <class A>\n");
+      hb.append("void serializeTo(A& " + Consts.RECORD_OUTPUT + 
+          ", const char* " + Consts.TAG + ") const {\n");
+      genSerializeFields(hb);
+      hb.append("}\n");
+      hb.append("template <class A>\n");
+      hb.append("void deserializeFrom(A& " + Consts.RECORD_INPUT + 
+          ", const char* " + Consts.TAG + ") {\n");
+      genDeserializeFields(hb);
+      hb.append("}\n");
       hb.append("}; // end record "+name+"\n");
       for (int i=ns.length-1; i>=0; i--) {
         hb.append("} // end namespace "+ns[i]+"\n");
@@ -657,42 +707,14 @@ void genCode(FileWriter hh, FileWriter cc, ArrayList<String> options)
       // serialize()
       cb.append("void "+fullName+"::serialize(::hadoop::OArchive& " + 
           Consts.RECORD_OUTPUT + ", const char* " + Consts.TAG + ") const {\n");
-      cb.append(Consts.RECORD_OUTPUT + ".startRecord(*this," + 
-          Consts.TAG + ");\n");
-      for (Iterator<JField<CppType>> i = fields.iterator(); i.hasNext();) {
-        JField<CppType> jf = i.next();
-        String name = jf.getName();
-        CppType type = jf.getType();
-        if (type instanceof JBuffer.CppBuffer) {
-          cb.append(Consts.RECORD_OUTPUT + ".serialize("+name+","+name+
-              ".length(),\""+name+"\");\n");
-        } else {
-          cb.append(Consts.RECORD_OUTPUT + ".serialize("+name+",\""+
-              name+"\");\n");
-        }
-      }
-      cb.append(Consts.RECORD_OUTPUT + ".endRecord(*this," + Consts.TAG + ");\n");
+      genSerializeFields(cb);
       cb.append("return;\n");
       cb.append("}\n");
       
       // deserializeWithoutFilter()
       cb.append("void "+fullName+"::deserializeWithoutFilter(::hadoop::IArchive& " +
           Consts.RECORD_INPUT + ", const char* " + Consts.TAG + ") {\n");
-      cb.append(Consts.RECORD_INPUT + ".startRecord(*this," + 
-          Consts.TAG + ");\n");
-      for (Iterator<JField<CppType>> i = fields.iterator(); i.hasNext();) {
-        JField<CppType> jf = i.next();
-        String name = jf.getName();
-        CppType type = jf.getType();
-        if (type instanceof JBuffer.CppBuffer) {
-          cb.append("{\nsize_t len=0; " + Consts.RECORD_INPUT + ".deserialize("+
-              name+",len,\""+name+"\");\n}\n");
-        } else {
-          cb.append(Consts.RECORD_INPUT + ".deserialize("+name+",\""+
-              name+"\");\n");
-        }
-      }
-      cb.append(Consts.RECORD_INPUT + ".endRecord(*this," + Consts.TAG + ");\n");
+      genDeserializeFields(cb);
       cb.append("return;\n");
       cb.append("}\n");
       
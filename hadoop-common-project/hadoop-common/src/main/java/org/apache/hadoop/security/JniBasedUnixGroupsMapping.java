@@ -20,10 +20,16 @@
 
 import java.io.IOException;
 import java.util.Arrays;
+import java.util.HashMap;
 import java.util.List;
+import java.util.Map;
 
 import org.apache.hadoop.classification.InterfaceAudience;
 import org.apache.hadoop.classification.InterfaceStability;
+import org.apache.hadoop.conf.Configurable;
+import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
+import org.apache.hadoop.io.nativeio.NativeIO;
 
 import org.apache.commons.logging.Log;
 import org.apache.commons.logging.LogFactory;
@@ -36,12 +42,23 @@
  */
 @InterfaceAudience.LimitedPrivate({"HDFS", "MapReduce"})
 @InterfaceStability.Evolving
-public class JniBasedUnixGroupsMapping implements GroupMappingServiceProvider {
+public class JniBasedUnixGroupsMapping
+    implements GroupMappingServiceProvider, Configurable {
   
   private static final Log LOG = 
     LogFactory.getLog(JniBasedUnixGroupsMapping.class);
+
+  private Configuration conf;
+  private int batchThreads =
+    CommonConfigurationKeys.HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_DEFAULT;
   
   native String[] getGroupForUser(String user);
+
+  /**
+   * Resolve the groups of each user, on up to <code>threads</code> native
+   * threads. A user that cannot be resolved gets an empty array.
+   */
+  native String[][] getGroupsForUsers(String[] users, int threads);
   
   static {
     if (!NativeCodeLoader.isNativeCodeLoaded()) {
@@ -66,6 +83,42 @@ public List<String> getGroups(String user) throws IOException {
     return Arrays.asList(groups);
   }
 
+  /**
+   * Resolve the groups of many users with a single native call, looking
+   * them up in parallel. This is much faster than calling
+   * {@link #getGroups(String)} for each when populating a cold cache.
+   * Users that cannot be resolved map to an empty list.
+   */
+  public Map<String, List<String>> getGroups(List<String> users)
+      throws IOException {
+    String[] userArray = users.toArray(new String[users.size()]);
+    String[][] groups = getGroupsForUsers(userArray, batchThreads);
+    Map<String, List<String>> result =
+      new HashMap<String, List<String>>(userArray.length * 2);
+    for (int i = 0; i < userArray.length; i++) {
+      result.put(userArray[i], Arrays.asList(groups[i]));
+    }
+    return result;
+  }
+
+  @Override
+  public void setConf(Configuration conf) {
+    this.conf = conf;
+    batchThreads = conf.getInt(
+      CommonConfigurationKeys.HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_KEY,
+      CommonConfigurationKeys.HADOOP_SECURITY_GROUP_MAPPING_BATCH_THREADS_DEFAULT);
+    // NSS modules that are not thread-safe must not be entered concurrently
+    if (conf.getBoolean(NativeIO.WORKAROUND_NON_THREADSAFE_CALLS_KEY,
+        NativeIO.WORKAROUND_NON_THREADSAFE_CALLS_DEFAULT)) {
+      batchThreads = 1;
+    }
+  }
+
+  @Override
+  public Configuration getConf() {
+    return conf;
+  }
+
   @Override
   public void cacheGroupsRefresh() throws IOException {
     // does nothing in this provider of user to groups mapping
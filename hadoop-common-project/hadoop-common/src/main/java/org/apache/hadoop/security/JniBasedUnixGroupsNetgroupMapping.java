@@ -19,6 +19,7 @@
 package org.apache.hadoop.security;
 
 import java.io.IOException;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
 import java.util.LinkedList;
@@ -47,6 +48,12 @@
 
   native String[] getUsersForNetgroupJNI(String group);
 
+  /**
+   * Resolve the users of each netgroup, all in one call. Group names are
+   * given without the leading '@'.
+   */
+  native String[][] getUsersForNetgroupsJNI(String[] groups);
+
   static {
     if (!NativeCodeLoader.isNativeCodeLoaded()) {
       throw new RuntimeException("Bailing out since native library couldn't " +
@@ -72,13 +79,17 @@ public List<String> getGroups(String user) throws IOException {
   }
 
   /**
-   * Refresh the netgroup cache
+   * Refresh the netgroup cache. All cached netgroups are resolved with one
+   * native call and updated in place, so lookups made during the refresh
+   * still see the old membership rather than none.
    */
   @Override
   public void cacheGroupsRefresh() throws IOException {
     List<String> groups = NetgroupCache.getNetgroupNames();
-    NetgroupCache.clear();
-    cacheGroupsAdd(groups);
+    List<List<String>> users = getUsersForNetgroups(groups);
+    for (int i = 0; i < groups.size(); i++) {
+      NetgroupCache.update(groups.get(i), users.get(i));
+    }
   }
 
   /**
@@ -88,17 +99,22 @@ public void cacheGroupsRefresh() throws IOException {
    */
   @Override
   public void cacheGroupsAdd(List<String> groups) throws IOException {
+    List<String> netgroups = new ArrayList<String>();
     for(String group: groups) {
       if(group.length() == 0) {
         // better safe than sorry (should never happen)
       } else if(group.charAt(0) == '@') {
         if(!NetgroupCache.isCached(group)) {
-          NetgroupCache.add(group, getUsersForNetgroup(group));
+          netgroups.add(group);
         }
       } else {
         // unix group, not caching
       }
     }
+    List<List<String>> users = getUsersForNetgroups(netgroups);
+    for (int i = 0; i < netgroups.size(); i++) {
+      NetgroupCache.add(netgroups.get(i), users.get(i));
+    }
   }
 
   /**
@@ -127,4 +143,44 @@ protected synchronized List<String> getUsersForNetgroup(String netgroup) {
     }
     return new LinkedList<String>();
   }
+
+  /**
+   * Calls JNI function to get the users of many netgroups at once. This is
+   * synchronized for the same reason as {@link #getUsersForNetgroup}.
+   *
+   * @param netgroups return users for these netgroups
+   * @return the list of users of each netgroup, in the same order; a
+   *         netgroup that could not be resolved has no users
+   */
+  protected synchronized List<List<String>> getUsersForNetgroups(
+      List<String> netgroups) {
+    List<List<String>> result = new ArrayList<List<String>>(netgroups.size());
+    if (netgroups.isEmpty()) {
+      return result;
+    }
+    String[] names = new String[netgroups.size()];
+    for (int i = 0; i < names.length; i++) {
+      // JNI code does not expect '@' at the begining of the group name
+      names[i] = netgroups.get(i).substring(1);
+    }
+    String[][] users = null;
+    try {
+      users = getUsersForNetgroupsJNI(names);
+    } catch (Exception e) {
+      if (LOG.isDebugEnabled()) {
+        LOG.debug("Error getting users for netgroups " + netgroups, e);
+      } else {
+        LOG.info("Error getting users for netgroups " + netgroups +
+            ": " + e.getMessage());
+      }
+    }
+    for (int i = 0; i < names.length; i++) {
+      if (users != null && users[i].length != 0) {
+        result.add(Arrays.asList(users[i]));
+      } else {
+        result.add(new LinkedList<String>());
+      }
+    }
+    return result;
+  }
 }
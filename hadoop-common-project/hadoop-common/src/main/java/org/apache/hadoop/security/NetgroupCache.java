@@ -42,10 +42,11 @@ public class NetgroupCache {
 
   private static final Log LOG = LogFactory.getLog(NetgroupCache.class);
 
-  private static boolean netgroupToUsersMapUpdated = true;
   private static Map<String, Set<String>> netgroupToUsersMap =
     new ConcurrentHashMap<String, Set<String>>();
 
+  // Kept in step with netgroupToUsersMap by the (synchronized) writers.
+  // Each set is replaced rather than modified, so readers need no lock.
   private static Map<String, Set<String>> userToNetgroupsMap =
     new ConcurrentHashMap<String, Set<String>>();
 
@@ -58,26 +59,23 @@ public class NetgroupCache {
    */
   public static void getNetgroups(final String user,
       List<String> groups) {
-    if(netgroupToUsersMapUpdated) {
-      netgroupToUsersMapUpdated = false; // at the beginning to avoid race
-      //update userToNetgroupsMap
-      for(String netgroup : netgroupToUsersMap.keySet()) {
-        for(String netuser : netgroupToUsersMap.get(netgroup)) {
-          // add to userToNetgroupsMap
-          if(!userToNetgroupsMap.containsKey(netuser)) {
-            userToNetgroupsMap.put(netuser, new HashSet<String>());
-          }
-          userToNetgroupsMap.get(netuser).add(netgroup);
-        }
-      }
-    }
-    if(userToNetgroupsMap.containsKey(user)) {
-      for(String netgroup : userToNetgroupsMap.get(user)) {
-        groups.add(netgroup);
-      }
+    Set<String> netgroups = userToNetgroupsMap.get(user);
+    if(netgroups != null) {
+      groups.addAll(netgroups);
     }
   }
 
+  /**
+   * Returns true if a user is a member of a cached netgroup
+   *
+   * @param user the user to check
+   * @param group the netgroup, including the leading '@'
+   */
+  public static boolean isUserInNetgroup(String user, String group) {
+    Set<String> netgroups = userToNetgroupsMap.get(user);
+    return netgroups != null && netgroups.contains(group);
+  }
+
   /**
    * Get the list of cached netgroups
    *
@@ -100,8 +98,9 @@ public static boolean isCached(String group) {
   /**
    * Clear the cache
    */
-  public static void clear() {
+  public static synchronized void clear() {
     netgroupToUsersMap.clear();
+    userToNetgroupsMap.clear();
   }
 
   /**
@@ -110,13 +109,46 @@ public static void clear() {
    * @param group name of the group to add to cache
    * @param users list of users for a given group
    */
-  public static void add(String group, List<String> users) {
+  public static synchronized void add(String group, List<String> users) {
     if(!isCached(group)) {
-      netgroupToUsersMap.put(group, new HashSet<String>());
-      for(String user: users) {
-        netgroupToUsersMap.get(group).add(user);
+      update(group, users);
+    }
+  }
+
+  /**
+   * Set the members of a group, adding it to the cache if it is not there.
+   * Only the users that joined or left the group are touched, so a refresh
+   * does not empty the cache while it runs.
+   *
+   * @param group name of the group
+   * @param users the current list of users of the group
+   */
+  public static synchronized void update(String group, List<String> users) {
+    Set<String> oldUsers = netgroupToUsersMap.get(group);
+    Set<String> newUsers = new HashSet<String>(users);
+    if(oldUsers != null) {
+      for(String user : oldUsers) {
+        if(!newUsers.contains(user)) {
+          Set<String> netgroups =
+            new HashSet<String>(userToNetgroupsMap.get(user));
+          netgroups.remove(group);
+          if(netgroups.isEmpty()) {
+            userToNetgroupsMap.remove(user);
+          } else {
+            userToNetgroupsMap.put(user, netgroups);
+          }
+        }
+      }
+    }
+    for(String user : newUsers) {
+      if(oldUsers == null || !oldUsers.contains(user)) {
+        Set<String> current = userToNetgroupsMap.get(user);
+        Set<String> netgroups = current == null ?
+          new HashSet<String>() : new HashSet<String>(current);
+        netgroups.add(group);
+        userToNetgroupsMap.put(user, netgroups);
       }
     }
-    netgroupToUsersMapUpdated = true; // at the end to avoid race
+    netgroupToUsersMap.put(group, newUsers);
   }
 }
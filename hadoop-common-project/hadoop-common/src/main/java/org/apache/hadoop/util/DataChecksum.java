@@ -45,6 +45,7 @@ public class DataChecksum implements Checksum {
   public static final int CHECKSUM_CRC32C  = 2;
   public static final int CHECKSUM_DEFAULT = 3; 
   public static final int CHECKSUM_MIXED   = 4;
+  public static final int CHECKSUM_XXHASH64 = 5;
  
   /** The checksum types */
   public static enum Type {
@@ -52,7 +53,9 @@ public static enum Type {
     CRC32 (CHECKSUM_CRC32, 4),
     CRC32C(CHECKSUM_CRC32C, 4),
     DEFAULT(CHECKSUM_DEFAULT, 0), // This cannot be used to create DataChecksum
-    MIXED (CHECKSUM_MIXED, 0); // This cannot be used to create DataChecksum
+    MIXED (CHECKSUM_MIXED, 0), // This cannot be used to create DataChecksum
+    // Corruption detection only, for data that never goes to HDFS
+    XXHASH64(CHECKSUM_XXHASH64, 4);
 
     public final int id;
     public final int size;
@@ -85,6 +88,8 @@ public static DataChecksum newDataChecksum(Type type, int bytesPerChecksum ) {
       return new DataChecksum(type, new PureJavaCrc32(), bytesPerChecksum );
     case CRC32C:
       return new DataChecksum(type, new PureJavaCrc32C(), bytesPerChecksum);
+    case XXHASH64:
+      return new DataChecksum(type, new XXHash64Checksum(), bytesPerChecksum);
     default:
       return null;  
     }
@@ -376,6 +381,11 @@ public void calculateChunkedSums(ByteBuffer data, ByteBuffer checksums) {
           checksums.array(), checksums.arrayOffset() + checksums.position());
       return;
     }
+    if (NativeCrc32.isAvailable()) {
+      NativeCrc32.calculateChunkedSums(bytesPerChecksum, type.id,
+          checksums, data);
+      return;
+    }
     
     data.mark();
     checksums.mark();
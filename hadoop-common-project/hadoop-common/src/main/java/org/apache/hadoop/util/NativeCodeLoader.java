@@ -79,6 +79,16 @@ public static boolean isNativeCodeLoaded() {
    */
   public static native boolean buildSupportsSnappy();
 
+  /**
+   * Returns true only if this build was compiled with support for zstd.
+   */
+  public static native boolean buildSupportsZstd();
+
+  /**
+   * Returns true only if this build was compiled with support for bzip2.
+   */
+  public static native boolean buildSupportsBzip2();
+
   /**
    * Return if native hadoop libraries, if present, can be used for this job.
    * @param conf configuration
@@ -17,6 +17,8 @@
  */
 package org.apache.hadoop.util;
 
+import java.io.FileDescriptor;
+import java.io.IOException;
 import java.nio.ByteBuffer;
 
 import org.apache.hadoop.fs.ChecksumException;
@@ -60,14 +62,204 @@ public static void verifyChunkedSums(int bytesPerSum, int checksumType,
         fileName, basePos);
   }
   
+  /**
+   * Verify several pairs of data and checksum buffers in a single native
+   * call, and throw an exception for the first invalid checksum found.
+   * This is equivalent to calling
+   * {@link #verifyChunkedSums(int, int, ByteBuffer, ByteBuffer, String, long)}
+   * on each pair in turn, but it crosses into native code only once, which
+   * matters when the buffers are small. The position, limit, and mark of the
+   * buffers are not modified.
+   *
+   * @param bytesPerSum the chunk size (eg 512 bytes)
+   * @param checksumType the DataChecksum type constant
+   * @param sums the DirectByteBuffers pointing at the beginning of the
+   *             stored checksums for each data buffer
+   * @param data the DirectByteBuffers pointing at the beginning of the
+   *             data to check
+   * @param fileName the name of the file being verified
+   * @param basePositions the position in the file where each data buffer
+   *                      starts
+   * @throws ChecksumException if there is an invalid checksum
+   */
+  public static void verifyChunkedSumsBatch(int bytesPerSum, int checksumType,
+      ByteBuffer[] sums, ByteBuffer[] data, String fileName,
+      long[] basePositions) throws ChecksumException {
+    int count = data.length;
+    if (sums.length != count || basePositions.length != count) {
+      throw new IllegalArgumentException("Mismatched batch lengths: " +
+          sums.length + " checksum buffers, " + count + " data buffers, " +
+          basePositions.length + " positions");
+    }
+    int[] sumsOffsets = new int[count];
+    int[] dataOffsets = new int[count];
+    int[] dataLengths = new int[count];
+    for (int i = 0; i < count; i++) {
+      sumsOffsets[i] = sums[i].position();
+      dataOffsets[i] = data[i].position();
+      dataLengths[i] = data[i].remaining();
+    }
+    nativeVerifyChunkedSumsBatch(bytesPerSum, checksumType,
+        sums, sumsOffsets, data, dataOffsets, dataLengths,
+        fileName, basePositions);
+  }
+
+  /**
+   * Calculate checksums for the given data and store them in the given
+   * checksum buffer. The buffers given to this function should have their
+   * position initially at the start of the data, and their limit set at the
+   * end of the data. The position, limit, and mark are not modified.
+   *
+   * @param bytesPerSum the chunk size (eg 512 bytes)
+   * @param checksumType the DataChecksum type constant
+   * @param sums the DirectByteBuffer into which the checksums will be
+   *             written. It must have room for one 4-byte checksum per
+   *             chunk of data.
+   * @param data the DirectByteBuffer pointing at the beginning of the
+   *             data to checksum
+   */
+  public static void calculateChunkedSums(int bytesPerSum, int checksumType,
+      ByteBuffer sums, ByteBuffer data) {
+    nativeComputeChunkedSums(bytesPerSum, checksumType,
+        sums, sums.position(),
+        data, data.position(), data.remaining());
+  }
+
+  /**
+   * Copy the given data into another direct buffer, verifying its checksums
+   * in the same pass, and throw an exception if any checksum is invalid.
+   * This reads the data from memory only once. The positions, limits and
+   * marks of the buffers are not modified.
+   *
+   * @param bytesPerSum the chunk size (eg 512 bytes)
+   * @param checksumType the DataChecksum type constant
+   * @param sums the DirectByteBuffer pointing at the beginning of the
+   *             stored checksums
+   * @param data the DirectByteBuffer pointing at the beginning of the
+   *             data to check
+   * @param dst the DirectByteBuffer to copy the data into, starting at its
+   *            position. It must have data.remaining() bytes remaining.
+   * @param basePos the position in the file where the data buffer starts
+   * @param fileName the name of the file being verified
+   * @throws ChecksumException if there is an invalid checksum. The contents
+   *         of dst are then unspecified.
+   */
+  public static void copyAndVerifyChunkedSums(int bytesPerSum,
+      int checksumType, ByteBuffer sums, ByteBuffer data, ByteBuffer dst,
+      String fileName, long basePos) throws ChecksumException {
+    nativeCopyAndVerifyChunkedSums(bytesPerSum, checksumType,
+        sums, sums.position(),
+        data, data.position(), data.remaining(),
+        dst, dst.position(),
+        fileName, basePos);
+  }
+
+  /**
+   * Copy the given data into another direct buffer, calculating its
+   * checksums in the same pass. The positions, limits and marks of the
+   * buffers are not modified.
+   *
+   * @param bytesPerSum the chunk size (eg 512 bytes)
+   * @param checksumType the DataChecksum type constant
+   * @param sums the DirectByteBuffer into which the checksums will be
+   *             written
+   * @param data the DirectByteBuffer pointing at the beginning of the
+   *             data to checksum
+   * @param dst the DirectByteBuffer to copy the data into, starting at its
+   *            position. It must have data.remaining() bytes remaining.
+   */
+  public static void copyAndCalculateChunkedSums(int bytesPerSum,
+      int checksumType, ByteBuffer sums, ByteBuffer data, ByteBuffer dst) {
+    nativeCopyAndComputeChunkedSums(bytesPerSum, checksumType,
+        sums, sums.position(),
+        data, data.position(), data.remaining(),
+        dst, dst.position());
+  }
+
+  /**
+   * Verify a range of a block file against the checksums in its meta file,
+   * without reading either into the Java heap. Both files are memory-mapped
+   * and verified in place.
+   *
+   * @param bytesPerSum the chunk size (eg 512 bytes)
+   * @param checksumType the DataChecksum type constant
+   * @param dataFd the open block file
+   * @param dataOffset the offset in the block file at which to start. This
+   *                   must be at a chunk boundary.
+   * @param dataLength the number of bytes of the block file to verify
+   * @param metaFd the open meta file
+   * @param sumsOffset the offset in the meta file of the checksum of the
+   *                   chunk at dataOffset
+   * @param fileName the name of the block file, for error messages
+   * @return the offset in the block file of the first chunk whose checksum
+   *         does not match, or -1 if all the checksums are valid
+   * @throws IOException if the files could not be mapped
+   */
+  public static long verifyChunkedSumsInFile(int bytesPerSum,
+      int checksumType, FileDescriptor dataFd, long dataOffset,
+      long dataLength, FileDescriptor metaFd, long sumsOffset,
+      String fileName) throws IOException {
+    return nativeVerifyChunkedSumsInFile(bytesPerSum, checksumType,
+        dataFd, dataOffset, dataLength, metaFd, sumsOffset, fileName);
+  }
+
+  /**
+   * Configure multi-threaded verification in
+   * {@link #verifyChunkedSums(int, int, ByteBuffer, ByteBuffer, String, long)}.
+   * Data buffers of at least minLength bytes are split across a pool of
+   * numThreads native threads plus the calling thread. The reported checksum
+   * error, if any, is still the first bad chunk in the buffer.
+   *
+   * @param numThreads the number of native worker threads, or 0 to verify
+   *                   on the calling thread only
+   * @param minLength the smallest data buffer, in bytes, to split up
+   */
+  public static void setVerifyParallelism(int numThreads, int minLength) {
+    nativeSetVerifyParallelism(numThreads, minLength);
+  }
+
   private static native void nativeVerifyChunkedSums(
       int bytesPerSum, int checksumType,
       ByteBuffer sums, int sumsOffset,
       ByteBuffer data, int dataOffset, int dataLength,
       String fileName, long basePos);
 
+  private static native void nativeVerifyChunkedSumsBatch(
+      int bytesPerSum, int checksumType,
+      ByteBuffer[] sums, int[] sumsOffsets,
+      ByteBuffer[] data, int[] dataOffsets, int[] dataLengths,
+      String fileName, long[] basePositions);
+
+  private static native void nativeComputeChunkedSums(
+      int bytesPerSum, int checksumType,
+      ByteBuffer sums, int sumsOffset,
+      ByteBuffer data, int dataOffset, int dataLength);
+
+  private static native void nativeCopyAndVerifyChunkedSums(
+      int bytesPerSum, int checksumType,
+      ByteBuffer sums, int sumsOffset,
+      ByteBuffer data, int dataOffset, int dataLength,
+      ByteBuffer dst, int dstOffset,
+      String fileName, long basePos);
+
+  private static native void nativeCopyAndComputeChunkedSums(
+      int bytesPerSum, int checksumType,
+      ByteBuffer sums, int sumsOffset,
+      ByteBuffer data, int dataOffset, int dataLength,
+      ByteBuffer dst, int dstOffset);
+
+  private static native long nativeVerifyChunkedSumsInFile(
+      int bytesPerSum, int checksumType,
+      FileDescriptor dataFd, long dataOffset, long dataLength,
+      FileDescriptor metaFd, long sumsOffset,
+      String fileName) throws IOException;
+
+  private static native void nativeSetVerifyParallelism(
+      int numThreads, int minLength);
+
   // Copy the constants over from DataChecksum so that javah will pick them up
   // and make them available in the native code header.
   public static final int CHECKSUM_CRC32 = DataChecksum.CHECKSUM_CRC32;
   public static final int CHECKSUM_CRC32C = DataChecksum.CHECKSUM_CRC32C;
+  public static final int CHECKSUM_XXHASH64 = DataChecksum.CHECKSUM_XXHASH64;
 }
@@ -0,0 +1,168 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.apache.hadoop.util;
+
+import java.util.zip.Checksum;
+
+import org.apache.hadoop.classification.InterfaceAudience;
+import org.apache.hadoop.classification.InterfaceStability;
+
+/**
+ * A pure-java implementation of xxHash64 with seed 0, as a
+ * {@link Checksum} whose value is the low 32 bits of the hash. This is
+ * the fallback for {@link DataChecksum.Type#XXHASH64} when the native
+ * code is not loaded, and gives the same sums.
+ *
+ * xxHash is not a CRC: it detects corruption, but sums of this type
+ * cannot be checked by anything that expects CRC32 or CRC32C.
+ */
+@InterfaceAudience.LimitedPrivate({"HDFS", "MapReduce"})
+@InterfaceStability.Evolving
+public class XXHash64Checksum implements Checksum {
+
+  private static final long PRIME64_1 = 0x9E3779B185EBCA87L;
+  private static final long PRIME64_2 = 0xC2B2AE3D27D4EB4FL;
+  private static final long PRIME64_3 = 0x165667B19E3779F9L;
+  private static final long PRIME64_4 = 0x85EBCA77C2B2AE63L;
+  private static final long PRIME64_5 = 0x27D4EB2F165667C5L;
+
+  /** the four lanes over whole 32-byte stripes */
+  private long v1, v2, v3, v4;
+  /** bytes of the current stripe that have not been consumed yet */
+  private final byte[] stripe = new byte[32];
+  private int stripeLen;
+  private long totalLen;
+
+  /** Create a new XXHash64Checksum object. */
+  public XXHash64Checksum() {
+    reset();
+  }
+
+  @Override
+  public long getValue() {
+    long h;
+    if (totalLen >= 32) {
+      h = Long.rotateLeft(v1, 1) + Long.rotateLeft(v2, 7) +
+          Long.rotateLeft(v3, 12) + Long.rotateLeft(v4, 18);
+      h = mergeRound(h, v1);
+      h = mergeRound(h, v2);
+      h = mergeRound(h, v3);
+      h = mergeRound(h, v4);
+    } else {
+      h = PRIME64_5;
+    }
+    h += totalLen;
+
+    int p = 0;
+    while (p + 8 <= stripeLen) {
+      h ^= round(0, readLong(stripe, p));
+      h = Long.rotateLeft(h, 27) * PRIME64_1 + PRIME64_4;
+      p += 8;
+    }
+    if (p + 4 <= stripeLen) {
+      h ^= (readInt(stripe, p) & 0xffffffffL) * PRIME64_1;
+      h = Long.rotateLeft(h, 23) * PRIME64_2 + PRIME64_3;
+      p += 4;
+    }
+    while (p < stripeLen) {
+      h ^= (stripe[p] & 0xff) * PRIME64_5;
+      h = Long.rotateLeft(h, 11) * PRIME64_1;
+      p++;
+    }
+
+    h ^= h >>> 33;
+    h *= PRIME64_2;
+    h ^= h >>> 29;
+    h *= PRIME64_3;
+    h ^= h >>> 32;
+    return h & 0xffffffffL;
+  }
+
+  @Override
+  public void reset() {
+    v1 = PRIME64_1 + PRIME64_2;
+    v2 = PRIME64_2;
+    v3 = 0;
+    v4 = -PRIME64_1;
+    stripeLen = 0;
+    totalLen = 0;
+  }
+
+  @Override
+  public void update(byte[] b, int off, int len) {
+    totalLen += len;
+    if (stripeLen > 0) {
+      int n = Math.min(len, 32 - stripeLen);
+      System.arraycopy(b, off, stripe, stripeLen, n);
+      stripeLen += n;
+      off += n;
+      len -= n;
+      if (stripeLen < 32) {
+        return;
+      }
+      consumeStripe(stripe, 0);
+      stripeLen = 0;
+    }
+    while (len >= 32) {
+      consumeStripe(b, off);
+      off += 32;
+      len -= 32;
+    }
+    System.arraycopy(b, off, stripe, 0, len);
+    stripeLen = len;
+  }
+
+  @Override
+  public void update(int b) {
+    stripe[stripeLen++] = (byte) b;
+    totalLen++;
+    if (stripeLen == 32) {
+      consumeStripe(stripe, 0);
+      stripeLen = 0;
+    }
+  }
+
+  private void consumeStripe(byte[] b, int off) {
+    v1 = round(v1, readLong(b, off));
+    v2 = round(v2, readLong(b, off + 8));
+    v3 = round(v3, readLong(b, off + 16));
+    v4 = round(v4, readLong(b, off + 24));
+  }
+
+  private static long round(long acc, long input) {
+    acc += input * PRIME64_2;
+    acc = Long.rotateLeft(acc, 31);
+    return acc * PRIME64_1;
+  }
+
+  private static long mergeRound(long acc, long val) {
+    acc ^= round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+  }
+
+  /** The hash is defined on little-endian words. */
+  private static long readLong(byte[] b, int off) {
+    return (readInt(b, off) & 0xffffffffL) |
+        ((long) readInt(b, off + 4) << 32);
+  }
+
+  private static int readInt(byte[] b, int off) {
+    return (b[off] & 0xff) | (b[off + 1] & 0xff) << 8 |
+        (b[off + 2] & 0xff) << 16 | (b[off + 3] & 0xff) << 24;
+  }
+}
@@ -0,0 +1,238 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "org_apache_hadoop_io_compress_bzip2.h"
+#include "org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor.h"
+#include "bzip2_parallel.h"
+
+/*
+ * The native half of a Bzip2Decompressor: a plain bz_stream when it
+ * decompresses on the calling thread, or a parallel engine otherwise.
+ */
+struct bzip2_decompressor {
+	bz_stream strm;
+	struct bz2_parallel *par;
+	jlong bytes_read;
+	jlong bytes_written;
+};
+
+static struct bz2_funcs bz2_funcs;
+
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_initIDs(
+	JNIEnv *env, jclass class, jstring libname
+	) {
+	const char *bzlib_name = NULL;
+	void *libbz2;
+
+	if (libname) {
+		bzlib_name = (*env)->GetStringUTFChars(env, libname, NULL);
+		if (!bzlib_name) {
+			return; // JVM throws Exception for us
+		}
+	}
+	// Load libbz2.so, or the library configured in its place
+	libbz2 = dlopen(bzlib_name && *bzlib_name ? bzlib_name : HADOOP_BZIP2_LIBRARY,
+	                RTLD_LAZY | RTLD_GLOBAL);
+	if (!libbz2) {
+		char msg[1000];
+		snprintf(msg, sizeof(msg), "Cannot load %s (%s)!",
+		         bzlib_name && *bzlib_name ? bzlib_name : HADOOP_BZIP2_LIBRARY,
+		         dlerror());
+		if (bzlib_name) {
+			(*env)->ReleaseStringUTFChars(env, libname, bzlib_name);
+		}
+		THROW(env, "java/lang/UnsatisfiedLinkError", msg);
+		return;
+	}
+	if (bzlib_name) {
+		(*env)->ReleaseStringUTFChars(env, libname, bzlib_name);
+	}
+
+	// Locate the requisite symbols from libbz2.so
+	dlerror();                                 // Clear any existing error
+	LOAD_DYNAMIC_SYMBOL(bz2_funcs.decompress_init, env, libbz2, "BZ2_bzDecompressInit");
+	LOAD_DYNAMIC_SYMBOL(bz2_funcs.decompress, env, libbz2, "BZ2_bzDecompress");
+	LOAD_DYNAMIC_SYMBOL(bz2_funcs.decompress_end, env, libbz2, "BZ2_bzDecompressEnd");
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_init(
+	JNIEnv *env, jclass class, jint threads
+	) {
+	struct bzip2_decompressor *d = calloc(1, sizeof(*d));
+	if (!d) {
+		THROW(env, "java/lang/OutOfMemoryError", NULL);
+		return (jlong)0;
+	}
+
+	int rv = threads > 1
+		? bz2_parallel_create(&bz2_funcs, threads, &d->par)
+		: bz2_funcs.decompress_init(&d->strm, 0, 0);
+	if (rv != BZ_OK) {
+		free(d);
+		switch (rv) {
+		case BZ_MEM_ERROR:
+			THROW(env, "java/lang/OutOfMemoryError", NULL);
+			break;
+		default:
+			THROW(env, "java/lang/InternalError", NULL);
+			break;
+		}
+		return (jlong)0;
+	}
+	return JLONG(d);
+}
+
+/*
+ * Layout of the value returned by decompressDirect, as for
+ * ZlibDecompressor.inflateDirect: the bytes of output produced, the bytes
+ * of input consumed and the stream state packed into one jlong.
+ */
+#define DECOMPRESS_COUNT_BITS 30
+#define DECOMPRESS_STREAM_END ((jlong)1 << 60)
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_decompressDirect(
+	JNIEnv *env, jclass class, jlong stream,
+	jobject compressed_direct_buf, jint compressed_direct_buf_off,
+	jint compressed_direct_buf_len,
+	jobject uncompressed_direct_buf, jint uncompressed_direct_buf_off,
+	jint uncompressed_direct_buf_len
+	) {
+	struct bzip2_decompressor *d = BZ2_HANDLE(stream);
+	if (!d) {
+		THROW(env, "java/lang/NullPointerException", NULL);
+		return (jlong)0;
+	}
+
+	// Get the input direct buffer
+	char *compressed_bytes = (*env)->GetDirectBufferAddress(env,
+										compressed_direct_buf);
+	if (!compressed_bytes) {
+		return (jlong)0;
+	}
+
+	// Get the output direct buffer
+	char *uncompressed_bytes = (*env)->GetDirectBufferAddress(env,
+										uncompressed_direct_buf);
+	if (!uncompressed_bytes) {
+		return (jlong)0;
+	}
+
+	size_t consumed, produced;
+	int rv;
+	if (d->par) {
+		rv = bz2_parallel_decompress(d->par,
+				compressed_bytes + compressed_direct_buf_off,
+				compressed_direct_buf_len, &consumed,
+				uncompressed_bytes + uncompressed_direct_buf_off,
+				uncompressed_direct_buf_len, &produced);
+	} else {
+		bz_stream *strm = &d->strm;
+		strm->next_in = compressed_bytes + compressed_direct_buf_off;
+		strm->avail_in = compressed_direct_buf_len;
+		strm->next_out = uncompressed_bytes + uncompressed_direct_buf_off;
+		strm->avail_out = uncompressed_direct_buf_len;
+		rv = bz2_funcs.decompress(strm);
+		consumed = compressed_direct_buf_len - strm->avail_in;
+		produced = uncompressed_direct_buf_len - strm->avail_out;
+	}
+
+	// Contingency? - Report error by throwing appropriate exceptions
+	jlong result = 0;
+	switch (rv) {
+	case BZ_STREAM_END:
+		result |= DECOMPRESS_STREAM_END;
+		// cascade
+	case BZ_OK:
+		d->bytes_read += consumed;
+		d->bytes_written += produced;
+		result |= (jlong)produced;
+		result |= (jlong)consumed << DECOMPRESS_COUNT_BITS;
+		break;
+	case BZ_DATA_ERROR:
+	case BZ_DATA_ERROR_MAGIC:
+		THROW(env, "java/io/IOException", "Corrupt bzip2 data");
+		break;
+	case BZ_MEM_ERROR:
+		THROW(env, "java/lang/OutOfMemoryError", NULL);
+		break;
+	default:
+		THROW(env, "java/lang/InternalError", NULL);
+		break;
+	}
+	return result;
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_getBytesRead(
+	JNIEnv *env, jclass class, jlong stream
+	) {
+	return ((struct bzip2_decompressor *)BZ2_HANDLE(stream))->bytes_read;
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_getBytesWritten(
+	JNIEnv *env, jclass class, jlong stream
+	) {
+	return ((struct bzip2_decompressor *)BZ2_HANDLE(stream))->bytes_written;
+}
+
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_reset(
+	JNIEnv *env, jclass class, jlong stream
+	) {
+	struct bzip2_decompressor *d = BZ2_HANDLE(stream);
+	d->bytes_read = 0;
+	d->bytes_written = 0;
+	if (d->par) {
+		bz2_parallel_reset(d->par);
+		return;
+	}
+	// libbz2 has no reset; start the stream over
+	bz2_funcs.decompress_end(&d->strm);
+	memset(&d->strm, 0, sizeof(d->strm));
+	int rv = bz2_funcs.decompress_init(&d->strm, 0, 0);
+	if (rv == BZ_MEM_ERROR) {
+		THROW(env, "java/lang/OutOfMemoryError", NULL);
+	} else if (rv != BZ_OK) {
+		THROW(env, "java/lang/InternalError", NULL);
+	}
+}
+
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_compress_bzip2_Bzip2Decompressor_end(
+	JNIEnv *env, jclass class, jlong stream
+	) {
+	struct bzip2_decompressor *d = BZ2_HANDLE(stream);
+	if (d->par) {
+		bz2_parallel_free(d->par);
+	} else {
+		bz2_funcs.decompress_end(&d->strm);
+	}
+	free(d);
+}
+
+/**
+ * vim: sw=2: ts=2: et:
+ */
@@ -0,0 +1,716 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bzip2_parallel.h"
+
+#define BLOCK_MARKER 0x314159265359ULL
+#define EOS_MARKER 0x177245385090ULL
+#define MARKER_BITS 48
+#define MARKER_MASK ((1ULL << MARKER_BITS) - 1)
+
+/* "BZh" and the block size digit */
+#define HEADER_BITS 32
+
+/* The end-of-stream marker and the combined CRC of the stream */
+#define TRAILER_BITS (MARKER_BITS + 32)
+
+/*
+ * A block starts with its marker, its CRC, the randomised bit, the 24-bit
+ * origin pointer and the 16-bit map of the symbols in use. A marker closer
+ * than that to the one before it cannot be real.
+ */
+#define MIN_BLOCK_BITS (MARKER_BITS + 32 + 1 + 24 + 16)
+
+enum job_state { JOB_QUEUED, JOB_RUNNING, JOB_DONE };
+
+struct bz2p_job {
+  // in stream order
+  struct bz2p_job *next;
+  // in the queue of the pool
+  struct bz2p_job *work_next;
+  // the block, from its marker on, starting at bit 0
+  unsigned char *raw;
+  uint64_t nbits;
+  // the rest is written by whoever runs the job, and read once it is done
+  int state;
+  int rc;
+  char *out;
+  size_t out_len, out_cap, out_pos;
+};
+
+struct bz2_parallel {
+  struct bz2_funcs funcs;
+  pthread_mutex_t lock;
+  // signalled when work is queued or the pool is stopping
+  pthread_cond_t work_cond;
+  // signalled when a job is done
+  pthread_cond_t done_cond;
+  int stopping;
+  int nthreads;
+  pthread_t *threads;
+  struct bz2p_job *work_head, *work_tail;
+  // jobs allowed at once; twice the threads, so that the pool has the next
+  // blocks in hand while the caller drains the oldest
+  int window;
+  // the jobs not yet fully returned; the list belongs to the caller
+  struct bz2p_job *head, *tail;
+  int njobs;
+
+  // Everything below is only touched by the caller
+
+  // block size digit of the stream header, or 0 until it has been read
+  int level;
+  size_t max_block_bytes;
+  // input gathered but not yet cut into jobs
+  unsigned char *acc;
+  size_t acc_len, acc_cap;
+  // the next bit of acc to look for a marker at
+  uint64_t scan_bit;
+  // the marker the block being gathered starts at, or -1
+  int64_t seg_start;
+  // set when a marker was found but the window was full
+  int blocked;
+  int eos_known;
+  uint64_t eos_bit;
+  // the length of the stream in acc, once eos_known
+  size_t stream_end;
+  int error;
+};
+
+/* Return the 48 bits of b starting at bit p, zero-padded past len */
+static uint64_t get48(const unsigned char *b, size_t len, uint64_t p)
+{
+  size_t i = p >> 3;
+  uint64_t v = 0;
+  int k;
+
+  for (k = 0; k < 7; k++) {
+    v = (v << 8) | (i + k < len ? b[i + k] : 0);
+  }
+  return (v >> (8 - (p & 7))) & MARKER_MASK;
+}
+
+/*
+ * Find the first marker starting at or after bit from that lies entirely
+ * within b, and say whether it is the end-of-stream one.
+ *
+ * @return the bit the marker starts at, or -1
+ */
+static int64_t find_marker(const unsigned char *b, size_t len, uint64_t from,
+                           int *eos)
+{
+  uint64_t limit = (uint64_t)len * 8;
+  uint64_t p = from;
+
+  while (p + MARKER_BITS <= limit) {
+    size_t i = p >> 3;
+    uint64_t v = 0;
+    unsigned sh;
+    int k;
+
+    for (k = 0; k < 8; k++) {
+      v = (v << 8) | (i + k < len ? b[i + k] : 0);
+    }
+    for (sh = p & 7; sh < 8 && p + MARKER_BITS <= limit; sh++, p++) {
+      uint64_t m = (v >> (16 - sh)) & MARKER_MASK;
+      if (m == BLOCK_MARKER || m == EOS_MARKER) {
+        *eos = m == EOS_MARKER;
+        return p;
+      }
+    }
+  }
+  return -1;
+}
+
+/* Copy nbits of src starting at bit src_bit to the start of dst */
+static void copy_bits(unsigned char *dst, const unsigned char *src,
+                      uint64_t src_bit, uint64_t nbits)
+{
+  const unsigned char *s = src + (src_bit >> 3);
+  unsigned sh = src_bit & 7;
+  size_t nbytes = (nbits + 7) / 8;
+  size_t last, i;
+
+  if (sh == 0) {
+    memcpy(dst, s, nbytes);
+  } else {
+    last = ((src_bit + nbits - 1) >> 3) - (src_bit >> 3);
+    for (i = 0; i < nbytes; i++) {
+      unsigned v = (unsigned)s[i] << sh;
+      if (i + 1 <= last) {
+        v |= s[i + 1] >> (8 - sh);
+      }
+      dst[i] = (unsigned char)v;
+    }
+  }
+  if (nbits & 7) {
+    dst[nbytes - 1] &= (unsigned char)(0xff << (8 - (nbits & 7)));
+  }
+}
+
+/* Write the low n bits of v at bit *pos of the zeroed buffer dst */
+static void put_bits(unsigned char *dst, uint64_t *pos, uint64_t v, int n)
+{
+  while (n-- > 0) {
+    if ((v >> n) & 1) {
+      dst[*pos >> 3] |= 0x80 >> (*pos & 7);
+    }
+    (*pos)++;
+  }
+}
+
+/*
+ * Decompress one job: its block, framed by a stream header and by an
+ * end-of-stream marker carrying the block's CRC, which for a stream of one
+ * block is also the combined CRC.
+ */
+static int decode(struct bz2_parallel *p, struct bz2p_job *j)
+{
+  size_t raw_len = (j->nbits + 7) / 8;
+  uint64_t pos = HEADER_BITS + j->nbits;
+  unsigned char *framed;
+  bz_stream s;
+  int rc;
+
+  framed = calloc(1, HEADER_BITS / 8 + raw_len + TRAILER_BITS / 8 + 1);
+  if (!framed) {
+    return BZ_MEM_ERROR;
+  }
+  memcpy(framed, "BZh", 3);
+  framed[3] = '0' + p->level;
+  memcpy(framed + HEADER_BITS / 8, j->raw, raw_len);
+  put_bits(framed, &pos, EOS_MARKER, MARKER_BITS);
+  put_bits(framed, &pos, get48(j->raw, raw_len, MARKER_BITS) >> 16, 32);
+
+  memset(&s, 0, sizeof(s));
+  rc = p->funcs.decompress_init(&s, 0, 0);
+  if (rc != BZ_OK) {
+    free(framed);
+    return rc;
+  }
+  s.next_in = (char *)framed;
+  s.avail_in = (pos + 7) / 8;
+  j->out_len = 0;
+  for (;;) {
+    if (j->out_len == j->out_cap) {
+      size_t cap = j->out_cap ? 2 * j->out_cap : p->level * 100000 + 4096;
+      char *out = realloc(j->out, cap);
+      if (!out) {
+        rc = BZ_MEM_ERROR;
+        break;
+      }
+      j->out = out;
+      j->out_cap = cap;
+    }
+    s.next_out = j->out + j->out_len;
+    s.avail_out = j->out_cap - j->out_len;
+    rc = p->funcs.decompress(&s);
+    j->out_len = j->out_cap - s.avail_out;
+    if (rc == BZ_STREAM_END) {
+      rc = BZ_OK;
+      break;
+    } else if (rc != BZ_OK) {
+      break;
+    } else if (s.avail_in == 0 && s.avail_out > 0) {
+      // libbz2 wants more than the whole block: it was cut short
+      rc = BZ_DATA_ERROR;
+      break;
+    }
+  }
+  p->funcs.decompress_end(&s);
+  free(framed);
+  return rc;
+}
+
+static void *worker(void *arg)
+{
+  struct bz2_parallel *p = arg;
+  struct bz2p_job *j;
+  int rc;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->stopping && !p->work_head) {
+      pthread_cond_wait(&p->work_cond, &p->lock);
+    }
+    if (p->stopping) {
+      break;
+    }
+    j = p->work_head;
+    p->work_head = j->work_next;
+    if (!p->work_head) {
+      p->work_tail = NULL;
+    }
+    j->state = JOB_RUNNING;
+    pthread_mutex_unlock(&p->lock);
+    rc = decode(p, j);
+    pthread_mutex_lock(&p->lock);
+    j->rc = rc;
+    j->state = JOB_DONE;
+    pthread_cond_broadcast(&p->done_cond);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static void free_job(struct bz2p_job *j)
+{
+  free(j->raw);
+  free(j->out);
+  free(j);
+}
+
+/* Take a queued job off the work queue. Called with the lock held. */
+static void unqueue(struct bz2_parallel *p, struct bz2p_job *j)
+{
+  struct bz2p_job **jp, *prev = NULL;
+
+  for (jp = &p->work_head; *jp; prev = *jp, jp = &(*jp)->work_next) {
+    if (*jp == j) {
+      *jp = j->work_next;
+      if (p->work_tail == j) {
+        p->work_tail = prev;
+      }
+      return;
+    }
+  }
+}
+
+/* Cut the bits [start, end) of acc into a job and queue it */
+static int queue_job(struct bz2_parallel *p, uint64_t start, uint64_t end)
+{
+  struct bz2p_job *j = calloc(1, sizeof(*j));
+
+  if (!j) {
+    return BZ_MEM_ERROR;
+  }
+  j->nbits = end - start;
+  j->raw = malloc((j->nbits + 7) / 8);
+  if (!j->raw) {
+    free(j);
+    return BZ_MEM_ERROR;
+  }
+  copy_bits(j->raw, p->acc, start, j->nbits);
+  if (p->tail) {
+    p->tail->next = j;
+  } else {
+    p->head = j;
+  }
+  p->tail = j;
+  p->njobs++;
+
+  pthread_mutex_lock(&p->lock);
+  if (p->work_tail) {
+    p->work_tail->work_next = j;
+  } else {
+    p->work_head = j;
+  }
+  p->work_tail = j;
+  pthread_cond_signal(&p->work_cond);
+  pthread_mutex_unlock(&p->lock);
+  return BZ_OK;
+}
+
+/*
+ * Look for markers in the input gathered, and queue a job for every block
+ * they close, until the window is full or the stream ends.
+ */
+static int scan(struct bz2_parallel *p)
+{
+  uint64_t acc_bits = (uint64_t)p->acc_len * 8;
+  int64_t m;
+  int is_eos, rc;
+
+  p->blocked = 0;
+  if (!p->level) {
+    if (p->acc_len < HEADER_BITS / 8) {
+      return BZ_OK;
+    }
+    if (memcmp(p->acc, "BZh", 3) || p->acc[3] < '1' || p->acc[3] > '9') {
+      return BZ_DATA_ERROR_MAGIC;
+    }
+    p->level = p->acc[3] - '0';
+    // 20-bit codes for every symbol, plus the tables, bound a block
+    p->max_block_bytes = (size_t)p->level * 100000 * 5 / 2 + 4096;
+  }
+  if (p->seg_start < 0) {
+    // The first marker comes straight after the header
+    if (acc_bits < HEADER_BITS + MARKER_BITS) {
+      return BZ_OK;
+    }
+    switch (get48(p->acc, p->acc_len, HEADER_BITS)) {
+    case BLOCK_MARKER:
+      break;
+    case EOS_MARKER:
+      p->eos_known = 1;
+      p->eos_bit = HEADER_BITS;
+      p->stream_end = (HEADER_BITS + TRAILER_BITS + 7) / 8;
+      break;
+    default:
+      return BZ_DATA_ERROR;
+    }
+    p->seg_start = HEADER_BITS;
+    p->scan_bit = HEADER_BITS + 1;
+  }
+  while (!p->eos_known) {
+    m = find_marker(p->acc, p->acc_len, p->scan_bit, &is_eos);
+    if (m < 0) {
+      if (acc_bits >= MARKER_BITS && acc_bits - MARKER_BITS + 1 > p->scan_bit) {
+        p->scan_bit = acc_bits - MARKER_BITS + 1;
+      }
+      break;
+    }
+    if ((uint64_t)(m - p->seg_start) < MIN_BLOCK_BITS) {
+      p->scan_bit = m + 1;
+      continue;
+    }
+    if (p->njobs >= p->window) {
+      p->scan_bit = m;
+      p->blocked = 1;
+      break;
+    }
+    rc = queue_job(p, p->seg_start, m);
+    if (rc != BZ_OK) {
+      return rc;
+    }
+    p->seg_start = m;
+    p->scan_bit = m + 1;
+    if (is_eos) {
+      p->eos_known = 1;
+      p->eos_bit = m;
+      p->stream_end = (m + TRAILER_BITS + 7) / 8;
+    }
+  }
+  return BZ_OK;
+}
+
+/* Drop the input before the block being gathered */
+static void compact(struct bz2_parallel *p)
+{
+  size_t drop;
+
+  if (p->seg_start < 8) {
+    return;
+  }
+  drop = p->seg_start >> 3;
+  memmove(p->acc, p->acc + drop, p->acc_len - drop);
+  p->acc_len -= drop;
+  p->seg_start -= 8 * drop;
+  p->scan_bit -= 8 * drop;
+  if (p->eos_known) {
+    p->eos_bit -= 8 * drop;
+    p->stream_end -= drop;
+  }
+}
+
+/*
+ * Add input and scan it. Input is given back if it lies past a marker the
+ * scan stopped at, or past the end of the stream, so that input is only
+ * ever taken once it is known to belong to this stream.
+ */
+static int take_input(struct bz2_parallel *p, const char *in, size_t len,
+                      size_t *taken)
+{
+  size_t before, keep;
+  int rc;
+
+  compact(p);
+  before = p->acc_len;
+  if (p->eos_known && len > p->stream_end - before) {
+    len = p->stream_end - before;
+  }
+  if (before + len > p->acc_cap) {
+    size_t cap = p->acc_cap ? p->acc_cap : 64 * 1024;
+    unsigned char *acc;
+    while (cap < before + len) {
+      cap *= 2;
+    }
+    acc = realloc(p->acc, cap);
+    if (!acc) {
+      return BZ_MEM_ERROR;
+    }
+    p->acc = acc;
+    p->acc_cap = cap;
+  }
+  memcpy(p->acc + before, in, len);
+  p->acc_len = before + len;
+
+  rc = scan(p);
+  if (rc != BZ_OK) {
+    return rc;
+  }
+  keep = p->acc_len;
+  if (p->blocked && (p->scan_bit >> 3) < keep) {
+    keep = p->scan_bit >> 3;
+  }
+  if (p->eos_known && p->stream_end < keep) {
+    keep = p->stream_end;
+  }
+  if (keep < before) {
+    keep = before;
+  }
+  p->acc_len = keep;
+  *taken = keep - before;
+  return BZ_OK;
+}
+
+/*
+ * Join the job at the head with the one after it, the head having failed
+ * because a false marker cut its block short, and decompress the two
+ * together. Called with the lock held.
+ */
+static int join_head(struct bz2_parallel *p)
+{
+  struct bz2p_job *h = p->head, *n = h->next;
+  unsigned char *raw;
+  uint64_t pos = h->nbits;
+  size_t i, nbytes = n->nbits / 8;
+
+  while (n->state == JOB_RUNNING) {
+    pthread_cond_wait(&p->done_cond, &p->lock);
+  }
+  if (n->state == JOB_QUEUED) {
+    unqueue(p, n);
+  }
+  if ((h->nbits + n->nbits) / 8 > p->max_block_bytes) {
+    return BZ_DATA_ERROR;
+  }
+  raw = calloc(1, (h->nbits + n->nbits + 7) / 8);
+  if (!raw) {
+    return BZ_MEM_ERROR;
+  }
+  memcpy(raw, h->raw, (h->nbits + 7) / 8);
+  for (i = 0; i < nbytes; i++) {
+    put_bits(raw, &pos, n->raw[i], 8);
+  }
+  if (n->nbits & 7) {
+    put_bits(raw, &pos, n->raw[nbytes] >> (8 - (n->nbits & 7)), n->nbits & 7);
+  }
+  free(h->raw);
+  h->raw = raw;
+  h->nbits += n->nbits;
+  h->next = n->next;
+  if (p->tail == n) {
+    p->tail = h;
+  }
+  p->njobs--;
+  free_job(n);
+
+  pthread_mutex_unlock(&p->lock);
+  h->rc = decode(p, h);
+  pthread_mutex_lock(&p->lock);
+  return BZ_OK;
+}
+
+/* Copy out what the jobs at the head have finished */
+static int deliver(struct bz2_parallel *p, char *out, size_t out_len,
+                   size_t *produced)
+{
+  struct bz2p_job *h;
+  int rc = BZ_OK;
+
+  pthread_mutex_lock(&p->lock);
+  while ((h = p->head) && h->state == JOB_DONE && *produced < out_len) {
+    if (h->rc != BZ_OK) {
+      if (h->rc != BZ_DATA_ERROR) {
+        rc = h->rc;
+        break;
+      }
+      if (h->next) {
+        rc = join_head(p);
+        if (rc != BZ_OK) {
+          break;
+        }
+        continue;
+      }
+      // Nothing to join with yet. If the stream seemed to end here, that
+      // end-of-stream marker was false too.
+      if (p->eos_known) {
+        p->eos_known = 0;
+        p->scan_bit = p->eos_bit + 1;
+      }
+      if ((h->nbits + (uint64_t)p->acc_len * 8 - p->seg_start) / 8 >
+          p->max_block_bytes) {
+        rc = BZ_DATA_ERROR;
+      }
+      break;
+    }
+    size_t n = h->out_len - h->out_pos;
+    if (n > out_len - *produced) {
+      n = out_len - *produced;
+    }
+    memcpy(out + *produced, h->out + h->out_pos, n);
+    h->out_pos += n;
+    *produced += n;
+    if (h->out_pos == h->out_len) {
+      p->head = h->next;
+      if (!p->head) {
+        p->tail = NULL;
+      }
+      p->njobs--;
+      free_job(h);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return rc;
+}
+
+int bz2_parallel_decompress(struct bz2_parallel *p,
+                            const char *in, size_t in_len, size_t *consumed,
+                            char *out, size_t out_len, size_t *produced)
+{
+  size_t taken;
+  int rc;
+
+  *consumed = 0;
+  *produced = 0;
+  if (p->error) {
+    return p->error;
+  }
+  for (;;) {
+    rc = deliver(p, out, out_len, produced);
+    if (rc != BZ_OK) {
+      goto error;
+    }
+    int input_done = p->eos_known && p->acc_len >= p->stream_end;
+    if (input_done && !p->head) {
+      return BZ_STREAM_END;
+    }
+    if (*produced == out_len) {
+      break;
+    }
+    if (p->blocked && p->njobs < p->window) {
+      rc = scan(p);
+      if (rc != BZ_OK) {
+        goto error;
+      }
+      continue;
+    }
+    if (!p->blocked && !input_done && *consumed < in_len) {
+      rc = take_input(p, in + *consumed, in_len - *consumed, &taken);
+      if (rc != BZ_OK) {
+        goto error;
+      }
+      *consumed += taken;
+      continue;
+    }
+    if (*produced > 0) {
+      break;
+    }
+    if (p->head && (p->blocked || input_done)) {
+      // No more input can be taken until the oldest block is out
+      pthread_mutex_lock(&p->lock);
+      if (p->head->state != JOB_DONE) {
+        pthread_cond_wait(&p->done_cond, &p->lock);
+      }
+      pthread_mutex_unlock(&p->lock);
+      continue;
+    }
+    break;
+  }
+  return BZ_OK;
+
+error:
+  p->error = rc;
+  return rc;
+}
+
+void bz2_parallel_reset(struct bz2_parallel *p)
+{
+  struct bz2p_job *j, *next;
+
+  pthread_mutex_lock(&p->lock);
+  for (j = p->head; j; j = j->next) {
+    if (j->state == JOB_QUEUED) {
+      unqueue(p, j);
+    }
+    while (j->state == JOB_RUNNING) {
+      pthread_cond_wait(&p->done_cond, &p->lock);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  for (j = p->head; j; j = next) {
+    next = j->next;
+    free_job(j);
+  }
+  p->head = p->tail = NULL;
+  p->njobs = 0;
+  p->level = 0;
+  p->acc_len = 0;
+  p->scan_bit = 0;
+  p->seg_start = -1;
+  p->blocked = 0;
+  p->eos_known = 0;
+  p->error = 0;
+}
+
+int bz2_parallel_create(const struct bz2_funcs *funcs, int threads,
+                        struct bz2_parallel **out)
+{
+  struct bz2_parallel *p = calloc(1, sizeof(*p));
+  int i;
+
+  if (!p) {
+    return BZ_MEM_ERROR;
+  }
+  p->funcs = *funcs;
+  p->seg_start = -1;
+  p->window = 2 * threads;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work_cond, NULL);
+  pthread_cond_init(&p->done_cond, NULL);
+  p->threads = calloc(threads, sizeof(pthread_t));
+  if (!p->threads) {
+    bz2_parallel_free(p);
+    return BZ_MEM_ERROR;
+  }
+  for (i = 0; i < threads; i++) {
+    if (pthread_create(&p->threads[i], NULL, worker, p)) {
+      bz2_parallel_free(p);
+      return BZ_MEM_ERROR;
+    }
+    p->nthreads++;
+  }
+  *out = p;
+  return BZ_OK;
+}
+
+void bz2_parallel_free(struct bz2_parallel *p)
+{
+  int i;
+
+  bz2_parallel_reset(p);
+  pthread_mutex_lock(&p->lock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->work_cond);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 0; i < p->nthreads; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+  pthread_cond_destroy(&p->done_cond);
+  pthread_cond_destroy(&p->work_cond);
+  pthread_mutex_destroy(&p->lock);
+  free(p->threads);
+  free(p->acc);
+  free(p);
+}
@@ -0,0 +1,78 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ORG_APACHE_HADOOP_IO_COMPRESS_BZIP2_PARALLEL_H
+#define ORG_APACHE_HADOOP_IO_COMPRESS_BZIP2_PARALLEL_H
+
+#include <bzlib.h>
+#include <stddef.h>
+
+/*
+ * Decompression of one bzip2 stream with its blocks spread over a pool of
+ * threads. The blocks of a bzip2 stream are independent, but they are not
+ * byte-aligned: the input is searched bit by bit for the 48-bit block and
+ * end-of-stream markers, and each block is re-framed as a stream of its
+ * own for libbz2 to decompress. The output comes out in order.
+ *
+ * A marker can turn up by chance inside compressed data. A block cut short
+ * by such a false marker fails its CRC, and is then joined with the piece
+ * after it and decompressed again, so false markers cost time but never
+ * change the output.
+ */
+
+/* The libbz2 entry points the engine calls, as located by the caller */
+struct bz2_funcs {
+  int (*decompress_init)(bz_stream *, int, int);
+  int (*decompress)(bz_stream *);
+  int (*decompress_end)(bz_stream *);
+};
+
+struct bz2_parallel;
+
+/**
+ * Create an engine decompressing on the given number of threads.
+ *
+ * @return BZ_OK, or BZ_MEM_ERROR if memory or threads ran out.
+ */
+int bz2_parallel_create(const struct bz2_funcs *funcs, int threads,
+                        struct bz2_parallel **out);
+
+/**
+ * Feed the engine compressed bytes and collect decompressed ones, like one
+ * call of BZ2_bzDecompress. Input is taken only up to the end of the
+ * stream, so that whatever follows it is left over for the caller.
+ *
+ * This blocks only when no more input can be taken and nothing is ready
+ * to be returned.
+ *
+ * @param consumed  (out) the bytes of in taken.
+ * @param produced  (out) the bytes written to out.
+ * @return BZ_OK, BZ_STREAM_END once the last byte of the stream has been
+ *         produced, or a BZ_ error code.
+ */
+int bz2_parallel_decompress(struct bz2_parallel *p,
+                            const char *in, size_t in_len, size_t *consumed,
+                            char *out, size_t out_len, size_t *produced);
+
+/** Get ready for a new stream, dropping anything pending. */
+void bz2_parallel_reset(struct bz2_parallel *p);
+
+/** Stop the threads and release the engine. */
+void bz2_parallel_free(struct bz2_parallel *p);
+
+#endif //ORG_APACHE_HADOOP_IO_COMPRESS_BZIP2_PARALLEL_H
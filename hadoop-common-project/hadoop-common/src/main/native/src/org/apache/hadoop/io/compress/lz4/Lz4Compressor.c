@@ -16,10 +16,21 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
+
 #include "config.h"
 #include "org_apache_hadoop.h"
 #include "org_apache_hadoop_io_compress_lz4_Lz4Compressor.h"
 
+/* A helper macro to convert the java 'stream-handle' to an LZ4 stream pointer. */
+#define LZ4STREAM(stream) ((void*)((ptrdiff_t)(stream)))
+
+/* A helper macro to convert the java 'ctx-handle' to an LZ4 context pointer. */
+#define LZ4CTX(ctx) ((void*)((ptrdiff_t)(ctx)))
+
+/* A helper macro to convert the LZ4 stream pointer to the java 'stream-handle'. */
+#define JLONG(stream) ((jlong)((ptrdiff_t)(stream)))
+
 //****************************
 // Simple Functions
 //****************************
@@ -35,18 +46,59 @@ LZ4_compress() :
 
 */
 
-static jfieldID Lz4Compressor_clazz;
+extern void* LZ4_createCtx(void);
+extern void LZ4_freeCtx(void* ctx);
+extern int LZ4_compressWithCtx(void* ctx, const char* source, char* dest, int isize);
+
+/*
+LZ4_compressWithCtx() :
+ same as LZ4_compress(), but reuses the hash table in ctx from call to call
+ instead of allocating and clearing one each time.
+*/
+
+extern void* LZ4_createStream(int maxBlockSize);
+extern void LZ4_resetStream(void* stream);
+extern void LZ4_freeStream(void* stream);
+extern int LZ4_compressStream(void* stream, const char* source, char* dest, int isize);
+
+/*
+LZ4_compressStream() :
+ compresses one block of a stream; matches may refer back into the last 64KB
+ of the blocks compressed before it since the last LZ4_resetStream().
+ isize must not exceed the maxBlockSize given to LZ4_createStream().
+ return : the number of bytes in compressed buffer dest, or -1 on error
+*/
+
+extern int LZ4_compressHC(const char* source, char* dest, int isize);
+
+/*
+LZ4_compressHC() :
+ same as LZ4_compress(), but searches much harder for matches. Compression
+ is several times slower; the output is decoded by the same functions.
+ return : the number of bytes in compressed buffer dest, or -1 on error
+*/
+
+extern void* LZ4_createHCCtx(void);
+extern void LZ4_freeHCCtx(void* ctx);
+extern int LZ4_compressHCWithCtx(void* ctx, const char* source, char* dest, int isize);
+
+/*
+LZ4_compressHCWithCtx() :
+ same as LZ4_compressHC(), but reuses the match finder in ctx from call to
+ call instead of allocating one each time.
+*/
+
 static jfieldID Lz4Compressor_uncompressedDirectBuf;
 static jfieldID Lz4Compressor_uncompressedDirectBufLen;
 static jfieldID Lz4Compressor_compressedDirectBuf;
 static jfieldID Lz4Compressor_directBufferSize;
+static jfieldID Lz4Compressor_stream;
+static jfieldID Lz4Compressor_ctx;
 
 
 JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_initIDs
 (JNIEnv *env, jclass clazz){
 
-  Lz4Compressor_clazz = (*env)->GetStaticFieldID(env, clazz, "clazz",
-                                                 "Ljava/lang/Class;");
   Lz4Compressor_uncompressedDirectBuf = (*env)->GetFieldID(env, clazz,
                                                            "uncompressedDirectBuf",
                                                            "Ljava/nio/Buffer;");
@@ -57,38 +109,47 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_init
                                                          "Ljava/nio/Buffer;");
   Lz4Compressor_directBufferSize = (*env)->GetFieldID(env, clazz,
                                                        "directBufferSize", "I");
+  Lz4Compressor_stream = (*env)->GetFieldID(env, clazz, "stream", "J");
+  Lz4Compressor_ctx = (*env)->GetFieldID(env, clazz, "ctx", "J");
 }
 
-JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_compressBytesDirect
-(JNIEnv *env, jobject thisj){
+static jint compress_bytes_direct(JNIEnv *env, jobject thisj, int use_hc){
   // Get members of Lz4Compressor
-  jobject clazz = (*env)->GetStaticObjectField(env, thisj, Lz4Compressor_clazz);
   jobject uncompressed_direct_buf = (*env)->GetObjectField(env, thisj, Lz4Compressor_uncompressedDirectBuf);
   jint uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, Lz4Compressor_uncompressedDirectBufLen);
   jobject compressed_direct_buf = (*env)->GetObjectField(env, thisj, Lz4Compressor_compressedDirectBuf);
   jint compressed_direct_buf_len = (*env)->GetIntField(env, thisj, Lz4Compressor_directBufferSize);
+  void *stream = LZ4STREAM((*env)->GetLongField(env, thisj, Lz4Compressor_stream));
+  void *ctx = LZ4CTX((*env)->GetLongField(env, thisj, Lz4Compressor_ctx));
 
   // Get the input direct buffer
-  LOCK_CLASS(env, clazz, "Lz4Compressor");
   const char* uncompressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "Lz4Compressor");
 
   if (uncompressed_bytes == 0) {
     return (jint)0;
   }
 
   // Get the output direct buffer
-  LOCK_CLASS(env, clazz, "Lz4Compressor");
   char* compressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "Lz4Compressor");
 
   if (compressed_bytes == 0) {
     return (jint)0;
   }
 
-  compressed_direct_buf_len = LZ4_compress(uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  if (use_hc && ctx != NULL) {
+    compressed_direct_buf_len = LZ4_compressHCWithCtx(ctx, uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  } else if (use_hc) {
+    compressed_direct_buf_len = LZ4_compressHC(uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  } else if (stream != NULL) {
+    compressed_direct_buf_len = LZ4_compressStream(stream, uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  } else if (ctx != NULL) {
+    compressed_direct_buf_len = LZ4_compressWithCtx(ctx, uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  } else {
+    compressed_direct_buf_len = LZ4_compress(uncompressed_bytes, compressed_bytes, uncompressed_direct_buf_len);
+  }
   if (compressed_direct_buf_len < 0){
-    THROW(env, "java/lang/InternalError", "LZ4_compress failed");
+    THROW(env, "java/lang/InternalError",
+          use_hc ? "LZ4_compressHC failed" : "LZ4_compress failed");
   }
 
   (*env)->SetIntField(env, thisj, Lz4Compressor_uncompressedDirectBufLen, 0);
@@ -96,3 +157,62 @@ JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_comp
   return (jint)compressed_direct_buf_len;
 }
 
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_compressBytesDirect
+(JNIEnv *env, jobject thisj){
+  return compress_bytes_direct(env, thisj, 0);
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_compressBytesDirectHC
+(JNIEnv *env, jobject thisj){
+  return compress_bytes_direct(env, thisj, 1);
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_initStream
+(JNIEnv *env, jclass clazz, jint max_block_size){
+  void *stream = LZ4_createStream(max_block_size);
+  if (stream == NULL) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(stream);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_resetStream
+(JNIEnv *env, jclass clazz, jlong stream){
+  LZ4_resetStream(LZ4STREAM(stream));
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_freeStream
+(JNIEnv *env, jclass clazz, jlong stream){
+  LZ4_freeStream(LZ4STREAM(stream));
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_initCtx
+(JNIEnv *env, jclass clazz){
+  void *ctx = LZ4_createCtx();
+  if (ctx == NULL) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(ctx);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_freeCtx
+(JNIEnv *env, jclass clazz, jlong ctx){
+  LZ4_freeCtx(LZ4CTX(ctx));
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_initHCCtx
+(JNIEnv *env, jclass clazz){
+  void *ctx = LZ4_createHCCtx();
+  if (ctx == NULL) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(ctx);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Compressor_freeHCCtx
+(JNIEnv *env, jclass clazz, jlong ctx){
+  LZ4_freeHCCtx(LZ4CTX(ctx));
+}
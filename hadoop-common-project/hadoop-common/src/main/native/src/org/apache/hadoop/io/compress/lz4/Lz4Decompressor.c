@@ -16,10 +16,18 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
+
 #include "config.h"
 #include "org_apache_hadoop.h"
 #include "org_apache_hadoop_io_compress_lz4_Lz4Decompressor.h"
 
+/* A helper macro to convert the java 'stream-handle' to an LZ4 stream pointer. */
+#define LZ4STREAM(stream) ((void*)((ptrdiff_t)(stream)))
+
+/* A helper macro to convert the LZ4 stream pointer to the java 'stream-handle'. */
+#define JLONG(stream) ((jlong)((ptrdiff_t)(stream)))
+
 int LZ4_uncompress_unknownOutputSize(const char* source, char* dest, int isize, int maxOutputSize);
 
 /*
@@ -32,18 +40,28 @@ LZ4_uncompress_unknownOutputSize() :
  note   : This version is a bit slower than LZ4_uncompress
 */
 
+void* LZ4_createStream(int maxBlockSize);
+void LZ4_resetStream(void* stream);
+void LZ4_freeStream(void* stream);
+int LZ4_uncompressStream(void* stream, const char* source, char* dest, int isize, int maxOutputSize);
+
+/*
+LZ4_uncompressStream() :
+ decodes one block written by LZ4_compressStream(), resolving references into
+ the blocks decoded before it since the last LZ4_resetStream().
+ return : as for LZ4_uncompress_unknownOutputSize()
+*/
+
 
-static jfieldID Lz4Decompressor_clazz;
 static jfieldID Lz4Decompressor_compressedDirectBuf;
 static jfieldID Lz4Decompressor_compressedDirectBufLen;
 static jfieldID Lz4Decompressor_uncompressedDirectBuf;
 static jfieldID Lz4Decompressor_directBufferSize;
+static jfieldID Lz4Decompressor_stream;
 
 JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_initIDs
 (JNIEnv *env, jclass clazz){
 
-  Lz4Decompressor_clazz = (*env)->GetStaticFieldID(env, clazz, "clazz",
-                                                   "Ljava/lang/Class;");
   Lz4Decompressor_compressedDirectBuf = (*env)->GetFieldID(env,clazz,
                                                            "compressedDirectBuf",
                                                            "Ljava/nio/Buffer;");
@@ -54,36 +72,37 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_in
                                                              "Ljava/nio/Buffer;");
   Lz4Decompressor_directBufferSize = (*env)->GetFieldID(env, clazz,
                                                          "directBufferSize", "I");
+  Lz4Decompressor_stream = (*env)->GetFieldID(env, clazz, "stream", "J");
 }
 
 JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_decompressBytesDirect
 (JNIEnv *env, jobject thisj){
   // Get members of Lz4Decompressor
-  jobject clazz = (*env)->GetStaticObjectField(env,thisj, Lz4Decompressor_clazz);
   jobject compressed_direct_buf = (*env)->GetObjectField(env,thisj, Lz4Decompressor_compressedDirectBuf);
   jint compressed_direct_buf_len = (*env)->GetIntField(env,thisj, Lz4Decompressor_compressedDirectBufLen);
   jobject uncompressed_direct_buf = (*env)->GetObjectField(env,thisj, Lz4Decompressor_uncompressedDirectBuf);
   size_t uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, Lz4Decompressor_directBufferSize);
+  void *stream = LZ4STREAM((*env)->GetLongField(env, thisj, Lz4Decompressor_stream));
 
   // Get the input direct buffer
-  LOCK_CLASS(env, clazz, "Lz4Decompressor");
   const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "Lz4Decompressor");
 
   if (compressed_bytes == 0) {
     return (jint)0;
   }
 
   // Get the output direct buffer
-  LOCK_CLASS(env, clazz, "Lz4Decompressor");
   char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "Lz4Decompressor");
 
   if (uncompressed_bytes == 0) {
     return (jint)0;
   }
 
-  uncompressed_direct_buf_len = LZ4_uncompress_unknownOutputSize(compressed_bytes, uncompressed_bytes, compressed_direct_buf_len, uncompressed_direct_buf_len);
+  if (stream != NULL) {
+    uncompressed_direct_buf_len = LZ4_uncompressStream(stream, compressed_bytes, uncompressed_bytes, compressed_direct_buf_len, uncompressed_direct_buf_len);
+  } else {
+    uncompressed_direct_buf_len = LZ4_uncompress_unknownOutputSize(compressed_bytes, uncompressed_bytes, compressed_direct_buf_len, uncompressed_direct_buf_len);
+  }
   if (uncompressed_direct_buf_len < 0) {
     THROW(env, "java/lang/InternalError", "LZ4_uncompress_unknownOutputSize failed.");
   }
@@ -92,3 +111,52 @@ JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_de
 
   return (jint)uncompressed_direct_buf_len;
 }
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_decompressDirectBuf
+(JNIEnv *env, jobject thisj, jobject src, jint src_off, jint src_len,
+ jobject dst, jint dst_off, jint dst_len){
+  void *stream = LZ4STREAM((*env)->GetLongField(env, thisj, Lz4Decompressor_stream));
+  int uncompressed_len;
+
+  // Get the caller's input and output direct buffers
+  const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, src);
+  if (compressed_bytes == 0) {
+    return (jint)0;
+  }
+  char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, dst);
+  if (uncompressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  if (stream != NULL) {
+    uncompressed_len = LZ4_uncompressStream(stream, compressed_bytes + src_off, uncompressed_bytes + dst_off, src_len, dst_len);
+  } else {
+    uncompressed_len = LZ4_uncompress_unknownOutputSize(compressed_bytes + src_off, uncompressed_bytes + dst_off, src_len, dst_len);
+  }
+  if (uncompressed_len < 0) {
+    THROW(env, "java/lang/InternalError", "LZ4_uncompress_unknownOutputSize failed.");
+    return (jint)0;
+  }
+
+  return (jint)uncompressed_len;
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_initStream
+(JNIEnv *env, jclass clazz, jint max_block_size){
+  void *stream = LZ4_createStream(max_block_size);
+  if (stream == NULL) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(stream);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_resetStream
+(JNIEnv *env, jclass clazz, jlong stream){
+  LZ4_resetStream(LZ4STREAM(stream));
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_lz4_Lz4Decompressor_freeStream
+(JNIEnv *env, jclass clazz, jlong stream){
+  LZ4_freeStream(LZ4STREAM(stream));
+}
@@ -142,7 +142,10 @@ typedef struct _U16_S
 //**************************************
 #define LZ4_HASH_FUNCTION(i)	(((i) * 2654435761U) >> ((MINMATCH*8)-HASH_LOG))
 #define LZ4_HASH_VALUE(p)		LZ4_HASH_FUNCTION(A32(p))
-#define LZ4_COPYPACKET(s,d)		A32(d) = A32(s); d+=4; s+=4; A32(d) = A32(s); d+=4; s+=4;
+// s and d may be only 4 bytes apart when expanding a short-offset match, so
+// copy through memcpy rather than A32() to keep the compiler from merging
+// the two stores.
+#define LZ4_COPYPACKET(s,d)		memcpy(d, s, 4); d+=4; s+=4; memcpy(d, s, 4); d+=4; s+=4;
 #define LZ4_WILDCOPY(s,d,e)		do { LZ4_COPYPACKET(s,d) } while (d<e);
 #define LZ4_BLINDCOPY(s,d,l)	{ BYTE* e=d+l; LZ4_WILDCOPY(s,d,e); d=e; }
 
@@ -152,18 +155,18 @@ typedef struct _U16_S
 // Compression CODE
 //****************************
 
-int LZ4_compressCtx(void** ctx,
+// Compress one block into dest, using HashTable as the match finder state.
+// Matches may reach back as far as lowLimit, which must be at or before
+// source; the bytes between lowLimit and source are the history window
+// left behind by the previous block of a stream. HashTable need not be
+// cleared: entries outside [lowLimit, ip) are ignored without being read,
+// and entries inside it point at valid data that is checked before use.
+static inline int LZ4_compressBlock(const BYTE** HashTable,
+				 const BYTE* lowLimit,
 				 char* source, 
 				 char* dest,
 				 int isize)
 {	
-#if HEAPMODE
-	struct refTables *srt = (struct refTables *) (*ctx);
-	const BYTE** HashTable;
-#else
-	const BYTE* HashTable[HASHTABLESIZE] = {0};
-#endif
-
 	const BYTE* ip = (BYTE*) source;       
 	const BYTE* anchor = ip;
 	const BYTE* const iend = ip + isize;
@@ -182,18 +185,6 @@ int LZ4_compressCtx(void** ctx,
 
 	// Init 
 	if (isize<MINLENGTH) goto _last_literals;
-#if HEAPMODE
-	if (*ctx == NULL) 
-	{
-		srt = (struct refTables *) malloc ( sizeof(struct refTables) );
-		*ctx = (void*) srt;
-	}
-	HashTable = srt->hashTable;
-	memset((void*)HashTable, 0, sizeof(srt->hashTable));
-#else
-	(void) ctx;
-#endif
-
 
 	// First Byte
 	HashTable[LZ4_HASH_VALUE(ip)] = ip;
@@ -220,10 +211,10 @@ int LZ4_compressCtx(void** ctx,
 			ref = HashTable[h];
 			HashTable[h] = ip;
 
-		} while ((ref < ip - MAX_DISTANCE) || (A32(ref) != A32(ip)));
+		} while ((ref < lowLimit) || (ref >= ip) || (ref < ip - MAX_DISTANCE) || (A32(ref) != A32(ip)));
 
 		// Catch up
-		while ((ip>anchor) && (ref>(BYTE*)source) && (ip[-1]==ref[-1])) { ip--; ref--; }  
+		while ((ip>anchor) && (ref>lowLimit) && (ip[-1]==ref[-1])) { ip--; ref--; }  
 
 		// Encode Literal length
 		length = ip - anchor;
@@ -277,7 +268,7 @@ _endCount:
 		// Test next position
 		ref = HashTable[LZ4_HASH_VALUE(ip)];
 		HashTable[LZ4_HASH_VALUE(ip)] = ip;
-		if ((ref > ip - (MAX_DISTANCE + 1)) && (A32(ref) == A32(ip))) { token = op++; *token=0; goto _next_match; }
+		if ((ref >= lowLimit) && (ref < ip) && (ref > ip - (MAX_DISTANCE + 1)) && (A32(ref) == A32(ip))) { token = op++; *token=0; goto _next_match; }
 
 		// Prepare next loop
 		anchor = ip++; 
@@ -299,24 +290,44 @@ _last_literals:
 }
 
 
+int LZ4_compressCtx(void** ctx,
+				 char* source, 
+				 char* dest,
+				 int isize)
+{	
+#if HEAPMODE
+	struct refTables *srt = (struct refTables *) (*ctx);
+	const BYTE** HashTable;
+
+	if (*ctx == NULL) 
+	{
+		srt = (struct refTables *) malloc ( sizeof(struct refTables) );
+		*ctx = (void*) srt;
+	}
+	HashTable = srt->hashTable;
+	memset((void*)HashTable, 0, sizeof(srt->hashTable));
+#else
+	const BYTE* HashTable[HASHTABLESIZE] = {0};
+	(void) ctx;
+#endif
+
+	return LZ4_compressBlock(HashTable, (BYTE*) source, source, dest, isize);
+}
+
+
 
 // Note : this function is valid only if isize < LZ4_64KLIMIT
 #define LZ4_64KLIMIT ((1U<<16) + (MFLIMIT-1))
 #define HASHLOG64K (HASH_LOG+1)
 #define LZ4_HASH64K_FUNCTION(i)	(((i) * 2654435761U) >> ((MINMATCH*8)-HASHLOG64K))
 #define LZ4_HASH64K_VALUE(p)	LZ4_HASH64K_FUNCTION(A32(p))
-int LZ4_compress64kCtx(void** ctx,
+// As LZ4_compressBlock(), for blocks shorter than LZ4_64KLIMIT, with the
+// hash table holding 16-bit offsets from source rather than pointers.
+static inline int LZ4_compress64kBlock(U16* HashTable,
 				 char* source, 
 				 char* dest,
 				 int isize)
 {	
-#if HEAPMODE
-	struct refTables *srt = (struct refTables *) (*ctx);
-	U16* HashTable;
-#else
-	U16 HashTable[HASHTABLESIZE<<1] = {0};
-#endif
-
 	const BYTE* ip = (BYTE*) source;       
 	const BYTE* anchor = ip;
 	const BYTE* const base = ip;
@@ -336,18 +347,6 @@ int LZ4_compress64kCtx(void** ctx,
 
 	// Init 
 	if (isize<MINLENGTH) goto _last_literals;
-#if HEAPMODE
-	if (*ctx == NULL) 
-	{
-		srt = (struct refTables *) malloc ( sizeof(struct refTables) );
-		*ctx = (void*) srt;
-	}
-	HashTable = (U16*)(srt->hashTable);
-	memset((void*)HashTable, 0, sizeof(srt->hashTable));
-#else
-	(void) ctx;
-#endif
-
 
 	// First Byte
 	ip++; forwardH = LZ4_HASH64K_VALUE(ip);
@@ -373,7 +372,7 @@ int LZ4_compress64kCtx(void** ctx,
 			ref = base + HashTable[h];
 			HashTable[h] = ip - base;
 
-		} while (A32(ref) != A32(ip));
+		} while ((ref >= ip) || (A32(ref) != A32(ip)));
 
 		// Catch up
 		while ((ip>anchor) && (ref>(BYTE*)source) && (ip[-1]==ref[-1])) { ip--; ref--; }  
@@ -427,7 +426,7 @@ _endCount:
 		// Test next position
 		ref = base + HashTable[LZ4_HASH64K_VALUE(ip)];
 		HashTable[LZ4_HASH64K_VALUE(ip)] = ip - base;
-		if (A32(ref) == A32(ip)) { token = op++; *token=0; goto _next_match; }
+		if ((ref < ip) && (A32(ref) == A32(ip))) { token = op++; *token=0; goto _next_match; }
 
 		// Prepare next loop
 		anchor = ip++; 
@@ -449,6 +448,57 @@ _last_literals:
 }
 
 
+int LZ4_compress64kCtx(void** ctx,
+				 char* source, 
+				 char* dest,
+				 int isize)
+{	
+#if HEAPMODE
+	struct refTables *srt = (struct refTables *) (*ctx);
+	U16* HashTable;
+
+	if (*ctx == NULL) 
+	{
+		srt = (struct refTables *) malloc ( sizeof(struct refTables) );
+		*ctx = (void*) srt;
+	}
+	HashTable = (U16*)(srt->hashTable);
+	memset((void*)HashTable, 0, sizeof(srt->hashTable));
+#else
+	U16 HashTable[HASHTABLESIZE<<1] = {0};
+	(void) ctx;
+#endif
+
+	return LZ4_compress64kBlock(HashTable, source, dest, isize);
+}
+
+
+
+// A context whose hash table is reused from one call to the next. It is
+// never cleared, so compressing with it costs no allocation or memset.
+void* LZ4_createCtx(void)
+{
+	return calloc(1, sizeof(struct refTables));
+}
+
+void LZ4_freeCtx(void* ctx)
+{
+	free(ctx);
+}
+
+int LZ4_compressWithCtx(void* ctx,
+				 char* source, 
+				 char* dest,
+				 int isize)
+{
+	struct refTables *srt = (struct refTables *) ctx;
+
+	if (isize < (int)LZ4_64KLIMIT)
+		return LZ4_compress64kBlock((U16*)(srt->hashTable), source, dest, isize);
+	return LZ4_compressBlock(srt->hashTable, (BYTE*) source, source, dest, isize);
+}
+
+
 
 int LZ4_compress(char* source, 
 				 char* dest,
@@ -480,6 +530,8 @@ int LZ4_compress(char* source,
 //		since they will *never* write outside of the provided output buffer :
 //		they both check this condition *before* writing anything.
 //		A corrupted packet however can make them *read* within the first 64K before the output buffer.
+//		LZ4_uncompress_unknownOutputSize() and LZ4_uncompressStream() also never read past the end
+//		of their input, and reject references to before the start of their output or history.
 
 int LZ4_uncompress(char* source, 
 				 char* dest,
@@ -561,11 +613,42 @@ _output_error:
 }
 
 
-int LZ4_uncompress_unknownOutputSize(
+// Copy in whole steps until d reaches e. Up to one step minus one byte is
+// written past e, and when s and d overlap s must be at least one step
+// behind d. Fixed-size memcpy compiles to single vector moves.
+static inline void LZ4_wildCopy8(BYTE* d, const BYTE* s, const BYTE* e)
+{
+	do { memcpy(d, s, 8); d+=8; s+=8; } while (d<e);
+}
+
+static inline void LZ4_wildCopy16(BYTE* d, const BYTE* s, const BYTE* e)
+{
+	do { memcpy(d, s, 16); d+=16; s+=16; } while (d<e);
+}
+
+static inline void LZ4_wildCopy32(BYTE* d, const BYTE* s, const BYTE* e)
+{
+	do { memcpy(d, s, 32); d+=32; s+=32; } while (d<e);
+}
+
+// The fast loop runs while both buffers have this much room left, so that
+// no copy in it needs a bounds check of its own.
+#define FASTLOOP_MARGIN 32
+
+// Spread a match whose offset is under 8 so that the source ends up at
+// least 8 bytes behind the destination, at the same phase of the pattern.
+static const int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
+static const int dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+// Decode one block into dest. References may reach back as far as
+// lowLimit, which must be at or before dest; anything earlier is treated
+// as a corrupt block.
+static inline int LZ4_decodeBlock(
 				char* source, 
 				char* dest,
 				int isize,
-				int maxOutputSize)
+				int maxOutputSize,
+				const BYTE* lowLimit)
 {	
 	// Local Variables
 	const BYTE* restrict ip = (const BYTE*) source;
@@ -580,14 +663,116 @@ int LZ4_uncompress_unknownOutputSize(
 	
 	U32	dec[4]={0, 3, 2, 3};
 	int	len, length;
+	size_t offset;
 
 
-	// Main Loop
+	// Fast loop: far from both ends, literals and matches are copied in
+	// whole 16- and 32-byte steps that may overrun into the margin. A
+	// sequence too long to fit is left to the careful loop below.
+	while ((iend - ip >= FASTLOOP_MARGIN) && (oend - op >= FASTLOOP_MARGIN))
+	{
+		const BYTE* const sequence = ip;
+
+		// get runlength and copy literals
+		token = *ip++;
+		length = token>>ML_BITS;
+
+		// Shortcut for the most common sequence, short literals followed
+		// by a short match that does not overlap itself: both fit in
+		// fixed-size copies.
+		if ((length != RUN_MASK) && ((token&ML_MASK) != ML_MASK))
+		{
+			memcpy(op, ip, 16);
+			op += length; ip += length;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			offset = A16(ip);
+#else
+			offset = ip[0] | (ip[1] << 8);
+#endif
+			if ((offset >= 8) && (offset <= (size_t)(op - lowLimit)))
+			{
+				ref = op - offset;
+				ip += 2;
+				memcpy(op, ref, 8);
+				memcpy(op+8, ref+8, 8);
+				memcpy(op+16, ref+16, 2);
+				op += (token&ML_MASK) + MINMATCH;
+				continue;
+			}
+			op -= length; ip = sequence + 1;
+		}
+
+		if (length == RUN_MASK)
+		{
+			do { len = *ip++; length += len; } while ((len == 255) && (ip < iend));
+			if ((length > (oend - op) - FASTLOOP_MARGIN) ||
+				(length > (iend - ip) - FASTLOOP_MARGIN)) { ip = sequence; break; }
+			LZ4_wildCopy32(op, ip, op+length);
+		}
+		else
+		{
+			memcpy(op, ip, 16);
+		}
+		op += length; ip += length;
+
+		// get offset
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		offset = A16(ip); ip+=2;
+#else
+		offset = ip[0] | (ip[1] << 8); ip+=2;
+#endif
+		if ((offset == 0) || (offset > (size_t)(op - lowLimit))) goto _output_error;
+		ref = op - offset;
+
+		// get matchlength
+		length = token&ML_MASK;
+		if (length == ML_MASK)
+		{
+			do {
+				if (ip >= iend) goto _output_error;
+				len = *ip++; length += len;
+			} while (len == 255);
+		}
+		length += MINMATCH;
+
+		// copy repeated sequence
+		cpy = op + length;
+		if (length > (oend - op) - FASTLOOP_MARGIN)
+		{
+			if (length > oend - op) goto _output_error;
+			while (op < cpy) *op++ = *ref++;
+			continue;
+		}
+		if (offset >= 32) LZ4_wildCopy32(op, ref, cpy);
+		else if (offset >= 16) LZ4_wildCopy16(op, ref, cpy);
+		else if (offset >= 8) LZ4_wildCopy8(op, ref, cpy);
+		else
+		{
+			op[0] = ref[0];
+			op[1] = ref[1];
+			op[2] = ref[2];
+			op[3] = ref[3];
+			ref += inc32table[offset];
+			memcpy(op+4, ref, 4);
+			ref -= dec64table[offset];
+			LZ4_wildCopy8(op+8, ref, cpy);
+		}
+		op = cpy;
+	}
+
+	// Careful loop, for the sequences near the ends of the buffers
 	while (ip<iend)
 	{
 		// get runlength
 		token = *ip++;
-		if ((length=(token>>ML_BITS)) == RUN_MASK)  { for (;(len=*ip++)==255;length+=255){} length += len; } 
+		if ((length=(token>>ML_BITS)) == RUN_MASK)
+		{
+			do {
+				if (ip >= iend) goto _output_error;
+				len = *ip++; length += len;
+			} while (len == 255);
+		}
+		if (length > iend - ip) goto _output_error;
 
 		// copy literals
 		cpy = op+length;
@@ -598,18 +783,28 @@ int LZ4_uncompress_unknownOutputSize(
 			op += length;
 			break;    // Necessarily EOF
 		}
-		LZ4_WILDCOPY(ip, op, cpy); ip -= (op-cpy); op = cpy;
+		if (length > (iend - ip) - COPYLENGTH) { memcpy(op, ip, length); ip += length; op = cpy; }
+		else { LZ4_WILDCOPY(ip, op, cpy); ip -= (op-cpy); op = cpy; }
 		if (ip>=iend) break;    // check EOF
+		if (iend - ip < 2) goto _output_error;
 
 		// get offset
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-		ref = cpy - A16(ip); ip+=2;
+		offset = A16(ip); ip+=2;
 #else
-		{ int delta = *ip++; delta += *ip++ << 8; ref = cpy - delta; }
+		offset = ip[0] | (ip[1] << 8); ip+=2;
 #endif
+		if ((offset == 0) || (offset > (size_t)(cpy - lowLimit))) goto _output_error;
+		ref = cpy - offset;
 
 		// get matchlength
-		if ((length=(token&ML_MASK)) == ML_MASK) { for (;(len=*ip++)==255;length+=255){} length += len; }
+		if ((length=(token&ML_MASK)) == ML_MASK)
+		{
+			do {
+				if (ip >= iend) goto _output_error;
+				len = *ip++; length += len;
+			} while (len == 255);
+		}
 
 		// copy repeated sequence
 		if (op-ref<COPYTOKEN)
@@ -625,7 +820,7 @@ int LZ4_uncompress_unknownOutputSize(
 		if (cpy>oend-COPYLENGTH)
 		{
 			if (cpy > oend) goto _output_error;	
-			LZ4_WILDCOPY(ref, op, (oend-COPYLENGTH));
+			if (op < oend-COPYLENGTH) LZ4_WILDCOPY(ref, op, (oend-COPYLENGTH));
 			while(op<cpy) *op++=*ref++;
 			op=cpy;
 			if (op == oend) break;    // Check EOF (should never happen, since last 5 bytes are supposed to be literals)
@@ -643,3 +838,121 @@ _output_error:
 	return (int) (-(((char*)ip)-source));
 }
 
+
+int LZ4_uncompress_unknownOutputSize(
+				char* source, 
+				char* dest,
+				int isize,
+				int maxOutputSize)
+{
+	return LZ4_decodeBlock(source, dest, isize, maxOutputSize, (BYTE*) dest);
+}
+
+
+
+//****************************
+// Streaming CODE
+//****************************
+
+// A stream compresses (or decodes) a sequence of blocks, each of which may
+// refer back into the last LZ4_STREAM_HISTORY bytes of the blocks before it.
+// Every block is copied into a private window so that the history is
+// contiguous with it; the window is slid down once it fills up.
+#define LZ4_STREAM_HISTORY (1 << MAXD_LOG)
+
+struct LZ4_streamState
+{
+	const BYTE* hashTable[HASHTABLESIZE];
+	BYTE* bufferStart;
+	BYTE* nextBlock;
+	BYTE* bufferEnd;
+	int maxBlockSize;
+};
+
+void LZ4_resetStream(void* stream)
+{
+	struct LZ4_streamState* st = (struct LZ4_streamState*) stream;
+	memset((void*)st->hashTable, 0, sizeof(st->hashTable));
+	st->nextBlock = st->bufferStart;
+}
+
+void* LZ4_createStream(int maxBlockSize)
+{
+	struct LZ4_streamState* st;
+	size_t bufferSize;
+
+	if (maxBlockSize <= 0) return NULL;
+	st = (struct LZ4_streamState*) malloc(sizeof(struct LZ4_streamState));
+	if (st == NULL) return NULL;
+	bufferSize = LZ4_STREAM_HISTORY + 2 * (size_t) maxBlockSize;
+	st->bufferStart = (BYTE*) malloc(bufferSize);
+	if (st->bufferStart == NULL) { free(st); return NULL; }
+	st->bufferEnd = st->bufferStart + bufferSize;
+	st->maxBlockSize = maxBlockSize;
+	LZ4_resetStream(st);
+	return st;
+}
+
+void LZ4_freeStream(void* stream)
+{
+	struct LZ4_streamState* st = (struct LZ4_streamState*) stream;
+	if (st == NULL) return;
+	free(st->bufferStart);
+	free(st);
+}
+
+// Move the last LZ4_STREAM_HISTORY bytes to the start of the window and
+// rebase the hash table to match. Entries that fall off the front are
+// dropped; they were already out of match distance.
+static void LZ4_slideStream(struct LZ4_streamState* st)
+{
+	BYTE* history = st->nextBlock - LZ4_STREAM_HISTORY;
+	size_t delta;
+	int i;
+
+	if (history <= st->bufferStart) return;
+	delta = history - st->bufferStart;
+	memmove(st->bufferStart, history, LZ4_STREAM_HISTORY);
+	for (i = 0; i < HASHTABLESIZE; i++)
+	{
+		if (st->hashTable[i] < history) st->hashTable[i] = NULL;
+		else st->hashTable[i] -= delta;
+	}
+	st->nextBlock -= delta;
+}
+
+int LZ4_compressStream(void* stream,
+				 const char* source,
+				 char* dest,
+				 int isize)
+{
+	struct LZ4_streamState* st = (struct LZ4_streamState*) stream;
+	int result;
+
+	if ((isize < 0) || (isize > st->maxBlockSize)) return -1;
+	if (st->nextBlock + isize > st->bufferEnd) LZ4_slideStream(st);
+	memcpy(st->nextBlock, source, isize);
+	result = LZ4_compressBlock(st->hashTable, st->bufferStart,
+			(char*) st->nextBlock, dest, isize);
+	st->nextBlock += isize;
+	return result;
+}
+
+int LZ4_uncompressStream(void* stream,
+				 char* source,
+				 char* dest,
+				 int isize,
+				 int maxOutputSize)
+{
+	struct LZ4_streamState* st = (struct LZ4_streamState*) stream;
+	int result;
+
+	if (maxOutputSize > st->maxBlockSize) maxOutputSize = st->maxBlockSize;
+	if (st->nextBlock + maxOutputSize > st->bufferEnd) LZ4_slideStream(st);
+	result = LZ4_decodeBlock(source, (char*) st->nextBlock, isize,
+			maxOutputSize, st->bufferStart);
+	if (result < 0) return result;
+	memcpy(dest, st->nextBlock, result);
+	st->nextBlock += result;
+	return result;
+}
@@ -0,0 +1,298 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//**************************************
+// A hash chain match finder for the LZ4 block format used by lz4.c.
+// It searches much harder for long matches than LZ4_compress() does, so
+// it is several times slower to compress, but the output is decoded by the
+// same LZ4_uncompress*() functions at the same speed.
+//**************************************
+
+//**************************************
+// Includes
+//**************************************
+#include <stdlib.h>   // for malloc
+#include <string.h>   // for memcpy
+
+
+//**************************************
+// Basic Types
+//**************************************
+#if defined(_MSC_VER)    // Visual Studio does not support 'stdint' natively
+#define BYTE	unsigned __int8
+#define U16		unsigned __int16
+#define U32		unsigned __int32
+#else
+#include <stdint.h>
+#define BYTE	uint8_t
+#define U16		uint16_t
+#define U32		uint32_t
+#endif
+
+
+//**************************************
+// Constants
+//**************************************
+// These must match lz4.c, since they define the block format
+#define MINMATCH 4
+#define COPYLENGTH 8
+#define LASTLITERALS 5
+#define MFLIMIT (COPYLENGTH+MINMATCH)
+#define MINLENGTH (MFLIMIT+1)
+
+#define MAXD_LOG 16
+#define MAX_DISTANCE ((1 << MAXD_LOG) - 1)
+
+#define ML_BITS 4
+#define ML_MASK ((1U<<ML_BITS)-1)
+#define RUN_BITS (8-ML_BITS)
+#define RUN_MASK ((1U<<RUN_BITS)-1)
+
+// Match finder parameters
+#define DICTIONARY_LOGSIZE MAXD_LOG
+#define MAXD (1<<DICTIONARY_LOGSIZE)
+#define MAXD_MASK ((U32)(MAXD - 1))
+
+#define HASH_LOG (DICTIONARY_LOGSIZE-1)
+#define HASHTABLESIZE (1 << HASH_LOG)
+
+// Increasing this value improves compression ratio at the cost of speed
+#define MAX_NB_ATTEMPTS 256
+
+
+//**************************************
+// Local structures
+//**************************************
+struct LZ4HC_Data
+{
+	const BYTE* base;
+	U32 nextToUpdate;
+	U32 hashTable[HASHTABLESIZE];
+	U16 chainTable[MAXD];
+};
+
+#ifdef __GNUC__
+#  define _PACKED __attribute__ ((packed))
+#else
+#  define _PACKED
+#endif
+
+typedef struct _U32_S
+{
+	U32 v;
+} _PACKED U32_S;
+
+#define A32(x) (((U32_S *)(x))->v)
+
+
+//**************************************
+// Macros
+//**************************************
+#define HASH_FUNCTION(i)	(((i) * 2654435761U) >> ((MINMATCH*8)-HASH_LOG))
+#define HASH_VALUE(p)		HASH_FUNCTION(A32(p))
+
+
+//****************************
+// Match finder
+//****************************
+
+// Add every position before ip to the hash chains.
+static inline void LZ4HC_insert(struct LZ4HC_Data* hc, const BYTE* ip)
+{
+	const U32 target = (U32)(ip - hc->base);
+
+	while (hc->nextToUpdate < target)
+	{
+		const U32 idx = hc->nextToUpdate;
+		const U32 h = HASH_VALUE(hc->base + idx);
+		U32 delta = idx - hc->hashTable[h];
+		if ((delta == 0) || (delta > MAX_DISTANCE)) delta = MAX_DISTANCE;
+		hc->chainTable[idx & MAXD_MASK] = (U16) delta;
+		hc->hashTable[h] = idx;
+		hc->nextToUpdate++;
+	}
+}
+
+// Return the length of the longest match for ip that ends at or before
+// matchlimit, storing its start in *matchpos; 0 if there is none.
+static inline int LZ4HC_findLongestMatch(struct LZ4HC_Data* hc,
+				 const BYTE* ip,
+				 const BYTE* const matchlimit,
+				 const BYTE** matchpos)
+{
+	const U32 cur = (U32)(ip - hc->base);
+	U32 idx;
+	int attempts = MAX_NB_ATTEMPTS;
+	int ml = 0;
+
+	LZ4HC_insert(hc, ip);
+	idx = hc->hashTable[HASH_VALUE(ip)];
+
+	while ((idx < cur) && (cur - idx <= MAX_DISTANCE) && (attempts-- > 0))
+	{
+		const BYTE* ref = hc->base + idx;
+		U16 delta;
+
+		// Cheap rejection: the byte that would extend the best match so far
+		if ((ref[ml] == ip[ml]) && (A32(ref) == A32(ip)))
+		{
+			const BYTE* p = ip + MINMATCH;
+			const BYTE* r = ref + MINMATCH;
+			while ((p < matchlimit) && (*p == *r)) { p++; r++; }
+			if ((int)(p - ip) > ml) { ml = (int)(p - ip); *matchpos = ref; }
+		}
+
+		delta = hc->chainTable[idx & MAXD_MASK];
+		if (delta > idx) break;
+		idx -= delta;
+	}
+
+	return ml;
+}
+
+
+//****************************
+// Compression CODE
+//****************************
+
+// Write the literals between *anchor and ip, followed by a match of ml bytes
+// at ref.
+static inline BYTE* LZ4HC_encodeSequence(BYTE* op,
+				 const BYTE* anchor,
+				 const BYTE* ip,
+				 const BYTE* ref,
+				 int ml)
+{
+	int length = (int)(ip - anchor);
+	int len, delta;
+	BYTE* token = op++;
+
+	// Encode Literal length
+	if (length>=(int)RUN_MASK) { *token=(RUN_MASK<<ML_BITS); len = length-RUN_MASK; for(; len > 254 ; len-=255) *op++ = 255; *op++ = (BYTE)len; } 
+	else *token = (length<<ML_BITS);
+
+	// Copy Literals
+	memcpy(op, anchor, length);
+	op += length;
+
+	// Encode Offset
+	delta = (int)(ip - ref);
+	*op++ = (BYTE) delta;
+	*op++ = (BYTE) (delta >> 8);
+
+	// Encode MatchLength
+	len = ml - MINMATCH;
+	if (len>=(int)ML_MASK) { *token+=ML_MASK; len-=ML_MASK; for(; len > 254 ; len-=255) *op++ = 255; *op++ = (BYTE)len; } 
+	else *token += len;
+
+	return op;
+}
+
+static int LZ4HC_compressBlock(struct LZ4HC_Data* hc,
+				 const char* source,
+				 char* dest,
+				 int isize)
+{
+	const BYTE* ip = (const BYTE*) source;
+	const BYTE* anchor = ip;
+	const BYTE* const iend = ip + isize;
+	const BYTE* const mflimit = iend - MFLIMIT;
+	const BYTE* const matchlimit = iend - LASTLITERALS;
+
+	BYTE* op = (BYTE*) dest;
+
+	hc->base = ip;
+	hc->nextToUpdate = 0;
+	memset((void*)hc->hashTable, 0, sizeof(hc->hashTable));
+
+	if (isize<MINLENGTH) goto _last_literals;
+	ip++;
+
+	// Main Loop
+	while (ip < mflimit)
+	{
+		const BYTE* ref;
+		const BYTE* ref2;
+		int ml, ml2;
+
+		ml = LZ4HC_findLongestMatch(hc, ip, matchlimit, &ref);
+		if (ml < MINMATCH) { ip++; continue; }
+
+		// Lazy evaluation: prefer a longer match starting one byte later
+		while (ip + 1 < mflimit)
+		{
+			ml2 = LZ4HC_findLongestMatch(hc, ip + 1, matchlimit, &ref2);
+			if (ml2 <= ml) break;
+			ip++; ml = ml2; ref = ref2;
+		}
+
+		op = LZ4HC_encodeSequence(op, anchor, ip, ref, ml);
+		ip += ml;
+		anchor = ip;
+	}
+
+_last_literals:
+	// Encode Last Literals
+	{
+		int lastRun = (int)(iend - anchor);
+		if (lastRun>=(int)RUN_MASK) { *op++=(RUN_MASK<<ML_BITS); lastRun-=RUN_MASK; for(; lastRun > 254 ; lastRun-=255) *op++ = 255; *op++ = (BYTE) lastRun; } 
+		else *op++ = (lastRun<<ML_BITS);
+		memcpy(op, anchor, iend - anchor);
+		op += iend-anchor;
+	} 
+
+	// End
+	return (int) (((char*)op)-dest);
+}
+
+
+// A match finder kept from one call to the next. LZ4HC_compressBlock sets
+// it up again for every block, so it saves only the allocation.
+void* LZ4_createHCCtx(void)
+{
+	return malloc(sizeof(struct LZ4HC_Data));
+}
+
+void LZ4_freeHCCtx(void* ctx)
+{
+	free(ctx);
+}
+
+int LZ4_compressHCWithCtx(void* ctx,
+				 const char* source, 
+				 char* dest,
+				 int isize)
+{
+	if (isize < 0) return -1;
+	return LZ4HC_compressBlock((struct LZ4HC_Data*) ctx, source, dest, isize);
+}
+
+int LZ4_compressHC(const char* source, 
+				 char* dest,
+				 int isize)
+{
+	struct LZ4HC_Data* hc;
+	int result;
+
+	if (isize < 0) return -1;
+	hc = (struct LZ4HC_Data*) malloc(sizeof(struct LZ4HC_Data));
+	if (hc == NULL) return -1;
+	result = LZ4HC_compressBlock(hc, source, dest, isize);
+	free(hc);
+	return result;
+}
@@ -16,24 +16,26 @@
  * limitations under the License.
  */
 
+#include <arpa/inet.h>
 #include <dlfcn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
+#include "bulk_crc32.h"
 #include "org_apache_hadoop_io_compress_snappy.h"
 #include "org_apache_hadoop_io_compress_snappy_SnappyCompressor.h"
 
 #define JINT_MAX 0x7fffffff
 
-static jfieldID SnappyCompressor_clazz;
 static jfieldID SnappyCompressor_uncompressedDirectBuf;
 static jfieldID SnappyCompressor_uncompressedDirectBufLen;
 static jfieldID SnappyCompressor_compressedDirectBuf;
 static jfieldID SnappyCompressor_directBufferSize;
 
 static snappy_status (*dlsym_snappy_compress)(const char*, size_t, char*, size_t*);
+static size_t (*dlsym_snappy_max_compressed_length)(size_t);
 
 JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompressor_initIDs
 (JNIEnv *env, jclass clazz){
@@ -50,9 +52,8 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompresso
   // Locate the requisite symbols from libsnappy.so
   dlerror();                                 // Clear any existing error
   LOAD_DYNAMIC_SYMBOL(dlsym_snappy_compress, env, libsnappy, "snappy_compress");
+  LOAD_DYNAMIC_SYMBOL(dlsym_snappy_max_compressed_length, env, libsnappy, "snappy_max_compressed_length");
 
-  SnappyCompressor_clazz = (*env)->GetStaticFieldID(env, clazz, "clazz",
-                                                 "Ljava/lang/Class;");
   SnappyCompressor_uncompressedDirectBuf = (*env)->GetFieldID(env, clazz,
                                                            "uncompressedDirectBuf",
                                                            "Ljava/nio/Buffer;");
@@ -68,7 +69,6 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompresso
 JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompressor_compressBytesDirect
 (JNIEnv *env, jobject thisj){
   // Get members of SnappyCompressor
-  jobject clazz = (*env)->GetStaticObjectField(env, thisj, SnappyCompressor_clazz);
   jobject uncompressed_direct_buf = (*env)->GetObjectField(env, thisj, SnappyCompressor_uncompressedDirectBuf);
   jint uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, SnappyCompressor_uncompressedDirectBufLen);
   jobject compressed_direct_buf = (*env)->GetObjectField(env, thisj, SnappyCompressor_compressedDirectBuf);
@@ -76,18 +76,14 @@ JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompresso
   size_t buf_len;
 
   // Get the input direct buffer
-  LOCK_CLASS(env, clazz, "SnappyCompressor");
   const char* uncompressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "SnappyCompressor");
 
   if (uncompressed_bytes == 0) {
     return 0;
   }
 
   // Get the output direct buffer
-  LOCK_CLASS(env, clazz, "SnappyCompressor");
   char* compressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "SnappyCompressor");
 
   if (compressed_bytes == 0) {
     return 0;
@@ -109,3 +105,91 @@ JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompresso
   (*env)->SetIntField(env, thisj, SnappyCompressor_uncompressedDirectBufLen, 0);
   return (jint)buf_len;
 }
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyCompressor_compressFramedBytesDirect
+(JNIEnv *env, jobject thisj, jboolean write_stream_identifier){
+  // Get members of SnappyCompressor
+  jobject uncompressed_direct_buf = (*env)->GetObjectField(env, thisj, SnappyCompressor_uncompressedDirectBuf);
+  jint uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, SnappyCompressor_uncompressedDirectBufLen);
+  jobject compressed_direct_buf = (*env)->GetObjectField(env, thisj, SnappyCompressor_compressedDirectBuf);
+  size_t compressed_direct_buf_len = (*env)->GetDirectBufferCapacity(env, compressed_direct_buf);
+  uint32_t sums_stack[64], *sums = sums_stack;
+  size_t num_chunks, chunk, in_off, out_off = 0, in_len, buf_len;
+  int type;
+
+  const char* uncompressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
+  if (uncompressed_bytes == 0) {
+    return 0;
+  }
+  char* compressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
+  if (compressed_bytes == 0) {
+    return 0;
+  }
+
+  if (write_stream_identifier) {
+    memcpy(compressed_bytes, SNAPPY_STREAM_IDENTIFIER, SNAPPY_STREAM_IDENTIFIER_SIZE);
+    out_off = SNAPPY_STREAM_IDENTIFIER_SIZE;
+  }
+
+  // Checksum every chunk in one pass, so the hardware CRC32C path can work
+  // on several chunks at once.
+  num_chunks = (uncompressed_direct_buf_len + SNAPPY_MAX_CHUNK_UNCOMPRESSED - 1) /
+               SNAPPY_MAX_CHUNK_UNCOMPRESSED;
+  if (num_chunks > sizeof(sums_stack) / sizeof(sums_stack[0])) {
+    sums = malloc(num_chunks * sizeof(uint32_t));
+    if (!sums) {
+      THROW(env, "java/lang/OutOfMemoryError", NULL);
+      return 0;
+    }
+  }
+  if (num_chunks > 0 &&
+      bulk_calculate_crc((const uint8_t *)uncompressed_bytes,
+                         uncompressed_direct_buf_len, sums, CRC32C_POLYNOMIAL,
+                         SNAPPY_MAX_CHUNK_UNCOMPRESSED) != 0) {
+    THROW(env, "java/lang/InternalError", "Could not checksum data.");
+    goto done;
+  }
+
+  for (chunk = 0, in_off = 0; chunk < num_chunks; chunk++) {
+    in_len = uncompressed_direct_buf_len - in_off;
+    if (in_len > SNAPPY_MAX_CHUNK_UNCOMPRESSED) {
+      in_len = SNAPPY_MAX_CHUNK_UNCOMPRESSED;
+    }
+    if (out_off + SNAPPY_CHUNK_HEADER_SIZE + SNAPPY_CHUNK_CRC_SIZE +
+        dlsym_snappy_max_compressed_length(in_len) > compressed_direct_buf_len) {
+      THROW(env, "java/lang/InternalError", "Could not compress data. Buffer length is too small.");
+      out_off = 0;
+      goto done;
+    }
+    char *chunk_start = compressed_bytes + out_off;
+    char *chunk_data = chunk_start + SNAPPY_CHUNK_HEADER_SIZE + SNAPPY_CHUNK_CRC_SIZE;
+    buf_len = compressed_direct_buf_len - (chunk_data - compressed_bytes);
+    if (dlsym_snappy_compress(uncompressed_bytes + in_off, in_len,
+                              chunk_data, &buf_len) != SNAPPY_OK) {
+      THROW(env, "java/lang/InternalError", "Could not compress data.");
+      out_off = 0;
+      goto done;
+    }
+    type = SNAPPY_CHUNK_COMPRESSED;
+    if (buf_len >= in_len) {
+      // Incompressible: store it, which is cheaper to read back
+      memcpy(chunk_data, uncompressed_bytes + in_off, in_len);
+      buf_len = in_len;
+      type = SNAPPY_CHUNK_UNCOMPRESSED;
+    }
+    snappy_put_le32(chunk_start,
+                    type | ((buf_len + SNAPPY_CHUNK_CRC_SIZE) << 8));
+    snappy_put_le32(chunk_start + SNAPPY_CHUNK_HEADER_SIZE,
+                    snappy_mask_crc(ntohl(sums[chunk])));
+    out_off += SNAPPY_CHUNK_HEADER_SIZE + SNAPPY_CHUNK_CRC_SIZE + buf_len;
+    in_off += in_len;
+  }
+
+  (*env)->SetIntField(env, thisj, SnappyCompressor_uncompressedDirectBufLen, 0);
+
+done:
+  if (sums != sums_stack) {
+    free(sums);
+  }
+  return (jint)out_off;
+}
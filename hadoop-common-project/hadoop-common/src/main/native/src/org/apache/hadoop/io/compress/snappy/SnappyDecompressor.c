@@ -16,22 +16,24 @@
  * limitations under the License.
  */
 
+#include <arpa/inet.h>
 #include <dlfcn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
+#include "bulk_crc32.h"
 #include "org_apache_hadoop_io_compress_snappy.h"
 #include "org_apache_hadoop_io_compress_snappy_SnappyDecompressor.h"
 
-static jfieldID SnappyDecompressor_clazz;
 static jfieldID SnappyDecompressor_compressedDirectBuf;
 static jfieldID SnappyDecompressor_compressedDirectBufLen;
 static jfieldID SnappyDecompressor_uncompressedDirectBuf;
 static jfieldID SnappyDecompressor_directBufferSize;
 
 static snappy_status (*dlsym_snappy_uncompress)(const char*, size_t, char*, size_t*);
+static snappy_status (*dlsym_snappy_uncompressed_length)(const char*, size_t, size_t*);
 
 JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompressor_initIDs
 (JNIEnv *env, jclass clazz){
@@ -48,9 +50,8 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompres
   // Locate the requisite symbols from libsnappy.so
   dlerror();                                 // Clear any existing error
   LOAD_DYNAMIC_SYMBOL(dlsym_snappy_uncompress, env, libsnappy, "snappy_uncompress");
+  LOAD_DYNAMIC_SYMBOL(dlsym_snappy_uncompressed_length, env, libsnappy, "snappy_uncompressed_length");
 
-  SnappyDecompressor_clazz = (*env)->GetStaticFieldID(env, clazz, "clazz",
-                                                   "Ljava/lang/Class;");
   SnappyDecompressor_compressedDirectBuf = (*env)->GetFieldID(env,clazz,
                                                            "compressedDirectBuf",
                                                            "Ljava/nio/Buffer;");
@@ -66,25 +67,20 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompres
 JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompressor_decompressBytesDirect
 (JNIEnv *env, jobject thisj){
   // Get members of SnappyDecompressor
-  jobject clazz = (*env)->GetStaticObjectField(env,thisj, SnappyDecompressor_clazz);
   jobject compressed_direct_buf = (*env)->GetObjectField(env,thisj, SnappyDecompressor_compressedDirectBuf);
   jint compressed_direct_buf_len = (*env)->GetIntField(env,thisj, SnappyDecompressor_compressedDirectBufLen);
   jobject uncompressed_direct_buf = (*env)->GetObjectField(env,thisj, SnappyDecompressor_uncompressedDirectBuf);
   size_t uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, SnappyDecompressor_directBufferSize);
 
   // Get the input direct buffer
-  LOCK_CLASS(env, clazz, "SnappyDecompressor");
   const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "SnappyDecompressor");
 
   if (compressed_bytes == 0) {
     return (jint)0;
   }
 
   // Get the output direct buffer
-  LOCK_CLASS(env, clazz, "SnappyDecompressor");
   char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
-  UNLOCK_CLASS(env, clazz, "SnappyDecompressor");
 
   if (uncompressed_bytes == 0) {
     return (jint)0;
@@ -103,3 +99,98 @@ JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompres
 
   return (jint)uncompressed_direct_buf_len;
 }
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompressor_decompressDirectBuf
+(JNIEnv *env, jclass clazz, jobject src, jint src_off, jint src_len,
+ jobject dst, jint dst_off, jint dst_len){
+  size_t uncompressed_len = dst_len;
+
+  // Get the caller's input and output direct buffers
+  const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, src);
+  if (compressed_bytes == 0) {
+    return (jint)0;
+  }
+  char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, dst);
+  if (uncompressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  snappy_status ret = dlsym_snappy_uncompress(compressed_bytes + src_off, src_len,
+                                              uncompressed_bytes + dst_off, &uncompressed_len);
+  if (ret == SNAPPY_BUFFER_TOO_SMALL){
+    THROW(env, "java/lang/InternalError", "Could not decompress data. Buffer length is too small.");
+    return (jint)0;
+  } else if (ret == SNAPPY_INVALID_INPUT){
+    THROW(env, "java/lang/InternalError", "Could not decompress data. Input is invalid.");
+    return (jint)0;
+  } else if (ret != SNAPPY_OK){
+    THROW(env, "java/lang/InternalError", "Could not decompress data.");
+    return (jint)0;
+  }
+
+  return (jint)uncompressed_len;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_snappy_SnappyDecompressor_decompressFramedBytesDirect
+(JNIEnv *env, jobject thisj, jint type){
+  // Get members of SnappyDecompressor
+  jobject compressed_direct_buf = (*env)->GetObjectField(env,thisj, SnappyDecompressor_compressedDirectBuf);
+  jint compressed_direct_buf_len = (*env)->GetIntField(env,thisj, SnappyDecompressor_compressedDirectBufLen);
+  jobject uncompressed_direct_buf = (*env)->GetObjectField(env,thisj, SnappyDecompressor_uncompressedDirectBuf);
+  size_t uncompressed_direct_buf_len = (*env)->GetDirectBufferCapacity(env, uncompressed_direct_buf);
+  size_t data_len, uncompressed_len;
+  uint32_t crc;
+
+  const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
+  if (compressed_bytes == 0) {
+    return (jint)0;
+  }
+  char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
+  if (uncompressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  // The chunk body: the masked CRC32C of the uncompressed data, then the data
+  if (compressed_direct_buf_len < SNAPPY_CHUNK_CRC_SIZE) {
+    return SNAPPY_FRAME_CORRUPT;
+  }
+  const char *data = compressed_bytes + SNAPPY_CHUNK_CRC_SIZE;
+  data_len = compressed_direct_buf_len - SNAPPY_CHUNK_CRC_SIZE;
+  (*env)->SetIntField(env, thisj, SnappyDecompressor_compressedDirectBufLen, 0);
+
+  switch (type) {
+    case SNAPPY_CHUNK_COMPRESSED:
+      if (dlsym_snappy_uncompressed_length(data, data_len, &uncompressed_len) != SNAPPY_OK ||
+          uncompressed_len > SNAPPY_MAX_CHUNK_UNCOMPRESSED ||
+          uncompressed_len > uncompressed_direct_buf_len) {
+        return SNAPPY_FRAME_CORRUPT;
+      }
+      if (dlsym_snappy_uncompress(data, data_len, uncompressed_bytes, &uncompressed_len) != SNAPPY_OK) {
+        return SNAPPY_FRAME_CORRUPT;
+      }
+      break;
+    case SNAPPY_CHUNK_UNCOMPRESSED:
+      if (data_len > SNAPPY_MAX_CHUNK_UNCOMPRESSED ||
+          data_len > uncompressed_direct_buf_len) {
+        return SNAPPY_FRAME_CORRUPT;
+      }
+      memcpy(uncompressed_bytes, data, data_len);
+      uncompressed_len = data_len;
+      break;
+    default:
+      return SNAPPY_FRAME_CORRUPT;
+  }
+
+  crc = 0;
+  if (uncompressed_len > 0 &&
+      bulk_calculate_crc((const uint8_t *)uncompressed_bytes, uncompressed_len,
+                         &crc, CRC32C_POLYNOMIAL, uncompressed_len) != 0) {
+    THROW(env, "java/lang/InternalError", "Could not checksum data.");
+    return (jint)0;
+  }
+  // CRC32C of no data is 0
+  if (snappy_mask_crc(ntohl(crc)) != snappy_get_le32(compressed_bytes)) {
+    return SNAPPY_FRAME_BAD_CHECKSUM;
+  }
+  return (jint)uncompressed_len;
+}
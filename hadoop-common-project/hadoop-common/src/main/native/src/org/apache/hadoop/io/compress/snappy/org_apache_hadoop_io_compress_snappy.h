@@ -25,5 +25,46 @@
 #include <jni.h>
 #include <snappy-c.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The snappy framing format. See framing_format.txt in the snappy sources.
+ * A stream is a sequence of chunks, each with a one byte type and a three
+ * byte little-endian length, starting with a stream identifier chunk.
+ * Data chunks hold at most 64KB of uncompressed data and are led by the
+ * masked CRC32C of that data.
+ */
+#define SNAPPY_CHUNK_COMPRESSED 0x00
+#define SNAPPY_CHUNK_UNCOMPRESSED 0x01
+#define SNAPPY_CHUNK_STREAM_IDENTIFIER 0xff
+#define SNAPPY_CHUNK_HEADER_SIZE 4
+#define SNAPPY_CHUNK_CRC_SIZE 4
+#define SNAPPY_MAX_CHUNK_UNCOMPRESSED (64 * 1024)
+#define SNAPPY_STREAM_IDENTIFIER "\xff\x06\x00\x00sNaPpY"
+#define SNAPPY_STREAM_IDENTIFIER_SIZE 10
+
+/* Return codes of decompressFramedBytesDirect */
+#define SNAPPY_FRAME_BAD_CHECKSUM -1
+#define SNAPPY_FRAME_CORRUPT -2
+
+/**
+ * The framing format stores CRCs masked, so that the CRC of data which
+ * itself contains CRCs is not degenerate.
+ */
+static inline uint32_t snappy_mask_crc(uint32_t crc) {
+  return ((crc >> 15) | (crc << 17)) + 0xa282ead8;
+}
+
+static inline void snappy_put_le32(char *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static inline uint32_t snappy_get_le32(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
 
 #endif //ORG_APACHE_HADOOP_IO_COMPRESS_SNAPPY_SNAPPY_H
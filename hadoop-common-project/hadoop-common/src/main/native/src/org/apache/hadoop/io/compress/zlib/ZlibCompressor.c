@@ -17,15 +17,17 @@
  */
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
+#include "bulk_crc32.h"
 #include "org_apache_hadoop_io_compress_zlib.h"
 #include "org_apache_hadoop_io_compress_zlib_ZlibCompressor.h"
 
-static jfieldID ZlibCompressor_clazz;
 static jfieldID ZlibCompressor_stream;
 static jfieldID ZlibCompressor_uncompressedDirectBuf;
 static jfieldID ZlibCompressor_uncompressedDirectBufOff;
@@ -34,21 +36,49 @@ static jfieldID ZlibCompressor_compressedDirectBuf;
 static jfieldID ZlibCompressor_directBufferSize;
 static jfieldID ZlibCompressor_finish;
 static jfieldID ZlibCompressor_finished;
+static jfieldID ZlibCompressor_parallel;
 
 static int (*dlsym_deflateInit2_)(z_streamp, int, int, int, int, int, const char *, int);
 static int (*dlsym_deflate)(z_streamp, int);
 static int (*dlsym_deflateSetDictionary)(z_streamp, const Bytef *, uInt);
 static int (*dlsym_deflateReset)(z_streamp);
 static int (*dlsym_deflateEnd)(z_streamp);
+static uLong (*dlsym_deflateBound)(z_streamp, uLong);
+static uLong (*dlsym_crc32)(uLong, const Bytef *, uInt);
+static int (*dlsym_deflateCopy)(z_streamp, z_streamp);
+
+static const char *ZlibCompressor_libraryName;
+static const struct hadoop_libdeflate *libdeflate;
+
+/*
+ * A deflate stream, with what is needed to compress a whole stream in one
+ * call with libdeflate instead. The z_stream comes first, so that ZSTREAM()
+ * applies to the handle as before.
+ */
+struct deflate_stream {
+  z_stream strm;
+  libdeflate_compress_fn one_shot;  // NULL if the settings rule it out
+  int level;
+  int has_dictionary;
+  int one_shot_done;                // the stream was compressed in one call
+  struct libdeflate_compressor *compressor;
+};
+
+#define DEFLATE_STREAM(stream) ((struct deflate_stream*)ZSTREAM(stream))
 
 JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_initIDs(
-	JNIEnv *env, jclass class
+	JNIEnv *env, jclass class, jstring accelerator, jboolean useLibdeflate
 	) {
-	// Load libz.so
-	void *libz = dlopen(HADOOP_ZLIB_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+	static const char * const symbols[] = {
+		"deflateInit2_", "deflate", "deflateSetDictionary", "deflateReset",
+		"deflateEnd", "deflateBound", "crc32", "deflateCopy", NULL
+	};
+
+	// Load the accelerator library if there is one, else libz.so
+	void *libz = hadoop_zlib_open(env, accelerator, symbols,
+	                              &ZlibCompressor_libraryName);
 	if (!libz) {
-		THROW(env, "java/lang/UnsatisfiedLinkError", "Cannot load libz.so");
 	  	return;
 	}
 
@@ -59,13 +89,20 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_initIDs(
 	LOAD_DYNAMIC_SYMBOL(dlsym_deflateSetDictionary, env, libz, "deflateSetDictionary");
 	LOAD_DYNAMIC_SYMBOL(dlsym_deflateReset, env, libz, "deflateReset");
 	LOAD_DYNAMIC_SYMBOL(dlsym_deflateEnd, env, libz, "deflateEnd");
+	LOAD_DYNAMIC_SYMBOL(dlsym_deflateBound, env, libz, "deflateBound");
+	LOAD_DYNAMIC_SYMBOL(dlsym_crc32, env, libz, "crc32");
+	LOAD_DYNAMIC_SYMBOL(dlsym_deflateCopy, env, libz, "deflateCopy");
+
+	// An accelerator is there to do the work, so libdeflate must not
+	if (useLibdeflate && !strcmp(ZlibCompressor_libraryName, HADOOP_ZLIB_LIBRARY)) {
+		libdeflate = hadoop_libdeflate_open();
+	}
 
 	// Initialize the requisite fieldIds
-    ZlibCompressor_clazz = (*env)->GetStaticFieldID(env, class, "clazz", 
-                                                      "Ljava/lang/Class;");
     ZlibCompressor_stream = (*env)->GetFieldID(env, class, "stream", "J");
     ZlibCompressor_finish = (*env)->GetFieldID(env, class, "finish", "Z");
     ZlibCompressor_finished = (*env)->GetFieldID(env, class, "finished", "Z");
+    ZlibCompressor_parallel = (*env)->GetFieldID(env, class, "parallel", "J");
     ZlibCompressor_uncompressedDirectBuf = (*env)->GetFieldID(env, class, 
     									"uncompressedDirectBuf", 
     									"Ljava/nio/Buffer;");
@@ -80,17 +117,35 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_initIDs(
     										"directBufferSize", "I");
 }
 
+JNIEXPORT jstring JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_getLibraryName(
+	JNIEnv *env, jclass class
+	) {
+    return (*env)->NewStringUTF(env, ZlibCompressor_libraryName);
+}
+
 JNIEXPORT jlong JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_init(
 	JNIEnv *env, jclass class, jint level, jint strategy, jint windowBits
 	) {
 	// Create a z_stream
-    z_stream *stream = malloc(sizeof(z_stream));
-    if (!stream) {
+    struct deflate_stream *ds = calloc(1, sizeof(struct deflate_stream));
+    if (!ds) {
 		THROW(env, "java/lang/OutOfMemoryError", NULL);
 		return (jlong)0;
     }
-    memset((void*)stream, 0, sizeof(z_stream));
+    z_stream *stream = &ds->strm;
+
+    // libdeflate writes the same formats with the default strategy and a
+    // full window
+    if (libdeflate && strategy == Z_DEFAULT_STRATEGY) {
+		switch (windowBits) {
+			case -MAX_WBITS: ds->one_shot = libdeflate->deflate_compress; break;
+			case MAX_WBITS: ds->one_shot = libdeflate->zlib_compress; break;
+			case MAX_WBITS + 16: ds->one_shot = libdeflate->gzip_compress; break;
+		}
+		ds->level = level == Z_DEFAULT_COMPRESSION ? 6 : level;
+    }
 
 	// Initialize stream
 	static const int memLevel = 8; 							// See zconf.h
@@ -99,7 +154,7 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_init(
     			
     if (rv != Z_OK) {
 	    // Contingency - Report error by throwing appropriate exceptions
-	    free(stream);
+	    free(ds);
 	    stream = NULL;
 	
 		switch (rv) {
@@ -124,17 +179,143 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_init(
     return JLONG(stream);
 }
 
+/*
+ * Process-wide cache of streams already primed with a dictionary.
+ *
+ * deflateSetDictionary hashes the whole dictionary into the stream, which
+ * for small records can cost as much as compressing them. Streams set up
+ * once per distinct dictionary and settings are kept here instead, and
+ * compressors take a copy with deflateCopy. Entries are never modified or
+ * freed once published, so they are copied from without holding the lock.
+ */
+#define PRIMED_CACHE_SIZE 16
+
+struct primed_stream {
+  int level;
+  int strategy;
+  int window_bits;
+  uInt dict_len;
+  Bytef *dict;
+  z_stream stream;
+};
+
+static struct primed_stream *primed_cache[PRIMED_CACHE_SIZE];
+static int primed_cache_used = 0;
+static pthread_mutex_t primed_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Must be called with primed_cache_lock held */
+static struct primed_stream *primed_cache_lookup(int level, int strategy,
+    int window_bits, const Bytef *dict, uInt dict_len)
+{
+  int i;
+
+  for (i = 0; i < primed_cache_used; i++) {
+    struct primed_stream *p = primed_cache[i];
+    if (p->level == level && p->strategy == strategy &&
+        p->window_bits == window_bits && p->dict_len == dict_len &&
+        memcmp(p->dict, dict, dict_len) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static void primed_stream_free(struct primed_stream *p)
+{
+  dlsym_deflateEnd(&p->stream);
+  free(p->dict);
+  free(p);
+}
+
+/**
+ * Find or create the primed stream for the given settings and dictionary.
+ * Returns NULL if the cache is full or the stream could not be set up,
+ * with *rv holding the zlib error in the latter case.
+ */
+static struct primed_stream *primed_cache_get(int level, int strategy,
+    int window_bits, const Bytef *dict, uInt dict_len, int *rv)
+{
+  static const int memLevel = 8;
+  struct primed_stream *p, *found;
+  int published, full;
+
+  *rv = Z_OK;
+  pthread_mutex_lock(&primed_cache_lock);
+  p = primed_cache_lookup(level, strategy, window_bits, dict, dict_len);
+  full = primed_cache_used >= PRIMED_CACHE_SIZE;
+  pthread_mutex_unlock(&primed_cache_lock);
+  if (p || full) {
+    return p;
+  }
+
+  p = calloc(1, sizeof(struct primed_stream));
+  if (!p || !(p->dict = malloc(dict_len ? dict_len : 1))) {
+    free(p);
+    *rv = Z_MEM_ERROR;
+    return NULL;
+  }
+  p->level = level;
+  p->strategy = strategy;
+  p->window_bits = window_bits;
+  p->dict_len = dict_len;
+  memcpy(p->dict, dict, dict_len);
+  *rv = dlsym_deflateInit2_(&p->stream, level, Z_DEFLATED, window_bits,
+                            memLevel, strategy, ZLIB_VERSION, sizeof(z_stream));
+  if (*rv != Z_OK) {
+    free(p->dict);
+    free(p);
+    return NULL;
+  }
+  *rv = dlsym_deflateSetDictionary(&p->stream, p->dict, dict_len);
+  if (*rv != Z_OK) {
+    primed_stream_free(p);
+    return NULL;
+  }
+
+  // Publish it, unless another thread got there first or the cache filled
+  pthread_mutex_lock(&primed_cache_lock);
+  found = primed_cache_lookup(level, strategy, window_bits, dict, dict_len);
+  published = !found && primed_cache_used < PRIMED_CACHE_SIZE;
+  if (published) {
+    primed_cache[primed_cache_used++] = p;
+  }
+  pthread_mutex_unlock(&primed_cache_lock);
+  if (!published) {
+    primed_stream_free(p);
+  }
+  return published ? p : found;
+}
+
 JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_setDictionary(
-	JNIEnv *env, jclass class, jlong stream, 
-	jarray b, jint off, jint len
+	JNIEnv *env, jclass class, jlong stream, jint level, jint strategy,
+	jint windowBits, jarray b, jint off, jint len
 	) {
+    static const int memLevel = 8;
+    struct primed_stream *primed;
+    int rv;
+
     Bytef *buf = (*env)->GetPrimitiveArrayCritical(env, b, 0);
     if (!buf) {
         return;
     }
-    int rv = dlsym_deflateSetDictionary(ZSTREAM(stream), buf + off, len);
+    primed = primed_cache_get(level, strategy, windowBits, buf + off, len, &rv);
+    if (primed) {
+        // Replace the stream with a copy of the primed one
+        z_stream *strm = ZSTREAM(stream);
+        dlsym_deflateEnd(strm);
+        rv = dlsym_deflateCopy(strm, &primed->stream);
+        if (rv != Z_OK) {
+            // Leave the stream usable, if without the dictionary
+            memset(strm, 0, sizeof(z_stream));
+            dlsym_deflateInit2_(strm, level, Z_DEFLATED, windowBits, memLevel,
+                                strategy, ZLIB_VERSION, sizeof(z_stream));
+        }
+    } else if (rv == Z_OK) {
+        rv = dlsym_deflateSetDictionary(ZSTREAM(stream), buf + off, len);
+    }
     (*env)->ReleasePrimitiveArrayCritical(env, b, buf, 0);
+    DEFLATE_STREAM(stream)->has_dictionary = 1;
     
     if (rv != Z_OK) {
     	// Contingency - Report error by throwing appropriate exceptions
@@ -144,6 +325,11 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_setDictionary(
 		    	THROW(env, "java/lang/IllegalArgumentException", NULL);
 			}
 			break;
+		    case Z_MEM_ERROR:
+			{
+		    	THROW(env, "java/lang/OutOfMemoryError", NULL);
+			}
+			break;
 	    	default:
 			{
 				THROW(env, "java/lang/InternalError", (ZSTREAM(stream))->msg);
@@ -153,10 +339,573 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_setDictionary(
     }
 }
 
+JNIEXPORT jbyteArray JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_trainDictionary(
+	JNIEnv *env, jclass class, jbyteArray samples, jintArray sampleSizes,
+	jint dictSize
+	) {
+    jsize num_samples = (*env)->GetArrayLength(env, sampleSizes);
+    size_t *sizes = malloc(sizeof(size_t) * (num_samples ? num_samples : 1));
+    unsigned char *dict = malloc(dictSize > 0 ? dictSize : 1);
+    jbyteArray result = NULL;
+    jint *sizes_j = NULL;
+    jbyte *samples_j = NULL;
+    size_t dict_len;
+    jsize i;
+
+    if (!sizes || !dict) {
+		THROW(env, "java/lang/OutOfMemoryError", NULL);
+		goto done;
+    }
+    sizes_j = (*env)->GetIntArrayElements(env, sampleSizes, NULL);
+    if (!sizes_j) {
+		goto done;
+    }
+    for (i = 0; i < num_samples; i++) {
+		sizes[i] = sizes_j[i];
+    }
+    (*env)->ReleaseIntArrayElements(env, sampleSizes, sizes_j, JNI_ABORT);
+    samples_j = (*env)->GetByteArrayElements(env, samples, NULL);
+    if (!samples_j) {
+		goto done;
+    }
+    dict_len = hadoop_zlib_train_dictionary((const unsigned char *)samples_j,
+                                            sizes, num_samples, dict, dictSize);
+    (*env)->ReleaseByteArrayElements(env, samples, samples_j, JNI_ABORT);
+    result = (*env)->NewByteArray(env, dict_len);
+    if (result) {
+		(*env)->SetByteArrayRegion(env, result, 0, dict_len, (jbyte *)dict);
+    }
+
+done:
+    free(sizes);
+    free(dict);
+    return result;
+}
+
+/*
+ * Block-parallel gzip compression, after pigz.
+ *
+ * The input is cut into fixed-size blocks which are deflated independently
+ * on a pool of worker threads. Each block is primed with the last 32KB of
+ * the block before it, so the compression ratio is close to that of a
+ * single stream. Every block but the last ends with a sync flush, which
+ * leaves the output byte-aligned, so the raw deflate output of the blocks
+ * can simply be concatenated behind one gzip header. The CRC32 of each
+ * block is computed by its worker and combined in order for the trailer.
+ * The result is an ordinary single-member gzip stream.
+ */
+
+#define PGZIP_DICT_SIZE 32768
+
+#define PGZIP_FREE 0
+#define PGZIP_FILLING 1
+#define PGZIP_QUEUED 2
+#define PGZIP_RUNNING 3
+#define PGZIP_DONE 4
+
+struct pgzip_job {
+  int state;
+  int last;
+  int error;
+  // PGZIP_DICT_SIZE bytes of dictionary space followed by the block
+  Bytef *in;
+  size_t in_len;
+  size_t dict_len;
+  Bytef *out;
+  size_t out_len;
+  size_t out_off;
+  uint32_t crc;
+};
+
+struct pgzip_worker {
+  struct pgzip *pgz;
+  z_stream stream;
+  pthread_t thread;
+};
+
+struct pgzip {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  int shutdown;
+
+  int num_workers;
+  struct pgzip_worker *workers;
+
+  // Ring of jobs in stream order. Jobs head .. head + count - 1 are in use;
+  // next_run is the oldest job still waiting for a worker.
+  int num_jobs;
+  struct pgzip_job *jobs;
+  int head;
+  int count;
+  int next_run;
+  int queued;
+
+  size_t block_size;
+  size_t out_size;
+
+  // Bytes of gzip header or trailer waiting to be written
+  Bytef pend[10];
+  int pend_len;
+  int pend_off;
+
+  int started;
+  int last_submitted;
+  int finished;
+  uint32_t crc;
+  uint64_t total_in;
+  uint64_t total_out;
+};
+
+#define PGZIP(handle) ((struct pgzip*)((ptrdiff_t)(handle)))
+
+static void *pgzip_worker_run(void *arg) {
+  struct pgzip_worker *worker = arg;
+  struct pgzip *pgz = worker->pgz;
+  z_stream *stream = &worker->stream;
+  struct pgzip_job *job;
+  int rv;
+
+  pthread_mutex_lock(&pgz->lock);
+  for (;;) {
+    while (!pgz->shutdown && pgz->queued == 0) {
+      pthread_cond_wait(&pgz->work_cond, &pgz->lock);
+    }
+    if (pgz->shutdown) {
+      break;
+    }
+    job = &pgz->jobs[pgz->next_run];
+    job->state = PGZIP_RUNNING;
+    pgz->next_run = (pgz->next_run + 1) % pgz->num_jobs;
+    pgz->queued--;
+    pthread_mutex_unlock(&pgz->lock);
+
+    rv = dlsym_deflateReset(stream);
+    if (rv == Z_OK && job->dict_len > 0) {
+      rv = dlsym_deflateSetDictionary(stream,
+               job->in + PGZIP_DICT_SIZE - job->dict_len, job->dict_len);
+    }
+    if (rv == Z_OK) {
+      stream->next_in = job->in + PGZIP_DICT_SIZE;
+      stream->avail_in = job->in_len;
+      stream->next_out = job->out;
+      stream->avail_out = pgz->out_size;
+      rv = dlsym_deflate(stream, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+      if (job->last ? rv != Z_STREAM_END :
+                      (rv != Z_OK || stream->avail_in != 0)) {
+        rv = Z_BUF_ERROR;
+      } else {
+        rv = Z_OK;
+      }
+    }
+    job->out_len = pgz->out_size - stream->avail_out;
+    job->crc = dlsym_crc32(0L, job->in + PGZIP_DICT_SIZE, job->in_len);
+
+    pthread_mutex_lock(&pgz->lock);
+    job->error = (rv != Z_OK);
+    job->state = PGZIP_DONE;
+    pthread_cond_broadcast(&pgz->done_cond);
+  }
+  pthread_mutex_unlock(&pgz->lock);
+  return NULL;
+}
+
+/**
+ * Stop the workers and free everything. num_started says how many worker
+ * threads were started, so this can also unwind a partial pgzip_create.
+ */
+static void pgzip_free(struct pgzip *pgz, int num_started) {
+  int i;
+
+  pthread_mutex_lock(&pgz->lock);
+  pgz->shutdown = 1;
+  pthread_cond_broadcast(&pgz->work_cond);
+  pthread_mutex_unlock(&pgz->lock);
+  for (i = 0; i < num_started; i++) {
+    pthread_join(pgz->workers[i].thread, NULL);
+  }
+  if (pgz->workers) {
+    for (i = 0; i < pgz->num_workers; i++) {
+      if (pgz->workers[i].stream.state) {
+        dlsym_deflateEnd(&pgz->workers[i].stream);
+      }
+    }
+    free(pgz->workers);
+  }
+  if (pgz->jobs) {
+    for (i = 0; i < pgz->num_jobs; i++) {
+      free(pgz->jobs[i].in);
+      free(pgz->jobs[i].out);
+    }
+    free(pgz->jobs);
+  }
+  pthread_cond_destroy(&pgz->done_cond);
+  pthread_cond_destroy(&pgz->work_cond);
+  pthread_mutex_destroy(&pgz->lock);
+  free(pgz);
+}
+
+/**
+ * Wait for the workers to go idle and forget all buffered data.
+ * Must be called with the lock held.
+ */
+static void pgzip_reset_locked(struct pgzip *pgz) {
+  int i;
+
+  for (i = 0; i < pgz->num_jobs; i++) {
+    while (pgz->jobs[i].state == PGZIP_QUEUED ||
+           pgz->jobs[i].state == PGZIP_RUNNING) {
+      pthread_cond_wait(&pgz->done_cond, &pgz->lock);
+    }
+  }
+  for (i = 0; i < pgz->num_jobs; i++) {
+    pgz->jobs[i].state = PGZIP_FREE;
+  }
+  pgz->head = pgz->count = pgz->next_run = pgz->queued = 0;
+  pgz->pend_len = pgz->pend_off = 0;
+  pgz->started = pgz->last_submitted = pgz->finished = 0;
+  pgz->crc = 0;
+  pgz->total_in = pgz->total_out = 0;
+}
+
+/**
+ * Create a parallel compressor. Returns 0 on success, or a zlib error code.
+ */
+static int pgzip_create(int level, int strategy, int num_workers,
+                        size_t block_size, struct pgzip **out) {
+  static const int memLevel = 8;
+  struct pgzip *pgz;
+  int i, rv = Z_OK, num_started = 0;
+
+  pgz = calloc(1, sizeof(struct pgzip));
+  if (!pgz) {
+    return Z_MEM_ERROR;
+  }
+  pthread_mutex_init(&pgz->lock, NULL);
+  pthread_cond_init(&pgz->work_cond, NULL);
+  pthread_cond_init(&pgz->done_cond, NULL);
+  if (block_size < PGZIP_DICT_SIZE) {
+    block_size = PGZIP_DICT_SIZE;
+  }
+  pgz->block_size = block_size;
+  pgz->num_workers = num_workers;
+  // Two jobs per worker lets the workers run while the caller is still
+  // draining finished blocks.
+  pgz->num_jobs = 2 * num_workers;
+
+  pgz->workers = calloc(num_workers, sizeof(struct pgzip_worker));
+  pgz->jobs = calloc(pgz->num_jobs, sizeof(struct pgzip_job));
+  if (!pgz->workers || !pgz->jobs) {
+    rv = Z_MEM_ERROR;
+    goto error;
+  }
+  for (i = 0; i < num_workers; i++) {
+    pgz->workers[i].pgz = pgz;
+    // Negative windowBits: raw deflate, the gzip framing is written here
+    rv = dlsym_deflateInit2_(&pgz->workers[i].stream, level, Z_DEFLATED,
+                             -MAX_WBITS, memLevel, strategy, ZLIB_VERSION,
+                             sizeof(z_stream));
+    if (rv != Z_OK) {
+      goto error;
+    }
+  }
+  // Leave room for the sync flush marker behind each block
+  pgz->out_size = dlsym_deflateBound(&pgz->workers[0].stream, block_size) + 16;
+  for (i = 0; i < pgz->num_jobs; i++) {
+    pgz->jobs[i].in = malloc(PGZIP_DICT_SIZE + block_size);
+    pgz->jobs[i].out = malloc(pgz->out_size);
+    if (!pgz->jobs[i].in || !pgz->jobs[i].out) {
+      rv = Z_MEM_ERROR;
+      goto error;
+    }
+  }
+  for (i = 0; i < num_workers; i++) {
+    if (pthread_create(&pgz->workers[i].thread, NULL, pgzip_worker_run,
+                       &pgz->workers[i])) {
+      rv = Z_MEM_ERROR;
+      goto error;
+    }
+    num_started++;
+  }
+  *out = pgz;
+  return Z_OK;
+
+error:
+  pgzip_free(pgz, num_started);
+  return rv;
+}
+
+static void pgzip_put_le32(Bytef *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+/**
+ * Hand a filled job to the workers. Must be called with the lock held.
+ */
+static void pgzip_submit_locked(struct pgzip *pgz, struct pgzip_job *job,
+                                int last) {
+  job->last = last;
+  job->state = PGZIP_QUEUED;
+  pgz->queued++;
+  if (last) {
+    pgz->last_submitted = 1;
+  }
+  pthread_cond_signal(&pgz->work_cond);
+}
+
+/**
+ * Take as much of the input as the free jobs can hold, submitting each job
+ * as it fills up. With finish set, the job holding the end of the input is
+ * submitted as the last block. Must be called with the lock held.
+ *
+ * @return the number of input bytes consumed
+ */
+static size_t pgzip_fill_locked(struct pgzip *pgz, const Bytef *in,
+                                size_t in_len, int finish) {
+  size_t consumed = 0, n;
+  struct pgzip_job *job, *prev;
+  int idx;
+
+  while (!pgz->last_submitted && (consumed < in_len || finish)) {
+    idx = (pgz->head + pgz->count - 1 + pgz->num_jobs) % pgz->num_jobs;
+    job = &pgz->jobs[idx];
+    if (pgz->count == 0 || job->state != PGZIP_FILLING) {
+      if (pgz->count == pgz->num_jobs) {
+        break;
+      }
+      idx = (pgz->head + pgz->count) % pgz->num_jobs;
+      job = &pgz->jobs[idx];
+      job->state = PGZIP_FILLING;
+      job->in_len = 0;
+      job->out_off = 0;
+      job->dict_len = 0;
+      if (pgz->started) {
+        // The slot before this one is either still in use or was freed
+        // without being reused, so its input is intact.
+        prev = &pgz->jobs[(idx - 1 + pgz->num_jobs) % pgz->num_jobs];
+        job->dict_len = prev->in_len < PGZIP_DICT_SIZE ?
+                        prev->in_len : PGZIP_DICT_SIZE;
+        memcpy(job->in + PGZIP_DICT_SIZE - job->dict_len,
+               prev->in + PGZIP_DICT_SIZE + prev->in_len - job->dict_len,
+               job->dict_len);
+      }
+      pgz->started = 1;
+      pgz->count++;
+    }
+    n = pgz->block_size - job->in_len;
+    if (n > in_len - consumed) {
+      n = in_len - consumed;
+    }
+    memcpy(job->in + PGZIP_DICT_SIZE + job->in_len, in + consumed, n);
+    job->in_len += n;
+    consumed += n;
+    if (finish && consumed == in_len) {
+      pgzip_submit_locked(pgz, job, 1);
+    } else if (job->in_len == pgz->block_size) {
+      pgzip_submit_locked(pgz, job, 0);
+    }
+  }
+  return consumed;
+}
+
+/**
+ * Copy finished output to out, in stream order, without waiting for the
+ * workers. Must be called with the lock held.
+ *
+ * @return the number of bytes written, or -1 if a block failed to compress
+ */
+static ssize_t pgzip_drain_locked(struct pgzip *pgz, Bytef *out,
+                                  size_t out_len) {
+  size_t produced = 0, n;
+  struct pgzip_job *job;
+
+  if (pgz->total_out == 0 && pgz->pend_len == 0) {
+    // gzip header: deflate, no flags, no mtime, unix
+    static const Bytef header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    memcpy(pgz->pend, header, sizeof(header));
+    pgz->pend_len = sizeof(header);
+    pgz->pend_off = 0;
+  }
+  while (produced < out_len) {
+    if (pgz->pend_off < pgz->pend_len) {
+      n = pgz->pend_len - pgz->pend_off;
+      if (n > out_len - produced) {
+        n = out_len - produced;
+      }
+      memcpy(out + produced, pgz->pend + pgz->pend_off, n);
+      pgz->pend_off += n;
+      produced += n;
+      continue;
+    }
+    if (pgz->count == 0) {
+      if (pgz->last_submitted) {
+        pgz->finished = 1;
+      }
+      break;
+    }
+    job = &pgz->jobs[pgz->head];
+    if (job->state != PGZIP_DONE) {
+      break;
+    }
+    if (job->error) {
+      return -1;
+    }
+    n = job->out_len - job->out_off;
+    if (n > out_len - produced) {
+      n = out_len - produced;
+    }
+    memcpy(out + produced, job->out + job->out_off, n);
+    job->out_off += n;
+    produced += n;
+    if (job->out_off == job->out_len) {
+      pgz->crc = crc32_zlib_combine(pgz->crc, job->crc, job->in_len);
+      pgz->total_in += job->in_len;
+      if (job->last) {
+        pgzip_put_le32(pgz->pend, pgz->crc);
+        pgzip_put_le32(pgz->pend + 4, (uint32_t)pgz->total_in);
+        pgz->pend_len = 8;
+        pgz->pend_off = 0;
+      }
+      job->state = PGZIP_FREE;
+      pgz->head = (pgz->head + 1) % pgz->num_jobs;
+      pgz->count--;
+    }
+  }
+  pgz->total_out += produced;
+  return produced;
+}
+
+/**
+ * Feed input to the parallel compressor and collect whatever output is
+ * ready. This only blocks when no output is ready and either the input
+ * cannot be queued or the stream is being finished.
+ *
+ * @return the number of bytes written to out, or -1 on a compression error
+ */
+static ssize_t pgzip_deflate(struct pgzip *pgz, const Bytef *in,
+                             size_t in_len, size_t *in_consumed,
+                             Bytef *out, size_t out_len, int finish) {
+  size_t consumed = 0;
+  ssize_t produced;
+
+  pthread_mutex_lock(&pgz->lock);
+  for (;;) {
+    consumed += pgzip_fill_locked(pgz, in + consumed, in_len - consumed,
+                                  finish);
+    produced = pgzip_drain_locked(pgz, out, out_len);
+    if (produced != 0 || pgz->finished) {
+      break;
+    }
+    if (consumed == in_len && !finish) {
+      break;
+    }
+    // The first block in line must be finished before anything else can
+    // make progress.
+    while (pgz->jobs[pgz->head].state != PGZIP_DONE) {
+      pthread_cond_wait(&pgz->done_cond, &pgz->lock);
+    }
+  }
+  pthread_mutex_unlock(&pgz->lock);
+  *in_consumed = consumed;
+  return produced;
+}
+
+static jint deflate_parallel(JNIEnv *env, jobject this, struct pgzip *pgz) {
+  jobject uncompressed_direct_buf = (*env)->GetObjectField(env, this,
+                  ZlibCompressor_uncompressedDirectBuf);
+  jint uncompressed_direct_buf_off = (*env)->GetIntField(env, this,
+                  ZlibCompressor_uncompressedDirectBufOff);
+  jint uncompressed_direct_buf_len = (*env)->GetIntField(env, this,
+                  ZlibCompressor_uncompressedDirectBufLen);
+  jobject compressed_direct_buf = (*env)->GetObjectField(env, this,
+                  ZlibCompressor_compressedDirectBuf);
+  jint compressed_direct_buf_len = (*env)->GetIntField(env, this,
+                  ZlibCompressor_directBufferSize);
+  jboolean finish = (*env)->GetBooleanField(env, this, ZlibCompressor_finish);
+  size_t consumed;
+  ssize_t produced;
+
+  Bytef *uncompressed_bytes = (*env)->GetDirectBufferAddress(env,
+                  uncompressed_direct_buf);
+  if (uncompressed_bytes == 0) {
+    return (jint)0;
+  }
+  Bytef *compressed_bytes = (*env)->GetDirectBufferAddress(env,
+                  compressed_direct_buf);
+  if (compressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  produced = pgzip_deflate(pgz,
+                  uncompressed_bytes + uncompressed_direct_buf_off,
+                  uncompressed_direct_buf_len, &consumed,
+                  compressed_bytes, compressed_direct_buf_len, finish);
+  if (produced < 0) {
+    THROW(env, "java/lang/InternalError", "parallel deflate failed");
+    return (jint)0;
+  }
+  (*env)->SetIntField(env, this, ZlibCompressor_uncompressedDirectBufOff,
+                  uncompressed_direct_buf_off + consumed);
+  (*env)->SetIntField(env, this, ZlibCompressor_uncompressedDirectBufLen,
+                  uncompressed_direct_buf_len - consumed);
+  if (pgz->finished) {
+    (*env)->SetBooleanField(env, this, ZlibCompressor_finished, JNI_TRUE);
+  }
+  return (jint)produced;
+}
+
+/*
+ * Compress a whole stream with libdeflate, if the first call for the stream
+ * is also the last: the caller has finished and all the input is here, as
+ * for a record or block compressed on its own. The z_stream is left as it
+ * was but for its totals.
+ *
+ * @return 1 with the bytes written in produced, or 0 to use zlib.
+ */
+static int deflate_one_shot(struct deflate_stream *ds,
+                            const Bytef *in, size_t in_len,
+                            Bytef *out, size_t out_len, size_t *produced) {
+  if (ds->one_shot_done) {
+    // As zlib does when called again at the end of a stream
+    *produced = 0;
+    return 1;
+  }
+  if (!ds->one_shot || ds->has_dictionary ||
+      ds->strm.total_in || ds->strm.total_out) {
+    return 0;
+  }
+  if (!ds->compressor) {
+    ds->compressor = libdeflate->alloc_compressor(ds->level);
+    if (!ds->compressor) {
+      ds->one_shot = NULL;
+      return 0;
+    }
+  }
+  // 0 means the output did not fit, which zlib then streams out instead
+  size_t n = ds->one_shot(ds->compressor, in, in_len, out, out_len);
+  if (!n) {
+    return 0;
+  }
+  ds->strm.total_in = in_len;
+  ds->strm.total_out = n;
+  ds->one_shot_done = 1;
+  *produced = n;
+  return 1;
+}
+
 JNIEXPORT jint JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_deflateBytesDirect(
 	JNIEnv *env, jobject this
 	) {
+    jlong parallel = (*env)->GetLongField(env, this, ZlibCompressor_parallel);
+    if (parallel) {
+      return deflate_parallel(env, this, PGZIP(parallel));
+    }
+
 	// Get members of ZlibCompressor
     z_stream *stream = ZSTREAM(
     						(*env)->GetLongField(env, this, 
@@ -168,8 +917,6 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_deflateBytesDirect(
     } 
 
     // Get members of ZlibCompressor
-    jobject clazz = (*env)->GetStaticObjectField(env, this, 
-                                                 ZlibCompressor_clazz);
 	jobject uncompressed_direct_buf = (*env)->GetObjectField(env, this, 
 									ZlibCompressor_uncompressedDirectBuf);
 	jint uncompressed_direct_buf_off = (*env)->GetIntField(env, this, 
@@ -185,25 +932,34 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_deflateBytesDirect(
 	jboolean finish = (*env)->GetBooleanField(env, this, ZlibCompressor_finish);
 
     // Get the input direct buffer
-    LOCK_CLASS(env, clazz, "ZlibCompressor");
 	Bytef* uncompressed_bytes = (*env)->GetDirectBufferAddress(env, 
 											uncompressed_direct_buf);
-    UNLOCK_CLASS(env, clazz, "ZlibCompressor");
     
   	if (uncompressed_bytes == 0) {
     	return (jint)0;
 	}
 	
     // Get the output direct buffer
-    LOCK_CLASS(env, clazz, "ZlibCompressor");
 	Bytef* compressed_bytes = (*env)->GetDirectBufferAddress(env, 
 										compressed_direct_buf);
-    UNLOCK_CLASS(env, clazz, "ZlibCompressor");
 
   	if (compressed_bytes == 0) {
 		return (jint)0;
 	}
 	
+	// Compress the stream in one call if this call has all of it
+	size_t one_shot_bytes;
+	if (finish && deflate_one_shot((struct deflate_stream *)stream,
+			uncompressed_bytes + uncompressed_direct_buf_off,
+			uncompressed_direct_buf_len, compressed_bytes,
+			compressed_direct_buf_len, &one_shot_bytes)) {
+		(*env)->SetBooleanField(env, this, ZlibCompressor_finished, JNI_TRUE);
+		(*env)->SetIntField(env, this, ZlibCompressor_uncompressedDirectBufOff,
+					uncompressed_direct_buf_off + uncompressed_direct_buf_len);
+		(*env)->SetIntField(env, this, ZlibCompressor_uncompressedDirectBufLen, 0);
+		return (jint)one_shot_bytes;
+	}
+
 	// Re-calibrate the z_stream
   	stream->next_in = uncompressed_bytes + uncompressed_direct_buf_off;
   	stream->next_out = compressed_bytes;
@@ -260,6 +1016,8 @@ JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_reset(
 	JNIEnv *env, jclass class, jlong stream
 	) {
+    DEFLATE_STREAM(stream)->has_dictionary = 0;
+    DEFLATE_STREAM(stream)->one_shot_done = 0;
     if (dlsym_deflateReset(ZSTREAM(stream)) != Z_OK) {
 		THROW(env, "java/lang/InternalError", NULL);
     }
@@ -269,11 +1027,89 @@ JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_end(
 	JNIEnv *env, jclass class, jlong stream
 	) {
-    if (dlsym_deflateEnd(ZSTREAM(stream)) == Z_STREAM_ERROR) {
+    struct deflate_stream *ds = DEFLATE_STREAM(stream);
+    if (ds->compressor) {
+		libdeflate->free_compressor(ds->compressor);
+		ds->compressor = NULL;
+    }
+    if (dlsym_deflateEnd(&ds->strm) == Z_STREAM_ERROR) {
 		THROW(env, "java/lang/InternalError", NULL);
     } else {
-		free(ZSTREAM(stream));
+		free(ds);
+    }
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_initParallel(
+	JNIEnv *env, jclass class, jint level, jint strategy, jint threads,
+	jint blockSize
+	) {
+    struct pgzip *pgz = NULL;
+
+    if (threads < 1 || blockSize < 1) {
+      THROW(env, "java/lang/IllegalArgumentException", NULL);
+      return (jlong)0;
     }
+    switch (pgzip_create(level, strategy, threads, blockSize, &pgz)) {
+      case Z_OK:
+        break;
+      case Z_MEM_ERROR:
+        THROW(env, "java/lang/OutOfMemoryError", NULL);
+        return (jlong)0;
+      case Z_STREAM_ERROR:
+        THROW(env, "java/lang/IllegalArgumentException", NULL);
+        return (jlong)0;
+      default:
+        THROW(env, "java/lang/InternalError", NULL);
+        return (jlong)0;
+    }
+    return JLONG(pgz);
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_getParallelBytesRead(
+	JNIEnv *env, jclass class, jlong parallel
+	) {
+    struct pgzip *pgz = PGZIP(parallel);
+    jlong total_in;
+
+    pthread_mutex_lock(&pgz->lock);
+    total_in = pgz->total_in;
+    pthread_mutex_unlock(&pgz->lock);
+    return total_in;
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_getParallelBytesWritten(
+	JNIEnv *env, jclass class, jlong parallel
+	) {
+    struct pgzip *pgz = PGZIP(parallel);
+    jlong total_out;
+
+    pthread_mutex_lock(&pgz->lock);
+    total_out = pgz->total_out;
+    pthread_mutex_unlock(&pgz->lock);
+    return total_out;
+}
+
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_resetParallel(
+	JNIEnv *env, jclass class, jlong parallel
+	) {
+    struct pgzip *pgz = PGZIP(parallel);
+
+    pthread_mutex_lock(&pgz->lock);
+    pgzip_reset_locked(pgz);
+    pthread_mutex_unlock(&pgz->lock);
+}
+
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibCompressor_endParallel(
+	JNIEnv *env, jclass class, jlong parallel
+	) {
+    struct pgzip *pgz = PGZIP(parallel);
+
+    pgzip_free(pgz, pgz->num_workers);
 }
 
 /**
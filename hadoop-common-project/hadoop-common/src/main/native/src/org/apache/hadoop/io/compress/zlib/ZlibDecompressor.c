@@ -25,30 +25,43 @@
 #include "org_apache_hadoop_io_compress_zlib.h"
 #include "org_apache_hadoop_io_compress_zlib_ZlibDecompressor.h"
 
-static jfieldID ZlibDecompressor_clazz;
-static jfieldID ZlibDecompressor_stream;
-static jfieldID ZlibDecompressor_compressedDirectBuf;
-static jfieldID ZlibDecompressor_compressedDirectBufOff;
-static jfieldID ZlibDecompressor_compressedDirectBufLen;
-static jfieldID ZlibDecompressor_uncompressedDirectBuf;
-static jfieldID ZlibDecompressor_directBufferSize;
-static jfieldID ZlibDecompressor_needDict;
-static jfieldID ZlibDecompressor_finished;
-
 static int (*dlsym_inflateInit2_)(z_streamp, int, const char *, int);
 static int (*dlsym_inflate)(z_streamp, int);
 static int (*dlsym_inflateSetDictionary)(z_streamp, const Bytef *, uInt);
 static int (*dlsym_inflateReset)(z_streamp);
 static int (*dlsym_inflateEnd)(z_streamp);
 
+static const char *ZlibDecompressor_libraryName;
+static const struct hadoop_libdeflate *libdeflate;
+
+/*
+ * An inflate stream, with what is needed to decompress a whole stream in
+ * one call with libdeflate instead. The z_stream comes first, so that
+ * ZSTREAM() applies to the handle as before.
+ */
+struct inflate_stream {
+  z_stream strm;
+  int window_bits;
+  int one_shot;                     // the next call may try libdeflate
+  int one_shot_done;                // the stream was decompressed in one call
+  struct libdeflate_decompressor *decompressor;
+};
+
+#define INFLATE_STREAM(stream) ((struct inflate_stream*)ZSTREAM(stream))
+
 JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_initIDs(
-	JNIEnv *env, jclass class
+	JNIEnv *env, jclass class, jstring accelerator, jboolean useLibdeflate
 	) {
-	// Load libz.so
-    void *libz = dlopen(HADOOP_ZLIB_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+	static const char * const symbols[] = {
+		"inflateInit2_", "inflate", "inflateSetDictionary", "inflateReset",
+		"inflateEnd", NULL
+	};
+
+	// Load the accelerator library if there is one, else libz.so
+	void *libz = hadoop_zlib_open(env, accelerator, symbols,
+	                              &ZlibDecompressor_libraryName);
 	if (!libz) {
-	  THROW(env, "java/lang/UnsatisfiedLinkError", "Cannot load libz.so");
 	  return;
 	} 
 
@@ -60,43 +73,37 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_initIDs(
 	LOAD_DYNAMIC_SYMBOL(dlsym_inflateReset, env, libz, "inflateReset");
 	LOAD_DYNAMIC_SYMBOL(dlsym_inflateEnd, env, libz, "inflateEnd");
 
-	// Initialize the requisite fieldIds
-    ZlibDecompressor_clazz = (*env)->GetStaticFieldID(env, class, "clazz", 
-                                                      "Ljava/lang/Class;");
-    ZlibDecompressor_stream = (*env)->GetFieldID(env, class, "stream", "J");
-    ZlibDecompressor_needDict = (*env)->GetFieldID(env, class, "needDict", "Z");
-    ZlibDecompressor_finished = (*env)->GetFieldID(env, class, "finished", "Z");
-    ZlibDecompressor_compressedDirectBuf = (*env)->GetFieldID(env, class, 
-    											"compressedDirectBuf", 
-    											"Ljava/nio/Buffer;");
-    ZlibDecompressor_compressedDirectBufOff = (*env)->GetFieldID(env, class, 
-    										"compressedDirectBufOff", "I");
-    ZlibDecompressor_compressedDirectBufLen = (*env)->GetFieldID(env, class, 
-    										"compressedDirectBufLen", "I");
-    ZlibDecompressor_uncompressedDirectBuf = (*env)->GetFieldID(env, class, 
-    											"uncompressedDirectBuf", 
-    											"Ljava/nio/Buffer;");
-    ZlibDecompressor_directBufferSize = (*env)->GetFieldID(env, class, 
-    											"directBufferSize", "I");
+	// An accelerator is there to do the work, so libdeflate must not
+	if (useLibdeflate && !strcmp(ZlibDecompressor_libraryName, HADOOP_ZLIB_LIBRARY)) {
+		libdeflate = hadoop_libdeflate_open();
+	}
+}
+
+JNIEXPORT jstring JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_getLibraryName(
+	JNIEnv *env, jclass class
+	) {
+    return (*env)->NewStringUTF(env, ZlibDecompressor_libraryName);
 }
 
 JNIEXPORT jlong JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_init(
 	JNIEnv *env, jclass cls, jint windowBits
 	) {
-    z_stream *stream = malloc(sizeof(z_stream));
-    memset((void*)stream, 0, sizeof(z_stream));
-
-    if (stream == 0) {
+    struct inflate_stream *is = calloc(1, sizeof(struct inflate_stream));
+    if (!is) {
 		THROW(env, "java/lang/OutOfMemoryError", NULL);
 		return (jlong)0;
     } 
+    z_stream *stream = &is->strm;
+    is->window_bits = windowBits;
+    is->one_shot = libdeflate != NULL;
     
     int rv = dlsym_inflateInit2_(stream, windowBits, ZLIB_VERSION, sizeof(z_stream));
 
 	if (rv != Z_OK) {
 	    // Contingency - Report error by throwing appropriate exceptions
-		free(stream);
+		free(is);
 		stream = NULL;
 		
 		switch (rv) {
@@ -127,6 +134,7 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_setDictionary(
         return;
     }
     int rv = dlsym_inflateSetDictionary(ZSTREAM(stream), buf + off, len);
+    INFLATE_STREAM(stream)->one_shot = 0;
     (*env)->ReleasePrimitiveArrayCritical(env, b, buf, 0);
     
     if (rv != Z_OK) {
@@ -148,89 +156,142 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_setDictionary(
 	}
 }
 
-JNIEXPORT jint JNICALL
-Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_inflateBytesDirect(
-	JNIEnv *env, jobject this
+/*
+ * Layout of the value returned by inflateDirect: the bytes of output
+ * produced, the bytes of input consumed and the stream state, packed into
+ * one jlong so that no fields need to be written back through JNI.
+ */
+#define INFLATE_COUNT_BITS 30
+#define INFLATE_COUNT_MASK (((jlong)1 << INFLATE_COUNT_BITS) - 1)
+#define INFLATE_STREAM_END ((jlong)1 << 60)
+#define INFLATE_NEED_DICT ((jlong)1 << 61)
+
+/*
+ * Decompress a whole stream with libdeflate, on the first call for the
+ * stream. This works when the call has all of the stream's input and room
+ * for all of its output, as for a record or block compressed on its own.
+ * When it does not, nothing is consumed and zlib streams the data instead;
+ * libdeflate is not tried again until the next stream. The z_stream is
+ * left as it was but for its totals and remaining input.
+ *
+ * @return 1 with the bytes taken and written in consumed and produced, or
+ *         0 to use zlib.
+ */
+static int inflate_one_shot(struct inflate_stream *is,
+                            const Bytef *in, size_t in_len,
+                            Bytef *out, size_t out_len,
+                            size_t *consumed, size_t *produced) {
+  libdeflate_decompress_fn decompress;
+  int rv;
+
+  if (!is->one_shot || in_len == 0) {
+    return 0;
+  }
+  is->one_shot = 0;
+  if (is->window_bits < 0) {
+    decompress = libdeflate->deflate_decompress_ex;
+  } else if (is->window_bits <= MAX_WBITS) {
+    decompress = libdeflate->zlib_decompress_ex;
+  } else if (is->window_bits <= MAX_WBITS + 16) {
+    decompress = libdeflate->gzip_decompress_ex;
+  } else {
+    // Automatic header detection, as zlib does it
+    decompress = in_len >= 2 && in[0] == 0x1f && in[1] == 0x8b
+        ? libdeflate->gzip_decompress_ex : libdeflate->zlib_decompress_ex;
+  }
+  if (!is->decompressor) {
+    is->decompressor = libdeflate->alloc_decompressor();
+    if (!is->decompressor) {
+      return 0;
+    }
+  }
+  rv = decompress(is->decompressor, in, in_len, out, out_len,
+                  consumed, produced);
+  if (rv != LIBDEFLATE_SUCCESS) {
+    return 0;
+  }
+  is->strm.avail_in = in_len - *consumed;
+  is->strm.total_in = *consumed;
+  is->strm.total_out = *produced;
+  is->one_shot_done = 1;
+  return 1;
+}
+
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_inflateDirect(
+	JNIEnv *env, jclass cls, jlong strm,
+	jobject compressed_direct_buf, jint compressed_direct_buf_off,
+	jint compressed_direct_buf_len,
+	jobject uncompressed_direct_buf, jint uncompressed_direct_buf_off,
+	jint uncompressed_direct_buf_len
 	) {
-	// Get members of ZlibDecompressor
-    z_stream *stream = ZSTREAM(
-    						(*env)->GetLongField(env, this, 
-    									ZlibDecompressor_stream)
-    					);
+    z_stream *stream = ZSTREAM(strm);
     if (!stream) {
 		THROW(env, "java/lang/NullPointerException", NULL);
-		return (jint)0;
+		return (jlong)0;
     } 
 
-    // Get members of ZlibDecompressor
-    jobject clazz = (*env)->GetStaticObjectField(env, this, 
-                                                 ZlibDecompressor_clazz);
-	jarray compressed_direct_buf = (jarray)(*env)->GetObjectField(env, this, 
-											ZlibDecompressor_compressedDirectBuf);
-	jint compressed_direct_buf_off = (*env)->GetIntField(env, this, 
-									ZlibDecompressor_compressedDirectBufOff);
-	jint compressed_direct_buf_len = (*env)->GetIntField(env, this, 
-									ZlibDecompressor_compressedDirectBufLen);
-
-	jarray uncompressed_direct_buf = (jarray)(*env)->GetObjectField(env, this, 
-											ZlibDecompressor_uncompressedDirectBuf);
-	jint uncompressed_direct_buf_len = (*env)->GetIntField(env, this, 
-										ZlibDecompressor_directBufferSize);
-
     // Get the input direct buffer
-    LOCK_CLASS(env, clazz, "ZlibDecompressor");
 	Bytef *compressed_bytes = (*env)->GetDirectBufferAddress(env, 
 										compressed_direct_buf);
-    UNLOCK_CLASS(env, clazz, "ZlibDecompressor");
     
 	if (!compressed_bytes) {
-	    return (jint)0;
+	    return (jlong)0;
 	}
 	
     // Get the output direct buffer
-    LOCK_CLASS(env, clazz, "ZlibDecompressor");
 	Bytef *uncompressed_bytes = (*env)->GetDirectBufferAddress(env, 
 											uncompressed_direct_buf);
-    UNLOCK_CLASS(env, clazz, "ZlibDecompressor");
 
 	if (!uncompressed_bytes) {
-	    return (jint)0;
+	    return (jlong)0;
 	}
 	
+	// Decompress the stream in one call if this call has all of it
+	struct inflate_stream *is = (struct inflate_stream *)stream;
+	size_t consumed, produced;
+	if (is->one_shot_done) {
+		// As zlib does when called again at the end of a stream
+		stream->avail_in = compressed_direct_buf_len;
+		return INFLATE_STREAM_END;
+	}
+	if (inflate_one_shot(is, compressed_bytes + compressed_direct_buf_off,
+			compressed_direct_buf_len,
+			uncompressed_bytes + uncompressed_direct_buf_off,
+			uncompressed_direct_buf_len, &consumed, &produced)) {
+		return INFLATE_STREAM_END | (jlong)produced |
+		       ((jlong)consumed << INFLATE_COUNT_BITS);
+	}
+
 	// Re-calibrate the z_stream
 	stream->next_in  = compressed_bytes + compressed_direct_buf_off;
-	stream->next_out = uncompressed_bytes;
+	stream->next_out = uncompressed_bytes + uncompressed_direct_buf_off;
 	stream->avail_in  = compressed_direct_buf_len;
 	stream->avail_out = uncompressed_direct_buf_len;
 	
-	// Decompress
-	int rv = dlsym_inflate(stream, Z_PARTIAL_FLUSH);
+	// Decompress. inflate runs until the input is used up or the output is
+	// full, so no flush is needed.
+	int rv = dlsym_inflate(stream, Z_NO_FLUSH);
 
 	// Contingency? - Report error by throwing appropriate exceptions
-	int no_decompressed_bytes = 0;	
+	jlong result = 0;
 	switch (rv) {
 		case Z_STREAM_END:
 		{
-		    (*env)->SetBooleanField(env, this, ZlibDecompressor_finished, JNI_TRUE);
+		    result |= INFLATE_STREAM_END;
 		} // cascade down
 		case Z_OK:
 		{
-		    compressed_direct_buf_off += compressed_direct_buf_len - stream->avail_in;
-		    (*env)->SetIntField(env, this, ZlibDecompressor_compressedDirectBufOff, 
-		    			compressed_direct_buf_off);
-		    (*env)->SetIntField(env, this, ZlibDecompressor_compressedDirectBufLen, 
-		    			stream->avail_in);
-		    no_decompressed_bytes = uncompressed_direct_buf_len - stream->avail_out;
+		    result |= uncompressed_direct_buf_len - stream->avail_out;
+		    result |= (jlong)(compressed_direct_buf_len - stream->avail_in)
+		               << INFLATE_COUNT_BITS;
 		}
 		break;
 		case Z_NEED_DICT:
 		{
-		    (*env)->SetBooleanField(env, this, ZlibDecompressor_needDict, JNI_TRUE);
-		    compressed_direct_buf_off += compressed_direct_buf_len - stream->avail_in;
-		    (*env)->SetIntField(env, this, ZlibDecompressor_compressedDirectBufOff, 
-		    			compressed_direct_buf_off);
-		    (*env)->SetIntField(env, this, ZlibDecompressor_compressedDirectBufLen, 
-		    			stream->avail_in);
+		    result |= INFLATE_NEED_DICT;
+		    result |= (jlong)(compressed_direct_buf_len - stream->avail_in)
+		               << INFLATE_COUNT_BITS;
 		}
 		break;
 		case Z_BUF_ERROR:
@@ -252,7 +313,7 @@ Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_inflateBytesDirect(
 		break;
     }
     
-    return no_decompressed_bytes;
+    return result;
 }
 
 JNIEXPORT jlong JNICALL
@@ -280,7 +341,10 @@ JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_reset(
 	JNIEnv *env, jclass cls, jlong stream
 	) {
-    if (dlsym_inflateReset(ZSTREAM(stream)) != Z_OK) {
+    struct inflate_stream *is = INFLATE_STREAM(stream);
+    is->one_shot = libdeflate != NULL;
+    is->one_shot_done = 0;
+    if (dlsym_inflateReset(&is->strm) != Z_OK) {
 		THROW(env, "java/lang/InternalError", 0);
     }
 }
@@ -289,10 +353,15 @@ JNIEXPORT void JNICALL
 Java_org_apache_hadoop_io_compress_zlib_ZlibDecompressor_end(
 	JNIEnv *env, jclass cls, jlong stream
 	) {
-    if (dlsym_inflateEnd(ZSTREAM(stream)) == Z_STREAM_ERROR) {
+    struct inflate_stream *is = INFLATE_STREAM(stream);
+    if (is->decompressor) {
+		libdeflate->free_decompressor(is->decompressor);
+		is->decompressor = NULL;
+    }
+    if (dlsym_inflateEnd(&is->strm) == Z_STREAM_ERROR) {
 		THROW(env, "java/lang/InternalError", 0);
     } else {
-		free(ZSTREAM(stream));
+		free(is);
     }
 }
 
@@ -34,4 +34,76 @@
 /* A helper macro to convert the z_stream pointer to the java 'stream-handle'. */
 #define JLONG(stream) ((jlong)((ptrdiff_t)(stream)))
 
+/**
+ * Open the zlib implementation for the codecs to bind to.
+ *
+ * If accelerator names a library that loads and exports every one of
+ * symbols, that library is used. Otherwise, libz is used.
+ *
+ * @param env         jni handle to report contingencies.
+ * @param accelerator path of a library exporting the zlib API, or NULL.
+ * @param symbols     NULL-terminated list of the symbols the caller needs.
+ * @param name        (out) the name of the library that was opened.
+ * @return the handle of the opened library, or NULL with an exception
+ *         pending.
+ */
+void *hadoop_zlib_open(JNIEnv *env, jstring accelerator,
+                       const char * const *symbols, const char **name);
+
+/**
+ * Build a preset deflate dictionary from the strings that recur across a
+ * set of samples.
+ *
+ * @param samples       the samples, back to back.
+ * @param sample_sizes  the length of each sample.
+ * @param num_samples   the number of samples.
+ * @param dict          (out) the dictionary.
+ * @param dict_capacity the size of dict.
+ * @return the length of the dictionary, which is 0 if the samples share
+ *         too little or memory ran out.
+ */
+size_t hadoop_zlib_train_dictionary(const unsigned char *samples,
+                                    const size_t *sample_sizes,
+                                    size_t num_samples,
+                                    unsigned char *dict,
+                                    size_t dict_capacity);
+
+/*
+ * libdeflate compresses and decompresses whole buffers rather than streams,
+ * but does so several times faster than zlib, in the same formats. Only its
+ * stable ABI is used, so it is declared here instead of through libdeflate.h.
+ */
+struct libdeflate_compressor;
+struct libdeflate_decompressor;
+
+/* The libdeflate_result of a call that succeeded */
+#define LIBDEFLATE_SUCCESS 0
+
+typedef size_t (*libdeflate_compress_fn)(struct libdeflate_compressor *,
+                                         const void *, size_t, void *, size_t);
+typedef int (*libdeflate_decompress_fn)(struct libdeflate_decompressor *,
+                                        const void *, size_t, void *, size_t,
+                                        size_t *, size_t *);
+
+struct hadoop_libdeflate {
+  struct libdeflate_compressor *(*alloc_compressor)(int);
+  libdeflate_compress_fn deflate_compress;
+  libdeflate_compress_fn zlib_compress;
+  libdeflate_compress_fn gzip_compress;
+  void (*free_compressor)(struct libdeflate_compressor *);
+  struct libdeflate_decompressor *(*alloc_decompressor)(void);
+  libdeflate_decompress_fn deflate_decompress_ex;
+  libdeflate_decompress_fn zlib_decompress_ex;
+  libdeflate_decompress_fn gzip_decompress_ex;
+  void (*free_decompressor)(struct libdeflate_decompressor *);
+};
+
+/**
+ * Open libdeflate, once per process.
+ *
+ * @return its entry points, or NULL if this build has no libdeflate
+ *         support or the library could not be loaded.
+ */
+const struct hadoop_libdeflate *hadoop_libdeflate_open(void);
+
 #endif //ORG_APACHE_HADOOP_IO_COMPRESS_ZLIB_ZLIB_H
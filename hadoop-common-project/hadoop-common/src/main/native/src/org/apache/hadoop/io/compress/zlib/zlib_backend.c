@@ -0,0 +1,128 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "org_apache_hadoop_io_compress_zlib.h"
+
+static void *open_accelerator(const char *path, const char * const *symbols) {
+  void *handle;
+  int i;
+
+  // RTLD_LOCAL so that the accelerator's zlib symbols do not interpose on
+  // libz for the rest of the process.
+  handle = dlopen(path, RTLD_LAZY | RTLD_LOCAL);
+  if (!handle) {
+    return NULL;
+  }
+  // Every symbol must come from the same library: a stream set up by one
+  // zlib must not be driven by another.
+  for (i = 0; symbols[i]; i++) {
+    dlerror();
+    if (!dlsym(handle, symbols[i]) || dlerror()) {
+      dlclose(handle);
+      return NULL;
+    }
+  }
+  return handle;
+}
+
+void *hadoop_zlib_open(JNIEnv *env, jstring accelerator,
+                       const char * const *symbols, const char **name) {
+  void *handle = NULL;
+  const char *path;
+  char *path_copy;
+
+  if (accelerator) {
+    path = (*env)->GetStringUTFChars(env, accelerator, NULL);
+    if (!path) {
+      return NULL; // OOM pending
+    }
+    if (path[0]) {
+      handle = open_accelerator(path, symbols);
+    }
+    if (handle) {
+      path_copy = strdup(path);
+      if (!path_copy) {
+        dlclose(handle);
+        handle = NULL;
+      } else {
+        *name = path_copy;
+      }
+    }
+    (*env)->ReleaseStringUTFChars(env, accelerator, path);
+    if (handle) {
+      return handle;
+    }
+  }
+
+  // Fall back to the libz we were built against
+  handle = dlopen(HADOOP_ZLIB_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+  if (!handle) {
+    THROW(env, "java/lang/UnsatisfiedLinkError", "Cannot load libz.so");
+    return NULL;
+  }
+  *name = HADOOP_ZLIB_LIBRARY;
+  return handle;
+}
+
+#ifdef HADOOP_LIBDEFLATE_LIBRARY
+static struct hadoop_libdeflate libdeflate;
+static const struct hadoop_libdeflate *libdeflate_loaded;
+static pthread_once_t libdeflate_once = PTHREAD_ONCE_INIT;
+
+static void load_libdeflate(void) {
+  void *handle = dlopen(HADOOP_LIBDEFLATE_LIBRARY, RTLD_LAZY | RTLD_LOCAL);
+  if (!handle) {
+    return;
+  }
+#define LOAD_LIBDEFLATE(field, symbol) \
+  if (!(libdeflate.field = dlsym(handle, symbol))) { \
+    dlclose(handle); \
+    return; \
+  }
+  LOAD_LIBDEFLATE(alloc_compressor, "libdeflate_alloc_compressor");
+  LOAD_LIBDEFLATE(deflate_compress, "libdeflate_deflate_compress");
+  LOAD_LIBDEFLATE(zlib_compress, "libdeflate_zlib_compress");
+  LOAD_LIBDEFLATE(gzip_compress, "libdeflate_gzip_compress");
+  LOAD_LIBDEFLATE(free_compressor, "libdeflate_free_compressor");
+  LOAD_LIBDEFLATE(alloc_decompressor, "libdeflate_alloc_decompressor");
+  LOAD_LIBDEFLATE(deflate_decompress_ex, "libdeflate_deflate_decompress_ex");
+  LOAD_LIBDEFLATE(zlib_decompress_ex, "libdeflate_zlib_decompress_ex");
+  LOAD_LIBDEFLATE(gzip_decompress_ex, "libdeflate_gzip_decompress_ex");
+  LOAD_LIBDEFLATE(free_decompressor, "libdeflate_free_decompressor");
+#undef LOAD_LIBDEFLATE
+  libdeflate_loaded = &libdeflate;
+}
+
+const struct hadoop_libdeflate *hadoop_libdeflate_open(void) {
+  pthread_once(&libdeflate_once, load_libdeflate);
+  return libdeflate_loaded;
+}
+#else
+const struct hadoop_libdeflate *hadoop_libdeflate_open(void) {
+  return NULL;
+}
+#endif
+
+/**
+ * vim: sw=2: ts=2: et:
+ */
@@ -0,0 +1,186 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Preset dictionary training for deflate.
+ *
+ * A deflate dictionary is just data the compressor pretends to have seen
+ * before the input, so it pays to fill it with the strings most of the
+ * inputs share. Every k-byte string of each sample is hashed and counted
+ * once per sample it occurs in. The samples are then cut into fixed-size
+ * segments scored by the summed counts of their strings, and the best
+ * segments are taken greedily. The strings of a segment that is taken stop
+ * counting towards the others, so the dictionary does not fill up with
+ * copies of the same content; as that only ever lowers scores, a segment
+ * can be rescored lazily when it reaches the top of the heap. The best segment is placed last, where
+ * matches against it are the shortest distance back.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "org_apache_hadoop_io_compress_zlib.h"
+
+#define TRAIN_KMER 8
+#define TRAIN_SEGMENT 64
+#define TRAIN_MIN_TABLE_BITS 12
+#define TRAIN_MAX_TABLE_BITS 22
+
+struct train_segment {
+  size_t off;
+  size_t len;
+  uint64_t score;
+};
+
+static inline uint32_t kmer_hash(const unsigned char *p, uint32_t mask)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+static uint64_t segment_score(const unsigned char *p, size_t len,
+                              const uint32_t *counts, uint32_t mask)
+{
+  uint64_t score = 0;
+  size_t i;
+  for (i = 0; i + TRAIN_KMER <= len; i++) {
+    score += counts[kmer_hash(p + i, mask)];
+  }
+  return score;
+}
+
+/* A binary max-heap of segments, ordered by score */
+static void heap_sift_down(struct train_segment *heap, size_t n, size_t i)
+{
+  struct train_segment tmp;
+  for (;;) {
+    size_t largest = i, l = 2 * i + 1, r = 2 * i + 2;
+    if (l < n && heap[l].score > heap[largest].score) {
+      largest = l;
+    }
+    if (r < n && heap[r].score > heap[largest].score) {
+      largest = r;
+    }
+    if (largest == i) {
+      return;
+    }
+    tmp = heap[i];
+    heap[i] = heap[largest];
+    heap[largest] = tmp;
+    i = largest;
+  }
+}
+
+size_t hadoop_zlib_train_dictionary(const unsigned char *samples,
+                                    const size_t *sample_sizes,
+                                    size_t num_samples,
+                                    unsigned char *dict,
+                                    size_t dict_capacity)
+{
+  size_t total = 0, num_segments = 0, s, i, off, picked_len = 0;
+  size_t num_picked = 0, dict_len = 0;
+  uint32_t *counts = NULL, *last_seen = NULL, mask;
+  struct train_segment *segments = NULL, *picked = NULL;
+  int bits = TRAIN_MIN_TABLE_BITS;
+
+  for (s = 0; s < num_samples; s++) {
+    total += sample_sizes[s];
+    num_segments += (sample_sizes[s] + TRAIN_SEGMENT - 1) / TRAIN_SEGMENT;
+  }
+  if (total == 0 || dict_capacity == 0) {
+    return 0;
+  }
+  while (bits < TRAIN_MAX_TABLE_BITS && ((size_t)1 << bits) < total * 2) {
+    bits++;
+  }
+  mask = (1U << bits) - 1;
+  counts = calloc((size_t)1 << bits, sizeof(uint32_t));
+  last_seen = calloc((size_t)1 << bits, sizeof(uint32_t));
+  segments = malloc(num_segments * sizeof(struct train_segment));
+  picked = malloc(num_segments * sizeof(struct train_segment));
+  if (!counts || !last_seen || !segments || !picked) {
+    goto done;
+  }
+
+  // Count the samples each string occurs in
+  for (s = 0, off = 0; s < num_samples; off += sample_sizes[s], s++) {
+    for (i = 0; i + TRAIN_KMER <= sample_sizes[s]; i++) {
+      uint32_t h = kmer_hash(samples + off + i, mask);
+      if (last_seen[h] != s + 1) {
+        last_seen[h] = s + 1;
+        counts[h]++;
+      }
+    }
+  }
+
+  num_segments = 0;
+  for (s = 0, off = 0; s < num_samples; off += sample_sizes[s], s++) {
+    for (i = 0; i < sample_sizes[s]; i += TRAIN_SEGMENT) {
+      struct train_segment *seg = &segments[num_segments++];
+      seg->off = off + i;
+      seg->len = sample_sizes[s] - i < TRAIN_SEGMENT ?
+                 sample_sizes[s] - i : TRAIN_SEGMENT;
+      seg->score = segment_score(samples + seg->off, seg->len, counts, mask);
+    }
+  }
+  for (i = num_segments / 2; i-- > 0; ) {
+    heap_sift_down(segments, num_segments, i);
+  }
+
+  while (num_segments > 0 && picked_len < dict_capacity) {
+    struct train_segment seg = segments[0];
+    uint64_t score = segment_score(samples + seg.off, seg.len, counts, mask);
+    if (score < seg.score) {
+      // Stale; put it back with its current score
+      segments[0].score = score;
+      heap_sift_down(segments, num_segments, 0);
+      continue;
+    }
+    segments[0] = segments[--num_segments];
+    heap_sift_down(segments, num_segments, 0);
+    // Once the best segment's strings occur in no more than its own
+    // sample, the rest would only add noise
+    if (seg.len < TRAIN_KMER || score <= seg.len - TRAIN_KMER + 1) {
+      break;
+    }
+    for (off = 0; off + TRAIN_KMER <= seg.len; off++) {
+      counts[kmer_hash(samples + seg.off + off, mask)] = 0;
+    }
+    picked[num_picked++] = seg;
+    picked_len += seg.len;
+  }
+
+  // Lay the segments out best last, dropping the front of the worst one if
+  // it does not fit
+  dict_len = picked_len < dict_capacity ? picked_len : dict_capacity;
+  off = dict_len;
+  for (i = 0; i < num_picked && off > 0; i++) {
+    size_t len = picked[i].len < off ? picked[i].len : off;
+    off -= len;
+    memcpy(dict + off, samples + picked[i].off + picked[i].len - len, len);
+  }
+
+done:
+  free(counts);
+  free(last_seen);
+  free(segments);
+  free(picked);
+  return dict_len;
+}
@@ -0,0 +1,215 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "org_apache_hadoop_io_compress_zstd.h"
+#include "org_apache_hadoop_io_compress_zstd_ZStandardCompressor.h"
+
+#define JINT_MAX 0x7fffffff
+
+/*
+ * Native state of one ZStandardCompressor. The dictionary, if any, is kept
+ * digested in cdict, which is rebuilt when the compression level changes.
+ */
+typedef struct {
+  ZSTD_CCtx *cctx;
+  ZSTD_CDict *cdict;
+  int cdict_level;
+  void *dict;
+  size_t dict_len;
+} zstd_compressor;
+
+static jfieldID ZStandardCompressor_uncompressedDirectBuf;
+static jfieldID ZStandardCompressor_uncompressedDirectBufLen;
+static jfieldID ZStandardCompressor_compressedDirectBuf;
+static jfieldID ZStandardCompressor_directBufferSize;
+static jfieldID ZStandardCompressor_level;
+static jfieldID ZStandardCompressor_stream;
+
+static ZSTD_CCtx* (*dlsym_ZSTD_createCCtx)(void);
+static size_t (*dlsym_ZSTD_freeCCtx)(ZSTD_CCtx*);
+static size_t (*dlsym_ZSTD_compressCCtx)(ZSTD_CCtx*, void*, size_t, const void*, size_t, int);
+static ZSTD_CDict* (*dlsym_ZSTD_createCDict)(const void*, size_t, int);
+static size_t (*dlsym_ZSTD_freeCDict)(ZSTD_CDict*);
+static size_t (*dlsym_ZSTD_compress_usingCDict)(ZSTD_CCtx*, void*, size_t, const void*, size_t, const ZSTD_CDict*);
+static unsigned (*dlsym_ZSTD_isError)(size_t);
+static const char* (*dlsym_ZSTD_getErrorName)(size_t);
+
+static void free_dictionary(zstd_compressor *zc) {
+  if (zc->cdict) {
+    dlsym_ZSTD_freeCDict(zc->cdict);
+    zc->cdict = NULL;
+  }
+  free(zc->dict);
+  zc->dict = NULL;
+  zc->dict_len = 0;
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardCompressor_initIDs
+(JNIEnv *env, jclass clazz){
+
+  // Load libzstd.so
+  void *libzstd = dlopen(HADOOP_ZSTD_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+  if (!libzstd) {
+    char msg[1000];
+    snprintf(msg, 1000, "%s (%s)!", "Cannot load " HADOOP_ZSTD_LIBRARY, dlerror());
+    THROW(env, "java/lang/UnsatisfiedLinkError", msg);
+    return;
+  }
+
+  // Locate the requisite symbols from libzstd.so
+  dlerror();                                 // Clear any existing error
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_createCCtx, env, libzstd, "ZSTD_createCCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_freeCCtx, env, libzstd, "ZSTD_freeCCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_compressCCtx, env, libzstd, "ZSTD_compressCCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_createCDict, env, libzstd, "ZSTD_createCDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_freeCDict, env, libzstd, "ZSTD_freeCDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_compress_usingCDict, env, libzstd, "ZSTD_compress_usingCDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_isError, env, libzstd, "ZSTD_isError");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_getErrorName, env, libzstd, "ZSTD_getErrorName");
+
+  ZStandardCompressor_uncompressedDirectBuf = (*env)->GetFieldID(env, clazz,
+                                                           "uncompressedDirectBuf",
+                                                           "Ljava/nio/Buffer;");
+  ZStandardCompressor_uncompressedDirectBufLen = (*env)->GetFieldID(env, clazz,
+                                                              "uncompressedDirectBufLen", "I");
+  ZStandardCompressor_compressedDirectBuf = (*env)->GetFieldID(env, clazz,
+                                                         "compressedDirectBuf",
+                                                         "Ljava/nio/Buffer;");
+  ZStandardCompressor_directBufferSize = (*env)->GetFieldID(env, clazz,
+                                                       "directBufferSize", "I");
+  ZStandardCompressor_level = (*env)->GetFieldID(env, clazz, "level", "I");
+  ZStandardCompressor_stream = (*env)->GetFieldID(env, clazz, "stream", "J");
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardCompressor_init
+(JNIEnv *env, jclass clazz){
+  zstd_compressor *zc = calloc(1, sizeof(zstd_compressor));
+  if (!zc) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  zc->cctx = dlsym_ZSTD_createCCtx();
+  if (!zc->cctx) {
+    free(zc);
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(zc);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardCompressor_setDictionary
+(JNIEnv *env, jclass clazz, jlong stream, jarray b, jint off, jint len){
+  zstd_compressor *zc = ZSTD_HANDLE(stream);
+  void *buf;
+
+  free_dictionary(zc);
+  if (len == 0) {
+    return;
+  }
+  zc->dict = malloc(len);
+  if (!zc->dict) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return;
+  }
+  buf = (*env)->GetPrimitiveArrayCritical(env, b, 0);
+  if (!buf) {
+    free_dictionary(zc);
+    THROW(env, "java/lang/InternalError", NULL);
+    return;
+  }
+  memcpy(zc->dict, (char*)buf + off, len);
+  (*env)->ReleasePrimitiveArrayCritical(env, b, buf, JNI_ABORT);
+  // The digested dictionary is built on first use, at the current level
+  zc->dict_len = len;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardCompressor_compressBytesDirect
+(JNIEnv *env, jobject thisj){
+  // Get members of ZStandardCompressor
+  jobject uncompressed_direct_buf = (*env)->GetObjectField(env, thisj, ZStandardCompressor_uncompressedDirectBuf);
+  jint uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, ZStandardCompressor_uncompressedDirectBufLen);
+  jobject compressed_direct_buf = (*env)->GetObjectField(env, thisj, ZStandardCompressor_compressedDirectBuf);
+  jint compressed_direct_buf_len = (*env)->GetIntField(env, thisj, ZStandardCompressor_directBufferSize);
+  jint level = (*env)->GetIntField(env, thisj, ZStandardCompressor_level);
+  zstd_compressor *zc = ZSTD_HANDLE((*env)->GetLongField(env, thisj, ZStandardCompressor_stream));
+  size_t ret;
+
+  // Get the input direct buffer
+  const char* uncompressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
+
+  if (uncompressed_bytes == 0) {
+    return 0;
+  }
+
+  // Get the output direct buffer
+  char* compressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
+
+  if (compressed_bytes == 0) {
+    return 0;
+  }
+
+  if (zc->dict) {
+    if (!zc->cdict || zc->cdict_level != level) {
+      if (zc->cdict) {
+        dlsym_ZSTD_freeCDict(zc->cdict);
+      }
+      zc->cdict = dlsym_ZSTD_createCDict(zc->dict, zc->dict_len, level);
+      if (!zc->cdict) {
+        THROW(env, "java/lang/InternalError", "Could not load zstd dictionary.");
+        return 0;
+      }
+      zc->cdict_level = level;
+    }
+    ret = dlsym_ZSTD_compress_usingCDict(zc->cctx, compressed_bytes,
+        compressed_direct_buf_len, uncompressed_bytes,
+        uncompressed_direct_buf_len, zc->cdict);
+  } else {
+    ret = dlsym_ZSTD_compressCCtx(zc->cctx, compressed_bytes,
+        compressed_direct_buf_len, uncompressed_bytes,
+        uncompressed_direct_buf_len, level);
+  }
+  if (dlsym_ZSTD_isError(ret)) {
+    char msg[1000];
+    snprintf(msg, sizeof(msg), "Could not compress data: %s",
+             dlsym_ZSTD_getErrorName(ret));
+    THROW(env, "java/lang/InternalError", msg);
+    return 0;
+  }
+  if (ret > JINT_MAX) {
+    THROW(env, "java/lang/InternalError", "Invalid return buffer length.");
+    return 0;
+  }
+
+  (*env)->SetIntField(env, thisj, ZStandardCompressor_uncompressedDirectBufLen, 0);
+  return (jint)ret;
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardCompressor_end
+(JNIEnv *env, jclass clazz, jlong stream){
+  zstd_compressor *zc = ZSTD_HANDLE(stream);
+
+  free_dictionary(zc);
+  dlsym_ZSTD_freeCCtx(zc->cctx);
+  free(zc);
+}
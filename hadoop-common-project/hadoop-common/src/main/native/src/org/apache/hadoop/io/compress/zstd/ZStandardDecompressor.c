@@ -0,0 +1,184 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "org_apache_hadoop_io_compress_zstd.h"
+#include "org_apache_hadoop_io_compress_zstd_ZStandardDecompressor.h"
+
+/*
+ * Native state of one ZStandardDecompressor, with the digested dictionary
+ * the frames were compressed against, if any.
+ */
+typedef struct {
+  ZSTD_DCtx *dctx;
+  ZSTD_DDict *ddict;
+} zstd_decompressor;
+
+static jfieldID ZStandardDecompressor_compressedDirectBuf;
+static jfieldID ZStandardDecompressor_compressedDirectBufLen;
+static jfieldID ZStandardDecompressor_uncompressedDirectBuf;
+static jfieldID ZStandardDecompressor_directBufferSize;
+static jfieldID ZStandardDecompressor_stream;
+
+static ZSTD_DCtx* (*dlsym_ZSTD_createDCtx)(void);
+static size_t (*dlsym_ZSTD_freeDCtx)(ZSTD_DCtx*);
+static size_t (*dlsym_ZSTD_decompressDCtx)(ZSTD_DCtx*, void*, size_t, const void*, size_t);
+static ZSTD_DDict* (*dlsym_ZSTD_createDDict)(const void*, size_t);
+static size_t (*dlsym_ZSTD_freeDDict)(ZSTD_DDict*);
+static size_t (*dlsym_ZSTD_decompress_usingDDict)(ZSTD_DCtx*, void*, size_t, const void*, size_t, const ZSTD_DDict*);
+static unsigned (*dlsym_ZSTD_isError)(size_t);
+static const char* (*dlsym_ZSTD_getErrorName)(size_t);
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardDecompressor_initIDs
+(JNIEnv *env, jclass clazz){
+
+  // Load libzstd.so
+  void *libzstd = dlopen(HADOOP_ZSTD_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+  if (!libzstd) {
+    char msg[1000];
+    snprintf(msg, 1000, "%s (%s)!", "Cannot load " HADOOP_ZSTD_LIBRARY, dlerror());
+    THROW(env, "java/lang/UnsatisfiedLinkError", msg);
+    return;
+  }
+
+  // Locate the requisite symbols from libzstd.so
+  dlerror();                                 // Clear any existing error
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_createDCtx, env, libzstd, "ZSTD_createDCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_freeDCtx, env, libzstd, "ZSTD_freeDCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_decompressDCtx, env, libzstd, "ZSTD_decompressDCtx");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_createDDict, env, libzstd, "ZSTD_createDDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_freeDDict, env, libzstd, "ZSTD_freeDDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_decompress_usingDDict, env, libzstd, "ZSTD_decompress_usingDDict");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_isError, env, libzstd, "ZSTD_isError");
+  LOAD_DYNAMIC_SYMBOL(dlsym_ZSTD_getErrorName, env, libzstd, "ZSTD_getErrorName");
+
+  ZStandardDecompressor_compressedDirectBuf = (*env)->GetFieldID(env,clazz,
+                                                           "compressedDirectBuf",
+                                                           "Ljava/nio/Buffer;");
+  ZStandardDecompressor_compressedDirectBufLen = (*env)->GetFieldID(env,clazz,
+                                                              "compressedDirectBufLen", "I");
+  ZStandardDecompressor_uncompressedDirectBuf = (*env)->GetFieldID(env,clazz,
+                                                             "uncompressedDirectBuf",
+                                                             "Ljava/nio/Buffer;");
+  ZStandardDecompressor_directBufferSize = (*env)->GetFieldID(env, clazz,
+                                                         "directBufferSize", "I");
+  ZStandardDecompressor_stream = (*env)->GetFieldID(env, clazz, "stream", "J");
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardDecompressor_init
+(JNIEnv *env, jclass clazz){
+  zstd_decompressor *zd = calloc(1, sizeof(zstd_decompressor));
+  if (!zd) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  zd->dctx = dlsym_ZSTD_createDCtx();
+  if (!zd->dctx) {
+    free(zd);
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    return (jlong)0;
+  }
+  return JLONG(zd);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardDecompressor_setDictionary
+(JNIEnv *env, jclass clazz, jlong stream, jarray b, jint off, jint len){
+  zstd_decompressor *zd = ZSTD_HANDLE(stream);
+  void *dict;
+
+  if (zd->ddict) {
+    dlsym_ZSTD_freeDDict(zd->ddict);
+    zd->ddict = NULL;
+  }
+  if (len == 0) {
+    return;
+  }
+  dict = (*env)->GetPrimitiveArrayCritical(env, b, 0);
+  if (!dict) {
+    THROW(env, "java/lang/InternalError", NULL);
+    return;
+  }
+  // ZSTD_createDDict copies the dictionary, so the array can be released
+  zd->ddict = dlsym_ZSTD_createDDict((char*)dict + off, len);
+  (*env)->ReleasePrimitiveArrayCritical(env, b, dict, JNI_ABORT);
+  if (!zd->ddict) {
+    THROW(env, "java/lang/InternalError", "Could not load zstd dictionary.");
+  }
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardDecompressor_decompressBytesDirect
+(JNIEnv *env, jobject thisj){
+  // Get members of ZStandardDecompressor
+  jobject compressed_direct_buf = (*env)->GetObjectField(env,thisj, ZStandardDecompressor_compressedDirectBuf);
+  jint compressed_direct_buf_len = (*env)->GetIntField(env,thisj, ZStandardDecompressor_compressedDirectBufLen);
+  jobject uncompressed_direct_buf = (*env)->GetObjectField(env,thisj, ZStandardDecompressor_uncompressedDirectBuf);
+  size_t uncompressed_direct_buf_len = (*env)->GetIntField(env, thisj, ZStandardDecompressor_directBufferSize);
+  zstd_decompressor *zd = ZSTD_HANDLE((*env)->GetLongField(env, thisj, ZStandardDecompressor_stream));
+  size_t ret;
+
+  // Get the input direct buffer
+  const char* compressed_bytes = (const char*)(*env)->GetDirectBufferAddress(env, compressed_direct_buf);
+
+  if (compressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  // Get the output direct buffer
+  char* uncompressed_bytes = (char *)(*env)->GetDirectBufferAddress(env, uncompressed_direct_buf);
+
+  if (uncompressed_bytes == 0) {
+    return (jint)0;
+  }
+
+  if (zd->ddict) {
+    ret = dlsym_ZSTD_decompress_usingDDict(zd->dctx, uncompressed_bytes,
+        uncompressed_direct_buf_len, compressed_bytes,
+        compressed_direct_buf_len, zd->ddict);
+  } else {
+    ret = dlsym_ZSTD_decompressDCtx(zd->dctx, uncompressed_bytes,
+        uncompressed_direct_buf_len, compressed_bytes,
+        compressed_direct_buf_len);
+  }
+  if (dlsym_ZSTD_isError(ret)) {
+    char msg[1000];
+    snprintf(msg, sizeof(msg), "Could not decompress data: %s",
+             dlsym_ZSTD_getErrorName(ret));
+    THROW(env, "java/lang/InternalError", msg);
+    return (jint)0;
+  }
+
+  (*env)->SetIntField(env, thisj, ZStandardDecompressor_compressedDirectBufLen, 0);
+
+  return (jint)ret;
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_io_compress_zstd_ZStandardDecompressor_end
+(JNIEnv *env, jclass clazz, jlong stream){
+  zstd_decompressor *zd = ZSTD_HANDLE(stream);
+
+  if (zd->ddict) {
+    dlsym_ZSTD_freeDDict(zd->ddict);
+  }
+  dlsym_ZSTD_freeDCtx(zd->dctx);
+  free(zd);
+}
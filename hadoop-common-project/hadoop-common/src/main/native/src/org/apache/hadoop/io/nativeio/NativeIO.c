@@ -23,19 +23,32 @@
 #include <fcntl.h>
 #include <grp.h>
 #include <jni.h>
+#include <poll.h>
+#include <pthread.h>
 #include <pwd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
 
 #include "config.h"
 #include "org_apache_hadoop.h"
 #include "org_apache_hadoop_io_nativeio_NativeIO.h"
 #include "file_descriptor.h"
 #include "errno_enum.h"
+#include "io_queue.h"
+#include "dir_scan.h"
+#include "disk_probe.h"
+#include "org/apache/hadoop/security/id_cache.h"
 
 // the NativeIO$Stat inner class and its constructor
 static jclass stat_clazz;
@@ -52,7 +65,6 @@ static jobject pw_lock_object;
 
 // Internal functions
 static void throw_ioe(JNIEnv* env, int errnum);
-static ssize_t get_pw_buflen();
 
 /**
  * Returns non-zero if the user has specified that the system
@@ -150,6 +162,23 @@ error:
   errno_enum_deinit(env);
 }
 
+/*
+ * Look up the name of a uid or gid, falling back to its number if it has
+ * none. On success the caller must free *name.
+ */
+static int id_name_or_number(int kind, id_t id, char **name)
+{
+  int rc = id_cache_lookup(kind, id, name);
+  if (rc == ENOENT) {
+    if ((*name = malloc(24)) == NULL) {
+      return ENOMEM;
+    }
+    snprintf(*name, 24, "%lu", (unsigned long)id);
+    rc = 0;
+  }
+  return rc;
+}
+
 /*
  * public static native Stat fstat(FileDescriptor fd);
  */
@@ -158,7 +187,7 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_fstat(
   JNIEnv *env, jclass clazz, jobject fd_object)
 {
   jobject ret = NULL;
-  char *pw_buf = NULL;
+  char *user_name = NULL, *group_name = NULL;
   int pw_lock_locked = 0;
 
   int fd = fd_get(env, fd_object);
@@ -171,12 +200,6 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_fstat(
     goto cleanup;
   }
 
-  size_t pw_buflen = get_pw_buflen();
-  if ((pw_buf = malloc(pw_buflen)) == NULL) {
-    THROW(env, "java/lang/OutOfMemoryError", "Couldn't allocate memory for pw buffer");
-    goto cleanup;
-  }
-
   if (pw_lock_object != NULL) {
     if ((*env)->MonitorEnter(env, pw_lock_object) != JNI_OK) {
       goto cleanup;
@@ -184,42 +207,22 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_fstat(
     pw_lock_locked = 1;
   }
 
-  // Grab username
-  struct passwd pwd, *pwdp;
-  while ((rc = getpwuid_r(s.st_uid, &pwd, pw_buf, pw_buflen, &pwdp)) != 0) {
-    if (rc != ERANGE) {
+  // Grab username and group through the id cache. An id with no name,
+  // such as one from another host's passwd, is reported as its number.
+  if ((rc = id_name_or_number(ID_CACHE_USER, s.st_uid, &user_name)) ||
+      (rc = id_name_or_number(ID_CACHE_GROUP, s.st_gid, &group_name))) {
+    if (rc == ENOMEM) {
+      THROW(env, "java/lang/OutOfMemoryError", "Couldn't allocate memory for id name");
+    } else {
       throw_ioe(env, rc);
-      goto cleanup;
-    }
-    free(pw_buf);
-    pw_buflen *= 2;
-    if ((pw_buf = malloc(pw_buflen)) == NULL) {
-      THROW(env, "java/lang/OutOfMemoryError", "Couldn't allocate memory for pw buffer");
-      goto cleanup;
     }
+    goto cleanup;
   }
-  assert(pwdp == &pwd);
 
-  jstring jstr_username = (*env)->NewStringUTF(env, pwd.pw_name);
+  jstring jstr_username = (*env)->NewStringUTF(env, user_name);
   if (jstr_username == NULL) goto cleanup;
 
-  // Grab group
-  struct group grp, *grpp;
-  while ((rc = getgrgid_r(s.st_gid, &grp, pw_buf, pw_buflen, &grpp)) != 0) {
-    if (rc != ERANGE) {
-      throw_ioe(env, rc);
-      goto cleanup;
-    }
-    free(pw_buf);
-    pw_buflen *= 2;
-    if ((pw_buf = malloc(pw_buflen)) == NULL) {
-      THROW(env, "java/lang/OutOfMemoryError", "Couldn't allocate memory for pw buffer");
-      goto cleanup;
-    }
-  }
-  assert(grpp == &grp);
-
-  jstring jstr_groupname = (*env)->NewStringUTF(env, grp.gr_name);
+  jstring jstr_groupname = (*env)->NewStringUTF(env, group_name);
   PASS_EXCEPTIONS_GOTO(env, cleanup);
 
   // Construct result
@@ -227,7 +230,8 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_fstat(
     jstr_username, jstr_groupname, s.st_mode);
 
 cleanup:
-  if (pw_buf != NULL) free(pw_buf);
+  free(user_name);
+  free(group_name);
   if (pw_lock_locked) {
     (*env)->MonitorExit(env, pw_lock_object);
   }
@@ -236,6 +240,16 @@ cleanup:
 
 
 
+/**
+ * static native void setIdCacheTtl(long positiveMs, long negativeMs);
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_setIdCacheTtl(
+  JNIEnv *env, jclass clazz, jlong positive_ms, jlong negative_ms)
+{
+  id_cache_set_ttl(positive_ms, negative_ms);
+}
+
 /**
  * public static native void posix_fadvise(
  *   FileDescriptor fd, long offset, long len, int flags);
@@ -314,6 +328,127 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_sync_1file_1range(
 #endif
 }
 
+#define BATCH_FADVISE 0
+#define BATCH_SYNC_FILE_RANGE 1
+
+/*
+ * Apply fadvise or sync_file_range to each of n ranges, storing the Errno of
+ * each failure in errors and returning the number of failures.
+ */
+static jint batch_range_op(JNIEnv *env, int op, jobjectArray fd_objects,
+                           jlongArray j_offsets, jlongArray j_lens,
+                           jintArray j_flags, jint n, jobjectArray errors)
+{
+  jlong *offsets = NULL, *lens = NULL;
+  jint *flags = NULL;
+  jint failures = 0;
+  int i, fd, rc;
+
+  if (n < 0 || n > (*env)->GetArrayLength(env, fd_objects) ||
+      n > (*env)->GetArrayLength(env, j_offsets) ||
+      n > (*env)->GetArrayLength(env, j_lens) ||
+      n > (*env)->GetArrayLength(env, j_flags) ||
+      n > (*env)->GetArrayLength(env, errors)) {
+    THROW(env, "java/lang/IndexOutOfBoundsException",
+          "batch is larger than its arrays");
+    return 0;
+  }
+  offsets = (*env)->GetLongArrayElements(env, j_offsets, NULL);
+  if (!offsets) goto cleanup; // JVM throws Exception for us
+  lens = (*env)->GetLongArrayElements(env, j_lens, NULL);
+  if (!lens) goto cleanup;
+  flags = (*env)->GetIntArrayElements(env, j_flags, NULL);
+  if (!flags) goto cleanup;
+
+  for (i = 0; i < n; i++) {
+    jobject fd_object = (*env)->GetObjectArrayElement(env, fd_objects, i);
+    jobject error = NULL;
+
+    PASS_EXCEPTIONS_GOTO(env, cleanup);
+    fd = fd_get(env, fd_object);
+    (*env)->DeleteLocalRef(env, fd_object);
+    PASS_EXCEPTIONS_GOTO(env, cleanup);
+
+    rc = 0;
+    if (op == BATCH_FADVISE) {
+#ifdef HAVE_POSIX_FADVISE
+      rc = posix_fadvise(fd, (off_t)offsets[i], (off_t)lens[i], flags[i]);
+#ifdef __FreeBSD__
+      if (rc) {
+        rc = errno;
+      }
+#endif
+#endif
+    } else {
+#ifdef my_sync_file_range
+      if (my_sync_file_range(fd, (off_t)offsets[i], (off_t)lens[i],
+                             flags[i])) {
+        rc = errno;
+      }
+#endif
+    }
+    if (rc) {
+      failures++;
+      error = errno_to_enum(env, rc);
+      PASS_EXCEPTIONS_GOTO(env, cleanup);
+    }
+    (*env)->SetObjectArrayElement(env, errors, i, error);
+    if (error) {
+      (*env)->DeleteLocalRef(env, error);
+    }
+  }
+
+cleanup:
+  if (flags) {
+    (*env)->ReleaseIntArrayElements(env, j_flags, flags, JNI_ABORT);
+  }
+  if (lens) {
+    (*env)->ReleaseLongArrayElements(env, j_lens, lens, JNI_ABORT);
+  }
+  if (offsets) {
+    (*env)->ReleaseLongArrayElements(env, j_offsets, offsets, JNI_ABORT);
+  }
+  return failures;
+}
+
+/**
+ * public static native int posix_fadvise_batch(FileDescriptor[] fds,
+ *   long[] offsets, long[] lens, int[] flags, int n, Errno[] errors);
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_posix_1fadvise_1batch(
+  JNIEnv *env, jclass clazz, jobjectArray fds, jlongArray offsets,
+  jlongArray lens, jintArray flags, jint n, jobjectArray errors)
+{
+#ifndef HAVE_POSIX_FADVISE
+  THROW(env, "java/lang/UnsupportedOperationException",
+        "fadvise support not available");
+  return 0;
+#else
+  return batch_range_op(env, BATCH_FADVISE, fds, offsets, lens, flags, n,
+                        errors);
+#endif
+}
+
+/**
+ * public static native int sync_file_range_batch(FileDescriptor[] fds,
+ *   long[] offsets, long[] lens, int[] flags, int n, Errno[] errors);
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_sync_1file_1range_1batch(
+  JNIEnv *env, jclass clazz, jobjectArray fds, jlongArray offsets,
+  jlongArray lens, jintArray flags, jint n, jobjectArray errors)
+{
+#ifndef my_sync_file_range
+  THROW(env, "java/lang/UnsupportedOperationException",
+        "sync_file_range support not available");
+  return 0;
+#else
+  return batch_range_op(env, BATCH_SYNC_FILE_RANGE, fds, offsets, lens,
+                        flags, n, errors);
+#endif
+}
+
 #ifdef __FreeBSD__
 static int toFreeBSDFlags(int flags)
 {
@@ -326,6 +461,7 @@ static int toFreeBSDFlags(int flags)
   if ( flags & 04000 ) rc |= O_NONBLOCK;
   if ( flags &010000 ) rc |= O_SYNC;
   if ( flags &020000 ) rc |= O_ASYNC;
+  if ( flags &040000 ) rc |= O_DIRECT;
   return rc;
 }
 #endif
@@ -340,6 +476,11 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_open(
 {
 #ifdef __FreeBSD__
   flags = toFreeBSDFlags(flags);
+#elif defined(O_DIRECT)
+  // NativeIO.O_DIRECT is the x86 value, which differs on other architectures
+  if (flags & 040000) {
+    flags = (flags & ~040000) | O_DIRECT;
+  }
 #endif
   jobject ret = NULL;
 
@@ -385,6 +526,1031 @@ Java_org_apache_hadoop_io_nativeio_NativeIO_chmod(
   (*env)->ReleaseStringUTFChars(env, j_path, path);
 }
 
+/*
+ * Find the page-aligned range covering [off, off + len) of a direct buffer
+ * returned by mmap, throwing if it is not one or the range is out of bounds.
+ */
+static int buffer_page_range(JNIEnv *env, jobject buf, jlong off, jlong len,
+                             void **start, size_t *length)
+{
+  char *addr = (*env)->GetDirectBufferAddress(env, buf);
+  jlong capacity = (*env)->GetDirectBufferCapacity(env, buf);
+  uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+  uintptr_t begin, end;
+
+  if (!addr || capacity < 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "buffer is not a direct ByteBuffer");
+    return -1;
+  }
+  if (off < 0 || len < 0 || off > capacity - len) {
+    THROW(env, "java/lang/IndexOutOfBoundsException",
+          "range is outside the buffer");
+    return -1;
+  }
+  begin = (uintptr_t)(addr + off) & ~page_mask;
+  end = (uintptr_t)(addr + off + len);
+  *start = (void *)begin;
+  *length = end - begin;
+  return 0;
+}
+
+/**
+ * public static native ByteBuffer mmap(FileDescriptor fd, int prot,
+ *   boolean shared, long offset, long length) throws IOException;
+ *
+ * The offset need not be page-aligned: the mapping starts at the page
+ * holding it and the returned buffer starts at the offset itself, which
+ * munmap undoes by rounding the buffer address back down.
+ */
+JNIEXPORT jobject JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_mmap(
+  JNIEnv *env, jclass clazz, jobject fd_object, jint prot,
+  jboolean shared, jlong offset, jlong length)
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  off_t skew;
+  void *addr;
+  jobject ret;
+
+  int fd = fd_get(env, fd_object);
+  PASS_EXCEPTIONS_RET(env, NULL);
+
+  // A ByteBuffer cannot address more than 2GB
+  if (offset < 0 || length <= 0 || length > INT32_MAX) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "invalid mmap offset or length");
+    return NULL;
+  }
+  skew = offset % page_size;
+  addr = mmap(NULL, length + skew, prot, shared ? MAP_SHARED : MAP_PRIVATE,
+              fd, offset - skew);
+  if (addr == MAP_FAILED) {
+    throw_ioe(env, errno);
+    return NULL;
+  }
+  ret = (*env)->NewDirectByteBuffer(env, (char *)addr + skew, length);
+  if (!ret) {
+    munmap(addr, length + skew);
+  }
+  return ret;
+}
+
+/**
+ * public static native void munmap(ByteBuffer buf) throws IOException;
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_munmap(
+  JNIEnv *env, jclass clazz, jobject buf)
+{
+  void *start;
+  size_t length;
+
+  if (buffer_page_range(env, buf, 0,
+        (*env)->GetDirectBufferCapacity(env, buf), &start, &length)) {
+    return;
+  }
+  if (munmap(start, length)) {
+    throw_ioe(env, errno);
+  }
+}
+
+/**
+ * public static native void madvise(ByteBuffer buf, long offset, long len,
+ *   int advice) throws IOException;
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_madvise(
+  JNIEnv *env, jclass clazz, jobject buf, jlong offset, jlong len,
+  jint advice)
+{
+  void *start;
+  size_t length;
+
+  if (buffer_page_range(env, buf, offset, len, &start, &length)) {
+    return;
+  }
+  if (madvise(start, length, advice)) {
+    throw_ioe(env, errno);
+  }
+}
+
+/**
+ * public static native void mlock(ByteBuffer buf, long offset, long len)
+ *   throws IOException;
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_mlock(
+  JNIEnv *env, jclass clazz, jobject buf, jlong offset, jlong len)
+{
+  void *start;
+  size_t length;
+
+  if (buffer_page_range(env, buf, offset, len, &start, &length)) {
+    return;
+  }
+  if (mlock(start, length)) {
+    throw_ioe(env, errno);
+  }
+}
+
+/**
+ * public static native void munlock(ByteBuffer buf, long offset, long len)
+ *   throws IOException;
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_munlock(
+  JNIEnv *env, jclass clazz, jobject buf, jlong offset, jlong len)
+{
+  void *start;
+  size_t length;
+
+  if (buffer_page_range(env, buf, offset, len, &start, &length)) {
+    return;
+  }
+  if (munlock(start, length)) {
+    throw_ioe(env, errno);
+  }
+}
+
+/**
+ * public static native long getPageSize();
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_getPageSize(
+  JNIEnv *env, jclass clazz)
+{
+  return sysconf(_SC_PAGESIZE);
+}
+
+#ifdef __linux__
+/*
+ * Wait for a non-blocking descriptor to accept more data.
+ */
+static int wait_writable(int fd)
+{
+  struct pollfd pfd;
+  int rc;
+
+  pfd.fd = fd;
+  pfd.events = POLLOUT;
+  do {
+    rc = poll(&pfd, 1, -1);
+  } while (rc < 0 && errno == EINTR);
+  return rc < 0 ? errno : 0;
+}
+
+/*
+ * Whether a transfer that has moved done bytes may stop because the
+ * destination would block: only on a checksum chunk boundary, so the
+ * caller never has to resume in the middle of a chunk.
+ */
+static int can_stop(jlong done, jint chunk_size)
+{
+  return chunk_size <= 0 || done % chunk_size == 0;
+}
+#endif
+
+/**
+ * public static native long sendfile(FileDescriptor out, FileDescriptor in,
+ *   long offset, long count, int chunkSize) throws IOException;
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_sendfile(
+  JNIEnv *env, jclass clazz, jobject out_object, jobject in_object,
+  jlong offset, jlong count, jint chunk_size)
+{
+#ifndef __linux__
+  THROW(env, "java/lang/UnsupportedOperationException",
+        "sendfile support not available");
+  return 0;
+#else
+  off_t off = offset;
+  jlong done = 0;
+  ssize_t n;
+  int rc;
+
+  int out_fd = fd_get(env, out_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+  int in_fd = fd_get(env, in_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+
+  while (done < count) {
+    n = sendfile(out_fd, in_fd, &off, count - done);
+    if (n > 0) {
+      done += n;
+    } else if (n == 0) {
+      break; // end of file
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN) {
+      if (can_stop(done, chunk_size)) {
+        break;
+      }
+      if ((rc = wait_writable(out_fd))) {
+        throw_ioe(env, rc);
+        return done;
+      }
+    } else {
+      throw_ioe(env, errno);
+      return done;
+    }
+  }
+  return done;
+#endif
+}
+
+#ifdef __linux__
+// The bytes moved through the splice pipe in one go
+#define SPLICE_PIPE_CAPACITY (64 * 1024)
+
+// A pipe per thread for splice, created on first use
+static pthread_key_t splice_pipe_key;
+static pthread_once_t splice_pipe_once = PTHREAD_ONCE_INIT;
+
+static void splice_pipe_close(void *p)
+{
+  int *fds = p;
+  close(fds[0]);
+  close(fds[1]);
+  free(fds);
+}
+
+static void splice_pipe_key_create(void)
+{
+  pthread_key_create(&splice_pipe_key, splice_pipe_close);
+}
+
+static int *splice_pipe_get(void)
+{
+  int *fds;
+
+  pthread_once(&splice_pipe_once, splice_pipe_key_create);
+  fds = pthread_getspecific(splice_pipe_key);
+  if (fds) {
+    return fds;
+  }
+  fds = malloc(2 * sizeof(int));
+  if (!fds) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (pipe(fds)) {
+    free(fds);
+    return NULL;
+  }
+  pthread_setspecific(splice_pipe_key, fds);
+  return fds;
+}
+
+/*
+ * Drop the thread's pipe, which may still hold bytes after an error.
+ */
+static void splice_pipe_discard(int *fds)
+{
+  pthread_setspecific(splice_pipe_key, NULL);
+  splice_pipe_close(fds);
+}
+#endif
+
+/**
+ * public static native long splice(FileDescriptor out, FileDescriptor in,
+ *   long offset, long count, int chunkSize) throws IOException;
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_splice(
+  JNIEnv *env, jclass clazz, jobject out_object, jobject in_object,
+  jlong offset, jlong count, jint chunk_size)
+{
+#ifndef __linux__
+  THROW(env, "java/lang/UnsupportedOperationException",
+        "splice support not available");
+  return 0;
+#else
+  loff_t off = offset;
+  jlong done = 0;
+  size_t batch = SPLICE_PIPE_CAPACITY;
+  int would_block = 0;
+  int *fds;
+  ssize_t n, m;
+  int rc;
+
+  int out_fd = fd_get(env, out_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+  int in_fd = fd_get(env, in_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+
+  fds = splice_pipe_get();
+  if (!fds) {
+    throw_ioe(env, errno);
+    return 0;
+  }
+  // Fill the pipe with whole chunks where they fit
+  if (chunk_size > 0 && chunk_size <= SPLICE_PIPE_CAPACITY) {
+    batch -= batch % chunk_size;
+  }
+
+  while (done < count && !(would_block && can_stop(done, chunk_size))) {
+    size_t want = count - done < (jlong)batch ? (size_t)(count - done) : batch;
+    n = splice(in_fd, &off, fds[1], NULL, want, SPLICE_F_MOVE);
+    if (n == 0) {
+      break; // end of file
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw_ioe(env, errno);
+      return done;
+    }
+    // Whatever entered the pipe must leave it before returning
+    while (n > 0) {
+      m = splice(fds[0], NULL, out_fd, NULL, n,
+                 SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (m > 0) {
+        n -= m;
+        done += m;
+      } else if (m < 0 && errno == EINTR) {
+        continue;
+      } else if (m < 0 && errno == EAGAIN) {
+        would_block = 1;
+        if ((rc = wait_writable(out_fd))) {
+          splice_pipe_discard(fds);
+          throw_ioe(env, rc);
+          return done;
+        }
+      } else {
+        splice_pipe_discard(fds);
+        throw_ioe(env, m < 0 ? errno : EPIPE);
+        return done;
+      }
+    }
+  }
+  return done;
+#endif
+}
+
+#ifdef __linux__
+/*
+ * Clone the range by sharing extents, on file systems with reflinks such as
+ * XFS and btrfs. Returns 0, or the errno if the range could not be cloned.
+ */
+static int copy_by_reflink(int in_fd, off_t in_off, int out_fd, off_t out_off,
+                           jlong len)
+{
+#ifdef FICLONERANGE
+  struct file_clone_range range;
+  struct stat s;
+
+  // The kernel clones up to the end of the source when given length 0,
+  // but wants block-aligned lengths otherwise unless the range ends at EOF
+  if (fstat(in_fd, &s)) {
+    return errno;
+  }
+  if (in_off + len > s.st_size) {
+    len = s.st_size - in_off;
+  }
+  if (len <= 0) {
+    return EINVAL;
+  }
+  range.src_fd = in_fd;
+  range.src_offset = in_off;
+  range.src_length = in_off + len == s.st_size ? 0 : len;
+  range.dest_offset = out_off;
+  if (ioctl(out_fd, FICLONERANGE, &range)) {
+    return errno;
+  }
+  return 0;
+#else
+  return EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Copy through a pipe with splice, for kernels or file system pairs that
+ * copy_file_range does not handle.
+ */
+static int copy_by_splice(int in_fd, loff_t *in_off, int out_fd,
+                          loff_t *out_off, jlong len, jlong *done)
+{
+  int *fds = splice_pipe_get();
+  ssize_t n, m;
+
+  if (!fds) {
+    return errno;
+  }
+  while (*done < len) {
+    size_t want = len - *done < SPLICE_PIPE_CAPACITY ?
+        (size_t)(len - *done) : SPLICE_PIPE_CAPACITY;
+    n = splice(in_fd, in_off, fds[1], NULL, want, SPLICE_F_MOVE);
+    if (n == 0) {
+      break; // end of file
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    while (n > 0) {
+      m = splice(fds[0], NULL, out_fd, out_off, n, SPLICE_F_MOVE);
+      if (m > 0) {
+        n -= m;
+        *done += m;
+      } else if (m < 0 && errno == EINTR) {
+        continue;
+      } else {
+        int rc = m < 0 ? errno : EIO;
+        splice_pipe_discard(fds);
+        return rc;
+      }
+    }
+  }
+  return 0;
+}
+#endif
+
+/*
+ * Copy with pread and pwrite.
+ */
+static int copy_by_rw(int in_fd, off_t in_off, int out_fd, off_t out_off,
+                      jlong len, jlong *done)
+{
+  const size_t buf_len = 1024 * 1024;
+  char *buf = malloc(buf_len);
+  ssize_t n, m, w;
+  int rc = 0;
+
+  if (!buf) {
+    return ENOMEM;
+  }
+  while (*done < len) {
+    size_t want = len - *done < (jlong)buf_len ?
+        (size_t)(len - *done) : buf_len;
+    n = pread(in_fd, buf, want, in_off + *done);
+    if (n == 0) {
+      break;
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      rc = errno;
+      break;
+    }
+    for (w = 0; w < n; ) {
+      m = pwrite(out_fd, buf + w, n - w, out_off + *done + w);
+      if (m < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        rc = errno;
+        break;
+      }
+      w += m;
+    }
+    *done += w;
+    if (rc) {
+      break;
+    }
+  }
+  free(buf);
+  return rc;
+}
+
+/*
+ * Whether a failed copy_file_range or reflink should be retried the slow
+ * way, rather than reported.
+ */
+static int copy_unsupported(int rc)
+{
+  return rc == ENOSYS || rc == EXDEV || rc == EINVAL || rc == EOPNOTSUPP ||
+         rc == ENOTTY || rc == EBADF;
+}
+
+// NativeIO.COPY_REFLINK
+#define COPY_REFLINK 1
+
+/**
+ * public static native long copyFileRange(FileDescriptor in, long inOffset,
+ *   FileDescriptor out, long outOffset, long len, int flags)
+ *   throws IOException;
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_copyFileRange(
+  JNIEnv *env, jclass clazz, jobject in_object, jlong in_offset,
+  jobject out_object, jlong out_offset, jlong len, jint flags)
+{
+  jlong done = 0;
+  int rc = ENOSYS;
+
+  int in_fd = fd_get(env, in_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+  int out_fd = fd_get(env, out_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+
+  if (in_offset < 0 || out_offset < 0 || len < 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "negative offset or length");
+    return 0;
+  }
+
+#ifdef __linux__
+  if (flags & COPY_REFLINK) {
+    struct stat s;
+    if ((rc = copy_by_reflink(in_fd, in_offset, out_fd, out_offset,
+                              len)) == 0) {
+      // The clone stops at the end of the source
+      if (fstat(in_fd, &s)) {
+        throw_ioe(env, errno);
+        return 0;
+      }
+      return in_offset + len > s.st_size ? s.st_size - in_offset : len;
+    } else if (!copy_unsupported(rc)) {
+      throw_ioe(env, rc);
+      return 0;
+    }
+  }
+#ifdef SYS_copy_file_range
+  {
+    loff_t in_off = in_offset, out_off = out_offset;
+    ssize_t n;
+
+    rc = 0;
+    while (done < len) {
+      n = syscall(SYS_copy_file_range, in_fd, &in_off, out_fd, &out_off,
+                  (size_t)(len - done), 0);
+      if (n > 0) {
+        done += n;
+      } else if (n == 0) {
+        break; // end of file
+      } else if (errno == EINTR) {
+        continue;
+      } else {
+        rc = errno;
+        break;
+      }
+    }
+    if (rc == 0) {
+      return done;
+    }
+    // Some kernels refuse partway, e.g. when crossing file systems, so
+    // carry on from where copy_file_range stopped
+    if (!copy_unsupported(rc)) {
+      throw_ioe(env, rc);
+      return done;
+    }
+  }
+#endif
+  {
+    loff_t in_off = in_offset + done, out_off = out_offset + done;
+    if ((rc = copy_by_splice(in_fd, &in_off, out_fd, &out_off, len,
+                             &done)) == 0) {
+      return done;
+    } else if (!copy_unsupported(rc)) {
+      throw_ioe(env, rc);
+      return done;
+    }
+  }
+#endif
+  if ((rc = copy_by_rw(in_fd, in_offset, out_fd, out_offset, len, &done))) {
+    throw_ioe(env, rc);
+  }
+  return done;
+}
+
+/**
+ * public static native void fallocate(FileDescriptor fd, int mode,
+ *   long offset, long len) throws IOException;
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_fallocate(
+  JNIEnv *env, jclass clazz, jobject fd_object, jint mode,
+  jlong offset, jlong len)
+{
+  int rc;
+
+  int fd = fd_get(env, fd_object);
+  PASS_EXCEPTIONS(env);
+
+#ifdef __linux__
+  if (fallocate(fd, mode, (off_t)offset, (off_t)len) == 0) {
+    return;
+  }
+  rc = errno;
+  if ((rc != EOPNOTSUPP && rc != ENOSYS) || mode != 0) {
+    if (rc == EOPNOTSUPP || rc == ENOSYS) {
+      THROW(env, "java/lang/UnsupportedOperationException",
+            "fallocate mode not supported by this file system");
+    } else {
+      throw_ioe(env, rc);
+    }
+    return;
+  }
+  // Fall through to posix_fallocate, which glibc emulates by writing
+  // a byte to each block on file systems or kernels without fallocate
+#else
+  if (mode != 0) {
+    THROW(env, "java/lang/UnsupportedOperationException",
+          "fallocate modes not available");
+    return;
+  }
+#endif
+  if ((rc = posix_fallocate(fd, (off_t)offset, (off_t)len))) {
+    throw_ioe(env, rc);
+  }
+}
+
+/**
+ * public static native ByteBuffer allocateAligned(int capacity,
+ *   int alignment);
+ */
+JNIEXPORT jobject JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_allocateAligned(
+  JNIEnv *env, jclass clazz, jint capacity, jint alignment)
+{
+  void *addr = NULL;
+  jobject ret;
+  int rc;
+
+  if (capacity <= 0 || alignment <= 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "capacity must be positive and alignment a power of two");
+    return NULL;
+  }
+  if (alignment < (jint)sizeof(void *)) {
+    alignment = sizeof(void *);
+  }
+  if ((rc = posix_memalign(&addr, alignment, capacity))) {
+    THROW(env, "java/lang/OutOfMemoryError", "posix_memalign failed");
+    return NULL;
+  }
+  ret = (*env)->NewDirectByteBuffer(env, addr, capacity);
+  if (!ret) {
+    free(addr);
+  }
+  return ret;
+}
+
+/**
+ * public static native void freeAligned(ByteBuffer buf);
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_freeAligned(
+  JNIEnv *env, jclass clazz, jobject buf)
+{
+  free((*env)->GetDirectBufferAddress(env, buf));
+}
+
+/**
+ * public static native int pwrite(FileDescriptor fd, ByteBuffer buf,
+ *   int off, int len, long position) throws IOException;
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_pwrite(
+  JNIEnv *env, jclass clazz, jobject fd_object, jobject buf,
+  jint off, jint len, jlong position)
+{
+  char *addr;
+  jlong capacity;
+  ssize_t n;
+
+  int fd = fd_get(env, fd_object);
+  PASS_EXCEPTIONS_RET(env, 0);
+
+  addr = (*env)->GetDirectBufferAddress(env, buf);
+  capacity = (*env)->GetDirectBufferCapacity(env, buf);
+  if (!addr || capacity < 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "buffer is not a direct ByteBuffer");
+    return 0;
+  }
+  if (off < 0 || len < 0 || off > capacity - len) {
+    THROW(env, "java/lang/IndexOutOfBoundsException",
+          "range is outside the buffer");
+    return 0;
+  }
+  do {
+    n = pwrite(fd, addr + off, len, (off_t)position);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    throw_ioe(env, errno);
+    return 0;
+  }
+  return n;
+}
+
+/**
+ * static native int readDirectory(String path, ByteBuffer buf)
+ *   throws IOException;
+ *
+ * Returns the number of bytes of dir_scan_records written to buf, or if
+ * they do not fit, the negated number of bytes needed.
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_readDirectory(
+  JNIEnv *env, jclass clazz, jstring j_path, jobject buf)
+{
+  char *addr;
+  jlong capacity;
+  size_t used = 0;
+  int rc;
+
+  addr = (*env)->GetDirectBufferAddress(env, buf);
+  capacity = (*env)->GetDirectBufferCapacity(env, buf);
+  if (!addr || capacity < 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "buffer is not a direct ByteBuffer");
+    return 0;
+  }
+  const char *path = (*env)->GetStringUTFChars(env, j_path, NULL);
+  if (path == NULL) return 0; // JVM throws Exception for us
+
+  rc = dir_scan(path, addr, capacity, &used);
+  (*env)->ReleaseStringUTFChars(env, j_path, path);
+  if (rc == ENOSPC) {
+    if (used > INT32_MAX) {
+      throw_ioe(env, EOVERFLOW);
+      return 0;
+    }
+    return -(jint)used;
+  } else if (rc) {
+    throw_ioe(env, rc);
+    return 0;
+  }
+  return used;
+}
+
+/**
+ * static native long createQueue(int depth, int backend) throws IOException;
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_createQueue(
+  JNIEnv *env, jclass clazz, jint depth, jint backend)
+{
+  struct ioq *q = NULL;
+  int rc;
+
+  if (depth <= 0) {
+    THROW(env, "java/lang/IllegalArgumentException", "depth must be positive");
+    return 0;
+  }
+  rc = ioq_create(depth, backend, &q);
+  if (rc == ENOSYS) {
+    THROW(env, "java/lang/UnsupportedOperationException",
+          "neither io_uring nor Linux AIO support available");
+    return 0;
+  } else if (rc) {
+    throw_ioe(env, rc);
+    return 0;
+  }
+  return (jlong)(intptr_t)q;
+}
+
+/**
+ * static native int getQueueBackend(long queue);
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_getQueueBackend(
+  JNIEnv *env, jclass clazz, jlong queue)
+{
+  return ioq_backend((struct ioq *)(intptr_t)queue);
+}
+
+/**
+ * static native int submitQueue(long queue, int n, int[] ops, long[] offsets,
+ *   FileDescriptor[] fds, ByteBuffer[] bufs) throws IOException;
+ *
+ * ops holds (op, slot, buffer offset, length) for each request, and the
+ * slot is handed back by reapQueue when the request completes.
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_submitQueue(
+  JNIEnv *env, jclass clazz, jlong queue, jint n, jintArray j_ops,
+  jlongArray j_offsets, jobjectArray j_fds, jobjectArray j_bufs)
+{
+  struct ioq *q = (struct ioq *)(intptr_t)queue;
+  struct ioq_request *reqs = NULL;
+  jint *ops = NULL;
+  jlong *offsets = NULL;
+  int i, ret = 0;
+
+  if (n <= 0) {
+    return 0;
+  }
+  reqs = calloc(n, sizeof(struct ioq_request));
+  if (!reqs) {
+    THROW(env, "java/lang/OutOfMemoryError", "submitQueue");
+    return 0;
+  }
+  ops = (*env)->GetIntArrayElements(env, j_ops, NULL);
+  if (!ops) goto cleanup; // JVM throws Exception for us
+  offsets = (*env)->GetLongArrayElements(env, j_offsets, NULL);
+  if (!offsets) goto cleanup;
+
+  for (i = 0; i < n; i++) {
+    jobject fd_object = (*env)->GetObjectArrayElement(env, j_fds, i);
+    jobject buf = (*env)->GetObjectArrayElement(env, j_bufs, i);
+    char *addr;
+
+    if ((*env)->ExceptionCheck(env)) goto cleanup;
+    reqs[i].fd = fd_get(env, fd_object);
+    if ((*env)->ExceptionCheck(env)) goto cleanup;
+    addr = (*env)->GetDirectBufferAddress(env, buf);
+    if (!addr) {
+      THROW(env, "java/lang/IllegalArgumentException",
+            "buffer is not a direct ByteBuffer");
+      goto cleanup;
+    }
+    reqs[i].op = ops[4 * i];
+    reqs[i].tag = ops[4 * i + 1];
+    reqs[i].buf = addr + ops[4 * i + 2];
+    reqs[i].len = ops[4 * i + 3];
+    reqs[i].offset = (off_t)offsets[i];
+    (*env)->DeleteLocalRef(env, fd_object);
+    (*env)->DeleteLocalRef(env, buf);
+  }
+
+  ret = ioq_submit(q, reqs, n);
+  if (ret < 0) {
+    throw_ioe(env, -ret);
+    ret = 0;
+  }
+
+cleanup:
+  if (offsets) {
+    (*env)->ReleaseLongArrayElements(env, j_offsets, offsets, JNI_ABORT);
+  }
+  if (ops) {
+    (*env)->ReleaseIntArrayElements(env, j_ops, ops, JNI_ABORT);
+  }
+  free(reqs);
+  return ret;
+}
+
+/**
+ * static native int reapQueue(long queue, int[] slots, long[] results,
+ *   int max, int minComplete) throws IOException;
+ */
+JNIEXPORT jint JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_reapQueue(
+  JNIEnv *env, jclass clazz, jlong queue, jintArray j_slots,
+  jlongArray j_results, jint max, jint min_complete)
+{
+  struct ioq *q = (struct ioq *)(intptr_t)queue;
+  struct ioq_completion *cqes;
+  int i, n;
+
+  if (max <= 0) {
+    return 0;
+  }
+  cqes = calloc(max, sizeof(struct ioq_completion));
+  if (!cqes) {
+    THROW(env, "java/lang/OutOfMemoryError", "reapQueue");
+    return 0;
+  }
+  n = ioq_reap(q, cqes, max, min_complete);
+  if (n < 0) {
+    throw_ioe(env, -n);
+    free(cqes);
+    return 0;
+  }
+  for (i = 0; i < n; i++) {
+    jint slot = (jint)cqes[i].tag;
+    jlong result = cqes[i].result;
+    (*env)->SetIntArrayRegion(env, j_slots, i, 1, &slot);
+    (*env)->SetLongArrayRegion(env, j_results, i, 1, &result);
+  }
+  free(cqes);
+  return n;
+}
+
+/**
+ * static native void destroyQueue(long queue);
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_destroyQueue(
+  JNIEnv *env, jclass clazz, jlong queue)
+{
+  ioq_free((struct ioq *)(intptr_t)queue);
+}
+
+/**
+ * static native long createDiskSampler(String[] dirs, int intervalMs,
+ *   int probeSize) throws IOException;
+ */
+JNIEXPORT jlong JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_createDiskSampler(
+  JNIEnv *env, jclass clazz, jobjectArray j_dirs, jint interval_ms,
+  jint probe_size)
+{
+  struct disk_prober *p = NULL;
+  jsize i, n = (*env)->GetArrayLength(env, j_dirs);
+  jstring *j_paths = NULL;
+  const char **paths = NULL;
+  int rc;
+
+  if (n <= 0 || interval_ms <= 0 || probe_size <= 0) {
+    THROW(env, "java/lang/IllegalArgumentException",
+          "need at least one directory, a positive interval and probe size");
+    return 0;
+  }
+  j_paths = calloc(n, sizeof(jstring));
+  paths = calloc(n, sizeof(char *));
+  if (!j_paths || !paths) {
+    THROW(env, "java/lang/OutOfMemoryError", "createDiskSampler");
+    goto cleanup;
+  }
+  for (i = 0; i < n; i++) {
+    j_paths[i] = (*env)->GetObjectArrayElement(env, j_dirs, i);
+    if (!j_paths[i]) {
+      if (!(*env)->ExceptionCheck(env)) {
+        THROW(env, "java/lang/NullPointerException", "null directory");
+      }
+      goto cleanup;
+    }
+    paths[i] = (*env)->GetStringUTFChars(env, j_paths[i], NULL);
+    if (!paths[i]) goto cleanup; // JVM throws Exception for us
+  }
+
+  rc = disk_prober_create(paths, n, interval_ms, probe_size, &p);
+  if (rc) {
+    throw_ioe(env, rc);
+    p = NULL;
+  }
+
+cleanup:
+  for (i = 0; j_paths && i < n && j_paths[i]; i++) {
+    if (paths[i]) {
+      (*env)->ReleaseStringUTFChars(env, j_paths[i], paths[i]);
+    }
+    (*env)->DeleteLocalRef(env, j_paths[i]);
+  }
+  free(paths);
+  free(j_paths);
+  return (jlong)(intptr_t)p;
+}
+
+/**
+ * static native void getDiskSample(long sampler, int volume, long[] out);
+ *
+ * Fills out with the read histogram, the write histogram, then the fields
+ * of disk_probe_stats and disk_probe_diskstats in their order.
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_getDiskSample(
+  JNIEnv *env, jclass clazz, jlong sampler, jint volume, jlongArray j_out)
+{
+  struct disk_prober *p = (struct disk_prober *)(intptr_t)sampler;
+  struct disk_probe_stats st;
+  jlong out[2 * DISK_PROBE_BUCKETS + 18];
+  jlong *f = out;
+  int i;
+
+  if (volume < 0 || volume >= disk_prober_volumes(p)) {
+    THROW(env, "java/lang/IndexOutOfBoundsException", "no such volume");
+    return;
+  }
+  if ((*env)->GetArrayLength(env, j_out) < (jsize)(sizeof(out) / sizeof(jlong))) {
+    THROW(env, "java/lang/IllegalArgumentException", "output array too short");
+    return;
+  }
+  disk_prober_stats(p, volume, &st);
+  for (i = 0; i < DISK_PROBE_BUCKETS; i++) {
+    *f++ = st.read_hist[i];
+  }
+  for (i = 0; i < DISK_PROBE_BUCKETS; i++) {
+    *f++ = st.write_hist[i];
+  }
+  *f++ = st.read_errors;
+  *f++ = st.write_errors;
+  *f++ = st.last_error;
+  *f++ = st.last_read_us;
+  *f++ = st.last_write_us;
+  *f++ = st.inflight_us;
+  *f++ = st.have_diskstats;
+  *f++ = st.diskstats.reads;
+  *f++ = st.diskstats.reads_merged;
+  *f++ = st.diskstats.sectors_read;
+  *f++ = st.diskstats.read_ms;
+  *f++ = st.diskstats.writes;
+  *f++ = st.diskstats.writes_merged;
+  *f++ = st.diskstats.sectors_written;
+  *f++ = st.diskstats.write_ms;
+  *f++ = st.diskstats.ios_in_progress;
+  *f++ = st.diskstats.io_ms;
+  *f++ = st.diskstats.weighted_io_ms;
+  (*env)->SetLongArrayRegion(env, j_out, 0, f - out, out);
+}
+
+/**
+ * static native void destroyDiskSampler(long sampler);
+ */
+JNIEXPORT void JNICALL
+Java_org_apache_hadoop_io_nativeio_NativeIO_destroyDiskSampler(
+  JNIEnv *env, jclass clazz, jlong sampler)
+{
+  disk_prober_free((struct disk_prober *)(intptr_t)sampler);
+}
+
 
 /*
  * Throw a java.IO.IOException, generating the message from errno.
@@ -421,13 +1587,6 @@ err:
 /*
  * Determine how big a buffer we need for reentrant getpwuid_r and getgrnam_r
  */
-ssize_t get_pw_buflen() {
-  long ret = 0;
-  #ifdef _SC_GETPW_R_SIZE_MAX
-  ret = sysconf(_SC_GETPW_R_SIZE_MAX);
-  #endif
-  return (ret > 512) ? ret : 512;
-}
 /**
  * vim: sw=2: ts=2: et:
  */
@@ -0,0 +1,213 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "config.h"
+#include "dir_scan.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/stat.h>
+#endif
+
+#define RECORD_ALIGN 8
+
+struct entry_stat {
+  int type;
+  int64_t size;
+  int64_t mtime;
+};
+
+#if defined(__linux__) && defined(SYS_statx) && defined(STATX_TYPE)
+#define HAVE_STATX_SYSCALL
+
+#ifndef AT_STATX_DONT_SYNC
+// From linux/fcntl.h, which clashes with the libc fcntl.h
+#define AT_STATX_DONT_SYNC 0x4000
+#endif
+
+// Cleared the first time the kernel answers ENOSYS
+static volatile int statx_works = 1;
+#endif
+
+static int type_of_mode(mode_t mode)
+{
+  if (S_ISREG(mode)) {
+    return DIR_SCAN_FILE;
+  } else if (S_ISDIR(mode)) {
+    return DIR_SCAN_DIRECTORY;
+  }
+  return DIR_SCAN_OTHER;
+}
+
+/*
+ * Stat one entry relative to the directory descriptor. AT_STATX_DONT_SYNC
+ * lets network file systems answer from their cached attributes.
+ */
+static int stat_entry(int dfd, const char *name, struct entry_stat *st)
+{
+  struct stat s;
+
+#ifdef HAVE_STATX_SYSCALL
+  if (statx_works) {
+    struct statx sx;
+    if (syscall(SYS_statx, dfd, name,
+                AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                STATX_TYPE | STATX_SIZE | STATX_MTIME, &sx) == 0) {
+      st->type = type_of_mode(sx.stx_mode);
+      st->size = sx.stx_size;
+      st->mtime = (int64_t)sx.stx_mtime.tv_sec * 1000 +
+          sx.stx_mtime.tv_nsec / 1000000;
+      return 0;
+    }
+    if (errno != ENOSYS) {
+      return errno ? errno : EIO;
+    }
+    statx_works = 0;
+  }
+#endif
+  if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW)) {
+    return errno ? errno : EIO;
+  }
+  st->type = type_of_mode(s.st_mode);
+  st->size = s.st_size;
+  st->mtime = (int64_t)s.st_mtime * 1000;
+#ifdef __linux__
+  st->mtime += s.st_mtim.tv_nsec / 1000000;
+#endif
+  return 0;
+}
+
+/*
+ * Stat an entry and append its record, or only count its size once the
+ * buffer has overflowed.
+ */
+static int add_entry(int dfd, const char *name, char *buf, size_t cap,
+                     size_t *used)
+{
+  struct dir_scan_record rec;
+  struct entry_stat st = { 0 };
+  size_t name_len, len;
+  int rc;
+
+  if (name[0] == '.' && (name[1] == '\0' ||
+                         (name[1] == '.' && name[2] == '\0'))) {
+    return 0;
+  }
+  if ((rc = stat_entry(dfd, name, &st))) {
+    // Block files come and go while a volume is scanned
+    return rc == ENOENT ? 0 : rc;
+  }
+  name_len = strlen(name);
+  len = (sizeof(rec) + name_len + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+  if (*used + len <= cap) {
+    rec.name_len = name_len;
+    rec.type = st.type;
+    rec.size = st.size;
+    rec.mtime = st.mtime;
+    memcpy(buf + *used, &rec, sizeof(rec));
+    memcpy(buf + *used + sizeof(rec), name, name_len);
+    memset(buf + *used + sizeof(rec) + name_len, 0,
+           len - sizeof(rec) - name_len);
+  }
+  *used += len;
+  return 0;
+}
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+int dir_scan(const char *path, char *buf, size_t cap, size_t *used)
+{
+  // Large enough for a few hundred entries per getdents64 call
+  char dents[32 * 1024] __attribute__((aligned(8)));
+  long n, off;
+  int dfd, rc = 0;
+
+  *used = 0;
+  dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dfd < 0) {
+    return errno;
+  }
+  for (;;) {
+    n = syscall(SYS_getdents64, dfd, dents, sizeof(dents));
+    if (n < 0) {
+      rc = errno;
+      break;
+    } else if (n == 0) {
+      break;
+    }
+    for (off = 0; off < n && rc == 0; ) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(dents + off);
+      rc = add_entry(dfd, d->d_name, buf, cap, used);
+      off += d->d_reclen;
+    }
+    if (rc) {
+      break;
+    }
+  }
+  close(dfd);
+  if (rc == 0 && *used > cap) {
+    rc = ENOSPC;
+  }
+  return rc;
+}
+
+#else
+
+int dir_scan(const char *path, char *buf, size_t cap, size_t *used)
+{
+  struct dirent *d;
+  DIR *dir;
+  int rc = 0;
+
+  *used = 0;
+  if (!(dir = opendir(path))) {
+    return errno;
+  }
+  for (;;) {
+    errno = 0;
+    if (!(d = readdir(dir))) {
+      rc = errno;
+      break;
+    }
+    if ((rc = add_entry(dirfd(dir), d->d_name, buf, cap, used))) {
+      break;
+    }
+  }
+  closedir(dir);
+  if (rc == 0 && *used > cap) {
+    rc = ENOSPC;
+  }
+  return rc;
+}
+
+#endif
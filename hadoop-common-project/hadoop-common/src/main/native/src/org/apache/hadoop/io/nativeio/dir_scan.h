@@ -0,0 +1,58 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Listing of a single directory with the size and modification time of
+ * each entry, for scans over very large trees of block files.
+ */
+
+#ifndef DIR_SCAN_H
+#define DIR_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIR_SCAN_FILE 0
+#define DIR_SCAN_DIRECTORY 1
+#define DIR_SCAN_OTHER 2
+
+/*
+ * Each entry is packed into the output buffer as this header followed by
+ * name_len bytes of name, without a terminator, padded to a multiple of
+ * eight bytes. Fields are in native byte order.
+ */
+struct dir_scan_record {
+  int32_t name_len;
+  int32_t type;
+  int64_t size;
+  // milliseconds since the epoch
+  int64_t mtime;
+};
+
+/**
+ * List the entries of a directory, other than "." and "..", into buf.
+ * Entries removed while the scan runs are left out. Symbolic links are
+ * not followed.
+ *
+ * @param used  set to the number of bytes written, or on ENOSPC to the
+ *              number of bytes the listing needs
+ * @return 0 on success, ENOSPC if the listing does not fit in cap bytes,
+ *         or another errno value
+ */
+int dir_scan(const char *path, char *buf, size_t cap, size_t *used);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "config.h"
+#include "disk_probe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#define PROBE_FILE_NAME ".disk_probe"
+
+// Probes cycle through this many blocks of the probe file, so that
+// consecutive probes do not keep hitting the same sectors
+#define PROBE_SLOTS 8
+
+struct probe_volume {
+  struct disk_prober *prober;
+  char *path;
+  int fd;
+  int direct;
+  void *buf;
+  size_t len;
+  unsigned slot;
+  dev_t dev;
+  pthread_t thread;
+  int started;
+  // protected by prober->lock
+  int64_t probe_start_us;
+  struct disk_probe_stats stats;
+};
+
+struct disk_prober {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int stopping;
+  int interval_ms;
+  int n;
+  struct probe_volume vols[];
+};
+
+static int64_t now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int bucket_of(int64_t us)
+{
+  int b = 0;
+
+  while (us > 1 && b < DISK_PROBE_BUCKETS - 1) {
+    us >>= 1;
+    b++;
+  }
+  return b;
+}
+
+static int full_pwrite(int fd, const void *buf, size_t len, off_t off)
+{
+  ssize_t n = pwrite(fd, buf, len, off);
+  if (n < 0) {
+    return errno;
+  }
+  return (size_t)n == len ? 0 : EIO;
+}
+
+static int full_pread(int fd, void *buf, size_t len, off_t off)
+{
+  ssize_t n = pread(fd, buf, len, off);
+  if (n < 0) {
+    return errno;
+  }
+  return (size_t)n == len ? 0 : EIO;
+}
+
+static int probe_write(struct probe_volume *v, off_t off)
+{
+  int rc = full_pwrite(v->fd, v->buf, v->len, off);
+  if (rc) {
+    return rc;
+  }
+  // O_DIRECT bypasses the page cache but not the drive's write cache
+  return fdatasync(v->fd) ? errno : 0;
+}
+
+static int probe_read(struct probe_volume *v, off_t off)
+{
+#ifdef POSIX_FADV_DONTNEED
+  if (!v->direct) {
+    posix_fadvise(v->fd, off, v->len, POSIX_FADV_DONTNEED);
+  }
+#endif
+  return full_pread(v->fd, v->buf, v->len, off);
+}
+
+static void record(struct probe_volume *v, int rc, int64_t start,
+                   uint64_t *hist, uint64_t *errors, int64_t *last)
+{
+  int64_t us = now_us() - start;
+
+  if (rc) {
+    (*errors)++;
+    v->stats.last_error = rc;
+  } else {
+    hist[bucket_of(us)]++;
+    *last = us;
+  }
+}
+
+static void probe_once(struct probe_volume *v)
+{
+  struct disk_prober *p = v->prober;
+  off_t off = (off_t)(v->slot++ % PROBE_SLOTS) * v->len;
+  int64_t start;
+  int rc;
+
+  start = now_us();
+  pthread_mutex_lock(&p->lock);
+  v->probe_start_us = start;
+  pthread_mutex_unlock(&p->lock);
+  rc = probe_write(v, off);
+  pthread_mutex_lock(&p->lock);
+  record(v, rc, start, v->stats.write_hist, &v->stats.write_errors,
+         &v->stats.last_write_us);
+  start = now_us();
+  v->probe_start_us = start;
+  pthread_mutex_unlock(&p->lock);
+
+  rc = probe_read(v, off);
+  pthread_mutex_lock(&p->lock);
+  record(v, rc, start, v->stats.read_hist, &v->stats.read_errors,
+         &v->stats.last_read_us);
+  v->probe_start_us = 0;
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void *probe_thread(void *arg)
+{
+  struct probe_volume *v = arg;
+  struct disk_prober *p = v->prober;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&p->lock);
+  while (!p->stopping) {
+    pthread_mutex_unlock(&p->lock);
+    probe_once(v);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += p->interval_ms / 1000;
+    deadline.tv_nsec += (long)(p->interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (!p->stopping &&
+           pthread_cond_timedwait(&p->cond, &p->lock, &deadline) != ETIMEDOUT) {
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static int open_volume(struct probe_volume *v, const char *dir,
+                       size_t probe_size)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  struct stat st;
+  int flags = O_RDWR | O_CREAT;
+  int i, rc;
+
+  if (page <= 0) {
+    page = 4096;
+  }
+  if (stat(dir, &st)) {
+    return errno;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return ENOTDIR;
+  }
+  v->dev = st.st_dev;
+  v->path = malloc(strlen(dir) + sizeof("/" PROBE_FILE_NAME));
+  if (!v->path) {
+    return ENOMEM;
+  }
+  sprintf(v->path, "%s/" PROBE_FILE_NAME, dir);
+
+  v->len = (probe_size + page - 1) / page * page;
+  if (v->len == 0) {
+    v->len = page;
+  }
+  rc = posix_memalign(&v->buf, page, v->len);
+  if (rc) {
+    v->buf = NULL;
+    return rc;
+  }
+  memset(v->buf, 0x5a, v->len);
+
+#ifdef O_DIRECT
+  v->fd = open(v->path, flags | O_DIRECT, 0600);
+  v->direct = v->fd >= 0;
+  if (v->fd < 0 && errno == EINVAL) {
+    // tmpfs and some FUSE filesystems refuse O_DIRECT
+    v->fd = open(v->path, flags, 0600);
+  }
+#else
+  v->fd = open(v->path, flags, 0600);
+#endif
+  if (v->fd < 0) {
+    return errno;
+  }
+  // Lay out the whole file now, so that no probe pays for allocating
+  for (i = 0; i < PROBE_SLOTS; i++) {
+    rc = full_pwrite(v->fd, v->buf, v->len, (off_t)i * v->len);
+    if (rc) {
+      return rc;
+    }
+  }
+  if (fsync(v->fd)) {
+    return errno;
+  }
+  v->stats.last_read_us = -1;
+  v->stats.last_write_us = -1;
+  return 0;
+}
+
+static void close_volume(struct probe_volume *v)
+{
+  if (v->fd >= 0) {
+    close(v->fd);
+    unlink(v->path);
+  }
+  free(v->path);
+  free(v->buf);
+}
+
+int disk_prober_create(const char * const *dirs, int n, int interval_ms,
+                       size_t probe_size, struct disk_prober **out)
+{
+  struct disk_prober *p;
+  pthread_condattr_t attr;
+  int i, rc = 0;
+
+  p = calloc(1, sizeof(*p) + n * sizeof(struct probe_volume));
+  if (!p) {
+    return ENOMEM;
+  }
+  p->n = n;
+  p->interval_ms = interval_ms;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&p->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  for (i = 0; i < n; i++) {
+    p->vols[i].prober = p;
+    p->vols[i].fd = -1;
+  }
+  for (i = 0; i < n && !rc; i++) {
+    rc = open_volume(&p->vols[i], dirs[i], probe_size);
+  }
+  for (i = 0; i < n && !rc; i++) {
+    rc = pthread_create(&p->vols[i].thread, NULL, probe_thread, &p->vols[i]);
+    p->vols[i].started = !rc;
+  }
+  if (rc) {
+    disk_prober_free(p);
+    return rc;
+  }
+  *out = p;
+  return 0;
+}
+
+int disk_prober_volumes(const struct disk_prober *p)
+{
+  return p->n;
+}
+
+static int read_diskstats(dev_t dev, struct disk_probe_diskstats *ds)
+{
+#ifdef __linux__
+  char line[256];
+  unsigned maj, min;
+  long long f[11];
+  FILE *fp;
+  int found = 0;
+
+  fp = fopen("/proc/diskstats", "r");
+  if (!fp) {
+    return 0;
+  }
+  while (!found && fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%u %u %*s %lld %lld %lld %lld %lld %lld %lld %lld "
+               "%lld %lld %lld", &maj, &min, &f[0], &f[1], &f[2], &f[3],
+               &f[4], &f[5], &f[6], &f[7], &f[8], &f[9], &f[10]) != 13) {
+      continue;
+    }
+    if (maj != major(dev) || min != minor(dev)) {
+      continue;
+    }
+    ds->reads = f[0];
+    ds->reads_merged = f[1];
+    ds->sectors_read = f[2];
+    ds->read_ms = f[3];
+    ds->writes = f[4];
+    ds->writes_merged = f[5];
+    ds->sectors_written = f[6];
+    ds->write_ms = f[7];
+    ds->ios_in_progress = f[8];
+    ds->io_ms = f[9];
+    ds->weighted_io_ms = f[10];
+    found = 1;
+  }
+  fclose(fp);
+  return found;
+#else
+  return 0;
+#endif
+}
+
+void disk_prober_stats(struct disk_prober *p, int vol,
+                       struct disk_probe_stats *out)
+{
+  struct probe_volume *v = &p->vols[vol];
+  int64_t now = now_us();
+
+  pthread_mutex_lock(&p->lock);
+  *out = v->stats;
+  out->inflight_us = v->probe_start_us ? now - v->probe_start_us : 0;
+  pthread_mutex_unlock(&p->lock);
+  memset(&out->diskstats, 0, sizeof(out->diskstats));
+  out->have_diskstats = read_diskstats(v->dev, &out->diskstats);
+}
+
+void disk_prober_free(struct disk_prober *p)
+{
+  int i;
+
+  pthread_mutex_lock(&p->lock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 0; i < p->n; i++) {
+    if (p->vols[i].started) {
+      pthread_join(p->vols[i].thread, NULL);
+    }
+    close_volume(&p->vols[i]);
+  }
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
@@ -0,0 +1,102 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Periodic latency probes of storage volumes: small direct writes and
+ * reads against a file in each volume, kept as latency histograms, along
+ * with the kernel's counters for the device underneath.
+ */
+
+#ifndef DISK_PROBE_H
+#define DISK_PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bucket i of a histogram counts probes that took [2^i, 2^(i+1))
+ * microseconds, except that bucket 0 also takes anything under 1us and
+ * the last bucket anything slower.
+ */
+#define DISK_PROBE_BUCKETS 32
+
+/* The first eleven fields of the device's line in /proc/diskstats */
+struct disk_probe_diskstats {
+  int64_t reads;
+  int64_t reads_merged;
+  int64_t sectors_read;
+  int64_t read_ms;
+  int64_t writes;
+  int64_t writes_merged;
+  int64_t sectors_written;
+  int64_t write_ms;
+  int64_t ios_in_progress;
+  int64_t io_ms;
+  int64_t weighted_io_ms;
+};
+
+struct disk_probe_stats {
+  uint64_t read_hist[DISK_PROBE_BUCKETS];
+  uint64_t write_hist[DISK_PROBE_BUCKETS];
+  uint64_t read_errors;
+  uint64_t write_errors;
+  // errno of the last failed probe, or 0
+  int last_error;
+  // latency of the last successful probe of each kind, or -1
+  int64_t last_read_us;
+  int64_t last_write_us;
+  // how long the probe now running has taken so far, or 0; a hung disk
+  // shows up here long before any histogram moves
+  int64_t inflight_us;
+  // set if the volume's device was found in /proc/diskstats
+  int have_diskstats;
+  struct disk_probe_diskstats diskstats;
+};
+
+struct disk_prober;
+
+/**
+ * Start probing each of the n directories every interval_ms milliseconds,
+ * each from a thread of its own so that one hung disk cannot hold up the
+ * probes of the others. A probe writes probe_size bytes, rounded up to the
+ * page size, with O_DIRECT and fdatasync, then reads them back the same
+ * way. The bytes live in a file named .disk_probe in each directory,
+ * created here and removed by disk_prober_free.
+ *
+ * @return 0 on success, or the errno value of the first directory
+ *         that could not be set up.
+ */
+int disk_prober_create(const char * const *dirs, int n, int interval_ms,
+                       size_t probe_size, struct disk_prober **out);
+
+/** Return the number of volumes being probed. */
+int disk_prober_volumes(const struct disk_prober *p);
+
+/**
+ * Copy out the statistics gathered for volume vol, and read the current
+ * counters of its device from /proc/diskstats.
+ */
+void disk_prober_stats(struct disk_prober *p, int vol,
+                       struct disk_probe_stats *out);
+
+/**
+ * Stop the probes and release the prober. Waits for the probes in flight,
+ * so it does not return while a disk is hung.
+ */
+void disk_prober_free(struct disk_prober *p);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "config.h"
+#include "io_queue.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+#include <linux/aio_abi.h>
+#endif
+
+struct ioq {
+  int backend;
+  unsigned depth;
+  unsigned inflight;
+#ifdef HAVE_LINUX_IO_URING_H
+  struct {
+    int fd;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    // The iovec of each submission slot, which must outlive the submission
+    struct iovec *iovecs;
+  } uring;
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+  struct {
+    aio_context_t ctx;
+    struct iocb *iocbs;
+    struct iocb **iocb_ptrs;
+    struct io_event *events;
+  } aio;
+#endif
+};
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static int uring_create(struct ioq *q)
+{
+  struct io_uring_params p;
+  unsigned char *sq_ring;
+
+  memset(&p, 0, sizeof(p));
+  q->uring.fd = syscall(__NR_io_uring_setup, q->depth, &p);
+  if (q->uring.fd < 0) {
+    return errno;
+  }
+  q->uring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  q->uring.cq_ring_size = p.cq_off.cqes +
+      p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (q->uring.cq_ring_size > q->uring.sq_ring_size) {
+      q->uring.sq_ring_size = q->uring.cq_ring_size;
+    }
+    q->uring.cq_ring_size = q->uring.sq_ring_size;
+  }
+  q->uring.sq_ring = mmap(NULL, q->uring.sq_ring_size,
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          q->uring.fd, IORING_OFF_SQ_RING);
+  if (q->uring.sq_ring == MAP_FAILED) {
+    q->uring.sq_ring = NULL;
+    return errno;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    q->uring.cq_ring = q->uring.sq_ring;
+  } else {
+    q->uring.cq_ring = mmap(NULL, q->uring.cq_ring_size,
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            q->uring.fd, IORING_OFF_CQ_RING);
+    if (q->uring.cq_ring == MAP_FAILED) {
+      q->uring.cq_ring = NULL;
+      return errno;
+    }
+  }
+  q->uring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  q->uring.sqes = mmap(NULL, q->uring.sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, q->uring.fd,
+                       IORING_OFF_SQES);
+  if (q->uring.sqes == MAP_FAILED) {
+    q->uring.sqes = NULL;
+    return errno;
+  }
+  sq_ring = q->uring.sq_ring;
+  q->uring.sq_head = (unsigned *)(sq_ring + p.sq_off.head);
+  q->uring.sq_tail = (unsigned *)(sq_ring + p.sq_off.tail);
+  q->uring.sq_mask = (unsigned *)(sq_ring + p.sq_off.ring_mask);
+  q->uring.sq_array = (unsigned *)(sq_ring + p.sq_off.array);
+  q->uring.cq_head = (unsigned *)((unsigned char *)q->uring.cq_ring +
+                                  p.cq_off.head);
+  q->uring.cq_tail = (unsigned *)((unsigned char *)q->uring.cq_ring +
+                                  p.cq_off.tail);
+  q->uring.cq_mask = (unsigned *)((unsigned char *)q->uring.cq_ring +
+                                  p.cq_off.ring_mask);
+  q->uring.cqes = (struct io_uring_cqe *)((unsigned char *)q->uring.cq_ring +
+                                          p.cq_off.cqes);
+  q->uring.iovecs = calloc(p.sq_entries, sizeof(struct iovec));
+  if (!q->uring.iovecs) {
+    return ENOMEM;
+  }
+  return 0;
+}
+
+static void uring_free(struct ioq *q)
+{
+  if (q->uring.sqes) {
+    munmap(q->uring.sqes, q->uring.sqes_size);
+  }
+  if (q->uring.cq_ring && q->uring.cq_ring != q->uring.sq_ring) {
+    munmap(q->uring.cq_ring, q->uring.cq_ring_size);
+  }
+  if (q->uring.sq_ring) {
+    munmap(q->uring.sq_ring, q->uring.sq_ring_size);
+  }
+  if (q->uring.fd >= 0) {
+    close(q->uring.fd);
+  }
+  free(q->uring.iovecs);
+}
+
+static int uring_submit(struct ioq *q, const struct ioq_request *reqs, int n)
+{
+  unsigned mask = *q->uring.sq_mask;
+  unsigned tail = *q->uring.sq_tail;
+  int i, ret;
+
+  for (i = 0; i < n; i++) {
+    unsigned idx = (tail + i) & mask;
+    struct io_uring_sqe *sqe = &q->uring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    q->uring.iovecs[idx].iov_base = reqs[i].buf;
+    q->uring.iovecs[idx].iov_len = reqs[i].len;
+    sqe->opcode = reqs[i].op == IOQ_OP_WRITE ? IORING_OP_WRITEV :
+                                               IORING_OP_READV;
+    sqe->fd = reqs[i].fd;
+    sqe->off = reqs[i].offset;
+    sqe->addr = (uintptr_t)&q->uring.iovecs[idx];
+    sqe->len = 1;
+    sqe->user_data = reqs[i].tag;
+    q->uring.sq_array[idx] = idx;
+  }
+  // Publish the entries before the kernel can see the new tail
+  __atomic_store_n(q->uring.sq_tail, tail + n, __ATOMIC_RELEASE);
+  ret = syscall(__NR_io_uring_enter, q->uring.fd, n, 0, 0, NULL, 0);
+  if (ret < n) {
+    // Take back whatever the kernel did not consume, so that a failed or
+    // short submit does not leave entries behind for the next one to send.
+    // The kernel only consumes entries inside io_uring_enter, so the head
+    // was at tail on the way in.
+    __atomic_store_n(q->uring.sq_tail, tail + (ret > 0 ? ret : 0),
+                     __ATOMIC_RELEASE);
+  }
+  return ret < 0 ? -errno : ret;
+}
+
+static int uring_reap(struct ioq *q, struct ioq_completion *out, int max,
+                      int min_complete)
+{
+  unsigned head, tail, mask = *q->uring.cq_mask;
+  int n = 0;
+
+  for (;;) {
+    head = *q->uring.cq_head;
+    tail = __atomic_load_n(q->uring.cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && n < max) {
+      struct io_uring_cqe *cqe = &q->uring.cqes[head & mask];
+      out[n].tag = cqe->user_data;
+      out[n].result = cqe->res;
+      n++;
+      head++;
+    }
+    __atomic_store_n(q->uring.cq_head, head, __ATOMIC_RELEASE);
+    if (n >= min_complete || n >= max) {
+      return n;
+    }
+    if (syscall(__NR_io_uring_enter, q->uring.fd, 0, min_complete - n,
+                IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+      return n > 0 ? n : -errno;
+    }
+  }
+}
+
+#endif // HAVE_LINUX_IO_URING_H
+
+#ifdef HAVE_LINUX_AIO_ABI_H
+
+static int aio_create(struct ioq *q)
+{
+  q->aio.iocbs = calloc(q->depth, sizeof(struct iocb));
+  q->aio.iocb_ptrs = calloc(q->depth, sizeof(struct iocb *));
+  q->aio.events = calloc(q->depth, sizeof(struct io_event));
+  if (!q->aio.iocbs || !q->aio.iocb_ptrs || !q->aio.events) {
+    return ENOMEM;
+  }
+  if (syscall(__NR_io_setup, q->depth, &q->aio.ctx) < 0) {
+    q->aio.ctx = 0;
+    return errno;
+  }
+  return 0;
+}
+
+static void aio_free(struct ioq *q)
+{
+  if (q->aio.ctx) {
+    syscall(__NR_io_destroy, q->aio.ctx);
+  }
+  free(q->aio.iocbs);
+  free(q->aio.iocb_ptrs);
+  free(q->aio.events);
+}
+
+static int aio_submit(struct ioq *q, const struct ioq_request *reqs, int n)
+{
+  int i, ret;
+
+  // The kernel copies each iocb during io_submit, so the slots are free
+  // again as soon as it returns
+  for (i = 0; i < n; i++) {
+    struct iocb *cb = &q->aio.iocbs[i];
+    memset(cb, 0, sizeof(*cb));
+    cb->aio_lio_opcode = reqs[i].op == IOQ_OP_WRITE ? IOCB_CMD_PWRITE :
+                                                      IOCB_CMD_PREAD;
+    cb->aio_fildes = reqs[i].fd;
+    cb->aio_buf = (uintptr_t)reqs[i].buf;
+    cb->aio_nbytes = reqs[i].len;
+    cb->aio_offset = reqs[i].offset;
+    cb->aio_data = reqs[i].tag;
+    q->aio.iocb_ptrs[i] = cb;
+  }
+  ret = syscall(__NR_io_submit, q->aio.ctx, n, q->aio.iocb_ptrs);
+  return ret < 0 ? -errno : ret;
+}
+
+static int aio_reap(struct ioq *q, struct ioq_completion *out, int max,
+                    int min_complete)
+{
+  int n = 0, ret, i;
+
+  if (max > (int)q->depth) {
+    max = q->depth;
+  }
+  while (n < max) {
+    ret = syscall(__NR_io_getevents, q->aio.ctx,
+                  n < min_complete ? min_complete - n : 0, max - n,
+                  q->aio.events, NULL);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return n > 0 ? n : -errno;
+    }
+    for (i = 0; i < ret; i++) {
+      out[n].tag = q->aio.events[i].data;
+      out[n].result = q->aio.events[i].res;
+      n++;
+    }
+    if (ret == 0 || n >= min_complete) {
+      break;
+    }
+  }
+  return n;
+}
+
+#endif // HAVE_LINUX_AIO_ABI_H
+
+int ioq_create(unsigned depth, int backend, struct ioq **out)
+{
+  struct ioq *q;
+  int ret = ENOSYS;
+
+  if (depth == 0) {
+    return EINVAL;
+  }
+  q = calloc(1, sizeof(struct ioq));
+  if (!q) {
+    return ENOMEM;
+  }
+  q->depth = depth;
+#ifdef HAVE_LINUX_IO_URING_H
+  q->uring.fd = -1;
+  if (backend == IOQ_BACKEND_AUTO || backend == IOQ_BACKEND_URING) {
+    q->backend = IOQ_BACKEND_URING;
+    ret = uring_create(q);
+    if (ret == 0) {
+      *out = q;
+      return 0;
+    }
+    uring_free(q);
+    memset(&q->uring, 0, sizeof(q->uring));
+    q->uring.fd = -1;
+  }
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+  if (backend == IOQ_BACKEND_AUTO || backend == IOQ_BACKEND_AIO) {
+    q->backend = IOQ_BACKEND_AIO;
+    ret = aio_create(q);
+    if (ret == 0) {
+      *out = q;
+      return 0;
+    }
+  }
+#endif
+  q->backend = 0;
+  ioq_free(q);
+  return ret;
+}
+
+int ioq_backend(const struct ioq *q)
+{
+  return q->backend;
+}
+
+unsigned ioq_inflight(const struct ioq *q)
+{
+  return q->inflight;
+}
+
+int ioq_submit(struct ioq *q, const struct ioq_request *reqs, int n)
+{
+  int ret = -ENOSYS;
+
+  if (n > (int)(q->depth - q->inflight)) {
+    n = q->depth - q->inflight;
+  }
+  if (n <= 0) {
+    return 0;
+  }
+  switch (q->backend) {
+#ifdef HAVE_LINUX_IO_URING_H
+  case IOQ_BACKEND_URING:
+    ret = uring_submit(q, reqs, n);
+    break;
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+  case IOQ_BACKEND_AIO:
+    ret = aio_submit(q, reqs, n);
+    break;
+#endif
+  }
+  if (ret > 0) {
+    q->inflight += ret;
+  }
+  return ret;
+}
+
+int ioq_reap(struct ioq *q, struct ioq_completion *out, int max,
+             int min_complete)
+{
+  int ret = -ENOSYS;
+
+  if (min_complete > (int)q->inflight) {
+    min_complete = q->inflight;
+  }
+  if (max <= 0 || q->inflight == 0) {
+    return 0;
+  }
+  switch (q->backend) {
+#ifdef HAVE_LINUX_IO_URING_H
+  case IOQ_BACKEND_URING:
+    ret = uring_reap(q, out, max, min_complete);
+    break;
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+  case IOQ_BACKEND_AIO:
+    ret = aio_reap(q, out, max, min_complete);
+    break;
+#endif
+  }
+  if (ret > 0) {
+    q->inflight -= ret;
+  }
+  return ret;
+}
+
+void ioq_free(struct ioq *q)
+{
+  if (!q) {
+    return;
+  }
+  switch (q->backend) {
+#ifdef HAVE_LINUX_IO_URING_H
+  case IOQ_BACKEND_URING:
+    uring_free(q);
+    break;
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+  case IOQ_BACKEND_AIO:
+    aio_free(q);
+    break;
+#endif
+  }
+  free(q);
+}
@@ -0,0 +1,89 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * A batched asynchronous pread/pwrite queue, on io_uring where the kernel
+ * has it and Linux AIO otherwise.
+ */
+
+#ifndef IO_QUEUE_H
+#define IO_QUEUE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IOQ_BACKEND_AUTO 0
+#define IOQ_BACKEND_URING 1
+#define IOQ_BACKEND_AIO 2
+
+#define IOQ_OP_READ 0
+#define IOQ_OP_WRITE 1
+
+struct ioq;
+
+struct ioq_request {
+  int op;
+  int fd;
+  void *buf;
+  uint32_t len;
+  off_t offset;
+  uint64_t tag;
+};
+
+struct ioq_completion {
+  uint64_t tag;
+  // bytes transferred, or -errno
+  int64_t result;
+};
+
+/**
+ * Create a queue allowing up to depth requests in flight.
+ *
+ * @param backend  IOQ_BACKEND_AUTO to use io_uring if the kernel supports
+ *                 it, or one of the backends to insist on it.
+ * @return 0 on success, or the errno value. ENOSYS means the requested
+ *         backend is not supported by this kernel or build.
+ */
+int ioq_create(unsigned depth, int backend, struct ioq **out);
+
+/** Return the backend a queue runs on. */
+int ioq_backend(const struct ioq *q);
+
+/** Return the number of requests submitted and not yet reaped. */
+unsigned ioq_inflight(const struct ioq *q);
+
+/**
+ * Submit a batch of requests with a single system call.
+ *
+ * @return the number of requests, from the front of reqs, that were
+ *         queued; fewer than n if the queue is full. Or -errno if none
+ *         could be.
+ */
+int ioq_submit(struct ioq *q, const struct ioq_request *reqs, int n);
+
+/**
+ * Collect up to max completions, waiting until at least min_complete
+ * (capped at the number in flight) are available.
+ *
+ * @return the number of completions, or -errno.
+ */
+int ioq_reap(struct ioq *q, struct ioq_completion *out, int max,
+             int min_complete);
+
+void ioq_free(struct ioq *q);
+
+#endif
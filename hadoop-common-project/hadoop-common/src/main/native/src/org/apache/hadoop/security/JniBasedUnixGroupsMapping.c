@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 #include <jni.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -32,14 +33,78 @@
 
 #include "org_apache_hadoop_security_JniBasedUnixGroupsMapping.h"
 #include "org_apache_hadoop.h"
+#include "id_cache.h"
 
 static jobjectArray emptyGroups = NULL;
 
+/*
+ * Group names seen so far, as global String references. The same few
+ * hundred names come back for nearly every user, so sharing one String
+ * for each saves a NewStringUTF per group per lookup.
+ */
+#define INTERN_BUCKETS 1024
+#define INTERN_MAX_NAMES 8192
+
+struct internedName {
+  struct internedName *next;
+  char *name;
+  jstring jname;
+};
+
+static pthread_mutex_t internLock = PTHREAD_MUTEX_INITIALIZER;
+static struct internedName *internTable[INTERN_BUCKETS];
+static int internCount = 0;
+
+/*
+ * Return a local reference to a String holding name, shared with earlier
+ * callers where possible, or NULL with an exception pending.
+ */
+static jstring internGroupName(JNIEnv *env, const char *name) {
+  unsigned int hash = 2166136261U;
+  const char *c;
+  struct internedName *entry;
+  jstring jname = NULL;
+
+  for (c = name; *c; c++) {
+    hash = (hash ^ (unsigned char)*c) * 16777619U;
+  }
+  hash %= INTERN_BUCKETS;
+
+  pthread_mutex_lock(&internLock);
+  for (entry = internTable[hash]; entry; entry = entry->next) {
+    if (strcmp(entry->name, name) == 0) {
+      jname = (*env)->NewLocalRef(env, entry->jname);
+      pthread_mutex_unlock(&internLock);
+      return jname;
+    }
+  }
+  jname = (*env)->NewStringUTF(env, name);
+  if (jname != NULL && internCount < INTERN_MAX_NAMES) {
+    entry = malloc(sizeof(struct internedName));
+    if (entry != NULL) {
+      entry->name = strdup(name);
+      entry->jname = (*env)->NewGlobalRef(env, jname);
+      if (entry->name != NULL && entry->jname != NULL) {
+        entry->next = internTable[hash];
+        internTable[hash] = entry;
+        internCount++;
+      } else {
+        if (entry->jname != NULL) {
+          (*env)->DeleteGlobalRef(env, entry->jname);
+        }
+        free(entry->name);
+        free(entry);
+      }
+    }
+  }
+  pthread_mutex_unlock(&internLock);
+  return jname;
+}
+
 JNIEXPORT jobjectArray JNICALL 
 Java_org_apache_hadoop_security_JniBasedUnixGroupsMapping_getGroupForUser 
 (JNIEnv *env, jobject jobj, jstring juser) {
   extern int getGroupIDList(const char *user, int *ngroups, gid_t **groups);
-  extern int getGroupDetails(gid_t group, char **grpBuf);
   const char *cuser = NULL;
   jobjectArray jgroups = NULL;
   int error = -1;
@@ -55,7 +120,7 @@ Java_org_apache_hadoop_security_JniBasedUnixGroupsMapping_getGroupForUser
       goto cleanup;
     }
   }
-  char *grpBuf = NULL;
+  char *grpName = NULL;
   cuser = (*env)->GetStringUTFChars(env, juser, NULL);
   if (cuser == NULL) {
     goto cleanup;
@@ -76,21 +141,22 @@ Java_org_apache_hadoop_security_JniBasedUnixGroupsMapping_getGroupForUser
     goto cleanup; 
   }
 
-  /*Iterate over the groupIDs and get the group structure for each*/
+  /*Iterate over the groupIDs and get the name of each, through the cache*/
   int i = 0;
   for (i = 0; i < ngroups; i++) {
-    error = getGroupDetails(groups[i],&grpBuf);
+    error = id_cache_lookup(ID_CACHE_GROUP, groups[i], &grpName);
     if (error != 0) {
       goto cleanup;
     }
-    jstring jgrp = (*env)->NewStringUTF(env, ((struct group*)grpBuf)->gr_name);
+    jstring jgrp = internGroupName(env, grpName);
     if (jgrp == NULL) {
       error = -1;
       goto cleanup;
     }
     (*env)->SetObjectArrayElement(env, jgroups,i,jgrp);
-    free(grpBuf);
-    grpBuf = NULL;
+    (*env)->DeleteLocalRef(env, jgrp);
+    free(grpName);
+    grpName = NULL;
   }
 
 cleanup:
@@ -100,11 +166,8 @@ cleanup:
   if (error == ENOENT) {
     THROW(env, "java/io/IOException", "No entry for user");
   }
-  if (groups != NULL) {
-    free(groups);
-  }
-  if (grpBuf != NULL) {
-    free(grpBuf);
+  if (grpName != NULL) {
+    free(grpName);
   }
   if (cuser != NULL) {
     (*env)->ReleaseStringUTFChars(env, juser, cuser);
@@ -115,3 +178,178 @@ cleanup:
     return emptyGroups;
   }
 }
+
+/*
+ * The groups of each user in a batch, filled in by the worker threads.
+ */
+struct group_batch {
+  char **users;
+  int num_users;
+  // index of the next user to resolve, shared by the workers
+  int next;
+  char ***names;
+  int *counts;
+};
+
+/*
+ * Resolve the group names of one user. On success the caller frees each
+ * name and the array.
+ */
+static int resolve_user_groups(const char *user, char ***names, int *count)
+{
+  extern int getGroupIDList(const char *user, int *ngroups, gid_t **groups);
+  gid_t *groups = NULL;
+  int ngroups = 0, i, error;
+
+  *names = NULL;
+  *count = 0;
+  error = getGroupIDList(user, &ngroups, &groups);
+  if (error != 0) {
+    return error;
+  }
+  *names = calloc(ngroups > 0 ? ngroups : 1, sizeof(char *));
+  if (*names == NULL) {
+    return ENOMEM;
+  }
+  for (i = 0; i < ngroups; i++) {
+    error = id_cache_lookup(ID_CACHE_GROUP, groups[i], &(*names)[i]);
+    if (error != 0) {
+      break;
+    }
+  }
+  if (error != 0) {
+    while (i-- > 0) {
+      free((*names)[i]);
+    }
+    free(*names);
+    *names = NULL;
+    return error;
+  }
+  *count = ngroups;
+  return 0;
+}
+
+static void *group_batch_worker(void *arg)
+{
+  struct group_batch *batch = arg;
+  int i;
+
+  while ((i = __sync_fetch_and_add(&batch->next, 1)) < batch->num_users) {
+    // A user that cannot be resolved gets no groups, as in getGroupForUser
+    if (resolve_user_groups(batch->users[i], &batch->names[i],
+                            &batch->counts[i]) != 0) {
+      batch->names[i] = NULL;
+      batch->counts[i] = 0;
+    }
+  }
+  return NULL;
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_org_apache_hadoop_security_JniBasedUnixGroupsMapping_getGroupsForUsers
+(JNIEnv *env, jobject jobj, jobjectArray jusers, jint threads) {
+  struct group_batch batch;
+  pthread_t *tids = NULL;
+  int nthreads = 0;
+  jobjectArray jresult = NULL;
+  jclass string_class, string_array_class;
+  int i, j;
+
+  memset(&batch, 0, sizeof(batch));
+  string_class = (*env)->FindClass(env, "java/lang/String");
+  PASS_EXCEPTIONS_RET(env, NULL);
+  string_array_class = (*env)->FindClass(env, "[Ljava/lang/String;");
+  PASS_EXCEPTIONS_RET(env, NULL);
+
+  batch.num_users = (*env)->GetArrayLength(env, jusers);
+  batch.users = calloc(batch.num_users + 1, sizeof(char *));
+  batch.names = calloc(batch.num_users + 1, sizeof(char **));
+  batch.counts = calloc(batch.num_users + 1, sizeof(int));
+  if (!batch.users || !batch.names || !batch.counts) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+    goto cleanup;
+  }
+  for (i = 0; i < batch.num_users; i++) {
+    jstring juser = (*env)->GetObjectArrayElement(env, jusers, i);
+    const char *cuser;
+    PASS_EXCEPTIONS_GOTO(env, cleanup);
+    if (juser == NULL) {
+      THROW(env, "java/lang/NullPointerException", "null user");
+      goto cleanup;
+    }
+    cuser = (*env)->GetStringUTFChars(env, juser, NULL);
+    if (cuser == NULL) {
+      goto cleanup;
+    }
+    batch.users[i] = strdup(cuser);
+    (*env)->ReleaseStringUTFChars(env, juser, cuser);
+    (*env)->DeleteLocalRef(env, juser);
+    if (batch.users[i] == NULL) {
+      THROW(env, "java/lang/OutOfMemoryError", NULL);
+      goto cleanup;
+    }
+  }
+
+  // The calling thread works through the batch too, so a failure to
+  // start the extra threads only costs parallelism
+  if (threads > batch.num_users) {
+    threads = batch.num_users;
+  }
+  if (threads > 1) {
+    tids = calloc(threads - 1, sizeof(pthread_t));
+  }
+  if (tids) {
+    for (; nthreads < threads - 1; nthreads++) {
+      if (pthread_create(&tids[nthreads], NULL, group_batch_worker, &batch)) {
+        break;
+      }
+    }
+  }
+  group_batch_worker(&batch);
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+
+  jresult = (*env)->NewObjectArray(env, batch.num_users, string_array_class,
+                                   NULL);
+  if (jresult == NULL) {
+    goto cleanup;
+  }
+  for (i = 0; i < batch.num_users; i++) {
+    jobjectArray jgroups = (*env)->NewObjectArray(env, batch.counts[i],
+                                                  string_class, NULL);
+    if (jgroups == NULL) {
+      jresult = NULL;
+      goto cleanup;
+    }
+    for (j = 0; j < batch.counts[i]; j++) {
+      jstring jgrp = internGroupName(env, batch.names[i][j]);
+      if (jgrp == NULL) {
+        jresult = NULL;
+        goto cleanup;
+      }
+      (*env)->SetObjectArrayElement(env, jgroups, j, jgrp);
+      (*env)->DeleteLocalRef(env, jgrp);
+    }
+    (*env)->SetObjectArrayElement(env, jresult, i, jgroups);
+    (*env)->DeleteLocalRef(env, jgroups);
+  }
+
+cleanup:
+  free(tids);
+  for (i = 0; i < batch.num_users; i++) {
+    if (batch.users) {
+      free(batch.users[i]);
+    }
+    if (batch.names && batch.names[i]) {
+      for (j = 0; j < batch.counts[i]; j++) {
+        free(batch.names[i][j]);
+      }
+      free(batch.names[i]);
+    }
+  }
+  free(batch.users);
+  free(batch.names);
+  free(batch.counts);
+  return jresult;
+}
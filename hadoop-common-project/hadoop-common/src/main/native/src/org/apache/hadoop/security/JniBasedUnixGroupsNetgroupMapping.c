@@ -42,28 +42,16 @@ struct listElement {
 
 typedef struct listElement UserList;
 
-JNIEXPORT jobjectArray JNICALL 
-Java_org_apache_hadoop_security_JniBasedUnixGroupsNetgroupMapping_getUsersForNetgroupJNI
-(JNIEnv *env, jobject jobj, jstring jgroup) {
-  UserList *userListHead = NULL;
+/*
+ * Collect the users of a netgroup into a list, returning how many there are
+ * or -1 if out of memory. The caller serializes calls, since the netgroup
+ * functions share global state.
+ */
+static int getNetgroupUsers(const char *group, UserList **userListHead) {
   UserList *current = NULL;
-  int       userListSize = 0;
-
-  // pointers to free at the end
-  const char *cgroup  = NULL;
-  jobjectArray jusers = NULL;
-
-  // do we need to end the group lookup?
-  int setnetgrentCalledFlag = 0;
-
-  // if not NULL then THROW exception
-  char *errorMessage = NULL;
-
-  cgroup = (*env)->GetStringUTFChars(env, jgroup, NULL);
-  if (cgroup == NULL) {
-    goto END;
-  }
+  int userListSize = 0;
 
+  *userListHead = NULL;
   //--------------------------------------------------
   // get users
   // see man pages for setnetgrent, getnetgrent and endnetgrent
@@ -72,71 +60,143 @@ Java_org_apache_hadoop_security_JniBasedUnixGroupsNetgroupMapping_getUsersForNet
   // note that we want to end group lokup regardless whether setnetgrent
   // was successful or not (as long as it was called we need to call
   // endnetgrent)
-  setnetgrentCalledFlag = 1;
 #ifndef __FreeBSD__
-  if(setnetgrent(cgroup) == 1) {
+  if(setnetgrent(group) == 1) {
+#else
+  setnetgrent(group);
+  {
 #endif
-    current = NULL;
     // three pointers are for host, user, domain, we only care
     // about user now
     char *p[3];
     while(getnetgrent(p, p + 1, p + 2)) {
       if(p[1]) {
         current = (UserList *)malloc(sizeof(UserList));
-        current->string = malloc(strlen(p[1]) + 1);
-        strcpy(current->string, p[1]);
-        current->next = userListHead;
-        userListHead = current;
+        if (current == NULL) {
+          userListSize = -1;
+          break;
+        }
+        current->string = strdup(p[1]);
+        current->next = *userListHead;
+        *userListHead = current;
+        if (current->string == NULL) {
+          userListSize = -1;
+          break;
+        }
         userListSize++;
       }
     }
-#ifndef __FreeBSD__
   }
-#endif
+  endnetgrent();
+  return userListSize;
+}
 
-  //--------------------------------------------------
-  // build return data (java array)
+static void freeUserList(UserList *userListHead) {
+  while(userListHead) {
+    UserList *current = userListHead;
+    userListHead = userListHead->next;
+    if(current->string) { free(current->string); }
+    free(current);
+  }
+}
 
-  jusers = (jobjectArray)(*env)->NewObjectArray(env,
-    userListSize, 
-    (*env)->FindClass(env, "java/lang/String"),
-    NULL);
+/*
+ * Build a String[] from a list of users, or return NULL with an exception
+ * pending.
+ */
+static jobjectArray userListToArray(JNIEnv *env, jclass stringClass,
+    UserList *userListHead, int userListSize) {
+  UserList *current = NULL;
+  jobjectArray jusers = (jobjectArray)(*env)->NewObjectArray(env,
+    userListSize, stringClass, NULL);
   if (jusers == NULL) {
-    errorMessage = "java/lang/OutOfMemoryError";
-    goto END;
+    return NULL;
   }
 
-  current = NULL;
-
   // note that the loop iterates over list but also over array (i)
   int i = 0;
   for(current = userListHead; current != NULL; current = current->next) {
     jstring juser = (*env)->NewStringUTF(env, current->string);
     if (juser == NULL) {
-      errorMessage = "java/lang/OutOfMemoryError";
-      goto END;
+      return NULL;
     }
     (*env)->SetObjectArrayElement(env, jusers, i++, juser);
+    (*env)->DeleteLocalRef(env, juser);
   }
+  return jusers;
+}
 
+JNIEXPORT jobjectArray JNICALL 
+Java_org_apache_hadoop_security_JniBasedUnixGroupsNetgroupMapping_getUsersForNetgroupJNI
+(JNIEnv *env, jobject jobj, jstring jgroup) {
+  UserList *userListHead = NULL;
+  int       userListSize = 0;
+  const char *cgroup  = NULL;
+  jobjectArray jusers = NULL;
 
-END:
-
-  // cleanup
-  if(cgroup) { (*env)->ReleaseStringUTFChars(env, jgroup, cgroup); }
-  if(setnetgrentCalledFlag) { endnetgrent(); }
-  while(userListHead) {
-    UserList *current = userListHead;
-    userListHead = userListHead->next;
-    if(current->string) { free(current->string); }
-    free(current);
+  jclass stringClass = (*env)->FindClass(env, "java/lang/String");
+  PASS_EXCEPTIONS_RET(env, NULL);
+  cgroup = (*env)->GetStringUTFChars(env, jgroup, NULL);
+  if (cgroup == NULL) {
+    return NULL;
+  }
+  userListSize = getNetgroupUsers(cgroup, &userListHead);
+  (*env)->ReleaseStringUTFChars(env, jgroup, cgroup);
+  if (userListSize < 0) {
+    THROW(env, "java/lang/OutOfMemoryError", NULL);
+  } else {
+    jusers = userListToArray(env, stringClass, userListHead, userListSize);
   }
+  freeUserList(userListHead);
+  return jusers;
+}
 
-  // return results or THROW
-  if(errorMessage) {
-    THROW(env, errorMessage, NULL);
+JNIEXPORT jobjectArray JNICALL
+Java_org_apache_hadoop_security_JniBasedUnixGroupsNetgroupMapping_getUsersForNetgroupsJNI
+(JNIEnv *env, jobject jobj, jobjectArray jgroups) {
+  jobjectArray jresult = NULL;
+  jclass stringClass, stringArrayClass;
+  int i, ngroups;
+
+  stringClass = (*env)->FindClass(env, "java/lang/String");
+  PASS_EXCEPTIONS_RET(env, NULL);
+  stringArrayClass = (*env)->FindClass(env, "[Ljava/lang/String;");
+  PASS_EXCEPTIONS_RET(env, NULL);
+
+  ngroups = (*env)->GetArrayLength(env, jgroups);
+  jresult = (*env)->NewObjectArray(env, ngroups, stringArrayClass, NULL);
+  if (jresult == NULL) {
     return NULL;
-  } else {
-    return jusers;
   }
+  for (i = 0; i < ngroups; i++) {
+    UserList *userListHead = NULL;
+    jobjectArray jusers = NULL;
+    jstring jgroup = (*env)->GetObjectArrayElement(env, jgroups, i);
+    const char *cgroup;
+
+    PASS_EXCEPTIONS_RET(env, NULL);
+    if (jgroup == NULL) {
+      THROW(env, "java/lang/NullPointerException", "null netgroup");
+      return NULL;
+    }
+    cgroup = (*env)->GetStringUTFChars(env, jgroup, NULL);
+    if (cgroup == NULL) {
+      return NULL;
+    }
+    int userListSize = getNetgroupUsers(cgroup, &userListHead);
+    (*env)->ReleaseStringUTFChars(env, jgroup, cgroup);
+    (*env)->DeleteLocalRef(env, jgroup);
+    if (userListSize < 0) {
+      THROW(env, "java/lang/OutOfMemoryError", NULL);
+    } else {
+      jusers = userListToArray(env, stringClass, userListHead, userListSize);
+    }
+    freeUserList(userListHead);
+    if (jusers == NULL) {
+      return NULL;
+    }
+    (*env)->SetObjectArrayElement(env, jresult, i, jusers);
+    (*env)->DeleteLocalRef(env, jusers);
+  }
+  return jresult;
 }
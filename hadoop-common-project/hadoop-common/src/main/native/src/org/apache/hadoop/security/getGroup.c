@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 #include <grp.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <pwd.h>
@@ -26,46 +27,107 @@
 /*Helper functions for the JNI implementation of unix group mapping service*/
 
 
+/*Scratch space for getGroupIDList, kept per thread and reused across calls*/
+struct groupScratch {
+  char *pwBuf;
+  long pwBufSize;
+  gid_t *groups;
+  int groupsSize;
+};
+
+static pthread_key_t scratchKey;
+static pthread_once_t scratchKeyOnce = PTHREAD_ONCE_INIT;
+
+static void freeScratch(void *p) {
+  struct groupScratch *scratch = p;
+  free(scratch->pwBuf);
+  free(scratch->groups);
+  free(scratch);
+}
+
+static void createScratchKey(void) {
+  pthread_key_create(&scratchKey, freeScratch);
+}
+
+static struct groupScratch *getScratch(void) {
+  struct groupScratch *scratch;
+  pthread_once(&scratchKeyOnce, createScratchKey);
+  scratch = pthread_getspecific(scratchKey);
+  if (scratch == NULL) {
+    scratch = calloc(1, sizeof(struct groupScratch));
+    if (scratch != NULL && pthread_setspecific(scratchKey, scratch) != 0) {
+      free(scratch);
+      scratch = NULL;
+    }
+  }
+  return scratch;
+}
+
 /**
- * Gets the group IDs for a given user. The groups argument is allocated
- * internally, and it contains the list of groups. The ngroups is updated to 
- * the number of groups
- * Returns 0 on success (on success, the caller must free the memory allocated
- * internally)
+ * Gets the group IDs for a given user. The groups argument is set to a
+ * buffer owned by the calling thread, which stays valid until the thread's
+ * next call and must not be freed. The ngroups is updated to the number of
+ * groups.
+ * Returns 0 on success
  */
 int getGroupIDList(const char *user, int *ngroups, gid_t **groups) {
-  int getPW(const char *user, char **pwbuf);
+  struct groupScratch *scratch = getScratch();
+  struct passwd pwd, *pw = NULL;
+  int error;
   *ngroups = 0;
-  char *pwbuf = NULL;
   *groups = NULL;
+  if (!scratch) {
+    return ENOMEM;
+  }
+  if (!scratch->pwBuf) {
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (size < 1024) {
+      size = 1024;
+    }
+    if (!(scratch->pwBuf = malloc(size))) {
+      return ENOMEM;
+    }
+    scratch->pwBufSize = size;
+  }
   /*Look up the password database first*/
-  int error = getPW(user, &pwbuf);
-  if (error != 0) {
-    if (pwbuf != NULL) {
-      free(pwbuf);
+  for (;;) {
+    error = getpwnam_r(user, &pwd, scratch->pwBuf, scratch->pwBufSize, &pw);
+    if (error != ERANGE) {
+      break;
+    }
+    char *bigger = realloc(scratch->pwBuf, scratch->pwBufSize * 2);
+    if (!bigger) {
+      return ENOMEM;
     }
+    scratch->pwBuf = bigger;
+    scratch->pwBufSize *= 2;
+  }
+  if (!pw && !error) {
+    return ENOENT;
+  } else if (error) {
     return error;
-  } 
-  struct passwd *pw = (struct passwd*)pwbuf;
-  int ng = 0;
-  /*Get the groupIDs that this user belongs to*/
-  if (getgrouplist(user, pw->pw_gid, NULL, &ng) < 0) {
-    *ngroups = ng;
-    *groups = (gid_t *) malloc(ng * sizeof (gid_t));
-    if (!*groups) {
-      *ngroups = 0;
-      free(pwbuf);
+  }
+  if (!scratch->groups) {
+    if (!(scratch->groups = malloc(64 * sizeof(gid_t)))) {
       return ENOMEM;
     }
-    if (getgrouplist(user, pw->pw_gid, *groups, &ng) < 0) {
-      *ngroups = 0;
-      free(pwbuf);
-      free(*groups);
-      *groups = NULL;
-      return ENOENT;
+    scratch->groupsSize = 64;
+  }
+  /*Get the groupIDs that this user belongs to, growing the buffer if the
+    user has more groups than have been seen on this thread so far*/
+  int ng = scratch->groupsSize;
+  while (getgrouplist(user, pw->pw_gid, scratch->groups, &ng) < 0) {
+    int want = ng > scratch->groupsSize ? ng : scratch->groupsSize * 2;
+    gid_t *bigger = realloc(scratch->groups, want * sizeof(gid_t));
+    if (!bigger) {
+      return ENOMEM;
     }
+    scratch->groups = bigger;
+    scratch->groupsSize = want;
+    ng = want;
   }
-  free(pwbuf);
+  *ngroups = ng;
+  *groups = scratch->groups;
   return 0;
 }
 
@@ -114,51 +176,6 @@ int getGroupDetails(gid_t group, char **grpBuf) {
   return 0;
 }
 
-/**
- * Gets the password database entry for a given user. 
- * The pwbuf argument is allocated internally and it contains the 
- * broken out fields for the password database entry
- * Returns 0 on success (on success, the caller must free the memory allocated 
- * internally).
- */
-int getPW(const char *user, char **pwbuf) {
-  struct passwd *pwbufp = NULL;
-  long currBufferSize = sysconf(_SC_GETPW_R_SIZE_MAX);
-  if (currBufferSize < 1024) {
-    currBufferSize = 1024;
-  }
-  *pwbuf = NULL;
-  char *buf = (char*)malloc(sizeof(char) * currBufferSize);
-  
-  if (!buf) {
-    return ENOMEM;
-  } 
-  int error;
-  
-  for (;;) {
-    error = getpwnam_r(user, (struct passwd*)buf, buf + sizeof(struct passwd),
-                       currBufferSize - sizeof(struct passwd), &pwbufp);
-    if (error != ERANGE) {
-      break;
-    }
-    free(buf);
-    currBufferSize *= 2;
-    buf = (char*)malloc(sizeof(char) * currBufferSize);
-    if (!buf) {
-      return ENOMEM;
-    }
-  } 
-  if (!pwbufp && !error) {
-    free(buf);
-    return ENOENT;
-  } else  if (error) {
-    free(buf);
-    return error;
-  }
-  *pwbuf = buf;
-  return 0;
-} 
-
 #undef TESTING
 
 #ifdef TESTING
@@ -183,7 +200,6 @@ int main(int argc, char **argv) {
     printf("grps[%d]: %s ",i, ((struct group*)grpbuf)->gr_name);
     free(grpbuf);
   }
-  free(groups);
   return 0;
 }
 #endif
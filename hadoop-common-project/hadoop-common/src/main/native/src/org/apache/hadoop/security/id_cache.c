@@ -0,0 +1,225 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "id_cache.h"
+
+#include <errno.h>
+#include <grp.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ID_CACHE_BUCKETS 1024
+// Beyond this many entries, expired ones are purged, then all if need be
+#define ID_CACHE_MAX_ENTRIES 8192
+
+struct id_entry {
+  struct id_entry *next;
+  int kind;
+  id_t id;
+  // NULL for a cached ENOENT
+  char *name;
+  int64_t expires_ms;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct id_entry *buckets[ID_CACHE_BUCKETS];
+static int num_entries;
+static long positive_ttl_ms = 4 * 60 * 60 * 1000L;
+static long negative_ttl_ms = 60 * 1000L;
+
+static int64_t now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned bucket_of(int kind, id_t id)
+{
+  uint32_t h = (uint32_t)id * 2654435761U;
+  return (h ^ (unsigned)kind) % ID_CACHE_BUCKETS;
+}
+
+static void entry_free(struct id_entry *e)
+{
+  free(e->name);
+  free(e);
+}
+
+/*
+ * Remove entries that have expired, or every entry if all is set.
+ * Called with cache_lock held.
+ */
+static void purge_locked(int all)
+{
+  int64_t now = now_ms();
+  int i;
+
+  for (i = 0; i < ID_CACHE_BUCKETS; i++) {
+    struct id_entry **pp = &buckets[i];
+    while (*pp) {
+      struct id_entry *e = *pp;
+      if (all || e->expires_ms <= now) {
+        *pp = e->next;
+        entry_free(e);
+        num_entries--;
+      } else {
+        pp = &e->next;
+      }
+    }
+  }
+}
+
+/*
+ * Look up a name in the system databases. The buffers are sized the same
+ * way as getGroup.c does it.
+ */
+static int resolve(int kind, id_t id, char **name)
+{
+  long buflen = sysconf(kind == ID_CACHE_USER ? _SC_GETPW_R_SIZE_MAX :
+                                                _SC_GETGR_R_SIZE_MAX);
+  char *buf = NULL;
+  const char *found;
+  int rc;
+
+  if (buflen < 1024) {
+    buflen = 1024;
+  }
+  for (;;) {
+    struct passwd pwd, *pwdp = NULL;
+    struct group grp, *grpp = NULL;
+
+    if (!(buf = malloc(buflen))) {
+      return ENOMEM;
+    }
+    if (kind == ID_CACHE_USER) {
+      rc = getpwuid_r((uid_t)id, &pwd, buf, buflen, &pwdp);
+      found = pwdp ? pwdp->pw_name : NULL;
+    } else {
+      rc = getgrgid_r((gid_t)id, &grp, buf, buflen, &grpp);
+      found = grpp ? grpp->gr_name : NULL;
+    }
+    if (rc != ERANGE) {
+      break;
+    }
+    free(buf);
+    buflen *= 2;
+  }
+  if (rc == 0 && !found) {
+    rc = ENOENT;
+  }
+  if (rc == 0 && !(*name = strdup(found))) {
+    rc = ENOMEM;
+  }
+  free(buf);
+  return rc;
+}
+
+int id_cache_lookup(int kind, id_t id, char **name)
+{
+  unsigned b = bucket_of(kind, id);
+  struct id_entry *e;
+  char *resolved = NULL;
+  long ttl;
+  int rc;
+
+  pthread_mutex_lock(&cache_lock);
+  for (e = buckets[b]; e; e = e->next) {
+    if (e->kind == kind && e->id == id) {
+      break;
+    }
+  }
+  if (e && e->expires_ms > now_ms()) {
+    rc = ENOENT;
+    if (e->name) {
+      rc = (*name = strdup(e->name)) ? 0 : ENOMEM;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return rc;
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  // Resolve without the lock, so that a slow directory service does not
+  // hold up hits on other ids
+  rc = resolve(kind, id, &resolved);
+  if (rc != 0 && rc != ENOENT) {
+    return rc;
+  }
+
+  pthread_mutex_lock(&cache_lock);
+  ttl = rc == 0 ? positive_ttl_ms : negative_ttl_ms;
+  if (ttl > 0) {
+    for (e = buckets[b]; e; e = e->next) {
+      if (e->kind == kind && e->id == id) {
+        break;
+      }
+    }
+    if (!e) {
+      if (num_entries >= ID_CACHE_MAX_ENTRIES) {
+        purge_locked(0);
+        if (num_entries >= ID_CACHE_MAX_ENTRIES) {
+          purge_locked(1);
+        }
+      }
+      e = calloc(1, sizeof(struct id_entry));
+      if (e) {
+        e->kind = kind;
+        e->id = id;
+        e->next = buckets[b];
+        buckets[b] = e;
+        num_entries++;
+      }
+    }
+    if (e) {
+      free(e->name);
+      e->name = resolved ? strdup(resolved) : NULL;
+      e->expires_ms = now_ms() + ttl;
+      if (resolved && !e->name) {
+        // Out of memory copying the name: expire the entry at once rather
+        // than let it read as a missing id
+        e->expires_ms = 0;
+      }
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  if (rc == 0) {
+    *name = resolved;
+  }
+  return rc;
+}
+
+void id_cache_set_ttl(long positive_ms, long negative_ms)
+{
+  pthread_mutex_lock(&cache_lock);
+  positive_ttl_ms = positive_ms;
+  negative_ttl_ms = negative_ms;
+  purge_locked(1);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void id_cache_clear(void)
+{
+  pthread_mutex_lock(&cache_lock);
+  purge_locked(1);
+  pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,47 @@
+/*
+ *  Licensed to the Apache Software Foundation (ASF) under one or more
+ *  contributor license agreements.  See the NOTICE file distributed with
+ *  this work for additional information regarding copyright ownership.
+ *  The ASF licenses this file to You under the Apache License, Version 2.0
+ *  (the "License"); you may not use this file except in compliance with
+ *  the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef ID_CACHE_H
+#define ID_CACHE_H
+
+#include <sys/types.h>
+
+#define ID_CACHE_USER 0
+#define ID_CACHE_GROUP 1
+
+/**
+ * Resolve a uid or gid to its name, going through a process-wide cache so
+ * that stat-heavy callers do not hit NSS (and perhaps LDAP) each time.
+ * Failed lookups are cached too, for a shorter time.
+ *
+ * @param kind   ID_CACHE_USER or ID_CACHE_GROUP
+ * @param name   on success, a copy of the name the caller must free
+ * @return 0 on success, ENOENT if there is no such id, or another errno
+ *         from the lookup. Only ENOENT results are cached negatively.
+ */
+int id_cache_lookup(int kind, id_t id, char **name);
+
+/**
+ * Set how long, in milliseconds, names and missing ids stay cached. A TTL
+ * of 0 disables caching of that kind of result.
+ */
+void id_cache_set_ttl(long positive_ms, long negative_ms);
+
+/** Drop every cached entry. */
+void id_cache_clear(void);
+
+#endif
@@ -29,3 +29,23 @@ JNIEXPORT jboolean JNICALL Java_org_apache_hadoop_util_NativeCodeLoader_buildSup
   return JNI_FALSE;
 #endif
 }
+
+JNIEXPORT jboolean JNICALL Java_org_apache_hadoop_util_NativeCodeLoader_buildSupportsZstd
+  (JNIEnv *env, jclass clazz)
+{
+#ifdef HADOOP_ZSTD_LIBRARY
+  return JNI_TRUE;
+#else
+  return JNI_FALSE;
+#endif
+}
+
+JNIEXPORT jboolean JNICALL Java_org_apache_hadoop_util_NativeCodeLoader_buildSupportsBzip2
+  (JNIEnv *env, jclass clazz)
+{
+#ifdef HADOOP_BZIP2_LIBRARY
+  return JNI_TRUE;
+#else
+  return JNI_FALSE;
+#endif
+}
@@ -18,10 +18,13 @@
 
 #include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "config.h"
@@ -29,6 +32,10 @@
 #include "org_apache_hadoop_util_NativeCrc32.h"
 #include "gcc_optimizations.h"
 #include "bulk_crc32.h"
+#include "org/apache/hadoop/io/nativeio/file_descriptor.h"
+
+// How much block file data to map at a time in nativeVerifyChunkedSumsInFile
+#define VERIFY_FILE_WINDOW (8 * 1024 * 1024)
 
 static void throw_checksum_exception(JNIEnv *env,
     uint32_t got_crc, uint32_t expected_crc,
@@ -89,6 +96,8 @@ static int convert_java_crc_type(JNIEnv *env, jint crc_type) {
       return CRC32_ZLIB_POLYNOMIAL;
     case org_apache_hadoop_util_NativeCrc32_CHECKSUM_CRC32C:
       return CRC32C_POLYNOMIAL;
+    case org_apache_hadoop_util_NativeCrc32_CHECKSUM_XXHASH64:
+      return XXHASH64_CHECKSUM;
     default:
       THROW(env, "java/lang/IllegalArgumentException",
         "Invalid checksum type");
@@ -153,6 +162,474 @@ JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeVerifyChunk
   }
 }
 
+JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeVerifyChunkedSumsBatch
+  (JNIEnv *env, jclass clazz,
+    jint bytes_per_checksum, jint j_crc_type,
+    jobjectArray j_sums, jintArray j_sums_offsets,
+    jobjectArray j_data, jintArray j_data_offsets, jintArray j_data_lens,
+    jstring j_filename, jlongArray j_base_positions)
+{
+  jint *offsets = NULL;
+  jlong *base_positions = NULL;
+  jobject sums_buf = NULL, data_buf = NULL;
+  jsize i, count;
+
+  if (unlikely(!j_sums || !j_sums_offsets || !j_data || !j_data_offsets ||
+      !j_data_lens || !j_base_positions)) {
+    THROW(env, "java/lang/NullPointerException",
+      "input arrays must not be null");
+    return;
+  }
+  count = (*env)->GetArrayLength(env, j_data);
+  if (unlikely((*env)->GetArrayLength(env, j_sums) != count ||
+      (*env)->GetArrayLength(env, j_sums_offsets) != count ||
+      (*env)->GetArrayLength(env, j_data_offsets) != count ||
+      (*env)->GetArrayLength(env, j_data_lens) != count ||
+      (*env)->GetArrayLength(env, j_base_positions) != count)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "input arrays must all have the same length");
+    return;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "invalid bytes_per_checksum");
+    return;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  // Convert to correct internal C constant for CRC type
+  int crc_type = convert_java_crc_type(env, j_crc_type);
+  if (crc_type == -1) return; // exception already thrown
+
+  // Copy out all of the offsets and lengths with one call per array.
+  offsets = malloc(sizeof(jint) * 3 * count);
+  base_positions = malloc(sizeof(jlong) * count);
+  if (unlikely(!offsets || !base_positions)) {
+    THROW(env, "java/lang/OutOfMemoryError",
+      "failed to allocate batch offsets");
+    goto cleanup;
+  }
+  jint *sums_offsets = offsets;
+  jint *data_offsets = offsets + count;
+  jint *data_lens = offsets + 2 * count;
+  (*env)->GetIntArrayRegion(env, j_sums_offsets, 0, count, sums_offsets);
+  (*env)->GetIntArrayRegion(env, j_data_offsets, 0, count, data_offsets);
+  (*env)->GetIntArrayRegion(env, j_data_lens, 0, count, data_lens);
+  (*env)->GetLongArrayRegion(env, j_base_positions, 0, count, base_positions);
+  PASS_EXCEPTIONS_GOTO(env, cleanup);
+
+  for (i = 0; i < count; i++) {
+    sums_buf = (*env)->GetObjectArrayElement(env, j_sums, i);
+    data_buf = (*env)->GetObjectArrayElement(env, j_data, i);
+    if (unlikely(!sums_buf || !data_buf)) {
+      THROW(env, "java/lang/NullPointerException",
+        "input ByteBuffers must not be null");
+      goto cleanup;
+    }
+
+    uint8_t *sums_addr = (*env)->GetDirectBufferAddress(env, sums_buf);
+    uint8_t *data_addr = (*env)->GetDirectBufferAddress(env, data_buf);
+    if (unlikely(!sums_addr || !data_addr)) {
+      THROW(env, "java/lang/IllegalArgumentException",
+        "input ByteBuffers must be direct buffers");
+      goto cleanup;
+    }
+    if (unlikely(sums_offsets[i] < 0 || data_offsets[i] < 0 ||
+        data_lens[i] < 0)) {
+      THROW(env, "java/lang/IllegalArgumentException",
+        "bad offsets or lengths");
+      goto cleanup;
+    }
+
+    uint32_t *sums = (uint32_t *)(sums_addr + sums_offsets[i]);
+    uint8_t *data = data_addr + data_offsets[i];
+    crc32_error_t error_data;
+    int ret = bulk_verify_crc(data, data_lens[i], sums, crc_type,
+                              bytes_per_checksum, &error_data);
+    if (unlikely(ret == INVALID_CHECKSUM_DETECTED)) {
+      long pos = base_positions[i] + (error_data.bad_data - data);
+      throw_checksum_exception(
+        env, error_data.got_crc, error_data.expected_crc,
+        j_filename, pos);
+      goto cleanup;
+    } else if (unlikely(ret != CHECKSUMS_VALID)) {
+      THROW(env, "java/lang/AssertionError",
+        "Bad response code from native bulk_verify_crc");
+      goto cleanup;
+    }
+    (*env)->DeleteLocalRef(env, sums_buf);
+    (*env)->DeleteLocalRef(env, data_buf);
+    sums_buf = data_buf = NULL;
+  }
+
+cleanup:
+  if (sums_buf) (*env)->DeleteLocalRef(env, sums_buf);
+  if (data_buf) (*env)->DeleteLocalRef(env, data_buf);
+  free(offsets);
+  free(base_positions);
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeComputeChunkedSums
+  (JNIEnv *env, jclass clazz,
+    jint bytes_per_checksum, jint j_crc_type,
+    jobject j_sums, jint sums_offset,
+    jobject j_data, jint data_offset, jint data_len)
+{
+  if (unlikely(!j_sums || !j_data)) {
+    THROW(env, "java/lang/NullPointerException",
+      "input ByteBuffers must not be null");
+    return;
+  }
+
+  // Convert direct byte buffers to C pointers
+  uint8_t *sums_addr = (*env)->GetDirectBufferAddress(env, j_sums);
+  uint8_t *data_addr = (*env)->GetDirectBufferAddress(env, j_data);
+
+  if (unlikely(!sums_addr || !data_addr)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "input ByteBuffers must be direct buffers");
+    return;
+  }
+  if (unlikely(sums_offset < 0 || data_offset < 0 || data_len < 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "bad offsets or lengths");
+    return;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "invalid bytes_per_checksum");
+    return;
+  }
+
+  uint32_t *sums = (uint32_t *)(sums_addr + sums_offset);
+  uint8_t *data = data_addr + data_offset;
+
+  // Convert to correct internal C constant for CRC type
+  int crc_type = convert_java_crc_type(env, j_crc_type);
+  if (crc_type == -1) return; // exception already thrown
+
+  // Setup complete. Actually compute checksums.
+  int ret = bulk_calculate_crc(data, data_len, sums, crc_type,
+                               bytes_per_checksum);
+  if (unlikely(ret != 0)) {
+    THROW(env, "java/lang/AssertionError",
+      "Bad response code from native bulk_calculate_crc");
+  }
+}
+
+/**
+ * Look up the address of a direct buffer to copy into, checking that it can
+ * hold len bytes starting at offset. Throws and returns NULL on failure.
+ */
+static uint8_t *get_copy_destination(JNIEnv *env, jobject j_dst,
+    jint dst_offset, jint len)
+{
+  uint8_t *dst_addr;
+
+  if (unlikely(!j_dst)) {
+    THROW(env, "java/lang/NullPointerException",
+      "destination ByteBuffer must not be null");
+    return NULL;
+  }
+  dst_addr = (*env)->GetDirectBufferAddress(env, j_dst);
+  if (unlikely(!dst_addr)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "destination ByteBuffer must be a direct buffer");
+    return NULL;
+  }
+  if (unlikely(dst_offset < 0 || len < 0 ||
+      (*env)->GetDirectBufferCapacity(env, j_dst) < (jlong)dst_offset + len)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "destination ByteBuffer is too small");
+    return NULL;
+  }
+  return dst_addr + dst_offset;
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeCopyAndVerifyChunkedSums
+  (JNIEnv *env, jclass clazz,
+    jint bytes_per_checksum, jint j_crc_type,
+    jobject j_sums, jint sums_offset,
+    jobject j_data, jint data_offset, jint data_len,
+    jobject j_dst, jint dst_offset,
+    jstring j_filename, jlong base_pos)
+{
+  if (unlikely(!j_sums || !j_data)) {
+    THROW(env, "java/lang/NullPointerException",
+      "input ByteBuffers must not be null");
+    return;
+  }
+
+  // Convert direct byte buffers to C pointers
+  uint8_t *sums_addr = (*env)->GetDirectBufferAddress(env, j_sums);
+  uint8_t *data_addr = (*env)->GetDirectBufferAddress(env, j_data);
+
+  if (unlikely(!sums_addr || !data_addr)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "input ByteBuffers must be direct buffers");
+    return;
+  }
+  if (unlikely(sums_offset < 0 || data_offset < 0 || data_len < 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "bad offsets or lengths");
+    return;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "invalid bytes_per_checksum");
+    return;
+  }
+  uint8_t *dst = get_copy_destination(env, j_dst, dst_offset, data_len);
+  if (dst == NULL) return; // exception already thrown
+
+  uint32_t *sums = (uint32_t *)(sums_addr + sums_offset);
+  uint8_t *data = data_addr + data_offset;
+
+  // Convert to correct internal C constant for CRC type
+  int crc_type = convert_java_crc_type(env, j_crc_type);
+  if (crc_type == -1) return; // exception already thrown
+
+  // Setup complete. Copy the data, verifying the checksums as we go.
+  crc32_error_t error_data;
+  int ret = bulk_copy_and_verify_crc(data, dst, data_len, sums, crc_type,
+                                     bytes_per_checksum, &error_data);
+  if (likely(ret == CHECKSUMS_VALID)) {
+    return;
+  } else if (unlikely(ret == INVALID_CHECKSUM_DETECTED)) {
+    long pos = base_pos + (error_data.bad_data - data);
+    throw_checksum_exception(
+      env, error_data.got_crc, error_data.expected_crc,
+      j_filename, pos);
+  } else {
+    THROW(env, "java/lang/AssertionError",
+      "Bad response code from native bulk_copy_and_verify_crc");
+  }
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeCopyAndComputeChunkedSums
+  (JNIEnv *env, jclass clazz,
+    jint bytes_per_checksum, jint j_crc_type,
+    jobject j_sums, jint sums_offset,
+    jobject j_data, jint data_offset, jint data_len,
+    jobject j_dst, jint dst_offset)
+{
+  if (unlikely(!j_sums || !j_data)) {
+    THROW(env, "java/lang/NullPointerException",
+      "input ByteBuffers must not be null");
+    return;
+  }
+
+  // Convert direct byte buffers to C pointers
+  uint8_t *sums_addr = (*env)->GetDirectBufferAddress(env, j_sums);
+  uint8_t *data_addr = (*env)->GetDirectBufferAddress(env, j_data);
+
+  if (unlikely(!sums_addr || !data_addr)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "input ByteBuffers must be direct buffers");
+    return;
+  }
+  if (unlikely(sums_offset < 0 || data_offset < 0 || data_len < 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "bad offsets or lengths");
+    return;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "invalid bytes_per_checksum");
+    return;
+  }
+  uint8_t *dst = get_copy_destination(env, j_dst, dst_offset, data_len);
+  if (dst == NULL) return; // exception already thrown
+
+  uint32_t *sums = (uint32_t *)(sums_addr + sums_offset);
+  uint8_t *data = data_addr + data_offset;
+
+  // Convert to correct internal C constant for CRC type
+  int crc_type = convert_java_crc_type(env, j_crc_type);
+  if (crc_type == -1) return; // exception already thrown
+
+  // Setup complete. Copy the data, computing the checksums as we go.
+  int ret = bulk_copy_and_calculate_crc(data, dst, data_len, sums, crc_type,
+                                        bytes_per_checksum);
+  if (unlikely(ret != 0)) {
+    THROW(env, "java/lang/AssertionError",
+      "Bad response code from native bulk_copy_and_calculate_crc");
+  }
+}
+
+/**
+ * A read-only mapping of part of a file, page-aligned as mmap requires.
+ */
+typedef struct file_window {
+  void *map_addr;
+  size_t map_len;
+  const uint8_t *data; // the first requested byte inside the mapping
+} file_window_t;
+
+static int map_file_window(int fd, off_t offset, size_t len,
+                           file_window_t *window)
+{
+  static long page_size;
+  off_t map_offset;
+  int flags = MAP_SHARED;
+
+  if (!page_size) {
+    page_size = sysconf(_SC_PAGESIZE);
+  }
+  map_offset = offset - (offset % page_size);
+  window->map_len = len + (offset - map_offset);
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  window->map_addr = mmap(NULL, window->map_len, PROT_READ, flags,
+                          fd, map_offset);
+  if (window->map_addr == MAP_FAILED) {
+    return errno;
+  }
+  madvise(window->map_addr, window->map_len, MADV_SEQUENTIAL);
+  window->data = (const uint8_t *)window->map_addr + (offset - map_offset);
+  return 0;
+}
+
+static void unmap_file_window(file_window_t *window)
+{
+  munmap(window->map_addr, window->map_len);
+}
+
+static void throw_file_exception(JNIEnv *env, jstring j_filename, int err)
+{
+  char message[1024];
+  const char *filename = NULL;
+
+  if (j_filename != NULL) {
+    filename = (*env)->GetStringUTFChars(env, j_filename, NULL);
+    if (filename == NULL) {
+      return; // OOME already thrown
+    }
+  }
+  snprintf(message, sizeof(message), "failed to map %s: %s",
+    filename ? filename : "null", strerror(err));
+  if (filename != NULL) {
+    (*env)->ReleaseStringUTFChars(env, j_filename, filename);
+  }
+  THROW(env, "java/io/IOException", message);
+}
+
+JNIEXPORT jlong JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeVerifyChunkedSumsInFile
+  (JNIEnv *env, jclass clazz,
+    jint bytes_per_checksum, jint j_crc_type,
+    jobject j_data_fd, jlong data_offset, jlong data_len,
+    jobject j_meta_fd, jlong sums_offset,
+    jstring j_filename)
+{
+  file_window_t data_window, sums_window;
+  size_t window_len, len;
+  int data_fd, meta_fd, ret;
+
+  fd_init(env);
+  PASS_EXCEPTIONS_RET(env, -1);
+  data_fd = fd_get(env, j_data_fd);
+  PASS_EXCEPTIONS_RET(env, -1);
+  meta_fd = fd_get(env, j_meta_fd);
+  PASS_EXCEPTIONS_RET(env, -1);
+
+  if (unlikely(data_offset < 0 || data_len < 0 || sums_offset < 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "bad offsets or lengths");
+    return -1;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "invalid bytes_per_checksum");
+    return -1;
+  }
+
+  // Convert to correct internal C constant for CRC type
+  int crc_type = convert_java_crc_type(env, j_crc_type);
+  if (crc_type == -1) return -1; // exception already thrown
+
+  // Touching a mapping past the end of the file raises SIGBUS, so check
+  // the requested ranges up front.
+  struct stat data_stat, meta_stat;
+  if (fstat(data_fd, &data_stat) || fstat(meta_fd, &meta_stat)) {
+    throw_file_exception(env, j_filename, errno);
+    return -1;
+  }
+  if (unlikely(data_offset + data_len > data_stat.st_size ||
+      sums_offset + ((data_len + bytes_per_checksum - 1) / bytes_per_checksum) *
+        (jlong)sizeof(uint32_t) > meta_stat.st_size)) {
+    THROW(env, "java/io/EOFException",
+      "range to verify extends past the end of the block or meta file");
+    return -1;
+  }
+
+  // Map and verify a window at a time, so that we don't need address space
+  // for the whole block at once. Windows are a whole number of chunks.
+  window_len = VERIFY_FILE_WINDOW - (VERIFY_FILE_WINDOW % bytes_per_checksum);
+  if (window_len == 0) {
+    window_len = bytes_per_checksum;
+  }
+  while (data_len > 0) {
+    len = data_len < window_len ? data_len : window_len;
+    ret = map_file_window(data_fd, data_offset, len, &data_window);
+    if (ret) {
+      throw_file_exception(env, j_filename, ret);
+      return -1;
+    }
+    ret = map_file_window(meta_fd, sums_offset,
+        ((len + bytes_per_checksum - 1) / bytes_per_checksum) *
+          sizeof(uint32_t), &sums_window);
+    if (ret) {
+      unmap_file_window(&data_window);
+      throw_file_exception(env, j_filename, ret);
+      return -1;
+    }
+
+    crc32_error_t error_data;
+    ret = bulk_verify_crc(data_window.data, len,
+        (const uint32_t *)sums_window.data, crc_type, bytes_per_checksum,
+        &error_data);
+    unmap_file_window(&sums_window);
+    unmap_file_window(&data_window);
+    if (unlikely(ret == INVALID_CHECKSUM_DETECTED)) {
+      return data_offset + (error_data.bad_data - data_window.data);
+    } else if (unlikely(ret != CHECKSUMS_VALID)) {
+      THROW(env, "java/lang/AssertionError",
+        "Bad response code from native bulk_verify_crc");
+      return -1;
+    }
+    data_offset += len;
+    data_len -= len;
+    sums_offset += (len / bytes_per_checksum) * sizeof(uint32_t);
+  }
+  return -1;
+}
+
+JNIEXPORT void JNICALL Java_org_apache_hadoop_util_NativeCrc32_nativeSetVerifyParallelism
+  (JNIEnv *env, jclass clazz, jint num_threads, jint min_len)
+{
+  char message[128];
+  int ret;
+
+  if (unlikely(num_threads < 0 || min_len < 0)) {
+    THROW(env, "java/lang/IllegalArgumentException",
+      "bad number of threads or length");
+    return;
+  }
+  ret = bulk_crc_set_parallelism(num_threads, min_len);
+  if (ret == EINVAL) {
+    snprintf(message, sizeof(message),
+      "number of threads must be at most %d", BULK_CRC_MAX_VERIFY_THREADS);
+    THROW(env, "java/lang/IllegalArgumentException", message);
+  } else if (ret) {
+    snprintf(message, sizeof(message),
+      "failed to start checksum threads: error %d", ret);
+    THROW(env, "java/lang/InternalError", message);
+  }
+}
+
 /**
  * vim: sw=2: ts=2: et:
  */
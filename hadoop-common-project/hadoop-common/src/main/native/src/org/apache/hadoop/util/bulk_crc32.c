@@ -24,7 +24,10 @@
 #include <assert.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "crc32_zlib_polynomial_tables.h"
@@ -36,8 +39,15 @@
 #define USE_PIPELINED
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__FreeBSD__)
+#define USE_CRC32C_WIDE
+#endif
+
 #define CRC_INITIAL_VAL 0xffffffff
 
+// Smallest chunk for which BULK_CRC_IMPL_AUTO picks the wide CRC32C kernel
+#define CRC32C_WIDE_MIN_CHUNK (64 * 1024)
+
 typedef uint32_t (*crc_update_func_t)(uint32_t, const uint8_t *, size_t);
 static inline uint32_t crc_val(uint32_t crc);
 static uint32_t crc32_zlib_sb8(uint32_t crc, const uint8_t *buf, size_t length);
@@ -47,25 +57,162 @@ static uint32_t crc32c_sb8(uint32_t crc, const uint8_t *buf, size_t length);
 static void pipelined_crc32c(uint32_t *crc1, uint32_t *crc2, uint32_t *crc3, const uint8_t *p_buf, size_t block_size, int num_blocks);
 #endif
 static int cached_cpu_supports_crc32; // initialized by constructor below
+static int cached_cpu_supports_crc32_zlib; // initialized by constructor below
 static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* data, size_t length);
+static uint32_t crc32_zlib_hardware(uint32_t crc, const uint8_t* data, size_t length);
+#ifdef USE_CRC32C_WIDE
+static int cached_cpu_supports_crc32c_wide; // initialized by constructor below
+static uint32_t crc32c_wide(uint32_t crc, const uint8_t* data, size_t length);
+#endif
+static int verify_crc_serial(const uint8_t *data, size_t data_len,
+    const uint32_t *sums, int checksum_type, int bytes_per_checksum,
+    crc32_error_t *error_info);
+static uint32_t xxhash64_sum(const uint8_t *data, size_t length);
+static int verify_crc_parallel(const uint8_t *data, size_t data_len,
+    const uint32_t *sums, int checksum_type, int bytes_per_checksum,
+    crc32_error_t *error_info);
 
-int bulk_calculate_crc(const uint8_t *data, size_t data_len,
-                    uint32_t *sums, int checksum_type,
-                    int bytes_per_checksum) {
-  uint32_t crc;
-  crc_update_func_t crc_update_func;
+// One of the BULK_CRC_IMPL_* constants; see bulk_crc_force_implementation
+static int forced_crc_impl = BULK_CRC_IMPL_AUTO;
 
+/**
+ * Choose the CRC update function to use for the given checksum type,
+ * taking CPU support and any forced implementation into account.
+ *
+ * @return 0 on success, -1 for an unknown checksum type
+ */
+static int select_crc_update_func(int checksum_type, int bytes_per_checksum,
+    crc_update_func_t *crc_update_func, int *do_pipelined) {
+  int impl = forced_crc_impl;
+
+  *do_pipelined = 0;
   switch (checksum_type) {
     case CRC32_ZLIB_POLYNOMIAL:
-      crc_update_func = crc32_zlib_sb8;
+      if (likely(cached_cpu_supports_crc32_zlib) &&
+          likely(impl != BULK_CRC_IMPL_SOFTWARE)) {
+        *crc_update_func = crc32_zlib_hardware;
+      } else {
+        *crc_update_func = crc32_zlib_sb8;
+      }
       break;
     case CRC32C_POLYNOMIAL:
-      crc_update_func = crc32c_sb8;
+#ifdef USE_CRC32C_WIDE
+      if (cached_cpu_supports_crc32c_wide &&
+          (impl == BULK_CRC_IMPL_WIDE ||
+           (impl == BULK_CRC_IMPL_AUTO &&
+            bytes_per_checksum >= CRC32C_WIDE_MIN_CHUNK))) {
+        *crc_update_func = crc32c_wide;
+        break;
+      }
+#endif
+      if (likely(cached_cpu_supports_crc32) &&
+          likely(impl != BULK_CRC_IMPL_SOFTWARE)) {
+        *crc_update_func = crc32c_hardware;
+#ifdef USE_PIPELINED
+        *do_pipelined = (impl == BULK_CRC_IMPL_AUTO ||
+                         impl == BULK_CRC_IMPL_PIPELINED);
+#endif
+      } else {
+        *crc_update_func = crc32c_sb8;
+      }
       break;
     default:
-      return -EINVAL;
+      return -1;
+  }
+  return 0;
+}
+
+int bulk_crc_force_implementation(int impl) {
+  switch (impl) {
+    case BULK_CRC_IMPL_AUTO:
+    case BULK_CRC_IMPL_SOFTWARE:
+      break;
+    case BULK_CRC_IMPL_PIPELINED:
+#ifndef USE_PIPELINED
+      return ENOTSUP;
+#endif
+      // fall through
+    case BULK_CRC_IMPL_HARDWARE:
+      if (!cached_cpu_supports_crc32) {
+        return ENOTSUP;
+      }
+      break;
+    case BULK_CRC_IMPL_WIDE:
+#ifdef USE_CRC32C_WIDE
+      if (!cached_cpu_supports_crc32c_wide) {
+        return ENOTSUP;
+      }
       break;
+#else
+      return ENOTSUP;
+#endif
+    default:
+      return EINVAL;
+  }
+  forced_crc_impl = impl;
+  return 0;
+}
+
+int bulk_calculate_crc(const uint8_t *data, size_t data_len,
+                    uint32_t *sums, int checksum_type,
+                    int bytes_per_checksum) {
+#ifdef USE_PIPELINED
+  uint32_t crc1, crc2, crc3;
+  int n_blocks = data_len / bytes_per_checksum;
+  int remainder = data_len % bytes_per_checksum;
+#endif
+  int do_pipelined;
+  uint32_t crc;
+  crc_update_func_t crc_update_func;
+
+  if (checksum_type == XXHASH64_CHECKSUM) {
+    while (likely(data_len > 0)) {
+      int len = likely(data_len >= bytes_per_checksum) ? bytes_per_checksum : data_len;
+      *sums++ = ntohl(xxhash64_sum(data, len));
+      data += len;
+      data_len -= len;
+    }
+    return 0;
+  }
+  if (unlikely(select_crc_update_func(checksum_type, bytes_per_checksum,
+                                      &crc_update_func, &do_pipelined))) {
+    return -EINVAL;
+  }
+
+#ifdef USE_PIPELINED
+  if (do_pipelined) {
+    /* Process three blocks at a time */
+    while (likely(n_blocks >= 3)) {
+      crc1 = crc2 = crc3 = CRC_INITIAL_VAL;
+      pipelined_crc32c(&crc1, &crc2, &crc3, data, bytes_per_checksum, 3);
+      *sums++ = ntohl(crc_val(crc1));
+      *sums++ = ntohl(crc_val(crc2));
+      *sums++ = ntohl(crc_val(crc3));
+      data += bytes_per_checksum * 3;
+      n_blocks -= 3;
+    }
+
+    /* One or two blocks */
+    if (n_blocks) {
+      crc1 = crc2 = crc3 = CRC_INITIAL_VAL;
+      pipelined_crc32c(&crc1, &crc2, &crc3, data, bytes_per_checksum, n_blocks);
+      *sums++ = ntohl(crc_val(crc1));
+      if (n_blocks == 2) {
+        *sums++ = ntohl(crc_val(crc2));
+      }
+      data += bytes_per_checksum * n_blocks;
+    }
+
+    /* For something smaller than a block */
+    if (remainder) {
+      crc1 = crc2 = crc3 = CRC_INITIAL_VAL;
+      pipelined_crc32c(&crc1, &crc2, &crc3, data, remainder, 1);
+      *sums = ntohl(crc_val(crc1));
+    }
+    return 0;
   }
+#endif
+
   while (likely(data_len > 0)) {
     int len = likely(data_len >= bytes_per_checksum) ? bytes_per_checksum : data_len;
     crc = CRC_INITIAL_VAL;
@@ -82,31 +229,38 @@ int bulk_verify_crc(const uint8_t *data, size_t data_len,
                     const uint32_t *sums, int checksum_type,
                     int bytes_per_checksum,
                     crc32_error_t *error_info) {
+  return verify_crc_parallel(data, data_len, sums, checksum_type,
+                             bytes_per_checksum, error_info);
+}
 
+static int verify_crc_serial(const uint8_t *data, size_t data_len,
+    const uint32_t *sums, int checksum_type, int bytes_per_checksum,
+    crc32_error_t *error_info) {
 #ifdef USE_PIPELINED
   uint32_t crc1, crc2, crc3;
   int n_blocks = data_len / bytes_per_checksum;
   int remainder = data_len % bytes_per_checksum;
-  int do_pipelined = 0;
 #endif
+  int do_pipelined;
   uint32_t crc;
   crc_update_func_t crc_update_func;
-  switch (checksum_type) {
-    case CRC32_ZLIB_POLYNOMIAL:
-      crc_update_func = crc32_zlib_sb8;
-      break;
-    case CRC32C_POLYNOMIAL:
-      if (likely(cached_cpu_supports_crc32)) {
-        crc_update_func = crc32c_hardware;
-#ifdef USE_PIPELINED
-        do_pipelined = 1;
-#endif
-      } else {
-        crc_update_func = crc32c_sb8;
+
+  if (checksum_type == XXHASH64_CHECKSUM) {
+    while (likely(data_len > 0)) {
+      int len = likely(data_len >= bytes_per_checksum) ? bytes_per_checksum : data_len;
+      crc = ntohl(xxhash64_sum(data, len));
+      if (unlikely(crc != *sums)) {
+        goto return_crc_error;
       }
-      break;
-    default:
-      return INVALID_CHECKSUM_TYPE;
+      data += len;
+      data_len -= len;
+      sums++;
+    }
+    return CHECKSUMS_VALID;
+  }
+  if (unlikely(select_crc_update_func(checksum_type, bytes_per_checksum,
+                                      &crc_update_func, &do_pipelined))) {
+    return INVALID_CHECKSUM_TYPE;
   }
 
 #ifdef USE_PIPELINED
@@ -184,6 +338,503 @@ return_crc_error:
   return INVALID_CHECKSUM_DETECTED;
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Begin code for multi-threaded verification of large buffers
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * One contiguous run of chunks verified by a single thread.
+ */
+typedef struct crc_verify_slice {
+  const uint8_t *data;
+  size_t data_len;
+  const uint32_t *sums;
+  int ret;
+  crc32_error_t error;
+} crc_verify_slice_t;
+
+/**
+ * A verification request that is being split across the worker pool.
+ * Slices are handed out in order; the caller's thread takes slices too.
+ */
+typedef struct crc_verify_job {
+  int checksum_type;
+  int bytes_per_checksum;
+  int num_slices;
+  int next_slice;
+  int slices_done;
+  crc_verify_slice_t slices[BULK_CRC_MAX_VERIFY_THREADS + 1];
+} crc_verify_job_t;
+
+/**
+ * The worker pool. At most one job runs on it at a time; callers which
+ * find it busy verify on their own thread rather than queueing.
+ */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  int num_threads;     // threads configured by bulk_crc_set_parallelism
+  int started_threads; // threads actually running
+  size_t min_len;
+  crc_verify_job_t *job;
+} verify_pool = {
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  0, 0, 0, NULL
+};
+
+/**
+ * Take the next unclaimed slice of the current job and verify it.
+ * Must be called with verify_pool.lock held; drops it while verifying.
+ *
+ * @return 1 if a slice was processed, 0 if there was nothing to do
+ */
+static int verify_pool_run_slice(crc_verify_job_t *job) {
+  crc_verify_slice_t *slice;
+
+  if (job->next_slice >= job->num_slices) {
+    return 0;
+  }
+  slice = &job->slices[job->next_slice++];
+  pthread_mutex_unlock(&verify_pool.lock);
+  slice->ret = verify_crc_serial(slice->data, slice->data_len, slice->sums,
+      job->checksum_type, job->bytes_per_checksum, &slice->error);
+  pthread_mutex_lock(&verify_pool.lock);
+  if (++job->slices_done == job->num_slices) {
+    pthread_cond_signal(&verify_pool.done_cond);
+  }
+  return 1;
+}
+
+static void *verify_pool_worker(void *arg) {
+  pthread_mutex_lock(&verify_pool.lock);
+  while (1) {
+    while ((!verify_pool.job) ||
+           (!verify_pool_run_slice(verify_pool.job))) {
+      pthread_cond_wait(&verify_pool.work_cond, &verify_pool.lock);
+    }
+  }
+  pthread_mutex_unlock(&verify_pool.lock);
+  return NULL;
+}
+
+int bulk_crc_set_parallelism(int num_threads, size_t min_len) {
+  pthread_attr_t attr;
+  pthread_t thread;
+  int ret = 0;
+
+  if (num_threads < 0 || num_threads > BULK_CRC_MAX_VERIFY_THREADS) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&verify_pool.lock);
+  // Threads are never torn down. Lowering num_threads only limits how many
+  // slices a job is split into, which leaves the surplus workers idle.
+  if (num_threads > verify_pool.started_threads) {
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (verify_pool.started_threads < num_threads) {
+      ret = pthread_create(&thread, &attr, verify_pool_worker, NULL);
+      if (ret) {
+        break;
+      }
+      verify_pool.started_threads++;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  verify_pool.num_threads = ret ? verify_pool.started_threads : num_threads;
+  verify_pool.min_len = min_len;
+  pthread_mutex_unlock(&verify_pool.lock);
+  return ret;
+}
+
+/**
+ * Verify a buffer, splitting it across the worker pool if parallel
+ * verification is enabled and the buffer is large enough.
+ *
+ * When more than one slice contains a bad chunk, the error from the slice
+ * nearest the start of the buffer is returned, so the result is the same
+ * as verifying the whole buffer on one thread.
+ */
+static int verify_crc_parallel(const uint8_t *data, size_t data_len,
+    const uint32_t *sums, int checksum_type, int bytes_per_checksum,
+    crc32_error_t *error_info) {
+  crc_verify_job_t job;
+  size_t n_chunks, chunks_per_slice, offset;
+  int i, num_threads;
+
+  if (checksum_type != CRC32C_POLYNOMIAL &&
+      checksum_type != CRC32_ZLIB_POLYNOMIAL &&
+      checksum_type != XXHASH64_CHECKSUM) {
+    return INVALID_CHECKSUM_TYPE;
+  }
+  // Unlocked peek: a stale value just means this call runs serially.
+  num_threads = verify_pool.num_threads;
+  if (likely(num_threads == 0 || data_len < verify_pool.min_len)) {
+    return verify_crc_serial(data, data_len, sums, checksum_type,
+                             bytes_per_checksum, error_info);
+  }
+  n_chunks = (data_len + bytes_per_checksum - 1) / bytes_per_checksum;
+  job.num_slices = num_threads + 1;
+  if (n_chunks < job.num_slices) {
+    job.num_slices = n_chunks;
+  }
+  chunks_per_slice = (n_chunks + job.num_slices - 1) / job.num_slices;
+  job.num_slices = (n_chunks + chunks_per_slice - 1) / chunks_per_slice;
+  job.checksum_type = checksum_type;
+  job.bytes_per_checksum = bytes_per_checksum;
+  job.next_slice = 0;
+  job.slices_done = 0;
+  for (i = 0, offset = 0; i < job.num_slices; i++) {
+    size_t len = chunks_per_slice * bytes_per_checksum;
+    if (len > data_len - offset) {
+      len = data_len - offset;
+    }
+    job.slices[i].data = data + offset;
+    job.slices[i].data_len = len;
+    job.slices[i].sums = sums + i * chunks_per_slice;
+    offset += len;
+  }
+
+  pthread_mutex_lock(&verify_pool.lock);
+  if (verify_pool.job) {
+    // Another caller owns the pool; don't wait for it.
+    pthread_mutex_unlock(&verify_pool.lock);
+    return verify_crc_serial(data, data_len, sums, checksum_type,
+                             bytes_per_checksum, error_info);
+  }
+  verify_pool.job = &job;
+  pthread_cond_broadcast(&verify_pool.work_cond);
+  while (verify_pool_run_slice(&job));
+  while (job.slices_done < job.num_slices) {
+    pthread_cond_wait(&verify_pool.done_cond, &verify_pool.lock);
+  }
+  verify_pool.job = NULL;
+  pthread_mutex_unlock(&verify_pool.lock);
+
+  for (i = 0; i < job.num_slices; i++) {
+    if (job.slices[i].ret != CHECKSUMS_VALID) {
+      if (error_info != NULL) {
+        *error_info = job.slices[i].error;
+      }
+      return job.slices[i].ret;
+    }
+  }
+  return CHECKSUMS_VALID;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Begin code for combining checksums of concatenated data
+///////////////////////////////////////////////////////////////////////////
+
+//
+// A CRC is the remainder of the message polynomial modulo the CRC
+// polynomial P. Appending len2 bytes to a buffer multiplies its remainder
+// by x^(8 * len2) mod P, so
+//   CRC(A + B) = (CRC(A) * x^(8 * len2) mod P) ^ CRC(B).
+// This is the technique that zlib's crc32_combine uses. Polynomials are in
+// the same bit-reflected representation as the lookup tables.
+//
+#define CRC32C_REFLECTED_POLY 0x82f63b78
+#define CRC32_ZLIB_REFLECTED_POLY 0xedb88320
+
+// x^(2^k) mod P for k = 0..31; filled in by the constructor below
+static uint32_t crc32c_x2n_table[32];
+static uint32_t crc32_zlib_x2n_table[32];
+
+/**
+ * Multiply a(x) by b(x) modulo P(x).
+ */
+static uint32_t gf2_multmodp(uint32_t a, uint32_t b, uint32_t poly) {
+  uint32_t m = (uint32_t)1 << 31;
+  uint32_t p = 0;
+
+  while (a) {
+    if (a & m) {
+      p ^= b;
+      a ^= m;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+  }
+  return p;
+}
+
+/**
+ * Return x^(n * 2^k) modulo P(x), using the table of x^(2^k) mod P.
+ */
+static uint32_t gf2_x2nmodp(size_t n, unsigned k, const uint32_t *table,
+                            uint32_t poly) {
+  uint32_t p = (uint32_t)1 << 31; // x^0 == 1
+
+  while (n) {
+    if (n & 1) {
+      p = gf2_multmodp(table[k & 31], p, poly);
+    }
+    n >>= 1;
+    k++;
+  }
+  return p;
+}
+
+static void init_x2n_table(uint32_t *table, uint32_t poly) {
+  uint32_t p = (uint32_t)1 << 30; // x^1
+  int n;
+
+  table[0] = p;
+  for (n = 1; n < 32; n++) {
+    table[n] = p = gf2_multmodp(p, p, poly);
+  }
+}
+
+void __attribute__ ((constructor)) init_crc_combine_tables(void) {
+  init_x2n_table(crc32c_x2n_table, CRC32C_REFLECTED_POLY);
+  init_x2n_table(crc32_zlib_x2n_table, CRC32_ZLIB_REFLECTED_POLY);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  return gf2_multmodp(gf2_x2nmodp(len2, 3, crc32c_x2n_table,
+                                  CRC32C_REFLECTED_POLY),
+                      crc1, CRC32C_REFLECTED_POLY) ^ crc2;
+}
+
+uint32_t crc32_zlib_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  return gf2_multmodp(gf2_x2nmodp(len2, 3, crc32_zlib_x2n_table,
+                                  CRC32_ZLIB_REFLECTED_POLY),
+                      crc1, CRC32_ZLIB_REFLECTED_POLY) ^ crc2;
+}
+
+int bulk_combine_crc(const uint32_t *sums, size_t data_len,
+                    int checksum_type, int bytes_per_checksum,
+                    uint32_t *result) {
+  const uint32_t *table;
+  uint32_t poly, shift, crc;
+  size_t len;
+
+  switch (checksum_type) {
+    case CRC32_ZLIB_POLYNOMIAL:
+      table = crc32_zlib_x2n_table;
+      poly = CRC32_ZLIB_REFLECTED_POLY;
+      break;
+    case CRC32C_POLYNOMIAL:
+      table = crc32c_x2n_table;
+      poly = CRC32C_REFLECTED_POLY;
+      break;
+    default:
+      return -EINVAL;
+  }
+  if (unlikely(bytes_per_checksum <= 0)) {
+    return -EINVAL;
+  }
+  if (unlikely(data_len == 0)) {
+    *result = 0;
+    return 0;
+  }
+
+  // Every chunk but the last is a full chunk, so the shift operator for
+  // those only has to be computed once.
+  shift = gf2_x2nmodp(bytes_per_checksum, 3, table, poly);
+  crc = ntohl(*sums++);
+  len = likely(data_len >= bytes_per_checksum) ? bytes_per_checksum : data_len;
+  data_len -= len;
+  while (likely(data_len > 0)) {
+    len = likely(data_len >= bytes_per_checksum) ? bytes_per_checksum : data_len;
+    if (likely(len == bytes_per_checksum)) {
+      crc = gf2_multmodp(shift, crc, poly) ^ ntohl(*sums);
+    } else {
+      crc = gf2_multmodp(gf2_x2nmodp(len, 3, table, poly), crc, poly) ^
+          ntohl(*sums);
+    }
+    data_len -= len;
+    sums++;
+  }
+  *result = crc;
+  return 0;
+}
+
+int crc_state_init(crc_state_t *state, int checksum_type,
+                   int bytes_per_checksum) {
+  crc_update_func_t crc_update_func;
+  int do_pipelined;
+
+  if (unlikely(bytes_per_checksum <= 0 ||
+               select_crc_update_func(checksum_type, bytes_per_checksum,
+                                      &crc_update_func, &do_pipelined))) {
+    return -EINVAL;
+  }
+  state->crc = CRC_INITIAL_VAL;
+  state->chunk_len = 0;
+  state->checksum_type = checksum_type;
+  state->bytes_per_checksum = bytes_per_checksum;
+  return 0;
+}
+
+int crc_state_resume(crc_state_t *state, int checksum_type,
+                     int bytes_per_checksum, uint32_t partial_sum,
+                     int partial_len) {
+  int ret = crc_state_init(state, checksum_type, bytes_per_checksum);
+  if (unlikely(ret)) {
+    return ret;
+  }
+  if (unlikely(partial_len < 0 || partial_len >= bytes_per_checksum)) {
+    return -EINVAL;
+  }
+  // A chunk's checksum is its running CRC inverted, so the running CRC
+  // comes back from the checksum alone.
+  if (partial_len > 0) {
+    state->crc = ~ntohl(partial_sum);
+    state->chunk_len = partial_len;
+  }
+  return 0;
+}
+
+size_t crc_state_update(crc_state_t *state, const uint8_t *data,
+                        size_t data_len, uint32_t *sums) {
+  crc_update_func_t crc_update_func;
+  int do_pipelined;
+  size_t n_sums = 0, len, whole;
+  int bpc = state->bytes_per_checksum;
+
+  select_crc_update_func(state->checksum_type, bpc,
+                         &crc_update_func, &do_pipelined);
+
+  // Finish the chunk left open by the last piece
+  if (state->chunk_len > 0) {
+    len = bpc - state->chunk_len;
+    if (len > data_len) {
+      len = data_len;
+    }
+    state->crc = crc_update_func(state->crc, data, len);
+    state->chunk_len += len;
+    data += len;
+    data_len -= len;
+    if (state->chunk_len < bpc) {
+      return 0;
+    }
+    sums[n_sums++] = ntohl(crc_val(state->crc));
+    state->crc = CRC_INITIAL_VAL;
+    state->chunk_len = 0;
+  }
+
+  // Whole chunks go through the bulk kernels
+  whole = data_len - data_len % bpc;
+  if (whole > 0) {
+    bulk_calculate_crc(data, whole, sums + n_sums, state->checksum_type, bpc);
+    n_sums += whole / bpc;
+    data += whole;
+    data_len -= whole;
+  }
+
+  // Open a chunk with whatever is left
+  if (data_len > 0) {
+    state->crc = crc_update_func(CRC_INITIAL_VAL, data, data_len);
+    state->chunk_len = data_len;
+  }
+  return n_sums;
+}
+
+int crc_state_final(const crc_state_t *state, uint32_t *sum) {
+  if (state->chunk_len > 0) {
+    *sum = ntohl(crc_val(state->crc));
+  }
+  return state->chunk_len;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Begin code for xxHash64
+///////////////////////////////////////////////////////////////////////////
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// The hash is defined on little-endian words, whatever the host order
+static inline uint64_t xxh_read64(const uint8_t *p) {
+  return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+      (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+      (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint32_t xxh_read32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+      (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_PRIME64_2;
+  acc = xxh_rotl64(acc, 31);
+  return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * xxHash64 of a buffer with seed 0, truncated to the 32 bits a chunk
+ * checksum has room for. The four lanes are independent, so the main loop
+ * runs at several bytes per cycle on any 64-bit CPU.
+ */
+static uint32_t xxhash64_sum(const uint8_t *p, size_t length) {
+  const uint8_t *end = p + length;
+  uint64_t h;
+
+  if (length >= 32) {
+    const uint8_t *limit = end - 32;
+    uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = XXH_PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -XXH_PRIME64_1;
+    do {
+      v1 = xxh_round(v1, xxh_read64(p));
+      v2 = xxh_round(v2, xxh_read64(p + 8));
+      v3 = xxh_round(v3, xxh_read64(p + 16));
+      v4 = xxh_round(v4, xxh_read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) +
+        xxh_rotl64(v4, 18);
+    h = xxh_merge_round(h, v1);
+    h = xxh_merge_round(h, v2);
+    h = xxh_merge_round(h, v3);
+    h = xxh_merge_round(h, v4);
+  } else {
+    h = XXH_PRIME64_5;
+  }
+  h += length;
+
+  while (p + 8 <= end) {
+    h ^= xxh_round(0, xxh_read64(p));
+    h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+    h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= *p * XXH_PRIME64_5;
+    h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return (uint32_t)h;
+}
+
 /**
  * Extract the final result of a CRC
  */
@@ -263,8 +914,16 @@ static uint32_t crc32_zlib_sb8(
 ///////////////////////////////////////////////////////////////////////////
 
 #if (defined(__amd64__) || defined(__i386)) && defined(__GNUC__) && !defined(__FreeBSD__)
+#  include <immintrin.h>
+
 #  define SSE42_FEATURE_BIT (1 << 20)
+#  define PCLMULQDQ_FEATURE_BIT (1 << 1)
+#  define OSXSAVE_FEATURE_BIT (1 << 27)
+#  define AVX512F_FEATURE_BIT (1 << 16)     // cpuid leaf 7, ebx
+#  define VPCLMULQDQ_FEATURE_BIT (1 << 10)  // cpuid leaf 7, ecx
+#  define XCR0_AVX512_STATE 0xe6 // xmm, ymm, opmask and zmm state enabled
 #  define CPUID_FEATURES 1
+#  define CPUID_EXTENDED_FEATURES 7
 /**
  * Call the cpuid instruction to determine CPU feature flags.
  */
@@ -286,6 +945,32 @@ static uint32_t cpuid(uint32_t eax_in) {
   return ecx;
 }
 
+#  ifdef USE_CRC32C_WIDE
+/**
+ * Return whether the CPU supports AVX-512F and VPCLMULQDQ, and the OS
+ * saves the zmm registers across context switches.
+ */
+static int cpu_supports_avx512_vpclmul(void) {
+  uint32_t max_leaf, ebx, ecx, edx, xcr0;
+
+  if (!(cpuid(CPUID_FEATURES) & OSXSAVE_FEATURE_BIT)) {
+    return 0;
+  }
+  asm("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+  if ((xcr0 & XCR0_AVX512_STATE) != XCR0_AVX512_STATE) {
+    return 0;
+  }
+  asm("cpuid" : "=a" (max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0)
+      : "cc");
+  if (max_leaf < CPUID_EXTENDED_FEATURES) {
+    return 0;
+  }
+  asm("cpuid" : "=a" (max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx)
+      : "a"(CPUID_EXTENDED_FEATURES), "c"(0) : "cc");
+  return (ebx & AVX512F_FEATURE_BIT) && (ecx & VPCLMULQDQ_FEATURE_BIT);
+}
+#  endif
+
 /**
  * On library load, initiailize the cached value above for
  * whether the cpu supports SSE4.2's crc32 instruction.
@@ -293,6 +978,11 @@ static uint32_t cpuid(uint32_t eax_in) {
 void __attribute__ ((constructor)) init_cpu_support_flag(void) {
   uint32_t ecx = cpuid(CPUID_FEATURES);
   cached_cpu_supports_crc32 = ecx & SSE42_FEATURE_BIT;
+  cached_cpu_supports_crc32_zlib = ecx & PCLMULQDQ_FEATURE_BIT;
+#  ifdef USE_CRC32C_WIDE
+  cached_cpu_supports_crc32c_wide = cached_cpu_supports_crc32 &&
+      cpu_supports_avx512_vpclmul();
+#  endif
 }
 
 
@@ -303,23 +993,23 @@ void __attribute__ ((constructor)) init_cpu_support_flag(void) {
 //
 
 #  ifdef __LP64__
-inline uint64_t _mm_crc32_u64(uint64_t crc, uint64_t value) {
+static inline uint64_t sse42_crc32_u64(uint64_t crc, uint64_t value) {
   asm("crc32q %[value], %[crc]\n" : [crc] "+r" (crc) : [value] "rm" (value));
   return crc;
 }
 #  endif
 
-inline uint32_t _mm_crc32_u32(uint32_t crc, uint32_t value) {
+static inline uint32_t sse42_crc32_u32(uint32_t crc, uint32_t value) {
   asm("crc32l %[value], %[crc]\n" : [crc] "+r" (crc) : [value] "rm" (value));
   return crc;
 }
 
-inline uint32_t _mm_crc32_u16(uint32_t crc, uint16_t value) {
+static inline uint32_t sse42_crc32_u16(uint32_t crc, uint16_t value) {
   asm("crc32w %[value], %[crc]\n" : [crc] "+r" (crc) : [value] "rm" (value));
   return crc;
 }
 
-inline uint32_t _mm_crc32_u8(uint32_t crc, uint8_t value) {
+static inline uint32_t sse42_crc32_u8(uint32_t crc, uint8_t value) {
   asm("crc32b %[value], %[crc]\n" : [crc] "+r" (crc) : [value] "rm" (value));
   return crc;
 }
@@ -337,7 +1027,7 @@ static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p_buf, size_t lengt
   uint64_t crc64bit = crc;
   size_t i;
   for (i = 0; i < length / sizeof(uint64_t); i++) {
-    crc64bit = _mm_crc32_u64(crc64bit, *(uint64_t*) p_buf);
+    crc64bit = sse42_crc32_u64(crc64bit, *(uint64_t*) p_buf);
     p_buf += sizeof(uint64_t);
   }
 
@@ -346,24 +1036,24 @@ static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p_buf, size_t lengt
   length &= sizeof(uint64_t) - 1;
   switch (length) {
     case 7:
-      crc32bit = _mm_crc32_u8(crc32bit, *p_buf++);
+      crc32bit = sse42_crc32_u8(crc32bit, *p_buf++);
     case 6:
-      crc32bit = _mm_crc32_u16(crc32bit, *(uint16_t*) p_buf);
+      crc32bit = sse42_crc32_u16(crc32bit, *(uint16_t*) p_buf);
       p_buf += 2;
     // case 5 is below: 4 + 1
     case 4:
-      crc32bit = _mm_crc32_u32(crc32bit, *(uint32_t*) p_buf);
+      crc32bit = sse42_crc32_u32(crc32bit, *(uint32_t*) p_buf);
       break;
     case 3:
-      crc32bit = _mm_crc32_u8(crc32bit, *p_buf++);
+      crc32bit = sse42_crc32_u8(crc32bit, *p_buf++);
     case 2:
-      crc32bit = _mm_crc32_u16(crc32bit, *(uint16_t*) p_buf);
+      crc32bit = sse42_crc32_u16(crc32bit, *(uint16_t*) p_buf);
       break;
     case 5:
-      crc32bit = _mm_crc32_u32(crc32bit, *(uint32_t*) p_buf);
+      crc32bit = sse42_crc32_u32(crc32bit, *(uint32_t*) p_buf);
       p_buf += 4;
     case 1:
-      crc32bit = _mm_crc32_u8(crc32bit, *p_buf);
+      crc32bit = sse42_crc32_u8(crc32bit, *p_buf);
       break;
     case 0:
       break;
@@ -511,7 +1201,7 @@ static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p_buf, size_t lengt
   // we haven't reconfirmed those benchmarks ourselves.
   size_t i;
   for (i = 0; i < length / sizeof(uint32_t); i++) {
-    crc = _mm_crc32_u32(crc, *(uint32_t*) p_buf);
+    crc = sse42_crc32_u32(crc, *(uint32_t*) p_buf);
     p_buf += sizeof(uint32_t);
   }
 
@@ -519,12 +1209,12 @@ static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p_buf, size_t lengt
   length &= sizeof(uint32_t) - 1;
   switch (length) {
     case 3:
-      crc = _mm_crc32_u8(crc, *p_buf++);
+      crc = sse42_crc32_u8(crc, *p_buf++);
     case 2:
-      crc = _mm_crc32_u16(crc, *(uint16_t*) p_buf);
+      crc = sse42_crc32_u16(crc, *(uint16_t*) p_buf);
       break;
     case 1:
-      crc = _mm_crc32_u8(crc, *p_buf);
+      crc = sse42_crc32_u8(crc, *p_buf);
       break;
     case 0:
       break;
@@ -662,7 +1352,451 @@ static void pipelined_crc32c(uint32_t *crc1, uint32_t *crc2, uint32_t *crc3, con
 
 # endif // 64-bit vs 32-bit
 
-#else // end x86 architecture
+///////////////////////////////////////////////////////////////////////////
+// Begin code for PCLMULQDQ specific hardware support of the zlib CRC32
+///////////////////////////////////////////////////////////////////////////
+
+//
+// The folding kernel below follows "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction" (Gopal et al, Intel, 2009),
+// using the bit-reflected constants for the zlib polynomial given at the
+// end of that paper. The target attribute lets gcc emit the pclmulqdq
+// instruction for this function only, so the rest of the file still
+// compiles for a baseline CPU; we only call it after checking cpuid.
+//
+#  define CRC32_PCLMUL_MIN_LEN 64
+
+/**
+ * Fold a buffer into a zlib CRC32 using carry-less multiplication.
+ *
+ *   crc    : The running (not yet inverted) CRC value.
+ *   buf    : The data. May be unaligned.
+ *   length : Must be at least 64 and a multiple of 16.
+ */
+static uint32_t __attribute__ ((target("pclmul")))
+crc32_zlib_pclmul_fold(uint32_t crc, const uint8_t *buf, size_t length) {
+  static const uint64_t __attribute__ ((aligned(16))) k1k2[] =
+      { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const uint64_t __attribute__ ((aligned(16))) k3k4[] =
+      { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const uint64_t __attribute__ ((aligned(16))) k5k0[] =
+      { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const uint64_t __attribute__ ((aligned(16))) poly[] =
+      { 0x01db710641ULL, 0x01f7011641ULL };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  /* Load the first 64 bytes and mix in the initial CRC */
+  x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0 = _mm_load_si128((const __m128i *)k1k2);
+  buf += 64;
+  length -= 64;
+
+  /* Fold four 128-bit lanes in parallel, 64 bytes per iteration */
+  while (likely(length >= 64)) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf += 64;
+    length -= 64;
+  }
+
+  /* Fold the four lanes into a single 128-bit value */
+  x0 = _mm_load_si128((const __m128i *)k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Fold any remaining 16-byte blocks */
+  while (length >= 16) {
+    x2 = _mm_loadu_si128((const __m128i *)buf);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    buf += 16;
+    length -= 16;
+  }
+
+  /* Fold 128 bits down to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction down to 32 bits */
+  x0 = _mm_load_si128((const __m128i *)poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+/**
+ * Update a CRC using the "zlib" polynomial with the PCLMULQDQ folding
+ * kernel. Buffers too short to fold, and the tail left over after folding,
+ * go through the slicing-by-8 code.
+ */
+static uint32_t crc32_zlib_hardware(uint32_t crc, const uint8_t *buf,
+                                    size_t length) {
+  if (likely(length >= CRC32_PCLMUL_MIN_LEN)) {
+    size_t fold_len = length & ~((size_t)15);
+    crc = crc32_zlib_pclmul_fold(crc, buf, fold_len);
+    buf += fold_len;
+    length -= fold_len;
+  }
+  return crc32_zlib_sb8(crc, buf, length);
+}
+
+#  ifdef USE_CRC32C_WIDE
+///////////////////////////////////////////////////////////////////////////
+// Begin code for AVX-512 VPCLMULQDQ support of CRC32C
+///////////////////////////////////////////////////////////////////////////
+
+//
+// This is the same folding technique as crc32_zlib_pclmul_fold above, but
+// with the constants for the CRC32C polynomial, and with 512-bit registers
+// that each hold four 128-bit lanes. Folding four zmm registers at once
+// consumes 256 bytes per iteration, which is considerably faster than even
+// the pipelined crc32q code once chunks are large enough to amortize the
+// setup and the final reduction.
+//
+// Each pair of constants folds a 128-bit lane forward by D bits:
+// { x^(D+32) mod P, x^(D-32) mod P }, bit-reflected and shifted left by one.
+//
+#  define CRC32C_WIDE_FOLD_LEN 256
+
+/**
+ * Fold a 128-bit lane forward with a pair of constants, and xor in data.
+ */
+#  define FOLD_128(x, k, data) \
+  _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00), \
+                              _mm_clmulepi64_si128((x), (k), 0x11)), (data))
+
+#  define FOLD_512(x, k, data) \
+  _mm512_xor_si512(_mm512_xor_si512(_mm512_clmulepi64_epi128((x), (k), 0x00), \
+                                    _mm512_clmulepi64_epi128((x), (k), 0x11)), \
+                   (data))
+
+/**
+ * Fold a buffer into a CRC32C using VPCLMULQDQ.
+ *
+ *   crc    : The running (not yet inverted) CRC value.
+ *   buf    : The data. May be unaligned.
+ *   length : Must be at least CRC32C_WIDE_FOLD_LEN and a multiple of 64.
+ */
+static uint32_t __attribute__ ((target("avx512f,vpclmulqdq,pclmul")))
+crc32c_wide_fold(uint32_t crc, const uint8_t *buf, size_t length) {
+  const __m512i k2048 = _mm512_broadcast_i32x4(
+      _mm_set_epi64x(0x0b9e02b86ULL, 0x0dcb17aa4ULL));
+  const __m512i k512 = _mm512_broadcast_i32x4(
+      _mm_set_epi64x(0x09e4addf8ULL, 0x0740eef02ULL));
+  const __m128i k384 = _mm_set_epi64x(0x1d82c63daULL, 0x01c291d04ULL);
+  const __m128i k256 = _mm_set_epi64x(0x0ba4fc28eULL, 0x1384aa63aULL);
+  const __m128i k128 = _mm_set_epi64x(0x14cd00bd6ULL, 0x0f20c0dfeULL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0dd45aab8ULL);
+  const __m128i poly = _mm_set_epi64x(0x0dea713f1ULL, 0x105ec76f1ULL);
+  __m512i z0, z1, z2, z3;
+  __m128i x0, x1, x2, x3, mask;
+
+  /* Load the first 256 bytes and mix in the initial CRC */
+  z0 = _mm512_loadu_si512((const void *)(buf + 0x00));
+  z1 = _mm512_loadu_si512((const void *)(buf + 0x40));
+  z2 = _mm512_loadu_si512((const void *)(buf + 0x80));
+  z3 = _mm512_loadu_si512((const void *)(buf + 0xc0));
+  z0 = _mm512_xor_si512(z0, _mm512_inserti32x4(_mm512_setzero_si512(),
+                                               _mm_cvtsi32_si128(crc), 0));
+  buf += 256;
+  length -= 256;
+
+  /* Fold four zmm registers in parallel, 256 bytes per iteration */
+  while (likely(length >= 256)) {
+    z0 = FOLD_512(z0, k2048, _mm512_loadu_si512((const void *)(buf + 0x00)));
+    z1 = FOLD_512(z1, k2048, _mm512_loadu_si512((const void *)(buf + 0x40)));
+    z2 = FOLD_512(z2, k2048, _mm512_loadu_si512((const void *)(buf + 0x80)));
+    z3 = FOLD_512(z3, k2048, _mm512_loadu_si512((const void *)(buf + 0xc0)));
+    buf += 256;
+    length -= 256;
+  }
+
+  /* Fold the four registers into one, then fold in any 64-byte blocks left */
+  z0 = FOLD_512(z0, k512, z1);
+  z0 = FOLD_512(z0, k512, z2);
+  z0 = FOLD_512(z0, k512, z3);
+  while (length >= 64) {
+    z0 = FOLD_512(z0, k512, _mm512_loadu_si512((const void *)buf));
+    buf += 64;
+    length -= 64;
+  }
+
+  /* Fold the four 128-bit lanes of the register into one */
+  x0 = _mm512_extracti32x4_epi32(z0, 0);
+  x1 = _mm512_extracti32x4_epi32(z0, 1);
+  x2 = _mm512_extracti32x4_epi32(z0, 2);
+  x3 = _mm512_extracti32x4_epi32(z0, 3);
+  x3 = FOLD_128(x0, k384, x3);
+  x3 = FOLD_128(x1, k256, x3);
+  x1 = FOLD_128(x2, k128, x3);
+
+  /* Fold 128 bits down to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, k128, 0x10);
+  mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction down to 32 bits */
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+/**
+ * Update a CRC32C with the VPCLMULQDQ folding kernel. Buffers too short to
+ * fold, and the tail left over after folding, use the crc32q instruction.
+ */
+static uint32_t crc32c_wide(uint32_t crc, const uint8_t *buf, size_t length) {
+  if (likely(length >= CRC32C_WIDE_FOLD_LEN)) {
+    size_t fold_len = length & ~((size_t)63);
+    crc = crc32c_wide_fold(crc, buf, fold_len);
+    buf += fold_len;
+    length -= fold_len;
+  }
+  return crc32c_hardware(crc, buf, length);
+}
+#  endif /* USE_CRC32C_WIDE */
+
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+// end x86 architecture, begin ARMv8
+
+///////////////////////////////////////////////////////////////////////////
+// Begin code for ARMv8 specific hardware support of CRC32 and CRC32C
+///////////////////////////////////////////////////////////////////////////
+
+#  include <sys/auxv.h>
+
+#  ifndef HWCAP_CRC32
+#    define HWCAP_CRC32 (1 << 7)
+#  endif
+
+/**
+ * On library load, initialize the cached values above for whether the
+ * cpu supports the ARMv8 crc32 instructions. These cover both the CRC32C
+ * and the zlib polynomials.
+ */
+void __attribute__ ((constructor)) init_cpu_support_flag(void) {
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  cached_cpu_supports_crc32 = (hwcap & HWCAP_CRC32) != 0;
+  cached_cpu_supports_crc32_zlib = cached_cpu_supports_crc32;
+}
+
+//
+// Definitions of the ARMv8 crc32 operations. As on x86, these are written
+// as inline assembly so that we don't need to compile the whole file with
+// -march=armv8-a+crc. The functions that use them carry a target attribute
+// instead, so the assembler accepts the instructions there only.
+//
+#  define CRC32C_ARM_TARGET __attribute__ ((target("+crc")))
+
+#  define CRC32CX(crc, value) \
+  __asm__("crc32cx %w[c], %w[c], %x[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32CW(crc, value) \
+  __asm__("crc32cw %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32CH(crc, value) \
+  __asm__("crc32ch %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32CB(crc, value) \
+  __asm__("crc32cb %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+
+#  define CRC32X(crc, value) \
+  __asm__("crc32x %w[c], %w[c], %x[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32W(crc, value) \
+  __asm__("crc32w %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32H(crc, value) \
+  __asm__("crc32h %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+#  define CRC32B(crc, value) \
+  __asm__("crc32b %w[c], %w[c], %w[v]" : [c] "+r" (crc) : [v] "r" (value))
+
+/**
+ * Hardware-accelerated CRC32C calculation using the 64-bit instructions.
+ */
+static uint32_t CRC32C_ARM_TARGET crc32c_hardware(uint32_t crc,
+    const uint8_t* p_buf, size_t length) {
+  while (likely(length >= sizeof(uint64_t))) {
+    CRC32CX(crc, *(uint64_t*)p_buf);
+    p_buf += sizeof(uint64_t);
+    length -= sizeof(uint64_t);
+  }
+  if (length & sizeof(uint32_t)) {
+    CRC32CW(crc, *(uint32_t*)p_buf);
+    p_buf += sizeof(uint32_t);
+  }
+  if (length & sizeof(uint16_t)) {
+    CRC32CH(crc, *(uint16_t*)p_buf);
+    p_buf += sizeof(uint16_t);
+  }
+  if (length & sizeof(uint8_t)) {
+    CRC32CB(crc, *p_buf);
+  }
+  return crc;
+}
+
+/**
+ * Hardware-accelerated calculation of the "zlib" CRC32 using the 64-bit
+ * instructions.
+ */
+static uint32_t CRC32C_ARM_TARGET crc32_zlib_hardware(uint32_t crc,
+    const uint8_t* p_buf, size_t length) {
+  while (likely(length >= sizeof(uint64_t))) {
+    CRC32X(crc, *(uint64_t*)p_buf);
+    p_buf += sizeof(uint64_t);
+    length -= sizeof(uint64_t);
+  }
+  if (length & sizeof(uint32_t)) {
+    CRC32W(crc, *(uint32_t*)p_buf);
+    p_buf += sizeof(uint32_t);
+  }
+  if (length & sizeof(uint16_t)) {
+    CRC32H(crc, *(uint16_t*)p_buf);
+    p_buf += sizeof(uint16_t);
+  }
+  if (length & sizeof(uint8_t)) {
+    CRC32B(crc, *p_buf);
+  }
+  return crc;
+}
+
+#ifdef USE_PIPELINED
+/**
+ * Pipelined version of hardware-accelerated CRC32C calculation using
+ * the 64 bit crc32cx instruction.
+ * crc32cx has a latency of several cycles but can issue once per cycle,
+ * so, as on x86, we feed three independent blocks in RR to keep the
+ * pipeline full.
+ *
+ *   crc1, crc2, crc3 : Store initial checksum for each block before
+ *           calling. When it returns, updated checksums are stored.
+ *   p_buf : The base address of the data buffer. The buffer should be
+ *           at least as big as block_size * num_blocks.
+ *   block_size : The size of each block in bytes.
+ *   num_blocks : The number of blocks to work on. Min = 1, Max = 3
+ */
+static void CRC32C_ARM_TARGET pipelined_crc32c(uint32_t *crc1, uint32_t *crc2,
+    uint32_t *crc3, const uint8_t *p_buf, size_t block_size, int num_blocks) {
+  uint32_t c1 = *crc1;
+  uint32_t c2 = *crc2;
+  uint32_t c3 = *crc3;
+  const uint8_t *p1 = p_buf;
+  const uint8_t *p2 = p_buf + block_size;
+  const uint8_t *p3 = p_buf + 2 * block_size;
+  size_t counter = block_size / sizeof(uint64_t);
+  size_t remainder = block_size % sizeof(uint64_t);
+
+  switch (num_blocks) {
+    case 3:
+      /* Do three blocks */
+      while (likely(counter)) {
+        CRC32CX(c1, *(uint64_t*)p1);
+        CRC32CX(c2, *(uint64_t*)p2);
+        CRC32CX(c3, *(uint64_t*)p3);
+        p1 += sizeof(uint64_t);
+        p2 += sizeof(uint64_t);
+        p3 += sizeof(uint64_t);
+        counter--;
+      }
+
+      /* Take care of the remainder. They are only up to seven bytes,
+       * so performing byte-level crc32 won't take much time.
+       */
+      while (likely(remainder)) {
+        CRC32CB(c1, *p1++);
+        CRC32CB(c2, *p2++);
+        CRC32CB(c3, *p3++);
+        remainder--;
+      }
+      break;
+    case 2:
+      /* Do two blocks */
+      while (likely(counter)) {
+        CRC32CX(c1, *(uint64_t*)p1);
+        CRC32CX(c2, *(uint64_t*)p2);
+        p1 += sizeof(uint64_t);
+        p2 += sizeof(uint64_t);
+        counter--;
+      }
+
+      while (likely(remainder)) {
+        CRC32CB(c1, *p1++);
+        CRC32CB(c2, *p2++);
+        remainder--;
+      }
+      break;
+    case 1:
+      /* single block */
+      c1 = crc32c_hardware(c1, p1, block_size);
+      break;
+    case 0:
+      return;
+    default:
+      assert(0 && "BUG: Invalid number of checksum blocks");
+  }
+
+  *crc1 = c1;
+  *crc2 = c2;
+  *crc3 = c3;
+  return;
+}
+#endif /* USE_PIPELINED */
+
+#else // end ARMv8 architecture
 
 static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* data, size_t length) {
   // never called!
@@ -670,4 +1804,148 @@ static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* data, size_t length
   return 0;
 }
 
+static uint32_t crc32_zlib_hardware(uint32_t crc, const uint8_t* data, size_t length) {
+  // never called!
+  assert(0 && "hardware zlib crc called on an unsupported platform");
+  return 0;
+}
+
+#ifdef USE_PIPELINED
+static void pipelined_crc32c(uint32_t *crc1, uint32_t *crc2, uint32_t *crc3, const uint8_t *p_buf, size_t block_size, int num_blocks) {
+  // never called!
+  assert(0 && "pipelined crc called on an unsupported platform");
+}
+#endif /* USE_PIPELINED */
+
 #endif
+
+///////////////////////////////////////////////////////////////////////////
+// Begin code for fused copy and checksum
+///////////////////////////////////////////////////////////////////////////
+
+// Chunks are checksummed and copied in groups of about this many bytes, so
+// that a group is still in L1 cache when it is copied.
+#define COPY_GROUP_SIZE (16 * 1024)
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#  include <emmintrin.h>
+
+/**
+ * Copy memory using non-temporal (streaming) stores, so that the
+ * destination bypasses the cache. The caller must issue copy_fence()
+ * before the copied data is handed to another thread.
+ */
+static void copy_nontemporal(uint8_t *dst, const uint8_t *src, size_t len) {
+  size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+
+  if (unlikely(len < 64)) {
+    memcpy(dst, src, len);
+    return;
+  }
+  // movntdq needs a 16-byte aligned destination
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  len -= head;
+  while (likely(len >= 64)) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + 0x00));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 0x10));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + 0x20));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + 0x30));
+    _mm_stream_si128((__m128i *)(dst + 0x00), a);
+    _mm_stream_si128((__m128i *)(dst + 0x10), b);
+    _mm_stream_si128((__m128i *)(dst + 0x20), c);
+    _mm_stream_si128((__m128i *)(dst + 0x30), d);
+    src += 64;
+    dst += 64;
+    len -= 64;
+  }
+  memcpy(dst, src, len);
+}
+
+static inline void copy_fence(void) {
+  _mm_sfence();
+}
+
+#else
+
+static void copy_nontemporal(uint8_t *dst, const uint8_t *src, size_t len) {
+  memcpy(dst, src, len);
+}
+
+static inline void copy_fence(void) {
+}
+
+#endif
+
+/**
+ * Return how many bytes of data to checksum and copy at once. This is a
+ * whole number of chunks, and a multiple of three chunks where possible so
+ * that the pipelined CRC32C code is fully used.
+ */
+static size_t copy_group_len(int bytes_per_checksum) {
+  size_t n_chunks = COPY_GROUP_SIZE / bytes_per_checksum;
+
+  if (n_chunks >= 3) {
+    n_chunks -= n_chunks % 3;
+  } else if (n_chunks == 0) {
+    n_chunks = 1;
+  }
+  return n_chunks * bytes_per_checksum;
+}
+
+int bulk_copy_and_verify_crc(const uint8_t *src, uint8_t *dst,
+    size_t data_len, const uint32_t *sums, int checksum_type,
+    int bytes_per_checksum, crc32_error_t *error_info) {
+  size_t group_len, len;
+  int ret;
+
+  if (unlikely(bytes_per_checksum <= 0)) {
+    return INVALID_CHECKSUM_TYPE;
+  }
+  group_len = copy_group_len(bytes_per_checksum);
+  while (likely(data_len > 0)) {
+    len = likely(data_len >= group_len) ? group_len : data_len;
+    ret = verify_crc_serial(src, len, sums, checksum_type,
+                            bytes_per_checksum, error_info);
+    if (unlikely(ret != CHECKSUMS_VALID)) {
+      copy_fence();
+      return ret;
+    }
+    copy_nontemporal(dst, src, len);
+    src += len;
+    dst += len;
+    sums += group_len / bytes_per_checksum;
+    data_len -= len;
+  }
+  copy_fence();
+  return CHECKSUMS_VALID;
+}
+
+int bulk_copy_and_calculate_crc(const uint8_t *src, uint8_t *dst,
+    size_t data_len, uint32_t *sums, int checksum_type,
+    int bytes_per_checksum) {
+  size_t group_len, len;
+  int ret;
+
+  if (unlikely(bytes_per_checksum <= 0)) {
+    return -EINVAL;
+  }
+  group_len = copy_group_len(bytes_per_checksum);
+  while (likely(data_len > 0)) {
+    len = likely(data_len >= group_len) ? group_len : data_len;
+    ret = bulk_calculate_crc(src, len, sums, checksum_type,
+                             bytes_per_checksum);
+    if (unlikely(ret != 0)) {
+      copy_fence();
+      return ret;
+    }
+    copy_nontemporal(dst, src, len);
+    src += len;
+    dst += len;
+    sums += group_len / bytes_per_checksum;
+    data_len -= len;
+  }
+  copy_fence();
+  return 0;
+}
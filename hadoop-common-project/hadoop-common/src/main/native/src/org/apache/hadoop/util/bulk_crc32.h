@@ -24,6 +24,11 @@
 // Constants for different CRC algorithms
 #define CRC32C_POLYNOMIAL 1
 #define CRC32_ZLIB_POLYNOMIAL 2
+// Not a CRC: the low 32 bits of xxHash64 (seed 0). It is cheaper than even
+// hardware CRC32C without SSE4.2, but only detects corruption. It has no
+// combine function or incremental state, and nothing outside the process
+// that wrote them (HDFS in particular) can check these sums.
+#define XXHASH64_CHECKSUM 3
 
 // Return codes for bulk_verify_crc
 #define CHECKSUMS_VALID 0
@@ -61,14 +66,63 @@ extern int bulk_verify_crc(const uint8_t *data, size_t data_len,
     int bytes_per_checksum,
     crc32_error_t *error_info);
 
+// Implementations which can be selected with bulk_crc_force_implementation
+#define BULK_CRC_IMPL_AUTO 0      // fastest one the CPU supports
+#define BULK_CRC_IMPL_SOFTWARE 1  // slicing-by-8 lookup tables
+#define BULK_CRC_IMPL_HARDWARE 2  // CPU crc32 instructions, one chunk at a time
+#define BULK_CRC_IMPL_PIPELINED 3 // CPU crc32 instructions, three chunks
+                                  // interleaved (CRC32C only)
+#define BULK_CRC_IMPL_WIDE 4      // AVX-512 VPCLMULQDQ folding (CRC32C only)
+
+/**
+ * Force the bulk CRC functions to use a particular implementation, instead
+ * of the fastest one the CPU supports. This affects the whole process, and
+ * is meant for tests and benchmarks only.
+ *
+ * The zlib polynomial has no pipelined or wide kernel, so
+ * BULK_CRC_IMPL_PIPELINED and BULK_CRC_IMPL_WIDE select the single-stream
+ * hardware kernel for it, where there is one. With BULK_CRC_IMPL_AUTO the
+ * wide kernel is only used for chunks of 64K and more.
+ *
+ * @param impl                  One of the BULK_CRC_IMPL_* constants
+ *
+ * @return                      0 for success, ENOTSUP if the CPU or platform
+ *                              lacks the implementation, or EINVAL
+ */
+extern int bulk_crc_force_implementation(int impl);
+
+// Upper bound for bulk_crc_set_parallelism
+#define BULK_CRC_MAX_VERIFY_THREADS 16
+
+/**
+ * Enable or disable multi-threaded verification in bulk_verify_crc.
+ *
+ * When enabled, buffers of at least min_len bytes are split on chunk
+ * boundaries and verified by a pool of num_threads native worker threads
+ * plus the calling thread. Error reporting is unchanged: the first bad chunk
+ * in the buffer is the one reported. If another thread is already using the
+ * pool, bulk_verify_crc verifies on the calling thread instead of waiting.
+ *
+ * @param num_threads           Number of worker threads. 0 disables parallel
+ *                              verification. At most
+ *                              BULK_CRC_MAX_VERIFY_THREADS.
+ * @param min_len               Buffers shorter than this many bytes are
+ *                              always verified on the calling thread.
+ *
+ * @return                      0 for success, or an errno value. If some
+ *                              worker threads could not be started, the
+ *                              ones that were started remain in use.
+ */
+extern int bulk_crc_set_parallelism(int num_threads, size_t min_len);
+
 /**
  * Calculate checksums for some data.
  *
  * The checksums are each 32 bits and are stored in sequential indexes of the
  * 'sums' array.
  *
- * This function is not (yet) optimized.  It is provided for testing purposes
- * only.
+ * When the CPU supports the SSE4.2 crc32 instruction, CRC32C sums are
+ * computed with the same pipelined hardware path used by bulk_verify_crc.
  *
  * @param data                  The data to checksum
  * @param dataLen               Length of the data buffer
@@ -84,4 +138,163 @@ int bulk_calculate_crc(const uint8_t *data, size_t data_len,
                     uint32_t *sums, int checksum_type,
                     int bytes_per_checksum);
 
+/**
+ * Copy a buffer of data which is checksummed in chunks of
+ * bytes_per_checksum bytes, verifying the checksums as it goes.
+ *
+ * The data is read from memory once: each group of chunks is checksummed
+ * and then copied while it is still in cache. Where the platform supports
+ * it, the copy uses non-temporal stores, so the destination does not evict
+ * the data still to be checksummed.
+ *
+ * @param src                   The data to copy and checksum
+ * @param dst                   Where to copy the data. It must be at least
+ *                              data_len bytes long and must not overlap src.
+ * @param data_len              Length of the data buffer
+ * @param sums                  The checksums to verify against
+ * @param checksum_type         One of the CRC32 algorithm constants defined
+ *                              above
+ * @param bytes_per_checksum    How many bytes of data to process per checksum.
+ * @param error_info            If non-NULL, will be filled in if an error
+ *                              is detected. bad_data points into src.
+ *
+ * @return                      As for bulk_verify_crc. If a bad chunk is
+ *                              found, the contents of dst from the start of
+ *                              the group of chunks containing it onwards
+ *                              are unspecified.
+ */
+extern int bulk_copy_and_verify_crc(const uint8_t *src, uint8_t *dst,
+    size_t data_len, const uint32_t *sums, int checksum_type,
+    int bytes_per_checksum, crc32_error_t *error_info);
+
+/**
+ * Copy a buffer of data and calculate its checksums in a single pass.
+ * See bulk_copy_and_verify_crc and bulk_calculate_crc.
+ *
+ * @return                      0 for success, non-zero for an error
+ */
+extern int bulk_copy_and_calculate_crc(const uint8_t *src, uint8_t *dst,
+    size_t data_len, uint32_t *sums, int checksum_type,
+    int bytes_per_checksum);
+
+/**
+ * Combine two CRC32C checksums.
+ *
+ * Given crc1 = CRC32C(A) and crc2 = CRC32C(B), return CRC32C(A + B), where
+ * A + B is the concatenation of A and B. This takes O(log len2) time and
+ * does not need the data itself.
+ *
+ * @param crc1                  CRC32C of the first block of data
+ * @param crc2                  CRC32C of the second block of data
+ * @param len2                  Length in bytes of the second block of data
+ *
+ * @return                      The CRC32C of the concatenated data
+ */
+extern uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/**
+ * Combine two CRC32 checksums computed with the zlib polynomial. See
+ * crc32c_combine.
+ */
+extern uint32_t crc32_zlib_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/**
+ * Compute the checksum of a whole buffer from the checksums of its chunks,
+ * as computed by bulk_calculate_crc, without access to the data.
+ *
+ * @param sums                  The chunk checksums, in the format written
+ *                              by bulk_calculate_crc.
+ * @param data_len              Length of the data that was checksummed.
+ *                              All chunks but the last one are taken to be
+ *                              bytes_per_checksum long.
+ * @param checksum_type         One of the CRC32 algorithm constants defined
+ *                              above
+ * @param bytes_per_checksum    How many bytes of data each checksum covers.
+ * @param result                (out param) the checksum of the whole data
+ *                              buffer, as an integer in host byte order.
+ *
+ * @return                      0 for success, non-zero for an error
+ */
+extern int bulk_combine_crc(const uint32_t *sums, size_t data_len,
+                    int checksum_type, int bytes_per_checksum,
+                    uint32_t *result);
+
+/**
+ * Running state of chunk checksums computed over data that arrives in
+ * pieces, which need not line up with chunk boundaries. Treat the fields
+ * as private.
+ */
+typedef struct crc_state {
+  uint32_t crc;                 // running CRC of the open chunk
+  int chunk_len;                // bytes of the open chunk seen so far
+  int checksum_type;
+  int bytes_per_checksum;
+} crc_state_t;
+
+/**
+ * Start checksumming data in chunks of bytes_per_checksum bytes.
+ *
+ * @param state                 The state to initialize
+ * @param checksum_type         One of the CRC32 algorithm constants defined
+ *                              above
+ * @param bytes_per_checksum    How many bytes of data to process per checksum.
+ *
+ * @return                      0 for success, non-zero for an error
+ */
+extern int crc_state_init(crc_state_t *state, int checksum_type,
+                          int bytes_per_checksum);
+
+/**
+ * Pick up checksumming after a partial chunk whose checksum is known, such
+ * as the last chunk of a file being appended to, without its data.
+ *
+ * @param state                 The state to initialize
+ * @param checksum_type         One of the CRC32 algorithm constants defined
+ *                              above
+ * @param bytes_per_checksum    How many bytes of data to process per checksum.
+ * @param partial_sum           The checksum of the partial chunk, in the
+ *                              format written by bulk_calculate_crc.
+ * @param partial_len           The length of the partial chunk, less than
+ *                              bytes_per_checksum.
+ *
+ * @return                      0 for success, non-zero for an error
+ */
+extern int crc_state_resume(crc_state_t *state, int checksum_type,
+                            int bytes_per_checksum, uint32_t partial_sum,
+                            int partial_len);
+
+/**
+ * Checksum the next piece of data. Whole chunks are checksummed with the
+ * same kernels as bulk_calculate_crc; the ends of the piece are carried
+ * over in the state.
+ *
+ * @param state                 The state, as set up by crc_state_init or
+ *                              crc_state_resume
+ * @param data                  The data to checksum
+ * @param data_len              Length of the data
+ * @param sums                  (out param) the checksum of each chunk this
+ *                              data completes, in the format written by
+ *                              bulk_calculate_crc. It must have room for
+ *                              (data_len / bytes_per_checksum + 1) sums.
+ *
+ * @return                      The number of sums written
+ */
+extern size_t crc_state_update(crc_state_t *state, const uint8_t *data,
+                               size_t data_len, uint32_t *sums);
+
+/**
+ * Get the checksum of the chunk still open, as for the last chunk of the
+ * data so far. The state is not changed, so more data may follow, which
+ * makes this suitable for each hflush of a file still being written.
+ *
+ * @param state                 The state
+ * @param sum                   (out param) the checksum of the open chunk,
+ *                              in the format written by bulk_calculate_crc
+ *
+ * @return                      The length of the open chunk, which is 0,
+ *                              with nothing written to sum, if the data so
+ *                              far ends on a chunk boundary
+ */
+extern int crc_state_final(const crc_state_t *state, uint32_t *sum);
+
 #endif
@@ -0,0 +1,588 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark for the codecs behind libhadoop's compressors.
+ *
+ * zlib and snappy are loaded with dlopen from the same libraries libhadoop
+ * uses, and lz4 is the bundled copy, so the numbers track what the JNI
+ * codecs get minus the JNI overhead. Each corpus is cut into blocks of each
+ * buffer size, as the block compressor streams do, and every block is
+ * compressed and decompressed on its own. For each combination this prints
+ * the compression ratio and the compress and decompress throughput in MB/s
+ * of uncompressed data.
+ *
+ * Built-in corpora mimic English text, SequenceFile records and sorted
+ * map output (shuffle) segments. Files named on the command line are
+ * measured as well.
+ *
+ * Usage: bench_codecs [MB processed per measurement, default 64] [file ...]
+ */
+
+#include "config.h"
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef HADOOP_SNAPPY_LIBRARY
+#include <snappy-c.h>
+#endif
+
+static const size_t BUFFER_SIZES[] = { 64 * 1024, 256 * 1024, 1024 * 1024,
+  4 * 1024 * 1024 };
+
+#define NUM_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+#define CORPUS_SIZE (16 * 1024 * 1024)
+
+/* The bundled lz4, as declared in Lz4Compressor.c and Lz4Decompressor.c */
+extern void* LZ4_createCtx(void);
+extern void LZ4_freeCtx(void* ctx);
+extern int LZ4_compressWithCtx(void* ctx, const char* source, char* dest, int isize);
+extern int LZ4_compressHC(const char* source, char* dest, int isize);
+extern int LZ4_uncompress_unknownOutputSize(const char* source, char* dest, int isize, int maxOutputSize);
+
+static int (*dlsym_compress2)(Bytef *, uLongf *, const Bytef *, uLong, int);
+static int (*dlsym_uncompress)(Bytef *, uLongf *, const Bytef *, uLong);
+static uLong (*dlsym_compressBound)(uLong);
+
+#ifdef HADOOP_SNAPPY_LIBRARY
+static snappy_status (*dlsym_snappy_compress)(const char*, size_t, char*, size_t*);
+static snappy_status (*dlsym_snappy_uncompress)(const char*, size_t, char*, size_t*);
+static size_t (*dlsym_snappy_max_compressed_length)(size_t);
+#endif
+
+static void *lz4_ctx;
+
+/**
+ * A block codec. compress and decompress return 0 on success and update
+ * *dst_len from the capacity of dst to the length of the output.
+ */
+struct codec {
+  const char *name;
+  int (*load)(void);
+  size_t (*bound)(size_t len);
+  int (*compress)(const char *src, size_t len, char *dst, size_t *dst_len);
+  int (*decompress)(const char *src, size_t len, char *dst, size_t *dst_len);
+};
+
+static int load_zlib(void)
+{
+  void *lib = dlopen(HADOOP_ZLIB_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+  if (!lib) {
+    return -1;
+  }
+  dlerror();
+  *(void **)(&dlsym_compress2) = dlsym(lib, "compress2");
+  *(void **)(&dlsym_uncompress) = dlsym(lib, "uncompress");
+  *(void **)(&dlsym_compressBound) = dlsym(lib, "compressBound");
+  return (dlsym_compress2 && dlsym_uncompress && dlsym_compressBound) ? 0 : -1;
+}
+
+static size_t zlib_bound(size_t len)
+{
+  return dlsym_compressBound(len);
+}
+
+static int zlib_compress(const char *src, size_t len, char *dst,
+                         size_t *dst_len, int level)
+{
+  uLongf out_len = *dst_len;
+  if (dlsym_compress2((Bytef *)dst, &out_len, (const Bytef *)src, len,
+                      level) != Z_OK) {
+    return -1;
+  }
+  *dst_len = out_len;
+  return 0;
+}
+
+static int zlib1_compress(const char *src, size_t len, char *dst,
+                          size_t *dst_len)
+{
+  return zlib_compress(src, len, dst, dst_len, 1);
+}
+
+static int zlib6_compress(const char *src, size_t len, char *dst,
+                          size_t *dst_len)
+{
+  return zlib_compress(src, len, dst, dst_len, 6);
+}
+
+static int zlib_decompress(const char *src, size_t len, char *dst,
+                           size_t *dst_len)
+{
+  uLongf out_len = *dst_len;
+  if (dlsym_uncompress((Bytef *)dst, &out_len, (const Bytef *)src,
+                       len) != Z_OK) {
+    return -1;
+  }
+  *dst_len = out_len;
+  return 0;
+}
+
+#ifdef HADOOP_SNAPPY_LIBRARY
+static int load_snappy(void)
+{
+  void *lib = dlopen(HADOOP_SNAPPY_LIBRARY, RTLD_LAZY | RTLD_GLOBAL);
+  if (!lib) {
+    return -1;
+  }
+  dlerror();
+  *(void **)(&dlsym_snappy_compress) = dlsym(lib, "snappy_compress");
+  *(void **)(&dlsym_snappy_uncompress) = dlsym(lib, "snappy_uncompress");
+  *(void **)(&dlsym_snappy_max_compressed_length) =
+      dlsym(lib, "snappy_max_compressed_length");
+  return (dlsym_snappy_compress && dlsym_snappy_uncompress &&
+          dlsym_snappy_max_compressed_length) ? 0 : -1;
+}
+
+static size_t snappy_bound(size_t len)
+{
+  return dlsym_snappy_max_compressed_length(len);
+}
+
+static int snappy_compress_block(const char *src, size_t len, char *dst,
+                                 size_t *dst_len)
+{
+  return dlsym_snappy_compress(src, len, dst, dst_len) == SNAPPY_OK ? 0 : -1;
+}
+
+static int snappy_decompress_block(const char *src, size_t len, char *dst,
+                                   size_t *dst_len)
+{
+  return dlsym_snappy_uncompress(src, len, dst, dst_len) == SNAPPY_OK ? 0 : -1;
+}
+#endif
+
+static int load_lz4(void)
+{
+  if (!lz4_ctx) {
+    lz4_ctx = LZ4_createCtx();
+  }
+  return lz4_ctx ? 0 : -1;
+}
+
+static size_t lz4_bound(size_t len)
+{
+  return len + len / 255 + 16;
+}
+
+static int lz4_compress(const char *src, size_t len, char *dst,
+                        size_t *dst_len)
+{
+  int ret = LZ4_compressWithCtx(lz4_ctx, src, dst, len);
+  if (ret < 0) {
+    return -1;
+  }
+  *dst_len = ret;
+  return 0;
+}
+
+static int lz4hc_compress(const char *src, size_t len, char *dst,
+                          size_t *dst_len)
+{
+  int ret = LZ4_compressHC(src, dst, len);
+  if (ret < 0) {
+    return -1;
+  }
+  *dst_len = ret;
+  return 0;
+}
+
+static int lz4_decompress(const char *src, size_t len, char *dst,
+                          size_t *dst_len)
+{
+  int ret = LZ4_uncompress_unknownOutputSize(src, dst, len, *dst_len);
+  if (ret < 0) {
+    return -1;
+  }
+  *dst_len = ret;
+  return 0;
+}
+
+static const struct codec CODECS[] = {
+  { "zlib-1", load_zlib, zlib_bound, zlib1_compress, zlib_decompress },
+  { "zlib-6", load_zlib, zlib_bound, zlib6_compress, zlib_decompress },
+#ifdef HADOOP_SNAPPY_LIBRARY
+  { "snappy", load_snappy, snappy_bound, snappy_compress_block,
+    snappy_decompress_block },
+#endif
+  { "lz4", load_lz4, lz4_bound, lz4_compress, lz4_decompress },
+  { "lz4hc", load_lz4, lz4_bound, lz4hc_compress, lz4_decompress },
+};
+
+struct corpus {
+  const char *name;
+  char *data;
+  size_t len;
+};
+
+/* A small deterministic generator, so runs are comparable */
+static uint32_t rnd_state = 0x12345678;
+
+static uint32_t rnd(void)
+{
+  rnd_state = rnd_state * 1103515245 + 12345;
+  return rnd_state >> 8;
+}
+
+/* Skewed towards small values, roughly like word frequencies */
+static uint32_t rnd_skewed(uint32_t n)
+{
+  uint32_t r = rnd() % n;
+  return (r * r) / n;
+}
+
+static const char *WORDS[] = {
+  "the", "of", "and", "to", "a", "in", "is", "that", "for", "it", "as",
+  "was", "with", "be", "by", "on", "not", "he", "this", "are", "or", "his",
+  "from", "at", "which", "but", "have", "an", "had", "they", "you", "were",
+  "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+  "more", "when", "will", "would", "who", "so", "no", "data", "block",
+  "node", "cluster", "replica", "namenode", "datanode", "compression",
+  "throughput", "latency", "record", "reducer", "mapper", "partition",
+  "checksum", "heartbeat", "scheduler", "container", "application",
+};
+
+static size_t put_vint(char *p, int64_t v)
+{
+  /* Hadoop's WritableUtils.writeVLong encoding */
+  size_t n = 0;
+  int len = -112, i;
+  uint64_t u;
+
+  if (v >= -112 && v <= 127) {
+    p[0] = (char)v;
+    return 1;
+  }
+  if (v < 0) {
+    v ^= -1L;
+    len = -120;
+  }
+  for (u = v; u != 0; u >>= 8) {
+    len--;
+  }
+  p[n++] = (char)len;
+  len = (len < -120) ? -(len + 120) : -(len + 112);
+  for (i = len; i != 0; i--) {
+    p[n++] = (char)((v >> ((i - 1) * 8)) & 0xff);
+  }
+  return n;
+}
+
+static size_t put_be32(char *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+  return 4;
+}
+
+static size_t make_line(char *p, size_t max)
+{
+  size_t n = 0, w;
+  while (n + 16 < max) {
+    const char *word = WORDS[rnd_skewed(NUM_ELEMS(WORDS))];
+    w = strlen(word);
+    memcpy(p + n, word, w);
+    n += w;
+    if (rnd() % 13 == 0) {
+      p[n++] = ',';
+    }
+    if (n > 60 + rnd() % 30) {
+      break;
+    }
+    p[n++] = ' ';
+  }
+  p[n++] = '.';
+  p[n++] = '\n';
+  return n;
+}
+
+static void make_text(struct corpus *c)
+{
+  size_t n = 0;
+  while (n + 128 < c->len) {
+    n += make_line(c->data + n, 128);
+  }
+  memset(c->data + n, '\n', c->len - n);
+}
+
+/* Text keys and log-like Text values, with a sync marker every ~2KB */
+static void make_seqfile(struct corpus *c)
+{
+  char sync[16], key[32], value[256];
+  size_t n = 0, since_sync = 0, key_len, value_len, hdr;
+  uint32_t id = 0;
+  int i;
+
+  for (i = 0; i < 16; i++) {
+    sync[i] = rnd();
+  }
+  n += snprintf(c->data, c->len, "SEQ\006%corg.apache.hadoop.io.Text"
+                "%corg.apache.hadoop.io.Text", 25, 25);
+  memcpy(c->data + n, sync, sizeof(sync));
+  n += sizeof(sync);
+  while (n + 512 < c->len) {
+    if (since_sync > 2000) {
+      n += put_be32(c->data + n, 0xffffffff);
+      memcpy(c->data + n, sync, sizeof(sync));
+      n += sizeof(sync);
+      since_sync = 0;
+    }
+    key_len = snprintf(key, sizeof(key), "user_%08u", id++ * 7919 % 100000000);
+    value_len = snprintf(value, sizeof(value),
+        "%u,host%03u.example.com,/%s/%s/part-%05u,%u,%u",
+        1350000000 + id * 3, rnd_skewed(500),
+        WORDS[rnd_skewed(NUM_ELEMS(WORDS))],
+        WORDS[rnd_skewed(NUM_ELEMS(WORDS))], rnd() % 1000,
+        rnd() % 16 ? 200 : 404, rnd() % 65536);
+    hdr = n;
+    n += 8;
+    n += put_vint(c->data + n, key_len);
+    memcpy(c->data + n, key, key_len);
+    n += key_len;
+    n += put_vint(c->data + n, value_len);
+    memcpy(c->data + n, value, value_len);
+    n += value_len;
+    put_be32(c->data + hdr, n - hdr - 8);
+    put_be32(c->data + hdr + 4, key_len + 1);
+    since_sync += n - hdr;
+  }
+  memset(c->data + n, 0, c->len - n);
+}
+
+/* An IFile segment of sorted Text keys with LongWritable counts */
+static void make_shuffle(struct corpus *c)
+{
+  char key[64];
+  size_t n = 0, key_len;
+  uint32_t word = 0, suffix = 0;
+  int i;
+
+  while (n + 128 < c->len) {
+    if (rnd() % 4 == 0) {
+      word++;
+      suffix = 0;
+    }
+    key_len = snprintf(key, sizeof(key), "%s_%06u_%04u",
+                       WORDS[word % NUM_ELEMS(WORDS)],
+                       word / (uint32_t)NUM_ELEMS(WORDS), suffix++);
+    n += put_vint(c->data + n, key_len);
+    n += put_vint(c->data + n, 8);
+    memcpy(c->data + n, key, key_len);
+    n += key_len;
+    for (i = 0; i < 8; i++) {
+      c->data[n++] = i < 5 ? 0 : (char)rnd_skewed(256);
+    }
+  }
+  /* EOF marker */
+  n += put_vint(c->data + n, -1);
+  n += put_vint(c->data + n, -1);
+  memset(c->data + n, 0, c->len - n);
+}
+
+static int load_file(struct corpus *c, const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  long len;
+
+  if (!fp) {
+    return -1;
+  }
+  if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0 ||
+      fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    return -1;
+  }
+  c->name = path;
+  c->len = len;
+  c->data = malloc(c->len);
+  if (!c->data || fread(c->data, 1, c->len, fp) != c->len) {
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  return 0;
+}
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run one measurement. Returns 0 on success, or -1 if the codec failed or
+ * did not round-trip the data.
+ */
+static int bench(const struct codec *codec, const struct corpus *c,
+                 size_t block_size, size_t total_bytes, double *ratio,
+                 double *compress_mbps, double *decompress_mbps)
+{
+  size_t num_blocks = (c->len + block_size - 1) / block_size;
+  size_t bound = codec->bound(block_size), iters, i, b, out_len;
+  size_t compressed_total = 0;
+  char *compressed = NULL, *uncompressed = NULL;
+  size_t *compressed_len = NULL;
+  double start;
+  int ret = -1;
+
+  iters = total_bytes / c->len;
+  if (iters == 0) {
+    iters = 1;
+  }
+  compressed = malloc(bound * num_blocks);
+  compressed_len = malloc(sizeof(size_t) * num_blocks);
+  uncompressed = malloc(block_size);
+  if (!compressed || !compressed_len || !uncompressed) {
+    goto done;
+  }
+
+  start = now_sec();
+  for (i = 0; i < iters; i++) {
+    for (b = 0; b < num_blocks; b++) {
+      size_t off = b * block_size;
+      size_t len = c->len - off < block_size ? c->len - off : block_size;
+      compressed_len[b] = bound;
+      if (codec->compress(c->data + off, len, compressed + b * bound,
+                          &compressed_len[b])) {
+        goto done;
+      }
+    }
+  }
+  *compress_mbps = (iters * (double)c->len) / (now_sec() - start) / 1e6;
+  for (b = 0; b < num_blocks; b++) {
+    compressed_total += compressed_len[b];
+  }
+  *ratio = (double)c->len / compressed_total;
+
+  start = now_sec();
+  for (i = 0; i < iters; i++) {
+    for (b = 0; b < num_blocks; b++) {
+      out_len = block_size;
+      if (codec->decompress(compressed + b * bound, compressed_len[b],
+                            uncompressed, &out_len)) {
+        goto done;
+      }
+      if (i == 0) {
+        size_t off = b * block_size;
+        size_t len = c->len - off < block_size ? c->len - off : block_size;
+        if (out_len != len || memcmp(uncompressed, c->data + off, len)) {
+          goto done;
+        }
+      }
+    }
+  }
+  *decompress_mbps = (iters * (double)c->len) / (now_sec() - start) / 1e6;
+  ret = 0;
+
+done:
+  free(compressed);
+  free(compressed_len);
+  free(uncompressed);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t total_bytes = 64 * 1024 * 1024;
+  struct corpus *corpora;
+  int num_corpora = 0, first_file = 1, i, k, s;
+  double ratio, compress_mbps, decompress_mbps;
+
+  if (argc > 1) {
+    char *end;
+    total_bytes = strtoul(argv[1], &end, 10) * 1024 * 1024;
+    if (*end == '\0') {
+      first_file = 2;
+    } else {
+      total_bytes = 64 * 1024 * 1024;
+    }
+    if (total_bytes == 0) {
+      fprintf(stderr, "usage: %s [MB processed per measurement] "
+              "[file ...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  corpora = calloc(sizeof(struct corpus), 3 + argc);
+  if (!corpora) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  corpora[0].name = "text";
+  corpora[1].name = "seqfile";
+  corpora[2].name = "shuffle";
+  for (i = 0; i < 3; i++) {
+    corpora[i].len = CORPUS_SIZE;
+    corpora[i].data = malloc(CORPUS_SIZE);
+    if (!corpora[i].data) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  make_text(&corpora[0]);
+  make_seqfile(&corpora[1]);
+  make_shuffle(&corpora[2]);
+  num_corpora = 3;
+  for (i = first_file; i < argc; i++) {
+    if (load_file(&corpora[num_corpora], argv[i])) {
+      fprintf(stderr, "%s: could not read %s\n", argv[0], argv[i]);
+      return EXIT_FAILURE;
+    }
+    num_corpora++;
+  }
+
+  printf("%-10s %-8s %10s %7s %14s %16s\n", "corpus", "codec", "buflen",
+         "ratio", "compress MB/s", "decompress MB/s");
+  for (k = 0; k < NUM_ELEMS(CODECS); k++) {
+    if (CODECS[k].load()) {
+      printf("%-10s %-8s (library not available)\n", "-", CODECS[k].name);
+      continue;
+    }
+    for (i = 0; i < num_corpora; i++) {
+      for (s = 0; s < NUM_ELEMS(BUFFER_SIZES); s++) {
+        if (bench(&CODECS[k], &corpora[i], BUFFER_SIZES[s], total_bytes,
+                  &ratio, &compress_mbps, &decompress_mbps)) {
+          fprintf(stderr, "%s failed on %s with %zu byte buffers\n",
+                  CODECS[k].name, corpora[i].name, BUFFER_SIZES[s]);
+          return EXIT_FAILURE;
+        }
+        printf("%-10s %-8s %10zu %7.2f %14.1f %16.1f\n", corpora[i].name,
+               CODECS[k].name, BUFFER_SIZES[s], ratio, compress_mbps,
+               decompress_mbps);
+      }
+    }
+  }
+  if (lz4_ctx) {
+    LZ4_freeCtx(lz4_ctx);
+  }
+  for (i = 0; i < num_corpora; i++) {
+    free(corpora[i].data);
+  }
+  free(corpora);
+  return EXIT_SUCCESS;
+}
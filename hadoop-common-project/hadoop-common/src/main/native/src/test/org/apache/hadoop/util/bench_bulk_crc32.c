@@ -0,0 +1,173 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmark for bulk_crc32.
+ *
+ * For each checksum algorithm and implementation the CPU supports, this
+ * sweeps bytes_per_checksum, the buffer size and the alignment of the data,
+ * and prints the throughput of bulk_calculate_crc and bulk_verify_crc in
+ * GB/s.
+ *
+ * Usage: bench_bulk_crc32 [MB processed per measurement, default 256]
+ */
+
+#include "bulk_crc32.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const int BYTES_PER_CHECKSUM[] = { 512, 1024, 4096, 16384, 65536 };
+static const size_t BUFFER_SIZES[] = { 64 * 1024, 1024 * 1024,
+  16 * 1024 * 1024 };
+static const int ALIGNMENTS[] = { 0, 1, 4, 8 };
+
+#define NUM_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+static const struct {
+  int type;
+  const char *name;
+} ALGORITHMS[] = {
+  { CRC32C_POLYNOMIAL, "crc32c" },
+  { CRC32_ZLIB_POLYNOMIAL, "crc32" },
+};
+
+static const struct {
+  int impl;
+  const char *name;
+} IMPLS[] = {
+  { BULK_CRC_IMPL_SOFTWARE, "sb8" },
+  { BULK_CRC_IMPL_HARDWARE, "hardware" },
+  { BULK_CRC_IMPL_PIPELINED, "pipelined" },
+  { BULK_CRC_IMPL_WIDE, "wide" },
+};
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run one measurement. Returns 0 on success, or the error from bulk_crc32.
+ */
+static int bench(const uint8_t *data, size_t data_len, uint32_t *sums,
+                 int crc_type, int bytes_per_checksum, size_t total_bytes,
+                 double *calc_gbps, double *verify_gbps)
+{
+  size_t iters = total_bytes / data_len, i;
+  crc32_error_t error_info;
+  double start;
+  int ret;
+
+  if (iters == 0) {
+    iters = 1;
+  }
+  start = now_sec();
+  for (i = 0; i < iters; i++) {
+    ret = bulk_calculate_crc(data, data_len, sums, crc_type,
+                             bytes_per_checksum);
+    if (ret) {
+      return ret;
+    }
+  }
+  *calc_gbps = (iters * (double)data_len) / (now_sec() - start) / 1e9;
+
+  start = now_sec();
+  for (i = 0; i < iters; i++) {
+    ret = bulk_verify_crc(data, data_len, sums, crc_type,
+                          bytes_per_checksum, &error_info);
+    if (ret) {
+      return ret;
+    }
+  }
+  *verify_gbps = (iters * (double)data_len) / (now_sec() - start) / 1e9;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  size_t total_bytes = 256 * 1024 * 1024;
+  size_t max_buf = BUFFER_SIZES[NUM_ELEMS(BUFFER_SIZES) - 1], i;
+  uint8_t *buf;
+  uint32_t *sums;
+  int a, m, b, s, l, ret;
+  double calc_gbps, verify_gbps;
+
+  if (argc > 1) {
+    total_bytes = strtoul(argv[1], NULL, 10) * 1024 * 1024;
+    if (total_bytes == 0) {
+      fprintf(stderr, "usage: %s [MB processed per measurement]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  buf = malloc(max_buf + 16);
+  sums = calloc(sizeof(uint32_t), max_buf / BYTES_PER_CHECKSUM[0] + 1);
+  if (!buf || !sums) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < max_buf + 16; i++) {
+    buf[i] = (uint8_t)(i * 31 + 7);
+  }
+
+  printf("%-8s %-10s %8s %10s %6s %12s %12s\n", "algo", "impl",
+         "bpc", "buflen", "align", "calc GB/s", "verify GB/s");
+  for (a = 0; a < NUM_ELEMS(ALGORITHMS); a++) {
+    for (m = 0; m < NUM_ELEMS(IMPLS); m++) {
+      ret = bulk_crc_force_implementation(IMPLS[m].impl);
+      if (ret == ENOTSUP) {
+        printf("%-8s %-10s (not supported on this CPU)\n",
+               ALGORITHMS[a].name, IMPLS[m].name);
+        continue;
+      } else if (ret) {
+        fprintf(stderr, "bulk_crc_force_implementation(%s) failed: %d\n",
+                IMPLS[m].name, ret);
+        return EXIT_FAILURE;
+      }
+      for (b = 0; b < NUM_ELEMS(BYTES_PER_CHECKSUM); b++) {
+        for (s = 0; s < NUM_ELEMS(BUFFER_SIZES); s++) {
+          if (BUFFER_SIZES[s] < BYTES_PER_CHECKSUM[b]) {
+            continue;
+          }
+          for (l = 0; l < NUM_ELEMS(ALIGNMENTS); l++) {
+            ret = bench(buf + ALIGNMENTS[l], BUFFER_SIZES[s], sums,
+                        ALGORITHMS[a].type, BYTES_PER_CHECKSUM[b],
+                        total_bytes, &calc_gbps, &verify_gbps);
+            if (ret) {
+              fprintf(stderr, "bulk crc failed with error %d\n", ret);
+              return EXIT_FAILURE;
+            }
+            printf("%-8s %-10s %8d %10zu %6d %12.2f %12.2f\n",
+                   ALGORITHMS[a].name, IMPLS[m].name, BYTES_PER_CHECKSUM[b],
+                   BUFFER_SIZES[s], ALIGNMENTS[l], calc_gbps, verify_gbps);
+          }
+        }
+      }
+    }
+  }
+  bulk_crc_force_implementation(BULK_CRC_IMPL_AUTO);
+  free(buf);
+  free(sums);
+  return EXIT_SUCCESS;
+}
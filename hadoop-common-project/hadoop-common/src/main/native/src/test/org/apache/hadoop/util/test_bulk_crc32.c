@@ -18,9 +18,12 @@
 
 #include "bulk_crc32.h"
 
+#include <arpa/inet.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define EXPECT_ZERO(x) \
     do { \
@@ -55,6 +58,300 @@ static int testBulkVerifyCrc(int dataLen, int crcType, int bytesPerChecksum)
   return 0;
 }
 
+/**
+ * Check that bulk_calculate_crc produces the expected checksum when the
+ * whole buffer is a single chunk.
+ */
+static int testBulkCalculateKnownCrc(const uint8_t *data, int dataLen,
+                                     int crcType, uint32_t expected)
+{
+  uint32_t sums[1];
+
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, sums, crcType, dataLen));
+  if (ntohl(sums[0]) != expected) {
+    fprintf(stderr, "TEST_ERROR: crc type %d, length %d: expected 0x%08x, "
+            "got 0x%08x\n", crcType, dataLen, expected, ntohl(sums[0]));
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Check bulk_calculate_crc against known checksums: the standard check
+ * values for the ASCII string "123456789", and buffers long enough to go
+ * through the hardware folding paths. The xxHash64 values are the low 32
+ * bits of the reference implementation's hashes.
+ */
+static int testBulkCalculateKnownCrcs(void)
+{
+  const char *check = "123456789";
+  uint8_t data[4099];
+  int i;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (i % 16) + 1;
+  }
+  EXPECT_ZERO(testBulkCalculateKnownCrc((const uint8_t*)check,
+        strlen(check), CRC32C_POLYNOMIAL, 0xe3069283));
+  EXPECT_ZERO(testBulkCalculateKnownCrc((const uint8_t*)check,
+        strlen(check), CRC32_ZLIB_POLYNOMIAL, 0xcbf43926));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 1000,
+        CRC32C_POLYNOMIAL, 0xc98c5191));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 1000,
+        CRC32_ZLIB_POLYNOMIAL, 0x67c84b48));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 4099,
+        CRC32C_POLYNOMIAL, 0xa978228e));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 4099,
+        CRC32_ZLIB_POLYNOMIAL, 0x5381c976));
+  EXPECT_ZERO(testBulkCalculateKnownCrc((const uint8_t*)check,
+        strlen(check), XXHASH64_CHECKSUM, 0x40e6ae83));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 1000,
+        XXHASH64_CHECKSUM, 0xa09e734f));
+  EXPECT_ZERO(testBulkCalculateKnownCrc(data, 4099,
+        XXHASH64_CHECKSUM, 0x36534379));
+  return 0;
+}
+
+/**
+ * Verify a buffer with the worker pool enabled, first intact and then with
+ * two corrupted chunks in different slices, and check that the first bad
+ * chunk is the one reported.
+ */
+static int testParallelVerifyCrc(int dataLen, int crcType,
+                                 int bytesPerChecksum, int numThreads)
+{
+  int i, ret;
+  uint8_t *data;
+  uint32_t *sums;
+  crc32_error_t errorData;
+  int firstBad = dataLen / 3, secondBad = dataLen - 1;
+
+  data = malloc(dataLen);
+  for (i = 0; i < dataLen; i++) {
+    data[i] = (i % 16) + 1;
+  }
+  sums = calloc(sizeof(uint32_t),
+                (dataLen + bytesPerChecksum - 1) / bytesPerChecksum);
+  EXPECT_ZERO(bulk_crc_set_parallelism(numThreads, 0));
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, sums, crcType,
+                                 bytesPerChecksum));
+  EXPECT_ZERO(bulk_verify_crc(data, dataLen, sums, crcType,
+                            bytesPerChecksum, &errorData));
+  data[secondBad]++;
+  data[firstBad]++;
+  ret = bulk_verify_crc(data, dataLen, sums, crcType,
+                        bytesPerChecksum, &errorData);
+  EXPECT_ZERO(bulk_crc_set_parallelism(0, 0));
+  if (ret != INVALID_CHECKSUM_DETECTED) {
+    fprintf(stderr, "TEST_ERROR: expected INVALID_CHECKSUM_DETECTED, "
+            "got %d\n", ret);
+    return 1;
+  }
+  if (errorData.bad_data !=
+      data + (firstBad / bytesPerChecksum) * bytesPerChecksum) {
+    fprintf(stderr, "TEST_ERROR: bad chunk reported at offset %ld, expected "
+            "the chunk containing offset %d\n",
+            (long)(errorData.bad_data - data), firstBad);
+    return 1;
+  }
+  free(data);
+  free(sums);
+  return 0;
+}
+
+/**
+ * Check that the checksum of a buffer computed from its chunk checksums
+ * matches the checksum computed over the whole buffer.
+ */
+static int testBulkCombineCrc(int dataLen, int crcType, int bytesPerChecksum)
+{
+  int i;
+  uint8_t *data;
+  uint32_t *sums;
+  uint32_t whole, combined, pair;
+  int split = dataLen / 2;
+
+  data = malloc(dataLen);
+  for (i = 0; i < dataLen; i++) {
+    data[i] = (i * 7) % 251;
+  }
+  sums = calloc(sizeof(uint32_t),
+                (dataLen + bytesPerChecksum - 1) / bytesPerChecksum + 1);
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, &whole, crcType, dataLen));
+  whole = ntohl(whole);
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, sums, crcType,
+                                 bytesPerChecksum));
+  EXPECT_ZERO(bulk_combine_crc(sums, dataLen, crcType, bytesPerChecksum,
+                               &combined));
+  if (combined != whole) {
+    fprintf(stderr, "TEST_ERROR: combined crc 0x%08x != whole crc 0x%08x\n",
+            combined, whole);
+    return 1;
+  }
+
+  EXPECT_ZERO(bulk_calculate_crc(data, split, &sums[0], crcType, split));
+  EXPECT_ZERO(bulk_calculate_crc(data + split, dataLen - split, &sums[1],
+                                 crcType, dataLen - split));
+  if (crcType == CRC32C_POLYNOMIAL) {
+    pair = crc32c_combine(ntohl(sums[0]), ntohl(sums[1]), dataLen - split);
+  } else {
+    pair = crc32_zlib_combine(ntohl(sums[0]), ntohl(sums[1]),
+                              dataLen - split);
+  }
+  if (pair != whole) {
+    fprintf(stderr, "TEST_ERROR: crc of two halves combined to 0x%08x, "
+            "expected 0x%08x\n", pair, whole);
+    return 1;
+  }
+  free(data);
+  free(sums);
+  return 0;
+}
+
+/**
+ * Check that the fused copy and checksum functions copy the data exactly
+ * and agree with bulk_calculate_crc and bulk_verify_crc.
+ */
+static int testBulkCopyCrc(int dataLen, int crcType, int bytesPerChecksum,
+                           int dstAlign)
+{
+  int i, ret, nSums = (dataLen + bytesPerChecksum - 1) / bytesPerChecksum;
+  uint8_t *data, *dstBuf, *dst;
+  uint32_t *sums, *copySums;
+  crc32_error_t errorData;
+
+  data = malloc(dataLen);
+  for (i = 0; i < dataLen; i++) {
+    data[i] = (i * 13) % 253;
+  }
+  dstBuf = malloc(dataLen + 16);
+  dst = dstBuf + dstAlign;
+  sums = calloc(sizeof(uint32_t), nSums);
+  copySums = calloc(sizeof(uint32_t), nSums);
+
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, sums, crcType,
+                                 bytesPerChecksum));
+  EXPECT_ZERO(bulk_copy_and_calculate_crc(data, dst, dataLen, copySums,
+                                          crcType, bytesPerChecksum));
+  EXPECT_ZERO(memcmp(sums, copySums, nSums * sizeof(uint32_t)));
+  EXPECT_ZERO(memcmp(data, dst, dataLen));
+
+  memset(dstBuf, 0, dataLen + 16);
+  EXPECT_ZERO(bulk_copy_and_verify_crc(data, dst, dataLen, sums, crcType,
+                                       bytesPerChecksum, &errorData));
+  EXPECT_ZERO(memcmp(data, dst, dataLen));
+
+  data[dataLen - 1]++;
+  ret = bulk_copy_and_verify_crc(data, dst, dataLen, sums, crcType,
+                                 bytesPerChecksum, &errorData);
+  if (ret != INVALID_CHECKSUM_DETECTED ||
+      errorData.bad_data != data + (nSums - 1) * bytesPerChecksum) {
+    fprintf(stderr, "TEST_ERROR: corrupt last chunk not detected by "
+            "bulk_copy_and_verify_crc (ret %d)\n", ret);
+    return 1;
+  }
+  free(data);
+  free(dstBuf);
+  free(sums);
+  free(copySums);
+  return 0;
+}
+
+/**
+ * Check that data checksummed as it arrives, in pieces of every size up to
+ * pieceMax, gets the same sums as the whole buffer, and that checksumming
+ * can be resumed from the sum of a partial chunk.
+ */
+static int testCrcState(int dataLen, int crcType, int bytesPerChecksum,
+                        int pieceMax)
+{
+  int i, nSums = (dataLen + bytesPerChecksum - 1) / bytesPerChecksum;
+  uint8_t *data;
+  uint32_t *sums, *stateSums;
+  uint32_t partial;
+  size_t off, n, len, got = 0;
+  int split, partialLen;
+  crc_state_t state, resumed;
+
+  data = malloc(dataLen);
+  for (i = 0; i < dataLen; i++) {
+    data[i] = (i * 13) % 251;
+  }
+  sums = calloc(sizeof(uint32_t), nSums);
+  stateSums = calloc(sizeof(uint32_t), nSums + 1);
+  EXPECT_ZERO(bulk_calculate_crc(data, dataLen, sums, crcType,
+                                 bytesPerChecksum));
+
+  EXPECT_ZERO(crc_state_init(&state, crcType, bytesPerChecksum));
+  for (off = 0, len = 1; off < dataLen; off += len, len = len % pieceMax + 1) {
+    if (len > dataLen - off) {
+      len = dataLen - off;
+    }
+    n = crc_state_update(&state, data + off, len, stateSums + got);
+    got += n;
+    // What an hflush here would report for the last chunk
+    partialLen = crc_state_final(&state, &partial);
+    if (partialLen != (off + len) % bytesPerChecksum ||
+        got != (off + len) / bytesPerChecksum) {
+      fprintf(stderr, "TEST_ERROR: at %d bytes, %d sums and a partial "
+              "chunk of %d\n", (int)(off + len), (int)got, partialLen);
+      return 1;
+    }
+  }
+  if (crc_state_final(&state, &partial)) {
+    stateSums[got++] = partial;
+  }
+  EXPECT_ZERO(got != nSums);
+  EXPECT_ZERO(memcmp(sums, stateSums, nSums * sizeof(uint32_t)));
+
+  // Resume in the middle of the last chunk from its sum alone
+  split = dataLen - 1 - (dataLen - 1) % bytesPerChecksum +
+          ((dataLen - 1) % bytesPerChecksum) / 2;
+  partialLen = split % bytesPerChecksum;
+  if (partialLen > 0) {
+    EXPECT_ZERO(bulk_calculate_crc(data + split - partialLen, partialLen,
+                                   &partial, crcType, bytesPerChecksum));
+    EXPECT_ZERO(crc_state_resume(&resumed, crcType, bytesPerChecksum,
+                                 partial, partialLen));
+    n = crc_state_update(&resumed, data + split, dataLen - split, stateSums);
+    if (crc_state_final(&resumed, &partial)) {
+      stateSums[n++] = partial;
+    }
+    EXPECT_ZERO(n != 1);
+    EXPECT_ZERO(stateSums[0] != sums[nSums - 1]);
+  }
+  EXPECT_ZERO(crc_state_resume(&resumed, crcType, bytesPerChecksum, 0,
+                               bytesPerChecksum) == 0);
+  free(data);
+  free(sums);
+  free(stateSums);
+  return 0;
+}
+
+/**
+ * Run the known-answer checks against every implementation the CPU
+ * supports, to make sure they agree with each other.
+ */
+static int testAllImplementations(void)
+{
+  static const int impls[] = { BULK_CRC_IMPL_SOFTWARE,
+    BULK_CRC_IMPL_HARDWARE, BULK_CRC_IMPL_PIPELINED, BULK_CRC_IMPL_WIDE,
+    BULK_CRC_IMPL_AUTO };
+  int i, ret;
+
+  for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    ret = bulk_crc_force_implementation(impls[i]);
+    if (ret == ENOTSUP) {
+      continue;
+    }
+    EXPECT_ZERO(ret);
+    EXPECT_ZERO(testBulkCalculateKnownCrcs());
+    EXPECT_ZERO(testBulkVerifyCrc(4096 + 100, CRC32C_POLYNOMIAL, 512));
+    EXPECT_ZERO(testBulkVerifyCrc(4096 + 100, CRC32_ZLIB_POLYNOMIAL, 512));
+  }
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
   /* Test running bulk_calculate_crc with some different algorithms and
@@ -71,6 +368,31 @@ int main(int argc, char **argv)
   EXPECT_ZERO(testBulkVerifyCrc(17, CRC32_ZLIB_POLYNOMIAL, 2));
   EXPECT_ZERO(testBulkVerifyCrc(17, CRC32C_POLYNOMIAL, 4));
   EXPECT_ZERO(testBulkVerifyCrc(17, CRC32_ZLIB_POLYNOMIAL, 4));
+  EXPECT_ZERO(testBulkVerifyCrc(4096 + 100, CRC32C_POLYNOMIAL, 512));
+  EXPECT_ZERO(testBulkVerifyCrc(3 * 512 + 7, CRC32C_POLYNOMIAL, 512));
+  EXPECT_ZERO(testBulkVerifyCrc(4096 + 100, XXHASH64_CHECKSUM, 512));
+  EXPECT_ZERO(testBulkVerifyCrc(17, XXHASH64_CHECKSUM, 4));
+  EXPECT_ZERO(testAllImplementations());
+  EXPECT_ZERO(testParallelVerifyCrc(1024 * 1024 + 3, CRC32C_POLYNOMIAL,
+                                    512, 4));
+  EXPECT_ZERO(testParallelVerifyCrc(1024 * 1024, CRC32_ZLIB_POLYNOMIAL,
+                                    512, 3));
+  EXPECT_ZERO(testParallelVerifyCrc(5 * 512, CRC32C_POLYNOMIAL, 512, 8));
+  EXPECT_ZERO(testParallelVerifyCrc(1024 * 1024, XXHASH64_CHECKSUM,
+                                    512, 3));
+  EXPECT_ZERO(testBulkCombineCrc(4096, CRC32C_POLYNOMIAL, 512));
+  EXPECT_ZERO(testBulkCombineCrc(4096 + 77, CRC32_ZLIB_POLYNOMIAL, 512));
+  EXPECT_ZERO(testBulkCombineCrc(17, CRC32C_POLYNOMIAL, 4));
+  EXPECT_ZERO(testBulkCombineCrc(100000, CRC32_ZLIB_POLYNOMIAL, 65536));
+  EXPECT_ZERO(testBulkCopyCrc(64 * 1024 + 5, CRC32C_POLYNOMIAL, 512, 0));
+  EXPECT_ZERO(testBulkCopyCrc(64 * 1024 + 5, CRC32_ZLIB_POLYNOMIAL, 512, 3));
+  EXPECT_ZERO(testBulkCopyCrc(100000, CRC32C_POLYNOMIAL, 65536, 9));
+  EXPECT_ZERO(testBulkCopyCrc(17, CRC32C_POLYNOMIAL, 4, 1));
+  EXPECT_ZERO(testBulkCopyCrc(64 * 1024 + 5, XXHASH64_CHECKSUM, 512, 7));
+  EXPECT_ZERO(testCrcState(4096 + 100, CRC32C_POLYNOMIAL, 512, 1500));
+  EXPECT_ZERO(testCrcState(4096 + 100, CRC32_ZLIB_POLYNOMIAL, 512, 700));
+  EXPECT_ZERO(testCrcState(64 * 512 + 3, CRC32C_POLYNOMIAL, 512, 5000));
+  EXPECT_ZERO(testCrcState(17, CRC32C_POLYNOMIAL, 4, 3));
 
   fprintf(stderr, "%s: SUCCESS.\n", argv[0]);
   return EXIT_SUCCESS;
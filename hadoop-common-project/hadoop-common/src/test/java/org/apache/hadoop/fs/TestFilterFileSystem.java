@@ -163,6 +163,7 @@ public void processDeleteOnExit() { }
     public FileStatus[] listStatus(Path f, PathFilter filter) { return null; }
     public FileStatus[] listStatus(Path[] files) { return null; }
     public FileStatus[] listStatus(Path[] files, PathFilter filter) { return null; }
+    public FileStatus[] getFileStatus(Path[] files) { return null; }
     public FileStatus[] globStatus(Path pathPattern) { return null; }
     public FileStatus[] globStatus(Path pathPattern, PathFilter filter) {
       return null;
@@ -174,6 +175,9 @@ public Iterator<LocatedFileStatus> listFiles(
     public Iterator<LocatedFileStatus> listLocatedStatus(Path f) {
       return null;
     }
+    public Iterator<FileStatus> listStatusIterator(Path f) {
+      return null;
+    }
     public Iterator<LocatedFileStatus> listLocatedStatus(Path f,
         final PathFilter filter) {
       return null;
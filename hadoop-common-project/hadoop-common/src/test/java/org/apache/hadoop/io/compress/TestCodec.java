@@ -33,14 +33,18 @@
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.io.OutputStreamWriter;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashMap;
+import java.util.List;
 import java.util.Map;
 import java.util.Random;
 import java.util.zip.GZIPInputStream;
 import java.util.zip.GZIPOutputStream;
 
 import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.ChecksumException;
 import org.apache.hadoop.fs.CommonConfigurationKeys;
 import org.apache.hadoop.fs.FileStatus;
 import org.apache.hadoop.fs.FileSystem;
@@ -54,12 +58,20 @@
 import org.apache.hadoop.io.Text;
 import org.apache.hadoop.io.Writable;
 import org.apache.hadoop.io.SequenceFile.CompressionType;
+import org.apache.hadoop.io.compress.bzip2.BZip2DummyDecompressor;
+import org.apache.hadoop.io.compress.bzip2.Bzip2Compressor;
+import org.apache.hadoop.io.compress.bzip2.Bzip2Factory;
+import org.apache.hadoop.io.compress.lz4.Lz4Compressor;
+import org.apache.hadoop.io.compress.lz4.Lz4Decompressor;
+import org.apache.hadoop.io.compress.snappy.SnappyCompressor;
+import org.apache.hadoop.io.compress.snappy.SnappyDecompressor;
 import org.apache.hadoop.io.compress.zlib.BuiltInGzipDecompressor;
 import org.apache.hadoop.io.compress.zlib.BuiltInZlibDeflater;
 import org.apache.hadoop.io.compress.zlib.BuiltInZlibInflater;
 import org.apache.hadoop.io.compress.zlib.ZlibCompressor;
 import org.apache.hadoop.io.compress.zlib.ZlibCompressor.CompressionLevel;
 import org.apache.hadoop.io.compress.zlib.ZlibCompressor.CompressionStrategy;
+import org.apache.hadoop.io.compress.zlib.ZlibDecompressor;
 import org.apache.hadoop.io.compress.zlib.ZlibFactory;
 import org.apache.hadoop.util.LineReader;
 import org.apache.hadoop.util.NativeCodeLoader;
@@ -99,6 +111,42 @@ public void testBZip2Codec() throws IOException {
     codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.BZip2Codec");
     codecTest(conf, seed, count, "org.apache.hadoop.io.compress.BZip2Codec");
   }
+
+  @Test
+  public void testNativeBzip2Codec() throws IOException {
+    Configuration conf = new Configuration(this.conf);
+    Assume.assumeTrue(Bzip2Factory.isNativeBzip2Loaded(conf));
+    codecTest(conf, seed, count, "org.apache.hadoop.io.compress.BZip2Codec");
+    Bzip2Factory.setBlockSize(conf, 1);
+    Bzip2Factory.setDecompressionThreads(conf, 4);
+    codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.BZip2Codec");
+    codecTest(conf, seed, count, "org.apache.hadoop.io.compress.BZip2Codec");
+
+    // Streams written natively are read back by the Java implementation
+    BZip2Codec codec = ReflectionUtils.newInstance(BZip2Codec.class, conf);
+    assertEquals(Bzip2Compressor.class, codec.getCompressorType());
+    byte[] data = new byte[1 << 20];
+    new Random(seed).nextBytes(data);
+    Arrays.fill(data, 0, data.length / 2, (byte) 'a');
+    ByteArrayOutputStream compressed = new ByteArrayOutputStream();
+    CompressionOutputStream out = codec.createOutputStream(compressed);
+    out.write(data);
+    out.close();
+    Configuration javaConf = new Configuration(conf);
+    javaConf.set(CommonConfigurationKeys.IO_COMPRESSION_CODEC_BZIP2_LIBRARY_KEY,
+        "java-builtin");
+    BZip2Codec javaCodec = ReflectionUtils.newInstance(BZip2Codec.class,
+        javaConf);
+    assertEquals(BZip2DummyDecompressor.class,
+        javaCodec.getDecompressorType());
+    DataInputStream in = new DataInputStream(javaCodec.createInputStream(
+        new ByteArrayInputStream(compressed.toByteArray())));
+    byte[] result = new byte[data.length];
+    in.readFully(result);
+    assertEquals(-1, in.read());
+    in.close();
+    assertArrayEquals(data, result);
+  }
   
   @Test
   public void testSnappyCodec() throws IOException {
@@ -107,6 +155,43 @@ public void testSnappyCodec() throws IOException {
       codecTest(conf, seed, count, "org.apache.hadoop.io.compress.SnappyCodec");
     }
   }
+
+  @Test
+  public void testFramedSnappyCodec() throws IOException {
+    if (SnappyCodec.isNativeCodeLoaded()) {
+      codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.FramedSnappyCodec");
+      codecTest(conf, seed, count, "org.apache.hadoop.io.compress.FramedSnappyCodec");
+    }
+  }
+
+  @Test
+  public void testFramedSnappyChecksum() throws IOException {
+    Assume.assumeTrue(SnappyCodec.isNativeCodeLoaded());
+    FramedSnappyCodec codec = ReflectionUtils.newInstance(
+        FramedSnappyCodec.class, conf);
+    // Random data is stored rather than compressed, so a flipped byte is
+    // caught by the chunk checksum rather than by snappy itself
+    byte[] data = new byte[1024];
+    new Random(seed).nextBytes(data);
+    ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+    CompressionOutputStream out = codec.createOutputStream(bytes);
+    out.write(data);
+    out.close();
+    byte[] compressed = bytes.toByteArray();
+    assertEquals("sNaPpY", new String(compressed, 4, 6, "US-ASCII"));
+
+    compressed[compressed.length - 1] ^= 1;
+    CompressionInputStream in = codec.createInputStream(
+        new ByteArrayInputStream(compressed));
+    try {
+      IOUtils.readFully(in, new byte[data.length], 0, data.length);
+      fail("Expected a checksum error");
+    } catch (ChecksumException e) {
+      // expected
+    } finally {
+      in.close();
+    }
+  }
   
   @Test
   public void testLz4Codec() throws IOException {
@@ -120,6 +205,91 @@ public void testLz4Codec() throws IOException {
     }
   }
 
+  @Test
+  public void testLz4HCCodec() throws IOException {
+    if (NativeCodeLoader.isNativeCodeLoaded() && Lz4Codec.isNativeCodeLoaded()) {
+      Configuration hcConf = new Configuration(conf);
+      hcConf.setBoolean(
+          CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_USELZ4HC_KEY, true);
+      codecTest(hcConf, seed, 0, "org.apache.hadoop.io.compress.Lz4Codec");
+      codecTest(hcConf, seed, count, "org.apache.hadoop.io.compress.Lz4Codec");
+    }
+  }
+
+  @Test
+  public void testLz4StreamingCodec() throws IOException {
+    if (NativeCodeLoader.isNativeCodeLoaded() && Lz4Codec.isNativeCodeLoaded()) {
+      Configuration streamingConf = new Configuration(conf);
+      streamingConf.setBoolean(
+          CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BLOCK_INDEPENDENT_KEY,
+          false);
+      // Use small buffers so that most blocks refer back to earlier ones
+      streamingConf.setInt(
+          CommonConfigurationKeys.IO_COMPRESSION_CODEC_LZ4_BUFFERSIZE_KEY,
+          4 * 1024);
+      codecTest(streamingConf, seed, 0, "org.apache.hadoop.io.compress.Lz4Codec");
+      codecTest(streamingConf, seed, count, "org.apache.hadoop.io.compress.Lz4Codec");
+    }
+  }
+
+  @Test
+  public void testDirectBufferDecompress() throws IOException {
+    if (SnappyCodec.isNativeCodeLoaded()) {
+      directBufferDecompressTest(new SnappyCompressor(), new SnappyDecompressor());
+    }
+    if (NativeCodeLoader.isNativeCodeLoaded() && Lz4Codec.isNativeCodeLoaded()) {
+      directBufferDecompressTest(new Lz4Compressor(), new Lz4Decompressor());
+    }
+  }
+
+  private void directBufferDecompressTest(Compressor compressor,
+      Decompressor decompressor) throws IOException {
+    byte[] data = new byte[16 * 1024];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte) (i % 7 == 0 ? i : 'a' + i % 13);
+    }
+    compressor.setInput(data, 0, data.length);
+    compressor.finish();
+    byte[] compressed = new byte[data.length * 2];
+    int len = 0;
+    while (!compressor.finished()) {
+      len += compressor.compress(compressed, len, compressed.length - len);
+    }
+    compressor.end();
+
+    ByteBuffer src = ByteBuffer.allocateDirect(len);
+    src.put(compressed, 0, len);
+    src.flip();
+    ByteBuffer dst = ByteBuffer.allocateDirect(data.length + 10);
+    dst.position(10);
+    int n;
+    if (decompressor instanceof SnappyDecompressor) {
+      n = ((SnappyDecompressor) decompressor).decompress(src, dst);
+    } else {
+      n = ((Lz4Decompressor) decompressor).decompress(src, dst);
+    }
+    decompressor.end();
+    assertEquals(data.length, n);
+    assertEquals(0, src.remaining());
+    assertEquals(10 + data.length, dst.position());
+    byte[] result = new byte[data.length];
+    dst.position(10);
+    dst.get(result);
+    assertArrayEquals(data, result);
+  }
+
+  @Test
+  public void testZStandardCodec() throws IOException {
+    if (ZStandardCodec.isNativeCodeLoaded()) {
+      codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.ZStandardCodec");
+      codecTest(conf, seed, count, "org.apache.hadoop.io.compress.ZStandardCodec");
+      Configuration levelConf = new Configuration(conf);
+      levelConf.setInt(
+          CommonConfigurationKeys.IO_COMPRESSION_CODEC_ZSTD_LEVEL_KEY, 19);
+      codecTest(levelConf, seed, count, "org.apache.hadoop.io.compress.ZStandardCodec");
+    }
+  }
+
   @Test
   public void testDeflateCodec() throws IOException {
     codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.DeflateCodec");
@@ -135,6 +305,210 @@ public void testGzipCodecWithParam() throws IOException {
     codecTest(conf, seed, count, "org.apache.hadoop.io.compress.GzipCodec");
   }
 
+  @Test
+  public void testGzipCodecParallel() throws IOException {
+    Configuration conf = new Configuration(this.conf);
+    if (!ZlibFactory.isNativeZlibLoaded(conf)) {
+      LOG.warn("testGzipCodecParallel skipped: native libs not loaded");
+      return;
+    }
+    ZlibFactory.setCompressionThreads(conf, 4);
+    codecTest(conf, seed, 0, "org.apache.hadoop.io.compress.GzipCodec");
+    codecTest(conf, seed, count, "org.apache.hadoop.io.compress.GzipCodec");
+
+    // The output must be a plain gzip stream spanning many blocks
+    byte[] b = new byte[3 * 1024 * 1024 + 17];
+    Random r = new Random(seed);
+    for (int i = 0; i < b.length; i++) {
+      b[i] = (byte) ((i % 4096 < 2048) ? i % 251 : r.nextInt(16));
+    }
+    GzipCodec gzc = ReflectionUtils.newInstance(GzipCodec.class, conf);
+    Compressor compressor = gzc.createCompressor();
+    assertEquals(GzipCodec.GzipZlibCompressor.class, compressor.getClass());
+    ByteArrayOutputStream bos = new ByteArrayOutputStream();
+    CompressionOutputStream cos = gzc.createOutputStream(bos, compressor);
+    cos.write(b);
+    cos.close();
+    compressor.end();
+
+    GZIPInputStream gzis = new GZIPInputStream(
+        new ByteArrayInputStream(bos.toByteArray()));
+    byte[] result = new byte[b.length];
+    IOUtils.readFully(gzis, result, 0, result.length);
+    assertEquals(-1, gzis.read());
+    gzis.close();
+    assertArrayEquals(b, result);
+  }
+
+  @Test
+  public void testGzipWholeStreamRecords() throws IOException {
+    Assume.assumeTrue(ZlibFactory.isNativeZlibLoaded(conf));
+    // Records small enough for one call each take the one-shot path where
+    // libdeflate is installed, and must stay plain gzip either way
+    GzipCodec gzc = ReflectionUtils.newInstance(GzipCodec.class, conf);
+    Compressor compressor = gzc.createCompressor();
+    Decompressor decompressor = gzc.createDecompressor();
+    ByteArrayOutputStream members = new ByteArrayOutputStream();
+    ByteArrayOutputStream expected = new ByteArrayOutputStream();
+    for (int i = 0; i < 100; i++) {
+      byte[] record = jsonRecord(i);
+      compressor.reset();
+      ByteArrayOutputStream bos = new ByteArrayOutputStream();
+      CompressionOutputStream cos = gzc.createOutputStream(bos, compressor);
+      cos.write(record);
+      cos.finish();
+      byte[] compressed = bos.toByteArray();
+
+      GZIPInputStream gzis = new GZIPInputStream(
+          new ByteArrayInputStream(compressed));
+      byte[] result = new byte[record.length];
+      IOUtils.readFully(gzis, result, 0, result.length);
+      assertEquals(-1, gzis.read());
+      assertArrayEquals(record, result);
+
+      ByteArrayOutputStream javaBos = new ByteArrayOutputStream();
+      GZIPOutputStream gzos = new GZIPOutputStream(javaBos);
+      gzos.write(record);
+      gzos.close();
+      members.write(javaBos.toByteArray());
+      expected.write(record);
+    }
+
+    // Many members in one buffer must each stop where they end
+    decompressor.reset();
+    DataInputStream in = new DataInputStream(gzc.createInputStream(
+        new ByteArrayInputStream(members.toByteArray()), decompressor));
+    byte[] result = new byte[expected.size()];
+    in.readFully(result);
+    assertEquals(-1, in.read());
+    assertArrayEquals(expected.toByteArray(), result);
+    compressor.end();
+    decompressor.end();
+  }
+
+  @Test
+  public void testZlibLibraryName() {
+    if (!ZlibFactory.isNativeZlibLoaded(conf)) {
+      LOG.warn("testZlibLibraryName skipped: native libs not loaded");
+      return;
+    }
+    // No accelerator is configured, so both sides must be bound to libz
+    assertNotNull(ZlibCompressor.getLibraryName());
+    assertEquals(ZlibCompressor.getLibraryName(),
+        ZlibDecompressor.getLibraryName());
+  }
+
+  @Test
+  public void testZlibTrainedDictionary() throws IOException {
+    Assume.assumeTrue(ZlibFactory.isNativeZlibLoaded(conf));
+    List<byte[]> samples = new ArrayList<byte[]>();
+    for (int i = 0; i < 1000; i++) {
+      samples.add(jsonRecord(i));
+    }
+    byte[] dict = ZlibCompressor.trainDictionary(samples, 4096);
+    assertTrue(dict.length > 0 && dict.length <= 4096);
+
+    // Compress each record on its own, reusing one compressor and
+    // decompressor, as a record-compressed writer would
+    ZlibCompressor compressor = new ZlibCompressor();
+    ZlibDecompressor decompressor = new ZlibDecompressor();
+    byte[] compressed = new byte[4096];
+    byte[] result = new byte[4096];
+    int withDict = 0, withoutDict = 0;
+    for (int i = 1000; i < 1100; i++) {
+      byte[] record = jsonRecord(i);
+      for (boolean useDict : new boolean[] { false, true }) {
+        compressor.reset();
+        if (useDict) {
+          compressor.setDictionary(dict, 0, dict.length);
+        }
+        compressor.setInput(record, 0, record.length);
+        compressor.finish();
+        int len = 0;
+        while (!compressor.finished()) {
+          len += compressor.compress(compressed, len, compressed.length - len);
+        }
+        if (useDict) {
+          withDict += len;
+        } else {
+          withoutDict += len;
+        }
+
+        decompressor.reset();
+        decompressor.setInput(compressed, 0, len);
+        int n = decompressor.decompress(result, 0, result.length);
+        if (useDict) {
+          assertEquals(0, n);
+          assertTrue(decompressor.needsDictionary());
+          decompressor.setDictionary(dict, 0, dict.length);
+          n = decompressor.decompress(result, 0, result.length);
+        }
+        assertEquals(record.length, n);
+        assertArrayEquals(record, Arrays.copyOf(result, record.length));
+      }
+    }
+    compressor.end();
+    decompressor.end();
+    assertTrue("dictionary did not help: " + withDict + " >= " + withoutDict,
+        withDict < withoutDict);
+  }
+
+  @Test
+  public void testZlibDecompressorSmallBuffers() throws IOException {
+    Assume.assumeTrue(ZlibFactory.isNativeZlibLoaded(conf));
+    // Several direct buffers' worth of output, so that each call to the
+    // decompressor loops over the counts and flags inflateDirect returns
+    byte[] data = new byte[300 * 1024];
+    Random r = new Random(4242);
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte)(r.nextInt(16) + 'a');
+    }
+    ZlibCompressor compressor = new ZlibCompressor();
+    compressor.setInput(data, 0, data.length);
+    compressor.finish();
+    byte[] compressed = new byte[data.length * 2];
+    int clen = 0;
+    while (!compressor.finished()) {
+      clen += compressor.compress(compressed, clen, compressed.length - clen);
+    }
+    compressor.end();
+    // Trailing bytes after the stream must be left as remaining input
+    byte[] trailer = "trailer".getBytes();
+    System.arraycopy(trailer, 0, compressed, clen, trailer.length);
+
+    ZlibDecompressor decompressor = new ZlibDecompressor();
+    byte[] result = new byte[data.length];
+    byte[] chunk = new byte[7919];
+    int in = 0, out = 0;
+    while (!decompressor.finished()) {
+      if (decompressor.needsInput()) {
+        assertTrue("ran out of input", in < clen + trailer.length);
+        int len = Math.min(1013, clen + trailer.length - in);
+        decompressor.setInput(compressed, in, len);
+        in += len;
+      }
+      int n = decompressor.decompress(chunk, 0, chunk.length);
+      assertTrue(out + n <= data.length);
+      System.arraycopy(chunk, 0, result, out, n);
+      out += n;
+    }
+    assertFalse(decompressor.needsDictionary());
+    assertEquals(data.length, out);
+    assertArrayEquals(data, result);
+    assertEquals(data.length, decompressor.getBytesWritten());
+    assertEquals(clen, decompressor.getBytesRead());
+    assertEquals(in - clen, decompressor.getRemaining());
+    decompressor.end();
+  }
+
+  private static byte[] jsonRecord(int i) {
+    String[] names = { "alice", "bob", "carol", "dave", "erin", "frank" };
+    return ("{\"id\":" + (i * 7919 % 100000) + ",\"user\":{\"name\":\"" +
+        names[i % names.length] + "\",\"premium\":" + (i % 3 != 0) +
+        "},\"event\":\"page_view\",\"url\":\"/products/" + (i % 500) +
+        "\",\"ts\":" + (1350000000 + i) + "}").getBytes();
+  }
+
   private static void codecTest(Configuration conf, int seed, int count, 
                                 String codecClass) 
     throws IOException {
@@ -22,6 +22,8 @@
 import java.io.FileInputStream;
 import java.io.FileOutputStream;
 import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
 import java.util.concurrent.atomic.AtomicReference;
 import java.util.ArrayList;
 import java.util.List;
@@ -30,9 +32,11 @@
 import static org.junit.Assume.*;
 import static org.junit.Assert.*;
 
+import org.apache.commons.io.FileUtils;
 import org.apache.commons.logging.Log;
 import org.apache.commons.logging.LogFactory;
 import org.apache.hadoop.conf.Configuration;
+import org.apache.hadoop.fs.CommonConfigurationKeys;
 import org.apache.hadoop.fs.FileUtil;
 import org.apache.hadoop.fs.FileSystem;
 import org.apache.hadoop.fs.Path;
@@ -276,6 +280,466 @@ public void testSyncFileRange() throws Exception {
     }
   }
 
+  @Test
+  public void testMmap() throws Exception {
+    File f = new File(TEST_DIR, "testMmap");
+    FileOutputStream fos = new FileOutputStream(f);
+    byte[] data = new byte[3 * 4096 + 100];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte)(i * 7);
+    }
+    try {
+      fos.write(data);
+    } finally {
+      fos.close();
+    }
+
+    FileInputStream fis = new FileInputStream(f);
+    try {
+      // An offset that is not page-aligned
+      int offset = 4096 + 13;
+      ByteBuffer buf = NativeIO.mmap(fis.getFD(), NativeIO.PROT_READ, true,
+                                     offset, data.length - offset);
+      assertTrue(buf.isDirect());
+      assertEquals(data.length - offset, buf.capacity());
+      for (int i = 0; i < buf.capacity(); i++) {
+        assertEquals(data[offset + i], buf.get(i));
+      }
+      NativeIO.madvise(buf, 0, buf.capacity(), NativeIO.MADV_WILLNEED);
+      try {
+        NativeIO.mlock(buf, 10, 20);
+        NativeIO.munlock(buf, 10, 20);
+      } catch (NativeIOException nioe) {
+        // RLIMIT_MEMLOCK may be zero for unprivileged users
+        assertTrue(nioe.getErrno() == Errno.EPERM ||
+                   nioe.getErrno() == Errno.ENOMEM);
+      }
+      try {
+        NativeIO.madvise(buf, 1, buf.capacity(), NativeIO.MADV_NORMAL);
+        fail("Did not throw on a range past the end of the buffer");
+      } catch (IndexOutOfBoundsException e) {
+        // expected
+      }
+      NativeIO.munmap(buf);
+
+      try {
+        NativeIO.mmap(fis.getFD(), NativeIO.PROT_READ | NativeIO.PROT_WRITE,
+                      true, 0, data.length);
+        fail("Did not throw mapping a read-only file writable");
+      } catch (NativeIOException nioe) {
+        assertEquals(Errno.EACCES, nioe.getErrno());
+      }
+    } finally {
+      fis.close();
+    }
+  }
+
+  @Test
+  public void testSendfileAndSplice() throws Exception {
+    File in = new File(TEST_DIR, "testSendfileIn");
+    byte[] data = new byte[200 * 1024 + 17];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte)(i * 13);
+    }
+    FileOutputStream fos = new FileOutputStream(in);
+    try {
+      fos.write(data);
+    } finally {
+      fos.close();
+    }
+
+    for (int splice = 0; splice < 2; splice++) {
+      File out = new File(TEST_DIR, "testSendfileOut" + splice);
+      FileInputStream fis = new FileInputStream(in);
+      fos = new FileOutputStream(out);
+      try {
+        long offset = 512, count = data.length - 1024;
+        long n;
+        try {
+          n = splice == 1 ?
+            NativeIO.splice(fos.getFD(), fis.getFD(), offset, count, 512) :
+            NativeIO.sendfile(fos.getFD(), fis.getFD(), offset, count, 512);
+        } catch (UnsupportedOperationException uoe) {
+          continue;
+        }
+        assertEquals(count, n);
+        // The input's file position is untouched
+        assertEquals(0, fis.getChannel().position());
+
+        // Asking for more than is left stops at the end of the file
+        n = splice == 1 ?
+          NativeIO.splice(fos.getFD(), fis.getFD(), offset + count, 4096, 0) :
+          NativeIO.sendfile(fos.getFD(), fis.getFD(), offset + count, 4096, 0);
+        assertEquals(data.length - offset - count, n);
+      } finally {
+        fis.close();
+        fos.close();
+      }
+      byte[] copy = FileUtils.readFileToByteArray(out);
+      assertEquals(data.length - 512, copy.length);
+      for (int i = 0; i < copy.length; i++) {
+        assertEquals(data[512 + i], copy[i]);
+      }
+    }
+  }
+
+  @Test
+  public void testFallocate() throws Exception {
+    File f = new File(TEST_DIR, "testFallocate");
+    RandomAccessFile raf = new RandomAccessFile(f, "rw");
+    try {
+      try {
+        NativeIO.fallocate(raf.getFD(), NativeIO.FALLOC_FL_KEEP_SIZE,
+                           0, 1024 * 1024);
+        assertEquals(0, raf.length());
+      } catch (UnsupportedOperationException uoe) {
+        // not every file system keeps the size
+      }
+      NativeIO.fallocate(raf.getFD(), 0, 0, 1024 * 1024);
+      assertEquals(1024 * 1024, raf.length());
+    } finally {
+      raf.close();
+    }
+    try {
+      NativeIO.fallocate(raf.getFD(), 0, 0, 4096);
+      fail("Did not throw on bad file");
+    } catch (NativeIOException nioe) {
+      assertEquals(Errno.EBADF, nioe.getErrno());
+    }
+  }
+
+  @Test
+  public void testDirectWrite() throws Exception {
+    File f = new File(TEST_DIR, "testDirectWrite");
+    FileDescriptor fd;
+    try {
+      fd = NativeIO.open(f.getAbsolutePath(),
+          NativeIO.O_WRONLY | NativeIO.O_CREAT | NativeIO.O_DIRECT, 0644);
+    } catch (NativeIOException nioe) {
+      // tmpfs, among others, refuses O_DIRECT
+      assumeTrue(nioe.getErrno() != Errno.EINVAL);
+      throw nioe;
+    }
+    int alignment = (int)NativeIO.getPageSize();
+    ByteBuffer buf = NativeIO.allocateAligned(4 * alignment, alignment);
+    FileOutputStream fos = new FileOutputStream(fd);
+    try {
+      for (int i = 0; i < buf.capacity(); i++) {
+        buf.put((byte)i);
+      }
+      buf.flip();
+      // Write the last half first, to a position past the end of the file
+      buf.position(2 * alignment);
+      NativeIO.pwriteFully(fd, buf, 2 * alignment);
+      buf.rewind().limit(2 * alignment);
+      NativeIO.pwriteFully(fd, buf, 0);
+    } finally {
+      fos.close();
+      NativeIO.freeAligned(buf);
+    }
+    byte[] written = FileUtils.readFileToByteArray(f);
+    assertEquals(4 * alignment, written.length);
+    for (int i = 0; i < written.length; i++) {
+      assertEquals((byte)i, written[i]);
+    }
+  }
+
+  @Test
+  public void testQueuedReadWrite() throws Exception {
+    int[] backends = { NativeIOQueue.BACKEND_IO_URING,
+                       NativeIOQueue.BACKEND_AIO };
+    boolean tested = false;
+    for (int backend : backends) {
+      NativeIOQueue queue;
+      try {
+        queue = new NativeIOQueue(8, backend);
+      } catch (UnsupportedOperationException uoe) {
+        continue;
+      }
+      tested = true;
+      try {
+        doQueuedReadWrite(queue);
+      } finally {
+        queue.close();
+      }
+    }
+    assumeTrue(tested);
+  }
+
+  private void doQueuedReadWrite(NativeIOQueue queue) throws Exception {
+    final int blocks = 16, blockSize = 4096;
+    RandomAccessFile raf = new RandomAccessFile(
+      new File(TEST_DIR, "testQueuedReadWrite"), "rw");
+    try {
+      FileDescriptor fd = raf.getFD();
+      long[] tags = new long[queue.getDepth()];
+      long[] results = new long[queue.getDepth()];
+
+      // Write each block, more of them than the queue holds at once
+      int next = 0, done = 0;
+      while (done < blocks) {
+        while (next < blocks && queue.getPending() + queue.getInFlight() <
+               queue.getDepth()) {
+          ByteBuffer buf = ByteBuffer.allocateDirect(blockSize);
+          for (int i = 0; i < blockSize; i++) {
+            buf.put((byte)(next * 31 + i));
+          }
+          buf.flip();
+          queue.add(NativeIOQueue.WRITE, fd, buf, (long)next * blockSize, next);
+          next++;
+        }
+        queue.submit();
+        int n = queue.reap(tags, results, 1);
+        for (int i = 0; i < n; i++) {
+          assertEquals(blockSize, results[i]);
+        }
+        done += n;
+      }
+      assertEquals(0, queue.getInFlight());
+      assertEquals((long)blocks * blockSize, raf.length());
+
+      // Read them back in reverse, into slices of one buffer
+      ByteBuffer all = ByteBuffer.allocateDirect(blocks * blockSize);
+      for (int b = blocks - 1; b >= 0; b -= queue.getDepth()) {
+        int batch = Math.min(queue.getDepth(), b + 1);
+        for (int k = 0; k < batch; k++) {
+          all.limit((b - k + 1) * blockSize).position((b - k) * blockSize);
+          queue.add(NativeIOQueue.READ, fd, all, (long)(b - k) * blockSize,
+                    b - k);
+        }
+        assertEquals(batch, queue.submit());
+        int got = 0;
+        while (got < batch) {
+          int n = queue.reap(tags, results, batch - got);
+          for (int i = 0; i < n; i++) {
+            assertEquals("block " + tags[i], blockSize, results[i]);
+          }
+          got += n;
+        }
+      }
+      all.clear();
+      for (int i = 0; i < blocks * blockSize; i++) {
+        assertEquals((byte)((i / blockSize) * 31 + i % blockSize), all.get(i));
+      }
+
+      // Reading past the end of the file completes with zero bytes
+      ByteBuffer buf = ByteBuffer.allocateDirect(blockSize);
+      queue.add(NativeIOQueue.READ, fd, buf, (long)blocks * blockSize, 99);
+      queue.submit();
+      assertEquals(1, queue.reap(tags, results, 1));
+      assertEquals(99, tags[0]);
+      assertEquals(0, results[0]);
+    } finally {
+      raf.close();
+    }
+  }
+
+  @Test
+  public void testFstatIdCache() throws Exception {
+    FileOutputStream fos = new FileOutputStream(
+      new File(TEST_DIR, "testFstatIdCache"));
+    try {
+      NativeIO.Stat uncached = NativeIO.fstat(fos.getFD());
+      // Cached lookups give the same names
+      for (int i = 0; i < 1000; i++) {
+        NativeIO.Stat stat = NativeIO.fstat(fos.getFD());
+        assertEquals(uncached.getOwner(), stat.getOwner());
+        assertEquals(uncached.getGroup(), stat.getGroup());
+      }
+      // as do lookups with caching disabled
+      NativeIO.setIdCacheTtl(0, 0);
+      try {
+        NativeIO.Stat stat = NativeIO.fstat(fos.getFD());
+        assertEquals(uncached.getOwner(), stat.getOwner());
+        assertEquals(uncached.getGroup(), stat.getGroup());
+      } finally {
+        NativeIO.setIdCacheTtl(1000 *
+          CommonConfigurationKeys.HADOOP_SECURITY_UID_NAME_CACHE_TIMEOUT_DEFAULT,
+          1000 * CommonConfigurationKeys
+            .HADOOP_SECURITY_UID_NAME_CACHE_NEGATIVE_TIMEOUT_DEFAULT);
+      }
+    } finally {
+      fos.close();
+    }
+  }
+
+  @Test
+  public void testWalkDirectory() throws Exception {
+    File root = new File(TEST_DIR, "testWalkDirectory");
+    // Enough files in one directory to outgrow the initial buffer
+    File sub = new File(root, "subdir0");
+    assertTrue(sub.mkdirs());
+    for (int i = 0; i < 3000; i++) {
+      File f = new File(sub, "blk_" + (1000000000L + i));
+      FileOutputStream fos = new FileOutputStream(f);
+      try {
+        fos.write(new byte[i % 7]);
+      } finally {
+        fos.close();
+      }
+    }
+    File skipped = new File(root, "skipped");
+    assertTrue(skipped.mkdirs());
+    assertTrue(new File(skipped, "hidden").createNewFile());
+
+    final List<String> names = new ArrayList<String>();
+    NativeIO.walkDirectory(root, new NativeIO.DirectoryVisitor() {
+      @Override
+      public boolean visit(File dir, String name, int type, long length,
+          long mtime) {
+        File f = new File(dir, name);
+        names.add(name);
+        assertEquals(f.isDirectory(), type == NativeIO.DIRENT_DIRECTORY);
+        if (type == NativeIO.DIRENT_FILE) {
+          assertEquals(f.length(), length);
+          assertEquals(f.lastModified() / 1000, mtime / 1000);
+        }
+        return !name.equals("skipped");
+      }
+    });
+    assertEquals(2 + 3000, names.size());
+    assertTrue(names.contains("blk_1000002999"));
+    assertFalse(names.contains("hidden"));
+
+    try {
+      NativeIO.walkDirectory(new File(TEST_DIR, "doesntexist"),
+        new NativeIO.DirectoryVisitor() {
+          @Override
+          public boolean visit(File dir, String name, int type, long length,
+              long mtime) {
+            return true;
+          }
+        });
+      fail("Did not throw on a missing directory");
+    } catch (NativeIOException nioe) {
+      assertEquals(Errno.ENOENT, nioe.getErrno());
+    }
+  }
+
+  @Test
+  public void testDiskSampler() throws Exception {
+    File vol1 = new File(TEST_DIR, "vol1");
+    File vol2 = new File(TEST_DIR, "vol2");
+    assertTrue(vol1.mkdirs() && vol2.mkdirs());
+    NativeDiskSampler sampler = new NativeDiskSampler(
+      new File[] { vol1, vol2 }, 10, 4096);
+    try {
+      assertEquals(2, sampler.getNumVolumes());
+      for (int i = 0; i < 2; i++) {
+        NativeDiskSampler.Sample sample;
+        long deadline = System.currentTimeMillis() + 10000;
+        do {
+          Thread.sleep(10);
+          sample = sampler.getSample(i);
+        } while (sample.getLastReadMicros() < 0 &&
+                 System.currentTimeMillis() < deadline);
+        assertEquals(0, sample.getReadErrors() + sample.getWriteErrors());
+        long[] hist = sample.getReadHistogram();
+        assertTrue(NativeDiskSampler.Sample.percentileMicros(hist, 0.5) >=
+                   sample.getLastReadMicros() / 2);
+        assertTrue(NativeDiskSampler.Sample.percentileMicros(
+          sample.getWriteHistogram(), 1.0) > 0);
+      }
+      assertTrue(new File(vol1, ".disk_probe").exists());
+    } finally {
+      sampler.close();
+    }
+    assertFalse(new File(vol1, ".disk_probe").exists());
+
+    try {
+      new NativeDiskSampler(
+        new File[] { new File(TEST_DIR, "doesntexist") }, 10, 4096);
+      fail("Did not throw on a missing directory");
+    } catch (NativeIOException nioe) {
+      assertEquals(Errno.ENOENT, nioe.getErrno());
+    }
+  }
+
+  @Test
+  public void testCopyFileRange() throws Exception {
+    File src = new File(TEST_DIR, "testCopyFileRange");
+    byte[] data = new byte[3 * 1024 * 1024 + 5];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte)(i * 11);
+    }
+    FileUtils.writeByteArrayToFile(src, data);
+
+    RandomAccessFile in = new RandomAccessFile(src, "r");
+    RandomAccessFile out = new RandomAccessFile(
+      new File(TEST_DIR, "testCopyFileRangeOut"), "rw");
+    try {
+      // A range, then a request running past the end of the source
+      assertEquals(1000, NativeIO.copyFileRange(in.getFD(), 10,
+                                                out.getFD(), 0, 1000, 0));
+      assertEquals(data.length - 1010, NativeIO.copyFileRange(in.getFD(),
+          1010, out.getFD(), 1000, data.length, NativeIO.COPY_REFLINK));
+      assertEquals(0, in.getFilePointer());
+      byte[] copy = new byte[(int)out.length()];
+      out.readFully(copy);
+      assertEquals(data.length - 10, copy.length);
+      for (int i = 0; i < copy.length; i++) {
+        assertEquals(data[10 + i], copy[i]);
+      }
+    } finally {
+      in.close();
+      out.close();
+    }
+
+    File meta = new File(TEST_DIR, "testCopyFileRange.meta");
+    FileUtils.writeByteArrayToFile(meta, new byte[] { 0, 1, 2 });
+    File dstDir = new File(TEST_DIR, "dst");
+    assertTrue(dstDir.mkdirs());
+    File dstBlock = new File(dstDir, src.getName());
+    File dstMeta = new File(dstDir, meta.getName());
+    NativeIO.copyBlockAndMeta(src, meta, dstBlock, dstMeta);
+    assertTrue(FileUtils.contentEquals(src, dstBlock));
+    assertTrue(FileUtils.contentEquals(meta, dstMeta));
+    assertEquals(2, dstDir.list().length);
+  }
+
+  @Test
+  public void testBatchedFadviseAndSyncFileRange() throws Exception {
+    FileOutputStream fos = new FileOutputStream(
+      new File(TEST_DIR, "testBatched"));
+    FileInputStream closed = new FileInputStream("/dev/zero");
+    closed.close();
+    try {
+      fos.write(new byte[8192]);
+      FileDescriptor[] fds = { fos.getFD(), closed.getFD(), fos.getFD() };
+      long[] offsets = { 0, 0, 4096 };
+      long[] lens = { 4096, 4096, 4096 };
+      Errno[] errors = new Errno[3];
+
+      int[] adviceFlags = { NativeIO.POSIX_FADV_DONTNEED,
+          NativeIO.POSIX_FADV_DONTNEED, NativeIO.POSIX_FADV_DONTNEED };
+      try {
+        assertEquals(1, NativeIO.posix_fadvise_batch(fds, offsets, lens,
+                                                     adviceFlags, 3, errors));
+        assertNull(errors[0]);
+        assertEquals(Errno.EBADF, errors[1]);
+        assertNull(errors[2]);
+      } catch (UnsupportedOperationException uoe) {
+        // no fadvise support on this machine
+      }
+
+      int[] syncFlags = { NativeIO.SYNC_FILE_RANGE_WRITE,
+          NativeIO.SYNC_FILE_RANGE_WRITE, NativeIO.SYNC_FILE_RANGE_WRITE };
+      errors = new Errno[3];
+      try {
+        assertEquals(1, NativeIO.sync_file_range_batch(fds, offsets, lens,
+                                                       syncFlags, 2, errors));
+        assertNull(errors[0]);
+        assertEquals(Errno.EBADF, errors[1]);
+        // Only the first n entries are applied
+        assertNull(errors[2]);
+      } catch (UnsupportedOperationException uoe) {
+        // no sync_file_range support on this machine
+      }
+    } finally {
+      fos.close();
+    }
+  }
+
   private void assertPermissions(File f, int expected) throws IOException {
     FileSystem localfs = FileSystem.getLocal(new Configuration());
     FsPermission perms = localfs.getFileStatus(
@@ -19,8 +19,12 @@
 import static org.junit.Assume.assumeTrue;
 import static org.junit.Assert.*;
 
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
+import java.util.Map;
+
+import org.apache.hadoop.conf.Configuration;
 import org.apache.hadoop.security.GroupMappingServiceProvider;
 import org.apache.hadoop.security.JniBasedUnixGroupsMapping;
 import org.apache.hadoop.security.ShellBasedUnixGroupsMapping;
@@ -49,6 +53,23 @@ public void testJNIGroupsMapping() throws Exception {
     //return an empty list
     testForUser("fooBarBaz1234DoesNotExist");
   }
+  @Test
+  public void testBatchGroupsMapping() throws Exception {
+    String user = UserGroupInformation.getCurrentUser().getShortUserName();
+    String missing = "fooBarBaz1234DoesNotExist";
+    JniBasedUnixGroupsMapping g = new JniBasedUnixGroupsMapping();
+    g.setConf(new Configuration());
+    List<String> users = new ArrayList<String>();
+    for (int i = 0; i < 50; i++) {
+      users.add(i % 2 == 0 ? user : missing + i);
+    }
+    Map<String, List<String>> groups = g.getGroups(users);
+    assertEquals(26, groups.size());
+    assertEquals(g.getGroups(user), groups.get(user));
+    assertTrue(groups.get(missing + 1).isEmpty());
+    assertTrue(g.getGroups(new ArrayList<String>()).isEmpty());
+  }
+
   private void testForUser(String user) throws Exception {
     GroupMappingServiceProvider g = new ShellBasedUnixGroupsMapping();
     List<String> shellBasedGroups = g.getGroups(user);
@@ -0,0 +1,76 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package org.apache.hadoop.security;
+
+import static org.junit.Assert.*;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.After;
+import org.junit.Test;
+
+public class TestNetgroupCache {
+
+  @After
+  public void clearCache() {
+    NetgroupCache.clear();
+  }
+
+  private static List<String> netgroupsOf(String user) {
+    List<String> groups = new ArrayList<String>();
+    NetgroupCache.getNetgroups(user, groups);
+    return groups;
+  }
+
+  @Test
+  public void testMembership() {
+    NetgroupCache.add("@ng1", Arrays.asList("alice", "bob"));
+    NetgroupCache.add("@ng2", Arrays.asList("bob"));
+    assertTrue(NetgroupCache.isUserInNetgroup("alice", "@ng1"));
+    assertFalse(NetgroupCache.isUserInNetgroup("alice", "@ng2"));
+    assertEquals(2, netgroupsOf("bob").size());
+    assertTrue(netgroupsOf("carol").isEmpty());
+
+    // add() leaves groups that are already cached alone
+    NetgroupCache.add("@ng1", Arrays.asList("carol"));
+    assertTrue(NetgroupCache.isUserInNetgroup("alice", "@ng1"));
+    assertFalse(NetgroupCache.isUserInNetgroup("carol", "@ng1"));
+  }
+
+  @Test
+  public void testIncrementalUpdate() {
+    NetgroupCache.add("@ng1", Arrays.asList("alice", "bob"));
+    NetgroupCache.add("@ng2", Arrays.asList("bob"));
+    NetgroupCache.update("@ng1", Arrays.asList("bob", "carol"));
+    assertFalse(NetgroupCache.isUserInNetgroup("alice", "@ng1"));
+    assertTrue(netgroupsOf("alice").isEmpty());
+    assertTrue(NetgroupCache.isUserInNetgroup("carol", "@ng1"));
+    assertEquals(2, netgroupsOf("bob").size());
+    assertEquals(2, NetgroupCache.getNetgroupNames().size());
+  }
+
+  @Test
+  public void testClear() {
+    NetgroupCache.add("@ng1", Arrays.asList("alice"));
+    NetgroupCache.clear();
+    assertFalse(NetgroupCache.isCached("@ng1"));
+    assertTrue(netgroupsOf("alice").isEmpty());
+  }
+}
@@ -36,7 +36,8 @@ public class TestDataChecksum {
   
   private static final int BYTES_PER_CHUNK = 512;
   private static final DataChecksum.Type CHECKSUM_TYPES[] = {
-    DataChecksum.Type.CRC32, DataChecksum.Type.CRC32C
+    DataChecksum.Type.CRC32, DataChecksum.Type.CRC32C,
+    DataChecksum.Type.XXHASH64
   };
   
   @Test
@@ -128,6 +129,37 @@ public void testEquality() {
         DataChecksum.newDataChecksum(DataChecksum.Type.CRC32C, 512)));        
   }
   
+  @Test
+  public void testXXHash64KnownValues() {
+    // Low 32 bits of the reference xxHash64 with seed 0
+    XXHash64Checksum sum = new XXHash64Checksum();
+    sum.update("123456789".getBytes(), 0, 9);
+    assertEquals(0x40e6ae83L, sum.getValue());
+
+    byte data[] = new byte[4099];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte) ((i % 16) + 1);
+    }
+    sum.reset();
+    sum.update(data, 0, 1000);
+    assertEquals(0xa09e734fL, sum.getValue());
+
+    // Pieces that straddle the 32-byte stripes, and single bytes
+    sum.reset();
+    int off = 0;
+    for (int len = 1; off < data.length; len = len % 45 + 1) {
+      len = Math.min(len, data.length - off);
+      if (len == 3) {
+        sum.update(data[off]);
+        sum.update(data, off + 1, 2);
+      } else {
+        sum.update(data, off, len);
+      }
+      off += len;
+    }
+    assertEquals(0x36534379L, sum.getValue());
+  }
+
   @Test
   public void testToString() {
     assertEquals("DataChecksum(type=CRC32, chunkSize=512)",
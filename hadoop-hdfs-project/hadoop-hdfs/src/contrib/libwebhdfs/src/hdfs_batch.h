@@ -0,0 +1,85 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _HDFS_BATCH_H_
+#define _HDFS_BATCH_H_
+
+/**
+ * Batches of metadata operations for libwebhdfs.  The operations of a
+ * batch are sent to the namenode over several connections at once, which
+ * is much faster than making the same calls one after another when there
+ * are many of them, as when walking a directory tree.
+ */
+
+#include "hdfs.h"
+
+#ifdef __cplusplus
+extern  "C" {
+#endif
+
+    /** How many operations of a batch are in flight at once by default */
+#define HDFS_BATCH_DEFAULT_CONCURRENCY 16
+
+    typedef enum {
+        HDFS_BATCH_GET_PATH_INFO,   // hdfsGetPathInfo
+        HDFS_BATCH_DELETE,          // hdfsDelete
+        HDFS_BATCH_CHMOD,           // hdfsChmod
+        HDFS_BATCH_CHOWN,           // hdfsChown
+        HDFS_BATCH_SET_REPLICATION, // hdfsSetReplication
+        HDFS_BATCH_CREATE_DIRECTORY // hdfsCreateDirectory
+    } hdfsBatchOpType;
+
+    /**
+     * One operation of a batch.  The arguments are those of the function
+     * the operation stands for; only the ones of its type are used.
+     */
+    typedef struct {
+        hdfsBatchOpType type;
+        const char *path;
+        int recursive;          // HDFS_BATCH_DELETE
+        short mode;             // HDFS_BATCH_CHMOD
+        const char *owner;      // HDFS_BATCH_CHOWN; NULL to keep it
+        const char *group;      // HDFS_BATCH_CHOWN; NULL to keep it
+        int16_t replication;    // HDFS_BATCH_SET_REPLICATION
+        int result;             // (out) 0 on success; an errno value on error
+        hdfsFileInfo *info;     // (out) For HDFS_BATCH_GET_PATH_INFO, on
+                                // success.  Free it with
+                                // hdfsFreeFileInfo(info, 1).
+    } hdfsBatchOp;
+
+    /**
+     * Run a batch of operations.  They may run in any order, so the
+     * operations of a batch should not depend on each other; to delete the
+     * files of a directory and then the directory, use two batches.
+     *
+     * @param fs             The configured filesystem handle.
+     * @param ops            The operations, whose results are filled in.
+     * @param numOps         The number of operations.
+     * @param maxConcurrency The most operations in flight at once, or 0
+     *                       for HDFS_BATCH_DEFAULT_CONCURRENCY.
+     * @return               The number of operations that failed, or -1
+     *                       on error with errno set, when no results are
+     *                       filled in.
+     */
+    int hdfsRunBatch(hdfsFS fs, hdfsBatchOp *ops, int numOps,
+                     int maxConcurrency);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_HDFS_BATCH_H_
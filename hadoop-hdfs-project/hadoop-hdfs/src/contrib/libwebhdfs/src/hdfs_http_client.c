@@ -15,14 +15,30 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include <pthread.h>
 #include "hdfs_http_client.h"
 
+/**
+ * The most connections the shared I/O thread keeps open to one server.
+ * Metadata requests beyond this wait for a connection to be free.
+ */
+#define WEBHDFS_MAX_HOST_CONNECTIONS 8
+
+/** The largest Content-Length the body of a response is allocated for up front */
+#define MAX_CONTENT_LENGTH_HINT (256 * 1024 * 1024)
+
 static pthread_mutex_t curlInitMutex = PTHREAD_MUTEX_INITIALIZER;
 static volatile int curlGlobalInited = 0;
+static pthread_once_t curlHandleKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t curlHandleKey;
+static int curlHandleKeyCreated = 0;
 
 ResponseBuffer initResponseBuffer() {
     ResponseBuffer info = (ResponseBuffer) calloc(1, sizeof(ResponseBufferInternal));
@@ -55,6 +71,34 @@ void freeResponse(Response resp)  {
     }
 }
 
+/**
+ * Make sure a response buffer has room for length more bytes, plus the
+ * terminating NUL.  The buffer at least doubles each time it grows, so
+ * filling it takes amortized linear time.
+ *
+ * @return 0 on success; -1 when out of memory
+ */
+static int reserveResponseBuffer(ResponseBuffer rbuffer, size_t length) {
+    size_t size, newSize;
+    char *content;
+    
+    if (rbuffer->remaining >= length) {
+        return 0;
+    }
+    size = rbuffer->content ? rbuffer->offset + rbuffer->remaining + 1 : 0;
+    newSize = rbuffer->offset + length + 1;
+    if (newSize < size * 2) {
+        newSize = size * 2;
+    }
+    content = realloc(rbuffer->content, newSize);
+    if (!content) {
+        return -1;
+    }
+    rbuffer->content = content;
+    rbuffer->remaining = newSize - rbuffer->offset - 1;
+    return 0;
+}
+
 /* Callback for allocating local buffer and reading data to local buffer */
 static size_t writefunc(void *ptr, size_t size, size_t nmemb, ResponseBuffer rbuffer) {
     if (size * nmemb < 1) {
@@ -65,12 +109,8 @@ static size_t writefunc(void *ptr, size_t size, size_t nmemb, ResponseBuffer rbu
         return -1;
     }
     
-    if (rbuffer->remaining < size * nmemb) {
-        rbuffer->content = realloc(rbuffer->content, rbuffer->offset + size * nmemb + 1);
-        if (rbuffer->content == NULL) {
-            return -1;
-        }
-        rbuffer->remaining = size * nmemb;
+    if (reserveResponseBuffer(rbuffer, size * nmemb)) {
+        return -1;
     }
     memcpy(rbuffer->content + rbuffer->offset, ptr, size * nmemb);
     rbuffer->offset += size * nmemb;
@@ -79,6 +119,30 @@ static size_t writefunc(void *ptr, size_t size, size_t nmemb, ResponseBuffer rbu
     return size * nmemb;
 }
 
+/**
+ * Callback for keeping the response header.  A Content-Length header makes
+ * room for the whole body up front, so large bodies such as directory
+ * listings are not copied again as they arrive.
+ */
+static size_t headerfunc(void *ptr, size_t size, size_t nmemb, Response resp) {
+    const char *const key = "Content-Length:";
+    size_t total = size * nmemb, keyLen = strlen(key);
+    char value[24];
+    unsigned long long length;
+    
+    if (total > keyLen && total - keyLen < sizeof(value) &&
+            !strncasecmp(ptr, key, keyLen)) {
+        memcpy(value, (char *) ptr + keyLen, total - keyLen);
+        value[total - keyLen] = '\0';
+        length = strtoull(value, NULL, 10);
+        // Only a hint: if it cannot be had, the body grows as it arrives
+        if (resp->body && length > 0 && length <= MAX_CONTENT_LENGTH_HINT) {
+            reserveResponseBuffer(resp->body, length);
+        }
+    }
+    return writefunc(ptr, size, nmemb, resp->header);
+}
+
 /**
  * Callback for reading data to buffer provided by user, 
  * thus no need to reallocate buffer.
@@ -108,38 +172,99 @@ static size_t readfunc(void *ptr, size_t size, size_t nmemb, void *stream) {
     webhdfsBuffer *wbuffer = (webhdfsBuffer *) stream;
     
     pthread_mutex_lock(&wbuffer->writeMutex);
-    while (wbuffer->remaining == 0) {
+    if (wbuffer->remaining == 0) {
         /*
          * the current remainning bytes to write is 0,
          * check whether need to finish the transfer
-         * if yes, return 0; else, wait
+         * if yes, return 0; else, pause until hdfsWrite or hdfsCloseFile
+         * resumes the upload, since this runs on the upload I/O thread
          */
         if (wbuffer->closeFlag) {
             //we can close the transfer now
             fprintf(stderr, "CloseFlag is set, ready to close the transfer\n");
             pthread_mutex_unlock(&wbuffer->writeMutex);
             return 0;
-        } else {
-            // len == 0 indicates that user's buffer has been transferred
-            pthread_cond_signal(&wbuffer->transfer_finish);
-            pthread_cond_wait(&wbuffer->newwrite_or_close, &wbuffer->writeMutex);
         }
+        wbuffer->paused = 1;
+        pthread_mutex_unlock(&wbuffer->writeMutex);
+        return CURL_READFUNC_PAUSE;
     }
     
-    if(wbuffer->remaining > 0 && !wbuffer->closeFlag) {
-        size_t copySize = wbuffer->remaining < size * nmemb ? wbuffer->remaining : size * nmemb;
-        memcpy(ptr, wbuffer->wbuffer + wbuffer->offset, copySize);
-        wbuffer->offset += copySize;
-        wbuffer->remaining -= copySize;
-        pthread_mutex_unlock(&wbuffer->writeMutex);
-        return copySize;
-    } else {
-        fprintf(stderr, "Webhdfs buffer is %ld, it should be a positive value!\n", wbuffer->remaining);
-        pthread_mutex_unlock(&wbuffer->writeMutex);
-        return 0;
+    // Copy up to the end of the ring; the rest goes in the next call
+    size_t copySize = wbuffer->remaining < size * nmemb ? wbuffer->remaining : size * nmemb;
+    if (copySize > wbuffer->capacity - wbuffer->offset) {
+        copySize = wbuffer->capacity - wbuffer->offset;
+    }
+    memcpy(ptr, wbuffer->wbuffer + wbuffer->offset, copySize);
+    wbuffer->offset = (wbuffer->offset + copySize) % wbuffer->capacity;
+    wbuffer->remaining -= copySize;
+    // hdfsWrite may be waiting for room
+    pthread_cond_signal(&wbuffer->transfer_finish);
+    pthread_mutex_unlock(&wbuffer->writeMutex);
+    return copySize;
+}
+
+static size_t streamfunc(void *ptr, size_t size, size_t nmemb, void *stream) {
+    webhdfsReadBuffer *rbuffer = (webhdfsReadBuffer *) stream;
+    size_t total = size * nmemb, done = 0, copySize;
+    long code = 0;
+    
+    // Only the transferring thread touches these
+    if (!rbuffer->responseChecked) {
+        curl_easy_getinfo(rbuffer->curl, CURLINFO_RESPONSE_CODE, &code);
+        rbuffer->responseOk = (code == 200);
+        rbuffer->responseChecked = 1;
+    }
+    if (!rbuffer->responseOk) {
+        return writefunc(ptr, size, nmemb, rbuffer->errorBody);
     }
+    pthread_mutex_lock(&rbuffer->readMutex);
+    while (done < total) {
+        if (rbuffer->closeFlag) {
+            // Returning short aborts the transfer
+            pthread_mutex_unlock(&rbuffer->readMutex);
+            return 0;
+        }
+        if (rbuffer->remaining == 0) {
+            pthread_cond_wait(&rbuffer->newread_or_close, &rbuffer->readMutex);
+            continue;
+        }
+        copySize = rbuffer->remaining < total - done ? rbuffer->remaining : total - done;
+        memcpy(rbuffer->rbuffer + rbuffer->offset, (char *) ptr + done, copySize);
+        rbuffer->offset += copySize;
+        rbuffer->remaining -= copySize;
+        done += copySize;
+        pthread_cond_signal(&rbuffer->transfer_finish);
+    }
+    pthread_mutex_unlock(&rbuffer->readMutex);
+    return total;
 }
 
+/* Nonzero once the reader has closed a stream, to abort its transfer */
+static int streamclosed(void *stream) {
+    webhdfsReadBuffer *rbuffer = (webhdfsReadBuffer *) stream;
+    int closeFlag;
+    
+    pthread_mutex_lock(&rbuffer->readMutex);
+    closeFlag = rbuffer->closeFlag;
+    pthread_mutex_unlock(&rbuffer->readMutex);
+    return closeFlag;
+}
+
+/* Callback for aborting a streaming read that is stalled on the network */
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int streamprogressfunc(void *stream, curl_off_t dltotal,
+                              curl_off_t dlnow, curl_off_t ultotal,
+                              curl_off_t ulnow) {
+    return streamclosed(stream);
+}
+#else
+static int streamprogressfunc(void *stream, double dltotal, double dlnow,
+                              double ultotal, double ulnow) {
+    return streamclosed(stream);
+}
+#endif
+
 static void initCurlGlobal() {
     if (!curlGlobalInited) {
         pthread_mutex_lock(&curlInitMutex);
@@ -151,9 +276,320 @@ static void initCurlGlobal() {
     }
 }
 
-static Response launchCmd(char *url, enum HttpHeader method, enum Redirect followloc) {
+static void freeCurlHandle(void *curl) {
+    curl_easy_cleanup((CURL *) curl);
+}
+
+static void makeCurlHandleKey() {
+    if (pthread_key_create(&curlHandleKey, freeCurlHandle)) {
+        fprintf(stderr, "Failed to create the thread-local curl handle key\n");
+        return;
+    }
+    curlHandleKeyCreated = 1;
+}
+
+/**
+ * Get the curl handle of the calling thread, reset to the default options.
+ * The handle lives as long as the thread, so the connections it opens to
+ * the namenode and the datanodes are kept alive and reused by the thread's
+ * later requests instead of being set up again each time.
+ */
+static CURL *getCurlHandle() {
     CURL *curl;
-    CURLcode res;
+    
+    initCurlGlobal();
+    pthread_once(&curlHandleKeyOnce, makeCurlHandleKey);
+    if (!curlHandleKeyCreated) {
+        return NULL;
+    }
+    curl = pthread_getspecific(curlHandleKey);
+    if (curl) {
+        curl_easy_reset(curl);   /* keeps the connection and DNS caches */
+        return curl;
+    }
+    curl = curl_easy_init();
+    if (curl && pthread_setspecific(curlHandleKey, curl)) {
+        curl_easy_cleanup(curl);
+        return NULL;
+    }
+    return curl;
+}
+
+/**
+ * A request run by one of the shared I/O threads.  The thread that made it
+ * waits for it to be done.
+ */
+struct sharedRequest {
+    CURL *curl;
+    CURLcode result;
+    int done;
+    pthread_cond_t cond;
+    webhdfsBuffer *uploadBuffer; // The ring of an upload, which is told when
+                                 // the transfer stops; NULL for other requests
+    struct sharedRequest *next;
+};
+
+/**
+ * A thread driving the requests of every thread of the process through one
+ * curl multi handle.
+ */
+struct ioThread {
+    int started;
+    CURLM *multi;
+    pthread_mutex_t lock;           // Protects the lists and each request's done
+    struct sharedRequest *pending;  // Requests not yet added to multi
+    struct sharedRequest *resumed;  // Paused uploads that have more to send
+    int wakeFds[2];                 // Written to tell the thread about new work
+};
+
+#define IO_THREAD_INITIALIZER \
+    { 0, NULL, PTHREAD_MUTEX_INITIALIZER, NULL, NULL, { -1, -1 } }
+
+/** The thread of the metadata requests and the reads of whole responses */
+static struct ioThread sharedIo = IO_THREAD_INITIALIZER;
+static pthread_once_t sharedThreadOnce = PTHREAD_ONCE_INIT;
+
+/** The thread of the uploads to the datanodes */
+static struct ioThread uploadIo = IO_THREAD_INITIALIZER;
+static pthread_once_t uploadThreadOnce = PTHREAD_ONCE_INIT;
+
+static void *ioThreadMain(void *v) {
+    struct ioThread *io = (struct ioThread *) v;
+    struct sharedRequest *req, *next, *pending, *resumed, **link;
+    struct curl_waitfd wakeFd;
+    CURLMsg *msg;
+    CURLcode result;
+    CURL *easy;
+    int running, left;
+    char drain[64];
+    
+    for (;;) {
+        pthread_mutex_lock(&io->lock);
+        pending = io->pending;
+        io->pending = NULL;
+        resumed = io->resumed;
+        io->resumed = NULL;
+        pthread_mutex_unlock(&io->lock);
+        for (req = pending; req; req = req->next) {
+            curl_multi_add_handle(io->multi, req->curl);
+        }
+        for (req = resumed; req; req = next) {
+            // A paused upload cannot end, so req is still there
+            next = req->next;
+            curl_easy_pause(req->curl, CURLPAUSE_CONT);
+        }
+        curl_multi_perform(io->multi, &running);
+        while ((msg = curl_multi_info_read(io->multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            easy = msg->easy_handle;
+            result = msg->data.result;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **) &req);
+            curl_multi_remove_handle(io->multi, easy);
+            if (req->uploadBuffer) {
+                // Wake hdfsWrite up if it is waiting for room that will never come
+                pthread_mutex_lock(&req->uploadBuffer->writeMutex);
+                // ... and keep anyone from resuming it from now on
+                req->uploadBuffer->transferDone = 1;
+                req->uploadBuffer->paused = 0;
+                pthread_cond_broadcast(&req->uploadBuffer->transfer_finish);
+                pthread_mutex_unlock(&req->uploadBuffer->writeMutex);
+            }
+            pthread_mutex_lock(&io->lock);
+            // An upload can stop while paused, if the datanode gives up on
+            // it; a resume asked for before that must not outlive it
+            for (link = &io->resumed; *link; link = &(*link)->next) {
+                if (*link == req) {
+                    *link = req->next;
+                    break;
+                }
+            }
+            req->result = result;
+            req->done = 1;
+            pthread_cond_signal(&req->cond);
+            pthread_mutex_unlock(&io->lock);
+        }
+        wakeFd.fd = io->wakeFds[0];
+        wakeFd.events = CURL_WAIT_POLLIN;
+        wakeFd.revents = 0;
+        curl_multi_wait(io->multi, &wakeFd, 1, 1000, NULL);
+        if (wakeFd.revents) {
+            while (read(io->wakeFds[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start an I/O thread.  io->started is left 0 if it could not be.
+ *
+ * @param maxHostConnections    The most connections to keep open to one
+ *                              server, or 0 for no limit
+ * @param pipelining            Whether requests may share a connection
+ */
+static void startIoThread(struct ioThread *io, long maxHostConnections,
+                          int pipelining) {
+    pthread_t thread;
+    
+    initCurlGlobal();
+    io->multi = curl_multi_init();
+    if (!io->multi) {
+        fprintf(stderr, "Failed to create the shared curl multi handle\n");
+        return;
+    }
+    if (pipelining) {
+#ifdef CURLPIPE_MULTIPLEX
+        // Multiplex over HTTP/2 where the server speaks it
+        curl_multi_setopt(io->multi, CURLMOPT_PIPELINING,
+                          (long) (CURLPIPE_HTTP1 | CURLPIPE_MULTIPLEX));
+#else
+        curl_multi_setopt(io->multi, CURLMOPT_PIPELINING, 1L);
+#endif
+    }
+    if (maxHostConnections > 0) {
+        // Requests beyond this wait for a connection inside the multi handle
+        curl_multi_setopt(io->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                          maxHostConnections);
+    }
+    if (pipe(io->wakeFds)) {
+        fprintf(stderr, "Failed to create the pipe of the curl I/O thread\n");
+        curl_multi_cleanup(io->multi);
+        return;
+    }
+    fcntl(io->wakeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(io->wakeFds[1], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&thread, NULL, ioThreadMain, io)) {
+        fprintf(stderr, "Failed to create the curl I/O thread\n");
+        close(io->wakeFds[0]);
+        close(io->wakeFds[1]);
+        curl_multi_cleanup(io->multi);
+        return;
+    }
+    pthread_detach(thread);
+    io->started = 1;
+}
+
+static void startSharedThread() {
+    startIoThread(&sharedIo, WEBHDFS_MAX_HOST_CONNECTIONS, 1);
+}
+
+/**
+ * An upload does not end until its file is closed, so uploads must neither
+ * wait for a connection nor share one: each gets a connection of its own.
+ */
+static void startUploadThread() {
+    startIoThread(&uploadIo, 0, 0);
+}
+
+static void wakeIoThread(struct ioThread *io) {
+    if (write(io->wakeFds[1], "", 1) < 0 && errno != EAGAIN) {
+        fprintf(stderr, "Failed to wake the curl I/O thread: error %d\n", errno);
+    }
+}
+
+/**
+ * Hand a request to an I/O thread.  The request must stay there until
+ * waitShared returns.
+ */
+static void submitShared(struct ioThread *io, struct sharedRequest *req) {
+    curl_easy_setopt(req->curl, CURLOPT_PRIVATE, (char *) req);
+    pthread_cond_init(&req->cond, NULL);
+    pthread_mutex_lock(&io->lock);
+    req->next = io->pending;
+    io->pending = req;
+    pthread_mutex_unlock(&io->lock);
+    wakeIoThread(io);
+}
+
+static CURLcode waitShared(struct ioThread *io, struct sharedRequest *req) {
+    pthread_mutex_lock(&io->lock);
+    while (!req->done) {
+        pthread_cond_wait(&req->cond, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+    pthread_cond_destroy(&req->cond);
+    return req->result;
+}
+
+/**
+ * Run a request on the I/O thread shared by every thread of the process,
+ * which keeps the connections of all of them in one cache.  Concurrent
+ * requests to the same server then share a few connections, multiplexed
+ * over HTTP/2 when the server supports it, instead of each thread keeping
+ * connections of its own.  The request's callbacks run on the I/O thread,
+ * so they must not block.
+ *
+ * Falls back to running the request on the calling thread if the I/O
+ * thread could not be started.
+ */
+static CURLcode performShared(CURL *curl) {
+    struct sharedRequest req;
+    
+    pthread_once(&sharedThreadOnce, startSharedThread);
+    if (!sharedIo.started) {
+        return curl_easy_perform(curl);
+    }
+#ifdef CURL_HTTP_VERSION_2TLS
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+#endif
+    memset(&req, 0, sizeof(req));
+    req.curl = curl;
+    submitShared(&sharedIo, &req);
+    return waitShared(&sharedIo, &req);
+}
+
+/**
+ * Ask for a response body compressed in any encoding libcurl can decode.
+ * libcurl decompresses it before the write callback sees it, and sends
+ * the header only if it was built with zlib.  Used for the JSON replies of
+ * metadata operations, which shrink about ten times.
+ */
+static void acceptCompressed(CURL *curl) {
+#if LIBCURL_VERSION_NUM >= 0x071506
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+#else
+    curl_easy_setopt(curl, CURLOPT_ENCODING, "");
+#endif
+}
+
+/**
+ * Set up a curl handle for a request whose response is kept in resp.
+ */
+static void setupCmd(CURL *curl, char *url, enum HttpHeader method,
+                     enum Redirect followloc, Response resp) {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp->body);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerfunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEHEADER, resp);
+    curl_easy_setopt(curl, CURLOPT_URL, url);       /* specify target URL */
+    switch(method) {
+        case GET:
+            // Only GETs return JSON worth compressing; the empty replies of
+            // the others are checked for their Content-Length, which a
+            // compressed reply may not have
+            acceptCompressed(curl);
+            break;
+        case PUT:
+            curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"PUT");
+            break;
+        case POST:
+            curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"POST");
+            break;
+        case DELETE:
+            curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"DELETE");
+            break;
+        default:
+            fprintf(stderr, "\nHTTP method not defined\n");
+            exit(EXIT_FAILURE);
+    }
+    if(followloc == YES) {
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+    }
+}
+
+static Response newCmdResponse() {
     Response resp;
     
     resp = (Response) calloc(1, sizeof(*resp));
@@ -162,44 +598,158 @@ static Response launchCmd(char *url, enum HttpHeader method, enum Redirect follo
     }
     resp->body = initResponseBuffer();
     resp->header = initResponseBuffer();
-    initCurlGlobal();
-    curl = curl_easy_init();                     /* get a curl handle */
+    return resp;
+}
+
+static Response launchCmd(char *url, enum HttpHeader method, enum Redirect followloc) {
+    CURL *curl;
+    CURLcode res;
+    Response resp;
+    
+    resp = newCmdResponse();
+    if (!resp) {
+        return NULL;
+    }
+    curl = getCurlHandle();                      /* get a curl handle */
     if(curl) {
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp->body);
-        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writefunc);
-        curl_easy_setopt(curl, CURLOPT_WRITEHEADER, resp->header);
-        curl_easy_setopt(curl, CURLOPT_URL, url);       /* specify target URL */
-        switch(method) {
-            case GET:
-                break;
-            case PUT:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"PUT");
-                break;
-            case POST:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"POST");
-                break;
-            case DELETE:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"DELETE");
-                break;
-            default:
-                fprintf(stderr, "\nHTTP method not defined\n");
-                exit(EXIT_FAILURE);
-        }
-        if(followloc == YES) {
-            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-        }
-        
-        res = curl_easy_perform(curl);                 /* Now run the curl handler */
+        setupCmd(curl, url, method, followloc, resp);
+        res = performShared(curl);                     /* Now run the curl handler */
         if(res != CURLE_OK) {
             fprintf(stderr, "preform the URL %s failed\n", url);
+            freeResponse(resp);
             return NULL;
         }
-        curl_easy_cleanup(curl);
     }
     return resp;
 }
 
+/**
+ * Start a request of a batch on a handle.
+ *
+ * @return 0 if it was started; -1 if it is to be skipped
+ */
+static int startBatchRequest(CURLM *multi, CURL *curl, webhdfsBatchRequest *req)
+{
+    if (!req->url) {
+        return -1;
+    }
+    req->resp = newCmdResponse();
+    if (!req->resp) {
+        return -1;
+    }
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    setupCmd(curl, req->url, req->method, NO, req->resp);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (char *) req);
+    if (curl_multi_add_handle(multi, curl)) {
+        freeResponse(req->resp);
+        req->resp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Start the next request of a batch that can be started on a handle.
+ *
+ * @return 1 if a request was started; 0 if none is left
+ */
+static int startNextBatchRequest(CURLM *multi, CURL *curl,
+                                 webhdfsBatchRequest *reqs, int numReqs,
+                                 int *next)
+{
+    while (*next < numReqs) {
+        if (!startBatchRequest(multi, curl, &reqs[(*next)++])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int launchBatch(webhdfsBatchRequest *reqs, int numReqs, int maxConcurrency)
+{
+    CURLM *multi;
+    CURL **handles;
+    CURL *easy;
+    CURLMsg *msg;
+    CURLcode result;
+    webhdfsBatchRequest *req;
+    int i, next = 0, numHandles = 0, active = 0, running, left;
+    
+    for (i = 0; i < numReqs; i++) {
+        reqs[i].resp = NULL;
+    }
+    if (numReqs <= 0) {
+        return 0;
+    }
+    if (maxConcurrency < 1) {
+        maxConcurrency = 1;
+    } else if (maxConcurrency > numReqs) {
+        maxConcurrency = numReqs;
+    }
+    initCurlGlobal();
+    // A multi handle of its own, so that a large batch does not hold up the
+    // requests of other threads on the shared one
+    multi = curl_multi_init();
+    if (!multi) {
+        return ENOMEM;
+    }
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+                      (long) (CURLPIPE_HTTP1 | CURLPIPE_MULTIPLEX));
+#endif
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      (long) maxConcurrency);
+    handles = calloc(maxConcurrency, sizeof(*handles));
+    if (!handles) {
+        curl_multi_cleanup(multi);
+        return ENOMEM;
+    }
+    for (numHandles = 0; numHandles < maxConcurrency && next < numReqs;
+            numHandles++) {
+        handles[numHandles] = curl_easy_init();
+        if (!handles[numHandles]) {
+            break;
+        }
+        active += startNextBatchRequest(multi, handles[numHandles], reqs,
+                                        numReqs, &next);
+    }
+    if (numHandles == 0) {
+        free(handles);
+        curl_multi_cleanup(multi);
+        return ENOMEM;
+    }
+    while (active > 0) {
+        curl_multi_perform(multi, &running);
+        while ((msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            easy = msg->easy_handle;
+            result = msg->data.result;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **) &req);
+            curl_multi_remove_handle(multi, easy);
+            active--;
+            if (result != CURLE_OK) {
+                fprintf(stderr, "preform the URL %s failed\n", req->url);
+                freeResponse(req->resp);
+                req->resp = NULL;
+            }
+            // The handle, and its connection, go on to the next request
+            active += startNextBatchRequest(multi, easy, reqs, numReqs, &next);
+        }
+        if (active > 0) {
+            curl_multi_wait(multi, NULL, 0, 1000, NULL);
+        }
+    }
+    for (i = 0; i < numHandles; i++) {
+        curl_easy_cleanup(handles[i]);
+    }
+    free(handles);
+    curl_multi_cleanup(multi);
+    return 0;
+}
+
 static Response launchRead_internal(char *url, enum HttpHeader method, enum Redirect followloc, Response resp) {
     if (!resp || !resp->body || !resp->body->content) {
         fprintf(stderr, "The user provided buffer should not be NULL!\n");
@@ -208,8 +758,7 @@ static Response launchRead_internal(char *url, enum HttpHeader method, enum Redi
     
     CURL *curl;
     CURLcode res;
-    initCurlGlobal();
-    curl = curl_easy_init();                     /* get a curl handle */
+    curl = getCurlHandle();                      /* get a curl handle */
     if(curl) {
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc_withbuffer);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp->body);
@@ -225,74 +774,170 @@ static Response launchRead_internal(char *url, enum HttpHeader method, enum Redi
             fprintf(stderr, "preform the URL %s failed\n", url);
             return NULL;
         }
-        curl_easy_cleanup(curl);
     }
     return resp;
 
 }
 
-static Response launchWrite(const char *url, enum HttpHeader method, webhdfsBuffer *uploadBuffer) {
+/**
+ * An upload run by the upload I/O thread
+ */
+struct webhdfsUpload {
+    struct sharedRequest req;
+    Response resp;
+    struct curl_slist *headers;
+};
+
+static void freeUpload(webhdfsUpload *upload) {
+    if (upload->req.curl) {
+        curl_easy_cleanup(upload->req.curl);
+    }
+    curl_slist_free_all(upload->headers);
+    free(upload);
+}
+
+static webhdfsUpload *startUpload(const char *url, enum HttpHeader method,
+                                  webhdfsBuffer *uploadBuffer) {
+    webhdfsUpload *upload;
+    CURL *curl;
+    
     if (!uploadBuffer) {
         fprintf(stderr, "upload buffer is NULL!\n");
         errno = EINVAL;
         return NULL;
     }
-    initCurlGlobal();
-    CURLcode res;
-    Response response = (Response) calloc(1, sizeof(*response));
-    if (!response) {
+    pthread_once(&uploadThreadOnce, startUploadThread);
+    if (!uploadIo.started) {
+        errno = EIO;
+        return NULL;
+    }
+    upload = calloc(1, sizeof(*upload));
+    if (!upload) {
+        fprintf(stderr, "failed to allocate memory for the upload\n");
+        errno = ENOMEM;
+        return NULL;
+    }
+    upload->resp = (Response) calloc(1, sizeof(*upload->resp));
+    if (!upload->resp) {
         fprintf(stderr, "failed to allocate memory for response\n");
+        free(upload);
+        errno = ENOMEM;
         return NULL;
     }
-    response->body = initResponseBuffer();
-    response->header = initResponseBuffer();
+    upload->resp->body = initResponseBuffer();
+    upload->resp->header = initResponseBuffer();
     
     //connect to the datanode in order to create the lease in the namenode
-    CURL *curl = curl_easy_init();
+    curl = curl_easy_init();
     if (!curl) {
         fprintf(stderr, "Failed to initialize the curl handle.\n");
+        freeResponse(upload->resp);
+        free(upload);
+        errno = ENOMEM;
         return NULL;
     }
+    upload->req.curl = curl;
+    upload->req.uploadBuffer = uploadBuffer;
     curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, upload->resp->body);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writefunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEHEADER, upload->resp->header);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, readfunc);
+    curl_easy_setopt(curl, CURLOPT_READDATA, uploadBuffer);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
     
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, response->body);
-        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writefunc);
-        curl_easy_setopt(curl, CURLOPT_WRITEHEADER, response->header);
-        curl_easy_setopt(curl, CURLOPT_READFUNCTION, readfunc);
-        curl_easy_setopt(curl, CURLOPT_READDATA, uploadBuffer);
-        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-        
-        struct curl_slist *chunk = NULL;
-        chunk = curl_slist_append(chunk, "Transfer-Encoding: chunked");
-        res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
-        chunk = curl_slist_append(chunk, "Expect:");
-        res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
-        
-        switch(method) {
-            case GET:
-                break;
-            case PUT:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"PUT");
-                break;
-            case POST:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"POST");
-                break;
-            case DELETE:
-                curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"DELETE");
-                break;
-            default:
-                fprintf(stderr, "\nHTTP method not defined\n");
-                exit(EXIT_FAILURE);
-        }
-        res = curl_easy_perform(curl);
-        curl_slist_free_all(chunk);
-        curl_easy_cleanup(curl);
+    upload->headers = curl_slist_append(upload->headers, "Transfer-Encoding: chunked");
+    upload->headers = curl_slist_append(upload->headers, "Expect:");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, upload->headers);
+    
+    switch(method) {
+        case PUT:
+            curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"PUT");
+            break;
+        case POST:
+            curl_easy_setopt(curl,CURLOPT_CUSTOMREQUEST,"POST");
+            break;
+        default:
+            fprintf(stderr, "\nHTTP method not defined\n");
+            exit(EXIT_FAILURE);
+    }
+    // readfunc may pause the upload as soon as the I/O thread starts it
+    pthread_mutex_lock(&uploadBuffer->writeMutex);
+    uploadBuffer->upload = upload;
+    pthread_mutex_unlock(&uploadBuffer->writeMutex);
+    submitShared(&uploadIo, &upload->req);
+    return upload;
+}
+
+void resumeUpload(webhdfsUpload *upload) {
+    pthread_mutex_lock(&uploadIo.lock);
+    upload->req.next = uploadIo.resumed;
+    uploadIo.resumed = &upload->req;
+    pthread_mutex_unlock(&uploadIo.lock);
+    wakeIoThread(&uploadIo);
+}
+
+Response finishUpload(webhdfsUpload *upload) {
+    Response resp;
+    
+    waitShared(&uploadIo, &upload->req);
+    resp = upload->resp;
+    freeUpload(upload);
+    return resp;
+}
+
+Response launchStreamOPEN(const char *url, webhdfsReadBuffer *buffer) {
+    CURL *curl;
+    CURLcode res;
+    Response resp;
+    int closeFlag;
+    
+    resp = (Response) calloc(1, sizeof(*resp));
+    if (!resp) {
+        return NULL;
+    }
+    resp->body = initResponseBuffer();
+    resp->header = initResponseBuffer();
+    initCurlGlobal();
+    // The stream runs on a thread of its own, so its handle is not reused
+    curl = curl_easy_init();
+    if (!curl) {
+        fprintf(stderr, "Failed to initialize the curl handle.\n");
+        freeResponse(resp);
+        return NULL;
     }
+    buffer->curl = curl;
+    buffer->errorBody = resp->body;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, streamfunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writefunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEHEADER, resp->header);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+#if LIBCURL_VERSION_NUM >= 0x072000
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, streamprogressfunc);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, buffer);
+#else
+    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, streamprogressfunc);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, buffer);
+#endif
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
     
-    return response;
+    res = curl_easy_perform(curl);
+    curl_easy_cleanup(curl);
+    pthread_mutex_lock(&buffer->readMutex);
+    buffer->curl = NULL;
+    buffer->errorBody = NULL;
+    closeFlag = buffer->closeFlag;
+    pthread_mutex_unlock(&buffer->readMutex);
+    if (res != CURLE_OK && !closeFlag) {
+        fprintf(stderr, "preform the URL %s failed\n", url);
+        freeResponse(resp);
+        return NULL;
+    }
+    return resp;
 }
 
 Response launchMKDIR(char *url) {
@@ -307,8 +952,53 @@ Response launchGFS(char *url) {
     return launchCmd(url, GET, NO);
 }
 
-Response launchLS(char *url) {
-    return launchCmd(url, GET, NO);
+struct bodyCallback {
+    webhdfsBodyCallback callback;
+    void *ctx;
+};
+
+/* Callback for handing the response body to the caller as it arrives */
+static size_t bodyfunc(void *ptr, size_t size, size_t nmemb, void *stream) {
+    struct bodyCallback *cb = (struct bodyCallback *) stream;
+    
+    if (size * nmemb < 1) {
+        return 0;
+    }
+    if (cb->callback(ptr, size * nmemb, cb->ctx)) {
+        return 0;                               /* aborts the transfer */
+    }
+    return size * nmemb;
+}
+
+Response launchLS(char *url, webhdfsBodyCallback callback, void *ctx) {
+    struct bodyCallback cb = { callback, ctx };
+    CURL *curl;
+    CURLcode res;
+    Response resp;
+    
+    resp = (Response) calloc(1, sizeof(*resp));
+    if (!resp) {
+        return NULL;
+    }
+    resp->header = initResponseBuffer();
+    curl = getCurlHandle();
+    if (!curl) {
+        freeResponse(resp);
+        return NULL;
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bodyfunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writefunc);
+    curl_easy_setopt(curl, CURLOPT_WRITEHEADER, resp->header);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    acceptCompressed(curl);
+    res = performShared(curl);
+    if (res != CURLE_OK) {
+        fprintf(stderr, "preform the URL %s failed\n", url);
+        freeResponse(resp);
+        return NULL;
+    }
+    return resp;
 }
 
 Response launchCHMOD(char *url) {
@@ -339,14 +1029,18 @@ Response launchNnAPPEND(char *url) {
     return launchCmd(url, POST, NO);
 }
 
-Response launchDnWRITE(const char *url, webhdfsBuffer *buffer) {
-    return launchWrite(url, PUT, buffer);
+webhdfsUpload *startDnWRITE(const char *url, webhdfsBuffer *buffer) {
+    return startUpload(url, PUT, buffer);
 }
 
-Response launchDnAPPEND(const char *url, webhdfsBuffer *buffer) {
-    return launchWrite(url, POST, buffer);
+webhdfsUpload *startDnAPPEND(const char *url, webhdfsBuffer *buffer) {
+    return startUpload(url, POST, buffer);
 }
 
 Response launchSETREPLICATION(char *url) {
     return launchCmd(url, PUT, NO);
 }
+
+Response launchGetBlockLocations(char *url) {
+    return launchCmd(url, GET, NO);
+}
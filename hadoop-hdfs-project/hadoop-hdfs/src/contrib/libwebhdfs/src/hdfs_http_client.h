@@ -33,29 +33,88 @@ enum hdfsStreamType
     OUTPUT = 2,
 };
 
+/**
+ * The smallest size of the upload buffer of a file opened for writing.
+ * A larger bufferSize given to hdfsOpenFile is used instead.
+ */
+#define WEBHDFS_UPLOAD_BUFFER_SIZE (1024 * 1024)
+
 /**
  * webhdfsBuffer - used for hold the data for read/write from/to http connection
+ *
+ * For uploads, hdfsWrite copies the user's data into a ring buffer and
+ * returns, and the upload I/O thread drains the ring into the http
+ * connection.  The upload pauses while the ring is empty; whoever next puts
+ * data in the ring or closes the file resumes it.
  */
+struct webhdfsUpload;
+typedef struct webhdfsUpload webhdfsUpload;
+
 typedef struct {
-    const char *wbuffer;  // The user's buffer for uploading
+    char *wbuffer;        // The ring of data waiting for uploading
+    size_t capacity;      // Size of wbuffer
     size_t remaining;     // Length of content
     size_t offset;        // offset for reading
     int openFlag;         // Check whether the hdfsOpenFile has been called before
     int closeFlag;        // Whether to close the http connection for writing
+    int transferDone;     // Set once the transfer has stopped
+    int paused;           // Set while the upload waits for data or closeFlag
+    webhdfsUpload *upload; // The transfer draining the ring
     pthread_mutex_t writeMutex; // Synchronization between the curl and hdfsWrite threads
-    pthread_cond_t newwrite_or_close; // Transferring thread waits for this condition
-                                      // when there is no more content for transferring in the buffer
-    pthread_cond_t transfer_finish; // Condition used to indicate finishing transferring (one buffer)
+    pthread_cond_t transfer_finish; // Condition used to indicate space was freed in the buffer,
+                                    // or the transfer stopped
 } webhdfsBuffer;
 
+typedef struct {
+    char *content;
+    size_t remaining;
+    size_t offset;
+} ResponseBufferInternal;
+typedef ResponseBufferInternal *ResponseBuffer;
+
+/**
+ * webhdfsReadBuffer - used for handing the data of a streaming read from the
+ * http connection to hdfsRead
+ */
+typedef struct {
+    char *rbuffer;        // The user's buffer for downloading
+    size_t remaining;     // Space left in rbuffer
+    size_t offset;        // Bytes put in rbuffer so far
+    int closeFlag;        // Whether to abort the transfer
+    int finished;         // Set once the transfer has ended
+    int error;            // Why the transfer ended; 0 for end of file
+    int responseChecked;  // Whether responseOk has been set yet
+    int responseOk;       // Whether the response is the file's data
+    void *curl;           // The curl handle doing the transfer
+    ResponseBuffer errorBody; // Where an error response is put
+    pthread_mutex_t readMutex; // Synchronization between the curl and hdfsRead threads
+    pthread_cond_t newread_or_close; // Transferring thread waits for this condition
+                                     // when there is no user's buffer to fill
+    pthread_cond_t transfer_finish; // Condition used to indicate data was put in rbuffer,
+                                    // or the transfer ended
+} webhdfsReadBuffer;
+
 struct webhdfsFileHandle {
     char *absPath;
     int bufferSize;
     short replication;
     tSize blockSize;
     char *datanode;
+    char *openUrl;        // OPEN url of the file without offset and length,
+                          // for reads
     webhdfsBuffer *uploadBuffer;
-    pthread_t connThread;
+    pthread_t connThread; // The thread of the streaming read, if any
+    webhdfsReadBuffer *downloadBuffer; // Non-NULL while a streaming read is open
+    tOffset streamOffset; // File offset of the next byte the stream will return
+    struct webhdfsPrefetch *prefetch; // Non-NULL while parallel reads are running
+    tOffset fileLength;   // The length of the file when last looked up, for
+                          // hdfsSeek; -1 if not known
+    pthread_mutex_t readDatanodeLock; // Protects the fields below
+    char *readDatanode;   // The datanode OPEN url of the last read redirect, if any,
+                          // without offset and length
+    tOffset readBlockStart; // The block of the file readDatanode was chosen for
+    tOffset readBlockEnd;
+    tOffset readBlockSize;  // The block size of the file, once known
 };
 
 enum HttpHeader {
@@ -70,13 +129,6 @@ enum Redirect {
     NO
 };
 
-typedef struct {
-    char *content;
-    size_t remaining;
-    size_t offset;
-} ResponseBufferInternal;
-typedef ResponseBufferInternal *ResponseBuffer;
-
 /**
  * The response got through webhdfs
  */
@@ -93,16 +145,79 @@ Response launchMKDIR(char *url);
 Response launchRENAME(char *url);
 Response launchCHMOD(char *url);
 Response launchGFS(char *url);
-Response launchLS(char *url);
+/**
+ * Called with each part of a response body as it arrives.
+ *
+ * @return 0 to go on; nonzero to abort the transfer
+ */
+typedef int (*webhdfsBodyCallback)(const char *data, size_t len, void *ctx);
+
+/**
+ * List a directory, handing the body of the response to callback as it
+ * arrives instead of keeping it in the response.
+ */
+Response launchLS(char *url, webhdfsBodyCallback callback, void *ctx);
 Response launchDELETE(char *url);
 Response launchCHOWN(char *url);
 Response launchOPEN(char *url, Response resp);
 Response launchUTIMES(char *url);
 Response launchNnWRITE(char *url);
 
-Response launchDnWRITE(const char *url, webhdfsBuffer *buffer);
 Response launchNnAPPEND(char *url);
 Response launchSETREPLICATION(char *url);
-Response launchDnAPPEND(const char *url, webhdfsBuffer *buffer);
+Response launchGetBlockLocations(char *url);
+
+/**
+ * Start uploading the data put in buffer to a datanode.  The upload runs on
+ * an I/O thread shared by every upload of the process, so the number of
+ * threads does not grow with the number of files open for writing.
+ *
+ * @return The upload, or NULL with errno set if it could not be started
+ */
+webhdfsUpload *startDnWRITE(const char *url, webhdfsBuffer *buffer);
+webhdfsUpload *startDnAPPEND(const char *url, webhdfsBuffer *buffer);
+
+/**
+ * Resume an upload that paused because its ring was empty.  Called after
+ * putting data in the ring or setting closeFlag, with writeMutex held, and
+ * only when paused was set; the caller clears it.
+ */
+void resumeUpload(webhdfsUpload *upload);
+
+/**
+ * Wait for an upload to end, once closeFlag has been set, and free it.
+ *
+ * @return The response of the datanode
+ */
+Response finishUpload(webhdfsUpload *upload);
+
+/**
+ * Read a file from the given offset to its end in one request, handing the
+ * data to the buffers given in downloadBuffer as they arrive.  Blocks until
+ * the transfer ends or downloadBuffer->closeFlag is set.
+ *
+ * @return The response, whose body is only filled in if the request failed,
+ *         or NULL if it could not be made
+ */
+Response launchStreamOPEN(const char *url, webhdfsReadBuffer *buffer);
+
+/**
+ * A request made by launchBatch
+ */
+typedef struct {
+    char *url;            // The url, or NULL to skip the request
+    enum HttpHeader method;
+    Response resp;        // (out param) The response, or NULL if the request
+                          // was skipped or failed
+} webhdfsBatchRequest;
+
+/**
+ * Make many requests, with up to maxConcurrency of them in flight at once.
+ * Each handle goes on to another request as soon as its last one finishes,
+ * so the connections are reused.
+ *
+ * @return 0 once every request has been made; ENOMEM if none could be
+ */
+int launchBatch(webhdfsBatchRequest *reqs, int numReqs, int maxConcurrency);
 
 #endif //_HDFS_HTTP_CLIENT_H_
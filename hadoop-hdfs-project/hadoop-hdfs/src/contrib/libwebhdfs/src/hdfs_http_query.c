@@ -16,239 +16,241 @@
  * limitations under the License.
  */
 #include "hdfs_http_query.h"
-#include <math.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 
-#define NUM_OF_PERMISSION_BITS 4
-#define NUM_OF_PORT_BITS 6
-#define NUM_OF_REPLICATION_BITS 6
-
-static char *prepareQUERY(const char *host, int nnPort, const char *srcpath, const char *OP, const char *user) {
-    size_t length;
-    char *url;
-    const char *const protocol = "http://";
-    const char *const prefix = "/webhdfs/v1";
-    char *temp;
-    char *port;
-    port= (char*) malloc(NUM_OF_PORT_BITS);
-    if (!port) {
+/**
+ * Percent-encode a path for the path or the query of a url.  Slashes and
+ * the unreserved characters of RFC 3986 are kept as they are.
+ *
+ * @return The malloc'ed encoded path, or NULL on OOM
+ */
+static char *encodePath(const char *path) {
+    static const char *const hex = "0123456789ABCDEF";
+    const unsigned char *c;
+    char *encoded, *out;
+    
+    encoded = malloc(strlen(path) * 3 + 1);
+    if (!encoded) {
         return NULL;
     }
-    sprintf(port,"%d",nnPort);
-    if (user != NULL) {
-        length = strlen(protocol) + strlen(host) + strlen(":") + strlen(port) + strlen(prefix) + strlen(srcpath) + strlen ("?op=") + strlen(OP) + strlen("&user.name=") + strlen(user);
-    } else {
-        length = strlen(protocol) + strlen(host) + strlen(":") + strlen(port) + strlen(prefix) + strlen(srcpath) +  strlen ("?op=") + strlen(OP);
+    out = encoded;
+    for (c = (const unsigned char *) path; *c; c++) {
+        if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                (*c >= '0' && *c <= '9') || strchr("/-._~", *c)) {
+            *out++ = *c;
+        } else {
+            *out++ = '%';
+            *out++ = hex[*c >> 4];
+            *out++ = hex[*c & 0xf];
+        }
     }
+    *out = '\0';
+    return encoded;
+}
+
+/**
+ * Make the url of an operation on a path, in one allocation.
+ *
+ * @param fmt   If not NULL, a printf-style format of the parameters that
+ *              follow op and user.name, each starting with '&'
+ * @return The malloc'ed url, or NULL on OOM
+ */
+static char *prepareQUERY(const char *host, int nnPort, const char *srcpath,
+                          const char *OP, const char *user,
+                          const char *fmt, ...) {
+    va_list ap;
+    char *path, *url = NULL;
+    int baseLen, paramsLen = 0;
     
-    temp = (char*) malloc(length + 1);
-    if (!temp) {
+    path = encodePath(srcpath);
+    if (!path) {
         return NULL;
     }
-    strcpy(temp,protocol);
-    temp = strcat(temp,host);
-    temp = strcat(temp,":");
-    temp = strcat(temp,port);
-    temp = strcat(temp,prefix);
-    temp = strcat(temp,srcpath);
-    temp = strcat(temp,"?op=");
-    temp = strcat(temp,OP);
-    if (user) {
-        temp = strcat(temp,"&user.name=");
-        temp = strcat(temp,user);
+    baseLen = snprintf(NULL, 0, "http://%s:%d/webhdfs/v1%s?op=%s%s%s",
+                       host, nnPort, path, OP, user ? "&user.name=" : "",
+                       user ? user : "");
+    if (fmt) {
+        va_start(ap, fmt);
+        paramsLen = vsnprintf(NULL, 0, fmt, ap);
+        va_end(ap);
     }
-    url = temp;
+    if (baseLen >= 0 && paramsLen >= 0) {
+        url = malloc(baseLen + paramsLen + 1);
+    }
+    if (url) {
+        snprintf(url, baseLen + 1, "http://%s:%d/webhdfs/v1%s?op=%s%s%s",
+                 host, nnPort, path, OP, user ? "&user.name=" : "",
+                 user ? user : "");
+        if (fmt) {
+            va_start(ap, fmt);
+            vsnprintf(url + baseLen, paramsLen + 1, fmt, ap);
+            va_end(ap);
+        }
+    }
+    free(path);
     return url;
 }
 
+/** A buffer for urls, reused by each thread */
+struct urlBuilder {
+    char *buf;
+    size_t capacity;
+};
 
-static int decToOctal(int decNo) {
-    int octNo=0;
-    int expo =0;
-    while (decNo != 0)  {
-        octNo = ((decNo % 8) * pow(10,expo)) + octNo;
-        decNo = decNo / 8;
-        expo++;
+static pthread_once_t urlBuilderKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t urlBuilderKey;
+static int urlBuilderKeyCreated = 0;
+
+static void freeUrlBuilder(void *v) {
+    struct urlBuilder *builder = (struct urlBuilder *) v;
+    
+    free(builder->buf);
+    free(builder);
+}
+
+static void makeUrlBuilderKey() {
+    if (pthread_key_create(&urlBuilderKey, freeUrlBuilder)) {
+        fprintf(stderr, "Failed to create the thread-local url builder key\n");
+        return;
     }
-    return octNo;
+    urlBuilderKeyCreated = 1;
 }
 
+const char *buildRangedURL(const char *base, int64_t offset, int64_t length) {
+    struct urlBuilder *builder;
+    size_t needed;
+    char *buf;
+    
+    pthread_once(&urlBuilderKeyOnce, makeUrlBuilderKey);
+    if (!urlBuilderKeyCreated) {
+        return NULL;
+    }
+    builder = pthread_getspecific(urlBuilderKey);
+    if (!builder) {
+        builder = calloc(1, sizeof(*builder));
+        if (!builder) {
+            return NULL;
+        }
+        if (pthread_setspecific(urlBuilderKey, builder)) {
+            free(builder);
+            return NULL;
+        }
+    }
+    // Two 64-bit numbers take at most 40 characters
+    needed = strlen(base) + strlen("&offset=&length=") + 40 + 1;
+    if (needed > builder->capacity) {
+        buf = realloc(builder->buf, needed);
+        if (!buf) {
+            return NULL;
+        }
+        builder->buf = buf;
+        builder->capacity = needed;
+    }
+    snprintf(builder->buf, builder->capacity,
+             "%s&offset=%" PRId64 "&length=%" PRId64, base, offset, length);
+    return builder->buf;
+}
 
 char *prepareMKDIR(const char *host, int nnPort, const char *dirsubpath, const char *user) {
-    return prepareQUERY(host, nnPort, dirsubpath, "MKDIRS", user);
+    return prepareQUERY(host, nnPort, dirsubpath, "MKDIRS", user, NULL);
 }
 
 
 char *prepareMKDIRwithMode(const char *host, int nnPort, const char *dirsubpath, int mode, const char *user) {
-    char *url;
-    char *permission;
-    permission = (char*) malloc(NUM_OF_PERMISSION_BITS);
-    if (!permission) {
-        return NULL;
-    }
-    mode = decToOctal(mode);
-    sprintf(permission,"%d",mode);
-    url = prepareMKDIR(host, nnPort, dirsubpath, user);
-    url = realloc(url,(strlen(url) + strlen("&permission=") + strlen(permission) + 1));
-    if (!url) {
-        return NULL;
-    }
-    url = strcat(url,"&permission=");
-    url = strcat(url,permission);
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "MKDIRS", user,
+                        "&permission=%o", mode);
 }
 
 
 char *prepareRENAME(const char *host, int nnPort, const char *srcpath, const char *destpath, const char *user) {
-    char *url;
-    url = prepareQUERY(host, nnPort, srcpath, "RENAME", user);
-    url = realloc(url,(strlen(url) + strlen("&destination=") + strlen(destpath) + 1));
-    if (!url) {
+    char *url, *destination;
+    
+    destination = encodePath(destpath);
+    if (!destination) {
         return NULL;
     }
-    url = strcat(url,"&destination=");
-    url = strcat(url,destpath);
+    url = prepareQUERY(host, nnPort, srcpath, "RENAME", user,
+                       "&destination=%s", destination);
+    free(destination);
     return url;
 }
 
 char *prepareGFS(const char *host, int nnPort, const char *dirsubpath, const char *user) {
-    return (prepareQUERY(host, nnPort, dirsubpath, "GETFILESTATUS", user));
+    return (prepareQUERY(host, nnPort, dirsubpath, "GETFILESTATUS", user, NULL));
 }
 
 char *prepareLS(const char *host, int nnPort, const char *dirsubpath, const char *user) {
-    return (prepareQUERY(host, nnPort, dirsubpath, "LISTSTATUS", user));
+    return (prepareQUERY(host, nnPort, dirsubpath, "LISTSTATUS", user, NULL));
 }
 
 char *prepareCHMOD(const char *host, int nnPort, const char *dirsubpath, int mode, const char *user) {
-    char *url;
-    char *permission;
-    permission = (char*) malloc(NUM_OF_PERMISSION_BITS);
-    if (!permission) {
-        return NULL;
-    }
-    mode &= 0x3FFF;
-    mode = decToOctal(mode);
-    sprintf(permission,"%d",mode);
-    url = prepareQUERY(host, nnPort, dirsubpath, "SETPERMISSION", user);
-    url = realloc(url,(strlen(url) + strlen("&permission=") + strlen(permission) + 1));
-    if (!url) {
-        return NULL;
-    }
-    url = strcat(url,"&permission=");
-    url = strcat(url,permission);
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "SETPERMISSION", user,
+                        "&permission=%o", mode & 0x3FFF);
 }
 
 char *prepareDELETE(const char *host, int nnPort, const char *dirsubpath, int recursive, const char *user) {
-    char *url = (prepareQUERY(host, nnPort, dirsubpath, "DELETE", user));
-    char *recursiveFlag = (char *)malloc(6);
-    if (!recursive) {
-        strcpy(recursiveFlag, "false");
-    } else {
-        strcpy(recursiveFlag, "true");
-    }
-    url = (char *) realloc(url, strlen(url) + strlen("&recursive=") + strlen(recursiveFlag) + 1);
-    if (!url) {
-        return NULL;
-    }
-    
-    strcat(url, "&recursive=");
-    strcat(url, recursiveFlag);
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "DELETE", user,
+                        "&recursive=%s", recursive ? "true" : "false");
 }
 
 char *prepareCHOWN(const char *host, int nnPort, const char *dirsubpath, const char *owner, const char *group, const char *user) {
-    char *url;
-    url = prepareQUERY(host, nnPort, dirsubpath, "SETOWNER", user);
-    if (!url) {
-        return NULL;
-    }
-    if(owner != NULL) {
-        url = realloc(url,(strlen(url) + strlen("&owner=") + strlen(owner) + 1));
-        url = strcat(url,"&owner=");
-        url = strcat(url,owner);
-    }
-    if (group != NULL) {
-        url = realloc(url,(strlen(url) + strlen("&group=") + strlen(group) + 1));
-        url = strcat(url,"&group=");
-        url = strcat(url,group);
-    }
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "SETOWNER", user,
+                        "%s%s%s%s", owner ? "&owner=" : "", owner ? owner : "",
+                        group ? "&group=" : "", group ? group : "");
 }
 
 char *prepareOPEN(const char *host, int nnPort, const char *dirsubpath, const char *user, size_t offset, size_t length) {
-    char *base_url = prepareQUERY(host, nnPort, dirsubpath, "OPEN", user);
-    char *url = (char *) malloc(strlen(base_url) + strlen("&offset=") + 15 + strlen("&length=") + 15);
-    if (!url) {
-        return NULL;
-    }
-    sprintf(url, "%s&offset=%ld&length=%ld", base_url, offset, length);
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "OPEN", user,
+                        "&offset=%zu&length=%zu", offset, length);
+}
+
+char *prepareOPENBase(const char *host, int nnPort, const char *dirsubpath, const char *user) {
+    return prepareQUERY(host, nnPort, dirsubpath, "OPEN", user, NULL);
+}
+
+char *prepareStreamOPEN(const char *host, int nnPort, const char *dirsubpath, const char *user, size_t offset) {
+    return prepareQUERY(host, nnPort, dirsubpath, "OPEN", user,
+                        "&offset=%zu", offset);
 }
 
 char *prepareUTIMES(const char *host, int nnPort, const char *dirsubpath, long unsigned mTime, long unsigned aTime, const char *user) {
-    char *url;
-    char *modTime;
-    char *acsTime;
-    modTime = (char*) malloc(12);
-    acsTime = (char*) malloc(12);
-    url = prepareQUERY(host, nnPort, dirsubpath, "SETTIMES", user);
-    sprintf(modTime,"%lu",mTime);
-    sprintf(acsTime,"%lu",aTime);
-    url = realloc(url,(strlen(url) + strlen("&modificationtime=") + strlen(modTime) + strlen("&accesstime=") + strlen(acsTime) + 1));
-    if (!url) {
-        return NULL;
-    }
-    url = strcat(url, "&modificationtime=");
-    url = strcat(url, modTime);
-    url = strcat(url,"&accesstime=");
-    url = strcat(url, acsTime);
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "SETTIMES", user,
+                        "&modificationtime=%lu&accesstime=%lu", mTime, aTime);
 }
 
 char *prepareNnWRITE(const char *host, int nnPort, const char *dirsubpath, const char *user, int16_t replication, size_t blockSize) {
-    char *url;
-    url = prepareQUERY(host, nnPort, dirsubpath, "CREATE", user);
-    url = realloc(url, (strlen(url) + strlen("&overwrite=true") + 1));
-    if (!url) {
-        return NULL;
-    }
-    url = strcat(url, "&overwrite=true");
+    char replicationParam[32] = "", blockSizeParam[48] = "";
+    
     if (replication > 0) {
-        url = realloc(url, (strlen(url) + strlen("&replication=") + 6));
-        if (!url) {
-            return NULL;
-        }
-        sprintf(url, "%s&replication=%d", url, replication);
+        snprintf(replicationParam, sizeof(replicationParam),
+                 "&replication=%d", replication);
     }
     if (blockSize > 0) {
-        url = realloc(url, (strlen(url) + strlen("&blocksize=") + 16));
-        if (!url) {
-            return NULL;
-        }
-        sprintf(url, "%s&blocksize=%ld", url, blockSize);
+        snprintf(blockSizeParam, sizeof(blockSizeParam),
+                 "&blocksize=%zu", blockSize);
     }
-    return url;
+    return prepareQUERY(host, nnPort, dirsubpath, "CREATE", user,
+                        "&overwrite=true%s%s", replicationParam, blockSizeParam);
 }
 
 char *prepareNnAPPEND(const char *host, int nnPort, const char *dirsubpath, const char *user) {
-    return (prepareQUERY(host, nnPort, dirsubpath, "APPEND", user));
+    return (prepareQUERY(host, nnPort, dirsubpath, "APPEND", user, NULL));
+}
+
+char *prepareGetBlockLocations(const char *host, int nnPort, const char *path, const char *user, int64_t offset, int64_t length)
+{
+    return prepareQUERY(host, nnPort, path, "GET_BLOCK_LOCATIONS", user,
+                        "&offset=%" PRId64 "&length=%" PRId64, offset, length);
 }
 
 char *prepareSETREPLICATION(const char *host, int nnPort, const char *path, int16_t replication, const char *user)
 {
-    char *url = prepareQUERY(host, nnPort, path, "SETREPLICATION", user);
-    char *replicationNum = (char *) malloc(NUM_OF_REPLICATION_BITS);
-    sprintf(replicationNum, "%u", replication);
-    url = realloc(url, strlen(url) + strlen("&replication=") + strlen(replicationNum)+ 1);
-    if (!url) {
-        return NULL;
-    }
-    
-    url = strcat(url, "&replication=");
-    url = strcat(url, replicationNum);
-    return url;
-}
\ No newline at end of file
+    return prepareQUERY(host, nnPort, path, "SETREPLICATION", user,
+                        "&replication=%d", replication);
+}
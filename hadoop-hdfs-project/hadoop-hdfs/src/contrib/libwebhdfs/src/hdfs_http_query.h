@@ -32,10 +32,26 @@ char *prepareLS(const char *host, int nnPort, const char *dirsubpath, const char
 char *prepareDELETE(const char *host, int nnPort, const char *dirsubpath, int recursive, const char *user);
 char *prepareCHOWN(const char *host, int nnPort, const char *dirsubpath, const char *owner, const char *group, const char *user);
 char *prepareOPEN(const char *host, int nnPort, const char *dirsubpath, const char *user, size_t offset, size_t length);
+char *prepareStreamOPEN(const char *host, int nnPort, const char *dirsubpath, const char *user, size_t offset);
+/**
+ * The url of an OPEN of a file without offset or length, for buildRangedURL.
+ * Worked out once per open file, so that each read only has to add a range.
+ */
+char *prepareOPENBase(const char *host, int nnPort, const char *dirsubpath, const char *user);
 char *prepareUTIMES(const char *host, int nnPort, const char *dirsubpath, long unsigned mTime, long unsigned aTime, const char *user);
 char *prepareNnWRITE(const char *host, int nnPort, const char *dirsubpath, const char *user, int16_t replication, size_t blockSize);
 char *prepareNnAPPEND(const char *host, int nnPort, const char *dirsubpath, const char *user);
 char *prepareSETREPLICATION(const char *host, int nnPort, const char *path, int16_t replication, const char *user);
+char *prepareGetBlockLocations(const char *host, int nnPort, const char *path, const char *user, int64_t offset, int64_t length);
+
+/**
+ * Add an offset and a length to an OPEN url, such as one made with
+ * prepareOPENBase, without allocating.
+ *
+ * @return The url in a buffer of the calling thread, valid until its next
+ *         call, or NULL on OOM
+ */
+const char *buildRangedURL(const char *base, int64_t offset, int64_t length);
 
 
 #endif  //_HDFS_HTTP_QUERY_H_
@@ -338,6 +338,27 @@ int parseOPEN(const char *header, const char *content) {
     return 1;
 }
 
+int parseDnOPEN(const char *header, const char *content) {
+    const char *responseCode = "200 OK";
+    if(!header || strncmp(header,"HTTP/",strlen("HTTP/"))) {
+        return -1;
+    }
+    if(!strstr(header, responseCode)) {
+        struct jsonException *exc = parseException(content);
+        if (exc) {
+            //the offset is out of the range: end of file, as for parseOPEN
+            if (!strcasecmp(exc->exception, "IOException") && strstr(exc->message, "out of the range")) {
+                free(exc);
+                return 0;
+            }
+            errno = printJsonException(exc, PRINT_EXC_ALL, "Calling WEBHDFS (OPEN(DataNode))");
+        }
+        return -1;
+    }
+    
+    return 1;
+}
+
 int parseCHMOD(char *header, const char *content) {
     return checkHeader(header, content, "CHMOD");
 }
@@ -450,3 +471,366 @@ int parseSETREPLICATION(char *response) {
     return (parseBoolean(response));
 }
 
+static const char *jsonStringMember(json_t *obj, const char *key)
+{
+    const char *str = json_string_value(json_object_get(obj, key));
+    return str ? str : "";
+}
+
+/**
+ * Write the host, the IP:xferPort name and the topology path of a datanode
+ * of a block location at heap, or only size them if heap is NULL.  The
+ * topology path is the network location and the name, as in NodeBase; it
+ * is left out if the datanode has no network location.
+ *
+ * @return The bytes the strings take, terminators included
+ */
+static size_t putDatanodeStrings(json_t *dn, char *heap, char **host,
+                                 char **name, char **path)
+{
+    const char *hostName = jsonStringMember(dn, "hostName");
+    const char *ipAddr = jsonStringMember(dn, "ipAddr");
+    const char *location = json_string_value(json_object_get(dn,
+                                                 "networkLocation"));
+    long long xferPort = json_integer_value(json_object_get(dn, "xferPort"));
+    size_t hostLen = strlen(hostName) + 1, nameLen, pathLen = 0;
+
+    nameLen = snprintf(NULL, 0, "%s:%lld", ipAddr, xferPort) + 1;
+    if (location) {
+        pathLen = strlen(location) + 1 + nameLen;
+    }
+    if (heap) {
+        *host = memcpy(heap, hostName, hostLen);
+        *name = heap + hostLen;
+        snprintf(*name, nameLen, "%s:%lld", ipAddr, xferPort);
+        *path = NULL;
+        if (location) {
+            *path = *name + nameLen;
+            snprintf(*path, pathLen, "%s/%s", location, *name);
+        }
+    }
+    return hostLen + nameLen + pathLen;
+}
+
+struct hdfsBlockLocation *parseGetBlockLocations(const char *response,
+                                                 int *numBlocks)
+{
+    json_error_t error;
+    json_t *jobj, *value, *blocks, *block, *locs;
+    struct jsonException *exception;
+    struct hdfsBlockLocation *packed = NULL;
+    char **slots, *heap;
+    size_t i, j, n, numSlots = 0, heapLen = 0;
+    int ret = 0;
+
+    jobj = json_loads(response, 0, &error);
+    if (!jobj) {
+        fprintf(stderr, "JSon parsing failed\n");
+        errno = EIO;
+        return NULL;
+    }
+    value = json_object_get(jobj, "RemoteException");
+    if (value) {
+        exception = parseJsonException(value);
+        ret = exception ? printJsonException(exception,
+                NOPRINT_EXC_FILE_NOT_FOUND,
+                "Calling WEBHDFS (GET_BLOCK_LOCATIONS)") : EIO;
+        goto done;
+    }
+    blocks = json_object_get(json_object_get(jobj, "LocatedBlocks"),
+                             "locatedBlocks");
+    if (!json_is_array(blocks)) {
+        fprintf(stderr, "parseGetBlockLocations: no locatedBlocks in the "
+                "response\n");
+        ret = EIO;
+        goto done;
+    }
+    // Size everything first, so that it can all go in one allocation,
+    // freed at once by hdfsFreeBlockLocations
+    n = json_array_size(blocks);
+    for (i = 0; i < n; i++) {
+        locs = json_object_get(json_array_get(blocks, i), "locations");
+        numSlots += 3 * (json_array_size(locs) + 1);
+        for (j = 0; j < json_array_size(locs); j++) {
+            heapLen += putDatanodeStrings(json_array_get(locs, j), NULL,
+                                          NULL, NULL, NULL);
+        }
+    }
+    packed = calloc(1, (n + 1) * sizeof(*packed) +
+                    numSlots * sizeof(char *) + heapLen);
+    if (!packed) {
+        ret = ENOMEM;
+        goto done;
+    }
+    slots = (char **) (packed + n + 1);
+    heap = (char *) (slots + numSlots);
+    for (i = 0; i < n; i++) {
+        size_t numLocs, numPaths = 0;
+
+        block = json_array_get(blocks, i);
+        locs = json_object_get(block, "locations");
+        numLocs = json_array_size(locs);
+        packed[i].offset = json_integer_value(json_object_get(block,
+                                                  "startOffset"));
+        packed[i].length = json_integer_value(json_object_get(
+                json_object_get(block, "block"), "numBytes"));
+        packed[i].corrupt = json_is_true(json_object_get(block, "isCorrupt"));
+        packed[i].numHosts = numLocs;
+        packed[i].hosts = slots;
+        packed[i].names = slots + numLocs + 1;
+        packed[i].topologyPaths = slots + 2 * (numLocs + 1);
+        for (j = 0; j < numLocs; j++) {
+            char *path;
+
+            heap += putDatanodeStrings(json_array_get(locs, j), heap,
+                        &packed[i].hosts[j], &packed[i].names[j], &path);
+            if (path) {
+                packed[i].topologyPaths[numPaths++] = path;
+            }
+        }
+        // The lists are NULL-terminated by calloc
+        slots += 3 * (numLocs + 1);
+    }
+    *numBlocks = n;
+
+done:
+    json_decref(jobj);
+    if (ret) {
+        errno = ret;
+        return NULL;
+    }
+    return packed;
+}
+
+/** How deep the parser tracks which containers it is in */
+#define LIST_PARSER_MAX_DEPTH 8
+
+/**
+ * Incremental parser of LISTSTATUS responses, which are of the form
+ * {"FileStatuses":{"FileStatus":[{...},{...}]}}.  The text of each entry
+ * of the array is kept only until the entry is complete, when it is
+ * converted to an hdfsFileInfo.  Anything outside the entries, such as a
+ * RemoteException, is kept whole and parsed at the end.
+ */
+struct jsonListParser {
+    /** Nesting depth, in objects and arrays, of the current byte */
+    int depth;
+    /** The kinds of container, '{' or '[', at the outer depths */
+    char containers[LIST_PARSER_MAX_DEPTH];
+    int inString;
+    int escaped;
+    /** Nonzero while the bytes of an entry are being collected */
+    int inEntry;
+    /** The first error met, as an errno value */
+    int error;
+    /** The text of the entry being collected */
+    char *entry;
+    size_t entryLen, entryCap;
+    /** The text outside the entries */
+    char *rest;
+    size_t restLen, restCap;
+    hdfsFileInfo *infos;
+    int numInfos, infoCap;
+};
+
+struct jsonListParser *jsonListParserNew(void)
+{
+    return calloc(1, sizeof(struct jsonListParser));
+}
+
+void jsonListParserFree(struct jsonListParser *parser)
+{
+    int i;
+
+    if (!parser) {
+        return;
+    }
+    for (i = 0; i < parser->numInfos; i++) {
+        free(parser->infos[i].mName);
+        free(parser->infos[i].mOwner);
+        free(parser->infos[i].mGroup);
+    }
+    free(parser->infos);
+    free(parser->entry);
+    free(parser->rest);
+    free(parser);
+}
+
+static int appendText(char **buf, size_t *len, size_t *cap, const char *data,
+                      size_t dataLen)
+{
+    size_t newCap;
+    char *newBuf;
+
+    if (*len + dataLen + 1 > *cap) {
+        newCap = *cap ? *cap * 2 : 256;
+        while (newCap < *len + dataLen + 1) {
+            newCap *= 2;
+        }
+        newBuf = realloc(*buf, newCap);
+        if (!newBuf) {
+            return ENOMEM;
+        }
+        *buf = newBuf;
+        *cap = newCap;
+    }
+    memcpy(*buf + *len, data, dataLen);
+    *len += dataLen;
+    (*buf)[*len] = '\0';
+    return 0;
+}
+
+/**
+ * Convert the entry collected so far to an hdfsFileInfo.
+ */
+static int finishEntry(struct jsonListParser *parser)
+{
+    json_error_t error;
+    json_t *jobj;
+    hdfsFileInfo *info, *newInfos;
+    int numEntries = 0, newCap;
+
+    if (parser->numInfos == parser->infoCap) {
+        newCap = parser->infoCap ? parser->infoCap * 2 : 64;
+        newInfos = realloc(parser->infos, newCap * sizeof(hdfsFileInfo));
+        if (!newInfos) {
+            return ENOMEM;
+        }
+        parser->infos = newInfos;
+        parser->infoCap = newCap;
+    }
+    jobj = json_loads(parser->entry, 0, &error);
+    if (!jobj) {
+        fprintf(stderr, "JSon parsing of a LISTSTATUS entry failed\n");
+        return EIO;
+    }
+    info = &parser->infos[parser->numInfos];
+    memset(info, 0, sizeof(*info));
+    info->mKind = kObjectKindFile;
+    parseJsonGFS(jobj, info, &numEntries, "LISTSTATUS");
+    // The strings belong to jobj
+    info->mName = info->mName ? strdup(info->mName) : NULL;
+    info->mOwner = info->mOwner ? strdup(info->mOwner) : NULL;
+    info->mGroup = info->mGroup ? strdup(info->mGroup) : NULL;
+    json_decref(jobj);
+    parser->numInfos++;
+    parser->entryLen = 0;
+    return 0;
+}
+
+int jsonListParserFeed(struct jsonListParser *parser, const char *data,
+                       size_t len)
+{
+    size_t i, start = 0;
+    int entryDepth = 4, ret;
+    char c;
+
+    if (parser->error) {
+        return parser->error;
+    }
+    for (i = 0; i < len; i++) {
+        c = data[i];
+        if (parser->inString) {
+            if (parser->escaped) {
+                parser->escaped = 0;
+            } else if (c == '\\') {
+                parser->escaped = 1;
+            } else if (c == '"') {
+                parser->inString = 0;
+            }
+            continue;
+        }
+        if (c == '"') {
+            parser->inString = 1;
+        } else if (c == '{' || c == '[') {
+            if (parser->depth < LIST_PARSER_MAX_DEPTH) {
+                parser->containers[parser->depth] = c;
+            }
+            parser->depth++;
+            // An entry is an object in the array of the object of the
+            // outermost object
+            if (c == '{' && parser->depth == entryDepth &&
+                    !strncmp(parser->containers, "{{[", 3)) {
+                ret = appendText(&parser->rest, &parser->restLen,
+                                 &parser->restCap, data + start, i - start);
+                if (ret) {
+                    goto error;
+                }
+                parser->inEntry = 1;
+                start = i;
+            }
+        } else if (c == '}' || c == ']') {
+            parser->depth--;
+            if (parser->inEntry && parser->depth == entryDepth - 1) {
+                ret = appendText(&parser->entry, &parser->entryLen,
+                                 &parser->entryCap, data + start,
+                                 i + 1 - start);
+                if (!ret) {
+                    ret = finishEntry(parser);
+                }
+                if (ret) {
+                    goto error;
+                }
+                parser->inEntry = 0;
+                start = i + 1;
+            }
+        }
+    }
+    if (parser->inEntry) {
+        ret = appendText(&parser->entry, &parser->entryLen, &parser->entryCap,
+                         data + start, len - start);
+    } else {
+        ret = appendText(&parser->rest, &parser->restLen, &parser->restCap,
+                         data + start, len - start);
+    }
+    if (ret) {
+        goto error;
+    }
+    return 0;
+
+error:
+    parser->error = ret;
+    return ret;
+}
+
+hdfsFileInfo *jsonListParserFinish(struct jsonListParser *parser,
+                                   int *numEntries)
+{
+    struct jsonException *exc;
+    hdfsFileInfo *infos;
+    int ret = parser->error;
+
+    if (!ret && (parser->depth != 0 || parser->inString || !parser->rest)) {
+        ret = EIO;
+    }
+    if (!ret && parser->numInfos == 0) {
+        // No entries: either an empty directory or an error
+        exc = parseException(parser->rest);
+        if (exc) {
+            ret = printJsonException(exc, PRINT_EXC_ALL,
+                                     "Calling WEBHDFS (LISTSTATUS)");
+        } else if (!strstr(parser->rest, "\"FileStatuses\"")) {
+            ret = EIO;
+        }
+    }
+    if (ret) {
+        jsonListParserFree(parser);
+        errno = ret;
+        return NULL;
+    }
+    if (!parser->infos) {
+        // Callers expect something to free even for an empty directory
+        parser->infos = calloc(1, sizeof(hdfsFileInfo));
+        if (!parser->infos) {
+            jsonListParserFree(parser);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    infos = parser->infos;
+    *numEntries = parser->numInfos;
+    parser->infos = NULL;
+    parser->numInfos = 0;
+    jsonListParserFree(parser);
+    return infos;
+}
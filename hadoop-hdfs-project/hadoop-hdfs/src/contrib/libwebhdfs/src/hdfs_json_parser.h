@@ -41,6 +41,7 @@ int parseDELETE (char *response);
 int parseSETREPLICATION(char *response);
 
 int parseOPEN(const char *header, const char *content);
+int parseDnOPEN(const char *header, const char *content);
 
 int parseNnWRITE(const char *header, const char *content);
 int parseDnWRITE(const char *header, const char *content);
@@ -51,6 +52,62 @@ char* parseDnLoc(char *content);
 
 hdfsFileInfo *parseGFS(char *response, hdfsFileInfo *fileStat, int *numEntries);
 
+/**
+ * Parse a GET_BLOCK_LOCATIONS response into block locations, as
+ * DFSUtil#locatedBlocks2Locations would make them.
+ *
+ * @param response        The body of the response
+ * @param numBlocks       (out param) The number of blocks
+ *
+ * @return                The blocks, packed with their lists and strings in
+ *                        one allocation; NULL with errno set on error.
+ */
+struct hdfsBlockLocation *parseGetBlockLocations(const char *response,
+                                                 int *numBlocks);
+
+struct jsonListParser;
+
+/**
+ * Create a parser of LISTSTATUS responses that converts each entry of the
+ * listing as soon as its text has arrived, so the whole response is never
+ * held in memory.
+ *
+ * @return                The parser, or NULL when out of memory.
+ */
+struct jsonListParser *jsonListParserNew(void);
+
+/**
+ * Parse the next part of a LISTSTATUS response.
+ *
+ * @param parser          The parser
+ * @param data            The next bytes of the response body
+ * @param len             The length of data
+ *
+ * @return                0 on success; the POSIX error number otherwise.
+ *                        An error sticks; later calls return it too.
+ */
+int jsonListParserFeed(struct jsonListParser *parser, const char *data,
+                       size_t len);
+
+/**
+ * Get the entries of a LISTSTATUS response that has been fed completely,
+ * and free the parser.
+ *
+ * @param parser          The parser
+ * @param numEntries      (out param) The number of entries
+ *
+ * @return                The entries, to be freed with hdfsFreeFileInfo;
+ *                        NULL with errno set if the response was an error
+ *                        or could not be parsed.
+ */
+hdfsFileInfo *jsonListParserFinish(struct jsonListParser *parser,
+                                   int *numEntries);
+
+/**
+ * Free a parser without getting its entries.
+ */
+void jsonListParserFree(struct jsonListParser *parser);
+
 int parseCHOWN (char *header, const char *content);
 int parseCHMOD (char *header, const char *content);
 int parseUTIMES(char *header, const char *content);
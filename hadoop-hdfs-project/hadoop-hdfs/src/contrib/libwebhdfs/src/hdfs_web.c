@@ -18,6 +18,7 @@
 
 #include "exception.h"
 #include "hdfs.h"
+#include "hdfs_batch.h"
 #include "hdfs_http_client.h"
 #include "hdfs_http_query.h"
 #include "hdfs_json_parser.h"
@@ -33,12 +34,16 @@
 #define HADOOP_NAMENODE         "org/apache/hadoop/hdfs/server/namenode/NameNode"
 #define JAVA_INETSOCKETADDRESS  "java/net/InetSocketAddress"
 
+/** The most byte ranges of one file that hdfsRead fetches at once */
+#define WEBHDFS_MAX_READ_PARALLELISM 64
+
 struct hdfsBuilder {
     int forceNewInstance;
     const char *nn;
     tPort port;
     const char *kerbTicketCachePath;
     const char *userName;
+    int readParallelism;
 };
 
 /**
@@ -53,6 +58,7 @@ struct hdfs_internal {
     char *nn;
     tPort port;
     char *userName;
+    int readParallelism;
 
     /**
      * Working directory -- stored with a trailing slash.
@@ -70,48 +76,101 @@ struct hdfsFile_internal {
     tOffset offset;
 };
 
-static webhdfsBuffer *initWebHdfsBuffer(void)
+static webhdfsBuffer *initWebHdfsBuffer(size_t capacity)
 {
     webhdfsBuffer *buffer = calloc(1, sizeof(*buffer));
     if (!buffer) {
         fprintf(stderr, "Fail to allocate memory for webhdfsBuffer.\n");
         return NULL;
     }
+    buffer->wbuffer = malloc(capacity);
+    if (!buffer->wbuffer) {
+        fprintf(stderr, "Fail to allocate memory for webhdfsBuffer.\n");
+        free(buffer);
+        return NULL;
+    }
+    buffer->capacity = capacity;
     buffer->remaining = 0;
     buffer->offset = 0;
-    buffer->wbuffer = NULL;
     buffer->closeFlag = 0;
     buffer->openFlag = 0;
+    buffer->transferDone = 0;
     pthread_mutex_init(&buffer->writeMutex, NULL);
-    pthread_cond_init(&buffer->newwrite_or_close, NULL);
     pthread_cond_init(&buffer->transfer_finish, NULL);
     return buffer;
 }
 
-static webhdfsBuffer *resetWebhdfsBuffer(webhdfsBuffer *wb, const char *buffer, size_t length) {
-    if (buffer && length > 0) {
-        pthread_mutex_lock(&wb->writeMutex);
-        wb->wbuffer = buffer;
-        wb->offset = 0;
-        wb->remaining = length;
-        pthread_cond_signal(&wb->newwrite_or_close);
-        while (wb->remaining != 0) {
+/**
+ * Let the upload go on if it paused for want of data.  Called with
+ * writeMutex held, after putting data in the ring or setting closeFlag.
+ */
+static void resumeWebhdfsBuffer(webhdfsBuffer *wb) {
+    if (wb->paused) {
+        wb->paused = 0;
+        resumeUpload(wb->upload);
+    }
+}
+
+/**
+ * Copy the user's data into the upload ring, waiting for the upload to
+ * make room when it is full.
+ *
+ * @return                       0 on success; EIO if the transfer has stopped
+ */
+static int writeToWebhdfsBuffer(webhdfsBuffer *wb, const char *buffer, size_t length) {
+    size_t tail, copySize;
+    int ret = 0;
+    
+    pthread_mutex_lock(&wb->writeMutex);
+    while (length > 0) {
+        if (wb->transferDone) {
+            ret = EIO;
+            break;
+        }
+        if (wb->remaining == wb->capacity) {
             pthread_cond_wait(&wb->transfer_finish, &wb->writeMutex);
+            continue;
+        }
+        tail = (wb->offset + wb->remaining) % wb->capacity;
+        copySize = wb->capacity - wb->remaining;
+        if (copySize > wb->capacity - tail) {
+            copySize = wb->capacity - tail;
         }
-        pthread_mutex_unlock(&wb->writeMutex);
+        if (copySize > length) {
+            copySize = length;
+        }
+        memcpy(wb->wbuffer + tail, buffer, copySize);
+        wb->remaining += copySize;
+        buffer += copySize;
+        length -= copySize;
+        resumeWebhdfsBuffer(wb);
+    }
+    pthread_mutex_unlock(&wb->writeMutex);
+    return ret;
+}
+
+/**
+ * Wait for the upload to take everything in the upload ring.
+ *
+ * @return                       0 on success; EIO if the transfer has stopped
+ */
+static int drainWebhdfsBuffer(webhdfsBuffer *wb) {
+    int ret = 0;
+    
+    pthread_mutex_lock(&wb->writeMutex);
+    while (wb->remaining > 0 && !wb->transferDone) {
+        pthread_cond_wait(&wb->transfer_finish, &wb->writeMutex);
+    }
+    if (wb->remaining > 0) {
+        ret = EIO;
     }
-    return wb;
+    pthread_mutex_unlock(&wb->writeMutex);
+    return ret;
 }
 
 static void freeWebhdfsBuffer(webhdfsBuffer *buffer) {
     if (buffer) {
-        int des = pthread_cond_destroy(&buffer->newwrite_or_close);
-        if (des == EBUSY) {
-            fprintf(stderr, "The condition newwrite_or_close is still referenced!\n");
-        } else if (des == EINVAL) {
-            fprintf(stderr, "The condition newwrite_or_close is invalid!\n");
-        }
-        des = pthread_cond_destroy(&buffer->transfer_finish);
+        int des = pthread_cond_destroy(&buffer->transfer_finish);
         if (des == EBUSY) {
             fprintf(stderr, "The condition transfer_finish is still referenced!\n");
         } else if (des == EINVAL) {
@@ -126,16 +185,25 @@ static void freeWebhdfsBuffer(webhdfsBuffer *buffer) {
         if (des == EBUSY) {
             fprintf(stderr, "The mutex is still locked or referenced!\n");
         }
+        free(buffer->wbuffer);
         free(buffer);
         buffer = NULL;
     }
 }
 
+static void stopReadStream(struct webhdfsFileHandle *handle);
+static void stopPrefetch(struct webhdfsFileHandle *handle);
+
 static void freeWebFileHandle(struct webhdfsFileHandle * handle) {
     if (!handle)
         return;
+    stopReadStream(handle);
+    stopPrefetch(handle);
     freeWebhdfsBuffer(handle->uploadBuffer);
+    free(handle->readDatanode);
+    pthread_mutex_destroy(&handle->readDatanodeLock);
     free(handle->datanode);
+    free(handle->openUrl);
     free(handle->absPath);
     free(handle);
 }
@@ -187,6 +255,36 @@ void hdfsBuilderSetKerbTicketCachePath(struct hdfsBuilder *bld,
     }
 }
 
+int hdfsBuilderConfSetStr(struct hdfsBuilder *bld, const char *key,
+                          const char *val)
+{
+    long parallelism;
+    char *end;
+
+    if (!bld || !key) {
+        return EINVAL;
+    }
+    // Other keys only mean something to the JNI version of libhdfs
+    if (!strcmp(key, HDFS_WEBHDFS_READ_PARALLELISM_KEY)) {
+        if (!val) {
+            bld->readParallelism = 0;
+            return 0;
+        }
+        errno = 0;
+        parallelism = strtol(val, &end, 10);
+        if (errno || end == val || *end || parallelism < 0) {
+            fprintf(stderr, "hdfsBuilderConfSetStr: invalid value %s for %s\n",
+                    val, key);
+            return EINVAL;
+        }
+        if (parallelism > WEBHDFS_MAX_READ_PARALLELISM) {
+            parallelism = WEBHDFS_MAX_READ_PARALLELISM;
+        }
+        bld->readParallelism = parallelism;
+    }
+    return 0;
+}
+
 hdfsFS hdfsConnectAsUser(const char* nn, tPort port, const char *user)
 {
     struct hdfsBuilder* bld = hdfsNewBuilder();
@@ -363,6 +461,7 @@ hdfsFS hdfsBuilderConnect(struct hdfsBuilder *bld)
             goto done;
         }
     }
+    fs->readParallelism = bld->readParallelism;
     // The working directory starts out as root.
     fs->workingDir = strdup("/");
     if (!fs->workingDir) {
@@ -594,10 +693,16 @@ done:
     }
 }
 
+static int feedListParser(const char *data, size_t len, void *ctx)
+{
+    return jsonListParserFeed((struct jsonListParser *) ctx, data, len);
+}
+
 hdfsFileInfo *hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
 {
     char *url = NULL, *absPath = NULL;
     Response resp = NULL;
+    struct jsonListParser *parser = NULL;
     int ret = 0;
     hdfsFileInfo *fileInfo = NULL;
 
@@ -610,18 +715,30 @@ hdfsFileInfo *hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
         ret = ENOMEM;
         goto done;
     }
-    fileInfo = calloc(1, sizeof(*fileInfo));
-    if (!fileInfo) {
+    parser = jsonListParserNew();
+    if (!parser) {
+        ret = ENOMEM;
+        goto done;
+    }
+    url = prepareLS(fs->nn, fs->port, absPath, fs->userName);
+    if (!url) {
         ret = ENOMEM;
         goto done;
     }
-    if(!((url = prepareLS(fs->nn, fs->port, absPath, fs->userName))
-         && (resp = launchLS(url))
-         && (fileInfo = parseGFS(resp->body->content, fileInfo, numEntries))))  {
+    // The entries are parsed as they arrive
+    resp = launchLS(url, feedListParser, parser);
+    if (!resp) {
         ret = EIO;
         goto done;
     }
+    fileInfo = jsonListParserFinish(parser, numEntries);
+    parser = NULL;
+    if (!fileInfo) {
+        ret = errno;
+        goto done;
+    }
 done:
+    jsonListParserFree(parser);
     freeResponse(resp);
     free(absPath);
     free(url);
@@ -629,7 +746,6 @@ done:
     if (ret == 0) {
         return fileInfo;
     } else {
-        hdfsFreeFileInfo(fileInfo, 1);
         errno = ret;
         return NULL;
     }
@@ -746,46 +862,157 @@ done:
     return 0;
 }
 
-int hdfsExists(hdfsFS fs, const char *path)
+/**
+ * Make the url of an operation of a batch.
+ *
+ * @return                       The url, or NULL with op->result set
+ */
+static char *prepareBatchOp(hdfsFS fs, hdfsBatchOp *op,
+                            enum HttpHeader *method)
 {
-    hdfsFileInfo *fileInfo = hdfsGetPathInfo(fs, path);
-    if (!fileInfo) {
-        // (errno will have been set by hdfsGetPathInfo)
-        return -1;
+    char *absPath, *url = NULL;
+    
+    if (!op->path) {
+        op->result = EINVAL;
+        return NULL;
     }
-    hdfsFreeFileInfo(fileInfo, 1);
-    return 0;
+    absPath = getAbsolutePath(fs, op->path);
+    if (!absPath) {
+        op->result = ENOMEM;
+        return NULL;
+    }
+    *method = PUT;
+    switch (op->type) {
+        case HDFS_BATCH_GET_PATH_INFO:
+            url = prepareGFS(fs->nn, fs->port, absPath, fs->userName);
+            *method = GET;
+            break;
+        case HDFS_BATCH_DELETE:
+            url = prepareDELETE(fs->nn, fs->port, absPath, op->recursive,
+                                fs->userName);
+            *method = DELETE;
+            break;
+        case HDFS_BATCH_CHMOD:
+            url = prepareCHMOD(fs->nn, fs->port, absPath, (int)op->mode,
+                               fs->userName);
+            break;
+        case HDFS_BATCH_CHOWN:
+            url = prepareCHOWN(fs->nn, fs->port, absPath, op->owner,
+                               op->group, fs->userName);
+            break;
+        case HDFS_BATCH_SET_REPLICATION:
+            url = prepareSETREPLICATION(fs->nn, fs->port, absPath,
+                                        op->replication, fs->userName);
+            break;
+        case HDFS_BATCH_CREATE_DIRECTORY:
+            url = prepareMKDIR(fs->nn, fs->port, absPath, fs->userName);
+            break;
+        default:
+            free(absPath);
+            op->result = EINVAL;
+            return NULL;
+    }
+    free(absPath);
+    if (!url) {
+        op->result = ENOMEM;
+    }
+    return url;
 }
 
-typedef struct {
-    char *url;
-    webhdfsBuffer *uploadBuffer;
-    int flags;
-    Response resp;
-} threadData;
+/**
+ * Get the result of an operation of a batch from its response.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int parseBatchOp(hdfsBatchOp *op, Response resp)
+{
+    hdfsFileInfo *fileInfo;
+    int numEntries = 0, ok = 0;
+    
+    switch (op->type) {
+        case HDFS_BATCH_GET_PATH_INFO:
+            fileInfo = (hdfsFileInfo *) calloc(1, sizeof(hdfsFileInfo));
+            if (!fileInfo) {
+                return ENOMEM;
+            }
+            fileInfo->mKind = kObjectKindFile;
+            op->info = parseGFS(resp->body->content, fileInfo, &numEntries);
+            ok = (op->info != NULL);
+            break;
+        case HDFS_BATCH_DELETE:
+            ok = parseDELETE(resp->body->content);
+            break;
+        case HDFS_BATCH_CHMOD:
+            ok = parseCHMOD(resp->header->content, resp->body->content);
+            break;
+        case HDFS_BATCH_CHOWN:
+            ok = parseCHOWN(resp->header->content, resp->body->content);
+            break;
+        case HDFS_BATCH_SET_REPLICATION:
+            ok = parseSETREPLICATION(resp->body->content);
+            break;
+        case HDFS_BATCH_CREATE_DIRECTORY:
+            ok = parseMKDIR(resp->body->content);
+            break;
+    }
+    return ok ? 0 : EIO;
+}
 
-static void freeThreadData(threadData *data) {
-    if (data) {
-        if (data->url) {
-            free(data->url);
+int hdfsRunBatch(hdfsFS fs, hdfsBatchOp *ops, int numOps, int maxConcurrency)
+{
+    webhdfsBatchRequest *reqs;
+    int i, ret, numFailed = 0;
+    
+    if (fs == NULL || numOps < 0 || (numOps > 0 && ops == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (numOps == 0) {
+        return 0;
+    }
+    if (maxConcurrency <= 0) {
+        maxConcurrency = HDFS_BATCH_DEFAULT_CONCURRENCY;
+    }
+    reqs = calloc(numOps, sizeof(*reqs));
+    if (!reqs) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < numOps; i++) {
+        ops[i].result = 0;
+        ops[i].info = NULL;
+        // Operations without a url are skipped, with their result set
+        reqs[i].url = prepareBatchOp(fs, &ops[i], &reqs[i].method);
+    }
+    ret = launchBatch(reqs, numOps, maxConcurrency);
+    for (i = 0; i < numOps; i++) {
+        if (!ret && !ops[i].result) {
+            ops[i].result = reqs[i].resp ?
+                            parseBatchOp(&ops[i], reqs[i].resp) : EIO;
         }
-        if (data->resp) {
-            freeResponse(data->resp);
+        if (ops[i].result) {
+            numFailed++;
         }
-        //the uploadBuffer would be freed by freeWebFileHandle()
-        free(data);
-        data = NULL;
+        freeResponse(reqs[i].resp);
+        free(reqs[i].url);
+    }
+    free(reqs);
+    if (ret) {
+        errno = ret;
+        return -1;
     }
+    return numFailed;
 }
 
-static void *writeThreadOperation(void *v) {
-    threadData *data = (threadData *) v;
-    if (data->flags & O_APPEND) {
-        data->resp = launchDnAPPEND(data->url, data->uploadBuffer);
-    } else {
-        data->resp = launchDnWRITE(data->url, data->uploadBuffer);
+int hdfsExists(hdfsFS fs, const char *path)
+{
+    hdfsFileInfo *fileInfo = hdfsGetPathInfo(fs, path);
+    if (!fileInfo) {
+        // (errno will have been set by hdfsGetPathInfo)
+        return -1;
     }
-    return data;
+    hdfsFreeFileInfo(fileInfo, 1);
+    return 0;
 }
 
 /**
@@ -808,7 +1035,7 @@ static void freeFileInternal(hdfsFile file)
  *
  * As part of the open process for OUTPUT files, we have to connect to the
  * NameNode and get the URL of the corresponding DataNode.
- * We also create a background thread here for doing I/O.
+ * We also start the upload to the DataNode here.
  *
  * @param webhandle              The webhandle being opened
  * @return                       0 on success; error code otherwise
@@ -819,9 +1046,11 @@ static int hdfsOpenOutputFileImpl(hdfsFS fs, hdfsFile file)
     Response resp = NULL;
     int parseRet, append, ret = 0;
     char *prepareUrl = NULL, *dnUrl = NULL;
-    threadData *data = NULL;
+    webhdfsUpload *upload;
 
-    webhandle->uploadBuffer = initWebHdfsBuffer();
+    webhandle->uploadBuffer = initWebHdfsBuffer(
+        webhandle->bufferSize > WEBHDFS_UPLOAD_BUFFER_SIZE ?
+        webhandle->bufferSize : WEBHDFS_UPLOAD_BUFFER_SIZE);
     if (!webhandle->uploadBuffer) {
         ret = ENOMEM;
         goto done;
@@ -876,23 +1105,14 @@ static int hdfsOpenOutputFileImpl(hdfsFS fs, hdfsFile file)
         ret = ENOMEM;
         goto done;
     }
-    //create a new thread for performing the http transferring
-    data = calloc(1, sizeof(*data));
-    if (!data) {
-        ret = ENOMEM;
-        goto done;
-    }
-    data->url = strdup(dnUrl);
-    if (!data->url) {
-        ret = ENOMEM;
-        goto done;
+    if (!append) {
+        upload = startDnWRITE(dnUrl, webhandle->uploadBuffer);
+    } else {
+        upload = startDnAPPEND(dnUrl, webhandle->uploadBuffer);
     }
-    data->flags = file->flags;
-    data->uploadBuffer = webhandle->uploadBuffer;
-    ret = pthread_create(&webhandle->connThread, NULL,
-                         writeThreadOperation, data);
-    if (ret) {
-        fprintf(stderr, "Failed to create the writing thread.\n");
+    if (!upload) {
+        fprintf(stderr, "Failed to start the upload to the datanode.\n");
+        ret = errno;
         goto done;
     }
     webhandle->uploadBuffer->openFlag = 1;
@@ -901,13 +1121,33 @@ done:
     freeResponse(resp);
     free(prepareUrl);
     free(dnUrl);
-    if (ret) {
-        free(data->url);
-        free(data);
-    }
     return ret;
 }
 
+/**
+ * Look up the length of a file open for reading, and its block size while
+ * we are at it.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int refreshFileLength(hdfsFS fs, struct webhdfsFileHandle *wf)
+{
+    hdfsFileInfo *fileInfo;
+
+    fileInfo = hdfsGetPathInfo(fs, wf->absPath);
+    if (!fileInfo) {
+        return errno;
+    }
+    wf->fileLength = fileInfo->mSize;
+    if (fileInfo->mBlockSize > 0) {
+        pthread_mutex_lock(&wf->readDatanodeLock);
+        wf->readBlockSize = fileInfo->mBlockSize;
+        pthread_mutex_unlock(&wf->readDatanodeLock);
+    }
+    hdfsFreeFileInfo(fileInfo, 1);
+    return 0;
+}
+
 hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
                       int bufferSize, short replication, tSize blockSize)
 {
@@ -944,6 +1184,7 @@ hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
         ret = ENOMEM;
         goto done;
     }
+    pthread_mutex_init(&webhandle->readDatanodeLock, NULL);
     webhandle->bufferSize = bufferSize;
     webhandle->replication = replication;
     webhandle->blockSize = blockSize;
@@ -952,12 +1193,24 @@ hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
         ret = ENOMEM;
         goto done;
     }
+    webhandle->fileLength = -1;
     file->file = webhandle;
     if (file->type == OUTPUT) {
         ret = hdfsOpenOutputFileImpl(fs, file);
         if (ret) {
             goto done;
         }
+    } else {
+        webhandle->openUrl = prepareOPENBase(fs->nn, fs->port,
+                                             webhandle->absPath, fs->userName);
+        if (!webhandle->openUrl) {
+            ret = ENOMEM;
+            goto done;
+        }
+        if (refreshFileLength(fs, webhandle)) {
+            // Reads will report the error; hdfsSeek asks again
+            webhandle->fileLength = -1;
+        }
     }
 
 done:
@@ -973,6 +1226,16 @@ done:
     return file;
 }
 
+hdfsFile hdfsOpenFileWithOptions(hdfsFS fs, const char* path, int flags,
+                                 int bufferSize, short replication,
+                                 tSize blockSize,
+                                 const struct hdfsOpenOptions *opts)
+{
+    // The hints are for the JNI client's reads; reads over HTTP have no
+    // read-ahead buffer or local replicas to apply them to
+    return hdfsOpenFile(fs, path, flags, bufferSize, replication, blockSize);
+}
+
 tSize hdfsWrite(hdfsFS fs, hdfsFile file, const void* buffer, tSize length)
 {
     if (length == 0) {
@@ -985,7 +1248,11 @@ tSize hdfsWrite(hdfsFS fs, hdfsFile file, const void* buffer, tSize length)
     
     struct webhdfsFileHandle *wfile = file->file;
     if (wfile->uploadBuffer && wfile->uploadBuffer->openFlag) {
-        resetWebhdfsBuffer(wfile->uploadBuffer, buffer, length);
+        if (writeToWebhdfsBuffer(wfile->uploadBuffer, buffer, length)) {
+            fprintf(stderr, "Error: the upload of %s has stopped.\n", wfile->absPath);
+            errno = EIO;
+            return -1;
+        }
         return length;
     } else {
         fprintf(stderr, "Error: have not opened the file %s for writing yet.\n", wfile->absPath);
@@ -999,32 +1266,22 @@ int hdfsCloseFile(hdfsFS fs, hdfsFile file)
     int ret = 0;
     fprintf(stderr, "to close file...\n");
     if (file->type == OUTPUT) {
-        void *respv;
-        threadData *tdata;
+        Response resp;
         struct webhdfsFileHandle *wfile = file->file;
         pthread_mutex_lock(&(wfile->uploadBuffer->writeMutex));
         wfile->uploadBuffer->closeFlag = 1;
-        pthread_cond_signal(&wfile->uploadBuffer->newwrite_or_close);
+        resumeWebhdfsBuffer(wfile->uploadBuffer);
         pthread_mutex_unlock(&(wfile->uploadBuffer->writeMutex));
         
-        //waiting for the writing thread to terminate
-        ret = pthread_join(wfile->connThread, &respv);
-        if (ret) {
-            fprintf(stderr, "Error (code %d) when pthread_join.\n", ret);
-        }
+        //waiting for the upload to end
+        resp = finishUpload(wfile->uploadBuffer->upload);
         //parse the response
-        tdata = (threadData *) respv;
-        if (!tdata) {
-            fprintf(stderr, "Response from the writing thread is NULL.\n");
-            ret = -1;
-        }
         if (file->flags & O_APPEND) {
-            parseDnAPPEND(tdata->resp->header->content, tdata->resp->body->content);
+            parseDnAPPEND(resp->header->content, resp->body->content);
         } else {
-            parseDnWRITE(tdata->resp->header->content, tdata->resp->body->content);
+            parseDnWRITE(resp->header->content, resp->body->content);
         }
-        //free the threaddata
-        freeThreadData(tdata);
+        freeResponse(resp);
     }
     freeFileInternal(file);
     fprintf(stderr, "Closed the webfilehandle...\n");
@@ -1044,13 +1301,154 @@ int hdfsFileIsOpenForWrite(hdfsFile file)
     return (file->type == OUTPUT);
 }
 
-static int hdfsReadImpl(hdfsFS fs, hdfsFile file, void* buffer, tSize off,
+/**
+ * Make one ranged OPEN request, whose data is put straight into the user's
+ * buffer.
+ *
+ * @param url                    The url to open
+ * @param direct                 Nonzero if url is that of a datanode
+ * @param buffer                 The user's buffer
+ * @param length                 The length of buffer
+ * @param numRead                (out param) The bytes read; 0 at end of file
+ * @param dnLoc                  (out param) If not NULL and the namenode
+ *                               redirected the request, the malloc'ed url
+ *                               of the datanode it was redirected to
+ * @return                       0 on success; error code otherwise
+ */
+static int launchRangedOPEN(const char *url, int direct, void *buffer,
+                            tSize length, tSize *numRead, char **dnLoc)
+{
+    int ret = 0, openResult;
+    Response resp;
+
+    resp = calloc(1, sizeof(*resp)); // resp is actually a pointer type
+    if (!resp) {
+        return ENOMEM;
+    }
+    resp->header = initResponseBuffer();
+    resp->body = initResponseBuffer();
+    if (!resp->header || !resp->body) {
+        ret = ENOMEM;
+        goto done;
+    }
+    resp->body->content = buffer;
+    resp->body->remaining = length;
+    if (!launchOPEN((char *) url, resp)) {
+        ret = EIO;
+        goto done;
+    }
+    if (direct) {
+        openResult = parseDnOPEN(resp->header->content, resp->body->content);
+    } else {
+        openResult = parseOPEN(resp->header->content, resp->body->content);
+    }
+    if (openResult < 0) {
+        ret = EIO;
+        goto done;
+    }
+    // Special case: if the parse returns 0, we asked for a byte range
+    // with outside what the file contains.  In this case, hdfsRead and
+    // hdfsPread return 0, meaning end-of-file.
+    *numRead = openResult ? resp->body->offset : 0;
+    if (dnLoc && !direct) {
+        *dnLoc = parseDnLoc(resp->header->content);
+    }
+
+done:
+    freeResponseBuffer(resp->header);
+    free(resp->body);
+    free(resp);
+    return ret;
+}
+
+/**
+ * Strip the offset and length parameters off an OPEN url.
+ *
+ * @return                       The malloc'ed url, or NULL on OOM
+ */
+static char *stripOffsetAndLength(const char *url)
+{
+    const char *param, *next;
+    char *out;
+    size_t len;
+
+    out = malloc(strlen(url) + 1);
+    if (!out) {
+        return NULL;
+    }
+    param = strchr(url, '?');
+    if (!param) {
+        strcpy(out, url);
+        return out;
+    }
+    len = param - url;
+    memcpy(out, url, len);
+    while (*param) {
+        next = strchr(param + 1, '&');
+        if (!next) {
+            next = param + strlen(param);
+        }
+        if (strncmp(param + 1, "offset=", strlen("offset=")) &&
+                strncmp(param + 1, "length=", strlen("length="))) {
+            memcpy(out + len, param, next - param);
+            len += next - param;
+        }
+        param = next;
+    }
+    out[len] = '\0';
+    // The first parameter kept has to follow a '?'
+    param = out + strcspn(out, "?&");
+    if (*param == '&') {
+        out[param - out] = '?';
+    }
+    return out;
+}
+
+/**
+ * Remember which datanode the namenode sent a read to, so that later reads
+ * in the same block can go to it directly.
+ */
+static void cacheReadDatanode(hdfsFS fs, struct webhdfsFileHandle *wf,
+                              tOffset off, char *dnLoc)
+{
+    hdfsFileInfo *fileInfo;
+    tOffset blockSize;
+    char *datanode;
+
+    pthread_mutex_lock(&wf->readDatanodeLock);
+    blockSize = wf->readBlockSize;
+    pthread_mutex_unlock(&wf->readDatanodeLock);
+    if (blockSize <= 0) {
+        fileInfo = hdfsGetPathInfo(fs, wf->absPath);
+        if (!fileInfo) {
+            return;
+        }
+        blockSize = fileInfo->mBlockSize;
+        hdfsFreeFileInfo(fileInfo, 1);
+        if (blockSize <= 0) {
+            return;
+        }
+    }
+    datanode = stripOffsetAndLength(dnLoc);
+    if (!datanode) {
+        return;
+    }
+    pthread_mutex_lock(&wf->readDatanodeLock);
+    free(wf->readDatanode);
+    wf->readDatanode = datanode;
+    wf->readBlockSize = blockSize;
+    wf->readBlockStart = off - off % blockSize;
+    wf->readBlockEnd = wf->readBlockStart + blockSize;
+    pthread_mutex_unlock(&wf->readDatanodeLock);
+}
+
+static int hdfsReadImpl(hdfsFS fs, hdfsFile file, void* buffer, tOffset off,
                         tSize length, tSize *numRead)
 {
+    struct webhdfsFileHandle *wf;
     int ret = 0;
-    char *url = NULL;
-    Response resp = NULL;
-    int openResult = -1;
+    const char *url = NULL;
+    char *dnLoc = NULL;
 
     if (fs == NULL || file == NULL || file->type != INPUT || buffer == NULL ||
             length < 0) {
@@ -1063,46 +1461,501 @@ static int hdfsReadImpl(hdfsFS fs, hdfsFile file, void* buffer, tSize off,
         *numRead = 0;
         goto done;
     }
-    resp = calloc(1, sizeof(*resp)); // resp is actually a pointer type
-    if (!resp) {
-        ret = ENOMEM;
-        goto done;
-    }
-    resp->header = initResponseBuffer();
-    resp->body = initResponseBuffer();
-    resp->body->content = buffer;
-    resp->body->remaining = length;
-    
-    if (!((url = prepareOPEN(fs->nn, fs->port, file->file->absPath,
-                             fs->userName, off, length))
-          && (resp = launchOPEN(url, resp))
-          && ((openResult = parseOPEN(resp->header->content, resp->body->content)) > 0))) {
-        if (openResult == 0) {
-            // Special case: if parseOPEN returns 0, we asked for a byte range
-            // with outside what the file contains.  In this case, hdfsRead and
-            // hdfsPread return 0, meaning end-of-file.
-            *numRead = 0;
+    wf = file->file;
+    // Reads within the block of the last redirect skip the namenode
+    pthread_mutex_lock(&wf->readDatanodeLock);
+    if (wf->readDatanode && off >= wf->readBlockStart &&
+            off + length <= wf->readBlockEnd) {
+        url = buildRangedURL(wf->readDatanode, off, length);
+    }
+    pthread_mutex_unlock(&wf->readDatanodeLock);
+    if (url) {
+        ret = launchRangedOPEN(url, 1, buffer, length, numRead, NULL);
+        if (!ret) {
             goto done;
         }
-        ret = EIO;
+        // The datanode may be gone; ask the namenode again
+        pthread_mutex_lock(&wf->readDatanodeLock);
+        free(wf->readDatanode);
+        wf->readDatanode = NULL;
+        pthread_mutex_unlock(&wf->readDatanodeLock);
+    }
+    url = buildRangedURL(wf->openUrl, off, length);
+    if (!url) {
+        ret = ENOMEM;
         goto done;
     }
-    *numRead = resp->body->offset;
+    ret = launchRangedOPEN(url, 0, buffer, length, numRead, &dnLoc);
+    if (!ret && dnLoc) {
+        cacheReadDatanode(fs, wf, off, dnLoc);
+    }
 
 done:
-    freeResponseBuffer(resp->header);
-    free(resp->body);
-    free(resp);
-    free(url);
+    free(dnLoc);
     return ret;
 }
 
+typedef struct {
+    char *url;
+    webhdfsReadBuffer *downloadBuffer;
+} readThreadData;
+
+static void *readThreadOperation(void *v) {
+    readThreadData *data = (readThreadData *) v;
+    webhdfsReadBuffer *rb = data->downloadBuffer;
+    Response resp;
+    int error;
+    
+    resp = launchStreamOPEN(data->url, rb);
+    if (!resp) {
+        error = EIO;
+    } else if (rb->responseOk) {
+        error = 0;
+    } else if (parseOPEN(resp->header->content, resp->body->content) == 0) {
+        // The offset is at or past the end of the file
+        error = 0;
+    } else {
+        error = EIO;
+    }
+    freeResponse(resp);
+    pthread_mutex_lock(&rb->readMutex);
+    rb->finished = 1;
+    rb->error = error;
+    pthread_cond_signal(&rb->transfer_finish);
+    pthread_mutex_unlock(&rb->readMutex);
+    free(data->url);
+    free(data);
+    return NULL;
+}
+
+/**
+ * Abort the streaming read of a file, if there is one, and wait for its
+ * thread to finish.
+ */
+static void stopReadStream(struct webhdfsFileHandle *handle)
+{
+    webhdfsReadBuffer *rb = handle->downloadBuffer;
+    int ret;
+
+    if (!rb) {
+        return;
+    }
+    pthread_mutex_lock(&rb->readMutex);
+    rb->closeFlag = 1;
+    pthread_cond_signal(&rb->newread_or_close);
+    pthread_mutex_unlock(&rb->readMutex);
+    ret = pthread_join(handle->connThread, NULL);
+    if (ret) {
+        fprintf(stderr, "Error (code %d) when pthread_join.\n", ret);
+    }
+    pthread_cond_destroy(&rb->newread_or_close);
+    pthread_cond_destroy(&rb->transfer_finish);
+    pthread_mutex_destroy(&rb->readMutex);
+    free(rb);
+    handle->downloadBuffer = NULL;
+}
+
+/**
+ * Start a streaming read of a file: one request for everything from the
+ * offset on, which consecutive hdfsRead calls consume.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int startReadStream(hdfsFS fs, struct webhdfsFileHandle *handle,
+                           tOffset offset)
+{
+    webhdfsReadBuffer *rb;
+    readThreadData *data;
+    int ret;
+
+    data = calloc(1, sizeof(*data));
+    rb = calloc(1, sizeof(*rb));
+    if (!data || !rb) {
+        ret = ENOMEM;
+        goto error;
+    }
+    data->url = prepareStreamOPEN(fs->nn, fs->port, handle->absPath,
+                                  fs->userName, offset);
+    if (!data->url) {
+        ret = ENOMEM;
+        goto error;
+    }
+    data->downloadBuffer = rb;
+    pthread_mutex_init(&rb->readMutex, NULL);
+    pthread_cond_init(&rb->newread_or_close, NULL);
+    pthread_cond_init(&rb->transfer_finish, NULL);
+    ret = pthread_create(&handle->connThread, NULL, readThreadOperation, data);
+    if (ret) {
+        fprintf(stderr, "Failed to create the reading thread.\n");
+        pthread_cond_destroy(&rb->newread_or_close);
+        pthread_cond_destroy(&rb->transfer_finish);
+        pthread_mutex_destroy(&rb->readMutex);
+        goto error;
+    }
+    handle->downloadBuffer = rb;
+    handle->streamOffset = offset;
+    return 0;
+
+error:
+    if (data) {
+        free(data->url);
+    }
+    free(data);
+    free(rb);
+    return ret;
+}
+
+/**
+ * Read the next bytes of the streaming read of a file.  Returns as soon as
+ * any bytes have arrived.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int readFromStream(struct webhdfsFileHandle *handle, void *buffer,
+                          tSize length, tSize *numRead)
+{
+    webhdfsReadBuffer *rb = handle->downloadBuffer;
+    int ret = 0;
+
+    pthread_mutex_lock(&rb->readMutex);
+    rb->rbuffer = buffer;
+    rb->offset = 0;
+    rb->remaining = length;
+    pthread_cond_signal(&rb->newread_or_close);
+    while (rb->offset == 0 && !rb->finished) {
+        pthread_cond_wait(&rb->transfer_finish, &rb->readMutex);
+    }
+    *numRead = rb->offset;
+    if (rb->offset == 0) {
+        ret = rb->error;
+    }
+    rb->rbuffer = NULL;
+    rb->offset = 0;
+    rb->remaining = 0;
+    pthread_mutex_unlock(&rb->readMutex);
+    handle->streamOffset += *numRead;
+    return ret;
+}
+
+enum prefetchState {
+    PREFETCH_EMPTY,
+    PREFETCH_PENDING,
+    PREFETCH_READY,
+    PREFETCH_FAILED
+};
+
+struct prefetchChunk {
+    int64_t index;        // Which chunk of the file this holds
+    enum prefetchState state;
+    char *data;
+    tSize length;         // Bytes in data; short only at the end of the file
+    int error;            // Why fetching it failed
+};
+
+/**
+ * The ranges of a file being fetched ahead of hdfsRead by several threads.
+ * The file is read in chunks of HDFS_WEBHDFS_READ_CHUNK_SIZE bytes; chunk i
+ * is put in chunks[i % parallelism], so only the parallelism chunks from
+ * the one being read on are ever fetched.
+ */
+struct webhdfsPrefetch {
+    hdfsFS fs;
+    hdfsFile file;
+    int parallelism;
+    struct prefetchChunk *chunks;
+    pthread_t *threads;
+    int numThreads;
+    int64_t consumeIndex; // The chunk hdfsRead is reading
+    tSize consumeOffset;  // How much of it has been returned, changed only by
+                          // hdfsRead
+    int64_t fetchIndex;   // The next chunk for a thread to fetch
+    int64_t endIndex;     // No chunk from here on is fetched; lowered at the
+                          // end of the file or on an error
+    uint64_t generation;  // Incremented by every seek
+    int closeFlag;
+    pthread_mutex_t lock; // Protects everything above, except for the data
+                          // of chunks that are ready
+    pthread_cond_t fetchable; // Signalled when there may be more to fetch
+    pthread_cond_t ready;     // Signalled when a chunk is done
+};
+
+/**
+ * Start reading the file from an offset, dropping whatever was fetched.
+ * Fetches still running for the old offset are thrown away when they end.
+ * Called with the lock held.
+ */
+static void resetPrefetch(struct webhdfsPrefetch *pf, tOffset offset)
+{
+    int i;
+
+    pf->generation++;
+    pf->consumeIndex = offset / HDFS_WEBHDFS_READ_CHUNK_SIZE;
+    pf->consumeOffset = offset % HDFS_WEBHDFS_READ_CHUNK_SIZE;
+    pf->fetchIndex = pf->consumeIndex;
+    pf->endIndex = INT64_MAX;
+    for (i = 0; i < pf->parallelism; i++) {
+        pf->chunks[i].state = PREFETCH_EMPTY;
+    }
+    pthread_cond_broadcast(&pf->fetchable);
+}
+
+static void *prefetchThreadOperation(void *v) {
+    struct webhdfsPrefetch *pf = (struct webhdfsPrefetch *) v;
+    struct prefetchChunk *chunk;
+    char *buf = NULL, *tmp;
+    int64_t index;
+    uint64_t generation;
+    tSize length, numRead;
+    int ret;
+    
+    pthread_mutex_lock(&pf->lock);
+    for (;;) {
+        while (!pf->closeFlag && (pf->fetchIndex >= pf->endIndex ||
+                pf->fetchIndex >= pf->consumeIndex + pf->parallelism)) {
+            pthread_cond_wait(&pf->fetchable, &pf->lock);
+        }
+        if (pf->closeFlag) {
+            break;
+        }
+        index = pf->fetchIndex++;
+        generation = pf->generation;
+        chunk = &pf->chunks[index % pf->parallelism];
+        chunk->index = index;
+        chunk->state = PREFETCH_PENDING;
+        pthread_mutex_unlock(&pf->lock);
+        
+        ret = 0;
+        length = 0;
+        if (!buf) {
+            buf = malloc(HDFS_WEBHDFS_READ_CHUNK_SIZE);
+            if (!buf) {
+                ret = ENOMEM;
+            }
+        }
+        // A ranged OPEN is only short at the end of the file, but keep
+        // asking until the chunk is full to be sure
+        while (!ret && length < HDFS_WEBHDFS_READ_CHUNK_SIZE) {
+            ret = hdfsReadImpl(pf->fs, pf->file, buf + length,
+                        index * HDFS_WEBHDFS_READ_CHUNK_SIZE + length,
+                        HDFS_WEBHDFS_READ_CHUNK_SIZE - length, &numRead);
+            if (!ret && numRead == 0) {
+                break;
+            }
+            length += numRead;
+        }
+        
+        pthread_mutex_lock(&pf->lock);
+        if (pf->generation != generation) {
+            // hdfsRead has seeked away; the slot may be someone else's now
+            continue;
+        }
+        if (ret) {
+            chunk->error = ret;
+            chunk->state = PREFETCH_FAILED;
+        } else {
+            // Hand over the buffer, taking the chunk's old one in exchange
+            tmp = chunk->data;
+            chunk->data = buf;
+            buf = tmp;
+            chunk->length = length;
+            chunk->state = PREFETCH_READY;
+        }
+        if ((ret || length < HDFS_WEBHDFS_READ_CHUNK_SIZE) &&
+                pf->endIndex > index + 1) {
+            pf->endIndex = index + 1;
+        }
+        pthread_cond_broadcast(&pf->ready);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    free(buf);
+    return NULL;
+}
+
+/**
+ * Stop fetching ahead, if we are, and wait for the fetching threads to
+ * finish the requests they are making.
+ */
+static void stopPrefetch(struct webhdfsFileHandle *handle)
+{
+    struct webhdfsPrefetch *pf = handle->prefetch;
+    int i, ret;
+
+    if (!pf) {
+        return;
+    }
+    pthread_mutex_lock(&pf->lock);
+    pf->closeFlag = 1;
+    pthread_cond_broadcast(&pf->fetchable);
+    pthread_mutex_unlock(&pf->lock);
+    for (i = 0; i < pf->numThreads; i++) {
+        ret = pthread_join(pf->threads[i], NULL);
+        if (ret) {
+            fprintf(stderr, "Error (code %d) when pthread_join.\n", ret);
+        }
+    }
+    for (i = 0; i < pf->parallelism; i++) {
+        free(pf->chunks[i].data);
+    }
+    pthread_cond_destroy(&pf->fetchable);
+    pthread_cond_destroy(&pf->ready);
+    pthread_mutex_destroy(&pf->lock);
+    free(pf->chunks);
+    free(pf->threads);
+    free(pf);
+    handle->prefetch = NULL;
+}
+
+/**
+ * Start fetching a file ahead of hdfsRead from an offset, with
+ * fs->readParallelism requests at once.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int startPrefetch(hdfsFS fs, hdfsFile file, tOffset offset)
+{
+    struct webhdfsPrefetch *pf;
+    int ret;
+
+    pf = calloc(1, sizeof(*pf));
+    if (!pf) {
+        return ENOMEM;
+    }
+    pf->fs = fs;
+    pf->file = file;
+    pf->parallelism = fs->readParallelism;
+    pf->chunks = calloc(pf->parallelism, sizeof(*pf->chunks));
+    pf->threads = calloc(pf->parallelism, sizeof(*pf->threads));
+    if (!pf->chunks || !pf->threads) {
+        free(pf->chunks);
+        free(pf->threads);
+        free(pf);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->fetchable, NULL);
+    pthread_cond_init(&pf->ready, NULL);
+    resetPrefetch(pf, offset);
+    file->file->prefetch = pf;
+    for (; pf->numThreads < pf->parallelism; pf->numThreads++) {
+        ret = pthread_create(&pf->threads[pf->numThreads], NULL,
+                             prefetchThreadOperation, pf);
+        if (ret) {
+            fprintf(stderr, "Failed to create a reading thread.\n");
+            break;
+        }
+    }
+    if (pf->numThreads == 0) {
+        stopPrefetch(file->file);
+        return ret;
+    }
+    return 0;
+}
+
+/**
+ * Read the next bytes of a file that is being fetched ahead.  Returns as
+ * soon as the chunk at the current offset is there.
+ *
+ * @return                       0 on success; error code otherwise
+ */
+static int readFromPrefetch(hdfsFS fs, hdfsFile file, void *buffer,
+                            tSize length, tSize *numRead)
+{
+    struct webhdfsPrefetch *pf = file->file->prefetch;
+    struct prefetchChunk *chunk;
+    tOffset position;
+    tSize avail;
+    int ret = 0;
+
+    if (!pf) {
+        ret = startPrefetch(fs, file, file->offset);
+        if (ret) {
+            return ret;
+        }
+        pf = file->file->prefetch;
+    }
+    pthread_mutex_lock(&pf->lock);
+    position = pf->consumeIndex * HDFS_WEBHDFS_READ_CHUNK_SIZE +
+               pf->consumeOffset;
+    if (position != file->offset) {
+        resetPrefetch(pf, file->offset);
+    }
+    for (;;) {
+        chunk = &pf->chunks[pf->consumeIndex % pf->parallelism];
+        if (chunk->index != pf->consumeIndex ||
+                chunk->state == PREFETCH_EMPTY ||
+                chunk->state == PREFETCH_PENDING) {
+            pthread_cond_wait(&pf->ready, &pf->lock);
+            continue;
+        }
+        if (chunk->state == PREFETCH_FAILED) {
+            ret = chunk->error;
+            // Ask again, from here, on the next read
+            resetPrefetch(pf, file->offset);
+            break;
+        }
+        if (pf->consumeOffset < chunk->length ||
+                chunk->length < HDFS_WEBHDFS_READ_CHUNK_SIZE) {
+            break;
+        }
+        // Done with this chunk; let a thread fetch one further ahead
+        chunk->state = PREFETCH_EMPTY;
+        pf->consumeIndex++;
+        pf->consumeOffset = 0;
+        pthread_cond_broadcast(&pf->fetchable);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    if (ret) {
+        return ret;
+    }
+    // The fetching threads leave a chunk alone once it is ready
+    avail = chunk->length - pf->consumeOffset;
+    if (avail < 0) {
+        avail = 0; // At or past the end of the file
+    }
+    if (avail > length) {
+        avail = length;
+    }
+    memcpy(buffer, chunk->data + pf->consumeOffset, avail);
+    pf->consumeOffset += avail;
+    *numRead = avail;
+    return 0;
+}
+
 tSize hdfsRead(hdfsFS fs, hdfsFile file, void* buffer, tSize length)
 {
+    struct webhdfsFileHandle *wf;
     int ret;
     tSize numRead = 0;
 
-    ret = hdfsReadImpl(fs, file, buffer, file->offset, length, &numRead);
+    if (fs == NULL || file == NULL || file->type != INPUT || buffer == NULL ||
+            length < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    wf = file->file;
+    if (fs->readParallelism > 1) {
+        ret = readFromPrefetch(fs, file, buffer, length, &numRead);
+        goto done;
+    }
+    // A seek, or an earlier failure, leaves the stream somewhere else
+    if (wf->downloadBuffer && wf->streamOffset != file->offset) {
+        stopReadStream(wf);
+    }
+    ret = 0;
+    if (!wf->downloadBuffer) {
+        ret = startReadStream(fs, wf, file->offset);
+    }
+    if (!ret) {
+        ret = readFromStream(wf, buffer, length, &numRead);
+        if (ret) {
+            // Start a new request on the next read
+            stopReadStream(wf);
+        }
+    }
+done:
     if (ret) {
         errno = ret;
         return -1;
@@ -1134,7 +1987,6 @@ int hdfsMove(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
 int hdfsSeek(hdfsFS fs, hdfsFile file, tOffset desiredPos)
 {
     struct webhdfsFileHandle *wf;
-    hdfsFileInfo *fileInfo = NULL;
     int ret = 0;
 
     if (!fs || !file || (file->type == OUTPUT) || (desiredPos < 0)) {
@@ -1146,25 +1998,25 @@ int hdfsSeek(hdfsFS fs, hdfsFile file, tOffset desiredPos)
         ret = EINVAL;
         goto done;
     }
-    fileInfo = hdfsGetPathInfo(fs, wf->absPath);
-    if (!fileInfo) {
-        ret = errno;
-        goto done;
+    // The file may have grown since we looked, so only a seek past the
+    // length we know needs to ask the namenode
+    if (desiredPos > wf->fileLength) {
+        ret = refreshFileLength(fs, wf);
+        if (ret) {
+            goto done;
+        }
     }
-    if (desiredPos > fileInfo->mSize) {
+    if (desiredPos > wf->fileLength) {
         fprintf(stderr,
                 "hdfsSeek for %s failed since the desired position %" PRId64
                 " is beyond the size of the file %" PRId64 "\n",
-                wf->absPath, desiredPos, fileInfo->mSize);
+                wf->absPath, desiredPos, wf->fileLength);
         ret = ENOTSUP;
         goto done;
     }
     file->offset = desiredPos;
 
 done:
-    if (fileInfo) {
-        hdfsFreeFileInfo(fileInfo, 1);
-    }
     if (ret) {
         errno = ret;
         return -1;
@@ -1279,29 +2131,131 @@ void hdfsFileDisableDirectRead(hdfsFile file)
 
 int hdfsHFlush(hdfsFS fs, hdfsFile file)
 {
+    int ret;
+
     if (file->type != OUTPUT) {
         errno = EINVAL; 
         return -1;
     }
-    // TODO: block until our write buffer is flushed
+    // Hand everything written so far to the http connection
+    ret = drainWebhdfsBuffer(file->file->uploadBuffer);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
     return 0;
 }
 
 int hdfsFlush(hdfsFS fs, hdfsFile file)
 {
+    int ret;
+
     if (file->type != OUTPUT) {
         errno = EINVAL; 
         return -1;
     }
-    // TODO: block until our write buffer is flushed
+    // Hand everything written so far to the http connection
+    ret = drainWebhdfsBuffer(file->file->uploadBuffer);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
     return 0;
 }
 
+struct hdfsBlockLocation *hdfsGetBlockLocations(hdfsFS fs, const char *path,
+        tOffset start, tOffset length, int *numBlocks)
+{
+    char *absPath = NULL;
+    char *url = NULL;
+    Response resp = NULL;
+    struct hdfsBlockLocation *blocks = NULL;
+    int ret = 0;
+
+    if (fs == NULL || path == NULL || numBlocks == NULL ||
+        start < 0 || length < 0) {
+        ret = EINVAL;
+        goto done;
+    }
+    absPath = getAbsolutePath(fs, path);
+    if (!absPath) {
+        ret = ENOMEM;
+        goto done;
+    }
+    url = prepareGetBlockLocations(fs->nn, fs->port, absPath, fs->userName,
+                                   start, length);
+    if (!url) {
+        ret = ENOMEM;
+        goto done;
+    }
+    resp = launchGetBlockLocations(url);
+    if (!resp || !resp->body->content) {
+        ret = EIO;
+        goto done;
+    }
+    blocks = parseGetBlockLocations(resp->body->content, numBlocks);
+    if (!blocks) {
+        ret = errno;
+    }
+
+done:
+    freeResponse(resp);
+    free(absPath);
+    free(url);
+    if (ret) {
+        errno = ret;
+        return NULL;
+    }
+    return blocks;
+}
+
+void hdfsFreeBlockLocations(struct hdfsBlockLocation *blocks, int numBlocks)
+{
+    //The lists and strings live in the same block, after the entries
+    free(blocks);
+}
+
 char*** hdfsGetHosts(hdfsFS fs, const char* path,
                      tOffset start, tOffset length)
 {
-    errno = ENOTSUP;
-    return NULL;
+    struct hdfsBlockLocation *blocks;
+    char ***blockHosts;
+    int numBlocks, i, j, ret = 0;
+
+    blocks = hdfsGetBlockLocations(fs, path, start, length, &numBlocks);
+    if (!blocks) {
+        return NULL;
+    }
+    blockHosts = calloc(numBlocks + 1, sizeof(char **));
+    if (!blockHosts) {
+        ret = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < numBlocks; i++) {
+        blockHosts[i] = calloc(blocks[i].numHosts + 1, sizeof(char *));
+        if (!blockHosts[i]) {
+            ret = ENOMEM;
+            goto done;
+        }
+        for (j = 0; j < blocks[i].numHosts; j++) {
+            blockHosts[i][j] = strdup(blocks[i].hosts[j]);
+            if (!blockHosts[i][j]) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+    }
+
+done:
+    hdfsFreeBlockLocations(blocks, numBlocks);
+    if (ret) {
+        if (blockHosts) {
+            hdfsFreeHosts(blockHosts);
+        }
+        errno = ret;
+        return NULL;
+    }
+    return blockHosts;
 }
 
 tOffset hdfsGetCapacity(hdfsFS fs)
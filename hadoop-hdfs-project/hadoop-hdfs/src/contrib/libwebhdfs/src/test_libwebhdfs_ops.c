@@ -17,6 +17,7 @@
  */
 
 #include "hdfs.h"
+#include "hdfs_batch.h"
 
 #include <inttypes.h>
 #include <jni.h>
@@ -295,23 +296,24 @@ int main(int argc, char **argv) {
             }
         }
         
-        //        char*** hosts = hdfsGetHosts(fs, srcPath, 0, 1);
-        //        if(hosts) {
-        //            fprintf(stderr, "hdfsGetHosts - SUCCESS! ... \n");
-        //            int i=0;
-        //            while(hosts[i]) {
-        //                int j = 0;
-        //                while(hosts[i][j]) {
-        //                    fprintf(stderr,
-        //                            "\thosts[%d][%d] - %s\n", i, j, hosts[i][j]);
-        //                    ++j;
-        //                }
-        //                ++i;
-        //            }
-        //        } else {
-        //            totalResult++;
-        //            fprintf(stderr, "waah! hdfsGetHosts - FAILED!\n");
-        //        }
+        char*** hosts = hdfsGetHosts(fs, srcPath, 0, 1);
+        if(hosts) {
+            fprintf(stderr, "hdfsGetHosts - SUCCESS! ... \n");
+            int i=0;
+            while(hosts[i]) {
+                int j = 0;
+                while(hosts[i][j]) {
+                    fprintf(stderr,
+                            "\thosts[%d][%d] - %s\n", i, j, hosts[i][j]);
+                    ++j;
+                }
+                ++i;
+            }
+            hdfsFreeHosts(hosts);
+        } else {
+            totalResult++;
+            fprintf(stderr, "waah! hdfsGetHosts - FAILED!\n");
+        }
         
         char *newOwner = "root";
         // setting tmp dir to 777 so later when connectAsUser nobody, we can write to it
@@ -370,6 +372,57 @@ int main(int argc, char **argv) {
         totalResult += (result ? 0 : 1);
     }
     
+    {
+        // TEST BATCHES
+        const int numBatchDirs = 8;
+        char batchPaths[8][64];
+        hdfsBatchOp ops[8];
+        int i;
+        
+        memset(ops, 0, sizeof(ops));
+        for (i = 0; i < numBatchDirs; i++) {
+            snprintf(batchPaths[i], sizeof(batchPaths[i]), "/tmp/batch%d", i);
+            ops[i].type = HDFS_BATCH_CREATE_DIRECTORY;
+            ops[i].path = batchPaths[i];
+        }
+        fprintf(stderr, "hdfsRunBatch(mkdir): %s\n", ((result = hdfsRunBatch(fs, ops, numBatchDirs, 3)) ? "Failed!" : "Success!"));
+        totalResult += result;
+        
+        for (i = 0; i < numBatchDirs; i++) {
+            ops[i].type = HDFS_BATCH_CHMOD;
+            ops[i].mode = 0711;
+        }
+        fprintf(stderr, "hdfsRunBatch(chmod): %s\n", ((result = hdfsRunBatch(fs, ops, numBatchDirs, 0)) ? "Failed!" : "Success!"));
+        totalResult += result;
+        
+        for (i = 0; i < numBatchDirs; i++) {
+            ops[i].type = HDFS_BATCH_GET_PATH_INFO;
+        }
+        fprintf(stderr, "hdfsRunBatch(getPathInfo): %s\n", ((result = hdfsRunBatch(fs, ops, numBatchDirs, 0)) ? "Failed!" : "Success!"));
+        totalResult += result;
+        result = 0;
+        for (i = 0; i < numBatchDirs; i++) {
+            if (ops[i].info) {
+                result |= (ops[i].info->mKind != kObjectKindDirectory ||
+                           ops[i].info->mPermissions != 0711);
+                hdfsFreeFileInfo(ops[i].info, 1);
+            } else {
+                result = 1;
+            }
+        }
+        totalResult += result;
+        fprintf(stderr, "hdfsRunBatch read (getPathInfo): %s\n", (result ? "Failed!" : "Success!"));
+        
+        for (i = 0; i < numBatchDirs; i++) {
+            ops[i].type = HDFS_BATCH_DELETE;
+            ops[i].recursive = 1;
+        }
+        fprintf(stderr, "hdfsRunBatch(delete): %s\n", ((result = hdfsRunBatch(fs, ops, numBatchDirs, 0)) ? "Failed!" : "Success!"));
+        totalResult += result;
+        fprintf(stderr, "hdfsExists: %s\n", ((result = hdfsExists(fs, batchPaths[0])) ? "Success!" : "Failed!"));
+        totalResult += (result ? 0 : 1);
+    }
+    
     {
         // TEST APPENDS
         const char *writePath = "/tmp/appends";
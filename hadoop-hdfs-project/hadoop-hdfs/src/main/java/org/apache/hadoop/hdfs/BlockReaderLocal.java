@@ -232,6 +232,22 @@ static BlockReaderLocal newBlockReader(Configuration conf, String file,
     return localBlockReader;
   }
   
+  /**
+   * Find the local paths of a replica's block and meta files, asking the
+   * datanode only when they are not cached already.
+   */
+  static BlockLocalPathInfo getLocalPathInfo(Configuration conf,
+      ExtendedBlock blk, Token<BlockTokenIdentifier> token, DatanodeInfo node,
+      int socketTimeout, boolean connectToDnViaHostname) throws IOException {
+    BlockLocalPathInfo pathinfo =
+        getLocalDatanodeInfo(node.getIpcPort()).getBlockLocalPathInfo(blk);
+    if (pathinfo == null) {
+      pathinfo = getBlockPathInfo(blk, node, conf, socketTimeout, token,
+          connectToDnViaHostname);
+    }
+    return pathinfo;
+  }
+
   private static synchronized LocalDatanodeInfo getLocalDatanodeInfo(int port) {
     LocalDatanodeInfo ldInfo = localDatanodeInfoMap.get(port);
     if (ldInfo == null) {
@@ -265,7 +281,7 @@ private static BlockLocalPathInfo getBlockPathInfo(ExtendedBlock blk,
     return pathinfo;
   }
   
-  private static boolean skipChecksumCheck(Configuration conf) {
+  static boolean skipChecksumCheck(Configuration conf) {
     return conf.getBoolean(
         DFSConfigKeys.DFS_CLIENT_READ_SHORTCIRCUIT_SKIP_CHECKSUM_KEY,
         DFSConfigKeys.DFS_CLIENT_READ_SHORTCIRCUIT_SKIP_CHECKSUM_DEFAULT);
@@ -192,6 +192,8 @@ public class DFSClient implements java.io.Closeable {
   final int hdfsTimeout;    // timeout value for a DFS operation.
   private final String authority;
   final SocketCache socketCache;
+  final DFSInputStream.ReadStatistics readStatistics =
+      new DFSInputStream.ReadStatistics();
   final Conf dfsClientConf;
   private Random r = new Random();
   private SocketAddress[] localInterfaceAddrs;
@@ -808,7 +810,7 @@ static BlockReader getLocalBlockReader(Configuration conf,
   private static Map<String, Boolean> localAddrMap = Collections
       .synchronizedMap(new HashMap<String, Boolean>());
   
-  private static boolean isLocalAddress(InetSocketAddress targetAddr) {
+  static boolean isLocalAddress(InetSocketAddress targetAddr) {
     InetAddress addr = targetAddr.getAddress();
     Boolean cached = localAddrMap.get(addr.getHostAddress());
     if (cached != null) {
@@ -2095,6 +2097,14 @@ public DFSDataInputStream(DFSInputStream in) throws IOException {
     }
   }
   
+  /**
+   * Get a snapshot of the bytes read through all the streams of this
+   * client so far.
+   */
+  public DFSInputStream.ReadStatistics getReadStatistics() {
+    return new DFSInputStream.ReadStatistics(readStatistics);
+  }
+
   boolean shouldTryShortCircuitRead(InetSocketAddress targetAddr) {
     return shortCircuitLocalReads && isLocalAddress(targetAddr);
   }
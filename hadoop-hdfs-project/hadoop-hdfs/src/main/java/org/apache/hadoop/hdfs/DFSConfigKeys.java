@@ -131,6 +131,8 @@ public class DFSConfigKeys extends CommonConfigurationKeys {
   public static final boolean DFS_CLIENT_HTTPS_NEED_AUTH_DEFAULT = false;
   public static final String  DFS_CLIENT_CACHED_CONN_RETRY_KEY = "dfs.client.cached.conn.retry";
   public static final int     DFS_CLIENT_CACHED_CONN_RETRY_DEFAULT = 3;
+  public static final String  DFS_CLIENT_COPY_STREAMS_KEY = "dfs.client.copy.streams";
+  public static final int     DFS_CLIENT_COPY_STREAMS_DEFAULT = 4;
   public static final String  DFS_NAMENODE_ACCESSTIME_PRECISION_KEY = "dfs.namenode.accesstime.precision";
   public static final long    DFS_NAMENODE_ACCESSTIME_PRECISION_DEFAULT = 3600000;
   public static final String  DFS_NAMENODE_REPLICATION_CONSIDERLOAD_KEY = "dfs.namenode.replication.considerLoad";
@@ -34,10 +34,12 @@
 
 import org.apache.hadoop.classification.InterfaceAudience;
 import org.apache.hadoop.fs.ChecksumException;
+import org.apache.hadoop.fs.ByteBufferPositionedReadable;
 import org.apache.hadoop.fs.ByteBufferReadable;
 import org.apache.hadoop.fs.FSInputStream;
 import org.apache.hadoop.fs.UnresolvedLinkException;
 import org.apache.hadoop.hdfs.SocketCache.SocketAndStreams;
+import org.apache.hadoop.hdfs.protocol.BlockLocalPathInfo;
 import org.apache.hadoop.hdfs.protocol.ClientDatanodeProtocol;
 import org.apache.hadoop.hdfs.protocol.DatanodeInfo;
 import org.apache.hadoop.hdfs.protocol.ExtendedBlock;
@@ -59,7 +61,8 @@
  * negotiation of the namenode and various datanodes as necessary.
  ****************************************************************/
 @InterfaceAudience.Private
-public class DFSInputStream extends FSInputStream implements ByteBufferReadable {
+public class DFSInputStream extends FSInputStream
+    implements ByteBufferReadable, ByteBufferPositionedReadable {
   private final SocketCache socketCache;
 
   private final DFSClient dfsClient;
@@ -100,6 +103,73 @@ public class DFSInputStream extends FSInputStream implements ByteBufferReadable
 
   private final int nCachedConnRetry;
 
+  /**
+   * Counters of the bytes a stream, or all the streams of a client, have
+   * read, by where the data came from.  Local bytes include short-circuit
+   * bytes.
+   */
+  public static class ReadStatistics {
+    private long totalBytesRead;
+    private long totalLocalBytesRead;
+    private long totalShortCircuitBytesRead;
+
+    public ReadStatistics() {
+    }
+
+    public ReadStatistics(ReadStatistics rhs) {
+      synchronized (rhs) {
+        this.totalBytesRead = rhs.totalBytesRead;
+        this.totalLocalBytesRead = rhs.totalLocalBytesRead;
+        this.totalShortCircuitBytesRead = rhs.totalShortCircuitBytesRead;
+      }
+    }
+
+    /**
+     * @return The total bytes read.
+     */
+    public synchronized long getTotalBytesRead() {
+      return totalBytesRead;
+    }
+
+    /**
+     * @return The total bytes read from a datanode on this host, including
+     *         short-circuit reads.
+     */
+    public synchronized long getTotalLocalBytesRead() {
+      return totalLocalBytesRead;
+    }
+
+    /**
+     * @return The total bytes read straight from the block files.
+     */
+    public synchronized long getTotalShortCircuitBytesRead() {
+      return totalShortCircuitBytesRead;
+    }
+
+    /**
+     * @return The total bytes read from datanodes on other hosts.
+     */
+    public synchronized long getRemoteBytesRead() {
+      return totalBytesRead - totalLocalBytesRead;
+    }
+
+    synchronized void addBytes(long amt, boolean local,
+        boolean shortCircuit) {
+      totalBytesRead += amt;
+      if (local) {
+        totalLocalBytesRead += amt;
+      }
+      if (shortCircuit) {
+        totalShortCircuitBytesRead += amt;
+      }
+    }
+  }
+
+  private final ReadStatistics readStatistics = new ReadStatistics();
+
+  /** Whether blockReader reads from a datanode on this host */
+  private boolean blockReaderLocal = false;
+
   void addToDeadNodes(DatanodeInfo dnInfo) {
     deadNodes.put(dnInfo, dnInfo);
   }
@@ -271,6 +341,104 @@ public synchronized List<LocatedBlock> getAllBlocks() throws IOException {
     return getBlockRange(0, getFileLength());
   }
 
+  /**
+   * Where a block of the file can be read from local disk, for readers in
+   * this process that read block files themselves, such as libhdfs.
+   */
+  public static class LocalBlock {
+    private final long startOffset;
+    private final long length;
+    private final String blockPath;
+    private final String metaPath;
+
+    LocalBlock(long startOffset, long length, String blockPath,
+        String metaPath) {
+      this.startOffset = startOffset;
+      this.length = length;
+      this.blockPath = blockPath;
+      this.metaPath = metaPath;
+    }
+
+    /**
+     * @return The offset in the file at which the block starts.
+     */
+    public long getStartOffset() {
+      return startOffset;
+    }
+
+    /**
+     * @return The number of bytes of the file in the block.
+     */
+    public long getLength() {
+      return length;
+    }
+
+    /**
+     * @return The local path of the block file, or null if the block
+     *         cannot be read from local disk.
+     */
+    public String getBlockPath() {
+      return blockPath;
+    }
+
+    /**
+     * @return The local path of the block's checksum file, or null if
+     *         checksums are not to be verified.
+     */
+    public String getMetaPath() {
+      return metaPath;
+    }
+  }
+
+  /**
+   * Find the block holding a position of the file and, when short-circuit
+   * reads are enabled and a replica is on this host, the local paths of its
+   * files.  Blocks of a file being written are never reported as local.
+   *
+   * @param offset  A position in the file
+   * @return The block, with null paths if it is not to be read locally; or
+   *         null if the position is past the end of the file
+   */
+  public synchronized LocalBlock getLocalBlock(long offset)
+      throws IOException {
+    if (offset < 0) {
+      throw new IOException("Negative offset " + offset);
+    }
+    if (offset >= getFileLength()) {
+      return null;
+    }
+    LocatedBlock blk = getBlockAt(offset, false);
+    if (!blockUnderConstruction()) {
+      for (DatanodeInfo node : blk.getLocations()) {
+        if (deadNodes.containsKey(node)) {
+          continue;
+        }
+        InetSocketAddress addr = NetUtils.createSocketAddr(
+            node.getXferAddr(dfsClient.connectToDnViaHostname()));
+        if (!dfsClient.shouldTryShortCircuitRead(addr)) {
+          continue;
+        }
+        try {
+          BlockLocalPathInfo info = BlockReaderLocal.getLocalPathInfo(
+              dfsClient.conf, blk.getBlock(), blk.getBlockToken(), node,
+              dfsClient.hdfsTimeout, dfsClient.connectToDnViaHostname());
+          if (info == null) {
+            continue;
+          }
+          boolean verify = verifyChecksum &&
+              !BlockReaderLocal.skipChecksumCheck(dfsClient.conf);
+          return new LocalBlock(blk.getStartOffset(), blk.getBlockSize(),
+              info.getBlockPath(), verify ? info.getMetaPath() : null);
+        } catch (IOException e) {
+          DFSClient.LOG.debug("Could not find the local paths of "
+              + blk.getBlock() + " on " + node, e);
+        }
+      }
+    }
+    return new LocalBlock(blk.getStartOffset(), blk.getBlockSize(),
+        null, null);
+  }
+
   /**
    * Get block at the specified position.
    * Fetch it from the namenode if not cached.
@@ -455,6 +623,7 @@ private synchronized DatanodeInfo blockSeekTo(long target) throws IOException {
         blockReader = getBlockReader(targetAddr, chosenNode, src, blk,
             accessToken, offsetIntoBlock, blk.getNumBytes() - offsetIntoBlock,
             buffersize, verifyChecksum, dfsClient.clientName);
+        blockReaderLocal = DFSClient.isLocalAddress(targetAddr);
         if(connectFailedOnce) {
           DFSClient.LOG.info("Successfully connected to " + targetAddr +
                              " for block " + blk.getBlockId());
@@ -591,7 +760,9 @@ private synchronized int readBuffer(ReaderStrategy reader, int off, int len,
     while (true) {
       // retry as many times as seekToNewSource allows.
       try {
-        return reader.doRead(blockReader, off, len);
+        int ret = reader.doRead(blockReader, off, len);
+        updateReadStatistics(ret, blockReader, blockReaderLocal);
+        return ret;
       } catch ( ChecksumException ce ) {
         DFSClient.LOG.warn("Found Checksum error for "
             + getCurrentBlock() + " from " + currentNode
@@ -716,11 +887,20 @@ private void addIntoCorruptedBlockMap(ExtendedBlock blk, DatanodeInfo node,
   }
       
   private DNAddrPair chooseDataNode(LocatedBlock block)
+    throws IOException {
+    return chooseDataNode(block, null);
+  }
+
+  /**
+   * As {@link #chooseDataNode(LocatedBlock)}, but only choosing the avoided
+   * datanode if no other is left.
+   */
+  private DNAddrPair chooseDataNode(LocatedBlock block, DatanodeInfo avoid)
     throws IOException {
     while (true) {
       DatanodeInfo[] nodes = block.getLocations();
       try {
-        DatanodeInfo chosenNode = bestNode(nodes, deadNodes);
+        DatanodeInfo chosenNode = bestNode(nodes, deadNodes, avoid);
         final String dnAddr =
             chosenNode.getXferAddr(dfsClient.connectToDnViaHostname());
         if (DFSClient.LOG.isDebugEnabled()) {
@@ -766,10 +946,43 @@ private DNAddrPair chooseDataNode(LocatedBlock block)
     }
   } 
       
+  /**
+   * Read exactly len bytes from reader into buf, advancing its position.
+   * Array-backed buffers go through readAll so that byte[] preads behave
+   * exactly as before.
+   */
+  private static int readAllInto(BlockReader reader, ByteBuffer buf, int len)
+      throws IOException {
+    if (buf.hasArray()) {
+      int nread = reader.readAll(buf.array(),
+          buf.arrayOffset() + buf.position(), len);
+      if (nread > 0) {
+        buf.position(buf.position() + nread);
+      }
+      return nread;
+    }
+    ByteBuffer target = buf.slice();
+    target.limit(len);
+    int nread = 0;
+    while (target.hasRemaining()) {
+      int ret = reader.read(target);
+      if (ret < 0) {
+        break;
+      }
+      nread += ret;
+    }
+    buf.position(buf.position() + nread);
+    return nread;
+  }
+
   private void fetchBlockByteRange(LocatedBlock block, long start, long end,
-      byte[] buf, int offset,
-      Map<ExtendedBlock, Set<DatanodeInfo>> corruptedBlockMap)
+      ByteBuffer buf,
+      Map<ExtendedBlock, Set<DatanodeInfo>> corruptedBlockMap,
+      DatanodeInfo avoid)
       throws IOException {
+    // a failed attempt may have filled part of buf, so each retry starts
+    // again from here
+    int startPos = buf.position();
     //
     // Connect to best DataNode for desired Block, with potential offset
     //
@@ -781,10 +994,11 @@ private void fetchBlockByteRange(LocatedBlock block, long start, long end,
       // or fetchBlockAt(). Always get the latest list of locations at the 
       // start of the loop.
       block = getBlockAt(block.getStartOffset(), false);
-      DNAddrPair retval = chooseDataNode(block);
+      DNAddrPair retval = chooseDataNode(block, avoid);
       DatanodeInfo chosenNode = retval.info;
       InetSocketAddress targetAddr = retval.addr;
       BlockReader reader = null;
+      buf.position(startPos);
           
       try {
         Token<BlockTokenIdentifier> blockToken = block.getBlockToken();
@@ -793,7 +1007,9 @@ private void fetchBlockByteRange(LocatedBlock block, long start, long end,
         reader = getBlockReader(targetAddr, chosenNode, src, block.getBlock(),
             blockToken, start, len, buffersize, verifyChecksum,
             dfsClient.clientName);
-        int nread = reader.readAll(buf, offset, len);
+        int nread = readAllInto(reader, buf, len);
+        updateReadStatistics(nread, reader,
+            DFSClient.isLocalAddress(targetAddr));
         if (nread != len) {
           throw new IOException("truncated return from reader.read(): " +
                                 "excpected " + len + ", got " + nread);
@@ -841,6 +1057,28 @@ private void fetchBlockByteRange(LocatedBlock block, long start, long end,
     }
   }
 
+  /**
+   * Count bytes read through reader in this stream's statistics and in its
+   * client's.
+   */
+  private void updateReadStatistics(int nRead, BlockReader reader,
+      boolean local) {
+    if (nRead <= 0) {
+      return;
+    }
+    boolean shortCircuit = reader instanceof BlockReaderLocal;
+    readStatistics.addBytes(nRead, local || shortCircuit, shortCircuit);
+    dfsClient.readStatistics.addBytes(nRead, local || shortCircuit,
+        shortCircuit);
+  }
+
+  /**
+   * Get a snapshot of the bytes read through this stream so far.
+   */
+  public ReadStatistics getReadStatistics() {
+    return new ReadStatistics(readStatistics);
+  }
+
   /**
    * Close the given BlockReader and cache its socket.
    */
@@ -973,6 +1211,40 @@ protected BlockReader getBlockReader(InetSocketAddress dnAddr,
   @Override
   public int read(long position, byte[] buffer, int offset, int length)
     throws IOException {
+    return read(position, ByteBuffer.wrap(buffer, offset, length));
+  }
+
+  /**
+   * Read bytes starting from the specified position into a ByteBuffer.
+   * Direct buffers are filled straight from the block readers without an
+   * intermediate byte[].
+   * 
+   * @param position start read from this position
+   * @param buf read buffer; up to buf.remaining() bytes are read and its
+   *            position is advanced past them
+   * 
+   * @return actual number of bytes read
+   */
+  @Override
+  public int read(long position, ByteBuffer buf) throws IOException {
+    return read(position, buf, false);
+  }
+
+  /**
+   * Positional read that stays away from the datanode
+   * {@link #read(long, ByteBuffer)} would try first for the first block,
+   * unless it has the only live replica.  A read that is slow because of
+   * its datanode can be hedged by starting one of these alongside it.
+   *
+   * @return actual number of bytes read
+   */
+  public int hedgedRead(long position, ByteBuffer buf) throws IOException {
+    return read(position, buf, true);
+  }
+
+  private int read(long position, ByteBuffer buf, boolean hedge)
+      throws IOException {
+    int length = buf.remaining();
     // sanity checks
     dfsClient.checkOpen();
     if (closed) {
@@ -994,12 +1266,20 @@ public int read(long position, byte[] buffer, int offset, int length)
     int remaining = realLen;
     Map<ExtendedBlock,Set<DatanodeInfo>> corruptedBlockMap 
       = new HashMap<ExtendedBlock, Set<DatanodeInfo>>();
+    DatanodeInfo avoid = null;
+    if (hedge && !blockRange.isEmpty()) {
+      try {
+        avoid = bestNode(blockRange.get(0).getLocations(), deadNodes);
+      } catch (IOException e) {
+        // no live replica to stay away from
+      }
+    }
     for (LocatedBlock blk : blockRange) {
       long targetStart = position - blk.getStartOffset();
       long bytesToRead = Math.min(remaining, blk.getBlockSize() - targetStart);
       try {
         fetchBlockByteRange(blk, targetStart, 
-            targetStart + bytesToRead - 1, buffer, offset, corruptedBlockMap);
+            targetStart + bytesToRead - 1, buf, corruptedBlockMap, avoid);
       } finally {
         // Check and report if any block replicas are corrupted.
         // BlockMissingException may be caught if all block replicas are
@@ -1009,7 +1289,6 @@ public int read(long position, byte[] buffer, int offset, int length)
 
       remaining -= bytesToRead;
       position += bytesToRead;
-      offset += bytesToRead;
     }
     assert remaining == 0 : "Wrong number of bytes read.";
     if (dfsClient.stats != null) {
@@ -1195,6 +1474,24 @@ static DatanodeInfo bestNode(DatanodeInfo nodes[],
     throw new IOException("No live nodes contain current block");
   }
 
+  /**
+   * As {@link #bestNode(DatanodeInfo[], AbstractMap)}, but only picking the
+   * avoided node if every other one is dead.
+   */
+  static DatanodeInfo bestNode(DatanodeInfo nodes[],
+                               AbstractMap<DatanodeInfo, DatanodeInfo> deadNodes,
+                               DatanodeInfo avoid)
+                               throws IOException {
+    if (avoid != null && nodes != null) {
+      for (int i = 0; i < nodes.length; i++) {
+        if (!nodes[i].equals(avoid) && !deadNodes.containsKey(nodes[i])) {
+          return nodes[i];
+        }
+      }
+    }
+    return bestNode(nodes, deadNodes);
+  }
+
   /** Utility class to encapsulate data node info and its address. */
   static class DNAddrPair {
     DatanodeInfo info;
@@ -18,23 +18,33 @@
 
 package org.apache.hadoop.hdfs;
 
+import java.io.EOFException;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.io.InterruptedIOException;
 import java.net.InetSocketAddress;
 import java.net.URI;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.EnumSet;
 import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
 
 import org.apache.hadoop.classification.InterfaceAudience;
 import org.apache.hadoop.classification.InterfaceStability;
 import org.apache.hadoop.conf.Configuration;
 import org.apache.hadoop.fs.BlockLocation;
+import org.apache.hadoop.fs.CommonConfigurationKeysPublic;
 import org.apache.hadoop.fs.ContentSummary;
 import org.apache.hadoop.fs.CreateFlag;
 import org.apache.hadoop.fs.BlockStorageLocation;
 import org.apache.hadoop.fs.VolumeId;
 import org.apache.hadoop.fs.FSDataInputStream;
+import org.apache.hadoop.fs.FSDataOutputStream;
 import org.apache.hadoop.fs.FileStatus;
 import org.apache.hadoop.fs.FileSystem;
 import org.apache.hadoop.fs.FsServerDefaults;
@@ -61,6 +71,7 @@
 import org.apache.hadoop.hdfs.security.token.block.InvalidBlockTokenException;
 import org.apache.hadoop.hdfs.security.token.delegation.DelegationTokenIdentifier;
 import org.apache.hadoop.hdfs.server.namenode.NameNode;
+import org.apache.hadoop.io.IOUtils;
 import org.apache.hadoop.io.Text;
 import org.apache.hadoop.security.AccessControlException;
 import org.apache.hadoop.security.token.SecretManager.InvalidToken;
@@ -327,6 +338,126 @@ public void concat(Path trg, Path [] psrcs) throws IOException {
     dfs.concat(getPathName(trg), srcs);
   }
 
+  /**
+   * THIS IS DFS only operations, it is not part of FileSystem
+   * Copy a file to another path in this filesystem.  The file is split
+   * into runs of whole blocks, which up to
+   * {@link DFSConfigKeys#DFS_CLIENT_COPY_STREAMS_KEY} streams copy at once,
+   * each into its own file; the pieces are then joined with
+   * {@link #concat(Path, Path[])}.  The copy keeps the block size and
+   * replication of src.
+   * @param src file to copy
+   * @param dst the new file, or an existing directory to copy src into
+   * @return false, copying nothing, if src is a directory
+   * @throws IOException if dst already exists, or the copy failed
+   */
+  public boolean copyFile(Path src, Path dst) throws IOException {
+    dst = makeQualified(dst);
+    final FileStatus srcStatus = getFileStatus(src);
+    if (srcStatus.isDirectory()) {
+      return false;
+    }
+    if (exists(dst) && getFileStatus(dst).isDirectory()) {
+      dst = new Path(dst, src.getName());
+    }
+    if (exists(dst)) {
+      throw new IOException("Target " + dst + " already exists");
+    }
+    final long blockSize = srcStatus.getBlockSize();
+    long numBlocks = (srcStatus.getLen() + blockSize - 1) / blockSize;
+    int maxStreams = Math.max(1, getConf().getInt(
+        DFSConfigKeys.DFS_CLIENT_COPY_STREAMS_KEY,
+        DFSConfigKeys.DFS_CLIENT_COPY_STREAMS_DEFAULT));
+    // concat needs every piece but the last to end on a block boundary
+    long blocksPerPart =
+        Math.max(1, (numBlocks + maxStreams - 1) / maxStreams);
+    int numParts = (int)Math.max(1,
+        (numBlocks + blocksPerPart - 1) / blocksPerPart);
+    final Path[] parts = new Path[numParts];
+    parts[0] = dst;
+    for (int i = 1; i < numParts; i++) {
+      parts[i] = new Path(dst.getParent(),
+          "." + dst.getName() + "._COPYING_." + i);
+    }
+    ExecutorService pool = Executors.newFixedThreadPool(numParts);
+    boolean success = false;
+    try {
+      List<Future<Void>> copies = new ArrayList<Future<Void>>(numParts);
+      for (int i = 0; i < numParts; i++) {
+        final Path part = parts[i];
+        final long start = i * blocksPerPart * blockSize;
+        final long end = Math.min(srcStatus.getLen(),
+            start + blocksPerPart * blockSize);
+        copies.add(pool.submit(new Callable<Void>() {
+          @Override
+          public Void call() throws IOException {
+            copyRange(srcStatus, part, start, end);
+            return null;
+          }
+        }));
+      }
+      for (Future<Void> copy : copies) {
+        try {
+          copy.get();
+        } catch (ExecutionException e) {
+          if (e.getCause() instanceof IOException) {
+            throw (IOException)e.getCause();
+          }
+          throw new IOException(e.getCause());
+        }
+      }
+      if (numParts > 1) {
+        concat(dst, Arrays.copyOfRange(parts, 1, numParts));
+      }
+      success = true;
+    } catch (InterruptedException e) {
+      throw new InterruptedIOException("Interrupted copying " + src);
+    } finally {
+      pool.shutdownNow();
+      if (!success) {
+        for (Path part : parts) {
+          try {
+            delete(part, false);
+          } catch (IOException e) {
+            // best effort
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /** Copy bytes [start, end) of a file to a new file. */
+  private void copyRange(FileStatus srcStatus, Path dst, long start,
+      long end) throws IOException {
+    int bufferSize = getConf().getInt(
+        CommonConfigurationKeysPublic.IO_FILE_BUFFER_SIZE_KEY,
+        CommonConfigurationKeysPublic.IO_FILE_BUFFER_SIZE_DEFAULT);
+    FSDataInputStream in = null;
+    FSDataOutputStream out = null;
+    try {
+      in = open(srcStatus.getPath(), bufferSize);
+      out = create(dst, false, bufferSize, srcStatus.getReplication(),
+          srcStatus.getBlockSize());
+      in.seek(start);
+      byte[] buf = new byte[bufferSize];
+      for (long pos = start; pos < end; ) {
+        int n = in.read(buf, 0, (int)Math.min(buf.length, end - pos));
+        if (n < 0) {
+          throw new EOFException(srcStatus.getPath() +
+              " ended at " + pos + " while copying it");
+        }
+        out.write(buf, 0, n);
+        pos += n;
+      }
+      out.close();
+      out = null;
+    } finally {
+      IOUtils.closeStream(out);
+      IOUtils.closeStream(in);
+    }
+  }
+
   
   @SuppressWarnings("deprecation")
   @Override
@@ -508,6 +639,59 @@ public LocatedFileStatus next() throws IOException {
     };
   }
   
+  /**
+   * List the entries of a directory one partial listing at a time, so
+   * only one batch from the NameNode is held in memory.
+   *
+   * As with {@link #listStatus(Path)}, this is not atomic for a large
+   * directory.
+   */
+  @Override
+  public RemoteIterator<FileStatus> listStatusIterator(final Path p)
+  throws IOException {
+    return new RemoteIterator<FileStatus>() {
+      private DirectoryListing thisListing;
+      private int i;
+      private String src;
+
+      { // initializer
+        src = getPathName(p);
+        // fetch the first batch of entries in the directory
+        thisListing = dfs.listPaths(src, HdfsFileStatus.EMPTY_NAME);
+        statistics.incrementReadOps(1);
+        if (thisListing == null) { // the directory does not exist
+          throw new FileNotFoundException("File " + p + " does not exist.");
+        }
+      }
+
+      @Override
+      public boolean hasNext() throws IOException {
+        if (thisListing == null) {
+          return false;
+        }
+        if (i>=thisListing.getPartialListing().length
+            && thisListing.hasMore()) {
+          // current listing is exhausted & fetch a new listing
+          thisListing = dfs.listPaths(src, thisListing.getLastName());
+          statistics.incrementReadOps(1);
+          if (thisListing == null) {
+            return false;
+          }
+          i = 0;
+        }
+        return (i<thisListing.getPartialListing().length);
+      }
+
+      @Override
+      public FileStatus next() throws IOException {
+        if (hasNext()) {
+          return makeQualified(thisListing.getPartialListing()[i++], p);
+        }
+        throw new java.util.NoSuchElementException("No more entry in " + p);
+      }
+    };
+  }
+
   /**
    * Create a directory with given name and permission, only when
    * parent directory exists.
@@ -553,6 +737,14 @@ public String toString() {
   public DFSClient getClient() {
     return dfs;
   }        
+
+  /**
+   * Get statistics about the reads which all the streams opened through
+   * this file system have done so far.
+   */
+  public DFSInputStream.ReadStatistics getReadStatistics() {
+    return dfs.getReadStatistics();
+  }
   
   @Override
   public FsStatus getStatus(Path p) throws IOException {
@@ -18,6 +18,7 @@
 package org.apache.hadoop.hdfs.client;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.List;
 
 import org.apache.hadoop.classification.InterfaceAudience;
@@ -68,4 +69,32 @@ public synchronized List<LocatedBlock> getAllBlocks() throws IOException {
   public long getVisibleLength() throws IOException {
     return ((DFSInputStream) in).getFileLength();
   }
+
+  /**
+   * Get statistics about the reads which this stream has done so far.
+   */
+  public DFSInputStream.ReadStatistics getReadStatistics() {
+    return ((DFSInputStream) in).getReadStatistics();
+  }
+
+  /**
+   * Find the block holding a position of the file, and where it can be read
+   * from local disk, if it can.
+   *
+   * @see DFSInputStream#getLocalBlock(long)
+   */
+  public DFSInputStream.LocalBlock getLocalBlock(long offset)
+      throws IOException {
+    return ((DFSInputStream) in).getLocalBlock(offset);
+  }
+
+  /**
+   * Positional read from another replica than a plain positional read
+   * would use, to hedge a slow read.
+   *
+   * @see DFSInputStream#hedgedRead(long, ByteBuffer)
+   */
+  public int hedgedRead(long position, ByteBuffer buf) throws IOException {
+    return ((DFSInputStream) in).hedgedRead(position, buf);
+  }
 }
@@ -0,0 +1,351 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fuse_attr_cache.h"
+#include "util/tree.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum attrEntryKind {
+  ATTR_ENTRY_STAT,
+  ATTR_ENTRY_DIR,
+};
+
+struct attrEntry {
+  RB_ENTRY(attrEntry) link;
+  /** Neighbours in the list from gAttrHead; prev was added earlier */
+  struct attrEntry *prev, *next;
+  /** CLOCK_MONOTONIC time, in nanoseconds, after which this is stale */
+  uint64_t expiry;
+  enum attrEntryKind kind;
+  /** For ATTR_ENTRY_STAT: whether the path exists, and its attributes */
+  int exists;
+  struct stat st;
+  /** For ATTR_ENTRY_DIR: the listing */
+  struct fuseDirList *list;
+  /** Points into the same allocation */
+  const char *path;
+};
+
+static int attrEntryCompare(const struct attrEntry *a,
+                            const struct attrEntry *b)
+{
+  if (a->kind != b->kind) {
+    return (a->kind < b->kind) ? -1 : 1;
+  }
+  return strcmp(a->path, b->path);
+}
+
+RB_HEAD(attrEntries, attrEntry);
+RB_GENERATE(attrEntries, attrEntry, link, attrEntryCompare);
+
+static pthread_mutex_t gAttrLock = PTHREAD_MUTEX_INITIALIZER;
+static struct attrEntries gAttrTree = RB_INITIALIZER(&gAttrTree);
+/** All entries, oldest first */
+static struct attrEntry *gAttrHead, *gAttrTail;
+static int gAttrNumEntries;
+/** The number of entries in all the cached listings */
+static int gAttrNumDirents;
+/** Incremented by every invalidation */
+static uint64_t gAttrGeneration;
+/** Set once by fuseAttrCacheInit; 0 means the cache is disabled */
+static uint64_t gAttrTtlNs;
+
+static uint64_t monotonicNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct attrEntry *findEntry(enum attrEntryKind kind, const char *path)
+{
+  struct attrEntry key;
+
+  key.kind = kind;
+  key.path = path;
+  return RB_FIND(attrEntries, &gAttrTree, &key);
+}
+
+static void removeEntry(struct attrEntry *entry)
+{
+  RB_REMOVE(attrEntries, &gAttrTree, entry);
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    gAttrHead = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    gAttrTail = entry->prev;
+  }
+  gAttrNumEntries--;
+  if (entry->list) {
+    gAttrNumDirents -= entry->list->numEntries;
+    free(entry->list);
+  }
+  free(entry);
+}
+
+static void removeEntryIfPresent(enum attrEntryKind kind, const char *path)
+{
+  struct attrEntry *entry = findEntry(kind, path);
+
+  if (entry) {
+    removeEntry(entry);
+  }
+}
+
+/**
+ * Drop the entries that have expired.  Entries are added in expiry
+ * order, so this stops at the first live one.
+ */
+static void trimExpired(uint64_t now)
+{
+  while (gAttrHead && gAttrHead->expiry <= now) {
+    removeEntry(gAttrHead);
+  }
+}
+
+static struct attrEntry *newEntry(enum attrEntryKind kind, const char *path)
+{
+  struct attrEntry *entry;
+  size_t len = strlen(path) + 1;
+
+  entry = calloc(1, sizeof(*entry) + len);
+  if (!entry) {
+    return NULL;
+  }
+  memcpy(entry + 1, path, len);
+  entry->path = (const char *)(entry + 1);
+  entry->kind = kind;
+  return entry;
+}
+
+/**
+ * Add an entry, replacing any other for the same path, unless there has
+ * been an invalidation since generation was taken.  Takes ownership of
+ * the entry.
+ */
+static void addEntry(struct attrEntry *entry, uint64_t generation)
+{
+  uint64_t now = monotonicNs();
+  int numDirents = entry->list ? entry->list->numEntries : 0;
+
+  pthread_mutex_lock(&gAttrLock);
+  if (gAttrGeneration != generation) {
+    pthread_mutex_unlock(&gAttrLock);
+    free(entry->list);
+    free(entry);
+    return;
+  }
+  trimExpired(now);
+  entry->expiry = now + gAttrTtlNs;
+  removeEntryIfPresent(entry->kind, entry->path);
+  while (gAttrNumEntries >= FUSE_ATTR_CACHE_MAX_ENTRIES ||
+         (numDirents && gAttrNumDirents + numDirents >
+                        FUSE_ATTR_CACHE_MAX_TOTAL_DIRENTS && gAttrHead)) {
+    removeEntry(gAttrHead);
+  }
+  RB_INSERT(attrEntries, &gAttrTree, entry);
+  entry->prev = gAttrTail;
+  entry->next = NULL;
+  if (gAttrTail) {
+    gAttrTail->next = entry;
+  } else {
+    gAttrHead = entry;
+  }
+  gAttrTail = entry;
+  gAttrNumEntries++;
+  gAttrNumDirents += numDirents;
+  pthread_mutex_unlock(&gAttrLock);
+}
+
+void fuseAttrCacheInit(int ttlSecs)
+{
+  gAttrTtlNs = (ttlSecs > 0) ? (uint64_t)ttlSecs * 1000000000ULL : 0;
+}
+
+int fuseAttrCacheGet(const char *path, struct stat *st)
+{
+  struct attrEntry *entry;
+  int ret = -1;
+
+  if (!gAttrTtlNs) {
+    return -1;
+  }
+  pthread_mutex_lock(&gAttrLock);
+  trimExpired(monotonicNs());
+  entry = findEntry(ATTR_ENTRY_STAT, path);
+  if (entry) {
+    if (entry->exists) {
+      *st = entry->st;
+    }
+    ret = entry->exists;
+  }
+  pthread_mutex_unlock(&gAttrLock);
+  return ret;
+}
+
+struct fuseDirList *fuseAttrCacheGetDir(const char *path)
+{
+  struct attrEntry *entry;
+  struct fuseDirList *list = NULL;
+
+  if (!gAttrTtlNs) {
+    return NULL;
+  }
+  pthread_mutex_lock(&gAttrLock);
+  trimExpired(monotonicNs());
+  entry = findEntry(ATTR_ENTRY_DIR, path);
+  if (entry) {
+    list = fuseDirListDup(entry->list);
+  }
+  pthread_mutex_unlock(&gAttrLock);
+  return list;
+}
+
+uint64_t fuseAttrCacheGeneration(void)
+{
+  uint64_t generation;
+
+  pthread_mutex_lock(&gAttrLock);
+  generation = gAttrGeneration;
+  pthread_mutex_unlock(&gAttrLock);
+  return generation;
+}
+
+void fuseAttrCachePut(const char *path, const struct stat *st,
+                      uint64_t generation)
+{
+  struct attrEntry *entry;
+
+  if (!gAttrTtlNs) {
+    return;
+  }
+  // Allocate outside the lock; addEntry frees it if it is not needed
+  entry = newEntry(ATTR_ENTRY_STAT, path);
+  if (!entry) {
+    return;
+  }
+  if (st) {
+    entry->exists = 1;
+    entry->st = *st;
+  }
+  addEntry(entry, generation);
+}
+
+void fuseAttrCachePutDir(const char *path, const struct fuseDirList *list,
+                         uint64_t generation)
+{
+  struct attrEntry *entry;
+
+  if (!gAttrTtlNs || list->numEntries > FUSE_ATTR_CACHE_MAX_DIRENTS) {
+    return;
+  }
+  entry = newEntry(ATTR_ENTRY_DIR, path);
+  if (!entry) {
+    return;
+  }
+  entry->list = fuseDirListDup(list);
+  if (!entry->list) {
+    free(entry);
+    return;
+  }
+  addEntry(entry, generation);
+}
+
+struct fuseDirList *fuseDirListDup(const struct fuseDirList *list)
+{
+  struct fuseDirList *copy;
+  int i;
+
+  copy = malloc(list->size);
+  if (!copy) {
+    return NULL;
+  }
+  memcpy(copy, list, list->size);
+  for (i = 0; i < list->numEntries; i++) {
+    copy->entries[i].name = (const char *)copy +
+        (list->entries[i].name - (const char *)list);
+  }
+  return copy;
+}
+
+void fuseAttrCacheInvalidate(const char *path)
+{
+  static const enum attrEntryKind kinds[] = { ATTR_ENTRY_STAT, ATTR_ENTRY_DIR };
+  struct attrEntry key, *entry, *next;
+  char *prefix;
+  size_t len, parentLen;
+  int k;
+
+  if (!gAttrTtlNs) {
+    return;
+  }
+  len = strlen(path);
+  while (len > 1 && path[len - 1] == '/') {
+    len--;
+  }
+  prefix = malloc(len + 2);
+  pthread_mutex_lock(&gAttrLock);
+  gAttrGeneration++;
+  if (!prefix || len <= 1) {
+    // The root, or no memory to do better: forget everything
+    while (gAttrHead) {
+      removeEntry(gAttrHead);
+    }
+    goto done;
+  }
+  parentLen = len;
+  while (parentLen > 1 && path[parentLen - 1] != '/') {
+    parentLen--;
+  }
+  if (parentLen > 1) {
+    parentLen--;
+  }
+  for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    // Everything beneath the path sorts just after path + "/"
+    memcpy(prefix, path, len);
+    prefix[len] = '/';
+    prefix[len + 1] = '\0';
+    key.kind = kinds[k];
+    key.path = prefix;
+    for (entry = RB_NFIND(attrEntries, &gAttrTree, &key); entry;
+         entry = next) {
+      if (entry->kind != kinds[k] || strncmp(entry->path, prefix, len + 1)) {
+        break;
+      }
+      next = RB_NEXT(attrEntries, &gAttrTree, entry);
+      removeEntry(entry);
+    }
+    // The path itself, then its parent
+    prefix[len] = '\0';
+    removeEntryIfPresent(kinds[k], prefix);
+    prefix[parentLen] = '\0';
+    removeEntryIfPresent(kinds[k], prefix);
+  }
+done:
+  pthread_mutex_unlock(&gAttrLock);
+  free(prefix);
+}
@@ -0,0 +1,145 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FUSE_ATTR_CACHE_H__
+#define __FUSE_ATTR_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * A cache of the attributes getattr returns and the listings readdir
+ * returns, keyed by path.
+ *
+ * HDFS metadata does not depend on who asks, so one cache serves every
+ * user of the mount.  readdir fills in the attributes of each entry it
+ * lists, which lets the getattr calls that follow a listing (ls -l, find,
+ * rsync) skip the NameNode, and paths found not to exist are remembered
+ * too, for the tools that probe search paths.  Changes made through this
+ * mount invalidate what they affect; changes made by other clients are
+ * seen once the entries expire.
+ */
+
+/** The most entries kept.  The oldest are dropped to make room. */
+#define FUSE_ATTR_CACHE_MAX_ENTRIES 65536
+
+/** The largest directory whose listing is kept */
+#define FUSE_ATTR_CACHE_MAX_DIRENTS 4096
+
+/** The most entries kept across all listings */
+#define FUSE_ATTR_CACHE_MAX_TOTAL_DIRENTS (64 * FUSE_ATTR_CACHE_MAX_DIRENTS)
+
+struct fuseDirent {
+  /** The final path component.  Points into the owning fuseDirList. */
+  const char *name;
+  struct stat st;
+};
+
+/**
+ * A directory listing, in a single allocation that free releases.
+ */
+struct fuseDirList {
+  /** Bytes allocated, including the names that follow the entries */
+  size_t size;
+  int numEntries;
+  struct fuseDirent entries[];
+};
+
+/**
+ * Set how long entries stay valid.
+ *
+ * @param ttlSecs       The time to live in seconds.  0 or less disables
+ *                      the cache.
+ */
+void fuseAttrCacheInit(int ttlSecs);
+
+/**
+ * Look up the attributes of a path.
+ *
+ * @param path          The absolute path.
+ * @param st            (out param) The attributes, if they are cached.
+ *
+ * @return              1 if the attributes were cached; 0 if the path was
+ *                      found not to exist; -1 if nothing valid is cached.
+ */
+int fuseAttrCacheGet(const char *path, struct stat *st);
+
+/**
+ * Look up the listing of a directory.
+ *
+ * @param path          The absolute path of the directory.
+ *
+ * @return              A copy of the listing, to be released with free;
+ *                      NULL if nothing valid is cached.
+ */
+struct fuseDirList *fuseAttrCacheGetDir(const char *path);
+
+/**
+ * Get the number of invalidations so far.  Take it before asking HDFS,
+ * and pass it to fuseAttrCachePut or fuseAttrCachePutDir with the answer.
+ *
+ * @return              The invalidation count.
+ */
+uint64_t fuseAttrCacheGeneration(void);
+
+/**
+ * Record the attributes of a path.  Does nothing if the cache is disabled,
+ * or if anything was invalidated since generation was taken, as the
+ * attributes may then be out of date.
+ *
+ * @param path          The absolute path.
+ * @param st            The attributes, or NULL if the path does not exist.
+ * @param generation    What fuseAttrCacheGeneration returned before HDFS
+ *                      was asked.
+ */
+void fuseAttrCachePut(const char *path, const struct stat *st,
+                      uint64_t generation);
+
+/**
+ * Record the listing of a directory, as fuseAttrCachePut does for
+ * attributes.  Listings longer than FUSE_ATTR_CACHE_MAX_DIRENTS are not
+ * kept.
+ *
+ * @param path          The absolute path of the directory.
+ * @param list          The listing.  The cache keeps a copy.
+ * @param generation    What fuseAttrCacheGeneration returned before HDFS
+ *                      was asked.
+ */
+void fuseAttrCachePutDir(const char *path, const struct fuseDirList *list,
+                         uint64_t generation);
+
+/**
+ * Copy a directory listing.
+ *
+ * @param list          The listing.
+ *
+ * @return              The copy, to be released with free; NULL on OOM.
+ */
+struct fuseDirList *fuseDirListDup(const struct fuseDirList *list);
+
+/**
+ * Forget what is cached about a path that has been changed, about its
+ * parent directory, whose listing and times change with it, and about
+ * everything beneath it.
+ *
+ * @param path          The absolute path.
+ */
+void fuseAttrCacheInvalidate(const char *path);
+
+#endif
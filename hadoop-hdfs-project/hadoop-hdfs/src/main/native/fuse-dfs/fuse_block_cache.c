@@ -0,0 +1,219 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fuse_block_cache.h"
+#include "util/tree.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fuseBlock {
+  RB_ENTRY(fuseBlock) link;
+  /** Neighbours in the LRU list; prev was used less recently */
+  struct fuseBlock *prev, *next;
+  /** References held by readers; a cached block holds one more */
+  int refs;
+  time_t mtime;
+  int64_t index;
+  size_t len;
+  char *data;
+  /** Points into the same allocation */
+  const char *path;
+};
+
+static int fuseBlockCompare(const struct fuseBlock *a,
+                            const struct fuseBlock *b)
+{
+  int ret = strcmp(a->path, b->path);
+
+  if (ret) {
+    return ret;
+  }
+  if (a->mtime != b->mtime) {
+    return (a->mtime < b->mtime) ? -1 : 1;
+  }
+  if (a->index != b->index) {
+    return (a->index < b->index) ? -1 : 1;
+  }
+  return 0;
+}
+
+RB_HEAD(fuseBlocks, fuseBlock);
+RB_GENERATE(fuseBlocks, fuseBlock, link, fuseBlockCompare);
+
+static pthread_mutex_t gBlockLock = PTHREAD_MUTEX_INITIALIZER;
+static struct fuseBlocks gBlockTree = RB_INITIALIZER(&gBlockTree);
+/** Cached blocks, least recently used first */
+static struct fuseBlock *gBlockHead, *gBlockTail;
+/** Set once by fuseBlockCacheInit */
+static size_t gBlockCapacity;
+static struct fuseBlockCacheStats gBlockStats;
+
+static void freeBlock(struct fuseBlock *block)
+{
+  free(block->data);
+  free(block);
+}
+
+static void unlinkBlock(struct fuseBlock *block)
+{
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    gBlockHead = block->next;
+  }
+  if (block->next) {
+    block->next->prev = block->prev;
+  } else {
+    gBlockTail = block->prev;
+  }
+  block->prev = block->next = NULL;
+}
+
+static void appendBlock(struct fuseBlock *block)
+{
+  block->prev = gBlockTail;
+  block->next = NULL;
+  if (gBlockTail) {
+    gBlockTail->next = block;
+  } else {
+    gBlockHead = block;
+  }
+  gBlockTail = block;
+}
+
+/**
+ * Take a block out of the cache.  It is freed once the readers using it
+ * are done.
+ *
+ * Called with gBlockLock held.
+ */
+static void evictBlock(struct fuseBlock *block)
+{
+  RB_REMOVE(fuseBlocks, &gBlockTree, block);
+  unlinkBlock(block);
+  gBlockStats.size -= FUSE_BLOCK_CACHE_BLOCK_SIZE;
+  gBlockStats.evictions++;
+  if (--block->refs == 0) {
+    freeBlock(block);
+  }
+}
+
+void fuseBlockCacheInit(size_t capacity)
+{
+  gBlockCapacity = capacity;
+  gBlockStats.capacity = capacity;
+}
+
+int fuseBlockCacheEnabled(void)
+{
+  return gBlockCapacity >= FUSE_BLOCK_CACHE_BLOCK_SIZE;
+}
+
+struct fuseBlock *fuseBlockCacheGet(const char *path, time_t mtime,
+                                    int64_t index)
+{
+  struct fuseBlock key, *block;
+
+  key.path = path;
+  key.mtime = mtime;
+  key.index = index;
+  pthread_mutex_lock(&gBlockLock);
+  block = RB_FIND(fuseBlocks, &gBlockTree, &key);
+  if (block) {
+    block->refs++;
+    unlinkBlock(block);
+    appendBlock(block);
+    gBlockStats.hits++;
+  } else {
+    gBlockStats.misses++;
+  }
+  pthread_mutex_unlock(&gBlockLock);
+  return block;
+}
+
+struct fuseBlock *fuseBlockAlloc(const char *path, time_t mtime,
+                                 int64_t index)
+{
+  struct fuseBlock *block;
+  size_t len = strlen(path) + 1;
+
+  block = calloc(1, sizeof(*block) + len);
+  if (!block) {
+    return NULL;
+  }
+  block->data = malloc(FUSE_BLOCK_CACHE_BLOCK_SIZE);
+  if (!block->data) {
+    free(block);
+    return NULL;
+  }
+  memcpy(block + 1, path, len);
+  block->path = (const char *)(block + 1);
+  block->mtime = mtime;
+  block->index = index;
+  block->refs = 1;
+  return block;
+}
+
+void fuseBlockCacheInsert(struct fuseBlock *block, size_t len)
+{
+  block->len = len;
+  if (len != FUSE_BLOCK_CACHE_BLOCK_SIZE || !fuseBlockCacheEnabled()) {
+    return;
+  }
+  pthread_mutex_lock(&gBlockLock);
+  if (RB_INSERT(fuseBlocks, &gBlockTree, block) == NULL) {
+    block->refs++;
+    appendBlock(block);
+    gBlockStats.size += FUSE_BLOCK_CACHE_BLOCK_SIZE;
+    while (gBlockStats.size > gBlockCapacity) {
+      evictBlock(gBlockHead);
+    }
+  }
+  pthread_mutex_unlock(&gBlockLock);
+}
+
+char *fuseBlockData(struct fuseBlock *block)
+{
+  return block->data;
+}
+
+size_t fuseBlockLen(const struct fuseBlock *block)
+{
+  return block->len;
+}
+
+void fuseBlockRelease(struct fuseBlock *block)
+{
+  int refs;
+
+  pthread_mutex_lock(&gBlockLock);
+  refs = --block->refs;
+  pthread_mutex_unlock(&gBlockLock);
+  if (refs == 0) {
+    freeBlock(block);
+  }
+}
+
+void fuseBlockCacheGetStats(struct fuseBlockCacheStats *stats)
+{
+  pthread_mutex_lock(&gBlockLock);
+  *stats = gBlockStats;
+  pthread_mutex_unlock(&gBlockLock);
+}
@@ -0,0 +1,118 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FUSE_BLOCK_CACHE_H__
+#define __FUSE_BLOCK_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * A cache of file data shared by every open file of the mount.
+ *
+ * Data is kept in blocks of FUSE_BLOCK_CACHE_BLOCK_SIZE bytes, keyed by
+ * path, modification time and block index, so that a file that has been
+ * replaced or appended to is not served from the old blocks.  Only full
+ * blocks are cached; the tail of a file may still be growing.  When the
+ * cache is over its capacity the least recently used blocks are dropped.
+ */
+
+#define FUSE_BLOCK_CACHE_BLOCK_SIZE (1024 * 1024)
+
+struct fuseBlock;
+
+struct fuseBlockCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  /** Bytes held by cached blocks */
+  size_t size;
+  size_t capacity;
+};
+
+/**
+ * Set how much data the cache may hold.
+ *
+ * @param capacity      The capacity in bytes.  0 disables the cache.
+ */
+void fuseBlockCacheInit(size_t capacity);
+
+/**
+ * @return              Nonzero if the cache is enabled.
+ */
+int fuseBlockCacheEnabled(void);
+
+/**
+ * Look up a block, counting a hit or a miss.
+ *
+ * @param path          The path of the file.
+ * @param mtime         The modification time of the file.
+ * @param index         The block index: the file offset divided by
+ *                      FUSE_BLOCK_CACHE_BLOCK_SIZE.
+ *
+ * @return              The block, to be released with fuseBlockRelease;
+ *                      NULL if it is not cached.
+ */
+struct fuseBlock *fuseBlockCacheGet(const char *path, time_t mtime,
+                                    int64_t index);
+
+/**
+ * Allocate a block for the caller to fill with fuseBlockData, and then to
+ * offer to the cache with fuseBlockCacheInsert.
+ *
+ * @return              The block, to be released with fuseBlockRelease;
+ *                      NULL on OOM.
+ */
+struct fuseBlock *fuseBlockAlloc(const char *path, time_t mtime,
+                                 int64_t index);
+
+/**
+ * Offer a filled block to the cache.  Blocks that are not full, and blocks
+ * another reader has cached in the meantime, are not kept.  The caller's
+ * reference stays valid either way.
+ *
+ * @param block         A block from fuseBlockAlloc.
+ * @param len           How many bytes of it were filled.
+ */
+void fuseBlockCacheInsert(struct fuseBlock *block, size_t len);
+
+/**
+ * @return              The data of a block: FUSE_BLOCK_CACHE_BLOCK_SIZE
+ *                      bytes, of which fuseBlockLen are valid.
+ */
+char *fuseBlockData(struct fuseBlock *block);
+
+/**
+ * @return              How many bytes of a block are valid.
+ */
+size_t fuseBlockLen(const struct fuseBlock *block);
+
+/**
+ * Drop a reference to a block.
+ */
+void fuseBlockRelease(struct fuseBlock *block);
+
+/**
+ * Get the counters of the cache.
+ *
+ * @param stats         (out param) The counters.
+ */
+void fuseBlockCacheGetStats(struct fuseBlockCacheStats *stats);
+
+#endif
@@ -34,18 +34,28 @@
 
 #define FUSE_CONN_DEFAULT_TIMER_PERIOD      5
 #define FUSE_CONN_DEFAULT_EXPIRY_PERIOD     (5 * 60)
+#define FUSE_CONN_DEFAULT_PER_USER          1
 #define HADOOP_SECURITY_AUTHENTICATION      "hadoop.security.authentication"
 #define HADOOP_FUSE_CONNECTION_TIMEOUT      "hadoop.fuse.connection.timeout"
 #define HADOOP_FUSE_TIMER_PERIOD            "hadoop.fuse.timer.period"
+#define HADOOP_FUSE_CONNECTIONS_PER_USER    "hadoop.fuse.connections.per.user"
 
 /** Length of the buffer needed by asctime_r */
 #define TIME_STR_LEN 26
 
+/** Number of independently locked parts of the connection cache */
+#define FUSE_CONN_SHARDS 16
+
+/** Usernames each FUSE thread remembers, and for how long, in seconds */
+#define FUSE_USER_CACHE_SIZE 8
+#define FUSE_USER_CACHE_TTL 60
+
 struct hdfsConn;
 
 static int hdfsConnCompare(const struct hdfsConn *a, const struct hdfsConn *b);
 static void hdfsConnExpiry(void);
 static void* hdfsConnExpiryThread(void *v);
+static time_t getMonotonicTime(void);
 
 RB_HEAD(hdfsConnTree, hdfsConn);
 
@@ -61,6 +71,8 @@ struct hdfsConn {
   int64_t refcnt;
   /** The username used to make this connection.  Dynamically allocated. */
   char *usrname;
+  /** Which of the user's connections this is, from 0 to gConnsPerUser - 1 */
+  int slot;
   /** Kerberos ticket cache path, or NULL if this is not a kerberized
    * connection.  Dynamically allocated. */
   char *kpath;
@@ -73,15 +85,57 @@ struct hdfsConn {
   /** Nonzero if this hdfs connection needs to be closed as soon as possible.
    * If this is true, the connection has been removed from the tree. */
   int condemned;
-  /** Number of times we should run the expiration timer on this connection
-   * before removing it. */
-  int expirationCount;
+  /** Monotonic time at which refcnt last dropped to 0 */
+  time_t idleSince;
+  /** Neighbours in the shard's idle list, while refcnt is 0 */
+  struct hdfsConn *idlePrev, *idleNext;
+  /** The part of the cache this connection belongs to */
+  struct hdfsConnShard *shard;
 };
 
 RB_GENERATE(hdfsConnTree, hdfsConn, entry, hdfsConnCompare);
 
-/** Current cached libhdfs connections */
-static struct hdfsConnTree gConnTree;
+/**
+ * Part of the connection cache.  Connections are spread over the shards by
+ * username, so that FUSE threads acting for different users do not contend
+ * on one lock.
+ */
+struct hdfsConnShard {
+  /** Lock which protects tree, and the refcnt and condemned fields of the
+   * connections that belong to this shard */
+  pthread_mutex_t mutex;
+  /** Current cached libhdfs connections */
+  struct hdfsConnTree tree;
+  /** The connections in tree that no thread is using, least recently used
+   * first.  Connections are appended as they become idle, so this is also
+   * the order in which they expire. */
+  struct hdfsConn *idleHead, *idleTail;
+  /** Connections removed from tree because they were too old or their
+   * Kerberos ticket cache changed */
+  uint64_t expired;
+};
+
+static struct hdfsConnShard gConnShards[FUSE_CONN_SHARDS];
+
+/** A username remembered by a FUSE thread */
+struct fuseUserCacheEntry {
+  uid_t uid;
+  /** Dynamically allocated; NULL if the entry is unused */
+  char *usrname;
+  /** Monotonic time after which the entry must be looked up again */
+  time_t expiry;
+};
+
+/** The usernames a FUSE thread remembers */
+struct fuseUserCache {
+  struct fuseUserCacheEntry entries[FUSE_USER_CACHE_SIZE];
+  /** The entry to replace next */
+  int next;
+};
+
+static pthread_once_t gUserCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gUserCacheKey;
+static int gUserCacheKeyErr;
 
 /** The URI used to make our connections.  Dynamically allocated. */
 static char *gUri;
@@ -89,9 +143,6 @@ static char *gUri;
 /** The port used to make our connections, or 0. */
 static int gPort;
 
-/** Lock which protects gConnTree and gConnectTimer->active */
-static pthread_mutex_t gConnMutex;
-
 /** Type of authentication configured */
 static enum authConf gHdfsAuthConf;
 
@@ -101,6 +152,9 @@ static int32_t gTimerPeriod;
 /** FUSE connection expiry period */
 static int32_t gExpiryPeriod;
 
+/** The most connections made for one user */
+static int32_t gConnsPerUser;
+
 /** FUSE timer expiration thread */
 static pthread_t gTimerThread;
 
@@ -132,7 +186,7 @@ static enum authConf discoverAuthConf(void)
 int fuseConnectInit(const char *nnUri, int port)
 {
   const char *timerPeriod;
-  int ret;
+  int i, ret;
 
   gTimerPeriod = FUSE_CONN_DEFAULT_TIMER_PERIOD;
   ret = hdfsConfGetInt(HADOOP_FUSE_TIMER_PERIOD, &gTimerPeriod);
@@ -158,6 +212,18 @@ int fuseConnectInit(const char *nnUri, int port)
           gExpiryPeriod, HADOOP_FUSE_CONNECTION_TIMEOUT);
     return -EINVAL;
   }
+  gConnsPerUser = FUSE_CONN_DEFAULT_PER_USER;
+  ret = hdfsConfGetInt(HADOOP_FUSE_CONNECTIONS_PER_USER, &gConnsPerUser);
+  if (ret) {
+    fprintf(stderr, "Unable to determine the configured value for %s.",
+          HADOOP_FUSE_CONNECTIONS_PER_USER);
+    return -EINVAL;
+  }
+  if (gConnsPerUser < 1) {
+    fprintf(stderr, "Invalid value %d given for %s.\n",
+          gConnsPerUser, HADOOP_FUSE_CONNECTIONS_PER_USER);
+    return -EINVAL;
+  }
   gHdfsAuthConf = discoverAuthConf();
   if (gHdfsAuthConf == AUTH_CONF_UNKNOWN) {
     fprintf(stderr, "Unable to determine the configured value for %s.",
@@ -170,29 +236,37 @@ int fuseConnectInit(const char *nnUri, int port)
     fprintf(stderr, "fuseConnectInit: OOM allocting nnUri\n");
     return -ENOMEM;
   }
-  ret = pthread_mutex_init(&gConnMutex, NULL);
-  if (ret) {
-    free(gUri);
-    fprintf(stderr, "fuseConnectInit: pthread_mutex_init failed with error %d\n",
-            ret);
-    return -ret;
+  for (i = 0; i < FUSE_CONN_SHARDS; i++) {
+    ret = pthread_mutex_init(&gConnShards[i].mutex, NULL);
+    if (ret) {
+      while (--i >= 0) {
+        pthread_mutex_destroy(&gConnShards[i].mutex);
+      }
+      free(gUri);
+      fprintf(stderr, "fuseConnectInit: pthread_mutex_init failed with error %d\n",
+              ret);
+      return -ret;
+    }
+    RB_INIT(&gConnShards[i].tree);
   }
-  RB_INIT(&gConnTree);
   ret = pthread_create(&gTimerThread, NULL, hdfsConnExpiryThread, NULL);
   if (ret) {
     free(gUri);
-    pthread_mutex_destroy(&gConnMutex);
+    for (i = 0; i < FUSE_CONN_SHARDS; i++) {
+      pthread_mutex_destroy(&gConnShards[i].mutex);
+    }
     fprintf(stderr, "fuseConnectInit: pthread_create failed with error %d\n",
             ret);
     return -ret;
   }
   fprintf(stderr, "fuseConnectInit: initialized with timer period %d, "
-          "expiry period %d\n", gTimerPeriod, gExpiryPeriod);
+          "expiry period %d, %d connection(s) per user\n", gTimerPeriod,
+          gExpiryPeriod, gConnsPerUser);
   return 0;
 }
 
 /**
- * Compare two libhdfs connections by username
+ * Compare two libhdfs connections by username, then slot
  *
  * @param a                The first libhdfs connection
  * @param b                The second libhdfs connection
@@ -201,23 +275,74 @@ int fuseConnectInit(const char *nnUri, int port)
  */
 static int hdfsConnCompare(const struct hdfsConn *a, const struct hdfsConn *b)
 {
-  return strcmp(a->usrname, b->usrname);
+  int ret = strcmp(a->usrname, b->usrname);
+
+  if (ret) {
+    return ret;
+  }
+  return (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+/**
+ * Find the shard of the connection cache a username belongs to
+ *
+ * @param usrname         The username
+ *
+ * @return                The shard
+ */
+static struct hdfsConnShard *hdfsConnShardFor(const char *usrname)
+{
+  uint32_t hash = 2166136261U;
+
+  // FNV-1a
+  for (; *usrname; usrname++) {
+    hash = (hash ^ (unsigned char)*usrname) * 16777619U;
+  }
+  return &gConnShards[hash % FUSE_CONN_SHARDS];
 }
 
 /**
- * Find a libhdfs connection by username
+ * Pick one of a user's libhdfs connections for a thread to use.
+ *
+ * An idle connection is taken if there is one, the one with the lowest slot,
+ * so that the others go on idling and expire once the load drops.  When all
+ * of them are busy, the user's first free slot is given for a new connection
+ * to be made in, or if there is none, the least busy connection is shared.
  *
+ * @param shard           The shard the username belongs to, locked
  * @param usrname         The username to look up
+ * @param freeSlot        (out param) The slot to make a new connection in,
+ *                        or -1 if the connection returned is to be used
  *
- * @return                The connection, or NULL if none could be found
+ * @return                The connection, or NULL if a new one has to be made
  */
-static struct hdfsConn* hdfsConnFind(const char *usrname)
+static struct hdfsConn* hdfsConnFind(struct hdfsConnShard *shard,
+                                     const char *usrname, int *freeSlot)
 {
-  struct hdfsConn exemplar;
+  struct hdfsConn exemplar, *conn, *best = NULL;
+  int slot = 0;
 
   memset(&exemplar, 0, sizeof(exemplar));
   exemplar.usrname = (char*)usrname;
-  return RB_FIND(hdfsConnTree, &gConnTree, &exemplar);
+  *freeSlot = -1;
+  for (conn = RB_NFIND(hdfsConnTree, &shard->tree, &exemplar);
+       conn && !strcmp(conn->usrname, usrname);
+       conn = RB_NEXT(hdfsConnTree, &shard->tree, conn)) {
+    if (conn->refcnt == 0) {
+      return conn;
+    }
+    if (*freeSlot < 0 && conn->slot != slot) {
+      *freeSlot = slot;
+    }
+    slot = conn->slot + 1;
+    if (!best || conn->refcnt < best->refcnt) {
+      best = conn;
+    }
+  }
+  if (*freeSlot < 0 && slot < gConnsPerUser) {
+    *freeSlot = slot;
+  }
+  return (*freeSlot < 0) ? best : NULL;
 }
 
 /**
@@ -242,6 +367,61 @@ static void hdfsConnFree(struct hdfsConn *conn)
   free(conn);
 }
 
+/**
+ * Append a connection that has just become idle to its shard's idle list.
+ *
+ * @param conn            The connection, whose shard is locked
+ */
+static void hdfsConnIdleAppend(struct hdfsConn *conn)
+{
+  struct hdfsConnShard *shard = conn->shard;
+
+  conn->idleSince = getMonotonicTime();
+  conn->idlePrev = shard->idleTail;
+  conn->idleNext = NULL;
+  if (shard->idleTail) {
+    shard->idleTail->idleNext = conn;
+  } else {
+    shard->idleHead = conn;
+  }
+  shard->idleTail = conn;
+}
+
+/**
+ * Remove a connection from its shard's idle list.
+ *
+ * @param conn            The connection, whose shard is locked
+ */
+static void hdfsConnIdleRemove(struct hdfsConn *conn)
+{
+  struct hdfsConnShard *shard = conn->shard;
+
+  if (conn->idlePrev) {
+    conn->idlePrev->idleNext = conn->idleNext;
+  } else {
+    shard->idleHead = conn->idleNext;
+  }
+  if (conn->idleNext) {
+    conn->idleNext->idlePrev = conn->idlePrev;
+  } else {
+    shard->idleTail = conn->idlePrev;
+  }
+  conn->idlePrev = conn->idleNext = NULL;
+}
+
+/**
+ * Free a list of connections linked through idleNext.
+ */
+static void hdfsConnFreeList(struct hdfsConn *conn)
+{
+  struct hdfsConn *next;
+
+  for (; conn; conn = next) {
+    next = conn->idleNext;
+    hdfsConnFree(conn);
+  }
+}
+
 /**
  * Convert a time_t to a string.
  *
@@ -313,50 +493,122 @@ static int hdfsConnCheckKpath(const struct hdfsConn *conn)
 /**
  * Cache expiration logic.
  *
- * This function is called periodically by the cache expiration thread.  For
- * each FUSE connection not currently in use (refcnt == 0) it will decrement the
- * expirationCount for that connection.  Once the expirationCount reaches 0 for
- * a connection, it can be garbage collected.
+ * This function is called periodically by the cache expiration thread.  A
+ * connection that no thread has used for gExpiryPeriod seconds is garbage
+ * collected.  The idle connections of each shard are kept in the order they
+ * became idle, so only the ones that have expired are looked at.
  *
  * We also check to see if the Kerberos credentials have changed.  If so, the
- * connecton is immediately condemned, even if it is currently in use.
+ * connecton is immediately condemned, even if it is currently in use.  The
+ * ticket caches are stat'ed without the shard lock held, so that FUSE threads
+ * are not held up by them.  This is safe because connections in the tree are
+ * only ever freed by this thread: hdfsConnRelease only frees condemned ones,
+ * and only this thread condemns them.
+ *
+ * Connections are disconnected after the shard lock is dropped as well.
  */
-static void hdfsConnExpiry(void)
+static void hdfsConnExpiryShard(struct hdfsConnShard *shard)
 {
-  struct hdfsConn *conn, *tmpConn;
-
-  pthread_mutex_lock(&gConnMutex);
-  RB_FOREACH_SAFE(conn, hdfsConnTree, &gConnTree, tmpConn) {
-    if (conn->kpath) {
-      if (hdfsConnCheckKpath(conn)) {
-        conn->condemned = 1;
-        RB_REMOVE(hdfsConnTree, &gConnTree, conn);
-        if (conn->refcnt == 0) {
-          /* If the connection is not in use by any threads, delete it
-           * immediately.  If it is still in use by some threads, the last
-           * thread using it will clean it up later inside hdfsConnRelease. */
-          hdfsConnFree(conn);
-          continue;
+  struct hdfsConn *conn, *toFree = NULL, **kconns = NULL, **tmp;
+  size_t numKconns = 0, kconnsCap = 0, i;
+  int *condemn = NULL;
+  time_t now = getMonotonicTime();
+
+  pthread_mutex_lock(&shard->mutex);
+  while ((conn = shard->idleHead) &&
+         conn->idleSince + gExpiryPeriod <= now) {
+    fprintf(stderr, "hdfsConnExpiry: freeing and removing connection as "
+            "%s because it's now too old.\n", conn->usrname);
+    hdfsConnIdleRemove(conn);
+    RB_REMOVE(hdfsConnTree, &shard->tree, conn);
+    shard->expired++;
+    conn->idleNext = toFree;
+    toFree = conn;
+  }
+  if (gHdfsAuthConf == AUTH_CONF_KERBEROS) {
+    RB_FOREACH(conn, hdfsConnTree, &shard->tree) {
+      if (!conn->kpath) {
+        continue;
+      }
+      if (numKconns == kconnsCap) {
+        kconnsCap = kconnsCap ? kconnsCap * 2 : 16;
+        tmp = realloc(kconns, kconnsCap * sizeof(*kconns));
+        if (!tmp) {
+          // check the ones we have room for; the rest wait for the next run
+          break;
         }
+        kconns = tmp;
       }
+      kconns[numKconns++] = conn;
+    }
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  hdfsConnFreeList(toFree);
+  toFree = NULL;
+  if (numKconns == 0) {
+    free(kconns);
+    return;
+  }
+
+  // kpath and its mtime never change once the connection is made
+  condemn = calloc(numKconns, sizeof(*condemn));
+  if (!condemn) {
+    free(kconns);
+    return;
+  }
+  for (i = 0; i < numKconns; i++) {
+    condemn[i] = (hdfsConnCheckKpath(kconns[i]) != 0);
+  }
+  pthread_mutex_lock(&shard->mutex);
+  for (i = 0; i < numKconns; i++) {
+    if (!condemn[i]) {
+      continue;
     }
+    conn = kconns[i];
+    conn->condemned = 1;
+    RB_REMOVE(hdfsConnTree, &shard->tree, conn);
+    shard->expired++;
     if (conn->refcnt == 0) {
-      /* If the connection is not currently in use by a thread, check to see if
-       * it ought to be removed because it's too old. */
-      conn->expirationCount--;
-      if (conn->expirationCount <= 0) {
-        if (conn->condemned) {
-          fprintf(stderr, "hdfsConnExpiry: LOGIC ERROR: condemned connection "
-                  "as %s is still in the tree!\n", conn->usrname);
-        }
-        fprintf(stderr, "hdfsConnExpiry: freeing and removing connection as "
-                "%s because it's now too old.\n", conn->usrname);
-        RB_REMOVE(hdfsConnTree, &gConnTree, conn);
-        hdfsConnFree(conn);
+      /* If the connection is not in use by any threads, delete it
+       * immediately.  If it is still in use by some threads, the last
+       * thread using it will clean it up later inside hdfsConnRelease. */
+      hdfsConnIdleRemove(conn);
+      conn->idleNext = toFree;
+      toFree = conn;
+    }
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  hdfsConnFreeList(toFree);
+  free(condemn);
+  free(kconns);
+}
+
+void fuseConnectGetStats(struct fuseConnectStats *stats)
+{
+  struct hdfsConn *conn;
+  int i;
+
+  memset(stats, 0, sizeof(*stats));
+  for (i = 0; i < FUSE_CONN_SHARDS; i++) {
+    pthread_mutex_lock(&gConnShards[i].mutex);
+    RB_FOREACH(conn, hdfsConnTree, &gConnShards[i].tree) {
+      stats->cached++;
+      if (conn->refcnt > 0) {
+        stats->inUse++;
       }
     }
+    stats->expired += gConnShards[i].expired;
+    pthread_mutex_unlock(&gConnShards[i].mutex);
+  }
+}
+
+static void hdfsConnExpiry(void)
+{
+  int i;
+
+  for (i = 0; i < FUSE_CONN_SHARDS; i++) {
+    hdfsConnExpiryShard(&gConnShards[i]);
   }
-  pthread_mutex_unlock(&gConnMutex);
 }
 
 /**
@@ -420,14 +672,16 @@ done:
 /**
  * Create a new libhdfs connection.
  *
+ * @param shard         The shard the username belongs to, locked
  * @param usrname       Username to use for the new connection
+ * @param slot          The user's slot to put the new connection in
  * @param ctx           FUSE context to use for the new connection
  * @param out           (out param) the new libhdfs connection
  *
  * @return              0 on success; error code otherwise
  */
-static int fuseNewConnect(const char *usrname, struct fuse_context *ctx,
-        struct hdfsConn **out)
+static int fuseNewConnect(struct hdfsConnShard *shard, const char *usrname,
+        int slot, struct fuse_context *ctx, struct hdfsConn **out)
 {
   struct hdfsBuilder *bld = NULL;
   char kpath[PATH_MAX] = { 0 };
@@ -458,6 +712,8 @@ static int fuseNewConnect(const char *usrname, struct fuse_context *ctx,
     hdfsBuilderSetNameNodePort(bld, gPort);
   }
   hdfsBuilderSetUserName(bld, usrname);
+  // for the latencies logged by fuseStatsDump
+  hdfsBuilderConfSetStr(bld, HDFS_METRICS_ENABLED_KEY, "true");
   if (gHdfsAuthConf == AUTH_CONF_KERBEROS) {
     findKerbTicketCachePath(ctx, kpath, sizeof(kpath));
     if (stat(kpath, &st) < 0) {
@@ -491,7 +747,9 @@ static int fuseNewConnect(const char *usrname, struct fuse_context *ctx,
             "error code %d\n", usrname, ret);
     goto error;
   }
-  RB_INSERT(hdfsConnTree, &gConnTree, conn);
+  conn->shard = shard;
+  conn->slot = slot;
+  RB_INSERT(hdfsConnTree, &shard->tree, conn);
   *out = conn;
   return 0;
 
@@ -510,39 +768,102 @@ error:
 int fuseConnect(const char *usrname, struct fuse_context *ctx,
                 struct hdfsConn **out)
 {
-  int ret;
+  int ret, slot;
   struct hdfsConn* conn;
+  struct hdfsConnShard *shard = hdfsConnShardFor(usrname);
 
-  pthread_mutex_lock(&gConnMutex);
-  conn = hdfsConnFind(usrname);
+  pthread_mutex_lock(&shard->mutex);
+  conn = hdfsConnFind(shard, usrname, &slot);
   if (!conn) {
-    ret = fuseNewConnect(usrname, ctx, &conn);
+    ret = fuseNewConnect(shard, usrname, slot, ctx, &conn);
     if (ret) {
-      pthread_mutex_unlock(&gConnMutex);
+      pthread_mutex_unlock(&shard->mutex);
       fprintf(stderr, "fuseConnect(usrname=%s): fuseNewConnect failed with "
               "error code %d\n", usrname, ret);
       return ret;
     }
+  } else if (conn->refcnt == 0) {
+    hdfsConnIdleRemove(conn);
   }
   conn->refcnt++;
-  conn->expirationCount = (gExpiryPeriod + gTimerPeriod - 1) / gTimerPeriod;
-  if (conn->expirationCount < 2)
-    conn->expirationCount = 2;
-  pthread_mutex_unlock(&gConnMutex);
+  pthread_mutex_unlock(&shard->mutex);
   *out = conn;
   return 0;
 }
 
+static void fuseUserCacheFree(void *v)
+{
+  struct fuseUserCache *cache = v;
+  int i;
+
+  for (i = 0; i < FUSE_USER_CACHE_SIZE; i++) {
+    free(cache->entries[i].usrname);
+  }
+  free(cache);
+}
+
+static void fuseUserCacheKeyInit(void)
+{
+  gUserCacheKeyErr = pthread_key_create(&gUserCacheKey, fuseUserCacheFree);
+}
+
+/**
+ * Get the username of a UID, without the global lock getUsername takes
+ * when the calling thread has looked it up recently.
+ *
+ * @param uid           The UID
+ * @param tmp           (out param) Set to a copy of the username that the
+ *                      caller must free, when the thread has no cache.
+ *
+ * @return              The username, or NULL if it could not be found
+ */
+static const char *getUsernameCached(uid_t uid, char **tmp)
+{
+  struct fuseUserCache *cache;
+  struct fuseUserCacheEntry *entry;
+  time_t now;
+  int i;
+
+  *tmp = NULL;
+  pthread_once(&gUserCacheOnce, fuseUserCacheKeyInit);
+  if (gUserCacheKeyErr) {
+    return (*tmp = getUsername(uid));
+  }
+  cache = pthread_getspecific(gUserCacheKey);
+  if (!cache) {
+    cache = calloc(1, sizeof(*cache));
+    if (!cache || pthread_setspecific(gUserCacheKey, cache)) {
+      free(cache);
+      return (*tmp = getUsername(uid));
+    }
+  }
+  now = getMonotonicTime();
+  for (i = 0; i < FUSE_USER_CACHE_SIZE; i++) {
+    entry = &cache->entries[i];
+    if (entry->usrname && entry->uid == uid && entry->expiry > now) {
+      return entry->usrname;
+    }
+  }
+  entry = &cache->entries[cache->next];
+  cache->next = (cache->next + 1) % FUSE_USER_CACHE_SIZE;
+  free(entry->usrname);
+  entry->uid = uid;
+  entry->usrname = getUsername(uid);
+  entry->expiry = now + FUSE_USER_CACHE_TTL;
+  return entry->usrname;
+}
+
 int fuseConnectAsThreadUid(struct hdfsConn **conn)
 {
   struct fuse_context *ctx;
-  char *usrname;
+  const char *usrname;
+  char *tmp;
   int ret;
   
   ctx = fuse_get_context();
-  usrname = getUsername(ctx->uid);
+  usrname = getUsernameCached(ctx->uid, &tmp);
   ret = fuseConnect(usrname, ctx, conn);
-  free(usrname);
+  free(tmp);
   return ret;
 }
 
@@ -557,7 +878,7 @@ int fuseConnectTest(void)
     // this without valid Kerberos authentication.  See HDFS-3674 for details.
     return 0;
   }
-  ret = fuseNewConnect("root", NULL, &conn);
+  ret = fuseNewConnect(hdfsConnShardFor("root"), "root", 0, NULL, &conn);
   if (ret) {
     fprintf(stderr, "fuseConnectTest failed with error code %d\n", ret);
     return ret;
@@ -573,18 +894,28 @@ struct hdfs_internal* hdfsConnGetFs(struct hdfsConn *conn)
 
 void hdfsConnRelease(struct hdfsConn *conn)
 {
-  pthread_mutex_lock(&gConnMutex);
+  struct hdfsConnShard *shard = conn->shard;
+  int doFree = 0;
+
+  pthread_mutex_lock(&shard->mutex);
   conn->refcnt--;
-  if ((conn->refcnt == 0) && (conn->condemned)) {
+  if (conn->refcnt == 0) {
+    if (conn->condemned) {
+      /* Notice that we're not removing the connection from its shard here.
+       * If the connection is condemned, it must have already been removed
+       * from the tree, so that no other threads start using it.
+       */
+      doFree = 1;
+    } else {
+      hdfsConnIdleAppend(conn);
+    }
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  if (doFree) {
     fprintf(stderr, "hdfsConnRelease(usrname=%s): freeing condemend FS!\n",
       conn->usrname);
-    /* Notice that we're not removing the connection from gConnTree here.
-     * If the connection is condemned, it must have already been removed from
-     * the tree, so that no other threads start using it.
-     */
     hdfsConnFree(conn);
   }
-  pthread_mutex_unlock(&gConnMutex);
 }
 
 /**
@@ -19,10 +19,21 @@
 #ifndef __FUSE_CONNECT_H__
 #define __FUSE_CONNECT_H__
 
+#include <stdint.h>
+
 struct fuse_context;
 struct hdfsConn;
 struct hdfs_internal;
 
+struct fuseConnectStats {
+  /** Connections in the cache */
+  uint64_t cached;
+  /** Cached connections that some thread is using */
+  uint64_t inUse;
+  /** Connections dropped from the cache since the mount */
+  uint64_t expired;
+};
+
 /**
  * Initialize the fuse connection subsystem.
  *
@@ -87,4 +98,11 @@ struct hdfs_internal* hdfsConnGetFs(struct hdfsConn *conn);
  */
 void hdfsConnRelease(struct hdfsConn *conn);
 
+/**
+ * Get counts of the cached connections.
+ *
+ * @param stats      (out param) The counts
+ */
+void fuseConnectGetStats(struct fuseConnectStats *stats);
+
 #endif
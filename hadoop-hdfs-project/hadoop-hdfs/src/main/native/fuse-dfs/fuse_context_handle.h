@@ -36,6 +36,9 @@ typedef struct dfs_context_struct {
   int direct_io;
   char **protectedpaths;
   size_t rdbuffer_size;
+  size_t wrbuffer_size;
+  int exact_nlink;
+  int statfs_interval;
 } dfs_context;
 
 #endif
@@ -21,6 +21,7 @@
 #include "fuse_impls.h"
 #include "fuse_init.h"
 #include "fuse_connect.h"
+#include "fuse_stats.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -41,29 +42,109 @@ int is_protected(const char *path) {
   return 0;
 }
 
+/**
+ * Define timed_<name>, which calls the operation <name> and records it in
+ * the statistics.
+ */
+#define DFS_TIMED(op, name, params, args)                    \
+  static int timed_##name params {                           \
+    uint64_t start = fuseStatsStart();                       \
+    int ret = name args;                                     \
+    fuseStatsEnd(op, start, ret);                            \
+    return ret;                                              \
+  }
+
+DFS_TIMED(FUSE_STATS_GETATTR, dfs_getattr,
+          (const char *path, struct stat *st), (path, st))
+DFS_TIMED(FUSE_STATS_ACCESS, dfs_access,
+          (const char *path, int mask), (path, mask))
+DFS_TIMED(FUSE_STATS_OPENDIR, dfs_opendir,
+          (const char *path, struct fuse_file_info *fi), (path, fi))
+DFS_TIMED(FUSE_STATS_READDIR, dfs_readdir,
+          (const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+           struct fuse_file_info *fi), (path, buf, filler, offset, fi))
+DFS_TIMED(FUSE_STATS_RELEASEDIR, dfs_releasedir,
+          (const char *path, struct fuse_file_info *fi), (path, fi))
+DFS_TIMED(FUSE_STATS_OPEN, dfs_open,
+          (const char *path, struct fuse_file_info *fi), (path, fi))
+DFS_TIMED(FUSE_STATS_READ, dfs_read,
+          (const char *path, char *buf, size_t size, off_t offset,
+           struct fuse_file_info *fi), (path, buf, size, offset, fi))
+DFS_TIMED(FUSE_STATS_SYMLINK, dfs_symlink,
+          (const char *from, const char *to), (from, to))
+DFS_TIMED(FUSE_STATS_STATFS, dfs_statfs,
+          (const char *path, struct statvfs *st), (path, st))
+DFS_TIMED(FUSE_STATS_MKDIR, dfs_mkdir,
+          (const char *path, mode_t mode), (path, mode))
+DFS_TIMED(FUSE_STATS_RMDIR, dfs_rmdir, (const char *path), (path))
+DFS_TIMED(FUSE_STATS_RENAME, dfs_rename,
+          (const char *from, const char *to), (from, to))
+DFS_TIMED(FUSE_STATS_UNLINK, dfs_unlink, (const char *path), (path))
+DFS_TIMED(FUSE_STATS_RELEASE, dfs_release,
+          (const char *path, struct fuse_file_info *fi), (path, fi))
+DFS_TIMED(FUSE_STATS_CREATE, dfs_create,
+          (const char *path, mode_t mode, struct fuse_file_info *fi),
+          (path, mode, fi))
+DFS_TIMED(FUSE_STATS_WRITE, dfs_write,
+          (const char *path, const char *buf, size_t size, off_t offset,
+           struct fuse_file_info *fi), (path, buf, size, offset, fi))
+DFS_TIMED(FUSE_STATS_FLUSH, dfs_flush,
+          (const char *path, struct fuse_file_info *fi), (path, fi))
+DFS_TIMED(FUSE_STATS_FSYNC, dfs_fsync,
+          (const char *path, int datasync, struct fuse_file_info *fi),
+          (path, datasync, fi))
+DFS_TIMED(FUSE_STATS_MKNOD, dfs_mknod,
+          (const char *path, mode_t mode, dev_t rdev), (path, mode, rdev))
+DFS_TIMED(FUSE_STATS_UTIMENS, dfs_utimens,
+          (const char *path, const struct timespec ts[2]), (path, ts))
+DFS_TIMED(FUSE_STATS_CHMOD, dfs_chmod,
+          (const char *path, mode_t mode), (path, mode))
+DFS_TIMED(FUSE_STATS_CHOWN, dfs_chown,
+          (const char *path, uid_t uid, gid_t gid), (path, uid, gid))
+DFS_TIMED(FUSE_STATS_TRUNCATE, dfs_truncate,
+          (const char *path, off_t size), (path, size))
+
+#if FUSE_VERSION >= 29
+static int timed_dfs_read_buf(const char *path, struct fuse_bufvec **bufp,
+                              size_t size, off_t offset,
+                              struct fuse_file_info *fi)
+{
+  uint64_t start = fuseStatsStart();
+  int ret = dfs_read_buf(path, bufp, size, offset, fi);
+
+  // count the bytes, as for read
+  fuseStatsEnd(FUSE_STATS_READ_BUF, start,
+               ret ? ret : (int)fuse_buf_size(*bufp));
+  return ret;
+}
+#endif
+
 static struct fuse_operations dfs_oper = {
-  .getattr  = dfs_getattr,
-  .access   = dfs_access,
-  .readdir  = dfs_readdir,
+  .getattr  = timed_dfs_getattr,
+  .access   = timed_dfs_access,
+  .opendir  = timed_dfs_opendir,
+  .readdir  = timed_dfs_readdir,
+  .releasedir = timed_dfs_releasedir,
   .destroy  = dfs_destroy,
   .init     = dfs_init,
-  .open     = dfs_open,
-  .read     = dfs_read,
-  .symlink  = dfs_symlink,
-  .statfs   = dfs_statfs,
-  .mkdir    = dfs_mkdir,
-  .rmdir    = dfs_rmdir,
-  .rename   = dfs_rename,
-  .unlink   = dfs_unlink,
-  .release  = dfs_release,
-  .create   = dfs_create,
-  .write    = dfs_write,
-  .flush    = dfs_flush,
-  .mknod    = dfs_mknod,
-  .utimens  = dfs_utimens,
-  .chmod    = dfs_chmod,
-  .chown    = dfs_chown,
-  .truncate = dfs_truncate,
+  .open     = timed_dfs_open,
+  .read     = timed_dfs_read,
+  .symlink  = timed_dfs_symlink,
+  .statfs   = timed_dfs_statfs,
+  .mkdir    = timed_dfs_mkdir,
+  .rmdir    = timed_dfs_rmdir,
+  .rename   = timed_dfs_rename,
+  .unlink   = timed_dfs_unlink,
+  .release  = timed_dfs_release,
+  .create   = timed_dfs_create,
+  .write    = timed_dfs_write,
+  .flush    = timed_dfs_flush,
+  .fsync    = timed_dfs_fsync,
+  .mknod    = timed_dfs_mknod,
+  .utimens  = timed_dfs_utimens,
+  .chmod    = timed_dfs_chmod,
+  .chown    = timed_dfs_chown,
+  .truncate = timed_dfs_truncate,
 };
 
 int main(int argc, char *argv[])
@@ -79,6 +160,10 @@ int main(int argc, char *argv[])
   memset(&options, 0, sizeof(struct options));
 
   options.rdbuffer_size = 10*1024*1024; 
+  options.wrbuffer_size = 4*1024*1024;
+  options.block_cache_mb = 128;
+  options.read_threads = 4;
+  options.statfs_interval = 10;
   options.attribute_timeout = 60; 
   options.entry_timeout = 60;
 
@@ -104,6 +189,12 @@ int main(int argc, char *argv[])
     fuse_opt_add_arg(&args, buf);
   }
 
+#if FUSE_VERSION >= 29
+  if (options.zero_copy_read) {
+    dfs_oper.read_buf = timed_dfs_read_buf;
+  }
+#endif
+
   if (options.nn_uri == NULL) {
     print_usage(argv[0]);
     exit(EXIT_SUCCESS);
@@ -33,14 +33,74 @@ struct hdfsConn;
  * a) a read buffer for performance reasons since fuse is typically called on 4K chunks only
  * b) the hdfs fs handle 
  *
+ * Reads are served from a few buffers, each holding a window of the file,
+ * so readers at different offsets of one open file do not take turns with
+ * a single buffer.  fh->mutex only guards the bookkeeping; filling a buffer
+ * and copying out of it happen without it.  When a file is read
+ * sequentially, the window after the one being read is filled in the
+ * background.  Windows are filled from the block cache shared by all open
+ * files when that is enabled.
+ *
+ * Writes are gathered into a buffer of wrbuffer_size bytes.  A full
+ * buffer is handed to a writer thread, which sends it to HDFS in one
+ * hdfsWrite while the next one fills.  An error from the writer thread is
+ * returned by the next write, flush, fsync or release.
+ *
  */
+
+/** How many read buffers an open file has */
+#define DFS_READ_SLOTS 4
+
+enum dfs_slot_state {
+  DFS_SLOT_EMPTY,    // buf holds nothing
+  DFS_SLOT_FILLING,  // a reader or prefetch thread is filling buf
+  DFS_SLOT_READY     // buf holds size bytes from offset
+};
+
+struct dfs_read_slot {
+  char *buf;  //allocated by the first fill
+  off_t offset; //where the window starts in the file
+  tSize size; //how much of buf holds data; less than the window at EOF
+  enum dfs_slot_state state;
+  int refs; //readers copying out of buf; it is not reused until they are done
+  int sequential; //whether it was filled for a sequential reader
+  unsigned long lastUse; //the handle's useClock when it was last read
+};
+
 typedef struct dfs_fh_struct {
   hdfsFile hdfsFH;
   struct hdfsConn *conn;
-  char *buf;
-  tSize bufferSize;  //what is the size of the buffer we have
-  off_t buffersStartOffset; //where the buffer starts in the file
   pthread_mutex_t mutex;
+  pthread_cond_t cond; //signalled when a slot is filled or released
+  struct dfs_read_slot slots[DFS_READ_SLOTS];
+  unsigned long useClock;
+  int prefetchesRunning; //prefetch threads that still use this handle
+  char *cachePath; //the path, if reads go through the block cache
+  time_t cacheMtime; //the modification time of the file when it was opened
+  char *writeBuf; //the write buffer being filled
+  size_t writeLen;
+  char *flushBuf; //the write buffer the writer thread owns while flushLen > 0
+  size_t flushLen;
+  tOffset writeOffset; //where the next write must start; -1 until known
+  int writeError; //negative errno from the writer thread, or 0
+  int writeBusy; //a write is copying into the buffer and may wait for the writer
+  int writerRunning;
+  int writerStop;
+  pthread_t writerThread;
 } dfs_fh;
 
+/**
+ * Wait until everything written to a handle has been passed to hdfsWrite.
+ *
+ * @return 0 on success; the negative errno of a failed write otherwise
+ */
+int dfs_write_drain(dfs_fh *fh);
+
+/**
+ * Drain a handle, then stop its writer thread and free its write buffers.
+ *
+ * @return 0 on success; the negative errno of a failed write otherwise
+ */
+int dfs_write_finish(dfs_fh *fh);
+
 #endif
@@ -34,10 +34,16 @@
 int dfs_mkdir(const char *path, mode_t mode);
 int dfs_rename(const char *from, const char *to);
 int dfs_getattr(const char *path, struct stat *st);
+int dfs_opendir(const char *path, struct fuse_file_info *fi);
 int dfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                 off_t offset, struct fuse_file_info *fi);
+int dfs_releasedir(const char *path, struct fuse_file_info *fi);
 int dfs_read(const char *path, char *buf, size_t size, off_t offset,
                     struct fuse_file_info *fi);
+#if FUSE_VERSION >= 29
+int dfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+                 off_t offset, struct fuse_file_info *fi);
+#endif
 int dfs_statfs(const char *path, struct statvfs *st);
 int dfs_mkdir(const char *path, mode_t mode);
 int dfs_rename(const char *from, const char *to);
@@ -53,6 +59,7 @@ int dfs_release (const char *path, struct fuse_file_info *fi);
 int dfs_mknod(const char *path, mode_t mode, dev_t rdev) ;
 int dfs_create(const char *path, mode_t mode, struct fuse_file_info *fi);
 int dfs_flush(const char *path, struct fuse_file_info *fi);
+int dfs_fsync(const char *path, int datasync, struct fuse_file_info *fi);
 int dfs_access(const char *path, int mask);
 int dfs_truncate(const char *path, off_t size);
 int dfs_symlink(const char *from, const char *to);
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_users.h"
@@ -47,6 +48,7 @@ int dfs_chmod(const char *path, mode_t mode)
     ret = (errno > 0) ? -errno : -EIO;
     goto cleanup;
   }
+  fuseAttrCacheInvalidate(path);
 
 cleanup:
   if (conn) {
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_users.h"
 #include "fuse_impls.h"
@@ -75,6 +76,7 @@ int dfs_chown(const char *path, uid_t uid, gid_t gid)
     ret = (ret > 0) ? -ret : -EIO;
     goto cleanup;
   }
+  fuseAttrCacheInvalidate(path);
 
 cleanup:
   if (conn) {
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_connect.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
@@ -44,10 +45,16 @@ int dfs_flush(const char *path, struct fuse_file_info *fi) {
     assert(fh);
     hdfsFile file_handle = (hdfsFile)fh->hdfsFH;
     assert(file_handle);
+    int ret = dfs_write_drain(fh);
+    if (ret) {
+      ERROR("Could not write the buffered data for %s: error %d", path, ret);
+      return ret;
+    }
     if (hdfsFlush(hdfsConnGetFs(fh->conn), file_handle) != 0) {
       ERROR("Could not flush %lx for %s\n",(long)file_handle, path);
       return -EIO;
     }
+    fuseAttrCacheInvalidate(path);
   }
 
   return 0;
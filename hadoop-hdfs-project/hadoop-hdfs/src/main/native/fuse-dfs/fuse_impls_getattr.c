@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_stat_struct.h"
@@ -27,6 +28,7 @@ int dfs_getattr(const char *path, struct stat *st)
   hdfsFS fs;
   int ret;
   hdfsFileInfo *info;
+  uint64_t generation;
 
   TRACE1("getattr", path)
   dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
@@ -34,6 +36,14 @@ int dfs_getattr(const char *path, struct stat *st)
   assert(path);
   assert(st);
 
+  switch (fuseAttrCacheGet(path, st)) {
+  case 1:
+    return 0;
+  case 0:
+    return -ENOENT;
+  }
+  generation = fuseAttrCacheGeneration();
+
   ret = fuseConnectAsThreadUid(&conn);
   if (ret) {
     fprintf(stderr, "fuseConnectAsThreadUid: failed to open a libhdfs "
@@ -45,13 +55,20 @@ int dfs_getattr(const char *path, struct stat *st)
   
   info = hdfsGetPathInfo(fs,path);
   if (NULL == info) {
+    // Build tools probe many paths that are not there; remember those too
+    if (errno == ENOENT) {
+      fuseAttrCachePut(path, NULL, generation);
+    }
     ret = -ENOENT;
     goto cleanup;
   }
   fill_stat_structure(&info[0], st);
 
-  // setup hard link info - for a file it is 1 else num entries in a dir + 2 (for . and ..)
-  if (info[0].mKind == kObjectKindDirectory) {
+  // Counting a directory's links means listing it, which costs as much as
+  // the directory is large.  Unless asked to, report a single link, as
+  // many network filesystems do; tools such as find take that to mean the
+  // count is unknown.
+  if (info[0].mKind == kObjectKindDirectory && dfs->exact_nlink) {
     int numEntries = 0;
     hdfsFileInfo *info = hdfsListDirectory(fs,path,&numEntries);
 
@@ -59,10 +76,8 @@ int dfs_getattr(const char *path, struct stat *st)
       hdfsFreeFileInfo(info,numEntries);
     }
     st->st_nlink = numEntries + 2;
-  } else {
-    // not a directory
-    st->st_nlink = 1;
   }
+  fuseAttrCachePut(path, st, generation);
 
   // free the info pointer
   hdfsFreeFileInfo(info,1);
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_trash.h"
@@ -55,6 +56,7 @@ int dfs_mkdir(const char *path, mode_t mode)
 
   // In theory the create and chmod should be atomic.
 
+  fuseAttrCacheInvalidate(path);
   if (hdfsCreateDirectory(fs, path)) {
     ERROR("HDFS could not create directory %s", path);
     ret = (errno > 0) ? -errno : -EIO;
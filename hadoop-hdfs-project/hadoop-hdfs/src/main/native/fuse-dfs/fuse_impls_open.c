@@ -16,20 +16,132 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
+#include "fuse_block_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_connect.h"
 #include "fuse_file_handle.h"
+#include "fuse_stats.h"
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of files whose page cache retention is tracked.  A file whose
+ * slot has been taken by another path just loses its kernel page cache on
+ * the next open.
+ */
+#define DFS_KEEP_CACHE_SLOTS 1024
+
+/**
+ * What a file looked like when it was last opened for reading, so that the
+ * kernel can be told to keep its page cache if it has not changed since.
+ */
+struct dfs_keep_cache_slot {
+  char *path;
+  time_t mtime;
+  off_t size;
+};
+
+static pthread_mutex_t gKeepCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct dfs_keep_cache_slot gKeepCache[DFS_KEEP_CACHE_SLOTS];
+
+static struct dfs_keep_cache_slot *dfs_keep_cache_slot(const char *path)
+{
+  uint32_t hash = 2166136261U;
+
+  for (; *path; path++) {
+    hash = (hash ^ (unsigned char)*path) * 16777619U;
+  }
+  return &gKeepCache[hash % DFS_KEEP_CACHE_SLOTS];
+}
+
+/**
+ * Note that a file is being opened for reading.
+ *
+ * @return 1 if it has the modification time and length it had when it was
+ *         last opened, so the kernel's cached pages of it are still good
+ */
+static int dfs_keep_cache_check(const char *path, time_t mtime, off_t size)
+{
+  struct dfs_keep_cache_slot *slot = dfs_keep_cache_slot(path);
+  int keep = 0;
+
+  pthread_mutex_lock(&gKeepCacheMutex);
+  if (slot->path && !strcmp(slot->path, path)) {
+    keep = (slot->mtime == mtime && slot->size == size);
+  } else {
+    free(slot->path);
+    slot->path = strdup(path);
+  }
+  slot->mtime = mtime;
+  slot->size = size;
+  pthread_mutex_unlock(&gKeepCacheMutex);
+  return keep;
+}
+
+/**
+ * Forget a file that is being written through this mount.  Its length may
+ * end up what it was, and its modification time only has seconds.
+ */
+static void dfs_keep_cache_forget(const char *path)
+{
+  struct dfs_keep_cache_slot *slot = dfs_keep_cache_slot(path);
+
+  pthread_mutex_lock(&gKeepCacheMutex);
+  if (slot->path && !strcmp(slot->path, path)) {
+    free(slot->path);
+    slot->path = NULL;
+  }
+  pthread_mutex_unlock(&gKeepCacheMutex);
+}
+
+/**
+ * Set up the caching of a file opened for reading.  Its reads go through
+ * the block cache, which keys blocks by the modification time of the file,
+ * and the kernel keeps its page cache of the file if the file has not
+ * changed since it was last opened.
+ *
+ * The attributes usually come from the attribute cache, as getattr has just
+ * been called.  If they are not there, they are only fetched when the block
+ * cache needs them; otherwise the kernel just drops its pages as usual.
+ */
+static void dfs_open_caching(hdfsFS fs, dfs_fh *fh, const char *path,
+                             struct fuse_file_info *fi)
+{
+  struct stat st;
+  hdfsFileInfo *info;
+
+  if (fuseAttrCacheGet(path, &st) != 1) {
+    if (!fuseBlockCacheEnabled()) {
+      return;
+    }
+    info = hdfsGetPathInfo(fs, path);
+    if (info == NULL) {
+      return;
+    }
+    st.st_mtime = info->mLastMod;
+    st.st_size = info->mSize;
+    hdfsFreeFileInfo(info, 1);
+  }
+  if (fuseBlockCacheEnabled()) {
+    fh->cacheMtime = st.st_mtime;
+    fh->cachePath = strdup(path);
+  }
+  fi->keep_cache = dfs_keep_cache_check(path, st.st_mtime, st.st_size);
+}
 
 int dfs_open(const char *path, struct fuse_file_info *fi)
 {
   hdfsFS fs = NULL;
   dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
   dfs_fh *fh = NULL;
-  int mutexInit = 0, ret;
+  int mutexInit = 0, condInit = 0, ret;
 
   TRACE1("open", path)
 
@@ -59,28 +171,43 @@ int dfs_open(const char *path, struct fuse_file_info *fi)
   fs = hdfsConnGetFs(fh->conn);
 
   if (flags & O_RDWR) {
-    hdfsFileInfo *info = hdfsGetPathInfo(fs, path);
-    if (info == NULL) {
-      // File does not exist (maybe?); interpret it as a O_WRONLY
-      // If the actual error was something else, we'll get it again when
-      // we try to open the file.
-      flags ^= O_RDWR;
+    // HDFS files cannot be both read and written.  An existing file is
+    // opened read only and a missing one write only.  Rather than asking
+    // the NameNode whether the file exists first, just try to open it for
+    // reading, unless the attribute cache knows it is not there.  Only
+    // ENOENT sends us on to the write open.
+    struct stat st;
+    int err;
+
+    flags ^= O_RDWR;
+    if (fuseAttrCacheGet(path, &st) != 0) {
+      fh->hdfsFH = hdfsOpenFile(fs, path, flags | O_RDONLY, 0, 0, 0);
+      err = errno;
+      if (fh->hdfsFH == NULL && err != ENOENT) {
+        ERROR("Could not open file %s (errno=%d)", path, err);
+        ret = (err == 0 || err == EINTERNAL) ? -EIO : -err;
+        goto error;
+      }
+    }
+    if (fh->hdfsFH == NULL) {
       flags |= O_WRONLY;
-    } else {
-      // File exists; open this as read only.
-      flags ^= O_RDWR;
-      flags |= O_RDONLY;
     }
   }
 
-  if ((fh->hdfsFH = hdfsOpenFile(fs, path, flags,  0, 0, 0)) == NULL) {
-    ERROR("Could not open file %s (errno=%d)", path, errno);
-    if (errno == 0 || errno == EINTERNAL) {
-      ret = -EIO;
+  if (fh->hdfsFH == NULL) {
+    if (flags & (O_WRONLY | O_CREAT)) {
+      fuseAttrCacheInvalidate(path);
+      dfs_keep_cache_forget(path);
+    }
+    if ((fh->hdfsFH = hdfsOpenFile(fs, path, flags,  0, 0, 0)) == NULL) {
+      ERROR("Could not open file %s (errno=%d)", path, errno);
+      if (errno == 0 || errno == EINTERNAL) {
+        ret = -EIO;
+        goto error;
+      }
+      ret = -errno;
       goto error;
     }
-    ret = -errno;
-    goto error;
   }
 
   ret = pthread_mutex_init(&fh->mutex, NULL);
@@ -91,20 +218,24 @@ int dfs_open(const char *path, struct fuse_file_info *fi)
   }
   mutexInit = 1;
 
-  if (fi->flags & O_WRONLY || fi->flags & O_CREAT) {
-    fh->buf = NULL;
-  } else  {
-    assert(dfs->rdbuffer_size > 0);
-    fh->buf = (char*)malloc(dfs->rdbuffer_size * sizeof(char));
-    if (NULL == fh->buf) {
-      ERROR("Could not allocate memory for a read for file %s\n", path);
-      ret = -EIO;
-      goto error;
-    }
-    fh->buffersStartOffset = 0;
-    fh->bufferSize = 0;
+  ret = pthread_cond_init(&fh->cond, NULL);
+  if (ret) {
+    fprintf(stderr, "dfs_open: error initializing condition variable: "
+            "error %d\n", ret);
+    ret = -EIO;
+    goto error;
+  }
+  condInit = 1;
+
+  // the read buffers are allocated as they are first filled, and the
+  // write buffers by the first write
+  fh->writeOffset = -1;
+  assert(dfs->rdbuffer_size > 0);
+  if (!(flags & (O_WRONLY | O_CREAT))) {
+    dfs_open_caching(fs, fh, path, fi);
   }
   fi->fh = (uint64_t)fh;
+  fuseStatsAdd(FUSE_STATS_OPEN_FILES, 1);
   return 0;
 
 error:
@@ -112,7 +243,9 @@ error:
     if (mutexInit) {
       pthread_mutex_destroy(&fh->mutex);
     }
-    free(fh->buf);
+    if (condInit) {
+      pthread_cond_destroy(&fh->cond);
+    }
     if (fh->hdfsFH) {
       hdfsCloseFile(fs, fh->hdfsFH);
     }
@@ -16,15 +16,474 @@
  * limitations under the License.
  */
 
+#include "fuse_block_cache.h"
 #include "fuse_connect.h"
 #include "fuse_dfs.h"
 #include "fuse_file_handle.h"
 #include "fuse_impls.h"
+#include "fuse_read_pool.h"
+#include "fuse_stats.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 static size_t min(const size_t x, const size_t y) {
   return x < y ? x : y;
 }
 
+/**
+ * Read until a buffer is full or EOF is hit.
+ *
+ * @return how much was read; -EIO on error
+ */
+static tSize dfs_pread_fully(dfs_fh *fh, off_t offset, char *buf, size_t size)
+{
+  hdfsFS fs = hdfsConnGetFs(fh->conn);
+  tSize num_read = 0;
+  size_t total_read = 0;
+
+  while (size - total_read > 0 &&
+         (num_read = hdfsPread(fs, fh->hdfsFH, offset + total_read,
+                               buf + total_read, size - total_read)) > 0) {
+    total_read += num_read;
+  }
+  if (num_read < 0) {
+    ERROR("pread failed at offset %ld with return code %d",
+          (long)(offset + total_read), (int)num_read);
+    return -EIO;
+  }
+  return total_read;
+}
+
+/** The most chunks a large read is split into */
+#define DFS_MAX_READ_CHUNKS 64
+
+struct dfs_chunked_read {
+  dfs_fh *fh;
+  char *buf;
+  off_t offset;
+  /** Where each chunk starts in buf; bounds[numChunks] is the read's size */
+  size_t bounds[DFS_MAX_READ_CHUNKS + 1];
+  /** What dfs_pread_fully returned for each chunk */
+  tSize results[DFS_MAX_READ_CHUNKS];
+};
+
+static void dfs_read_chunk(void *v, int i)
+{
+  struct dfs_chunked_read *r = (struct dfs_chunked_read*)v;
+
+  r->results[i] = dfs_pread_fully(r->fh, r->offset + r->bounds[i],
+                                  r->buf + r->bounds[i],
+                                  r->bounds[i + 1] - r->bounds[i]);
+}
+
+/**
+ * Read straight into the caller's buffer.  A read of several megabytes is
+ * split into chunks that the read pool fetches at once, each through a
+ * DataNode stream of its own.  The chunks end at multiples of
+ * FUSE_BLOCK_CACHE_BLOCK_SIZE in the file, which HDFS block sizes are
+ * multiples of, so that no chunk spans two blocks.
+ *
+ * @return how much was read; -EIO on error
+ */
+static int dfs_read_direct(dfs_fh *fh, char *buf, size_t size, off_t offset)
+{
+  const size_t grid = FUSE_BLOCK_CACHE_BLOCK_SIZE;
+  struct dfs_chunked_read r;
+  size_t numChunks;
+  int i, ret = 0;
+
+  numChunks = min((size + grid - 1) / grid, fuseReadPoolSize() + 1);
+  numChunks = min(numChunks, DFS_MAX_READ_CHUNKS);
+  if (numChunks <= 1) {
+    return dfs_pread_fully(fh, offset, buf, size);
+  }
+  r.fh = fh;
+  r.buf = buf;
+  r.offset = offset;
+  r.bounds[0] = 0;
+  for (i = 1; i < (int)numChunks; i++) {
+    // split evenly, moving each boundary up to the grid
+    off_t end = offset + size * i / numChunks;
+    end = (end + grid - 1) / grid * grid;
+    r.bounds[i] = min(end - offset, size);
+  }
+  r.bounds[numChunks] = size;
+  fuseReadPoolRun(dfs_read_chunk, &r, numChunks);
+  fuseStatsAdd(FUSE_STATS_READ_CHUNKS, numChunks);
+
+  // a chunk cut short by EOF ends the read; the ones after it are empty
+  for (i = 0; i < (int)numChunks; i++) {
+    if (r.results[i] < 0) {
+      return -EIO;
+    }
+    ret += r.results[i];
+    if ((size_t)r.results[i] < r.bounds[i + 1] - r.bounds[i]) {
+      break;
+    }
+  }
+  return ret;
+}
+
+/**
+ * Fill a slot from the block cache, reading the blocks it does not have
+ * from HDFS and offering them to it.
+ *
+ * @return how much was read; -EIO or -ENOMEM on error
+ */
+static tSize dfs_fill_from_cache(dfs_fh *fh, off_t offset, char *buf,
+                                 size_t size)
+{
+  const size_t blockSize = FUSE_BLOCK_CACHE_BLOCK_SIZE;
+  size_t total_read = 0;
+
+  while (total_read < size) {
+    const off_t pos = offset + total_read;
+    const int64_t index = pos / blockSize;
+    const size_t blockOffset = pos % blockSize;
+    struct fuseBlock *block;
+
+    block = fuseBlockCacheGet(fh->cachePath, fh->cacheMtime, index);
+    if (block == NULL) {
+      block = fuseBlockAlloc(fh->cachePath, fh->cacheMtime, index);
+      if (block == NULL) {
+        ERROR("Could not allocate a cache block of %zd bytes", blockSize);
+        return -ENOMEM;
+      }
+      tSize num_read = dfs_pread_fully(fh, index * blockSize,
+                                       fuseBlockData(block), blockSize);
+      if (num_read < 0) {
+        fuseBlockRelease(block);
+        return num_read;
+      }
+      fuseBlockCacheInsert(block, num_read);
+    }
+    const size_t len = fuseBlockLen(block);
+    if (len > blockOffset) {
+      const size_t amount = min(len - blockOffset, size - total_read);
+      memcpy(buf + total_read, fuseBlockData(block) + blockOffset, amount);
+      total_read += amount;
+    }
+    fuseBlockRelease(block);
+    if (len < blockSize) {
+      break;
+    }
+  }
+  return total_read;
+}
+
+/**
+ * Fill a slot that has been marked DFS_SLOT_FILLING, without fh->mutex.
+ *
+ * @return 0 on success; -EIO or -ENOMEM otherwise
+ */
+static int dfs_fill_slot(dfs_fh *fh, struct dfs_read_slot *slot, size_t window)
+{
+  tSize total_read;
+
+  if (slot->buf == NULL) {
+    slot->buf = (char*)malloc(window);
+    if (slot->buf == NULL) {
+      ERROR("Could not allocate a read buffer of %zd bytes", window);
+      return -ENOMEM;
+    }
+  }
+  if (fh->cachePath) {
+    total_read = dfs_fill_from_cache(fh, slot->offset, slot->buf, window);
+  } else {
+    total_read = dfs_pread_fully(fh, slot->offset, slot->buf, window);
+  }
+  if (total_read < 0) {
+    return total_read;
+  }
+  slot->size = total_read;
+  return 0;
+}
+
+/**
+ * Publish the outcome of dfs_fill_slot and wake anyone waiting for it.
+ *
+ * Called with fh->mutex held.
+ */
+static void dfs_finish_fill(dfs_fh *fh, struct dfs_read_slot *slot, int ret)
+{
+  slot->state = ret ? DFS_SLOT_EMPTY : DFS_SLOT_READY;
+  pthread_cond_broadcast(&fh->cond);
+}
+
+/**
+ * Find a slot that holds data for a read: all of it, or as much as there is
+ * before EOF.
+ *
+ * Called with fh->mutex held.
+ */
+static struct dfs_read_slot *dfs_find_ready(dfs_fh *fh, off_t offset,
+                                            size_t size, size_t window)
+{
+  int i;
+
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    struct dfs_read_slot *slot = &fh->slots[i];
+    if (slot->state == DFS_SLOT_READY &&
+        offset >= slot->offset && offset < slot->offset + slot->size &&
+        (offset + size <= slot->offset + slot->size || slot->size < window)) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Whether a slot being filled will hold the data for a read.
+ *
+ * Called with fh->mutex held.
+ */
+static int dfs_is_filling(dfs_fh *fh, off_t offset, size_t size, size_t window)
+{
+  int i;
+
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    struct dfs_read_slot *slot = &fh->slots[i];
+    if (slot->state == DFS_SLOT_FILLING &&
+        offset >= slot->offset && offset + size <= slot->offset + window) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Whether a read starts within, or just after, a slot that holds data or
+ * whose window is on the way.  Such reads are taken to be sequential.
+ *
+ * Called with fh->mutex held.
+ */
+static int dfs_follows_slot(dfs_fh *fh, off_t offset, size_t window)
+{
+  int i;
+
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    struct dfs_read_slot *slot = &fh->slots[i];
+    off_t end = slot->offset + (slot->state == DFS_SLOT_READY ? slot->size : window);
+    if (slot->state != DFS_SLOT_EMPTY && offset > slot->offset && offset <= end) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Pick the slot to fill next: an empty one, or else the one least recently
+ * read that nobody is filling or copying from.  It is marked as filling.
+ *
+ * Called with fh->mutex held.
+ *
+ * @return the slot, or NULL if every slot is busy
+ */
+static struct dfs_read_slot *dfs_claim_slot(dfs_fh *fh, off_t offset,
+                                            int sequential)
+{
+  struct dfs_read_slot *victim = NULL;
+  int i;
+
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    struct dfs_read_slot *slot = &fh->slots[i];
+    if (slot->state == DFS_SLOT_FILLING || slot->refs > 0) {
+      continue;
+    }
+    if (slot->state == DFS_SLOT_EMPTY) {
+      victim = slot;
+      break;
+    }
+    if (victim == NULL || slot->lastUse < victim->lastUse) {
+      victim = slot;
+    }
+  }
+  if (victim) {
+    victim->state = DFS_SLOT_FILLING;
+    victim->offset = offset;
+    victim->size = 0;
+    victim->sequential = sequential;
+    victim->lastUse = ++fh->useClock;
+  }
+  return victim;
+}
+
+struct dfs_prefetch_arg {
+  dfs_fh *fh;
+  struct dfs_read_slot *slot;
+  size_t window;
+};
+
+/**
+ * Fill a slot ahead of a sequential reader.  This runs on a detached thread
+ * of its own; dfs_release waits for it to finish.
+ */
+static void *dfs_prefetch(void *v)
+{
+  struct dfs_prefetch_arg *arg = (struct dfs_prefetch_arg*)v;
+  dfs_fh *fh = arg->fh;
+  int ret;
+
+  ret = dfs_fill_slot(fh, arg->slot, arg->window);
+  pthread_mutex_lock(&fh->mutex);
+  dfs_finish_fill(fh, arg->slot, ret);
+  fh->prefetchesRunning--;
+  pthread_mutex_unlock(&fh->mutex);
+  free(arg);
+  return NULL;
+}
+
+/**
+ * Once a sequential reader is half way through a full window, start filling
+ * the window after it, unless that is already there or on the way.  If
+ * that cannot be done, the reader just fills the window itself when it gets
+ * there.
+ *
+ * Called with fh->mutex held.
+ */
+static void dfs_maybe_prefetch(dfs_fh *fh, struct dfs_read_slot *cur,
+                               off_t offset, size_t size, size_t window)
+{
+  struct dfs_prefetch_arg *arg;
+  struct dfs_read_slot *slot;
+  pthread_attr_t attr;
+  pthread_t thread;
+  const off_t next = cur->offset + window;
+  int i, ret;
+
+  if (!cur->sequential || cur->size < window ||
+      offset + size <= cur->offset + window / 2) {
+    return;
+  }
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    if (fh->slots[i].state != DFS_SLOT_EMPTY && fh->slots[i].offset == next) {
+      return;
+    }
+  }
+  arg = (struct dfs_prefetch_arg*)malloc(sizeof(*arg));
+  if (arg == NULL) {
+    return;
+  }
+  slot = dfs_claim_slot(fh, next, 1);
+  if (slot == NULL) {
+    free(arg);
+    return;
+  }
+  arg->fh = fh;
+  arg->slot = slot;
+  arg->window = window;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = pthread_create(&thread, &attr, dfs_prefetch, arg);
+  pthread_attr_destroy(&attr);
+  if (ret) {
+    ERROR("Could not create a thread to prefetch from offset %ld: error %d",
+          (long)next, ret);
+    dfs_finish_fill(fh, slot, -EIO);
+    free(arg);
+    return;
+  }
+  fh->prefetchesRunning++;
+  fuseStatsAdd(FUSE_STATS_PREFETCHES, 1);
+}
+
+/**
+ * Serve a read smaller than the window from the open file's buffers.
+ *
+ * @param buf where to copy the data, if pipeFd is -1
+ * @param pipeFd the write end of a pipe to write the data to instead, or -1.
+ *        It must have room for size bytes.
+ *
+ * @return how much was read; -EAGAIN if the pipe did not take all of it;
+ *         another negative errno on error
+ */
+static int dfs_read_slots(dfs_context *dfs, dfs_fh *fh, char *buf, int pipeFd,
+                          size_t size, off_t offset)
+{
+  const size_t window = dfs->rdbuffer_size;
+  struct dfs_read_slot *slot;
+  int isEOF = 0, waited = 0;
+  int ret = 0;
+
+  pthread_mutex_lock(&fh->mutex);
+  for (;;) {
+    slot = dfs_find_ready(fh, offset, size, window);
+    if (slot) {
+      slot->refs++;
+      fuseStatsAdd(waited ? FUSE_STATS_READ_WAITS : FUSE_STATS_READ_HITS, 1);
+      break;
+    }
+    if (dfs_is_filling(fh, offset, size, window)) {
+      pthread_cond_wait(&fh->cond, &fh->mutex);
+      waited = 1;
+      continue;
+    }
+    // a read that carries on from a window, or starts the file, is taken
+    // to be sequential, and the windows after it are prefetched
+    slot = dfs_claim_slot(fh, offset,
+                          offset == 0 || dfs_follows_slot(fh, offset, window));
+    if (slot == NULL) {
+      pthread_cond_wait(&fh->cond, &fh->mutex);
+      continue;
+    }
+    slot->refs++;
+    pthread_mutex_unlock(&fh->mutex);
+    fuseStatsAdd(FUSE_STATS_READ_FILLS, 1);
+    ret = dfs_fill_slot(fh, slot, window);
+    pthread_mutex_lock(&fh->mutex);
+    dfs_finish_fill(fh, slot, ret);
+    if (ret || slot->size == 0) {
+      // an error, or a read at or past EOF
+      slot->refs--;
+      pthread_mutex_unlock(&fh->mutex);
+      return ret;
+    }
+    break;
+  }
+  slot->lastUse = ++fh->useClock;
+  dfs_maybe_prefetch(fh, slot, offset, size, window);
+  pthread_mutex_unlock(&fh->mutex);
+
+  //
+  // The slot is not refilled while we hold a reference to it, so the copy
+  // needs no lock
+  //
+  assert(offset >= slot->offset);
+  const size_t bufferReadIndex = offset - slot->offset;
+  assert(bufferReadIndex < slot->size);
+
+  const size_t amount = min(slot->offset + slot->size - offset, size);
+  assert(amount > 0 && amount <= slot->size);
+  isEOF = (slot->size < window);
+
+  if (pipeFd < 0) {
+    memcpy(buf, slot->buf + bufferReadIndex, amount);
+    ret = amount;
+  } else if (write(pipeFd, slot->buf + bufferReadIndex, amount) == amount) {
+    ret = amount;
+  } else {
+    ret = -EAGAIN;
+  }
+
+  pthread_mutex_lock(&fh->mutex);
+  if (--slot->refs == 0) {
+    pthread_cond_broadcast(&fh->cond);
+  }
+  pthread_mutex_unlock(&fh->mutex);
+
+  // fuse requires the below and the code should guarantee this assertion
+  // 3 cases on return:
+  //   1. entire read satisfied
+  //   2. partial read and isEOF - including 0 size read
+  //   3. error 
+  assert(ret == size || isEOF || ret < 0);
+
+  return ret;
+}
+
 /**
  * dfs_read
  *
@@ -49,7 +508,6 @@ int dfs_read(const char *path, char *buf, size_t size, off_t offset,
   assert(fi);
 
   dfs_fh *fh = (dfs_fh*)fi->fh;
-  hdfsFS fs = hdfsConnGetFs(fh->conn);
 
   assert(fh != NULL);
   assert(fh->hdfsFH != NULL);
@@ -60,104 +518,172 @@ int dfs_read(const char *path, char *buf, size_t size, off_t offset,
 
   // If size is bigger than the read buffer, then just read right into the user supplied buffer
   if ( size >= dfs->rdbuffer_size) {
-    int num_read;
-    size_t total_read = 0;
-    while (size - total_read > 0 && (num_read = hdfsPread(fs, fh->hdfsFH, offset + total_read, buf + total_read, size - total_read)) > 0) {
-      total_read += num_read;
-    }
+    fuseStatsAdd(FUSE_STATS_READ_DIRECT, 1);
     // if there was an error before satisfying the current read, this logic declares it an error
     // and does not try to return any of the bytes read. Don't think it matters, so the code
     // is just being conservative.
-    if (total_read < size && num_read < 0) {
-      total_read = -EIO;
-    }
-    return total_read;
+    return dfs_read_direct(fh, buf, size, offset);
   }
 
-  //
-  // Critical section - protect from multiple reads in different threads accessing the read buffer
-  // (no returns until end)
-  //
-
-  pthread_mutex_lock(&fh->mutex);
+  return dfs_read_slots(dfs, fh, buf, -1, size, offset);
+}
 
-  // used only to check the postcondition of this function - namely that we satisfy
-  // the entire read or EOF is hit.
-  int isEOF = 0;
-  int ret = 0;
+#if FUSE_VERSION >= 29
 
-  // check if the buffer is empty or
-  // the read starts before the buffer starts or
-  // the read ends after the buffer ends
-
-  if (fh->bufferSize == 0  || 
-      offset < fh->buffersStartOffset || 
-      offset + size > fh->buffersStartOffset + fh->bufferSize) 
-    {
-      // Read into the buffer from DFS
-      int num_read = 0;
-      size_t total_read = 0;
-
-      while (dfs->rdbuffer_size  - total_read > 0 &&
-             (num_read = hdfsPread(fs, fh->hdfsFH, offset + total_read, fh->buf + total_read, dfs->rdbuffer_size - total_read)) > 0) {
-        total_read += num_read;
-      }
+/**
+ * The pipe a FUSE thread hands read replies to libfuse through.  libfuse
+ * splices what is in it to the fuse device, so the data is copied once,
+ * into the pipe, rather than into a reply buffer and then into the kernel.
+ */
+struct dfs_reply_pipe {
+  int fds[2];
+  size_t capacity;
+};
 
-      // if there was an error before satisfying the current read, this logic declares it an error
-      // and does not try to return any of the bytes read. Don't think it matters, so the code
-      // is just being conservative.
-      if (total_read < size && num_read < 0) {
-        // invalidate the buffer 
-        fh->bufferSize = 0; 
-        ERROR("pread failed for %s with return code %d", path, (int)num_read);
-        ret = -EIO;
-      } else {
-        // Either EOF, all read or read beyond size, but then there was an error
-        fh->bufferSize = total_read;
-        fh->buffersStartOffset = offset;
-
-        if (dfs->rdbuffer_size - total_read > 0) {
-          // assert(num_read == 0); this should be true since if num_read < 0 handled above.
-          isEOF = 1;
-        }
-      }
-    }
+static pthread_once_t gReplyPipeOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gReplyPipeKey;
+static int gReplyPipeKeyErr;
 
-  //
-  // NOTE on EOF, fh->bufferSize == 0 and ret = 0 ,so the logic for copying data into the caller's buffer is bypassed, and
-  //  the code returns 0 as required
-  //
-  if (ret == 0 && fh->bufferSize > 0) {
+static void dfs_reply_pipe_free(void *v)
+{
+  struct dfs_reply_pipe *p = v;
 
-    assert(offset >= fh->buffersStartOffset);
-    assert(fh->buf);
+  if (p->fds[0] >= 0) {
+    close(p->fds[0]);
+    close(p->fds[1]);
+  }
+  free(p);
+}
 
-    const size_t bufferReadIndex = offset - fh->buffersStartOffset;
-    assert(bufferReadIndex >= 0 && bufferReadIndex < fh->bufferSize);
+static void dfs_reply_pipe_key_init(void)
+{
+  gReplyPipeKeyErr = pthread_key_create(&gReplyPipeKey, dfs_reply_pipe_free);
+}
 
-    const size_t amount = min(fh->buffersStartOffset + fh->bufferSize - offset, size);
-    assert(amount >= 0 && amount <= fh->bufferSize);
+static void dfs_reply_pipe_close(struct dfs_reply_pipe *p)
+{
+  if (p->fds[0] >= 0) {
+    close(p->fds[0]);
+    close(p->fds[1]);
+  }
+  p->fds[0] = p->fds[1] = -1;
+  p->capacity = 0;
+}
 
-    const char *offsetPtr = fh->buf + bufferReadIndex;
-    assert(offsetPtr >= fh->buf);
-    assert(offsetPtr + amount <= fh->buf + fh->bufferSize);
-    
-    memcpy(buf, offsetPtr, amount);
+/**
+ * Get the calling thread's reply pipe, empty and with room for size bytes.
+ *
+ * @return the pipe, or NULL if there is none to be had
+ */
+static struct dfs_reply_pipe *dfs_get_reply_pipe(size_t size)
+{
+  struct dfs_reply_pipe *p;
+  int pending, capacity;
 
-    ret = amount;
+  pthread_once(&gReplyPipeOnce, dfs_reply_pipe_key_init);
+  if (gReplyPipeKeyErr) {
+    return NULL;
+  }
+  p = pthread_getspecific(gReplyPipeKey);
+  if (!p) {
+    p = malloc(sizeof(*p));
+    if (!p) {
+      return NULL;
+    }
+    p->fds[0] = p->fds[1] = -1;
+    p->capacity = 0;
+    if (pthread_setspecific(gReplyPipeKey, p)) {
+      free(p);
+      return NULL;
+    }
   }
+  // A reply that libfuse did not send in full leaves data behind
+  if (p->fds[0] >= 0 &&
+      (ioctl(p->fds[0], FIONREAD, &pending) || pending != 0)) {
+    dfs_reply_pipe_close(p);
+  }
+  if (p->fds[0] < 0) {
+    if (pipe2(p->fds, O_NONBLOCK | O_CLOEXEC)) {
+      p->fds[0] = p->fds[1] = -1;
+      return NULL;
+    }
+    capacity = fcntl(p->fds[1], F_GETPIPE_SZ);
+    p->capacity = capacity > 0 ? capacity : 0;
+  }
+  if (p->capacity < size) {
+    capacity = fcntl(p->fds[1], F_SETPIPE_SZ, (int)size);
+    if (capacity < 0) {
+      return NULL;
+    }
+    p->capacity = capacity;
+  }
+  return p;
+}
 
-  //
-  // Critical section end 
-  //
-  pthread_mutex_unlock(&fh->mutex);
- 
-  // fuse requires the below and the code should guarantee this assertion
-  // 3 cases on return:
-  //   1. entire read satisfied
-  //   2. partial read and isEOF - including 0 size read
-  //   3. error 
-  assert(ret == size || isEOF || ret < 0);
+/**
+ * dfs_read_buf
+ *
+ * Used instead of dfs_read with -ozero_copy_read.  Reads served from the
+ * open file's buffers are written to a pipe that libfuse splices to the
+ * kernel; other reads go to a buffer that libfuse frees, as with dfs_read.
+ */
+int dfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+                 off_t offset, struct fuse_file_info *fi)
+{
+  dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
+  dfs_fh *fh = (dfs_fh*)fi->fh;
+  struct fuse_bufvec *bv;
+  struct dfs_reply_pipe *p;
+  char *mem;
+  int ret;
 
- return ret;
+  TRACE1("read_buf",path)
+
+  assert(dfs);
+  assert(fh != NULL);
+
+  bv = malloc(sizeof(*bv));
+  if (!bv) {
+    return -ENOMEM;
+  }
+  *bv = FUSE_BUFVEC_INIT(0);
+  if (size == 0) {
+    *bufp = bv;
+    return 0;
+  }
+  if (size < dfs->rdbuffer_size) {
+    p = dfs_get_reply_pipe(size);
+    if (p) {
+      ret = dfs_read_slots(dfs, fh, NULL, p->fds[1], size, offset);
+      if (ret >= 0) {
+        bv->buf[0].size = ret;
+        bv->buf[0].flags = FUSE_BUF_IS_FD;
+        bv->buf[0].fd = p->fds[0];
+        *bufp = bv;
+        return 0;
+      }
+      if (ret != -EAGAIN) {
+        free(bv);
+        return ret;
+      }
+      dfs_reply_pipe_close(p);
+    }
+  }
+  mem = malloc(size);
+  if (!mem) {
+    free(bv);
+    return -ENOMEM;
+  }
+  ret = dfs_read(path, mem, size, offset, fi);
+  if (ret < 0) {
+    free(mem);
+    free(bv);
+    return ret;
+  }
+  bv->buf[0].size = ret;
+  bv->buf[0].mem = mem;
+  *bufp = bv;
+  return 0;
 }
+
+#endif
@@ -16,55 +16,78 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_stat_struct.h"
 #include "fuse_connect.h"
 
-int dfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                       off_t offset, struct fuse_file_info *fi)
-{
-  int ret;
-  struct hdfsConn *conn = NULL;
-  hdfsFS fs;
-  dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
+#include <pthread.h>
+#include <stdlib.h>
 
-  TRACE1("readdir", path)
+/** How many entries are fetched from HDFS at a time */
+#define DFS_READDIR_BATCH 1024
 
-  assert(dfs);
-  assert(path);
-  assert(buf);
-
-  ret = fuseConnectAsThreadUid(&conn);
-  if (ret) {
-    fprintf(stderr, "fuseConnectAsThreadUid: failed to open a libhdfs "
-            "connection!  error %d.\n", ret);
-    ret = -EIO;
-    goto cleanup;
-  }
-  fs = hdfsConnGetFs(conn);
+/**
+ * The state of an open directory.
+ *
+ * Entries are fetched from HDFS a batch at a time as the kernel asks for
+ * them, so the first ones are returned while the NameNode is still
+ * listing the rest and only one batch is held in memory.  The first batch
+ * is large enough to hold any listing the attribute cache keeps; if it
+ * turns out to be the whole directory, it is cached.
+ *
+ * Each item has an offset: "." is 0, ".." is 1, and the entries follow.
+ * The offset handed to filler with an item is the offset of the next one,
+ * which is the offset the kernel passes back to continue from there.
+ */
+struct dfs_dir {
+  pthread_mutex_t mutex;
+  char *path;
+  struct hdfsConn *conn; // NULL when the listing came from the cache
+  hdfsDir dir;           // NULL once the last batch has been fetched
+  struct fuseDirList *list; // the current batch
+  int whole;             // whether list holds the whole directory
+  int pos;               // the index in list of the next entry
+  off_t offset;          // the offset of the next item
+  uint64_t generation;   // taken before the listing was started
+};
 
-  // Read dirents. Calling a variant that just returns the final path
-  // component (HDFS-975) would save us from parsing it out below.
-  int numEntries = 0;
-  hdfsFileInfo *info = hdfsListDirectory(fs, path, &numEntries);
+/**
+ * Turn a batch from hdfsReadDirBatch into a listing, and remember the
+ * attributes of each entry for the getattr calls that usually follow.
+ *
+ * @return              The listing, to be released with free; NULL on OOM.
+ */
+static struct fuseDirList *make_dir_list(dfs_context *dfs, const char *path,
+                                         hdfsFileInfo *info, int numEntries,
+                                         uint64_t generation)
+{
+  struct fuseDirList *list;
+  size_t size, pathLen = strlen(path);
+  char *names, *childPath = NULL;
+  int i;
 
-  // NULL means either the directory doesn't exist or maybe IO error.
-  if (NULL == info) {
-    ret = (errno > 0) ? -errno : -ENOENT;
-    goto cleanup;
+  size = sizeof(*list) + numEntries * sizeof(list->entries[0]);
+  for (i = 0; i < numEntries; i++) {
+    if (info[i].mName) {
+      size += strlen(info[i].mName) + 1;
+    }
+  }
+  list = malloc(size);
+  if (!list) {
+    return NULL;
   }
+  list->size = size;
+  list->numEntries = 0;
+  names = (char*)&list->entries[numEntries];
 
-  int i ;
   for (i = 0; i < numEntries; i++) {
     if (NULL == info[i].mName) {
       ERROR("Path %s info[%d].mName is NULL", path, i);
       continue;
     }
 
-    struct stat st;
-    fill_stat_structure(&info[i], &st);
-
     // Find the final path component
     const char *str = strrchr(info[i].mName, '/');
     if (NULL == str) {
@@ -73,50 +96,263 @@ int dfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     }
     str++;
 
-    // pack this entry into the fuse buffer
-    int res = 0;
-    if ((res = filler(buf,str,&st,0)) != 0) {
-      ERROR("Readdir filler failed: %d\n",res);
+    struct fuseDirent *ent = &list->entries[list->numEntries++];
+    fill_stat_structure(&info[i], &ent->st);
+    strcpy(names, str);
+    ent->name = names;
+    names += strlen(str) + 1;
+
+    if (!(dfs->exact_nlink && info[i].mKind == kObjectKindDirectory)) {
+      size_t len = strlen(str);
+      char *tmp = realloc(childPath, pathLen + len + 2);
+      if (tmp) {
+        childPath = tmp;
+        snprintf(childPath, pathLen + len + 2, "%s/%s",
+                 (pathLen > 1) ? path : "", str);
+        fuseAttrCachePut(childPath, &ent->st, generation);
+      }
+    }
+  }
+  free(childPath);
+  return list;
+}
+
+/**
+ * Start listing a directory from the beginning.
+ *
+ * @return              0 on success; a negative errno otherwise
+ */
+static int dfs_dir_start(struct dfs_dir *d)
+{
+  d->pos = 0;
+  d->offset = 0;
+  if (d->whole) {
+    // The listing is all here; it only needs to be returned again
+    return 0;
+  }
+  free(d->list);
+  d->list = NULL;
+  if (d->dir) {
+    hdfsCloseDir(d->dir);
+  }
+  d->generation = fuseAttrCacheGeneration();
+  d->dir = hdfsOpenDir(hdfsConnGetFs(d->conn), d->path);
+  if (!d->dir) {
+    return (errno > 0) ? -errno : -ENOENT;
+  }
+  return 0;
+}
+
+/**
+ * Make sure d->list holds the next entry, unless the end of the directory
+ * has been reached.
+ *
+ * @return              1 if there is a next entry; 0 at the end of the
+ *                      directory; a negative errno otherwise
+ */
+static int dfs_dir_fill(dfs_context *dfs, struct dfs_dir *d)
+{
+  hdfsFileInfo *info;
+  int first, numEntries, maxEntries;
+
+  if (d->list && d->pos < d->list->numEntries) {
+    return 1;
+  }
+  if (d->whole) {
+    // list is re-used when the directory is read again
+    return 0;
+  }
+  // Usually the batch just returned is freed here, and an entry that
+  // make_dir_list skipped leaves a batch with nothing left to return
+  while (d->dir) {
+    first = (d->list == NULL && d->offset == 2);
+    maxEntries = first ? FUSE_ATTR_CACHE_MAX_DIRENTS + 1 : DFS_READDIR_BATCH;
+    numEntries = hdfsReadDirBatch(d->dir, maxEntries, &info);
+    if (numEntries < 0) {
+      ERROR("Could not list %s: error %d", d->path, errno);
+      return (errno > 0) ? -errno : -EIO;
+    }
+    if (numEntries < maxEntries) {
+      hdfsCloseDir(d->dir);
+      d->dir = NULL;
+    }
+    free(d->list);
+    d->list = NULL;
+    d->pos = 0;
+    if (numEntries == 0) {
+      break;
+    }
+    d->list = make_dir_list(dfs, d->path, info, numEntries, d->generation);
+    hdfsFreeFileInfo(info, numEntries);
+    if (!d->list) {
+      ERROR("Could not allocate the listing of %s", d->path);
+      return -ENOMEM;
+    }
+    if (first && !d->dir) {
+      d->whole = 1;
+      fuseAttrCachePutDir(d->path, d->list, d->generation);
+    }
+    if (d->list->numEntries > 0) {
+      return 1;
     }
   }
+  return 0;
+}
 
-  // insert '.' and '..'
+int dfs_opendir(const char *path, struct fuse_file_info *fi)
+{
+  struct dfs_dir *d;
+  int ret;
+
+  TRACE1("opendir", path)
+
+  assert(path);
+  assert('/' == *path);
+
+  d = calloc(1, sizeof(*d));
+  if (!d) {
+    return -ENOMEM;
+  }
+  ret = pthread_mutex_init(&d->mutex, NULL);
+  if (ret) {
+    free(d);
+    return -ret;
+  }
+  d->path = strdup(path);
+  if (!d->path) {
+    ret = -ENOMEM;
+    goto error;
+  }
+  d->list = fuseAttrCacheGetDir(path);
+  if (d->list) {
+    d->whole = 1;
+  } else {
+    ret = fuseConnectAsThreadUid(&d->conn);
+    if (ret) {
+      fprintf(stderr, "fuseConnectAsThreadUid: failed to open a libhdfs "
+              "connection!  error %d.\n", ret);
+      d->conn = NULL;
+      ret = -EIO;
+      goto error;
+    }
+    ret = dfs_dir_start(d);
+    if (ret) {
+      goto error;
+    }
+  }
+  fi->fh = (uint64_t)(uintptr_t)d;
+  return 0;
+
+error:
+  if (d->conn) {
+    hdfsConnRelease(d->conn);
+  }
+  free(d->path);
+  pthread_mutex_destroy(&d->mutex);
+  free(d);
+  return ret;
+}
+
+/**
+ * Fill in the attributes of "." and "..".
+ */
+static void dfs_dots_stat(struct stat *st)
+{
+  memset(st, 0, sizeof(struct stat));
+
+  // set to 0 to indicate not supported for directory because we cannot (efficiently) get this info for every subdirectory
+  st->st_nlink =  0;
+
+  // setup stat size and acl meta data
+  st->st_size    = 512;
+  st->st_blksize = 512;
+  st->st_blocks  =  1;
+  st->st_mode    = (S_IFDIR | 0777);
+  st->st_uid     = default_id;
+  st->st_gid     = default_id;
+  // todo fix below times
+  st->st_atime   = 0;
+  st->st_mtime   = 0;
+  st->st_ctime   = 0;
+}
+
+int dfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                       off_t offset, struct fuse_file_info *fi)
+{
+  struct dfs_dir *d = (struct dfs_dir*)(uintptr_t)fi->fh;
+  dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
   const char *const dots [] = { ".",".."};
-  for (i = 0 ; i < 2 ; i++)
-    {
-      struct stat st;
-      memset(&st, 0, sizeof(struct stat));
-
-      // set to 0 to indicate not supported for directory because we cannot (efficiently) get this info for every subdirectory
-      st.st_nlink =  0;
-
-      // setup stat size and acl meta data
-      st.st_size    = 512;
-      st.st_blksize = 512;
-      st.st_blocks  =  1;
-      st.st_mode    = (S_IFDIR | 0777);
-      st.st_uid     = default_id;
-      st.st_gid     = default_id;
-      // todo fix below times
-      st.st_atime   = 0;
-      st.st_mtime   = 0;
-      st.st_ctime   = 0;
-
-      const char *const str = dots[i];
-
-      // flatten the info using fuse's function into a buffer
-      int res = 0;
-      if ((res = filler(buf,str,&st,0)) != 0) {
-	ERROR("Readdir filler failed: %d\n",res);
+  struct stat dotsSt;
+  const char *name;
+  const struct stat *st;
+  int ret = 0;
+
+  TRACE1("readdir", path)
+
+  assert(dfs);
+  assert(path);
+  assert(buf);
+
+  if (!d) {
+    return -EBADF;
+  }
+  pthread_mutex_lock(&d->mutex);
+  if (offset < d->offset) {
+    // rewinddir or seekdir to an earlier entry
+    ret = dfs_dir_start(d);
+    if (ret) {
+      goto done;
+    }
+  }
+  dfs_dots_stat(&dotsSt);
+  for (;;) {
+    if (d->offset < 2) {
+      name = dots[d->offset];
+      st = &dotsSt;
+    } else {
+      ret = dfs_dir_fill(dfs, d);
+      if (ret <= 0) {
+        break;
       }
+      name = d->list->entries[d->pos].name;
+      st = &d->list->entries[d->pos].st;
     }
-  // free the info pointers
-  hdfsFreeFileInfo(info,numEntries);
-  ret = 0;
-
-cleanup:
-  if (conn) {
-    hdfsConnRelease(conn);
+    // seekdir to a later entry skips the ones before it
+    if (d->offset >= offset && filler(buf, name, st, d->offset + 1)) {
+      // the kernel's buffer is full; this entry goes in the next call
+      ret = 0;
+      break;
+    }
+    if (d->offset >= 2) {
+      d->pos++;
+    }
+    d->offset++;
   }
+
+done:
+  pthread_mutex_unlock(&d->mutex);
   return ret;
 }
+
+int dfs_releasedir(const char *path, struct fuse_file_info *fi)
+{
+  struct dfs_dir *d = (struct dfs_dir*)(uintptr_t)fi->fh;
+
+  TRACE1("releasedir", path)
+
+  if (!d) {
+    return 0;
+  }
+  if (d->dir) {
+    hdfsCloseDir(d->dir);
+  }
+  if (d->conn) {
+    hdfsConnRelease(d->conn);
+  }
+  free(d->list);
+  free(d->path);
+  pthread_mutex_destroy(&d->mutex);
+  free(d);
+  fi->fh = 0;
+  return 0;
+}
@@ -16,10 +16,12 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_file_handle.h"
 #include "fuse_connect.h"
+#include "fuse_stats.h"
 
 #include <stdlib.h>
 
@@ -47,20 +49,38 @@ int dfs_release (const char *path, struct fuse_file_info *fi) {
   assert(dfs);
   assert('/' == *path);
 
-  int ret = 0;
+  int i, ret = 0;
   dfs_fh *fh = (dfs_fh*)fi->fh;
   assert(fh);
   hdfsFile file_handle = (hdfsFile)fh->hdfsFH;
+  // prefetch threads read through file_handle
+  pthread_mutex_lock(&fh->mutex);
+  while (fh->prefetchesRunning > 0) {
+    pthread_cond_wait(&fh->cond, &fh->mutex);
+  }
+  pthread_mutex_unlock(&fh->mutex);
+  ret = dfs_write_finish(fh);
+  if (ret) {
+    ERROR("Could not write the buffered data for %s: error %d", path, ret);
+  }
   if (NULL != file_handle) {
     if (hdfsCloseFile(hdfsConnGetFs(fh->conn), file_handle) != 0) {
       ERROR("Could not close handle %ld for %s\n",(long)file_handle, path);
       ret = -EIO;
     }
   }
-  free(fh->buf);
+  if (fi->flags & (O_WRONLY | O_CREAT)) {
+    fuseAttrCacheInvalidate(path);
+  }
+  for (i = 0; i < DFS_READ_SLOTS; i++) {
+    free(fh->slots[i].buf);
+  }
+  free(fh->cachePath);
   hdfsConnRelease(fh->conn);
   pthread_mutex_destroy(&fh->mutex);
+  pthread_cond_destroy(&fh->cond);
   free(fh);
   fi->fh = 0;
+  fuseStatsAdd(FUSE_STATS_OPEN_FILES, -1);
   return ret;
 }
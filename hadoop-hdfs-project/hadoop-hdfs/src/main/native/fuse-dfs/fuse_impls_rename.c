@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_trash.h"
@@ -56,6 +57,8 @@ int dfs_rename(const char *from, const char *to)
     goto cleanup;
   }
   fs = hdfsConnGetFs(conn);
+  fuseAttrCacheInvalidate(from);
+  fuseAttrCacheInvalidate(to);
   if (hdfsRename(fs, from, to)) {
     ERROR("Rename %s to %s failed", from, to);
     ret = (errno > 0) ? -errno : -EIO;
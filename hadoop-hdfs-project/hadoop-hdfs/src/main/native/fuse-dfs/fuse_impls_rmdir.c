@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_trash.h"
@@ -64,6 +65,7 @@ int dfs_rmdir(const char *path)
     goto cleanup;
   }
 
+  fuseAttrCacheInvalidate(path);
   if (hdfsDeleteWithTrash(fs, path, dfs->usetrash)) {
     ERROR("Error trying to delete directory %s", path);
     ret = -EIO;
@@ -19,12 +19,130 @@
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_connect.h"
+#include "fuse_users.h"
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * The last statfs result, refreshed every statfs_interval seconds by a
+ * thread of its own, so that statfs callers never wait for the NameNode
+ * once it has been filled in.
+ */
+static pthread_mutex_t gStatfsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct statvfs gStatfs;
+static int gStatfsValid;
+static int gStatfsRefreshing;
+
+struct dfs_statfs_refresh {
+  int interval;
+  /** Who the refreshes connect as: the first caller of statfs */
+  char *usrname;
+  struct fuse_context ctx;
+};
+
+/**
+ * Ask HDFS for the figures statfs reports.
+ *
+ * @return 0 on success; -EIO otherwise
+ */
+static int dfs_fetch_statfs(struct hdfsConn *conn, struct statvfs *st)
+{
+  hdfsFS fs = hdfsConnGetFs(conn);
+
+  const tOffset cap   = hdfsGetCapacity(fs);
+  const tOffset used  = hdfsGetUsed(fs);
+  const tOffset bsize = hdfsGetDefaultBlockSize(fs);
+
+  if (cap < 0 || used < 0 || bsize <= 0) {
+    return -EIO;
+  }
+  memset(st,0,sizeof(struct statvfs));
+  st->f_bsize   =  bsize;
+  st->f_frsize  =  bsize;
+  st->f_blocks  =  cap/bsize;
+  st->f_bfree   =  (cap-used)/bsize;
+  st->f_bavail  =  (cap-used)/bsize;
+  st->f_files   =  1000;
+  st->f_ffree   =  500;
+  st->f_favail  =  500;
+  st->f_fsid    =  1023;
+  st->f_flag    =  ST_RDONLY | ST_NOSUID;
+  st->f_namemax =  1023;
+  return 0;
+}
+
+static void *dfs_statfs_refresher(void *v)
+{
+  struct dfs_statfs_refresh *r = (struct dfs_statfs_refresh*)v;
+  struct hdfsConn *conn;
+  struct statvfs st;
+  int ret;
+
+  for (;;) {
+    sleep(r->interval);
+    ret = fuseConnect(r->usrname, &r->ctx, &conn);
+    if (ret) {
+      ERROR("dfs_statfs_refresher: fuseConnect(%s) failed with error %d; "
+            "keeping the last statfs result", r->usrname, ret);
+      continue;
+    }
+    ret = dfs_fetch_statfs(conn, &st);
+    hdfsConnRelease(conn);
+    if (ret) {
+      ERROR("dfs_statfs_refresher: could not get the capacity of the "
+            "filesystem; keeping the last statfs result");
+      continue;
+    }
+    pthread_mutex_lock(&gStatfsLock);
+    gStatfs = st;
+    pthread_mutex_unlock(&gStatfsLock);
+  }
+  return NULL;
+}
+
+/**
+ * Start refreshing gStatfs in the background, as the calling FUSE thread's
+ * user.
+ *
+ * Called with gStatfsLock held.
+ */
+static void dfs_start_statfs_refresher(int interval)
+{
+  struct dfs_statfs_refresh *r;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int ret;
+
+  r = calloc(1, sizeof(*r));
+  if (!r) {
+    return;
+  }
+  r->interval = interval;
+  r->ctx = *fuse_get_context();
+  r->usrname = getUsername(r->ctx.uid);
+  if (!r->usrname) {
+    free(r);
+    return;
+  }
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = pthread_create(&thread, &attr, dfs_statfs_refresher, r);
+  pthread_attr_destroy(&attr);
+  if (ret) {
+    ERROR("dfs_statfs: could not start the statfs refresher: error %d; "
+          "statfs will keep returning the same figures", ret);
+    free(r->usrname);
+    free(r);
+    return;
+  }
+  gStatfsRefreshing = 1;
+}
 
 int dfs_statfs(const char *path, struct statvfs *st)
 {
   struct hdfsConn *conn = NULL;
-  hdfsFS fs;
   dfs_context *dfs = (dfs_context*)fuse_get_context()->private_data;
   int ret;
 
@@ -34,7 +152,15 @@ int dfs_statfs(const char *path, struct statvfs *st)
   assert(st);
   assert(dfs);
 
-  memset(st,0,sizeof(struct statvfs));
+  if (dfs->statfs_interval > 0) {
+    pthread_mutex_lock(&gStatfsLock);
+    if (gStatfsValid) {
+      *st = gStatfs;
+      pthread_mutex_unlock(&gStatfsLock);
+      return 0;
+    }
+    pthread_mutex_unlock(&gStatfsLock);
+  }
 
   ret = fuseConnectAsThreadUid(&conn);
   if (ret) {
@@ -43,24 +169,16 @@ int dfs_statfs(const char *path, struct statvfs *st)
     ret = -EIO;
     goto cleanup;
   }
-  fs = hdfsConnGetFs(conn);
-
-  const tOffset cap   = hdfsGetCapacity(fs);
-  const tOffset used  = hdfsGetUsed(fs);
-  const tOffset bsize = hdfsGetDefaultBlockSize(fs);
-
-  st->f_bsize   =  bsize;
-  st->f_frsize  =  bsize;
-  st->f_blocks  =  cap/bsize;
-  st->f_bfree   =  (cap-used)/bsize;
-  st->f_bavail  =  (cap-used)/bsize;
-  st->f_files   =  1000;
-  st->f_ffree   =  500;
-  st->f_favail  =  500;
-  st->f_fsid    =  1023;
-  st->f_flag    =  ST_RDONLY | ST_NOSUID;
-  st->f_namemax =  1023;
-  ret = 0;
+  ret = dfs_fetch_statfs(conn, st);
+  if (ret == 0 && dfs->statfs_interval > 0) {
+    pthread_mutex_lock(&gStatfsLock);
+    gStatfs = *st;
+    gStatfsValid = 1;
+    if (!gStatfsRefreshing) {
+      dfs_start_statfs_refresher(dfs->statfs_interval);
+    }
+    pthread_mutex_unlock(&gStatfsLock);
+  }
 
 cleanup:
   if (conn) {
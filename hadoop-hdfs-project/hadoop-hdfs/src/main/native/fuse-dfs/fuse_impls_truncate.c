@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_connect.h"
@@ -65,6 +66,7 @@ int dfs_truncate(const char *path, off_t size)
     goto cleanup;
   }
 
+  fuseAttrCacheInvalidate(path);
   if (hdfsCloseFile(fs, file) != 0) {
     ERROR("Could not close file %s", path);
     ret = -EIO;
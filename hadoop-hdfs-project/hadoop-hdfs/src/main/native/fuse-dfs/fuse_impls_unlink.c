@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_connect.h"
@@ -55,6 +56,7 @@ int dfs_unlink(const char *path)
   }
   fs = hdfsConnGetFs(conn);
 
+  fuseAttrCacheInvalidate(path);
   if (hdfsDeleteWithTrash(fs, path, dfs->usetrash)) {
     ERROR("Could not delete file %s", path);
     ret = (errno > 0) ? -errno : -EIO;
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_impls.h"
 #include "fuse_connect.h"
@@ -45,6 +46,7 @@ int dfs_utimens(const char *path, const struct timespec ts[2])
   }
   fs = hdfsConnGetFs(conn);
 
+  fuseAttrCacheInvalidate(path);
   if (hdfsUtime(fs, path, mTime, aTime)) {
     hdfsFileInfo *info = hdfsGetPathInfo(fs, path);
     if (info == NULL) {
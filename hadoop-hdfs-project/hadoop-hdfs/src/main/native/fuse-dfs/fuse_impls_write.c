@@ -21,6 +21,238 @@
 #include "fuse_impls.h"
 #include "fuse_file_handle.h"
 
+#include <stdlib.h>
+
+static size_t min(const size_t x, const size_t y) {
+  return x < y ? x : y;
+}
+
+/**
+ * Write all of a buffer to HDFS.
+ *
+ * @return 0 on success; a negative errno otherwise
+ */
+static int dfs_write_all(hdfsFS fs, hdfsFile file, const char *buf, size_t size)
+{
+  size_t total = 0;
+
+  while (total < size) {
+    tSize length = hdfsWrite(fs, file, buf + total, size - total);
+    if (length <= 0) {
+      ERROR("Could not write all bytes: %zd of %zd written (errno=%d)",
+            total, size, errno);
+      return (errno == 0 || errno == EINTERNAL) ? -EIO : -errno;
+    }
+    total += length;
+  }
+  return 0;
+}
+
+/**
+ * The writer thread of a handle: sends each buffer it is handed to HDFS,
+ * until it is told to stop.
+ */
+static void *dfs_writer(void *v)
+{
+  dfs_fh *fh = (dfs_fh*)v;
+  hdfsFS fs = hdfsConnGetFs(fh->conn);
+
+  pthread_mutex_lock(&fh->mutex);
+  for (;;) {
+    while (fh->flushLen == 0 && !fh->writerStop) {
+      pthread_cond_wait(&fh->cond, &fh->mutex);
+    }
+    if (fh->flushLen == 0) {
+      break;
+    }
+    pthread_mutex_unlock(&fh->mutex);
+    int ret = dfs_write_all(fs, fh->hdfsFH, fh->flushBuf, fh->flushLen);
+    pthread_mutex_lock(&fh->mutex);
+    if (ret && !fh->writeError) {
+      fh->writeError = ret;
+    }
+    fh->flushLen = 0;
+    pthread_cond_broadcast(&fh->cond);
+  }
+  pthread_mutex_unlock(&fh->mutex);
+  return NULL;
+}
+
+/**
+ * Hand the full write buffer to the writer thread, once it is done with
+ * the last one.  If the thread cannot be had, the buffer is
+ * written here instead.
+ *
+ * Called with fh->mutex held.
+ *
+ * @return 0 on success; a negative errno otherwise
+ */
+static int dfs_hand_off(dfs_fh *fh, size_t capacity)
+{
+  char *tmp;
+  int ret;
+
+  while (fh->flushLen > 0) {
+    pthread_cond_wait(&fh->cond, &fh->mutex);
+  }
+  if (fh->writeError) {
+    return fh->writeError;
+  }
+  if (fh->flushBuf == NULL) {
+    fh->flushBuf = (char*)malloc(capacity);
+  }
+  if (fh->flushBuf && !fh->writerRunning) {
+    ret = pthread_create(&fh->writerThread, NULL, dfs_writer, fh);
+    if (ret) {
+      ERROR("Could not create a writer thread: error %d", ret);
+    } else {
+      fh->writerRunning = 1;
+    }
+  }
+  if (!fh->writerRunning) {
+    ret = dfs_write_all(hdfsConnGetFs(fh->conn), fh->hdfsFH,
+                        fh->writeBuf, fh->writeLen);
+    fh->writeLen = 0;
+    if (ret) {
+      fh->writeError = ret;
+    }
+    return ret;
+  }
+  tmp = fh->flushBuf;
+  fh->flushBuf = fh->writeBuf;
+  fh->writeBuf = tmp;
+  fh->flushLen = fh->writeLen;
+  fh->writeLen = 0;
+  pthread_cond_broadcast(&fh->cond);
+  return 0;
+}
+
+int dfs_write_drain(dfs_fh *fh)
+{
+  int ret;
+
+  pthread_mutex_lock(&fh->mutex);
+  while (fh->writeBusy || fh->flushLen > 0) {
+    pthread_cond_wait(&fh->cond, &fh->mutex);
+  }
+  // The caller is about to wait for HDFS anyway, so the rest is written
+  // here rather than handed off
+  if (fh->writeLen > 0 && !fh->writeError) {
+    fh->writeError = dfs_write_all(hdfsConnGetFs(fh->conn), fh->hdfsFH,
+                                   fh->writeBuf, fh->writeLen);
+    fh->writeLen = 0;
+  }
+  ret = fh->writeError;
+  pthread_mutex_unlock(&fh->mutex);
+  return ret;
+}
+
+int dfs_write_finish(dfs_fh *fh)
+{
+  int ret = dfs_write_drain(fh);
+
+  if (fh->writerRunning) {
+    pthread_mutex_lock(&fh->mutex);
+    fh->writerStop = 1;
+    pthread_cond_broadcast(&fh->cond);
+    pthread_mutex_unlock(&fh->mutex);
+    pthread_join(fh->writerThread, NULL);
+    fh->writerRunning = 0;
+  }
+  free(fh->writeBuf);
+  free(fh->flushBuf);
+  fh->writeBuf = fh->flushBuf = NULL;
+  return ret;
+}
+
+/**
+ * Find out where the next write to a handle must start, the first time it
+ * is needed.  After that it is tracked on the handle, which saves an
+ * hdfsTell per write.
+ *
+ * Called with fh->mutex held.
+ *
+ * @return 0 on success; -EIO otherwise
+ */
+static int dfs_init_write_offset(dfs_fh *fh, const char *path)
+{
+  if (fh->writeOffset < 0) {
+    fh->writeOffset = hdfsTell(hdfsConnGetFs(fh->conn), fh->hdfsFH);
+    if (fh->writeOffset < 0) {
+      ERROR("Could not get the offset of %s (errno=%d)", path, errno);
+      return -EIO;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Write through a handle's write buffer.  Besides appending, a write may
+ * rewrite data that is still in the buffer, as tools that go back to fill
+ * in a header do.
+ *
+ * Called with fh->mutex held.
+ */
+static int dfs_write_buffered(dfs_context *dfs, dfs_fh *fh, const char *path,
+                              const char *buf, size_t size, off_t offset)
+{
+  const size_t capacity = dfs->wrbuffer_size;
+  size_t copied = 0;
+  int ret;
+
+  while (fh->writeBusy) {
+    pthread_cond_wait(&fh->cond, &fh->mutex);
+  }
+  if (fh->writeError) {
+    return fh->writeError;
+  }
+  ret = dfs_init_write_offset(fh, path);
+  if (ret) {
+    return ret;
+  }
+  // What is in the buffer may still change; what was handed off may not
+  const tOffset bufferStart = fh->writeOffset - fh->writeLen;
+  if (offset < bufferStart || offset > fh->writeOffset) {
+    ERROR("User trying to random access write to a file %d not in [%d, %d] "
+          "for %s", (int)offset, (int)bufferStart, (int)fh->writeOffset, path);
+    return -ENOTSUP;
+  }
+  if (fh->writeBuf == NULL) {
+    fh->writeBuf = (char*)malloc(capacity);
+    if (fh->writeBuf == NULL) {
+      ERROR("Could not allocate a write buffer of %zd bytes for %s",
+            capacity, path);
+      return -ENOMEM;
+    }
+  }
+  // dfs_hand_off may drop the lock, so keep other writes out until this
+  // one is all in the buffer
+  fh->writeBusy = 1;
+  ret = size;
+  if (offset < fh->writeOffset) {
+    copied = min(fh->writeOffset - offset, size);
+    memcpy(fh->writeBuf + (offset - bufferStart), buf, copied);
+  }
+  const size_t rewritten = copied;
+  while (copied < size) {
+    size_t amount = min(capacity - fh->writeLen, size - copied);
+    memcpy(fh->writeBuf + fh->writeLen, buf + copied, amount);
+    fh->writeLen += amount;
+    copied += amount;
+    if (fh->writeLen == capacity) {
+      ret = dfs_hand_off(fh, capacity);
+      if (ret) {
+        break;
+      }
+      ret = size;
+    }
+  }
+  fh->writeOffset += copied - rewritten;
+  fh->writeBusy = 0;
+  pthread_cond_broadcast(&fh->cond);
+  return ret;
+}
+
 int dfs_write(const char *path, const char *buf, size_t size,
                      off_t offset, struct fuse_file_info *fi)
 {
@@ -43,20 +275,26 @@ int dfs_write(const char *path, const char *buf, size_t size,
   assert(file_handle);
 
   //
-  // Critical section - make the sanity check (tell to see the writes are sequential) and the actual write 
+  // Critical section - make the sanity check (that the writes are sequential) and the actual write 
   // (no returns until end)
   //
   pthread_mutex_lock(&fh->mutex);
 
+  if (dfs->wrbuffer_size > 0) {
+    ret = dfs_write_buffered(dfs, fh, path, buf, size, offset);
+    pthread_mutex_unlock(&fh->mutex);
+    return ret;
+  }
+
   tSize length = 0;
   hdfsFS fs = hdfsConnGetFs(fh->conn);
 
-  tOffset cur_offset = hdfsTell(fs, file_handle);
-  if (cur_offset != offset) {
+  ret = dfs_init_write_offset(fh, path);
+  if (ret == 0 && fh->writeOffset != offset) {
     ERROR("User trying to random access write to a file %d != %d for %s",
-	  (int)cur_offset, (int)offset, path);
+	  (int)fh->writeOffset, (int)offset, path);
     ret =  -ENOTSUP;
-  } else {
+  } else if (ret == 0) {
     length = hdfsWrite(fs, file_handle, buf, size);
     if (length <= 0) {
       ERROR("Could not write all bytes for %s %d != %d (errno=%d)", 
@@ -71,6 +309,9 @@ int dfs_write(const char *path, const char *buf, size_t size,
       ERROR("Could not write all bytes for %s %d != %d (errno=%d)", 
 	    path, length, (int)size, errno);
     }
+    if (length > 0) {
+      fh->writeOffset += length;
+    }
   }
 
   //
@@ -16,11 +16,15 @@
  * limitations under the License.
  */
 
+#include "fuse_attr_cache.h"
+#include "fuse_block_cache.h"
 #include "fuse_dfs.h"
 #include "fuse_init.h"
 #include "fuse_options.h"
 #include "fuse_context_handle.h"
 #include "fuse_connect.h"
+#include "fuse_read_pool.h"
+#include "fuse_stats.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -91,11 +95,17 @@ static void dfsPrintOptions(FILE *fp, const struct options *o)
   INFO("Mounting with options: [ protected=%s, nn_uri=%s, nn_port=%d, "
           "debug=%d, read_only=%d, initchecks=%d, "
           "no_permissions=%d, usetrash=%d, entry_timeout=%d, "
-          "attribute_timeout=%d, rdbuffer_size=%zd, direct_io=%d ]",
+          "attribute_timeout=%d, rdbuffer_size=%zd, wrbuffer_size=%zd, "
+          "block_cache_mb=%d, read_threads=%d, statfs_interval=%d, "
+          "direct_io=%d, "
+          "exact_nlink=%d, zero_copy_read=%d ]",
           (o->protected ? o->protected : "(NULL)"), o->nn_uri, o->nn_port, 
           o->debug, o->read_only, o->initchecks,
           o->no_permissions, o->usetrash, o->entry_timeout,
-          o->attribute_timeout, o->rdbuffer_size, o->direct_io);
+          o->attribute_timeout, o->rdbuffer_size, o->wrbuffer_size,
+          o->block_cache_mb, o->read_threads, o->statfs_interval,
+          o->direct_io,
+          o->exact_nlink, o->zero_copy_read);
 }
 
 void *dfs_init(void)
@@ -118,7 +128,10 @@ void *dfs_init(void)
   dfs->usetrash              = options.usetrash;
   dfs->protectedpaths        = NULL;
   dfs->rdbuffer_size         = options.rdbuffer_size;
+  dfs->wrbuffer_size         = options.wrbuffer_size;
   dfs->direct_io             = options.direct_io;
+  dfs->exact_nlink           = options.exact_nlink;
+  dfs->statfs_interval       = options.statfs_interval;
 
   dfsPrintOptions(stderr, &options);
 
@@ -130,6 +143,20 @@ void *dfs_init(void)
     dfs->rdbuffer_size = 32768;
   }
 
+  // The kernel caches attributes for as long as this too, but only for
+  // paths it has looked up; ours also keeps what readdir returns.  Our
+  // entries are shared between users, which is only safe when the kernel
+  // checks permissions against them.
+  fuseAttrCacheInit(options.no_permissions ? 0 : options.attribute_timeout);
+  fuseBlockCacheInit(options.block_cache_mb > 0 ?
+                     (size_t)options.block_cache_mb * 1024 * 1024 : 0);
+  if (options.read_threads > 0 && fuseReadPoolInit(options.read_threads)) {
+    ERROR("dfs_init: large reads will use fewer threads");
+  }
+  if (fuseStatsInit()) {
+    ERROR("dfs_init: SIGUSR1 will not log statistics");
+  }
+
   ret = fuseConnectInit(options.nn_uri, options.nn_port);
   if (ret) {
     ERROR("FATAL: dfs_init: fuseConnectInit failed with error %d!", ret);
@@ -151,4 +178,6 @@ void *dfs_init(void)
 void dfs_destroy(void *ptr)
 {
   TRACE("destroy")
+
+  fuseStatsDump();
 }
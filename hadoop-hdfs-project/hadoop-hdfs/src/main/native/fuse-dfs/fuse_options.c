@@ -37,11 +37,19 @@ void print_options() {
 	 "\tentry_timeout=%d\n"
 	 "\tattribute_timeout=%d\n"
 	 "\tprivate=%d\n"
-	 "\trdbuffer_size=%d (KBs)\n", 
+	 "\trdbuffer_size=%d (KBs)\n"
+	 "\twrbuffer_size=%d (KBs)\n"
+	 "\tblock_cache=%d (MBs)\n"
+	 "\tread_threads=%d\n"
+	 "\tstatfs_interval=%d\n"
+	 "\texact_nlink=%d\n"
+	 "\tzero_copy_read=%d\n", 
 	 options.protected, options.nn_uri, options.nn_port, options.debug,
 	 options.read_only, options.usetrash, options.entry_timeout, 
 	 options.attribute_timeout, options.private, 
-	 (int)options.rdbuffer_size / 1024);
+	 (int)options.rdbuffer_size / 1024, (int)options.wrbuffer_size / 1024,
+	 options.block_cache_mb, options.read_threads, options.statfs_interval,
+	 options.exact_nlink, options.zero_copy_read);
 }
 
 const char *program;
@@ -56,7 +64,11 @@ void print_usage(const char *pname)
 	 "[-ousetrash] [-obig_writes] [-oprivate (single user)] [ro] "
 	 "[-oserver=<hadoop_servername>] [-oport=<hadoop_port>] "
 	 "[-oentry_timeout=<secs>] [-oattribute_timeout=<secs>] "
-	 "[-odirect_io] [-onopoermissions] [-o<other fuse option>] "
+	 "[-ordbuffer=<bytes>] [-owrbuffer=<bytes>] [-oblock_cache=<MBs>] "
+	 "[-oread_threads=<num>] [-ostatfs_interval=<secs>] "
+	 "[-odirect_io] [-onopoermissions] [-oexact_nlink] "
+	 "[-ozero_copy_read] "
+	 "[-o<other fuse option>] "
 	 "<mntpoint> [fuse options]\n", pname);
   printf("NOTE: debugging option for fuse is -debug\n");
 }
@@ -77,6 +89,8 @@ enum
     KEY_INITCHECKS,
     KEY_NOPERMISSIONS,
     KEY_DIRECTIO,
+    KEY_EXACT_NLINK,
+    KEY_ZERO_COPY_READ,
   };
 
 struct fuse_opt dfs_opts[] =
@@ -87,6 +101,10 @@ struct fuse_opt dfs_opts[] =
     DFSFS_OPT_KEY("protected=%s", protected, 0),
     DFSFS_OPT_KEY("port=%d", nn_port, 0),
     DFSFS_OPT_KEY("rdbuffer=%d", rdbuffer_size,0),
+    DFSFS_OPT_KEY("wrbuffer=%d", wrbuffer_size,0),
+    DFSFS_OPT_KEY("block_cache=%d", block_cache_mb,0),
+    DFSFS_OPT_KEY("read_threads=%d", read_threads,0),
+    DFSFS_OPT_KEY("statfs_interval=%d", statfs_interval,0),
 
     FUSE_OPT_KEY("private", KEY_PRIVATE),
     FUSE_OPT_KEY("ro", KEY_RO),
@@ -98,6 +116,8 @@ struct fuse_opt dfs_opts[] =
     FUSE_OPT_KEY("usetrash", KEY_USETRASH),
     FUSE_OPT_KEY("notrash", KEY_NOTRASH),
     FUSE_OPT_KEY("direct_io", KEY_DIRECTIO),
+    FUSE_OPT_KEY("exact_nlink", KEY_EXACT_NLINK),
+    FUSE_OPT_KEY("zero_copy_read", KEY_ZERO_COPY_READ),
     FUSE_OPT_KEY("-v",             KEY_VERSION),
     FUSE_OPT_KEY("--version",      KEY_VERSION),
     FUSE_OPT_KEY("-h",             KEY_HELP),
@@ -148,6 +168,19 @@ int dfs_options(void *data, const char *arg, int key,  struct fuse_args *outargs
   case KEY_DIRECTIO:
     options.direct_io = 1;
     break;
+  case KEY_EXACT_NLINK:
+    options.exact_nlink = 1;
+    break;
+  case KEY_ZERO_COPY_READ:
+#if FUSE_VERSION >= 29
+    // replies are spliced to the fuse device from the pipe read_buf fills
+    options.zero_copy_read = 1;
+    fuse_opt_add_arg(outargs, "-osplice_write");
+    fuse_opt_add_arg(outargs, "-osplice_move");
+#else
+    INFO("Ignoring zero_copy_read: it needs fuse 2.9 or later");
+#endif
+    break;
   case KEY_BIGWRITES:
 #ifdef FUSE_CAP_BIG_WRITES
     fuse_opt_add_arg(outargs, "-obig_writes");
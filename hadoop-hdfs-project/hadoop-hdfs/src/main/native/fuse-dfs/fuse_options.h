@@ -33,7 +33,13 @@ struct options {
   int attribute_timeout;
   int private;
   size_t rdbuffer_size;
+  size_t wrbuffer_size;
+  int block_cache_mb;
+  int read_threads;
+  int statfs_interval;
   int direct_io;
+  int exact_nlink;
+  int zero_copy_read;
 } options;
 
 extern struct fuse_opt dfs_opts[];
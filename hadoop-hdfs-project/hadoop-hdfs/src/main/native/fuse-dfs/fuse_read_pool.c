@@ -0,0 +1,163 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fuse_dfs.h"
+#include "fuse_read_pool.h"
+
+#include <pthread.h>
+
+struct fuseReadJob {
+  fuseReadPoolFn fn;
+  void *arg;
+  int count;
+  /** The next task to hand out */
+  int next;
+  /** How many tasks have finished */
+  int done;
+  /** Signalled when the last task finishes */
+  pthread_cond_t finished;
+  /** The job queued after this one */
+  struct fuseReadJob *queued;
+};
+
+static pthread_mutex_t gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gPoolWork = PTHREAD_COND_INITIALIZER;
+/** Jobs with tasks left to hand out, oldest first */
+static struct fuseReadJob *gJobs;
+static int gNumThreads;
+
+/**
+ * Take the job off the queue once its last task has been handed out.
+ *
+ * Called with gPoolLock held.
+ */
+static void dequeueIfTaken(struct fuseReadJob *job)
+{
+  struct fuseReadJob **link;
+
+  if (job->next < job->count) {
+    return;
+  }
+  for (link = &gJobs; *link; link = &(*link)->queued) {
+    if (*link == job) {
+      *link = job->queued;
+      break;
+    }
+  }
+}
+
+/**
+ * Run a task of a job, and count it as done.
+ *
+ * Called with gPoolLock held, and job->next < job->count.
+ */
+static void runTask(struct fuseReadJob *job)
+{
+  const int index = job->next++;
+
+  dequeueIfTaken(job);
+  pthread_mutex_unlock(&gPoolLock);
+  job->fn(job->arg, index);
+  pthread_mutex_lock(&gPoolLock);
+  if (++job->done == job->count) {
+    pthread_cond_signal(&job->finished);
+  }
+}
+
+static void *poolThread(void *v)
+{
+  pthread_mutex_lock(&gPoolLock);
+  for (;;) {
+    while (gJobs == NULL) {
+      pthread_cond_wait(&gPoolWork, &gPoolLock);
+    }
+    runTask(gJobs);
+  }
+  return NULL;
+}
+
+int fuseReadPoolInit(int numThreads)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int i, ret = 0;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (i = 0; i < numThreads; i++) {
+    ret = pthread_create(&thread, &attr, poolThread, NULL);
+    if (ret) {
+      ERROR("fuseReadPoolInit: could only start %d of %d threads: error %d",
+            i, numThreads, ret);
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  pthread_mutex_lock(&gPoolLock);
+  gNumThreads = i;
+  pthread_mutex_unlock(&gPoolLock);
+  return ret;
+}
+
+int fuseReadPoolSize(void)
+{
+  int numThreads;
+
+  pthread_mutex_lock(&gPoolLock);
+  numThreads = gNumThreads;
+  pthread_mutex_unlock(&gPoolLock);
+  return numThreads;
+}
+
+void fuseReadPoolRun(fuseReadPoolFn fn, void *arg, int count)
+{
+  struct fuseReadJob job, **link;
+  int i;
+
+  if (count <= 0) {
+    return;
+  }
+  if (count == 1 || fuseReadPoolSize() == 0) {
+    for (i = 0; i < count; i++) {
+      fn(arg, i);
+    }
+    return;
+  }
+  job.fn = fn;
+  job.arg = arg;
+  job.count = count;
+  job.next = 0;
+  job.done = 0;
+  job.queued = NULL;
+  pthread_cond_init(&job.finished, NULL);
+  pthread_mutex_lock(&gPoolLock);
+  for (link = &gJobs; *link; link = &(*link)->queued) {
+  }
+  *link = &job;
+  pthread_cond_broadcast(&gPoolWork);
+  // Work on the job too, rather than wait for threads that may be busy
+  // with other reads
+  while (job.next < job.count) {
+    runTask(&job);
+  }
+  while (job.done < job.count) {
+    pthread_cond_wait(&job.finished, &gPoolLock);
+  }
+  pthread_mutex_unlock(&gPoolLock);
+  pthread_cond_destroy(&job.finished);
+}
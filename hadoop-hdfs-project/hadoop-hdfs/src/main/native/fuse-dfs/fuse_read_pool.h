@@ -0,0 +1,61 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FUSE_READ_POOL_H__
+#define __FUSE_READ_POOL_H__
+
+/**
+ * A pool of threads that share the work of large reads.
+ *
+ * A read is split into tasks that the pool's threads and the reading thread
+ * run together.  The threads live as long as the mount, so each attaches to
+ * the JVM once and keeps its JNIEnv, rather than a thread being made and
+ * attached for every read.
+ */
+
+/**
+ * Run one task of a job.
+ *
+ * @param arg           The argument given to fuseReadPoolRun.
+ * @param index         Which task, from 0 to the job's count - 1.
+ */
+typedef void (*fuseReadPoolFn)(void *arg, int index);
+
+/**
+ * Start the pool's threads.
+ *
+ * @param numThreads    How many threads to start.  0 runs every task on the
+ *                      thread that asks for it.
+ *
+ * @return              0 on success; the error number otherwise.  Fewer
+ *                      threads may have been started.
+ */
+int fuseReadPoolInit(int numThreads);
+
+/**
+ * @return              How many threads the pool has.
+ */
+int fuseReadPoolSize(void);
+
+/**
+ * Run count tasks of a job, on the pool's threads and the calling thread,
+ * and wait for all of them to finish.
+ */
+void fuseReadPoolRun(fuseReadPoolFn fn, void *arg, int count);
+
+#endif
@@ -17,22 +17,12 @@
  */
 
 #include <math.h>
-#include <pthread.h>
-#include <grp.h>
-#include <pwd.h>
 
 #include "fuse_dfs.h"
 #include "fuse_stat_struct.h"
+#include "fuse_users.h"
 #include "fuse_context_handle.h"
 
-/*
- * getpwuid and getgrgid return static structs so we safeguard the contents
- * while retrieving fields using the 2 structs below.
- * NOTE: if using both, always get the passwd struct firt!
- */
-extern pthread_mutex_t passwdstruct_mutex; 
-extern pthread_mutex_t groupstruct_mutex;
-
 const int default_id = 99; // nobody  - not configurable since soon uids in dfs, yeah!
 const int blksize = 512;
 
@@ -48,46 +38,18 @@ int fill_stat_structure(hdfsFileInfo *info, struct stat *st)
   // initialize the stat structure
   memset(st, 0, sizeof(struct stat));
 
-  // by default: set to 0 to indicate not supported for directory because we cannot (efficiently) get this info for every subdirectory
-  st->st_nlink = (info->mKind == kObjectKindDirectory) ? 0 : 1;
+  // a directory's link count is not known without listing it; see
+  // dfs_getattr
+  st->st_nlink = 1;
 
   uid_t owner_id = default_id;
-  if (info->mOwner != NULL) {
-    //
-    // Critical section - protect from concurrent calls in different threads since
-    // the struct below is static.
-    // (no returns until end)
-    //
-    pthread_mutex_lock(&passwdstruct_mutex);
-
-    struct passwd *passwd_info = getpwnam(info->mOwner);
-    owner_id = passwd_info == NULL ? default_id : passwd_info->pw_uid;
-
-    //
-    // End critical section 
-    // 
-    pthread_mutex_unlock(&passwdstruct_mutex);
-
-  } 
+  if (info->mOwner != NULL && getUserId(info->mOwner, &owner_id)) {
+    owner_id = default_id;
+  }
 
   gid_t group_id = default_id;
-
-  if (info->mGroup != NULL) {
-    //
-    // Critical section - protect from concurrent calls in different threads since
-    // the struct below is static.
-    // (no returns until end)
-    //
-    pthread_mutex_lock(&groupstruct_mutex);
-
-    struct group *grp = getgrnam(info->mGroup);
-    group_id = grp == NULL ? default_id : grp->gr_gid;
-
-    //
-    // End critical section 
-    // 
-    pthread_mutex_unlock(&groupstruct_mutex);
-
+  if (info->mGroup != NULL && getGroupId(info->mGroup, &group_id)) {
+    group_id = default_id;
   }
 
   short perm = (info->mKind == kObjectKindDirectory) ? (S_IFDIR | 0777) :  (S_IFREG | 0666);
@@ -0,0 +1,243 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fuse_block_cache.h"
+#include "fuse_connect.h"
+#include "fuse_dfs.h"
+#include "fuse_stats.h"
+#include "libhdfs/hdfs.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Latencies are counted in buckets of powers of two microseconds; the last
+ * bucket takes everything from about 36 minutes up.
+ */
+#define FUSE_STATS_BUCKETS 32
+
+struct fuseOpStats {
+  uint64_t count;
+  uint64_t errors;
+  uint64_t bytes;
+  uint64_t totalUs;
+  uint64_t maxUs;
+  uint64_t buckets[FUSE_STATS_BUCKETS];
+};
+
+static const char * const gOpNames[FUSE_STATS_NUM_OPS] = {
+  "getattr", "access", "opendir", "readdir", "releasedir", "open", "read",
+  "read_buf", "symlink", "statfs", "mkdir", "rmdir", "rename", "unlink",
+  "release", "create", "write", "flush", "fsync", "mknod", "utimens",
+  "chmod", "chown", "truncate",
+};
+
+static const char * const gCounterNames[FUSE_STATS_NUM_COUNTERS] = {
+  "read_hits", "read_waits", "read_fills", "prefetches", "read_direct",
+  "read_chunks", "open_files",
+};
+
+static struct fuseOpStats gOpStats[FUSE_STATS_NUM_OPS];
+static int64_t gCounters[FUSE_STATS_NUM_COUNTERS];
+
+/** SIGUSR1 writes a byte to gSignalPipe[1] for the dump thread to read */
+static int gSignalPipe[2] = { -1, -1 };
+
+uint64_t fuseStatsStart(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void fuseStatsEnd(int op, uint64_t start, int ret)
+{
+  struct fuseOpStats *stats = &gOpStats[op];
+  uint64_t us = fuseStatsStart() - start, max;
+  int bucket = 0;
+
+  while (bucket < FUSE_STATS_BUCKETS - 1 && (us >> bucket) > 1) {
+    bucket++;
+  }
+  __sync_fetch_and_add(&stats->count, 1);
+  __sync_fetch_and_add(&stats->totalUs, us);
+  __sync_fetch_and_add(&stats->buckets[bucket], 1);
+  if (ret < 0) {
+    __sync_fetch_and_add(&stats->errors, 1);
+  } else if (op == FUSE_STATS_READ || op == FUSE_STATS_WRITE) {
+    __sync_fetch_and_add(&stats->bytes, ret);
+  }
+  max = stats->maxUs;
+  while (us > max) {
+    max = __sync_val_compare_and_swap(&stats->maxUs, max, us);
+  }
+}
+
+void fuseStatsAdd(int counter, int64_t delta)
+{
+  __sync_fetch_and_add(&gCounters[counter], delta);
+}
+
+/**
+ * Find the bucket that holds a percentile.
+ *
+ * @return the upper bound of the bucket, in microseconds
+ */
+static uint64_t fuseStatsPercentile(const struct fuseOpStats *stats,
+                                    uint64_t count, int permille)
+{
+  uint64_t rank = (count * permille + 999) / 1000, seen = 0;
+  int i;
+
+  for (i = 0; i < FUSE_STATS_BUCKETS; i++) {
+    seen += stats->buckets[i];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return 2ULL << i;
+}
+
+void fuseStatsDump(void)
+{
+  struct hdfsOpMetrics metrics[HDFS_METRICS_NUM_OPS];
+  struct fuseBlockCacheStats blockStats;
+  struct fuseConnectStats connStats;
+  struct fuseOpStats stats;
+  int i;
+
+  INFO("fuse_dfs statistics (latencies in microseconds; percentiles are "
+       "upper bounds of power-of-two buckets):");
+  INFO("%-10s %10s %8s %14s %8s %8s %8s %8s %10s", "op", "count", "errors",
+       "bytes", "avg", "p50", "p90", "p99", "max");
+  for (i = 0; i < FUSE_STATS_NUM_OPS; i++) {
+    // A racy copy; the fields may be out by a call or two from each other
+    stats = gOpStats[i];
+    if (stats.count == 0) {
+      continue;
+    }
+    INFO("%-10s %10" PRIu64 " %8" PRIu64 " %14" PRIu64 " %8" PRIu64
+         " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10" PRIu64,
+         gOpNames[i], stats.count, stats.errors, stats.bytes,
+         stats.totalUs / stats.count,
+         fuseStatsPercentile(&stats, stats.count, 500),
+         fuseStatsPercentile(&stats, stats.count, 900),
+         fuseStatsPercentile(&stats, stats.count, 990), stats.maxUs);
+  }
+  for (i = 0; i < FUSE_STATS_NUM_COUNTERS; i++) {
+    INFO("%s: %" PRId64, gCounterNames[i], gCounters[i]);
+  }
+  if (fuseBlockCacheEnabled()) {
+    fuseBlockCacheGetStats(&blockStats);
+    INFO("Block cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+         " evictions, %zd of %zd bytes used", blockStats.hits,
+         blockStats.misses, blockStats.evictions, blockStats.size,
+         blockStats.capacity);
+  }
+  fuseConnectGetStats(&connStats);
+  INFO("Connections: %" PRIu64 " cached, %" PRIu64 " in use, %" PRIu64
+       " expired", connStats.cached, connStats.inUse, connStats.expired);
+  if (hdfsGetMetrics(metrics) == 0) {
+    for (i = 0; i < HDFS_METRICS_NUM_OPS; i++) {
+      if (metrics[i].count == 0) {
+        continue;
+      }
+      INFO("libhdfs %-16s %10" PRIu64 " calls, p50 %" PRIu64 " p99 %" PRIu64
+           " max %" PRIu64 " us", hdfsMetricsOpName(i), metrics[i].count,
+           metrics[i].p50Ns / 1000, metrics[i].p99Ns / 1000,
+           metrics[i].maxNs / 1000);
+    }
+  }
+}
+
+static void fuseStatsSignal(int sig)
+{
+  int err = errno;
+  char c = 0;
+
+  // If the pipe is full a dump is already pending
+  if (write(gSignalPipe[1], &c, 1) < 0) {
+    // nothing to do
+  }
+  errno = err;
+}
+
+static void *fuseStatsThread(void *v)
+{
+  char c;
+  ssize_t res;
+
+  for (;;) {
+    res = read(gSignalPipe[0], &c, 1);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      break;
+    }
+    fuseStatsDump();
+  }
+  return NULL;
+}
+
+int fuseStatsInit(void)
+{
+  struct sigaction act;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int ret;
+
+  if (pipe(gSignalPipe) < 0) {
+    ret = -errno;
+    ERROR("fuseStatsInit: pipe failed: error %d", -ret);
+    return ret;
+  }
+  fcntl(gSignalPipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(gSignalPipe[1], F_SETFD, FD_CLOEXEC);
+  fcntl(gSignalPipe[1], F_SETFL, O_NONBLOCK);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = pthread_create(&thread, &attr, fuseStatsThread, NULL);
+  pthread_attr_destroy(&attr);
+  if (ret) {
+    ERROR("fuseStatsInit: pthread_create failed: error %d", ret);
+    goto error;
+  }
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = fuseStatsSignal;
+  act.sa_flags = SA_RESTART;
+  sigemptyset(&act.sa_mask);
+  if (sigaction(SIGUSR1, &act, NULL) < 0) {
+    // The thread just blocks on the pipe for ever
+    ret = errno;
+    ERROR("fuseStatsInit: sigaction failed: error %d", ret);
+    return -ret;
+  }
+  return 0;
+
+error:
+  close(gSignalPipe[0]);
+  close(gSignalPipe[1]);
+  gSignalPipe[0] = gSignalPipe[1] = -1;
+  return -ret;
+}
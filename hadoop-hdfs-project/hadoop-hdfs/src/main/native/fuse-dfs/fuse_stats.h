@@ -0,0 +1,116 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FUSE_STATS_H__
+#define __FUSE_STATS_H__
+
+#include <stdint.h>
+
+/**
+ * Runtime statistics of the mount: how often each FUSE operation is called,
+ * how many fail and how long they take, along with counters kept by the
+ * read path.  They are logged when the process gets SIGUSR1 and on unmount.
+ */
+
+enum fuseStatsOp {
+  FUSE_STATS_GETATTR,
+  FUSE_STATS_ACCESS,
+  FUSE_STATS_OPENDIR,
+  FUSE_STATS_READDIR,
+  FUSE_STATS_RELEASEDIR,
+  FUSE_STATS_OPEN,
+  FUSE_STATS_READ,
+  FUSE_STATS_READ_BUF,
+  FUSE_STATS_SYMLINK,
+  FUSE_STATS_STATFS,
+  FUSE_STATS_MKDIR,
+  FUSE_STATS_RMDIR,
+  FUSE_STATS_RENAME,
+  FUSE_STATS_UNLINK,
+  FUSE_STATS_RELEASE,
+  FUSE_STATS_CREATE,
+  FUSE_STATS_WRITE,
+  FUSE_STATS_FLUSH,
+  FUSE_STATS_FSYNC,
+  FUSE_STATS_MKNOD,
+  FUSE_STATS_UTIMENS,
+  FUSE_STATS_CHMOD,
+  FUSE_STATS_CHOWN,
+  FUSE_STATS_TRUNCATE,
+  FUSE_STATS_NUM_OPS
+};
+
+enum fuseStatsCounter {
+  /** Reads served from a window already in the open file's buffers */
+  FUSE_STATS_READ_HITS,
+  /** Reads that had to wait for another thread to fill a window */
+  FUSE_STATS_READ_WAITS,
+  /** Reads that filled a window themselves */
+  FUSE_STATS_READ_FILLS,
+  /** Windows filled in the background ahead of a sequential reader */
+  FUSE_STATS_PREFETCHES,
+  /** Reads of at least a window, which bypass the buffers */
+  FUSE_STATS_READ_DIRECT,
+  /** Chunks such reads were split into for the read pool */
+  FUSE_STATS_READ_CHUNKS,
+  /** Files open right now */
+  FUSE_STATS_OPEN_FILES,
+  FUSE_STATS_NUM_COUNTERS
+};
+
+/**
+ * Note the start of an operation.
+ *
+ * @return              The time to pass to fuseStatsEnd.
+ */
+uint64_t fuseStatsStart(void);
+
+/**
+ * Record an operation that has finished.
+ *
+ * @param op            The enum fuseStatsOp.
+ * @param start         What fuseStatsStart returned.
+ * @param ret           What the operation returned: a negative errno is
+ *                      counted as an error, and for read and write a
+ *                      positive value as bytes transferred.
+ */
+void fuseStatsEnd(int op, uint64_t start, int ret);
+
+/**
+ * Add to one of the counters.
+ *
+ * @param counter       The enum fuseStatsCounter.
+ * @param delta         How much to add; may be negative.
+ */
+void fuseStatsAdd(int counter, int64_t delta);
+
+/**
+ * Log the statistics, along with those of the block cache, the connection
+ * cache and libhdfs.
+ */
+void fuseStatsDump(void);
+
+/**
+ * Start the thread that logs the statistics whenever the process gets
+ * SIGUSR1.
+ *
+ * @return              0 on success; a negative errno otherwise
+ */
+int fuseStatsInit(void);
+
+#endif
@@ -18,7 +18,11 @@
 
 
 #include <hdfs.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <strings.h>
+#include <sys/time.h>
 
 #include "fuse_dfs.h"
 #include "fuse_trash.h"
@@ -28,7 +32,54 @@
 const char *const TrashPrefixDir = "/user/root/.Trash";
 const char *const TrashDir = "/user/root/.Trash/Current";
 
-#define TRASH_RENAME_TRIES  100
+/** How many trash directories are remembered as existing */
+#define TRASH_KNOWN_DIRS 64
+
+/*
+ * Trash directories that have been seen to exist, most recently added at
+ * gTrashNext - 1, so that deleting many files from one directory does not
+ * check for the directory every time.  An entry goes stale when the trash
+ * is checkpointed or emptied; a failed rename then drops it.
+ */
+static pthread_mutex_t gTrashMutex = PTHREAD_MUTEX_INITIALIZER;
+static char *gTrashKnown[TRASH_KNOWN_DIRS];
+static int gTrashNext;
+/** Makes the names of items moved next to an older one of the same name
+ * unique within this mount */
+static unsigned int gTrashCounter;
+
+static int trash_dir_known(const char *trash_dir) {
+  int i, ret = 0;
+
+  pthread_mutex_lock(&gTrashMutex);
+  for (i = 0; i < TRASH_KNOWN_DIRS; i++) {
+    if (gTrashKnown[i] && !strcmp(gTrashKnown[i], trash_dir)) {
+      ret = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&gTrashMutex);
+  return ret;
+}
+
+static void trash_dir_set_known(const char *trash_dir, int known) {
+  char *dup = known ? strdup(trash_dir) : NULL;
+  int i;
+
+  pthread_mutex_lock(&gTrashMutex);
+  for (i = 0; i < TRASH_KNOWN_DIRS; i++) {
+    if (gTrashKnown[i] && !strcmp(gTrashKnown[i], trash_dir)) {
+      free(gTrashKnown[i]);
+      gTrashKnown[i] = NULL;
+    }
+  }
+  if (dup) {
+    free(gTrashKnown[gTrashNext]);
+    gTrashKnown[gTrashNext] = dup;
+    gTrashNext = (gTrashNext + 1) % TRASH_KNOWN_DIRS;
+  }
+  pthread_mutex_unlock(&gTrashMutex);
+}
 
 //
 // NOTE: this function is a c implementation of org.apache.hadoop.fs.Trash.moveToTrash(Path path).
@@ -74,29 +125,45 @@ int move_to_trash(const char *item, hdfsFS userFS) {
     return -EIO;
   }
 
+  char target[4096];
+  if ( snprintf(target, sizeof target,"%s/%s",trash_dir, fname) >= sizeof target) {
+    ERROR("Move to trash error target not big enough for %s", item);
+    return -EIO;
+  }
+
+  //
+  // Usually the trash directory exists and nothing of the same name is in
+  // it, so the rename is tried first and the reasons it can fail are only
+  // looked into when it does.
+  //
+  if (trash_dir_known(trash_dir) && !hdfsRename(userFS, item, target)) {
+    return 0;
+  }
+
   // create the target trash directory in trash (if needed)
   if ( hdfsExists(userFS, trash_dir)) {
     // make the directory to put it in in the Trash - NOTE
     // hdfsCreateDirectory also creates parents, so Current will be created if it does not exist.
     if (hdfsCreateDirectory(userFS, trash_dir)) {
+      trash_dir_set_known(trash_dir, 0);
       return -EIO;
     }
   }
+  trash_dir_set_known(trash_dir, 1);
 
   //
-  // if the target path in Trash already exists, then append with
-  // a number. Start from 1.
+  // if the target path in Trash already exists, then append the time and
+  // a counter, as the java version appends the time.
   //
-  char target[4096];
-  int j ;
-  if ( snprintf(target, sizeof target,"%s/%s",trash_dir, fname) >= sizeof target) {
-    ERROR("Move to trash error target not big enough for %s", item);
-    return -EIO;
-  }
-
-  // NOTE: this loop differs from the java version by capping the #of tries
-  for (j = 1; ! hdfsExists(userFS, target) && j < TRASH_RENAME_TRIES ; j++) {
-    if (snprintf(target, sizeof target,"%s/%s.%d",trash_dir, fname, j) >= sizeof target) {
+  if (!hdfsExists(userFS, target)) {
+    struct timeval tv;
+    unsigned int counter;
+
+    gettimeofday(&tv, NULL);
+    counter = __sync_fetch_and_add(&gTrashCounter, 1);
+    if (snprintf(target, sizeof target, "%s/%s.%" PRId64 ".%u", trash_dir,
+                 fname, (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000,
+                 counter) >= sizeof target) {
       ERROR("Move to trash error target not big enough for %s", item);
       return -EIO;
     }
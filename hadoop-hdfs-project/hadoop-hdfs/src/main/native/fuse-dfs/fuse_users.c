@@ -17,42 +17,321 @@
  */
 
 
+#include <errno.h>
 #include <pthread.h>
 #include <grp.h>
 #include <pwd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "fuse_dfs.h"
+#include "fuse_users.h"
+#include "util/tree.h"
 
-/*
- * getpwuid and getgrgid return static structs so we safeguard the contents
- * while retrieving fields using the 2 structs below.
- * NOTE: if using both, always get the passwd struct firt!
+/** How long a user or group lookup is remembered, in seconds */
+#define FUSE_ID_CACHE_TTL 300
+
+/** The most lookups remembered for users, and separately for groups */
+#define FUSE_ID_CACHE_MAX_ENTRIES 8192
+
+/** The largest buffer handed to getpwuid_r and friends */
+#define NSS_BUF_MAX (1024 * 1024)
+
+/**
+ * A remembered user or group lookup.  A successful lookup can be found both
+ * by id and by name; a failed one only by what was looked up.
+ */
+struct fuseIdEntry {
+  RB_ENTRY(fuseIdEntry) idLink;
+  RB_ENTRY(fuseIdEntry) nameLink;
+  /** Neighbours in the cache's list; prev was added earlier */
+  struct fuseIdEntry *prev, *next;
+  /** Which of the cache's trees the entry is in */
+  int inIdTree, inNameTree;
+  /** CLOCK_MONOTONIC time, in seconds, after which this is stale */
+  time_t expiry;
+  /** The id; meaningless if the lookup by name failed */
+  id_t id;
+  /** The name, or NULL if the lookup by id failed.  Points into the same
+   * allocation. */
+  const char *name;
+};
+
+static int fuseIdEntryCompareId(const struct fuseIdEntry *a,
+                                const struct fuseIdEntry *b)
+{
+  return (a->id < b->id) ? -1 : ((a->id > b->id) ? 1 : 0);
+}
+
+static int fuseIdEntryCompareName(const struct fuseIdEntry *a,
+                                  const struct fuseIdEntry *b)
+{
+  return strcmp(a->name, b->name);
+}
+
+RB_HEAD(fuseIdTree, fuseIdEntry);
+RB_HEAD(fuseNameTree, fuseIdEntry);
+RB_GENERATE(fuseIdTree, fuseIdEntry, idLink, fuseIdEntryCompareId);
+RB_GENERATE(fuseNameTree, fuseIdEntry, nameLink, fuseIdEntryCompareName);
+
+/**
+ * Remembered lookups of either users or groups.  Lookups take the lock
+ * shared, so that listing a large directory does not serialize the FUSE
+ * threads.
+ */
+struct fuseIdCache {
+  pthread_rwlock_t lock;
+  struct fuseIdTree byId;
+  struct fuseNameTree byName;
+  /** All the entries, oldest first */
+  struct fuseIdEntry *head, *tail;
+  int numEntries;
+};
+
+static struct fuseIdCache gUserCache = {
+  PTHREAD_RWLOCK_INITIALIZER, RB_INITIALIZER(&gUserCache.byId),
+  RB_INITIALIZER(&gUserCache.byName), NULL, NULL, 0
+};
+
+static struct fuseIdCache gGroupCache = {
+  PTHREAD_RWLOCK_INITIALIZER, RB_INITIALIZER(&gGroupCache.byId),
+  RB_INITIALIZER(&gGroupCache.byName), NULL, NULL, 0
+};
+
+static time_t monotonicSecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static void fuseIdCacheRemove(struct fuseIdCache *cache,
+                              struct fuseIdEntry *entry)
+{
+  if (entry->inIdTree) {
+    RB_REMOVE(fuseIdTree, &cache->byId, entry);
+  }
+  if (entry->inNameTree) {
+    RB_REMOVE(fuseNameTree, &cache->byName, entry);
+  }
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  cache->numEntries--;
+  free(entry);
+}
+
+/**
+ * Look up the name of an id in a cache.
+ *
+ * @param cache         The cache
+ * @param id            The id
+ * @param name          (out param) A copy of the name that the caller must
+ *                      free, or NULL if the id is known not to exist
+ *
+ * @return              0 if the answer was cached; -1 otherwise
+ */
+static int fuseIdCacheGetName(struct fuseIdCache *cache, id_t id,
+                              char **name)
+{
+  struct fuseIdEntry key, *entry;
+  int ret = -1;
+
+  key.id = id;
+  pthread_rwlock_rdlock(&cache->lock);
+  entry = RB_FIND(fuseIdTree, &cache->byId, &key);
+  if (entry && entry->expiry > monotonicSecs()) {
+    *name = entry->name ? strdup(entry->name) : NULL;
+    if (*name || !entry->name) {
+      ret = 0;
+    }
+  }
+  pthread_rwlock_unlock(&cache->lock);
+  return ret;
+}
+
+/**
+ * Look up the id of a name in a cache.
+ *
+ * @param cache         The cache
+ * @param name          The name
+ * @param id            (out param) The id
+ *
+ * @return              1 if the name exists; 0 if it is known not to; -1
+ *                      if nothing is cached for it.
+ */
+static int fuseIdCacheGetId(struct fuseIdCache *cache, const char *name,
+                            id_t *id)
+{
+  struct fuseIdEntry key, *entry;
+  int ret = -1;
+
+  key.name = name;
+  pthread_rwlock_rdlock(&cache->lock);
+  entry = RB_FIND(fuseNameTree, &cache->byName, &key);
+  if (entry && entry->expiry > monotonicSecs()) {
+    ret = entry->inIdTree;
+    *id = entry->id;
+  }
+  pthread_rwlock_unlock(&cache->lock);
+  return ret;
+}
+
+/**
+ * Remember a lookup.  Whatever was remembered before about the same id or
+ * name is forgotten.
+ *
+ * @param cache         The cache
+ * @param id            The id
+ * @param hasId         Zero if a lookup of the name found nothing
+ * @param name          The name, or NULL if a lookup of the id found nothing
+ */
+static void fuseIdCachePut(struct fuseIdCache *cache, id_t id, int hasId,
+                           const char *name)
+{
+  struct fuseIdEntry *entry, *old;
+  size_t len = name ? strlen(name) + 1 : 0;
+
+  entry = calloc(1, sizeof(*entry) + len);
+  if (!entry) {
+    return;
+  }
+  if (name) {
+    memcpy(entry + 1, name, len);
+    entry->name = (const char *)(entry + 1);
+  }
+  entry->id = id;
+  entry->inIdTree = hasId;
+  entry->inNameTree = (name != NULL);
+  entry->expiry = monotonicSecs() + FUSE_ID_CACHE_TTL;
+  pthread_rwlock_wrlock(&cache->lock);
+  if (entry->inIdTree) {
+    old = RB_FIND(fuseIdTree, &cache->byId, entry);
+    if (old) {
+      fuseIdCacheRemove(cache, old);
+    }
+  }
+  if (entry->inNameTree) {
+    old = RB_FIND(fuseNameTree, &cache->byName, entry);
+    if (old) {
+      fuseIdCacheRemove(cache, old);
+    }
+  }
+  while (cache->numEntries >= FUSE_ID_CACHE_MAX_ENTRIES) {
+    fuseIdCacheRemove(cache, cache->head);
+  }
+  if (entry->inIdTree) {
+    RB_INSERT(fuseIdTree, &cache->byId, entry);
+  }
+  if (entry->inNameTree) {
+    RB_INSERT(fuseNameTree, &cache->byName, entry);
+  }
+  entry->prev = cache->tail;
+  if (cache->tail) {
+    cache->tail->next = entry;
+  } else {
+    cache->head = entry;
+  }
+  cache->tail = entry;
+  cache->numEntries++;
+  pthread_rwlock_unlock(&cache->lock);
+}
+
+/**
+ * Get a buffer for getpwuid_r and friends, the first time with the size
+ * the system suggests and then twice as large as before.
+ *
+ * @param buf           (inout param) The buffer; NULL the first time
+ * @param len           (inout param) The size of the buffer
+ * @param sysconfName   _SC_GETPW_R_SIZE_MAX or _SC_GETGR_R_SIZE_MAX
+ *
+ * @return              0 on success; -1 if no larger buffer can be had
  */
-pthread_mutex_t passwdstruct_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t groupstruct_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int nssBufGrow(char **buf, size_t *len, int sysconfName)
+{
+  long suggested;
+  char *newBuf;
+
+  if (!*buf) {
+    suggested = sysconf(sysconfName);
+    *len = suggested > 0 ? suggested : 1024;
+  } else if (*len >= NSS_BUF_MAX) {
+    return -1;
+  } else {
+    *len *= 2;
+  }
+  newBuf = realloc(*buf, *len);
+  if (!newBuf) {
+    return -1;
+  }
+  *buf = newBuf;
+  return 0;
+}
 
 /*
  * Utility for getting the user making the fuse call in char * form
  * NOTE: if non-null return, the return must be freed by the caller.
  */
 char *getUsername(uid_t uid) {
-  //
-  // Critical section - protect from concurrent calls in different threads.
-  // since the struct below is static.
-  // (no returns until end)
-  //
+  struct passwd pwd, *userinfo = NULL;
+  char *buf = NULL, *ret = NULL;
+  size_t len;
+  int err = ENOMEM;
 
-  pthread_mutex_lock(&passwdstruct_mutex);
-
-  struct passwd *userinfo = getpwuid(uid);
-  char * ret = userinfo && userinfo->pw_name ? strdup(userinfo->pw_name) : NULL;
-
-  pthread_mutex_unlock(&passwdstruct_mutex);
+  if (!fuseIdCacheGetName(&gUserCache, uid, &ret)) {
+    return ret;
+  }
+  while (!nssBufGrow(&buf, &len, _SC_GETPW_R_SIZE_MAX)) {
+    err = getpwuid_r(uid, &pwd, buf, len, &userinfo);
+    if (err != ERANGE) {
+      break;
+    }
+  }
+  if (!err) {
+    fuseIdCachePut(&gUserCache, uid, 1, userinfo ? userinfo->pw_name : NULL);
+    ret = userinfo && userinfo->pw_name ? strdup(userinfo->pw_name) : NULL;
+  }
+  free(buf);
+  return ret;
+}
 
-  //
-  // End critical section 
-  // 
+int getUserId(const char *usrname, uid_t *uid) {
+  struct passwd pwd, *userinfo = NULL;
+  char *buf = NULL;
+  size_t len;
+  id_t id;
+  int err = ENOMEM, ret;
+
+  ret = fuseIdCacheGetId(&gUserCache, usrname, &id);
+  if (ret >= 0) {
+    *uid = id;
+    return ret ? 0 : -1;
+  }
+  while (!nssBufGrow(&buf, &len, _SC_GETPW_R_SIZE_MAX)) {
+    err = getpwnam_r(usrname, &pwd, buf, len, &userinfo);
+    if (err != ERANGE) {
+      break;
+    }
+  }
+  ret = -1;
+  if (!err && userinfo) {
+    fuseIdCachePut(&gUserCache, userinfo->pw_uid, 1, userinfo->pw_name);
+    *uid = userinfo->pw_uid;
+    ret = 0;
+  } else if (!err) {
+    fuseIdCachePut(&gUserCache, 0, 0, usrname);
+  }
+  free(buf);
   return ret;
 }
 
@@ -74,54 +353,94 @@ void freeGroups(char **groups, int numgroups) {
 #define GROUPBUF_SIZE 5
 
 char *getGroup(gid_t gid) {
-  //
-  // Critical section - protect from concurrent calls in different threads.
-  // since the struct below is static.
-  // (no returns until end)
-  //
-
-  pthread_mutex_lock(&groupstruct_mutex);
-
-  struct group* grp = getgrgid(gid);
-  char * ret = grp && grp->gr_name ? strdup(grp->gr_name) : NULL;
+  struct group grpbuf, *grp = NULL;
+  char *buf = NULL, *ret = NULL;
+  size_t len;
+  int err = ENOMEM;
 
-  //
-  // End critical section 
-  // 
-  pthread_mutex_unlock(&groupstruct_mutex);
+  if (!fuseIdCacheGetName(&gGroupCache, gid, &ret)) {
+    return ret;
+  }
+  while (!nssBufGrow(&buf, &len, _SC_GETGR_R_SIZE_MAX)) {
+    err = getgrgid_r(gid, &grpbuf, buf, len, &grp);
+    if (err != ERANGE) {
+      break;
+    }
+  }
+  if (!err) {
+    fuseIdCachePut(&gGroupCache, gid, 1, grp ? grp->gr_name : NULL);
+    ret = grp && grp->gr_name ? strdup(grp->gr_name) : NULL;
+  }
+  free(buf);
+  return ret;
+}
 
+int getGroupId(const char *group, gid_t *gid) {
+  struct group grpbuf, *grp = NULL;
+  char *buf = NULL;
+  size_t len;
+  id_t id;
+  int err = ENOMEM, ret;
+
+  ret = fuseIdCacheGetId(&gGroupCache, group, &id);
+  if (ret >= 0) {
+    *gid = id;
+    return ret ? 0 : -1;
+  }
+  while (!nssBufGrow(&buf, &len, _SC_GETGR_R_SIZE_MAX)) {
+    err = getgrnam_r(group, &grpbuf, buf, len, &grp);
+    if (err != ERANGE) {
+      break;
+    }
+  }
+  ret = -1;
+  if (!err && grp) {
+    fuseIdCachePut(&gGroupCache, grp->gr_gid, 1, grp->gr_name);
+    *gid = grp->gr_gid;
+    ret = 0;
+  } else if (!err) {
+    fuseIdCachePut(&gGroupCache, 0, 0, group);
+  }
+  free(buf);
   return ret;
 }
 
+/**
+ * Look up the primary group of a user.
+ *
+ * @param uid           The user
+ * @param gid           (out param) The primary group
+ *
+ * @return              0 on success; -1 if the user could not be found
+ */
+static int getPrimaryGid(uid_t uid, gid_t *gid) {
+  struct passwd pwd, *userinfo = NULL;
+  char *buf = NULL;
+  size_t len;
+
+  while (!nssBufGrow(&buf, &len, _SC_GETPW_R_SIZE_MAX)) {
+    if (getpwuid_r(uid, &pwd, buf, len, &userinfo) != ERANGE) {
+      break;
+    }
+  }
+  if (userinfo) {
+    *gid = userinfo->pw_gid;
+  }
+  free(buf);
+  return userinfo ? 0 : -1;
+}
 
 /**
  * Utility for getting the group from the uid
  * NOTE: if non-null return, the return must be freed by the caller.
  */
 char *getGroupUid(uid_t uid) {
-  //
-  // Critical section - protect from concurrent calls in different threads
-  // since the structs below are static.
-  // (no returns until end)
-  //
-
-  pthread_mutex_lock(&passwdstruct_mutex);
-  pthread_mutex_lock(&groupstruct_mutex);
-
-  char *ret = NULL;
-  struct passwd *userinfo = getpwuid(uid);
-  if (NULL != userinfo) {
-    struct group* grp = getgrgid( userinfo->pw_gid);
-    ret = grp && grp->gr_name ? strdup(grp->gr_name) : NULL;
-  }
+  gid_t gid;
 
-  //
-  // End critical section 
-  // 
-  pthread_mutex_unlock(&groupstruct_mutex);
-  pthread_mutex_unlock(&passwdstruct_mutex);
-
-  return ret;
+  if (getPrimaryGid(uid, &gid)) {
+    return NULL;
+  }
+  return getGroup(gid);
 }
 
 
@@ -129,23 +448,9 @@ char *getGroupUid(uid_t uid) {
  * lookup the gid based on the uid
  */
 gid_t getGidUid(uid_t uid) {
-  //
-  // Critical section - protect from concurrent calls in different threads
-  // since the struct below is static.
-  // (no returns until end)
-  //
-
-  pthread_mutex_lock(&passwdstruct_mutex);
-
-  struct passwd *userinfo = getpwuid(uid);
-  gid_t gid = userinfo == NULL ? 0 : userinfo->pw_gid;
-
-  //
-  // End critical section 
-  // 
-  pthread_mutex_unlock(&passwdstruct_mutex);
+  gid_t gid;
 
-  return gid;
+  return getPrimaryGid(uid, &gid) ? 0 : gid;
 }
 
 /**
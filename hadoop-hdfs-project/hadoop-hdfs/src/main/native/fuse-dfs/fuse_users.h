@@ -28,6 +28,8 @@
  * 1. all these functions should be thread safe.
  * 2. the ones that return char * or char **, generally require
  * the caller to free the return value.
+ * 3. lookups are remembered for a few minutes, so changes to the passwd
+ * and group databases are not seen straight away.
  *
  */
 
@@ -38,6 +40,16 @@
  */
 char *getUsername(uid_t uid);
 
+/**
+ * Look up the uid of a user name.
+ *
+ * @param usrname       The user name
+ * @param uid           (out param) The uid
+ *
+ * @return              0 on success; -1 if the user could not be found
+ */
+int getUserId(const char *usrname, uid_t *uid);
+
 
 /**
  * Cleans up a char ** group pointer
@@ -49,6 +61,16 @@ void freeGroups(char **groups, int numgroups);
  */
 char *getGroup(gid_t gid);
 
+/**
+ * Look up the gid of a group name.
+ *
+ * @param group         The group name
+ * @param gid           (out param) The gid
+ *
+ * @return              0 on success; -1 if the group could not be found
+ */
+int getGroupId(const char *group, gid_t *gid);
+
 /**
  * Utility for getting the group from the uid
  * NOTE: if non-null return, the return must be freed by the caller.
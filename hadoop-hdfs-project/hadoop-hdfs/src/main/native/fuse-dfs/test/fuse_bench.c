@@ -0,0 +1,420 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fuse-dfs/test/fuse_bench.h"
+#include "util/posix_util.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FUSE_BENCH_MAX_THREADS 256
+
+enum fuseBenchPhase {
+  FUSE_BENCH_WRITE,
+  FUSE_BENCH_READ,
+  FUSE_BENCH_CREATE,
+  FUSE_BENCH_STAT,
+  FUSE_BENCH_READDIR,
+};
+
+struct fuseBenchThread {
+  pthread_t thread;
+  const struct fuseBenchConf *conf;
+  enum fuseBenchPhase phase;
+  int blockSize;
+  /** The directory this thread works in */
+  char dir[PATH_MAX];
+  /** The latency of each call made in this phase */
+  uint64_t *latNs;
+  size_t numLat, latCap;
+  int64_t bytes;
+  /** 0 on success; negative error code otherwise */
+  int error;
+};
+
+static uint64_t nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/**
+ * Record a call that started at start and moved bytes bytes.
+ *
+ * @return          0 on success; -ENOMEM otherwise
+ */
+static int record(struct fuseBenchThread *t, uint64_t start, int64_t bytes)
+{
+  uint64_t *latNs;
+  size_t cap;
+
+  if (t->numLat == t->latCap) {
+    cap = t->latCap ? t->latCap * 2 : 1024;
+    latNs = realloc(t->latNs, cap * sizeof(*latNs));
+    if (!latNs) {
+      return -ENOMEM;
+    }
+    t->latNs = latNs;
+    t->latCap = cap;
+  }
+  t->latNs[t->numLat++] = nowNs() - start;
+  t->bytes += bytes;
+  return 0;
+}
+
+static int benchWrite(struct fuseBenchThread *t, char *buf)
+{
+  const struct fuseBenchConf *conf = t->conf;
+  char path[PATH_MAX];
+  int64_t done;
+  uint64_t start;
+  ssize_t len;
+  int fd, ret = 0;
+
+  if (snprintf(path, sizeof(path), "%s/data", t->dir) >= sizeof(path)) {
+    return -ENAMETOOLONG;
+  }
+  // HDFS files can not be overwritten in place
+  if (unlink(path) && errno != ENOENT) {
+    return -errno;
+  }
+  fd = open(path, O_CREAT | O_WRONLY, 0644);
+  if (fd < 0) {
+    return -errno;
+  }
+  memset(buf, 'a', t->blockSize);
+  for (done = 0; done < conf->fileSize; done += len) {
+    len = t->blockSize;
+    if (len > conf->fileSize - done) {
+      len = conf->fileSize - done;
+    }
+    start = nowNs();
+    len = write(fd, buf, len);
+    if (len <= 0) {
+      ret = len ? -errno : -EIO;
+      break;
+    }
+    ret = record(t, start, len);
+    if (ret) {
+      break;
+    }
+  }
+  // The data is only known to have reached HDFS once close returns
+  if (close(fd) && !ret) {
+    ret = -errno;
+  }
+  return ret;
+}
+
+static int benchRead(struct fuseBenchThread *t, char *buf)
+{
+  char path[PATH_MAX];
+  uint64_t start;
+  ssize_t len;
+  int fd, ret = 0;
+
+  if (snprintf(path, sizeof(path), "%s/data", t->dir) >= sizeof(path)) {
+    return -ENAMETOOLONG;
+  }
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -errno;
+  }
+  for (;;) {
+    start = nowNs();
+    len = read(fd, buf, t->blockSize);
+    if (len <= 0) {
+      break;
+    }
+    ret = record(t, start, len);
+    if (ret) {
+      break;
+    }
+  }
+  if (len < 0) {
+    ret = -errno;
+  }
+  close(fd);
+  return ret;
+}
+
+static int benchMetadata(struct fuseBenchThread *t)
+{
+  const struct fuseBenchConf *conf = t->conf;
+  char path[PATH_MAX];
+  struct stat st;
+  uint64_t start;
+  DIR *dp;
+  int i, fd, ret, num;
+
+  num = (t->phase == FUSE_BENCH_READDIR) ? conf->numListings : conf->numFiles;
+  for (i = 0; i < num; i++) {
+    if (snprintf(path, sizeof(path), "%s/f%d", t->dir, i) >= sizeof(path)) {
+      return -ENAMETOOLONG;
+    }
+    start = nowNs();
+    switch (t->phase) {
+    case FUSE_BENCH_CREATE:
+      fd = open(path, O_CREAT | O_WRONLY, 0644);
+      if (fd < 0 || close(fd)) {
+        return -errno;
+      }
+      break;
+    case FUSE_BENCH_STAT:
+      if (stat(path, &st)) {
+        return -errno;
+      }
+      break;
+    default:
+      dp = opendir(t->dir);
+      if (!dp) {
+        return -errno;
+      }
+      while (readdir(dp)) {
+        ;
+      }
+      closedir(dp);
+      break;
+    }
+    ret = record(t, start, 0);
+    if (ret) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+static void *benchThreadMain(void *v)
+{
+  struct fuseBenchThread *t = v;
+  char *buf = NULL;
+
+  if (t->phase == FUSE_BENCH_WRITE || t->phase == FUSE_BENCH_READ) {
+    buf = malloc(t->blockSize);
+    if (!buf) {
+      t->error = -ENOMEM;
+      return NULL;
+    }
+  }
+  switch (t->phase) {
+  case FUSE_BENCH_WRITE:
+    t->error = benchWrite(t, buf);
+    break;
+  case FUSE_BENCH_READ:
+    t->error = benchRead(t, buf);
+    break;
+  default:
+    t->error = benchMetadata(t);
+    break;
+  }
+  free(buf);
+  return NULL;
+}
+
+static int compareU64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static double percentileUs(const uint64_t *sorted, size_t num, double p)
+{
+  if (num == 0) {
+    return 0;
+  }
+  return sorted[(size_t)((num - 1) * p)] / 1e3;
+}
+
+/**
+ * Run one phase on every thread and print a line of results.
+ *
+ * @return          0 on success; the first thread's error otherwise
+ */
+static int runPhase(struct fuseBenchThread *threads, int numThreads,
+                    enum fuseBenchPhase phase, int blockSize, const char *name)
+{
+  uint64_t start, elapsed, *all;
+  size_t num = 0;
+  int64_t bytes = 0;
+  double secs;
+  int i, ret = 0;
+
+  start = nowNs();
+  for (i = 0; i < numThreads; i++) {
+    threads[i].phase = phase;
+    threads[i].blockSize = blockSize;
+    threads[i].numLat = 0;
+    threads[i].bytes = 0;
+    threads[i].error = 0;
+    ret = pthread_create(&threads[i].thread, NULL, benchThreadMain,
+                         &threads[i]);
+    if (ret) {
+      fprintf(stderr, "FUSE_BENCH: %s: pthread_create failed with error "
+              "%d\n", name, ret);
+      numThreads = i;
+      ret = -ret;
+      break;
+    }
+  }
+  for (i = 0; i < numThreads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    if (threads[i].error && !ret) {
+      ret = threads[i].error;
+    }
+  }
+  elapsed = nowNs() - start;
+  if (ret) {
+    fprintf(stderr, "FUSE_BENCH: %s failed with error %d\n", name, ret);
+    return ret;
+  }
+  for (i = 0; i < numThreads; i++) {
+    num += threads[i].numLat;
+    bytes += threads[i].bytes;
+  }
+  all = malloc((num ? num : 1) * sizeof(*all));
+  if (!all) {
+    return -ENOMEM;
+  }
+  num = 0;
+  for (i = 0; i < numThreads; i++) {
+    memcpy(all + num, threads[i].latNs, threads[i].numLat * sizeof(*all));
+    num += threads[i].numLat;
+  }
+  qsort(all, num, sizeof(*all), compareU64);
+  secs = elapsed / 1e9;
+  printf("%-16s %7d %10zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+         name, numThreads, num, (double)bytes / (1024.0 * 1024.0) / secs,
+         num / secs, percentileUs(all, num, 0.5), percentileUs(all, num, 0.9),
+         percentileUs(all, num, 0.99), num ? all[num - 1] / 1e3 : 0.0);
+  fflush(stdout);
+  free(all);
+  return 0;
+}
+
+static int64_t envInt(const char *name, int64_t defaultVal)
+{
+  const char *val = getenv(name);
+  char *end;
+  int64_t ret;
+
+  if (!val) {
+    return defaultVal;
+  }
+  ret = strtoll(val, &end, 10);
+  if (*end || ret <= 0) {
+    fprintf(stderr, "FUSE_BENCH: ignoring %s=%s\n", name, val);
+    return defaultVal;
+  }
+  return ret;
+}
+
+void fuseBenchConfFromEnv(struct fuseBenchConf *conf)
+{
+  static const int defaultBlockSizes[] = { 4096, 65536, 1048576 };
+  int i;
+
+  memset(conf, 0, sizeof(*conf));
+  conf->numThreads = envInt("TLH_FUSE_BENCH_THREADS", 4);
+  if (conf->numThreads > FUSE_BENCH_MAX_THREADS) {
+    conf->numThreads = FUSE_BENCH_MAX_THREADS;
+  }
+  conf->fileSize = envInt("TLH_FUSE_BENCH_FILE_SIZE", 64LL * 1024 * 1024);
+  conf->numFiles = envInt("TLH_FUSE_BENCH_FILES", 1000);
+  conf->numListings = envInt("TLH_FUSE_BENCH_LISTINGS", 20);
+  for (i = 0; i < sizeof(defaultBlockSizes) / sizeof(defaultBlockSizes[0]);
+       i++) {
+    conf->blockSizes[conf->numBlockSizes++] = defaultBlockSizes[i];
+  }
+}
+
+int runFuseBench(const char *root, const char *pcomp,
+                 const struct fuseBenchConf *conf)
+{
+  static struct fuseBenchThread threads[FUSE_BENCH_MAX_THREADS];
+  char base[PATH_MAX], name[32];
+  int i, ret = 0, numThreads = conf->numThreads;
+
+  if (numThreads <= 0 || numThreads > FUSE_BENCH_MAX_THREADS) {
+    return -EINVAL;
+  }
+  snprintf(base, sizeof(base), "%s/%s", root, pcomp);
+  if (mkdir(base, 0755)) {
+    ret = -errno;
+    fprintf(stderr, "FUSE_BENCH: failed to create %s: error %d\n", base, ret);
+    return ret;
+  }
+  memset(threads, 0, sizeof(threads));
+  for (i = 0; i < numThreads; i++) {
+    threads[i].conf = conf;
+    if (snprintf(threads[i].dir, sizeof(threads[i].dir), "%s/t%d", base, i)
+          >= sizeof(threads[i].dir)) {
+      ret = -ENAMETOOLONG;
+      goto done;
+    }
+    if (mkdir(threads[i].dir, 0755)) {
+      ret = -errno;
+      fprintf(stderr, "FUSE_BENCH: failed to create %s: error %d\n",
+              threads[i].dir, ret);
+      goto done;
+    }
+  }
+  printf("%-16s %7s %10s %10s %10s %10s %10s %10s %10s\n",
+         "phase", "threads", "ops", "MB/s", "ops/s", "p50(us)", "p90(us)",
+         "p99(us)", "max(us)");
+  for (i = 0; !ret && i < conf->numBlockSizes; i++) {
+    snprintf(name, sizeof(name), "write(%d)", conf->blockSizes[i]);
+    ret = runPhase(threads, numThreads, FUSE_BENCH_WRITE,
+                   conf->blockSizes[i], name);
+    if (!ret) {
+      snprintf(name, sizeof(name), "read(%d)", conf->blockSizes[i]);
+      ret = runPhase(threads, numThreads, FUSE_BENCH_READ,
+                     conf->blockSizes[i], name);
+    }
+  }
+  if (!ret) {
+    ret = runPhase(threads, numThreads, FUSE_BENCH_CREATE, 0, "create");
+  }
+  if (!ret) {
+    ret = runPhase(threads, numThreads, FUSE_BENCH_STAT, 0, "stat");
+  }
+  if (!ret) {
+    ret = runPhase(threads, numThreads, FUSE_BENCH_READDIR, 0, "readdir");
+  }
+
+done:
+  for (i = 0; i < numThreads; i++) {
+    free(threads[i].latNs);
+  }
+  if (recursiveDelete(base)) {
+    fprintf(stderr, "FUSE_BENCH: failed to delete %s\n", base);
+  }
+  return ret;
+}
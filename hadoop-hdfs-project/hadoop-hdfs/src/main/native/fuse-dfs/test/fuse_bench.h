@@ -0,0 +1,70 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FUSE_BENCH_H__
+#define __FUSE_BENCH_H__
+
+#include <stdint.h>
+
+/** The most block sizes the data phases are run with */
+#define FUSE_BENCH_MAX_BLOCK_SIZES 8
+
+struct fuseBenchConf {
+  /** How many threads run each phase */
+  int numThreads;
+  /** The size of the file each thread writes and reads back */
+  int64_t fileSize;
+  /** The sizes of the write and read calls, in bytes */
+  int blockSizes[FUSE_BENCH_MAX_BLOCK_SIZES];
+  int numBlockSizes;
+  /** How many files each thread creates, and then stats */
+  int numFiles;
+  /** How many times each thread lists its directory */
+  int numListings;
+};
+
+/**
+ * Fill in the default benchmark configuration, then override it from the
+ * environment: TLH_FUSE_BENCH_THREADS, TLH_FUSE_BENCH_FILE_SIZE (bytes),
+ * TLH_FUSE_BENCH_FILES and TLH_FUSE_BENCH_LISTINGS.
+ *
+ * @param conf             (out param) The configuration
+ */
+void fuseBenchConfFromEnv(struct fuseBenchConf *conf);
+
+/**
+ * Measure the performance of a filesystem, usually a FUSE mount.
+ *
+ * Sequential write and read throughput is measured at each block size, then
+ * the rate of creates, stats and directory listings.  Every phase runs on
+ * conf->numThreads threads at once, and prints a line with its throughput
+ * and latency percentiles to stdout.
+ *
+ * The operations will be performed under <root>/<pcomp>, which is deleted
+ * afterwards.  This directory should not exist prior to the benchmark.
+ *
+ * @param root             The root directory for the benchmark.
+ * @param pcomp            Path component to add to root
+ * @param conf             The configuration
+ *
+ * @return                 0 on success; negative error code otherwise
+ */
+int runFuseBench(const char *root, const char *pcomp,
+                 const struct fuseBenchConf *conf);
+
+#endif
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include "fuse-dfs/test/fuse_bench.h"
 #include "fuse-dfs/test/fuse_workload.h"
 #include "libhdfs/expect.h"
 #include "libhdfs/hdfs.h"
@@ -261,6 +262,9 @@ static int spawnFuseServer(const char *argv0,
 
 /**
  * Test that we can start up fuse_dfs and do some stuff.
+ *
+ * With TLH_FUSE_BENCH set, the mount is then benchmarked; see
+ * fuseBenchConfFromEnv for the settings.
  */
 int main(int argc, char **argv)
 {
@@ -322,6 +326,19 @@ int main(int argc, char **argv)
     ret = EXIT_FAILURE;
     goto done_nmd_shutdown;
   }
+  if (getenv("TLH_FUSE_BENCH")) {
+    struct fuseBenchConf benchConf;
+
+    fuseBenchConfFromEnv(&benchConf);
+    ret = runFuseBench(mntPoint, "bench", &benchConf);
+    if (ret) {
+      fprintf(stderr, "FUSE_TEST: runFuseBench failed with error "
+              "code %d\n", ret);
+      cleanupFuse(mntPoint);
+      ret = EXIT_FAILURE;
+      goto done_nmd_shutdown;
+    }
+  }
   if (cleanupFuse(mntPoint)) {
     fprintf(stderr, "FUSE_TEST: fuserMount -u %s failed with error "
             "code %d\n", mntPoint, ret);
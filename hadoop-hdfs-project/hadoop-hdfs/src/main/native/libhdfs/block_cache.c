@@ -0,0 +1,232 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "block_cache.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct blockCacheEntry {
+    /** Next entry in the same hash bucket */
+    struct blockCacheEntry *hashNext;
+    /** Neighbours in the LRU list; lruPrev is more recently used */
+    struct blockCacheEntry *lruPrev, *lruNext;
+    struct blockCacheFile file;
+    int64_t blockIdx;
+    uint32_t hash;
+    int32_t len;
+    char data[];
+};
+
+static pthread_mutex_t gCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static struct blockCacheEntry **gBuckets = NULL;
+static uint32_t gNumBuckets = 0;
+static struct blockCacheEntry *gLruHead = NULL, *gLruTail = NULL;
+static int64_t gCapacity = 0, gUsed = 0;
+static int32_t gBlockSize = 0;
+
+static uint32_t blockHash(const struct blockCacheFile *file, int64_t blockIdx)
+{
+    uint32_t hash = 2166136261U;
+    const char *c;
+
+    for (c = file->uri; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619U;
+    }
+    hash = (hash ^ (uint32_t)file->mtime) * 16777619U;
+    hash = (hash ^ (uint32_t)file->length) * 16777619U;
+    hash = (hash ^ (uint32_t)blockIdx) * 16777619U;
+    hash = (hash ^ (uint32_t)(blockIdx >> 32)) * 16777619U;
+    return hash;
+}
+
+int blockCacheInit(int64_t capacity, int32_t blockSize)
+{
+    int64_t maxBlocks;
+    uint32_t numBuckets = 64;
+
+    if (capacity <= 0 || blockSize <= 0) {
+        return EINVAL;
+    }
+    pthread_mutex_lock(&gCacheLock);
+    if (gBuckets) {
+        pthread_mutex_unlock(&gCacheLock);
+        return 0;
+    }
+    maxBlocks = capacity / blockSize + 1;
+    while (numBuckets < maxBlocks && numBuckets < (1U << 20)) {
+        numBuckets <<= 1;
+    }
+    gBuckets = calloc(numBuckets, sizeof(struct blockCacheEntry *));
+    if (!gBuckets) {
+        pthread_mutex_unlock(&gCacheLock);
+        return ENOMEM;
+    }
+    gNumBuckets = numBuckets;
+    gCapacity = capacity;
+    gBlockSize = blockSize;
+    pthread_mutex_unlock(&gCacheLock);
+    return 0;
+}
+
+int32_t blockCacheBlockSize(void)
+{
+    int32_t blockSize;
+
+    pthread_mutex_lock(&gCacheLock);
+    blockSize = gBlockSize;
+    pthread_mutex_unlock(&gCacheLock);
+    return blockSize;
+}
+
+static struct blockCacheEntry *findEntry(const struct blockCacheFile *file,
+                                         int64_t blockIdx, uint32_t hash)
+{
+    struct blockCacheEntry *entry;
+
+    for (entry = gBuckets[hash & (gNumBuckets - 1)]; entry;
+            entry = entry->hashNext) {
+        if (entry->hash == hash && entry->blockIdx == blockIdx &&
+                entry->file.mtime == file->mtime &&
+                entry->file.length == file->length &&
+                !strcmp(entry->file.uri, file->uri)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void lruUnlink(struct blockCacheEntry *entry)
+{
+    if (entry->lruPrev) {
+        entry->lruPrev->lruNext = entry->lruNext;
+    } else {
+        gLruHead = entry->lruNext;
+    }
+    if (entry->lruNext) {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    } else {
+        gLruTail = entry->lruPrev;
+    }
+    entry->lruPrev = entry->lruNext = NULL;
+}
+
+static void lruPushFront(struct blockCacheEntry *entry)
+{
+    entry->lruPrev = NULL;
+    entry->lruNext = gLruHead;
+    if (gLruHead) {
+        gLruHead->lruPrev = entry;
+    } else {
+        gLruTail = entry;
+    }
+    gLruHead = entry;
+}
+
+static void evictEntry(struct blockCacheEntry *entry)
+{
+    struct blockCacheEntry **link;
+
+    for (link = &gBuckets[entry->hash & (gNumBuckets - 1)]; *link;
+            link = &(*link)->hashNext) {
+        if (*link == entry) {
+            *link = entry->hashNext;
+            break;
+        }
+    }
+    lruUnlink(entry);
+    gUsed -= entry->len;
+    free(entry->file.uri);
+    free(entry);
+}
+
+int32_t blockCacheGet(const struct blockCacheFile *file, int64_t blockIdx,
+                      int32_t off, void *buf, int32_t len)
+{
+    struct blockCacheEntry *entry;
+    uint32_t hash;
+    int32_t ret = -1;
+
+    if (!file->uri) {
+        return -1;
+    }
+    hash = blockHash(file, blockIdx);
+    pthread_mutex_lock(&gCacheLock);
+    if (gBuckets) {
+        entry = findEntry(file, blockIdx, hash);
+        if (entry) {
+            ret = 0;
+            if (off < entry->len) {
+                ret = entry->len - off;
+                if (ret > len) {
+                    ret = len;
+                }
+                memcpy(buf, entry->data + off, ret);
+            }
+            lruUnlink(entry);
+            lruPushFront(entry);
+        }
+    }
+    pthread_mutex_unlock(&gCacheLock);
+    return ret;
+}
+
+void blockCachePut(const struct blockCacheFile *file, int64_t blockIdx,
+                   const void *data, int32_t len)
+{
+    struct blockCacheEntry *entry;
+    uint32_t hash;
+
+    if (!file->uri || len < 0) {
+        return;
+    }
+    hash = blockHash(file, blockIdx);
+    // Copy outside the lock; a racing put of the same block is dropped below
+    entry = malloc(sizeof(struct blockCacheEntry) + len);
+    if (!entry) {
+        return;
+    }
+    entry->file = *file;
+    entry->file.uri = strdup(file->uri);
+    if (!entry->file.uri) {
+        free(entry);
+        return;
+    }
+    entry->blockIdx = blockIdx;
+    entry->hash = hash;
+    entry->len = len;
+    memcpy(entry->data, data, len);
+
+    pthread_mutex_lock(&gCacheLock);
+    if (!gBuckets || len > gCapacity || findEntry(file, blockIdx, hash)) {
+        pthread_mutex_unlock(&gCacheLock);
+        free(entry->file.uri);
+        free(entry);
+        return;
+    }
+    while (gUsed + len > gCapacity && gLruTail) {
+        evictEntry(gLruTail);
+    }
+    entry->hashNext = gBuckets[hash & (gNumBuckets - 1)];
+    gBuckets[hash & (gNumBuckets - 1)] = entry;
+    lruPushFront(entry);
+    gUsed += len;
+    pthread_mutex_unlock(&gCacheLock);
+}
@@ -0,0 +1,97 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_BLOCK_CACHE_H
+#define LIBHDFS_BLOCK_CACHE_H
+
+/**
+ * A process-wide LRU cache of file data for libhdfs.
+ *
+ * Files are cut into fixed-size blocks, and each cached block is keyed by
+ * the version of the file it belongs to and its index in the file.  A
+ * version is the fully qualified path of the file, which names the cluster
+ * as well, together with the modification time and length the file had
+ * when it was opened.  A file that is rewritten, appended to, or replaced
+ * by another one is thus never served from the blocks of the old one; the
+ * blocks of versions that are no longer read age out of the LRU.  A block
+ * shorter than the block size is the last one of the file.
+ */
+
+#include <stdint.h>
+
+/**
+ * A version of a file, whose blocks are cached together.
+ */
+struct blockCacheFile {
+    /** The fully qualified path, with the filesystem's scheme and
+     * authority */
+    char *uri;
+    /** The modification time, in milliseconds, when the file was opened */
+    int64_t mtime;
+    /** The length of the file when it was opened */
+    int64_t length;
+};
+
+/**
+ * Create the cache, if it does not exist yet.  The first caller decides
+ * the capacity and block size; later calls do nothing.
+ *
+ * @param capacity      The most bytes of data to cache.
+ * @param blockSize     The size of the blocks files are cut into.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+int blockCacheInit(int64_t capacity, int32_t blockSize);
+
+/**
+ * Get the block size of the cache.
+ *
+ * @return              The block size, or 0 if there is no cache.
+ */
+int32_t blockCacheBlockSize(void);
+
+/**
+ * Copy cached data out of a block.
+ *
+ * @param file          The version of the file.
+ * @param blockIdx      The index of the block in the file.
+ * @param off           The offset within the block to copy from.
+ * @param buf           (out param) Where to copy the data.
+ * @param len           The most bytes to copy.
+ *
+ * @return              The number of bytes copied, which is 0 if off is
+ *                      past the end of the file; -1 if the block is not
+ *                      cached.
+ */
+int32_t blockCacheGet(const struct blockCacheFile *file, int64_t blockIdx,
+                      int32_t off, void *buf, int32_t len);
+
+/**
+ * Add a block to the cache, evicting the least recently used blocks to
+ * make room.  The data is copied.
+ *
+ * @param file          The version of the file.
+ * @param blockIdx      The index of the block in the file.
+ * @param data          The contents of the block.
+ * @param len           The length of the block.  Less than the block size
+ *                      only for the last block of the file.
+ */
+void blockCachePut(const struct blockCacheFile *file, int64_t blockIdx,
+                   const void *data, int32_t len);
+
+#endif
@@ -21,6 +21,7 @@
 #include "jni_helper.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -59,6 +60,11 @@ static const struct ExceptionInfo gExceptionInfo[] = {
         .noPrintFlag = NOPRINT_EXC_ILLEGAL_ARGUMENT,
         .excErrno = EINVAL,
     },
+    {
+        .name = "java/lang/UnsupportedOperationException",
+        .noPrintFlag = NOPRINT_EXC_UNSUPPORTED_OPERATION,
+        .excErrno = ENOTSUP,
+    },
     {
         .name = "java/lang/OutOfMemoryError",
         .noPrintFlag = 0,
@@ -67,6 +73,87 @@ static const struct ExceptionInfo gExceptionInfo[] = {
     
 };
 
+/**
+ * The classes named in gExceptionInfo, resolved on first use so that an
+ * exception can be matched with IsInstanceOf rather than by fetching and
+ * comparing its class name.  An entry is NULL if its class could not be
+ * loaded; such entries are matched by name.
+ */
+static jclass gExceptionClasses[EXCEPTION_INFO_LEN];
+static int gExceptionClassesLoaded = 0;
+static pthread_mutex_t gExceptionClassesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void loadExceptionClasses(JNIEnv *env)
+{
+    int i;
+    jclass cls;
+
+    pthread_mutex_lock(&gExceptionClassesLock);
+    if (!gExceptionClassesLoaded) {
+        for (i = 0; i < EXCEPTION_INFO_LEN; i++) {
+            cls = (*env)->FindClass(env, gExceptionInfo[i].name);
+            if (!cls) {
+                (*env)->ExceptionClear(env);
+                continue;
+            }
+            gExceptionClasses[i] = (*env)->NewGlobalRef(env, cls);
+            (*env)->DeleteLocalRef(env, cls);
+        }
+        __sync_synchronize();
+        gExceptionClassesLoaded = 1;
+    }
+    pthread_mutex_unlock(&gExceptionClassesLock);
+}
+
+static void lookUpClassName(JNIEnv *env, jthrowable exc, char **className)
+{
+    jthrowable jthr;
+
+    jthr = classNameOfObject(exc, env, className);
+    if (jthr) {
+        fprintf(stderr, "PrintExceptionAndFree: error determining class name "
+            "of exception.\n");
+        *className = strdup("(unknown)");
+        destroyLocalReference(env, jthr);
+    }
+}
+
+/**
+ * Find the gExceptionInfo entry for an exception.
+ *
+ * @param env             The JNI environment
+ * @param exc             The exception
+ * @param className       (inout param) The class name of the exception, if
+ *                        it has been looked up; looked up here if it is
+ *                        NULL and some entry has to be matched by name.
+ *
+ * @return                The index of the entry, or -1 if there is none
+ */
+static int findExceptionInfo(JNIEnv *env, jthrowable exc, char **className)
+{
+    int i;
+
+    if (!gExceptionClassesLoaded) {
+        loadExceptionClasses(env);
+    }
+    __sync_synchronize();
+    for (i = 0; i < EXCEPTION_INFO_LEN; i++) {
+        if (gExceptionClasses[i]) {
+            if ((*env)->IsInstanceOf(env, exc, gExceptionClasses[i])) {
+                return i;
+            }
+            continue;
+        }
+        if (!*className) {
+            lookUpClassName(env, exc, className);
+        }
+        if (*className && !strcmp(gExceptionInfo[i].name, *className)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 void getExceptionInfo(const char *excName, int noPrintFlags,
                       int *excErrno, int *shouldPrint)
 {
@@ -95,19 +182,8 @@ int printExceptionAndFreeV(JNIEnv *env, jthrowable exc, int noPrintFlags,
     jvalue jVal;
     jthrowable jthr;
 
-    jthr = classNameOfObject(exc, env, &className);
-    if (jthr) {
-        fprintf(stderr, "PrintExceptionAndFree: error determining class name "
-            "of exception.\n");
-        className = strdup("(unknown)");
-        destroyLocalReference(env, jthr);
-    }
-    for (i = 0; i < EXCEPTION_INFO_LEN; i++) {
-        if (!strcmp(gExceptionInfo[i].name, className)) {
-            break;
-        }
-    }
-    if (i < EXCEPTION_INFO_LEN) {
+    i = findExceptionInfo(env, exc, &className);
+    if (i >= 0) {
         noPrint = (gExceptionInfo[i].noPrintFlag & noPrintFlags);
         excErrno = gExceptionInfo[i].excErrno;
     } else {
@@ -115,6 +191,11 @@ int printExceptionAndFreeV(JNIEnv *env, jthrowable exc, int noPrintFlags,
         excErrno = EINTERNAL;
     }
     if (!noPrint) {
+        // Expected exceptions never get this far, so only unexpected ones
+        // pay for the class name and stack trace
+        if (!className) {
+            lookUpClassName(env, exc, &className);
+        }
         vfprintf(stderr, fmt, ap);
         fprintf(stderr, " error:\n");
 
@@ -0,0 +1,387 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exists_cache.h"
+#include "util/tree.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** The longest path that is cached, including the terminating NUL */
+#define EXISTS_CACHE_MAX_PATH 4096
+
+struct existsCacheFs;
+
+struct existsEntry {
+    RB_ENTRY(existsEntry) link;
+    /** Neighbours in the owner's list; prev was added earlier */
+    struct existsEntry *prev, *next;
+    struct existsCacheFs *owner;
+    /** CLOCK_MONOTONIC time, in nanoseconds, after which this is stale */
+    uint64_t expiry;
+    int exists;
+    /** Normalized absolute path.  Points into the same allocation. */
+    const char *path;
+};
+
+struct existsCacheFs {
+    RB_ENTRY(existsCacheFs) link;
+    const void *fs;
+    uint64_t ttlNs;
+    /** Incremented by every invalidation */
+    uint64_t generation;
+    /** This handle's entries, oldest first */
+    struct existsEntry *head, *tail;
+    int numEntries;
+};
+
+static int existsEntryCompare(const struct existsEntry *a,
+                              const struct existsEntry *b)
+{
+    if (a->owner != b->owner) {
+        return (a->owner < b->owner) ? -1 : 1;
+    }
+    return strcmp(a->path, b->path);
+}
+
+static int existsCacheFsCompare(const struct existsCacheFs *a,
+                                const struct existsCacheFs *b)
+{
+    return (a->fs < b->fs) ? -1 : ((a->fs > b->fs) ? 1 : 0);
+}
+
+RB_HEAD(existsEntries, existsEntry);
+RB_HEAD(existsCacheFsTree, existsCacheFs);
+RB_GENERATE(existsEntries, existsEntry, link, existsEntryCompare);
+RB_GENERATE(existsCacheFsTree, existsCacheFs, link, existsCacheFsCompare);
+
+static pthread_mutex_t gExistsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct existsEntries gEntries = RB_INITIALIZER(&gEntries);
+static struct existsCacheFsTree gFsTree = RB_INITIALIZER(&gFsTree);
+/** Size of gFsTree.  Read without the lock so that handles without a
+ * cache do not contend on it. */
+static volatile int gNumFs = 0;
+
+static uint64_t monotonicNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Normalize an absolute path: repeated slashes are collapsed and a
+ * trailing slash is dropped.
+ *
+ * @param path      The path.
+ * @param out       (out param) A buffer of EXISTS_CACHE_MAX_PATH bytes.
+ *
+ * @return          0 on success; -1 if the path is not absolute, is too
+ *                  long, or has "." or ".." components.
+ */
+static int normalizePath(const char *path, char *out)
+{
+    const char *c, *component;
+    size_t len = 0;
+
+    if (!path || path[0] != '/') {
+        return -1;
+    }
+    c = path;
+    while (*c) {
+        while (*c == '/') {
+            c++;
+        }
+        if (!*c) {
+            break;
+        }
+        component = c;
+        while (*c && *c != '/') {
+            c++;
+        }
+        if ((c - component == 1 && component[0] == '.') ||
+                (c - component == 2 && component[0] == '.' &&
+                 component[1] == '.')) {
+            return -1;
+        }
+        if (len + 1 + (c - component) >= EXISTS_CACHE_MAX_PATH) {
+            return -1;
+        }
+        out[len++] = '/';
+        memcpy(out + len, component, c - component);
+        len += c - component;
+    }
+    if (len == 0) {
+        out[len++] = '/';
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+static struct existsCacheFs *findFs(const void *fs)
+{
+    struct existsCacheFs key;
+
+    key.fs = fs;
+    return RB_FIND(existsCacheFsTree, &gFsTree, &key);
+}
+
+static struct existsEntry *findEntry(struct existsCacheFs *owner,
+                                     const char *path)
+{
+    struct existsEntry key;
+
+    key.owner = owner;
+    key.path = path;
+    return RB_FIND(existsEntries, &gEntries, &key);
+}
+
+static void removeEntry(struct existsEntry *entry)
+{
+    struct existsCacheFs *owner = entry->owner;
+
+    RB_REMOVE(existsEntries, &gEntries, entry);
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        owner->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        owner->tail = entry->prev;
+    }
+    owner->numEntries--;
+    free(entry);
+}
+
+static void removeAllEntries(struct existsCacheFs *owner)
+{
+    while (owner->head) {
+        removeEntry(owner->head);
+    }
+}
+
+/**
+ * Drop the entries of a handle that have expired.  Entries are mostly
+ * added in expiry order, so this stops at the first live one.
+ */
+static void trimExpired(struct existsCacheFs *owner, uint64_t now)
+{
+    while (owner->head && owner->head->expiry <= now) {
+        removeEntry(owner->head);
+    }
+}
+
+int existsCacheAddFs(const void *fs, int64_t ttlMs)
+{
+    struct existsCacheFs *owner;
+
+    if (ttlMs <= 0) {
+        return EINVAL;
+    }
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (!owner) {
+        owner = calloc(1, sizeof(*owner));
+        if (!owner) {
+            pthread_mutex_unlock(&gExistsLock);
+            return ENOMEM;
+        }
+        owner->fs = fs;
+        RB_INSERT(existsCacheFsTree, &gFsTree, owner);
+        gNumFs++;
+    }
+    owner->ttlNs = (uint64_t)ttlMs * 1000000ULL;
+    pthread_mutex_unlock(&gExistsLock);
+    return 0;
+}
+
+void existsCacheRemoveFs(const void *fs)
+{
+    struct existsCacheFs *owner;
+
+    if (!gNumFs) {
+        return;
+    }
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (owner) {
+        removeAllEntries(owner);
+        RB_REMOVE(existsCacheFsTree, &gFsTree, owner);
+        gNumFs--;
+        free(owner);
+    }
+    pthread_mutex_unlock(&gExistsLock);
+}
+
+int existsCacheGet(const void *fs, const char *path)
+{
+    char norm[EXISTS_CACHE_MAX_PATH];
+    struct existsCacheFs *owner;
+    struct existsEntry *entry;
+    uint64_t now;
+    int ret = -1;
+
+    if (!gNumFs || normalizePath(path, norm)) {
+        return -1;
+    }
+    now = monotonicNs();
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (owner) {
+        trimExpired(owner, now);
+        entry = findEntry(owner, norm);
+        if (entry) {
+            if (entry->expiry > now) {
+                ret = entry->exists;
+            } else {
+                removeEntry(entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&gExistsLock);
+    return ret;
+}
+
+uint64_t existsCacheGeneration(const void *fs)
+{
+    struct existsCacheFs *owner;
+    uint64_t generation = 0;
+
+    if (!gNumFs) {
+        return 0;
+    }
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (owner) {
+        generation = owner->generation;
+    }
+    pthread_mutex_unlock(&gExistsLock);
+    return generation;
+}
+
+void existsCachePut(const void *fs, const char *path, int exists,
+                    uint64_t generation)
+{
+    char norm[EXISTS_CACHE_MAX_PATH];
+    struct existsCacheFs *owner;
+    struct existsEntry *entry, *old;
+    size_t len;
+    uint64_t now;
+
+    if (!gNumFs || normalizePath(path, norm)) {
+        return;
+    }
+    len = strlen(norm) + 1;
+    // Allocate outside the lock; it is freed below if it is not needed
+    entry = malloc(sizeof(*entry) + len);
+    if (!entry) {
+        return;
+    }
+    memcpy(entry + 1, norm, len);
+    entry->path = (const char *)(entry + 1);
+    entry->exists = !!exists;
+    now = monotonicNs();
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (!owner || owner->generation != generation) {
+        pthread_mutex_unlock(&gExistsLock);
+        free(entry);
+        return;
+    }
+    trimExpired(owner, now);
+    entry->owner = owner;
+    entry->expiry = now + owner->ttlNs;
+    old = findEntry(owner, norm);
+    if (old) {
+        removeEntry(old);
+    }
+    while (owner->numEntries >= EXISTS_CACHE_MAX_ENTRIES) {
+        removeEntry(owner->head);
+    }
+    RB_INSERT(existsEntries, &gEntries, entry);
+    entry->prev = owner->tail;
+    entry->next = NULL;
+    if (owner->tail) {
+        owner->tail->next = entry;
+    } else {
+        owner->head = entry;
+    }
+    owner->tail = entry;
+    owner->numEntries++;
+    pthread_mutex_unlock(&gExistsLock);
+}
+
+void existsCacheInvalidate(const void *fs, const char *path)
+{
+    char norm[EXISTS_CACHE_MAX_PATH];
+    struct existsCacheFs *owner;
+    struct existsEntry key, *entry, *next;
+    size_t len, i;
+
+    if (!gNumFs) {
+        return;
+    }
+    pthread_mutex_lock(&gExistsLock);
+    owner = findFs(fs);
+    if (!owner) {
+        goto done;
+    }
+    owner->generation++;
+    if (normalizePath(path, norm) || !strcmp(norm, "/")) {
+        removeAllEntries(owner);
+        goto done;
+    }
+    len = strlen(norm);
+    // Everything beneath the path sorts just after path + "/"
+    norm[len] = '/';
+    norm[len + 1] = '\0';
+    key.owner = owner;
+    key.path = norm;
+    for (entry = RB_NFIND(existsEntries, &gEntries, &key); entry;
+            entry = next) {
+        if (entry->owner != owner || strncmp(entry->path, norm, len + 1)) {
+            break;
+        }
+        next = RB_NEXT(existsEntries, &gEntries, entry);
+        removeEntry(entry);
+    }
+    // The path itself, then each of its parents
+    norm[len] = '\0';
+    for (i = len; i > 0; i--) {
+        if (i < len && norm[i] != '/') {
+            continue;
+        }
+        norm[i] = '\0';
+        entry = findEntry(owner, norm);
+        if (entry) {
+            removeEntry(entry);
+        }
+    }
+    entry = findEntry(owner, "/");
+    if (entry) {
+        removeEntry(entry);
+    }
+done:
+    pthread_mutex_unlock(&gExistsLock);
+}
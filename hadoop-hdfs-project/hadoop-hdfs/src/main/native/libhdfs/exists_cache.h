@@ -0,0 +1,105 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_EXISTS_CACHE_H
+#define LIBHDFS_EXISTS_CACHE_H
+
+/**
+ * A process-wide cache of whether paths exist, for libhdfs.
+ *
+ * Only filesystem handles that have been added with existsCacheAddFs use
+ * the cache.  Each entry is keyed by the filesystem handle and an absolute
+ * path, and is forgotten once it is older than the handle's time to live.
+ * Changes made through the same handle invalidate the entries they affect;
+ * changes made by anyone else are only seen once the entries expire.
+ */
+
+#include <stdint.h>
+
+/**
+ * The most entries kept for one filesystem handle.  The oldest entries are
+ * dropped to make room for new ones.
+ */
+#define EXISTS_CACHE_MAX_ENTRIES 65536
+
+/**
+ * Start caching lookups on a filesystem handle.  Adding a handle again
+ * changes its time to live.
+ *
+ * @param fs            The filesystem handle.
+ * @param ttlMs         How long entries stay valid, in milliseconds.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+int existsCacheAddFs(const void *fs, int64_t ttlMs);
+
+/**
+ * Stop caching lookups on a filesystem handle and drop its entries.
+ * Does nothing if the handle was never added.
+ *
+ * @param fs            The filesystem handle.
+ */
+void existsCacheRemoveFs(const void *fs);
+
+/**
+ * Look up whether a path exists.
+ *
+ * @param fs            The filesystem handle.
+ * @param path          The path.
+ *
+ * @return              1 if the path exists; 0 if it does not; -1 if
+ *                      nothing valid is cached for it.
+ */
+int existsCacheGet(const void *fs, const char *path);
+
+/**
+ * Get the number of invalidations so far on a filesystem handle.  Take it
+ * before asking the filesystem whether a path exists, and pass it to
+ * existsCachePut with the answer.
+ *
+ * @param fs            The filesystem handle.
+ *
+ * @return              The invalidation count.
+ */
+uint64_t existsCacheGeneration(const void *fs);
+
+/**
+ * Record whether a path exists.  Does nothing if the handle has not been
+ * added, the path is not absolute, or the handle has seen an invalidation
+ * since generation was taken, as the answer may then be out of date.
+ *
+ * @param fs            The filesystem handle.
+ * @param path          The path.
+ * @param exists        Nonzero if the path exists.
+ * @param generation    What existsCacheGeneration returned before the
+ *                      filesystem was asked.
+ */
+void existsCachePut(const void *fs, const char *path, int exists,
+                    uint64_t generation);
+
+/**
+ * Forget what is cached about a path that has been changed, its parent
+ * directories and everything beneath it.  A relative path forgets
+ * everything cached for the handle.
+ *
+ * @param fs            The filesystem handle.
+ * @param path          The path.
+ */
+void existsCacheInvalidate(const void *fs, const char *path);
+
+#endif
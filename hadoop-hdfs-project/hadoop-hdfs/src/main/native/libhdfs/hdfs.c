@@ -16,13 +16,24 @@
  * limitations under the License.
  */
 
+#include "block_cache.h"
 #include "exception.h"
+#include "exists_cache.h"
 #include "hdfs.h"
+#include "hdfs_buffer_pool.h"
+#include "hdfs_metrics.h"
+#include "hedged_read.h"
 #include "jni_helper.h"
+#include "local_block.h"
+#include "util/tree.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 /* Some frequently used Java paths */
 #define HADOOP_CONF     "org/apache/hadoop/conf/Configuration"
@@ -35,6 +46,10 @@
 #define HADOOP_ISTRM    "org/apache/hadoop/fs/FSDataInputStream"
 #define HADOOP_OSTRM    "org/apache/hadoop/fs/FSDataOutputStream"
 #define HADOOP_STAT     "org/apache/hadoop/fs/FileStatus"
+#define HADOOP_RITERATOR "org/apache/hadoop/fs/RemoteIterator"
+#define HADOOP_HDFS_ISTRM "org/apache/hadoop/hdfs/client/HdfsDataInputStream"
+#define HADOOP_RSTATS   "org/apache/hadoop/hdfs/DFSInputStream$ReadStatistics"
+#define HADOOP_LOCAL_BLOCK "org/apache/hadoop/hdfs/DFSInputStream$LocalBlock"
 #define HADOOP_FSPERM   "org/apache/hadoop/fs/permission/FsPermission"
 #define JAVA_NET_ISA    "java/net/InetSocketAddress"
 #define JAVA_NET_URI    "java/net/URI"
@@ -53,9 +68,26 @@
 
 // Bit fields for hdfsFile_internal flags
 #define HDFS_FILE_SUPPORTS_DIRECT_READ (1<<0)
+#define HDFS_FILE_SUPPORTS_DIRECT_PREAD (1<<1)
+#define HDFS_FILE_NATIVE_LOCAL_READ (1<<2)
+
+/**
+ * The smallest and largest byte[] kept per file for copying through.
+ * Longer writes are copied through it in pieces, and longer reads are
+ * shortened.
+ */
+#define SCRATCH_ARRAY_MIN (64 * 1024)
+#define SCRATCH_ARRAY_MAX (1024 * 1024)
 
 tSize readDirect(hdfsFS fs, hdfsFile f, void* buffer, tSize length);
-static void hdfsFreeFileInfoEntry(hdfsFileInfo *hdfsFileInfo);
+struct groupCommit;
+static void groupCommitStop(struct groupCommit *gc);
+static tSize preadDirect(hdfsFS fs, hdfsFile f, tOffset position,
+                         void* buffer, tSize length);
+static tSize preadUncached(hdfsFS fs, hdfsFile f, tOffset position,
+                           void* buffer, tSize length);
+static int32_t hedgedPread(void *arg, int hedge, int64_t position,
+                           void *buf, int32_t len);
 
 /**
  * The C equivalent of org.apache.org.hadoop.FSData(Input|Output)Stream .
@@ -67,6 +99,16 @@ enum hdfsStreamType
     OUTPUT = 2,
 };
 
+/**
+ * The handle to a directory being listed with hdfsReadDirBatch.
+ */
+struct hdfsDir_internal {
+    /** Global reference to a RemoteIterator<FileStatus> */
+    jobject iter;
+    /** The directory path, for error messages */
+    char *path;
+};
+
 /**
  * The 'file-handle' to a file in hdfs.
  */
@@ -74,6 +116,34 @@ struct hdfsFile_internal {
     void* file;
     enum hdfsStreamType type;
     int flags;
+    /** The version of the file open, if preads use the block cache */
+    struct blockCacheFile cacheFile;
+    /** The read-ahead buffer, holding file data from raStart to raEnd */
+    char *raBuf;
+    tSize raWindow;
+    tSize raStart;
+    tSize raEnd;
+    /** A byte[] kept for reads and writes to copy through, and its guard */
+    jbyteArray scratchArray;
+    tSize scratchArrayLen;
+    pthread_mutex_t scratchLock;
+    /**
+     * For native local reads: the block last read, and the extent of the
+     * last block found not to be on this host, both guarded by localLock
+     */
+    struct localBlock *localBlock;
+    tOffset remoteStart;
+    tOffset remoteEnd;
+    pthread_mutex_t localLock;
+    /** The posix_fadvise advice and drop-behind for local blocks */
+    int localAdvice;
+    int localDropBehind;
+    /** Bytes read natively, which the stream's read statistics miss */
+    int64_t nativeBytesRead;
+    /** Set by hdfsFileEnableGroupCommit */
+    struct groupCommit *groupCommit;
+    /** Runs the preads of the file, if they are hedged */
+    struct hedgedReader *hedgedReader;
 };
 
 int hdfsFileIsOpenForRead(hdfsFile file)
@@ -247,6 +317,46 @@ static jthrowable hadoopConfGetInt(JNIEnv *env, jobject jConfiguration,
     return NULL;
 }
 
+static jthrowable hadoopConfGetLong(JNIEnv *env, jobject jConfiguration,
+        const char *key, int64_t *val)
+{
+    jthrowable jthr = NULL;
+    jvalue jVal;
+    jstring jkey = NULL;
+
+    jthr = newJavaStr(env, key, &jkey);
+    if (jthr)
+        return jthr;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jConfiguration,
+            HADOOP_CONF, "getLong", JMETHOD2(JPARAM(JAVA_STRING), "J", "J"),
+            jkey, (jlong)(*val));
+    destroyLocalReference(env, jkey);
+    if (jthr)
+        return jthr;
+    *val = jVal.j;
+    return NULL;
+}
+
+static jthrowable hadoopConfGetBool(JNIEnv *env, jobject jConfiguration,
+        const char *key, int *val)
+{
+    jthrowable jthr = NULL;
+    jvalue jVal;
+    jstring jkey = NULL;
+
+    jthr = newJavaStr(env, key, &jkey);
+    if (jthr)
+        return jthr;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jConfiguration,
+            HADOOP_CONF, "getBoolean", JMETHOD2(JPARAM(JAVA_STRING), "Z", "Z"),
+            jkey, (jboolean)(!!*val));
+    destroyLocalReference(env, jkey);
+    if (jthr)
+        return jthr;
+    *val = jVal.z;
+    return NULL;
+}
+
 int hdfsConfGetInt(const char *key, int32_t *val)
 {
     JNIEnv *env;
@@ -287,6 +397,7 @@ struct hdfsBuilderConfOpt {
 
 struct hdfsBuilder {
     int forceNewInstance;
+    int shared;
     const char *nn;
     tPort port;
     const char *kerbTicketCachePath;
@@ -294,9 +405,112 @@ struct hdfsBuilder {
     struct hdfsBuilderConfOpt *opts;
 };
 
+/**
+ * The classes that hdfsWarmUp loads ahead of the first call that needs
+ * them.  Loading one also loads whatever it links against.
+ */
+static const char * const gWarmUpClasses[] = {
+    HADOOP_CONF,
+    HADOOP_PATH,
+    HADOOP_FS,
+    HADOOP_DFS,
+    HADOOP_ISTRM,
+    HADOOP_OSTRM,
+    HADOOP_STAT,
+    HADOOP_BLK_LOC,
+    HADOOP_FSPERM,
+    "org/apache/hadoop/hdfs/DFSClient",
+    "org/apache/hadoop/hdfs/DFSInputStream",
+    "org/apache/hadoop/hdfs/DFSOutputStream",
+    "org/apache/hadoop/hdfs/RemoteBlockReader2",
+    "org/apache/hadoop/hdfs/protocolPB/ClientNamenodeProtocolTranslatorPB",
+    "org/apache/hadoop/security/UserGroupInformation",
+    "org/apache/hadoop/fs/FileUtil",
+};
+
+#define NUM_WARM_UP_CLASSES \
+    ((int)(sizeof(gWarmUpClasses) / sizeof(gWarmUpClasses[0])))
+
+static pthread_once_t gWarmUpOnce = PTHREAD_ONCE_INIT;
+
+static void *warmUpMain(void *v)
+{
+    JNIEnv *env;
+    jthrowable jthr;
+    jobject jConfiguration = NULL;
+    jstring jKey = NULL;
+    jvalue jVal;
+    jclass cls;
+    int i;
+
+    // Creating the JVM holds the jvmMutex, so a caller that needs the JVM
+    // before it is ready just waits for this instead of starting another
+    env = getJNIEnv();
+    if (!env) {
+        return NULL;
+    }
+    for (i = 0; i < NUM_WARM_UP_CLASSES; i++) {
+        jthr = globalClassReference(gWarmUpClasses[i], env, &cls);
+        if (jthr) {
+            // Not every build has every class; nothing depends on this
+            destroyLocalReference(env, jthr);
+        }
+    }
+    // Reading a key parses the default resources, which loads the XML
+    // parser
+    jthr = constructNewObjectOfClass(env, &jConfiguration, HADOOP_CONF,
+                                     "()V");
+    if (!jthr) {
+        jthr = newJavaStr(env, "fs.defaultFS", &jKey);
+    }
+    if (!jthr) {
+        jthr = invokeMethod(env, &jVal, INSTANCE, jConfiguration,
+                HADOOP_CONF, "get", JMETHOD1(JPARAM(JAVA_STRING),
+                JPARAM(JAVA_STRING)), jKey);
+        if (!jthr) {
+            destroyLocalReference(env, jVal.l);
+        }
+    }
+    if (jthr) {
+        printExceptionAndFree(env, jthr, PRINT_EXC_ALL, "hdfsWarmUp");
+    }
+    destroyLocalReference(env, jKey);
+    destroyLocalReference(env, jConfiguration);
+    // Exiting detaches this thread from the JVM
+    return NULL;
+}
+
+static void startWarmUp(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret;
+
+    ret = pthread_attr_init(&attr);
+    if (ret) {
+        return;
+    }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, warmUpMain, NULL);
+    if (ret) {
+        fprintf(stderr, "hdfsWarmUp: pthread_create failed with error "
+                "%d\n", ret);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void hdfsWarmUp(void)
+{
+    pthread_once(&gWarmUpOnce, startWarmUp);
+}
+
 struct hdfsBuilder *hdfsNewBuilder(void)
 {
-    struct hdfsBuilder *bld = calloc(1, sizeof(struct hdfsBuilder));
+    struct hdfsBuilder *bld;
+
+    // Start the JVM while the caller is still setting up its connection
+    hdfsWarmUp();
+    bld = calloc(1, sizeof(struct hdfsBuilder));
     if (!bld) {
         errno = ENOMEM;
         return NULL;
@@ -359,6 +573,11 @@ void hdfsBuilderSetKerbTicketCachePath(struct hdfsBuilder *bld,
     bld->kerbTicketCachePath = kerbTicketCachePath;
 }
 
+void hdfsBuilderSetShared(struct hdfsBuilder *bld)
+{
+    bld->shared = 1;
+}
+
 hdfsFS hdfsConnect(const char* host, tPort port)
 {
     struct hdfsBuilder *bld = hdfsNewBuilder();
@@ -472,7 +691,280 @@ static const char *hdfsBuilderToStr(const struct hdfsBuilder *bld,
     return buf;
 }
 
-hdfsFS hdfsBuilderConnect(struct hdfsBuilder *bld)
+/**
+ * Connections made with hdfsBuilderSetShared are kept here, keyed by
+ * everything the builder was given, and handed out again to later
+ * builders with the same settings.  hdfsDisconnect only drops a
+ * reference; a connection nobody uses is closed once it has been idle for
+ * CONN_CACHE_IDLE_SECS, checked whenever a shared connection is made or
+ * released.  A kerberized connection is also retired when its ticket
+ * cache is rewritten, so that new callers pick up the new ticket.
+ */
+#define CONN_CACHE_IDLE_SECS 300
+
+struct hdfsCachedConn {
+    RB_ENTRY(hdfsCachedConn) byKey;
+    RB_ENTRY(hdfsCachedConn) byFs;
+    /** The builder settings, as one string.  Dynamically allocated. */
+    char *key;
+    /** Kerberos ticket cache path, or NULL.  Dynamically allocated. */
+    char *kpath;
+    /** mtime of kpath when the connection was made */
+    time_t kpathMtime;
+    long kpathMtimeNs;
+    hdfsFS fs;
+    /** Number of hdfsBuilderConnect calls not yet disconnected */
+    int refcnt;
+    /** When refcnt last dropped to 0 */
+    time_t idleSince;
+    /** Nonzero once the connection has been taken out of gConnsByKey; it
+     * is closed when refcnt drops to 0 */
+    int condemned;
+};
+
+static int connCompareKey(const struct hdfsCachedConn *a,
+                          const struct hdfsCachedConn *b)
+{
+    return strcmp(a->key, b->key);
+}
+
+static int connCompareFs(const struct hdfsCachedConn *a,
+                         const struct hdfsCachedConn *b)
+{
+    return (a->fs < b->fs) ? -1 : ((a->fs > b->fs) ? 1 : 0);
+}
+
+RB_HEAD(connCacheByKey, hdfsCachedConn);
+RB_HEAD(connCacheByFs, hdfsCachedConn);
+RB_GENERATE(connCacheByKey, hdfsCachedConn, byKey, connCompareKey);
+RB_GENERATE(connCacheByFs, hdfsCachedConn, byFs, connCompareFs);
+
+/** The connections new builders may share */
+static struct connCacheByKey gConnsByKey = RB_INITIALIZER(&gConnsByKey);
+
+/** Every cached connection, including condemned ones still in use */
+static struct connCacheByFs gConnsByFs = RB_INITIALIZER(&gConnsByFs);
+
+/** Protects gConnsByKey, gConnsByFs and the connections in them */
+static pthread_mutex_t gConnCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int closeFileSystem(hdfsFS fs);
+
+/**
+ * Build the cache key of a builder.
+ *
+ * @return          The malloc'ed key, or NULL on OOM
+ */
+static char *connCacheKey(const struct hdfsBuilder *bld)
+{
+    struct hdfsBuilderConfOpt *opt;
+    char *key, *next;
+
+    if (asprintf(&key, "%s\n%d\n%s\n%s\n%d", bld->nn ? bld->nn : "",
+                 bld->port, bld->userName ? bld->userName : "",
+                 bld->kerbTicketCachePath ? bld->kerbTicketCachePath : "",
+                 bld->forceNewInstance) < 0) {
+        return NULL;
+    }
+    for (opt = bld->opts; opt; opt = opt->next) {
+        if (asprintf(&next, "%s\n%s=%s", key, opt->key, opt->val) < 0) {
+            free(key);
+            return NULL;
+        }
+        free(key);
+        key = next;
+    }
+    return key;
+}
+
+/**
+ * Get the mtime of a kerberos ticket cache.
+ *
+ * @return          0 on success; the errno from stat otherwise, with the
+ *                  mtime zeroed
+ */
+static int connCacheKpathMtime(const char *kpath, time_t *mtime, long *ns)
+{
+    struct stat st;
+
+    *mtime = 0;
+    *ns = 0;
+    if (stat(kpath, &st) < 0) {
+        return errno ? errno : EIO;
+    }
+    *mtime = st.st_mtim.tv_sec;
+    *ns = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/**
+ * Take a connection out of gConnsByKey, so no new builder gets it.  You
+ * must hold gConnCacheMutex.
+ *
+ * @return          The fs to close once the mutex is dropped, or NULL if
+ *                  the connection is still in use
+ */
+static hdfsFS connCacheCondemn(struct hdfsCachedConn *conn)
+{
+    hdfsFS fs = NULL;
+
+    if (!conn->condemned) {
+        RB_REMOVE(connCacheByKey, &gConnsByKey, conn);
+        conn->condemned = 1;
+    }
+    if (conn->refcnt == 0) {
+        RB_REMOVE(connCacheByFs, &gConnsByFs, conn);
+        fs = conn->fs;
+        free(conn->key);
+        free(conn->kpath);
+        free(conn);
+    }
+    return fs;
+}
+
+/**
+ * Close the connections that have been idle too long.
+ */
+static void connCacheExpire(void)
+{
+    struct hdfsCachedConn *conn, *tmp;
+    hdfsFS expired[16], fs;
+    time_t now = time(NULL);
+    int i, numExpired = 0;
+
+    pthread_mutex_lock(&gConnCacheMutex);
+    RB_FOREACH_SAFE(conn, connCacheByKey, &gConnsByKey, tmp) {
+        if (numExpired == sizeof(expired) / sizeof(expired[0])) {
+            // The rest can wait for the next call
+            break;
+        }
+        if (conn->refcnt == 0 &&
+                now - conn->idleSince >= CONN_CACHE_IDLE_SECS) {
+            fs = connCacheCondemn(conn);
+            if (fs) {
+                expired[numExpired++] = fs;
+            }
+        }
+    }
+    pthread_mutex_unlock(&gConnCacheMutex);
+    for (i = 0; i < numExpired; i++) {
+        closeFileSystem(expired[i]);
+    }
+}
+
+/**
+ * Find a usable cached connection and take a reference to it.
+ *
+ * @return          The connection's fs, or NULL if there is none
+ */
+static hdfsFS connCacheGet(const char *key, const char *kpath)
+{
+    struct hdfsCachedConn exemplar, *conn;
+    hdfsFS fs = NULL, stale = NULL;
+    time_t mtime = 0;
+    long ns = 0;
+
+    connCacheExpire();
+    pthread_mutex_lock(&gConnCacheMutex);
+    exemplar.key = (char*)key;
+    conn = RB_FIND(connCacheByKey, &gConnsByKey, &exemplar);
+    if (conn) {
+        if (kpath && (connCacheKpathMtime(kpath, &mtime, &ns) ||
+                mtime != conn->kpathMtime || ns != conn->kpathMtimeNs)) {
+            stale = connCacheCondemn(conn);
+        } else {
+            conn->refcnt++;
+            fs = conn->fs;
+        }
+    }
+    pthread_mutex_unlock(&gConnCacheMutex);
+    if (stale) {
+        closeFileSystem(stale);
+    }
+    return fs;
+}
+
+/**
+ * Add a new connection to the cache, with one reference.  If another
+ * thread has cached one for the same key in the meantime, that one is
+ * used instead and fs is closed.
+ *
+ * @return          The fs to hand to the caller
+ */
+static hdfsFS connCachePut(const char *key, const char *kpath, hdfsFS fs)
+{
+    struct hdfsCachedConn *conn, *existing;
+    hdfsFS ret = fs;
+
+    conn = calloc(1, sizeof(*conn));
+    if (!conn) {
+        // Still usable, just not shared
+        return fs;
+    }
+    conn->key = strdup(key);
+    conn->kpath = kpath ? strdup(kpath) : NULL;
+    if (!conn->key || (kpath && !conn->kpath) || (kpath &&
+            connCacheKpathMtime(kpath, &conn->kpathMtime,
+                                &conn->kpathMtimeNs))) {
+        free(conn->key);
+        free(conn->kpath);
+        free(conn);
+        return fs;
+    }
+    conn->fs = fs;
+    conn->refcnt = 1;
+    pthread_mutex_lock(&gConnCacheMutex);
+    existing = RB_INSERT(connCacheByKey, &gConnsByKey, conn);
+    if (existing) {
+        existing->refcnt++;
+        ret = existing->fs;
+    } else {
+        RB_INSERT(connCacheByFs, &gConnsByFs, conn);
+    }
+    pthread_mutex_unlock(&gConnCacheMutex);
+    if (existing) {
+        free(conn->key);
+        free(conn->kpath);
+        free(conn);
+        closeFileSystem(fs);
+    }
+    return ret;
+}
+
+/**
+ * Drop a reference to a cached connection.
+ *
+ * @return          0 if fs is cached, and has been released; 1 if it is
+ *                  not cached, and the caller must close it
+ */
+static int connCacheRelease(hdfsFS fs)
+{
+    struct hdfsCachedConn exemplar, *conn;
+    hdfsFS condemned = NULL;
+
+    pthread_mutex_lock(&gConnCacheMutex);
+    exemplar.fs = fs;
+    conn = RB_FIND(connCacheByFs, &gConnsByFs, &exemplar);
+    if (conn) {
+        if (--conn->refcnt == 0) {
+            conn->idleSince = time(NULL);
+            if (conn->condemned) {
+                condemned = connCacheCondemn(conn);
+            }
+        }
+    }
+    pthread_mutex_unlock(&gConnCacheMutex);
+    if (!conn) {
+        return 1;
+    }
+    if (condemned) {
+        closeFileSystem(condemned);
+    }
+    connCacheExpire();
+    return 0;
+}
+
+static hdfsFS hdfsBuilderConnectUntimed(struct hdfsBuilder *bld)
 {
     JNIEnv *env = 0;
     jobject jConfiguration = NULL, jFS = NULL, jURI = NULL, jCachePath = NULL;
@@ -647,7 +1139,82 @@ done:
     return (hdfsFS)jRet;
 }
 
+/**
+ * Connect through the connection cache.  Like hdfsBuilderConnectUntimed,
+ * this frees bld.
+ */
+static hdfsFS hdfsBuilderConnectShared(struct hdfsBuilder *bld)
+{
+    const char *kpath = bld->kerbTicketCachePath;
+    char *key;
+    hdfsFS fs;
+
+    key = connCacheKey(bld);
+    if (!key) {
+        hdfsFreeBuilder(bld);
+        errno = ENOMEM;
+        return NULL;
+    }
+    fs = connCacheGet(key, kpath);
+    if (fs) {
+        hdfsFreeBuilder(bld);
+    } else {
+        fs = hdfsBuilderConnectUntimed(bld);
+        if (fs) {
+            fs = connCachePut(key, kpath, fs);
+        }
+    }
+    free(key);
+    return fs;
+}
+
+hdfsFS hdfsBuilderConnect(struct hdfsBuilder *bld)
+{
+    struct hdfsBuilderConfOpt *opt;
+    uint64_t start;
+    int64_t existsTtlMs = 0;
+    hdfsFS ret;
+    int err;
+
+    // Look for the metrics key first so this connection is timed too
+    for (opt = bld->opts; opt; opt = opt->next) {
+        if (!strcmp(opt->key, HDFS_METRICS_ENABLED_KEY) &&
+                !strcmp(opt->val, "true")) {
+            metricsEnable();
+        } else if (!strcmp(opt->key, HDFS_EXISTS_CACHE_TTL_MS_KEY)) {
+            existsTtlMs = strtoll(opt->val, NULL, 10);
+        }
+    }
+    start = METRICS_START();
+    if (bld->shared) {
+        ret = hdfsBuilderConnectShared(bld);
+    } else {
+        ret = hdfsBuilderConnectUntimed(bld);
+    }
+    if (ret && existsTtlMs > 0) {
+        err = existsCacheAddFs(ret, existsTtlMs);
+        if (err) {
+            fprintf(stderr, "hdfsBuilderConnect: WARN: could not enable the "
+                    "exists cache: error %d\n", err);
+        }
+    }
+    METRICS_END(HDFS_METRICS_OP_CONNECT, start, 0);
+    return ret;
+}
+
 int hdfsDisconnect(hdfsFS fs)
+{
+    if (fs == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (!connCacheRelease(fs)) {
+        return 0;
+    }
+    return closeFileSystem(fs);
+}
+
+static int closeFileSystem(hdfsFS fs)
 {
     // JAVA EQUIVALENT:
     //  fs.close()
@@ -670,6 +1237,7 @@ int hdfsDisconnect(hdfsFS fs)
         return -1;
     }
 
+    existsCacheRemoveFs(fs);
     jthrowable jthr = invokeMethod(env, NULL, INSTANCE, jFS, HADOOP_FS,
                      "close", "()V");
     if (jthr) {
@@ -710,45 +1278,221 @@ static jthrowable getDefaultBlockSize(JNIEnv *env, jobject jFS,
     return NULL;
 }
 
-hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags, 
-                      int bufferSize, short replication, tSize blockSize)
+/**
+ * Find out which version of a file is open, for its blocks to be cached
+ * under.  The file is looked up again after it was opened, so it may have
+ * been replaced in between; for HDFS streams, a length that does not agree
+ * with the stream's leaves the file uncached.
+ *
+ * @param out       (out param) The version; its uri is left NULL if the
+ *                  file is not to be cached.
+ *
+ * @return          NULL on success; the exception otherwise
+ */
+static jthrowable getCacheFile(JNIEnv *env, jobject jFS, jobject jPath,
+                               hdfsFile file, int isHdfs,
+                               struct blockCacheFile *out)
 {
-    /*
-      JAVA EQUIVALENT:
-       File f = new File(path);
-       FSData{Input|Output}Stream f{is|os} = fs.create(f);
-       return f{is|os};
-    */
-    /* Get the JNIEnv* corresponding to current thread */
-    JNIEnv* env = getJNIEnv();
-    int accmode = flags & O_ACCMODE;
-
-    if (env == NULL) {
-      errno = EINTERNAL;
-      return NULL;
-    }
-
-    jstring jStrBufferSize = NULL, jStrReplication = NULL;
-    jobject jConfiguration = NULL, jPath = NULL, jFile = NULL;
-    jobject jFS = (jobject)fs;
     jthrowable jthr;
     jvalue jVal;
-    hdfsFile file = NULL;
-    int ret;
+    jobject jStat = NULL, jQualified = NULL;
+    jstring jUri = NULL;
 
-    if (accmode == O_RDONLY || accmode == O_WRONLY) {
-	/* yay */
-    } else if (accmode == O_RDWR) {
-      fprintf(stderr, "ERROR: cannot open an hdfs file in O_RDWR mode\n");
-      errno = ENOTSUP;
-      return NULL;
-    } else {
-      fprintf(stderr, "ERROR: cannot open an hdfs file in mode 0x%x\n", accmode);
-      errno = EINVAL;
-      return NULL;
+    // JAVA EQUIVALENT:
+    //  FileStatus st = fs.getFileStatus(path);
+    //  uri = st.getPath().toString();
+    jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
+            "getFileStatus", JMETHOD1(JPARAM(HADOOP_PATH), JPARAM(HADOOP_STAT)),
+            jPath);
+    if (jthr)
+        goto done;
+    jStat = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
+                        "getModificationTime", "()J");
+    if (jthr)
+        goto done;
+    out->mtime = jVal.j;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
+                        "getLen", "()J");
+    if (jthr)
+        goto done;
+    out->length = jVal.j;
+    if (isHdfs) {
+        jthr = invokeMethod(env, &jVal, INSTANCE, file->file,
+                            HADOOP_HDFS_ISTRM, "getVisibleLength", "()J");
+        if (jthr)
+            goto done;
+        if (jVal.j != out->length) {
+            goto done;
+        }
     }
-
-    if ((flags & O_CREAT) && (flags & O_EXCL)) {
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
+                        "getPath", JMETHOD1("", JPARAM(HADOOP_PATH)));
+    if (jthr)
+        goto done;
+    jQualified = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jQualified, HADOOP_PATH,
+                        "toString", JMETHOD1("", JPARAM(JAVA_STRING)));
+    if (jthr)
+        goto done;
+    jUri = jVal.l;
+    jthr = newCStr(env, jUri, &out->uri);
+
+done:
+    destroyLocalReference(env, jStat);
+    destroyLocalReference(env, jQualified);
+    destroyLocalReference(env, jUri);
+    return jthr;
+}
+
+/**
+ * Set up the read-ahead buffer, block cache and native local reads of a
+ * file opened for read, as configured and hinted.
+ *
+ * @return          0 on success; an errno value otherwise
+ */
+static int setupReadCaches(JNIEnv *env, jobject jFS, jobject jPath,
+                           jobject jConfiguration, hdfsFile file,
+                           const char *path,
+                           const struct hdfsOpenOptions *opts)
+{
+    jthrowable jthr;
+    int32_t window = 0, cacheBlockSize = HDFS_BLOCK_CACHE_BLOCK_SIZE_DEFAULT;
+    int64_t cacheSize = 0;
+    int32_t hedgeThresholdMs = 0, hedgeThreads = 16;
+    int nativeLocal = 0, isHdfs = 0, ret;
+    jclass cls;
+
+    jthr = hadoopConfGetInt(env, jConfiguration, HDFS_READAHEAD_WINDOW_KEY,
+                            &window);
+    if (!jthr) {
+        jthr = hadoopConfGetLong(env, jConfiguration,
+                                 HDFS_BLOCK_CACHE_SIZE_KEY, &cacheSize);
+    }
+    if (!jthr) {
+        jthr = hadoopConfGetInt(env, jConfiguration,
+                    HDFS_BLOCK_CACHE_BLOCK_SIZE_KEY, &cacheBlockSize);
+    }
+    if (!jthr) {
+        jthr = hadoopConfGetBool(env, jConfiguration,
+                    HDFS_NATIVE_LOCAL_READ_KEY, &nativeLocal);
+    }
+    if (!jthr) {
+        jthr = hadoopConfGetInt(env, jConfiguration,
+                    HDFS_HEDGED_READ_THRESHOLD_MS_KEY, &hedgeThresholdMs);
+    }
+    if (!jthr) {
+        jthr = hadoopConfGetInt(env, jConfiguration,
+                    HDFS_HEDGED_READ_THREADS_KEY, &hedgeThreads);
+    }
+    if (!jthr && (nativeLocal || hedgeThresholdMs > 0 || cacheSize > 0)) {
+        // Only HDFS streams can say where their blocks are, or read from
+        // another replica, or how long the file they have open is
+        jthr = globalClassReference(HADOOP_HDFS_ISTRM, env, &cls);
+        if (!jthr) {
+            isHdfs = (*env)->IsInstanceOf(env, file->file, cls);
+        }
+    }
+    if (nativeLocal && isHdfs) {
+        file->flags |= HDFS_FILE_NATIVE_LOCAL_READ;
+    }
+    if (jthr) {
+        return printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsOpenFile(%s): reading cache configuration", path);
+    }
+    if (opts->readahead) {
+        window = opts->readahead;
+    } else if (opts->pattern == HDFS_ACCESS_RANDOM) {
+        window = 0;
+    }
+    switch (opts->pattern) {
+    case HDFS_ACCESS_SEQUENTIAL:
+        file->localAdvice = POSIX_FADV_SEQUENTIAL;
+        break;
+    case HDFS_ACCESS_RANDOM:
+        file->localAdvice = POSIX_FADV_RANDOM;
+        break;
+    default:
+        file->localAdvice = POSIX_FADV_NORMAL;
+        break;
+    }
+    file->localDropBehind = !!opts->dropBehind;
+    if (window > 0) {
+        file->raBuf = malloc(window);
+        if (!file->raBuf) {
+            return ENOMEM;
+        }
+        file->raWindow = window;
+    }
+    if (hedgeThresholdMs > 0 && isHdfs) {
+        ret = hedgedReadPoolInit(hedgeThreads);
+        if (ret) {
+            fprintf(stderr, "hdfsOpenFile(%s): WARN: could not start the "
+                    "hedged read threads: error %d\n", path, ret);
+        } else {
+            ret = hedgedReaderCreate(hedgedPread, file, hedgeThresholdMs,
+                                     &file->hedgedReader);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+    if (cacheSize > 0) {
+        ret = blockCacheInit(cacheSize, cacheBlockSize);
+        if (ret) {
+            fprintf(stderr, "hdfsOpenFile(%s): WARN: could not create the "
+                    "block cache: error %d\n", path, ret);
+            return 0;
+        }
+        jthr = getCacheFile(env, jFS, jPath, file, isHdfs, &file->cacheFile);
+        if (jthr) {
+            return printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsOpenFile(%s): looking up the file to cache", path);
+        }
+    }
+    return 0;
+}
+
+static hdfsFile hdfsOpenFileUntimed(hdfsFS fs, const char* path, int flags,
+                                    int bufferSize, short replication, tSize blockSize,
+                                    const struct hdfsOpenOptions *opts)
+{
+    /*
+      JAVA EQUIVALENT:
+       File f = new File(path);
+       FSData{Input|Output}Stream f{is|os} = fs.create(f);
+       return f{is|os};
+    */
+    /* Get the JNIEnv* corresponding to current thread */
+    JNIEnv* env = getJNIEnv();
+    int accmode = flags & O_ACCMODE;
+
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return NULL;
+    }
+
+    jstring jStrBufferSize = NULL, jStrReplication = NULL;
+    jobject jConfiguration = NULL, jPath = NULL, jFile = NULL;
+    jobject jFS = (jobject)fs;
+    jthrowable jthr;
+    jvalue jVal;
+    hdfsFile file = NULL;
+    int ret;
+
+    if (accmode == O_RDONLY || accmode == O_WRONLY) {
+	/* yay */
+    } else if (accmode == O_RDWR) {
+      fprintf(stderr, "ERROR: cannot open an hdfs file in O_RDWR mode\n");
+      errno = ENOTSUP;
+      return NULL;
+    } else {
+      fprintf(stderr, "ERROR: cannot open an hdfs file in mode 0x%x\n", accmode);
+      errno = EINVAL;
+      return NULL;
+    }
+
+    if ((flags & O_CREAT) && (flags & O_EXCL)) {
       fprintf(stderr, "WARN: hdfs does not truly support O_CREATE && O_EXCL\n");
     }
 
@@ -855,7 +1599,9 @@ hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
                          jBufferSize, jReplication, jBlockSize);
     }
     if (jthr) {
-        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+        // A missing file is routine for readers probing for it
+        ret = printExceptionAndFree(env, jthr, NOPRINT_EXC_FILE_NOT_FOUND |
+                NOPRINT_EXC_ACCESS_CONTROL | NOPRINT_EXC_UNRESOLVED_LINK,
             "hdfsOpenFile(%s): FileSystem#%s(%s)", path, method, signature);
         goto done;
     }
@@ -867,6 +1613,8 @@ hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
         ret = ENOMEM;
         goto done;
     }
+    pthread_mutex_init(&file->scratchLock, NULL);
+    pthread_mutex_init(&file->localLock, NULL);
     file->file = (*env)->NewGlobalRef(env, jFile);
     if (!file->file) {
         ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
@@ -888,6 +1636,18 @@ hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
                   "hdfsOpenFile(%s): WARN: Unexpected error %d when testing "
                   "for direct read compatibility\n", path, errno);
         }
+        if (preadDirect(fs, file, 0, &buf, 0) == 0) {
+            file->flags |= HDFS_FILE_SUPPORTS_DIRECT_PREAD;
+        } else if (errno != ENOTSUP) {
+            fprintf(stderr,
+                  "hdfsOpenFile(%s): WARN: Unexpected error %d when testing "
+                  "for direct pread compatibility\n", path, errno);
+        }
+        ret = setupReadCaches(env, jFS, jPath, jConfiguration, file, path,
+                              opts);
+        if (ret) {
+            goto done;
+        }
     }
     ret = 0;
 
@@ -902,6 +1662,13 @@ done:
             if (file->file) {
                 (*env)->DeleteGlobalRef(env, file->file);
             }
+            pthread_mutex_destroy(&file->scratchLock);
+            pthread_mutex_destroy(&file->localLock);
+            if (file->hedgedReader) {
+                hedgedReaderFree(file->hedgedReader);
+            }
+            free(file->cacheFile.uri);
+            free(file->raBuf);
             free(file);
         }
         errno = ret;
@@ -910,7 +1677,40 @@ done:
     return file;
 }
 
-int hdfsCloseFile(hdfsFS fs, hdfsFile file)
+hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
+                      int bufferSize, short replication, tSize blockSize)
+{
+    return hdfsOpenFileWithOptions(fs, path, flags, bufferSize, replication,
+                                   blockSize, NULL);
+}
+
+hdfsFile hdfsOpenFileWithOptions(hdfsFS fs, const char* path, int flags,
+                                 int bufferSize, short replication,
+                                 tSize blockSize,
+                                 const struct hdfsOpenOptions *opts)
+{
+    static const struct hdfsOpenOptions noOptions;
+    uint64_t start = METRICS_START();
+    hdfsFile ret;
+
+    if (!opts) {
+        opts = &noOptions;
+    }
+    if (opts->readahead < -1 || opts->pattern < HDFS_ACCESS_DEFAULT ||
+            opts->pattern > HDFS_ACCESS_RANDOM) {
+        errno = EINVAL;
+        return NULL;
+    }
+    ret = hdfsOpenFileUntimed(fs, path, flags, bufferSize, replication,
+                             blockSize, opts);
+    if ((flags & O_ACCMODE) != O_RDONLY) {
+        existsCacheInvalidate(fs, path);
+    }
+    METRICS_END(HDFS_METRICS_OP_OPEN, start, 0);
+    return ret;
+}
+
+static int hdfsCloseFileUntimed(hdfsFS fs, hdfsFile file)
 {
     int ret;
     // JAVA EQUIVALENT:
@@ -933,6 +1733,16 @@ int hdfsCloseFile(hdfsFS fs, hdfsFile file)
         return -1;
     }
 
+    if (file->groupCommit) {
+        groupCommitStop(file->groupCommit);
+        file->groupCommit = NULL;
+    }
+    if (file->hedgedReader) {
+        // Reads that lost a race may still be using the stream
+        hedgedReaderFree(file->hedgedReader);
+        file->hedgedReader = NULL;
+    }
+
     //The interface whose 'close' method to be called
     const char* interface = (file->type == INPUT) ? 
         HADOOP_ISTRM : HADOOP_OSTRM;
@@ -950,6 +1760,16 @@ int hdfsCloseFile(hdfsFS fs, hdfsFile file)
 
     //De-allocate memory
     (*env)->DeleteGlobalRef(env, file->file);
+    if (file->scratchArray) {
+        (*env)->DeleteGlobalRef(env, file->scratchArray);
+    }
+    pthread_mutex_destroy(&file->scratchLock);
+    if (file->localBlock) {
+        localBlockUnref(file->localBlock);
+    }
+    pthread_mutex_destroy(&file->localLock);
+    free(file->cacheFile.uri);
+    free(file->raBuf);
     free(file);
 
     if (ret) {
@@ -959,6 +1779,16 @@ int hdfsCloseFile(hdfsFS fs, hdfsFile file)
     return 0;
 }
 
+int hdfsCloseFile(hdfsFS fs, hdfsFile file)
+{
+    uint64_t start = METRICS_START();
+    int ret;
+
+    ret = hdfsCloseFileUntimed(fs, file);
+    METRICS_END(HDFS_METRICS_OP_CLOSE, start, 0);
+    return ret;
+}
+
 int hdfsExists(hdfsFS fs, const char *path)
 {
     JNIEnv *env = getJNIEnv();
@@ -971,11 +1801,20 @@ int hdfsExists(hdfsFS fs, const char *path)
     jvalue  jVal;
     jobject jFS = (jobject)fs;
     jthrowable jthr;
+    uint64_t generation;
     
     if (path == NULL) {
         errno = EINVAL;
         return -1;
     }
+    switch (existsCacheGet(fs, path)) {
+    case 1:
+        return 0;
+    case 0:
+        errno = ENOENT;
+        return -1;
+    }
+    generation = existsCacheGeneration(fs);
     jthr = constructNewObjectOfPath(env, path, &jPath);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
@@ -991,6 +1830,7 @@ int hdfsExists(hdfsFS fs, const char *path)
             JMETHOD1(JPARAM(HADOOP_PATH), "Z"));
         return -1;
     }
+    existsCachePut(fs, path, jVal.z, generation);
     if (jVal.z) {
         return 0;
     } else {
@@ -999,6 +1839,73 @@ int hdfsExists(hdfsFS fs, const char *path)
     }
 }
 
+/**
+ * Borrow the byte[] kept in f, first growing it geometrically until it holds
+ * length bytes or SCRATCH_ARRAY_MAX.  On success the caller holds
+ * f->scratchLock and must call releaseScratchArray.
+ *
+ * @param capacity  (out param) the length of the array
+ * @return          The array, or NULL with no lock held if another thread
+ *                  is using it or it could not be grown.  The caller then
+ *                  uses a temporary array.
+ */
+static jbyteArray borrowScratchArray(JNIEnv *env, hdfsFile f, tSize length,
+                                     tSize *capacity)
+{
+    jbyteArray jArray;
+    tSize want;
+
+    if (pthread_mutex_trylock(&f->scratchLock)) {
+        return NULL;
+    }
+    if (length > SCRATCH_ARRAY_MAX) {
+        length = SCRATCH_ARRAY_MAX;
+    }
+    if (f->scratchArrayLen < length) {
+        want = f->scratchArrayLen ? f->scratchArrayLen : SCRATCH_ARRAY_MIN;
+        while (want < length) {
+            want *= 2;
+        }
+        if (want > SCRATCH_ARRAY_MAX) {
+            want = SCRATCH_ARRAY_MAX;
+        }
+        jArray = (*env)->NewByteArray(env, want);
+        if (!jArray) {
+            printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "borrowScratchArray: NewByteArray");
+            pthread_mutex_unlock(&f->scratchLock);
+            return NULL;
+        }
+        if (f->scratchArray) {
+            (*env)->DeleteGlobalRef(env, f->scratchArray);
+            f->scratchArrayLen = 0;
+        }
+        f->scratchArray = (*env)->NewGlobalRef(env, jArray);
+        destroyLocalReference(env, jArray);
+        if (!f->scratchArray) {
+            printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "borrowScratchArray: NewGlobalRef");
+            pthread_mutex_unlock(&f->scratchLock);
+            return NULL;
+        }
+        f->scratchArrayLen = want;
+    }
+    *capacity = f->scratchArrayLen;
+    return f->scratchArray;
+}
+
+/**
+ * Return an array from borrowScratchArray, or free a temporary one.
+ */
+static void releaseScratchArray(JNIEnv *env, hdfsFile f, jbyteArray jArray)
+{
+    if (jArray == f->scratchArray) {
+        pthread_mutex_unlock(&f->scratchLock);
+    } else {
+        destroyLocalReference(env, jArray);
+    }
+}
+
 // Checks input file for readiness for reading.
 static int readPrepare(JNIEnv* env, hdfsFS fs, hdfsFile f,
                        jobject* jInputStream)
@@ -1021,7 +1928,196 @@ static int readPrepare(JNIEnv* env, hdfsFS fs, hdfsFile f,
     return 0;
 }
 
-tSize hdfsRead(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
+/**
+ * Ask the stream where the block holding a position is, and open it if it
+ * is on this host.  Blocks that are not are remembered, so the stream is
+ * only asked once per block.
+ *
+ * @return          A reference to the block; NULL if the data has to be
+ *                  read through the JVM.
+ */
+static struct localBlock *findLocalBlock(JNIEnv *env, hdfsFile f,
+                                         tOffset position)
+{
+    struct localBlock *block = NULL;
+    jthrowable jthr;
+    jvalue jVal;
+    jobject jBlock = NULL;
+    jstring jBlockPath = NULL, jMetaPath = NULL;
+    char *blockPath = NULL, *metaPath = NULL;
+    int64_t start, length;
+    int ret;
+
+    pthread_mutex_lock(&f->localLock);
+    block = f->localBlock;
+    if (block && position >= localBlockStart(block) &&
+            position < localBlockStart(block) + localBlockLength(block)) {
+        localBlockRef(block);
+        pthread_mutex_unlock(&f->localLock);
+        return block;
+    }
+    block = NULL;
+    if (position >= f->remoteStart && position < f->remoteEnd) {
+        pthread_mutex_unlock(&f->localLock);
+        return NULL;
+    }
+    pthread_mutex_unlock(&f->localLock);
+
+    // JAVA EQUIVALENT:
+    //  ((HdfsDataInputStream)fis).getLocalBlock(position);
+    jthr = invokeMethod(env, &jVal, INSTANCE, f->file, HADOOP_HDFS_ISTRM,
+            "getLocalBlock", JMETHOD1("J", JPARAM(HADOOP_LOCAL_BLOCK)),
+            (jlong)position);
+    if (jthr)
+        goto done;
+    jBlock = jVal.l;
+    if (!jBlock) {
+        // Past the end of the file
+        goto done;
+    }
+    jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_LOCAL_BLOCK,
+                        "getStartOffset", "()J");
+    if (jthr)
+        goto done;
+    start = jVal.j;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_LOCAL_BLOCK,
+                        "getLength", "()J");
+    if (jthr)
+        goto done;
+    length = jVal.j;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_LOCAL_BLOCK,
+                        "getBlockPath", JMETHOD1("", JPARAM(JAVA_STRING)));
+    if (jthr)
+        goto done;
+    jBlockPath = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_LOCAL_BLOCK,
+                        "getMetaPath", JMETHOD1("", JPARAM(JAVA_STRING)));
+    if (jthr)
+        goto done;
+    jMetaPath = jVal.l;
+    if (jBlockPath) {
+        jthr = newCStr(env, jBlockPath, &blockPath);
+        if (!jthr && jMetaPath) {
+            jthr = newCStr(env, jMetaPath, &metaPath);
+        }
+        if (jthr)
+            goto done;
+        ret = localBlockOpen(start, length, blockPath, metaPath, &block);
+        if (ret) {
+            fprintf(stderr, "findLocalBlock(%s): WARN: could not open the "
+                    "local replica: error %d\n", blockPath, ret);
+            block = NULL;
+        } else if (f->localAdvice != POSIX_FADV_NORMAL ||
+                   f->localDropBehind) {
+            localBlockAdvise(block, f->localAdvice, f->localDropBehind);
+        }
+    }
+    pthread_mutex_lock(&f->localLock);
+    if (block) {
+        if (f->localBlock) {
+            localBlockUnref(f->localBlock);
+        }
+        localBlockRef(block);
+        f->localBlock = block;
+    } else {
+        f->remoteStart = start;
+        f->remoteEnd = start + length;
+    }
+    pthread_mutex_unlock(&f->localLock);
+
+done:
+    if (jthr) {
+        printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "findLocalBlock(position=%" PRId64 "): "
+            "HdfsDataInputStream#getLocalBlock", position);
+    }
+    destroyLocalReference(env, jBlock);
+    destroyLocalReference(env, jBlockPath);
+    destroyLocalReference(env, jMetaPath);
+    free(blockPath);
+    free(metaPath);
+    return block;
+}
+
+/**
+ * Read from a replica on this host of the block holding a position,
+ * without copying the data through the JVM.
+ *
+ * @return          The number of bytes read, which is less than length at
+ *                  the end of a block; -1 if the data has to be read
+ *                  through the JVM instead.
+ */
+static tSize readLocal(JNIEnv *env, hdfsFile f, tOffset position,
+                       void *buffer, tSize length)
+{
+    struct localBlock *block;
+    tSize ret;
+
+    block = findLocalBlock(env, f, position);
+    if (!block) {
+        return -1;
+    }
+    ret = localBlockRead(block, position - localBlockStart(block),
+                         buffer, length);
+    if (ret > 0) {
+        __sync_fetch_and_add(&f->nativeBytesRead, ret);
+    } else {
+        // Stop reading this replica natively.  If it is corrupt, the JVM
+        // will find out and report it.
+        ret = -1;
+        pthread_mutex_lock(&f->localLock);
+        if (f->localBlock == block) {
+            localBlockUnref(block);
+            f->localBlock = NULL;
+        }
+        f->remoteStart = localBlockStart(block);
+        f->remoteEnd = localBlockStart(block) + localBlockLength(block);
+        pthread_mutex_unlock(&f->localLock);
+    }
+    localBlockUnref(block);
+    return ret;
+}
+
+/**
+ * Read natively from a local replica at the stream's position, moving the
+ * position past the bytes read.
+ *
+ * @return          As for readLocal
+ */
+static tSize readLocalAtPos(hdfsFile f, void *buffer, tSize length)
+{
+    JNIEnv *env;
+    jthrowable jthr;
+    jvalue jVal;
+    tSize ret;
+
+    env = getJNIEnv();
+    if (env == NULL) {
+        return -1;
+    }
+    jthr = invokeCachedMethod(env, &jVal, f->file, JM_ISTRM_GET_POS);
+    if (jthr) {
+        printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsRead: FSDataInputStream#getPos");
+        return -1;
+    }
+    ret = readLocal(env, f, jVal.j, buffer, length);
+    if (ret < 0) {
+        return -1;
+    }
+    jthr = invokeCachedMethod(env, NULL, f->file, JM_ISTRM_SEEK,
+                              jVal.j + ret);
+    if (jthr) {
+        // The position has not moved, so the read can be done again
+        printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsRead: FSDataInputStream#seek");
+        return -1;
+    }
+    return ret;
+}
+
+// Reads from the stream itself, bypassing the read-ahead buffer
+static tSize readUncached(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
 {
     if (length == 0) {
         return 0;
@@ -1029,6 +2125,12 @@ tSize hdfsRead(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
         errno = EINVAL;
         return -1;
     }
+    if (f && (f->flags & HDFS_FILE_NATIVE_LOCAL_READ)) {
+        tSize ret = readLocalAtPos(f, buffer, length);
+        if (ret >= 0) {
+            return ret;
+        }
+    }
     if (f->flags & HDFS_FILE_SUPPORTS_DIRECT_READ) {
       return readDirect(fs, f, buffer, length);
     }
@@ -1051,37 +2153,44 @@ tSize hdfsRead(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
     }
 
     jbyteArray jbRarray;
-    jint noReadBytes = length;
+    tSize capacity;
     jvalue jVal;
     jthrowable jthr;
 
-    //Read the requisite bytes
-    jbRarray = (*env)->NewByteArray(env, length);
-    if (!jbRarray) {
-        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
-            "hdfsRead: NewByteArray");
-        return -1;
+    //Read the requisite bytes, through the file's byte[] if it is free
+    jbRarray = borrowScratchArray(env, f, length, &capacity);
+    if (jbRarray) {
+        if (length > capacity) {
+            length = capacity;
+        }
+    } else {
+        jbRarray = (*env)->NewByteArray(env, length);
+        if (!jbRarray) {
+            errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsRead: NewByteArray");
+            return -1;
+        }
     }
 
-    jthr = invokeMethod(env, &jVal, INSTANCE, jInputStream, HADOOP_ISTRM,
-                               "read", "([B)I", jbRarray);
+    jthr = invokeCachedMethod(env, &jVal, jInputStream, JM_ISTRM_READ,
+                               jbRarray, 0, length);
     if (jthr) {
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsRead: FSDataInputStream#read");
         return -1;
     }
     if (jVal.i < 0) {
         // EOF
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         return 0;
     } else if (jVal.i == 0) {
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         errno = EINTR;
         return -1;
     }
-    (*env)->GetByteArrayRegion(env, jbRarray, 0, noReadBytes, buffer);
-    destroyLocalReference(env, jbRarray);
+    (*env)->GetByteArrayRegion(env, jbRarray, 0, jVal.i, buffer);
+    releaseScratchArray(env, f, jbRarray);
     if ((*env)->ExceptionCheck(env)) {
         errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
             "hdfsRead: GetByteArrayRegion");
@@ -1090,6 +2199,45 @@ tSize hdfsRead(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
     return jVal.i;
 }
 
+static tSize hdfsReadUntimed(hdfsFS fs, hdfsFile f, void* buffer,
+                             tSize length)
+{
+    tSize avail;
+
+    if (!f || !f->raBuf || length <= 0) {
+        return readUncached(fs, f, buffer, length);
+    }
+    avail = f->raEnd - f->raStart;
+    if (avail == 0) {
+        // Large reads gain nothing from the buffer
+        if (length >= f->raWindow) {
+            return readUncached(fs, f, buffer, length);
+        }
+        avail = readUncached(fs, f, f->raBuf, f->raWindow);
+        if (avail <= 0) {
+            return avail;
+        }
+        f->raStart = 0;
+        f->raEnd = avail;
+    }
+    if (length > avail) {
+        length = avail;
+    }
+    memcpy(buffer, f->raBuf + f->raStart, length);
+    f->raStart += length;
+    return length;
+}
+
+tSize hdfsRead(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
+{
+    uint64_t start = METRICS_START();
+    tSize ret;
+
+    ret = hdfsReadUntimed(fs, f, buffer, length);
+    METRICS_END(HDFS_METRICS_OP_READ, start, ret);
+    return ret;
+}
+
 // Reads using the read(ByteBuffer) API, which does fewer copies
 tSize readDirect(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
 {
@@ -1120,37 +2268,460 @@ tSize readDirect(hdfsFS fs, hdfsFile f, void* buffer, tSize length)
         return -1;
     }
 
-    jthr = invokeMethod(env, &jVal, INSTANCE, jInputStream,
-        HADOOP_ISTRM, "read", "(Ljava/nio/ByteBuffer;)I", bb);
+    jthr = invokeCachedMethod(env, &jVal, jInputStream,
+        JM_ISTRM_READ_BYTE_BUFFER, bb);
     destroyLocalReference(env, bb);
     if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+        errno = printExceptionAndFree(env, jthr,
+            NOPRINT_EXC_UNSUPPORTED_OPERATION,
             "readDirect: FSDataInputStream#read");
         return -1;
     }
     return (jVal.i < 0) ? 0 : jVal.i;
 }
 
-tSize hdfsPread(hdfsFS fs, hdfsFile f, tOffset position,
-                void* buffer, tSize length)
+/**
+ * Read a whole block of the file into the block cache.
+ *
+ * @return          0 on success; -1 on error, with errno set
+ */
+static int cacheBlock(hdfsFS fs, hdfsFile f, int64_t blockIdx,
+                      int32_t blockSize)
 {
-    JNIEnv* env;
-    jbyteArray jbRarray;
-    jvalue jVal;
-    jthrowable jthr;
+    char *data;
+    tSize ret, len = 0;
 
-    if (length == 0) {
-        return 0;
-    } else if (length < 0) {
-        errno = EINVAL;
+    data = malloc(blockSize);
+    if (!data) {
+        errno = ENOMEM;
         return -1;
     }
-    if (!f || f->type == UNINITIALIZED) {
-        errno = EBADF;
-        return -1;
+    while (len < blockSize) {
+        ret = preadUncached(fs, f, blockIdx * blockSize + len, data + len,
+                            blockSize - len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(data);
+            return -1;
+        } else if (ret == 0) {
+            // end of file: this is the last block
+            break;
+        }
+        len += ret;
     }
+    blockCachePut(&f->cacheFile, blockIdx, data, len);
+    free(data);
+    return 0;
+}
 
-    env = getJNIEnv();
+static tSize hdfsPreadUntimed(hdfsFS fs, hdfsFile f, tOffset position,
+                              void* buffer, tSize length)
+{
+    int32_t blockSize, ret;
+    int64_t blockIdx;
+    tSize done = 0;
+
+    if (!f || !f->cacheFile.uri || length <= 0 || position < 0) {
+        return preadUncached(fs, f, position, buffer, length);
+    }
+    blockSize = blockCacheBlockSize();
+    // Reads of a block or more would only churn the cache
+    if (blockSize <= 0 || length >= blockSize) {
+        return preadUncached(fs, f, position, buffer, length);
+    }
+    while (done < length) {
+        blockIdx = (position + done) / blockSize;
+        ret = blockCacheGet(&f->cacheFile, blockIdx,
+                (position + done) % blockSize, (char*)buffer + done,
+                length - done);
+        if (ret < 0) {
+            if (cacheBlock(fs, f, blockIdx, blockSize)) {
+                return done ? done : -1;
+            }
+            ret = blockCacheGet(&f->cacheFile, blockIdx,
+                    (position + done) % blockSize, (char*)buffer + done,
+                    length - done);
+            if (ret < 0) {
+                // Evicted already, or too big to cache; read it directly
+                ret = preadUncached(fs, f, position + done,
+                                    (char*)buffer + done, length - done);
+                if (ret < 0) {
+                    return done ? done : -1;
+                }
+            }
+        }
+        if (ret == 0) {
+            // end of file
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+tSize hdfsPread(hdfsFS fs, hdfsFile f, tOffset position,
+                void* buffer, tSize length)
+{
+    uint64_t start = METRICS_START();
+    tSize ret;
+
+    ret = hdfsPreadUntimed(fs, f, position, buffer, length);
+    METRICS_END(HDFS_METRICS_OP_PREAD, start, ret);
+    return ret;
+}
+
+/**
+ * hdfsPreadv merges two ranges into a single read when the gap between them
+ * is at most this many bytes; reading the gap is cheaper than another round
+ * trip.
+ */
+#define PREADV_MERGE_GAP (64 * 1024)
+
+/**
+ * The most bytes hdfsPreadv reads in one merged request.  A single range
+ * larger than this is still read in one request, into the caller's buffer.
+ */
+#define PREADV_MAX_MERGED (8 * 1024 * 1024)
+
+/**
+ * Positional read of exactly length bytes.
+ */
+static int preadFully(hdfsFS fs, hdfsFile f, tOffset position,
+                      char *buffer, tSize length)
+{
+    tSize ret;
+
+    while (length > 0) {
+        ret = hdfsPread(fs, f, position, buffer, length);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        } else if (ret == 0) {
+            // end of file before the range was filled
+            errno = EIO;
+            return -1;
+        }
+        position += ret;
+        buffer += ret;
+        length -= ret;
+    }
+    return 0;
+}
+
+static int compareReadRanges(const void *a, const void *b)
+{
+    const struct hdfsReadRange *ra = *(const struct hdfsReadRange * const *)a;
+    const struct hdfsReadRange *rb = *(const struct hdfsReadRange * const *)b;
+
+    if (ra->offset < rb->offset) {
+        return -1;
+    }
+    return (ra->offset > rb->offset);
+}
+
+int hdfsPreadv(hdfsFS fs, hdfsFile f,
+               const struct hdfsReadRange *ranges, int numRanges)
+{
+    const struct hdfsReadRange **sorted;
+    char *scratch = NULL;
+    int i, j, k, ret = 0;
+    tOffset start, end;
+
+    if (!f || f->type == UNINITIALIZED) {
+        errno = EBADF;
+        return -1;
+    }
+    if (numRanges < 0 || (numRanges > 0 && !ranges)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < numRanges; i++) {
+        if (ranges[i].offset < 0 || ranges[i].length < 0 ||
+                (ranges[i].length > 0 && !ranges[i].buffer)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (numRanges == 0) {
+        return 0;
+    }
+    sorted = malloc(sizeof(*sorted) * numRanges);
+    if (!sorted) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < numRanges; i++) {
+        sorted[i] = &ranges[i];
+    }
+    qsort(sorted, numRanges, sizeof(*sorted), compareReadRanges);
+
+    for (i = 0; i < numRanges; i = j) {
+        // Grow the request over every following range that starts close
+        // enough to its end
+        start = sorted[i]->offset;
+        end = start + sorted[i]->length;
+        for (j = i + 1; j < numRanges; j++) {
+            tOffset next = sorted[j]->offset + sorted[j]->length;
+            if (sorted[j]->offset > end + PREADV_MERGE_GAP ||
+                    (next > end && next - start > PREADV_MAX_MERGED)) {
+                break;
+            }
+            if (next > end) {
+                end = next;
+            }
+        }
+        if (end == start) {
+            continue;
+        }
+        if (j == i + 1) {
+            if (preadFully(fs, f, start, sorted[i]->buffer,
+                           sorted[i]->length)) {
+                ret = errno;
+                break;
+            }
+            continue;
+        }
+        scratch = malloc(end - start);
+        if (!scratch) {
+            ret = ENOMEM;
+            break;
+        }
+        if (preadFully(fs, f, start, scratch, end - start)) {
+            ret = errno;
+            break;
+        }
+        for (k = i; k < j; k++) {
+            if (sorted[k]->length == 0) {
+                continue;
+            }
+            memcpy(sorted[k]->buffer, scratch + (sorted[k]->offset - start),
+                   sorted[k]->length);
+        }
+        free(scratch);
+        scratch = NULL;
+    }
+    free(scratch);
+    free(sorted);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * The most released buffers of hdfsReadZeroCopy kept for reuse by each
+ * thread, and for each NUMA node.  Further buffers are freed on release.
+ */
+#define ZERO_COPY_POOL_MAX 4
+
+static pthread_once_t zeroCopyPoolOnce = PTHREAD_ONCE_INIT;
+static struct hdfsBufferPool *zeroCopyPool = NULL;
+
+static void zeroCopyPoolInit(void)
+{
+    zeroCopyPool = hdfsBufferPoolCreate(HDFS_ZERO_COPY_BUFFER_SIZE,
+                                        ZERO_COPY_POOL_MAX);
+}
+
+/**
+ * Point a ByteBuffer of the given capacity at its first length bytes.
+ */
+static jthrowable byteBufferReset(JNIEnv *env, jobject bb, tSize length,
+                                  tSize capacity)
+{
+    jthrowable jthr;
+    jvalue jVal;
+
+    jthr = invokeCachedMethod(env, &jVal, bb, JM_BUFFER_CLEAR);
+    if (jthr) {
+        return jthr;
+    }
+    destroyLocalReference(env, jVal.l);
+    if (length == capacity) {
+        return NULL;
+    }
+    jthr = invokeCachedMethod(env, &jVal, bb, JM_BUFFER_LIMIT, length);
+    if (jthr) {
+        return jthr;
+    }
+    destroyLocalReference(env, jVal.l);
+    return NULL;
+}
+
+tSize hdfsReadPoolBuffer(hdfsFS fs, hdfsFile f, void *buffer, tSize length)
+{
+    // JAVA EQUIVALENT:
+    //  ByteBuffer bbuffer = pooled(buffer); // wraps the pooled C buffer
+    //  bbuffer.clear().limit(length);
+    //  fis.read(bbuffer);
+
+    jobject jInputStream, bb;
+    jthrowable jthr;
+    jvalue jVal;
+    tSize capacity;
+
+    if (length == 0) {
+        return 0;
+    } else if (length < 0 || !buffer) {
+        errno = EINVAL;
+        return -1;
+    }
+    capacity = bufferPoolBufferSize(bufferPoolOf(buffer));
+    if (length > capacity) {
+        length = capacity;
+    }
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    if (readPrepare(env, fs, f, &jInputStream) == -1) {
+      return -1;
+    }
+    if (!(f->flags & HDFS_FILE_SUPPORTS_DIRECT_READ) ||
+            f->raEnd > f->raStart) {
+        // The stream cannot fill a ByteBuffer, or the next bytes are in the
+        // read-ahead buffer, so copy into the pooled buffer instead.
+        // Callers still get the same interface.
+        return hdfsRead(fs, f, buffer, length);
+    }
+    bb = bufferPoolByteBuffer(env, buffer);
+    if (!bb) {
+        return -1;
+    }
+    jthr = byteBufferReset(env, bb, length, capacity);
+    if (!jthr) {
+        jthr = invokeCachedMethod(env, &jVal, jInputStream,
+            JM_ISTRM_READ_BYTE_BUFFER, bb);
+    }
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsReadPoolBuffer: FSDataInputStream#read");
+        return -1;
+    }
+    return (jVal.i < 0) ? 0 : jVal.i;
+}
+
+tSize hdfsReadZeroCopy(hdfsFS fs, hdfsFile f, tSize maxLength,
+                       const void **data, struct hdfsZeroCopyBuffer **buffer)
+{
+    void *buf;
+    tSize ret;
+
+    *data = NULL;
+    *buffer = NULL;
+    if (maxLength == 0) {
+        return 0;
+    } else if (maxLength < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_once(&zeroCopyPoolOnce, zeroCopyPoolInit);
+    if (!zeroCopyPool) {
+        errno = ENOMEM;
+        return -1;
+    }
+    buf = hdfsBufferPoolGet(zeroCopyPool);
+    if (!buf) {
+        return -1;
+    }
+    ret = hdfsReadPoolBuffer(fs, f, buf, maxLength);
+    if (ret <= 0) {
+        int err = errno;
+        hdfsBufferPoolRelease(zeroCopyPool, buf);
+        errno = err;
+        return ret;
+    }
+    *data = buf;
+    *buffer = buf;
+    return ret;
+}
+
+void hdfsReleaseZeroCopy(struct hdfsZeroCopyBuffer *zbuf)
+{
+    if (!zbuf) {
+        return;
+    }
+    hdfsBufferPoolRelease(zeroCopyPool, zbuf);
+}
+
+// Positional read using the read(long, ByteBuffer) API, which reads
+// straight into the caller's buffer
+static tSize preadDirect(hdfsFS fs, hdfsFile f, tOffset position,
+                         void* buffer, tSize length)
+{
+    // JAVA EQUIVALENT:
+    //  ByteBuffer bbuffer = ByteBuffer.allocateDirect(length) // wraps C buffer
+    //  fis.read(position, bbuffer);
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    jobject jInputStream;
+    if (readPrepare(env, fs, f, &jInputStream) == -1) {
+      return -1;
+    }
+
+    jvalue jVal;
+    jthrowable jthr;
+
+    jobject bb = (*env)->NewDirectByteBuffer(env, buffer, length);
+    if (bb == NULL) {
+        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "preadDirect: NewDirectByteBuffer");
+        return -1;
+    }
+
+    jthr = invokeCachedMethod(env, &jVal, jInputStream,
+        JM_ISTRM_PREAD_BYTE_BUFFER, position, bb);
+    destroyLocalReference(env, bb);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr,
+            NOPRINT_EXC_UNSUPPORTED_OPERATION,
+            "preadDirect: FSDataInputStream#read");
+        return -1;
+    }
+    if (jVal.i == 0 && length > 0) {
+        errno = EINTR;
+        return -1;
+    }
+    return (jVal.i < 0) ? 0 : jVal.i;
+}
+
+// Positional read from the stream itself, bypassing the block cache
+static tSize preadStream(hdfsFS fs, hdfsFile f, tOffset position,
+                         void* buffer, tSize length)
+{
+    JNIEnv* env;
+    jbyteArray jbRarray;
+    tSize capacity;
+    jvalue jVal;
+    jthrowable jthr;
+
+    if (length == 0) {
+        return 0;
+    } else if (length < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!f || f->type == UNINITIALIZED) {
+        errno = EBADF;
+        return -1;
+    }
+
+    env = getJNIEnv();
     if (env == NULL) {
       errno = EINTERNAL;
       return -1;
@@ -1162,35 +2733,51 @@ tSize hdfsPread(hdfsFS fs, hdfsFile f, tOffset position,
         errno = EINVAL;
         return -1;
     }
+    if (f->flags & HDFS_FILE_NATIVE_LOCAL_READ) {
+        tSize ret = readLocal(env, f, position, buffer, length);
+        if (ret >= 0) {
+            return ret;
+        }
+    }
+    if (f->flags & HDFS_FILE_SUPPORTS_DIRECT_PREAD) {
+        return preadDirect(fs, f, position, buffer, length);
+    }
 
     // JAVA EQUIVALENT:
     //  byte [] bR = new byte[length];
     //  fis.read(pos, bR, 0, length);
-    jbRarray = (*env)->NewByteArray(env, length);
-    if (!jbRarray) {
-        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
-            "hdfsPread: NewByteArray");
-        return -1;
+    jbRarray = borrowScratchArray(env, f, length, &capacity);
+    if (jbRarray) {
+        if (length > capacity) {
+            length = capacity;
+        }
+    } else {
+        jbRarray = (*env)->NewByteArray(env, length);
+        if (!jbRarray) {
+            errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsPread: NewByteArray");
+            return -1;
+        }
     }
-    jthr = invokeMethod(env, &jVal, INSTANCE, f->file, HADOOP_ISTRM,
-                     "read", "(J[BII)I", position, jbRarray, 0, length);
+    jthr = invokeCachedMethod(env, &jVal, f->file, JM_ISTRM_PREAD,
+                     position, jbRarray, 0, length);
     if (jthr) {
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsPread: FSDataInputStream#read");
         return -1;
     }
     if (jVal.i < 0) {
         // EOF
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         return 0;
     } else if (jVal.i == 0) {
-        destroyLocalReference(env, jbRarray);
+        releaseScratchArray(env, f, jbRarray);
         errno = EINTR;
         return -1;
     }
     (*env)->GetByteArrayRegion(env, jbRarray, 0, jVal.i, buffer);
-    destroyLocalReference(env, jbRarray);
+    releaseScratchArray(env, f, jbRarray);
     if ((*env)->ExceptionCheck(env)) {
         errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
             "hdfsPread: GetByteArrayRegion");
@@ -1199,11 +2786,74 @@ tSize hdfsPread(hdfsFS fs, hdfsFile f, tOffset position,
     return jVal.i;
 }
 
-tSize hdfsWrite(hdfsFS fs, hdfsFile f, const void* buffer, tSize length)
+/**
+ * Positional read from another replica than preadStream would go to; the
+ * second read of a hedged pread.
+ */
+static tSize preadHedge(hdfsFile f, tOffset position, void* buffer,
+                        tSize length)
+{
+    // JAVA EQUIVALENT:
+    //  ((HdfsDataInputStream)fis).hedgedRead(position, bbuffer);
+    JNIEnv* env;
+    jvalue jVal;
+    jthrowable jthr;
+    jobject bb;
+
+    env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+    bb = (*env)->NewDirectByteBuffer(env, buffer, length);
+    if (bb == NULL) {
+        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "preadHedge: NewDirectByteBuffer");
+        return -1;
+    }
+    jthr = invokeCachedMethod(env, &jVal, f->file,
+        JM_HDFS_ISTRM_HEDGED_READ, position, bb);
+    destroyLocalReference(env, bb);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "preadHedge: HdfsDataInputStream#hedgedRead");
+        return -1;
+    }
+    if (jVal.i == 0 && length > 0) {
+        errno = EINTR;
+        return -1;
+    }
+    return (jVal.i < 0) ? 0 : jVal.i;
+}
+
+// The hedgedReadFn of files with hedged preads
+static int32_t hedgedPread(void *arg, int hedge, int64_t position,
+                           void *buf, int32_t len)
+{
+    hdfsFile f = arg;
+
+    if (hedge) {
+        return preadHedge(f, position, buf, len);
+    }
+    return preadStream(NULL, f, position, buf, len);
+}
+
+// Positional read bypassing the block cache, hedged if the file says so
+static tSize preadUncached(hdfsFS fs, hdfsFile f, tOffset position,
+                           void* buffer, tSize length)
+{
+    if (f && f->hedgedReader && length > 0) {
+        return hedgedReaderRead(f->hedgedReader, position, buffer, length);
+    }
+    return preadStream(fs, f, position, buffer, length);
+}
+
+static tSize hdfsWriteUntimed(hdfsFS fs, hdfsFile f, const void* buffer,
+                              tSize length)
 {
     // JAVA EQUIVALENT
-    // byte b[] = str.getBytes();
-    // fso.write(b);
+    // System.arraycopy(buffer, 0, scratch, 0, length);
+    // fso.write(scratch, 0, length);
 
     //Get the JNIEnv* corresponding to current thread
     JNIEnv* env = getJNIEnv();
@@ -1221,6 +2871,7 @@ tSize hdfsWrite(hdfsFS fs, hdfsFile f, const void* buffer, tSize length)
     jobject jOutputStream = f->file;
     jbyteArray jbWarray;
     jthrowable jthr;
+    tSize capacity, done, chunk;
     
     if (length < 0) {
     	errno = EINVAL;
@@ -1241,33 +2892,63 @@ tSize hdfsWrite(hdfsFS fs, hdfsFile f, const void* buffer, tSize length)
     if (length == 0) {
         return 0;
     }
-    //Write the requisite bytes into the file
-    jbWarray = (*env)->NewByteArray(env, length);
+    //Write the requisite bytes into the file, through the file's byte[] if
+    //it is free, in pieces if it is shorter than the data
+    jbWarray = borrowScratchArray(env, f, length, &capacity);
     if (!jbWarray) {
-        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
-            "hdfsWrite: NewByteArray");
-        return -1;
-    }
-    (*env)->SetByteArrayRegion(env, jbWarray, 0, length, buffer);
-    if ((*env)->ExceptionCheck(env)) {
-        destroyLocalReference(env, jbWarray);
-        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
-            "hdfsWrite(length = %d): SetByteArrayRegion", length);
-        return -1;
+        jbWarray = (*env)->NewByteArray(env, length);
+        if (!jbWarray) {
+            errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsWrite: NewByteArray");
+            return -1;
+        }
+        capacity = length;
     }
-    jthr = invokeMethod(env, NULL, INSTANCE, jOutputStream,
-            HADOOP_OSTRM, "write", "([B)V", jbWarray);
-    destroyLocalReference(env, jbWarray);
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsWrite: FSDataOutputStream#write");
-        return -1;
+    for (done = 0; done < length; done += chunk) {
+        chunk = length - done;
+        if (chunk > capacity) {
+            chunk = capacity;
+        }
+        (*env)->SetByteArrayRegion(env, jbWarray, 0, chunk,
+                                   (const jbyte*)buffer + done);
+        if ((*env)->ExceptionCheck(env)) {
+            releaseScratchArray(env, f, jbWarray);
+            errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsWrite(length = %d): SetByteArrayRegion", length);
+            return -1;
+        }
+        jthr = invokeCachedMethod(env, NULL, jOutputStream,
+                JM_OSTRM_WRITE, jbWarray, 0, chunk);
+        if (jthr) {
+            releaseScratchArray(env, f, jbWarray);
+            errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsWrite: FSDataOutputStream#write");
+            return -1;
+        }
     }
+    releaseScratchArray(env, f, jbWarray);
     // Unlike most Java streams, FSDataOutputStream never does partial writes.
     // If we succeeded, all the data was written.
     return length;
 }
 
+static tSize groupCommitWrite(struct groupCommit *gc, const void *buffer,
+                              tSize length, int64_t *seq);
+
+tSize hdfsWrite(hdfsFS fs, hdfsFile f, const void* buffer, tSize length)
+{
+    uint64_t start = METRICS_START();
+    tSize ret;
+
+    if (f && f->groupCommit) {
+        ret = groupCommitWrite(f->groupCommit, buffer, length, NULL);
+    } else {
+        ret = hdfsWriteUntimed(fs, f, buffer, length);
+    }
+    METRICS_END(HDFS_METRICS_OP_WRITE, start, ret);
+    return ret;
+}
+
 int hdfsSeek(hdfsFS fs, hdfsFile f, tOffset desiredPos) 
 {
     // JAVA EQUIVALENT
@@ -1287,105 +2968,420 @@ int hdfsSeek(hdfsFS fs, hdfsFile f, tOffset desiredPos)
     }
 
     jobject jInputStream = f->file;
-    jthrowable jthr = invokeMethod(env, NULL, INSTANCE, jInputStream,
-            HADOOP_ISTRM, "seek", "(J)V", desiredPos);
+    jthrowable jthr = invokeCachedMethod(env, NULL, jInputStream,
+            JM_ISTRM_SEEK, desiredPos);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsSeek(desiredPos=%" PRId64 ")"
             ": FSDataInputStream#seek", desiredPos);
         return -1;
     }
+    f->raStart = f->raEnd = 0;
+    return 0;
+}
+
+
+
+tOffset hdfsTell(hdfsFS fs, hdfsFile f)
+{
+    // JAVA EQUIVALENT
+    //  pos = f.getPos();
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    //Sanity check
+    if (!f || f->type == UNINITIALIZED) {
+        errno = EBADF;
+        return -1;
+    }
+
+    //Parameters
+    jobject jStream = f->file;
+    CachedMethod getPos = (f->type == INPUT) ?
+        JM_ISTRM_GET_POS : JM_OSTRM_GET_POS;
+    jvalue jVal;
+    jthrowable jthr = invokeCachedMethod(env, &jVal, jStream, getPos);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsTell: %s#getPos",
+            ((f->type == INPUT) ? "FSDataInputStream" :
+                                 "FSDataOutputStream"));
+        return -1;
+    }
+    // The stream is ahead by whatever is still in the read-ahead buffer
+    return jVal.j - (f->raEnd - f->raStart);
+}
+
+static int hdfsFlushUntimed(hdfsFS fs, hdfsFile f) 
+{
+    // JAVA EQUIVALENT
+    //  fos.flush();
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    //Sanity check
+    if (!f || f->type != OUTPUT) {
+        errno = EBADF;
+        return -1;
+    }
+    jthrowable jthr = invokeCachedMethod(env, NULL, f->file,
+                     JM_OSTRM_FLUSH);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsFlush: FSDataInputStream#flush");
+        return -1;
+    }
+    return 0;
+}
+
+int hdfsFlush(hdfsFS fs, hdfsFile f)
+{
+    uint64_t start = METRICS_START();
+    int ret;
+
+    ret = hdfsFlushUntimed(fs, f);
+    METRICS_END(HDFS_METRICS_OP_FLUSH, start, 0);
+    return ret;
+}
+
+static int hdfsHFlushUntimed(hdfsFS fs, hdfsFile f)
+{
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    //Sanity check
+    if (!f || f->type != OUTPUT) {
+        errno = EBADF;
+        return -1;
+    }
+
+    jobject jOutputStream = f->file;
+    jthrowable jthr = invokeCachedMethod(env, NULL, jOutputStream,
+                     JM_OSTRM_HFLUSH);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsHFlush: FSDataOutputStream#hflush");
+        return -1;
+    }
+    return 0;
+}
+
+static int hdfsHSyncUntimed(hdfsFS fs, hdfsFile f)
+{
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    //Sanity check
+    if (!f || f->type != OUTPUT) {
+        errno = EBADF;
+        return -1;
+    }
+
+    jthrowable jthr = invokeCachedMethod(env, NULL, f->file,
+                     JM_OSTRM_HSYNC);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsHSync: FSDataOutputStream#hsync");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Group commit on a file opened for write.  Writes are numbered by the
+ * bytes written so far, and a flusher thread flushes everything written
+ * whenever anyone waits for a number it has not flushed yet.
+ */
+struct groupCommit {
+    hdfsFS fs;
+    hdfsFile file;
+    /** Held across each write, so that sequence numbers follow the data */
+    pthread_mutex_t writeLock;
+    /** Guards everything below */
+    pthread_mutex_t lock;
+    /** Signalled when someone starts waiting, and on shutdown */
+    pthread_cond_t flushCond;
+    /** Signalled when a flush finishes, and on shutdown */
+    pthread_cond_t doneCond;
+    int64_t written;
+    /** Everything up to here has been hflushed or hsynced */
+    int64_t flushed;
+    int64_t synced;
+    /** The highest numbers anyone waits for */
+    int64_t wantFlush;
+    int64_t wantSync;
+    /** The errno of the first failed flush, or 0 */
+    int error;
+    int shutdown;
+    int maxDelayUs;
+    pthread_t thread;
+};
+
+static void *groupCommitMain(void *arg)
+{
+    struct groupCommit *gc = arg;
+    struct timespec deadline;
+    int64_t target;
+    int sync, ret;
+
+    pthread_mutex_lock(&gc->lock);
+    while (!gc->shutdown) {
+        if (gc->error || (gc->wantFlush <= gc->flushed &&
+                          gc->wantSync <= gc->synced)) {
+            pthread_cond_wait(&gc->flushCond, &gc->lock);
+            continue;
+        }
+        if (gc->maxDelayUs > 0) {
+            // Give other writers a chance to join this flush
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += gc->maxDelayUs / 1000000;
+            deadline.tv_nsec += (gc->maxDelayUs % 1000000) * 1000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while (!gc->shutdown && pthread_cond_timedwait(&gc->flushCond,
+                        &gc->lock, &deadline) != ETIMEDOUT) {
+            }
+            if (gc->shutdown) {
+                break;
+            }
+        }
+        // Everything counted in written has been handed to the stream, so
+        // this flush covers it
+        target = gc->written;
+        sync = gc->wantSync > gc->synced;
+        pthread_mutex_unlock(&gc->lock);
+        if (sync) {
+            ret = hdfsHSyncUntimed(gc->fs, gc->file);
+        } else {
+            ret = hdfsHFlushUntimed(gc->fs, gc->file);
+        }
+        pthread_mutex_lock(&gc->lock);
+        if (ret) {
+            gc->error = errno ? errno : EIO;
+        } else {
+            gc->flushed = target;
+            if (sync) {
+                gc->synced = target;
+            }
+        }
+        pthread_cond_broadcast(&gc->doneCond);
+    }
+    pthread_mutex_unlock(&gc->lock);
+    return NULL;
+}
+
+/**
+ * Stop the flusher thread of a file being closed, and free the group
+ * commit state.  Anyone still waiting gets EBADF.
+ */
+static void groupCommitStop(struct groupCommit *gc)
+{
+    pthread_mutex_lock(&gc->lock);
+    gc->shutdown = 1;
+    pthread_cond_broadcast(&gc->flushCond);
+    pthread_cond_broadcast(&gc->doneCond);
+    pthread_mutex_unlock(&gc->lock);
+    pthread_join(gc->thread, NULL);
+    pthread_cond_destroy(&gc->flushCond);
+    pthread_cond_destroy(&gc->doneCond);
+    pthread_mutex_destroy(&gc->lock);
+    pthread_mutex_destroy(&gc->writeLock);
+    free(gc);
+}
+
+static tSize groupCommitWrite(struct groupCommit *gc, const void *buffer,
+                              tSize length, int64_t *seq)
+{
+    tSize ret;
+
+    pthread_mutex_lock(&gc->writeLock);
+    ret = hdfsWriteUntimed(gc->fs, gc->file, buffer, length);
+    if (ret > 0) {
+        pthread_mutex_lock(&gc->lock);
+        gc->written += ret;
+        if (seq) {
+            *seq = gc->written;
+        }
+        pthread_mutex_unlock(&gc->lock);
+    } else if (ret == 0 && seq) {
+        pthread_mutex_lock(&gc->lock);
+        *seq = gc->written;
+        pthread_mutex_unlock(&gc->lock);
+    }
+    pthread_mutex_unlock(&gc->writeLock);
+    return ret;
+}
+
+/**
+ * Wait for the flusher to cover a sequence number.  A negative seq means
+ * everything written so far.
+ */
+static int groupCommitWait(struct groupCommit *gc, int64_t seq, int sync)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&gc->lock);
+    if (seq < 0) {
+        seq = gc->written;
+    } else if (seq > gc->written) {
+        pthread_mutex_unlock(&gc->lock);
+        errno = EINVAL;
+        return -1;
+    }
+    if (sync) {
+        if (seq > gc->wantSync) {
+            gc->wantSync = seq;
+            pthread_cond_signal(&gc->flushCond);
+        }
+    } else if (seq > gc->wantFlush) {
+        gc->wantFlush = seq;
+        pthread_cond_signal(&gc->flushCond);
+    }
+    while (1) {
+        if ((sync ? gc->synced : gc->flushed) >= seq) {
+            break;
+        } else if (gc->error) {
+            ret = gc->error;
+            break;
+        } else if (gc->shutdown) {
+            ret = EBADF;
+            break;
+        }
+        pthread_cond_wait(&gc->doneCond, &gc->lock);
+    }
+    pthread_mutex_unlock(&gc->lock);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
     return 0;
 }
 
-
-
-tOffset hdfsTell(hdfsFS fs, hdfsFile f)
+int hdfsFileEnableGroupCommit(hdfsFS fs, hdfsFile file, int maxDelayUs)
 {
-    // JAVA EQUIVALENT
-    //  pos = f.getPos();
-
-    //Get the JNIEnv* corresponding to current thread
-    JNIEnv* env = getJNIEnv();
-    if (env == NULL) {
-      errno = EINTERNAL;
-      return -1;
-    }
+    struct groupCommit *gc;
+    int ret;
 
-    //Sanity check
-    if (!f || f->type == UNINITIALIZED) {
+    if (!file || file->type != OUTPUT) {
         errno = EBADF;
         return -1;
     }
-
-    //Parameters
-    jobject jStream = f->file;
-    const char* interface = (f->type == INPUT) ?
-        HADOOP_ISTRM : HADOOP_OSTRM;
-    jvalue jVal;
-    jthrowable jthr = invokeMethod(env, &jVal, INSTANCE, jStream,
-                     interface, "getPos", "()J");
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsTell: %s#getPos",
-            ((f->type == INPUT) ? "FSDataInputStream" :
-                                 "FSDataOutputStream"));
+    if (maxDelayUs < 0) {
+        errno = EINVAL;
         return -1;
     }
-    return jVal.j;
+    if (file->groupCommit) {
+        errno = EBUSY;
+        return -1;
+    }
+    gc = calloc(1, sizeof(*gc));
+    if (!gc) {
+        errno = ENOMEM;
+        return -1;
+    }
+    gc->fs = fs;
+    gc->file = file;
+    gc->maxDelayUs = maxDelayUs;
+    pthread_mutex_init(&gc->writeLock, NULL);
+    pthread_mutex_init(&gc->lock, NULL);
+    pthread_cond_init(&gc->flushCond, NULL);
+    pthread_cond_init(&gc->doneCond, NULL);
+    ret = pthread_create(&gc->thread, NULL, groupCommitMain, gc);
+    if (ret) {
+        fprintf(stderr, "hdfsFileEnableGroupCommit: pthread_create failed "
+                "with error %d\n", ret);
+        pthread_cond_destroy(&gc->flushCond);
+        pthread_cond_destroy(&gc->doneCond);
+        pthread_mutex_destroy(&gc->lock);
+        pthread_mutex_destroy(&gc->writeLock);
+        free(gc);
+        errno = ret;
+        return -1;
+    }
+    file->groupCommit = gc;
+    return 0;
 }
 
-int hdfsFlush(hdfsFS fs, hdfsFile f) 
+int64_t hdfsGroupCommitWrite(hdfsFS fs, hdfsFile file,
+                             const void *buffer, tSize length)
 {
-    // JAVA EQUIVALENT
-    //  fos.flush();
+    uint64_t start = METRICS_START();
+    int64_t seq = -1;
+    tSize ret;
 
-    //Get the JNIEnv* corresponding to current thread
-    JNIEnv* env = getJNIEnv();
-    if (env == NULL) {
-      errno = EINTERNAL;
-      return -1;
+    if (!file || !file->groupCommit) {
+        errno = EINVAL;
+        return -1;
     }
-
-    //Sanity check
-    if (!f || f->type != OUTPUT) {
-        errno = EBADF;
+    ret = groupCommitWrite(file->groupCommit, buffer, length, &seq);
+    METRICS_END(HDFS_METRICS_OP_WRITE, start, ret);
+    if (ret < 0) {
         return -1;
     }
-    jthrowable jthr = invokeMethod(env, NULL, INSTANCE, f->file, 
-                     HADOOP_OSTRM, "flush", "()V");
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsFlush: FSDataInputStream#flush");
+    return seq;
+}
+
+int hdfsGroupCommitWait(hdfsFS fs, hdfsFile file, int64_t seq, int sync)
+{
+    uint64_t start = METRICS_START();
+    int ret;
+
+    if (!file || !file->groupCommit || seq < 0) {
+        errno = EINVAL;
         return -1;
     }
-    return 0;
+    ret = groupCommitWait(file->groupCommit, seq, sync);
+    METRICS_END(sync ? HDFS_METRICS_OP_HSYNC : HDFS_METRICS_OP_HFLUSH,
+                start, 0);
+    return ret;
 }
 
 int hdfsHFlush(hdfsFS fs, hdfsFile f)
 {
-    //Get the JNIEnv* corresponding to current thread
-    JNIEnv* env = getJNIEnv();
-    if (env == NULL) {
-      errno = EINTERNAL;
-      return -1;
-    }
+    uint64_t start = METRICS_START();
+    int ret;
 
-    //Sanity check
-    if (!f || f->type != OUTPUT) {
-        errno = EBADF;
-        return -1;
+    if (f && f->groupCommit) {
+        ret = groupCommitWait(f->groupCommit, -1, 0);
+    } else {
+        ret = hdfsHFlushUntimed(fs, f);
     }
+    METRICS_END(HDFS_METRICS_OP_HFLUSH, start, 0);
+    return ret;
+}
 
-    jobject jOutputStream = f->file;
-    jthrowable jthr = invokeMethod(env, NULL, INSTANCE, jOutputStream,
-                     HADOOP_OSTRM, "hflush", "()V");
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsHFlush: FSDataOutputStream#hflush");
-        return -1;
+int hdfsHSync(hdfsFS fs, hdfsFile f)
+{
+    uint64_t start = METRICS_START();
+    int ret;
+
+    if (f && f->groupCommit) {
+        ret = groupCommitWait(f->groupCommit, -1, 1);
+    } else {
+        ret = hdfsHSyncUntimed(fs, f);
     }
-    return 0;
+    METRICS_END(HDFS_METRICS_OP_HSYNC, start, 0);
+    return ret;
 }
 
 int hdfsAvailable(hdfsFS fs, hdfsFile f)
@@ -1409,20 +3405,77 @@ int hdfsAvailable(hdfsFS fs, hdfsFile f)
     //Parameters
     jobject jInputStream = f->file;
     jvalue jVal;
-    jthrowable jthr = invokeMethod(env, &jVal, INSTANCE, jInputStream,
-                     HADOOP_ISTRM, "available", "()I");
+    jthrowable jthr = invokeCachedMethod(env, &jVal, jInputStream,
+                     JM_ISTRM_AVAILABLE);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsAvailable: FSDataInputStream#available");
         return -1;
     }
-    return jVal.i;
+    return jVal.i + (f->raEnd - f->raStart);
+}
+
+/**
+ * Determine whether two FileSystems are DistributedFileSystems for the same
+ * cluster.
+ *
+ * @return          1 if they are; 0 if not, or on error
+ */
+static int sameDistributedFs(JNIEnv *env, jobject jSrcFS, jobject jDstFS)
+{
+    jthrowable jthr;
+    jclass cls;
+    jvalue jVal;
+    jobject jSrcUri = NULL, jDstUri = NULL;
+    int ret = 0;
+
+    jthr = globalClassReference(HADOOP_DFS, env, &cls);
+    if (jthr)
+        goto done;
+    if (!(*env)->IsInstanceOf(env, jSrcFS, cls) ||
+            !(*env)->IsInstanceOf(env, jDstFS, cls)) {
+        goto done;
+    }
+    if ((*env)->IsSameObject(env, jSrcFS, jDstFS)) {
+        ret = 1;
+        goto done;
+    }
+    jthr = invokeMethod(env, &jVal, INSTANCE, jSrcFS, HADOOP_FS,
+                        "getUri", "()Ljava/net/URI;");
+    if (jthr)
+        goto done;
+    jSrcUri = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jDstFS, HADOOP_FS,
+                        "getUri", "()Ljava/net/URI;");
+    if (jthr)
+        goto done;
+    jDstUri = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jSrcUri, JAVA_NET_URI,
+                        "equals", "(Ljava/lang/Object;)Z", jDstUri);
+    if (jthr)
+        goto done;
+    ret = jVal.z ? 1 : 0;
+
+done:
+    if (jthr) {
+        // Not worth failing the copy over; take the generic path
+        printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "sameDistributedFs");
+    }
+    destroyLocalReference(env, jSrcUri);
+    destroyLocalReference(env, jDstUri);
+    return ret;
 }
 
 static int hdfsCopyImpl(hdfsFS srcFS, const char* src, hdfsFS dstFS,
         const char* dst, jboolean deleteSource)
 {
     //JAVA EQUIVALENT
+    //  if (srcFS and dstFS are the same HDFS) {
+    //    if (deleteSource ? srcFS.rename(srcPath, dstPath) :
+    //                       srcFS.copyFile(srcPath, dstPath))
+    //      return;
+    //  }
     //  FileUtil#copy(srcFS, srcPath, dstFS, dstPath,
     //                 deleteSource = false, conf)
 
@@ -1454,6 +3507,32 @@ static int hdfsCopyImpl(hdfsFS srcFS, const char* src, hdfsFS dstFS,
         goto done;
     }
 
+    // Within one cluster a move is a rename, and a copy of a file need not
+    // go through a single stream.  Anything these cannot do, such as
+    // copying a directory, is left to FileUtil#copy.
+    if (sameDistributedFs(env, jSrcFS, jDstFS)) {
+        if (deleteSource) {
+            jthr = invokeMethod(env, &jVal, INSTANCE, jSrcFS, HADOOP_FS,
+                    "rename", JMETHOD2(JPARAM(HADOOP_PATH),
+                    JPARAM(HADOOP_PATH), "Z"), jSrcPath, jDstPath);
+        } else {
+            jthr = invokeMethod(env, &jVal, INSTANCE, jSrcFS, HADOOP_DFS,
+                    "copyFile", JMETHOD2(JPARAM(HADOOP_PATH),
+                    JPARAM(HADOOP_PATH), "Z"), jSrcPath, jDstPath);
+        }
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsCopyImpl(src=%s, dst=%s, deleteSource=%d): "
+                "FileSystem#%s", src, dst, deleteSource,
+                deleteSource ? "rename" : "copyFile");
+            goto done;
+        }
+        if (jVal.z) {
+            ret = 0;
+            goto done;
+        }
+    }
+
     //Create the org.apache.hadoop.conf.Configuration object
     jthr = constructNewObjectOfClass(env, &jConfiguration,
                                      HADOOP_CONF, "()V");
@@ -1493,16 +3572,303 @@ done:
         return -1;
     }
     return 0;
-}
+}
+
+int hdfsCopy(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
+{
+    int ret;
+
+    ret = hdfsCopyImpl(srcFS, src, dstFS, dst, 0);
+    existsCacheInvalidate(dstFS, dst);
+    return ret;
+}
+
+int hdfsMove(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
+{
+    int ret;
+
+    ret = hdfsCopyImpl(srcFS, src, dstFS, dst, 1);
+    existsCacheInvalidate(srcFS, src);
+    existsCacheInvalidate(dstFS, dst);
+    return ret;
+}
+
+/**
+ * A file being written as several part files at once.  Part 0 is the file
+ * itself; the others sit next to it until they are concatenated onto it.
+ */
+struct hdfsParallelWriter {
+    hdfsFS fs;
+    int numParts;
+    tOffset partSize;
+    char **paths;
+    hdfsFile *files;
+};
+
+/**
+ * Close whatever parts are still open, delete every part, and free the
+ * writer.
+ */
+static void parallelWriterDiscard(struct hdfsParallelWriter *w)
+{
+    int i;
+
+    for (i = 0; i < w->numParts; i++) {
+        if (w->files[i]) {
+            hdfsCloseFile(w->fs, w->files[i]);
+        }
+        if (w->paths[i]) {
+            hdfsDelete(w->fs, w->paths[i], 0);
+            free(w->paths[i]);
+        }
+    }
+    free(w->paths);
+    free(w->files);
+    free(w);
+}
+
+struct hdfsParallelWriter *hdfsParallelWriterOpen(hdfsFS fs,
+        const char *path, int numParts, tOffset partSize,
+        short replication, tSize blockSize)
+{
+    struct hdfsParallelWriter *w;
+    const char *base;
+    jthrowable jthr;
+    jclass cls;
+    tOffset defaultBlockSize;
+    int i, ret, dirLen;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return NULL;
+    }
+    if (numParts <= 0 || partSize <= 0 || blockSize < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (numParts > 1) {
+        // Only HDFS can concat
+        jthr = globalClassReference(HADOOP_DFS, env, &cls);
+        if (jthr) {
+            errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsParallelWriterOpen(%s): globalClassReference", path);
+            return NULL;
+        }
+        if (!(*env)->IsInstanceOf(env, (jobject)fs, cls)) {
+            errno = ENOTSUP;
+            return NULL;
+        }
+        // ... which needs every part but the last to be whole blocks
+        if (blockSize == 0) {
+            defaultBlockSize = hdfsGetDefaultBlockSizeAtPath(fs, path);
+            if (defaultBlockSize < 0) {
+                return NULL;
+            }
+        } else {
+            defaultBlockSize = blockSize;
+        }
+        if (partSize % defaultBlockSize) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+    w = calloc(1, sizeof(*w));
+    if (!w) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    w->fs = fs;
+    w->numParts = numParts;
+    w->partSize = partSize;
+    w->paths = calloc(numParts, sizeof(char*));
+    w->files = calloc(numParts, sizeof(hdfsFile));
+    if (!w->paths || !w->files) {
+        ret = ENOMEM;
+        goto error;
+    }
+    base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    dirLen = base - path;
+    for (i = 0; i < numParts; i++) {
+        if (i == 0) {
+            w->paths[i] = strdup(path);
+        } else if (asprintf(&w->paths[i], "%.*s.%s._WRITING_.%d",
+                            dirLen, path, base, i) < 0) {
+            w->paths[i] = NULL;
+        }
+        if (!w->paths[i]) {
+            ret = ENOMEM;
+            goto error;
+        }
+        w->files[i] = hdfsOpenFile(fs, w->paths[i], O_WRONLY, 0,
+                                   replication, blockSize);
+        if (!w->files[i]) {
+            ret = errno;
+            goto error;
+        }
+    }
+    return w;
+
+error:
+    parallelWriterDiscard(w);
+    errno = ret;
+    return NULL;
+}
+
+hdfsFile hdfsParallelWriterPart(struct hdfsParallelWriter *w, int part)
+{
+    if (!w || part < 0 || part >= w->numParts) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return w->files[part];
+}
+
+/**
+ * Concatenate parts 1 to last onto part 0.
+ */
+static int parallelWriterConcat(JNIEnv *env, struct hdfsParallelWriter *w,
+                                int last)
+{
+    jthrowable jthr;
+    jclass jPathClass;
+    jobjectArray jParts = NULL;
+    jobject jTarget = NULL, jPath;
+    jvalue jVal;
+    int i, ret = 0;
+
+    jthr = globalClassReference(HADOOP_PATH, env, &jPathClass);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsParallelWriterClose: globalClassReference");
+        goto done;
+    }
+    jParts = (*env)->NewObjectArray(env, last, jPathClass, NULL);
+    if (!jParts) {
+        ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "hdfsParallelWriterClose: NewObjectArray(%d)", last);
+        goto done;
+    }
+    for (i = 1; i <= last; i++) {
+        jthr = constructNewObjectOfPath(env, w->paths[i], &jPath);
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsParallelWriterClose(%s): constructNewObjectOfPath",
+                w->paths[i]);
+            goto done;
+        }
+        (*env)->SetObjectArrayElement(env, jParts, i - 1, jPath);
+        destroyLocalReference(env, jPath);
+        if ((*env)->ExceptionCheck(env)) {
+            ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsParallelWriterClose(%s): SetObjectArrayElement",
+                w->paths[i]);
+            goto done;
+        }
+    }
+    jthr = constructNewObjectOfPath(env, w->paths[0], &jTarget);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsParallelWriterClose(%s): constructNewObjectOfPath",
+            w->paths[0]);
+        goto done;
+    }
+    jthr = invokeMethod(env, &jVal, INSTANCE, (jobject)w->fs, HADOOP_DFS,
+            "concat", JMETHOD2(JPARAM(HADOOP_PATH), JARRPARAM(HADOOP_PATH),
+            JAVA_VOID), jTarget, jParts);
+    // concat removes the parts it appends
+    for (i = 1; i <= last; i++) {
+        existsCacheInvalidate(w->fs, w->paths[i]);
+    }
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsParallelWriterClose(%s): DistributedFileSystem#concat",
+            w->paths[0]);
+        goto done;
+    }
+
+done:
+    destroyLocalReference(env, jParts);
+    destroyLocalReference(env, jTarget);
+    return ret;
+}
+
+int hdfsParallelWriterClose(struct hdfsParallelWriter *w)
+{
+    // JAVA EQUIVALENT:
+    //  for (part : parts) part.close();
+    //  fs.concat(parts[0], parts[1 .. last non-empty part]);
+    tOffset len;
+    int i, last = 0, firstShort, ret;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+    if (!w) {
+        errno = EINVAL;
+        return -1;
+    }
+    firstShort = w->numParts;
+    for (i = 0; i < w->numParts; i++) {
+        len = hdfsTell(w->fs, w->files[i]);
+        if (len < 0) {
+            ret = errno;
+            goto error;
+        }
+        ret = hdfsCloseFile(w->fs, w->files[i]) ? errno : 0;
+        w->files[i] = NULL;
+        if (ret) {
+            goto error;
+        }
+        if (len != w->partSize && firstShort == w->numParts) {
+            firstShort = i;
+        }
+        if (len > 0) {
+            last = i;
+        }
+    }
+    // A short part would leave a hole before the parts after it
+    if (firstShort < last) {
+        fprintf(stderr, "hdfsParallelWriterClose(%s): part %d is short of "
+                "%"PRId64" bytes, but part %d is not empty\n", w->paths[0],
+                firstShort, w->partSize, last);
+        ret = EINVAL;
+        goto error;
+    }
+    if (last > 0) {
+        ret = parallelWriterConcat(env, w, last);
+        if (ret) {
+            goto error;
+        }
+    }
+    for (i = 0; i < w->numParts; i++) {
+        // concat removed the parts it took; the empty ones are left
+        if (i > last) {
+            hdfsDelete(w->fs, w->paths[i], 0);
+        }
+        free(w->paths[i]);
+    }
+    free(w->paths);
+    free(w->files);
+    free(w);
+    return 0;
 
-int hdfsCopy(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
-{
-    return hdfsCopyImpl(srcFS, src, dstFS, dst, 0);
+error:
+    parallelWriterDiscard(w);
+    errno = ret;
+    return -1;
 }
 
-int hdfsMove(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
+void hdfsParallelWriterAbort(struct hdfsParallelWriter *w)
 {
-    return hdfsCopyImpl(srcFS, src, dstFS, dst, 1);
+    if (w) {
+        parallelWriterDiscard(w);
+    }
 }
 
 int hdfsDelete(hdfsFS fs, const char* path, int recursive)
@@ -1534,6 +3900,7 @@ int hdfsDelete(hdfsFS fs, const char* path, int recursive)
                      "delete", "(Lorg/apache/hadoop/fs/Path;Z)Z",
                      jPath, jRecursive);
     destroyLocalReference(env, jPath);
+    existsCacheInvalidate(fs, path);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsDelete(path=%s, recursive=%d): "
@@ -1587,6 +3954,8 @@ int hdfsRename(hdfsFS fs, const char* oldPath, const char* newPath)
     jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS, "rename",
                      JMETHOD2(JPARAM(HADOOP_PATH), JPARAM(HADOOP_PATH), "Z"),
                      jOldPath, jNewPath);
+    existsCacheInvalidate(fs, oldPath);
+    existsCacheInvalidate(fs, newPath);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
             "hdfsRename(oldPath=%s, newPath=%s): FileSystem#rename",
@@ -1758,6 +4127,7 @@ int hdfsCreateDirectory(hdfsFS fs, const char* path)
                      "mkdirs", "(Lorg/apache/hadoop/fs/Path;)Z",
                      jPath);
     destroyLocalReference(env, jPath);
+    existsCacheInvalidate(fs, path);
     if (jthr) {
         errno = printExceptionAndFree(env, jthr,
             NOPRINT_EXC_ACCESS_CONTROL | NOPRINT_EXC_FILE_NOT_FOUND |
@@ -1995,15 +4365,77 @@ int hdfsUtime(hdfsFS fs, const char* path, tTime mtime, tTime atime)
     return 0;
 }
 
+/**
+ * A growable buffer of strings that are later copied, as one piece, into
+ * the allocation handed back to the caller.  Strings are referred to by
+ * their offset plus one, with zero meaning NULL.  Owner, group and host
+ * names repeat a lot, so they can go through a small direct-mapped table
+ * and are then usually stored once.
+ */
+#define STRING_HEAP_INTERN_BUCKETS 64
+
+struct stringHeap {
+    char *buf;
+    size_t len, cap;
+    /** Offsets of interned strings, plus one; zero when empty */
+    size_t interned[STRING_HEAP_INTERN_BUCKETS];
+};
+
+/**
+ * Copy str into the heap.
+ *
+ * @param intern    If nonzero, share an earlier copy of the same string
+ * @param off       (out param) the offset of the copy, plus one
+ * @return          0 on success, or ENOMEM
+ */
+static int stringHeapAdd(struct stringHeap *heap, const char *str,
+                         int intern, size_t *off)
+{
+    size_t len = strlen(str) + 1, cap, *slot = NULL;
+    uint32_t hash = 2166136261U;
+    const char *c;
+    char *buf;
+
+    if (intern) {
+        for (c = str; *c; c++) {
+            hash = (hash ^ (unsigned char)*c) * 16777619U;
+        }
+        slot = &heap->interned[hash % STRING_HEAP_INTERN_BUCKETS];
+        if (*slot && !strcmp(heap->buf + *slot - 1, str)) {
+            *off = *slot;
+            return 0;
+        }
+    }
+    if (heap->len + len > heap->cap) {
+        cap = heap->cap ? heap->cap : 4096;
+        while (cap < heap->len + len) {
+            cap *= 2;
+        }
+        buf = realloc(heap->buf, cap);
+        if (!buf) {
+            return ENOMEM;
+        }
+        heap->buf = buf;
+        heap->cap = cap;
+    }
+    memcpy(heap->buf + heap->len, str, len);
+    *off = heap->len + 1;
+    if (slot) {
+        // A colliding name just replaces the one in the table
+        *slot = *off;
+    }
+    heap->len += len;
+    return 0;
+}
+
 char***
 hdfsGetHosts(hdfsFS fs, const char* path, tOffset start, tOffset length)
 {
     // JAVA EQUIVALENT:
-    //  fs.getFileBlockLoctions(new Path(path), start, length);
+    //  fs.getFileBlockLocations(new Path(path), start, length);
     jthrowable jthr;
     jobject jPath = NULL;
-    jobject jFileStatus = NULL;
-    jvalue jFSVal, jVal;
+    jvalue jVal;
     jobjectArray jBlockLocations = NULL, jFileBlockHosts = NULL;
     jstring jHost = NULL;
     char*** blockHosts = NULL;
@@ -2026,26 +4458,14 @@ hdfsGetHosts(hdfsFS fs, const char* path, tOffset start, tOffset length)
             "hdfsGetHosts(path=%s): constructNewObjectOfPath", path);
         goto done;
     }
-    jthr = invokeMethod(env, &jFSVal, INSTANCE, jFS,
-            HADOOP_FS, "getFileStatus", "(Lorg/apache/hadoop/fs/Path;)"
-            "Lorg/apache/hadoop/fs/FileStatus;", jPath);
-    if (jthr) {
-        ret = printExceptionAndFree(env, jthr, NOPRINT_EXC_FILE_NOT_FOUND,
-                "hdfsGetHosts(path=%s, start=%"PRId64", length=%"PRId64"):"
-                "FileSystem#getFileStatus", path, start, length);
-        destroyLocalReference(env, jPath);
-        goto done;
-    }
-    jFileStatus = jFSVal.l;
-
     //org.apache.hadoop.fs.FileSystem#getFileBlockLocations
     jthr = invokeMethod(env, &jVal, INSTANCE, jFS,
                      HADOOP_FS, "getFileBlockLocations", 
-                     "(Lorg/apache/hadoop/fs/FileStatus;JJ)"
+                     "(Lorg/apache/hadoop/fs/Path;JJ)"
                      "[Lorg/apache/hadoop/fs/BlockLocation;",
-                     jFileStatus, start, length);
+                     jPath, start, length);
     if (jthr) {
-        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+        ret = printExceptionAndFree(env, jthr, NOPRINT_EXC_FILE_NOT_FOUND,
                 "hdfsGetHosts(path=%s, start=%"PRId64", length=%"PRId64"):"
                 "FileSystem#getFileBlockLocations", path, start, length);
         goto done;
@@ -2137,7 +4557,6 @@ hdfsGetHosts(hdfsFS fs, const char* path, tOffset start, tOffset length)
 
 done:
     destroyLocalReference(env, jPath);
-    destroyLocalReference(env, jFileStatus);
     destroyLocalReference(env, jBlockLocations);
     destroyLocalReference(env, jFileBlockHosts);
     destroyLocalReference(env, jHost);
@@ -2165,6 +4584,258 @@ void hdfsFreeHosts(char ***blockHosts)
 }
 
 
+/**
+ * Builds a packed array of hdfsBlockLocation: the blocks, then the host,
+ * name and topology path lists as one array of pointers, then the strings.
+ *
+ * While building, slots holds the string offsets of all the lists, each
+ * list ending with a zero, and first holds where each block's lists start.
+ */
+enum { BLKLOC_HOSTS, BLKLOC_NAMES, BLKLOC_TOPOLOGY, BLKLOC_NUM_LISTS };
+
+struct blockLocArena {
+    struct hdfsBlockLocation *blocks;
+    size_t (*first)[BLKLOC_NUM_LISTS];
+    size_t *slots;
+    size_t numSlots, slotCap;
+    struct stringHeap strings;
+};
+
+static void blockLocArenaFree(struct blockLocArena *arena)
+{
+    free(arena->blocks);
+    free(arena->first);
+    free(arena->slots);
+    free(arena->strings.buf);
+    memset(arena, 0, sizeof(*arena));
+}
+
+static int blockLocAddSlot(struct blockLocArena *arena, size_t off)
+{
+    size_t cap;
+    size_t *slots;
+
+    if (arena->numSlots == arena->slotCap) {
+        cap = arena->slotCap ? arena->slotCap * 2 : 64;
+        slots = realloc(arena->slots, cap * sizeof(size_t));
+        if (!slots) {
+            return ENOMEM;
+        }
+        arena->slots = slots;
+        arena->slotCap = cap;
+    }
+    arena->slots[arena->numSlots++] = off;
+    return 0;
+}
+
+/**
+ * Add the String[] returned by one of the BlockLocation getters as list
+ * 'which' of block idx.
+ *
+ * @param count     (out param) the number of strings, or NULL
+ */
+static jthrowable blockLocAddList(JNIEnv *env, struct blockLocArena *arena,
+        int idx, int which, jobject jBlock, const char *getter, int *count)
+{
+    jthrowable jthr;
+    jvalue jVal;
+    jobjectArray jStrs;
+    jstring jStr;
+    const char *str;
+    size_t off;
+    jsize i, n = 0;
+    int ret;
+
+    jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_BLK_LOC,
+                        getter, "()[Ljava/lang/String;");
+    if (jthr) {
+        return jthr;
+    }
+    jStrs = jVal.l;
+    arena->first[idx][which] = arena->numSlots;
+    if (jStrs) {
+        n = (*env)->GetArrayLength(env, jStrs);
+    }
+    for (i = 0; i < n; i++) {
+        jStr = (*env)->GetObjectArrayElement(env, jStrs, i);
+        if (!jStr) {
+            jthr = getPendingExceptionAndClear(env);
+            if (!jthr) {
+                jthr = newRuntimeError(env, "BlockLocation#%s: "
+                    "null element %d", getter, i);
+            }
+            goto done;
+        }
+        str = (*env)->GetStringUTFChars(env, jStr, NULL);
+        if (!str) {
+            destroyLocalReference(env, jStr);
+            jthr = getPendingExceptionAndClear(env);
+            goto done;
+        }
+        ret = stringHeapAdd(&arena->strings, str, 1, &off);
+        (*env)->ReleaseStringUTFChars(env, jStr, str);
+        destroyLocalReference(env, jStr);
+        if (ret || blockLocAddSlot(arena, off)) {
+            jthr = newRuntimeError(env, "blockLocAddList: OOM");
+            goto done;
+        }
+    }
+    if (blockLocAddSlot(arena, 0)) {
+        jthr = newRuntimeError(env, "blockLocAddList: OOM");
+        goto done;
+    }
+    if (count) {
+        *count = n;
+    }
+
+done:
+    destroyLocalReference(env, jStrs);
+    return jthr;
+}
+
+struct hdfsBlockLocation *hdfsGetBlockLocations(hdfsFS fs, const char *path,
+        tOffset start, tOffset length, int *numBlocks)
+{
+    // JAVA EQUIVALENT:
+    //  fs.getFileBlockLocations(new Path(path), start, length);
+    jthrowable jthr;
+    jobject jPath = NULL, jBlock = NULL;
+    jvalue jVal;
+    jobjectArray jBlockLocations = NULL;
+    struct blockLocArena arena;
+    struct hdfsBlockLocation *packed = NULL;
+    char **slots, *heap;
+    size_t k;
+    int i, ret;
+    jsize jNumBlocks = 0;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return NULL;
+    }
+
+    jobject jFS = (jobject)fs;
+    memset(&arena, 0, sizeof(arena));
+
+    //Create an object of org.apache.hadoop.fs.Path
+    jthr = constructNewObjectOfPath(env, path, &jPath);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsGetBlockLocations(path=%s): constructNewObjectOfPath", path);
+        goto done;
+    }
+    jthr = invokeMethod(env, &jVal, INSTANCE, jFS,
+                     HADOOP_FS, "getFileBlockLocations",
+                     "(Lorg/apache/hadoop/fs/Path;JJ)"
+                     "[Lorg/apache/hadoop/fs/BlockLocation;",
+                     jPath, start, length);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, NOPRINT_EXC_FILE_NOT_FOUND,
+                "hdfsGetBlockLocations(path=%s, start=%"PRId64", "
+                "length=%"PRId64"): FileSystem#getFileBlockLocations",
+                path, start, length);
+        goto done;
+    }
+    jBlockLocations = jVal.l;
+    jNumBlocks = (*env)->GetArrayLength(env, jBlockLocations);
+
+    arena.blocks = calloc(jNumBlocks + 1, sizeof(struct hdfsBlockLocation));
+    arena.first = calloc(jNumBlocks + 1, sizeof(*arena.first));
+    if (!arena.blocks || !arena.first) {
+        ret = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < jNumBlocks; i++) {
+        jBlock = (*env)->GetObjectArrayElement(env, jBlockLocations, i);
+        if (!jBlock) {
+            ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsGetBlockLocations(path=%s): GetObjectArrayElement(%d)",
+                path, i);
+            goto done;
+        }
+        jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_BLK_LOC,
+                            "getOffset", "()J");
+        if (jthr)
+            goto blockError;
+        arena.blocks[i].offset = jVal.j;
+        jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_BLK_LOC,
+                            "getLength", "()J");
+        if (jthr)
+            goto blockError;
+        arena.blocks[i].length = jVal.j;
+        jthr = invokeMethod(env, &jVal, INSTANCE, jBlock, HADOOP_BLK_LOC,
+                            "isCorrupt", "()Z");
+        if (jthr)
+            goto blockError;
+        arena.blocks[i].corrupt = jVal.z;
+        jthr = blockLocAddList(env, &arena, i, BLKLOC_HOSTS, jBlock,
+                               "getHosts", &arena.blocks[i].numHosts);
+        if (jthr)
+            goto blockError;
+        jthr = blockLocAddList(env, &arena, i, BLKLOC_NAMES, jBlock,
+                               "getNames", NULL);
+        if (jthr)
+            goto blockError;
+        jthr = blockLocAddList(env, &arena, i, BLKLOC_TOPOLOGY, jBlock,
+                               "getTopologyPaths", NULL);
+        if (jthr)
+            goto blockError;
+        destroyLocalReference(env, jBlock);
+        jBlock = NULL;
+    }
+
+    //Pack the blocks, the pointer lists and the strings together
+    packed = malloc((jNumBlocks + 1) * sizeof(struct hdfsBlockLocation) +
+                    arena.numSlots * sizeof(char*) + arena.strings.len);
+    if (!packed) {
+        ret = ENOMEM;
+        goto done;
+    }
+    memcpy(packed, arena.blocks,
+           (jNumBlocks + 1) * sizeof(struct hdfsBlockLocation));
+    slots = (char**)(packed + jNumBlocks + 1);
+    heap = (char*)(slots + arena.numSlots);
+    if (arena.strings.len) {
+        memcpy(heap, arena.strings.buf, arena.strings.len);
+    }
+    for (k = 0; k < arena.numSlots; k++) {
+        slots[k] = arena.slots[k] ? heap + arena.slots[k] - 1 : NULL;
+    }
+    for (i = 0; i < jNumBlocks; i++) {
+        packed[i].hosts = slots + arena.first[i][BLKLOC_HOSTS];
+        packed[i].names = slots + arena.first[i][BLKLOC_NAMES];
+        packed[i].topologyPaths = slots + arena.first[i][BLKLOC_TOPOLOGY];
+    }
+    ret = 0;
+    goto done;
+
+blockError:
+    ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+        "hdfsGetBlockLocations(path=%s, start=%"PRId64", length=%"PRId64"): "
+        "BlockLocation %d", path, start, length, i);
+
+done:
+    destroyLocalReference(env, jPath);
+    destroyLocalReference(env, jBlockLocations);
+    destroyLocalReference(env, jBlock);
+    blockLocArenaFree(&arena);
+    if (ret) {
+        errno = ret;
+        return NULL;
+    }
+    *numBlocks = jNumBlocks;
+    return packed;
+}
+
+void hdfsFreeBlockLocations(struct hdfsBlockLocation *blocks, int numBlocks)
+{
+    //The lists and strings live in the same block, after the entries
+    free(blocks);
+}
+
+
 tOffset hdfsGetDefaultBlockSize(hdfsFS fs)
 {
     // JAVA EQUIVALENT:
@@ -2265,49 +4936,251 @@ tOffset hdfsGetCapacity(hdfsFS fs)
 }
 
 
-  
-tOffset hdfsGetUsed(hdfsFS fs)
+  
+tOffset hdfsGetUsed(hdfsFS fs)
+{
+    // JAVA EQUIVALENT:
+    //  FsStatus fss = fs.getStatus();
+    //  return Fss.getUsed();
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    jobject jFS = (jobject)fs;
+
+    //FileSystem#getStatus
+    jvalue  jVal;
+    jthrowable jthr;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
+                     "getStatus", "()Lorg/apache/hadoop/fs/FsStatus;");
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsGetUsed: FileSystem#getStatus");
+        return -1;
+    }
+    jobject fss = (jobject)jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, fss, HADOOP_FSSTATUS,
+                     "getUsed", "()J");
+    destroyLocalReference(env, fss);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsGetUsed: FsStatus#getUsed");
+        return -1;
+    }
+    return jVal.j;
+}
+
+/**
+ * Call getter on obj, which must be an instance of className, to get a
+ * DFSInputStream.ReadStatistics, and copy its counters into stats.
+ *
+ * @return          0 on success; -1 with errno set on error.  errno is
+ *                  ENOTSUP if obj is not an instance of className.
+ */
+static int getReadStatistics(JNIEnv *env, jobject obj, const char *className,
+        const char *getter, struct hdfsReadStatistics *stats)
+{
+    jthrowable jthr;
+    jclass cls;
+    jvalue jVal;
+    jobject jStats;
+    int ret = 0;
+
+    jthr = globalClassReference(className, env, &cls);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "%s: globalClassReference(%s)", getter, className);
+        return -1;
+    }
+    if (!(*env)->IsInstanceOf(env, obj, cls)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    jthr = invokeMethod(env, &jVal, INSTANCE, obj, className, getter,
+            "()L" HADOOP_RSTATS ";");
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "%s#%s", className, getter);
+        return -1;
+    }
+    jStats = jVal.l;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStats, HADOOP_RSTATS,
+                        "getTotalBytesRead", "()J");
+    if (jthr)
+        goto done;
+    stats->totalBytesRead = jVal.j;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStats, HADOOP_RSTATS,
+                        "getTotalLocalBytesRead", "()J");
+    if (jthr)
+        goto done;
+    stats->totalLocalBytesRead = jVal.j;
+    jthr = invokeMethod(env, &jVal, INSTANCE, jStats, HADOOP_RSTATS,
+                        "getTotalShortCircuitBytesRead", "()J");
+    if (jthr)
+        goto done;
+    stats->totalShortCircuitBytesRead = jVal.j;
+    stats->totalRemoteBytesRead =
+        stats->totalBytesRead - stats->totalLocalBytesRead;
+    stats->hedgedReadOps = 0;
+    stats->hedgedReadWins = 0;
+
+done:
+    destroyLocalReference(env, jStats);
+    if (jthr) {
+        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "%s: ReadStatistics", getter);
+        ret = -1;
+    }
+    return ret;
+}
+
+int hdfsFileGetReadStatistics(hdfsFile file,
+                              struct hdfsReadStatistics *stats)
+{
+    // JAVA EQUIVALENT:
+    //  ((HdfsDataInputStream)fis).getReadStatistics();
+
+    int64_t nativeBytes;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+    if (!file || file->type != INPUT) {
+        errno = EBADF;
+        return -1;
+    }
+    if (getReadStatistics(env, file->file, HADOOP_HDFS_ISTRM,
+                          "getReadStatistics", stats)) {
+        return -1;
+    }
+    // Native local reads are short-circuit reads the stream never saw
+    nativeBytes = __sync_fetch_and_add(&file->nativeBytesRead, 0);
+    stats->totalBytesRead += nativeBytes;
+    stats->totalLocalBytesRead += nativeBytes;
+    stats->totalShortCircuitBytesRead += nativeBytes;
+    if (file->hedgedReader) {
+        hedgedReaderGetCounts(file->hedgedReader, &stats->hedgedReadOps,
+                              &stats->hedgedReadWins);
+    }
+    return 0;
+}
+
+int hdfsGetReadStatistics(hdfsFS fs, struct hdfsReadStatistics *stats)
+{
+    // JAVA EQUIVALENT:
+    //  ((DistributedFileSystem)fs).getReadStatistics();
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+    return getReadStatistics(env, (jobject)fs, HADOOP_DFS,
+                             "getReadStatistics", stats);
+}
+
+
+ 
+/**
+ * Builds a packed array of hdfsFileInfo: the entries followed by a heap of
+ * their strings, in one allocation, so hdfsFreeFileInfo frees it with a
+ * single call.
+ *
+ * While building, strOff holds each entry's string offsets in the heap;
+ * arenaFinish turns them into pointers.
+ */
+enum { ARENA_NAME, ARENA_OWNER, ARENA_GROUP, ARENA_NUM_STRINGS };
+
+struct fileInfoArena {
+    hdfsFileInfo *entries;
+    size_t (*strOff)[ARENA_NUM_STRINGS];
+    struct stringHeap strings;
+};
+
+static int arenaInit(struct fileInfoArena *arena, int numEntries)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->entries = calloc(numEntries, sizeof(hdfsFileInfo));
+    arena->strOff = calloc(numEntries, sizeof(*arena->strOff));
+    if (!arena->entries || !arena->strOff) {
+        free(arena->entries);
+        free(arena->strOff);
+        memset(arena, 0, sizeof(*arena));
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static void arenaFree(struct fileInfoArena *arena)
+{
+    free(arena->entries);
+    free(arena->strOff);
+    free(arena->strings.buf);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * Copy str into the heap as string 'which' of entry idx.
+ *
+ * @param intern    If nonzero, share an earlier copy of the same string
+ * @return          0 on success, or ENOMEM
+ */
+static int arenaSetString(struct fileInfoArena *arena, int idx, int which,
+                          const char *str, int intern)
 {
-    // JAVA EQUIVALENT:
-    //  FsStatus fss = fs.getStatus();
-    //  return Fss.getUsed();
+    return stringHeapAdd(&arena->strings, str, intern,
+                         &arena->strOff[idx][which]);
+}
 
-    //Get the JNIEnv* corresponding to current thread
-    JNIEnv* env = getJNIEnv();
-    if (env == NULL) {
-      errno = EINTERNAL;
-      return -1;
-    }
+static char *arenaString(char *heap, size_t off)
+{
+    return off ? heap + off - 1 : NULL;
+}
 
-    jobject jFS = (jobject)fs;
+/**
+ * Pack the first numEntries entries and their strings into one allocation.
+ * The arena is freed either way.
+ *
+ * @return          The packed array, or NULL if out of memory
+ */
+static hdfsFileInfo *arenaFinish(struct fileInfoArena *arena, int numEntries)
+{
+    hdfsFileInfo *packed;
+    char *heap;
+    int i;
 
-    //FileSystem#getStatus
-    jvalue  jVal;
-    jthrowable jthr;
-    jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
-                     "getStatus", "()Lorg/apache/hadoop/fs/FsStatus;");
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsGetUsed: FileSystem#getStatus");
-        return -1;
-    }
-    jobject fss = (jobject)jVal.l;
-    jthr = invokeMethod(env, &jVal, INSTANCE, fss, HADOOP_FSSTATUS,
-                     "getUsed", "()J");
-    destroyLocalReference(env, fss);
-    if (jthr) {
-        errno = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
-            "hdfsGetUsed: FsStatus#getUsed");
-        return -1;
+    packed = malloc(numEntries * sizeof(hdfsFileInfo) + arena->strings.len);
+    if (packed) {
+        memcpy(packed, arena->entries, numEntries * sizeof(hdfsFileInfo));
+        heap = (char*)(packed + numEntries);
+        if (arena->strings.len) {
+            memcpy(heap, arena->strings.buf, arena->strings.len);
+        }
+        for (i = 0; i < numEntries; i++) {
+            packed[i].mName = arenaString(heap, arena->strOff[i][ARENA_NAME]);
+            packed[i].mOwner =
+                arenaString(heap, arena->strOff[i][ARENA_OWNER]);
+            packed[i].mGroup =
+                arenaString(heap, arena->strOff[i][ARENA_GROUP]);
+        }
     }
-    return jVal.j;
+    arenaFree(arena);
+    return packed;
 }
 
-
- 
 static jthrowable
-getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
+getFileInfoFromStat(JNIEnv *env, jobject jStat, struct fileInfoArena *arena,
+                    int idx)
 {
+    hdfsFileInfo *fileInfo = &arena->entries[idx];
     jvalue jVal;
     jthrowable jthr;
     jobject jPath = NULL;
@@ -2315,6 +5188,7 @@ getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
     jstring jUserName = NULL;
     jstring jGroupName = NULL;
     jobject jPermission = NULL;
+    int ret;
 
     jthr = invokeMethod(env, &jVal, INSTANCE, jStat,
                      HADOOP_STAT, "isDir", "()Z");
@@ -2376,8 +5250,12 @@ getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
         jthr = getPendingExceptionAndClear(env);
         goto done;
     }
-    fileInfo->mName = strdup(cPathName);
+    ret = arenaSetString(arena, idx, ARENA_NAME, cPathName, 0);
     (*env)->ReleaseStringUTFChars(env, jPathName, cPathName);
+    if (ret) {
+        jthr = newRuntimeError(env, "getFileInfoFromStat: OOM copying mName");
+        goto done;
+    }
     jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
                     "getOwner", "()Ljava/lang/String;");
     if (jthr)
@@ -2389,8 +5267,12 @@ getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
         jthr = getPendingExceptionAndClear(env);
         goto done;
     }
-    fileInfo->mOwner = strdup(cUserName);
+    ret = arenaSetString(arena, idx, ARENA_OWNER, cUserName, 1);
     (*env)->ReleaseStringUTFChars(env, jUserName, cUserName);
+    if (ret) {
+        jthr = newRuntimeError(env, "getFileInfoFromStat: OOM copying mOwner");
+        goto done;
+    }
 
     const char* cGroupName;
     jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
@@ -2403,8 +5285,12 @@ getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
         jthr = getPendingExceptionAndClear(env);
         goto done;
     }
-    fileInfo->mGroup = strdup(cGroupName);
+    ret = arenaSetString(arena, idx, ARENA_GROUP, cGroupName, 1);
     (*env)->ReleaseStringUTFChars(env, jGroupName, cGroupName);
+    if (ret) {
+        jthr = newRuntimeError(env, "getFileInfoFromStat: OOM copying mGroup");
+        goto done;
+    }
 
     jthr = invokeMethod(env, &jVal, INSTANCE, jStat, HADOOP_STAT,
             "getPermission",
@@ -2425,8 +5311,6 @@ getFileInfoFromStat(JNIEnv *env, jobject jStat, hdfsFileInfo *fileInfo)
     jthr = NULL;
 
 done:
-    if (jthr)
-        hdfsFreeFileInfoEntry(fileInfo);
     destroyLocalReference(env, jPath);
     destroyLocalReference(env, jPathName);
     destroyLocalReference(env, jUserName);
@@ -2451,6 +5335,7 @@ getFileInfo(JNIEnv *env, jobject jFS, jobject jPath, hdfsFileInfo **fileInfo)
     jobject jStat;
     jvalue  jVal;
     jthrowable jthr;
+    struct fileInfoArena arena;
 
     jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
                      "exists", JMETHOD1(JPARAM(HADOOP_PATH), "Z"),
@@ -2467,19 +5352,27 @@ getFileInfo(JNIEnv *env, jobject jFS, jobject jPath, hdfsFileInfo **fileInfo)
     if (jthr)
         return jthr;
     jStat = jVal.l;
-    *fileInfo = calloc(1, sizeof(hdfsFileInfo));
-    if (!*fileInfo) {
+    if (arenaInit(&arena, 1)) {
         destroyLocalReference(env, jStat);
         return newRuntimeError(env, "getFileInfo: OOM allocating hdfsFileInfo");
     }
-    jthr = getFileInfoFromStat(env, jStat, *fileInfo); 
+    jthr = getFileInfoFromStat(env, jStat, &arena, 0);
     destroyLocalReference(env, jStat);
-    return jthr;
+    if (jthr) {
+        arenaFree(&arena);
+        return jthr;
+    }
+    *fileInfo = arenaFinish(&arena, 1);
+    if (!*fileInfo) {
+        return newRuntimeError(env, "getFileInfo: OOM allocating hdfsFileInfo");
+    }
+    return NULL;
 }
 
 
 
-hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
+static hdfsFileInfo* hdfsListDirectoryUntimed(hdfsFS fs, const char* path,
+                                              int *numEntries)
 {
     // JAVA EQUIVALENT:
     //  Path p(path);
@@ -2489,6 +5382,7 @@ hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
     jthrowable jthr;
     jobject jPath = NULL;
     hdfsFileInfo *pathList = NULL; 
+    struct fileInfoArena arena;
     jobjectArray jPathList = NULL;
     jvalue jVal;
     jsize jPathListSize = 0;
@@ -2502,6 +5396,7 @@ hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
     }
 
     jobject jFS = (jobject)fs;
+    memset(&arena, 0, sizeof(arena));
 
     //Create an object of org.apache.hadoop.fs.Path
     jthr = constructNewObjectOfPath(env, path, &jPath);
@@ -2531,9 +5426,8 @@ hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
     }
 
     //Allocate memory
-    pathList = calloc(jPathListSize, sizeof(hdfsFileInfo));
-    if (pathList == NULL) {
-        ret = ENOMEM;
+    ret = arenaInit(&arena, jPathListSize);
+    if (ret) {
         goto done;
     }
 
@@ -2548,7 +5442,7 @@ hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
                 path, i, jPathListSize);
             goto done;
         }
-        jthr = getFileInfoFromStat(env, tmpStat, &pathList[i]);
+        jthr = getFileInfoFromStat(env, tmpStat, &arena, i);
         destroyLocalReference(env, tmpStat);
         if (jthr) {
             ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
@@ -2557,14 +5451,15 @@ hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
             goto done;
         }
     }
-    ret = 0;
+    pathList = arenaFinish(&arena, jPathListSize);
+    ret = pathList ? 0 : ENOMEM;
 
 done:
     destroyLocalReference(env, jPath);
     destroyLocalReference(env, jPathList);
 
     if (ret) {
-        hdfsFreeFileInfo(pathList, jPathListSize);
+        arenaFree(&arena);
         errno = ret;
         return NULL;
     }
@@ -2572,9 +5467,183 @@ done:
     return pathList;
 }
 
+hdfsFileInfo* hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
+{
+    uint64_t start = METRICS_START();
+    hdfsFileInfo *ret;
 
+    ret = hdfsListDirectoryUntimed(fs, path, numEntries);
+    METRICS_END(HDFS_METRICS_OP_LIST_DIRECTORY, start, 0);
+    return ret;
+}
 
-hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
+hdfsDir hdfsOpenDir(hdfsFS fs, const char* path)
+{
+    // JAVA EQUIVALENT:
+    //  Path p(path);
+    //  RemoteIterator<FileStatus> iter = fs.listStatusIterator(p)
+    jthrowable jthr;
+    jobject jPath = NULL;
+    jvalue jVal;
+    hdfsDir dir = NULL;
+    int ret;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return NULL;
+    }
+
+    jobject jFS = (jobject)fs;
+
+    dir = calloc(1, sizeof(struct hdfsDir_internal));
+    if (!dir) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    dir->path = strdup(path);
+    if (!dir->path) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    //Create an object of org.apache.hadoop.fs.Path
+    jthr = constructNewObjectOfPath(env, path, &jPath);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsOpenDir(%s): constructNewObjectOfPath", path);
+        goto done;
+    }
+
+    jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
+                     "listStatusIterator",
+                     JMETHOD1(JPARAM(HADOOP_PATH), JPARAM(HADOOP_RITERATOR)),
+                     jPath);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr,
+            NOPRINT_EXC_ACCESS_CONTROL | NOPRINT_EXC_FILE_NOT_FOUND |
+            NOPRINT_EXC_UNRESOLVED_LINK,
+            "hdfsOpenDir(%s): FileSystem#listStatusIterator", path);
+        goto done;
+    }
+    dir->iter = (*env)->NewGlobalRef(env, jVal.l);
+    destroyLocalReference(env, jVal.l);
+    if (!dir->iter) {
+        ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "hdfsOpenDir(%s): NewGlobalRef", path);
+        goto done;
+    }
+    ret = 0;
+
+done:
+    destroyLocalReference(env, jPath);
+
+    if (ret) {
+        free(dir->path);
+        free(dir);
+        errno = ret;
+        return NULL;
+    }
+    return dir;
+}
+
+int hdfsReadDirBatch(hdfsDir dir, int maxEntries, hdfsFileInfo **entries)
+{
+    // JAVA EQUIVALENT:
+    //  while (n < maxEntries && iter.hasNext())
+    //    getFileInfoFromStat(iter.next())
+    jthrowable jthr;
+    jobject jStat;
+    jvalue jVal;
+    struct fileInfoArena arena;
+    int n = 0, ret;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return -1;
+    }
+
+    *entries = NULL;
+    if (!dir || maxEntries <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&arena, 0, sizeof(arena));
+
+    while (n < maxEntries) {
+        jthr = invokeMethod(env, &jVal, INSTANCE, dir->iter,
+                HADOOP_RITERATOR, "hasNext", "()Z");
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr,
+                NOPRINT_EXC_FILE_NOT_FOUND,
+                "hdfsReadDirBatch(%s): RemoteIterator#hasNext", dir->path);
+            goto done;
+        }
+        if (!jVal.z) {
+            break;
+        }
+        //Allocate the array for this batch on the first entry
+        if (!arena.entries) {
+            ret = arenaInit(&arena, maxEntries);
+            if (ret) {
+                goto done;
+            }
+        }
+        jthr = invokeMethod(env, &jVal, INSTANCE, dir->iter,
+                HADOOP_RITERATOR, "next", "()Ljava/lang/Object;");
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsReadDirBatch(%s): RemoteIterator#next", dir->path);
+            goto done;
+        }
+        jStat = jVal.l;
+        jthr = getFileInfoFromStat(env, jStat, &arena, n);
+        destroyLocalReference(env, jStat);
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsReadDirBatch(%s): getFileInfoFromStat", dir->path);
+            goto done;
+        }
+        n++;
+    }
+    ret = 0;
+    if (n > 0) {
+        *entries = arenaFinish(&arena, n);
+        if (!*entries) {
+            ret = ENOMEM;
+        }
+    }
+
+done:
+    if (ret) {
+        arenaFree(&arena);
+        errno = ret;
+        return -1;
+    }
+    return n;
+}
+
+void hdfsCloseDir(hdfsDir dir)
+{
+    JNIEnv* env;
+
+    if (!dir) {
+        return;
+    }
+    env = getJNIEnv();
+    if (env && dir->iter) {
+        (*env)->DeleteGlobalRef(env, dir->iter);
+    }
+    free(dir->path);
+    free(dir);
+}
+
+
+
+static hdfsFileInfo *hdfsGetPathInfoUntimed(hdfsFS fs, const char* path)
 {
     // JAVA EQUIVALENT:
     //  File f(path);
@@ -2591,6 +5660,14 @@ hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
     }
 
     jobject jFS = (jobject)fs;
+    uint64_t generation;
+
+    // Only misses are cached; a hit still needs the file's details
+    if (existsCacheGet(fs, path) == 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    generation = existsCacheGeneration(fs);
 
     //Create an object of org.apache.hadoop.fs.Path
     jobject jPath;
@@ -2610,6 +5687,7 @@ hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
             "hdfsGetPathInfo(%s): getFileInfo", path);
         return NULL;
     }
+    existsCachePut(fs, path, fileInfo != NULL, generation);
     if (!fileInfo) {
         errno = ENOENT;
         return NULL;
@@ -2617,23 +5695,134 @@ hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
     return fileInfo;
 }
 
-static void hdfsFreeFileInfoEntry(hdfsFileInfo *hdfsFileInfo)
+hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
 {
-    free(hdfsFileInfo->mName);
-    free(hdfsFileInfo->mOwner);
-    free(hdfsFileInfo->mGroup);
-    memset(hdfsFileInfo, 0, sizeof(hdfsFileInfo));
+    uint64_t start = METRICS_START();
+    hdfsFileInfo *ret;
+
+    ret = hdfsGetPathInfoUntimed(fs, path);
+    METRICS_END(HDFS_METRICS_OP_GET_PATH_INFO, start, 0);
+    return ret;
 }
 
-void hdfsFreeFileInfo(hdfsFileInfo *hdfsFileInfo, int numEntries)
+hdfsFileInfo *hdfsGetPathInfoBatch(hdfsFS fs, const char **paths,
+                                   int numPaths)
 {
-    //Free the mName, mOwner, and mGroup
-    int i;
-    for (i=0; i < numEntries; ++i) {
-        hdfsFreeFileInfoEntry(hdfsFileInfo + i);
+    // JAVA EQUIVALENT:
+    //  Path []pathList = { new Path(paths[0]), ... };
+    //  FileStatus []statList = fs.getFileStatus(pathList);
+    //  foreach stat in statList
+    //    getFileInfoFromStat(stat)
+    jthrowable jthr;
+    jclass jPathClass;
+    jobjectArray jPathList = NULL, jStatList = NULL;
+    jobject jPath, jStat;
+    jvalue jVal;
+    hdfsFileInfo *infoList = NULL;
+    struct fileInfoArena arena;
+    int i, ret;
+
+    //Get the JNIEnv* corresponding to current thread
+    JNIEnv* env = getJNIEnv();
+    if (env == NULL) {
+      errno = EINTERNAL;
+      return NULL;
+    }
+
+    jobject jFS = (jobject)fs;
+
+    if (numPaths <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (arenaInit(&arena, numPaths)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    //Build the org.apache.hadoop.fs.Path[]
+    jthr = globalClassReference(HADOOP_PATH, env, &jPathClass);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+            "hdfsGetPathInfoBatch: globalClassReference");
+        goto done;
+    }
+    jPathList = (*env)->NewObjectArray(env, numPaths, jPathClass, NULL);
+    if (!jPathList) {
+        ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "hdfsGetPathInfoBatch: NewObjectArray(%d)", numPaths);
+        goto done;
+    }
+    for (i = 0; i < numPaths; i++) {
+        jthr = constructNewObjectOfPath(env, paths[i], &jPath);
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsGetPathInfoBatch(%s): constructNewObjectOfPath",
+                paths[i]);
+            goto done;
+        }
+        (*env)->SetObjectArrayElement(env, jPathList, i, jPath);
+        destroyLocalReference(env, jPath);
+        if ((*env)->ExceptionCheck(env)) {
+            ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsGetPathInfoBatch(%s): SetObjectArrayElement",
+                paths[i]);
+            goto done;
+        }
+    }
+
+    //Look all of them up in one call
+    jthr = invokeMethod(env, &jVal, INSTANCE, jFS, HADOOP_FS,
+            "getFileStatus",
+            JMETHOD1(JARRPARAM(HADOOP_PATH), JARRPARAM(HADOOP_STAT)),
+            jPathList);
+    if (jthr) {
+        ret = printExceptionAndFree(env, jthr,
+            NOPRINT_EXC_ACCESS_CONTROL | NOPRINT_EXC_UNRESOLVED_LINK,
+            "hdfsGetPathInfoBatch: FileSystem#getFileStatus");
+        goto done;
+    }
+    jStatList = jVal.l;
+
+    //Missing paths come back as null and keep a zeroed entry
+    for (i = 0; i < numPaths; i++) {
+        jStat = (*env)->GetObjectArrayElement(env, jStatList, i);
+        if ((*env)->ExceptionCheck(env)) {
+            ret = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+                "hdfsGetPathInfoBatch: GetObjectArrayElement(%d out of %d)",
+                i, numPaths);
+            goto done;
+        }
+        if (!jStat) {
+            continue;
+        }
+        jthr = getFileInfoFromStat(env, jStat, &arena, i);
+        destroyLocalReference(env, jStat);
+        if (jthr) {
+            ret = printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "hdfsGetPathInfoBatch(%s): getFileInfoFromStat", paths[i]);
+            goto done;
+        }
+    }
+    infoList = arenaFinish(&arena, numPaths);
+    ret = infoList ? 0 : ENOMEM;
+
+done:
+    destroyLocalReference(env, jPathList);
+    destroyLocalReference(env, jStatList);
+
+    if (ret) {
+        arenaFree(&arena);
+        errno = ret;
+        return NULL;
     }
+    return infoList;
+}
 
-    //Free entire block
+void hdfsFreeFileInfo(hdfsFileInfo *hdfsFileInfo, int numEntries)
+{
+    //The mName, mOwner, and mGroup strings live in the same block, after
+    //the entries (see arenaFinish)
     free(hdfsFileInfo);
 }
 
@@ -65,6 +65,194 @@ extern  "C" {
     struct hdfsFile_internal;
     typedef struct hdfsFile_internal* hdfsFile;
 
+    struct hdfsDir_internal;
+    typedef struct hdfsDir_internal* hdfsDir;
+
+    /**
+     * The capacity of the buffers handed out by hdfsReadZeroCopy.
+     */
+#define HDFS_ZERO_COPY_BUFFER_SIZE (1024 * 1024)
+
+    /**
+     * Configuration keys for client-side caching, to be set with
+     * hdfsBuilderConfSetStr.  Both are off by default.
+     *
+     * HDFS_READAHEAD_WINDOW_KEY: when nonzero, hdfsRead fills a native
+     *   buffer of this many bytes per file and serves smaller reads from it.
+     * HDFS_BLOCK_CACHE_SIZE_KEY: when nonzero, hdfsPread keeps up to this
+     *   many bytes of file data in a process-wide LRU cache, in blocks of
+     *   HDFS_BLOCK_CACHE_BLOCK_SIZE_KEY bytes.  The first file opened with
+     *   the cache enabled decides its size.  Data is cached under the
+     *   file's full URI, modification time and length as of hdfsOpenFile,
+     *   so a file that is rewritten or replaced is read afresh by the next
+     *   open, while files opened before the change go on seeing the old
+     *   data.
+     */
+#define HDFS_READAHEAD_WINDOW_KEY "libhdfs.readahead.window"
+#define HDFS_BLOCK_CACHE_SIZE_KEY "libhdfs.block.cache.size"
+#define HDFS_BLOCK_CACHE_BLOCK_SIZE_KEY "libhdfs.block.cache.block.size"
+#define HDFS_BLOCK_CACHE_BLOCK_SIZE_DEFAULT (1024 * 1024)
+
+    /**
+     * Configuration key to be set to "true" with hdfsBuilderConfSetStr to
+     * have hdfsRead and hdfsPread read blocks that have a replica on this
+     * host straight from the datanode's block files, verifying checksums
+     * natively, instead of copying the data through the JVM.  It needs
+     * short-circuit reads to be enabled and allowed for the user, as for
+     * dfs.client.read.shortcircuit; other blocks, and any block that cannot
+     * be read or fails its checksum, are read through the JVM as usual.
+     * Bytes read this way are counted by hdfsFileGetReadStatistics as
+     * short-circuit bytes, though not by hdfsGetReadStatistics.
+     */
+#define HDFS_NATIVE_LOCAL_READ_KEY "libhdfs.native.local.read"
+
+    /**
+     * Configuration key to be set with hdfsBuilderConfSetStr to a number of
+     * milliseconds for which hdfsExists remembers whether absolute paths
+     * exist, and hdfsGetPathInfo remembers that they do not, on the
+     * connection.  Off by default.  Creating, deleting or renaming a path
+     * through the same hdfsFS forgets what was remembered about it, its
+     * parents and its children; changes made by other clients go unseen
+     * until the time runs out.
+     */
+#define HDFS_EXISTS_CACHE_TTL_MS_KEY "libhdfs.exists.cache.ttl.ms"
+
+    /**
+     * Configuration key for libwebhdfs, to be set with hdfsBuilderConfSetStr
+     * to the number of byte ranges that hdfsRead fetches from a file at
+     * once.  Above 1, each file read with hdfsRead has that many requests of
+     * HDFS_WEBHDFS_READ_CHUNK_SIZE bytes in flight ahead of the reader, which
+     * helps where one HTTP connection cannot fill the network, at the cost
+     * of that much memory per file.  Off (1) by default; libhdfs ignores it.
+     */
+#define HDFS_WEBHDFS_READ_PARALLELISM_KEY "libwebhdfs.read.parallelism"
+#define HDFS_WEBHDFS_READ_CHUNK_SIZE (4 * 1024 * 1024)
+
+    /**
+     * Configuration key to be set to "true" with hdfsBuilderConfSetStr to
+     * turn on the latency histograms read by hdfsGetMetrics.  Once any
+     * connection turns them on they stay on for the whole process.
+     */
+#define HDFS_METRICS_ENABLED_KEY "libhdfs.metrics.enabled"
+
+    /**
+     * Configuration keys for hedged preads, to be set with
+     * hdfsBuilderConfSetStr.
+     *
+     * HDFS_HEDGED_READ_THRESHOLD_MS_KEY: when nonzero, an hdfsPread of an
+     *   HDFS file that has taken this many milliseconds is raced against a
+     *   second read of the same range from another replica, and the first
+     *   to succeed is returned.  Off by default.
+     * HDFS_HEDGED_READ_THREADS_KEY: the size of the process-wide pool of
+     *   threads that hedged preads run on; 16 by default.  The first file
+     *   opened with hedging on decides it.  A pread that finds every thread
+     *   busy is not hedged.
+     *
+     * hdfsFileGetReadStatistics counts the hedges and how many of them won.
+     */
+#define HDFS_HEDGED_READ_THRESHOLD_MS_KEY "libhdfs.hedged.read.threshold.ms"
+#define HDFS_HEDGED_READ_THREADS_KEY "libhdfs.hedged.read.threads"
+
+    /**
+     * The calls that hdfsGetMetrics reports on.  HDFS_METRICS_OP_JNI_ATTACH
+     * is the time taken to attach a new thread to the JVM, which the first
+     * libhdfs call on each thread pays.
+     */
+    typedef enum {
+        HDFS_METRICS_OP_CONNECT,
+        HDFS_METRICS_OP_OPEN,
+        HDFS_METRICS_OP_CLOSE,
+        HDFS_METRICS_OP_READ,
+        HDFS_METRICS_OP_PREAD,
+        HDFS_METRICS_OP_WRITE,
+        HDFS_METRICS_OP_FLUSH,
+        HDFS_METRICS_OP_HFLUSH,
+        HDFS_METRICS_OP_HSYNC,
+        HDFS_METRICS_OP_GET_PATH_INFO,
+        HDFS_METRICS_OP_LIST_DIRECTORY,
+        HDFS_METRICS_OP_JNI_ATTACH,
+        HDFS_METRICS_NUM_OPS
+    } hdfsMetricsOp;
+
+    /**
+     * The latencies of one kind of call.  Percentiles are accurate to
+     * within 12.5%.
+     */
+    struct hdfsOpMetrics {
+        uint64_t count;    /* the number of calls */
+        uint64_t totalNs;  /* the total time spent in them */
+        uint64_t maxNs;    /* the longest call */
+        uint64_t p50Ns;    /* the median call */
+        uint64_t p90Ns;
+        uint64_t p99Ns;
+        uint64_t p999Ns;
+        uint64_t bytes;    /* the bytes read or written by the calls */
+    };
+
+    /**
+     * Byte counts of the reads done through a file, or through all the
+     * files of a filesystem.  Local bytes, read from a datanode on this
+     * host, include short-circuit bytes, read straight from the block
+     * files.  Remote bytes are the rest.  The hedged read counts are only
+     * kept per file, and are 0 for a filesystem.
+     */
+    struct hdfsReadStatistics {
+        uint64_t totalBytesRead;
+        uint64_t totalLocalBytesRead;
+        uint64_t totalShortCircuitBytesRead;
+        uint64_t totalRemoteBytesRead;
+        uint64_t hedgedReadOps;   /* preads that started a second read */
+        uint64_t hedgedReadWins;  /* second reads that finished first */
+    };
+
+    /**
+     * Get the read statistics of a file open for read.  Bytes served from
+     * libhdfs' own read-ahead buffer or block cache are not counted.
+     *
+     * @param file     The HDFS file
+     * @param stats    (out param) The statistics
+     * @return         0 on success; -1 with errno set on error.  errno is
+     *                 ENOTSUP if the file is not on HDFS.
+     */
+    int hdfsFileGetReadStatistics(hdfsFile file,
+                                  struct hdfsReadStatistics *stats);
+
+    /**
+     * Get the read statistics of all the files opened through a
+     * filesystem, as for hdfsFileGetReadStatistics.
+     *
+     * @param fs       The configured filesystem handle.
+     * @param stats    (out param) The statistics
+     * @return         0 on success; -1 with errno set on error.  errno is
+     *                 ENOTSUP if the filesystem is not HDFS.
+     */
+    int hdfsGetReadStatistics(hdfsFS fs, struct hdfsReadStatistics *stats);
+
+    /**
+     * Get the latencies of libhdfs calls since the process started, or
+     * since the last hdfsResetMetrics.
+     *
+     * @param metrics  (out param) An array of HDFS_METRICS_NUM_OPS entries,
+     *                 indexed by hdfsMetricsOp
+     * @return         0 on success; -1 with errno set to ENOTSUP if no
+     *                 connection has set HDFS_METRICS_ENABLED_KEY
+     */
+    int hdfsGetMetrics(struct hdfsOpMetrics *metrics);
+
+    /**
+     * Clear the latencies reported by hdfsGetMetrics.  Calls in progress
+     * may be counted either way.
+     */
+    void hdfsResetMetrics(void);
+
+    /**
+     * Get a short name for a hdfsMetricsOp, such as "pread".
+     *
+     * @param op       The hdfsMetricsOp
+     * @return         The name, or NULL if op is out of range
+     */
+    const char *hdfsMetricsOpName(int op);
+
     /**
      * Determine if a file is open for read.
      *
@@ -141,6 +329,18 @@ extern  "C" {
      */
      hdfsFS hdfsBuilderConnect(struct hdfsBuilder *bld);
 
+    /**
+     * hdfsWarmUp - Start the JVM, and load the classes libhdfs uses, in a
+     * background thread.  A program that calls this early can overlap the
+     * second or two that takes with its own start up.  hdfsNewBuilder
+     * calls it, and calls after the first do nothing.
+     *
+     * The JVM is set up from CLASSPATH and LIBHDFS_OPTS as usual, so a
+     * class data sharing archive can be given with -Xshare options in
+     * LIBHDFS_OPTS.
+     */
+    void hdfsWarmUp(void);
+
     /**
      * Create an HDFS builder.
      *
@@ -156,6 +356,22 @@ extern  "C" {
      */
     void hdfsBuilderSetForceNewInstance(struct hdfsBuilder *bld);
 
+    /**
+     * Share the connection with other builders that have the same
+     * namenode, port, user name, kerberos ticket cache, configuration
+     * and forceNewInstance setting.  Connecting returns an existing
+     * connection if there is one, and hdfsDisconnect only releases it;
+     * libhdfs closes shared connections after they have been unused for
+     * five minutes, or when the kerberos ticket cache changes.
+     *
+     * Services that connect for each request should set this, since
+     * making a connection, and with forceNewInstance the RPC client
+     * behind it, is expensive.
+     *
+     * @param bld The HDFS builder
+     */
+    void hdfsBuilderSetShared(struct hdfsBuilder *bld);
+
     /**
      * Set the HDFS NameNode to connect to.
      *
@@ -290,6 +506,64 @@ extern  "C" {
     hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
                           int bufferSize, short replication, tSize blocksize);
 
+    /**
+     * How a file opened with hdfsOpenFileWithOptions is going to be read.
+     */
+    enum hdfsAccessPattern {
+        /** Nothing is known; reads are set up as configured */
+        HDFS_ACCESS_DEFAULT = 0,
+        /** The file is read from start to end */
+        HDFS_ACCESS_SEQUENTIAL,
+        /** The file is read in small preads at scattered offsets */
+        HDFS_ACCESS_RANDOM,
+    };
+
+    /**
+     * Hints for hdfsOpenFileWithOptions about how a file will be read.
+     * All zeroes means no hints, as for hdfsOpenFile.  They are ignored
+     * for files opened for writing.
+     */
+    struct hdfsOpenOptions {
+        enum hdfsAccessPattern pattern;
+        /**
+         * The size of the read-ahead buffer that hdfsRead fills, in place
+         * of HDFS_READAHEAD_WINDOW_KEY; -1 for none.  When 0, the
+         * configured size is used, or none for HDFS_ACCESS_RANDOM.
+         */
+        int32_t readahead;
+        /**
+         * Nonzero to have data read natively from local replicas (see
+         * HDFS_NATIVE_LOCAL_READ_KEY) dropped from the page cache once it
+         * has been read, so that a large scan does not push out data that
+         * other readers on the host are using.
+         */
+        int dropBehind;
+    };
+
+    /**
+     * hdfsOpenFileWithOptions - Open a hdfs file as hdfsOpenFile does,
+     * with hints about how it will be read.
+     *
+     * The access pattern is passed on with posix_fadvise(2) for the block
+     * files of local replicas read natively, and HDFS_ACCESS_RANDOM turns
+     * off the configured read-ahead buffer.  Data read through the JVM
+     * from a datanode gets the datanode's own readahead and drop-behind
+     * settings whatever the hints.
+     *
+     * @param fs The configured filesystem handle.
+     * @param path The full path to the file.
+     * @param flags As for hdfsOpenFile.
+     * @param bufferSize As for hdfsOpenFile.
+     * @param replication As for hdfsOpenFile.
+     * @param blocksize As for hdfsOpenFile.
+     * @param opts The hints, or NULL for none.
+     * @return Returns the handle to the open file or NULL on error.
+     */
+    hdfsFile hdfsOpenFileWithOptions(hdfsFS fs, const char* path, int flags,
+                                     int bufferSize, short replication,
+                                     tSize blocksize,
+                                     const struct hdfsOpenOptions *opts);
+
 
     /** 
      * hdfsCloseFile - Close an open file. 
@@ -361,6 +635,136 @@ extern  "C" {
     tSize hdfsPread(hdfsFS fs, hdfsFile file, tOffset position,
                     void* buffer, tSize length);
 
+    /**
+     * One range of a vectored read.
+     */
+    struct hdfsReadRange {
+        tOffset offset; /// position in the file to read from
+        tSize length;   /// number of bytes to read
+        void *buffer;   /// where to put them; at least length bytes
+    };
+
+    /**
+     * hdfsPreadv - Positional read of several ranges of an open file.
+     *
+     * Ranges that are close together are fetched with a single read and
+     * split into the caller's buffers afterwards, so many small reads of
+     * one file cost far fewer round trips than the same hdfsPread calls.
+     * Ranges may be given in any order and may overlap.  The file offset
+     * is not changed.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param ranges The ranges to read.
+     * @param numRanges The number of ranges.
+     * @return      0 once every range has been filled completely.
+     *              On error, -1.  Errno will be set to the error code,
+     *              and is EIO if a range extends past the end of the file.
+     *              The contents of the buffers are then undefined.
+     */
+    int hdfsPreadv(hdfsFS fs, hdfsFile file,
+                   const struct hdfsReadRange *ranges, int numRanges);
+
+    /**
+     * A native buffer filled by hdfsReadZeroCopy.  It is one of the
+     * page-aligned, NUMA-local buffers described at hdfsBufferPool.
+     */
+    struct hdfsZeroCopyBuffer;
+
+    /**
+     * hdfsReadZeroCopy - Read data from an open file into a pooled buffer.
+     *
+     * The data is read straight into native memory owned by libhdfs, so
+     * unlike hdfsRead there is no Java array to copy out of, and the
+     * ByteBuffer wrapping the memory is reused rather than created on
+     * every call.  The buffer stays valid until it is passed to
+     * hdfsReleaseZeroCopy.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param maxLength The most bytes to read.  Reads larger than
+     *              HDFS_ZERO_COPY_BUFFER_SIZE are shortened.
+     * @param data (out) Set to the first byte read.
+     * @param buffer (out) Set to the buffer holding the data, to be
+     *              released with hdfsReleaseZeroCopy.  Set to NULL
+     *              unless bytes were read.
+     * @return      See hdfsRead
+     */
+    tSize hdfsReadZeroCopy(hdfsFS fs, hdfsFile file, tSize maxLength,
+                           const void **data,
+                           struct hdfsZeroCopyBuffer **buffer);
+
+    /**
+     * hdfsReleaseZeroCopy - Return a buffer from hdfsReadZeroCopy to the
+     * pool.  The data it held must not be used afterwards.
+     *
+     * @param buffer The buffer to release, or NULL.
+     */
+    void hdfsReleaseZeroCopy(struct hdfsZeroCopyBuffer *buffer);
+
+    /**
+     * A pool of native buffers for direct reads.  Buffers are
+     * page-aligned, and their memory is placed on the NUMA node of the
+     * thread that first takes them from the pool.  Released buffers are
+     * kept by the releasing thread for its next hdfsBufferPoolGet, if
+     * they are on its node, or else by the pool for another thread on
+     * theirs.  hdfsReadZeroCopy uses a pool of its own.
+     */
+    struct hdfsBufferPool;
+
+    /**
+     * hdfsBufferPoolCreate - Create a buffer pool.
+     *
+     * @param bufferSize The size of the buffers, which is rounded up to
+     *              a whole number of pages.
+     * @param maxCached The most released buffers kept for reuse by each
+     *              thread, and kept by the pool for each node.  Further
+     *              buffers are freed on release.
+     * @return      The pool, or NULL on error with errno set.
+     */
+    struct hdfsBufferPool *hdfsBufferPoolCreate(tSize bufferSize,
+                                                int maxCached);
+
+    /**
+     * hdfsBufferPoolDestroy - Free a pool and the buffers it keeps.  Every
+     * buffer must have been released, and no thread may still be using
+     * the pool.
+     *
+     * @param pool The pool, or NULL.
+     */
+    void hdfsBufferPoolDestroy(struct hdfsBufferPool *pool);
+
+    /**
+     * hdfsBufferPoolGet - Take a buffer from a pool.
+     *
+     * @param pool The pool.
+     * @return      The buffer, or NULL on error with errno set.
+     */
+    void *hdfsBufferPoolGet(struct hdfsBufferPool *pool);
+
+    /**
+     * hdfsBufferPoolRelease - Give a buffer back to the pool it came from.
+     *
+     * @param pool The pool.
+     * @param buffer The buffer, or NULL.
+     */
+    void hdfsBufferPoolRelease(struct hdfsBufferPool *pool, void *buffer);
+
+    /**
+     * hdfsReadPoolBuffer - Read data from an open file into a buffer from
+     * hdfsBufferPoolGet.  As with hdfsReadZeroCopy, the data goes straight
+     * into the buffer, through a ByteBuffer kept with it.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param buffer The buffer.
+     * @param length The most bytes to read.  Reads larger than the
+     *              pool's buffer size are shortened.
+     * @return      See hdfsRead
+     */
+    tSize hdfsReadPoolBuffer(hdfsFS fs, hdfsFile file, void *buffer,
+                             tSize length);
+
 
     /** 
      * hdfsWrite - Write data into an open file.
@@ -393,6 +797,70 @@ extern  "C" {
     int hdfsHFlush(hdfsFS fs, hdfsFile file);
 
 
+    /**
+     * hdfsHSync - Like hdfsHFlush, but also have the datanodes sync the
+     * data to disk.
+     * @param fs configured filesystem handle
+     * @param file file handle
+     * @return 0 on success, -1 on error and sets errno
+     */
+    int hdfsHSync(hdfsFS fs, hdfsFile file);
+
+
+    /**
+     * hdfsFileEnableGroupCommit - Coalesce the flushes of a file opened for
+     * write.
+     *
+     * A background thread then does the file's hflushes and hsyncs.  Each
+     * one covers every write made before it started, so callers waiting
+     * on many small writes share a few round trips to the datanodes
+     * instead of making one each.  hdfsHFlush and hdfsHSync on the file
+     * wait for such a flush of everything written so far, and
+     * hdfsGroupCommitWrite and hdfsGroupCommitWait let a writer wait for
+     * a particular write only.
+     *
+     * Once a flush fails, every later wait on the file fails with the same
+     * error.  The thread stops when the file is closed.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param maxDelayUs How long a flush waits for more writers to join it,
+     *              in microseconds.  0 flushes as soon as anyone waits.
+     * @return 0 on success, -1 on error and sets errno.  EBUSY means group
+     *              commit was already enabled.
+     */
+    int hdfsFileEnableGroupCommit(hdfsFS fs, hdfsFile file, int maxDelayUs);
+
+    /**
+     * hdfsGroupCommitWrite - Write data to a file with group commit
+     * enabled, and get a sequence number for it.  Writes from several
+     * threads are done one at a time.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param buffer The data.
+     * @param length The no. of bytes to write.
+     * @return The sequence number to pass to hdfsGroupCommitWait, which is
+     *              the number of bytes written through the handle since
+     *              group commit was enabled, this write included; -1 on
+     *              error and sets errno.
+     */
+    int64_t hdfsGroupCommitWrite(hdfsFS fs, hdfsFile file,
+                                 const void *buffer, tSize length);
+
+    /**
+     * hdfsGroupCommitWait - Wait until a write to a file with group commit
+     * enabled has been flushed.
+     *
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param seq The sequence number of the write.
+     * @param sync Nonzero to wait for an hsync rather than an hflush.
+     * @return 0 on success, -1 on error and sets errno.
+     */
+    int hdfsGroupCommitWait(hdfsFS fs, hdfsFile file, int64_t seq, int sync);
+
+
     /**
      * hdfsAvailable - Number of bytes that can be read from this
      * input stream without blocking.
@@ -404,7 +872,9 @@ extern  "C" {
 
 
     /**
-     * hdfsCopy - Copy file from one filesystem to another.
+     * hdfsCopy - Copy file from one filesystem to another.  When both
+     * are the same HDFS cluster, a file is copied by several streams at
+     * once (see dfs.client.copy.streams) instead of one.
      * @param srcFS The handle to source filesystem.
      * @param src The path of source file. 
      * @param dstFS The handle to destination filesystem.
@@ -415,7 +885,8 @@ extern  "C" {
 
 
     /**
-     * hdfsMove - Move file from one filesystem to another.
+     * hdfsMove - Move file from one filesystem to another.  When both
+     * are the same HDFS cluster, this is a rename.
      * @param srcFS The handle to source filesystem.
      * @param src The path of source file. 
      * @param dstFS The handle to destination filesystem.
@@ -425,6 +896,67 @@ extern  "C" {
     int hdfsMove(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst);
 
 
+    /**
+     * A file written through several streams at once.  Part i holds the
+     * bytes from i * partSize up to (i + 1) * partSize; the parts are
+     * concatenated into one file when the writer is closed.
+     */
+    struct hdfsParallelWriter;
+
+    /**
+     * hdfsParallelWriterOpen - Create a file to be written in parts.
+     *
+     * Each part is its own hdfsFile, so the parts can be written from
+     * different threads, or queued with hdfsAsyncWrite.  More than one
+     * part needs HDFS, which can concatenate them.
+     *
+     * @param fs The configured filesystem handle.
+     * @param path The full path to the file.
+     * @param numParts The number of parts.
+     * @param partSize The size of every part but the last.  It must be a
+     *              multiple of the block size.
+     * @param replication Block replication - pass 0 if you want to use
+     *              the default configured values.
+     * @param blockSize Size of block - pass 0 if you want to use the
+     *              default configured values.
+     * @return      The writer, or NULL on error with errno set.  errno is
+     *              ENOTSUP if more than one part was asked of a filesystem
+     *              other than HDFS.
+     */
+    struct hdfsParallelWriter *hdfsParallelWriterOpen(hdfsFS fs,
+            const char *path, int numParts, tOffset partSize,
+            short replication, tSize blockSize);
+
+    /**
+     * hdfsParallelWriterPart - Get the file handle of one part.  The
+     * handle belongs to the writer; do not close it.
+     *
+     * @param w The writer.
+     * @param part The part, from 0 to numParts - 1.
+     * @return      The handle, or NULL with errno set to EINVAL.
+     */
+    hdfsFile hdfsParallelWriterPart(struct hdfsParallelWriter *w, int part);
+
+    /**
+     * hdfsParallelWriterClose - Close every part and join them into the
+     * file.  Every part before the last non-empty one must hold exactly
+     * partSize bytes.  On error the file and its parts are deleted.  The
+     * writer is freed either way.
+     *
+     * @param w The writer.
+     * @return      0 on success, -1 on error with errno set.
+     */
+    int hdfsParallelWriterClose(struct hdfsParallelWriter *w);
+
+    /**
+     * hdfsParallelWriterAbort - Close and delete the file and its parts,
+     * and free the writer.
+     *
+     * @param w The writer.
+     */
+    void hdfsParallelWriterAbort(struct hdfsParallelWriter *w);
+
+
     /**
      * hdfsDelete - Delete file. 
      * @param fs The configured filesystem handle.
@@ -517,6 +1049,86 @@ extern  "C" {
                                     int *numEntries);
 
 
+    /**
+     * hdfsOpenDir - Start listing a directory a batch at a time, without
+     * holding the whole listing in memory.  hdfsCloseDir should be called
+     * when done.
+     * @param fs The configured filesystem handle.
+     * @param path The path of the directory.
+     * @return Returns a handle for hdfsReadDirBatch; NULL on error.
+     */
+    hdfsDir hdfsOpenDir(hdfsFS fs, const char* path);
+
+
+    /**
+     * hdfsReadDirBatch - Get the next entries of a directory opened by
+     * hdfsOpenDir.
+     * @param dir The directory handle.
+     * @param maxEntries The most entries to return.
+     * @param entries (out param) Set to a dynamically-allocated array of
+     * hdfsFileInfo objects, to be freed with hdfsFreeFileInfo, or to NULL
+     * if there are no more entries.
+     * @return Returns the number of entries in the array, 0 at the end of
+     * the directory, or -1 on error.
+     */
+    int hdfsReadDirBatch(hdfsDir dir, int maxEntries,
+                         hdfsFileInfo **entries);
+
+
+    /**
+     * hdfsCloseDir - Release a directory handle.
+     * @param dir The directory handle.
+     */
+    void hdfsCloseDir(hdfsDir dir);
+
+    /**
+     * What an hdfsWalkCallback returns: go on with the walk, leave out the
+     * children of the directory just passed, or end the walk.
+     */
+#define HDFS_WALK_CONTINUE 0
+#define HDFS_WALK_SKIP 1
+#define HDFS_WALK_STOP 2
+
+    /**
+     * Called by hdfsWalk for each file and directory it finds.  The info
+     * is freed when the callback returns; its mName is the full path.
+     * Calls come from any of the walk's threads, several at once when the
+     * parallelism is above 1.
+     *
+     * @param info The entry.
+     * @param depth 0 for the root, 1 for its children, and so on.
+     * @param arg As passed to hdfsWalk.
+     * @return One of HDFS_WALK_CONTINUE, HDFS_WALK_SKIP or HDFS_WALK_STOP.
+     */
+    typedef int (*hdfsWalkCallback)(const hdfsFileInfo *info, int depth,
+                                    void *arg);
+
+    /**
+     * hdfsWalk - Pass every file and directory under a path to a callback,
+     * listing directories on several threads at once.
+     *
+     * The calling thread and parallelism - 1 more JVM-attached threads
+     * each list directories from a queue of their own, newest first, and
+     * take the oldest directories from the others' queues once theirs is
+     * empty.  Entries are passed on a batch at a time as the listings come
+     * in, parents before their children, but in no other order.  A
+     * directory that is deleted before it is listed is left out.
+     *
+     * @param fs The configured filesystem handle.
+     * @param root The path to start at, which is passed to the callback
+     * first.
+     * @param parallelism The most directories to list at once.
+     * @param maxDepth The depth of the deepest entries to pass on, or -1
+     * for no limit; 1 passes the root and its children.
+     * @param callback Called for each entry.
+     * @param arg Passed to callback.
+     * @return Returns 0 once the walk is done or the callback stops it; -1
+     * on error, with errno set.
+     */
+    int hdfsWalk(hdfsFS fs, const char *root, int parallelism, int maxDepth,
+                 hdfsWalkCallback callback, void *arg);
+
+
     /** 
      * hdfsGetPathInfo - Get information about a path as a (dynamically
      * allocated) single hdfsFileInfo struct. hdfsFreeFileInfo should be
@@ -529,6 +1141,21 @@ extern  "C" {
     hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path);
 
 
+    /**
+     * hdfsGetPathInfoBatch - Get information about several paths with a
+     * single call into the filesystem. hdfsFreeFileInfo(info, numPaths)
+     * should be called when the array is no longer needed.
+     * @param fs The configured filesystem handle.
+     * @param paths The paths to look up.
+     * @param numPaths The number of paths.
+     * @return Returns a dynamically-allocated array of numPaths
+     * hdfsFileInfo objects, in the order of paths.  The entry for a path
+     * that does not exist is zeroed, with a NULL mName.  NULL on error.
+     */
+    hdfsFileInfo *hdfsGetPathInfoBatch(hdfsFS fs, const char **paths,
+                                       int numPaths);
+
+
     /** 
      * hdfsFreeFileInfo - Free up the hdfsFileInfo array (including fields) 
      * @param hdfsFileInfo The array of dynamically-allocated hdfsFileInfo
@@ -563,6 +1190,48 @@ extern  "C" {
     void hdfsFreeHosts(char ***blockHosts);
 
 
+    /**
+     * hdfsBlockLocation - Where one block of a file is stored.
+     */
+    struct hdfsBlockLocation {
+        tOffset offset;        /* the offset of the block in the file */
+        tOffset length;        /* the length of the block in bytes */
+        int corrupt;           /* nonzero if all the replicas are corrupt */
+        int numHosts;          /* the number of entries in hosts */
+        char **hosts;          /* the datanode hostnames */
+        char **names;          /* the datanode IP:xferPort names */
+        char **topologyPaths;  /* the datanode network topology paths */
+    };
+
+
+    /**
+     * hdfsGetBlockLocations - Get the blocks covering part of a file, with
+     * their offsets, lengths and the datanodes storing them.  hosts, names
+     * and topologyPaths are NULL-terminated; topologyPaths may be empty if
+     * the filesystem does not know the topology.
+     * @param fs The configured filesystem handle.
+     * @param path The path of the file.
+     * @param start The start of the range.
+     * @param length The length of the range.
+     * @param numBlocks Set to the number of blocks.
+     * @return Returns a dynamically-allocated array of numBlocks
+     * hdfsBlockLocation objects, to be freed with hdfsFreeBlockLocations;
+     * NULL on error.
+     */
+    struct hdfsBlockLocation *hdfsGetBlockLocations(hdfsFS fs,
+            const char *path, tOffset start, tOffset length, int *numBlocks);
+
+
+    /**
+     * hdfsFreeBlockLocations - Free up the array returned by
+     * hdfsGetBlockLocations.
+     * @param blocks The array.
+     * @param numBlocks The size of the array.
+     */
+    void hdfsFreeBlockLocations(struct hdfsBlockLocation *blocks,
+                                int numBlocks);
+
+
     /** 
      * hdfsGetDefaultBlockSize - Get the default blocksize.
      *
@@ -632,6 +1301,107 @@ extern  "C" {
      * @return 0 on success else -1
      */
     int hdfsUtime(hdfsFS fs, const char* path, tTime mtime, tTime atime);
+
+    /**
+     * A pool of JVM-attached worker threads that services asynchronous
+     * reads and writes.  Any number of requests can share a few threads.
+     */
+    struct hdfsAsyncPool;
+
+    /**
+     * The outcome of an asynchronous request.
+     */
+    struct hdfsAsyncCompletion {
+        void *tag;      /// the tag the request was submitted with
+        tSize result;   /// what hdfsPread or hdfsWrite returned
+        int error;      /// errno when result is -1; 0 otherwise
+    };
+
+    /**
+     * Called on a worker thread when a request completes.  It must not
+     * block for long, since it holds up the worker.
+     */
+    typedef void (*hdfsAsyncCallback)(
+        const struct hdfsAsyncCompletion *completion, void *arg);
+
+    /**
+     * hdfsAsyncPoolCreate - Start a pool of worker threads.
+     *
+     * @param numThreads The number of worker threads.
+     * @param maxPending The most requests that may be queued and not yet
+     *              started; submissions beyond this fail with EAGAIN.
+     * @param callback Called for each completion, or NULL to queue
+     *              completions for hdfsAsyncPoolReap instead.
+     * @param callbackArg Passed to callback.
+     * @return      The pool, or NULL on error with errno set.
+     */
+    struct hdfsAsyncPool *hdfsAsyncPoolCreate(int numThreads, int maxPending,
+            hdfsAsyncCallback callback, void *callbackArg);
+
+    /**
+     * hdfsAsyncPoolDestroy - Finish every submitted request and stop the
+     * worker threads.  Completions not yet reaped are discarded.
+     *
+     * @param pool The pool.
+     */
+    void hdfsAsyncPoolDestroy(struct hdfsAsyncPool *pool);
+
+    /**
+     * hdfsAsyncPread - Queue a positional read; see hdfsPread.
+     *
+     * The buffer must stay valid until the request completes.
+     *
+     * @param pool The pool to run the read on.
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param position Position from which to read
+     * @param buffer The buffer to copy read bytes into.
+     * @param length The length of the buffer.
+     * @param tag Returned with the completion.
+     * @return      0 if the request was queued, else -1 with errno set.
+     */
+    int hdfsAsyncPread(struct hdfsAsyncPool *pool, hdfsFS fs, hdfsFile file,
+                       tOffset position, void *buffer, tSize length,
+                       void *tag);
+
+    /**
+     * hdfsAsyncWrite - Queue a write; see hdfsWrite.
+     *
+     * Writes to the same file run one at a time, in the order they were
+     * submitted.  The buffer must stay valid until the request completes.
+     *
+     * @param pool The pool to run the write on.
+     * @param fs The configured filesystem handle.
+     * @param file The file handle.
+     * @param buffer The data.
+     * @param length The no. of bytes to write.
+     * @param tag Returned with the completion.
+     * @return      0 if the request was queued, else -1 with errno set.
+     */
+    int hdfsAsyncWrite(struct hdfsAsyncPool *pool, hdfsFS fs, hdfsFile file,
+                       const void *buffer, tSize length, void *tag);
+
+    /**
+     * hdfsAsyncPoolGetFd - Get a descriptor that polls readable while
+     * completions are waiting to be reaped.  Only meaningful for pools
+     * created without a callback.  The pool owns the descriptor.
+     *
+     * @param pool The pool.
+     * @return      The descriptor.
+     */
+    int hdfsAsyncPoolGetFd(struct hdfsAsyncPool *pool);
+
+    /**
+     * hdfsAsyncPoolReap - Take completions off the queue without blocking.
+     *
+     * @param pool The pool.
+     * @param completions Filled in with up to maxCompletions completions.
+     * @param maxCompletions The size of completions.
+     * @return      The number of completions stored, which may be 0.
+     */
+    int hdfsAsyncPoolReap(struct hdfsAsyncPool *pool,
+                          struct hdfsAsyncCompletion *completions,
+                          int maxCompletions);
     
 #ifdef __cplusplus
 }
@@ -0,0 +1,408 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdfs.h"
+#include "jni_helper.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum asyncOp {
+    ASYNC_PREAD,
+    ASYNC_WRITE,
+};
+
+struct asyncRequest {
+    struct asyncRequest *next;
+    enum asyncOp op;
+    hdfsFS fs;
+    hdfsFile file;
+    tOffset position;
+    void *buffer;
+    tSize length;
+    struct hdfsAsyncCompletion completion;
+};
+
+struct hdfsAsyncPool {
+    pthread_mutex_t lock;
+    /** Signalled when a request may have become runnable, or on shutdown */
+    pthread_cond_t cond;
+    /** Requests not yet started, in submission order */
+    struct asyncRequest *pendingHead, *pendingTail;
+    int numPending, maxPending;
+    /** Completions waiting for hdfsAsyncPoolReap */
+    struct asyncRequest *doneHead, *doneTail;
+    /** The file each worker is writing, or NULL */
+    hdfsFile *writing;
+    pthread_t *threads;
+    int numThreads;
+    int shutdown;
+    hdfsAsyncCallback callback;
+    void *callbackArg;
+    /** Holds one byte while completions are queued */
+    int pipeFds[2];
+};
+
+struct asyncWorker {
+    struct hdfsAsyncPool *pool;
+    int idx;
+};
+
+/**
+ * Unlink and return the first pending request that can run now.  A write
+ * cannot run while another worker is writing the same file, which keeps the
+ * writes of each file in order.  Called with the pool lock held.
+ */
+static struct asyncRequest *takeRequest(struct hdfsAsyncPool *pool)
+{
+    struct asyncRequest *req, *prev = NULL;
+    int i;
+
+    for (req = pool->pendingHead; req; prev = req, req = req->next) {
+        if (req->op == ASYNC_WRITE) {
+            for (i = 0; i < pool->numThreads; i++) {
+                if (pool->writing[i] == req->file) {
+                    break;
+                }
+            }
+            if (i < pool->numThreads) {
+                continue;
+            }
+        }
+        if (prev) {
+            prev->next = req->next;
+        } else {
+            pool->pendingHead = req->next;
+        }
+        if (pool->pendingTail == req) {
+            pool->pendingTail = prev;
+        }
+        req->next = NULL;
+        pool->numPending--;
+        return req;
+    }
+    return NULL;
+}
+
+static void runRequest(struct asyncRequest *req)
+{
+    tSize ret;
+
+    if (req->op == ASYNC_PREAD) {
+        ret = hdfsPread(req->fs, req->file, req->position, req->buffer,
+                        req->length);
+    } else {
+        ret = hdfsWrite(req->fs, req->file, req->buffer, req->length);
+    }
+    req->completion.result = ret;
+    req->completion.error = (ret < 0) ? errno : 0;
+}
+
+/**
+ * Hand a finished request to the callback or the completion queue.
+ */
+static void completeRequest(struct hdfsAsyncPool *pool,
+                            struct asyncRequest *req)
+{
+    char c = 0;
+
+    if (pool->callback) {
+        pool->callback(&req->completion, pool->callbackArg);
+        free(req);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->doneTail) {
+        pool->doneTail->next = req;
+    } else {
+        pool->doneHead = req;
+        // The queue was empty, so the pipe was too
+        if (write(pool->pipeFds[1], &c, 1) < 0) {
+            fprintf(stderr, "hdfsAsyncPool: failed to signal completion: "
+                    "error %d\n", errno);
+        }
+    }
+    pool->doneTail = req;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *asyncWorkerMain(void *arg)
+{
+    struct asyncWorker *worker = arg;
+    struct hdfsAsyncPool *pool = worker->pool;
+    int idx = worker->idx;
+    struct asyncRequest *req;
+
+    free(worker);
+    // Attach to the JVM now rather than on the first request
+    if (!getJNIEnv()) {
+        fprintf(stderr, "hdfsAsyncPool: worker %d could not get a "
+                "JNIEnv\n", idx);
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        req = takeRequest(pool);
+        if (!req) {
+            if (pool->shutdown && !pool->pendingHead) {
+                break;
+            }
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        if (req->op == ASYNC_WRITE) {
+            pool->writing[idx] = req->file;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        runRequest(req);
+        pthread_mutex_lock(&pool->lock);
+        if (req->op == ASYNC_WRITE) {
+            // A later write to this file may be waiting for us
+            pool->writing[idx] = NULL;
+            pthread_cond_broadcast(&pool->cond);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        completeRequest(pool, req);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static int setPipeFlags(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return errno;
+    }
+    flags = fcntl(fd, F_GETFD);
+    if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+struct hdfsAsyncPool *hdfsAsyncPoolCreate(int numThreads, int maxPending,
+        hdfsAsyncCallback callback, void *callbackArg)
+{
+    struct hdfsAsyncPool *pool;
+    struct asyncWorker *worker;
+    int i, ret;
+
+    if (numThreads <= 0 || maxPending <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pool = calloc(1, sizeof(struct hdfsAsyncPool));
+    if (!pool) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->pipeFds[0] = pool->pipeFds[1] = -1;
+    pool->maxPending = maxPending;
+    pool->callback = callback;
+    pool->callbackArg = callbackArg;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->writing = calloc(numThreads, sizeof(hdfsFile));
+    pool->threads = calloc(numThreads, sizeof(pthread_t));
+    if (!pool->writing || !pool->threads) {
+        ret = ENOMEM;
+        goto error;
+    }
+    if (pipe(pool->pipeFds) < 0) {
+        ret = errno;
+        pool->pipeFds[0] = pool->pipeFds[1] = -1;
+        goto error;
+    }
+    ret = setPipeFlags(pool->pipeFds[0]);
+    if (!ret) {
+        ret = setPipeFlags(pool->pipeFds[1]);
+    }
+    if (ret) {
+        goto error;
+    }
+    for (i = 0; i < numThreads; i++) {
+        worker = malloc(sizeof(struct asyncWorker));
+        if (!worker) {
+            ret = ENOMEM;
+            goto error;
+        }
+        worker->pool = pool;
+        worker->idx = i;
+        ret = pthread_create(&pool->threads[i], NULL, asyncWorkerMain, worker);
+        if (ret) {
+            free(worker);
+            goto error;
+        }
+        pool->numThreads++;
+    }
+    return pool;
+
+error:
+    hdfsAsyncPoolDestroy(pool);
+    errno = ret;
+    return NULL;
+}
+
+void hdfsAsyncPoolDestroy(struct hdfsAsyncPool *pool)
+{
+    struct asyncRequest *req;
+    int i;
+
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->numThreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    while ((req = pool->doneHead)) {
+        pool->doneHead = req->next;
+        free(req);
+    }
+    if (pool->pipeFds[0] >= 0) {
+        close(pool->pipeFds[0]);
+        close(pool->pipeFds[1]);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->writing);
+    free(pool->threads);
+    free(pool);
+}
+
+static int submitRequest(struct hdfsAsyncPool *pool, struct asyncRequest *req)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->lock);
+        free(req);
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    if (pool->numPending >= pool->maxPending) {
+        pthread_mutex_unlock(&pool->lock);
+        free(req);
+        errno = EAGAIN;
+        return -1;
+    }
+    if (pool->pendingTail) {
+        pool->pendingTail->next = req;
+    } else {
+        pool->pendingHead = req;
+    }
+    pool->pendingTail = req;
+    pool->numPending++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static struct asyncRequest *newRequest(enum asyncOp op, hdfsFS fs,
+        hdfsFile file, tOffset position, void *buffer, tSize length,
+        void *tag)
+{
+    struct asyncRequest *req;
+
+    req = calloc(1, sizeof(struct asyncRequest));
+    if (!req) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    req->op = op;
+    req->fs = fs;
+    req->file = file;
+    req->position = position;
+    req->buffer = buffer;
+    req->length = length;
+    req->completion.tag = tag;
+    return req;
+}
+
+int hdfsAsyncPread(struct hdfsAsyncPool *pool, hdfsFS fs, hdfsFile file,
+                   tOffset position, void *buffer, tSize length, void *tag)
+{
+    struct asyncRequest *req;
+
+    if (!file || !hdfsFileIsOpenForRead(file)) {
+        errno = EBADF;
+        return -1;
+    }
+    req = newRequest(ASYNC_PREAD, fs, file, position, buffer, length, tag);
+    if (!req) {
+        return -1;
+    }
+    return submitRequest(pool, req);
+}
+
+int hdfsAsyncWrite(struct hdfsAsyncPool *pool, hdfsFS fs, hdfsFile file,
+                   const void *buffer, tSize length, void *tag)
+{
+    struct asyncRequest *req;
+
+    if (!file || !hdfsFileIsOpenForWrite(file)) {
+        errno = EBADF;
+        return -1;
+    }
+    req = newRequest(ASYNC_WRITE, fs, file, 0, (void*)buffer, length, tag);
+    if (!req) {
+        return -1;
+    }
+    return submitRequest(pool, req);
+}
+
+int hdfsAsyncPoolGetFd(struct hdfsAsyncPool *pool)
+{
+    return pool->pipeFds[0];
+}
+
+int hdfsAsyncPoolReap(struct hdfsAsyncPool *pool,
+                      struct hdfsAsyncCompletion *completions,
+                      int maxCompletions)
+{
+    struct asyncRequest *req;
+    int n = 0;
+    char c;
+
+    pthread_mutex_lock(&pool->lock);
+    while (n < maxCompletions && (req = pool->doneHead)) {
+        pool->doneHead = req->next;
+        if (!pool->doneHead) {
+            pool->doneTail = NULL;
+            // Empty again, so take the byte back out of the pipe
+            if (read(pool->pipeFds[0], &c, 1) < 0) {
+                fprintf(stderr, "hdfsAsyncPoolReap: failed to clear "
+                        "completion signal: error %d\n", errno);
+            }
+        }
+        completions[n++] = req->completion;
+        free(req);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
@@ -0,0 +1,409 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exception.h"
+#include "hdfs.h"
+#include "hdfs_buffer_pool.h"
+#include "jni_helper.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/** The most NUMA nodes told apart; buffers of higher nodes count as 0's */
+#define POOL_MAX_NODES 64
+
+/**
+ * Each buffer is one mapping: a page holding this header, then the data,
+ * which is therefore page-aligned.
+ */
+struct poolBuffer {
+    struct poolBuffer *next;
+    struct hdfsBufferPool *pool;
+    /** The NUMA node the data was placed on */
+    int node;
+    /** Created by bufferPoolByteBuffer */
+    jobject byteBuffer;
+};
+
+/**
+ * The released buffers a thread keeps for itself.  They are all on the
+ * node the thread was on when it last took or released one.
+ */
+struct threadCache {
+    struct threadCache *next;
+    struct hdfsBufferPool *pool;
+    struct poolBuffer *head;
+    int count;
+    int node;
+};
+
+struct hdfsBufferPool {
+    size_t pageSize;
+    size_t dataSize;
+    int maxCached;
+    int numNodes;
+    /** Each thread's struct threadCache */
+    pthread_key_t key;
+    /** Guards everything below */
+    pthread_mutex_t lock;
+    /** Buffers released on other nodes, or left by exited threads */
+    struct poolBuffer *nodeFree[POOL_MAX_NODES];
+    int nodeFreeCount[POOL_MAX_NODES];
+    /** Every threadCache, so that the pool can be destroyed */
+    struct threadCache *caches;
+};
+
+/** The page size, set when the first pool is created */
+static size_t gPageSize = 0;
+
+static int numaNumNodes(void)
+{
+    FILE *fp;
+    int first, last = 0;
+
+    // The file holds a range like "0-1", or "0" on a single node
+    fp = fopen("/sys/devices/system/node/possible", "r");
+    if (!fp) {
+        return 1;
+    }
+    if (fscanf(fp, "%d-%d", &first, &last) != 2 || last < 0) {
+        last = 0;
+    }
+    fclose(fp);
+    return (last < POOL_MAX_NODES) ? last + 1 : POOL_MAX_NODES;
+}
+
+/**
+ * @return              The NUMA node of the CPU the caller is running on.
+ */
+static int currentNode(const struct hdfsBufferPool *pool)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+
+    if (pool->numNodes > 1 && syscall(SYS_getcpu, &cpu, &node, NULL) == 0 &&
+            node < (unsigned)pool->numNodes) {
+        return node;
+    }
+#endif
+    return 0;
+}
+
+static struct poolBuffer *bufferHeader(void *data)
+{
+    return (struct poolBuffer*)((char*)data - gPageSize);
+}
+
+static void *bufferData(struct poolBuffer *buf)
+{
+    return (char*)buf + buf->pool->pageSize;
+}
+
+static struct poolBuffer *bufferAlloc(struct hdfsBufferPool *pool, int node)
+{
+    struct poolBuffer *buf;
+    char *data;
+    size_t off;
+
+    buf = mmap(NULL, pool->pageSize + pool->dataSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    data = (char*)buf + pool->pageSize;
+#if defined(__linux__) && defined(SYS_mbind)
+    if (pool->numNodes > 1) {
+        unsigned long mask[POOL_MAX_NODES / (8 * sizeof(unsigned long))];
+
+        // MPOL_PREFERRED: this node while it has free memory.  Kernels
+        // without NUMA support fail this, which leaves first-touch.
+        memset(mask, 0, sizeof(mask));
+        mask[node / (8 * sizeof(unsigned long))] |=
+            1UL << (node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, data, pool->dataSize, 1, mask,
+                (unsigned long)POOL_MAX_NODES + 1, 0);
+    }
+#endif
+    // Fault the pages in now, on this thread, rather than wherever the
+    // first read into them happens to run
+    for (off = 0; off < pool->dataSize; off += pool->pageSize) {
+        data[off] = 0;
+    }
+    buf->next = NULL;
+    buf->pool = pool;
+    buf->node = node;
+    buf->byteBuffer = NULL;
+    return buf;
+}
+
+static void bufferFree(JNIEnv *env, struct poolBuffer *buf)
+{
+    if (buf->byteBuffer) {
+        if (!env) {
+            // The ByteBuffer can't be dropped without a JNIEnv, and its
+            // memory can't be unmapped while it might still be used
+            return;
+        }
+        (*env)->DeleteGlobalRef(env, buf->byteBuffer);
+    }
+    munmap(buf, buf->pool->pageSize + buf->pool->dataSize);
+}
+
+/**
+ * Move the buffers of a cache to the shared lists.  Called with the pool
+ * lock held.
+ */
+static void cacheFlush(struct hdfsBufferPool *pool, struct threadCache *cache)
+{
+    struct poolBuffer *buf;
+
+    while ((buf = cache->head)) {
+        cache->head = buf->next;
+        buf->next = pool->nodeFree[buf->node];
+        pool->nodeFree[buf->node] = buf;
+        pool->nodeFreeCount[buf->node]++;
+    }
+    cache->count = 0;
+}
+
+/**
+ * The destructor of the thread caches.  Their buffers are left to the
+ * other threads rather than freed, since an exiting thread may no longer
+ * have a JNIEnv.
+ */
+static void cacheDestroy(void *arg)
+{
+    struct threadCache *cache = arg;
+    struct hdfsBufferPool *pool = cache->pool;
+    struct threadCache **prev;
+
+    pthread_mutex_lock(&pool->lock);
+    cacheFlush(pool, cache);
+    for (prev = &pool->caches; *prev; prev = &(*prev)->next) {
+        if (*prev == cache) {
+            *prev = cache->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(cache);
+}
+
+/**
+ * Get the calling thread's cache, creating it if need be, and make sure
+ * it only holds buffers of the node the thread is on now.
+ *
+ * @return              The cache, or NULL if it could not be created.
+ */
+static struct threadCache *getCache(struct hdfsBufferPool *pool, int node)
+{
+    struct threadCache *cache;
+
+    cache = pthread_getspecific(pool->key);
+    if (!cache) {
+        cache = calloc(1, sizeof(*cache));
+        if (!cache) {
+            return NULL;
+        }
+        cache->pool = pool;
+        cache->node = node;
+        if (pthread_setspecific(pool->key, cache)) {
+            free(cache);
+            return NULL;
+        }
+        pthread_mutex_lock(&pool->lock);
+        cache->next = pool->caches;
+        pool->caches = cache;
+        pthread_mutex_unlock(&pool->lock);
+    } else if (cache->node != node) {
+        // The thread has moved to another node
+        pthread_mutex_lock(&pool->lock);
+        cacheFlush(pool, cache);
+        pthread_mutex_unlock(&pool->lock);
+        cache->node = node;
+    }
+    return cache;
+}
+
+struct hdfsBufferPool *hdfsBufferPoolCreate(tSize bufferSize, int maxCached)
+{
+    struct hdfsBufferPool *pool;
+    int ret;
+
+    if (!gPageSize) {
+        gPageSize = sysconf(_SC_PAGESIZE);
+    }
+    if (bufferSize <= 0 || bufferSize > INT32_MAX - (tSize)gPageSize ||
+            maxCached < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->pageSize = gPageSize;
+    pool->dataSize = (bufferSize + pool->pageSize - 1) & ~(pool->pageSize - 1);
+    pool->maxCached = maxCached;
+    pool->numNodes = numaNumNodes();
+    ret = pthread_key_create(&pool->key, cacheDestroy);
+    if (ret) {
+        free(pool);
+        errno = ret;
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void *hdfsBufferPoolGet(struct hdfsBufferPool *pool)
+{
+    struct threadCache *cache;
+    struct poolBuffer *buf = NULL;
+    int node;
+
+    node = currentNode(pool);
+    cache = getCache(pool, node);
+    if (cache && cache->head) {
+        buf = cache->head;
+        cache->head = buf->next;
+        cache->count--;
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        buf = pool->nodeFree[node];
+        if (buf) {
+            pool->nodeFree[node] = buf->next;
+            pool->nodeFreeCount[node]--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (!buf) {
+        buf = bufferAlloc(pool, node);
+        if (!buf) {
+            return NULL;
+        }
+    }
+    buf->next = NULL;
+    return bufferData(buf);
+}
+
+void hdfsBufferPoolRelease(struct hdfsBufferPool *pool, void *buffer)
+{
+    struct threadCache *cache;
+    struct poolBuffer *buf;
+
+    if (!buffer) {
+        return;
+    }
+    buf = bufferHeader(buffer);
+    cache = getCache(pool, currentNode(pool));
+    if (cache && cache->node == buf->node && cache->count < pool->maxCached) {
+        buf->next = cache->head;
+        cache->head = buf;
+        cache->count++;
+        return;
+    }
+    // Keep it for a thread on its own node, if there aren't plenty already
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nodeFreeCount[buf->node] < pool->maxCached) {
+        buf->next = pool->nodeFree[buf->node];
+        pool->nodeFree[buf->node] = buf;
+        pool->nodeFreeCount[buf->node]++;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (buf) {
+        bufferFree(buf->byteBuffer ? getJNIEnv() : NULL, buf);
+    }
+}
+
+void hdfsBufferPoolDestroy(struct hdfsBufferPool *pool)
+{
+    struct threadCache *cache;
+    struct poolBuffer *buf;
+    JNIEnv *env = NULL;
+    int node;
+
+    if (!pool) {
+        return;
+    }
+    pthread_key_delete(pool->key);
+    while ((cache = pool->caches)) {
+        pool->caches = cache->next;
+        cacheFlush(pool, cache);
+        free(cache);
+    }
+    for (node = 0; node < POOL_MAX_NODES; node++) {
+        while ((buf = pool->nodeFree[node])) {
+            pool->nodeFree[node] = buf->next;
+            if (buf->byteBuffer && !env) {
+                env = getJNIEnv();
+            }
+            bufferFree(env, buf);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+struct hdfsBufferPool *bufferPoolOf(void *buffer)
+{
+    return bufferHeader(buffer)->pool;
+}
+
+int32_t bufferPoolBufferSize(const struct hdfsBufferPool *pool)
+{
+    return pool->dataSize;
+}
+
+jobject bufferPoolByteBuffer(JNIEnv *env, void *buffer)
+{
+    struct poolBuffer *buf = bufferHeader(buffer);
+    jobject bb;
+
+    // A buffer is only used by one thread at a time
+    if (buf->byteBuffer) {
+        return buf->byteBuffer;
+    }
+    bb = (*env)->NewDirectByteBuffer(env, buffer, buf->pool->dataSize);
+    if (!bb) {
+        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "bufferPoolByteBuffer: NewDirectByteBuffer");
+        return NULL;
+    }
+    buf->byteBuffer = (*env)->NewGlobalRef(env, bb);
+    destroyLocalReference(env, bb);
+    if (!buf->byteBuffer) {
+        errno = printPendingExceptionAndFree(env, PRINT_EXC_ALL,
+            "bufferPoolByteBuffer: NewGlobalRef");
+        return NULL;
+    }
+    return buf->byteBuffer;
+}
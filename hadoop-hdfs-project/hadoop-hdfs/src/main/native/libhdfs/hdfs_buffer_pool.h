@@ -0,0 +1,52 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_HDFS_BUFFER_POOL_H
+#define LIBHDFS_HDFS_BUFFER_POOL_H
+
+/**
+ * What the rest of libhdfs needs to know about the buffers handed out by
+ * hdfsBufferPoolGet.
+ */
+
+#include <jni.h>
+
+struct hdfsBufferPool;
+
+/**
+ * @return              The pool a buffer came from.
+ */
+struct hdfsBufferPool *bufferPoolOf(void *buffer);
+
+/**
+ * @return              The usable size of the buffers of a pool.
+ */
+int32_t bufferPoolBufferSize(const struct hdfsBufferPool *pool);
+
+/**
+ * Get the direct ByteBuffer covering the whole of a buffer, creating it on
+ * first use.  It is kept with the buffer, so the JVM can read into the
+ * buffer again and again without a new ByteBuffer; the caller must set its
+ * position and limit before each use.
+ *
+ * @return              A global reference owned by the buffer, or NULL on
+ *                      error with errno set.
+ */
+jobject bufferPoolByteBuffer(JNIEnv *env, void *buffer);
+
+#endif
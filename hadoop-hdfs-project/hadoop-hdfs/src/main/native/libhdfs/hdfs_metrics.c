@@ -0,0 +1,189 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdfs.h"
+#include "hdfs_metrics.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Latencies are kept in log-linear buckets, as HdrHistogram does: values
+ * below METRICS_LINEAR get a bucket each, and every power of two above
+ * that is split into METRICS_SUB_BUCKETS, so a bucket is within 12.5% of
+ * any value in it.  Values of 2^METRICS_MAX_SHIFT ns (about 18 minutes) or
+ * more share the last bucket.
+ */
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_LINEAR (2 * METRICS_SUB_BUCKETS)
+#define METRICS_MAX_SHIFT 40
+#define METRICS_NUM_BUCKETS \
+    (METRICS_LINEAR + (METRICS_MAX_SHIFT - METRICS_SUB_BITS - 1) * \
+     METRICS_SUB_BUCKETS)
+
+struct metricsOp {
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t bytes;
+    uint64_t buckets[METRICS_NUM_BUCKETS];
+};
+
+volatile int gMetricsEnabled = 0;
+
+static struct metricsOp gOps[HDFS_METRICS_NUM_OPS];
+
+static const char * const gOpNames[HDFS_METRICS_NUM_OPS] = {
+    "connect",
+    "openFile",
+    "closeFile",
+    "read",
+    "pread",
+    "write",
+    "flush",
+    "hflush",
+    "hsync",
+    "getPathInfo",
+    "listDirectory",
+    "jniAttach",
+};
+
+void metricsEnable(void)
+{
+    gMetricsEnabled = 1;
+}
+
+uint64_t metricsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec + 1;
+}
+
+static int bucketOf(uint64_t ns)
+{
+    int msb;
+
+    if (ns < METRICS_LINEAR) {
+        return ns;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    if (msb >= METRICS_MAX_SHIFT) {
+        return METRICS_NUM_BUCKETS - 1;
+    }
+    return METRICS_LINEAR + (msb - METRICS_SUB_BITS - 1) * METRICS_SUB_BUCKETS +
+        ((ns >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1));
+}
+
+/** The smallest value that falls in a bucket */
+static uint64_t bucketFloor(int idx)
+{
+    int msb;
+
+    if (idx < METRICS_LINEAR) {
+        return idx;
+    }
+    idx -= METRICS_LINEAR;
+    msb = idx / METRICS_SUB_BUCKETS + METRICS_SUB_BITS + 1;
+    return (uint64_t)(METRICS_SUB_BUCKETS + idx % METRICS_SUB_BUCKETS) <<
+        (msb - METRICS_SUB_BITS);
+}
+
+void metricsRecord(int op, uint64_t start, int64_t bytes)
+{
+    struct metricsOp *m = &gOps[op];
+    uint64_t ns = metricsNow() - start, max;
+
+    __sync_fetch_and_add(&m->buckets[bucketOf(ns)], 1);
+    __sync_fetch_and_add(&m->count, 1);
+    __sync_fetch_and_add(&m->totalNs, ns);
+    if (bytes > 0) {
+        __sync_fetch_and_add(&m->bytes, (uint64_t)bytes);
+    }
+    for (max = m->maxNs; ns > max; max = m->maxNs) {
+        if (__sync_bool_compare_and_swap(&m->maxNs, max, ns)) {
+            break;
+        }
+    }
+}
+
+int hdfsGetMetrics(struct hdfsOpMetrics *metrics)
+{
+    static const int pct[] = { 500, 900, 990, 999 };
+    uint64_t *out[4];
+    uint64_t counts[METRICS_NUM_BUCKETS], total, seen, want;
+    int op, i, p;
+
+    if (!gMetricsEnabled) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    for (op = 0; op < HDFS_METRICS_NUM_OPS; op++) {
+        struct metricsOp *m = &gOps[op];
+        struct hdfsOpMetrics *r = &metrics[op];
+
+        memset(r, 0, sizeof(*r));
+        r->totalNs = m->totalNs;
+        r->maxNs = m->maxNs;
+        r->bytes = m->bytes;
+        // Other threads keep recording, so work from one copy of the
+        // buckets and let their sum be the count
+        total = 0;
+        for (i = 0; i < METRICS_NUM_BUCKETS; i++) {
+            counts[i] = m->buckets[i];
+            total += counts[i];
+        }
+        r->count = total;
+        if (!total) {
+            continue;
+        }
+        out[0] = &r->p50Ns;
+        out[1] = &r->p90Ns;
+        out[2] = &r->p99Ns;
+        out[3] = &r->p999Ns;
+        seen = 0;
+        p = 0;
+        for (i = 0; i < METRICS_NUM_BUCKETS && p < 4; i++) {
+            seen += counts[i];
+            while (p < 4) {
+                want = (total * pct[p] + 999) / 1000;
+                if (seen < want) {
+                    break;
+                }
+                *out[p++] = bucketFloor(i);
+            }
+        }
+    }
+    return 0;
+}
+
+void hdfsResetMetrics(void)
+{
+    memset(gOps, 0, sizeof(gOps));
+}
+
+const char *hdfsMetricsOpName(int op)
+{
+    if (op < 0 || op >= HDFS_METRICS_NUM_OPS) {
+        return NULL;
+    }
+    return gOpNames[op];
+}
@@ -0,0 +1,66 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_HDFS_METRICS_H
+#define LIBHDFS_HDFS_METRICS_H
+
+/**
+ * Process-wide latency histograms for libhdfs calls.
+ *
+ * Recording is off until metricsEnable is called, and while it is off a
+ * call costs one load and branch: METRICS_START yields 0 without reading
+ * the clock, and METRICS_END ignores a start time of 0.
+ */
+
+#include "hdfs.h"
+
+#include <stdint.h>
+
+/** Nonzero once metricsEnable has been called */
+extern volatile int gMetricsEnabled;
+
+/**
+ * Turn recording on for the rest of the life of the process.
+ */
+void metricsEnable(void);
+
+/**
+ * Get the monotonic clock in nanoseconds.  Never returns 0.
+ */
+uint64_t metricsNow(void);
+
+/**
+ * Add one call to the histogram of an operation.
+ *
+ * @param op            The hdfsMetricsOp of the call.
+ * @param start         What METRICS_START returned when the call began.
+ * @param bytes         The bytes the call moved; negative values, such as
+ *                      error returns, count as 0.
+ */
+void metricsRecord(int op, uint64_t start, int64_t bytes);
+
+#define METRICS_START() (gMetricsEnabled ? metricsNow() : 0)
+
+#define METRICS_END(op, start, bytes) \
+    do { \
+        if (start) { \
+            metricsRecord(op, start, bytes); \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,388 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hdfs.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The most entries each hdfsReadDirBatch call of a walk asks for */
+#define WALK_BATCH_SIZE 1000
+
+/** The initial capacity of a walk queue */
+#define WALK_QUEUE_MIN_CAPACITY 16
+
+/** A directory waiting to be listed */
+struct walkDir {
+    /** Dynamically allocated */
+    char *path;
+    int depth;
+};
+
+/**
+ * The directories one thread of a walk has found and not yet listed, as a
+ * ring buffer.  The thread takes the newest from the tail; the others steal
+ * the oldest, which are likely to have the most under them, from the head.
+ */
+struct walkQueue {
+    pthread_mutex_t lock;
+    struct walkDir *dirs;
+    int head, len, capacity;
+};
+
+struct walkState {
+    hdfsFS fs;
+    int maxDepth;
+    hdfsWalkCallback callback;
+    void *arg;
+    struct walkQueue *queues;
+    int numQueues;
+    /** Directories queued or being listed; the walk is over at 0 */
+    int outstanding;
+    /** Directories queued */
+    int queued;
+    /** Threads waiting on idleCond for work */
+    int sleepers;
+    /** Set once the walk is to end early */
+    int stop;
+    /** The first error the walk ran into, or 0 */
+    int error;
+    /** Guards waiting on idleCond, which is signalled when any of the three
+     * counters above changes in a way a sleeper would care about */
+    pthread_mutex_t idleLock;
+    pthread_cond_t idleCond;
+};
+
+struct walkThread {
+    struct walkState *walk;
+    int idx;
+    pthread_t thread;
+};
+
+static int walkStopped(struct walkState *walk)
+{
+    return __sync_fetch_and_add(&walk->stop, 0);
+}
+
+static void walkWakeAll(struct walkState *walk)
+{
+    pthread_mutex_lock(&walk->idleLock);
+    pthread_cond_broadcast(&walk->idleCond);
+    pthread_mutex_unlock(&walk->idleLock);
+}
+
+/**
+ * End the walk early.
+ *
+ * @param err       The error to return from hdfsWalk, or 0 if the callback
+ *                  asked for the walk to stop.
+ */
+static void walkStop(struct walkState *walk, int err)
+{
+    if (err) {
+        __sync_bool_compare_and_swap(&walk->error, 0, err);
+    }
+    __sync_lock_test_and_set(&walk->stop, 1);
+    walkWakeAll(walk);
+}
+
+/**
+ * Queue a directory to be listed by one of the walk's threads.
+ *
+ * @return          0 on success; an errno value otherwise
+ */
+static int walkPush(struct walkState *walk, int idx, const char *path,
+                    int depth)
+{
+    struct walkQueue *q = &walk->queues[idx];
+    struct walkDir *dirs;
+    char *copy;
+    int i, capacity;
+
+    copy = strdup(path);
+    if (!copy) {
+        return ENOMEM;
+    }
+    // Count the directory first, so that the counts are never less than
+    // the directories a thread could find
+    __sync_fetch_and_add(&walk->outstanding, 1);
+    __sync_fetch_and_add(&walk->queued, 1);
+    pthread_mutex_lock(&q->lock);
+    if (q->len == q->capacity) {
+        capacity = q->capacity ? q->capacity * 2 : WALK_QUEUE_MIN_CAPACITY;
+        dirs = malloc(capacity * sizeof(struct walkDir));
+        if (!dirs) {
+            pthread_mutex_unlock(&q->lock);
+            __sync_fetch_and_sub(&walk->queued, 1);
+            __sync_fetch_and_sub(&walk->outstanding, 1);
+            free(copy);
+            return ENOMEM;
+        }
+        for (i = 0; i < q->len; i++) {
+            dirs[i] = q->dirs[(q->head + i) % q->capacity];
+        }
+        free(q->dirs);
+        q->dirs = dirs;
+        q->head = 0;
+        q->capacity = capacity;
+    }
+    dirs = &q->dirs[(q->head + q->len) % q->capacity];
+    dirs->path = copy;
+    dirs->depth = depth;
+    q->len++;
+    pthread_mutex_unlock(&q->lock);
+    // A sleeper counts itself before it looks at queued, so either it sees
+    // this directory or this sees it
+    if (__sync_fetch_and_add(&walk->sleepers, 0) > 0) {
+        pthread_mutex_lock(&walk->idleLock);
+        pthread_cond_signal(&walk->idleCond);
+        pthread_mutex_unlock(&walk->idleLock);
+    }
+    return 0;
+}
+
+/**
+ * Take the next directory for a thread to list: the newest of its own, or
+ * else the oldest of another thread's.
+ *
+ * @return          1 if a directory was taken; 0 if every queue was empty
+ */
+static int walkTake(struct walkState *walk, int idx, struct walkDir *dir)
+{
+    struct walkQueue *q;
+    int i;
+
+    q = &walk->queues[idx];
+    pthread_mutex_lock(&q->lock);
+    if (q->len > 0) {
+        q->len--;
+        *dir = q->dirs[(q->head + q->len) % q->capacity];
+        pthread_mutex_unlock(&q->lock);
+        __sync_fetch_and_sub(&walk->queued, 1);
+        return 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    for (i = 1; i < walk->numQueues; i++) {
+        q = &walk->queues[(idx + i) % walk->numQueues];
+        pthread_mutex_lock(&q->lock);
+        if (q->len > 0) {
+            *dir = q->dirs[q->head];
+            q->head = (q->head + 1) % q->capacity;
+            q->len--;
+            pthread_mutex_unlock(&q->lock);
+            __sync_fetch_and_sub(&walk->queued, 1);
+            return 1;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+    return 0;
+}
+
+/**
+ * Pass an entry to the callback, and queue it if it is a directory to be
+ * walked.
+ *
+ * @return          0 on success; an errno value otherwise
+ */
+static int walkVisit(struct walkState *walk, int idx,
+                     const hdfsFileInfo *info, int depth)
+{
+    int ret;
+
+    ret = walk->callback(info, depth, walk->arg);
+    if (ret == HDFS_WALK_STOP) {
+        walkStop(walk, 0);
+        return 0;
+    }
+    if (ret == HDFS_WALK_CONTINUE && info->mKind == kObjectKindDirectory &&
+            (walk->maxDepth < 0 || depth < walk->maxDepth)) {
+        return walkPush(walk, idx, info->mName, depth);
+    }
+    return 0;
+}
+
+/**
+ * List a directory, passing its entries on.
+ *
+ * @return          0 on success; an errno value otherwise
+ */
+static int walkList(struct walkState *walk, int idx,
+                    const struct walkDir *dir)
+{
+    hdfsDir d;
+    hdfsFileInfo *entries;
+    int i, n, ret = 0;
+
+    d = hdfsOpenDir(walk->fs, dir->path);
+    if (!d) {
+        // Deleted since its parent was listed
+        return (errno == ENOENT) ? 0 : errno;
+    }
+    while (!walkStopped(walk)) {
+        n = hdfsReadDirBatch(d, WALK_BATCH_SIZE, &entries);
+        if (n <= 0) {
+            if (n < 0 && errno != ENOENT) {
+                ret = errno;
+            }
+            break;
+        }
+        for (i = 0; i < n && !ret && !walkStopped(walk); i++) {
+            ret = walkVisit(walk, idx, &entries[i], dir->depth + 1);
+        }
+        hdfsFreeFileInfo(entries, n);
+        if (ret) {
+            break;
+        }
+    }
+    hdfsCloseDir(d);
+    return ret;
+}
+
+/**
+ * List directories until there are none left anywhere, or the walk stops.
+ */
+static void walkRun(struct walkState *walk, int idx)
+{
+    struct walkDir dir;
+    int ret, finished;
+
+    while (1) {
+        if (walkTake(walk, idx, &dir)) {
+            if (!walkStopped(walk)) {
+                ret = walkList(walk, idx, &dir);
+                if (ret) {
+                    fprintf(stderr, "hdfsWalk(%s): listing failed with "
+                            "error %d\n", dir.path, ret);
+                    walkStop(walk, ret);
+                }
+            }
+            free(dir.path);
+            if (__sync_sub_and_fetch(&walk->outstanding, 1) == 0) {
+                walkWakeAll(walk);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&walk->idleLock);
+        __sync_fetch_and_add(&walk->sleepers, 1);
+        while (!walkStopped(walk) &&
+               __sync_fetch_and_add(&walk->outstanding, 0) > 0 &&
+               __sync_fetch_and_add(&walk->queued, 0) == 0) {
+            pthread_cond_wait(&walk->idleCond, &walk->idleLock);
+        }
+        __sync_fetch_and_sub(&walk->sleepers, 1);
+        finished = walkStopped(walk) ||
+            __sync_fetch_and_add(&walk->outstanding, 0) == 0;
+        pthread_mutex_unlock(&walk->idleLock);
+        if (finished) {
+            break;
+        }
+    }
+}
+
+static void *walkThreadMain(void *arg)
+{
+    struct walkThread *t = arg;
+
+    walkRun(t->walk, t->idx);
+    return NULL;
+}
+
+int hdfsWalk(hdfsFS fs, const char *root, int parallelism, int maxDepth,
+             hdfsWalkCallback callback, void *arg)
+{
+    struct walkState walk;
+    struct walkThread *threads = NULL;
+    struct walkQueue *q;
+    hdfsFileInfo *info;
+    int i, numThreads = 0, ret;
+
+    if (!fs || !root || parallelism < 1 || maxDepth < -1 || !callback) {
+        errno = EINVAL;
+        return -1;
+    }
+    info = hdfsGetPathInfo(fs, root);
+    if (!info) {
+        return -1;
+    }
+    memset(&walk, 0, sizeof(walk));
+    walk.fs = fs;
+    walk.maxDepth = maxDepth;
+    walk.callback = callback;
+    walk.arg = arg;
+    walk.queues = calloc(parallelism, sizeof(struct walkQueue));
+    if (!walk.queues) {
+        hdfsFreeFileInfo(info, 1);
+        errno = ENOMEM;
+        return -1;
+    }
+    walk.numQueues = parallelism;
+    for (i = 0; i < parallelism; i++) {
+        pthread_mutex_init(&walk.queues[i].lock, NULL);
+    }
+    pthread_mutex_init(&walk.idleLock, NULL);
+    pthread_cond_init(&walk.idleCond, NULL);
+
+    ret = walkVisit(&walk, 0, info, 0);
+    hdfsFreeFileInfo(info, 1);
+    if (ret) {
+        walk.error = ret;
+    } else if (walk.queued > 0) {
+        if (parallelism > 1) {
+            threads = calloc(parallelism - 1, sizeof(struct walkThread));
+        }
+        for (i = 1; threads && i < parallelism; i++) {
+            threads[numThreads].walk = &walk;
+            threads[numThreads].idx = i;
+            ret = pthread_create(&threads[numThreads].thread, NULL,
+                                 walkThreadMain, &threads[numThreads]);
+            if (ret) {
+                // The walk still finishes, on fewer threads
+                fprintf(stderr, "hdfsWalk(%s): WARN: pthread_create failed "
+                        "with error %d\n", root, ret);
+                break;
+            }
+            numThreads++;
+        }
+        walkRun(&walk, 0);
+        for (i = 0; i < numThreads; i++) {
+            pthread_join(threads[i].thread, NULL);
+        }
+        free(threads);
+    }
+
+    for (i = 0; i < parallelism; i++) {
+        q = &walk.queues[i];
+        // Left over if the walk stopped early
+        for (; q->len > 0; q->len--) {
+            free(q->dirs[(q->head + q->len - 1) % q->capacity].path);
+        }
+        free(q->dirs);
+        pthread_mutex_destroy(&q->lock);
+    }
+    free(walk.queues);
+    pthread_cond_destroy(&walk.idleCond);
+    pthread_mutex_destroy(&walk.idleLock);
+    if (walk.error) {
+        errno = walk.error;
+        return -1;
+    }
+    return 0;
+}
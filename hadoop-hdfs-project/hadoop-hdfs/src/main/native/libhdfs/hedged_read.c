@@ -0,0 +1,320 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hedged_read.h"
+#include "jni_helper.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct hedgedReader {
+    hedgedReadFn fn;
+    void *arg;
+    int thresholdMs;
+    pthread_mutex_t lock;
+    /** Signalled when the last running read finishes */
+    pthread_cond_t idle;
+    /** Reads still running on pool threads, guarded by lock */
+    int running;
+    uint64_t hedges;
+    uint64_t wins;
+};
+
+/**
+ * One range being read by up to two pool threads.  The caller waits until a
+ * read has succeeded or none is left running; the winner copies its data
+ * into the caller's buffer under the lock, before the caller can return.
+ */
+struct hedgedRace {
+    struct hedgedReader *reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    /** The caller, and each read not yet finished */
+    int refs;
+    int running;
+    int done;
+    int64_t position;
+    void *buf;
+    int32_t len;
+    int32_t ret;
+    int err;
+};
+
+struct hedgedTask {
+    struct hedgedTask *next;
+    struct hedgedRace *race;
+    int hedge;
+};
+
+static pthread_mutex_t gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gPoolCond = PTHREAD_COND_INITIALIZER;
+static struct hedgedTask *gTaskHead = NULL, *gTaskTail = NULL;
+static int gNumThreads = 0;
+/** Threads waiting for a task, less the tasks queued for them */
+static int gNumIdle = 0;
+
+static void raceUnref(struct hedgedRace *race)
+{
+    // Called with race->lock held; releases it
+    int refs = --race->refs;
+
+    pthread_mutex_unlock(&race->lock);
+    if (refs == 0) {
+        pthread_mutex_destroy(&race->lock);
+        pthread_cond_destroy(&race->cond);
+        free(race);
+    }
+}
+
+static void runTask(struct hedgedTask *task)
+{
+    struct hedgedRace *race = task->race;
+    struct hedgedReader *reader = race->reader;
+    int32_t ret;
+    int err = 0;
+    void *buf;
+
+    buf = malloc(race->len);
+    if (buf) {
+        ret = reader->fn(reader->arg, task->hedge, race->position, buf,
+                         race->len);
+        if (ret < 0) {
+            err = errno;
+        }
+    } else {
+        ret = -1;
+        err = ENOMEM;
+    }
+    pthread_mutex_lock(&race->lock);
+    race->running--;
+    if (!race->done) {
+        if (ret >= 0) {
+            memcpy(race->buf, buf, ret);
+            race->done = 1;
+            race->ret = ret;
+            if (task->hedge) {
+                __sync_fetch_and_add(&reader->wins, 1);
+            }
+        } else {
+            race->err = err;
+        }
+    }
+    pthread_cond_broadcast(&race->cond);
+    raceUnref(race);
+    free(buf);
+
+    pthread_mutex_lock(&reader->lock);
+    if (--reader->running == 0) {
+        pthread_cond_broadcast(&reader->idle);
+    }
+    pthread_mutex_unlock(&reader->lock);
+}
+
+static void *hedgedWorkerMain(void *arg)
+{
+    struct hedgedTask *task;
+
+    // Attach to the JVM now rather than on the first read
+    if (!getJNIEnv()) {
+        fprintf(stderr, "hedgedReadPool: could not get a JNIEnv\n");
+    }
+    pthread_mutex_lock(&gPoolLock);
+    while (1) {
+        task = gTaskHead;
+        if (!task) {
+            pthread_cond_wait(&gPoolCond, &gPoolLock);
+            continue;
+        }
+        gTaskHead = task->next;
+        if (!gTaskHead) {
+            gTaskTail = NULL;
+        }
+        pthread_mutex_unlock(&gPoolLock);
+        runTask(task);
+        free(task);
+        pthread_mutex_lock(&gPoolLock);
+        gNumIdle++;
+    }
+    return NULL;
+}
+
+int hedgedReadPoolInit(int numThreads)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret = 0;
+
+    if (numThreads <= 0) {
+        return EINVAL;
+    }
+    pthread_mutex_lock(&gPoolLock);
+    if (gNumThreads > 0) {
+        pthread_mutex_unlock(&gPoolLock);
+        return 0;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (gNumThreads < numThreads) {
+        ret = pthread_create(&thread, &attr, hedgedWorkerMain, NULL);
+        if (ret) {
+            break;
+        }
+        gNumThreads++;
+        // Idle from now on; tasks queued before it runs wait for it
+        gNumIdle++;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_mutex_unlock(&gPoolLock);
+    // A smaller pool than asked for still works
+    return gNumThreads > 0 ? 0 : ret;
+}
+
+/**
+ * Queue a read of a race for an idle pool thread.
+ *
+ * @return              0 on success; EAGAIN if no thread is idle
+ */
+static int startRead(struct hedgedRace *race, int hedge)
+{
+    struct hedgedTask *task;
+
+    task = malloc(sizeof(*task));
+    if (!task) {
+        return ENOMEM;
+    }
+    task->next = NULL;
+    task->race = race;
+    task->hedge = hedge;
+    pthread_mutex_lock(&gPoolLock);
+    if (gNumIdle == 0) {
+        pthread_mutex_unlock(&gPoolLock);
+        free(task);
+        return EAGAIN;
+    }
+    gNumIdle--;
+    if (gTaskTail) {
+        gTaskTail->next = task;
+    } else {
+        gTaskHead = task;
+    }
+    gTaskTail = task;
+    pthread_cond_signal(&gPoolCond);
+    pthread_mutex_unlock(&gPoolLock);
+
+    // Under race->lock, which the caller holds
+    race->refs++;
+    race->running++;
+    pthread_mutex_lock(&race->reader->lock);
+    race->reader->running++;
+    pthread_mutex_unlock(&race->reader->lock);
+    return 0;
+}
+
+int hedgedReaderCreate(hedgedReadFn fn, void *arg, int thresholdMs,
+                       struct hedgedReader **out)
+{
+    struct hedgedReader *reader;
+
+    reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        return ENOMEM;
+    }
+    reader->fn = fn;
+    reader->arg = arg;
+    reader->thresholdMs = thresholdMs;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->idle, NULL);
+    *out = reader;
+    return 0;
+}
+
+int32_t hedgedReaderRead(struct hedgedReader *reader, int64_t position,
+                         void *buf, int32_t len)
+{
+    struct hedgedRace *race;
+    struct timespec deadline;
+    int32_t ret;
+
+    race = calloc(1, sizeof(*race));
+    if (!race) {
+        return reader->fn(reader->arg, 0, position, buf, len);
+    }
+    race->reader = reader;
+    pthread_mutex_init(&race->lock, NULL);
+    pthread_cond_init(&race->cond, NULL);
+    race->refs = 1;
+    race->position = position;
+    race->buf = buf;
+    race->len = len;
+
+    pthread_mutex_lock(&race->lock);
+    if (startRead(race, 0)) {
+        raceUnref(race);
+        return reader->fn(reader->arg, 0, position, buf, len);
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += reader->thresholdMs / 1000;
+    deadline.tv_nsec += (reader->thresholdMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (!race->done && race->running > 0) {
+        if (pthread_cond_timedwait(&race->cond, &race->lock,
+                                   &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (!race->done && race->running > 0 && startRead(race, 1) == 0) {
+        __sync_fetch_and_add(&reader->hedges, 1);
+    }
+    while (!race->done && race->running > 0) {
+        pthread_cond_wait(&race->cond, &race->lock);
+    }
+    if (race->done) {
+        ret = race->ret;
+    } else {
+        ret = -1;
+        errno = race->err;
+    }
+    raceUnref(race);
+    return ret;
+}
+
+void hedgedReaderGetCounts(struct hedgedReader *reader, uint64_t *hedges,
+                           uint64_t *wins)
+{
+    *hedges = __sync_fetch_and_add(&reader->hedges, 0);
+    *wins = __sync_fetch_and_add(&reader->wins, 0);
+}
+
+void hedgedReaderFree(struct hedgedReader *reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    while (reader->running > 0) {
+        pthread_cond_wait(&reader->idle, &reader->lock);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->idle);
+    free(reader);
+}
@@ -0,0 +1,96 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_HEDGED_READ_H
+#define LIBHDFS_HEDGED_READ_H
+
+/**
+ * Hedged positional reads for libhdfs.
+ *
+ * A read runs on a thread of a process-wide pool.  If it has not finished
+ * within the file's threshold, a second read of the same range is started
+ * on another pool thread, and whichever succeeds first is returned.  The
+ * other read is left to finish on its own and its data is thrown away.
+ * When no pool thread is idle a read runs on the caller's thread without a
+ * hedge, and a hedge that finds no idle thread is not started.
+ */
+
+#include <stdint.h>
+
+struct hedgedReader;
+
+/**
+ * Read part of a file.
+ *
+ * @param arg           The argument given to hedgedReaderCreate.
+ * @param hedge         0 for the first read of a range, 1 for the hedge.
+ * @param position      Where in the file to read from.
+ * @param buf           (out param) Where to put the data.
+ * @param len           The most bytes to read.
+ *
+ * @return              The number of bytes read, 0 at the end of the file;
+ *                      -1 on error, with errno set.
+ */
+typedef int32_t (*hedgedReadFn)(void *arg, int hedge, int64_t position,
+                                void *buf, int32_t len);
+
+/**
+ * Start the pool, if it has not been started yet.  The first caller
+ * decides the number of threads; later calls do nothing.
+ *
+ * @param numThreads    The number of pool threads.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+int hedgedReadPoolInit(int numThreads);
+
+/**
+ * Create the hedged reader of a file.
+ *
+ * @param fn            How to read the file.
+ * @param arg           Passed to fn.
+ * @param thresholdMs   How long a read may take before it is hedged.
+ * @param out           (out param) The reader.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+int hedgedReaderCreate(hedgedReadFn fn, void *arg, int thresholdMs,
+                       struct hedgedReader **out);
+
+/**
+ * Read part of a file, hedging the read if it is slow.  Reads may be made
+ * from several threads at once.
+ *
+ * @return              As for hedgedReadFn
+ */
+int32_t hedgedReaderRead(struct hedgedReader *reader, int64_t position,
+                         void *buf, int32_t len);
+
+/**
+ * Get how many hedges a reader has started, and how many of them finished
+ * first.
+ */
+void hedgedReaderGetCounts(struct hedgedReader *reader, uint64_t *hedges,
+                           uint64_t *wins);
+
+/**
+ * Wait for any reads that lost a race to finish, then free the reader.
+ */
+void hedgedReaderFree(struct hedgedReader *reader);
+
+#endif
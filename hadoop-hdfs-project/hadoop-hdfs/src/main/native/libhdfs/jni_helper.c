@@ -18,6 +18,7 @@
 
 #include "config.h"
 #include "exception.h"
+#include "hdfs_metrics.h"
 #include "jni_helper.h"
 
 #include <stdio.h> 
@@ -27,6 +28,9 @@ static pthread_mutex_t hdfsHashMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t jvmMutex = PTHREAD_MUTEX_INITIALIZER;
 static volatile int hashTableInited = 0;
 
+#define HADOOP_ISTRM_CLASS "org/apache/hadoop/fs/FSDataInputStream"
+#define HADOOP_OSTRM_CLASS "org/apache/hadoop/fs/FSDataOutputStream"
+
 #define LOCK_HASH_TABLE() pthread_mutex_lock(&hdfsHashMutex)
 #define UNLOCK_HASH_TABLE() pthread_mutex_unlock(&hdfsHashMutex)
 
@@ -54,8 +58,17 @@ static volatile int hashTableInited = 0;
 /** Key that allows us to retrieve thread-local storage */
 static pthread_key_t gTlsKey;
 
-/** nonzero if we succeeded in initializing gTlsKey. Protected by the jvmMutex */
-static int gTlsKeyInitialized = 0;
+/** Creates gTlsKey exactly once */
+static pthread_once_t gTlsKeyOnce = PTHREAD_ONCE_INIT;
+
+/** The error from creating gTlsKey, or 0.  Set under gTlsKeyOnce */
+static int gTlsKeyError = 0;
+
+/**
+ * The JVM, published once it is running and gCachedMethods is filled in.
+ * Threads that find it set attach without taking the jvmMutex.
+ */
+static JavaVM * volatile gJvm = NULL;
 
 /** Pthreads thread-local storage for each library thread. */
 struct hdfsTls {
@@ -198,32 +211,80 @@ static void* searchEntryFromTable(const char *key)
 
 
 
-jthrowable invokeMethod(JNIEnv *env, jvalue *retval, MethType methType,
-                 jobject instObj, const char *className,
-                 const char *methName, const char *methSignature, ...)
-{
-    va_list args;
-    jclass cls;
+/**
+ * The methods behind CachedMethod, in the same order.
+ */
+static struct {
+    const char *className;
+    const char *methName;
+    const char *methSignature;
     jmethodID mid;
+} gCachedMethods[NUM_CACHED_METHODS] = {
+    { HADOOP_ISTRM_CLASS, "read", "([BII)I", NULL },
+    { HADOOP_ISTRM_CLASS, "read", "(Ljava/nio/ByteBuffer;)I", NULL },
+    { HADOOP_ISTRM_CLASS, "read", "(J[BII)I", NULL },
+    { HADOOP_ISTRM_CLASS, "read", "(JLjava/nio/ByteBuffer;)I", NULL },
+    { HADOOP_ISTRM_CLASS, "seek", "(J)V", NULL },
+    { HADOOP_ISTRM_CLASS, "getPos", "()J", NULL },
+    { HADOOP_ISTRM_CLASS, "available", "()I", NULL },
+    { "org/apache/hadoop/hdfs/client/HdfsDataInputStream", "hedgedRead",
+        "(JLjava/nio/ByteBuffer;)I", NULL },
+    { HADOOP_OSTRM_CLASS, "write", "([BII)V", NULL },
+    { HADOOP_OSTRM_CLASS, "getPos", "()J", NULL },
+    { HADOOP_OSTRM_CLASS, "flush", "()V", NULL },
+    { HADOOP_OSTRM_CLASS, "hflush", "()V", NULL },
+    { HADOOP_OSTRM_CLASS, "hsync", "()V", NULL },
+    { "java/nio/Buffer", "clear", "()Ljava/nio/Buffer;", NULL },
+    { "java/nio/Buffer", "limit", "(I)Ljava/nio/Buffer;", NULL },
+};
+
+/** nonzero once gCachedMethods has been filled in.  Protected by jvmMutex */
+static int gCachedMethodsInitialized = 0;
+
+/**
+ * Resolve the entries of gCachedMethods.  You must be holding the jvmMutex
+ * when you call this function.
+ *
+ * A thread gets its first JNIEnv either under the jvmMutex or after seeing
+ * gJvm, which is only published once this has run, so the table can then
+ * be read without locking.  An entry that cannot be resolved is left NULL,
+ * and invokeCachedMethod then falls back to looking it up on each call.
+ */
+static void initCachedMethods(JNIEnv *env)
+{
+    int i;
+    jthrowable jthr;
+
+    if (gCachedMethodsInitialized) {
+        return;
+    }
+    for (i = 0; i < NUM_CACHED_METHODS; i++) {
+        jthr = methodIdFromClass(gCachedMethods[i].className,
+                gCachedMethods[i].methName, gCachedMethods[i].methSignature,
+                INSTANCE, env, &gCachedMethods[i].mid);
+        if (jthr) {
+            destroyLocalReference(env, jthr);
+            gCachedMethods[i].mid = NULL;
+        }
+    }
+    gCachedMethodsInitialized = 1;
+}
+
+/**
+ * Call a resolved method and collect its result and any exception.
+ */
+static jthrowable invokeMethodV(JNIEnv *env, jvalue *retval,
+        MethType methType, jobject instObj, jclass cls, jmethodID mid,
+        const char *methSignature, va_list args)
+{
     jthrowable jthr;
     const char *str; 
     char returnType;
-    
-    jthr = validateMethodType(env, methType);
-    if (jthr)
-        return jthr;
-    jthr = globalClassReference(className, env, &cls);
-    if (jthr)
-        return jthr;
-    jthr = methodIdFromClass(className, methName, methSignature, 
-                            methType, env, &mid);
-    if (jthr)
-        return jthr;
+
     str = methSignature;
     while (*str != ')') str++;
     str++;
     returnType = *str;
-    va_start(args, methSignature);
     if (returnType == JOBJECT || returnType == JARRAYOBJECT) {
         jobject jobj = NULL;
         if (methType == STATIC) {
@@ -282,7 +343,6 @@ jthrowable invokeMethod(JNIEnv *env, jvalue *retval, MethType methType,
         }
         retval->i = ji;
     }
-    va_end(args);
 
     jthr = (*env)->ExceptionOccurred(env);
     if (jthr) {
@@ -292,6 +352,58 @@ jthrowable invokeMethod(JNIEnv *env, jvalue *retval, MethType methType,
     return NULL;
 }
 
+jthrowable invokeMethod(JNIEnv *env, jvalue *retval, MethType methType,
+                 jobject instObj, const char *className,
+                 const char *methName, const char *methSignature, ...)
+{
+    va_list args;
+    jclass cls;
+    jmethodID mid;
+    jthrowable jthr;
+    
+    jthr = validateMethodType(env, methType);
+    if (jthr)
+        return jthr;
+    jthr = globalClassReference(className, env, &cls);
+    if (jthr)
+        return jthr;
+    jthr = methodIdFromClass(className, methName, methSignature, 
+                            methType, env, &mid);
+    if (jthr)
+        return jthr;
+    va_start(args, methSignature);
+    jthr = invokeMethodV(env, retval, methType, instObj, cls, mid,
+                         methSignature, args);
+    va_end(args);
+    return jthr;
+}
+
+jthrowable invokeCachedMethod(JNIEnv *env, jvalue *retval, jobject instObj,
+                              CachedMethod method, ...)
+{
+    va_list args;
+    jmethodID mid;
+    jthrowable jthr;
+
+    if (method < 0 || method >= NUM_CACHED_METHODS) {
+        return newRuntimeError(env, "invokeCachedMethod(method=%d): "
+            "illegal method.\n", method);
+    }
+    mid = gCachedMethods[method].mid;
+    if (!mid) {
+        jthr = methodIdFromClass(gCachedMethods[method].className,
+                gCachedMethods[method].methName,
+                gCachedMethods[method].methSignature, INSTANCE, env, &mid);
+        if (jthr)
+            return jthr;
+    }
+    va_start(args, method);
+    jthr = invokeMethodV(env, retval, INSTANCE, instObj, NULL, mid,
+                         gCachedMethods[method].methSignature, args);
+    va_end(args);
+    return jthr;
+}
+
 jthrowable constructNewObjectOfClass(JNIEnv *env, jobject *out, const char *className, 
                                   const char *ctorSignature, ...)
 {
@@ -424,6 +536,16 @@ done:
 }
 
 
+/**
+ * Make vm visible to attachToPublishedJvm.  Everything written before this,
+ * including gCachedMethods, is visible to threads that see it.
+ */
+static void publishJvm(JavaVM *vm)
+{
+    __sync_synchronize();
+    gJvm = vm;
+}
+
 /**
  * Get the global JNI environemnt.
  *
@@ -519,6 +641,8 @@ static JNIEnv* getGlobalJNIEnv(void)
         if (jthr) {
             printExceptionAndFree(env, jthr, PRINT_EXC_ALL, "loadFileSystems");
         }
+        initCachedMethods(env);
+        publishJvm(vm);
     }
     else {
         //Attach this thread to the VM
@@ -529,11 +653,44 @@ static JNIEnv* getGlobalJNIEnv(void)
                     "failed with error: %d\n", rv);
             return NULL;
         }
+        initCachedMethods(env);
+        publishJvm(vm);
     }
 
     return env;
 }
 
+static void createTlsKey(void)
+{
+    gTlsKeyError = pthread_key_create(&gTlsKey, hdfsThreadDestructor);
+}
+
+/**
+ * Attach the calling thread to the JVM without taking the jvmMutex, if the
+ * JVM has already been published.
+ *
+ * @return          The JNIEnv, or NULL if the caller must take the slow path
+ */
+static JNIEnv* attachToPublishedJvm(void)
+{
+    JavaVM *vm;
+    JNIEnv *env;
+    jint rv;
+
+    vm = gJvm;
+    __sync_synchronize();
+    if (!vm) {
+        return NULL;
+    }
+    rv = (*vm)->AttachCurrentThread(vm, (void*)&env, 0);
+    if (rv != 0) {
+        fprintf(stderr, "Call to AttachCurrentThread "
+                "failed with error: %d\n", rv);
+        return NULL;
+    }
+    return env;
+}
+
 /**
  * getJNIEnv: A helper function to get the JNIEnv* for the given thread.
  * If no JVM exists, then one will be created. JVM command line arguments
@@ -545,11 +702,13 @@ static JNIEnv* getGlobalJNIEnv(void)
  * failt to do this, it will cause a memory leak.
  *
  * However, POSIX TLS is not the most efficient way to do things.  It requires a
- * key to be initialized before it can be used.  Since we don't know if this key
- * is initialized at the start of this function, we have to lock a mutex first
- * and check.  Luckily, most operating systems support the more efficient
+ * key to be initialized before it can be used, which pthread_once does for
+ * us.  Luckily, most operating systems support the more efficient
  * __thread construct, which is initialized by the linker.
  *
+ * Only the threads that find no JVM published take the jvmMutex; once one
+ * is running, new threads attach to it without locking.
+ *
  * @param: None.
  * @return The JNIEnv* corresponding to the thread.
  */
@@ -557,6 +716,7 @@ JNIEnv* getJNIEnv(void)
 {
     JNIEnv *env;
     struct hdfsTls *tls;
+    uint64_t start;
     int ret;
 
 #ifdef HAVE_BETTER_TLS
@@ -564,25 +724,27 @@ JNIEnv* getJNIEnv(void)
     if (quickTls)
         return quickTls->env;
 #endif
-    pthread_mutex_lock(&jvmMutex);
-    if (!gTlsKeyInitialized) {
-        ret = pthread_key_create(&gTlsKey, hdfsThreadDestructor);
-        if (ret) {
-            pthread_mutex_unlock(&jvmMutex);
-            fprintf(stderr, "getJNIEnv: pthread_key_create failed with "
-                "error %d\n", ret);
-            return NULL;
-        }
-        gTlsKeyInitialized = 1;
+    ret = pthread_once(&gTlsKeyOnce, createTlsKey);
+    if (!ret) {
+        ret = gTlsKeyError;
+    }
+    if (ret) {
+        fprintf(stderr, "getJNIEnv: pthread_key_create failed with "
+            "error %d\n", ret);
+        return NULL;
     }
     tls = pthread_getspecific(gTlsKey);
     if (tls) {
-        pthread_mutex_unlock(&jvmMutex);
         return tls->env;
     }
 
-    env = getGlobalJNIEnv();
-    pthread_mutex_unlock(&jvmMutex);
+    start = METRICS_START();
+    env = attachToPublishedJvm();
+    if (!env) {
+        pthread_mutex_lock(&jvmMutex);
+        env = getGlobalJNIEnv();
+        pthread_mutex_unlock(&jvmMutex);
+    }
     if (!env) {
         fprintf(stderr, "getJNIEnv: getGlobalJNIEnv failed\n");
         return NULL;
@@ -604,6 +766,7 @@ JNIEnv* getJNIEnv(void)
 #ifdef HAVE_BETTER_TLS
     quickTls = tls;
 #endif
+    METRICS_END(HDFS_METRICS_OP_JNI_ATTACH, start, 0);
     return env;
 }
 
@@ -88,6 +88,42 @@ jthrowable invokeMethod(JNIEnv *env, jvalue *retval, MethType methType,
                  jobject instObj, const char *className, const char *methName, 
                  const char *methSignature, ...);
 
+/**
+ * Instance methods that libhdfs calls on its hot paths.  Their classes and
+ * method IDs are resolved once, when this library first gets a JNIEnv, so
+ * calling them through invokeCachedMethod takes no locks.
+ */
+typedef enum {
+    JM_ISTRM_READ,              // FSDataInputStream#read(byte[], int, int)
+    JM_ISTRM_READ_BYTE_BUFFER,  // FSDataInputStream#read(ByteBuffer)
+    JM_ISTRM_PREAD,             // FSDataInputStream#read(long, byte[], int, int)
+    JM_ISTRM_PREAD_BYTE_BUFFER, // FSDataInputStream#read(long, ByteBuffer)
+    JM_ISTRM_SEEK,              // FSDataInputStream#seek(long)
+    JM_ISTRM_GET_POS,           // FSDataInputStream#getPos()
+    JM_ISTRM_AVAILABLE,         // FSDataInputStream#available()
+    JM_HDFS_ISTRM_HEDGED_READ,  // HdfsDataInputStream#hedgedRead(long, ByteBuffer)
+    JM_OSTRM_WRITE,             // FSDataOutputStream#write(byte[], int, int)
+    JM_OSTRM_GET_POS,           // FSDataOutputStream#getPos()
+    JM_OSTRM_FLUSH,             // FSDataOutputStream#flush()
+    JM_OSTRM_HFLUSH,            // FSDataOutputStream#hflush()
+    JM_OSTRM_HSYNC,             // FSDataOutputStream#hsync()
+    JM_BUFFER_CLEAR,            // Buffer#clear()
+    JM_BUFFER_LIMIT,            // Buffer#limit(int)
+    NUM_CACHED_METHODS
+} CachedMethod;
+
+/** invokeCachedMethod: Invoke one of the pre-resolved instance methods.
+ * Behaves like invokeMethod with methType INSTANCE.
+ * env: The JNIEnv pointer
+ * retval: As for invokeMethod
+ * instObj: The object to invoke the method on.
+ * method: Which method to invoke.
+ * Arguments (the method arguments) must be passed after method
+ * RETURNS: NULL on success, or the exception thrown.
+ */
+jthrowable invokeCachedMethod(JNIEnv *env, jvalue *retval, jobject instObj,
+                              CachedMethod method, ...);
+
 jthrowable constructNewObjectOfClass(JNIEnv *env, jobject *out, const char *className, 
                                   const char *ctorSignature, ...);
 
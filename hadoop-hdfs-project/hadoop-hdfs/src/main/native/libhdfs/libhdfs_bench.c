@@ -0,0 +1,617 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * libhdfs_bench: measure libhdfs throughput and latency.
+ *
+ * For each thread count, each phase runs the same operation on that many
+ * threads sharing one hdfsFS: writing a file per thread, then, for each
+ * read size, reading it back sequentially, reading it at random offsets
+ * with hdfsSeek and hdfsRead, and with hdfsPread, and finally metadata
+ * lookups.  Every call is timed by the benchmark itself, so the same source
+ * measures libwebhdfs too (built as libwebhdfs_bench), and the two can be
+ * compared to see what the HTTP path costs.  The first call of each thread
+ * is also reported on its own: it pays for setting up connections, so a
+ * first call much slower than the median one shows connections being made
+ * rather than reused.
+ *
+ * With no -n, libhdfs_bench starts a mini cluster of its own.
+ */
+
+#include "hdfs.h"
+#ifndef LIBHDFS_BENCH_WEBHDFS
+#include "native_mini_dfs.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LIBHDFS_BENCH_WEBHDFS
+#define BENCH_NAME "libwebhdfs_bench"
+#else
+#define BENCH_NAME "libhdfs_bench"
+#endif
+
+#define BENCH_MAX_THREADS 256
+#define BENCH_MAX_READ_SIZES 16
+#define BENCH_MAX_THREAD_COUNTS 16
+
+struct benchConf {
+    const char *nn;
+    int port;
+    int threadCounts[BENCH_MAX_THREAD_COUNTS];
+    int numThreadCounts;
+    int64_t fileSize;
+    int bufferSize;
+    int hflushEvery;
+    int numOps;
+    int readSizes[BENCH_MAX_READ_SIZES];
+    int numReadSizes;
+    const char *dir;
+};
+
+enum benchPhase {
+    BENCH_WRITE,
+    BENCH_READ,
+    BENCH_SEEK_READ,
+    BENCH_PREAD,
+    BENCH_GET_PATH_INFO,
+    BENCH_LIST_DIRECTORY,
+};
+
+struct benchThread {
+    pthread_t thread;
+    const struct benchConf *conf;
+    hdfsFS fs;
+    enum benchPhase phase;
+    int readSize;
+    int idx;
+    char path[256];
+    /** The latency of each call made in this phase */
+    uint64_t *latNs;
+    size_t numLat, latCap;
+    int64_t bytes;
+    /** 0 on success; errno otherwise */
+    int error;
+};
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/**
+ * Record a call that started at start and moved bytes bytes.
+ *
+ * @return          0 on success; ENOMEM otherwise
+ */
+static int record(struct benchThread *t, uint64_t start, int64_t bytes)
+{
+    uint64_t *latNs;
+    size_t cap;
+
+    if (t->numLat == t->latCap) {
+        cap = t->latCap ? t->latCap * 2 : 1024;
+        latNs = realloc(t->latNs, cap * sizeof(*latNs));
+        if (!latNs) {
+            return ENOMEM;
+        }
+        t->latNs = latNs;
+        t->latCap = cap;
+    }
+    t->latNs[t->numLat++] = nowNs() - start;
+    t->bytes += bytes;
+    return 0;
+}
+
+static tOffset randomOffset(unsigned int *seed, tOffset range)
+{
+    if (range <= 0) {
+        return 0;
+    }
+    return ((((tOffset)rand_r(seed)) << 31) | rand_r(seed)) % range;
+}
+
+static int benchWrite(struct benchThread *t, char *buf)
+{
+    const struct benchConf *conf = t->conf;
+    hdfsFile file;
+    int64_t done;
+    uint64_t start;
+    tSize len;
+    int writes = 0, ret = 0;
+
+    file = hdfsOpenFile(t->fs, t->path, O_WRONLY, 0, 0, 0);
+    if (!file) {
+        return errno;
+    }
+    memset(buf, 'a' + (t->idx % 26), conf->bufferSize);
+    for (done = 0; done < conf->fileSize; done += len) {
+        len = conf->bufferSize;
+        if (len > conf->fileSize - done) {
+            len = conf->fileSize - done;
+        }
+        start = nowNs();
+        len = hdfsWrite(t->fs, file, buf, len);
+        if (len <= 0) {
+            ret = len ? errno : EIO;
+            break;
+        }
+        if (conf->hflushEvery && (++writes % conf->hflushEvery) == 0) {
+            if (hdfsHFlush(t->fs, file)) {
+                ret = errno;
+                break;
+            }
+        }
+        ret = record(t, start, len);
+        if (ret) {
+            break;
+        }
+    }
+    if (hdfsCloseFile(t->fs, file) && !ret) {
+        ret = errno;
+    }
+    return ret;
+}
+
+static int benchRead(struct benchThread *t, char *buf)
+{
+    hdfsFile file;
+    uint64_t start;
+    tSize len;
+    int ret = 0;
+
+    file = hdfsOpenFile(t->fs, t->path, O_RDONLY, 0, 0, 0);
+    if (!file) {
+        return errno;
+    }
+    for (;;) {
+        start = nowNs();
+        len = hdfsRead(t->fs, file, buf, t->readSize);
+        if (len <= 0) {
+            break;
+        }
+        ret = record(t, start, len);
+        if (ret) {
+            break;
+        }
+    }
+    if (len < 0) {
+        ret = errno;
+    }
+    hdfsCloseFile(t->fs, file);
+    return ret;
+}
+
+/**
+ * Random reads, with hdfsSeek and hdfsRead for BENCH_SEEK_READ, or with
+ * hdfsPread.
+ */
+static int benchRandomRead(struct benchThread *t, char *buf)
+{
+    const struct benchConf *conf = t->conf;
+    unsigned int seed = t->idx + 1;
+    hdfsFile file;
+    tOffset pos, range;
+    uint64_t start;
+    tSize len;
+    int i, ret = 0;
+
+    file = hdfsOpenFile(t->fs, t->path, O_RDONLY, 0, 0, 0);
+    if (!file) {
+        return errno;
+    }
+    range = conf->fileSize - t->readSize;
+    for (i = 0; i < conf->numOps; i++) {
+        pos = randomOffset(&seed, range);
+        start = nowNs();
+        if (t->phase == BENCH_SEEK_READ) {
+            if (hdfsSeek(t->fs, file, pos)) {
+                ret = errno;
+                break;
+            }
+            len = hdfsRead(t->fs, file, buf, t->readSize);
+        } else {
+            len = hdfsPread(t->fs, file, pos, buf, t->readSize);
+        }
+        if (len < 0) {
+            ret = errno;
+            break;
+        }
+        ret = record(t, start, len);
+        if (ret) {
+            break;
+        }
+    }
+    hdfsCloseFile(t->fs, file);
+    return ret;
+}
+
+static int benchMetadata(struct benchThread *t)
+{
+    hdfsFileInfo *info;
+    uint64_t start;
+    int i, numEntries, ret;
+
+    for (i = 0; i < t->conf->numOps; i++) {
+        start = nowNs();
+        if (t->phase == BENCH_GET_PATH_INFO) {
+            info = hdfsGetPathInfo(t->fs, t->path);
+            numEntries = 1;
+        } else {
+            info = hdfsListDirectory(t->fs, t->conf->dir, &numEntries);
+        }
+        if (!info) {
+            return errno;
+        }
+        ret = record(t, start, 0);
+        hdfsFreeFileInfo(info, numEntries);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void *benchThreadMain(void *v)
+{
+    struct benchThread *t = v;
+    char *buf;
+    int size;
+
+    size = (t->phase == BENCH_WRITE) ? t->conf->bufferSize : t->readSize;
+    buf = malloc(size > 0 ? size : 1);
+    if (!buf) {
+        t->error = ENOMEM;
+        return NULL;
+    }
+    switch (t->phase) {
+    case BENCH_WRITE:
+        t->error = benchWrite(t, buf);
+        break;
+    case BENCH_READ:
+        t->error = benchRead(t, buf);
+        break;
+    case BENCH_SEEK_READ:
+    case BENCH_PREAD:
+        t->error = benchRandomRead(t, buf);
+        break;
+    default:
+        t->error = benchMetadata(t);
+        break;
+    }
+    free(buf);
+    return NULL;
+}
+
+static int compareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static double percentileUs(const uint64_t *sorted, size_t num, double p)
+{
+    if (num == 0) {
+        return 0;
+    }
+    return sorted[(size_t)((num - 1) * p)] / 1e3;
+}
+
+/**
+ * Run one phase on numThreads threads and print a line of results.
+ *
+ * @return          0 on success; the first thread's error otherwise
+ */
+static int runPhase(const struct benchConf *conf, struct benchThread *threads,
+                    int numThreads, enum benchPhase phase, int readSize,
+                    const char *name)
+{
+    uint64_t start, elapsed, firstNs = 0, *all;
+    size_t num = 0;
+    int64_t bytes = 0;
+    double secs;
+    int i, numFirst = 0, ret = 0;
+
+    start = nowNs();
+    for (i = 0; i < numThreads; i++) {
+        threads[i].phase = phase;
+        threads[i].readSize = readSize;
+        threads[i].numLat = 0;
+        threads[i].bytes = 0;
+        threads[i].error = 0;
+        if (pthread_create(&threads[i].thread, NULL, benchThreadMain,
+                           &threads[i])) {
+            fprintf(stderr, "runPhase(%s): pthread_create failed\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < numThreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (threads[i].error && !ret) {
+            ret = threads[i].error;
+        }
+    }
+    elapsed = nowNs() - start;
+    if (ret) {
+        fprintf(stderr, "%s: failed with error %d\n", name, ret);
+        return ret;
+    }
+    for (i = 0; i < numThreads; i++) {
+        num += threads[i].numLat;
+        bytes += threads[i].bytes;
+        if (threads[i].numLat) {
+            firstNs += threads[i].latNs[0];
+            numFirst++;
+        }
+    }
+    all = malloc((num ? num : 1) * sizeof(*all));
+    if (!all) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        return ENOMEM;
+    }
+    num = 0;
+    for (i = 0; i < numThreads; i++) {
+        memcpy(all + num, threads[i].latNs,
+               threads[i].numLat * sizeof(*all));
+        num += threads[i].numLat;
+    }
+    qsort(all, num, sizeof(*all), compareU64);
+    secs = elapsed / 1e9;
+    printf("%-20s %7d %10zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f "
+           "%10.1f %10.1f\n", name, numThreads, num,
+           (double)bytes / (1024.0 * 1024.0) / secs, num / secs,
+           numFirst ? firstNs / 1e3 / numFirst : 0.0,
+           percentileUs(all, num, 0.5), percentileUs(all, num, 0.9),
+           percentileUs(all, num, 0.99), percentileUs(all, num, 0.999),
+           num ? all[num - 1] / 1e3 : 0.0);
+    fflush(stdout);
+    free(all);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+BENCH_NAME ": measure libhdfs throughput and latency.\n"
+"\n"
+"Usage: " BENCH_NAME " [options]\n"
+#ifdef LIBHDFS_BENCH_WEBHDFS
+"  -n <namenode>   Namenode to use.\n"
+"  -p <port>       Namenode http port (default 0, the configured port).\n"
+#else
+"  -n <namenode>   Namenode to use.  Without it, a mini cluster is\n"
+"                  started for the benchmark.\n"
+"  -p <port>       Namenode port (default 0, the configured port).\n"
+#endif
+"  -t <threads>    Comma-separated thread counts; every phase is run with\n"
+"                  each (default 4).\n"
+"  -s <bytes>      Size of the file each thread writes (default 64M).\n"
+"  -b <bytes>      Buffer size of writes (default 1M).\n"
+"  -H <writes>     hflush after every this many writes (default 0,\n"
+"                  never).\n"
+"  -o <ops>        Operations per thread for the random read and\n"
+"                  metadata phases (default 1000).\n"
+"  -r <sizes>      Comma-separated read sizes (default 4k,64k,1M).\n"
+"  -d <dir>        Directory to write in (default /libhdfs_bench).  It is\n"
+"                  deleted afterwards.\n");
+}
+
+static int64_t parseSize(const char *str)
+{
+    char *end;
+    int64_t val;
+
+    val = strtoll(str, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': val *= 1024LL; end++; break;
+    case 'm': case 'M': val *= 1024LL * 1024LL; end++; break;
+    case 'g': case 'G': val *= 1024LL * 1024LL * 1024LL; end++; break;
+    }
+    if (*end || val < 0) {
+        fprintf(stderr, "can't parse size '%s'\n", str);
+        exit(EXIT_FAILURE);
+    }
+    return val;
+}
+
+/**
+ * Parse a comma-separated list of sizes.
+ *
+ * @return          The number of sizes
+ */
+static int parseSizes(int *sizes, int maxSizes, char *str)
+{
+    char *tok, *savePtr;
+    int num = 0;
+
+    for (tok = strtok_r(str, ",", &savePtr); tok;
+            tok = strtok_r(NULL, ",", &savePtr)) {
+        if (num == maxSizes) {
+            fprintf(stderr, "at most %d values in '%s'\n", maxSizes, str);
+            exit(EXIT_FAILURE);
+        }
+        sizes[num++] = parseSize(tok);
+    }
+    return num;
+}
+
+int main(int argc, char **argv)
+{
+    struct benchConf conf = {
+        .nn = NULL,
+        .port = 0,
+        .threadCounts = { 4 },
+        .numThreadCounts = 1,
+        .fileSize = 64LL * 1024LL * 1024LL,
+        .bufferSize = 1024 * 1024,
+        .hflushEvery = 0,
+        .numOps = 1000,
+        .readSizes = { 4096, 65536, 1048576 },
+        .numReadSizes = 3,
+        .dir = "/libhdfs_bench",
+    };
+#ifndef LIBHDFS_BENCH_WEBHDFS
+    struct NativeMiniDfsConf miniConf = {
+        .doFormat = 1,
+    };
+    struct NativeMiniDfsCluster *cluster = NULL;
+#endif
+    static struct benchThread threads[BENCH_MAX_THREADS];
+    struct hdfsBuilder *bld;
+    char name[40];
+    hdfsFS fs;
+    int c, i, j, numThreads, maxThreads = 0, ret = 0;
+
+    while ((c = getopt(argc, argv, "n:p:t:s:b:H:o:r:d:h")) != -1) {
+        switch (c) {
+        case 'n': conf.nn = optarg; break;
+        case 'p': conf.port = atoi(optarg); break;
+        case 't':
+            conf.numThreadCounts = parseSizes(conf.threadCounts,
+                                   BENCH_MAX_THREAD_COUNTS, optarg);
+            break;
+        case 's': conf.fileSize = parseSize(optarg); break;
+        case 'b': conf.bufferSize = parseSize(optarg); break;
+        case 'H': conf.hflushEvery = atoi(optarg); break;
+        case 'o': conf.numOps = atoi(optarg); break;
+        case 'r':
+            conf.numReadSizes = parseSizes(conf.readSizes,
+                                BENCH_MAX_READ_SIZES, optarg);
+            break;
+        case 'd': conf.dir = optarg; break;
+        default:
+            usage();
+            return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < conf.numThreadCounts; i++) {
+        if (conf.threadCounts[i] <= 0 ||
+                conf.threadCounts[i] > BENCH_MAX_THREADS) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        if (conf.threadCounts[i] > maxThreads) {
+            maxThreads = conf.threadCounts[i];
+        }
+    }
+    for (i = 0; i < conf.numReadSizes; i++) {
+        if (conf.readSizes[i] <= 0) {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (conf.numThreadCounts == 0 || conf.bufferSize <= 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!conf.nn) {
+#ifdef LIBHDFS_BENCH_WEBHDFS
+        usage();
+        return EXIT_FAILURE;
+#else
+        cluster = nmdCreate(&miniConf);
+        if (!cluster || nmdWaitClusterUp(cluster)) {
+            fprintf(stderr, "failed to start a mini cluster\n");
+            return EXIT_FAILURE;
+        }
+        conf.nn = "localhost";
+        conf.port = nmdGetNameNodePort(cluster);
+#endif
+    }
+    bld = hdfsNewBuilder();
+    if (!bld) {
+        fprintf(stderr, "hdfsNewBuilder failed\n");
+        return EXIT_FAILURE;
+    }
+    hdfsBuilderSetNameNode(bld, conf.nn);
+    hdfsBuilderSetNameNodePort(bld, conf.port);
+    fs = hdfsBuilderConnect(bld);
+    if (!fs) {
+        fprintf(stderr, "failed to connect to %s:%d: error %d\n",
+                conf.nn, conf.port, errno);
+        return EXIT_FAILURE;
+    }
+    if (hdfsCreateDirectory(fs, conf.dir)) {
+        fprintf(stderr, "failed to create %s: error %d\n", conf.dir, errno);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < maxThreads; i++) {
+        threads[i].conf = &conf;
+        threads[i].fs = fs;
+        threads[i].idx = i;
+        snprintf(threads[i].path, sizeof(threads[i].path), "%s/file.%d",
+                 conf.dir, i);
+    }
+
+    printf("%-20s %7s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+           "phase", "threads", "ops", "MB/s", "ops/s", "first(us)",
+           "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (j = 0; !ret && j < conf.numThreadCounts; j++) {
+        numThreads = conf.threadCounts[j];
+        ret = runPhase(&conf, threads, numThreads, BENCH_WRITE, 0, "write");
+        for (i = 0; !ret && i < conf.numReadSizes; i++) {
+            snprintf(name, sizeof(name), "read(%d)", conf.readSizes[i]);
+            ret = runPhase(&conf, threads, numThreads, BENCH_READ,
+                           conf.readSizes[i], name);
+        }
+        for (i = 0; !ret && i < conf.numReadSizes; i++) {
+            snprintf(name, sizeof(name), "seekRead(%d)", conf.readSizes[i]);
+            ret = runPhase(&conf, threads, numThreads, BENCH_SEEK_READ,
+                           conf.readSizes[i], name);
+        }
+        for (i = 0; !ret && i < conf.numReadSizes; i++) {
+            snprintf(name, sizeof(name), "pread(%d)", conf.readSizes[i]);
+            ret = runPhase(&conf, threads, numThreads, BENCH_PREAD,
+                           conf.readSizes[i], name);
+        }
+        if (!ret) {
+            ret = runPhase(&conf, threads, numThreads, BENCH_GET_PATH_INFO, 0,
+                           "getPathInfo");
+        }
+        if (!ret) {
+            ret = runPhase(&conf, threads, numThreads, BENCH_LIST_DIRECTORY,
+                           0, "listDirectory");
+        }
+    }
+
+    for (i = 0; i < maxThreads; i++) {
+        free(threads[i].latNs);
+    }
+    hdfsDelete(fs, conf.dir, 1);
+    hdfsDisconnect(fs);
+#ifndef LIBHDFS_BENCH_WEBHDFS
+    if (cluster) {
+        nmdShutdown(cluster);
+        nmdFree(cluster);
+    }
+#endif
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
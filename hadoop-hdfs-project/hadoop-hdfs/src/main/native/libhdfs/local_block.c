@@ -0,0 +1,338 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "local_block.h"
+#include "bulk_crc32.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The length of the version and DataChecksum header of a checksum file */
+#define META_HEADER_LEN 7
+
+/** DataChecksum type ids, as stored in checksum files */
+#define CHECKSUM_NULL 0
+#define CHECKSUM_CRC32 1
+#define CHECKSUM_CRC32C 2
+
+/** The largest chunk size accepted from a checksum file */
+#define MAX_BYTES_PER_CHECKSUM (16 * 1024 * 1024)
+
+struct localBlock {
+    int refs;
+    int64_t start;
+    int64_t length;
+    int dataFd;
+    /** The checksum file, or -1 if checksums are not verified */
+    int metaFd;
+    /** One of the bulk_crc32.h polynomials */
+    int crcType;
+    int32_t bytesPerChecksum;
+    /** Set by localBlockAdvise */
+    int dropBehind;
+};
+
+int64_t localBlockStart(const struct localBlock *block)
+{
+    return block->start;
+}
+
+int64_t localBlockLength(const struct localBlock *block)
+{
+    return block->length;
+}
+
+/**
+ * Read exactly len bytes at off, unless the file ends first.
+ *
+ * @return              0 on success; an errno value otherwise.  A file that
+ *                      ends early is reported as EIO.
+ */
+static int preadFully(int fd, void *buf, size_t len, int64_t off)
+{
+    char *b = buf;
+    ssize_t res;
+
+    while (len > 0) {
+        res = pread(fd, b, len, off);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        } else if (res == 0) {
+            return EIO;
+        }
+        b += res;
+        len -= res;
+        off += res;
+    }
+    return 0;
+}
+
+static int readMetaHeader(struct localBlock *block, const char *metaPath)
+{
+    unsigned char hdr[META_HEADER_LEN];
+    uint32_t bpc;
+    int ret;
+
+    ret = preadFully(block->metaFd, hdr, sizeof(hdr), 0);
+    if (ret) {
+        return ret;
+    }
+    memcpy(&bpc, hdr + 3, sizeof(bpc));
+    bpc = ntohl(bpc);
+    switch (hdr[2]) {
+    case CHECKSUM_NULL:
+        // Nothing to verify
+        close(block->metaFd);
+        block->metaFd = -1;
+        return 0;
+    case CHECKSUM_CRC32:
+        block->crcType = CRC32_ZLIB_POLYNOMIAL;
+        break;
+    case CHECKSUM_CRC32C:
+        block->crcType = CRC32C_POLYNOMIAL;
+        break;
+    default:
+        fprintf(stderr, "localBlockOpen(%s): unknown checksum type %d\n",
+                metaPath, hdr[2]);
+        return ENOTSUP;
+    }
+    if (bpc == 0 || bpc > MAX_BYTES_PER_CHECKSUM) {
+        fprintf(stderr, "localBlockOpen(%s): bad chunk size %" PRIu32 "\n",
+                metaPath, bpc);
+        return EIO;
+    }
+    block->bytesPerChecksum = bpc;
+    return 0;
+}
+
+int localBlockOpen(int64_t start, int64_t length, const char *blockPath,
+                   const char *metaPath, struct localBlock **out)
+{
+    struct localBlock *block;
+    int ret;
+
+    block = calloc(1, sizeof(*block));
+    if (!block) {
+        return ENOMEM;
+    }
+    block->refs = 1;
+    block->start = start;
+    block->length = length;
+    block->metaFd = -1;
+    block->dataFd = open(blockPath, O_RDONLY | O_CLOEXEC);
+    if (block->dataFd < 0) {
+        ret = errno;
+        goto error;
+    }
+    if (metaPath) {
+        block->metaFd = open(metaPath, O_RDONLY | O_CLOEXEC);
+        if (block->metaFd < 0) {
+            ret = errno;
+            goto error;
+        }
+        ret = readMetaHeader(block, metaPath);
+        if (ret) {
+            goto error;
+        }
+    }
+    *out = block;
+    return 0;
+
+error:
+    localBlockUnref(block);
+    return ret;
+}
+
+void localBlockRef(struct localBlock *block)
+{
+    __sync_fetch_and_add(&block->refs, 1);
+}
+
+void localBlockUnref(struct localBlock *block)
+{
+    if (__sync_sub_and_fetch(&block->refs, 1) > 0) {
+        return;
+    }
+    if (block->dataFd >= 0) {
+        close(block->dataFd);
+    }
+    if (block->metaFd >= 0) {
+        close(block->metaFd);
+    }
+    free(block);
+}
+
+void localBlockAdvise(struct localBlock *block, int advice, int dropBehind)
+{
+    int ret;
+
+    ret = posix_fadvise(block->dataFd, 0, 0, advice);
+    if (!ret && block->metaFd >= 0) {
+        ret = posix_fadvise(block->metaFd, 0, 0, advice);
+    }
+    if (ret) {
+        fprintf(stderr, "localBlockAdvise: WARN: posix_fadvise(%d) failed "
+                "with error %d\n", advice, ret);
+    }
+    block->dropBehind = dropBehind;
+}
+
+/**
+ * Read whole chunks of a block and verify them.
+ *
+ * @param block         The block.
+ * @param chunk         The index of the first chunk to read.
+ * @param buf           (out param) Where to put the chunks.
+ * @param len           The length of the chunks, which is a multiple of the
+ *                      chunk size unless they end the block.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+static int readChunks(struct localBlock *block, int64_t chunk, char *buf,
+                      int32_t len)
+{
+    int32_t bpc = block->bytesPerChecksum;
+    int64_t numChunks = (len + bpc - 1) / bpc;
+    uint32_t *sums;
+    crc32_error_t err;
+    int ret;
+
+    ret = preadFully(block->dataFd, buf, len, chunk * bpc);
+    if (ret) {
+        return ret;
+    }
+    sums = malloc(numChunks * sizeof(uint32_t));
+    if (!sums) {
+        return ENOMEM;
+    }
+    ret = preadFully(block->metaFd, sums, numChunks * sizeof(uint32_t),
+                     META_HEADER_LEN + chunk * sizeof(uint32_t));
+    if (!ret) {
+        ret = bulk_verify_crc((const uint8_t *)buf, len, sums,
+                              block->crcType, bpc, &err);
+        if (ret == INVALID_CHECKSUM_DETECTED) {
+            fprintf(stderr, "localBlockRead: checksum error at block offset "
+                    "%" PRId64 ": got %08" PRIx32 ", expected %08" PRIx32
+                    "\n", chunk * bpc + (err.bad_data - (uint8_t *)buf),
+                    err.got_crc, err.expected_crc);
+            ret = EIO;
+        } else if (ret) {
+            ret = EINVAL;
+        }
+    }
+    free(sums);
+    return ret;
+}
+
+/**
+ * Read part of one chunk through a bounce buffer, since only whole chunks
+ * can be verified.
+ */
+static int readPartialChunk(struct localBlock *block, int64_t off, char *buf,
+                            int32_t len)
+{
+    int32_t bpc = block->bytesPerChecksum;
+    int64_t chunk = off / bpc;
+    int64_t chunkLen = block->length - chunk * bpc;
+    char *bounce;
+    int ret;
+
+    if (chunkLen > bpc) {
+        chunkLen = bpc;
+    }
+    bounce = malloc(chunkLen);
+    if (!bounce) {
+        return ENOMEM;
+    }
+    ret = readChunks(block, chunk, bounce, chunkLen);
+    if (!ret) {
+        memcpy(buf, bounce + (off - chunk * bpc), len);
+    }
+    free(bounce);
+    return ret;
+}
+
+int32_t localBlockRead(struct localBlock *block, int64_t off, void *buf,
+                       int32_t len)
+{
+    char *b = buf;
+    int64_t end, alignedStart, alignedEnd;
+    int32_t bpc = block->bytesPerChecksum, n;
+    int ret;
+
+    if (off < 0 || len < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (off >= block->length) {
+        return 0;
+    }
+    if (len > block->length - off) {
+        len = block->length - off;
+    }
+    end = off + len;
+    if (block->metaFd < 0) {
+        ret = preadFully(block->dataFd, buf, len, off);
+        goto done;
+    }
+    // Whole chunks go straight into buf; the partial chunks at either end,
+    // if any, go through a bounce buffer.  The last chunk of the block is
+    // whole even when it is short.
+    alignedStart = ((off + bpc - 1) / bpc) * bpc;
+    alignedEnd = (end == block->length) ? end : (end / bpc) * bpc;
+    if (alignedStart > alignedEnd) {
+        // Within a single chunk
+        ret = readPartialChunk(block, off, b, len);
+    } else {
+        ret = 0;
+        if (off < alignedStart) {
+            n = alignedStart - off;
+            ret = readPartialChunk(block, off, b, n);
+        }
+        if (!ret && alignedStart < alignedEnd) {
+            ret = readChunks(block, alignedStart / bpc,
+                             b + (alignedStart - off),
+                             alignedEnd - alignedStart);
+        }
+        if (!ret && alignedEnd < end) {
+            ret = readPartialChunk(block, alignedEnd, b + (alignedEnd - off),
+                                   end - alignedEnd);
+        }
+    }
+
+done:
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
+    if (block->dropBehind) {
+        // Only the pages wholly within the range are dropped, so a page
+        // shared with the next read stays cached for it
+        posix_fadvise(block->dataFd, off, len, POSIX_FADV_DONTNEED);
+    }
+    return len;
+}
@@ -0,0 +1,100 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBHDFS_LOCAL_BLOCK_H
+#define LIBHDFS_LOCAL_BLOCK_H
+
+/**
+ * Native reads of block replicas that live on this host.
+ *
+ * The JVM finds where a block's data and checksum files are, the same way
+ * short-circuit reads inside the JVM do; the data is then read and checked
+ * here with plain pread(2) calls, without copying it through the JVM.  The
+ * checksum file starts with a two byte version and the DataChecksum header,
+ * a one byte type and four byte chunk size, followed by one 32-bit
+ * big-endian checksum per chunk.
+ */
+
+#include <stdint.h>
+
+struct localBlock;
+
+/**
+ * Open the files of a local replica and read its checksum header.
+ *
+ * @param start         The offset in the HDFS file at which the block starts.
+ * @param length        The number of bytes of the file in the block.
+ * @param blockPath     The local path of the block file.
+ * @param metaPath      The local path of the checksum file, or NULL to read
+ *                      without verifying checksums.
+ * @param out           (out param) The opened block, with one reference.
+ *
+ * @return              0 on success; an errno value otherwise
+ */
+int localBlockOpen(int64_t start, int64_t length, const char *blockPath,
+                   const char *metaPath, struct localBlock **out);
+
+/**
+ * @return              The offset in the HDFS file at which the block starts.
+ */
+int64_t localBlockStart(const struct localBlock *block);
+
+/**
+ * @return              The number of bytes of the file in the block.
+ */
+int64_t localBlockLength(const struct localBlock *block);
+
+/**
+ * Take another reference to a block.
+ */
+void localBlockRef(struct localBlock *block);
+
+/**
+ * Drop a reference to a block, closing its files with the last one.
+ */
+void localBlockUnref(struct localBlock *block);
+
+/**
+ * Tell the kernel how a block is going to be read.  Call it before the
+ * block is shared with other threads.
+ *
+ * @param block         The block.
+ * @param advice        A posix_fadvise(2) advice for the whole block file,
+ *                      such as POSIX_FADV_SEQUENTIAL.
+ * @param dropBehind    Nonzero to drop the data of each read from the page
+ *                      cache once it has been copied out.
+ */
+void localBlockAdvise(struct localBlock *block, int advice, int dropBehind);
+
+/**
+ * Read from a block, verifying the checksums of every chunk read.  Blocks
+ * may be read from several threads at once.
+ *
+ * @param block         The block.
+ * @param off           The offset within the block to read from.
+ * @param buf           (out param) Where to put the data.
+ * @param len           The most bytes to read.
+ *
+ * @return              The number of bytes read, which is less than len only
+ *                      at the end of the block; -1 on error, with errno set.
+ *                      A checksum mismatch is reported as EIO.
+ */
+int32_t localBlockRead(struct localBlock *block, int64_t off, void *buf,
+                       int32_t len);
+
+#endif
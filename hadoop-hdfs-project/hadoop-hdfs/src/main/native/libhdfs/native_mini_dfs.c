@@ -22,8 +22,10 @@
 
 #include <errno.h>
 #include <jni.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #define MINIDFS_CLUSTER_BUILDER "org/apache/hadoop/hdfs/MiniDFSCluster$Builder"
 #define MINIDFS_CLUSTER "org/apache/hadoop/hdfs/MiniDFSCluster"
@@ -36,6 +38,28 @@ struct NativeMiniDfsCluster {
     jobject obj;
 };
 
+static jthrowable nmdConfSetStr(JNIEnv *env, jobject cobj, const char *key,
+                                const char *value)
+{
+    jthrowable jthr;
+    jstring jkey = NULL, jvalue = NULL;
+
+    jthr = newJavaStr(env, key, &jkey);
+    if (jthr)
+        goto done;
+    jthr = newJavaStr(env, value, &jvalue);
+    if (jthr)
+        goto done;
+    jthr = invokeMethod(env, NULL, INSTANCE, cobj, HADOOP_CONF,
+            "set", "(Ljava/lang/String;Ljava/lang/String;)V", jkey, jvalue);
+done:
+    if (jkey)
+        (*env)->DeleteLocalRef(env, jkey);
+    if (jvalue)
+        (*env)->DeleteLocalRef(env, jvalue);
+    return jthr;
+}
+
 struct NativeMiniDfsCluster* nmdCreate(struct NativeMiniDfsConf *conf)
 {
     struct NativeMiniDfsCluster* cl = NULL;
@@ -59,6 +83,20 @@ struct NativeMiniDfsCluster* nmdCreate(struct NativeMiniDfsConf *conf)
             "nmdCreate: new Configuration");
         goto error_free_cl;
     }
+    if (conf->configureShortCircuit) {
+        struct passwd *pw = getpwuid(geteuid());
+        if (!pw) {
+            fprintf(stderr, "nmdCreate: getpwuid failed\n");
+            goto error_dlr_cobj;
+        }
+        jthr = nmdConfSetStr(env, cobj, "dfs.block.local-path-access.user",
+                             pw->pw_name);
+        if (jthr) {
+            printExceptionAndFree(env, jthr, PRINT_EXC_ALL,
+                "nmdCreate: Configuration#set");
+            goto error_dlr_cobj;
+        }
+    }
     jthr = constructNewObjectOfClass(env, &bld, MINIDFS_CLUSTER_BUILDER,
                     "(L"HADOOP_CONF";)V", cobj);
     if (jthr) {
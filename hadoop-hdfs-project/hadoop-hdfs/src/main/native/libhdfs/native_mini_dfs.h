@@ -31,6 +31,11 @@ struct NativeMiniDfsConf {
      * Nonzero if the cluster should be formatted prior to startup
      */
     jboolean doFormat;
+    /**
+     * Nonzero if the datanodes should let the current user read block files
+     * directly, for short-circuit reads
+     */
+    jboolean configureShortCircuit;
 };
 
 /**
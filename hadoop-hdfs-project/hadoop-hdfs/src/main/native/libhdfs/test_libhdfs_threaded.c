@@ -22,11 +22,13 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <semaphore.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define TO_STR_HELPER(X) #X
 #define TO_STR(X) TO_STR_HELPER(X)
@@ -48,7 +50,8 @@ struct tlhThreadInfo {
     pthread_t thread;
 };
 
-static int hdfsSingleNameNodeConnect(struct NativeMiniDfsCluster *cl, hdfsFS *fs)
+static int hdfsSingleNameNodeConnect(struct NativeMiniDfsCluster *cl, hdfsFS *fs,
+                                     int readCaches, int nativeLocal)
 {
     int ret, port;
     hdfsFS hdfs;
@@ -70,6 +73,22 @@ static int hdfsSingleNameNodeConnect(struct NativeMiniDfsCluster *cl, hdfsFS *fs
                           TO_STR(TLH_DEFAULT_BLOCK_SIZE));
     hdfsBuilderConfSetStr(bld, "dfs.blocksize",
                           TO_STR(TLH_DEFAULT_BLOCK_SIZE));
+    hdfsBuilderConfSetStr(bld, HDFS_METRICS_ENABLED_KEY, "true");
+    if (readCaches) {
+        /* Small enough that the test files span several buffers */
+        hdfsBuilderConfSetStr(bld, HDFS_READAHEAD_WINDOW_KEY, "5");
+        hdfsBuilderConfSetStr(bld, HDFS_BLOCK_CACHE_SIZE_KEY, "1048576");
+        hdfsBuilderConfSetStr(bld, HDFS_BLOCK_CACHE_BLOCK_SIZE_KEY, "16");
+        /* Long enough that only invalidation can make the tests pass */
+        hdfsBuilderConfSetStr(bld, HDFS_EXISTS_CACHE_TTL_MS_KEY, "600000");
+        /* Short enough that some preads are hedged */
+        hdfsBuilderConfSetStr(bld, HDFS_HEDGED_READ_THRESHOLD_MS_KEY, "1");
+        hdfsBuilderConfSetStr(bld, HDFS_HEDGED_READ_THREADS_KEY, "4");
+    }
+    if (nativeLocal) {
+        hdfsBuilderConfSetStr(bld, "dfs.client.read.shortcircuit", "true");
+        hdfsBuilderConfSetStr(bld, HDFS_NATIVE_LOCAL_READ_KEY, "true");
+    }
     hdfs = hdfsBuilderConnect(bld);
     if (!hdfs) {
         ret = -errno;
@@ -110,11 +129,490 @@ static int doTestGetDefaultBlockSize(hdfsFS fs, const char *path)
     return 0;
 }
 
+static int doTestPreadv(hdfsFS fs, const char *path,
+                        const char *contents, int expected)
+{
+    hdfsFile file;
+    char buf[3][256];
+    struct hdfsReadRange ranges[3];
+
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    memset(buf, 0, sizeof(buf));
+    /* Out of order and overlapping, so that they get merged */
+    ranges[0].offset = 2;
+    ranges[0].length = expected - 2;
+    ranges[0].buffer = buf[0];
+    ranges[1].offset = 0;
+    ranges[1].length = 3;
+    ranges[1].buffer = buf[1];
+    ranges[2].offset = expected - 1;
+    ranges[2].length = 1;
+    ranges[2].buffer = buf[2];
+    EXPECT_ZERO(hdfsPreadv(fs, file, ranges, 3));
+    EXPECT_ZERO(memcmp(contents + 2, buf[0], expected - 2));
+    EXPECT_ZERO(memcmp(contents, buf[1], 3));
+    EXPECT_ZERO(memcmp(contents + expected - 1, buf[2], 1));
+    EXPECT_ZERO(hdfsTell(fs, file));
+
+    /* A range past the end of the file can't be filled */
+    ranges[2].length = 2;
+    EXPECT_NEGATIVE_ONE_WITH_ERRNO(hdfsPreadv(fs, file, ranges, 3), EIO);
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+static int doTestAsyncPread(hdfsFS fs, const char *path,
+                            const char *contents, int expected)
+{
+    struct hdfsAsyncPool *pool;
+    struct hdfsAsyncCompletion completions[2];
+    struct pollfd pfd;
+    hdfsFile file;
+    char buf[2][256];
+    int i, reaped = 0;
+
+    pool = hdfsAsyncPoolCreate(2, 16, NULL, NULL);
+    EXPECT_NONNULL(pool);
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    EXPECT_ZERO(hdfsAsyncPread(pool, fs, file, 0, buf[0], expected, buf[0]));
+    EXPECT_ZERO(hdfsAsyncPread(pool, fs, file, 1, buf[1], expected - 1,
+                               buf[1]));
+    while (reaped < 2) {
+        pfd.fd = hdfsAsyncPoolGetFd(pool);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        EXPECT_INT_EQ(1, poll(&pfd, 1, 60000));
+        reaped += hdfsAsyncPoolReap(pool, completions + reaped, 2 - reaped);
+    }
+    for (i = 0; i < 2; i++) {
+        EXPECT_ZERO(completions[i].error);
+        if (completions[i].tag == buf[0]) {
+            EXPECT_INT_EQ(expected, completions[i].result);
+        } else {
+            EXPECT_INT_EQ(expected - 1, completions[i].result);
+        }
+    }
+    EXPECT_ZERO(memcmp(contents, buf[0], expected));
+    EXPECT_ZERO(memcmp(contents + 1, buf[1], expected - 1));
+    hdfsAsyncPoolDestroy(pool);
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+static int doTestSmallReads(hdfsFS fs, const char *path,
+                            const char *contents, int expected)
+{
+    hdfsFile file;
+    char buf[256];
+    int ret, done = 0;
+
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    while (done < expected) {
+        ret = hdfsRead(fs, file, buf + done, 3);
+        if (ret <= 0) {
+            fprintf(stderr, "hdfsRead returned %d after %d bytes\n", ret,
+                    done);
+            return EIO;
+        }
+        done += ret;
+        EXPECT_INT_EQ(done, (int)hdfsTell(fs, file));
+    }
+    EXPECT_ZERO(hdfsRead(fs, file, buf, 3));
+    EXPECT_ZERO(memcmp(contents, buf, expected));
+
+    /* Seeking back drops anything buffered */
+    EXPECT_ZERO(hdfsSeek(fs, file, 1));
+    EXPECT_INT_EQ(2, hdfsRead(fs, file, buf, 2));
+    EXPECT_ZERO(memcmp(contents + 1, buf, 2));
+    EXPECT_INT_EQ(3, (int)hdfsTell(fs, file));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+static int doTestOpenWithOptions(hdfsFS fs, const char *path,
+                                 const char *contents, int expected)
+{
+    struct hdfsOpenOptions opts;
+    hdfsFile file;
+    char buf[256];
+    int ret, done = 0;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.readahead = -2;
+    EXPECT_NULL(hdfsOpenFileWithOptions(fs, path, O_RDONLY, 0, 0, 0, &opts));
+    EXPECT_INT_EQ(EINVAL, errno);
+
+    /* A sequential scan that drops what it has read */
+    opts.pattern = HDFS_ACCESS_SEQUENTIAL;
+    opts.readahead = 2;
+    opts.dropBehind = 1;
+    file = hdfsOpenFileWithOptions(fs, path, O_RDONLY, 0, 0, 0, &opts);
+    EXPECT_NONNULL(file);
+    while (done < expected) {
+        ret = hdfsRead(fs, file, buf + done, 3);
+        if (ret <= 0) {
+            fprintf(stderr, "hdfsRead returned %d after %d bytes\n", ret,
+                    done);
+            return EIO;
+        }
+        done += ret;
+    }
+    EXPECT_ZERO(memcmp(contents, buf, expected));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+
+    /* Random preads, without any read-ahead buffer */
+    memset(&opts, 0, sizeof(opts));
+    opts.pattern = HDFS_ACCESS_RANDOM;
+    file = hdfsOpenFileWithOptions(fs, path, O_RDONLY, 0, 0, 0, &opts);
+    EXPECT_NONNULL(file);
+    EXPECT_INT_EQ(2, hdfsPread(fs, file, expected - 2, buf, 2));
+    EXPECT_ZERO(memcmp(contents + expected - 2, buf, 2));
+    EXPECT_INT_EQ(1, hdfsPread(fs, file, 0, buf, 1));
+    EXPECT_ZERO(memcmp(contents, buf, 1));
+    EXPECT_INT_EQ(expected, hdfsRead(fs, file, buf, sizeof(buf)));
+    EXPECT_ZERO(memcmp(contents, buf, expected));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+#define TLH_PART_SIZE 4096
+
+static int writeFilledPart(hdfsFS fs, struct hdfsParallelWriter *w,
+                           int part, int len)
+{
+    char buf[TLH_PART_SIZE];
+    hdfsFile file;
+
+    file = hdfsParallelWriterPart(w, part);
+    EXPECT_NONNULL(file);
+    memset(buf, 'a' + part, len);
+    EXPECT_INT_EQ(len, hdfsWrite(fs, file, buf, len));
+    return 0;
+}
+
+struct tlhWalkCounts {
+    pthread_mutex_t lock;
+    int dirs;
+    int files;
+    int maxDepth;
+};
+
+static int walkCount(const hdfsFileInfo *info, int depth, void *arg)
+{
+    struct tlhWalkCounts *counts = arg;
+    const char *slash = strrchr(info->mName, '/');
+
+    pthread_mutex_lock(&counts->lock);
+    if (info->mKind == kObjectKindDirectory) {
+        counts->dirs++;
+    } else {
+        counts->files++;
+    }
+    if (depth > counts->maxDepth) {
+        counts->maxDepth = depth;
+    }
+    pthread_mutex_unlock(&counts->lock);
+    return (slash && !strcmp(slash, "/skip")) ? HDFS_WALK_SKIP :
+        HDFS_WALK_CONTINUE;
+}
+
+static int doTestWalk(hdfsFS fs, const char *root)
+{
+    struct tlhWalkCounts counts;
+    char path[256];
+    hdfsFile file;
+    int i, j;
+
+    /* root, 3 subdirectories of 2 files each, and one that is skipped */
+    EXPECT_ZERO(hdfsCreateDirectory(fs, root));
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 2; j++) {
+            snprintf(path, sizeof(path), "%s/d%d/f%d", root, i, j);
+            file = hdfsOpenFile(fs, path, O_WRONLY, 0, 0, 0);
+            EXPECT_NONNULL(file);
+            EXPECT_ZERO(hdfsCloseFile(fs, file));
+        }
+    }
+    snprintf(path, sizeof(path), "%s/skip/d", root);
+    EXPECT_ZERO(hdfsCreateDirectory(fs, path));
+
+    memset(&counts, 0, sizeof(counts));
+    pthread_mutex_init(&counts.lock, NULL);
+    EXPECT_ZERO(hdfsWalk(fs, root, 4, -1, walkCount, &counts));
+    EXPECT_INT_EQ(5, counts.dirs);
+    EXPECT_INT_EQ(6, counts.files);
+    EXPECT_INT_EQ(2, counts.maxDepth);
+
+    memset(&counts, 0, sizeof(counts));
+    EXPECT_ZERO(hdfsWalk(fs, root, 1, 1, walkCount, &counts));
+    EXPECT_INT_EQ(5, counts.dirs);
+    EXPECT_ZERO(counts.files);
+    EXPECT_INT_EQ(1, counts.maxDepth);
+    pthread_mutex_destroy(&counts.lock);
+
+    snprintf(path, sizeof(path), "%s/missing", root);
+    EXPECT_NONZERO(hdfsWalk(fs, path, 4, -1, walkCount, &counts));
+    EXPECT_INT_EQ(ENOENT, errno);
+    return 0;
+}
+
+static int doTestParallelWriter(hdfsFS fs, const char *path)
+{
+    struct hdfsParallelWriter *w;
+    hdfsFileInfo *fileInfo;
+    hdfsFile file;
+    char buf[2];
+
+    /* Part size must be a multiple of the block size */
+    EXPECT_NULL(hdfsParallelWriterOpen(fs, path, 3, TLH_PART_SIZE + 1, 0,
+                                       TLH_PART_SIZE));
+    EXPECT_INT_EQ(EINVAL, errno);
+
+    /* Parts can be written in any order; the fourth stays empty */
+    w = hdfsParallelWriterOpen(fs, path, 4, TLH_PART_SIZE, 0,
+                               TLH_PART_SIZE);
+    EXPECT_NONNULL(w);
+    EXPECT_NULL(hdfsParallelWriterPart(w, 4));
+    EXPECT_ZERO(writeFilledPart(fs, w, 2, 10));
+    EXPECT_ZERO(writeFilledPart(fs, w, 0, TLH_PART_SIZE));
+    EXPECT_ZERO(writeFilledPart(fs, w, 1, TLH_PART_SIZE));
+    EXPECT_ZERO(hdfsParallelWriterClose(w));
+    fileInfo = hdfsGetPathInfo(fs, path);
+    EXPECT_NONNULL(fileInfo);
+    EXPECT_INT_EQ(2 * TLH_PART_SIZE + 10, fileInfo->mSize);
+    hdfsFreeFileInfo(fileInfo, 1);
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    EXPECT_INT_EQ(2, hdfsPread(fs, file, TLH_PART_SIZE - 1, buf, 2));
+    EXPECT_ZERO(memcmp("ab", buf, 2));
+    EXPECT_INT_EQ(2, hdfsPread(fs, file, 2 * TLH_PART_SIZE - 1, buf, 2));
+    EXPECT_ZERO(memcmp("bc", buf, 2));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    EXPECT_ZERO(hdfsDelete(fs, path, 0));
+
+    /* A short part followed by a non-empty one leaves nothing behind */
+    w = hdfsParallelWriterOpen(fs, path, 2, TLH_PART_SIZE, 0,
+                               TLH_PART_SIZE);
+    EXPECT_NONNULL(w);
+    EXPECT_ZERO(writeFilledPart(fs, w, 0, 10));
+    EXPECT_ZERO(writeFilledPart(fs, w, 1, 10));
+    EXPECT_NONZERO(hdfsParallelWriterClose(w));
+    EXPECT_INT_EQ(EINVAL, errno);
+    EXPECT_NONZERO(hdfsExists(fs, path));
+    return 0;
+}
+
+/**
+ * Writes on a file with group commit are numbered, and waiting for a
+ * number means the data up to it can be read.
+ */
+static int doTestGroupCommit(hdfsFS fs, const char *path)
+{
+    hdfsFile file, reader;
+    int64_t seq1, seq2;
+    char buf[8];
+
+    file = hdfsOpenFile(fs, path, O_WRONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    EXPECT_ZERO(hdfsFileEnableGroupCommit(fs, file, 1000));
+    EXPECT_NONZERO(hdfsFileEnableGroupCommit(fs, file, 1000));
+    EXPECT_INT_EQ(EBUSY, errno);
+    seq1 = hdfsGroupCommitWrite(fs, file, "abc", 3);
+    EXPECT_INT_EQ(3, (int)seq1);
+    seq2 = hdfsGroupCommitWrite(fs, file, "de", 2);
+    EXPECT_INT_EQ(5, (int)seq2);
+    EXPECT_NONZERO(hdfsGroupCommitWait(fs, file, seq2 + 1, 0));
+    EXPECT_INT_EQ(EINVAL, errno);
+    EXPECT_ZERO(hdfsGroupCommitWait(fs, file, seq1, 0));
+    EXPECT_ZERO(hdfsGroupCommitWait(fs, file, seq2, 1));
+    reader = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(reader);
+    EXPECT_INT_EQ(5, hdfsPread(fs, reader, 0, buf, sizeof(buf)));
+    EXPECT_ZERO(memcmp("abcde", buf, 5));
+    EXPECT_ZERO(hdfsCloseFile(fs, reader));
+    /* Plain writes and hflushes go through the flusher too */
+    EXPECT_INT_EQ(1, hdfsWrite(fs, file, "f", 1));
+    EXPECT_ZERO(hdfsHFlush(fs, file));
+    EXPECT_INT_EQ(7, (int)hdfsGroupCommitWrite(fs, file, "g", 1));
+    EXPECT_ZERO(hdfsHSync(fs, file));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    EXPECT_ZERO(hdfsDelete(fs, path, 0));
+    return 0;
+}
+
+/**
+ * Creating, renaming and deleting a path through the same connection is
+ * seen at once by hdfsExists and hdfsGetPathInfo, whether or not they are
+ * cached.
+ */
+static int doTestExistsCache(hdfsFS fs, const char *dir)
+{
+    char path[256], renamed[256], child[256];
+    hdfsFileInfo *fileInfo;
+    hdfsFile file;
+
+    snprintf(path, sizeof(path), "%s/exists", dir);
+    snprintf(renamed, sizeof(renamed), "%s/exists.renamed", dir);
+    snprintf(child, sizeof(child), "%s/exists.renamed/child", dir);
+    EXPECT_NONZERO(hdfsExists(fs, path));
+    EXPECT_INT_EQ(ENOENT, errno);
+    EXPECT_NULL(hdfsGetPathInfo(fs, path));
+    EXPECT_INT_EQ(ENOENT, errno);
+    file = hdfsOpenFile(fs, path, O_WRONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    EXPECT_ZERO(hdfsExists(fs, path));
+    fileInfo = hdfsGetPathInfo(fs, path);
+    EXPECT_NONNULL(fileInfo);
+    hdfsFreeFileInfo(fileInfo, 1);
+    EXPECT_NONZERO(hdfsExists(fs, renamed));
+    EXPECT_ZERO(hdfsRename(fs, path, renamed));
+    EXPECT_NONZERO(hdfsExists(fs, path));
+    EXPECT_ZERO(hdfsExists(fs, renamed));
+    EXPECT_ZERO(hdfsDelete(fs, renamed, 0));
+    EXPECT_NONZERO(hdfsExists(fs, renamed));
+    /* Making a directory makes its parents */
+    EXPECT_NONZERO(hdfsExists(fs, child));
+    EXPECT_ZERO(hdfsCreateDirectory(fs, child));
+    EXPECT_ZERO(hdfsExists(fs, renamed));
+    EXPECT_ZERO(hdfsExists(fs, child));
+    /* ... and deleting one deletes its children */
+    EXPECT_ZERO(hdfsDelete(fs, renamed, 1));
+    EXPECT_NONZERO(hdfsExists(fs, child));
+    EXPECT_INT_EQ(ENOENT, errno);
+    return 0;
+}
+
+static int expectPread(hdfsFS fs, const char *path, const char *contents)
+{
+    hdfsFile file;
+    char buf[64];
+    int len = strlen(contents);
+
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    /* Less than the test block cache block size, so it is cached */
+    EXPECT_INT_EQ(len, hdfsPread(fs, file, 0, buf, len + 1));
+    EXPECT_ZERO(memcmp(contents, buf, len));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+static int writeAndPread(hdfsFS fs, const char *path, const char *contents)
+{
+    hdfsFile file;
+    int len = strlen(contents);
+
+    file = hdfsOpenFile(fs, path, O_WRONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    EXPECT_INT_EQ(len, hdfsWrite(fs, file, contents, len));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return expectPread(fs, path, contents);
+}
+
+/**
+ * A file that is rewritten, or replaced by a rename, is read afresh by the
+ * next open, whether or not preads go through the block cache.
+ */
+static int doTestBlockCacheReplace(hdfsFS fs, const char *dir)
+{
+    char path[256], other[256];
+
+    snprintf(path, sizeof(path), "%s/cached", dir);
+    snprintf(other, sizeof(other), "%s/cached.other", dir);
+    EXPECT_ZERO(writeAndPread(fs, path, "first"));
+    EXPECT_ZERO(writeAndPread(fs, path, "second"));
+    /* Same length, new contents */
+    EXPECT_ZERO(writeAndPread(fs, path, "SECOND"));
+    EXPECT_ZERO(writeAndPread(fs, other, "renamed"));
+    EXPECT_ZERO(hdfsDelete(fs, path, 0));
+    EXPECT_ZERO(hdfsRename(fs, other, path));
+    EXPECT_ZERO(expectPread(fs, path, "renamed"));
+    EXPECT_ZERO(hdfsDelete(fs, path, 0));
+    return 0;
+}
+
+static int doTestReadZeroCopy(hdfsFS fs, const char *path,
+                              const char *contents, int expected)
+{
+    hdfsFile file;
+    const void *data;
+    struct hdfsZeroCopyBuffer *buffer;
+    int ret;
+
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    ret = hdfsReadZeroCopy(fs, file, HDFS_ZERO_COPY_BUFFER_SIZE * 2,
+                           &data, &buffer);
+    if (ret < 0) {
+        ret = errno;
+        fprintf(stderr, "hdfsReadZeroCopy failed and set errno %d\n", ret);
+        return ret;
+    }
+    if (ret != expected) {
+        fprintf(stderr, "hdfsReadZeroCopy was supposed to read %d bytes, "
+                "but it read %d\n", expected, ret);
+        return EIO;
+    }
+    EXPECT_NONNULL(buffer);
+    EXPECT_ZERO(memcmp(contents, data, expected));
+    hdfsReleaseZeroCopy(buffer);
+
+    /* At end of file there is no buffer to release */
+    EXPECT_ZERO(hdfsReadZeroCopy(fs, file, expected, &data, &buffer));
+    EXPECT_NULL(buffer);
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    return 0;
+}
+
+static int doTestReadPoolBuffer(hdfsFS fs, const char *path,
+                                const char *contents, int expected)
+{
+    struct hdfsBufferPool *pool;
+    hdfsFile file;
+    void *buf, *again;
+    int ret;
+
+    pool = hdfsBufferPoolCreate(expected, 1);
+    EXPECT_NONNULL(pool);
+    buf = hdfsBufferPoolGet(pool);
+    EXPECT_NONNULL(buf);
+    EXPECT_ZERO((int)((uintptr_t)buf % sysconf(_SC_PAGESIZE)));
+    file = hdfsOpenFile(fs, path, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    /* Longer than the buffer, so shortened */
+    ret = hdfsReadPoolBuffer(fs, file, buf, 1 << 30);
+    if (ret < 0) {
+        ret = errno;
+        fprintf(stderr, "hdfsReadPoolBuffer failed and set errno %d\n", ret);
+        return ret;
+    }
+    EXPECT_INT_EQ(expected, ret);
+    EXPECT_ZERO(memcmp(contents, buf, expected));
+    EXPECT_ZERO(hdfsReadPoolBuffer(fs, file, buf, expected));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+    hdfsBufferPoolRelease(pool, buf);
+    /* The thread gets its own buffer back */
+    again = hdfsBufferPoolGet(pool);
+    EXPECT_INT_EQ(1, again == buf);
+    hdfsBufferPoolRelease(pool, again);
+    hdfsBufferPoolDestroy(pool);
+    return 0;
+}
+
 static int doTestHdfsOperations(struct tlhThreadInfo *ti, hdfsFS fs)
 {
-    char prefix[256], tmp[256];
+    char prefix[256], tmp[256], missing[256], copy[256];
+    const char *batchPaths[3];
     hdfsFile file;
-    int ret, expected;
+    hdfsDir dir;
+    struct hdfsBlockLocation *blocks;
+    struct hdfsReadStatistics readStats;
+    struct hdfsOpMetrics metrics[HDFS_METRICS_NUM_OPS];
+    int ret, expected, numEntries, seen;
     hdfsFileInfo *fileInfo;
 
     snprintf(prefix, sizeof(prefix), "/tlhData%04d", ti->threadIdx);
@@ -129,6 +627,9 @@ static int doTestHdfsOperations(struct tlhThreadInfo *ti, hdfsFS fs)
 
     /* There should not be any file to open for reading. */
     EXPECT_NULL(hdfsOpenFile(fs, tmp, O_RDONLY, 0, 0, 0));
+    EXPECT_INT_EQ(ENOENT, errno);
+    EXPECT_NULL(hdfsGetPathInfo(fs, tmp));
+    EXPECT_INT_EQ(ENOENT, errno);
 
     /* hdfsOpenFile should not accept mode = 3 */
     EXPECT_NULL(hdfsOpenFile(fs, tmp, 3, 0, 0, 0));
@@ -169,7 +670,55 @@ static int doTestHdfsOperations(struct tlhThreadInfo *ti, hdfsFS fs)
         return EIO;
     }
     EXPECT_ZERO(memcmp(prefix, tmp, expected));
+    /* The mini cluster's datanode is on this host */
+    EXPECT_ZERO(hdfsFileGetReadStatistics(file, &readStats));
+    EXPECT_NONZERO(readStats.totalBytesRead);
+    EXPECT_INT_EQ((int)readStats.totalBytesRead,
+                  (int)readStats.totalLocalBytesRead);
+    EXPECT_ZERO(readStats.totalRemoteBytesRead);
+    if (ti->threadIdx % 3 == 2) {
+        EXPECT_INT_EQ((int)readStats.totalBytesRead,
+                      (int)readStats.totalShortCircuitBytesRead);
+    }
     EXPECT_ZERO(hdfsCloseFile(fs, file));
+    EXPECT_ZERO(hdfsGetMetrics(metrics));
+    EXPECT_NONZERO(metrics[HDFS_METRICS_OP_CONNECT].count);
+    EXPECT_NONZERO(metrics[HDFS_METRICS_OP_READ].count);
+    EXPECT_NONZERO(metrics[HDFS_METRICS_OP_READ].bytes);
+    EXPECT_NONZERO(metrics[HDFS_METRICS_OP_WRITE].bytes);
+    EXPECT_NONZERO(metrics[HDFS_METRICS_OP_READ].maxNs);
+
+    /* hdfsPread should not move the file offset */
+    snprintf(tmp, sizeof(tmp), "%s/file", prefix);
+    file = hdfsOpenFile(fs, tmp, O_RDONLY, 0, 0, 0);
+    EXPECT_NONNULL(file);
+    memset(tmp, 0, sizeof(tmp));
+    ret = hdfsPread(fs, file, 1, tmp, sizeof(tmp));
+    if (ret < 0) {
+        ret = errno;
+        fprintf(stderr, "hdfsPread failed and set errno %d\n", ret);
+        return ret;
+    }
+    if (ret != expected - 1) {
+        fprintf(stderr, "hdfsPread was supposed to read %d bytes, but "
+                "it read %d\n", expected - 1, ret);
+        return EIO;
+    }
+    EXPECT_ZERO(memcmp(prefix + 1, tmp, expected - 1));
+    EXPECT_ZERO(hdfsTell(fs, file));
+    EXPECT_ZERO(hdfsFileGetReadStatistics(file, &readStats));
+    EXPECT_NONNEGATIVE((int)(readStats.hedgedReadOps -
+                             readStats.hedgedReadWins));
+    EXPECT_ZERO(hdfsCloseFile(fs, file));
+
+    /* Read it again through the zero-copy interface */
+    snprintf(tmp, sizeof(tmp), "%s/file", prefix);
+    EXPECT_ZERO(doTestReadZeroCopy(fs, tmp, prefix, expected));
+    EXPECT_ZERO(doTestReadPoolBuffer(fs, tmp, prefix, expected));
+    EXPECT_ZERO(doTestPreadv(fs, tmp, prefix, expected));
+    EXPECT_ZERO(doTestAsyncPread(fs, tmp, prefix, expected));
+    EXPECT_ZERO(doTestSmallReads(fs, tmp, prefix, expected));
+    EXPECT_ZERO(doTestOpenWithOptions(fs, tmp, prefix, expected));
 
     // TODO: Non-recursive delete should fail?
     //EXPECT_NONZERO(hdfsDelete(fs, prefix, 0));
@@ -196,6 +745,70 @@ static int doTestHdfsOperations(struct tlhThreadInfo *ti, hdfsFS fs)
     EXPECT_ZERO(strcmp("doop2", fileInfo->mGroup));
     hdfsFreeFileInfo(fileInfo, 1);
 
+    /* The file is smaller than a block */
+    blocks = hdfsGetBlockLocations(fs, tmp, 0, expected, &numEntries);
+    EXPECT_NONNULL(blocks);
+    EXPECT_INT_EQ(1, numEntries);
+    EXPECT_ZERO(blocks[0].offset);
+    EXPECT_INT_EQ(expected, blocks[0].length);
+    EXPECT_INT_EQ(1, blocks[0].numHosts);
+    EXPECT_NONNULL(blocks[0].hosts[0]);
+    EXPECT_NULL(blocks[0].hosts[1]);
+    EXPECT_NONNULL(blocks[0].names[0]);
+    hdfsFreeBlockLocations(blocks, numEntries);
+
+    /* Look up the file, a missing path and the directory in one call */
+    snprintf(missing, sizeof(missing), "%s/nosuchfile", prefix);
+    batchPaths[0] = tmp;
+    batchPaths[1] = missing;
+    batchPaths[2] = prefix;
+    fileInfo = hdfsGetPathInfoBatch(fs, batchPaths, 3);
+    EXPECT_NONNULL(fileInfo);
+    EXPECT_INT_EQ(kObjectKindFile, fileInfo[0].mKind);
+    EXPECT_INT_EQ(expected, fileInfo[0].mSize);
+    EXPECT_ZERO(strcmp("ha2", fileInfo[0].mOwner));
+    EXPECT_NULL(fileInfo[1].mName);
+    EXPECT_INT_EQ(kObjectKindDirectory, fileInfo[2].mKind);
+    hdfsFreeFileInfo(fileInfo, 3);
+
+    snprintf(copy, sizeof(copy), "%s/parts", prefix);
+    EXPECT_ZERO(doTestParallelWriter(fs, copy));
+    snprintf(copy, sizeof(copy), "%s/events", prefix);
+    EXPECT_ZERO(doTestGroupCommit(fs, copy));
+    EXPECT_ZERO(doTestExistsCache(fs, prefix));
+    EXPECT_ZERO(doTestBlockCacheReplace(fs, prefix));
+    snprintf(copy, sizeof(copy), "%s/walk", prefix);
+    EXPECT_ZERO(doTestWalk(fs, copy));
+
+    /* Copy and move within the cluster */
+    snprintf(copy, sizeof(copy), "%s/copy", prefix);
+    EXPECT_ZERO(hdfsCopy(fs, tmp, fs, copy));
+    fileInfo = hdfsGetPathInfo(fs, copy);
+    EXPECT_NONNULL(fileInfo);
+    EXPECT_INT_EQ(expected, fileInfo->mSize);
+    hdfsFreeFileInfo(fileInfo, 1);
+    EXPECT_NONZERO(hdfsCopy(fs, tmp, fs, copy));
+    snprintf(missing, sizeof(missing), "%s/moved", prefix);
+    EXPECT_ZERO(hdfsMove(fs, copy, fs, missing));
+    EXPECT_NONZERO(hdfsExists(fs, copy));
+    EXPECT_ZERO(hdfsExists(fs, missing));
+
+    /* Listing a batch at a time should see what hdfsListDirectory sees */
+    fileInfo = hdfsListDirectory(fs, prefix, &numEntries);
+    EXPECT_NONNULL(fileInfo);
+    hdfsFreeFileInfo(fileInfo, numEntries);
+    dir = hdfsOpenDir(fs, prefix);
+    EXPECT_NONNULL(dir);
+    for (seen = 0; (ret = hdfsReadDirBatch(dir, 1, &fileInfo)) > 0; ) {
+        EXPECT_INT_EQ(1, ret);
+        EXPECT_NONNULL(fileInfo[0].mName);
+        hdfsFreeFileInfo(fileInfo, ret);
+        seen += ret;
+    }
+    EXPECT_ZERO(ret);
+    hdfsCloseDir(dir);
+    EXPECT_INT_EQ(numEntries, seen);
+
     EXPECT_ZERO(hdfsDelete(fs, prefix, 1));
     return 0;
 }
@@ -208,7 +821,9 @@ static void *testHdfsOperations(void *v)
 
     fprintf(stderr, "testHdfsOperations(threadIdx=%d): starting\n",
         ti->threadIdx);
-    ret = hdfsSingleNameNodeConnect(tlhCluster, &fs);
+    /* Half of the threads run with the client-side read caches enabled */
+    ret = hdfsSingleNameNodeConnect(tlhCluster, &fs, ti->threadIdx % 2,
+                                    ti->threadIdx % 3 == 2);
     if (ret) {
         fprintf(stderr, "testHdfsOperations(threadIdx=%d): "
             "hdfsSingleNameNodeConnect failed with error %d.\n",
@@ -225,6 +840,39 @@ static void *testHdfsOperations(void *v)
     return NULL;
 }
 
+static hdfsFS sharedConnect(struct NativeMiniDfsCluster *cl)
+{
+    struct hdfsBuilder *bld;
+
+    bld = hdfsNewBuilder();
+    if (!bld)
+        return NULL;
+    hdfsBuilderSetForceNewInstance(bld);
+    hdfsBuilderSetShared(bld);
+    hdfsBuilderSetNameNode(bld, "localhost");
+    hdfsBuilderSetNameNodePort(bld, nmdGetNameNodePort(cl));
+    return hdfsBuilderConnect(bld);
+}
+
+/**
+ * Shared connections with the same settings are one connection, which
+ * stays usable until the last of them is disconnected.
+ */
+static int doTestSharedConnect(struct NativeMiniDfsCluster *cl)
+{
+    hdfsFS fs1, fs2;
+
+    fs1 = sharedConnect(cl);
+    EXPECT_NONNULL(fs1);
+    fs2 = sharedConnect(cl);
+    EXPECT_NONNULL(fs2);
+    EXPECT_NONZERO(fs1 == fs2);
+    EXPECT_ZERO(hdfsDisconnect(fs1));
+    EXPECT_ZERO(hdfsExists(fs2, "/"));
+    EXPECT_ZERO(hdfsDisconnect(fs2));
+    return 0;
+}
+
 static int checkFailures(struct tlhThreadInfo *ti, int tlhNumThreads)
 {
     int i, threadsFailed = 0;
@@ -260,6 +908,7 @@ int main(void)
     struct tlhThreadInfo ti[TLH_MAX_THREADS];
     struct NativeMiniDfsConf conf = {
         .doFormat = 1,
+        .configureShortCircuit = 1,
     };
 
     tlhNumThreadsStr = getenv("TLH_NUM_THREADS");
@@ -282,6 +931,7 @@ int main(void)
     tlhCluster = nmdCreate(&conf);
     EXPECT_NONNULL(tlhCluster);
     EXPECT_ZERO(nmdWaitClusterUp(tlhCluster));
+    EXPECT_ZERO(doTestSharedConnect(tlhCluster));
 
     for (i = 0; i < tlhNumThreads; i++) {
         EXPECT_ZERO(pthread_create(&ti[i].thread, NULL,
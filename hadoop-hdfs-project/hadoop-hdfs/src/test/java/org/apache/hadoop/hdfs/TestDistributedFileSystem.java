@@ -765,4 +765,52 @@ public void testCreateWithCustomChecksum() throws Exception {
       }
     }
   }
+
+  @Test
+  public void testCopyFile() throws Exception {
+    final Configuration conf = getTestConfiguration();
+    conf.setInt(DFSConfigKeys.DFS_CLIENT_COPY_STREAMS_KEY, 3);
+    final MiniDFSCluster cluster = new MiniDFSCluster.Builder(conf)
+        .numDataNodes(1).build();
+    try {
+      DistributedFileSystem fs = cluster.getFileSystem();
+      Path dir = new Path("/testCopyFile");
+      Path src = new Path(dir, "src");
+      // 7 and a half blocks: three pieces of three, three and one and a half
+      DFSTestUtil.createFile(fs, src, 1024, 7 * 1024 + 512, 1024, (short)1,
+          0xBEEFl);
+      Path dst = new Path(dir, "dst");
+      assertTrue(fs.copyFile(src, dst));
+      assertEquals(fs.getFileStatus(src).getLen(),
+          fs.getFileStatus(dst).getLen());
+      assertEquals(1024, fs.getFileStatus(dst).getBlockSize());
+      assertEquals(DFSTestUtil.readFile(fs, src), DFSTestUtil.readFile(fs, dst));
+      assertEquals(fs.getFileChecksum(src), fs.getFileChecksum(dst));
+      // Only src and dst are left; the pieces were concatenated away
+      assertEquals(2, fs.listStatus(dir).length);
+
+      try {
+        fs.copyFile(src, dst);
+        fail("copied over an existing file");
+      } catch (IOException e) {
+        // expected
+      }
+
+      // A directory target means a copy inside it
+      Path subdir = new Path(dir, "subdir");
+      assertTrue(fs.mkdirs(subdir));
+      assertTrue(fs.copyFile(src, subdir));
+      assertEquals(DFSTestUtil.readFile(fs, src),
+          DFSTestUtil.readFile(fs, new Path(subdir, "src")));
+      assertFalse(fs.copyFile(subdir, new Path(dir, "subdir2")));
+
+      // An empty file has no blocks to split
+      Path empty = new Path(dir, "empty");
+      DFSTestUtil.createFile(fs, empty, 0, (short)1, 0);
+      assertTrue(fs.copyFile(empty, new Path(dir, "empty2")));
+      assertEquals(0, fs.getFileStatus(new Path(dir, "empty2")).getLen());
+    } finally {
+      cluster.shutdown();
+    }
+  }
 }
@@ -22,6 +22,7 @@
 
 import java.io.DataOutputStream;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Random;
 
 import org.apache.hadoop.conf.Configuration;
@@ -183,6 +184,48 @@ private void datanodeRestartTest(MiniDFSCluster cluster, FileSystem fileSys,
     checkAndEraseData(actual, 0, expected, "Pread Datanode Restart Test");
   }
   
+  private void doDirectPread(FSDataInputStream stm, long position,
+      byte[] actual) throws IOException {
+    ByteBuffer buf = ByteBuffer.allocateDirect(actual.length);
+    while (buf.hasRemaining()) {
+      int nbytes = stm.read(position + buf.position(), buf);
+      assertTrue("Error in direct pread", nbytes > 0);
+    }
+    buf.flip();
+    buf.get(actual);
+  }
+
+  /**
+   * Check positional reads into direct ByteBuffers, within and across
+   * block boundaries.
+   */
+  private void pReadFileDirect(FileSystem fileSys, Path name)
+      throws IOException {
+    FSDataInputStream stm = fileSys.open(name);
+    byte[] expected = new byte[12 * blockSize];
+    if (simulatedStorage) {
+      for (int i= 0; i < expected.length; i++) {  
+        expected[i] = SimulatedFSDataset.DEFAULT_DATABYTE;
+      }
+    } else {
+      Random rand = new Random(seed);
+      rand.nextBytes(expected);
+    }
+    byte[] actual = new byte[4096];
+    doDirectPread(stm, 0L, actual);
+    checkAndEraseData(actual, 0, expected, "Direct Pread Test 1");
+    actual = new byte[blockSize + 4096];
+    doDirectPread(stm, blockSize - 2048, actual);
+    checkAndEraseData(actual, (blockSize - 2048), expected,
+        "Direct Pread Test 2");
+    // the stream offset is untouched by positioned reads
+    assertEquals(0, stm.getPos());
+    // reading at the end of the file returns -1
+    ByteBuffer buf = ByteBuffer.allocateDirect(1);
+    assertEquals(-1, stm.read(12 * blockSize, buf));
+    stm.close();
+  }
+
   private void cleanupFile(FileSystem fileSys, Path name) throws IOException {
     assertTrue(fileSys.exists(name));
     assertTrue(fileSys.delete(name, true));
@@ -214,6 +257,7 @@ private void dfsPreadTest(boolean disableTransferTo) throws IOException {
       Path file1 = new Path("preadtest.dat");
       writeFile(fileSys, file1);
       pReadFile(fileSys, file1);
+      pReadFileDirect(fileSys, file1);
       datanodeRestartTest(cluster, fileSys, file1);
       cleanupFile(fileSys, file1);
     } finally {
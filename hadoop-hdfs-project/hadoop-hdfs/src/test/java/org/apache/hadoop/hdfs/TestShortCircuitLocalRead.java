@@ -17,9 +17,12 @@
  */
 package org.apache.hadoop.hdfs;
 
+import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertTrue;
 
 import java.io.EOFException;
+import java.io.File;
+import java.io.FileInputStream;
 import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.security.PrivilegedExceptionAction;
@@ -157,6 +160,11 @@ static void checkFileContentDirect(FileSystem fs, Path name, byte[] expected,
       nread += nbytes;
     }
     checkData(arrayFromByteBuffer(actual), readOffset, expected, "Read 3");
+    // Every byte came from the datanode on this host
+    DFSInputStream.ReadStatistics stats = stm.getReadStatistics();
+    assertEquals(nread, stats.getTotalBytesRead());
+    assertEquals(nread, stats.getTotalLocalBytesRead());
+    assertEquals(0, stats.getRemoteBytesRead());
     stm.close();
   }
 
@@ -355,6 +363,70 @@ public void testSkipWithVerifyChecksum() throws IOException {
     }
   }
      
+  /**
+   * Test that a stream reports where its blocks are on local disk, so that
+   * readers outside the JVM can read them directly.
+   */
+  @Test
+  public void testGetLocalBlock() throws IOException {
+    Configuration conf = new Configuration();
+    conf.setBoolean(DFSConfigKeys.DFS_CLIENT_READ_SHORTCIRCUIT_KEY, true);
+    conf.set(DFSConfigKeys.DFS_BLOCK_LOCAL_PATH_ACCESS_USER_KEY,
+        UserGroupInformation.getCurrentUser().getShortUserName());
+    MiniDFSCluster cluster = new MiniDFSCluster.Builder(conf).numDataNodes(1)
+        .format(true).build();
+    FileSystem fs = cluster.getFileSystem();
+    try {
+      byte[] fileData = AppendTestUtil.randomBytes(seed, 2*blockSize+100);
+      Path file1 = new Path("filelocal.dat");
+      FSDataOutputStream stm = createFile(fs, file1, 1);
+      stm.write(fileData);
+      stm.close();
+
+      HdfsDataInputStream in = (HdfsDataInputStream)fs.open(file1);
+      try {
+        DFSInputStream.LocalBlock block = in.getLocalBlock(blockSize + 7);
+        assertEquals(blockSize, block.getStartOffset());
+        assertEquals(blockSize, block.getLength());
+        assertTrue(new File(block.getBlockPath()).isFile());
+        assertTrue(new File(block.getMetaPath()).isFile());
+        byte[] actual = new byte[blockSize];
+        FileInputStream dataIn = new FileInputStream(block.getBlockPath());
+        try {
+          IOUtils.readFully(dataIn, actual, 0, actual.length);
+        } finally {
+          dataIn.close();
+        }
+        checkData(actual, blockSize, fileData, "getLocalBlock");
+
+        block = in.getLocalBlock(2*blockSize + 99);
+        assertEquals(2*blockSize, block.getStartOffset());
+        assertEquals(100, block.getLength());
+        assertTrue(in.getLocalBlock(fileData.length) == null);
+      } finally {
+        in.close();
+      }
+
+      // Without short-circuit reads, blocks are never reported as local
+      conf = new Configuration(conf);
+      conf.setBoolean(DFSConfigKeys.DFS_CLIENT_READ_SHORTCIRCUIT_KEY, false);
+      FileSystem fs2 = FileSystem.newInstance(fs.getUri(), conf);
+      try {
+        in = (HdfsDataInputStream)fs2.open(file1);
+        DFSInputStream.LocalBlock block = in.getLocalBlock(0);
+        assertEquals(0, block.getStartOffset());
+        assertTrue(block.getBlockPath() == null);
+        assertTrue(block.getMetaPath() == null);
+        in.close();
+      } finally {
+        fs2.close();
+      }
+    } finally {
+      fs.close();
+      cluster.shutdown();
+    }
+  }
+
   /**
    * Test to run benchmarks between shortcircuit read vs regular read with
    * specified number of threads simultaneously reading.
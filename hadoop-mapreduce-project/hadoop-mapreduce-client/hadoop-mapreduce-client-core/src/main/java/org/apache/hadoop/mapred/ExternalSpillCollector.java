@@ -0,0 +1,51 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package org.apache.hadoop.mapred;
+
+import java.io.IOException;
+
+import org.apache.hadoop.classification.InterfaceAudience;
+import org.apache.hadoop.classification.InterfaceStability;
+import org.apache.hadoop.fs.Path;
+
+/**
+ * An {@link OutputCollector} of map outputs that can also take spills
+ * written outside the map task, such as by a pipes program that sorts its
+ * own output, and merge them with the rest of the map output.
+ */
+@InterfaceAudience.LimitedPrivate({"MapReduce"})
+@InterfaceStability.Unstable
+public interface ExternalSpillCollector {
+
+  /**
+   * Can spills be added? They can't if the map output is not sorted, as
+   * when there are no reduces.
+   */
+  boolean canAddSpills();
+
+  /**
+   * Add a spill in the format of the map task's own: an IFile segment for
+   * each partition, sorted by the output key comparator, with an index in
+   * a file of the same name followed by ".index". Both files are deleted
+   * once they have been read.
+   * @param spill the path of the spill on the local file system
+   * @throws IOException
+   */
+  void addSpill(Path spill) throws IOException;
+}
@@ -522,7 +522,8 @@ private long getInputBytes(List<Statistics> stats) {
    * the configured partitioner should not be called. It's common for
    * partitioners to compute a result mod numReduces, which causes a div0 error
    */
-  private static class OldOutputCollector<K,V> implements OutputCollector<K,V> {
+  private static class OldOutputCollector<K,V>
+      implements OutputCollector<K,V>, ExternalSpillCollector {
     private final Partitioner<K,V> partitioner;
     private final MapOutputCollector<K,V> collector;
     private final int numPartitions;
@@ -556,6 +557,19 @@ public void collect(K key, V value) throws IOException {
         throw new IOException("interrupt exception", ie);
       }
     }
+
+    @Override
+    public boolean canAddSpills() {
+      return collector instanceof MapOutputBuffer;
+    }
+
+    @Override
+    public void addSpill(Path spill) throws IOException {
+      if (!canAddSpills()) {
+        throw new IOException("Map output can't take spills: " + spill);
+      }
+      ((MapOutputBuffer<?, ?>) collector).addSpill(spill);
+    }
   }
 
   private class NewDirectOutputCollector<K,V>
@@ -880,6 +894,9 @@ private long getOutputBytes(List<Statistics> stats) {
 
     final ArrayList<SpillRecord> indexCacheList =
       new ArrayList<SpillRecord>();
+    // spills written outside the task, merged after its own
+    final ArrayList<Path> externalSpills = new ArrayList<Path>();
+    final ArrayList<SpillRecord> externalIndexes = new ArrayList<SpillRecord>();
     private int totalIndexCacheMemory;
     private int indexCacheMemoryLimit;
     private static final int INDEX_CACHE_MEMORY_LIMIT_DEFAULT = 1024 * 1024;
@@ -1741,19 +1758,40 @@ public Progress getProgress() {
       public void close() { }
     }
 
+    /**
+     * Add a spill written outside the task.
+     * @see ExternalSpillCollector#addSpill(Path)
+     */
+    public synchronized void addSpill(Path spill) throws IOException {
+      final Path indexFile = spill.suffix(".index");
+      final SpillRecord index = new SpillRecord(indexFile, job);
+      if (index.size() != partitions) {
+        throw new IOException("Spill " + spill + " has " + index.size() +
+                              " partitions, not " + partitions);
+      }
+      externalSpills.add(spill);
+      externalIndexes.add(index);
+      rfs.delete(indexFile, false);
+    }
+
     private void mergeParts() throws IOException, InterruptedException, 
                                      ClassNotFoundException {
       // get the approximate size of the final output/index files
       long finalOutFileSize = 0;
       long finalIndexFileSize = 0;
-      final Path[] filename = new Path[numSpills];
+      final int spills = numSpills + externalSpills.size();
+      final Path[] filename = new Path[spills];
       final TaskAttemptID mapId = getTaskID();
 
       for(int i = 0; i < numSpills; i++) {
         filename[i] = mapOutputFile.getSpillFile(i);
         finalOutFileSize += rfs.getFileStatus(filename[i]).getLen();
       }
-      if (numSpills == 1) { //the spill is the final output
+      for(int i = numSpills; i < spills; i++) {
+        filename[i] = externalSpills.get(i - numSpills);
+        finalOutFileSize += rfs.getFileStatus(filename[i]).getLen();
+      }
+      if (spills == 1 && numSpills == 1) { //the spill is the final output
         sameVolRename(filename[0],
             mapOutputFile.getOutputFileForWriteInVolume(filename[0]));
         if (indexCacheList.size() == 0) {
@@ -1772,6 +1810,7 @@ private void mergeParts() throws IOException, InterruptedException,
         Path indexFileName = mapOutputFile.getSpillIndexFile(i);
         indexCacheList.add(new SpillRecord(indexFileName, job));
       }
+      indexCacheList.addAll(externalIndexes);
 
       //make correction in the length to include the sequence file header
       //lengths for each partition
@@ -1785,7 +1824,7 @@ private void mergeParts() throws IOException, InterruptedException,
       //The output stream for the final single output file
       FSDataOutputStream finalOut = rfs.create(finalOutputFile, true, 4096);
 
-      if (numSpills == 0) {
+      if (spills == 0) {
         //create dummy files
         IndexRecord rec = new IndexRecord();
         SpillRecord sr = new SpillRecord(partitions);
@@ -1816,8 +1855,8 @@ private void mergeParts() throws IOException, InterruptedException,
         for (int parts = 0; parts < partitions; parts++) {
           //create the segments to be merged
           List<Segment<K,V>> segmentList =
-            new ArrayList<Segment<K, V>>(numSpills);
-          for(int i = 0; i < numSpills; i++) {
+            new ArrayList<Segment<K, V>>(spills);
+          for(int i = 0; i < spills; i++) {
             IndexRecord indexRecord = indexCacheList.get(i).getIndex(parts);
 
             Segment<K,V> s =
@@ -1849,7 +1888,7 @@ private void mergeParts() throws IOException, InterruptedException,
           Writer<K, V> writer =
               new Writer<K, V>(job, finalOut, keyClass, valClass, codec,
                                spilledRecordsCounter);
-          if (combinerRunner == null || numSpills < minSpillsForCombine) {
+          if (combinerRunner == null || spills < minSpillsForCombine) {
             Merger.writeFile(kvIter, writer, reporter, job);
           } else {
             combineCollector.setWriter(writer);
@@ -1869,7 +1908,7 @@ private void mergeParts() throws IOException, InterruptedException,
         }
         spillRec.writeToFile(finalIndexFile, job);
         finalOut.close();
-        for(int i = 0; i < numSpills; i++) {
+        for(int i = 0; i < spills; i++) {
           rfs.delete(filename[i],true);
         }
       }
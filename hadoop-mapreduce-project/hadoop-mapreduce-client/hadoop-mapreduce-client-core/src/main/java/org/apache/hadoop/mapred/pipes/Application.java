@@ -132,6 +132,8 @@
     
     process = runClient(cmd, env);
     clientSocket = serverSocket.accept();
+    // messages are already buffered; don't hold back the small ones
+    clientSocket.setTcpNoDelay(true);
     
     String challenge = getSecurityChallenge();
     String digestToSend = createDigest(password, challenge);
@@ -21,6 +21,7 @@
 import java.io.BufferedInputStream;
 import java.io.BufferedOutputStream;
 import java.io.DataInputStream;
+import java.io.DataOutput;
 import java.io.DataOutputStream;
 import java.io.FileOutputStream;
 import java.io.FilterOutputStream;
@@ -59,6 +60,18 @@
 
   private DataOutputStream stream;
   private DataOutputBuffer buffer = new DataOutputBuffer();
+  /**
+   * The size of the MAP_ITEMS and REDUCE_VALUES frames to send, or 0 to send
+   * each map input or reduce value on its own
+   */
+  private final int batchBytes;
+  /**
+   * The map inputs or reduce values waiting to be sent in a frame of type
+   * batchType
+   */
+  private DataOutputBuffer batch;
+  private MessageType batchType = MessageType.MAP_ITEMS;
+  private int batchCount = 0;
   private static final Log LOG = 
     LogFactory.getLog(BinaryProtocol.class.getName());
   private UplinkReaderThread uplink;
@@ -78,6 +91,8 @@ private static enum MessageType { START(0),
                                     CLOSE(8),
                                     ABORT(9),
                                     AUTHENTICATION_REQ(10),
+                                    MAP_ITEMS(11),
+                                    REDUCE_VALUES(12),
                                     OUTPUT(50),
                                     PARTITIONED_OUTPUT(51),
                                     STATUS(52),
@@ -85,7 +100,8 @@ private static enum MessageType { START(0),
                                     DONE(54),
                                     REGISTER_COUNTER(55),
                                     INCREMENT_COUNTER(56),
-                                    AUTHENTICATION_RESP(57);
+                                    AUTHENTICATION_RESP(57),
+                                    OUTPUTS(58);
     final int code;
     MessageType(int code) {
       this.code = code;
@@ -135,6 +151,15 @@ public void run() {
             readObject(key);
             readObject(value);
             handler.output(key, value);
+          } else if (cmd == MessageType.OUTPUTS.code) {
+            // the frame length, which lets the C++ side read a frame in one go
+            WritableUtils.readVInt(inStream);
+            int count = WritableUtils.readVInt(inStream);
+            for (int i = 0; i < count; ++i) {
+              readObject(key);
+              readObject(value);
+              handler.output(key, value);
+            }
           } else if (cmd == MessageType.PARTITIONED_OUTPUT.code) {
             int part = WritableUtils.readVInt(inStream);
             readObject(key);
@@ -248,6 +273,10 @@ public BinaryProtocol(Socket sock,
                                             handler, key, value);
     uplink.setName("pipe-uplink-handler");
     uplink.start();
+    batchBytes = Submitter.getBatchBytes(config);
+    if (batchBytes > 0) {
+      batch = new DataOutputBuffer(batchBytes);
+    }
   }
 
   /**
@@ -308,38 +337,94 @@ public void runMap(InputSplit split, int numReduces,
 
   public void mapItem(WritableComparable key, 
                       Writable value) throws IOException {
+    if (batch != null) {
+      startBatch(MessageType.MAP_ITEMS);
+      writeObject(batch, key);
+      writeObject(batch, value);
+      endBatchRecord();
+      return;
+    }
     WritableUtils.writeVInt(stream, MessageType.MAP_ITEM.code);
     writeObject(key);
     writeObject(value);
   }
 
+  /**
+   * Make sure the batch holds records for a frame of the given type,
+   * sending what it has if they are of another type.
+   */
+  private void startBatch(MessageType type) throws IOException {
+    if (batchType != type) {
+      flushBatch();
+      batchType = type;
+    }
+  }
+
+  private void endBatchRecord() throws IOException {
+    batchCount++;
+    if (batch.getLength() >= batchBytes) {
+      flushBatch();
+    }
+  }
+
+  /**
+   * Send the records waiting in the batch as one MAP_ITEMS or REDUCE_VALUES
+   * frame: the frame length in bytes, the number of records, then the
+   * records as MAP_ITEM or REDUCE_VALUE would send them. Every other
+   * downward message sends the batch first, so that messages arrive in the
+   * order they were made.
+   * @throws IOException
+   */
+  private void flushBatch() throws IOException {
+    if (batchCount == 0) {
+      return;
+    }
+    WritableUtils.writeVInt(stream, batchType.code);
+    WritableUtils.writeVInt(stream, batch.getLength());
+    WritableUtils.writeVInt(stream, batchCount);
+    stream.write(batch.getData(), 0, batch.getLength());
+    batch.reset();
+    batchCount = 0;
+  }
+
   public void runReduce(int reduce, boolean pipedOutput) throws IOException {
+    flushBatch();
     WritableUtils.writeVInt(stream, MessageType.RUN_REDUCE.code);
     WritableUtils.writeVInt(stream, reduce);
     WritableUtils.writeVInt(stream, pipedOutput ? 1 : 0);
   }
 
   public void reduceKey(WritableComparable key) throws IOException {
+    flushBatch();
     WritableUtils.writeVInt(stream, MessageType.REDUCE_KEY.code);
     writeObject(key);
   }
 
   public void reduceValue(Writable value) throws IOException {
+    if (batch != null) {
+      startBatch(MessageType.REDUCE_VALUES);
+      writeObject(batch, value);
+      endBatchRecord();
+      return;
+    }
     WritableUtils.writeVInt(stream, MessageType.REDUCE_VALUE.code);
     writeObject(value);
   }
 
   public void endOfInput() throws IOException {
+    flushBatch();
     WritableUtils.writeVInt(stream, MessageType.CLOSE.code);
     LOG.debug("Sent close command");
   }
   
   public void abort() throws IOException {
+    flushBatch();
     WritableUtils.writeVInt(stream, MessageType.ABORT.code);
     LOG.debug("Sent abort command");
   }
 
   public void flush() throws IOException {
+    flushBatch();
     stream.flush();
   }
 
@@ -351,24 +436,35 @@ public void flush() throws IOException {
    * @throws IOException
    */
   private void writeObject(Writable obj) throws IOException {
+    writeObject(stream, obj);
+  }
+
+  /**
+   * Write the given object as for {@link #writeObject(Writable)}, to the
+   * given output.
+   * @param out where to write the object
+   * @param obj the object to write
+   * @throws IOException
+   */
+  private void writeObject(DataOutput out, Writable obj) throws IOException {
     // For Text and BytesWritable, encode them directly, so that they end up
     // in C++ as the natural translations.
     if (obj instanceof Text) {
       Text t = (Text) obj;
       int len = t.getLength();
-      WritableUtils.writeVInt(stream, len);
-      stream.write(t.getBytes(), 0, len);
+      WritableUtils.writeVInt(out, len);
+      out.write(t.getBytes(), 0, len);
     } else if (obj instanceof BytesWritable) {
       BytesWritable b = (BytesWritable) obj;
       int len = b.getLength();
-      WritableUtils.writeVInt(stream, len);
-      stream.write(b.getBytes(), 0, len);
+      WritableUtils.writeVInt(out, len);
+      out.write(b.getBytes(), 0, len);
     } else {
       buffer.reset();
       obj.write(buffer);
       int length = buffer.getLength();
-      WritableUtils.writeVInt(stream, length);
-      stream.write(buffer.getData(), 0, length);
+      WritableUtils.writeVInt(out, length);
+      out.write(buffer.getData(), 0, length);
     }
   }
 }
@@ -18,18 +18,24 @@
 
 package org.apache.hadoop.mapred.pipes;
 
+import java.io.File;
 import java.io.IOException;
 
+import org.apache.hadoop.fs.Path;
+import org.apache.hadoop.io.BytesWritable;
 import org.apache.hadoop.io.FloatWritable;
 import org.apache.hadoop.io.NullWritable;
+import org.apache.hadoop.io.Text;
 import org.apache.hadoop.io.Writable;
 import org.apache.hadoop.io.WritableComparable;
+import org.apache.hadoop.mapred.ExternalSpillCollector;
 import org.apache.hadoop.mapred.JobConf;
 import org.apache.hadoop.mapred.MapRunner;
 import org.apache.hadoop.mapred.OutputCollector;
 import org.apache.hadoop.mapred.RecordReader;
 import org.apache.hadoop.mapred.Reporter;
 import org.apache.hadoop.mapred.SkipBadRecords;
+import org.apache.hadoop.mapred.lib.HashPartitioner;
 import org.apache.hadoop.mapreduce.MRJobConfig;
 
 /**
@@ -51,6 +57,42 @@ public void configure(JobConf job) {
     SkipBadRecords.setAutoIncrMapperProcCount(job, false);
   }
 
+  private static boolean isBinary(Class<?> cls) {
+    return cls == Text.class || cls == BytesWritable.class;
+  }
+
+  /**
+   * Can the C++ program sort and spill the map outputs itself? It can
+   * only sort and partition the way the defaults for Text and
+   * BytesWritable do, and write uncompressed spills.
+   */
+  private boolean canCollectNatively(OutputCollector<K2, V2> output) {
+    return Submitter.getNativeCollector(job) &&
+      job.getNumReduceTasks() > 0 &&
+      output instanceof ExternalSpillCollector &&
+      ((ExternalSpillCollector) output).canAddSpills() &&
+      isBinary(job.getMapOutputKeyClass()) &&
+      isBinary(job.getMapOutputValueClass()) &&
+      job.get(MRJobConfig.KEY_COMPARATOR) == null &&
+      Submitter.getJavaPartitioner(job) == HashPartitioner.class &&
+      job.getCombinerClass() == null &&
+      !job.getCompressMapOutput();
+  }
+
+  /**
+   * Hand the spills the C++ program wrote to the map task to merge.
+   */
+  private void addNativeSpills(ExternalSpillCollector output, String prefix
+                               ) throws IOException {
+    for (int i = 0; ; ++i) {
+      File spill = new File(prefix + i + ".out");
+      if (!spill.exists()) {
+        break;
+      }
+      output.addSpill(new Path(spill.getAbsolutePath()));
+    }
+  }
+
   /**
    * Run the map task.
    * @param input the set of inputs
@@ -61,6 +103,14 @@ public void configure(JobConf job) {
   public void run(RecordReader<K1, V1> input, OutputCollector<K2, V2> output,
                   Reporter reporter) throws IOException {
     Application<K1, V1, K2, V2> application = null;
+    String nativeSpillPrefix = null;
+    if (canCollectNatively(output)) {
+      // tell the C++ side where to spill, and what it is writing
+      nativeSpillPrefix = new File("pipes-spill").getAbsolutePath();
+      job.set(Submitter.NATIVE_SPILL_PREFIX, nativeSpillPrefix);
+      job.setMapOutputKeyClass(job.getMapOutputKeyClass());
+      job.setMapOutputValueClass(job.getMapOutputValueClass());
+    }
     try {
       RecordReader<FloatWritable, NullWritable> fakeInput = 
         (!Submitter.getIsJavaRecordReader(job) && 
@@ -98,6 +148,9 @@ public void run(RecordReader<K1, V1> input, OutputCollector<K2, V2> output,
         downlink.endOfInput();
       }
       application.waitForFinish();
+      if (nativeSpillPrefix != null) {
+        addNativeSpills((ExternalSpillCollector) output, nativeSpillPrefix);
+      }
     } catch (Throwable t) {
       application.abort(t);
     } finally {
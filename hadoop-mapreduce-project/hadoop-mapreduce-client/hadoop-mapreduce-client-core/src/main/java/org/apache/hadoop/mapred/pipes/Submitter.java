@@ -82,6 +82,12 @@ public class Submitter extends Configured implements Tool {
   public static final String PARTITIONER = "mapreduce.pipes.partitioner";
   public static final String INPUT_FORMAT = "mapreduce.pipes.inputformat";
   public static final String PORT = "mapreduce.pipes.command.port";
+  public static final String BATCH_BYTES = "mapreduce.pipes.batch.bytes";
+  public static final String MAP_THREADS = "mapreduce.pipes.map.threads";
+  public static final String NATIVE_COLLECTOR =
+    "mapreduce.pipes.native.collector";
+  public static final String NATIVE_SPILL_PREFIX =
+    "mapreduce.pipes.native.spill.prefix";
   
   public Submitter() {
     this(new Configuration());
@@ -240,6 +246,71 @@ public static void setKeepCommandFile(JobConf conf, boolean keep) {
     conf.setBoolean(Submitter.PRESERVE_COMMANDFILE, keep);
   }
 
+  /**
+   * Get how many bytes of map inputs, reduce values and outputs are packed
+   * into each frame of the binary protocol. Sending many small records in
+   * one frame saves most of their per-record cost. The C++ program must be
+   * linked against a pipes library that understands batched frames.
+   * @param conf the configuration to check
+   * @return the frame size in bytes, or 0 if records are sent one by one
+   */
+  public static int getBatchBytes(JobConf conf) {
+    return conf.getInt(Submitter.BATCH_BYTES, 0);
+  }
+
+  /**
+   * Set how many bytes of map inputs, reduce values and outputs to pack
+   * into each frame of the binary protocol.
+   * @param conf the configuration to modify
+   * @param bytes the frame size in bytes, or 0 to send records one by one
+   */
+  public static void setBatchBytes(JobConf conf, int bytes) {
+    conf.setInt(Submitter.BATCH_BYTES, bytes);
+  }
+
+  /**
+   * Get how many threads the C++ map function is run in. Each thread has
+   * its own mapper, combiner and partitioner, and the order of the map
+   * outputs is not defined.
+   * @param conf the configuration to check
+   * @return the number of map threads
+   */
+  public static int getMapThreads(JobConf conf) {
+    return conf.getInt(Submitter.MAP_THREADS, 1);
+  }
+
+  /**
+   * Set how many threads the C++ map function is run in.
+   * @param conf the configuration to modify
+   * @param threads the number of threads; 1 runs map on the thread that
+   *   reads the input
+   */
+  public static void setMapThreads(JobConf conf, int threads) {
+    conf.setInt(Submitter.MAP_THREADS, threads);
+  }
+
+  /**
+   * Does the C++ program sort and spill its own map outputs, so that the
+   * Java task only has to merge them? This is only done when the map
+   * outputs are Text or BytesWritable, with the default comparator and
+   * partitioner, no Java combiner and no compression; otherwise the
+   * outputs are collected by Java as usual.
+   * @param conf the configuration to check
+   * @return true, if the map outputs may be collected natively
+   */
+  public static boolean getNativeCollector(JobConf conf) {
+    return conf.getBoolean(Submitter.NATIVE_COLLECTOR, false);
+  }
+
+  /**
+   * Set whether the C++ program may sort and spill its own map outputs.
+   * @param conf the configuration to modify
+   * @param value the new value
+   */
+  public static void setNativeCollector(JobConf conf, boolean value) {
+    conf.setBoolean(Submitter.NATIVE_COLLECTOR, value);
+  }
+
   /**
    * Submit a job to the map/reduce cluster. All of the necessary modifications
    * to the job to run under pipes are made to the configuration.
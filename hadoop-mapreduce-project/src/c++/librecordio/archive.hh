@@ -45,32 +45,100 @@ public:
   virtual void endVector(Index* idx, const char* tag) = 0;
   virtual Index* startMap(const char* tag) = 0;
   virtual void endMap(Index* idx, const char* tag) = 0;
+  /**
+   * Whether the archive is known to hold no more records.  Archives that
+   * can't tell without reading return false.
+   */
+  virtual bool atEnd() { return false; }
+  /**
+   * Move past a string or buffer field; archives that can do it without
+   * decoding the field override these.
+   */
+  virtual void skipString(const char* tag) {
+    std::string t;
+    deserialize(t, tag);
+  }
+  virtual void skipBuffer(const char* tag) {
+    std::string t;
+    size_t len = 0;
+    deserialize(t, len, tag);
+  }
   virtual void deserialize(hadoop::Record& s, const char* tag) {
     s.deserialize(*this, tag);
   }
+  /**
+   * Vectors of numbers, which an archive can read in bulk; by default
+   * they are read an element at a time like any other vector.
+   */
+  virtual void deserialize(std::vector<int32_t>& v, const char* tag) {
+    deserialize<int32_t>(v, tag);
+  }
+  virtual void deserialize(std::vector<int64_t>& v, const char* tag) {
+    deserialize<int64_t>(v, tag);
+  }
+  virtual void deserialize(std::vector<float>& v, const char* tag) {
+    deserialize<float>(v, tag);
+  }
+  virtual void deserialize(std::vector<double>& v, const char* tag) {
+    deserialize<double>(v, tag);
+  }
+  /**
+   * Vectors and maps replace what the container held.  They are read into
+   * the elements already there, so a record read again and again reuses
+   * the strings and containers it ended up with last time.
+   */
   template <typename T>
   void deserialize(std::vector<T>& v, const char* tag) {
     Index* idx = startVector(tag);
+    size_t n = 0;
     while (!idx->done()) {
-      T t;
+      if (n == v.size()) {
+        v.push_back(T());
+      }
+      deserialize(v[n++], tag);
+      idx->incr();
+    }
+    endVector(idx, tag);
+    v.resize(n, T());
+  }
+  void deserialize(std::vector<bool>& v, const char* tag) {
+    Index* idx = startVector(tag);
+    v.clear();
+    while (!idx->done()) {
+      bool t;
       deserialize(t, tag);
       v.push_back(t);
       idx->incr();
     }
     endVector(idx, tag);
   }
+  /**
+   * Maps are written in key order, so the entries are matched against the
+   * old ones in order: a key that was there before keeps its entry, and
+   * only new keys allocate one.
+   */
   template <typename K, typename V>
   void deserialize(std::map<K,V>& v, const char* tag) {
+    typedef typename std::map<K,V>::iterator I;
     Index* idx = startMap(tag);
+    I cur = v.begin();
+    K key;
     while (!idx->done()) {
-      K key;
       deserialize(key, tag);
-      V value;
-      deserialize(value, tag);
-      v[key] = value;
+      while (cur != v.end() && cur->first < key) {
+        v.erase(cur++);
+      }
+      I entry = cur;
+      if (cur != v.end() && !(key < cur->first)) {
+        cur++;
+      } else {
+        entry = v.insert(cur, std::make_pair(key, V()));
+      }
+      deserialize(entry->second, tag);
       idx->incr();
     }
     endMap(idx, tag);
+    v.erase(cur, v.end());
   }
   virtual ~IArchive() {}
 };
@@ -94,6 +162,22 @@ public:
   virtual void serialize(const hadoop::Record& s, const char* tag) {
     s.serialize(*this, tag);
   }
+  /**
+   * Vectors of numbers, which an archive can write in bulk; by default
+   * they are written an element at a time like any other vector.
+   */
+  virtual void serialize(const std::vector<int32_t>& v, const char* tag) {
+    serialize<int32_t>(v, tag);
+  }
+  virtual void serialize(const std::vector<int64_t>& v, const char* tag) {
+    serialize<int64_t>(v, tag);
+  }
+  virtual void serialize(const std::vector<float>& v, const char* tag) {
+    serialize<float>(v, tag);
+  }
+  virtual void serialize(const std::vector<double>& v, const char* tag) {
+    serialize<double>(v, tag);
+  }
   template <typename T>
   void serialize(const std::vector<T>& v, const char* tag) {
     startVector(v.size(), tag);
@@ -17,6 +17,7 @@
  */
 
 #include "binarchive.hh"
+#include "filestream.hh"
 #include <rpc/types.h>
 #include <rpc/xdr.h>
 
@@ -160,20 +161,119 @@ static void deserializeString(std::string& t, InStream& stream)
 {
   int32_t len = 0;
   ::deserializeInt(len, stream);
-  if (len > 0) {
-    // resize the string to the right length
-    t.resize(len);
-    // read into the string in 64k chunks
-    const int bufSize = 65536;
-    int offset = 0;
-    char buf[bufSize];
-    while (len > 0) {
-      int chunkLength = len > bufSize ? bufSize : len;
-      stream.read((void *)buf, chunkLength);
-      t.replace(offset, chunkLength, buf, chunkLength);
-      offset += chunkLength;
-      len -= chunkLength;
+  if (len <= 0) {
+    t.clear();
+    return;
+  }
+  // read straight into the string, which keeps the capacity it already
+  // has; 64k at a time, so a bad length fails on the data that isn't
+  // there before all of it is allocated
+  const size_t chunk = 65536;
+  size_t done = 0;
+  while (done < (size_t) len) {
+    size_t n = (size_t) len - done < chunk ? (size_t) len - done : chunk;
+    t.resize(done + n);
+    if ((ssize_t) n != stream.read(&t[done], n)) {
+      throw new IOException("Error deserializing string.");
+    }
+    done += n;
+  }
+}
+
+// Floats and doubles are big-endian IEEE 754, as XDR writes them.  Where
+// the compiler tells us the byte order they are copied a word at a time
+// and swapped if need be; elsewhere they are put together byte by byte.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+static inline uint32_t toBigEndian(uint32_t bits)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap32(bits);
+#else
+  return bits;
+#endif
+}
+
+static inline uint64_t toBigEndian(uint64_t bits)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(bits);
+#else
+  return bits;
+#endif
+}
+#define RECORDIO_WORD_SWAP 1
+#endif
+
+template <typename T, typename Bits>
+static void decodeFloats(const char* src, T* dst, size_t n)
+{
+  for (size_t cur = 0; cur < n; cur++, src += sizeof(T)) {
+    Bits bits = 0;
+#ifdef RECORDIO_WORD_SWAP
+    memcpy(&bits, src, sizeof(T));
+    bits = toBigEndian(bits);
+#else
+    for (size_t idx = 0; idx < sizeof(T); idx++) {
+      bits = (bits << 8) | (uint8_t) src[idx];
+    }
+#endif
+    memcpy(dst + cur, &bits, sizeof(T));
+  }
+}
+
+template <typename T, typename Bits>
+static void encodeFloats(const T* src, char* dst, size_t n)
+{
+  for (size_t cur = 0; cur < n; cur++, dst += sizeof(T)) {
+    Bits bits;
+    memcpy(&bits, src + cur, sizeof(T));
+#ifdef RECORDIO_WORD_SWAP
+    bits = toBigEndian(bits);
+    memcpy(dst, &bits, sizeof(T));
+#else
+    for (size_t idx = 0; idx < sizeof(T); idx++) {
+      dst[idx] = (uint8_t) (bits >> ((sizeof(T) - 1 - idx) * 8));
     }
+#endif
+  }
+}
+
+template <typename T, typename Bits>
+static void deserializeFloats(std::vector<T>& v, InStream& stream)
+{
+  int32_t len;
+  ::deserializeInt(len, stream);
+  // a chunk at a time, so a bad length fails on the data that isn't there
+  // rather than on allocating it
+  char buf[4096];
+  const size_t chunk = sizeof(buf) / sizeof(T);
+  size_t left = len > 0 ? len : 0;
+  v.clear();
+  while (left > 0) {
+    size_t n = left < chunk ? left : chunk;
+    if ((ssize_t) (n * sizeof(T)) != stream.read(buf, n * sizeof(T))) {
+      throw new IOException("Error deserializing vector.");
+    }
+    size_t start = v.size();
+    v.resize(start + n);
+    decodeFloats<T, Bits>(buf, &v[start], n);
+    left -= n;
+  }
+}
+
+template <typename T, typename Bits>
+static void serializeFloats(const std::vector<T>& v, OutStream& stream)
+{
+  ::serializeInt(v.size(), stream);
+  char buf[4096];
+  const size_t chunk = sizeof(buf) / sizeof(T);
+  for (size_t done = 0; done < v.size(); ) {
+    size_t n = v.size() - done < chunk ? v.size() - done : chunk;
+    encodeFloats<T, Bits>(&v[done], buf, n);
+    if ((ssize_t) (n * sizeof(T)) != stream.write(buf, n * sizeof(T))) {
+      throw new IOException("Error serializing vector.");
+    }
+    done += n;
   }
 }
 
@@ -220,6 +320,39 @@ void hadoop::IBinArchive::deserialize(std::string& t, size_t& len, const char* t
   len = t.length();
 }
 
+void hadoop::IBinArchive::deserialize(std::vector<float>& v, const char* tag)
+{
+  ::deserializeFloats<float, uint32_t>(v, stream);
+}
+
+void hadoop::IBinArchive::deserialize(std::vector<double>& v, const char* tag)
+{
+  ::deserializeFloats<double, uint64_t>(v, stream);
+}
+
+void hadoop::IBinArchive::skipString(const char* tag)
+{
+  int32_t len = 0;
+  ::deserializeInt(len, stream);
+  if (len <= 0) {
+    return;
+  }
+  // a short one costs less to read than to seek past
+  char buf[4096];
+  if ((size_t) len <= sizeof(buf)) {
+    if (len != stream.read(buf, len)) {
+      throw new IOException("Error skipping string.");
+    }
+  } else if (!stream.skip(len)) {
+    throw new IOException("Error skipping string.");
+  }
+}
+
+void hadoop::IBinArchive::skipBuffer(const char* tag)
+{
+  skipString(tag);
+}
+
 void hadoop::IBinArchive::startRecord(Record& s, const char* tag)
 {
 }
@@ -232,26 +365,24 @@ Index* hadoop::IBinArchive::startVector(const char* tag)
 {
   int32_t len;
   ::deserializeInt(len, stream);
-  BinIndex *idx = new BinIndex((size_t) len);
-  return idx;
+  return indexes.get((size_t) len);
 }
 
 void hadoop::IBinArchive::endVector(Index* idx, const char* tag)
 {
-  delete idx;
+  indexes.put(idx);
 }
 
 Index* hadoop::IBinArchive::startMap(const char* tag)
 {
   int32_t len;
   ::deserializeInt(len, stream);
-  BinIndex *idx = new BinIndex((size_t) len);
-  return idx;
+  return indexes.get((size_t) len);
 }
 
 void hadoop::IBinArchive::endMap(Index* idx, const char* tag)
 {
-  delete idx;
+  indexes.put(idx);
 }
 
 hadoop::IBinArchive::~IBinArchive()
@@ -299,6 +430,16 @@ void hadoop::OBinArchive::serialize(const std::string& t, size_t len, const char
   ::serializeString(t, stream);
 }
 
+void hadoop::OBinArchive::serialize(const std::vector<float>& v, const char* tag)
+{
+  ::serializeFloats<float, uint32_t>(v, stream);
+}
+
+void hadoop::OBinArchive::serialize(const std::vector<double>& v, const char* tag)
+{
+  ::serializeFloats<double, uint64_t>(v, stream);
+}
+
 void hadoop::OBinArchive::startRecord(const Record& s, const char* tag)
 {
 }
@@ -328,3 +469,496 @@ void hadoop::OBinArchive::endMap(size_t len, const char* tag)
 hadoop::OBinArchive::~OBinArchive()
 {
 }
+
+hadoop::IBufferedBinArchive::IBufferedBinArchive(InStream& _stream,
+                                                 size_t bufferSize)
+  : stream(_stream), mapped(NULL)
+{
+  capacity = bufferSize < 16 ? 16 : bufferSize;
+  buffer = new char[capacity];
+  pos = end = buffer;
+}
+
+hadoop::IBufferedBinArchive::IBufferedBinArchive(MemoryInStream& _stream)
+  : stream(_stream), mapped(&_stream)
+{
+  capacity = 0;
+  buffer = NULL;
+  pos = _stream.data();
+  end = pos + _stream.available();
+}
+
+void hadoop::IBufferedBinArchive::fill(size_t need)
+{
+  if (mapped != NULL) {
+    // the whole rest of the stream is already in view
+    throw new IOException("Error deserializing data.");
+  }
+  size_t have = end - pos;
+  if (need > capacity) {
+    // only a string read in place can need more than the buffer holds
+    char* bigger = new char[need];
+    memcpy(bigger, pos, have);
+    delete[] buffer;
+    buffer = bigger;
+    capacity = need;
+  } else {
+    memmove(buffer, pos, have);
+  }
+  pos = buffer;
+  end = buffer + have;
+  while (have < need) {
+    ssize_t n = stream.read(buffer + have, capacity - have);
+    if (n <= 0) {
+      throw new IOException("Error deserializing data.");
+    }
+    have += n;
+    end += n;
+  }
+}
+
+int64_t hadoop::IBufferedBinArchive::readLong()
+{
+  require(1);
+  int8_t b = *pos++;
+  if (b >= -112) {
+    return b;
+  }
+  bool isNegative = (b < -120);
+  int len = isNegative ? -(b + 120) : -(b + 112);
+  require(len);
+  uint64_t t = 0;
+  for (int idx = 0; idx < len; idx++) {
+    t = (t << 8) | (uint8_t) pos[idx];
+  }
+  pos += len;
+  return isNegative ? ~t : t;
+}
+
+void hadoop::IBufferedBinArchive::deserialize(int8_t& t, const char* tag)
+{
+  require(1);
+  t = *pos++;
+}
+
+void hadoop::IBufferedBinArchive::deserialize(bool& t, const char* tag)
+{
+  require(sizeof(bool));
+  memcpy(&t, pos, sizeof(bool));
+  pos += sizeof(bool);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(int32_t& t, const char* tag)
+{
+  t = readLong();
+}
+
+void hadoop::IBufferedBinArchive::deserialize(int64_t& t, const char* tag)
+{
+  t = readLong();
+}
+
+void hadoop::IBufferedBinArchive::deserialize(float& t, const char* tag)
+{
+  require(sizeof(float));
+  decodeFloats<float, uint32_t>(pos, &t, 1);
+  pos += sizeof(float);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(double& t, const char* tag)
+{
+  require(sizeof(double));
+  decodeFloats<double, uint64_t>(pos, &t, 1);
+  pos += sizeof(double);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::string& t, const char* tag)
+{
+  int32_t len = readLong();
+  if (len <= 0) {
+    t.clear();
+    return;
+  }
+  size_t have = end - pos;
+  if ((size_t) len <= have) {
+    t.assign(pos, len);
+    pos += len;
+    return;
+  }
+  if (mapped != NULL) {
+    throw new IOException("Error deserializing string.");
+  }
+  // take what is buffered, then read the rest straight into the string
+  t.resize(len);
+  memcpy(&t[0], pos, have);
+  pos = end = buffer;
+  size_t done = have;
+  while (done < (size_t) len) {
+    ssize_t n = stream.read(&t[done], len - done);
+    if (n <= 0) {
+      throw new IOException("Error deserializing string.");
+    }
+    done += n;
+  }
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::string& t, size_t& len,
+                                              const char* tag)
+{
+  deserialize(t, tag);
+  len = t.length();
+}
+
+void hadoop::IBufferedBinArchive::deserialize(const char*& data, size_t& len,
+                                              const char* tag)
+{
+  int32_t length = readLong();
+  len = length > 0 ? length : 0;
+  require(len);
+  data = pos;
+  pos += len;
+}
+
+template <typename T>
+void hadoop::IBufferedBinArchive::readLongs(std::vector<T>& v)
+{
+  int32_t len = readLong();
+  v.clear();
+  if (len <= 0) {
+    return;
+  }
+  // each element takes at least a byte, so don't reserve beyond the buffer
+  size_t have = end - pos;
+  v.reserve((size_t) len < have ? len : have);
+  for (int32_t cur = 0; cur < len; cur++) {
+    if (pos < end && (int8_t) *pos >= -112) {
+      v.push_back((int8_t) *pos++);
+    } else {
+      v.push_back((T) readLong());
+    }
+  }
+}
+
+template <typename T, typename Bits>
+void hadoop::IBufferedBinArchive::readFloats(std::vector<T>& v)
+{
+  int32_t len = readLong();
+  size_t left = len > 0 ? len : 0;
+  v.clear();
+  while (left > 0) {
+    size_t n = (end - pos) / sizeof(T);
+    if (n == 0) {
+      require(sizeof(T));
+      continue;
+    }
+    if (n > left) {
+      n = left;
+    }
+    size_t start = v.size();
+    v.resize(start + n);
+    decodeFloats<T, Bits>(pos, &v[start], n);
+    pos += n * sizeof(T);
+    left -= n;
+  }
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::vector<int32_t>& v,
+                                              const char* tag)
+{
+  readLongs(v);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::vector<int64_t>& v,
+                                              const char* tag)
+{
+  readLongs(v);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::vector<float>& v,
+                                              const char* tag)
+{
+  readFloats<float, uint32_t>(v);
+}
+
+void hadoop::IBufferedBinArchive::deserialize(std::vector<double>& v,
+                                              const char* tag)
+{
+  readFloats<double, uint64_t>(v);
+}
+
+void hadoop::IBufferedBinArchive::skipString(const char* tag)
+{
+  int32_t len = readLong();
+  if (len <= 0) {
+    return;
+  }
+  size_t have = end - pos;
+  if ((size_t) len <= have) {
+    pos += len;
+    return;
+  }
+  if (mapped != NULL) {
+    throw new IOException("Error skipping string.");
+  }
+  size_t rest = len - have;
+  pos = end = buffer;
+  if (rest < capacity) {
+    // refilling is cheaper than a seek for what fits in the buffer
+    require(rest);
+    pos += rest;
+  } else if (!stream.skip(rest)) {
+    throw new IOException("Error skipping string.");
+  }
+}
+
+void hadoop::IBufferedBinArchive::skipBuffer(const char* tag)
+{
+  skipString(tag);
+}
+
+void hadoop::IBufferedBinArchive::startRecord(Record& s, const char* tag)
+{
+}
+
+void hadoop::IBufferedBinArchive::endRecord(Record& s, const char* tag)
+{
+}
+
+Index* hadoop::IBufferedBinArchive::startVector(const char* tag)
+{
+  int32_t len = readLong();
+  return indexes.get((size_t) len);
+}
+
+void hadoop::IBufferedBinArchive::endVector(Index* idx, const char* tag)
+{
+  indexes.put(idx);
+}
+
+Index* hadoop::IBufferedBinArchive::startMap(const char* tag)
+{
+  int32_t len = readLong();
+  return indexes.get((size_t) len);
+}
+
+void hadoop::IBufferedBinArchive::endMap(Index* idx, const char* tag)
+{
+  indexes.put(idx);
+}
+
+bool hadoop::IBufferedBinArchive::atEnd()
+{
+  if (pos < end) {
+    return false;
+  }
+  if (mapped != NULL) {
+    return true;
+  }
+  ssize_t n = stream.read(buffer, capacity);
+  if (n <= 0) {
+    return true;
+  }
+  pos = buffer;
+  end = buffer + n;
+  return false;
+}
+
+hadoop::IBufferedBinArchive::~IBufferedBinArchive()
+{
+  if (mapped != NULL) {
+    mapped->skip(pos - mapped->data());
+  }
+  delete[] buffer;
+}
+
+hadoop::OBufferedBinArchive::OBufferedBinArchive(OutStream& _stream,
+                                                 size_t bufferSize)
+  : stream(_stream)
+{
+  capacity = bufferSize < 16 ? 16 : bufferSize;
+  buffer = new char[capacity];
+  pos = buffer;
+}
+
+void hadoop::OBufferedBinArchive::flush()
+{
+  size_t len = pos - buffer;
+  pos = buffer;
+  if (len > 0 && (ssize_t) len != stream.write(buffer, len)) {
+    throw new IOException("Error serializing data.");
+  }
+}
+
+void hadoop::OBufferedBinArchive::writeLong(int64_t t)
+{
+  reserve(9);
+  if (t >= -112 && t <= 127) {
+    *pos++ = (int8_t) t;
+    return;
+  }
+  int8_t len = -112;
+  if (t < 0) {
+    t ^= 0xFFFFFFFFFFFFFFFFLL; // take one's complement
+    len = -120;
+  }
+  uint64_t tmp = t;
+  while (tmp != 0) {
+    tmp = tmp >> 8;
+    len--;
+  }
+  *pos++ = len;
+  len = (len < -120) ? -(len + 120) : -(len + 112);
+  for (int idx = len; idx != 0; idx--) {
+    *pos++ = (uint8_t) (t >> ((idx - 1) * 8));
+  }
+}
+
+void hadoop::OBufferedBinArchive::writeBytes(const char* data, size_t len)
+{
+  if (len <= (size_t) (buffer + capacity - pos)) {
+    memcpy(pos, data, len);
+    pos += len;
+    return;
+  }
+  flush();
+  if (len < capacity) {
+    memcpy(pos, data, len);
+    pos += len;
+  } else if ((ssize_t) len != stream.write(data, len)) {
+    throw new IOException("Error serializing data.");
+  }
+}
+
+void hadoop::OBufferedBinArchive::serialize(int8_t t, const char* tag)
+{
+  reserve(1);
+  *pos++ = t;
+}
+
+void hadoop::OBufferedBinArchive::serialize(bool t, const char* tag)
+{
+  reserve(sizeof(bool));
+  memcpy(pos, &t, sizeof(bool));
+  pos += sizeof(bool);
+}
+
+void hadoop::OBufferedBinArchive::serialize(int32_t t, const char* tag)
+{
+  writeLong(t);
+}
+
+void hadoop::OBufferedBinArchive::serialize(int64_t t, const char* tag)
+{
+  writeLong(t);
+}
+
+void hadoop::OBufferedBinArchive::serialize(float t, const char* tag)
+{
+  reserve(sizeof(float));
+  encodeFloats<float, uint32_t>(&t, pos, 1);
+  pos += sizeof(float);
+}
+
+void hadoop::OBufferedBinArchive::serialize(double t, const char* tag)
+{
+  reserve(sizeof(double));
+  encodeFloats<double, uint64_t>(&t, pos, 1);
+  pos += sizeof(double);
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::string& t,
+                                            const char* tag)
+{
+  writeLong(t.length());
+  writeBytes(t.data(), t.length());
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::string& t, size_t len,
+                                            const char* tag)
+{
+  serialize(t, tag);
+}
+
+template <typename T>
+void hadoop::OBufferedBinArchive::writeLongs(const std::vector<T>& v)
+{
+  writeLong((int32_t) v.size());
+  for (size_t cur = 0; cur < v.size(); cur++) {
+    writeLong(v[cur]);
+  }
+}
+
+template <typename T, typename Bits>
+void hadoop::OBufferedBinArchive::writeFloats(const std::vector<T>& v)
+{
+  writeLong((int32_t) v.size());
+  const size_t chunk = capacity / sizeof(T);
+  for (size_t done = 0; done < v.size(); ) {
+    size_t n = v.size() - done < chunk ? v.size() - done : chunk;
+    reserve(n * sizeof(T));
+    encodeFloats<T, Bits>(&v[done], pos, n);
+    pos += n * sizeof(T);
+    done += n;
+  }
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::vector<int32_t>& v,
+                                            const char* tag)
+{
+  writeLongs(v);
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::vector<int64_t>& v,
+                                            const char* tag)
+{
+  writeLongs(v);
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::vector<float>& v,
+                                            const char* tag)
+{
+  writeFloats<float, uint32_t>(v);
+}
+
+void hadoop::OBufferedBinArchive::serialize(const std::vector<double>& v,
+                                            const char* tag)
+{
+  writeFloats<double, uint64_t>(v);
+}
+
+void hadoop::OBufferedBinArchive::startRecord(const Record& s,
+                                              const char* tag)
+{
+}
+
+void hadoop::OBufferedBinArchive::endRecord(const Record& s, const char* tag)
+{
+}
+
+void hadoop::OBufferedBinArchive::startVector(size_t len, const char* tag)
+{
+  writeLong((int32_t) len);
+}
+
+void hadoop::OBufferedBinArchive::endVector(size_t len, const char* tag)
+{
+}
+
+void hadoop::OBufferedBinArchive::startMap(size_t len, const char* tag)
+{
+  writeLong((int32_t) len);
+}
+
+void hadoop::OBufferedBinArchive::endMap(size_t len, const char* tag)
+{
+}
+
+hadoop::OBufferedBinArchive::~OBufferedBinArchive()
+{
+  try {
+    flush();
+  } catch (IOException* e) {
+    delete e;
+  }
+  delete[] buffer;
+}
@@ -23,6 +23,8 @@
 
 namespace hadoop {
 
+class MemoryInStream;
+
 class BinIndex : public Index {
 private:
   size_t size;
@@ -30,14 +32,42 @@ public:
   BinIndex(size_t size_) { size = size_; }
   bool done() { return (size==0); }
   void incr() { size--; }
+  void reset(size_t size_) { size = size_; }
   ~BinIndex() {}
 };
+
+/**
+ * Keeps the indexes of finished vectors and maps for the next ones, so an
+ * archive doesn't allocate one for every vector it reads.
+ */
+class BinIndexPool {
+private:
+  std::vector<BinIndex*> spare;
+public:
+  BinIndex* get(size_t size) {
+    if (spare.empty()) {
+      return new BinIndex(size);
+    }
+    BinIndex* idx = spare.back();
+    spare.pop_back();
+    idx->reset(size);
+    return idx;
+  }
+  void put(Index* idx) { spare.push_back(static_cast<BinIndex*>(idx)); }
+  ~BinIndexPool() {
+    for (size_t cur = 0; cur < spare.size(); cur++) {
+      delete spare[cur];
+    }
+  }
+};
   
 class IBinArchive : public IArchive {
 private:
   InStream& stream;
+  BinIndexPool indexes;
 public:
   IBinArchive(InStream& _stream) : stream(_stream) {}
+  virtual bool atEnd() { return stream.atEnd(); }
   virtual void deserialize(int8_t& t, const char* tag);
   virtual void deserialize(bool& t, const char* tag);
   virtual void deserialize(int32_t& t, const char* tag);
@@ -46,6 +76,10 @@ public:
   virtual void deserialize(double& t, const char* tag);
   virtual void deserialize(std::string& t, const char* tag);
   virtual void deserialize(std::string& t, size_t& len, const char* tag);
+  virtual void deserialize(std::vector<float>& v, const char* tag);
+  virtual void deserialize(std::vector<double>& v, const char* tag);
+  virtual void skipString(const char* tag);
+  virtual void skipBuffer(const char* tag);
   virtual void startRecord(Record& s, const char* tag);
   virtual void endRecord(Record& s, const char* tag);
   virtual Index* startVector(const char* tag);
@@ -68,6 +102,8 @@ public:
   virtual void serialize(double t, const char* tag);
   virtual void serialize(const std::string& t, const char* tag);
   virtual void serialize(const std::string& t, size_t len, const char* tag);
+  virtual void serialize(const std::vector<float>& v, const char* tag);
+  virtual void serialize(const std::vector<double>& v, const char* tag);
   virtual void startRecord(const Record& s, const char* tag);
   virtual void endRecord(const Record& s, const char* tag);
   virtual void startVector(size_t len, const char* tag);
@@ -77,5 +113,309 @@ public:
   virtual ~OBinArchive();
 };
 
+/**
+ * An IBinArchive that reads the stream in large chunks into a buffer and
+ * decodes from there, rather than making a stream call for every field.
+ * It reads ahead of the records it returns, so it must be the only reader
+ * of the stream.
+ *
+ * Over a MemoryInStream, such as a MmapInStream or a BufferInStream, it
+ * decodes straight from the stream's memory, and moves the stream past
+ * what it has read when it is destroyed.
+ */
+class IBufferedBinArchive : public IArchive {
+  friend class IStaticBinArchive;
+  friend class BlockRecordReader;
+private:
+  InStream& stream;
+  MemoryInStream* mapped;
+  char* buffer;
+  size_t capacity;
+  const char* pos;
+  const char* end;
+  BinIndexPool indexes;
+  void fill(size_t need);
+  int64_t readLong();
+  template <typename T> void readLongs(std::vector<T>& v);
+  template <typename T, typename Bits> void readFloats(std::vector<T>& v);
+  /** Make sure at least need bytes are buffered, or throw. */
+  void require(size_t need) {
+    if ((size_t) (end - pos) < need) {
+      fill(need);
+    }
+  }
+public:
+  IBufferedBinArchive(InStream& _stream, size_t bufferSize = 65536);
+  IBufferedBinArchive(MemoryInStream& _stream);
+  /**
+   * Read a string without copying it into a std::string.
+   * @param data set to the start of the string, which stays valid until
+   *    the next call on the archive; or, over a MemoryInStream, as long
+   *    as the stream's bytes do
+   * @param len set to the length of the string
+   */
+  void deserialize(const char*& data, size_t& len, const char* tag);
+  virtual void deserialize(int8_t& t, const char* tag);
+  virtual void deserialize(bool& t, const char* tag);
+  virtual void deserialize(int32_t& t, const char* tag);
+  virtual void deserialize(int64_t& t, const char* tag);
+  virtual void deserialize(float& t, const char* tag);
+  virtual void deserialize(double& t, const char* tag);
+  virtual void deserialize(std::string& t, const char* tag);
+  virtual void deserialize(std::string& t, size_t& len, const char* tag);
+  virtual void deserialize(std::vector<int32_t>& v, const char* tag);
+  virtual void deserialize(std::vector<int64_t>& v, const char* tag);
+  virtual void deserialize(std::vector<float>& v, const char* tag);
+  virtual void deserialize(std::vector<double>& v, const char* tag);
+  virtual void skipString(const char* tag);
+  virtual void skipBuffer(const char* tag);
+  virtual void startRecord(Record& s, const char* tag);
+  virtual void endRecord(Record& s, const char* tag);
+  virtual Index* startVector(const char* tag);
+  virtual void endVector(Index* idx, const char* tag);
+  virtual Index* startMap(const char* tag);
+  virtual void endMap(Index* idx, const char* tag);
+  virtual bool atEnd();
+  virtual ~IBufferedBinArchive();
+};
+
+/**
+ * An OBinArchive that encodes into a buffer and writes it to the stream
+ * when it fills, when flush is called, and when the archive is destroyed.
+ * The destructor cannot report a failed write, so call flush first to
+ * see it.
+ */
+class OBufferedBinArchive : public OArchive {
+  friend class OStaticBinArchive;
+private:
+  OutStream& stream;
+  char* buffer;
+  size_t capacity;
+  char* pos;
+  void writeLong(int64_t t);
+  void writeBytes(const char* data, size_t len);
+  template <typename T> void writeLongs(const std::vector<T>& v);
+  template <typename T, typename Bits> void writeFloats(const std::vector<T>& v);
+  /** Make sure there is room for need bytes, which is at most capacity. */
+  void reserve(size_t need) {
+    if ((size_t) (buffer + capacity - pos) < need) {
+      flush();
+    }
+  }
+public:
+  OBufferedBinArchive(OutStream& _stream, size_t bufferSize = 65536);
+  /** Write what is buffered to the stream. */
+  void flush();
+  virtual void serialize(int8_t t, const char* tag);
+  virtual void serialize(bool t, const char* tag);
+  virtual void serialize(int32_t t, const char* tag);
+  virtual void serialize(int64_t t, const char* tag);
+  virtual void serialize(float t, const char* tag);
+  virtual void serialize(double t, const char* tag);
+  virtual void serialize(const std::string& t, const char* tag);
+  virtual void serialize(const std::string& t, size_t len, const char* tag);
+  virtual void serialize(const std::vector<int32_t>& v, const char* tag);
+  virtual void serialize(const std::vector<int64_t>& v, const char* tag);
+  virtual void serialize(const std::vector<float>& v, const char* tag);
+  virtual void serialize(const std::vector<double>& v, const char* tag);
+  virtual void startRecord(const Record& s, const char* tag);
+  virtual void endRecord(const Record& s, const char* tag);
+  virtual void startVector(size_t len, const char* tag);
+  virtual void endVector(size_t len, const char* tag);
+  virtual void startMap(size_t len, const char* tag);
+  virtual void endMap(size_t len, const char* tag);
+  virtual ~OBufferedBinArchive();
+};
+
+
+/**
+ * The kBinary format read without virtual calls, for records generated
+ * with a deserializeFrom template: rec.deserializeFrom(archive, NULL)
+ * reads a record with the field decoding inlined into it.  Reads through
+ * an IBufferedBinArchive, so the same read-ahead rules apply.
+ */
+class IStaticBinArchive {
+private:
+  IBufferedBinArchive archive;
+  int64_t readLong() {
+    if (archive.pos < archive.end && (int8_t) *archive.pos >= -112) {
+      return (int8_t) *archive.pos++;
+    }
+    return archive.readLong();
+  }
+public:
+  IStaticBinArchive(InStream& stream, size_t bufferSize = 65536)
+    : archive(stream, bufferSize) {}
+  IStaticBinArchive(MemoryInStream& stream) : archive(stream) {}
+  bool atEnd() { return archive.atEnd(); }
+  void deserialize(int8_t& t, const char* tag) {
+    archive.require(1);
+    t = *archive.pos++;
+  }
+  void deserialize(bool& t, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(t, tag);
+  }
+  void deserialize(int32_t& t, const char* tag) { t = readLong(); }
+  void deserialize(int64_t& t, const char* tag) { t = readLong(); }
+  void deserialize(float& t, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(t, tag);
+  }
+  void deserialize(double& t, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(t, tag);
+  }
+  void deserialize(std::string& t, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(t, tag);
+  }
+  void deserialize(std::string& t, size_t& len, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(t, len, tag);
+  }
+  void deserialize(const char*& data, size_t& len, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(data, len, tag);
+  }
+  void deserialize(std::vector<int32_t>& v, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(v, tag);
+  }
+  void deserialize(std::vector<int64_t>& v, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(v, tag);
+  }
+  void deserialize(std::vector<float>& v, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(v, tag);
+  }
+  void deserialize(std::vector<double>& v, const char* tag) {
+    archive.IBufferedBinArchive::deserialize(v, tag);
+  }
+  template <typename R>
+  void deserialize(R& r, const char* tag) {
+    r.deserializeFrom(*this, tag);
+  }
+  // vectors and maps reuse the elements already there, as in IArchive
+  template <typename T>
+  void deserialize(std::vector<T>& v, const char* tag) {
+    int32_t len = readLong();
+    size_t n = len > 0 ? len : 0;
+    if (n < v.size()) {
+      v.resize(n, T());
+    }
+    for (size_t cur = 0; cur < n; cur++) {
+      if (cur == v.size()) {
+        v.push_back(T());
+      }
+      deserialize(v[cur], tag);
+    }
+  }
+  void deserialize(std::vector<bool>& v, const char* tag) {
+    int32_t len = readLong();
+    v.clear();
+    for (int32_t cur = 0; cur < len; cur++) {
+      bool t;
+      deserialize(t, tag);
+      v.push_back(t);
+    }
+  }
+  template <typename K, typename V>
+  void deserialize(std::map<K,V>& v, const char* tag) {
+    typedef typename std::map<K,V>::iterator I;
+    int32_t len = readLong();
+    I cur = v.begin();
+    K key;
+    for (int32_t count = 0; count < len; count++) {
+      deserialize(key, tag);
+      while (cur != v.end() && cur->first < key) {
+        v.erase(cur++);
+      }
+      I entry = cur;
+      if (cur != v.end() && !(key < cur->first)) {
+        cur++;
+      } else {
+        entry = v.insert(cur, std::make_pair(key, V()));
+      }
+      deserialize(entry->second, tag);
+    }
+    v.erase(cur, v.end());
+  }
+  void startRecord(Record& s, const char* tag) {}
+  void endRecord(Record& s, const char* tag) {}
+};
+
+/**
+ * The kBinary format written without virtual calls, for records generated
+ * with a serializeTo template: rec.serializeTo(archive, NULL).  Writes
+ * through an OBufferedBinArchive, so call flush to see a failed write.
+ */
+class OStaticBinArchive {
+private:
+  OBufferedBinArchive archive;
+  void writeLong(int64_t t) {
+    if (t >= -112 && t <= 127) {
+      archive.reserve(1);
+      *archive.pos++ = (int8_t) t;
+      return;
+    }
+    archive.writeLong(t);
+  }
+public:
+  OStaticBinArchive(OutStream& stream, size_t bufferSize = 65536)
+    : archive(stream, bufferSize) {}
+  void flush() { archive.flush(); }
+  void serialize(int8_t t, const char* tag) {
+    archive.reserve(1);
+    *archive.pos++ = t;
+  }
+  void serialize(bool t, const char* tag) {
+    archive.OBufferedBinArchive::serialize(t, tag);
+  }
+  void serialize(int32_t t, const char* tag) { writeLong(t); }
+  void serialize(int64_t t, const char* tag) { writeLong(t); }
+  void serialize(float t, const char* tag) {
+    archive.OBufferedBinArchive::serialize(t, tag);
+  }
+  void serialize(double t, const char* tag) {
+    archive.OBufferedBinArchive::serialize(t, tag);
+  }
+  void serialize(const std::string& t, const char* tag) {
+    writeLong(t.length());
+    archive.writeBytes(t.data(), t.length());
+  }
+  void serialize(const std::string& t, size_t len, const char* tag) {
+    serialize(t, tag);
+  }
+  void serialize(const std::vector<int32_t>& v, const char* tag) {
+    archive.OBufferedBinArchive::serialize(v, tag);
+  }
+  void serialize(const std::vector<int64_t>& v, const char* tag) {
+    archive.OBufferedBinArchive::serialize(v, tag);
+  }
+  void serialize(const std::vector<float>& v, const char* tag) {
+    archive.OBufferedBinArchive::serialize(v, tag);
+  }
+  void serialize(const std::vector<double>& v, const char* tag) {
+    archive.OBufferedBinArchive::serialize(v, tag);
+  }
+  template <typename R>
+  void serialize(const R& r, const char* tag) {
+    r.serializeTo(*this, tag);
+  }
+  template <typename T>
+  void serialize(const std::vector<T>& v, const char* tag) {
+    writeLong((int32_t) v.size());
+    for (size_t cur = 0; cur < v.size(); cur++) {
+      // through a reference to T, so a std::vector<bool> element is a bool
+      const T& t = v[cur];
+      serialize(t, tag);
+    }
+  }
+  template <typename K, typename V>
+  void serialize(const std::map<K,V>& v, const char* tag) {
+    writeLong((int32_t) v.size());
+    typedef typename std::map<K,V>::const_iterator CI;
+    for (CI cur = v.begin(); cur != v.end(); cur++) {
+      serialize(cur->first, tag);
+      serialize(cur->second, tag);
+    }
+  }
+  void startRecord(const Record& s, const char* tag) {}
+  void endRecord(const Record& s, const char* tag) {}
+};
+
 }
 #endif /*BINARCHIVE_HH_*/
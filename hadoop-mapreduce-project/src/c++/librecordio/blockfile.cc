@@ -0,0 +1,539 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "blockfile.hh"
+
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef RECORDIO_SNAPPY
+#include <snappy-c.h>
+#endif
+#ifdef RECORDIO_LZ4
+#include <lz4.h>
+#endif
+
+using namespace hadoop;
+
+static const char kHeaderMagic[4] = { 'R', 'I', 'O', 'B' };
+static const char kFooterMagic[4] = { 'R', 'I', 'O', 'F' };
+static const int8_t kVersion = 1;
+// magic, version, codec, sync marker
+static const size_t kHeaderLength = 4 + 1 + 1 + 16;
+// sync marker, record count, raw length, stored length, CRC-32
+static const size_t kBlockHeaderLength = 16 + 4 + 4 + 4 + 4;
+// a record count of -1 after a sync marker starts the footer: the block
+// offsets and first record numbers, the record total, where the footer
+// starts and the footer magic
+static const int32_t kFooterMark = -1;
+static const size_t kFooterTailLength = 8 + 4;
+
+static void putInt32(char* buf, uint32_t t)
+{
+  for (int idx = 0; idx < 4; idx++) {
+    buf[idx] = (char) (t >> ((3 - idx) * 8));
+  }
+}
+
+static uint32_t getInt32(const char* buf)
+{
+  uint32_t t = 0;
+  for (int idx = 0; idx < 4; idx++) {
+    t = (t << 8) | (uint8_t) buf[idx];
+  }
+  return t;
+}
+
+static void putInt64(char* buf, uint64_t t)
+{
+  putInt32(buf, (uint32_t) (t >> 32));
+  putInt32(buf + 4, (uint32_t) t);
+}
+
+static uint64_t getInt64(const char* buf)
+{
+  return ((uint64_t) getInt32(buf) << 32) | getInt32(buf + 4);
+}
+
+static void appendInt32(std::string& s, uint32_t t)
+{
+  char buf[4];
+  putInt32(buf, t);
+  s.append(buf, 4);
+}
+
+static void appendInt64(std::string& s, uint64_t t)
+{
+  char buf[8];
+  putInt64(buf, t);
+  s.append(buf, 8);
+}
+
+static bool readFully(InStream& stream, char* buf, size_t len)
+{
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = stream.read(buf + done, len - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+// splitmix64, to spread a seed over the bits of the sync marker
+static uint64_t mix(uint64_t& state)
+{
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void newSyncMarker(char* marker, const void* seed)
+{
+  static uint64_t counter = 0;
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint64_t state = ((uint64_t) tv.tv_sec << 20) ^ (uint64_t) tv.tv_usec ^
+    ((uint64_t) getpid() << 32) ^ (uint64_t) (size_t) seed ^ (++counter << 48);
+  putInt64(marker, mix(state));
+  putInt64(marker + 8, mix(state));
+}
+
+static bool codecAvailable(int codec)
+{
+  switch (codec) {
+    case kNoCodec:
+    case kDeflateCodec:
+      return true;
+#ifdef RECORDIO_SNAPPY
+    case kSnappyCodec:
+      return true;
+#endif
+#ifdef RECORDIO_LZ4
+    case kLz4Codec:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+static void compressBlock(BlockCodec codec, const std::string& raw,
+                          std::string& out)
+{
+  switch (codec) {
+    case kDeflateCodec: {
+      uLongf len = compressBound(raw.length());
+      out.resize(len);
+      if (compress((Bytef*) &out[0], &len, (const Bytef*) raw.data(),
+                   raw.length()) != Z_OK) {
+        throw new IOException("Error compressing block.");
+      }
+      out.resize(len);
+      return;
+    }
+#ifdef RECORDIO_SNAPPY
+    case kSnappyCodec: {
+      size_t len = snappy_max_compressed_length(raw.length());
+      out.resize(len);
+      if (snappy_compress(raw.data(), raw.length(), &out[0], &len)
+          != SNAPPY_OK) {
+        throw new IOException("Error compressing block.");
+      }
+      out.resize(len);
+      return;
+    }
+#endif
+#ifdef RECORDIO_LZ4
+    case kLz4Codec: {
+      int len = LZ4_compressBound(raw.length());
+      out.resize(len);
+      len = LZ4_compress_default(raw.data(), &out[0], raw.length(), len);
+      if (len <= 0) {
+        throw new IOException("Error compressing block.");
+      }
+      out.resize(len);
+      return;
+    }
+#endif
+    default:
+      throw new IOException("Unsupported block codec.");
+  }
+}
+
+static void decompressBlock(BlockCodec codec, const std::string& stored,
+                            size_t rawLength, std::string& raw)
+{
+  raw.resize(rawLength);
+  switch (codec) {
+    case kDeflateCodec: {
+      uLongf len = rawLength;
+      if (uncompress((Bytef*) &raw[0], &len, (const Bytef*) stored.data(),
+                     stored.length()) != Z_OK || len != rawLength) {
+        throw new IOException("Error decompressing block.");
+      }
+      return;
+    }
+#ifdef RECORDIO_SNAPPY
+    case kSnappyCodec: {
+      size_t len = rawLength;
+      if (snappy_uncompress(stored.data(), stored.length(), &raw[0], &len)
+          != SNAPPY_OK || len != rawLength) {
+        throw new IOException("Error decompressing block.");
+      }
+      return;
+    }
+#endif
+#ifdef RECORDIO_LZ4
+    case kLz4Codec: {
+      if (LZ4_decompress_safe(stored.data(), &raw[0], stored.length(),
+                              rawLength) != (int) rawLength) {
+        throw new IOException("Error decompressing block.");
+      }
+      return;
+    }
+#endif
+    default:
+      throw new IOException("Unsupported block codec.");
+  }
+}
+
+static uint32_t checksum(const std::string& data)
+{
+  return crc32(0L, (const Bytef*) data.data(), data.length());
+}
+
+ssize_t hadoop::BlockInStream::read(void *buf, size_t buflen)
+{
+  if (data == NULL) {
+    return 0;
+  }
+  size_t n = data->length() - pos;
+  if (n > buflen) {
+    n = buflen;
+  }
+  memcpy(buf, data->data() + pos, n);
+  pos += n;
+  return n;
+}
+
+hadoop::BlockRecordWriter::BlockRecordWriter(OutStream& _stream,
+                                             BlockCodec _codec,
+                                             size_t _blockSize)
+  : stream(_stream), codec(_codec), blockSize(_blockSize),
+    blockStream(block),
+    archive(blockStream, _blockSize < 65536 ? _blockSize : 65536),
+    records(0), totalRecords(0), offset(0), closed(false)
+{
+  if (!codecAvailable(codec)) {
+    throw new IOException("Unsupported block codec.");
+  }
+  newSyncMarker(marker, this);
+  char header[kHeaderLength];
+  memcpy(header, kHeaderMagic, 4);
+  header[4] = kVersion;
+  header[5] = (char) codec;
+  memcpy(header + 6, marker, 16);
+  writeBytes(header, kHeaderLength);
+}
+
+void hadoop::BlockRecordWriter::writeBytes(const void* buf, size_t len)
+{
+  if ((ssize_t) len != stream.write(buf, len)) {
+    throw new IOException("Error writing block.");
+  }
+  offset += len;
+}
+
+void hadoop::BlockRecordWriter::writeBlock()
+{
+  const std::string* stored = &block;
+  if (codec != kNoCodec) {
+    compressBlock(codec, block, compressed);
+    stored = &compressed;
+  }
+  BlockInfo info;
+  info.offset = offset;
+  info.firstRecord = totalRecords - records;
+  blocks.push_back(info);
+  char header[kBlockHeaderLength];
+  memcpy(header, marker, 16);
+  putInt32(header + 16, records);
+  putInt32(header + 20, block.length());
+  putInt32(header + 24, stored->length());
+  putInt32(header + 28, checksum(*stored));
+  writeBytes(header, kBlockHeaderLength);
+  writeBytes(stored->data(), stored->length());
+  block.clear();
+  records = 0;
+}
+
+void hadoop::BlockRecordWriter::write(const Record& record)
+{
+  record.serialize(archive, NULL);
+  records++;
+  totalRecords++;
+  // the archive's buffer goes into the block when it fills, so blocks
+  // hold up to a buffer more than blockSize
+  if (block.length() >= blockSize) {
+    flush();
+  }
+}
+
+void hadoop::BlockRecordWriter::flush()
+{
+  archive.flush();
+  if (records > 0) {
+    writeBlock();
+  }
+}
+
+void hadoop::BlockRecordWriter::close()
+{
+  if (closed) {
+    return;
+  }
+  closed = true;
+  flush();
+  std::string footer(marker, 16);
+  appendInt32(footer, kFooterMark);
+  appendInt32(footer, blocks.size());
+  for (size_t cur = 0; cur < blocks.size(); cur++) {
+    appendInt64(footer, blocks[cur].offset);
+    appendInt64(footer, blocks[cur].firstRecord);
+  }
+  appendInt64(footer, totalRecords);
+  appendInt64(footer, offset);
+  footer.append(kFooterMagic, 4);
+  writeBytes(footer.data(), footer.length());
+}
+
+hadoop::BlockRecordWriter::~BlockRecordWriter()
+{
+  try {
+    close();
+  } catch (IOException* e) {
+    delete e;
+  }
+}
+
+hadoop::BlockRecordReader::BlockRecordReader(InStream& _stream)
+  : stream(_stream), file(NULL), codec(kNoCodec), archive(blockStream),
+    records(0), offset(0), limit(-1), done(false)
+{
+  readHeader();
+}
+
+hadoop::BlockRecordReader::BlockRecordReader(FileInStream& _stream,
+                                             int64_t start, int64_t end)
+  : stream(_stream), file(&_stream), codec(kNoCodec), archive(blockStream),
+    records(0), offset(0), limit(end), done(false)
+{
+  readHeader();
+  if (start > offset) {
+    sync(start);
+  }
+}
+
+void hadoop::BlockRecordReader::readBytes(void* buf, size_t len)
+{
+  if (!readFully(stream, (char*) buf, len)) {
+    throw new IOException("Error reading block.");
+  }
+  offset += len;
+}
+
+void hadoop::BlockRecordReader::readHeader()
+{
+  char header[kHeaderLength];
+  readBytes(header, kHeaderLength);
+  if (memcmp(header, kHeaderMagic, 4) != 0 || header[4] != kVersion) {
+    throw new IOException("Not a block file.");
+  }
+  if (!codecAvailable(header[5])) {
+    throw new IOException("Unsupported block codec.");
+  }
+  codec = (BlockCodec) header[5];
+  memcpy(marker, header + 6, 16);
+}
+
+bool hadoop::BlockRecordReader::readBlock()
+{
+  if (done || (limit >= 0 && offset >= limit)) {
+    done = true;
+    return false;
+  }
+  char header[kBlockHeaderLength];
+  size_t have = 0;
+  while (have < kBlockHeaderLength) {
+    ssize_t n = stream.read(header + have, kBlockHeaderLength - have);
+    if (n <= 0) {
+      break;
+    }
+    have += n;
+  }
+  // the file of a writer that was never closed ends after a block
+  if (have == 0) {
+    done = true;
+    return false;
+  }
+  offset += have;
+  if (have < kBlockHeaderLength || memcmp(header, marker, 16) != 0) {
+    throw new IOException("Error reading block: no sync marker.");
+  }
+  int32_t count = getInt32(header + 16);
+  if (count == kFooterMark) {
+    done = true;
+    return false;
+  }
+  size_t rawLength = getInt32(header + 20);
+  size_t storedLength = getInt32(header + 24);
+  uint32_t crc = getInt32(header + 28);
+  if (count <= 0 || storedLength == 0 ||
+      (codec == kNoCodec && rawLength != storedLength)) {
+    throw new IOException("Error reading block: bad header.");
+  }
+  std::string& stored = (codec == kNoCodec) ? block : compressed;
+  stored.resize(storedLength);
+  readBytes(&stored[0], storedLength);
+  if (checksum(stored) != crc) {
+    throw new IOException("Error reading block: checksum mismatch.");
+  }
+  if (codec != kNoCodec) {
+    decompressBlock(codec, compressed, rawLength, block);
+  }
+  blockStream.reset(block);
+  records = count;
+  return true;
+}
+
+bool hadoop::BlockRecordReader::read(Record& record)
+{
+  while (records == 0) {
+    if (!readBlock()) {
+      return false;
+    }
+  }
+  record.deserialize(archive, NULL);
+  if (--records == 0 && !archive.atEnd()) {
+    throw new IOException("Error reading block: bytes after the records.");
+  }
+  return true;
+}
+
+void hadoop::BlockRecordReader::seek(int64_t position)
+{
+  if (file == NULL) {
+    throw new IOException("Block file is not seekable.");
+  }
+  if (!file->seek(position)) {
+    throw new IOException("Error seeking in block file.");
+  }
+  offset = position;
+  records = 0;
+  done = false;
+  // drop what the archive had read ahead of the block it was in
+  archive.pos = archive.end = archive.buffer;
+  blockStream.reset(block);
+  block.clear();
+}
+
+void hadoop::BlockRecordReader::sync(int64_t position)
+{
+  if (position < (int64_t) kHeaderLength) {
+    position = kHeaderLength;
+  }
+  seek(position);
+  // look for the marker a chunk at a time, keeping the end of each chunk
+  // in case a marker straddles two
+  char buf[65536];
+  size_t have = 0;
+  int64_t base = position;
+  while (true) {
+    ssize_t n = file->read(buf + have, sizeof(buf) - have);
+    if (n <= 0) {
+      done = true;
+      return;
+    }
+    have += n;
+    for (size_t cur = 0; cur + 16 <= have; cur++) {
+      if (buf[cur] == marker[0] && memcmp(buf + cur, marker, 16) == 0) {
+        seek(base + cur);
+        return;
+      }
+    }
+    size_t keep = have < 15 ? have : 15;
+    memmove(buf, buf + have - keep, keep);
+    base += have - keep;
+    have = keep;
+  }
+}
+
+void hadoop::BlockRecordReader::seekToBlock(const BlockInfo& info)
+{
+  seek(info.offset);
+}
+
+bool hadoop::BlockRecordReader::readIndex(std::vector<BlockInfo>& blocks,
+                                          int64_t& totalRecords)
+{
+  if (file == NULL) {
+    throw new IOException("Block file is not seekable.");
+  }
+  bool found = false;
+  int64_t length = file->length();
+  char tail[kFooterTailLength];
+  if (length >= (int64_t) (kHeaderLength + kFooterTailLength) &&
+      file->seek(length - kFooterTailLength) &&
+      readFully(*file, tail, kFooterTailLength) &&
+      memcmp(tail + 8, kFooterMagic, 4) == 0) {
+    int64_t start = getInt64(tail);
+    std::string footer;
+    if (start >= (int64_t) kHeaderLength && start < length &&
+        file->seek(start)) {
+      footer.resize(length - start);
+      if (!readFully(*file, &footer[0], footer.length())) {
+        footer.clear();
+      }
+    }
+    // marker, mark, count, entries, total, start, magic
+    size_t fixed = 16 + 4 + 4 + 8 + kFooterTailLength;
+    if (footer.length() >= fixed && memcmp(footer.data(), marker, 16) == 0 &&
+        (int32_t) getInt32(footer.data() + 16) == kFooterMark) {
+      size_t count = getInt32(footer.data() + 20);
+      if (footer.length() == fixed + count * 16) {
+        blocks.resize(count);
+        const char* p = footer.data() + 24;
+        for (size_t cur = 0; cur < count; cur++, p += 16) {
+          blocks[cur].offset = getInt64(p);
+          blocks[cur].firstRecord = getInt64(p + 8);
+        }
+        totalRecords = getInt64(p);
+        found = true;
+      }
+    }
+  }
+  if (!file->seek(offset)) {
+    throw new IOException("Error seeking in block file.");
+  }
+  return found;
+}
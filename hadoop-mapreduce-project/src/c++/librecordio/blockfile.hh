@@ -0,0 +1,177 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLOCKFILE_HH_
+#define BLOCKFILE_HH_
+
+#include "binarchive.hh"
+#include "filestream.hh"
+
+namespace hadoop {
+
+/**
+ * How the blocks of a block file are compressed.  Deflate is always
+ * there; snappy and lz4 need the library built with RECORDIO_SNAPPY or
+ * RECORDIO_LZ4, and programs linked with -lsnappy or -llz4.
+ */
+enum BlockCodec { kNoCodec = 0, kDeflateCodec = 1, kSnappyCodec = 2,
+                  kLz4Codec = 3 };
+
+/**
+ * Where a block starts in a block file, and the number of its first
+ * record counting from zero.
+ */
+struct BlockInfo {
+  int64_t offset;
+  int64_t firstRecord;
+};
+
+/**
+ * A stream that reads the block a BlockRecordReader has loaded, and ends
+ * where the block does.
+ */
+class BlockInStream : public InStream {
+private:
+  const std::string* data;
+  size_t pos;
+public:
+  BlockInStream() : data(NULL), pos(0) {}
+  void reset(const std::string& block) { data = &block; pos = 0; }
+  ssize_t read(void *buf, size_t buflen);
+  bool atEnd() { return data == NULL || pos == data->length(); }
+};
+
+/** A stream that appends to a string. */
+class BlockOutStream : public OutStream {
+private:
+  std::string& data;
+public:
+  BlockOutStream(std::string& block) : data(block) {}
+  ssize_t write(const void *buf, size_t len) {
+    data.append((const char*) buf, len);
+    return len;
+  }
+};
+
+/**
+ * Writes records in the kBinary format, grouped into blocks that are
+ * compressed on their own.  The file starts with a header giving the
+ * codec and a random sync marker.  Each block starts with the sync
+ * marker, so a reader can find the next block from any offset; this
+ * allows a file to be split for parallel reads.  The block goes on with
+ * its record count, raw and stored lengths and a CRC-32 of the stored
+ * bytes.  close() writes a footer that indexes the blocks.
+ *
+ * The writer counts offsets from where it started, so the stream should
+ * be at the start of a file.
+ */
+class BlockRecordWriter {
+private:
+  OutStream& stream;
+  BlockCodec codec;
+  size_t blockSize;
+  char marker[16];
+  std::string block;
+  std::string compressed;
+  BlockOutStream blockStream;
+  OBufferedBinArchive archive;
+  int32_t records;
+  int64_t totalRecords;
+  int64_t offset;
+  std::vector<BlockInfo> blocks;
+  bool closed;
+  void writeBytes(const void* buf, size_t len);
+  void writeBlock();
+  BlockRecordWriter(const BlockRecordWriter&);
+  BlockRecordWriter& operator=(const BlockRecordWriter&);
+public:
+  /**
+   * @param blockSize roughly how many uncompressed bytes of records go
+   *   into a block; a record is never split between blocks
+   */
+  BlockRecordWriter(OutStream& stream, BlockCodec codec = kNoCodec,
+                    size_t blockSize = 1048576);
+  void write(const hadoop::Record& record);
+  /** End the current block, so the records so far can be read back. */
+  void flush();
+  /** Write the last block and the footer. */
+  void close();
+  /** Closes the writer if that wasn't done; errors are dropped then. */
+  ~BlockRecordWriter();
+};
+
+/**
+ * Reads the records of a file written by BlockRecordWriter.  Over a
+ * FileInStream it can also read the blocks that start in part of the
+ * file, and find them through the footer.
+ */
+class BlockRecordReader {
+private:
+  InStream& stream;
+  FileInStream* file;
+  BlockCodec codec;
+  char marker[16];
+  std::string block;
+  std::string compressed;
+  BlockInStream blockStream;
+  IBufferedBinArchive archive;
+  int32_t records;
+  int64_t offset;
+  int64_t limit;
+  bool done;
+  void readHeader();
+  void readBytes(void* buf, size_t len);
+  bool readBlock();
+  void seek(int64_t position);
+  BlockRecordReader(const BlockRecordReader&);
+  BlockRecordReader& operator=(const BlockRecordReader&);
+public:
+  BlockRecordReader(InStream& stream);
+  /**
+   * Read the blocks whose sync marker starts in [start, end), which is
+   * how the splits of a file share out its blocks.  The stream should be
+   * at the start of the file.
+   * @param end -1 for the end of the file
+   */
+  BlockRecordReader(FileInStream& stream, int64_t start = 0,
+                    int64_t end = -1);
+  BlockCodec getCodec() const { return codec; }
+  /**
+   * Read the next record.
+   * @return false once the records have run out
+   */
+  bool read(hadoop::Record& record);
+  /**
+   * Go on from the first block that starts at or after position.  Needs
+   * a FileInStream.
+   */
+  void sync(int64_t position);
+  /**
+   * Go on from a block found in the index.  Needs a FileInStream.
+   */
+  void seekToBlock(const BlockInfo& info);
+  /**
+   * Read the block index from the footer.  Needs a FileInStream.
+   * @return false if the file has no footer, as when the writer was
+   *   never closed
+   */
+  bool readIndex(std::vector<BlockInfo>& blocks, int64_t& totalRecords);
+};
+
+}; // end namespace hadoop
+#endif /*BLOCKFILE_HH_*/
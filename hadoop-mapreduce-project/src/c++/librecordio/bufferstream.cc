@@ -0,0 +1,95 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferstream.hh"
+
+using namespace hadoop;
+
+hadoop::BufferOutStream::BufferOutStream(size_t initialCapacity)
+{
+  mData = NULL;
+  mSize = 0;
+  mCapacity = 0;
+  if (initialCapacity > 0) {
+    grow(initialCapacity);
+  }
+}
+
+void hadoop::BufferOutStream::grow(size_t need)
+{
+  size_t capacity = mCapacity > 0 ? mCapacity : 256;
+  while (capacity < need) {
+    capacity *= 2;
+  }
+  char* bigger = new char[capacity];
+  if (mSize > 0) {
+    memcpy(bigger, mData, mSize);
+  }
+  delete[] mData;
+  mData = bigger;
+  mCapacity = capacity;
+}
+
+char* hadoop::BufferOutStream::reserve(size_t len)
+{
+  if (mCapacity - mSize < len) {
+    grow(mSize + len);
+  }
+  return mData + mSize;
+}
+
+ssize_t hadoop::BufferOutStream::write(const void* buf, size_t len)
+{
+  if (len > 0) {
+    memcpy(reserve(len), buf, len);
+    mSize += len;
+  }
+  return len;
+}
+
+char* hadoop::BufferOutStream::release(size_t& len)
+{
+  char* data = mData;
+  len = mSize;
+  mData = NULL;
+  mSize = 0;
+  mCapacity = 0;
+  return data;
+}
+
+hadoop::BufferOutStream::~BufferOutStream()
+{
+  delete[] mData;
+}
+
+ssize_t hadoop::BufferInStream::read(void *buf, size_t len)
+{
+  size_t n = len < mSize - mPos ? len : mSize - mPos;
+  memcpy(buf, mData + mPos, n);
+  mPos += n;
+  return n;
+}
+
+bool hadoop::BufferInStream::skip(size_t nbytes)
+{
+  if (nbytes > mSize - mPos) {
+    return false;
+  }
+  mPos += nbytes;
+  return true;
+}
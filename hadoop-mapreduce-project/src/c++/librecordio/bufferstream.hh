@@ -0,0 +1,102 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BUFFERSTREAM_HH_
+#define BUFFERSTREAM_HH_
+
+#include <stdint.h>
+#include <string>
+#include "recordio.hh"
+
+namespace hadoop {
+
+/**
+ * An OutStream that writes into a buffer it owns, which grows by doubling.
+ * A record can be serialized into it and the bytes used where they are:
+ * through data() and size(), or by taking the storage with release().
+ * clear() keeps the storage, so a stream reused for each record stops
+ * allocating once it has held the largest one.
+ */
+class BufferOutStream : public OutStream {
+public:
+  BufferOutStream(size_t initialCapacity = 256);
+  ssize_t write(const void* buf, size_t len);
+  /**
+   * Make room for len more bytes, to be written in place and then added
+   * with commit.
+   * @return where the bytes go; valid until the next call that grows the
+   *   buffer
+   */
+  char* reserve(size_t len);
+  /** Add len bytes written after the end, as reserve allowed. */
+  void commit(size_t len) { mSize += len; }
+  /** The bytes written; valid until the buffer grows or is released. */
+  const char* data() const { return mData; }
+  size_t size() const { return mSize; }
+  size_t capacity() const { return mCapacity; }
+  /** Drop what has been written, keeping the storage. */
+  void clear() { mSize = 0; }
+  /**
+   * Take the storage, which the caller must delete[].  The stream is left
+   * empty, and allocates again when it is next written.
+   * @param len set to the number of bytes written
+   * @return the bytes written, or NULL if the stream has no storage
+   */
+  char* release(size_t& len);
+  virtual ~BufferOutStream();
+private:
+  char* mData;
+  size_t mSize;
+  size_t mCapacity;
+  void grow(size_t need);
+  BufferOutStream(const BufferOutStream&);
+  BufferOutStream& operator=(const BufferOutStream&);
+};
+
+/**
+ * An InStream that reads bytes the caller keeps in memory, without
+ * copying them.  IBufferedBinArchive and IStaticBinArchive decode straight
+ * from them, so strings read in place point into the caller's bytes.
+ */
+class BufferInStream : public MemoryInStream {
+public:
+  BufferInStream() : mData(NULL), mSize(0), mPos(0) {}
+  /** Read the len bytes at data, which must outlive the reads. */
+  BufferInStream(const char* data, size_t len)
+    : mData(data), mSize(len), mPos(0) {}
+  /** Read other bytes from the start. */
+  void reset(const char* data, size_t len) {
+    mData = data;
+    mSize = len;
+    mPos = 0;
+  }
+  ssize_t read(void *buf, size_t buflen);
+  bool skip(size_t nbytes);
+  bool atEnd() { return mPos == mSize; }
+  const char* data() const { return mData + mPos; }
+  size_t available() const { return mSize - mPos; }
+  /** The offset of the next byte to be read. */
+  size_t tell() const { return mPos; }
+private:
+  const char* mData;
+  size_t mSize;
+  size_t mPos;
+};
+
+}; // end namespace
+#endif /*BUFFERSTREAM_HH_*/
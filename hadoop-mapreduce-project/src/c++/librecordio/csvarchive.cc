@@ -18,126 +18,264 @@
 
 #include "csvarchive.hh"
 #include <stdlib.h>
+#include <string.h>
 
 using namespace hadoop;
 
-static std::string readUptoTerminator(PushBackInStream& stream)
+static inline bool isTerminator(char c)
 {
-  std::string s;
+  return c == ',' || c == '\n' || c == '}';
+}
+
+void hadoop::PushBackInStream::setStream(InStream* stream_, size_t bufferSize)
+{
+  stream = stream_;
+  isAvail = false;
+  pbchar = 0;
+  delete[] buffer;
+  buffer = bufferSize > 0 ? new char[bufferSize] : NULL;
+  capacity = bufferSize;
+  pos = end = buffer;
+}
+
+bool hadoop::PushBackInStream::fill()
+{
+  ssize_t n = stream->read(buffer, capacity);
+  if (n <= 0) {
+    return false;
+  }
+  pos = buffer;
+  end = buffer + n;
+  return true;
+}
+
+ssize_t hadoop::PushBackInStream::read(void* buf, size_t len)
+{
+  char* p = (char*) buf;
+  size_t done = 0;
+  if (len > 0 && isAvail) {
+    *p = pbchar;
+    isAvail = false;
+    done = 1;
+  }
+  if (buffer == NULL) {
+    if (done < len) {
+      ssize_t ret = stream->read(p + done, len - done);
+      return ret + done;
+    }
+    return done;
+  }
+  while (done < len) {
+    if (pos == end) {
+      if (len - done >= capacity) {
+        ssize_t ret = stream->read(p + done, len - done);
+        return ret > 0 ? ret + done : done;
+      }
+      if (!fill()) {
+        break;
+      }
+    }
+    size_t n = end - pos;
+    if (n > len - done) {
+      n = len - done;
+    }
+    memcpy(p + done, pos, n);
+    pos += n;
+    done += n;
+  }
+  return done;
+}
+
+void hadoop::PushBackInStream::readField(std::string& s)
+{
+  s.clear();
+  if (isAvail) {
+    isAvail = false;
+    if (isTerminator(pbchar)) {
+      if (pbchar != ',') {
+        isAvail = true;
+      }
+      return;
+    }
+    s.push_back(pbchar);
+  }
+  if (buffer == NULL) {
+    while (1) {
+      char c;
+      if (1 != stream->read(&c, 1)) {
+        throw new IOException("Error in deserialization.");
+      }
+      if (isTerminator(c)) {
+        if (c != ',') {
+          pushBack(c);
+        }
+        return;
+      }
+      s.push_back(c);
+    }
+  }
   while (1) {
-    char c;
-    if (1 != stream.read(&c, 1)) {
+    if (pos == end && !fill()) {
       throw new IOException("Error in deserialization.");
     }
-    if (c == ',' || c == '\n' || c == '}') {
-      if (c != ',') {
-        stream.pushBack(c);
+    const char* p = pos;
+    while (p < end && !isTerminator(*p)) {
+      p++;
+    }
+    s.append(pos, p - pos);
+    if (p < end) {
+      pos = p + 1;
+      if (*p != ',') {
+        pushBack(*p);
       }
-      break;
+      return;
     }
-    s.push_back(c);
+    pos = end;
+  }
+}
+
+bool hadoop::PushBackInStream::atEnd()
+{
+  if (isAvail || pos < end) {
+    return false;
+  }
+  if (buffer == NULL) {
+    return stream->atEnd();
+  }
+  return !fill();
+}
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
   }
-  return s;
+  return -1;
 }
 
 void hadoop::ICsvArchive::deserialize(int8_t& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = (int8_t) strtol(s.c_str(), NULL, 10);
+  stream.readField(field);
+  t = (int8_t) strtol(field.c_str(), NULL, 10);
 }
 
 void hadoop::ICsvArchive::deserialize(bool& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = (s == "T") ? true : false;
+  stream.readField(field);
+  t = (field == "T") ? true : false;
 }
 
 void hadoop::ICsvArchive::deserialize(int32_t& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = strtol(s.c_str(), NULL, 10);
+  stream.readField(field);
+  t = strtol(field.c_str(), NULL, 10);
 }
 
 void hadoop::ICsvArchive::deserialize(int64_t& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = strtoll(s.c_str(), NULL, 10);
+  stream.readField(field);
+  t = strtoll(field.c_str(), NULL, 10);
 }
 
 void hadoop::ICsvArchive::deserialize(float& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = strtof(s.c_str(), NULL);
+  stream.readField(field);
+  t = strtof(field.c_str(), NULL);
 }
 
 void hadoop::ICsvArchive::deserialize(double& t, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  t = strtod(s.c_str(), NULL);
+  stream.readField(field);
+  t = strtod(field.c_str(), NULL);
 }
 
 void hadoop::ICsvArchive::deserialize(std::string& t, const char* tag)
 {
-  std::string temp = readUptoTerminator(stream);
-  if (temp[0] != '\'') {
+  stream.readField(field);
+  if (field.empty() || field[0] != '\'') {
     throw new IOException("Errror deserializing string.");
   }
   t.clear();
-  // skip first character, replace escaped characters 
-  int len = temp.length();
-  for (int i = 1; i < len; i++) {
-    char c = temp.at(i);
-    if (c == '%') {
-      // since we escape '%', there have to be at least two chars following a '%'
-      char ch1 = temp.at(i+1);
-      char ch2 = temp.at(i+2);
-      i += 2;
-	  if (ch1 == '0' && ch2 == '0') {
-	    t.append(1, '\0');
-	  } else if (ch1 == '0' && ch2 == 'A') {
-	    t.append(1, '\n');
-	  } else if (ch1 == '0' && ch2 == 'D') {
-	    t.append(1, '\r');
-	  } else if (ch1 == '2' && ch2 == 'C') {
-	    t.append(1, ',');
-	  } else if (ch1 == '7' && ch2 == 'D') {
-	    t.append(1, '}');
-	  } else if (ch1 == '2' && ch2 == '5') {
-	    t.append(1, '%');
-	  } else {
-	    throw new IOException("Error deserializing string.");
-	  }
-    } 
-    else {
-      t.append(1, c);
+  // skip first character, replace escaped characters, copying the runs
+  // between them in one go
+  const char* p = field.data() + 1;
+  const char* last = field.data() + field.length();
+  while (p < last) {
+    const char* esc = (const char*) memchr(p, '%', last - p);
+    if (esc == NULL) {
+      t.append(p, last - p);
+      break;
+    }
+    t.append(p, esc - p);
+    // since we escape '%', there have to be at least two chars following a '%'
+    if (last - esc < 3) {
+      throw new IOException("Error deserializing string.");
     }
+    char ch1 = esc[1];
+    char ch2 = esc[2];
+    if (ch1 == '0' && ch2 == '0') {
+      t.append(1, '\0');
+    } else if (ch1 == '0' && ch2 == 'A') {
+      t.append(1, '\n');
+    } else if (ch1 == '0' && ch2 == 'D') {
+      t.append(1, '\r');
+    } else if (ch1 == '2' && ch2 == 'C') {
+      t.append(1, ',');
+    } else if (ch1 == '7' && ch2 == 'D') {
+      t.append(1, '}');
+    } else if (ch1 == '2' && ch2 == '5') {
+      t.append(1, '%');
+    } else {
+      throw new IOException("Error deserializing string.");
+    }
+    p = esc + 3;
   }
 }
 
 void hadoop::ICsvArchive::deserialize(std::string& t, size_t& len, const char* tag)
 {
-  std::string s = readUptoTerminator(stream);
-  if (s[0] != '#') {
+  stream.readField(field);
+  if (field.empty() || field[0] != '#') {
     throw new IOException("Errror deserializing buffer.");
   }
-  s.erase(0, 1); /// erase first character
-  len = s.length();
+  len = field.length() - 1;
   if (len%2 == 1) { // len is guaranteed to be even
     throw new IOException("Errror deserializing buffer.");
   }
   len = len >> 1;
+  t.resize(len);
   for (size_t idx = 0; idx < len; idx++) {
-    char buf[3];
-    buf[0] = s[2*idx];
-    buf[1] = s[2*idx+1];
-    buf[2] = '\0';
-    int i;
-    if (1 != sscanf(buf, "%2x", &i)) {
+    // the writer pads bytes below 0x10 with a space rather than a zero
+    char c = field[2*idx+1];
+    int hi = (c == ' ') ? 0 : hexValue(c);
+    int lo = hexValue(field[2*idx+2]);
+    if (hi < 0 || lo < 0) {
       throw new IOException("Errror deserializing buffer.");
     }
-    t.push_back((char) i);
+    t[idx] = (char) (hi << 4 | lo);
+  }
+}
+
+void hadoop::ICsvArchive::skipString(const char* tag)
+{
+  stream.readField(field);
+  if (field.empty() || field[0] != '\'') {
+    throw new IOException("Errror deserializing string.");
+  }
+}
+
+void hadoop::ICsvArchive::skipBuffer(const char* tag)
+{
+  stream.readField(field);
+  if (field.empty() || field[0] != '#') {
+    throw new IOException("Errror deserializing buffer.");
   }
-  len = t.length();
 }
 
 void hadoop::ICsvArchive::startRecord(Record& s, const char* tag)
@@ -166,7 +304,7 @@ void hadoop::ICsvArchive::endRecord(Record& s, const char* tag)
   } else if (mark != '}') {
     throw new IOException("Error deserializing record.");
   } else {
-    readUptoTerminator(stream);
+    stream.readField(field);
   }
 }
 
@@ -192,7 +330,7 @@ void hadoop::ICsvArchive::endVector(Index* idx, const char* tag)
   if (mark != '}') {
     throw new IOException("Error deserializing vector.");
   }
-  readUptoTerminator(stream);
+  stream.readField(field);
 }
 
 Index* hadoop::ICsvArchive::startMap(const char* tag)
@@ -218,7 +356,7 @@ void hadoop::ICsvArchive::endMap(Index* idx, const char* tag)
   if (mark != '}') {
     throw new IOException("Error deserializing map.");
   }
-  readUptoTerminator(stream);
+  stream.readField(field);
 }
 
 hadoop::ICsvArchive::~ICsvArchive()
@@ -23,36 +23,38 @@
 
 namespace hadoop {
 
+/**
+ * An InStream that can take back the last character read.  Given a
+ * buffer size it also reads its stream in blocks of that size, so it
+ * must then be the only reader of the stream.
+ */
 class PushBackInStream {
 private:
   InStream* stream;
   bool isAvail;
   char pbchar;
+  char* buffer;
+  size_t capacity;
+  const char* pos;
+  const char* end;
+  bool fill();
 public:
-  void setStream(InStream* stream_) {
-    stream = stream_;
-    isAvail = false;
-    pbchar = 0;
-  }
-  ssize_t read(void* buf, size_t len) {
-    if (len > 0 && isAvail) {
-      char* p = (char*) buf;
-      *p = pbchar;
-      isAvail = false;
-      if (len > 1) {
-        ssize_t ret = stream->read((char*)buf + 1, len - 1);
-        return ret + 1;
-      } else {
-        return 1;
-      }
-    } else {
-      return stream->read(buf, len);
-    }
-  }
+  PushBackInStream() : stream(NULL), isAvail(false), pbchar(0),
+    buffer(NULL), capacity(0), pos(NULL), end(NULL) {}
+  void setStream(InStream* stream_, size_t bufferSize = 0);
+  ssize_t read(void* buf, size_t len);
   void pushBack(char c) {
     pbchar = c;
     isAvail = true;
   }
+  /**
+   * Read up to the next ',', '\n' or '}'.  A ',' is consumed; the other
+   * terminators are left to be read.
+   * @param s set to the characters before the terminator
+   */
+  void readField(std::string& s);
+  bool atEnd();
+  ~PushBackInStream() { delete[] buffer; }
 };
 
 class CsvIndex : public Index {
@@ -75,8 +77,15 @@ public:
 class ICsvArchive : public IArchive {
 private:
   PushBackInStream stream;
+  std::string field;
 public:
-  ICsvArchive(InStream& _stream) { stream.setStream(&_stream); }
+  /**
+   * @param bufferSize if not 0, read the stream in blocks of this size
+   *    rather than a character at a time
+   */
+  ICsvArchive(InStream& _stream, size_t bufferSize = 0) {
+    stream.setStream(&_stream, bufferSize);
+  }
   virtual void deserialize(int8_t& t, const char* tag);
   virtual void deserialize(bool& t, const char* tag);
   virtual void deserialize(int32_t& t, const char* tag);
@@ -85,12 +94,15 @@ public:
   virtual void deserialize(double& t, const char* tag);
   virtual void deserialize(std::string& t, const char* tag);
   virtual void deserialize(std::string& t, size_t& len, const char* tag);
+  virtual void skipString(const char* tag);
+  virtual void skipBuffer(const char* tag);
   virtual void startRecord(Record& s, const char* tag);
   virtual void endRecord(Record& s, const char* tag);
   virtual Index* startVector(const char* tag);
   virtual void endVector(Index* idx, const char* tag);
   virtual Index* startMap(const char* tag);
   virtual void endMap(Index* idx, const char* tag);
+  virtual bool atEnd() { return stream.atEnd(); }
   virtual ~ICsvArchive();
 };
 
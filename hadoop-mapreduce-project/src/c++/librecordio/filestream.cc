@@ -18,6 +18,11 @@
 
 #include "filestream.hh"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace hadoop;
 
 hadoop::FileInStream::FileInStream()
@@ -41,6 +46,35 @@ bool hadoop::FileInStream::skip(size_t nbytes)
   return (0==fseek(mFile, nbytes, SEEK_CUR));
 }
 
+bool hadoop::FileInStream::atEnd()
+{
+  int ch = getc(mFile);
+  if (ch == EOF) {
+    return true;
+  }
+  ungetc(ch, mFile);
+  return false;
+}
+
+bool hadoop::FileInStream::seek(int64_t offset)
+{
+  return (0==fseeko(mFile, offset, SEEK_SET));
+}
+
+int64_t hadoop::FileInStream::tell()
+{
+  return ftello(mFile);
+}
+
+int64_t hadoop::FileInStream::length()
+{
+  struct stat st;
+  if (fstat(fileno(mFile), &st) != 0) {
+    return -1;
+  }
+  return st.st_size;
+}
+
 bool hadoop::FileInStream::close()
 {
   int ret = fclose(mFile);
@@ -55,6 +89,77 @@ hadoop::FileInStream::~FileInStream()
   }
 }
 
+hadoop::MmapInStream::MmapInStream()
+{
+  mData = NULL;
+  mSize = 0;
+  mPos = 0;
+}
+
+bool hadoop::MmapInStream::open(const std::string& name)
+{
+  int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  mSize = st.st_size;
+  mPos = 0;
+  if (mSize > 0) {
+    void* addr = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      mSize = 0;
+      return false;
+    }
+    mData = (char*) addr;
+    madvise(mData, mSize, MADV_SEQUENTIAL);
+  }
+  // the mapping keeps the file open
+  ::close(fd);
+  return true;
+}
+
+ssize_t hadoop::MmapInStream::read(void *buf, size_t len)
+{
+  size_t n = len < mSize - mPos ? len : mSize - mPos;
+  memcpy(buf, mData + mPos, n);
+  mPos += n;
+  return n;
+}
+
+bool hadoop::MmapInStream::skip(size_t nbytes)
+{
+  if (nbytes > mSize - mPos) {
+    return false;
+  }
+  mPos += nbytes;
+  return true;
+}
+
+bool hadoop::MmapInStream::close()
+{
+  int ret = 0;
+  if (mData != NULL) {
+    ret = munmap(mData, mSize);
+  }
+  mData = NULL;
+  mSize = 0;
+  mPos = 0;
+  return (ret == 0);
+}
+
+hadoop::MmapInStream::~MmapInStream()
+{
+  if (mData != NULL) {
+    close();
+  }
+}
+
 hadoop::FileOutStream::FileOutStream()
 {
   mFile = NULL;
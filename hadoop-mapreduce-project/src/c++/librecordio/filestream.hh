@@ -32,6 +32,13 @@ public:
   bool open(const std::string& name);
   ssize_t read(void *buf, size_t buflen);
   bool skip(size_t nbytes);
+  bool atEnd();
+  /** Move to an offset from the start of the file. */
+  bool seek(int64_t offset);
+  /** The offset of the next byte to be read, or -1 on error. */
+  int64_t tell();
+  /** The length of the file, or -1 on error. */
+  int64_t length();
   bool close();
   virtual ~FileInStream();
 private:
@@ -39,6 +46,30 @@ private:
 };
 
 
+/**
+ * Reads a file through a read-only memory mapping, so that a reader such
+ * as IBufferedBinArchive can use the bytes where they are rather than
+ * copying them out.  The kernel is told that the file will be read in
+ * order, so it reads ahead and drops pages behind.
+ */
+class MmapInStream : public MemoryInStream {
+public:
+  MmapInStream();
+  bool open(const std::string& name);
+  ssize_t read(void *buf, size_t buflen);
+  bool skip(size_t nbytes);
+  bool atEnd() { return mPos == mSize; }
+  bool close();
+  /** The bytes not read yet; they stay valid until the stream is closed. */
+  const char* data() const { return mData + mPos; }
+  size_t available() const { return mSize - mPos; }
+  virtual ~MmapInStream();
+private:
+  char *mData;
+  size_t mSize;
+  size_t mPos;
+};
+
 class FileOutStream: public OutStream {
 public:
   FileOutStream();
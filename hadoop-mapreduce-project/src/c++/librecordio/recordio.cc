@@ -29,9 +29,15 @@ hadoop::RecordReader::RecordReader(InStream& stream, RecFormat f)
     case kBinary:
       mpArchive = new IBinArchive(stream);
       break;
+    case kBufferedBinary:
+      mpArchive = new IBufferedBinArchive(stream);
+      break;
     case kCSV:
       mpArchive = new ICsvArchive(stream);
       break;
+    case kBufferedCSV:
+      mpArchive = new ICsvArchive(stream, 65536);
+      break;
     case kXML:
       mpArchive = new IXmlArchive(stream);
       break;
@@ -48,13 +54,31 @@ void hadoop::RecordReader::read(Record& record)
   record.deserialize(*mpArchive, (const char*) NULL);
 }
 
+ReadStatus hadoop::RecordReader::tryRead(Record& record)
+{
+  if (mpArchive->atEnd()) {
+    return kReadEnd;
+  }
+  try {
+    record.deserialize(*mpArchive, (const char*) NULL);
+  } catch (Exception* e) {
+    delete e;
+    return kReadError;
+  }
+  return kReadOk;
+}
+
 hadoop::RecordWriter::RecordWriter(OutStream& stream, RecFormat f)
 {
   switch (f) {
     case kBinary:
       mpArchive = new OBinArchive(stream);
       break;
+    case kBufferedBinary:
+      mpArchive = new OBufferedBinArchive(stream);
+      break;
     case kCSV:
+    case kBufferedCSV:
       mpArchive = new OCsvArchive(stream);
       break;
     case kXML:
@@ -33,9 +33,41 @@ namespace hadoop {
 class InStream {
 public:
   virtual ssize_t read(void *buf, size_t buflen) = 0;
+  /**
+   * Whether the stream is known to have nothing left to read.  Streams
+   * that can't tell without reading return false.
+   */
+  virtual bool atEnd() { return false; }
+  /**
+   * Move past the next nbytes without returning them.  By default they
+   * are read and thrown away.
+   * @return false if the stream ended first
+   */
+  virtual bool skip(size_t nbytes) {
+    char buf[4096];
+    while (nbytes > 0) {
+      ssize_t n = read(buf, nbytes < sizeof(buf) ? nbytes : sizeof(buf));
+      if (n <= 0) {
+        return false;
+      }
+      nbytes -= n;
+    }
+    return true;
+  }
   virtual ~InStream() {}
 };
 
+/**
+ * An InStream whose unread bytes are all in memory, so that a reader can
+ * use them where they are rather than copy them out.
+ */
+class MemoryInStream : public InStream {
+public:
+  /** The bytes not read yet; skip moves past them. */
+  virtual const char* data() const = 0;
+  virtual size_t available() const = 0;
+};
+
 class OutStream {
 public:
   virtual ssize_t write(const void *buf, size_t len) = 0;
@@ -54,7 +86,14 @@ public:
   virtual ~Record() {}
 };
 
-enum RecFormat { kBinary, kXML, kCSV };
+/**
+ * kBufferedBinary is the kBinary format, read and written through a
+ * buffer, and kBufferedCSV the kCSV format read through one; these
+ * readers read ahead, so each must be the only reader of its stream.
+ */
+enum RecFormat { kBinary, kXML, kCSV, kBufferedBinary, kBufferedCSV };
+
+enum ReadStatus { kReadOk, kReadEnd, kReadError };
 
 class RecordReader {
 private:
@@ -62,9 +101,51 @@ private:
 public:
   RecordReader(InStream& stream, RecFormat f);
   virtual void read(hadoop::Record& record);
+  /**
+   * Read the next record without throwing.
+   * @return kReadEnd if the input ended where a record would start, as
+   *   the binary and CSV formats can tell over a FileInStream or
+   *   MmapInStream;
+   *   kReadError if the record could not be read, which is how the end of
+   *   other inputs shows
+   */
+  virtual ReadStatus tryRead(hadoop::Record& record);
   virtual ~RecordReader();
 };
 
+/**
+ * Records kept to be read into again.  A record given back keeps the
+ * strings and containers it was last read into, and reading the next
+ * record into it reuses them, so a steady stream of records allocates
+ * little once the pool holds as many as are in use at a time.
+ */
+template <class T>
+class RecordPool {
+private:
+  std::vector<T*> spare;
+  RecordPool(const RecordPool&);
+  RecordPool& operator=(const RecordPool&);
+public:
+  RecordPool() {}
+  /** A record from the pool, or a new one if the pool is empty. */
+  T* get() {
+    if (spare.empty()) {
+      return new T();
+    }
+    T* record = spare.back();
+    spare.pop_back();
+    return record;
+  }
+  /** Give a record back; the pool deletes those it holds when it goes. */
+  void put(T* record) { spare.push_back(record); }
+  size_t size() const { return spare.size(); }
+  ~RecordPool() {
+    for (size_t cur = 0; cur < spare.size(); cur++) {
+      delete spare[cur];
+    }
+  }
+};
+
 class RecordWriter {
 private:
   OArchive* mpArchive;
@@ -0,0 +1,289 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how fast each archive format serializes and deserializes
+ * records heavy in primitives, in strings, and in nested vectors, maps
+ * and records, and how many allocations each takes per record.  The
+ * records go to and from memory, so only the archives are timed.
+ *
+ * Usage: bench [records]
+ */
+
+#include "bench.jr.hh"
+#include "recordio.hh"
+#include "bufferstream.hh"
+#include "binarchive.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <new>
+#include <vector>
+
+using namespace org::apache::hadoop::record::bench;
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+  allocations++;
+  void* p = malloc(size > 0 ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) throw()
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t size) throw()
+{
+  free(p);
+}
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Fractions are multiples of 1/64, which the six decimals of the text
+ * formats give back exactly.
+ */
+static void fill(Primitives& r, int i)
+{
+  r.setFlag(i % 2 == 0);
+  r.setTiny((int8_t) i);
+  r.setSmall(i % 100);
+  r.setCount(rand());
+  r.setId(i);
+  r.setTotal(((int64_t) rand() << 31) | rand());
+  r.setRatio((i % 64) / 8.0f);
+  r.setScore(rand() / 64.0);
+}
+
+static std::string text(size_t len)
+{
+  std::string s;
+  for (size_t i = 0; i < len; i++) {
+    s.push_back('a' + rand() % 26);
+  }
+  return s;
+}
+
+static void fill(Strings& r, int i)
+{
+  r.getName() = text(8 + rand() % 16);
+  r.getDescription() = text(64 + rand() % 192);
+  std::string& payload = r.getPayload();
+  payload.clear();
+  for (int j = rand() % 128; j > 0; j--) {
+    payload.push_back((char) rand());
+  }
+  std::vector<std::string>& tags = r.getTags();
+  tags.clear();
+  for (int j = rand() % 6; j > 0; j--) {
+    tags.push_back(text(4 + rand() % 8));
+  }
+}
+
+static void fill(Nested& r, int i)
+{
+  r.setId(i);
+  std::vector<Point>& points = r.getPoints();
+  points.resize(rand() % 12);
+  for (size_t j = 0; j < points.size(); j++) {
+    points[j].setX(rand() % 4096);
+    points[j].setY(rand() % 4096);
+    points[j].setWeight((rand() % 1024) / 16.0);
+  }
+  std::map<std::string, std::vector<int64_t> >& index = r.getIndex();
+  index.clear();
+  for (int j = rand() % 4; j > 0; j--) {
+    std::vector<int64_t>& offsets = index[text(6)];
+    for (int k = rand() % 8; k > 0; k--) {
+      offsets.push_back(rand());
+    }
+  }
+  std::map<int32_t, std::string>& labels = r.getLabels();
+  labels.clear();
+  for (int j = rand() % 4; j > 0; j--) {
+    labels[rand() % 1000] = text(10);
+  }
+  fill(r.getInfo(), i);
+}
+
+enum Method { kArchive, kStatic, kDocuments };
+
+struct Format {
+  const char* name;
+  hadoop::RecFormat format;
+  /*
+   * kStatic uses the static binary archives; kDocuments writes each record
+   * as an XML document of its own, since an XML archive reads a single
+   * document.
+   */
+  Method method;
+};
+
+static const Format formats[] = {
+  { "binary", hadoop::kBinary, kArchive },
+  { "buffered-binary", hadoop::kBufferedBinary, kArchive },
+  { "static-binary", hadoop::kBufferedBinary, kStatic },
+  { "csv", hadoop::kCSV, kArchive },
+  { "buffered-csv", hadoop::kBufferedCSV, kArchive },
+  { "xml", hadoop::kXML, kDocuments },
+};
+
+static void report(const char* record, const char* format, const char* op,
+                   size_t bytes, size_t count, double secs, size_t allocs)
+{
+  if (secs <= 0) {
+    secs = 1e-9;
+  }
+  printf("%-11s %-16s %-11s %9.1f MB/s %11.0f rec/s %8.2f allocs/rec\n",
+         record, format, op, bytes / secs / 1048576, count / secs,
+         (double) allocs / count);
+}
+
+template <class T>
+static bool bench(const char* name, const std::vector<T>& records)
+{
+  size_t count = records.size();
+  bool ok = true;
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    const Format& format = formats[f];
+    hadoop::BufferOutStream out(1 << 20);
+    std::vector<size_t> ends;
+    ends.reserve(count);
+
+    size_t before = allocations;
+    double start = now();
+    if (format.method == kArchive) {
+      hadoop::RecordWriter writer(out, format.format);
+      for (size_t i = 0; i < count; i++) {
+        writer.write(records[i]);
+      }
+    } else if (format.method == kStatic) {
+      hadoop::OStaticBinArchive archive(out);
+      for (size_t i = 0; i < count; i++) {
+        records[i].serializeTo(archive, NULL);
+      }
+    } else {
+      for (size_t i = 0; i < count; i++) {
+        hadoop::RecordWriter writer(out, format.format);
+        writer.write(records[i]);
+        ends.push_back(out.size());
+      }
+    }
+    double secs = now() - start;
+    report(name, format.name, "serialize", out.size(), count, secs,
+           allocations - before);
+
+    // Read everything into one record, as a reader reusing it would, and
+    // check the records read against those written afterwards.
+    hadoop::BufferInStream in(out.data(), out.size());
+    T record;
+    before = allocations;
+    start = now();
+    try {
+      if (format.method == kArchive) {
+        hadoop::RecordReader reader(in, format.format);
+        for (size_t i = 0; i < count; i++) {
+          reader.read(record);
+        }
+      } else if (format.method == kStatic) {
+        hadoop::IStaticBinArchive archive(in);
+        for (size_t i = 0; i < count; i++) {
+          record.deserializeFrom(archive, NULL);
+        }
+      } else {
+        for (size_t i = 0; i < count; i++) {
+          size_t begin = i == 0 ? 0 : ends[i - 1];
+          in.reset(out.data() + begin, ends[i] - begin);
+          hadoop::RecordReader reader(in, format.format);
+          reader.read(record);
+        }
+      }
+    } catch (hadoop::IOException* e) {
+      printf("%s %s: %s\n", name, format.name, e->what());
+      delete e;
+      ok = false;
+      continue;
+    }
+    secs = now() - start;
+    report(name, format.name, "deserialize", out.size(), count, secs,
+           allocations - before);
+
+    bool same = true;
+    in.reset(out.data(), out.size());
+    if (format.method == kArchive) {
+      hadoop::RecordReader reader(in, format.format);
+      for (size_t i = 0; i < count && same; i++) {
+        reader.read(record);
+        same = (record == records[i]);
+      }
+    } else if (format.method == kStatic) {
+      hadoop::IStaticBinArchive archive(in);
+      for (size_t i = 0; i < count && same; i++) {
+        record.deserializeFrom(archive, NULL);
+        same = (record == records[i]);
+      }
+    } else {
+      same = (record == records[count - 1]);
+    }
+    if (!same) {
+      printf("%s %s: records read back differ\n", name, format.name);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+template <class T>
+static std::vector<T> generate(size_t count)
+{
+  std::vector<T> records(count);
+  for (size_t i = 0; i < count; i++) {
+    fill(records[i], (int) i);
+  }
+  return records;
+}
+
+int main(int argc, char** argv)
+{
+  size_t count = 20000;
+  if (argc > 1) {
+    count = strtoul(argv[1], NULL, 10);
+  }
+  if (count == 0) {
+    fprintf(stderr, "Usage: bench [records]\n");
+    return 1;
+  }
+  srand(1);
+  bool ok = true;
+  ok = bench("primitives", generate<Primitives>(count)) && ok;
+  ok = bench("strings", generate<Strings>(count)) && ok;
+  ok = bench("nested", generate<Nested>(count)) && ok;
+  return ok ? 0 : 1;
+}
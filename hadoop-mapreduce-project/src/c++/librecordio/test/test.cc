@@ -48,6 +48,200 @@ int main()
     }
     istream.close();
   }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.dat", true);
+    {
+      hadoop::RecordWriter writer(ostream, hadoop::kBufferedBinary);
+      r1.setBoolVal(true);
+      r1.setByteVal((int8_t)0x66);
+      r1.setFloatVal(3.145);
+      r1.setDoubleVal(1.5234);
+      r1.setIntVal(4567);
+      r1.setLongVal(0x5a5a5a5a5a5aLL);
+      std::string& s = r1.getStringVal();
+      s = "random text";
+      writer.write(r1);
+      writer.write(r1);
+    }
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.dat");
+    hadoop::RecordReader reader(istream, hadoop::kBufferedBinary);
+    reader.read(r2);
+    bool first = (r1 == r2);
+    reader.read(r2);
+    if (first && r1 == r2) {
+      printf("Buffered binary archive test passed.\n");
+    } else {
+      printf("Buffered binary archive test failed.\n");
+    }
+    istream.close();
+  }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.dat", true);
+    {
+      hadoop::OStaticBinArchive archive(ostream);
+      r1.setIntVal(4567);
+      r1.serializeTo(archive, NULL);
+    }
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.dat");
+    hadoop::RecordReader reader(istream, hadoop::kBinary);
+    reader.read(r2);
+    bool first = (r1 == r2);
+    istream.close();
+    istream.open("/tmp/hadooptmp.dat");
+    {
+      hadoop::IStaticBinArchive archive(istream);
+      r2.deserializeFrom(archive, NULL);
+    }
+    if (first && r1 == r2) {
+      printf("Static binary archive test passed.\n");
+    } else {
+      printf("Static binary archive test failed.\n");
+    }
+    istream.close();
+  }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.dat", true);
+    hadoop::RecordWriter writer(ostream, hadoop::kBinary);
+    r1.setIntVal(4567);
+    writer.write(r1);
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.dat");
+    hadoop::RecordReader reader(istream, hadoop::kBinary);
+    if (reader.tryRead(r2) == hadoop::kReadOk && r1 == r2 &&
+        reader.tryRead(r2) == hadoop::kReadEnd) {
+      printf("Binary archive tryRead test passed.\n");
+    } else {
+      printf("Binary archive tryRead test failed.\n");
+    }
+    istream.close();
+  }
+  {
+    hadoop::BufferOutStream ostream(16);
+    {
+      hadoop::RecordWriter writer(ostream, hadoop::kBufferedBinary);
+      writer.write(r1);
+    }
+    size_t recordSize = ostream.size();
+    {
+      hadoop::OStaticBinArchive archive(ostream);
+      r1.serializeTo(archive, NULL);
+    }
+    bool grown = (ostream.size() == 2 * recordSize &&
+                  ostream.capacity() >= ostream.size());
+    hadoop::BufferInStream istream(ostream.data(), ostream.size());
+    hadoop::RecordReader reader(istream, hadoop::kBinary);
+    reader.read(r2);
+    bool first = (r1 == r2 && istream.tell() == recordSize);
+    {
+      hadoop::IStaticBinArchive archive(istream);
+      r2.deserializeFrom(archive, NULL);
+    }
+    bool second = (r1 == r2 && istream.atEnd());
+    size_t len;
+    char* bytes = ostream.release(len);
+    bool released = (len == 2 * recordSize && ostream.size() == 0 &&
+                     ostream.data() == NULL);
+    ostream.write(bytes, len);
+    released = released && memcmp(ostream.data(), bytes, len) == 0;
+    delete[] bytes;
+    if (grown && first && second && released) {
+      printf("Buffer stream test passed.\n");
+    } else {
+      printf("Buffer stream test failed.\n");
+    }
+  }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.dat", true);
+    org::apache::hadoop::record::test::RecRecord1 r3 = r1;
+    {
+      hadoop::RecordWriter writer(ostream, hadoop::kBufferedBinary);
+      std::vector<std::string>& v = r1.getVectorVal();
+      v.push_back("first");
+      v.push_back("second");
+      v.push_back("third");
+      std::map<std::string,std::string>& m = r1.getMapVal();
+      m["a"] = "one";
+      m["c"] = "three";
+      r1.getBufferVal() = "buffer";
+      writer.write(r1);
+      v.resize(1);
+      m.erase("a");
+      m["b"] = "two";
+      r1.getBufferVal() = "";
+      writer.write(r1);
+    }
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.dat");
+    hadoop::RecordReader reader(istream, hadoop::kBufferedBinary);
+    hadoop::RecordPool<org::apache::hadoop::record::test::RecRecord1> pool;
+    org::apache::hadoop::record::test::RecRecord1* rec = pool.get();
+    reader.read(*rec);
+    pool.put(rec);
+    bool first = (rec->getVectorVal().size() == 3);
+    rec = pool.get();
+    reader.read(*rec);
+    if (first && *rec == r1 && pool.size() == 0) {
+      printf("Record reuse test passed.\n");
+    } else {
+      printf("Record reuse test failed.\n");
+    }
+    pool.put(rec);
+    istream.close();
+    r1 = r3;
+  }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.dat", true);
+    {
+      hadoop::BlockRecordWriter writer(ostream, hadoop::kDeflateCodec, 64);
+      for (int i = 0; i < 10; i++) {
+        r1.setIntVal(i);
+        writer.write(r1);
+      }
+    }
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.dat");
+    int64_t length = istream.length();
+    int count = 0;
+    bool same = true;
+    {
+      hadoop::BlockRecordReader reader(istream, 0, length / 2);
+      while (reader.read(r2)) {
+        r1.setIntVal(count++);
+        same = same && (r1 == r2);
+      }
+    }
+    istream.close();
+    istream.open("/tmp/hadooptmp.dat");
+    std::vector<hadoop::BlockInfo> blocks;
+    int64_t total = 0;
+    {
+      hadoop::BlockRecordReader reader(istream, length / 2);
+      while (reader.read(r2)) {
+        r1.setIntVal(count++);
+        same = same && (r1 == r2);
+      }
+      reader.readIndex(blocks, total);
+    }
+    if (same && count == 10 && total == 10 && blocks.size() > 1) {
+      printf("Block file test passed.\n");
+    } else {
+      printf("Block file test failed.\n");
+    }
+    istream.close();
+    r1.setIntVal(4567);
+  }
   {
     hadoop::FileOutStream ostream;
     ostream.open("/tmp/hadooptmp.txt", true);
@@ -73,6 +267,29 @@ int main()
     }
     istream.close();
   }
+  {
+    hadoop::FileOutStream ostream;
+    ostream.open("/tmp/hadooptmp.txt", true);
+    hadoop::RecordWriter writer(ostream, hadoop::kCSV);
+    r1.setIntVal(4567);
+    std::string& s = r1.getStringVal();
+    s = "random text, with %escapes}";
+    writer.write(r1);
+    writer.write(r1);
+    ostream.close();
+    hadoop::FileInStream istream;
+    istream.open("/tmp/hadooptmp.txt");
+    hadoop::RecordReader reader(istream, hadoop::kBufferedCSV);
+    reader.read(r2);
+    bool first = (r1 == r2);
+    reader.read(r2);
+    if (first && r1 == r2 && reader.tryRead(r2) == hadoop::kReadEnd) {
+      printf("Buffered CSV archive test passed.\n");
+    } else {
+      printf("Buffered CSV archive test failed.\n");
+    }
+    istream.close();
+  }
   {
     hadoop::FileOutStream ostream;
     ostream.open("/tmp/hadooptmp.xml", true);
@@ -21,6 +21,9 @@
 
 #include "recordio.hh"
 #include "filestream.hh"
+#include "bufferstream.hh"
+#include "binarchive.hh"
+#include "blockfile.hh"
 #include "test.jr.hh"
 
 #endif /*TEST_HH_*/
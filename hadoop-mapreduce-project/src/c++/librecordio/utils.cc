@@ -21,11 +21,24 @@
 
 using namespace hadoop;
 
+/**
+ * What skip passes to startRecord and endRecord, which only need a Record
+ * to have something to pass; unlike a RecordTypeInfo it costs nothing to
+ * make.
+ */
+class SkippedRecord : public Record {
+public:
+  void serialize(OArchive& archive, const char* tag) const {}
+  void deserialize(IArchive& archive, const char* tag) {}
+  const std::string& type() const { return name; }
+  const std::string& signature() const { return name; }
+private:
+  std::string name;
+};
+
 void Utils::skip(IArchive& a, const char* tag, const TypeID& typeID)
 {
   bool b;
-  size_t len=0;
-  ::std::string str;
   int8_t bt;
   double d;
   float f;
@@ -37,7 +50,7 @@ void Utils::skip(IArchive& a, const char* tag, const TypeID& typeID)
     a.deserialize(b, tag);
     break;
   case RIOTYPE_BUFFER: 
-    a.deserialize(str, len, tag);
+    a.skipBuffer(tag);
     break;
   case RIOTYPE_BYTE: 
     a.deserialize(bt, tag);
@@ -69,14 +82,14 @@ void Utils::skip(IArchive& a, const char* tag, const TypeID& typeID)
     }
     break;
   case RIOTYPE_STRING: 
-    a.deserialize(str, tag);
+    a.skipString(tag);
     break;
   case RIOTYPE_STRUCT: 
     {
       // since we don't know the key, value types, 
       // we need to deserialize in a generic manner
       // we need to pass a record in, though it's never used
-      RecordTypeInfo rec;
+      SkippedRecord rec;
       a.startRecord(rec, tag);
       StructTypeID& stID = (StructTypeID&) typeID;
       std::vector<FieldTypeInfo*>& typeInfos = stID.getFieldTypeInfos();
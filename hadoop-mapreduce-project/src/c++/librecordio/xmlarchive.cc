@@ -21,49 +21,71 @@
 
 using namespace hadoop;
 
-void hadoop::MySAXHandler::startElement(const XMLCh* const name, AttributeList& attr)
+// The order matters: the first kNumScalarTags hold values
+static const char* const tagNames[] = {
+  "boolean", "ex:i1", "i4", "int", "ex:i8", "ex:float", "double", "string",
+  "struct", "array"
+};
+static const int kNumTags = sizeof(tagNames) / sizeof(tagNames[0]);
+static const int kNumScalarTags = 8;
+static const char* const endTagNames[] = { "/struct", "/array" };
+
+hadoop::MySAXHandler::MySAXHandler(std::vector<Value>& list) : vlist(list)
 {
   charsValid = false;
-  char* qname = XMLString::transcode(name);
-  if(std::string("boolean") == qname ||
-    std::string("ex:i1") == qname ||
-    std::string("i4") == qname ||
-    std::string("int") == qname ||
-    std::string("ex:i8") == qname ||
-    std::string("ex:float") == qname ||
-    std::string("double") == qname ||
-    std::string("string") == qname) {
-    std::string s(qname);
-    Value v(s);
-    vlist.push_back(v);
-    charsValid = true;
-  } else if(std::string("struct") == qname ||
-    std::string("array") == qname) {
-    std::string s(qname);
-    Value v(s);
-    vlist.push_back(v);
+  for (int i = 0; i < kNumTags; i++) {
+    tags[i] = XMLString::transcode(tagNames[i]);
+  }
+}
+
+hadoop::MySAXHandler::~MySAXHandler()
+{
+  for (int i = 0; i < kNumTags; i++) {
+    XMLString::release(&tags[i]);
+  }
+}
+
+int hadoop::MySAXHandler::findTag(const XMLCh* const name) const
+{
+  for (int i = 0; i < kNumTags; i++) {
+    if (XMLString::equals(name, tags[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void hadoop::MySAXHandler::startElement(const XMLCh* const name, AttributeList& attr)
+{
+  int tag = findTag(name);
+  charsValid = (tag >= 0 && tag < kNumScalarTags);
+  if (tag >= 0) {
+    vlist.push_back(Value(tagNames[tag]));
   }
-  XMLString::release(&qname);
 }
 
 void hadoop::MySAXHandler::endElement(const XMLCh* const name)
 {
   charsValid = false;
-  char* qname = XMLString::transcode(name);
-  if(std::string("struct") == qname ||
-    std::string("array") == qname) {
-    std::string s = "/";
-    Value v(s + qname);
-    vlist.push_back(v);
+  int tag = findTag(name);
+  if (tag >= kNumScalarTags) {
+    vlist.push_back(Value(endTagNames[tag - kNumScalarTags]));
   }
-  XMLString::release(&qname);
 }
 
 void hadoop::MySAXHandler::characters(const XMLCh* const buf, const unsigned int len)
 {
   if (charsValid) {
-    char *cstr = XMLString::transcode(buf);
     Value& v = vlist.back();
+    unsigned int i = 0;
+    while (i < len && buf[i] < 0x80) {
+      i++;
+    }
+    if (i == len) {
+      v.addAscii(buf, len);
+      return;
+    }
+    char *cstr = XMLString::transcode(buf);
     v.addChars(cstr, strlen(cstr));
     XMLString::release(&cstr);
   }
@@ -183,7 +205,7 @@ static std::string fromXMLBuffer(std::string s, size_t& len)
 
 void hadoop::IXmlArchive::deserialize(int8_t& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "ex:i1") {
     throw new IOException("Error deserializing byte");
   }
@@ -192,7 +214,7 @@ void hadoop::IXmlArchive::deserialize(int8_t& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(bool& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "boolean") {
     throw new IOException("Error deserializing boolean");
   }
@@ -201,7 +223,7 @@ void hadoop::IXmlArchive::deserialize(bool& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(int32_t& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "i4" && v.getType() != "int") {
     throw new IOException("Error deserializing int");
   }
@@ -210,7 +232,7 @@ void hadoop::IXmlArchive::deserialize(int32_t& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(int64_t& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "ex:i8") {
     throw new IOException("Error deserializing long");
   }
@@ -219,7 +241,7 @@ void hadoop::IXmlArchive::deserialize(int64_t& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(float& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "ex:float") {
     throw new IOException("Error deserializing float");
   }
@@ -228,7 +250,7 @@ void hadoop::IXmlArchive::deserialize(float& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(double& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "double") {
     throw new IOException("Error deserializing double");
   }
@@ -237,7 +259,7 @@ void hadoop::IXmlArchive::deserialize(double& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(std::string& t, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "string") {
     throw new IOException("Error deserializing string");
   }
@@ -246,16 +268,30 @@ void hadoop::IXmlArchive::deserialize(std::string& t, const char* tag)
 
 void hadoop::IXmlArchive::deserialize(std::string& t, size_t& len, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "string") {
     throw new IOException("Error deserializing buffer");
   }
   t = fromXMLBuffer(v.getValue(), len);
 }
 
+void hadoop::IXmlArchive::skipString(const char* tag)
+{
+  if (next().getType() != "string") {
+    throw new IOException("Error deserializing string");
+  }
+}
+
+void hadoop::IXmlArchive::skipBuffer(const char* tag)
+{
+  if (next().getType() != "string") {
+    throw new IOException("Error deserializing buffer");
+  }
+}
+
 void hadoop::IXmlArchive::startRecord(Record& s, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "struct") {
     throw new IOException("Error deserializing record");
   }
@@ -263,7 +299,7 @@ void hadoop::IXmlArchive::startRecord(Record& s, const char* tag)
 
 void hadoop::IXmlArchive::endRecord(Record& s, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "/struct") {
     throw new IOException("Error deserializing record");
   }
@@ -271,7 +307,7 @@ void hadoop::IXmlArchive::endRecord(Record& s, const char* tag)
 
 Index* hadoop::IXmlArchive::startVector(const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "array") {
     throw new IOException("Error deserializing vector");
   }
@@ -280,7 +316,7 @@ Index* hadoop::IXmlArchive::startVector(const char* tag)
 
 void hadoop::IXmlArchive::endVector(Index* idx, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "/array") {
     throw new IOException("Error deserializing vector");
   }
@@ -289,7 +325,7 @@ void hadoop::IXmlArchive::endVector(Index* idx, const char* tag)
 
 Index* hadoop::IXmlArchive::startMap(const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "array") {
     throw new IOException("Error deserializing map");
   }
@@ -298,7 +334,7 @@ Index* hadoop::IXmlArchive::startMap(const char* tag)
 
 void hadoop::IXmlArchive::endMap(Index* idx, const char* tag)
 {
-  Value v = next();
+  const Value& v = next();
   if (v.getType() != "/array") {
     throw new IOException("Error deserializing map");
   }
@@ -37,7 +37,15 @@ private:
 public:
   Value(const std::string& t) { type = t; }
   void addChars(const char* buf, unsigned int len) {
-    value += std::string(buf, len);
+    value.append(buf, len);
+  }
+  /** Append characters that are all below 0x80 without transcoding. */
+  void addAscii(const XMLCh* buf, unsigned int len) {
+    size_t start = value.length();
+    value.resize(start + len);
+    for (unsigned int i = 0; i < len; i++) {
+      value[start + i] = (char) buf[i];
+    }
   }
   const std::string& getType() const { return type; }
   const std::string& getValue() const { return value; }
@@ -47,8 +55,12 @@ class MySAXHandler : public HandlerBase {
 private:
   std::vector<Value>& vlist;
   bool charsValid;
+  /** The element names we look for, transcoded once up front */
+  XMLCh* tags[10];
+  int findTag(const XMLCh* const name) const;
 public:
-  MySAXHandler(std::vector<Value>& list) : vlist(list) {charsValid = false;}
+  MySAXHandler(std::vector<Value>& list);
+  ~MySAXHandler();
   void startElement(const XMLCh* const name, AttributeList& attr);
   void endElement(const XMLCh* const name);
   void characters(const XMLCh* const buf, unsigned int len);
@@ -61,7 +73,7 @@ private:
 public:
   XmlIndex(std::vector<Value>& list, unsigned int& idx) : vlist(list), vidx(idx) {}
   bool done() {
-   Value v = vlist[vidx];
+   const Value& v = vlist[vidx];
    return (v.getType() == "/array") ? true : false;
   }
   void incr() {}
@@ -109,10 +121,8 @@ private:
   MySAXHandler *docHandler;
   SAXParser *parser;
   MyInputSource* src;
-  Value next() {
-    Value v = vlist[vidx];
-    vidx++;
-    return v;
+  const Value& next() {
+    return vlist[vidx++];
   }
 public:
   IXmlArchive(InStream& _stream) {
@@ -144,6 +154,8 @@ public:
   virtual void deserialize(double& t, const char* tag);
   virtual void deserialize(std::string& t, const char* tag);
   virtual void deserialize(std::string& t, size_t& len, const char* tag);
+  virtual void skipString(const char* tag);
+  virtual void skipBuffer(const char* tag);
   virtual void startRecord(Record& s, const char* tag);
   virtual void endRecord(Record& s, const char* tag);
   virtual Index* startVector(const char* tag);
@@ -0,0 +1,657 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs a pipes word count in this process, without a cluster, and reports
+ * where the time goes.
+ *
+ * A synthetic binary command file is written first, as the Java side of
+ * the binary protocol would send it, and then runTask replays it through
+ * mapreduce.pipes.commandfile.  The outputs go to /dev/null.  The mapper,
+ * combiner and reducer are wrapped so that the time is split between
+ *
+ *   decode   reading and dispatching the protocol, and anything else
+ *            outside the phases below
+ *   map      the map function, not counting its emits
+ *   emit     emits by the mapper, combiner or reducer, including
+ *            partitioning and sending the outputs
+ *   combine  the combiner, which runs inside emit when its buffer spills
+ *   reduce   the reduce function, not counting its emits or reading values
+ *
+ * Every change of phase reads the clock, which adds a little to the cost
+ * of each record.  With more than one map thread the phases are summed
+ * over the threads, so they add up to more than the elapsed time, and
+ * decode includes the time spent waiting for other threads.
+ */
+
+#include "hadoop/Pipes.hh"
+#include "hadoop/TemplateFactory.hh"
+#include "hadoop/SerialUtils.hh"
+#include "hadoop/StringUtils.hh"
+
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The binary protocol message codes, as in HadoopPipes.cc
+enum Message {START_MESSAGE = 0, SET_JOB_CONF = 1, RUN_MAP = 3,
+              MAP_ITEM = 4, RUN_REDUCE = 5, REDUCE_KEY = 6,
+              REDUCE_VALUE = 7, CLOSE = 8, AUTHENTICATION_REQ = 10,
+              MAP_ITEMS = 11,
+              REDUCE_VALUES = 12};
+
+enum Phase {DECODE, MAP, EMIT, COMBINE, REDUCE, NUM_PHASES};
+
+static const char* const PHASE_NAMES[NUM_PHASES] = {
+  "decode", "map", "emit", "combine", "reduce"
+};
+
+static uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * The time one thread has spent in each phase, and the records and bytes
+ * that went through it.  A thread is in one phase at a time; entering a
+ * phase pauses the one it was in.
+ */
+struct ThreadPhases {
+  uint64_t nanos[NUM_PHASES];
+  uint64_t records[NUM_PHASES];
+  uint64_t bytes[NUM_PHASES];
+  Phase current;
+  uint64_t since;
+
+  ThreadPhases() {
+    memset(nanos, 0, sizeof(nanos));
+    memset(records, 0, sizeof(records));
+    memset(bytes, 0, sizeof(bytes));
+    current = DECODE;
+    since = nowNanos();
+  }
+
+  Phase enter(Phase phase) {
+    uint64_t now = nowNanos();
+    nanos[current] += now - since;
+    since = now;
+    Phase previous = current;
+    current = phase;
+    return previous;
+  }
+};
+
+static pthread_mutex_t allPhasesLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<ThreadPhases*> allPhases;
+static __thread ThreadPhases* threadPhases = NULL;
+
+static ThreadPhases& getThreadPhases() {
+  if (threadPhases == NULL) {
+    threadPhases = new ThreadPhases();
+    pthread_mutex_lock(&allPhasesLock);
+    allPhases.push_back(threadPhases);
+    pthread_mutex_unlock(&allPhasesLock);
+  }
+  return *threadPhases;
+}
+
+/**
+ * Counts records in a phase and stays in that phase until destroyed.
+ */
+class InPhase {
+private:
+  ThreadPhases& phases;
+  Phase previous;
+public:
+  InPhase(Phase phase, uint64_t records, uint64_t bytes)
+    : phases(getThreadPhases()) {
+    previous = phases.enter(phase);
+    phases.records[phase] += records;
+    phases.bytes[phase] += bytes;
+  }
+
+  ~InPhase() {
+    phases.enter(previous);
+  }
+};
+
+/**
+ * Passes everything on to the task's own context, but times the emits and
+ * the reading of reduce values.  The values of a reduce or combine are
+ * counted as the records of that phase.
+ */
+class TimedContext: public HadoopPipes::MapContext,
+                    public HadoopPipes::ReduceContext {
+private:
+  HadoopPipes::TaskContext* base;
+  HadoopPipes::MapContext* mapBase;
+  HadoopPipes::ReduceContext* reduceBase;
+  Phase valuePhase;
+public:
+  TimedContext(Phase _valuePhase)
+    : base(NULL), mapBase(NULL), reduceBase(NULL),
+      valuePhase(_valuePhase) {}
+
+  void setBase(HadoopPipes::MapContext& context) {
+    base = mapBase = &context;
+  }
+
+  void setBase(HadoopPipes::ReduceContext& context) {
+    base = reduceBase = &context;
+  }
+
+  const HadoopPipes::JobConf* getJobConf() {
+    return base->getJobConf();
+  }
+
+  const std::string& getInputKey() {
+    return base->getInputKey();
+  }
+
+  const std::string& getInputValue() {
+    return base->getInputValue();
+  }
+
+  HadoopPipes::ByteRange getInputKeyBytes() {
+    return base->getInputKeyBytes();
+  }
+
+  HadoopPipes::ByteRange getInputValueBytes() {
+    return base->getInputValueBytes();
+  }
+
+  void emit(const std::string& key, const std::string& value) {
+    InPhase phase(EMIT, 1, key.size() + value.size());
+    base->emit(key, value);
+  }
+
+  void progress() {
+    base->progress();
+  }
+
+  void setStatus(const std::string& status) {
+    base->setStatus(status);
+  }
+
+  Counter* getCounter(const std::string& group, const std::string& name) {
+    return base->getCounter(group, name);
+  }
+
+  void incrementCounter(const Counter* counter, uint64_t amount) {
+    base->incrementCounter(counter, amount);
+  }
+
+  const std::string& getInputSplit() {
+    return mapBase->getInputSplit();
+  }
+
+  const std::string& getInputKeyClass() {
+    return mapBase->getInputKeyClass();
+  }
+
+  const std::string& getInputValueClass() {
+    return mapBase->getInputValueClass();
+  }
+
+  bool nextValue() {
+    HadoopPipes::ByteRange value;
+    return nextValueBytes(value);
+  }
+
+  bool nextValueBytes(HadoopPipes::ByteRange& value) {
+    ThreadPhases& phases = getThreadPhases();
+    // a combiner's values are already in memory, but a reducer's are read
+    // from the protocol
+    Phase previous = phases.current;
+    if (valuePhase == REDUCE) {
+      phases.enter(DECODE);
+    }
+    bool result = reduceBase->nextValueBytes(value);
+    if (result) {
+      phases.records[valuePhase] += 1;
+      phases.bytes[valuePhase] += value.length;
+      if (valuePhase == REDUCE) {
+        phases.records[DECODE] += 1;
+        phases.bytes[DECODE] += value.length;
+      }
+    }
+    phases.enter(previous);
+    return result;
+  }
+};
+
+class TimedMapper: public HadoopPipes::Mapper {
+private:
+  HadoopPipes::Mapper* mapper;
+  TimedContext context;
+public:
+  TimedMapper(HadoopPipes::Mapper* _mapper)
+    : mapper(_mapper), context(MAP) {}
+
+  void map(HadoopPipes::MapContext& base) {
+    HadoopPipes::ByteRange key = base.getInputKeyBytes();
+    HadoopPipes::ByteRange value = base.getInputValueBytes();
+    InPhase phase(MAP, 1, key.length + value.length);
+    getThreadPhases().records[DECODE] += 1;
+    getThreadPhases().bytes[DECODE] += key.length + value.length;
+    context.setBase(base);
+    mapper->map(context);
+  }
+
+  void close() {
+    mapper->close();
+  }
+
+  ~TimedMapper() {
+    delete mapper;
+  }
+};
+
+class TimedReducer: public HadoopPipes::Reducer {
+private:
+  HadoopPipes::Reducer* reducer;
+  Phase phase;
+  TimedContext context;
+public:
+  TimedReducer(HadoopPipes::Reducer* _reducer, Phase _phase)
+    : reducer(_reducer), phase(_phase), context(_phase) {}
+
+  void reduce(HadoopPipes::ReduceContext& base) {
+    InPhase inPhase(phase, 0, base.getInputKeyBytes().length);
+    context.setBase(base);
+    reducer->reduce(context);
+  }
+
+  void close() {
+    reducer->close();
+  }
+
+  ~TimedReducer() {
+    delete reducer;
+  }
+};
+
+/**
+ * Wraps the mappers, reducers and combiners of another factory.
+ */
+class TimedFactory: public HadoopPipes::Factory {
+private:
+  const HadoopPipes::Factory& factory;
+public:
+  TimedFactory(const HadoopPipes::Factory& _factory): factory(_factory) {}
+
+  HadoopPipes::Mapper* createMapper(HadoopPipes::MapContext& context) const {
+    return new TimedMapper(factory.createMapper(context));
+  }
+
+  HadoopPipes::Reducer*
+      createReducer(HadoopPipes::ReduceContext& context) const {
+    return new TimedReducer(factory.createReducer(context), REDUCE);
+  }
+
+  HadoopPipes::Reducer*
+      createCombiner(HadoopPipes::MapContext& context) const {
+    HadoopPipes::Reducer* combiner = factory.createCombiner(context);
+    return combiner == NULL ? NULL : new TimedReducer(combiner, COMBINE);
+  }
+
+  HadoopPipes::Partitioner*
+      createPartitioner(HadoopPipes::MapContext& context) const {
+    return factory.createPartitioner(context);
+  }
+};
+
+/**
+ * Emits each space separated word of the value with a count of one.
+ */
+class WordCountMap
+  : public HadoopPipes::TypedMapper<HadoopPipes::ByteRange,
+                                    HadoopPipes::ByteRange> {
+public:
+  WordCountMap(HadoopPipes::TaskContext& context) {}
+
+  void typedMap(const HadoopPipes::ByteRange& key,
+                const HadoopPipes::ByteRange& value,
+                HadoopPipes::MapContext& context) {
+    const char* end = value.data + value.length;
+    const char* word = value.data;
+    for (const char* p = value.data; p <= end; ++p) {
+      if (p == end || *p == ' ') {
+        if (p > word) {
+          output.emit(context, HadoopPipes::ByteRange(word, p - word),
+                      (int32_t) 1);
+        }
+        word = p + 1;
+      }
+    }
+  }
+};
+
+/**
+ * Sums the counts of a word; used as the combiner too.
+ */
+class WordCountReduce
+  : public HadoopPipes::TypedReducer<HadoopPipes::ByteRange, int32_t> {
+public:
+  WordCountReduce(HadoopPipes::TaskContext& context) {}
+
+  void typedReduce(const HadoopPipes::ByteRange& key,
+                   HadoopPipes::TypedValues<int32_t>& values,
+                   HadoopPipes::ReduceContext& context) {
+    int32_t sum = 0;
+    int32_t value;
+    while (values.next(value)) {
+      sum += value;
+    }
+    output.emit(context, key, sum);
+  }
+};
+
+struct Options {
+  bool reduce;
+  int64_t records;
+  int keyBytes;
+  int valueBytes;
+  int words;
+  int batchBytes;
+  int reduces;
+  int threads;
+  int sortMb;
+  std::string file;
+};
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -R         run a reduce rather than a map\n"
+          "  -n NUM     the number of map inputs or reduce values "
+          "(default 1000000)\n"
+          "  -k BYTES   the size of each map input key (default 16)\n"
+          "  -v BYTES   the size of each map input value (default 100)\n"
+          "  -w NUM     the number of distinct words (default 10000)\n"
+          "  -b BYTES   mapreduce.pipes.batch.bytes, or 0 to send records "
+          "one by one (default 65536)\n"
+          "  -r NUM     the number of reduces; 0 runs the map without a "
+          "combiner (default 1)\n"
+          "  -t NUM     mapreduce.pipes.map.threads (default 1)\n"
+          "  -s MB      mapreduce.task.io.sort.mb (default 100)\n"
+          "  -f FILE    where to write the command file "
+          "(default /tmp/pipes-bench.<pid>)\n",
+          program);
+  exit(1);
+}
+
+static std::string makeWord(unsigned int* seed) {
+  static const char LETTERS[] = "abcdefghijklmnopqrstuvwxyz";
+  int length = 3 + rand_r(seed) % 8;
+  std::string word(length, ' ');
+  for (int i = 0; i < length; ++i) {
+    word[i] = LETTERS[rand_r(seed) % 26];
+  }
+  return word;
+}
+
+/**
+ * A buffer of records to be sent as one MAP_ITEMS or REDUCE_VALUES frame,
+ * or one message at a time if there is no batching.
+ */
+class CommandBatch {
+private:
+  HadoopUtils::OutStream& out;
+  int type;
+  int batchBytes;
+  std::string frame;
+  HadoopUtils::StringOutStream frameStream;
+  int count;
+public:
+  CommandBatch(HadoopUtils::OutStream& _out, int _type, int _batchBytes)
+    : out(_out), type(_type), batchBytes(_batchBytes), frameStream(frame),
+      count(0) {}
+
+  HadoopUtils::OutStream& startRecord() {
+    if (batchBytes == 0) {
+      HadoopUtils::serializeInt(type == MAP_ITEMS ? MAP_ITEM : REDUCE_VALUE,
+                                out);
+      return out;
+    }
+    return frameStream;
+  }
+
+  void endRecord() {
+    if (batchBytes != 0) {
+      count += 1;
+      if ((int) frame.size() >= batchBytes) {
+        flush();
+      }
+    }
+  }
+
+  void flush() {
+    if (count == 0) {
+      return;
+    }
+    HadoopUtils::serializeInt(type, out);
+    HadoopUtils::serializeInt(frame.size(), out);
+    HadoopUtils::serializeInt(count, out);
+    out.write(frame.data(), frame.size());
+    frame.clear();
+    count = 0;
+  }
+};
+
+/**
+ * Write the messages of a task as the Java side would send them.
+ * @return the number of bytes of input records
+ */
+static uint64_t writeCommands(const Options& options) {
+  HadoopUtils::FileOutStream out;
+  HADOOP_ASSERT(out.open(options.file, true),
+                "Can't create " + options.file + ": " + strerror(errno));
+  // with no shared secret any digest is accepted
+  HadoopUtils::serializeInt(AUTHENTICATION_REQ, out);
+  HadoopUtils::serializeString("", out);
+  HadoopUtils::serializeString("", out);
+  HadoopUtils::serializeInt(START_MESSAGE, out);
+  HadoopUtils::serializeInt(0, out);
+  std::vector<std::string> conf;
+  conf.push_back("mapreduce.pipes.batch.bytes");
+  conf.push_back(HadoopUtils::toString(options.batchBytes));
+  conf.push_back("mapreduce.pipes.map.threads");
+  conf.push_back(HadoopUtils::toString(options.threads));
+  conf.push_back("mapreduce.task.io.sort.mb");
+  conf.push_back(HadoopUtils::toString(options.sortMb));
+  HadoopUtils::serializeInt(SET_JOB_CONF, out);
+  HadoopUtils::serializeInt(conf.size(), out);
+  for (size_t i = 0; i < conf.size(); ++i) {
+    HadoopUtils::serializeString(conf[i], out);
+  }
+
+  unsigned int seed = 1;
+  std::vector<std::string> words;
+  for (int i = 0; i < options.words; ++i) {
+    words.push_back(makeWord(&seed));
+  }
+  uint64_t inputBytes = 0;
+  if (options.reduce) {
+    HadoopUtils::serializeInt(RUN_REDUCE, out);
+    HadoopUtils::serializeInt(0, out);
+    HadoopUtils::serializeInt(1, out);
+    std::string one;
+    HadoopPipes::WritableCodec<int32_t>::encode(1, one);
+    CommandBatch batch(out, REDUCE_VALUES, options.batchBytes);
+    for (int i = 0; i < options.words; ++i) {
+      int64_t values = options.records / options.words +
+        (i < options.records % options.words ? 1 : 0);
+      if (values == 0) {
+        continue;
+      }
+      batch.flush();
+      HadoopUtils::serializeInt(REDUCE_KEY, out);
+      HadoopUtils::serializeString(words[i], out);
+      for (int64_t v = 0; v < values; ++v) {
+        HadoopUtils::serializeString(one, batch.startRecord());
+        batch.endRecord();
+        inputBytes += one.size();
+      }
+    }
+    batch.flush();
+  } else {
+    HadoopUtils::serializeInt(RUN_MAP, out);
+    HadoopUtils::serializeString("", out);
+    HadoopUtils::serializeInt(options.reduces, out);
+    HadoopUtils::serializeInt(1, out);
+    CommandBatch batch(out, MAP_ITEMS, options.batchBytes);
+    std::string key;
+    std::string value;
+    for (int64_t i = 0; i < options.records; ++i) {
+      // the record number, padded or cut to the size of a key
+      key = HadoopUtils::toString((int) (i % 1000000000));
+      key.insert(0, std::max(0, options.keyBytes - (int) key.size()), '0');
+      key.resize(options.keyBytes);
+      value.clear();
+      while ((int) value.size() < options.valueBytes) {
+        if (!value.empty()) {
+          value += ' ';
+        }
+        value += words[rand_r(&seed) % words.size()];
+      }
+      value.resize(options.valueBytes);
+      HadoopUtils::OutStream& record = batch.startRecord();
+      HadoopUtils::serializeString(key, record);
+      HadoopUtils::serializeString(value, record);
+      batch.endRecord();
+      inputBytes += key.size() + value.size();
+    }
+    batch.flush();
+  }
+  HadoopUtils::serializeInt(CLOSE, out);
+  out.close();
+  return inputBytes;
+}
+
+static void report(uint64_t start, uint64_t inputBytes) {
+  uint64_t nanos[NUM_PHASES];
+  uint64_t records[NUM_PHASES];
+  uint64_t bytes[NUM_PHASES];
+  uint64_t end = start;
+  memset(nanos, 0, sizeof(nanos));
+  memset(records, 0, sizeof(records));
+  memset(bytes, 0, sizeof(bytes));
+  for (size_t t = 0; t < allPhases.size(); ++t) {
+    // the time after a thread's last change of phase is not counted: for
+    // the main thread that is waiting for the ping thread to stop
+    ThreadPhases* phases = allPhases[t];
+    for (int p = 0; p < NUM_PHASES; ++p) {
+      nanos[p] += phases->nanos[p];
+      records[p] += phases->records[p];
+      bytes[p] += phases->bytes[p];
+    }
+    end = std::max(end, phases->since);
+  }
+  printf("%-8s %10s %12s %14s %10s\n", "phase", "seconds", "records",
+         "records/s", "MB/s");
+  for (int p = 0; p < NUM_PHASES; ++p) {
+    if (records[p] == 0) {
+      continue;
+    }
+    double seconds = nanos[p] / 1e9;
+    printf("%-8s %10.3f %12llu %14.0f %10.1f\n", PHASE_NAMES[p], seconds,
+           (unsigned long long) records[p],
+           seconds > 0 ? records[p] / seconds : 0.0,
+           seconds > 0 ? bytes[p] / seconds / (1024 * 1024) : 0.0);
+  }
+  double elapsed = (end - start) / 1e9;
+  printf("%-8s %10.3f %12llu %14.0f %10.1f\n", "elapsed", elapsed,
+         (unsigned long long) records[DECODE],
+         elapsed > 0 ? records[DECODE] / elapsed : 0.0,
+         elapsed > 0 ? inputBytes / elapsed / (1024 * 1024) : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  options.reduce = false;
+  options.records = 1000000;
+  options.keyBytes = 16;
+  options.valueBytes = 100;
+  options.words = 10000;
+  options.batchBytes = 65536;
+  options.reduces = 1;
+  options.threads = 1;
+  options.sortMb = 100;
+  options.file = "/tmp/pipes-bench." + HadoopUtils::toString(getpid());
+  int opt;
+  while ((opt = getopt(argc, argv, "Rn:k:v:w:b:r:t:s:f:")) != -1) {
+    switch (opt) {
+    case 'R': options.reduce = true; break;
+    case 'n': options.records = strtoll(optarg, NULL, 10); break;
+    case 'k': options.keyBytes = atoi(optarg); break;
+    case 'v': options.valueBytes = atoi(optarg); break;
+    case 'w': options.words = atoi(optarg); break;
+    case 'b': options.batchBytes = atoi(optarg); break;
+    case 'r': options.reduces = atoi(optarg); break;
+    case 't': options.threads = atoi(optarg); break;
+    case 's': options.sortMb = atoi(optarg); break;
+    case 'f': options.file = optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || options.records < 0 || options.keyBytes < 1 ||
+      options.valueBytes < 0 || options.words < 1 ||
+      options.batchBytes < 0 || options.reduces < 0 ||
+      options.threads < 1 || options.sortMb < 1) {
+    usage(argv[0]);
+  }
+
+  uint64_t inputBytes;
+  try {
+    inputBytes = writeCommands(options);
+  } catch (HadoopUtils::Error& err) {
+    fprintf(stderr, "%s\n", err.getMessage().c_str());
+    return 1;
+  }
+  // send the outputs nowhere; if the link can't be made they go to the file
+  std::string outFile = options.file + ".out";
+  unlink(outFile.c_str());
+  if (symlink("/dev/null", outFile.c_str()) != 0) {
+    fprintf(stderr, "Can't link %s to /dev/null: %s\n", outFile.c_str(),
+            strerror(errno));
+  }
+  setenv("mapreduce.pipes.commandfile", options.file.c_str(), 1);
+  unsetenv("mapreduce.pipes.command.port");
+  unsetenv("hadoop.pipes.shared.secret.location");
+
+  HadoopPipes::TemplateFactory<WordCountMap, WordCountReduce, void,
+                               WordCountReduce> factory;
+  TimedFactory timedFactory(factory);
+  uint64_t start = getThreadPhases().since;
+  bool ok = HadoopPipes::runTask(timedFactory);
+  unlink(options.file.c_str());
+  unlink(outFile.c_str());
+  if (!ok) {
+    return 1;
+  }
+  report(start, inputBytes);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HADOOP_PIPES_HDFS_RECORD_READER_HH
+#define HADOOP_PIPES_HDFS_RECORD_READER_HH
+
+#include "hadoop/Pipes.hh"
+
+namespace HadoopPipes {
+
+  class HdfsInput;
+
+  /**
+   * A RecordReader that reads the map's FileSplit straight from the file
+   * system through libhdfs, so that input records do not have to be read
+   * by the Java task and sent down the pipe.  Use it as the record reader
+   * of a TemplateFactory, and run the job with
+   * hadoop.pipes.java.recordreader set to false.
+   *
+   * The split is read in large preads, with the next one issued in the
+   * background while the current one is parsed.  Records are split up the
+   * way the Java input formats do it, and keys and values are the bytes
+   * the Java record reader would have sent:
+   *
+   * - For SequenceFileInputFormat (chosen by mapred.input.format.class or
+   *   mapreduce.job.inputformat.class), the raw key and value of each
+   *   record, less the length prefix for Text and BytesWritable.  Only
+   *   uncompressed SequenceFiles can be read.
+   * - Otherwise, lines as for TextInputFormat: the key is the offset of
+   *   the line as a serialized LongWritable, and the value is the line
+   *   without its line terminator.
+   *
+   * The job conf key mapreduce.pipes.hdfs.reader.buffer.bytes sets the
+   * size of each read (4MB by default).  Errors are thrown as
+   * HadoopUtils::Error.
+   */
+  class HdfsRecordReader: public RecordReader {
+  public:
+    HdfsRecordReader(MapContext& context);
+    virtual bool next(std::string& key, std::string& value);
+    virtual float getProgress();
+    virtual void close();
+    virtual ~HdfsRecordReader();
+
+  private:
+    /**
+     * How a SequenceFile key or value class prefixes its serialized bytes
+     * with their length, which the Java side strips before sending them.
+     */
+    enum LengthPrefix { NO_PREFIX, VINT_PREFIX, INT_PREFIX };
+
+    bool nextLine(std::string& key, std::string& value);
+    bool nextSequenceRecord(std::string& key, std::string& value);
+    void readSequenceHeader();
+    static LengthPrefix getLengthPrefix(const std::string& className);
+    void readSerialized(std::string& buffer, int length, LengthPrefix prefix);
+
+    HdfsInput* input;
+    bool sequenceFile;
+    int64_t start;
+    int64_t end;
+    // SequenceFile state
+    char sync[16];
+    bool syncSeen;
+    LengthPrefix keyPrefix;
+    LengthPrefix valuePrefix;
+  };
+}
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HADOOP_PIPES_HDFS_RECORD_WRITER_HH
+#define HADOOP_PIPES_HDFS_RECORD_WRITER_HH
+
+#include "hadoop/Pipes.hh"
+
+namespace HadoopUtils {
+  class OutStream;
+}
+
+namespace HadoopPipes {
+
+  class HdfsOutput;
+
+  /**
+   * A RecordWriter that writes the reduce's output file straight to the
+   * file system through libhdfs, so that output records do not have to be
+   * sent up the pipe to the Java task.  Use it as the record writer of a
+   * TemplateFactory, and run the job with hadoop.pipes.java.recordwriter
+   * set to false.
+   *
+   * Records are written as TextOutputFormat writes Text keys and values:
+   * the key, mapreduce.output.textoutputformat.separator (a tab by
+   * default), the value and a newline.  The file is part-NNNNN in the
+   * task's work output directory, mapreduce.task.output.dir, so it is
+   * committed with the task attempt like the output of a Java writer.
+   *
+   * Output is written in large buffers, with the previous buffer written
+   * in the background while the next one is filled.  The job conf key
+   * mapreduce.pipes.hdfs.writer.buffer.bytes sets the buffer size (4MB by
+   * default).  If mapreduce.output.fileoutputformat.compress is set, the
+   * file is compressed with zlib: as a .gz file for GzipCodec or a
+   * .deflate file for DefaultCodec, the only codecs supported.  Errors
+   * are thrown as HadoopUtils::Error, and the output is only complete
+   * once close() returns.
+   */
+  class HdfsRecordWriter: public RecordWriter {
+  public:
+    HdfsRecordWriter(ReduceContext& context);
+    virtual void emit(const std::string& key, const std::string& value);
+    virtual void close();
+    virtual ~HdfsRecordWriter();
+
+  private:
+    HdfsOutput* output;
+    /** where records are written: the output, or a compressor over it */
+    HadoopUtils::OutStream* stream;
+    std::string separator;
+  };
+}
+
+#endif
@@ -31,6 +31,7 @@
 #include <string>
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace HadoopPipes {
@@ -47,12 +48,37 @@ class JobConf {
 public:
   virtual bool hasKey(const std::string& key) const = 0;
   virtual const std::string& get(const std::string& key) const = 0;
+
+  /**
+   * Look up a key once, rather than with hasKey and then get.
+   * @return the value, or NULL if the key is not set
+   */
+  virtual const std::string* tryGet(const std::string& key) const {
+    return hasKey(key) ? &get(key) : NULL;
+  }
+
   virtual int getInt(const std::string& key) const = 0;
   virtual float getFloat(const std::string& key) const = 0;
   virtual bool getBoolean(const std::string&key) const = 0;
   virtual ~JobConf() {}
 };
 
+/**
+ * A run of bytes that belongs to the framework, such as the current input
+ * key or value.  It is not NUL terminated.
+ */
+struct ByteRange {
+  const char* data;
+  size_t length;
+
+  ByteRange(): data(NULL), length(0) {}
+  ByteRange(const char* _data, size_t _length): data(_data), length(_length) {}
+
+  std::string toString() const {
+    return std::string(data, length);
+  }
+};
+
 /**
  * Task context provides the information about the task and job.
  */
@@ -88,6 +114,26 @@ public:
    */
   virtual const std::string& getInputValue() = 0;
 
+  /**
+   * Get the current key without copying it.  When map inputs are sent in
+   * batches (mapreduce.pipes.batch.bytes), this points straight into the
+   * buffer they were received in.
+   * @return the current key, valid until the next record is read
+   */
+  virtual ByteRange getInputKeyBytes() {
+    const std::string& key = getInputKey();
+    return ByteRange(key.data(), key.size());
+  }
+
+  /**
+   * Get the current value without copying it, as for getInputKeyBytes.
+   * @return the current value, valid until the next record is read
+   */
+  virtual ByteRange getInputValueBytes() {
+    const std::string& value = getInputValue();
+    return ByteRange(value.data(), value.size());
+  }
+
   /**
    * Generate an output record
    */
@@ -144,6 +190,19 @@ public:
    * Advance to the next value.
    */
   virtual bool nextValue() = 0;
+
+  /**
+   * Advance to the next value and get it without copying it.
+   * @param value set to the value, which is only valid until the next call
+   * @return false if there are no more values for the current key
+   */
+  virtual bool nextValueBytes(ByteRange& value) {
+    if (!nextValue()) {
+      return false;
+    }
+    value = getInputValueBytes();
+    return true;
+  }
 };
 
 class Closable {
@@ -18,6 +18,11 @@
 #ifndef HADOOP_PIPES_TEMPLATE_FACTORY_HH
 #define HADOOP_PIPES_TEMPLATE_FACTORY_HH
 
+#include "hadoop/Pipes.hh"
+#include "hadoop/SerialUtils.hh"
+
+#include <string.h>
+
 namespace HadoopPipes {
 
   template <class mapper, class reducer>
@@ -91,6 +96,218 @@ namespace HadoopPipes {
    : public TemplateFactory5<mapper,reducer,partitioner,combiner,recordReader>{
   };
 
+  /**
+   * How a C++ type is carried by the binary protocol. Text and
+   * BytesWritable are sent as their raw bytes, and other Writables as the
+   * bytes their write method produces, so for instance an IntWritable is
+   * four bytes, most significant first.
+   *
+   * decode reads a value in place from the bytes of a key or value, and
+   * encode replaces the contents of a string with the bytes of a value.
+   */
+  template <class T>
+  struct WritableCodec;
+
+  /**
+   * A big-endian integer of sizeof(T) bytes, as IntWritable and
+   * LongWritable write them.
+   */
+  template <class T>
+  struct BigEndianCodec {
+    static T decode(ByteRange bytes) {
+      HADOOP_ASSERT(bytes.length == sizeof(T),
+                    "Wrong number of bytes for a big-endian integer");
+      uint64_t result = 0;
+      for (size_t i = 0; i < sizeof(T); ++i) {
+        result = (result << 8) | (unsigned char) bytes.data[i];
+      }
+      return (T) result;
+    }
+
+    static void encode(T value, std::string& bytes) {
+      char buffer[sizeof(T)];
+      uint64_t bits = (uint64_t) value;
+      for (size_t i = sizeof(T); i > 0; --i) {
+        buffer[i - 1] = (char) bits;
+        bits >>= 8;
+      }
+      bytes.assign(buffer, sizeof(T));
+    }
+  };
+
+  /**
+   * A floating point number as FloatWritable or DoubleWritable writes it:
+   * its IEEE 754 bits as a big-endian integer of type B.
+   */
+  template <class T, class B>
+  struct FloatingPointCodec {
+    static T decode(ByteRange bytes) {
+      B bits = BigEndianCodec<B>::decode(bytes);
+      T result;
+      memcpy(&result, &bits, sizeof(T));
+      return result;
+    }
+
+    static void encode(T value, std::string& bytes) {
+      B bits;
+      memcpy(&bits, &value, sizeof(T));
+      BigEndianCodec<B>::encode(bits, bytes);
+    }
+  };
+
+  /**
+   * IntWritable.
+   */
+  template <>
+  struct WritableCodec<int32_t>: public BigEndianCodec<int32_t> {
+  };
+
+  /**
+   * LongWritable.
+   */
+  template <>
+  struct WritableCodec<int64_t>: public BigEndianCodec<int64_t> {
+  };
+
+  /**
+   * FloatWritable.
+   */
+  template <>
+  struct WritableCodec<float>: public FloatingPointCodec<float, uint32_t> {
+  };
+
+  /**
+   * DoubleWritable.
+   */
+  template <>
+  struct WritableCodec<double>: public FloatingPointCodec<double, uint64_t> {
+  };
+
+  /**
+   * Text or BytesWritable, or any other Writable as its serialized bytes,
+   * without copying them. The range is only valid until the next record.
+   */
+  template <>
+  struct WritableCodec<ByteRange> {
+    static ByteRange decode(ByteRange bytes) {
+      return bytes;
+    }
+
+    static void encode(ByteRange value, std::string& bytes) {
+      bytes.assign(value.data, value.length);
+    }
+  };
+
+  /**
+   * Text or BytesWritable as a copy of its bytes.
+   */
+  template <>
+  struct WritableCodec<std::string> {
+    static std::string decode(ByteRange bytes) {
+      return bytes.toString();
+    }
+
+    static void encode(const std::string& value, std::string& bytes) {
+      bytes = value;
+    }
+  };
+
+  /**
+   * Emits typed keys and values, encoding them into buffers that are
+   * reused from one record to the next.
+   */
+  class TypedEmitter {
+  private:
+    std::string keyBytes;
+    std::string valueBytes;
+
+  public:
+    template <class K, class V>
+    void emit(TaskContext& context, const K& key, const V& value) {
+      WritableCodec<K>::encode(key, keyBytes);
+      WritableCodec<V>::encode(value, valueBytes);
+      context.emit(keyBytes, valueBytes);
+    }
+  };
+
+  /**
+   * A mapper whose input key and value are decoded in place into K and V,
+   * which must have a WritableCodec. For example a mapper over
+   * SequenceFiles of LongWritable and Text would be a
+   * TypedMapper<int64_t, ByteRange>.
+   */
+  template <class K, class V>
+  class TypedMapper: public Mapper {
+  protected:
+    TypedEmitter output;
+
+  public:
+    void map(MapContext& context) {
+      typedMap(WritableCodec<K>::decode(context.getInputKeyBytes()),
+               WritableCodec<V>::decode(context.getInputValueBytes()),
+               context);
+    }
+
+    /**
+     * Map one record. A ByteRange key or value is only valid during the
+     * call.
+     */
+    virtual void typedMap(const K& key, const V& value,
+                          MapContext& context) = 0;
+  };
+
+  /**
+   * The values of the current key of a TypedReducer, decoded one at a time
+   * as they are read.
+   */
+  template <class V>
+  class TypedValues {
+  private:
+    ReduceContext& context;
+
+  public:
+    TypedValues(ReduceContext& _context): context(_context) {}
+
+    /**
+     * Advance to the next value.
+     * @param value set to the value; a ByteRange is only valid until the
+     *    next call
+     * @return false if there are no more values for the current key
+     */
+    bool next(V& value) {
+      ByteRange bytes;
+      if (!context.nextValueBytes(bytes)) {
+        return false;
+      }
+      value = WritableCodec<V>::decode(bytes);
+      return true;
+    }
+  };
+
+  /**
+   * A reducer, or combiner, whose input key and values are decoded in
+   * place into K and V, which must have a WritableCodec.
+   */
+  template <class K, class V>
+  class TypedReducer: public Reducer {
+  protected:
+    TypedEmitter output;
+
+  public:
+    void reduce(ReduceContext& context) {
+      TypedValues<V> values(context);
+      typedReduce(WritableCodec<K>::decode(context.getInputKeyBytes()),
+                  values, context);
+    }
+
+    /**
+     * Reduce the values of one key. A ByteRange key is only valid during
+     * the call.
+     */
+    virtual void typedReduce(const K& key, TypedValues<V>& values,
+                             ReduceContext& context) = 0;
+  };
+
 }
 
 #endif
@@ -20,16 +20,20 @@
 #include "hadoop/SerialUtils.hh"
 #include "hadoop/StringUtils.hh"
 
+#include <algorithm>
+#include <deque>
 #include <map>
 #include <vector>
 
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <pthread.h>
@@ -49,10 +53,41 @@ namespace HadoopPipes {
 
   class JobConfImpl: public JobConf {
   private:
-    map<string, string> values;
+    /**
+     * A value along with what the typed getters return for it, parsed once
+     * when it is set.  A getter for a value that doesn't parse converts
+     * the text again to throw the usual error.
+     */
+    struct Value {
+      string text;
+      bool isInt;
+      int intValue;
+      bool isFloat;
+      float floatValue;
+      bool isBool;
+      bool boolValue;
+    };
+    map<string, Value> values;
+
+    const Value& find(const string& key) const {
+      map<string, Value>::const_iterator itr = values.find(key);
+      if (itr == values.end()) {
+        throw Error("Key " + key + " not found in JobConf");
+      }
+      return itr->second;
+    }
+
   public:
     void set(const string& key, const string& value) {
-      values[key] = value;
+      Value& entry = values[key];
+      char trash;
+      entry.text = value;
+      entry.isInt = sscanf(value.c_str(), "%d%c", &entry.intValue,
+                           &trash) == 1;
+      entry.isFloat = sscanf(value.c_str(), "%f%c", &entry.floatValue,
+                             &trash) == 1;
+      entry.isBool = value == "true" || value == "false";
+      entry.boolValue = value == "true";
     }
 
     virtual bool hasKey(const string& key) const {
@@ -60,26 +95,27 @@ namespace HadoopPipes {
     }
 
     virtual const string& get(const string& key) const {
-      map<string,string>::const_iterator itr = values.find(key);
-      if (itr == values.end()) {
-        throw Error("Key " + key + " not found in JobConf");
-      }
-      return itr->second;
+      return find(key).text;
+    }
+
+    virtual const string* tryGet(const string& key) const {
+      map<string, Value>::const_iterator itr = values.find(key);
+      return itr == values.end() ? NULL : &itr->second.text;
     }
 
     virtual int getInt(const string& key) const {
-      const string& val = get(key);
-      return toInt(val);
+      const Value& val = find(key);
+      return val.isInt ? val.intValue : toInt(val.text);
     }
 
     virtual float getFloat(const string& key) const {
-      const string& val = get(key);
-      return toFloat(val);
+      const Value& val = find(key);
+      return val.isFloat ? val.floatValue : toFloat(val.text);
     }
 
     virtual bool getBoolean(const string&key) const {
-      const string& val = get(key);
-      return toBool(val);
+      const Value& val = find(key);
+      return val.isBool ? val.boolValue : toBool(val.text);
     }
   };
 
@@ -90,9 +126,18 @@ namespace HadoopPipes {
     virtual void setInputTypes(string keyType, string valueType) = 0;
     virtual void runMap(string inputSplit, int numReduces, bool pipedInput)= 0;
     virtual void mapItem(const string& key, const string& value) = 0;
+    /**
+     * A map input that stays in the protocol's buffer until the next event.
+     */
+    virtual void mapItem(ByteRange key, ByteRange value) = 0;
     virtual void runReduce(int reduce, bool pipedOutput) = 0;
     virtual void reduceKey(const string& key) = 0;
     virtual void reduceValue(const string& value) = 0;
+    /**
+     * A reduce value that stays in the protocol's buffer until the next
+     * event.
+     */
+    virtual void reduceValue(ByteRange value) = 0;
     virtual void close() = 0;
     virtual void abort() = 0;
     virtual ~DownwardProtocol() {}
@@ -116,6 +161,15 @@ namespace HadoopPipes {
   class Protocol {
   public:
     virtual void nextEvent() = 0;
+    /**
+     * If the next event is a reduce value that has already been read, take
+     * it without dispatching it.
+     * @param value set to the value, valid until the next event
+     * @return false if the next event must be read with nextEvent()
+     */
+    virtual bool nextFrameValue(ByteRange& value) {
+      return false;
+    }
     virtual UpwardProtocol* getUplink() = 0;
     virtual ~Protocol() {}
   };
@@ -296,26 +350,129 @@ namespace HadoopPipes {
 
   enum MESSAGE_TYPE {START_MESSAGE, SET_JOB_CONF, SET_INPUT_TYPES, RUN_MAP, 
                      MAP_ITEM, RUN_REDUCE, REDUCE_KEY, REDUCE_VALUE, 
-                     CLOSE, ABORT, AUTHENTICATION_REQ,
+                     CLOSE, ABORT, AUTHENTICATION_REQ, MAP_ITEMS,
+                     REDUCE_VALUES,
                      OUTPUT=50, PARTITIONED_OUTPUT, STATUS, PROGRESS, DONE,
-                     REGISTER_COUNTER, INCREMENT_COUNTER, AUTHENTICATION_RESP};
+                     REGISTER_COUNTER, INCREMENT_COUNTER, AUTHENTICATION_RESP,
+                     OUTPUTS};
+
+  /**
+   * The job configuration key giving the size of the frames that batch
+   * records together, in bytes.  Records are sent one by one if it is 0.
+   */
+  static const char* BATCH_BYTES_KEY = "mapreduce.pipes.batch.bytes";
+
+  /**
+   * Reads from a buffer, and can hand out pieces of it in place.
+   */
+  class BufferInStream: public InStream {
+  private:
+    const char* pos;
+    const char* end;
+  public:
+    BufferInStream(const char* data, size_t len): pos(data), end(data + len) {}
+
+    virtual void read(void *buf, size_t len) {
+      memcpy(buf, take(len), len);
+    }
+
+    /**
+     * Skip over the next len bytes.
+     * @return where they start
+     */
+    const char* take(size_t len) {
+      HADOOP_ASSERT((size_t)(end - pos) >= len, "unexpected end of frame");
+      const char* result = pos;
+      pos += len;
+      return result;
+    }
+
+    /**
+     * Read a string, serialized as by serializeString, in place.
+     */
+    ByteRange takeString() {
+      int32_t len = deserializeInt(*this);
+      HADOOP_ASSERT(len >= 0, "negative string length in frame");
+      return ByteRange(take(len), len);
+    }
+  };
 
   class BinaryUpwardProtocol: public UpwardProtocol {
   private:
-    FileOutStream* stream;
+    OutStream* stream;
+    /**
+     * The outputs waiting to be sent in an OUTPUTS frame, if batchBytes is
+     * not 0
+     */
+    string batch;
+    StringOutStream batchStream;
+    int32_t batchCount;
+    size_t batchBytes;
+
+    /**
+     * Send the waiting outputs as one OUTPUTS frame: the frame length in
+     * bytes, the number of records, then the records as OUTPUT would send
+     * them.  Every other message sends the batch first, so that messages
+     * arrive in the order they were made.
+     */
+    void flushBatch() {
+      if (batchCount == 0) {
+        return;
+      }
+      serializeInt(OUTPUTS, *stream);
+      serializeInt(batch.size(), *stream);
+      serializeInt(batchCount, *stream);
+      stream->write(batch.data(), batch.size());
+      batch.clear();
+      batchCount = 0;
+    }
+
   public:
-    BinaryUpwardProtocol(FILE* _stream) {
-      stream = new FileOutStream();
-      HADOOP_ASSERT(stream->open(_stream), "problem opening stream");
+    BinaryUpwardProtocol(FILE* _stream): batchStream(batch) {
+      FileOutStream* fileStream = new FileOutStream();
+      stream = fileStream;
+      HADOOP_ASSERT(fileStream->open(_stream), "problem opening stream");
+      batchCount = 0;
+      batchBytes = 0;
+    }
+
+    /**
+     * Write to the given stream, which is then owned by the protocol.
+     */
+    BinaryUpwardProtocol(OutStream* _stream): batchStream(batch) {
+      stream = _stream;
+      batchCount = 0;
+      batchBytes = 0;
+    }
+
+    /**
+     * Set the size of the OUTPUTS frames to send.
+     * @param bytes the frame size in bytes, or 0 to send each output on its
+     *    own
+     */
+    void setBatchBytes(int bytes) {
+      flushBatch();
+      batchBytes = bytes > 0 ? bytes : 0;
+      batch.reserve(batchBytes);
     }
 
     virtual void authenticate(const string &responseDigest) {
+      flushBatch();
       serializeInt(AUTHENTICATION_RESP, *stream);
       serializeString(responseDigest, *stream);
       stream->flush();
     }
 
     virtual void output(const string& key, const string& value) {
+      if (batchBytes > 0) {
+        serializeString(key, batchStream);
+        serializeString(value, batchStream);
+        ++batchCount;
+        if (batch.size() >= batchBytes) {
+          flushBatch();
+        }
+        return;
+      }
       serializeInt(OUTPUT, *stream);
       serializeString(key, *stream);
       serializeString(value, *stream);
@@ -323,6 +480,7 @@ namespace HadoopPipes {
 
     virtual void partitionedOutput(int reduce, const string& key,
                                    const string& value) {
+      flushBatch();
       serializeInt(PARTITIONED_OUTPUT, *stream);
       serializeInt(reduce, *stream);
       serializeString(key, *stream);
@@ -330,22 +488,27 @@ namespace HadoopPipes {
     }
 
     virtual void status(const string& message) {
+      flushBatch();
       serializeInt(STATUS, *stream);
       serializeString(message, *stream);
     }
 
     virtual void progress(float progress) {
+      flushBatch();
       serializeInt(PROGRESS, *stream);
       serializeFloat(progress, *stream);
       stream->flush();
     }
 
     virtual void done() {
+      flushBatch();
       serializeInt(DONE, *stream);
+      stream->flush();
     }
 
     virtual void registerCounter(int id, const string& group, 
                                  const string& name) {
+      flushBatch();
       serializeInt(REGISTER_COUNTER, *stream);
       serializeInt(id, *stream);
       serializeString(group, *stream);
@@ -354,6 +517,7 @@ namespace HadoopPipes {
 
     virtual void incrementCounter(const TaskContext::Counter* counter, 
                                   uint64_t amount) {
+      flushBatch();
       serializeInt(INCREMENT_COUNTER, *stream);
       serializeInt(counter->getId(), *stream);
       serializeLong(amount, *stream);
@@ -366,13 +530,50 @@ namespace HadoopPipes {
 
   class BinaryProtocol: public Protocol {
   private:
-    FileInStream* downStream;
+    InStream* downStream;
     DownwardProtocol* handler;
     BinaryUpwardProtocol * uplink;
     string key;
     string value;
     string password;
     bool authDone;
+    /**
+     * The MAP_ITEMS or REDUCE_VALUES frame being handed out, one record per
+     * event.  The records are passed on in place, so it is only replaced
+     * once they have all been handed out.
+     */
+    string frame;
+    BufferInStream* frameStream;
+    int32_t frameType;
+    int32_t frameRecords;
+
+    /**
+     * Read a whole frame of the given type: its length in bytes and number
+     * of records, then the records.
+     */
+    void readFrame(int32_t type) {
+      int32_t len = deserializeInt(*downStream);
+      int32_t count = deserializeInt(*downStream);
+      HADOOP_ASSERT(len > 0 && count > 0, "Empty frame of type " +
+                    toString(type));
+      frame.resize(len);
+      downStream->read(&frame[0], len);
+      delete frameStream;
+      frameStream = new BufferInStream(frame.data(), frame.size());
+      frameType = type;
+      frameRecords = count;
+    }
+
+    void nextFrameRecord() {
+      --frameRecords;
+      if (frameType == REDUCE_VALUES) {
+        handler->reduceValue(frameStream->takeString());
+        return;
+      }
+      ByteRange frameKey = frameStream->takeString();
+      ByteRange frameValue = frameStream->takeString();
+      handler->mapItem(frameKey, frameValue);
+    }
     void getPassword(string &password) {
       const char *passwordFile = getenv("hadoop.pipes.shared.secret.location");
       if (passwordFile == NULL) {
@@ -448,22 +649,53 @@ namespace HadoopPipes {
       return string(digestBuffer);
     }
 
-  public:
-    BinaryProtocol(FILE* down, DownwardProtocol* _handler, FILE* up) {
-      downStream = new FileInStream();
-      downStream->open(down);
-      uplink = new BinaryUpwardProtocol(up);
+    void init(DownwardProtocol* _handler) {
       handler = _handler;
       authDone = false;
+      frameStream = NULL;
+      frameType = 0;
+      frameRecords = 0;
       getPassword(password);
     }
 
+  public:
+    BinaryProtocol(FILE* down, DownwardProtocol* _handler, FILE* up) {
+      FileInStream* fileStream = new FileInStream();
+      fileStream->open(down);
+      downStream = fileStream;
+      uplink = new BinaryUpwardProtocol(up);
+      init(_handler);
+    }
+
+    /**
+     * Talk over the given streams, which are then owned by the protocol.
+     */
+    BinaryProtocol(InStream* down, DownwardProtocol* _handler,
+                   OutStream* up) {
+      downStream = down;
+      uplink = new BinaryUpwardProtocol(up);
+      init(_handler);
+    }
+
     UpwardProtocol* getUplink() {
       return uplink;
     }
 
+    virtual bool nextFrameValue(ByteRange& value) {
+      if (frameRecords == 0 || frameType != REDUCE_VALUES) {
+        return false;
+      }
+      --frameRecords;
+      value = frameStream->takeString();
+      return true;
+    }
+
     virtual void nextEvent() {
       int32_t cmd;
+      if (frameRecords > 0) {
+        nextFrameRecord();
+        return;
+      }
       cmd = deserializeInt(*downStream);
       if (!authDone && cmd != AUTHENTICATION_REQ) {
         //Authentication request must be the first message if
@@ -496,6 +728,11 @@ namespace HadoopPipes {
           deserializeString(item, *downStream);
           result.push_back(item);
         }
+        for(size_t i=0; i + 1 < result.size(); i += 2) {
+          if (result[i] == BATCH_BYTES_KEY) {
+            uplink->setBatchBytes(toInt(result[i + 1]));
+          }
+        }
         handler->setJobConf(result);
         break;
       }
@@ -523,6 +760,12 @@ namespace HadoopPipes {
         handler->mapItem(key, value);
         break;
       }
+      case MAP_ITEMS:
+      case REDUCE_VALUES:
+        // read the whole frame at once, then hand out its first record
+        readFrame(cmd);
+        nextFrameRecord();
+        break;
       case RUN_REDUCE: {
         int32_t reduce;
         int32_t piped;
@@ -553,11 +796,106 @@ namespace HadoopPipes {
     }
 
     virtual ~BinaryProtocol() {
+      delete frameStream;
       delete downStream;
       delete uplink;
     }
   };
 
+  /**
+   * Bump allocator for the keys and values a CombineRunner holds between
+   * spills.  Everything is released at once by clear().
+   */
+  class CombineArena {
+  private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    /** chunks that are full, or that hold a single big item */
+    vector<char*> chunks;
+    /** the chunk being filled, if any */
+    char* current;
+    char* pos;
+    size_t left;
+  public:
+    CombineArena(): current(NULL), pos(NULL), left(0) {}
+
+    /**
+     * Copy bytes into the arena.
+     * @return where the copy lives, until the next clear()
+     */
+    const char* copy(const char* data, size_t len) {
+      if (len > left) {
+        if (len > CHUNK_SIZE / 4) {
+          char* chunk = new char[len];
+          chunks.push_back(chunk);
+          memcpy(chunk, data, len);
+          return chunk;
+        }
+        if (current != NULL) {
+          chunks.push_back(current);
+        }
+        current = pos = new char[CHUNK_SIZE];
+        left = CHUNK_SIZE;
+      }
+      char* result = pos;
+      memcpy(result, data, len);
+      pos += len;
+      left -= len;
+      return result;
+    }
+
+    /**
+     * Free everything but the current chunk, which is kept for reuse.
+     */
+    void clear() {
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        delete[] chunks[i];
+      }
+      chunks.clear();
+      if (current != NULL) {
+        pos = current;
+        left = CHUNK_SIZE;
+      }
+    }
+
+    ~CombineArena() {
+      clear();
+      delete[] current;
+    }
+  };
+
+  /**
+   * A distinct key buffered by a CombineRunner.  Its values are a list
+   * through CombineValue::next, in the order they were emitted.
+   */
+  struct CombineGroup {
+    ByteRange key;
+    uint32_t hash;
+    int32_t firstValue;
+    int32_t lastValue;
+  };
+
+  struct CombineValue {
+    ByteRange value;
+    int32_t next;
+  };
+
+  /**
+   * Orders groups by key the way std::string compares them.
+   */
+  class CombineKeyLess {
+  private:
+    const vector<CombineGroup>* groups;
+  public:
+    CombineKeyLess(const vector<CombineGroup>& _groups): groups(&_groups) {}
+
+    bool operator()(int32_t left, int32_t right) const {
+      const ByteRange& a = (*groups)[left].key;
+      const ByteRange& b = (*groups)[right].key;
+      int cmp = memcmp(a.data, b.data, std::min(a.length, b.length));
+      return cmp < 0 || (cmp == 0 && a.length < b.length);
+    }
+  };
+
   /**
    * Define a context object to give to combiners that will let them
    * go through the values and emit their results correctly.
@@ -570,25 +908,38 @@ namespace HadoopPipes {
     UpwardProtocol* uplink;
     bool firstKey;
     bool firstValue;
-    map<string, vector<string> >::iterator keyItr;
-    map<string, vector<string> >::iterator endKeyItr;
-    vector<string>::iterator valueItr;
-    vector<string>::iterator endValueItr;
+    const vector<CombineGroup>* groups;
+    const vector<CombineValue>* values;
+    vector<int32_t>::const_iterator keyItr;
+    vector<int32_t>::const_iterator endKeyItr;
+    int32_t valueIdx;
+    // copies of the current key and value, made when they are asked for
+    string key;
+    bool keyCopied;
+    string value;
+    bool valueCopied;
 
   public:
     CombineContext(ReduceContext* _baseContext,
                    Partitioner* _partitioner,
                    int _numReduces,
                    UpwardProtocol* _uplink,
-                   map<string, vector<string> >& data) {
+                   const vector<CombineGroup>& _groups,
+                   const vector<CombineValue>& _values,
+                   const vector<int32_t>& order) {
       baseContext = _baseContext;
       partitioner = _partitioner;
       numReduces = _numReduces;
       uplink = _uplink;
-      keyItr = data.begin();
-      endKeyItr = data.end();
+      groups = &_groups;
+      values = &_values;
+      keyItr = order.begin();
+      endKeyItr = order.end();
+      valueIdx = -1;
       firstKey = true;
       firstValue = true;
+      keyCopied = false;
+      valueCopied = false;
     }
 
     virtual const JobConf* getJobConf() {
@@ -596,11 +947,29 @@ namespace HadoopPipes {
     }
 
     virtual const std::string& getInputKey() {
-      return keyItr->first;
+      if (!keyCopied) {
+        const ByteRange& range = (*groups)[*keyItr].key;
+        key.assign(range.data, range.length);
+        keyCopied = true;
+      }
+      return key;
     }
 
     virtual const std::string& getInputValue() {
-      return *valueItr;
+      if (!valueCopied) {
+        const ByteRange& range = (*values)[valueIdx].value;
+        value.assign(range.data, range.length);
+        valueCopied = true;
+      }
+      return value;
+    }
+
+    virtual ByteRange getInputKeyBytes() {
+      return (*groups)[*keyItr].key;
+    }
+
+    virtual ByteRange getInputValueBytes() {
+      return (*values)[valueIdx].value;
     }
 
     virtual void emit(const std::string& key, const std::string& value) {
@@ -626,10 +995,11 @@ namespace HadoopPipes {
       } else {
         ++keyItr;
       }
+      keyCopied = false;
       if (keyItr != endKeyItr) {
-        valueItr = keyItr->second.begin();
-        endValueItr = keyItr->second.end();
+        valueIdx = (*groups)[*keyItr].firstValue;
         firstValue = true;
+        valueCopied = false;
         return true;
       }
       return false;
@@ -638,10 +1008,11 @@ namespace HadoopPipes {
     virtual bool nextValue() {
       if (firstValue) {
         firstValue = false;
-      } else {
-        ++valueItr;
+      } else if (valueIdx >= 0) {
+        valueIdx = (*values)[valueIdx].next;
+        valueCopied = false;
       }
-      return valueItr != endValueItr;
+      return valueIdx >= 0;
     }
     
     virtual Counter* getCounter(const std::string& group, 
@@ -657,10 +1028,17 @@ namespace HadoopPipes {
   /**
    * A RecordWriter that will take the map outputs, buffer them up and then
    * combine then when the buffer is full.
+   *
+   * The outputs are grouped by key in an open addressing hash table; the
+   * keys are only sorted when the buffer is spilled.
    */
   class CombineRunner: public RecordWriter {
   private:
-    map<string, vector<string> > data;
+    CombineArena arena;
+    vector<CombineGroup> groups;
+    vector<CombineValue> values;
+    /** indexes into groups, or -1; the size is a power of two */
+    vector<int32_t> slots;
     int64_t spillSize;
     int64_t numBytes;
     ReduceContext* baseContext;
@@ -668,6 +1046,47 @@ namespace HadoopPipes {
     int numReduces;
     UpwardProtocol* uplink;
     Reducer* combiner;
+
+    static const size_t INITIAL_SLOTS = 1024;
+
+    static uint32_t hashKey(const char* data, size_t len) {
+      // FNV-1a
+      uint32_t hash = 2166136261U;
+      for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char) data[i]) * 16777619U;
+      }
+      return hash;
+    }
+
+    /**
+     * Find the slot of a key, or the empty slot it would go in.
+     */
+    size_t findSlot(const char* data, size_t len, uint32_t hash) const {
+      size_t mask = slots.size() - 1;
+      size_t slot = hash & mask;
+      while (slots[slot] >= 0) {
+        const CombineGroup& group = groups[slots[slot]];
+        if (group.hash == hash && group.key.length == len &&
+            memcmp(group.key.data, data, len) == 0) {
+          break;
+        }
+        slot = (slot + 1) & mask;
+      }
+      return slot;
+    }
+
+    void growSlots() {
+      size_t mask = slots.size() * 2 - 1;
+      slots.assign(mask + 1, -1);
+      for (size_t i = 0; i < groups.size(); ++i) {
+        size_t slot = groups[i].hash & mask;
+        while (slots[slot] >= 0) {
+          slot = (slot + 1) & mask;
+        }
+        slots[slot] = i;
+      }
+    }
+
   public:
     CombineRunner(int64_t _spillSize, ReduceContext* _baseContext, 
                   Reducer* _combiner, UpwardProtocol* _uplink, 
@@ -679,12 +1098,38 @@ namespace HadoopPipes {
       numReduces = _numReduces;
       uplink = _uplink;
       combiner = _combiner;
+      slots.assign(INITIAL_SLOTS, -1);
     }
 
     virtual void emit(const std::string& key,
                       const std::string& value) {
-      numBytes += key.length() + value.length();
-      data[key].push_back(value);
+      uint32_t hash = hashKey(key.data(), key.length());
+      size_t slot = findSlot(key.data(), key.length(), hash);
+      CombineValue entry;
+      entry.value = ByteRange(arena.copy(value.data(), value.length()),
+                              value.length());
+      entry.next = -1;
+      int32_t valueIdx = values.size();
+      values.push_back(entry);
+      numBytes += sizeof(CombineValue) + value.length();
+      if (slots[slot] >= 0) {
+        CombineGroup& group = groups[slots[slot]];
+        values[group.lastValue].next = valueIdx;
+        group.lastValue = valueIdx;
+      } else {
+        CombineGroup group;
+        group.key = ByteRange(arena.copy(key.data(), key.length()),
+                              key.length());
+        group.hash = hash;
+        group.firstValue = valueIdx;
+        group.lastValue = valueIdx;
+        slots[slot] = groups.size();
+        groups.push_back(group);
+        numBytes += sizeof(CombineGroup) + 2 * sizeof(int32_t) + key.length();
+        if (groups.size() * 2 > slots.size()) {
+          growSlots();
+        }
+      }
       if (numBytes >= spillSize) {
         spillAll();
       }
@@ -696,119 +1141,1062 @@ namespace HadoopPipes {
 
   private:
     void spillAll() {
+      vector<int32_t> order(groups.size());
+      for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+      }
+      std::sort(order.begin(), order.end(), CombineKeyLess(groups));
       CombineContext context(baseContext, partitioner, numReduces, 
-                             uplink, data);
+                             uplink, groups, values, order);
       while (context.nextKey()) {
         combiner->reduce(context);
       }
-      data.clear();
+      groups.clear();
+      values.clear();
+      slots.assign(slots.size(), -1);
+      arena.clear();
       numBytes = 0;
     }
   };
 
-  class TaskContextImpl: public MapContext, public ReduceContext, 
-                         public DownwardProtocol {
+  /**
+   * The job conf key with where to write native spills, set by the Java
+   * side when the map output can be collected natively.  Spill n is
+   * written to the prefix followed by n and ".out", with its index in the
+   * same name followed by ".index".
+   */
+  static const char* NATIVE_SPILL_PREFIX_KEY =
+    "mapreduce.pipes.native.spill.prefix";
+
+  static const char* TASK_COUNTER_GROUP =
+    "org.apache.hadoop.mapreduce.TaskCounter";
+
+  /**
+   * CRC-32 as java.util.zip.CRC32 computes it.
+   */
+  class Crc32 {
   private:
-    bool done;
-    JobConf* jobConf;
-    string key;
-    const string* newKey;
-    const string* value;
-    bool hasTask;
-    bool isNewKey;
-    bool isNewValue;
-    string* inputKeyClass;
-    string* inputValueClass;
-    string status;
-    float progressFloat;
-    uint64_t lastProgress;
-    bool statusSet;
-    Protocol* protocol;
-    UpwardProtocol *uplink;
-    string* inputSplit;
-    RecordReader* reader;
-    Mapper* mapper;
-    Reducer* reducer;
-    RecordWriter* writer;
-    Partitioner* partitioner;
-    int numReduces;
-    const Factory* factory;
-    pthread_mutex_t mutexDone;
-    std::vector<int> registeredCounterIds;
+    static uint32_t table[256];
+    static pthread_once_t tableOnce;
+    uint32_t crc;
+
+    static void makeTable() {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+    }
 
   public:
+    Crc32(): crc(0xFFFFFFFFU) {
+      pthread_once(&tableOnce, makeTable);
+    }
 
-    TaskContextImpl(const Factory& _factory) {
-      statusSet = false;
-      done = false;
-      newKey = NULL;
-      factory = &_factory;
-      jobConf = NULL;
-      inputKeyClass = NULL;
-      inputValueClass = NULL;
-      inputSplit = NULL;
-      mapper = NULL;
-      reducer = NULL;
-      reader = NULL;
-      writer = NULL;
-      partitioner = NULL;
-      protocol = NULL;
-      isNewKey = false;
-      isNewValue = false;
-      lastProgress = 0;
-      progressFloat = 0.0f;
-      hasTask = false;
-      pthread_mutex_init(&mutexDone, NULL);
+    void update(const void* buf, size_t len) {
+      const unsigned char* p = (const unsigned char*) buf;
+      for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+      }
     }
 
-    void setProtocol(Protocol* _protocol, UpwardProtocol* _uplink) {
+    uint32_t getValue() const {
+      return crc ^ 0xFFFFFFFFU;
+    }
+  };
 
-      protocol = _protocol;
-      uplink = _uplink;
+  uint32_t Crc32::table[256];
+  pthread_once_t Crc32::tableOnce = PTHREAD_ONCE_INIT;
+
+  /**
+   * A stream that counts and checksums what is written through it, as
+   * IFileOutputStream does for each partition of a spill.
+   */
+  class ChecksumOutStream: public OutStream {
+  private:
+    OutStream* stream;
+    Crc32 crc;
+    uint64_t length;
+  public:
+    ChecksumOutStream(OutStream* _stream): stream(_stream), length(0) {}
+
+    virtual void write(const void* buf, size_t len) {
+      crc.update(buf, len);
+      length += len;
+      stream->write(buf, len);
     }
 
-    virtual void start(int protocol) {
-      if (protocol != 0) {
-        throw Error("Protocol version " + toString(protocol) + 
-                    " not supported");
-      }
+    virtual void flush() {
+      stream->flush();
     }
 
-    virtual void setJobConf(vector<string> values) {
-      int len = values.size();
-      JobConfImpl* result = new JobConfImpl();
-      HADOOP_ASSERT(len % 2 == 0, "Odd length of job conf values");
-      for(int i=0; i < len; i += 2) {
-        result->set(values[i], values[i+1]);
-      }
-      jobConf = result;
+    uint64_t getLength() const {
+      return length;
     }
 
-    virtual void setInputTypes(string keyType, string valueType) {
-      inputKeyClass = new string(keyType);
-      inputValueClass = new string(valueType);
+    uint32_t getChecksum() const {
+      return crc.getValue();
     }
+  };
 
-    virtual void runMap(string _inputSplit, int _numReduces, bool pipedInput) {
-      inputSplit = new string(_inputSplit);
-      reader = factory->createRecordReader(*this);
-      HADOOP_ASSERT((reader == NULL) == pipedInput,
-                    pipedInput ? "RecordReader defined when not needed.":
-                    "RecordReader not defined");
-      if (reader != NULL) {
-        value = new string();
-      }
-      mapper = factory->createMapper(*this);
+  static void writeBigEndian(OutStream& stream, uint64_t value, int bytes) {
+    unsigned char buf[8];
+    for (int i = 0; i < bytes; ++i) {
+      buf[i] = (unsigned char) (value >> (8 * (bytes - 1 - i)));
+    }
+    stream.write(buf, bytes);
+  }
+
+  /**
+   * Collects the map outputs in the C++ process and writes them as sorted
+   * spills in the format of the Java map task's own, so that they are not
+   * sent over the pipe for the Java side to sort.  It sits in front of the
+   * task's uplink; everything but outputs is passed on.
+   */
+  class NativeCollector: public UpwardProtocol {
+  private:
+    /**
+     * How a key or value is serialized in the spill: as Text, with a vint
+     * length, or as BytesWritable, with a 4 byte length.
+     */
+    enum Encoding {TEXT, BYTES};
+
+    struct Record {
+      /** the first 8 bytes of the key, big endian and zero padded */
+      uint64_t prefix;
+      int32_t partition;
+      uint32_t keyLength;
+      uint32_t valueLength;
+      size_t offset;
+    };
+
+    /**
+     * Sorts records by partition, then key, the way the default raw
+     * comparators of Text and BytesWritable do.
+     */
+    class RecordLess {
+    private:
+      const char* data;
+    public:
+      RecordLess(const char* _data): data(_data) {}
+
+      bool operator()(const Record& a, const Record& b) const {
+        if (a.partition != b.partition) {
+          return a.partition < b.partition;
+        }
+        if (a.prefix != b.prefix) {
+          return a.prefix < b.prefix;
+        }
+        int cmp = memcmp(data + a.offset, data + b.offset,
+                         std::min(a.keyLength, b.keyLength));
+        return cmp < 0 || (cmp == 0 && a.keyLength < b.keyLength);
+      }
+    };
+
+    UpwardProtocol* uplink;
+    int numReduces;
+    string prefix;
+    Encoding keyEncoding;
+    Encoding valueEncoding;
+    int64_t spillSize;
+    string data;
+    vector<Record> records;
+    int numSpills;
+    TaskContext::Counter* outputRecords;
+    TaskContext::Counter* outputBytes;
+
+    static Encoding getEncoding(const JobConf& conf, const string& key) {
+      const string& name = conf.get(key);
+      if (name == "org.apache.hadoop.io.Text") {
+        return TEXT;
+      }
+      HADOOP_ASSERT(name == "org.apache.hadoop.io.BytesWritable",
+                    "can't collect " + name + " natively");
+      return BYTES;
+    }
+
+    static int vintSize(int64_t value) {
+      if (value >= -112 && value <= 127) {
+        return 1;
+      }
+      if (value < 0) {
+        value ^= -1ll;
+      }
+      int size = 1;
+      for (uint64_t tmp = value; tmp != 0; tmp >>= 8) {
+        ++size;
+      }
+      return size;
+    }
+
+    static size_t serializedLength(Encoding encoding, uint32_t length) {
+      return (encoding == TEXT ? vintSize(length) : 4) + length;
+    }
+
+    static void writeField(OutStream& stream, Encoding encoding,
+                           const char* bytes, uint32_t length) {
+      if (encoding == TEXT) {
+        serializeInt(length, stream);
+      } else {
+        writeBigEndian(stream, length, 4);
+      }
+      stream.write(bytes, length);
+    }
+
+    /**
+     * Partition as the default HashPartitioner does, by
+     * BinaryComparable.hashCode().
+     */
+    int hashPartition(const string& key) const {
+      int32_t hash = 1;
+      for (size_t i = 0; i < key.size(); ++i) {
+        hash = (int32_t) (31U * (uint32_t) hash + (uint32_t) (int8_t) key[i]);
+      }
+      return (hash & 0x7fffffff) % numReduces;
+    }
+
+    void add(int partition, const string& key, const string& value) {
+      HADOOP_ASSERT(partition >= 0 && partition < numReduces,
+                    "Illegal partition " + toString(partition));
+      Record rec;
+      rec.prefix = 0;
+      for (size_t i = 0; i < 8; ++i) {
+        rec.prefix <<= 8;
+        if (i < key.size()) {
+          rec.prefix |= (unsigned char) key[i];
+        }
+      }
+      rec.partition = partition;
+      rec.keyLength = key.size();
+      rec.valueLength = value.size();
+      rec.offset = data.size();
+      data.append(key);
+      data.append(value);
+      records.push_back(rec);
+      if ((int64_t) (data.size() + records.size() * sizeof(Record)) >=
+          spillSize) {
+        spill();
+      }
+    }
+
+    /**
+     * Sort the buffered outputs and write them as the next spill.
+     */
+    void spill() {
+      if (records.empty()) {
+        return;
+      }
+      std::sort(records.begin(), records.end(), RecordLess(data.data()));
+      string name = prefix + toString(numSpills);
+      FileOutStream file;
+      HADOOP_ASSERT(file.open(name + ".out", true),
+                    "problem creating " + name + ".out: " + strerror(errno));
+      string index;
+      StringOutStream indexStream(index);
+      uint64_t offset = 0;
+      uint64_t bytes = 0;
+      size_t next = 0;
+      for (int part = 0; part < numReduces; ++part) {
+        ChecksumOutStream segment(&file);
+        for (; next < records.size() && records[next].partition == part;
+             ++next) {
+          const Record& rec = records[next];
+          size_t keySize = serializedLength(keyEncoding, rec.keyLength);
+          size_t valueSize = serializedLength(valueEncoding, rec.valueLength);
+          serializeInt(keySize, segment);
+          serializeInt(valueSize, segment);
+          writeField(segment, keyEncoding, data.data() + rec.offset,
+                     rec.keyLength);
+          writeField(segment, valueEncoding,
+                     data.data() + rec.offset + rec.keyLength,
+                     rec.valueLength);
+          bytes += keySize + valueSize;
+        }
+        // the end of file marker, then the checksum, as IFile.Writer has
+        serializeInt(-1, segment);
+        serializeInt(-1, segment);
+        uint64_t rawLength = segment.getLength();
+        writeBigEndian(file, segment.getChecksum(), 4);
+        writeBigEndian(indexStream, offset, 8);
+        writeBigEndian(indexStream, rawLength, 8);
+        writeBigEndian(indexStream, rawLength + 4, 8);
+        offset += rawLength + 4;
+      }
+      HADOOP_ASSERT(file.close(), "problem writing " + name + ".out");
+      Crc32 indexCrc;
+      indexCrc.update(index.data(), index.size());
+      writeBigEndian(indexStream, indexCrc.getValue(), 8);
+      FileOutStream indexFile;
+      HADOOP_ASSERT(indexFile.open(name + ".out.index", true),
+                    "problem creating " + name + ".out.index: " +
+                    strerror(errno));
+      indexFile.write(index.data(), index.size());
+      HADOOP_ASSERT(indexFile.close(), "problem writing " + name +
+                    ".out.index");
+      uplink->incrementCounter(outputRecords, records.size());
+      uplink->incrementCounter(outputBytes, bytes);
+      ++numSpills;
+      data.clear();
+      records.clear();
+    }
+
+  public:
+    NativeCollector(MapContext& context, UpwardProtocol* _uplink,
+                    int _numReduces, int64_t _spillSize) {
+      const JobConf& conf = *context.getJobConf();
+      uplink = _uplink;
       numReduces = _numReduces;
+      spillSize = _spillSize;
+      prefix = conf.get(NATIVE_SPILL_PREFIX_KEY);
+      keyEncoding = getEncoding(conf, "mapreduce.map.output.key.class");
+      valueEncoding = getEncoding(conf, "mapreduce.map.output.value.class");
+      numSpills = 0;
+      outputRecords = context.getCounter(TASK_COUNTER_GROUP,
+                                         "MAP_OUTPUT_RECORDS");
+      outputBytes = context.getCounter(TASK_COUNTER_GROUP,
+                                       "MAP_OUTPUT_BYTES");
+    }
+
+    /**
+     * Write what is left as the last spill.
+     */
+    void close() {
+      spill();
+    }
+
+    virtual void output(const string& key, const string& value) {
+      add(numReduces == 1 ? 0 : hashPartition(key), key, value);
+    }
+
+    virtual void partitionedOutput(int reduce, const string& key,
+                                   const string& value) {
+      add(reduce, key, value);
+    }
+
+    virtual void status(const string& message) {
+      uplink->status(message);
+    }
+
+    virtual void progress(float progress) {
+      uplink->progress(progress);
+    }
+
+    virtual void done() {
+      uplink->done();
+    }
+
+    virtual void registerCounter(int id, const string& group,
+                                 const string& name) {
+      uplink->registerCounter(id, group, name);
+    }
+
+    virtual void incrementCounter(const TaskContext::Counter* counter,
+                                  uint64_t amount) {
+      uplink->incrementCounter(counter, amount);
+    }
+
+    virtual ~NativeCollector() {
+      delete outputRecords;
+      delete outputBytes;
+    }
+  };
+
+  /**
+   * The job conf key with the number of threads to run map() in.  Each
+   * thread gets its own Mapper, and combiner and Partitioner if there are
+   * any.
+   */
+  static const char* MAP_THREADS_KEY = "mapreduce.pipes.map.threads";
+
+  /**
+   * Holds a mutex for as long as it is in scope.
+   */
+  class MutexLock {
+  private:
+    pthread_mutex_t* mutex;
+  public:
+    MutexLock(pthread_mutex_t* _mutex): mutex(_mutex) {
+      pthread_mutex_lock(mutex);
+    }
+
+    ~MutexLock() {
+      pthread_mutex_unlock(mutex);
+    }
+  };
+
+  /**
+   * An output that a map thread has buffered up.
+   */
+  struct MapOutput {
+    /** the reduce it was partitioned to, or -1 */
+    int reduce;
+    string key;
+    string value;
+  };
+
+  /**
+   * An uplink that several threads can use at once, by holding a lock for
+   * each message.
+   */
+  class SharedUplink: public UpwardProtocol {
+  private:
+    UpwardProtocol* uplink;
+    pthread_mutex_t mutex;
+  public:
+    SharedUplink(UpwardProtocol* _uplink): uplink(_uplink) {
+      pthread_mutex_init(&mutex, NULL);
+    }
+
+    virtual void output(const string& key, const string& value) {
+      MutexLock lock(&mutex);
+      uplink->output(key, value);
+    }
+
+    virtual void partitionedOutput(int reduce, const string& key,
+                                   const string& value) {
+      MutexLock lock(&mutex);
+      uplink->partitionedOutput(reduce, key, value);
+    }
+
+    /**
+     * Send the first count of outputs, holding the lock just once.
+     */
+    void outputAll(const vector<MapOutput>& outputs, size_t count) {
+      MutexLock lock(&mutex);
+      for (size_t i = 0; i < count; ++i) {
+        const MapOutput& out = outputs[i];
+        if (out.reduce >= 0) {
+          uplink->partitionedOutput(out.reduce, out.key, out.value);
+        } else {
+          uplink->output(out.key, out.value);
+        }
+      }
+    }
+
+    virtual void status(const string& message) {
+      MutexLock lock(&mutex);
+      uplink->status(message);
+    }
+
+    virtual void progress(float progress) {
+      MutexLock lock(&mutex);
+      uplink->progress(progress);
+    }
+
+    virtual void done() {
+      MutexLock lock(&mutex);
+      uplink->done();
+    }
+
+    virtual void registerCounter(int id, const string& group,
+                                 const string& name) {
+      MutexLock lock(&mutex);
+      uplink->registerCounter(id, group, name);
+    }
+
+    virtual void incrementCounter(const TaskContext::Counter* counter,
+                                  uint64_t amount) {
+      MutexLock lock(&mutex);
+      uplink->incrementCounter(counter, amount);
+    }
+
+    virtual ~SharedUplink() {
+      pthread_mutex_destroy(&mutex);
+    }
+  };
+
+  /**
+   * The uplink of one map thread.  Outputs are buffered and passed to the
+   * SharedUplink in runs; everything else goes straight through.
+   */
+  class MapThreadUplink: public UpwardProtocol {
+  private:
+    static const size_t FLUSH_BYTES = 64 * 1024;
+    SharedUplink* shared;
+    /** the buffered outputs are the first count; the rest are for reuse */
+    vector<MapOutput> outputs;
+    size_t count;
+    size_t bytes;
+
+    void add(int reduce, const string& key, const string& value) {
+      if (count == outputs.size()) {
+        outputs.push_back(MapOutput());
+      }
+      MapOutput& out = outputs[count++];
+      out.reduce = reduce;
+      out.key = key;
+      out.value = value;
+      bytes += key.size() + value.size();
+      if (bytes >= FLUSH_BYTES) {
+        flush();
+      }
+    }
+
+  public:
+    MapThreadUplink(SharedUplink* _shared): shared(_shared), count(0),
+                                            bytes(0) {}
+
+    void flush() {
+      if (count > 0) {
+        shared->outputAll(outputs, count);
+        count = 0;
+        bytes = 0;
+      }
+    }
+
+    virtual void output(const string& key, const string& value) {
+      add(-1, key, value);
+    }
+
+    virtual void partitionedOutput(int reduce, const string& key,
+                                   const string& value) {
+      add(reduce, key, value);
+    }
+
+    virtual void status(const string& message) {
+      shared->status(message);
+    }
+
+    virtual void progress(float progress) {
+      shared->progress(progress);
+    }
+
+    virtual void done() {
+      flush();
+      shared->done();
+    }
+
+    virtual void registerCounter(int id, const string& group,
+                                 const string& name) {
+      shared->registerCounter(id, group, name);
+    }
+
+    virtual void incrementCounter(const TaskContext::Counter* counter,
+                                  uint64_t amount) {
+      shared->incrementCounter(counter, amount);
+    }
+  };
+
+  /**
+   * Map inputs copied out of the protocol, to be handed to a map thread.
+   * The records are laid end to end in bytes; ends has the end of each
+   * key and then of its value.
+   */
+  struct MapBatch {
+    string bytes;
+    vector<size_t> ends;
+
+    size_t size() const {
+      return ends.size() / 2;
+    }
+
+    void clear() {
+      bytes.clear();
+      ends.clear();
+    }
+  };
+
+  /**
+   * The context of one map thread.  It reads the records of a MapBatch and
+   * emits through its own writer or buffered uplink.
+   */
+  class MapThread: public MapContext, public ReduceContext {
+  private:
+    MapContext* base;
+    MapThreadUplink uplink;
+    Mapper* mapper;
+    Reducer* combiner;
+    Partitioner* partitioner;
+    RecordWriter* writer;
+    int numReduces;
+    ByteRange keyBytes;
+    ByteRange valueBytes;
+    string key;
+    bool keyCopied;
+    string value;
+    bool valueCopied;
+
+  public:
+    pthread_t thread;
+
+    MapThread(MapContext* _base, const Factory& factory,
+              SharedUplink* shared, int _numReduces,
+              int64_t spillSize): base(_base), uplink(shared) {
+      keyCopied = true;
+      valueCopied = true;
+      numReduces = _numReduces;
+      combiner = NULL;
+      partitioner = NULL;
+      writer = NULL;
+      mapper = factory.createMapper(*this);
+      if (numReduces != 0) {
+        combiner = factory.createCombiner(*this);
+        partitioner = factory.createPartitioner(*this);
+      }
+      if (combiner != NULL) {
+        writer = new CombineRunner(spillSize, this, combiner, &uplink,
+                                   partitioner, numReduces);
+      }
+    }
+
+    /**
+     * Run map() over each record of a batch.
+     */
+    void mapBatch(const MapBatch& batch) {
+      size_t start = 0;
+      for (size_t i = 0; i < batch.ends.size(); i += 2) {
+        size_t keyEnd = batch.ends[i];
+        size_t valueEnd = batch.ends[i + 1];
+        keyBytes = ByteRange(batch.bytes.data() + start, keyEnd - start);
+        valueBytes = ByteRange(batch.bytes.data() + keyEnd,
+                               valueEnd - keyEnd);
+        keyCopied = false;
+        valueCopied = false;
+        mapper->map(*this);
+        start = valueEnd;
+      }
+      uplink.flush();
+    }
+
+    void close() {
+      mapper->close();
+      if (writer != NULL) {
+        writer->close();
+      }
+      uplink.flush();
+    }
+
+    virtual const JobConf* getJobConf() {
+      return base->getJobConf();
+    }
+
+    virtual const std::string& getInputKey() {
+      if (!keyCopied) {
+        key.assign(keyBytes.data, keyBytes.length);
+        keyCopied = true;
+      }
+      return key;
+    }
+
+    virtual const std::string& getInputValue() {
+      if (!valueCopied) {
+        value.assign(valueBytes.data, valueBytes.length);
+        valueCopied = true;
+      }
+      return value;
+    }
+
+    virtual ByteRange getInputKeyBytes() {
+      return keyBytes;
+    }
+
+    virtual ByteRange getInputValueBytes() {
+      return valueBytes;
+    }
+
+    virtual void emit(const std::string& key, const std::string& value) {
+      if (writer != NULL) {
+        writer->emit(key, value);
+      } else if (partitioner != NULL) {
+        uplink.partitionedOutput(partitioner->partition(key, numReduces),
+                                 key, value);
+      } else {
+        uplink.output(key, value);
+      }
+    }
+
+    /**
+     * Progress is reported by the protocol thread as it hands out records.
+     */
+    virtual void progress() {
+    }
+
+    virtual void setStatus(const std::string& status) {
+      uplink.status(status);
+    }
+
+    virtual Counter* getCounter(const std::string& group,
+                                const std::string& name) {
+      return base->getCounter(group, name);
+    }
+
+    virtual void incrementCounter(const Counter* counter, uint64_t amount) {
+      base->incrementCounter(counter, amount);
+    }
+
+    virtual const std::string& getInputSplit() {
+      return base->getInputSplit();
+    }
+
+    virtual const std::string& getInputKeyClass() {
+      return base->getInputKeyClass();
+    }
+
+    virtual const std::string& getInputValueClass() {
+      return base->getInputValueClass();
+    }
+
+    virtual bool nextValue() {
+      return false;
+    }
+
+    virtual ~MapThread() {
+      delete mapper;
+      delete combiner;
+      delete writer;
+      delete partitioner;
+    }
+  };
+
+  /**
+   * Runs the mapper in several threads.  The protocol thread copies the
+   * inputs into batches with add(), and a bounded queue hands them to the
+   * threads.  The order outputs are sent in is not defined.
+   */
+  class MapThreadPool {
+  private:
+    static const size_t BATCH_RECORDS = 256;
+    static const size_t BATCH_BYTES = 256 * 1024;
+    MapContext* base;
+    vector<MapThread*> threads;
+    std::deque<MapBatch*> queue;
+    size_t maxQueued;
+    /** batches that have been mapped, for reuse */
+    vector<MapBatch*> spare;
+    MapBatch* current;
+    /** threads that have been joined */
+    vector<MapThread*> closed;
+    bool closing;
+    bool failed;
+    string failure;
+    pthread_mutex_t mutex;
+    pthread_cond_t queueNotEmpty;
+    pthread_cond_t queueNotFull;
+
+    static void* run(void* ptr) {
+      std::pair<MapThreadPool*, MapThread*>* args =
+        (std::pair<MapThreadPool*, MapThread*>*) ptr;
+      args->first->work(args->second);
+      delete args;
+      return NULL;
+    }
+
+    void work(MapThread* thread) {
+      MutexLock lock(&mutex);
+      for (;;) {
+        while (queue.empty() && !closing && !failed) {
+          pthread_cond_wait(&queueNotEmpty, &mutex);
+        }
+        if (queue.empty() || failed) {
+          break;
+        }
+        MapBatch* batch = queue.front();
+        queue.pop_front();
+        pthread_cond_signal(&queueNotFull);
+        pthread_mutex_unlock(&mutex);
+        bool ok = true;
+        string error;
+        try {
+          thread->mapBatch(*batch);
+        } catch (Error& err) {
+          ok = false;
+          error = err.getMessage();
+        }
+        pthread_mutex_lock(&mutex);
+        batch->clear();
+        spare.push_back(batch);
+        if (!ok) {
+          fail(error);
+        }
+      }
+    }
+
+    /**
+     * Stop all the threads.  Called with the mutex held.
+     */
+    void fail(const string& error) {
+      if (!failed) {
+        failed = true;
+        failure = error;
+      }
+      pthread_cond_broadcast(&queueNotEmpty);
+      pthread_cond_broadcast(&queueNotFull);
+    }
+
+    void dispatch() {
+      pthread_mutex_lock(&mutex);
+      while (queue.size() >= maxQueued && !failed) {
+        // keep the progress going while the map threads are busy
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&queueNotFull, &mutex, &deadline);
+        pthread_mutex_unlock(&mutex);
+        base->progress();
+        pthread_mutex_lock(&mutex);
+      }
+      if (failed) {
+        pthread_mutex_unlock(&mutex);
+        throw Error("Map thread failed: " + failure);
+      }
+      queue.push_back(current);
+      current = NULL;
+      pthread_cond_signal(&queueNotEmpty);
+      pthread_mutex_unlock(&mutex);
+    }
+
+    void join() {
+      for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i]->thread, NULL);
+      }
+    }
+
+  public:
+    MapThreadPool(MapContext* _base, const Factory& factory,
+                  SharedUplink* uplink, int numThreads, int numReduces,
+                  int64_t spillSize) {
+      base = _base;
+      current = NULL;
+      closing = false;
+      failed = false;
+      maxQueued = 2 * numThreads;
+      pthread_mutex_init(&mutex, NULL);
+      pthread_cond_init(&queueNotEmpty, NULL);
+      pthread_cond_init(&queueNotFull, NULL);
+      // the buffer of each combiner is a share of the task's
+      spillSize /= numThreads;
+      for (int i = 0; i < numThreads; ++i) {
+        threads.push_back(new MapThread(base, factory, uplink, numReduces,
+                                        spillSize));
+      }
+      for (int i = 0; i < numThreads; ++i) {
+        int ret = pthread_create(&threads[i]->thread, NULL, run,
+                                 new std::pair<MapThreadPool*, MapThread*>(
+                                   this, threads[i]));
+        if (ret != 0) {
+          pthread_mutex_lock(&mutex);
+          fail("problem creating map thread: " + string(strerror(ret)));
+          pthread_mutex_unlock(&mutex);
+          closed.assign(threads.begin() + i, threads.end());
+          threads.resize(i);
+          throw Error(failure);
+        }
+      }
+    }
+
+    /**
+     * Copy a record into the current batch, and queue the batch once it is
+     * full.
+     */
+    void add(ByteRange key, ByteRange value) {
+      if (current == NULL) {
+        pthread_mutex_lock(&mutex);
+        if (spare.empty()) {
+          current = new MapBatch();
+        } else {
+          current = spare.back();
+          spare.pop_back();
+        }
+        pthread_mutex_unlock(&mutex);
+      }
+      current->bytes.append(key.data, key.length);
+      current->ends.push_back(current->bytes.size());
+      current->bytes.append(value.data, value.length);
+      current->ends.push_back(current->bytes.size());
+      if (current->size() >= BATCH_RECORDS ||
+          current->bytes.size() >= BATCH_BYTES) {
+        dispatch();
+      }
+    }
+
+    /**
+     * Map what is left, wait for the threads and close their mappers.
+     */
+    void finish() {
+      if (current != NULL) {
+        dispatch();
+      }
+      pthread_mutex_lock(&mutex);
+      closing = true;
+      pthread_cond_broadcast(&queueNotEmpty);
+      pthread_mutex_unlock(&mutex);
+      join();
+      threads.swap(closed);
+      if (failed) {
+        throw Error("Map thread failed: " + failure);
+      }
+      for (size_t i = 0; i < closed.size(); ++i) {
+        closed[i]->close();
+      }
+    }
+
+    ~MapThreadPool() {
+      pthread_mutex_lock(&mutex);
+      fail("Map threads abandoned");
+      pthread_mutex_unlock(&mutex);
+      join();
+      for (size_t i = 0; i < threads.size(); ++i) {
+        delete threads[i];
+      }
+      for (size_t i = 0; i < closed.size(); ++i) {
+        delete closed[i];
+      }
+      for (size_t i = 0; i < queue.size(); ++i) {
+        delete queue[i];
+      }
+      for (size_t i = 0; i < spare.size(); ++i) {
+        delete spare[i];
+      }
+      delete current;
+      pthread_cond_destroy(&queueNotFull);
+      pthread_cond_destroy(&queueNotEmpty);
+      pthread_mutex_destroy(&mutex);
+    }
+  };
+
+  class TaskContextImpl: public MapContext, public ReduceContext, 
+                         public DownwardProtocol {
+  private:
+    bool done;
+    JobConf* jobConf;
+    string key;
+    const string* newKey;
+    const string* value;
+    // the current record as ranges, which may point into the protocol's
+    // buffer; key and value are only filled in from them when asked for
+    ByteRange newKeyBytes;
+    ByteRange keyBytes;
+    ByteRange valueBytes;
+    bool keyCopied;
+    string valueCopy;
+    bool hasTask;
+    bool isNewKey;
+    bool isNewValue;
+    string* inputKeyClass;
+    string* inputValueClass;
+    string status;
+    float progressFloat;
+    // raised once a second by the ping thread, so that progress() need not
+    // look at the clock on every record
+    bool progressDue;
+    bool statusSet;
+    Protocol* protocol;
+    UpwardProtocol *uplink;
+    string* inputSplit;
+    RecordReader* reader;
+    Mapper* mapper;
+    Reducer* reducer;
+    RecordWriter* writer;
+    Partitioner* partitioner;
+    int numReduces;
+    const Factory* factory;
+    pthread_mutex_t mutexDone;
+    pthread_mutex_t mutexCounters;
+    std::vector<int> registeredCounterIds;
+    // the increments to each counter, by id, not yet sent to the parent
+    std::vector<uint64_t> counterDeltas;
+    SharedUplink* sharedUplink;
+    MapThreadPool* mapPool;
+    NativeCollector* collector;
+
+  public:
+
+    TaskContextImpl(const Factory& _factory) {
+      statusSet = false;
+      done = false;
+      newKey = NULL;
+      value = NULL;
+      keyCopied = true;
+      factory = &_factory;
+      jobConf = NULL;
+      inputKeyClass = NULL;
+      inputValueClass = NULL;
+      inputSplit = NULL;
+      mapper = NULL;
+      reducer = NULL;
+      reader = NULL;
+      writer = NULL;
+      partitioner = NULL;
+      protocol = NULL;
+      isNewKey = false;
+      isNewValue = false;
+      progressDue = true;
+      progressFloat = 0.0f;
+      hasTask = false;
+      sharedUplink = NULL;
+      mapPool = NULL;
+      collector = NULL;
+      pthread_mutex_init(&mutexDone, NULL);
+      pthread_mutex_init(&mutexCounters, NULL);
+    }
+
+    void setProtocol(Protocol* _protocol, UpwardProtocol* _uplink) {
+
+      protocol = _protocol;
+      uplink = _uplink;
+    }
+
+    virtual void start(int protocol) {
+      if (protocol != 0) {
+        throw Error("Protocol version " + toString(protocol) + 
+                    " not supported");
+      }
+    }
+
+    virtual void setJobConf(vector<string> values) {
+      int len = values.size();
+      JobConfImpl* result = new JobConfImpl();
+      HADOOP_ASSERT(len % 2 == 0, "Odd length of job conf values");
+      for(int i=0; i < len; i += 2) {
+        result->set(values[i], values[i+1]);
+      }
+      jobConf = result;
+    }
+
+    virtual void setInputTypes(string keyType, string valueType) {
+      inputKeyClass = new string(keyType);
+      inputValueClass = new string(valueType);
+    }
+
+    virtual void runMap(string _inputSplit, int _numReduces, bool pipedInput) {
+      inputSplit = new string(_inputSplit);
+      reader = factory->createRecordReader(*this);
+      HADOOP_ASSERT((reader == NULL) == pipedInput,
+                    pipedInput ? "RecordReader defined when not needed.":
+                    "RecordReader not defined");
+      if (reader != NULL) {
+        value = new string();
+      }
+      numReduces = _numReduces;
+      int64_t spillSize = 100;
+      if (jobConf->hasKey("mapreduce.task.io.sort.mb")) {
+        spillSize = jobConf->getInt("mapreduce.task.io.sort.mb");
+      }
+      if (numReduces != 0 && jobConf->hasKey(NATIVE_SPILL_PREFIX_KEY)) {
+        collector = new NativeCollector(*this, uplink, numReduces,
+                                        spillSize * 1024 * 1024);
+        uplink = collector;
+      }
+      int mapThreads = 1;
+      if (jobConf->hasKey(MAP_THREADS_KEY)) {
+        mapThreads = jobConf->getInt(MAP_THREADS_KEY);
+      }
+      if (mapThreads > 1) {
+        sharedUplink = new SharedUplink(uplink);
+        uplink = sharedUplink;
+        mapPool = new MapThreadPool(this, *factory, sharedUplink, mapThreads,
+                                    numReduces, spillSize * 1024 * 1024);
+        hasTask = true;
+        return;
+      }
+      mapper = factory->createMapper(*this);
       if (numReduces != 0) { 
         reducer = factory->createCombiner(*this);
         partitioner = factory->createPartitioner(*this);
       }
       if (reducer != NULL) {
-        int64_t spillSize = 100;
-        if (jobConf->hasKey("mapreduce.task.io.sort.mb")) {
-          spillSize = jobConf->getInt("mapreduce.task.io.sort.mb");
-        }
         writer = new CombineRunner(spillSize * 1024 * 1024, this, reducer, 
                                    uplink, partitioner, numReduces);
       }
@@ -818,6 +2206,16 @@ namespace HadoopPipes {
     virtual void mapItem(const string& _key, const string& _value) {
       newKey = &_key;
       value = &_value;
+      newKeyBytes = ByteRange(_key.data(), _key.size());
+      valueBytes = ByteRange(_value.data(), _value.size());
+      isNewKey = true;
+    }
+
+    virtual void mapItem(ByteRange _key, ByteRange _value) {
+      newKey = NULL;
+      value = NULL;
+      newKeyBytes = _key;
+      valueBytes = _value;
       isNewKey = true;
     }
 
@@ -838,6 +2236,13 @@ namespace HadoopPipes {
     virtual void reduceValue(const string& _value) {
       isNewValue = true;
       value = &_value;
+      valueBytes = ByteRange(_value.data(), _value.size());
+    }
+
+    virtual void reduceValue(ByteRange _value) {
+      isNewValue = true;
+      value = NULL;
+      valueBytes = _value;
     }
     
     virtual bool isDone() {
@@ -871,7 +2276,14 @@ namespace HadoopPipes {
             return false;
           }
         }
-        key = *newKey;
+        if (newKey != NULL) {
+          key = *newKey;
+          keyBytes = ByteRange(key.data(), key.size());
+          keyCopied = true;
+        } else {
+          keyBytes = newKeyBytes;
+          keyCopied = false;
+        }
       } else {
         if (!reader->next(key, const_cast<string&>(*value))) {
           pthread_mutex_lock(&mutexDone);
@@ -879,10 +2291,14 @@ namespace HadoopPipes {
           pthread_mutex_unlock(&mutexDone);
           return false;
         }
+        keyBytes = ByteRange(key.data(), key.size());
+        valueBytes = ByteRange(value->data(), value->size());
         progressFloat = reader->getProgress();
       }
       isNewKey = false;
-      if (mapper != NULL) {
+      if (mapPool != NULL) {
+        mapPool->add(keyBytes, valueBytes);
+      } else if (mapper != NULL) {
         mapper->map(*this);
       } else {
         reducer->reduce(*this);
@@ -899,10 +2315,23 @@ namespace HadoopPipes {
       }
       isNewValue = false;
       progress();
+      // values batched in a REDUCE_VALUES frame are taken straight from it
+      if (protocol->nextFrameValue(valueBytes)) {
+        value = NULL;
+        return true;
+      }
       protocol->nextEvent();
       return isNewValue;
     }
 
+    virtual bool nextValueBytes(ByteRange& _value) {
+      if (!nextValue()) {
+        return false;
+      }
+      _value = valueBytes;
+      return true;
+    }
+
     /**
      * Get the JobConf for the current task.
      */
@@ -915,6 +2344,10 @@ namespace HadoopPipes {
      * @return the current key or NULL if called before the first map or reduce
      */
     virtual const string& getInputKey() {
+      if (!keyCopied) {
+        key.assign(keyBytes.data, keyBytes.length);
+        keyCopied = true;
+      }
       return key;
     }
 
@@ -924,27 +2357,59 @@ namespace HadoopPipes {
      *    reduce
      */
     virtual const string& getInputValue() {
+      if (value == NULL) {
+        valueCopy.assign(valueBytes.data, valueBytes.length);
+        value = &valueCopy;
+      }
       return *value;
     }
 
+    virtual ByteRange getInputKeyBytes() {
+      return keyBytes;
+    }
+
+    virtual ByteRange getInputValueBytes() {
+      return valueBytes;
+    }
+
     /**
      * Mark your task as having made progress without changing the status 
      * message.
      */
     virtual void progress() {
-      if (uplink != 0) {
-        uint64_t now = getCurrentMillis();
-        if (now - lastProgress > 1000) {
-          lastProgress = now;
-          if (statusSet) {
-            uplink->status(status);
-            statusSet = false;
-          }
-          uplink->progress(progressFloat);
+      if (uplink != 0 && __atomic_load_n(&progressDue, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&progressDue, false, __ATOMIC_RELAXED);
+        if (statusSet) {
+          uplink->status(status);
+          statusSet = false;
         }
+        flushCounters();
+        uplink->progress(progressFloat);
       }
     }
 
+    /**
+     * Send the counter increments made since the last flush, one message
+     * per counter.
+     */
+    void flushCounters() {
+      MutexLock lock(&mutexCounters);
+      for (size_t id = 0; id < counterDeltas.size(); ++id) {
+        if (counterDeltas[id] != 0) {
+          Counter counter(id);
+          uplink->incrementCounter(&counter, counterDeltas[id]);
+          counterDeltas[id] = 0;
+        }
+      }
+    }
+
+    /**
+     * Let the next call to progress() report to the parent.
+     */
+    void setProgressDue() {
+      __atomic_store_n(&progressDue, true, __ATOMIC_RELAXED);
+    }
+
     /**
      * Set the status message and call progress.
      */
@@ -992,23 +2457,32 @@ namespace HadoopPipes {
      */
     virtual Counter* getCounter(const std::string& group, 
                                const std::string& name) {
+      // map threads may register counters too
+      MutexLock lock(&mutexCounters);
       int id = registeredCounterIds.size();
       registeredCounterIds.push_back(id);
+      counterDeltas.push_back(0);
       uplink->registerCounter(id, group, name);
       return new Counter(id);
     }
 
     /**
-     * Increment the value of the counter with the given amount.
+     * Increment the value of the counter with the given amount.  The
+     * increments are added up here and sent with the next progress report,
+     * rather than in a message each.
      */
     virtual void incrementCounter(const Counter* counter, uint64_t amount) {
-      uplink->incrementCounter(counter, amount); 
+      MutexLock lock(&mutexCounters);
+      counterDeltas[counter->getId()] += amount;
     }
 
     void closeAll() {
       if (reader) {
         reader->close();
       }
+      if (mapPool) {
+        mapPool->finish();
+      }
       if (mapper) {
         mapper->close();
       }
@@ -1018,6 +2492,10 @@ namespace HadoopPipes {
       if (writer) {
         writer->close();
       }
+      if (collector) {
+        collector->close();
+      }
+      flushCounters();
     }
 
     virtual ~TaskContextImpl() {
@@ -1033,21 +2511,33 @@ namespace HadoopPipes {
       delete reducer;
       delete writer;
       delete partitioner;
+      delete mapPool;
+      delete sharedUplink;
+      delete collector;
+      pthread_mutex_destroy(&mutexCounters);
       pthread_mutex_destroy(&mutexDone);
     }
   };
 
   /**
-   * Ping the parent every 5 seconds to know if it is alive 
+   * Ping the parent every 5 seconds to know if it is alive, and let the
+   * task report its progress once a second.
    */
   void* ping(void* ptr) {
     TaskContextImpl* context = (TaskContextImpl*) ptr;
     char* portStr = getenv("mapreduce.pipes.command.port");
     int MAX_RETRIES = 3;
+    int PING_SECONDS = 5;
     int remaining_retries = MAX_RETRIES;
+    int seconds = 0;
     while (!context->isDone()) {
       try{
-        sleep(5);
+        sleep(1);
+        context->setProgressDue();
+        if (++seconds < PING_SECONDS) {
+          continue;
+        }
+        seconds = 0;
         int sock = -1;
         if (portStr) {
           sock = socket(PF_INET, SOCK_STREAM, 0);
@@ -1099,8 +2589,6 @@ namespace HadoopPipes {
       int sock = -1;
       FILE* stream = NULL;
       FILE* outStream = NULL;
-      char *bufin = NULL;
-      char *bufout = NULL;
       if (portStr) {
         sock = socket(PF_INET, SOCK_STREAM, 0);
         HADOOP_ASSERT(sock != - 1,
@@ -1113,21 +2601,19 @@ namespace HadoopPipes {
                       string("problem connecting command socket: ") +
                       strerror(errno));
 
-        stream = fdopen(sock, "r");
-        outStream = fdopen(sock, "w");
+        // the outputs are buffered below, so send each flush straight away
+        // rather than waiting for the ack of the previous one
+        int on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
 
-        // increase buffer size
         int bufsize = 128*1024;
-        int setbuf;
-        bufin = new char[bufsize];
-        bufout = new char[bufsize];
-        setbuf = setvbuf(stream, bufin, _IOFBF, bufsize);
-        HADOOP_ASSERT(setbuf == 0, string("problem with setvbuf for inStream: ")
-                                     + strerror(errno));
-        setbuf = setvbuf(outStream, bufout, _IOFBF, bufsize);
-        HADOOP_ASSERT(setbuf == 0, string("problem with setvbuf for outStream: ")
-                                     + strerror(errno));
-        connection = new BinaryProtocol(stream, context, outStream);
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        // Read and write the socket directly rather than through stdio,
+        // which locks the FILE on every call.  The protocol thread is the
+        // only reader, and writers are serialized by the uplink.
+        connection = new BinaryProtocol(new FdInStream(sock, bufsize), context,
+                                        new FdOutStream(sock, bufsize));
       } else if (getenv("mapreduce.pipes.commandfile")) {
         char* filename = getenv("mapreduce.pipes.commandfile");
         string outFilename = filename;
@@ -1169,8 +2655,6 @@ namespace HadoopPipes {
       if (outStream != NULL) {
         //fclose(outStream);
       } 
-      delete bufin;
-      delete bufout;
       return true;
     } catch (Error& err) {
       fprintf(stderr, "Hadoop Pipes Exception: %s\n", 
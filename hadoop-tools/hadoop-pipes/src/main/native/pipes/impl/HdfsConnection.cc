@@ -0,0 +1,51 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HdfsConnection.hh"
+#include "hadoop/SerialUtils.hh"
+
+#include <errno.h>
+#include <string.h>
+
+using std::string;
+
+namespace HadoopPipes {
+
+  hdfsFS connectToFileSystem(const string& uri, string& path) {
+    string nameNode = "default";
+    path = uri;
+    string::size_type colon = uri.find(':');
+    if (colon != string::npos && colon < uri.find('/')) {
+      string rest = uri.substr(colon + 1);
+      string authority;
+      if (rest.compare(0, 2, "//") == 0) {
+        string::size_type slash = rest.find('/', 2);
+        authority = rest.substr(2, slash == string::npos ? slash : slash - 2);
+        rest = slash == string::npos ? "/" : rest.substr(slash);
+      }
+      nameNode = uri.substr(0, colon) + "://" + authority;
+      path = rest;
+    }
+    struct hdfsBuilder* bld = hdfsNewBuilder();
+    HADOOP_ASSERT(bld != NULL, "can't create an hdfs builder");
+    hdfsBuilderSetNameNode(bld, nameNode.c_str());
+    hdfsFS fs = hdfsBuilderConnect(bld);
+    HADOOP_ASSERT(fs != NULL, "can't connect to " + nameNode + ": " +
+                  strerror(errno));
+    return fs;
+  }
+}
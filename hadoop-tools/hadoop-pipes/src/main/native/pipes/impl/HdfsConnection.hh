@@ -0,0 +1,38 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HADOOP_PIPES_HDFS_CONNECTION_HH
+#define HADOOP_PIPES_HDFS_CONNECTION_HH
+
+#include <string>
+
+#include "hdfs.h"
+
+namespace HadoopPipes {
+
+  /**
+   * Connect to the file system named by the scheme and authority of uri,
+   * or to the default file system if uri has none.
+   * @param uri a path, with or without a scheme and authority
+   * @param path set to the part of uri within the file system
+   * @return the connection, which the caller must hdfsDisconnect
+   * @throws Error if the connection can't be made
+   */
+  hdfsFS connectToFileSystem(const std::string& uri, std::string& path);
+}
+
+#endif
@@ -0,0 +1,539 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hadoop/HdfsRecordReader.hh"
+#include "HdfsConnection.hh"
+#include "hadoop/SerialUtils.hh"
+#include "hadoop/StringUtils.hh"
+
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+
+using namespace HadoopUtils;
+
+namespace HadoopPipes {
+
+  /**
+   * The job conf key with the number of bytes to read from the file
+   * system at a time.
+   */
+  static const char* BUFFER_BYTES_KEY =
+    "mapreduce.pipes.hdfs.reader.buffer.bytes";
+  static const int DEFAULT_BUFFER_BYTES = 4 * 1024 * 1024;
+
+  /**
+   * The job conf key that PipesNonJavaInputFormat keeps the job's own
+   * input format in.
+   */
+  static const char* INPUT_FORMAT_KEY = "mapreduce.pipes.inputformat";
+
+  /**
+   * Reads a file sequentially from the file system, one large pread at a
+   * time.  While one buffer is being consumed, a background thread reads
+   * the next one.
+   */
+  class HdfsInput: public InStream {
+  private:
+    string path;
+    hdfsFS fs;
+    hdfsFile file;
+    int64_t fileLength;
+    size_t bufferSize;
+
+    /** the unread bytes are current[used, filled), from file offset bufferPos */
+    char* current;
+    size_t filled;
+    size_t used;
+    int64_t bufferPos;
+
+    /** the buffer the background thread reads into, and its request */
+    char* ahead;
+    int64_t aheadPos;
+    size_t aheadFilled;
+    int aheadErrno;
+    bool pending;
+    bool aheadReady;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    static void* prefetchThread(void* arg) {
+      static_cast<HdfsInput*>(arg)->prefetchLoop();
+      return NULL;
+    }
+
+    void prefetchLoop() {
+      pthread_mutex_lock(&lock);
+      while (!stopping) {
+        if (!pending || aheadReady) {
+          pthread_cond_wait(&cond, &lock);
+          continue;
+        }
+        int64_t pos = aheadPos;
+        pthread_mutex_unlock(&lock);
+        int err = 0;
+        size_t n = readAt(ahead, pos, bufferSize, &err);
+        pthread_mutex_lock(&lock);
+        aheadFilled = n;
+        aheadErrno = err;
+        aheadReady = true;
+        pthread_cond_broadcast(&cond);
+      }
+      pthread_mutex_unlock(&lock);
+    }
+
+    /**
+     * Read up to len bytes at pos, stopping short only at the end of the
+     * file or on an error, which is returned in err.
+     */
+    size_t readAt(char* buf, int64_t pos, size_t len, int* err) {
+      size_t done = 0;
+      while (done < len) {
+        tSize n = hdfsPread(fs, file, pos + done, buf + done, len - done);
+        if (n < 0) {
+          *err = errno ? errno : EIO;
+          break;
+        }
+        if (n == 0) {
+          break;
+        }
+        done += n;
+      }
+      return done;
+    }
+
+    void startPrefetch(int64_t pos) {
+      pthread_mutex_lock(&lock);
+      aheadPos = pos;
+      aheadReady = false;
+      pending = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+    }
+
+    void waitPrefetch() {
+      pthread_mutex_lock(&lock);
+      while (!aheadReady) {
+        pthread_cond_wait(&cond, &lock);
+      }
+      pending = false;
+      pthread_mutex_unlock(&lock);
+    }
+
+  public:
+    HdfsInput(const string& uri, size_t _bufferSize) {
+      fs = connectToFileSystem(uri, path);
+      hdfsFileInfo* info = hdfsGetPathInfo(fs, path.c_str());
+      file = info == NULL ? NULL : hdfsOpenFile(fs, path.c_str(), O_RDONLY,
+                                                0, 0, 0);
+      if (file == NULL) {
+        int err = errno;
+        if (info != NULL) {
+          hdfsFreeFileInfo(info, 1);
+        }
+        hdfsDisconnect(fs);
+        HADOOP_ASSERT(false, "can't open " + uri + ": " + strerror(err));
+      }
+      fileLength = info->mSize;
+      hdfsFreeFileInfo(info, 1);
+      bufferSize = _bufferSize;
+      current = static_cast<char*>(malloc(bufferSize));
+      ahead = static_cast<char*>(malloc(bufferSize));
+      HADOOP_ASSERT(current != NULL && ahead != NULL,
+                    "can't allocate read buffers");
+      filled = used = 0;
+      bufferPos = 0;
+      aheadPos = 0;
+      aheadFilled = 0;
+      aheadErrno = 0;
+      pending = aheadReady = stopping = false;
+      pthread_mutex_init(&lock, NULL);
+      pthread_cond_init(&cond, NULL);
+      int ret = pthread_create(&thread, NULL, prefetchThread, this);
+      HADOOP_ASSERT(ret == 0, "can't start the read-ahead thread");
+    }
+
+    virtual ~HdfsInput() {
+      pthread_mutex_lock(&lock);
+      stopping = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      pthread_join(thread, NULL);
+      pthread_mutex_destroy(&lock);
+      pthread_cond_destroy(&cond);
+      free(current);
+      free(ahead);
+      hdfsCloseFile(fs, file);
+      hdfsDisconnect(fs);
+    }
+
+    const string& getPath() const {
+      return path;
+    }
+
+    int64_t length() const {
+      return fileLength;
+    }
+
+    int64_t tell() const {
+      return bufferPos + used;
+    }
+
+    /**
+     * Move to pos, keeping the buffered data if pos is within it.
+     */
+    void seek(int64_t pos) {
+      if (pos >= bufferPos && pos <= bufferPos + (int64_t) filled) {
+        used = pos - bufferPos;
+        return;
+      }
+      if (pending) {
+        waitPrefetch();
+      }
+      bufferPos = pos;
+      filled = used = 0;
+    }
+
+    /**
+     * Make sure there is unread data buffered.
+     * @return false at the end of the file
+     */
+    bool fill() {
+      if (used < filled) {
+        return true;
+      }
+      int64_t next = bufferPos + filled;
+      if (!pending || aheadPos != next) {
+        if (pending) {
+          waitPrefetch();
+        }
+        if (next >= fileLength) {
+          return false;
+        }
+        startPrefetch(next);
+      }
+      waitPrefetch();
+      HADOOP_ASSERT(aheadErrno == 0, "error reading " + path + ": " +
+                    strerror(aheadErrno));
+      char* tmp = current;
+      current = ahead;
+      ahead = tmp;
+      bufferPos = aheadPos;
+      filled = aheadFilled;
+      used = 0;
+      if (filled == 0) {
+        return false;
+      }
+      if (bufferPos + (int64_t) filled < fileLength) {
+        startPrefetch(bufferPos + filled);
+      }
+      return true;
+    }
+
+    const char* data() const {
+      return current + used;
+    }
+
+    size_t available() const {
+      return filled - used;
+    }
+
+    void skip(size_t len) {
+      used += len;
+    }
+
+    virtual void read(void* buf, size_t len) {
+      char* out = static_cast<char*>(buf);
+      while (len > 0) {
+        HADOOP_ASSERT(fill(), "unexpected end of " + path);
+        size_t n = len < available() ? len : available();
+        memcpy(out, data(), n);
+        used += n;
+        out += n;
+        len -= n;
+      }
+    }
+  };
+
+  /**
+   * Read a big-endian integer, as written by DataOutput.
+   */
+  static uint64_t readBigEndian(InStream& stream, int bytes) {
+    unsigned char buf[8];
+    stream.read(buf, bytes);
+    uint64_t result = 0;
+    for (int i = 0; i < bytes; ++i) {
+      result = (result << 8) | buf[i];
+    }
+    return result;
+  }
+
+  static bool endsWith(const string& str, const char* suffix) {
+    size_t len = strlen(suffix);
+    return str.size() >= len &&
+      str.compare(str.size() - len, len, suffix) == 0;
+  }
+
+  HdfsRecordReader::HdfsRecordReader(MapContext& context) {
+    const JobConf* conf = context.getJobConf();
+
+    // The split is a FileSplit: the path, then the start and length
+    StringInStream splitStream(context.getInputSplit());
+    string uri;
+    deserializeString(uri, splitStream);
+    start = readBigEndian(splitStream, 8);
+    end = start + (int64_t) readBigEndian(splitStream, 8);
+
+    const string* format = conf->tryGet(INPUT_FORMAT_KEY);
+    if (format == NULL ||
+        *format == "org.apache.hadoop.mapred.TextInputFormat" ||
+        *format == "org.apache.hadoop.mapreduce.lib.input.TextInputFormat") {
+      sequenceFile = false;
+      HADOOP_ASSERT(!endsWith(uri, ".gz") && !endsWith(uri, ".bz2") &&
+                    !endsWith(uri, ".deflate") && !endsWith(uri, ".snappy") &&
+                    !endsWith(uri, ".lz4"),
+                    "compressed text input needs the Java record reader: " +
+                    uri);
+    } else {
+      HADOOP_ASSERT(*format == "org.apache.hadoop.mapred.SequenceFileInputFormat" ||
+                    *format == "org.apache.hadoop.mapreduce.lib.input."
+                    "SequenceFileInputFormat",
+                    "HdfsRecordReader can't read " + *format);
+      sequenceFile = true;
+    }
+
+    int bufferSize = DEFAULT_BUFFER_BYTES;
+    if (conf->hasKey(BUFFER_BYTES_KEY)) {
+      bufferSize = conf->getInt(BUFFER_BYTES_KEY);
+      HADOOP_ASSERT(bufferSize > 0, string(BUFFER_BYTES_KEY) +
+                    " must be positive");
+    }
+    input = new HdfsInput(uri, bufferSize);
+    syncSeen = false;
+    keyPrefix = valuePrefix = NO_PREFIX;
+    try {
+      if (sequenceFile) {
+        readSequenceHeader();
+      } else {
+        input->seek(start);
+        // As in LineRecordReader, a split that does not start the file
+        // leaves its first line, which may be partial, to the split before.
+        if (start != 0) {
+          while (input->fill()) {
+            const char* nl = static_cast<const char*>(
+              memchr(input->data(), '\n', input->available()));
+            if (nl != NULL) {
+              input->skip(nl - input->data() + 1);
+              break;
+            }
+            input->skip(input->available());
+          }
+        }
+      }
+    } catch (...) {
+      delete input;
+      throw;
+    }
+  }
+
+  HdfsRecordReader::LengthPrefix
+  HdfsRecordReader::getLengthPrefix(const string& className) {
+    if (className == "org.apache.hadoop.io.Text") {
+      return VINT_PREFIX;
+    }
+    if (className == "org.apache.hadoop.io.BytesWritable") {
+      return INT_PREFIX;
+    }
+    return NO_PREFIX;
+  }
+
+  void HdfsRecordReader::readSequenceHeader() {
+    const string& path = input->getPath();
+    char magic[4];
+    input->seek(0);
+    input->read(magic, sizeof(magic));
+    HADOOP_ASSERT(memcmp(magic, "SEQ", 3) == 0,
+                  path + " is not a SequenceFile");
+    int version = magic[3];
+    HADOOP_ASSERT(version == 5 || version == 6,
+                  "unsupported SequenceFile version " + toString(version) +
+                  " in " + path);
+    string keyClass, valueClass;
+    deserializeString(keyClass, *input);
+    deserializeString(valueClass, *input);
+    char flags[2];
+    input->read(flags, sizeof(flags));
+    HADOOP_ASSERT(!flags[0] && !flags[1],
+                  "compressed SequenceFiles need the Java record reader: " +
+                  path);
+    if (version >= 6) {
+      int entries = readBigEndian(*input, 4);
+      string ignored;
+      for (int i = 0; i < 2 * entries; ++i) {
+        deserializeString(ignored, *input);
+      }
+    }
+    input->read(sync, sizeof(sync));
+    keyPrefix = getLengthPrefix(keyClass);
+    valuePrefix = getLengthPrefix(valueClass);
+
+    // As in SequenceFile.Reader.sync(), a split that does not start the
+    // file begins at the first sync mark at or after its start.  Unlike
+    // the Java reader, a split that starts inside the header also looks
+    // for a sync mark, since the first split already owns the records
+    // up to it.
+    if (start == 0) {
+      return;
+    }
+    int64_t from = std::max(start, input->tell());
+    if (from + 4 + (int64_t) sizeof(sync) >= input->length()) {
+      input->seek(input->length());
+      return;
+    }
+    input->seek(from + 4);
+    char check[sizeof(sync)];
+    input->read(check, sizeof(check));
+    for (size_t i = 0; ; ++i) {
+      size_t j = 0;
+      while (j < sizeof(sync) && sync[j] == check[(i + j) % sizeof(sync)]) {
+        ++j;
+      }
+      if (j == sizeof(sync)) {
+        // back up to the escape before the mark
+        input->seek(input->tell() - 4 - sizeof(sync));
+        return;
+      }
+      if (!input->fill()) {
+        return;
+      }
+      check[i % sizeof(sync)] = *input->data();
+      input->skip(1);
+    }
+  }
+
+  void HdfsRecordReader::readSerialized(string& buffer, int length,
+                                        LengthPrefix prefix) {
+    HADOOP_ASSERT(length >= 0, "corrupt record in " + input->getPath());
+    buffer.resize(length);
+    if (length > 0) {
+      input->read(&buffer[0], length);
+    }
+    size_t skip = 0;
+    if (prefix == VINT_PREFIX && length > 0) {
+      // WritableUtils.decodeVIntSize
+      int8_t first = buffer[0];
+      skip = first >= -112 ? 1 : (first < -120 ? -119 - first : -111 - first);
+    } else if (prefix == INT_PREFIX) {
+      skip = 4;
+    }
+    HADOOP_ASSERT(skip <= buffer.size(), "corrupt record in " +
+                  input->getPath());
+    buffer.erase(0, skip);
+  }
+
+  bool HdfsRecordReader::nextSequenceRecord(string& key, string& value) {
+    int64_t pos = input->tell();
+    if (!input->fill()) {
+      return false;
+    }
+    int32_t length = readBigEndian(*input, 4);
+    if (length == -1) {
+      char check[sizeof(sync)];
+      input->read(check, sizeof(check));
+      HADOOP_ASSERT(memcmp(check, sync, sizeof(sync)) == 0,
+                    "corrupt sync mark in " + input->getPath());
+      syncSeen = true;
+      if (!input->fill()) {
+        return false;
+      }
+      length = readBigEndian(*input, 4);
+    } else {
+      syncSeen = false;
+    }
+    // A record after a sync mark past the split's end starts the next split
+    if (pos >= end && syncSeen) {
+      return false;
+    }
+    int32_t keyLength = readBigEndian(*input, 4);
+    HADOOP_ASSERT(keyLength >= 0 && keyLength <= length,
+                  "corrupt record in " + input->getPath());
+    readSerialized(key, keyLength, keyPrefix);
+    readSerialized(value, length - keyLength, valuePrefix);
+    return true;
+  }
+
+  bool HdfsRecordReader::nextLine(string& key, string& value) {
+    int64_t pos = input->tell();
+    // A line that starts exactly at the end of the split still belongs
+    // to it, since the next split skips its first line.
+    if (pos > end || !input->fill()) {
+      return false;
+    }
+    char offset[8];
+    for (int i = 0; i < 8; ++i) {
+      offset[i] = (char) (pos >> (56 - 8 * i));
+    }
+    key.assign(offset, sizeof(offset));
+    value.clear();
+    do {
+      const char* data = input->data();
+      size_t avail = input->available();
+      const char* nl = static_cast<const char*>(memchr(data, '\n', avail));
+      if (nl != NULL) {
+        value.append(data, nl - data);
+        input->skip(nl - data + 1);
+        break;
+      }
+      value.append(data, avail);
+      input->skip(avail);
+    } while (input->fill());
+    if (!value.empty() && value[value.size() - 1] == '\r') {
+      value.resize(value.size() - 1);
+    }
+    return true;
+  }
+
+  bool HdfsRecordReader::next(string& key, string& value) {
+    HADOOP_ASSERT(input != NULL, "HdfsRecordReader is closed");
+    return sequenceFile ? nextSequenceRecord(key, value)
+                        : nextLine(key, value);
+  }
+
+  float HdfsRecordReader::getProgress() {
+    if (input == NULL || end <= start) {
+      return 1.0f;
+    }
+    float progress = (float) (input->tell() - start) / (end - start);
+    return progress < 0.0f ? 0.0f : (progress > 1.0f ? 1.0f : progress);
+  }
+
+  void HdfsRecordReader::close() {
+    delete input;
+    input = NULL;
+  }
+
+  HdfsRecordReader::~HdfsRecordReader() {
+    delete input;
+  }
+}
@@ -0,0 +1,381 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "hadoop/HdfsRecordWriter.hh"
+#include "HdfsConnection.hh"
+#include "hadoop/SerialUtils.hh"
+#include "hadoop/StringUtils.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+using std::string;
+
+using namespace HadoopUtils;
+
+namespace HadoopPipes {
+
+  /**
+   * The job conf key with the number of bytes to write to the file system
+   * at a time.
+   */
+  static const char* BUFFER_BYTES_KEY =
+    "mapreduce.pipes.hdfs.writer.buffer.bytes";
+  static const int DEFAULT_BUFFER_BYTES = 4 * 1024 * 1024;
+
+  static const char* SEPARATOR_KEY =
+    "mapreduce.output.textoutputformat.separator";
+  static const char* COMPRESS_KEY =
+    "mapreduce.output.fileoutputformat.compress";
+  static const char* COMPRESS_CODEC_KEY =
+    "mapreduce.output.fileoutputformat.compress.codec";
+  static const char* GZIP_CODEC = "org.apache.hadoop.io.compress.GzipCodec";
+  static const char* DEFAULT_CODEC =
+    "org.apache.hadoop.io.compress.DefaultCodec";
+
+  /**
+   * Writes a new file to the file system, one large write at a time.
+   * While one buffer is being filled, a background thread writes the
+   * previous one.
+   */
+  class HdfsOutput: public OutStream {
+  private:
+    string path;
+    hdfsFS fs;
+    hdfsFile file;
+    size_t bufferSize;
+
+    /** the buffer being filled, with filled bytes in it */
+    char* current;
+    size_t filled;
+
+    /** the buffer the background thread writes, and its request */
+    char* behind;
+    size_t behindFilled;
+    int behindErrno;
+    bool pending;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    static void* writeThread(void* arg) {
+      static_cast<HdfsOutput*>(arg)->writeLoop();
+      return NULL;
+    }
+
+    void writeLoop() {
+      pthread_mutex_lock(&lock);
+      while (!stopping) {
+        if (!pending) {
+          pthread_cond_wait(&cond, &lock);
+          continue;
+        }
+        pthread_mutex_unlock(&lock);
+        int err = writeAll(behind, behindFilled);
+        pthread_mutex_lock(&lock);
+        behindErrno = err;
+        pending = false;
+        pthread_cond_broadcast(&cond);
+      }
+      pthread_mutex_unlock(&lock);
+    }
+
+    /**
+     * Write len bytes, returning 0 or the error that stopped the write.
+     * Once a write has failed, nothing more is written.
+     */
+    int writeAll(const char* buf, size_t len) {
+      if (behindErrno != 0) {
+        return behindErrno;
+      }
+      while (len > 0) {
+        tSize n = hdfsWrite(fs, file, buf, len);
+        if (n <= 0) {
+          return errno ? errno : EIO;
+        }
+        buf += n;
+        len -= n;
+      }
+      return 0;
+    }
+
+    /**
+     * Wait for the background write to finish.
+     * @throws Error if it, or any write before it, failed
+     */
+    void waitWrite() {
+      pthread_mutex_lock(&lock);
+      while (pending) {
+        pthread_cond_wait(&cond, &lock);
+      }
+      int err = behindErrno;
+      pthread_mutex_unlock(&lock);
+      HADOOP_ASSERT(err == 0, "error writing " + path + ": " + strerror(err));
+    }
+
+    /**
+     * Hand the current buffer to the background thread.
+     */
+    void startWrite() {
+      waitWrite();
+      char* tmp = behind;
+      behind = current;
+      current = tmp;
+      pthread_mutex_lock(&lock);
+      behindFilled = filled;
+      pending = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      filled = 0;
+    }
+
+    void stopThread() {
+      pthread_mutex_lock(&lock);
+      while (pending) {
+        pthread_cond_wait(&cond, &lock);
+      }
+      stopping = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      pthread_join(thread, NULL);
+    }
+
+  public:
+    HdfsOutput(const string& uri, size_t _bufferSize) {
+      fs = connectToFileSystem(uri, path);
+      file = hdfsOpenFile(fs, path.c_str(), O_WRONLY, 0, 0, 0);
+      if (file == NULL) {
+        int err = errno;
+        hdfsDisconnect(fs);
+        HADOOP_ASSERT(false, "can't create " + uri + ": " + strerror(err));
+      }
+      bufferSize = _bufferSize;
+      current = static_cast<char*>(malloc(bufferSize));
+      behind = static_cast<char*>(malloc(bufferSize));
+      HADOOP_ASSERT(current != NULL && behind != NULL,
+                    "can't allocate write buffers");
+      filled = 0;
+      behindFilled = 0;
+      behindErrno = 0;
+      pending = stopping = false;
+      pthread_mutex_init(&lock, NULL);
+      pthread_cond_init(&cond, NULL);
+      int ret = pthread_create(&thread, NULL, writeThread, this);
+      HADOOP_ASSERT(ret == 0, "can't start the write-behind thread");
+    }
+
+    /**
+     * Write out everything and close the file.
+     * @throws Error if any of the data could not be written
+     */
+    void close() {
+      flush();
+      stopThread();
+      int ret = hdfsCloseFile(fs, file);
+      int err = errno;
+      file = NULL;
+      HADOOP_ASSERT(ret == 0, "error closing " + path + ": " + strerror(err));
+    }
+
+    virtual ~HdfsOutput() {
+      if (file != NULL) {
+        // not closed, so the output is abandoned
+        stopThread();
+        hdfsCloseFile(fs, file);
+      }
+      pthread_mutex_destroy(&lock);
+      pthread_cond_destroy(&cond);
+      free(current);
+      free(behind);
+      hdfsDisconnect(fs);
+    }
+
+    const string& getPath() const {
+      return path;
+    }
+
+    virtual void write(const void* buf, size_t len) {
+      const char* in = static_cast<const char*>(buf);
+      while (len > 0) {
+        size_t n = bufferSize - filled;
+        if (n > len) {
+          n = len;
+        }
+        memcpy(current + filled, in, n);
+        filled += n;
+        in += n;
+        len -= n;
+        if (filled == bufferSize) {
+          startWrite();
+        }
+      }
+    }
+
+    /**
+     * Write out the buffered data and wait for it to be written.
+     */
+    virtual void flush() {
+      if (filled > 0) {
+        startWrite();
+      }
+      waitWrite();
+    }
+  };
+
+  /**
+   * Compresses what is written to it with zlib, in the gzip or the zlib
+   * format, and writes the result to another stream.
+   */
+  class DeflateOutStream: public OutStream {
+  private:
+    static const size_t CHUNK_BYTES = 256 * 1024;
+    OutStream& out;
+    z_stream strm;
+    char chunk[CHUNK_BYTES];
+
+    void deflateInput(int flush) {
+      int ret;
+      do {
+        strm.next_out = reinterpret_cast<Bytef*>(chunk);
+        strm.avail_out = CHUNK_BYTES;
+        ret = deflate(&strm, flush);
+        HADOOP_ASSERT(ret != Z_STREAM_ERROR, "zlib stream error");
+        out.write(chunk, CHUNK_BYTES - strm.avail_out);
+      } while (strm.avail_out == 0);
+      HADOOP_ASSERT(flush != Z_FINISH || ret == Z_STREAM_END,
+                    "zlib did not finish the stream");
+    }
+
+  public:
+    /**
+     * @param gzip whether to write the gzip format, as GzipCodec does,
+     *   rather than the zlib format of DefaultCodec
+     */
+    DeflateOutStream(OutStream& _out, bool gzip): out(_out) {
+      memset(&strm, 0, sizeof(strm));
+      int ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                             gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+      HADOOP_ASSERT(ret == Z_OK, "can't initialize zlib");
+    }
+
+    virtual void write(const void* buf, size_t len) {
+      strm.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(buf));
+      strm.avail_in = len;
+      deflateInput(Z_NO_FLUSH);
+    }
+
+    /**
+     * End the compressed stream.  Nothing more may be written after it.
+     */
+    virtual void flush() {
+      strm.next_in = NULL;
+      strm.avail_in = 0;
+      deflateInput(Z_FINISH);
+    }
+
+    virtual ~DeflateOutStream() {
+      deflateEnd(&strm);
+    }
+  };
+
+  HdfsRecordWriter::HdfsRecordWriter(ReduceContext& context) {
+    const JobConf* conf = context.getJobConf();
+    const string* outDir = conf->tryGet("mapreduce.task.output.dir");
+    HADOOP_ASSERT(outDir != NULL,
+                  "HdfsRecordWriter needs mapreduce.task.output.dir");
+    separator = conf->hasKey(SEPARATOR_KEY) ? conf->get(SEPARATOR_KEY) : "\t";
+
+    const char* extension = "";
+    bool gzip = false;
+    bool compress = conf->hasKey(COMPRESS_KEY) && conf->getBoolean(COMPRESS_KEY);
+    if (compress) {
+      string codec = conf->hasKey(COMPRESS_CODEC_KEY) ?
+        conf->get(COMPRESS_CODEC_KEY) : DEFAULT_CODEC;
+      if (codec == GZIP_CODEC) {
+        gzip = true;
+        extension = ".gz";
+      } else {
+        HADOOP_ASSERT(codec == DEFAULT_CODEC, "HdfsRecordWriter can't write "
+                      "with " + codec + "; use the Java record writer");
+        extension = ".deflate";
+      }
+    }
+
+    int bufferSize = DEFAULT_BUFFER_BYTES;
+    if (conf->hasKey(BUFFER_BYTES_KEY)) {
+      bufferSize = conf->getInt(BUFFER_BYTES_KEY);
+      HADOOP_ASSERT(bufferSize > 0, string(BUFFER_BYTES_KEY) +
+                    " must be positive");
+    }
+
+    // The name FileOutputFormat.getUniqueName gives a reduce's output
+    char name[32];
+    snprintf(name, sizeof(name), "/part-%05d",
+             conf->getInt("mapreduce.task.partition"));
+    output = new HdfsOutput(*outDir + name + extension, bufferSize);
+    stream = output;
+    if (compress) {
+      try {
+        stream = new DeflateOutStream(*output, gzip);
+      } catch (...) {
+        delete output;
+        throw;
+      }
+    }
+  }
+
+  void HdfsRecordWriter::emit(const string& key, const string& value) {
+    HADOOP_ASSERT(output != NULL, "HdfsRecordWriter is closed");
+    stream->write(key.data(), key.size());
+    stream->write(separator.data(), separator.size());
+    stream->write(value.data(), value.size());
+    stream->write("\n", 1);
+  }
+
+  void HdfsRecordWriter::close() {
+    if (output == NULL) {
+      return;
+    }
+    if (stream != output) {
+      stream->flush();
+      delete stream;
+    }
+    stream = NULL;
+    HdfsOutput* closing = output;
+    output = NULL;
+    try {
+      closing->close();
+    } catch (...) {
+      delete closing;
+      throw;
+    }
+    delete closing;
+  }
+
+  HdfsRecordWriter::~HdfsRecordWriter() {
+    if (stream != output) {
+      delete stream;
+    }
+    delete output;
+  }
+}
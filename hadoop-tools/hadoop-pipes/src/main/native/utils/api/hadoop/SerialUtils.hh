@@ -145,6 +145,47 @@ namespace HadoopUtils {
     bool isOwned;
   };
 
+  /**
+   * A buffered stream that reads from a file descriptor, such as a socket.
+   * Unlike a FILE*, it takes no lock, so only one thread may use it at a
+   * time.  The descriptor is not closed.
+   */
+  class FdInStream: public InStream {
+  public:
+    FdInStream(int fd, size_t bufsize);
+    virtual void read(void *buf, size_t buflen);
+    virtual ~FdInStream();
+  private:
+    int fd;
+    char* buffer;
+    size_t capacity;
+    /** the unread bytes are buffer[pos, end) */
+    size_t pos;
+    size_t end;
+  };
+
+  /**
+   * A buffered stream that writes to a file descriptor, with the same
+   * threading rules as FdInStream.
+   */
+  class FdOutStream: public OutStream {
+  public:
+    FdOutStream(int fd, size_t bufsize);
+    virtual void write(const void *buf, size_t len);
+    virtual void flush();
+    virtual ~FdOutStream();
+  private:
+    /**
+     * Write the buffer and then len bytes of buf, in as few calls as the
+     * descriptor allows.
+     */
+    void writeThrough(const void* buf, size_t len);
+    int fd;
+    char* buffer;
+    size_t capacity;
+    size_t used;
+  };
+
   /**
    * A stream that reads from a string.
    */
@@ -157,6 +198,18 @@ namespace HadoopUtils {
     std::string::const_iterator itr;
   };
 
+  /**
+   * A stream that appends to a string.
+   */
+  class StringOutStream: public OutStream {
+  public:
+    StringOutStream(std::string& str);
+    virtual void write(const void *buf, size_t len);
+    virtual void flush();
+  private:
+    std::string& buffer;
+  };
+
   void serializeInt(int32_t t, OutStream& stream);
   int32_t deserializeInt(InStream& stream);
   void serializeLong(int64_t t, OutStream& stream);
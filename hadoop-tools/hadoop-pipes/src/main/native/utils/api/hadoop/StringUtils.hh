@@ -18,8 +18,10 @@
 #ifndef HADOOP_STRING_UTILS_HH
 #define HADOOP_STRING_UTILS_HH
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace HadoopUtils {
@@ -61,6 +63,17 @@ namespace HadoopUtils {
   std::vector<std::string> splitString(const std::string& str,
                                        const char* separator);
 
+  /**
+   * Split a run of bytes into words as above, without copying them.
+   * @param data the bytes to split
+   * @param length the number of bytes
+   * @param separator a list of characters that divide words
+   * @param words cleared, then filled with the start and length of each
+   *    word; reusing the vector from one call to the next saves allocating
+   */
+  void splitString(const char* data, size_t length, const char* separator,
+                   std::vector<std::pair<const char*, size_t> >& words);
+
   /**
    * Quote a string to avoid "\", non-printable characters, and the 
    * deliminators.
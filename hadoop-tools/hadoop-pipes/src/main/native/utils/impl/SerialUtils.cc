@@ -18,11 +18,11 @@
 #include "hadoop/SerialUtils.hh"
 #include "hadoop/StringUtils.hh"
 
+#include <algorithm>
 #include <errno.h>
-#include <rpc/types.h>
-#include <rpc/xdr.h>
 #include <string>
 #include <string.h>
+#include <sys/uio.h>
 
 using std::string;
 
@@ -157,22 +157,125 @@ namespace HadoopUtils {
     }
   }
 
+  FdInStream::FdInStream(int _fd, size_t bufsize) {
+    fd = _fd;
+    capacity = bufsize;
+    buffer = new char[capacity];
+    pos = 0;
+    end = 0;
+  }
+
+  void FdInStream::read(void *buf, size_t len) {
+    char* dest = (char*) buf;
+    size_t avail = end - pos;
+    if (len <= avail) {
+      memcpy(dest, buffer + pos, len);
+      pos += len;
+      return;
+    }
+    memcpy(dest, buffer + pos, avail);
+    dest += avail;
+    len -= avail;
+    pos = end = 0;
+    // Read the rest of the request straight into the caller's buffer, and
+    // whatever follows into ours, with one call where possible.
+    while (len > 0) {
+      struct iovec iov[2];
+      iov[0].iov_base = dest;
+      iov[0].iov_len = len;
+      iov[1].iov_base = buffer;
+      iov[1].iov_len = capacity;
+      ssize_t result = readv(fd, iov, 2);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      HADOOP_ASSERT(result != 0, "end of file");
+      HADOOP_ASSERT(result > 0,
+                    string("read error on file: ") + strerror(errno));
+      if ((size_t) result >= len) {
+        end = result - len;
+        return;
+      }
+      dest += result;
+      len -= result;
+    }
+  }
+
+  FdInStream::~FdInStream() {
+    delete[] buffer;
+  }
+
+  FdOutStream::FdOutStream(int _fd, size_t bufsize) {
+    fd = _fd;
+    capacity = bufsize;
+    buffer = new char[capacity];
+    used = 0;
+  }
+
+  void FdOutStream::write(const void *buf, size_t len) {
+    if (len <= capacity - used) {
+      memcpy(buffer + used, buf, len);
+      used += len;
+    } else {
+      writeThrough(buf, len);
+    }
+  }
+
+  void FdOutStream::writeThrough(const void* buf, size_t len) {
+    const char* head = buffer;
+    size_t headLen = used;
+    const char* tail = (const char*) buf;
+    size_t tailLen = len;
+    used = 0;
+    while (headLen + tailLen > 0) {
+      struct iovec iov[2];
+      iov[0].iov_base = (void*) head;
+      iov[0].iov_len = headLen;
+      iov[1].iov_base = (void*) tail;
+      iov[1].iov_len = tailLen;
+      ssize_t result = writev(fd, iov, 2);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      HADOOP_ASSERT(result > 0,
+                    string("write error to file: ") + strerror(errno));
+      size_t done = std::min((size_t) result, headLen);
+      head += done;
+      headLen -= done;
+      tail += result - done;
+      tailLen -= result - done;
+    }
+  }
+
+  void FdOutStream::flush() {
+    if (used > 0) {
+      writeThrough(NULL, 0);
+    }
+  }
+
+  FdOutStream::~FdOutStream() {
+    delete[] buffer;
+  }
+
   StringInStream::StringInStream(const std::string& str): buffer(str) {
     itr = buffer.begin();
   }
 
   void StringInStream::read(void *buf, size_t buflen) {
-    size_t bytes = 0;
-    char* output = (char*) buf;
-    std::string::const_iterator end = buffer.end();
-    while (bytes < buflen) {
-      output[bytes++] = *itr;
-      ++itr;
-      if (itr == end) {
-        break;
-      }
-    }
-    HADOOP_ASSERT(bytes == buflen, "unexpected end of string reached");
+    HADOOP_ASSERT((size_t)(buffer.end() - itr) >= buflen,
+                  "unexpected end of string reached");
+    std::copy(itr, itr + buflen, (char*) buf);
+    itr += buflen;
+  }
+
+  StringOutStream::StringOutStream(std::string& str): buffer(str) {
+  }
+
+  void StringOutStream::write(const void *buf, size_t len) {
+    buffer.append((const char*) buf, len);
+  }
+
+  void StringOutStream::flush() {
   }
 
   void serializeInt(int32_t t, OutStream& stream) {
@@ -181,9 +284,11 @@ namespace HadoopUtils {
 
   void serializeLong(int64_t t, OutStream& stream)
   {
+    // Encode into one buffer, so that the stream is written once
+    uint8_t buf[9];
     if (t >= -112 && t <= 127) {
-      int8_t b = t;
-      stream.write(&b, 1);
+      buf[0] = (int8_t) t;
+      stream.write(buf, 1);
       return;
     }
         
@@ -194,20 +299,19 @@ namespace HadoopUtils {
     }
         
     uint64_t tmp = t;
+    int bytes = 0;
     while (tmp != 0) {
       tmp = tmp >> 8;
-      len--;
+      bytes++;
     }
   
-    stream.write(&len, 1);      
-    len = (len < -120) ? -(len + 120) : -(len + 112);
-        
-    for (uint32_t idx = len; idx != 0; idx--) {
-      uint32_t shiftbits = (idx - 1) * 8;
-      uint64_t mask = 0xFFll << shiftbits;
-      uint8_t b = (t & mask) >> shiftbits;
-      stream.write(&b, 1);
+    buf[0] = len - bytes;
+    tmp = t;
+    for (int idx = bytes; idx != 0; idx--) {
+      buf[idx] = (uint8_t) tmp;
+      tmp = tmp >> 8;
     }
+    stream.write(buf, bytes + 1);
   }
 
   int32_t deserializeInt(InStream& stream) {
@@ -230,12 +334,11 @@ namespace HadoopUtils {
       negative = false;
       len = -112 - b;
     }
-    uint8_t barr[len];
+    uint8_t barr[8];
     stream.read(barr, len);
-    int64_t t = 0;
+    uint64_t t = 0;
     for (int idx = 0; idx < len; idx++) {
-      t = t << 8;
-      t |= (barr[idx] & 0xFF);
+      t = (t << 8) | barr[idx];
     }
     if (negative) {
       t ^= -1ll;
@@ -243,22 +346,34 @@ namespace HadoopUtils {
     return t;
   }
 
+  // Floats go on the wire as big-endian IEEE 754 singles, which is what
+  // DataOutput.writeFloat produces on the Java side
   void serializeFloat(float t, OutStream& stream)
   {
-    char buf[sizeof(float)];
-    XDR xdrs;
-    xdrmem_create(&xdrs, buf, sizeof(float), XDR_ENCODE);
-    xdr_float(&xdrs, &t);
+    uint32_t bits;
+    uint8_t buf[sizeof(float)];
+    memcpy(&bits, &t, sizeof(float));
+    buf[0] = bits >> 24;
+    buf[1] = bits >> 16;
+    buf[2] = bits >> 8;
+    buf[3] = bits;
     stream.write(buf, sizeof(float));
   }
 
-  void deserializeFloat(float& t, InStream& stream)
+  float deserializeFloat(InStream& stream)
   {
-    char buf[sizeof(float)];
+    uint8_t buf[sizeof(float)];
     stream.read(buf, sizeof(float));
-    XDR xdrs;
-    xdrmem_create(&xdrs, buf, sizeof(float), XDR_DECODE);
-    xdr_float(&xdrs, &t);
+    uint32_t bits = ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
+                    ((uint32_t) buf[2] << 8) | buf[3];
+    float t;
+    memcpy(&t, &bits, sizeof(float));
+    return t;
+  }
+
+  void deserializeFloat(float& t, InStream& stream)
+  {
+    t = deserializeFloat(stream);
   }
 
   void serializeString(const std::string& t, OutStream& stream)
@@ -273,19 +388,9 @@ namespace HadoopUtils {
   {
     int32_t len = deserializeInt(stream);
     if (len > 0) {
-      // resize the string to the right length
+      // resize the string to the right length and read straight into it
       t.resize(len);
-      // read into the string in 64k chunks
-      const int bufSize = 65536;
-      int offset = 0;
-      char buf[bufSize];
-      while (len > 0) {
-        int chunkLength = len > bufSize ? bufSize : len;
-        stream.read(buf, chunkLength);
-        t.replace(offset, chunkLength, buf, chunkLength);
-        offset += chunkLength;
-        len -= chunkLength;
-      }
+      stream.read(&t[0], len);
     } else {
       t.clear();
     }
@@ -77,70 +77,172 @@ namespace HadoopUtils {
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
   }
 
-  vector<string> splitString(const std::string& str,
-			     const char* separator) {
-    vector<string> result;
-    string::size_type prev_pos=0;
-    string::size_type pos=0;
-    while ((pos = str.find_first_of(separator, prev_pos)) != string::npos) {
-      if (prev_pos < pos) {
-	result.push_back(str.substr(prev_pos, pos-prev_pos));
+  /**
+   * A set of bytes, such as the separators of splitString, that can be
+   * tested for membership with one load.
+   */
+  class ByteSet {
+  private:
+    bool member[256];
+  public:
+    ByteSet() {
+      memset(member, 0, sizeof(member));
+    }
+
+    void add(unsigned char ch) {
+      member[ch] = true;
+    }
+
+    void addAll(const char* chars) {
+      for (; *chars != '\0'; ++chars) {
+        add(*chars);
+      }
+    }
+
+    bool contains(char ch) const {
+      return member[static_cast<unsigned char>(ch)];
+    }
+  };
+
+  /**
+   * Call add(start, length) for each word of data.  A single separator is
+   * found with memchr, which the C library vectorizes; a longer list is
+   * looked up in a ByteSet.
+   */
+  template <class Words>
+  static void forEachWord(const char* data, size_t length,
+                          const char* separator, Words& words) {
+    const char* end = data + length;
+    const char* word = data;
+    if (separator[0] != '\0' && separator[1] == '\0') {
+      while (word < end) {
+        const char* next = static_cast<const char*>(memchr(word, separator[0],
+                                                           end - word));
+        if (next == NULL) {
+          next = end;
+        }
+        if (next > word) {
+          words.add(word, next - word);
+        }
+        word = next + 1;
       }
-      prev_pos = pos + 1;
+      return;
     }
-    if (prev_pos < str.size()) {
-      result.push_back(str.substr(prev_pos));
+    ByteSet separators;
+    separators.addAll(separator);
+    for (const char* p = data; p < end; ++p) {
+      if (separators.contains(*p)) {
+        if (p > word) {
+          words.add(word, p - word);
+        }
+        word = p + 1;
+      }
     }
+    if (word < end) {
+      words.add(word, end - word);
+    }
+  }
+
+  struct StringWords {
+    vector<string>& result;
+    StringWords(vector<string>& _result): result(_result) {}
+    void add(const char* word, size_t length) {
+      result.push_back(string(word, length));
+    }
+  };
+
+  struct RangeWords {
+    vector<std::pair<const char*, size_t> >& result;
+    RangeWords(vector<std::pair<const char*, size_t> >& _result)
+      : result(_result) {}
+    void add(const char* word, size_t length) {
+      result.push_back(std::make_pair(word, length));
+    }
+  };
+
+  vector<string> splitString(const std::string& str,
+			     const char* separator) {
+    vector<string> result;
+    StringWords words(result);
+    forEachWord(str.data(), str.size(), separator, words);
     return result;
   }
 
+  void splitString(const char* data, size_t length, const char* separator,
+                   vector<std::pair<const char*, size_t> >& result) {
+    result.clear();
+    RangeWords words(result);
+    forEachWord(data, length, separator, words);
+  }
+
   string quoteString(const string& str,
                      const char* deliminators) {
-    
-    string result(str);
-    for(int i=result.length() -1; i >= 0; --i) {
-      char ch = result[i];
-      if (!isprint(ch) ||
-          ch == '\\' || 
-          strchr(deliminators, ch)) {
-        switch (ch) {
-        case '\\':
-          result.replace(i, 1, "\\\\");
-          break;
-        case '\t':
-          result.replace(i, 1, "\\t");
-          break;
-        case '\n':
-          result.replace(i, 1, "\\n");
-          break;
-        case ' ':
-          result.replace(i, 1, "\\s");
-          break;
-        default:
-          char buff[4];
-          sprintf(buff, "\\%02x", static_cast<unsigned char>(result[i]));
-          result.replace(i, 1, buff);
-        }
+    ByteSet quoted;
+    for (int ch = 0; ch < 256; ++ch) {
+      if (!isprint(ch) || ch == '\\') {
+        quoted.add(ch);
+      }
+    }
+    quoted.addAll(deliminators);
+    string::size_type first = 0;
+    while (first < str.size() && !quoted.contains(str[first])) {
+      ++first;
+    }
+    if (first == str.size()) {
+      return str;
+    }
+    string result;
+    result.reserve(str.size() + str.size() / 4 + 4);
+    result.append(str, 0, first);
+    for (string::size_type i = first; i < str.size(); ++i) {
+      char ch = str[i];
+      if (!quoted.contains(ch)) {
+        result += ch;
+        continue;
+      }
+      switch (ch) {
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\t':
+        result += "\\t";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      case ' ':
+        result += "\\s";
+        break;
+      default:
+        char buff[4];
+        sprintf(buff, "\\%02x", static_cast<unsigned char>(ch));
+        result += buff;
       }
     }
     return result;
   }
 
   string unquoteString(const string& str) {
-    string result(str);
-    string::size_type current = result.find('\\');
+    string::size_type current = str.find('\\');
+    if (current == string::npos) {
+      return str;
+    }
+    string result;
+    result.reserve(str.size());
+    string::size_type done = 0;
     while (current != string::npos) {
-      if (current + 1 < result.size()) {
+      result.append(str, done, current - done);
+      if (current + 1 < str.size()) {
         char new_ch;
         int num_chars;
-        if (isxdigit(result[current+1])) {
+        if (isxdigit(str[current+1])) {
           num_chars = 2;
-          HADOOP_ASSERT(current + num_chars < result.size(),
+          HADOOP_ASSERT(current + num_chars < str.size(),
                      "escape pattern \\<hex><hex> is missing second digit in '"
                      + str + "'");
           char sub_str[3];
-          sub_str[0] = result[current+1];
-          sub_str[1] = result[current+2];
+          sub_str[0] = str[current+1];
+          sub_str[1] = str[current+2];
           sub_str[2] = '\0';
           char* end_ptr = NULL;
           long int int_val = strtol(sub_str, &end_ptr, 16);
@@ -149,7 +251,7 @@ namespace HadoopUtils {
           new_ch = static_cast<char>(int_val);
         } else {
           num_chars = 1;
-          switch(result[current+1]) {
+          switch(str[current+1]) {
           case '\\':
             new_ch = '\\';
             break;
@@ -164,16 +266,18 @@ namespace HadoopUtils {
             break;
           default:
             string msg("unknow n escape character '");
-            msg += result[current+1];
+            msg += str[current+1];
             HADOOP_ASSERT(false, msg + "' found in '" + str + "'");
           }
         }
-        result.replace(current, 1 + num_chars, 1, new_ch);
-        current = result.find('\\', current+1);
+        result += new_ch;
+        done = current + 1 + num_chars;
+        current = str.find('\\', done);
       } else {
         HADOOP_ASSERT(false, "trailing \\ in '" + str + "'");
       }
     }
+    result.append(str, done, string::npos);
     return result;
   }
 
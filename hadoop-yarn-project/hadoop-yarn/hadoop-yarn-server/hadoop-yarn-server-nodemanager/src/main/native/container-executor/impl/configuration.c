@@ -40,26 +40,26 @@ struct confentry {
 
 struct configuration {
   int size;
-  struct confentry **confdetails;
+  struct confentry *confdetails;
+  // the contents of the file, which the keys and values point into
+  char *arena;
+  // open addressed hash of the keys, holding an entry's index plus one
+  int *index;
+  int index_size;
 };
 
-struct configuration config={.size=0, .confdetails=NULL};
+struct configuration config={.size=0, .confdetails=NULL, .arena=NULL,
+                             .index=NULL, .index_size=0};
 
 //clean up method for freeing configuration
 void free_configurations() {
-  int i = 0;
-  for (i = 0; i < config.size; i++) {
-    if (config.confdetails[i]->key != NULL) {
-      free((void *)config.confdetails[i]->key);
-    }
-    if (config.confdetails[i]->value != NULL) {
-      free((void *)config.confdetails[i]->value);
-    }
-    free(config.confdetails[i]);
-  }
-  if (config.size > 0) {
-    free(config.confdetails);
-  }
+  free(config.confdetails);
+  free(config.arena);
+  free(config.index);
+  config.confdetails = NULL;
+  config.arena = NULL;
+  config.index = NULL;
+  config.index_size = 0;
   config.size = 0;
 }
 
@@ -127,14 +127,48 @@ int check_configuration_permissions(const char* file_name) {
   return 0;
 }
 
+static unsigned int hash_key(const char *key) {
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (; *key != '\0'; ++key) {
+    hash = (hash ^ (unsigned char) *key) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Index the keys. When a key is given more than once the first one wins,
+ * as it always has.
+ */
+static int index_configurations() {
+  config.index_size = 16;
+  while (config.index_size < 2 * config.size) {
+    config.index_size *= 2;
+  }
+  config.index = (int *) calloc(config.index_size, sizeof(int));
+  if (config.index == NULL) {
+    return -1;
+  }
+  int i;
+  for (i = 0; i < config.size; ++i) {
+    unsigned int slot = hash_key(config.confdetails[i].key) &
+      (config.index_size - 1);
+    while (config.index[slot] != 0 &&
+           strcmp(config.confdetails[config.index[slot] - 1].key,
+                  config.confdetails[i].key) != 0) {
+      slot = (slot + 1) & (config.index_size - 1);
+    }
+    if (config.index[slot] == 0) {
+      config.index[slot] = i + 1;
+    }
+  }
+  return 0;
+}
+
 //function used to load the configurations present in the secure config
 void read_config(const char* file_name) {
   FILE *conf_file;
-  char *line;
-  char *equaltok;
-  char *temp_equaltok;
-  size_t linesize = 1000;
-  int size_read = 0;
+  struct stat conf_stat;
 
   if (file_name == NULL) {
     fprintf(ERRORFILE, "Null configuration filename passed in\n");
@@ -145,133 +179,116 @@ void read_config(const char* file_name) {
     fprintf(LOGFILE, "read_config :Conf file name is : %s \n", file_name);
   #endif
 
-  //allocate space for ten configuration items.
-  config.confdetails = (struct confentry **) malloc(sizeof(struct confentry *)
-      * MAX_SIZE);
   config.size = 0;
   conf_file = fopen(file_name, "r");
   if (conf_file == NULL) {
     fprintf(ERRORFILE, "Invalid conf file provided : %s \n", file_name);
     exit(INVALID_CONFIG_FILE);
   }
-  while(!feof(conf_file)) {
-    line = (char *) malloc(linesize);
-    if(line == NULL) {
-      fprintf(ERRORFILE, "malloc failed while reading configuration file.\n");
-      exit(OUT_OF_MEMORY);
-    }
-    size_read = getline(&line,&linesize,conf_file);
- 
-    //feof returns true only after we read past EOF.
-    //so a file with no new line, at last can reach this place
-    //if size_read returns negative check for eof condition
-    if (size_read == -1) {
-      free(line);
-      if(!feof(conf_file)){
-        exit(INVALID_CONFIG_FILE);
-      } else {
-        break;
-      }
+  // read the whole file into one buffer and parse it in place, so that the
+  // keys and values need no allocations of their own
+  if (fstat(fileno(conf_file), &conf_stat) != 0) {
+    exit(INVALID_CONFIG_FILE);
+  }
+  size_t len = conf_stat.st_size;
+  config.arena = (char *) malloc(len + 1);
+  if (config.arena == NULL) {
+    fprintf(ERRORFILE, "malloc failed while reading configuration file.\n");
+    exit(OUT_OF_MEMORY);
+  }
+  len = fread(config.arena, 1, len, conf_file);
+  if (ferror(conf_file)) {
+    exit(INVALID_CONFIG_FILE);
+  }
+  fclose(conf_file);
+  config.arena[len] = '\0';
+
+  char *end = config.arena + len;
+  char *line;
+  int lines = 1;
+  for (line = config.arena; line < end; ++line) {
+    if (*line == '\n') {
+      lines++;
     }
-    int eol = strlen(line) - 1;
-    if(line[eol] == '\n') {
-        //trim the ending new line
-        line[eol] = '\0';
+  }
+  config.confdetails = (struct confentry *) malloc(sizeof(struct confentry)
+      * lines);
+  if (config.confdetails == NULL) {
+    fprintf(LOGFILE, "Failed allocating memory for configuration items\n");
+    free_configurations();
+    return;
+  }
+
+  char *next;
+  for (line = config.arena; line < end; line = next) {
+    char *eol = memchr(line, '\n', end - line);
+    if (eol == NULL) {
+      eol = end;
     }
+    *eol = '\0';
+    next = eol + 1;
     //comment line
     if(line[0] == '#') {
-      free(line);
       continue;
     }
-    //tokenize first to get key and list of values.
-    //if no equals is found ignore this line, can be an empty line also
-    equaltok = strtok_r(line, "=", &temp_equaltok);
-    if(equaltok == NULL) {
-      free(line);
+    //the key and the value are the first two runs of characters other
+    //than '='. if there is no key ignore this line, can be an empty line
+    char *key = line + strspn(line, "=");
+    if (*key == '\0') {
       continue;
     }
-    config.confdetails[config.size] = (struct confentry *) malloc(
-            sizeof(struct confentry));
-    if(config.confdetails[config.size] == NULL) {
-      fprintf(LOGFILE,
-          "Failed allocating memory for single configuration item\n");
-      goto cleanup;
+    char *value = key + strcspn(key, "=");
+    if (*value != '\0') {
+      *value++ = '\0';
+      value += strspn(value, "=");
     }
-
-    #ifdef DEBUG
-      fprintf(LOGFILE, "read_config : Adding conf key : %s \n", equaltok);
-    #endif
-
-    memset(config.confdetails[config.size], 0, sizeof(struct confentry));
-    config.confdetails[config.size]->key = (char *) malloc(
-            sizeof(char) * (strlen(equaltok)+1));
-    strcpy((char *)config.confdetails[config.size]->key, equaltok);
-    equaltok = strtok_r(NULL, "=", &temp_equaltok);
-    if (equaltok == NULL) {
+    if (*value == '\0') {
       fprintf(LOGFILE, "configuration tokenization failed \n");
-      goto cleanup;
+      free_configurations();
+      return;
     }
+    value[strcspn(value, "=")] = '\0';
     //means value is commented so don't store the key
-    if(equaltok[0] == '#') {
-      free(line);
-      free((void *)config.confdetails[config.size]->key);
-      free(config.confdetails[config.size]);
+    if(value[0] == '#') {
       continue;
     }
 
     #ifdef DEBUG
-      fprintf(LOGFILE, "read_config : Adding conf value : %s \n", equaltok);
+      fprintf(LOGFILE, "read_config : Adding conf key : %s \n", key);
+      fprintf(LOGFILE, "read_config : Adding conf value : %s \n", value);
     #endif
 
-    config.confdetails[config.size]->value = (char *) malloc(
-            sizeof(char) * (strlen(equaltok)+1));
-    strcpy((char *)config.confdetails[config.size]->value, equaltok);
-    if((config.size + 1) % MAX_SIZE  == 0) {
-      config.confdetails = (struct confentry **) realloc(config.confdetails,
-          sizeof(struct confentry **) * (MAX_SIZE + config.size));
-      if (config.confdetails == NULL) {
-        fprintf(LOGFILE,
-            "Failed re-allocating memory for configuration items\n");
-        goto cleanup;
-      }
-    }
-    if(config.confdetails[config.size] )
+    config.confdetails[config.size].key = key;
+    config.confdetails[config.size].value = value;
     config.size++;
-    free(line);
   }
- 
-  //close the file
-  fclose(conf_file);
 
   if (config.size == 0) {
     fprintf(ERRORFILE, "Invalid configuration provided in %s\n", file_name);
     exit(INVALID_CONFIG_FILE);
   }
-
-  //clean up allocated file name
-  return;
-  //free spaces alloced.
-  cleanup:
-  if (line != NULL) {
-    free(line);
+  if (index_configurations() != 0) {
+    fprintf(LOGFILE, "Failed allocating memory for configuration index\n");
+    free_configurations();
   }
-  fclose(conf_file);
-  free_configurations();
-  return;
 }
 
 /*
  * function used to get a configuration value.
- * The function for the first time populates the configuration details into
- * array, next time onwards used the populated array.
+ * The keys are looked up in the index built by read_config.
  *
  */
 char * get_value(const char* key) {
-  int count;
-  for (count = 0; count < config.size; count++) {
-    if (strcmp(config.confdetails[count]->key, key) == 0) {
-      return strdup(config.confdetails[count]->value);
+  if (config.index_size == 0) {
+    return NULL;
+  }
+  unsigned int slot = hash_key(key) & (config.index_size - 1);
+  while (config.index[slot] != 0) {
+    const struct confentry *entry = &config.confdetails[config.index[slot] - 1];
+    if (strcmp(entry->key, key) == 0) {
+      return strdup(entry->value);
     }
+    slot = (slot + 1) & (config.index_size - 1);
   }
   return NULL;
 }
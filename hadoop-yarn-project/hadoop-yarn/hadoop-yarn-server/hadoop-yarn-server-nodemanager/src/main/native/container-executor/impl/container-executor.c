@@ -24,13 +24,21 @@
 #include <fts.h>
 #include <errno.h>
 #include <grp.h>
+#include <limits.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
 
 static const int DEFAULT_MIN_USERID = 1000;
 
@@ -237,6 +245,63 @@ int change_user(uid_t user, gid_t group) {
   return 0;
 }
 
+#define MAX_TIMED_PHASES 16
+
+// the phases of this invocation, when log.launch.timing is set
+static int timing_enabled = 0;
+static struct timespec timing_start;
+static struct timespec timing_last;
+static long long timing_start_ms = 0;
+static const char *phase_names[MAX_TIMED_PHASES];
+static long long phase_micros[MAX_TIMED_PHASES];
+static int num_phases = 0;
+
+static long long micros_between(const struct timespec *from,
+                                const struct timespec *to) {
+  return (to->tv_sec - from->tv_sec) * 1000000LL +
+    (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+void start_phase_timing() {
+  char *value = get_value(LAUNCH_TIMING_KEY);
+  timing_enabled = value != NULL && strcmp(value, "true") == 0;
+  free(value);
+  num_phases = 0;
+  if (timing_enabled) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    timing_start_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &timing_start);
+    timing_last = timing_start;
+  }
+}
+
+void end_phase(const char *name) {
+  if (!timing_enabled || num_phases == MAX_TIMED_PHASES) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  phase_names[num_phases] = name;
+  phase_micros[num_phases++] = micros_between(&timing_last, &now);
+  timing_last = now;
+}
+
+void log_phase_timing(const char *command, const char *id) {
+  if (!timing_enabled) {
+    return;
+  }
+  fprintf(LOGFILE, "timing command=%s id=%s start_ms=%lld", command, id,
+          timing_start_ms);
+  int i;
+  for (i = 0; i < num_phases; ++i) {
+    fprintf(LOGFILE, " %s=%lld", phase_names[i], phase_micros[i]);
+  }
+  fprintf(LOGFILE, " total=%lld\n", micros_between(&timing_start,
+                                                   &timing_last));
+  fflush(LOGFILE);
+}
+
 /**
  * Utility function to concatenate argB to argA using the concat_pattern.
  */
@@ -326,6 +391,10 @@ char *get_tmp_directory(const char *work_dir) {
  * with the desired permissions.
  */
 int mkdirs(const char* path, mode_t perm) {
+  // usually only the last level is missing, or none at all
+  if (path[0] == '/' && (mkdir(path, perm) == 0 || errno == EEXIST)) {
+    return 0;
+  }
   char *buffer = strdup(path);
   char *token;
   int cwd = open("/", O_RDONLY);
@@ -359,6 +428,135 @@ int mkdirs(const char* path, mode_t perm) {
   return 0;
 }
 
+/**
+ * The names a per-directory step needs to build its paths.
+ */
+struct dir_names {
+  const char *user;
+  const char *app_id;
+  const char *container_id;
+  char* const* log_dirs;
+};
+
+typedef int (*dir_step)(const char *dir, const void *arg);
+
+static int count_dirs(char* const* dirs) {
+  int count = 0;
+  char* const* ptr;
+  for(ptr = dirs; *ptr != NULL; ++ptr) {
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Run step on each of dirs. The dirs are usually on different disks, so
+ * each one gets its own child process and a slow disk only holds up its
+ * own step. Processes rather than threads, since the steps switch the
+ * effective user. A dir that can't be handed to a child is done in
+ * process.
+ * Returns the result for each dir, or NULL if it can't allocate them.
+ */
+static int *run_on_each_dir(char* const* dirs, dir_step step,
+                            const void *arg) {
+  int count = count_dirs(dirs);
+  int *results = calloc(count + 1, sizeof(int));
+  pid_t *children = calloc(count + 1, sizeof(pid_t));
+  if (results == NULL || children == NULL) {
+    fprintf(LOGFILE, "Malloc failed in run_on_each_dir\n");
+    free(results);
+    free(children);
+    return NULL;
+  }
+  int i;
+  for (i = 0; i < count; ++i) {
+    if (count > 1) {
+      fflush(LOGFILE);
+      fflush(ERRORFILE);
+      children[i] = fork();
+      if (children[i] == 0) {
+        // -1 comes back as 255
+        exit(step(dirs[i], arg) & 0xff);
+      } else if (children[i] != -1) {
+        continue;
+      }
+      fprintf(LOGFILE, "Failed to fork for %s - %s\n", dirs[i],
+              strerror(errno));
+    }
+    results[i] = step(dirs[i], arg);
+  }
+  for (i = 0; i < count; ++i) {
+    if (children[i] <= 0) {
+      continue;
+    }
+    int status = 0;
+    while (waitpid(children[i], &status, 0) == -1) {
+      if (errno != EINTR) {
+        status = -1;
+        break;
+      }
+    }
+    if (status == -1 || !WIFEXITED(status)) {
+      results[i] = -1;
+    } else {
+      results[i] = WEXITSTATUS(status) == 0xff ? -1 : WEXITSTATUS(status);
+    }
+  }
+  free(children);
+  return results;
+}
+
+/**
+ * Index of the first dir whose step succeeded, or -1 if none did.
+ */
+static int first_success(const int *results, int count) {
+  int i;
+  for (i = 0; i < count; ++i) {
+    if (results[i] == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int create_container_dir(const char *local_dir, const void *arg) {
+  const struct dir_names *names = arg;
+  char *container_dir = get_container_work_directory(local_dir, names->user,
+                                                     names->app_id,
+                                                     names->container_id);
+  if (container_dir == NULL) {
+    return -1;
+  }
+  // create dirs as 0750
+  int result = mkdirs(container_dir, S_IRWXU | S_IRGRP | S_IXGRP);
+  free(container_dir);
+  return result;
+}
+
+static int create_container_log_dir(const char *log_dir, const void *arg) {
+  const struct dir_names *names = arg;
+  char *container_log_dir = concatenate("%s/%s/%s", "container log dir", 3,
+                                        log_dir, names->app_id,
+                                        names->container_id);
+  if (container_log_dir == NULL) {
+    return -1;
+  }
+  int result = mkdirs(container_log_dir, S_IRWXU | S_IRGRP | S_IXGRP);
+  free(container_log_dir);
+  return result;
+}
+
+static int create_any_container_dir(const char *dir, const void *arg) {
+  const struct dir_names *names = arg;
+  char* const* ptr;
+  for(ptr = names->log_dirs; *ptr != NULL; ++ptr) {
+    if (*ptr == dir) {
+      return create_container_log_dir(dir, arg);
+    }
+  }
+  return create_container_dir(dir, arg);
+}
+
 /**
  * Function to prepare the container directories.
  * It creates the container work and log directories.
@@ -373,50 +571,30 @@ static int create_container_directories(const char* user, const char *app_id,
     return -1;
   }
 
-  int result = -1;
-  char* const* local_dir_ptr;
-  for(local_dir_ptr = local_dir; *local_dir_ptr != NULL; ++local_dir_ptr) {
-    char *container_dir = get_container_work_directory(*local_dir_ptr, user, app_id, 
-                                                container_id);
-    if (container_dir == NULL) {
-      return -1;
-    }
-    if (mkdirs(container_dir, perms) == 0) {
-      result = 0;
-    }
-    // continue on to create other work directories
-    free(container_dir);
-
+  // the work and log directories are made in one round, so that the launch
+  // waits for the slowest disk once
+  int num_local = count_dirs(local_dir);
+  int num_log = count_dirs(log_dir);
+  char **dirs = calloc(num_local + num_log + 1, sizeof(char*));
+  if (dirs == NULL) {
+    fprintf(LOGFILE, "Malloc of container dirs failed\n");
+    return -1;
   }
-  if (result != 0) {
-    return result;
+  memcpy(dirs, local_dir, num_local * sizeof(char*));
+  memcpy(dirs + num_local, log_dir, num_log * sizeof(char*));
+  struct dir_names names = {user, app_id, container_id, log_dir};
+  int *results = run_on_each_dir(dirs, create_any_container_dir, &names);
+  free(dirs);
+  if (results == NULL) {
+    return -1;
   }
-
-  result = -1;
-  // also make the directory for the container logs
-  char *combined_name = malloc(strlen(app_id) + strlen(container_id) + 2);
-  if (combined_name == NULL) {
-    fprintf(LOGFILE, "Malloc of combined name failed\n");
-    result = -1;
-  } else {
-    sprintf(combined_name, "%s/%s", app_id, container_id);
-
-    char* const* log_dir_ptr;
-    for(log_dir_ptr = log_dir; *log_dir_ptr != NULL; ++log_dir_ptr) {
-      char *container_log_dir = get_app_log_directory(*log_dir_ptr, combined_name);
-      if (container_log_dir == NULL) {
-        free(combined_name);
-        return -1;
-      } else if (mkdirs(container_log_dir, perms) != 0) {
-    	free(container_log_dir);
-      } else {
-    	result = 0;
-    	free(container_log_dir);
-      }
-    }
-    free(combined_name);
+  // it's enough to have one of each
+  int result = -1;
+  if (first_success(results, num_local) != -1 &&
+      first_success(results + num_local, num_log) != -1) {
+    result = 0;
   }
-
+  free(results);
   if (result != 0) {
     return result;
   }
@@ -576,6 +754,14 @@ int create_directory_for_user(const char* path) {
   uid_t root = 0;
   int ret = 0;
 
+  // nothing to do if an earlier container already set it up
+  struct stat sb;
+  if (lstat(path, &sb) == 0 && S_ISDIR(sb.st_mode) &&
+      (sb.st_mode & 07777) == permissions && sb.st_uid == user &&
+      sb.st_gid == nm_gid) {
+    return 0;
+  }
+
   if(getuid() == root) {
     ret = change_effective_user(root, nm_gid);
   }
@@ -627,6 +813,49 @@ static int open_file_as_nm(const char* filename) {
   return result;
 }
 
+/**
+ * Copy the rest of input to out_fd without bringing it into user space,
+ * with copy_file_range where the kernel has it and sendfile otherwise.
+ * Both move the file offsets, so after a partial copy the caller can
+ * carry on from where they stopped.
+ * Returns 1 if the file was copied, 0 if the kernel can't copy between
+ * these files and -1 on error.
+ */
+static int copy_in_kernel(int input, const char* in_filename,
+                          int out_fd, const char* out_filename) {
+#ifdef __linux__
+  const size_t chunk = 1 << 30;
+  ssize_t len = 0;
+#ifdef SYS_copy_file_range
+  do {
+    len = syscall(SYS_copy_file_range, input, NULL, out_fd, NULL, chunk, 0);
+  } while (len > 0);
+  if (len == 0) {
+    return 1;
+  }
+  // too old a kernel, or files on different file systems
+  if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+      errno != EOPNOTSUPP) {
+    fprintf(LOGFILE, "Failed to copy %s to %s - %s\n", in_filename,
+            out_filename, strerror(errno));
+    return -1;
+  }
+#endif
+  do {
+    len = sendfile(out_fd, input, NULL, chunk);
+  } while (len > 0);
+  if (len == 0) {
+    return 1;
+  }
+  if (errno != EINVAL && errno != ENOSYS) {
+    fprintf(LOGFILE, "Failed to copy %s to %s - %s\n", in_filename,
+            out_filename, strerror(errno));
+    return -1;
+  }
+#endif
+  return 0;
+}
+
 /**
  * Copy a file from a fd to a given filename.
  * The new file must not exist and it is created with permissions perm.
@@ -643,6 +872,21 @@ static int copy_file(int input, const char* in_filename,
             strerror(errno));
     return -1;
   }
+  int copied = copy_in_kernel(input, in_filename, out_fd, out_filename);
+  if (copied != 0) {
+    if (copied == -1) {
+      close(out_fd);
+      return -1;
+    }
+    if (close(out_fd) != 0) {
+      fprintf(LOGFILE, "Failed to close file %s - %s\n", out_filename, 
+              strerror(errno));
+      return -1;
+    }
+    close(input);
+    return 0;
+  }
+  // the kernel can't copy between these files, go through the buffer
   ssize_t len = read(input, buffer, buffer_size);
   while (len > 0) {
     ssize_t pos = 0;
@@ -673,29 +917,61 @@ static int copy_file(int input, const char* in_filename,
   return 0;
 }
 
+static int create_user_dir(const char *local_dir, const void *arg) {
+  const struct dir_names *names = arg;
+  char *user_dir = get_user_directory(local_dir, names->user);
+  if (user_dir == NULL) {
+    fprintf(LOGFILE, "Couldn't get userdir directory for %s.\n", names->user);
+    return -1;
+  }
+  int result = create_directory_for_user(user_dir);
+  free(user_dir);
+  return result;
+}
+
 /**
  * Function to initialize the user directories of a user.
  */
 int initialize_user(const char *user, char* const* local_dirs) {
-
-  char *user_dir;
-  char* const* local_dir_ptr;
+  struct dir_names names = {user, NULL, NULL, NULL};
+  int *results = run_on_each_dir(local_dirs, create_user_dir, &names);
+  if (results == NULL) {
+    return INITIALIZE_USER_FAILED;
+  }
   int failed = 0;
-  for(local_dir_ptr = local_dirs; *local_dir_ptr != 0; ++local_dir_ptr) {
-    user_dir = get_user_directory(*local_dir_ptr, user);
-    if (user_dir == NULL) {
-      fprintf(LOGFILE, "Couldn't get userdir directory for %s.\n", user);
-      failed = 1;
-      break;
-    }
-    if (create_directory_for_user(user_dir) != 0) {
+  int i;
+  for (i = 0; local_dirs[i] != NULL; ++i) {
+    if (results[i] != 0) {
       failed = 1;
     }
-    free(user_dir);
   }
+  free(results);
   return failed ? INITIALIZE_USER_FAILED : 0;
 }
 
+static int create_app_log_dir(const char *log_root, const void *arg) {
+  const struct dir_names *names = arg;
+  char *app_log_dir = get_app_log_directory(log_root, names->app_id);
+  if (app_log_dir == NULL) {
+    return -1;
+  }
+  int result = create_directory_for_user(app_log_dir);
+  free(app_log_dir);
+  return result;
+}
+
+static int create_app_dir(const char *local_dir, const void *arg) {
+  const struct dir_names *names = arg;
+  char *app_dir = get_app_directory(local_dir, names->user, names->app_id);
+  if (app_dir == NULL) {
+    return -1;
+  }
+  // 750
+  int result = mkdirs(app_dir, S_IRWXU | S_IRGRP | S_IXGRP);
+  free(app_dir);
+  return result;
+}
+
 /**
  * Function to prepare the application directories for the container.
  */
@@ -713,29 +989,27 @@ int initialize_app(const char *user, const char *app_id,
   if (result != 0) {
     return result;
   }
+  end_phase("user_dirs");
 
   ////////////// create the log directories for the app on all disks
-  char* const* log_root;
-  char *any_one_app_log_dir = NULL;
-  for(log_root=log_roots; *log_root != NULL; ++log_root) {
-    char *app_log_dir = get_app_log_directory(*log_root, app_id);
-    if (app_log_dir == NULL) {
-      // try the next one
-    } else if (create_directory_for_user(app_log_dir) != 0) {
-      free(app_log_dir);
+  struct dir_names names = {user, app_id, NULL, NULL};
+  int *results = run_on_each_dir(log_roots, create_app_log_dir, &names);
+  if (results == NULL) {
+    return -1;
+  }
+  int i;
+  for (i = 0; log_roots[i] != NULL; ++i) {
+    if (results[i] != 0) {
+      free(results);
       return -1;
-    } else if (any_one_app_log_dir == NULL) {
-      any_one_app_log_dir = app_log_dir;
-    } else {
-      free(app_log_dir);
     }
   }
-
-  if (any_one_app_log_dir == NULL) {
+  free(results);
+  if (i == 0) {
     fprintf(LOGFILE, "Did not create any app-log directories\n");
     return -1;
   }
-  free(any_one_app_log_dir);
+  end_phase("log_dirs");
   ////////////// End of creating the log directories for the app on all disks
 
   // open up the credentials file
@@ -743,33 +1017,29 @@ int initialize_app(const char *user, const char *app_id,
   if (cred_file == -1) {
     return -1;
   }
+  end_phase("open_files");
 
   // give up root privs
   if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
     return -1;
   }
+  end_phase("change_user");
 
-  // 750
-  mode_t permissions = S_IRWXU | S_IRGRP | S_IXGRP;
-  char* const* nm_root;
+  results = run_on_each_dir(local_dirs, create_app_dir, &names);
+  if (results == NULL) {
+    return -1;
+  }
+  int primary = first_success(results, count_dirs(local_dirs));
+  free(results);
   char *primary_app_dir = NULL;
-  for(nm_root=local_dirs; *nm_root != NULL; ++nm_root) {
-    char *app_dir = get_app_directory(*nm_root, user, app_id);
-    if (app_dir == NULL) {
-      // try the next one
-    } else if (mkdirs(app_dir, permissions) != 0) {
-      free(app_dir);
-    } else if (primary_app_dir == NULL) {
-      primary_app_dir = app_dir;
-    } else {
-      free(app_dir);
-    }
+  if (primary != -1) {
+    primary_app_dir = get_app_directory(local_dirs[primary], user, app_id);
   }
-
   if (primary_app_dir == NULL) {
     fprintf(LOGFILE, "Did not create any app directories\n");
     return -1;
   }
+  end_phase("app_dirs");
 
   char *nmPrivate_credentials_file_copy = strdup(nmPrivate_credentials_file);
   // TODO: FIXME. The user's copy of creds should go to a path selected by
@@ -787,6 +1057,8 @@ int initialize_app(const char *user, const char *app_id,
   }
 
   free(nmPrivate_credentials_file_copy);
+  end_phase("copy_credentials");
+  log_phase_timing("initialize_container", app_id);
 
   fclose(stdin);
   fflush(LOGFILE);
@@ -806,11 +1078,125 @@ int initialize_app(const char *user, const char *app_id,
   return -1;
 }
 
+/**
+ * Write value to the file of the given cgroup.
+ */
+static int write_cgroup_value(const char *cgroup, const char *file,
+                              const char *value) {
+  char *path = concatenate("%s/%s", "cgroup file", 2, cgroup, file);
+  if (path == NULL) {
+    return -1;
+  }
+  int ret = 0;
+  int fd = open(path, O_WRONLY);
+  if (fd == -1 || write(fd, value, strlen(value)) != (ssize_t) strlen(value)) {
+    fprintf(LOGFILE, "Can't write %s to %s - %s\n", value, path,
+            strerror(errno));
+    ret = -1;
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  free(path);
+  return ret;
+}
+
+/**
+ * Whether the given cgroup has the given control file.
+ */
+static int cgroup_has_file(const char *cgroup, const char *file) {
+  char *path = concatenate("%s/%s", "cgroup file", 2, cgroup, file);
+  int result = path != NULL && access(path, F_OK) == 0;
+  free(path);
+  return result;
+}
+
+/**
+ * The path of a container's cgroup under the given controller, or NULL if
+ * cgroups aren't configured or the container id can't name a cgroup.
+ */
+static char *get_container_cgroup(const char *controller,
+                                  const char *container_id) {
+  if (strchr(container_id, '/') != NULL || container_id[0] == '.' ||
+      container_id[0] == '\0') {
+    fprintf(LOGFILE, "Invalid container id %s for a cgroup\n", container_id);
+    return NULL;
+  }
+  char *mount = get_value(CGROUPS_MOUNT_KEY);
+  if (mount == NULL) {
+    fprintf(LOGFILE, "%s isn't configured\n", CGROUPS_MOUNT_KEY);
+    return NULL;
+  }
+  char *hierarchy = get_value(CGROUPS_HIERARCHY_KEY);
+  char *cgroup = concatenate("%s/%s/%s/%s", "cgroup", 4, mount, controller,
+                             hierarchy == NULL ? DEFAULT_CGROUPS_HIERARCHY :
+                             hierarchy, container_id);
+  free(mount);
+  free(hierarchy);
+  return cgroup;
+}
+
+/**
+ * Move the calling process into a cgroup of its own under each of the cpu,
+ * cpuacct and blkio controllers, if cgroups.mount is configured. The
+ * cgroups are <cgroups.mount>/<controller>/<cgroups.hierarchy>/<container>,
+ * and the launch script and everything it starts inherit them.
+ * notify_on_release is set so that the hierarchy's release agent can
+ * remove them once the container is gone.
+ * A share or weight of 0 leaves the controller's default.
+ */
+static int add_to_container_cgroups(const char *container_id, int cpu_shares,
+                                    int blkio_weight) {
+  char *mount = get_value(CGROUPS_MOUNT_KEY);
+  if (mount == NULL) {
+    return 0;
+  }
+  free(mount);
+  const char *controllers[] = {"cpu", "cpuacct", "blkio", NULL};
+  char pid_buf[21];
+  snprintf(pid_buf, sizeof(pid_buf), "%d", getpid());
+  char value_buf[21];
+  uid_t user = geteuid();
+  gid_t group = getegid();
+  int ret = change_effective_user(0, 0);
+  int i;
+  for (i = 0; ret == 0 && controllers[i] != NULL; ++i) {
+    char *cgroup = get_container_cgroup(controllers[i], container_id);
+    if (cgroup == NULL) {
+      ret = -1;
+      break;
+    }
+    if (mkdir(cgroup, 0755) != 0 && errno != EEXIST) {
+      fprintf(LOGFILE, "Can't create cgroup %s - %s\n", cgroup,
+              strerror(errno));
+      ret = -1;
+    } else if (write_cgroup_value(cgroup, "notify_on_release", "1") != 0) {
+      ret = -1;
+    } else if (cpu_shares > 0 && strcmp(controllers[i], "cpu") == 0) {
+      snprintf(value_buf, sizeof(value_buf), "%d", cpu_shares);
+      ret = write_cgroup_value(cgroup, "cpu.shares", value_buf);
+    } else if (blkio_weight > 0 && strcmp(controllers[i], "blkio") == 0) {
+      snprintf(value_buf, sizeof(value_buf), "%d", blkio_weight);
+      // kernels that schedule with BFQ rather than CFQ only have its weight
+      ret = write_cgroup_value(cgroup, cgroup_has_file(cgroup, "blkio.weight") ?
+                               "blkio.weight" : "blkio.bfq.weight", value_buf);
+    }
+    if (ret == 0) {
+      ret = write_cgroup_value(cgroup, "tasks", pid_buf);
+    }
+    free(cgroup);
+  }
+  if (change_effective_user(user, group) != 0) {
+    ret = -1;
+  }
+  return ret == 0 ? 0 : CGROUP_SETUP_FAILED;
+}
+
 int launch_container_as_user(const char *user, const char *app_id, 
                    const char *container_id, const char *work_dir,
                    const char *script_name, const char *cred_file,
                    const char* pid_file, char* const* local_dirs,
-                   char* const* log_dirs) {
+                   char* const* log_dirs, int cpu_shares, int blkio_weight) {
   int exit_code = -1;
   char *script_file_dest = NULL;
   char *cred_file_dest = NULL;
@@ -836,6 +1222,7 @@ int launch_container_as_user(const char *user, const char *app_id,
   if (cred_file_source == -1) {
     goto cleanup;
   }
+  end_phase("open_files");
 
   // setsid 
   pid_t pid = setsid();
@@ -850,29 +1237,43 @@ int launch_container_as_user(const char *user, const char *app_id,
     exit_code = WRITE_PIDFILE_FAILED;
     goto cleanup;
   }  
+  end_phase("setsid_pidfile");
+
+  // isolate the container before it can start anything
+  exit_code = add_to_container_cgroups(container_id, cpu_shares, blkio_weight);
+  if (exit_code != 0) {
+    goto cleanup;
+  }
+  exit_code = -1;
+  end_phase("cgroups");
 
   // give up root privs
   if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
     exit_code = SETUID_OPER_FAILED;
     goto cleanup;
   }
+  end_phase("change_user");
 
   if (create_container_directories(user, app_id, container_id, local_dirs,
                                    log_dirs, work_dir) != 0) {
     fprintf(LOGFILE, "Could not create container dirs");
     goto cleanup;
   }
+  end_phase("container_dirs");
 
   // 700
   if (copy_file(container_file_source, script_name, script_file_dest,S_IRWXU) != 0) {
     goto cleanup;
   }
+  end_phase("copy_script");
 
   // 600
   if (copy_file(cred_file_source, cred_file, cred_file_dest,
         S_IRUSR | S_IWUSR) != 0) {
     goto cleanup;
   }
+  end_phase("copy_credentials");
+  log_phase_timing("launch_container", container_id);
 
   fcloseall();
   umask(0027);
@@ -895,15 +1296,10 @@ int launch_container_as_user(const char *user, const char *app_id,
   return exit_code;
 }
 
-int signal_container_as_user(const char *user, int pid, int sig) {
-  if(pid <= 0) {
-    return INVALID_CONTAINER_PID;
-  }
-
-  if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
-    return SETUID_OPER_FAILED;
-  }
-
+/**
+ * Signal the process group led by pid, or just pid if it doesn't lead one.
+ */
+static int signal_container(int pid, int sig) {
   //Don't continue if the process-group is not alive anymore.
   int has_group = 1;
   if (kill(-pid,0) < 0) {
@@ -938,6 +1334,93 @@ int signal_container_as_user(const char *user, int pid, int sig) {
   return 0;
 }
 
+int signal_container_as_user(const char *user, int pid, int sig) {
+  if(pid <= 0) {
+    return INVALID_CONTAINER_PID;
+  }
+
+  if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
+    return SETUID_OPER_FAILED;
+  }
+  return signal_container(pid, sig);
+}
+
+/**
+ * Signal every process in a container's cgroup, which also reaches those
+ * that left the container's process group.
+ */
+static int signal_container_cgroup(const char *container_id, int sig) {
+  char *cgroup = get_container_cgroup("cpu", container_id);
+  if (cgroup == NULL) {
+    return INVALID_CONTAINER_PID;
+  }
+  char *tasks = concatenate("%s/%s", "cgroup tasks", 2, cgroup, "tasks");
+  free(cgroup);
+  if (tasks == NULL) {
+    return OUT_OF_MEMORY;
+  }
+  FILE *file = fopen(tasks, "r");
+  if (file == NULL) {
+    int ret = errno == ENOENT ? INVALID_CONTAINER_PID : -1;
+    if (ret != INVALID_CONTAINER_PID) {
+      fprintf(LOGFILE, "Can't read %s - %s\n", tasks, strerror(errno));
+    }
+    free(tasks);
+    return ret;
+  }
+  int ret = INVALID_CONTAINER_PID;
+  int pid;
+  while (fscanf(file, "%d", &pid) == 1) {
+    if (kill(pid, sig) == 0) {
+      if (ret == INVALID_CONTAINER_PID) {
+        ret = 0;
+      }
+    } else if (errno != ESRCH) {
+      fprintf(LOGFILE, "Error signalling process %d in %s with %d - %s\n",
+              pid, tasks, sig, strerror(errno));
+      ret = UNABLE_TO_SIGNAL_CONTAINER;
+    }
+  }
+  fclose(file);
+  if (ret == 0) {
+    fprintf(LOGFILE, "Killing cgroup %s with %d\n", container_id, sig);
+  }
+  free(tasks);
+  return ret;
+}
+
+int signal_containers_as_user(const char *user, char* const* targets,
+                              int sig) {
+  if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
+    return SETUID_OPER_FAILED;
+  }
+  int ret = 0;
+  char* const* target;
+  for(target = targets; *target != NULL; ++target) {
+    int result;
+    size_t prefix_len = strlen(CGROUP_TARGET_PREFIX);
+    if (strncmp(*target, CGROUP_TARGET_PREFIX, prefix_len) == 0) {
+      result = signal_container_cgroup(*target + prefix_len, sig);
+    } else {
+      char *end_ptr = NULL;
+      long pid = strtol(*target, &end_ptr, 10);
+      if (*target == end_ptr || *end_ptr != '\0' || pid <= 0 ||
+          pid > INT_MAX) {
+        fprintf(LOGFILE, "Illegal argument for container pid %s\n", *target);
+        result = INVALID_CONTAINER_PID;
+      } else {
+        result = signal_container(pid, sig);
+      }
+    }
+    fprintf(LOGFILE, "signal %s %d\n", *target, result);
+    if (result != 0) {
+      ret = result;
+    }
+  }
+  fflush(LOGFILE);
+  return ret;
+}
+
 /**
  * Delete a final directory as the node manager user.
  */
@@ -958,108 +1441,228 @@ static int rmdir_as_nm(const char* path) {
   return ret;
 }
 
+// how many levels of directories delete_dir_at holds open before it hands
+// the rest of the tree to fts
+#define DELETE_MAX_OPEN_DIRS 64
+
 /**
- * Recursively delete the given path.
+ * Recursively delete the given path with fts; used for trees nested too
+ * deeply to hold a descriptor open for every level.
  * full_path : the path to delete
- * needs_tt_user: the top level directory must be deleted by the tt user.
+ * keep_top: leave the top level directory in place.
  */
-static int delete_path(const char *full_path, 
-                       int needs_tt_user) {
+static int delete_path_fts(const char *full_path, int keep_top) {
   int exit_code = 0;
+  char *(paths[]) = {strdup(full_path), 0};
+  if (paths[0] == NULL) {
+    fprintf(LOGFILE, "Malloc failed in delete_path\n");
+    return -1;
+  }
+  FTS* tree = fts_open(paths, FTS_PHYSICAL | FTS_XDEV, NULL);
+  FTSENT* entry = NULL;
+  int ret = 0;
 
-  if (full_path == NULL) {
-    fprintf(LOGFILE, "Path is null\n");
-    exit_code = UNABLE_TO_BUILD_PATH; // may be malloc failed
-  } else {
-    char *(paths[]) = {strdup(full_path), 0};
-    if (paths[0] == NULL) {
-      fprintf(LOGFILE, "Malloc failed in delete_path\n");
-      return -1;
-    }
-    // check to make sure the directory exists
-    if (access(full_path, F_OK) != 0) {
-      if (errno == ENOENT) {
-        free(paths[0]);
-        return 0;
-      }
-    }
-    FTS* tree = fts_open(paths, FTS_PHYSICAL | FTS_XDEV, NULL);
-    FTSENT* entry = NULL;
-    int ret = 0;
-
-    if (tree == NULL) {
-      fprintf(LOGFILE,
-              "Cannot open file traversal structure for the path %s:%s.\n", 
-              full_path, strerror(errno));
-      free(paths[0]);
-      return -1;
-    }
-    while (((entry = fts_read(tree)) != NULL) && exit_code == 0) {
-      switch (entry->fts_info) {
-
-      case FTS_DP:        // A directory being visited in post-order
-        if (!needs_tt_user ||
-            strcmp(entry->fts_path, full_path) != 0) {
-          if (rmdir(entry->fts_accpath) != 0) {
-            fprintf(LOGFILE, "Couldn't delete directory %s - %s\n", 
-                    entry->fts_path, strerror(errno));
-            exit_code = -1;
-          }
-        }
-        break;
+  if (tree == NULL) {
+    fprintf(LOGFILE,
+            "Cannot open file traversal structure for the path %s:%s.\n", 
+            full_path, strerror(errno));
+    free(paths[0]);
+    return -1;
+  }
+  while (((entry = fts_read(tree)) != NULL) && exit_code == 0) {
+    switch (entry->fts_info) {
 
-      case FTS_F:         // A regular file
-      case FTS_SL:        // A symbolic link
-      case FTS_SLNONE:    // A broken symbolic link
-      case FTS_DEFAULT:   // Unknown type of file
-        if (unlink(entry->fts_accpath) != 0) {
-          fprintf(LOGFILE, "Couldn't delete file %s - %s\n", entry->fts_path,
-                  strerror(errno));
+    case FTS_DP:        // A directory being visited in post-order
+      if (!keep_top || entry->fts_level != FTS_ROOTLEVEL) {
+        if (rmdir(entry->fts_accpath) != 0) {
+          fprintf(LOGFILE, "Couldn't delete directory %s - %s\n", 
+                  entry->fts_path, strerror(errno));
           exit_code = -1;
         }
-        break;
+      }
+      break;
 
-      case FTS_DNR:       // Unreadable directory
-        fprintf(LOGFILE, "Unreadable directory %s. Skipping..\n", 
-                entry->fts_path);
-        break;
+    case FTS_F:         // A regular file
+    case FTS_SL:        // A symbolic link
+    case FTS_SLNONE:    // A broken symbolic link
+    case FTS_DEFAULT:   // Unknown type of file
+      if (unlink(entry->fts_accpath) != 0) {
+        fprintf(LOGFILE, "Couldn't delete file %s - %s\n", entry->fts_path,
+                strerror(errno));
+        exit_code = -1;
+      }
+      break;
+
+    case FTS_DNR:       // Unreadable directory
+      fprintf(LOGFILE, "Unreadable directory %s. Skipping..\n", 
+              entry->fts_path);
+      break;
 
-      case FTS_D:         // A directory in pre-order
-        // if the directory isn't readable, chmod it
-        if ((entry->fts_statp->st_mode & 0200) == 0) {
-          fprintf(LOGFILE, "Unreadable directory %s, chmoding.\n", 
-                  entry->fts_path);
-          if (chmod(entry->fts_accpath, 0700) != 0) {
-            fprintf(LOGFILE, "Error chmoding %s - %s, continuing\n", 
-                    entry->fts_path, strerror(errno));
-          }
+    case FTS_D:         // A directory in pre-order
+      // if the directory isn't readable, chmod it
+      if ((entry->fts_statp->st_mode & 0200) == 0) {
+        fprintf(LOGFILE, "Unreadable directory %s, chmoding.\n", 
+                entry->fts_path);
+        if (chmod(entry->fts_accpath, 0700) != 0) {
+          fprintf(LOGFILE, "Error chmoding %s - %s, continuing\n", 
+                  entry->fts_path, strerror(errno));
         }
-        break;
+      }
+      break;
 
-      case FTS_NS:        // A file with no stat(2) information
-        // usually a root directory that doesn't exist
-        fprintf(LOGFILE, "Directory not found %s\n", entry->fts_path);
-        break;
+    case FTS_NS:        // A file with no stat(2) information
+      // usually a root directory that doesn't exist
+      fprintf(LOGFILE, "Directory not found %s\n", entry->fts_path);
+      break;
 
-      case FTS_DC:        // A directory that causes a cycle
-      case FTS_DOT:       // A dot directory
-      case FTS_NSOK:      // No stat information requested
-        break;
+    case FTS_DC:        // A directory that causes a cycle
+    case FTS_DOT:       // A dot directory
+    case FTS_NSOK:      // No stat information requested
+      break;
+
+    case FTS_ERR:       // Error return
+      fprintf(LOGFILE, "Error traversing directory %s - %s\n", 
+              entry->fts_path, strerror(entry->fts_errno));
+      exit_code = -1;
+      break;
+    default:
+      exit_code = -1;
+      break;
+    }
+  }
+  ret = fts_close(tree);
+  if (exit_code == 0 && ret != 0) {
+    fprintf(LOGFILE, "Error in fts_close while deleting %s\n", full_path);
+    exit_code = -1;
+  }
+  free(paths[0]);
+  return exit_code;
+}
 
-      case FTS_ERR:       // Error return
-        fprintf(LOGFILE, "Error traversing directory %s - %s\n", 
-                entry->fts_path, strerror(entry->fts_errno));
+/**
+ * Delete the directory name in parent_fd, or just its contents if keep is
+ * set. Entries are removed with unlinkat relative to the directory, and
+ * only subdirectories are stat'ed, so a file costs one readdir entry and
+ * one unlinkat. Mount points and symlinks are not followed.
+ * path: the full path of the directory, for messages
+ * st: the lstat of the directory
+ * depth: how many ancestors are held open
+ */
+static int delete_dir_at(int parent_fd, const char *name, const char *path,
+                         const struct stat *st, int keep, int depth) {
+  int exit_code = 0;
+  if (depth >= DELETE_MAX_OPEN_DIRS) {
+    return delete_path_fts(path, keep);
+  }
+  // if the directory isn't readable, chmod it
+  if ((st->st_mode & 0200) == 0) {
+    fprintf(LOGFILE, "Unreadable directory %s, chmoding.\n", path);
+    if (fchmodat(parent_fd, name, 0700, 0) != 0) {
+      fprintf(LOGFILE, "Error chmoding %s - %s, continuing\n", path,
+              strerror(errno));
+    }
+  }
+  int fd = openat(parent_fd, name,
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(LOGFILE, "Unreadable directory %s. Skipping..\n", path);
+    return 0;
+  }
+  DIR *dir = fdopendir(fd);
+  if (dir == NULL) {
+    fprintf(LOGFILE, "Error traversing directory %s - %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  while (exit_code == 0) {
+    errno = 0;
+    struct dirent *ent = readdir(dir);
+    if (ent == NULL) {
+      if (errno != 0) {
+        fprintf(LOGFILE, "Error traversing directory %s - %s\n", path,
+                strerror(errno));
         exit_code = -1;
-        break;
-        break;
-      default:
+      }
+      break;
+    }
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    struct stat child_st;
+    int is_dir = ent->d_type == DT_DIR;
+    if (ent->d_type == DT_DIR || ent->d_type == DT_UNKNOWN) {
+      if (fstatat(fd, ent->d_name, &child_st, AT_SYMLINK_NOFOLLOW) != 0) {
+        if (errno == ENOENT) {
+          continue;
+        }
+        fprintf(LOGFILE, "Couldn't stat %s/%s - %s\n", path, ent->d_name,
+                strerror(errno));
         exit_code = -1;
         break;
       }
+      is_dir = S_ISDIR(child_st.st_mode);
     }
-    ret = fts_close(tree);
-    if (exit_code == 0 && ret != 0) {
-      fprintf(LOGFILE, "Error in fts_close while deleting %s\n", full_path);
+    if (!is_dir) {
+      if (unlinkat(fd, ent->d_name, 0) != 0) {
+        fprintf(LOGFILE, "Couldn't delete file %s/%s - %s\n", path,
+                ent->d_name, strerror(errno));
+        exit_code = -1;
+      }
+    } else if (child_st.st_dev != st->st_dev) {
+      // don't cross into another file system
+      fprintf(LOGFILE, "Couldn't delete directory %s/%s - %s\n", path,
+              ent->d_name, strerror(EXDEV));
+      exit_code = -1;
+    } else {
+      char *child_path = concatenate("%s/%s", "delete path", 2, path,
+                                     ent->d_name);
+      if (child_path == NULL) {
+        exit_code = -1;
+      } else {
+        exit_code = delete_dir_at(fd, ent->d_name, child_path, &child_st, 0,
+                                  depth + 1);
+        free(child_path);
+      }
+    }
+  }
+  closedir(dir);
+  if (exit_code == 0 && !keep) {
+    if (unlinkat(parent_fd, name, AT_REMOVEDIR) != 0) {
+      fprintf(LOGFILE, "Couldn't delete directory %s - %s\n", path,
+              strerror(errno));
+      exit_code = -1;
+    }
+  }
+  return exit_code;
+}
+
+/**
+ * Recursively delete the given path.
+ * full_path : the path to delete
+ * needs_tt_user: the top level directory must be deleted by the tt user.
+ */
+static int delete_path(const char *full_path, 
+                       int needs_tt_user) {
+  int exit_code = 0;
+
+  if (full_path == NULL) {
+    fprintf(LOGFILE, "Path is null\n");
+    exit_code = UNABLE_TO_BUILD_PATH; // may be malloc failed
+  } else {
+    struct stat st;
+    if (lstat(full_path, &st) != 0) {
+      // nothing to do if the directory is already gone
+      if (errno == ENOENT) {
+        return 0;
+      }
+      fprintf(LOGFILE, "Directory not found %s\n", full_path);
+    } else if (S_ISDIR(st.st_mode)) {
+      exit_code = delete_dir_at(AT_FDCWD, full_path, full_path, &st,
+                                needs_tt_user, 0);
+    } else if (unlink(full_path) != 0) {
+      fprintf(LOGFILE, "Couldn't delete file %s - %s\n", full_path,
+              strerror(errno));
       exit_code = -1;
     }
     if (needs_tt_user) {
@@ -1068,43 +1671,168 @@ static int delete_path(const char *full_path,
       // that is owned by the node manager.
       exit_code = rmdir_as_nm(full_path);
     }
-    free(paths[0]);
   }
   return exit_code;
 }
 
+static int delete_subdir(const char *base_dir, const void *arg) {
+  const char *subdir = arg;
+  char* full_path = concatenate("%s/%s", "user subdir", 2,
+                                base_dir, subdir);
+  if (full_path == NULL) {
+    return -1;
+  }
+  int ret = delete_path(full_path, strlen(subdir) == 0);
+  free(full_path);
+  return ret;
+}
+
+/**
+ * Delete subdir from each of the base dirs, each disk at the same time.
+ */
+static int delete_in_dirs(const char *subdir, char* const* baseDirs) {
+  int ret = 0;
+  int *results = run_on_each_dir(baseDirs, delete_subdir, subdir);
+  if (results == NULL) {
+    return -1;
+  }
+  int i;
+  for (i = 0; baseDirs[i] != NULL; ++i) {
+    // delete as much as we can, but remember the error
+    if (results[i] != 0) {
+      ret = results[i];
+    }
+  }
+  free(results);
+  return ret;
+}
+
+/**
+ * Is delete_as_user configured to move directories into the trash rather
+ * than delete them?
+ */
+static int use_trash() {
+  char *value = get_value(DELETE_TRASH_KEY);
+  int result = value != NULL && strcmp(value, "true") == 0;
+  free(value);
+  return result;
+}
+
+/**
+ * Move base_dir/subdir into the trash of base_dir under a name of its own.
+ * A rename only works within one file system, which is why every base dir
+ * has its own trash. Returns 0 if the directory was moved.
+ */
+static int move_to_trash(const char *base_dir, const char *subdir, int seq) {
+  int ret = -1;
+  char name[64];
+  snprintf(name, sizeof(name), "%ld.%d.%d", (long) time(NULL), getpid(), seq);
+  char *full_path = concatenate("%s/%s", "user subdir", 2, base_dir, subdir);
+  char *trash_path = concatenate("%s/%s/%s", "trash path", 3, base_dir,
+                                 TRASH_DIR, name);
+  if (full_path != NULL && trash_path != NULL) {
+    char *slash = strrchr(trash_path, '/');
+    *slash = '\0';
+    if (mkdir(trash_path, 0700) != 0 && errno != EEXIST) {
+      fprintf(LOGFILE, "Can't create trash %s - %s\n", trash_path,
+              strerror(errno));
+    } else {
+      *slash = '/';
+      ret = rename(full_path, trash_path);
+    }
+  }
+  free(full_path);
+  free(trash_path);
+  return ret;
+}
+
+/**
+ * Empty the trash of each of the base dirs in a detached, low priority
+ * process, so that the caller doesn't wait for the delete. Each run
+ * empties everything in the trash, including what earlier runs left.
+ */
+static void start_trash_reaper(char* const* baseDirs) {
+  fflush(LOGFILE);
+  fflush(ERRORFILE);
+  pid_t child = fork();
+  if (child == -1) {
+    fprintf(LOGFILE, "Failed to fork the trash reaper - %s\n",
+            strerror(errno));
+    return;
+  }
+  if (child != 0) {
+    int status = 0;
+    while (waitpid(child, &status, 0) == -1 && errno == EINTR) {
+    }
+    return;
+  }
+  // the grandchild does the work, so that nobody has to wait for it
+  if (setsid() == -1 || fork() != 0) {
+    _exit(0);
+  }
+  // let go of the output, which the caller reads to the end
+  int null_fd = open("/dev/null", O_RDWR);
+  if (null_fd != -1) {
+    dup2(null_fd, STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    if (null_fd > STDERR_FILENO) {
+      close(null_fd);
+    }
+  }
+  setpriority(PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+  // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE
+  syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+  exit(delete_in_dirs(TRASH_DIR, baseDirs) == 0 ? 0 : 1);
+}
+
 /**
  * Delete the given directory as the user from each of the directories
  * user: the user doing the delete
  * subdir: the subdir to delete (if baseDirs is empty, this is treated as
            an absolute path)
  * baseDirs: (optional) the baseDirs where the subdir is located
+ *
+ * If delete.use.trash is set, the subdir is renamed into the trash of each
+ * base dir instead and a background process deletes it later. Whatever
+ * can't be moved is deleted right away.
  */
 int delete_as_user(const char *user,
                    const char *subdir,
                    char* const* baseDirs) {
-  int ret = 0;
-
-  char** ptr;
-
   // TODO: No switching user? !!!!
   if (baseDirs == NULL || *baseDirs == NULL) {
     return delete_path(subdir, strlen(subdir) == 0);
   }
-  // do the delete
-  for(ptr = (char**)baseDirs; *ptr != NULL; ++ptr) {
-    char* full_path = concatenate("%s/%s", "user subdir", 2,
-                              *ptr, subdir);
-    if (full_path == NULL) {
-      return -1;
-    }
-    int this_ret = delete_path(full_path, strlen(subdir) == 0);
-    free(full_path);
-    // delete as much as we can, but remember the error
-    if (this_ret != 0) {
-      ret = this_ret;
+  if (strlen(subdir) == 0 || !use_trash()) {
+    return delete_in_dirs(subdir, baseDirs);
+  }
+  char** ptr;
+  char **left = calloc(count_dirs(baseDirs) + 1, sizeof(char*));
+  if (left == NULL) {
+    fprintf(LOGFILE, "Malloc failed in delete_as_user\n");
+    return -1;
+  }
+  int moved = 0;
+  int num_left = 0;
+  int i = 0;
+  for(ptr = (char**)baseDirs; *ptr != NULL; ++ptr, ++i) {
+    if (move_to_trash(*ptr, subdir, i) == 0) {
+      moved = 1;
+    } else {
+      left[num_left++] = *ptr;
     }
   }
+  int ret = 0;
+  if (num_left > 0) {
+    ret = delete_in_dirs(subdir, left);
+  }
+  free(left);
+  if (moved) {
+    start_trash_reaper(baseDirs);
+  }
   return ret;
 }
 
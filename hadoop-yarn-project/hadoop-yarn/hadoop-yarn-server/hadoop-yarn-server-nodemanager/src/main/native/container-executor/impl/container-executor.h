@@ -25,6 +25,7 @@ enum command {
   LAUNCH_CONTAINER = 1,
   SIGNAL_CONTAINER = 2,
   DELETE_AS_USER = 3,
+  SIGNAL_CONTAINERS = 4,
 };
 
 enum errorcodes {
@@ -53,7 +54,11 @@ enum errorcodes {
   // PREPARE_JOB_LOGS_FAILED (NOT USED) 23
   INVALID_CONFIG_FILE =  24,
   SETSID_OPER_FAILED = 25,
-  WRITE_PIDFILE_FAILED = 26
+  WRITE_PIDFILE_FAILED = 26,
+  DAEMON_SOCKET_FAILED = 27,
+  DAEMON_REQUEST_FAILED = 28,
+  DAEMON_PEER_NOT_ALLOWED = 29,
+  CGROUP_SETUP_FAILED = 30
 };
 
 #define NM_GROUP_KEY "yarn.nodemanager.linux-container-executor.group"
@@ -64,6 +69,13 @@ enum errorcodes {
 #define CREDENTIALS_FILENAME "container_tokens"
 #define MIN_USERID_KEY "min.user.id"
 #define BANNED_USERS_KEY "banned.users"
+#define DELETE_TRASH_KEY "delete.use.trash"
+#define TRASH_DIR ".trash"
+#define CGROUPS_MOUNT_KEY "cgroups.mount"
+#define CGROUPS_HIERARCHY_KEY "cgroups.hierarchy"
+#define DEFAULT_CGROUPS_HIERARCHY "hadoop-yarn"
+#define CGROUP_TARGET_PREFIX "cgroup:"
+#define LAUNCH_TIMING_KEY "log.launch.timing"
 #define TMP_DIR "tmp"
 
 extern struct passwd *user_detail;
@@ -111,13 +123,16 @@ int initialize_app(const char *user, const char *app_id,
  * @param pid_file file where pid of process should be written to
  * @param local_dirs nodemanager-local-directories to be used
  * @param log_dirs nodemanager-log-directories to be used
+ * @param cpu_shares cpu.shares of the container's cgroup, 0 for the default
+ * @param blkio_weight blkio.weight of the container's cgroup, 0 for the
+ * default
  * @return -1 or errorcode enum value on error (should never return on success).
  */
 int launch_container_as_user(const char * user, const char *app_id,
                      const char *container_id, const char *work_dir,
                      const char *script_name, const char *cred_file,
                      const char *pid_file, char* const* local_dirs,
-                     char* const* log_dirs);
+                     char* const* log_dirs, int cpu_shares, int blkio_weight);
 
 /**
  * Function used to signal a container launched by the user.
@@ -130,6 +145,19 @@ int launch_container_as_user(const char * user, const char *app_id,
  */
 int signal_container_as_user(const char *user, int pid, int sig);
 
+/**
+ * Send a signal to many containers at once, as signal_container_as_user
+ * would to each of them.
+ * @param user the user to send the signals as.
+ * @param targets the containers' pids, or cgroup:<container id> to signal
+ * every process in the container's cgroup.
+ * @param sig the signal to send.
+ * @return 0 if every container was signalled, otherwise the last error. The
+ * result for each target is written to the log as "signal <target> <code>".
+ */
+int signal_containers_as_user(const char *user, char* const* targets,
+                              int sig);
+
 // delete a directory (or file) recursively as the user. The directory
 // could optionally be relative to the baseDir set of directories (if the same
 // directory appears on multiple disk volumes, the disk volumes should be passed
@@ -196,3 +224,20 @@ int initialize_user(const char *user, char* const* local_dirs);
 int create_directory_for_user(const char* path);
 
 int change_user(uid_t user, gid_t group);
+
+/**
+ * Start timing the phases of this invocation, if log.launch.timing is set.
+ */
+void start_phase_timing();
+
+/**
+ * Mark the end of the named phase, which began where the last one ended.
+ */
+void end_phase(const char *name);
+
+/**
+ * Write the phase timings in microseconds as one line to the log:
+ * timing command=<command> id=<id> start_ms=<epoch ms> <phase>=<us>...
+ * total=<us>
+ */
+void log_phase_timing(const char *command, const char *id);
@@ -0,0 +1,437 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#include "container-executor.h"
+#include "daemon.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <grp.h>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// how many groups of the peer to look through at most
+#define MAX_PEER_GROUPS 1024
+
+/**
+ * Read exactly len bytes, returning 0 on success.
+ */
+static int read_fully(int fd, void *buf, size_t len) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/**
+ * Write all of the buffer, returning 0 on success. A peer that has gone
+ * away gives an error rather than a SIGPIPE.
+ */
+static int write_fully(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int write_frame(int fd, int type, const void *data, uint32_t len) {
+  char header[5];
+  uint32_t net_len = htonl(len);
+  header[0] = (char) type;
+  memcpy(header + 1, &net_len, 4);
+  if (write_fully(fd, header, sizeof(header)) != 0) {
+    return -1;
+  }
+  return write_fully(fd, data, len);
+}
+
+static int write_exit_frame(int fd, int exit_code) {
+  uint32_t net_code = htonl((uint32_t) exit_code);
+  return write_frame(fd, DAEMON_FRAME_EXIT, &net_code, 4);
+}
+
+char **read_daemon_request(int fd, const char *program, int *argc) {
+  uint32_t count = 0;
+  if (read_fully(fd, &count, 4) != 0) {
+    return NULL;
+  }
+  count = ntohl(count);
+  if (count == 0 || count > DAEMON_MAX_ARGS) {
+    fprintf(LOGFILE, "Invalid daemon request with %u arguments\n", count);
+    return NULL;
+  }
+  // the strings go in one block after the program name, so that
+  // free_values frees them with the array
+  size_t used = strlen(program) + 1;
+  size_t capacity = used + 256;
+  char *strings = malloc(capacity);
+  uint32_t *offsets = malloc(sizeof(uint32_t) * count);
+  if (strings == NULL || offsets == NULL) {
+    goto fail;
+  }
+  strcpy(strings, program);
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    uint32_t len = 0;
+    if (read_fully(fd, &len, 4) != 0) {
+      goto fail;
+    }
+    len = ntohl(len);
+    if (len > DAEMON_MAX_REQUEST_BYTES - used) {
+      fprintf(LOGFILE, "Daemon request is longer than %d bytes\n",
+              DAEMON_MAX_REQUEST_BYTES);
+      goto fail;
+    }
+    if (used + len + 1 > capacity) {
+      capacity = (used + len + 1) * 2;
+      char *bigger = realloc(strings, capacity);
+      if (bigger == NULL) {
+        goto fail;
+      }
+      strings = bigger;
+    }
+    if (read_fully(fd, strings + used, len) != 0) {
+      goto fail;
+    }
+    if (memchr(strings + used, '\0', len) != NULL) {
+      fprintf(LOGFILE, "Daemon request has a NUL in an argument\n");
+      goto fail;
+    }
+    strings[used + len] = '\0';
+    offsets[i] = used;
+    used += len + 1;
+  }
+  char **values = malloc(sizeof(char *) * (count + 2));
+  if (values == NULL) {
+    goto fail;
+  }
+  values[0] = strings;
+  for (i = 0; i < count; i++) {
+    values[i + 1] = strings + offsets[i];
+  }
+  values[count + 1] = NULL;
+  free(offsets);
+  *argc = count + 1;
+  return values;
+
+ fail:
+  free(strings);
+  free(offsets);
+  return NULL;
+}
+
+int check_daemon_peer(int fd, gid_t nm_gid, uid_t *peer_uid) {
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    fprintf(LOGFILE, "Can't get the daemon peer's credentials - %s\n",
+            strerror(errno));
+    return 0;
+  }
+  *peer_uid = cred.uid;
+  if (cred.uid == 0 || cred.gid == nm_gid) {
+    return 1;
+  }
+  struct passwd *pw = getpwuid(cred.uid);
+  if (pw == NULL) {
+    fprintf(LOGFILE, "Daemon peer %d is not a known user\n", cred.uid);
+    return 0;
+  }
+  gid_t groups[MAX_PEER_GROUPS];
+  int ngroups = MAX_PEER_GROUPS;
+  if (getgrouplist(pw->pw_name, pw->pw_gid, groups, &ngroups) < 0) {
+    ngroups = MAX_PEER_GROUPS;
+  }
+  int i;
+  for (i = 0; i < ngroups; i++) {
+    if (groups[i] == nm_gid) {
+      return 1;
+    }
+  }
+  fprintf(LOGFILE, "Daemon peer %s is not in the node manager group\n",
+          pw->pw_name);
+  return 0;
+}
+
+/**
+ * Run a request in a forked process, passing its output back in frames,
+ * then its exit code.
+ */
+static void serve_request(int conn, gid_t nm_gid, daemon_command command) {
+  uid_t peer_uid = -1;
+  if (!check_daemon_peer(conn, nm_gid, &peer_uid)) {
+    write_exit_frame(conn, DAEMON_PEER_NOT_ALLOWED);
+    return;
+  }
+  int argc = 0;
+  char **argv = read_daemon_request(conn, "container-executor", &argc);
+  if (argv == NULL) {
+    write_exit_frame(conn, INVALID_ARGUMENT_NUMBER);
+    return;
+  }
+  int out[2], err[2];
+  if (pipe(out) != 0 || pipe(err) != 0) {
+    fprintf(LOGFILE, "Failed to create pipes - %s\n", strerror(errno));
+    write_exit_frame(conn, DAEMON_REQUEST_FAILED);
+    return;
+  }
+  fflush(LOGFILE);
+  fflush(ERRORFILE);
+  pid_t child = fork();
+  if (child == -1) {
+    fprintf(LOGFILE, "Failed to fork - %s\n", strerror(errno));
+    write_exit_frame(conn, DAEMON_REQUEST_FAILED);
+    return;
+  }
+  if (child == 0) {
+    // as a fresh invocation by the peer would be
+    close(conn);
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    close(out[0]);
+    close(out[1]);
+    close(err[0]);
+    close(err[1]);
+    set_nm_uid(peer_uid, nm_gid);
+    optind = 1;
+    exit(command(argc, argv));
+  }
+  close(out[1]);
+  close(err[1]);
+  free_values(argv);
+  // pass the output on until the command and anything it left running
+  // have closed it; if the client has gone, keep reading so that they
+  // don't block
+  struct pollfd fds[2];
+  fds[0].fd = out[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = err[0];
+  fds[1].events = POLLIN;
+  int open_fds = 2;
+  int client_ok = 1;
+  char buffer[4096];
+  while (open_fds > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    int i;
+    for (i = 0; i < 2; i++) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        open_fds--;
+      } else if (client_ok && write_frame(conn, i == 0 ? DAEMON_FRAME_STDOUT
+                                          : DAEMON_FRAME_STDERR,
+                                          buffer, n) != 0) {
+        client_ok = 0;
+      }
+    }
+  }
+  int status = 0;
+  while (waitpid(child, &status, 0) < 0) {
+    if (errno != EINTR) {
+      status = DAEMON_REQUEST_FAILED << 8;
+      break;
+    }
+  }
+  // the exit code a shell would report
+  int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) :
+    WIFSIGNALED(status) ? 128 + WTERMSIG(status) : DAEMON_REQUEST_FAILED;
+  if (client_ok) {
+    write_exit_frame(conn, exit_code);
+  }
+}
+
+/**
+ * Create the socket: root and the node manager group may connect.
+ */
+static int open_daemon_socket(const char *path, gid_t nm_gid) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(ERRORFILE, "Daemon socket path %s is too long\n", path);
+    return -1;
+  }
+  // the directory must be as safe as the configuration's, so that no one
+  // else can put their own socket in its place
+  char *dir_copy = strdup(path);
+  if (dir_copy == NULL) {
+    return -1;
+  }
+  int dir_ok = check_configuration_permissions(dirname(dir_copy));
+  free(dir_copy);
+  if (dir_ok != 0) {
+    return -1;
+  }
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(ERRORFILE, "%s exists and is not a socket\n", path);
+      return -1;
+    }
+    unlink(path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(ERRORFILE, "Can't create daemon socket - %s\n", strerror(errno));
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  // no one may connect until the socket has its owner and mode
+  mode_t old_umask = umask(0077);
+  int bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+  umask(old_umask);
+  if (bound != 0 || chown(path, 0, nm_gid) != 0 ||
+      chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) != 0 ||
+      listen(fd, 128) != 0) {
+    fprintf(ERRORFILE, "Can't set up daemon socket %s - %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int run_daemon(const char *conf_file, gid_t nm_gid, daemon_command command) {
+  char *socket_path = get_value(DAEMON_SOCKET_KEY);
+  if (socket_path == NULL) {
+    fprintf(ERRORFILE, "Can't get configured value for %s.\n",
+            DAEMON_SOCKET_KEY);
+    return INVALID_CONFIG_FILE;
+  }
+  int listen_fd = open_daemon_socket(socket_path, nm_gid);
+  if (listen_fd < 0) {
+    free(socket_path);
+    return DAEMON_SOCKET_FAILED;
+  }
+  struct stat conf_stat;
+  if (stat(conf_file, &conf_stat) != 0) {
+    fprintf(ERRORFILE, "Can't stat file %s - %s\n", conf_file,
+            strerror(errno));
+    goto fail;
+  }
+  // the request handlers are reaped by the kernel
+  signal(SIGCHLD, SIG_IGN);
+  fprintf(LOGFILE, "Serving requests on %s\n", socket_path);
+  fflush(LOGFILE);
+  free(socket_path);
+  while (1) {
+    int conn = accept(listen_fd, NULL, NULL);
+    if (conn < 0) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        fprintf(LOGFILE, "Failed to accept a connection - %s\n",
+                strerror(errno));
+        fflush(LOGFILE);
+      }
+      continue;
+    }
+    // the checks made before each command line run, made again per
+    // request; a configuration that has changed is read again, and one
+    // that has become invalid stops the daemon as it would the command
+    struct stat now;
+    if (check_configuration_permissions(conf_file) != 0 ||
+        stat(conf_file, &now) != 0) {
+      write_exit_frame(conn, INVALID_CONFIG_FILE);
+      close(conn);
+      continue;
+    }
+    if (now.st_ino != conf_stat.st_ino || now.st_dev != conf_stat.st_dev ||
+        now.st_mtime != conf_stat.st_mtime ||
+        now.st_size != conf_stat.st_size) {
+      free_configurations();
+      read_config(conf_file);
+      conf_stat = now;
+      // the socket and the process are set up for the group it started with
+      char *nm_group = get_value(NM_GROUP_KEY);
+      struct group *group_info = nm_group == NULL ? NULL : getgrnam(nm_group);
+      free(nm_group);
+      if (group_info == NULL || group_info->gr_gid != nm_gid) {
+        fprintf(ERRORFILE, "The node manager group has changed in %s; the"
+                " daemon must be restarted.\n", conf_file);
+        exit(INVALID_CONFIG_FILE);
+      }
+      fprintf(LOGFILE, "Re-read configuration file %s\n", conf_file);
+      fflush(LOGFILE);
+    }
+    fflush(LOGFILE);
+    fflush(ERRORFILE);
+    pid_t handler = fork();
+    if (handler == 0) {
+      close(listen_fd);
+      signal(SIGCHLD, SIG_DFL);
+      serve_request(conn, nm_gid, command);
+      close(conn);
+      _exit(0);
+    }
+    if (handler == -1) {
+      fprintf(LOGFILE, "Failed to fork - %s\n", strerror(errno));
+      fflush(LOGFILE);
+      write_exit_frame(conn, DAEMON_REQUEST_FAILED);
+    }
+    close(conn);
+  }
+  return 0;
+
+ fail:
+  close(listen_fd);
+  unlink(socket_path);
+  free(socket_path);
+  return INVALID_CONFIG_FILE;
+}
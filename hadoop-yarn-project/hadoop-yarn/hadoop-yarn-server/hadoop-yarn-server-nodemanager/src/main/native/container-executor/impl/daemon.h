@@ -0,0 +1,80 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+
+#define DAEMON_SOCKET_KEY "daemon.socket.path"
+
+// the most arguments, and argument bytes, a request may carry
+#define DAEMON_MAX_ARGS 1024
+#define DAEMON_MAX_REQUEST_BYTES (1024 * 1024)
+
+// the kinds of frame in a response
+enum daemon_frame {
+  DAEMON_FRAME_STDOUT = 1,
+  DAEMON_FRAME_STDERR = 2,
+  DAEMON_FRAME_EXIT = 3
+};
+
+/**
+ * Runs the arguments of a request in the same way as the command line, and
+ * returns the exit code; argv[0] is the program name.
+ */
+typedef int (*daemon_command)(int argc, char **argv);
+
+/**
+ * Serve requests on a Unix socket until killed, instead of being exec'ed
+ * once per operation. The socket is owned by root and the node manager
+ * group with mode 0660, in a directory that only root can write.
+ *
+ * A request is one connection. The client sends the arguments it would
+ * have passed after the program name - user, command and command args - as
+ * a 32 bit count followed by each argument as a 32 bit length and its
+ * bytes, all in network order. The daemon answers with frames of a type
+ * byte, a 32 bit length and data: the command's standard output and error
+ * as they are written, then its exit code. The connection stays open as
+ * long as the command runs, which for a launch is the life of the
+ * container.
+ *
+ * Each request is checked as a fresh invocation would be: the peer must be
+ * root or in the node manager group, the configuration's permissions are
+ * checked again and it is re-read if it has changed, and the command runs
+ * in a forked process that does the user checks and changes user as
+ * before. A request refused on the daemon's checks is answered with its
+ * exit code before the request is read.
+ * @param conf_file the resolved configuration file
+ * @param nm_gid the node manager group
+ * @param command runs one request in the forked process
+ * @return an errorcode enum value if the socket can't be set up
+ */
+int run_daemon(const char *conf_file, gid_t nm_gid, daemon_command command);
+
+/**
+ * Read a request from a connection.
+ * @param argc set to the number of arguments, counting a program name
+ *   that is put in front of them
+ * @return the arguments, NULL terminated and freed with free_values, or
+ *   NULL if the request is malformed
+ */
+char **read_daemon_request(int fd, const char *program, int *argc);
+
+/**
+ * Is the connected peer allowed to make requests: root, or a user in the
+ * node manager group? Sets peer_uid to its uid.
+ */
+int check_daemon_peer(int fd, gid_t nm_gid, uid_t *peer_uid);
@@ -19,6 +19,7 @@
 #include "config.h"
 #include "configuration.h"
 #include "container-executor.h"
+#include "daemon.h"
 
 #include <errno.h>
 #include <grp.h>
@@ -45,6 +46,8 @@
 void display_usage(FILE *stream) {
   fprintf(stream,
           "Usage: container-executor --checksetup\n");
+  fprintf(stream,
+          "Usage: container-executor --daemon\n");
   fprintf(stream,
       "Usage: container-executor user command command-args\n");
   fprintf(stream, "Commands:\n");
@@ -52,40 +55,39 @@ void display_usage(FILE *stream) {
    "nm-local-dirs nm-log-dirs cmd app...\n", INITIALIZE_CONTAINER);
   fprintf(stream,
       "   launch container:    %2d appid containerid workdir "\
-      "container-script tokens pidfile nm-local-dirs nm-log-dirs\n",
+      "container-script tokens pidfile nm-local-dirs nm-log-dirs "\
+      "[cpu-shares blkio-weight]\n",
 	  LAUNCH_CONTAINER);
   fprintf(stream, "   signal container:    %2d container-pid signal\n",
 	  SIGNAL_CONTAINER);
   fprintf(stream, "   delete as user: %2d relative-path\n",
 	  DELETE_AS_USER);
+  fprintf(stream, "   signal containers:   %2d signal container-pid|"\
+      CGROUP_TARGET_PREFIX "containerid...\n", SIGNAL_CONTAINERS);
 }
 
-int main(int argc, char **argv) {
-  int invalid_args = 0; 
-  int do_check_setup = 0;
-  
-  LOGFILE = stdout;
-  ERRORFILE = stderr;
-
-  // Minimum number of arguments required to run 
-  // the std. container-executor commands is 4
-  // 4 args not needed for checksetup option
-  if (argc < 4) {
-    invalid_args = 1;
-    if (argc == 2) {
-      const char *arg1 = argv[1];
-      if (strcmp("--checksetup", arg1) == 0) {
-        invalid_args = 0;
-        do_check_setup = 1;        
-      }      
-    }
-  }
-  
-  if (invalid_args != 0) {
-    display_usage(stdout);
-    return INVALID_ARGUMENT_NUMBER;
+/**
+ * Parse a cgroup share or weight from the command line; 0 means the
+ * controller's default.
+ */
+static int parse_share(const char *str, const char *name, int *share) {
+  char *end_ptr = NULL;
+  long value = strtol(str, &end_ptr, 10);
+  if (str == end_ptr || *end_ptr != '\0' || value < 0 || value > INT_MAX) {
+    fprintf(ERRORFILE, "Invalid %s %s\n", name, str);
+    fflush(ERRORFILE);
+    return -1;
   }
+  *share = value;
+  return 0;
+}
 
+/**
+ * Run a command given as on the command line: user, command and command
+ * args follow the program name. The command line and the daemon's
+ * requests both come here, after the setup checks.
+ */
+static int run_command(int argc, char **argv) {
   int command;
   const char * app_id = NULL;
   const char * container_id = NULL;
@@ -93,56 +95,18 @@ int main(int argc, char **argv) {
   const char * script_file = NULL;
   const char * current_dir = NULL;
   const char * pid_file = NULL;
+  int cpu_shares = 0;
+  int blkio_weight = 0;
 
   int exit_code = 0;
 
   char * dir_to_be_deleted = NULL;
-
-  char *executable_file = get_executable();
-
-  char *orig_conf_file = HADOOP_CONF_DIR "/" CONF_FILENAME;
-  char *conf_file = resolve_config_path(orig_conf_file, argv[0]);
   char *local_dirs, *log_dirs;
 
-  if (conf_file == NULL) {
-    fprintf(ERRORFILE, "Configuration file %s not found.\n", orig_conf_file);
-    exit(INVALID_CONFIG_FILE);
-  }
-  if (check_configuration_permissions(conf_file) != 0) {
-    exit(INVALID_CONFIG_FILE);
-  }
-  read_config(conf_file);
-  free(conf_file);
-
-  // look up the node manager group in the config file
-  char *nm_group = get_value(NM_GROUP_KEY);
-  if (nm_group == NULL) {
-    fprintf(ERRORFILE, "Can't get configured value for %s.\n", NM_GROUP_KEY);
-    exit(INVALID_CONFIG_FILE);
-  }
-  struct group *group_info = getgrnam(nm_group);
-  if (group_info == NULL) {
-    fprintf(ERRORFILE, "Can't get group information for %s - %s.\n", nm_group,
-            strerror(errno));
-    fflush(LOGFILE);
-    exit(INVALID_CONFIG_FILE);
-  }
-  set_nm_uid(getuid(), group_info->gr_gid);
-  // if we are running from a setuid executable, make the real uid root
-  setuid(0);
-  // set the real and effective group id to the node manager group
-  setgid(group_info->gr_gid);
-
-  if (check_executor_permissions(executable_file) != 0) {
-    fprintf(ERRORFILE, "Invalid permissions on container-executor binary.\n");
-    return INVALID_CONTAINER_EXEC_PERMISSIONS;
-  }
-
-  if (do_check_setup != 0) {
-    // basic setup checks done
-    // verified configs available and valid
-    // verified executor permissions
-    return 0;
+  if (argc < 4) {
+    fprintf(ERRORFILE, "Too few arguments (%d vs 4)\n", argc);
+    fflush(ERRORFILE);
+    return INVALID_ARGUMENT_NUMBER;
   }
 
   //checks done for user name
@@ -151,10 +115,12 @@ int main(int argc, char **argv) {
     return INVALID_USER_NAME;
   }
 
+  start_phase_timing();
   int ret = set_user(argv[optind]);
   if (ret != 0) {
     return ret;
   }
+  end_phase("check_user");
  
   optind = optind + 1;
   command = atoi(argv[optind++]);
@@ -180,9 +146,9 @@ int main(int argc, char **argv) {
                                extract_values(log_dirs), argv + optind);
     break;
   case LAUNCH_CONTAINER:
-    if (argc != 11) {
-      fprintf(ERRORFILE, "Too few arguments (%d vs 11) for launch container\n",
-	      argc);
+    if (argc != 11 && argc != 13) {
+      fprintf(ERRORFILE, "Wrong number of arguments (%d vs 11 or 13) for " \
+	      "launch container\n", argc);
       fflush(ERRORFILE);
       return INVALID_ARGUMENT_NUMBER;
     }
@@ -194,10 +160,16 @@ int main(int argc, char **argv) {
     pid_file = argv[optind++];
     local_dirs = argv[optind++];// good local dirs as a comma separated list
     log_dirs = argv[optind++];// good log dirs as a comma separated list
+    if (argc == 13) {
+      if (parse_share(argv[optind++], "cpu shares", &cpu_shares) != 0 ||
+          parse_share(argv[optind++], "blkio weight", &blkio_weight) != 0) {
+        return INVALID_ARGUMENT_NUMBER;
+      }
+    }
     exit_code = launch_container_as_user(user_detail->pw_name, app_id,
                     container_id, current_dir, script_file, cred_file,
                     pid_file, extract_values(local_dirs),
-                    extract_values(log_dirs));
+                    extract_values(log_dirs), cpu_shares, blkio_weight);
     break;
   case SIGNAL_CONTAINER:
     if (argc != 5) {
@@ -224,6 +196,25 @@ int main(int argc, char **argv) {
       exit_code = signal_container_as_user(user_detail->pw_name, container_pid, signal);
     }
     break;
+  case SIGNAL_CONTAINERS:
+    if (argc < 5) {
+      fprintf(ERRORFILE, "Too few arguments (%d vs 5) for " \
+          "signal containers\n", argc);
+      fflush(ERRORFILE);
+      return INVALID_ARGUMENT_NUMBER;
+    } else {
+      char* end_ptr = NULL;
+      char* option = argv[optind++];
+      int signal = strtol(option, &end_ptr, 10);
+      if (option == end_ptr || *end_ptr != '\0') {
+        fprintf(ERRORFILE, "Illegal argument for signal %s\n", option);
+        fflush(ERRORFILE);
+        return INVALID_ARGUMENT_NUMBER;
+      }
+      exit_code = signal_containers_as_user(user_detail->pw_name,
+                                            argv + optind, signal);
+    }
+    break;
   case DELETE_AS_USER:
     dir_to_be_deleted = argv[optind++];
     exit_code= delete_as_user(user_detail->pw_name, dir_to_be_deleted,
@@ -234,6 +225,97 @@ int main(int argc, char **argv) {
     fflush(ERRORFILE);
     exit_code = INVALID_COMMAND_PROVIDED;
   }
+  return exit_code;
+}
+
+int main(int argc, char **argv) {
+  int invalid_args = 0; 
+  int do_check_setup = 0;
+  int do_daemon = 0;
+  
+  LOGFILE = stdout;
+  ERRORFILE = stderr;
+
+  // Minimum number of arguments required to run 
+  // the std. container-executor commands is 4
+  // 4 args not needed for checksetup option
+  if (argc < 4) {
+    invalid_args = 1;
+    if (argc == 2) {
+      const char *arg1 = argv[1];
+      if (strcmp("--checksetup", arg1) == 0) {
+        invalid_args = 0;
+        do_check_setup = 1;        
+      } else if (strcmp("--daemon", arg1) == 0) {
+        invalid_args = 0;
+        do_daemon = 1;
+      }
+    }
+  }
+  
+  if (invalid_args != 0) {
+    display_usage(stdout);
+    return INVALID_ARGUMENT_NUMBER;
+  }
+
+  char *executable_file = get_executable();
+
+  char *orig_conf_file = HADOOP_CONF_DIR "/" CONF_FILENAME;
+  char *conf_file = resolve_config_path(orig_conf_file, argv[0]);
+
+  if (conf_file == NULL) {
+    fprintf(ERRORFILE, "Configuration file %s not found.\n", orig_conf_file);
+    exit(INVALID_CONFIG_FILE);
+  }
+  if (check_configuration_permissions(conf_file) != 0) {
+    exit(INVALID_CONFIG_FILE);
+  }
+  read_config(conf_file);
+
+  // look up the node manager group in the config file
+  char *nm_group = get_value(NM_GROUP_KEY);
+  if (nm_group == NULL) {
+    fprintf(ERRORFILE, "Can't get configured value for %s.\n", NM_GROUP_KEY);
+    exit(INVALID_CONFIG_FILE);
+  }
+  struct group *group_info = getgrnam(nm_group);
+  if (group_info == NULL) {
+    fprintf(ERRORFILE, "Can't get group information for %s - %s.\n", nm_group,
+            strerror(errno));
+    fflush(LOGFILE);
+    exit(INVALID_CONFIG_FILE);
+  }
+  uid_t invoking_uid = getuid();
+  set_nm_uid(invoking_uid, group_info->gr_gid);
+  // if we are running from a setuid executable, make the real uid root
+  setuid(0);
+  // set the real and effective group id to the node manager group
+  setgid(group_info->gr_gid);
+
+  if (check_executor_permissions(executable_file) != 0) {
+    fprintf(ERRORFILE, "Invalid permissions on container-executor binary.\n");
+    return INVALID_CONTAINER_EXEC_PERMISSIONS;
+  }
+
+  if (do_check_setup != 0) {
+    // basic setup checks done
+    // verified configs available and valid
+    // verified executor permissions
+    return 0;
+  }
+
+  if (do_daemon != 0) {
+    // the daemon runs commands for anyone in the node manager group, so
+    // only root may start it
+    if (invoking_uid != 0) {
+      fprintf(ERRORFILE, "The daemon must be started by root.\n");
+      return INVALID_USER_NAME;
+    }
+    return run_daemon(conf_file, group_info->gr_gid, run_command);
+  }
+  free(conf_file);
+
+  int exit_code = run_command(argc, argv);
   fclose(LOGFILE);
   fclose(ERRORFILE);
   return exit_code;
@@ -17,6 +17,7 @@
  */
 #include "configuration.h"
 #include "container-executor.h"
+#include "daemon.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -25,6 +26,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
@@ -196,6 +199,59 @@ void test_check_user() {
   }
 }
 
+static void write_request_arg(int fd, const char *arg, uint32_t len) {
+  uint32_t net_len = htonl(len);
+  if (write(fd, &net_len, 4) != 4 || write(fd, arg, len) != len) {
+    printf("FAIL: failed to write request - %s\n", strerror(errno));
+    exit(1);
+  }
+}
+
+void test_daemon_request() {
+  printf("\nTesting daemon requests\n");
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    printf("FAIL: failed to create a socket pair - %s\n", strerror(errno));
+    exit(1);
+  }
+  uint32_t count = htonl(3);
+  if (write(fds[0], &count, 4) != 4) {
+    printf("FAIL: failed to write request - %s\n", strerror(errno));
+    exit(1);
+  }
+  write_request_arg(fds[0], username, strlen(username));
+  write_request_arg(fds[0], "3", 1);
+  write_request_arg(fds[0], "", 0);
+  int argc = 0;
+  char **argv = read_daemon_request(fds[1], "container-executor", &argc);
+  if (argv == NULL || argc != 4 || strcmp(argv[0], "container-executor") != 0
+      || strcmp(argv[1], username) != 0 || strcmp(argv[2], "3") != 0
+      || strcmp(argv[3], "") != 0 || argv[4] != NULL) {
+    printf("FAIL: failed to read a daemon request\n");
+    exit(1);
+  }
+  free_values(argv);
+
+  // an argument may not hide a NUL
+  if (write(fds[0], &count, 4) != 4) {
+    printf("FAIL: failed to write request - %s\n", strerror(errno));
+    exit(1);
+  }
+  write_request_arg(fds[0], "a\0b", 3);
+  if (read_daemon_request(fds[1], "container-executor", &argc) != NULL) {
+    printf("FAIL: read a daemon request with a NUL in it\n");
+    exit(1);
+  }
+
+  uid_t peer = -1;
+  if (!check_daemon_peer(fds[1], getegid(), &peer) || peer != getuid()) {
+    printf("FAIL: failed to allow a peer in the node manager group\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
 void test_resolve_config_path() {
   printf("\nTesting resolve_config_path\n");
   if (strcmp(resolve_config_path("/etc/passwd", NULL), "/etc/passwd") != 0) {
@@ -286,6 +342,102 @@ void test_delete_container() {
   free(dont_touch);
 }
 
+void test_delete_multiple_dirs() {
+  printf("\nTesting delete from multiple base dirs\n");
+  char buffer[100000];
+  int i;
+  for (i = 1; i <= 3; ++i) {
+    sprintf(buffer, "mkdir -p %s/del-%d/victim/a/b/c", TEST_ROOT, i);
+    run(buffer);
+    sprintf(buffer, "touch %s/del-%d/victim/a/f1 %s/del-%d/victim/a/b/f2",
+            TEST_ROOT, i, TEST_ROOT, i);
+    run(buffer);
+    sprintf(buffer, "ln -s /etc/passwd %s/del-%d/victim/a/link", TEST_ROOT, i);
+    run(buffer);
+    sprintf(buffer, "chmod 500 %s/del-%d/victim/a/b", TEST_ROOT, i);
+    run(buffer);
+  }
+  // the victim is missing from one of the dirs
+  run("mkdir -p " TEST_ROOT "/del-4");
+  char *dirs[] = {TEST_ROOT "/del-1", TEST_ROOT "/del-4", TEST_ROOT "/del-2",
+                  TEST_ROOT "/del-3", 0};
+  int ret = delete_as_user(username, "victim", dirs);
+  if (ret != 0) {
+    printf("FAIL: return code from delete_as_user is %d\n", ret);
+    exit(1);
+  }
+  for (i = 1; i <= 3; ++i) {
+    sprintf(buffer, "%s/del-%d/victim", TEST_ROOT, i);
+    if (access(buffer, F_OK) == 0) {
+      printf("FAIL: failed to delete the directory - %s\n", buffer);
+      exit(1);
+    }
+    sprintf(buffer, "%s/del-%d", TEST_ROOT, i);
+    if (access(buffer, F_OK) != 0) {
+      printf("FAIL: accidently deleted the directory - %s\n", buffer);
+      exit(1);
+    }
+  }
+  if (access("/etc/passwd", F_OK) != 0) {
+    printf("FAIL: followed a symlink out of the directory\n");
+    exit(1);
+  }
+  run("rm -fr " TEST_ROOT "/del-1 " TEST_ROOT "/del-2 " TEST_ROOT "/del-3 "
+      TEST_ROOT "/del-4");
+}
+
+void test_delete_to_trash() {
+  printf("\nTesting delete through the trash\n");
+  char buffer[100000];
+  FILE *file = fopen(TEST_ROOT "/trash.cfg", "w");
+  if (file == NULL) {
+    printf("FAIL: Failed to open %s.\n", TEST_ROOT "/trash.cfg");
+    exit(1);
+  }
+  fprintf(file, "delete.use.trash=true\n");
+  fclose(file);
+  free_configurations();
+  read_config(TEST_ROOT "/trash.cfg");
+
+  int i;
+  for (i = 1; i <= 2; ++i) {
+    sprintf(buffer, "mkdir -p %s/trash-%d/victim/a/b", TEST_ROOT, i);
+    run(buffer);
+    sprintf(buffer, "touch %s/trash-%d/victim/a/b/f", TEST_ROOT, i);
+    run(buffer);
+  }
+  char *dirs[] = {TEST_ROOT "/trash-1", TEST_ROOT "/trash-2", 0};
+  int ret = delete_as_user(username, "victim", dirs);
+  if (ret != 0) {
+    printf("FAIL: return code from delete_as_user is %d\n", ret);
+    exit(1);
+  }
+  for (i = 1; i <= 2; ++i) {
+    sprintf(buffer, "%s/trash-%d/victim", TEST_ROOT, i);
+    if (access(buffer, F_OK) == 0) {
+      printf("FAIL: failed to move the directory - %s\n", buffer);
+      exit(1);
+    }
+  }
+  // the reaper runs in the background, give it a while
+  int tries;
+  for (tries = 0; tries < 100; ++tries) {
+    if (access(TEST_ROOT "/trash-1/" TRASH_DIR, F_OK) != 0 &&
+        access(TEST_ROOT "/trash-2/" TRASH_DIR, F_OK) != 0) {
+      break;
+    }
+    usleep(100000);
+  }
+  if (tries == 100) {
+    printf("FAIL: the trash was never emptied\n");
+    exit(1);
+  }
+  run("rm -fr " TEST_ROOT "/trash-1 " TEST_ROOT "/trash-2 "
+      TEST_ROOT "/trash.cfg");
+  free_configurations();
+  read_config(TEST_ROOT "/test.cfg");
+}
+
 void test_delete_app() {
   char* app_dir = get_app_directory(TEST_ROOT "/local-2", username, "app_2");
   char* dont_touch = get_app_directory(TEST_ROOT "/local-2", username, 
@@ -435,6 +587,50 @@ void test_signal_container() {
   }
 }
 
+void test_signal_containers() {
+  printf("\nTesting signal_containers\n");
+  fflush(stdout);
+  fflush(stderr);
+  pid_t children[3];
+  char pids[3][20];
+  int i;
+  for (i = 0; i < 3; ++i) {
+    children[i] = fork();
+    if (children[i] == -1) {
+      printf("FAIL: fork failed\n");
+      exit(1);
+    } else if (children[i] == 0) {
+      if (change_user(user_detail->pw_uid, user_detail->pw_gid) != 0) {
+        exit(1);
+      }
+      sleep(3600);
+      exit(0);
+    }
+    sprintf(pids[i], "%d", children[i]);
+  }
+  // give them time to become the user
+  sleep(1);
+  // one of them is already gone, which shows only in its own result
+  char *targets[] = {pids[0], pids[1], "999999", pids[2], 0};
+  int ret = signal_containers_as_user(username, targets, SIGKILL);
+  if (ret != INVALID_CONTAINER_PID) {
+    printf("FAIL: signal_containers returned %d instead of %d\n", ret,
+           INVALID_CONTAINER_PID);
+    exit(1);
+  }
+  for (i = 0; i < 3; ++i) {
+    int status = 0;
+    if (waitpid(children[i], &status, 0) == -1) {
+      printf("FAIL: waitpid failed - %s\n", strerror(errno));
+      exit(1);
+    }
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
+      printf("FAIL: child %d wasn't killed - %d\n", children[i], status);
+      exit(1);
+    }
+  }
+}
+
 void test_signal_container_group() {
   printf("\nTesting group signal_container\n");
   fflush(stdout);
@@ -612,7 +808,7 @@ void test_run_container() {
   } else if (child == 0) {
     if (launch_container_as_user(username, "app_4", "container_1", 
           container_dir, script_name, TEST_ROOT "/creds.txt", pid_file,
-          extract_values(local_dirs), extract_values(log_dirs)) != 0) {
+          extract_values(local_dirs), extract_values(log_dirs), 0, 0) != 0) {
       printf("FAIL: failed in child\n");
       exit(42);
     }
@@ -742,12 +938,19 @@ int main(int argc, char **argv) {
 
   test_delete_user();
 
+  test_delete_multiple_dirs();
+
+  test_delete_to_trash();
+
   test_check_user();
 
+  test_daemon_request();
+
   // the tests that change user need to be run in a subshell, so that
   // when they change user they don't give up our privs
   run_test_in_child("test_signal_container", test_signal_container);
   run_test_in_child("test_signal_container_group", test_signal_container_group);
+  run_test_in_child("test_signal_containers", test_signal_containers);
 
   // init app and run container can't be run if you aren't testing as root
   if (getuid() == 0) {